@@ -32,13 +32,30 @@ void main(){
 }
 )END";
 
+/* UYVY frames are uploaded as RGBA texture of half width (U Y0 V Y1 in each
+ * texel) and converted to RGB here (BT.709, limited range), so neither UG
+ * nor the GUI need to convert them on the CPU.
+ */
 static const char *frag_src = R"END(
 #version 330 core
 in vec2 UV;
 out vec3 color;
 uniform sampler2D tex;
+uniform bool uyvy;
 void main(){
-	color = texture(tex, UV).rgb;
+	if(!uyvy){
+		color = texture(tex, UV).rgb;
+		return;
+	}
+	ivec2 size = textureSize(tex, 0);
+	ivec2 px = clamp(ivec2(UV * vec2(size.x * 2, size.y)), ivec2(0), ivec2(size.x * 2 - 1, size.y - 1));
+	vec4 macropixel = texelFetch(tex, ivec2(px.x / 2, px.y), 0);
+	float y = 1.164 * (((px.x & 1) == 0 ? macropixel.g : macropixel.a) - 16.0 / 255.0);
+	float cb = macropixel.r - 0.5;
+	float cr = macropixel.b - 0.5;
+	color = clamp(vec3(y + 1.793 * cr,
+				y - 0.213 * cb - 0.533 * cr,
+				y + 2.112 * cb), 0.0, 1.0);
 }
 )END";
 
@@ -222,13 +239,37 @@ bool PreviewWidget::loadFrame(){
 		if(!ipc_frame_reader_read(ipc_frame_reader.get(), ipc_frame.get()))
 			return false;
 
-		assert(ipc_frame->header.color_spec == IPC_FRAME_COLOR_RGB);
+		const auto& hdr = ipc_frame->header;
+		GLenum format = GL_RGB;
+		int texW = hdr.width;
+		switch(hdr.color_spec){
+		case IPC_FRAME_COLOR_RGB:
+			break;
+		case IPC_FRAME_COLOR_RGBA:
+			format = GL_RGBA;
+			break;
+		case IPC_FRAME_COLOR_UYVY:
+			format = GL_RGBA;
+			texW = (hdr.width + 1) / 2;
+			break;
+		default:
+			return false;
+		}
+
 		selected_texture = frame_texture;
+		frameIsUyvy = hdr.color_spec == IPC_FRAME_COLOR_UYVY;
 		f->glBindTexture(GL_TEXTURE_2D, frame_texture);
-		f->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB,
-				ipc_frame->header.width, ipc_frame->header.height,
-				0, GL_RGB, GL_UNSIGNED_BYTE, ipc_frame->data);
-		setVidSize(ipc_frame->header.width, ipc_frame->header.height);
+		if(texW != frameTexW || hdr.height != frameTexH || format != frameTexFormat){
+			f->glTexImage2D(GL_TEXTURE_2D, 0, format, texW, hdr.height,
+					0, format, GL_UNSIGNED_BYTE, ipc_frame->data);
+			frameTexW = texW;
+			frameTexH = hdr.height;
+			frameTexFormat = format;
+		} else {
+			f->glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, texW, hdr.height,
+					format, GL_UNSIGNED_BYTE, ipc_frame->data);
+		}
+		setVidSize(hdr.width, hdr.height);
 	}
 
 	return true;
@@ -246,6 +287,8 @@ void PreviewWidget::render(){
 	GLuint loc;
 	loc = f->glGetUniformLocation(program, "scale_vec");
 	f->glUniform2fv(loc, 1, scaleVec);
+	loc = f->glGetUniformLocation(program, "uyvy");
+	f->glUniform1i(loc, selected_texture == frame_texture && frameIsUyvy);
 
 	f->glDrawArrays(GL_TRIANGLES, 0, 6);
 
@@ -36,6 +36,11 @@ private:
 
 	GLuint selected_texture = 0;
 
+	int frameTexW = 0; ///< frame_texture storage is reused while these match
+	int frameTexH = 0;
+	GLenum frameTexFormat = 0;
+	bool frameIsUyvy = false;
+
 	QOpenGLVertexArrayObject vao;
 
 	GLfloat scaleVec[2];
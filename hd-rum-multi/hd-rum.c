@@ -1,65 +1,173 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <stdatomic.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/socket.h>
-#include <sys/select.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
 #include <arpa/inet.h>
 #include <netdb.h>
-#define __USE_GNU 1
 #include <pthread.h>
-#include <fcntl.h>
 #include <sched.h>
 
 
 #define SIZE    10000
+#define BATCH   64      /* packets received/sent by one syscall */
+#define SPIN    2000    /* empty/full ring checks before going to sleep */
+#define MAX_MSGS 1024   /* sendmmsg() limit (UIO_MAXIOV) */
 
 struct replica {
     const char *host;
     unsigned short port;
-    int sock;
+    struct sockaddr_storage addr;
+    socklen_t addrlen;
 };
 
-
+/*
+ * Packets are stored in a ring written by the receiving thread only and read
+ * by all shard threads, each of which has its own read position. A slot may
+ * be reused when all shards have passed it, so the packet is never copied.
+ * Positions are monotonic counters, slot index is position % qsize.
+ */
 struct item {
-    struct item *next;
     long size;
     char buf[SIZE];
 };
 
+/*
+ * A shard sends every packet to its subset of replicas. Threads sleep on the
+ * condition variable only after spinning, the other side signals only if
+ * somebody sleeps (waiters), so there are no syscalls on the fast path.
+ */
+struct shard {
+    pthread_t thread;
+    int first;                  /* index of the first replica */
+    int count;                  /* number of replicas */
+    int sock;
+    int cpu;                    /* -1 - not pinned */
+    _Atomic unsigned long tail; /* read position */
+    unsigned long long sent;
+    struct mmsghdr msgs[MAX_MSGS];
+    struct iovec iovs[MAX_MSGS];
+};
+
 static struct item *queue;
-static struct item *qhead;
-static struct item *qtail;
-static int qempty = 1;
-static int qfull = 0;
-static pthread_mutex_t qempty_mtx = PTHREAD_MUTEX_INITIALIZER;
-static pthread_mutex_t qfull_mtx = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t qempty_cond = PTHREAD_COND_INITIALIZER;
-static pthread_cond_t qfull_cond = PTHREAD_COND_INITIALIZER;
+static unsigned long qsize;
+static _Atomic unsigned long qhead;     /* write position */
+
+static pthread_mutex_t wait_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t data_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t space_cond = PTHREAD_COND_INITIALIZER;
+static _Atomic int data_waiters;
+static _Atomic int space_waiters;
 
 struct replica *replicas;
 int count;
+static struct shard *shards;
+static int shard_count = 1;
+
+#ifndef __linux__
+/* portable fallbacks of the batched calls - one syscall per packet */
+struct mmsghdr {
+    struct msghdr msg_hdr;
+    unsigned int msg_len;
+};
+
+#define MSG_WAITFORONE 0
 
-void qinit(int qsize)
+static int recvmmsg(int sock, struct mmsghdr *msgs, unsigned int vlen,
+                    int flags, struct timespec *timeout)
 {
-    int i;
+    (void) flags, (void) timeout;
+    ssize_t ret = recvmsg(sock, &msgs[0].msg_hdr, 0);
+    if (ret < 0)
+        return -1;
+    msgs[0].msg_len = ret;
+    (void) vlen;
+    return 1;
+}
+
+static int sendmmsg(int sock, struct mmsghdr *msgs, unsigned int vlen,
+                    int flags)
+{
+    unsigned int i;
+
+    for (i = 0; i < vlen; i++) {
+        ssize_t ret = sendmsg(sock, &msgs[i].msg_hdr, flags);
+        if (ret < 0)
+            return i > 0 ? (int) i : -1;
+        msgs[i].msg_len = ret;
+    }
+    return vlen;
+}
+#endif
+
+
+static void pin_thread(int cpu)
+{
+#ifdef __linux__
+    cpu_set_t set;
+
+    if (cpu < 0)
+        return;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set))
+        fprintf(stderr, "cannot pin thread to CPU %d\n", cpu);
+#else
+    if (cpu >= 0)
+        fprintf(stderr, "CPU pinning is not supported on this platform\n");
+#endif
+}
+
+
+void qinit(int qsize_req)
+{
+    if (qsize_req < 2 * BATCH)
+        qsize_req = 2 * BATCH;
+    qsize = qsize_req;
 
-    printf("initializing packet queue for %d items\n", qsize);
+    printf("initializing packet queue for %lu items\n", qsize);
 
     queue = (struct item *) calloc(qsize, sizeof(struct item));
     if (queue == NULL) {
         fprintf(stderr, "not enough memory\n");
         exit(2);
     }
+}
+
+
+/* position of the slowest shard */
+static unsigned long min_tail(void)
+{
+    unsigned long head = atomic_load(&qhead);
+    unsigned long min = head;
+    int i;
+
+    for (i = 0; i < shard_count; i++) {
+        unsigned long t = atomic_load(&shards[i].tail);
+        if (head - t > head - min)
+            min = t;
+    }
+    return min;
+}
 
-    for (i = 0; i < qsize; i++)
-        queue[i].next = queue + i + 1;
-    queue[qsize - 1].next = queue;
 
-    qhead = qtail = queue;
+/* wakes the threads waiting on cond, if any */
+static void wake(_Atomic int *waiters, pthread_cond_t *cond)
+{
+    if (atomic_load(waiters) > 0) {
+        pthread_mutex_lock(&wait_mtx);
+        pthread_cond_broadcast(cond);
+        pthread_mutex_unlock(&wait_mtx);
+    }
 }
 
 
@@ -80,9 +188,8 @@ int buffer_size(int sock, int optname, int size)
 }
 
 
-int output_socket(unsigned short port, const char *host, int bufsize)
+void resolve_replica(struct replica *r)
 {
-    int s;
     struct addrinfo hints;
     struct addrinfo *res;
     char saddr[INET_ADDRSTRLEN];
@@ -94,24 +201,34 @@ int output_socket(unsigned short port, const char *host, int bufsize)
     hints.ai_protocol = IPPROTO_UDP;
     hints.ai_family = PF_INET;
 
-    snprintf(p, 6, "%d", port);
+    snprintf(p, 6, "%d", r->port);
     p[5] = '\0';
 
-    if (getaddrinfo(host, p, &hints, &res)) {
+    if (getaddrinfo(r->host, p, &hints, &res)) {
         int err = errno;
         if (err == 0)
-            fprintf(stderr, "Address not found: %s\n", host);
+            fprintf(stderr, "Address not found: %s\n", r->host);
         else
-            fprintf(stderr, "%s: %s\n", gai_strerror(err), host);
+            fprintf(stderr, "%s: %s\n", gai_strerror(err), r->host);
         exit(2);
     }
 
     inet_ntop(AF_INET, &((struct sockaddr_in *) res->ai_addr)->sin_addr,
               saddr, sizeof(saddr));
     printf("connecting to %s (%s) port %d\n",
-           res->ai_canonname, saddr, port);
+           res->ai_canonname, saddr, r->port);
 
-    if ((s = socket(res->ai_family, res->ai_socktype, 0)) == -1) {
+    memcpy(&r->addr, res->ai_addr, res->ai_addrlen);
+    r->addrlen = res->ai_addrlen;
+    freeaddrinfo(res);
+}
+
+
+int output_socket(int bufsize)
+{
+    int s;
+
+    if ((s = socket(PF_INET, SOCK_DGRAM, 0)) == -1) {
         perror("socket");
         exit(2);
     }
@@ -119,56 +236,150 @@ int output_socket(unsigned short port, const char *host, int bufsize)
     if (buffer_size(s, SO_SNDBUF, bufsize))
         exit(2);
 
-    if (connect(s, res->ai_addr, res->ai_addrlen)) {
-        perror("connect");
-        exit(2);
-    }
-
     return s;
 }
 
 
-void *writer(void *arg)
+/* sends packets [from, to) to all replicas of the shard */
+static void send_batch(struct shard *sh, unsigned long from, unsigned long to)
 {
+    int n = 0;
     int i;
 
-    while (1) {
-        while (qhead != qtail) {
-            for (i = 0; i < count; i++)
-                write(replicas[i].sock, qhead->buf, qhead->size);
+    for (; from != to; from++) {
+        struct item *it = &queue[from % qsize];
+
+        for (i = 0; i < sh->count; i++) {
+            struct replica *r = &replicas[sh->first + i];
+
+            sh->iovs[n].iov_base = it->buf;
+            sh->iovs[n].iov_len = it->size;
+            memset(&sh->msgs[n].msg_hdr, 0, sizeof(struct msghdr));
+            sh->msgs[n].msg_hdr.msg_name = &r->addr;
+            sh->msgs[n].msg_hdr.msg_namelen = r->addrlen;
+            sh->msgs[n].msg_hdr.msg_iov = &sh->iovs[n];
+            sh->msgs[n].msg_hdr.msg_iovlen = 1;
+            if (++n == MAX_MSGS || (from + 1 == to && i + 1 == sh->count)) {
+                int off = 0;
+                while (off < n) {
+                    int ret = sendmmsg(sh->sock, sh->msgs + off, n - off, 0);
+                    if (ret < 0) {
+                        if (errno == EINTR)
+                            continue;
+                        /* unreachable/busy destination - skip the message */
+                        ret = 1;
+                    } else {
+                        sh->sent += ret;
+                    }
+                    off += ret;
+                }
+                n = 0;
+            }
+        }
+    }
+}
 
-            qhead = qhead->next;
 
-            pthread_mutex_lock(&qfull_mtx);
-            qfull = 0;
-            pthread_cond_signal(&qfull_cond);
-            pthread_mutex_unlock(&qfull_mtx);
-        }
+void *writer(void *arg)
+{
+    struct shard *sh = (struct shard *) arg;
+    unsigned long tail = atomic_load(&sh->tail);
+    int spin = 0;
+
+    pin_thread(sh->cpu);
+
+    while (1) {
+        unsigned long head = atomic_load(&qhead);
 
-        pthread_mutex_lock(&qempty_mtx);
-        if (qempty)
-            pthread_cond_wait(&qempty_cond, &qempty_mtx);
-        qempty = 1;
-        pthread_mutex_unlock(&qempty_mtx);
+        if (head == tail) {
+            if (++spin < SPIN) {
+                sched_yield();
+                continue;
+            }
+            pthread_mutex_lock(&wait_mtx);
+            atomic_fetch_add(&data_waiters, 1);
+            while (atomic_load(&qhead) == tail)
+                pthread_cond_wait(&data_cond, &wait_mtx);
+            atomic_fetch_sub(&data_waiters, 1);
+            pthread_mutex_unlock(&wait_mtx);
+            spin = 0;
+            continue;
+        }
+        spin = 0;
+
+        if (head - tail > BATCH)
+            head = tail + BATCH;
+        send_batch(sh, tail, head);
+        tail = head;
+        atomic_store(&sh->tail, tail);
+        wake(&space_waiters, &space_cond);
     }
 
     return NULL;
 }
 
 
+/* parses comma-separated CPU list, returns number of items */
+static int parse_cpus(char *list, int **cpus)
+{
+    int n = 0;
+    char *item, *save_ptr;
+
+    *cpus = NULL;
+    while ((item = strtok_r(list, ",", &save_ptr)) != NULL) {
+        *cpus = realloc(*cpus, (n + 1) * sizeof(int));
+        (*cpus)[n++] = atoi(item);
+        list = NULL;
+    }
+    return n;
+}
+
+
+static void usage(const char *progname)
+{
+    fprintf(stderr, "%s [-t threads] [-c cpu_list] buffer_size port host...\n"
+            "\t-t threads  - number of sending threads, replicas are evenly split between them (default 1)\n"
+            "\t-c cpu_list - comma-separated CPUs to pin the receiving thread and then the sending threads to\n",
+            progname);
+}
+
+
 int main(int argc, char **argv)
 {
     unsigned short port;
-    int qsize;
     int bufsize;
     struct sockaddr_in addr;
     int sock_in;
-    pthread_t thread;
-    int err = 0;
+    int *cpus = NULL;
+    int cpu_count = 0;
+    int opt;
     int i;
 
+    while ((opt = getopt(argc, argv, "+t:c:h")) != -1) {
+        switch (opt) {
+        case 't':
+            shard_count = atoi(optarg);
+            if (shard_count <= 0) {
+                fprintf(stderr, "invalid thread count: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'c':
+            cpu_count = parse_cpus(optarg, &cpus);
+            break;
+        case 'h':
+            usage(argv[0]);
+            return 0;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    argc -= optind - 1;
+    argv += optind - 1;
+
     if (argc < 4) {
-        fprintf(stderr, "%s buffer_size port host...\n", argv[0]);
+        usage(argv[0]);
         return 1;
     }
 
@@ -188,8 +399,6 @@ int main(int argc, char **argv)
         break;
     }
 
-    qsize = bufsize / 8000;
-
     printf("using UDP send and receive buffer size of %d bytes\n", bufsize);
 
     if ((port = atoi(argv[2])) <= 0) {
@@ -197,7 +406,7 @@ int main(int argc, char **argv)
         return 1;
     }
 
-    qinit(qsize);
+    qinit(bufsize / 8000);
 
     /* input socket */
     if ((sock_in = socket(PF_INET, SOCK_DGRAM, 0)) == -1) {
@@ -235,51 +444,87 @@ int main(int argc, char **argv)
         else
             replicas[i].port = port;
 
-        replicas[i].sock = output_socket(replicas[i].port, replicas[i].host,
-                                         bufsize);
+        resolve_replica(&replicas[i]);
     }
 
-    if (pthread_create(&thread, NULL, writer, NULL)) {
-        fprintf(stderr, "cannot create writer thread\n");
+    if (shard_count > count)
+        shard_count = count;
+    shards = (struct shard *) calloc(shard_count, sizeof(struct shard));
+    if (shards == NULL) {
+        fprintf(stderr, "not enough memory for shard array");
         return 2;
     }
+    for (i = 0; i < shard_count; i++) {
+        shards[i].first = i * count / shard_count;
+        shards[i].count = (i + 1) * count / shard_count - shards[i].first;
+        shards[i].sock = output_socket(bufsize);
+        shards[i].cpu = i + 1 < cpu_count ? cpus[i + 1] : -1;
+        atomic_init(&shards[i].tail, 0);
+    }
+    printf("sending with %d thread(s)\n", shard_count);
+
+    for (i = 0; i < shard_count; i++) {
+        if (pthread_create(&shards[i].thread, NULL, writer, &shards[i])) {
+            fprintf(stderr, "cannot create writer thread\n");
+            return 2;
+        }
+    }
+
+    pin_thread(cpu_count > 0 ? cpus[0] : -1);
 
     /* main loop */
-    while (1) {
-        fcntl(sock_in, F_SETFL, O_NONBLOCK);
+    struct mmsghdr msgs[BATCH];
+    struct iovec iovs[BATCH];
+    unsigned long head = 0;
+    int spin = 0;
 
-        while (qtail->next != qhead
-               && ((qtail->size = read(sock_in, qtail->buf, SIZE)) > 0
-                   || (err = errno) == EAGAIN)) {
+    while (1) {
+        unsigned long free_slots = qsize - (head - min_tail());
+        int n;
 
-            if (qtail->size <= 0) {
+        if (free_slots == 0) {
+            if (++spin < SPIN) {
                 sched_yield();
+                continue;
             }
-            else {
-                qtail = qtail->next;
-
-                pthread_mutex_lock(&qempty_mtx);
-                qempty = 0;
-                pthread_cond_signal(&qempty_cond);
-                pthread_mutex_unlock(&qempty_mtx);
-            }
+            pthread_mutex_lock(&wait_mtx);
+            atomic_fetch_add(&space_waiters, 1);
+            while (head - min_tail() == qsize)
+                pthread_cond_wait(&space_cond, &wait_mtx);
+            atomic_fetch_sub(&space_waiters, 1);
+            pthread_mutex_unlock(&wait_mtx);
+            spin = 0;
+            continue;
+        }
+        spin = 0;
+
+        if (free_slots > BATCH)
+            free_slots = BATCH;
+        for (i = 0; i < (int) free_slots; i++) {
+            struct item *it = &queue[(head + i) % qsize];
+
+            iovs[i].iov_base = it->buf;
+            iovs[i].iov_len = SIZE;
+            memset(&msgs[i].msg_hdr, 0, sizeof(struct msghdr));
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
         }
 
-        if (qtail->size <= 0)
-            break;
-
-        pthread_mutex_lock(&qfull_mtx);
-        if (qfull)
-            pthread_cond_wait(&qfull_cond, &qfull_mtx);
-        qfull = 1;
-        pthread_mutex_unlock(&qfull_mtx);
-    }
+        /* blocks until at least one packet is available */
+        n = recvmmsg(sock_in, msgs, free_slots, MSG_WAITFORONE, NULL);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            printf("read: %s\n", strerror(errno));
+            return 2;
+        }
 
-    if (qtail->size < 0) {
-        printf("read: %s\n", strerror(err));
-        return 2;
+        for (i = 0; i < n; i++)
+            queue[(head + i) % qsize].size = msgs[i].msg_len;
+        head += n;
+        atomic_store(&qhead, head);
+        wake(&data_waiters, &data_cond);
     }
 
     return 0;
 }
-
@@ -110,56 +110,71 @@ char *xor_using_sse2 (char *source, char *dest, int packet_size)
     return dest;
 }
 
-CUDA_DLL_API void gpu_encode_upgrade (char * source_data,int *OUTBUF, int * PCM,int param_k,int param_m,int w_f,int packet_size ,int buf_size)
-{
+/**
+ * Number of chunks the parity is downloaded in, the CPU staircase of the
+ * small-packet path processes a chunk while the following ones are transferred.
+ */
+#define PARITY_DOWNLOAD_CHUNKS 4
 
-    // cudaError_t error;
+/**
+ * Computes parity of source_data (which must be page-locked) into its tail.
+ * All work is enqueued to stream, only the source packets are uploaded as the
+ * parity is computed from scratch.
+ */
+CUDA_DLL_API void gpu_encode_upgrade (char * source_data,int *OUTBUF, int * PCM,int param_k,int param_m,int w_f,int packet_size ,int buf_size, cudaStream_t stream)
+{
+    (void) buf_size;
     int blocksize = packet_size/sizeof(int);
-    // printf("blocksize: %d\npacket size: %d\n",blocksize,packet_size );
+    char *parity = source_data + param_k*packet_size;
+    int *PARITY = OUTBUF + (param_k*packet_size)/4;
+
+    cudaMemcpyAsync(OUTBUF, source_data, param_k*packet_size, cudaMemcpyHostToDevice, stream);
+    cuda_check_error("memcpy OUTBUF");
+
     if(blocksize>256){
         if(blocksize>1024)  blocksize=1024;
-        // puts("big one");
-        frame_encode_int_big <<< param_m, blocksize, packet_size >>> (OUTBUF,PCM, param_k, param_m, w_f, packet_size);
+        frame_encode_int_big <<< param_m, blocksize, packet_size, stream >>> (OUTBUF,PCM, param_k, param_m, w_f, packet_size);
         cuda_check_error("frame_encode_int_big");
 
-        frame_encode_staircase<<< 1, blocksize, packet_size >>> (OUTBUF, PCM, param_k, param_m, w_f, packet_size);
+        frame_encode_staircase<<< 1, blocksize, packet_size, stream >>> (OUTBUF, PCM, param_k, param_m, w_f, packet_size);
         cuda_check_error("frame_encode_staircase");
 
-        cudaMemcpy(source_data + param_k*packet_size,OUTBUF + (param_k*packet_size)/4, param_m*packet_size,cudaMemcpyDeviceToHost );
-        // // cudaMemcpy(source_data,OUTBUF, buf_size,cudaMemcpyDeviceToHost );
+        cudaMemcpyAsync(parity, PARITY, param_m*packet_size, cudaMemcpyDeviceToHost, stream);
         cuda_check_error("memcpy out_buf");
-
-
-        //     gettimeofday(&t0, 0);
-        // for ( int m = 1; m < param_m; ++m)
-        // {
-        //     char *prev_parity = (char *) source_data + (param_k + m - 1) * packet_size;
-        //     char *parity_packet = (char *) source_data + (param_k + m) * packet_size;
-        //     xor_using_sse2(prev_parity, parity_packet, packet_size);
-
-        // }
-        // gettimeofday(&t1, 0);
-        // long elapsed = (t1.tv_sec - t0.tv_sec) * 1000000 + t1.tv_usec - t0.tv_usec;
-        // printf("time staircase: %f\n",elapsed/1000.0 );
-
+        cudaStreamSynchronize(stream);
+        cuda_check_error("sync out_buf");
     }
     else{
-        // puts("chudy soused");
-        frame_encode_int <<< param_m, blocksize, packet_size >>> (OUTBUF,PCM, param_k, param_m, w_f, packet_size);
+        frame_encode_int <<< param_m, blocksize, packet_size, stream >>> (OUTBUF,PCM, param_k, param_m, w_f, packet_size);
         cuda_check_error("frame_encode_int");
 
-        cudaMemcpy(source_data + param_k*packet_size,OUTBUF + (param_k*packet_size)/4, param_m*packet_size,cudaMemcpyDeviceToHost );
-        // cudaMemcpy(source_data,OUTBUF, buf_size,cudaMemcpyDeviceToHost );
+        cudaEvent_t downloaded[PARITY_DOWNLOAD_CHUNKS];
+        int chunk_rows = (param_m + PARITY_DOWNLOAD_CHUNKS - 1) / PARITY_DOWNLOAD_CHUNKS;
+        for (int c = 0; c < PARITY_DOWNLOAD_CHUNKS; ++c) {
+            int first = c * chunk_rows;
+            int rows = param_m - first < chunk_rows ? param_m - first : chunk_rows;
+            cudaEventCreateWithFlags(&downloaded[c], cudaEventDisableTiming);
+            if (rows > 0) {
+                cudaMemcpyAsync(parity + first*packet_size, PARITY + (first*packet_size)/4, rows*packet_size,
+                        cudaMemcpyDeviceToHost, stream);
+            }
+            cudaEventRecord(downloaded[c], stream);
+        }
         cuda_check_error("memcpyu out_buf");
 
-        for ( int m = 1; m < param_m; ++m)
-        {
-            char *prev_parity = (char *) source_data + (param_k + m - 1) * packet_size;
-            char *parity_packet = (char *) source_data + (param_k + m) * packet_size;
-            xor_using_sse2(prev_parity, parity_packet, packet_size);
-
+        for (int c = 0; c < PARITY_DOWNLOAD_CHUNKS; ++c) {
+            cudaEventSynchronize(downloaded[c]);
+            cudaEventDestroy(downloaded[c]);
+            int first = c * chunk_rows;
+            int last = first + chunk_rows < param_m ? first + chunk_rows : param_m;
+            for ( int m = first > 1 ? first : 1; m < last; ++m)
+            {
+                char *prev_parity = (char *) parity + (m - 1) * packet_size;
+                char *parity_packet = (char *) parity + m * packet_size;
+                xor_using_sse2(prev_parity, parity_packet, packet_size);
+            }
         }
-
+        cuda_check_error("sync out_buf");
     }
 
 
@@ -16,11 +16,16 @@
  * =====================================================================================
  */
 
+#include <algorithm>
 #include <stdlib.h>
 #include <stdio.h>
 #if defined __SSE2__ || _M_IX86_FP == 2
 #include <emmintrin.h>
 #endif
+#if defined __GNUC__ && (defined __x86_64__ || defined __i386__)
+#include <immintrin.h>
+#define HAVE_AVX2_DISPATCH 1
+#endif
 #include <string.h>
 #include <time.h>
 
@@ -29,6 +34,9 @@
 
 using namespace std;
 
+#define MIN_BYTES_PER_JOB (256 * 1024) ///< frame data amount per worker
+#define SLICE_ALIGN 64                 ///< symbol slices processed by workers are aligned to this
+
 #ifdef _WIN32
 #define aligned_malloc _aligned_malloc
 #define aligned_free _aligned_free
@@ -134,6 +142,116 @@ xor_using_sse (char* source, char* dest, int packet_size)
     return dest;
 }
 
+#ifdef HAVE_AVX2_DISPATCH
+__attribute__((target("avx2"))) static char*
+xor_using_avx2 (char* source, char* dest, int packet_size)
+{
+    int iter_bytes_32 = (packet_size/32)*32;
+    for ( int i = 0; i < iter_bytes_32; i += 32 )
+    {
+        __m256i ymm1 = _mm256_loadu_si256((__m256i *)(void *) (source + i));
+        __m256i ymm2 = _mm256_loadu_si256((__m256i *)(void *) (dest + i));
+        _mm256_storeu_si256((__m256i *)(void *) (dest + i), _mm256_xor_si256(ymm1, ymm2));
+    }
+    xor_using_sse(source + iter_bytes_32, dest + iter_bytes_32, packet_size - iter_bytes_32);
+    return dest;
+}
+#endif
+
+/**
+ * dest ^= source, uses the widest SIMD available at runtime
+ */
+static char*
+xor_region (char* source, char* dest, int packet_size)
+{
+#ifdef HAVE_AVX2_DISPATCH
+    static const bool have_avx2 = __builtin_cpu_supports("avx2");
+    if ( have_avx2 )
+        return xor_using_avx2(source, dest, packet_size);
+#endif
+    return xor_using_sse(source, dest, packet_size);
+}
+
+LDGM_session_cpu::LDGM_session_cpu (unsigned int threads)
+{
+    printf("CPU LDGM in progress .... \n");
+    elapsed_sum=0.0;
+    no_frames=0;
+    for ( unsigned int i = 1; i < threads; ++i )
+        workers.emplace_back(&LDGM_session_cpu::worker_loop, this);
+}
+
+LDGM_session_cpu::~LDGM_session_cpu ()
+{
+    printf("LDGM TIME CPU: %f ms\n",this->elapsed_sum2/(double)this->no_frames2 );
+    {
+        unique_lock<mutex> lk(lock);
+        should_exit = true;
+    }
+    job_cv.notify_all();
+    for ( auto &t : workers )
+        t.join();
+}
+
+void
+LDGM_session_cpu::worker_loop ()
+{
+    unique_lock<mutex> lk(lock);
+    while ( true ) {
+        job_cv.wait(lk, [this]{ return should_exit || jobs_next < jobs_total; });
+        if ( should_exit )
+            return;
+        int idx = jobs_next++;
+        const function<void(int)> *current = job;
+        lk.unlock();
+        (*current)(idx);
+        lk.lock();
+        if ( ++jobs_done == jobs_total )
+            done_cv.notify_one();
+    }
+}
+
+/**
+ * Runs job(0) .. job(job_count - 1) in the worker pool and waits for
+ * completion. The calling thread processes jobs as well.
+ */
+void
+LDGM_session_cpu::run_parallel ( int job_count, const function<void(int)> &f )
+{
+    if ( job_count <= 1 || workers.empty() ) {
+        for ( int i = 0; i < job_count; ++i )
+            f(i);
+        return;
+    }
+    unique_lock<mutex> lk(lock);
+    job = &f;
+    jobs_next = jobs_done = 0;
+    jobs_total = job_count;
+    job_cv.notify_all();
+    while ( jobs_next < jobs_total ) {
+        int idx = jobs_next++;
+        lk.unlock();
+        f(idx);
+        lk.lock();
+        ++jobs_done;
+    }
+    done_cv.wait(lk, [this]{ return jobs_done == jobs_total; });
+    jobs_total = jobs_next = jobs_done = 0;
+    job = nullptr;
+}
+
+/**
+ * Number of byte slices of the symbols to process in parallel - sized so
+ * that each worker gets at least MIN_BYTES_PER_JOB of the frame.
+ */
+int
+LDGM_session_cpu::get_job_count ( int data_len ) const
+{
+    int jobs = min<int>(data_len / MIN_BYTES_PER_JOB, workers.size() + 1);
+    jobs = min<int>(jobs, packet_size / SLICE_ALIGN);
+    return max(jobs, 1);
+}
+
 void *
 LDGM_session_cpu::alloc_buf (int buf_size)
 {
@@ -150,39 +268,33 @@ LDGM_session_cpu::alloc_buf (int buf_size)
 void
 LDGM_session_cpu::encode ( char* data_ptr, char* parity_ptr )
 {
-//    start encoding
-   // printf ( "packet_size: %d\n", this->packet_size );
-
-    char *parity_packet;
-
-	parity_packet = (char *) aligned_malloc(packet_size, 16);
-	if (!parity_packet)
-	{
-		printf ( "Error while using posix_memalign\n" );
-		return;
-	}
-	memset(parity_packet, 0, packet_size);
-
-    for ( int m = 0; m < param_m; ++m) {
-//	printf ( "m: %d\n", m );
-
-//	printf ( "max w: %d\n", max_row_weight );
-        //Find out which packets to XOR
-        for ( int k = 0; k < max_row_weight+2; ++k) {
-            int idx = pcm[m*(max_row_weight+2) + k];
-//	    printf ( "adept: %d\n", idx );
-            if (idx > -1 && idx < param_k) {
-//		printf ( "xoring idx: %d\n", idx );
-                char *ptr = data_ptr + idx*packet_size;
-                parity_packet = xor_using_sse(ptr, parity_packet, packet_size);
+    // Each parity packet is XOR of data packets and the previous parity packet
+    // (staircase). Since there are no dependencies between bytes of the
+    // symbols, the symbols are split to slices processed in parallel.
+    int jobs = get_job_count(param_k * packet_size);
+    int slice = (packet_size + jobs - 1) / jobs;
+    slice = (slice + SLICE_ALIGN - 1) / SLICE_ALIGN * SLICE_ALIGN;
+
+    run_parallel(jobs, [&](int j) {
+        int off = j * slice;
+        int len = min(slice, packet_size - off);
+        if ( len <= 0 )
+            return;
+        for ( int m = 0; m < param_m; ++m) {
+            char *parity_packet = parity_ptr + m*packet_size + off;
+            if ( m == 0 )
+                memset(parity_packet, 0, len);
+            else
+                memcpy(parity_packet, parity_packet - packet_size, len);
+            //Find out which packets to XOR
+            for ( int k = 0; k < max_row_weight+2; ++k) {
+                int idx = pcm[m*(max_row_weight+2) + k];
+                if (idx > -1 && idx < param_k) {
+                    xor_region(data_ptr + idx*packet_size + off, parity_packet, len);
+                }
             }
         }
-
-        //Add the new parity packet to overall parity
-        memcpy ( parity_ptr + m*packet_size, parity_packet, packet_size );
-    }
-
-	aligned_free(parity_packet);
+    });
 
     return ;
 }		/* -----  end of method LDGM_session_cpu::encode  ----- */
@@ -391,12 +503,29 @@ LDGM_session_cpu::decode_frame ( char* received, int buf_size, int* frame_size,
      */
     int iter = 0;
 
+    schedule.clear();
     while ( needs_decoding(&graph) && iter < 4) {
 //	printf ( "iteratin\n" );
         iterate(&graph);
         iter++;
     }
 
+    //execute the recovery collected by iterate() in byte slices in parallel
+    if ( !schedule.empty() ) {
+        int jobs = get_job_count(schedule.size() * p_size);
+        int slice = (p_size + jobs - 1) / jobs;
+        slice = (slice + SLICE_ALIGN - 1) / SLICE_ALIGN * SLICE_ALIGN;
+        run_parallel(jobs, [&](int j) {
+            int off = j * slice;
+            int len = min(slice, p_size - off);
+            for ( auto &op : schedule ) {
+                memset(op.dst + off, 0, len);
+                for ( char *src : op.srcs )
+                    xor_region(src + off, op.dst + off, len);
+            }
+        });
+    }
+
 //    printf("decoding process: %.3f s\n", t);
 
     //printf ( "iterations: %d\n", iter );
@@ -472,9 +601,10 @@ LDGM_session_cpu::iterate ( Tanner_graph *graph )
 //		printf ( "repairing first block\n" );
 //	    }
             it_v = graph->nodes.find(r_index);
-            memset(it_v->second.getDataPtr(), 0, packet_size);
             char *r_data = it_v->second.getDataPtr();
             //find other nodes connected to this constraint node and XOR their values
+            //(only recorded here, executed by decode_frame)
+            schedule.push_back({r_data, {}});
             int count = 0;
             for(vector<int>::iterator j = it_c->second.neighbours.begin();
                     j != it_c->second.neighbours.end(); ++j)
@@ -483,8 +613,7 @@ LDGM_session_cpu::iterate ( Tanner_graph *graph )
                 {
 //		    printf ( "decode, packet_size: %d\n", packet_size );
                     char *g_data = (graph->nodes.find(*j))->second.getDataPtr();
-                    //XOR
-                    xor_using_sse(g_data, r_data, packet_size);
+                    schedule.back().srcs.push_back(g_data);
                     count++;
                 }
             }
@@ -20,6 +20,12 @@
 #ifndef  LDGM_SESSION_CPU_INC
 #define  LDGM_SESSION_CPU_INC
 
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 #include "ldgm-session.h"
 //#include "timer-util.h"
 
@@ -33,14 +39,12 @@ class LDGM_session_cpu : public LDGM_session
 {
     public:
 	/* ====================  LIFECYCLE     ======================================= */
-	LDGM_session_cpu () {
-		printf("CPU LDGM in progress .... \n");
-		elapsed_sum=0.0;
-		no_frames=0;
-	}                            /* constructor */
-	~LDGM_session_cpu () {
-		printf("LDGM TIME CPU: %f ms\n",this->elapsed_sum2/(double)this->no_frames2 );
-	 }                            /* constructor */
+	/**
+	 * @param threads number of threads used to encode/decode a frame
+	 *                (including the calling one)
+	 */
+	LDGM_session_cpu (unsigned int threads = 1);
+	~LDGM_session_cpu ();
 
 	void
 	    encode (char*, char*);
@@ -65,10 +69,38 @@ class LDGM_session_cpu : public LDGM_session
 	/* ====================  DATA MEMBERS  ======================================= */
 
     private:
+	/** Recovery of a lost symbol - dst = XOR of srcs */
+	struct xor_op {
+	    char *dst;
+	    std::vector<char *> srcs;
+	};
+
+	int
+	    get_job_count ( int data_len ) const;
+
+	void
+	    run_parallel ( int job_count, const std::function<void(int)> &job );
+
+	void
+	    worker_loop ();
+
 	/* ====================  DATA MEMBERS  ======================================= */
     double elapsed_sum;
 	long no_frames;
 
+	std::vector<xor_op> schedule;          ///< decoding operations collected by iterate()
+
+	// worker pool - jobs of the running task are taken by the workers and the caller
+	std::vector<std::thread> workers;
+	std::mutex lock;
+	std::condition_variable job_cv;
+	std::condition_variable done_cv;
+	const std::function<void(int)> *job = nullptr;
+	int jobs_total = 0;
+	int jobs_next = 0;
+	int jobs_done = 0;
+	bool should_exit = false;
+
 }; /* -----  end of class LDGM_session_cpu  ----- */
 
 #endif   /* ----- #ifndef LDGM_SESSION_CPU_INC  ----- */
@@ -25,6 +25,9 @@
 #include <iostream>
 #include <fstream>
 #include <map>
+#include <mutex>
+#include <tuple>
+#include <vector>
 #include <cuda_runtime.h>
 
 #include "ldgm-session-gpu.h"
@@ -42,6 +45,30 @@
 
 // static int * PCM;
 
+/*
+ * Device copies of parity-check matrices shared by all sessions. The same
+ * matrix repeats for the same (k, m, c, seed), eg. when a session is recreated
+ * after a frame size change, so it is uploaded only once. Entries are kept
+ * until exit.
+ */
+static std::mutex pcm_cache_lock;
+static std::map<std::tuple<int, int, std::vector<int> >, int *> pcm_cache;
+
+static int *get_device_pcm(const int *pcm, int k, int m, int w_f)
+{
+    std::lock_guard<std::mutex> lk(pcm_cache_lock);
+    int *&PCM = pcm_cache[std::make_tuple(k, m, std::vector<int>(pcm, pcm + w_f * m))];
+    if (PCM == NULL)
+    {
+        cudaError_t error = cudaMalloc((void **) &PCM, w_f * m * sizeof(int));
+        if(error != cudaSuccess)printf("7CUDA error: %s\n", cudaGetErrorString(error));
+
+        error = cudaMemcpy(PCM, pcm, w_f * m * sizeof(int), cudaMemcpyHostToDevice);
+        if(error != cudaSuccess)printf("8CUDA error: %s\n", cudaGetErrorString(error));
+    }
+    return PCM;
+}
+
 LDGM_session_gpu::LDGM_session_gpu() {
     printf("GPU LDGM in progress .... \n");
 
@@ -52,9 +79,14 @@ LDGM_session_gpu::LDGM_session_gpu() {
     SYNC_VEC=NULL;
 
     PCM=NULL;
+    PCM_src=NULL;
 
     OUTBUF_SIZE=0;
     OUTBUF=NULL;
+
+    // own non-blocking stream so that sessions do not serialize on the default one
+    cudaStreamCreateWithFlags(&stream, cudaStreamNonBlocking);
+    cuda_check_error("cudaStreamCreate");
 }
 
 LDGM_session_gpu::~LDGM_session_gpu () {
@@ -73,8 +105,8 @@ LDGM_session_gpu::~LDGM_session_gpu () {
     cuda_check_error("sync_vec");
 
 
-    //    cudaFree(OUTBUF);
-    cudaFree(PCM);
+    cudaFree(OUTBUF);
+    cudaStreamDestroy(stream);
 
     cudaFree(ERROR_VEC);
     cudaFree(SYNC_VEC);
@@ -120,8 +152,6 @@ void LDGM_session_gpu::encode ( char *source_data, char *parity )
     unsigned int w_f = max_row_weight + 2;
     unsigned int buf_size = (param_k + param_m) * packet_size;
 
-    cudaError_t error;
-
     // error = cudaHostGetDevicePointer( &(out_buf_d), source_data, 0);
     // cuda_check_error("out_buf_d");
 
@@ -137,26 +167,14 @@ void LDGM_session_gpu::encode ( char *source_data, char *parity )
         OUTBUF_SIZE=buf_size;
     }
 
-        cudaMemcpy((void *) OUTBUF,source_data,buf_size,cudaMemcpyHostToDevice);
-    cuda_check_error("memcpy OUTBUF");
-
-
-
-    if (PCM == NULL)
-    {   
-        // puts("cudaMalloc");      
-        error = cudaMalloc((void **) &PCM, w_f * param_m * sizeof(int));
-        if(error != cudaSuccess)printf("7CUDA error: %s\n", cudaGetErrorString(error));
-
-        error = cudaMemcpy(PCM, pcm, w_f * param_m * sizeof(int), cudaMemcpyHostToDevice);
-        if(error != cudaSuccess)printf("8CUDA error: %s\n", cudaGetErrorString(error));
+    if (PCM == NULL || PCM_src != pcm)
+    {
+        PCM = get_device_pcm(pcm, param_k, param_m, w_f);
+        PCM_src = pcm;
     }
 
-
-
-
-
-    gpu_encode_upgrade(source_data,OUTBUF , PCM, param_k, param_m, w_f, packet_size, buf_size);
+    // source_data is from alloc_buf() (page-locked) so the copies are asynchronous
+    gpu_encode_upgrade(source_data,OUTBUF , PCM, param_k, param_m, w_f, packet_size, buf_size, stream);
 
     // puts("end");
 
@@ -273,13 +291,10 @@ char *LDGM_session_gpu::decode_frame ( char *received_data, int buf_size, int *f
     // int * error_vec_d;
     // int * pcm_d;
 
-    if (PCM == NULL)
+    if (PCM == NULL || PCM_src != pcm)
     {
-        error = cudaMalloc((void **) &PCM, w_f * param_m * sizeof(int));
-        if (error != cudaSuccess) printf("3 %s\n", cudaGetErrorString(error));
-
-        error = cudaMemcpy(PCM, pcm, w_f * param_m * sizeof(int), cudaMemcpyHostToDevice);
-        if (error != cudaSuccess) printf("4 %s\n", cudaGetErrorString(error));
+        PCM = get_device_pcm(pcm, param_k, param_m, w_f);
+        PCM_src = pcm;
     }
 
     if (SYNC_VEC == NULL)
@@ -26,6 +26,8 @@
 #include <map>
 #include <queue>
 
+struct CUstream_st;
+
 /*
  * =====================================================================================
  *        Class:  LDGM_session_gpu
@@ -92,7 +94,9 @@ class LDGM_session_gpu : public LDGM_session
     int * SYNC_VEC;
 	int * ERROR_VEC;
 
-	int * PCM;
+	int * PCM;          ///< device PCM, owned by the process-wide cache
+	const int * PCM_src; ///< host pcm the PCM was looked up for
+	struct CUstream_st * stream; ///< encoding stream (cudaStream_t)
 
 
 
@@ -90,10 +90,13 @@ void Client::readDescComplete(
 }
 
 void Client::readCandidate(std::function<void(Client&, bool)> onComplete){
-	using namespace std::placeholders;
-	inMsg.async_readMsg(socket,
-			std::bind(&Client::readCandidateComplete,
-				shared_from_this(), onComplete, _1));
+	asio::dispatch(socket.get_executor(),
+			[self = shared_from_this(), onComplete = std::move(onComplete)]() mutable {
+				using namespace std::placeholders;
+				self->inMsg.async_readMsg(self->socket,
+						std::bind(&Client::readCandidateComplete,
+							self, std::move(onComplete), _1));
+			});
 }
 
 void Client::readCandidateComplete(
@@ -115,8 +118,15 @@ bool Client::isSendCallbackPending() const{
 
 
 void Client::sendMsg(std::string_view msg){
+	asio::dispatch(socket.get_executor(),
+			[self = shared_from_this(), msg = std::string(msg)]() mutable {
+				self->sendMsgInStrand(std::move(msg));
+			});
+}
+
+void Client::sendMsgInStrand(std::string&& msg){
 	if(isSendCallbackPending()){
-		sendQueue.emplace(msg);
+		sendQueue.emplace(std::move(msg));
 		return;
 	}
 
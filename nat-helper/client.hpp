@@ -45,6 +45,11 @@
 #include <asio.hpp>
 #include "message.hpp"
 
+/**
+ * All operations on the socket and the client state run in the strand of the
+ * socket executor. sendMsg() and readCandidate() may be called from any
+ * thread, they are dispatched to the strand.
+ */
 class Client : public std::enable_shared_from_this<Client>{
 public:
 	Client(asio::ip::tcp::socket&& socket);
@@ -61,12 +66,18 @@ public:
 
 	void sendMsg(std::string_view msg);
 
+	/**
+	 * onComplete is called from the client strand, getCandidates() may
+	 * be used there until next readCandidate()
+	 */
 	void readCandidate(std::function<void(Client&, bool)> onComplete);
 	const std::vector<std::string>& getCandidates() { return candidates; }
 
 	bool isSendCallbackPending() const;
 
 private:
+	void sendMsgInStrand(std::string&& msg);
+
 	void readNameComplete(asio::ip::tcp::socket& socket,
 			std::function<void(Client&, bool)> onComplete, bool success);
 
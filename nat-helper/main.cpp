@@ -41,12 +41,13 @@
 namespace {
 	void printUsage(std::string_view name){
 		std::cout << "Usage: "
-			<< name << " [-h/--help] [-p/--port <port>]\n";
+			<< name << " [-h/--help] [-p/--port <port>] [-t/--threads <count>]\n";
 	}
 }
 
 int main(int argc, char **argv){
 	int port = 12558;
+	unsigned threads = 0;
 
 	for(int i = 1; i < argc; i++){
 		std::string_view arg(argv[i]);
@@ -66,6 +67,19 @@ int main(int argc, char **argv){
 				printUsage(argv[0]);
 				return 1;
 			}
+		} else if(arg == "-t" || arg == "--threads"){
+			if(i + 1 >= argc){
+				std::cerr << "Expected thread count\n";
+				printUsage(argv[0]);
+				return 1;
+			}
+			std::string_view threadsStr(argv[++i]);
+			auto res = std::from_chars(threadsStr.data(), threadsStr.data() + threadsStr.size(), threads);
+			if(res.ec != std::errc() || res.ptr == threadsStr.data()){
+				std::cerr << "Failed to parse thread count\n";
+				printUsage(argv[0]);
+				return 1;
+			}
 		} else {
 			std::cerr << "Unknown argument " << arg << std::endl;
 			printUsage(argv[0]);
@@ -74,7 +88,7 @@ int main(int argc, char **argv){
 	}
 
 
-	NatHelper server(port);
+	NatHelper server(port, threads);
 
 	server.run();
 
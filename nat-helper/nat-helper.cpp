@@ -38,13 +38,19 @@
 #include <functional>
 #include "nat-helper.hpp"
 
-NatHelper::NatHelper(int port) : port(port),
-	io_service(),
-	//work_guard(io_service.get_executor()),
-	acceptor(io_service),
-	pendingSocket(io_service)
-{
+namespace {
+	constexpr unsigned SHARDS_PER_THREAD = 4;
+}
 
+NatHelper::NatHelper(int port, unsigned threadCount) : port(port),
+	threadCount(threadCount > 0 ? threadCount : std::max(1u, std::thread::hardware_concurrency())),
+	io_context(this->threadCount),
+	acceptor(io_context),
+	pendingSocket(asio::make_strand(io_context))
+{
+	for(unsigned i = 0; i < this->threadCount * SHARDS_PER_THREAD; i++){
+		shards.emplace_back(std::make_unique<Shard>(io_context));
+	}
 }
 
 NatHelper::NatHelper() : NatHelper(12558)
@@ -54,9 +60,7 @@ NatHelper::NatHelper() : NatHelper(12558)
 
 
 void NatHelper::worker(){
-	std::cout << "Running" << std::endl;
-	io_service.run();
-	std::cout << "End" << std::endl;
+	io_context.run();
 }
 
 void NatHelper::run(){
@@ -70,69 +74,81 @@ void NatHelper::run(){
 	acceptor.async_accept(pendingSocket,
 			std::bind(&NatHelper::onConnectionAccepted, this, _1));
 
-	std::cout << "Starting thread" << std::endl;
-	worker_thread = std::thread(&NatHelper::worker, this);
+	std::cout << "Starting " << threadCount << " threads" << std::endl;
+	for(unsigned i = 0; i < threadCount; i++){
+		worker_threads.emplace_back(&NatHelper::worker, this);
+	}
 }
 
 void NatHelper::stop(){
 	std::cout << "Stopping..." << std::endl;
-	io_service.stop();
-	worker_thread.join();
+	io_context.stop();
+	for(auto& t : worker_threads){
+		t.join();
+	}
+	worker_threads.clear();
 }
 
 void NatHelper::onConnectionAccepted(const std::error_code& ec){
+	using namespace std::placeholders;
+
 	if(ec){
 		std::cerr << "Error accepting client connection: " << ec.message() << std::endl;
-		return;
+	} else {
+		// the client keeps itself alive by its pending reads
+		auto client = std::make_shared<Client>(std::move(pendingSocket));
+		client->readDescription(
+				std::bind(&NatHelper::onClientDesc, this, _1, _2));
 	}
 
-	using namespace std::placeholders;
-
-	auto client = std::make_shared<Client>(std::move(pendingSocket));
-	client->readDescription(
-			std::bind(&NatHelper::onClientDesc, this, _1, _2));
-	incomingClients.insert({client.get(), std::move(client)});
+	if(ec == asio::error::operation_aborted){
+		return;
+	}
 
+	// each socket gets its own strand, so its handlers never run concurrently
+	pendingSocket = asio::ip::tcp::socket(asio::make_strand(io_context));
 	acceptor.async_accept(pendingSocket,
 			std::bind(&NatHelper::onConnectionAccepted, this, _1));
 }
 
-void NatHelper::cleanEmptyRooms(){
-	for(auto it = rooms.begin(); it != rooms.end(); ){
-		if(it->second->isEmpty()){
-			std::cout << "Removing empty room " << it->first << "\n";
-			it = rooms.erase(it);
-		} else {
-			it++;
-		}
-	}
+NatHelper::Shard& NatHelper::getShard(const std::string& roomName){
+	return *shards[std::hash<std::string>{}(roomName) % shards.size()];
 }
 
 void NatHelper::onClientDesc(Client& client, bool success){
 	if(!success){
 		std::cerr << "Error reading client description" << std::endl;
-		incomingClients.erase(&client);
 		return;
 	}
 
-	const auto& roomName = client.getRoomName();
-	std::cout << "Moving client " << client.getClientName()
+	Shard& shard = getShard(client.getRoomName());
+	asio::post(shard.strand,
+			[this, &shard, c = client.shared_from_this()]() mutable {
+				addToRoom(shard, std::move(c));
+			});
+}
+
+void NatHelper::addToRoom(Shard& shard, std::shared_ptr<Client>&& client){
+	const auto& roomName = client->getRoomName();
+	std::cout << "Moving client " << client->getClientName()
 		<< " to room " << roomName
 		<< std::endl;
 
-	auto roomIt = rooms.find(roomName);
-	if(roomIt == rooms.end()){
-		cleanEmptyRooms();
+	auto roomIt = shard.rooms.find(roomName);
+	if(roomIt == shard.rooms.end()){
 		std::cout << "Creating room " << roomName << std::endl;
-		roomIt = rooms.insert({roomName, std::make_shared<Room>(roomName)}).first;
+		auto onEmpty = [&shard](Room& room){
+			std::cout << "Removing empty room " << room.getName() << "\n";
+			shard.rooms.erase(room.getName());
+		};
+		roomIt = shard.rooms.insert({roomName,
+				std::make_shared<Room>(roomName, shard.strand, onEmpty)}).first;
 	}
 
-	auto clientIt = incomingClients.find(&client);
 	auto& room = roomIt->second;
 	if(room->isFull()){
 		std::cerr << "Room " << roomName << " is full, dropping client" << std::endl;
 	} else {
-		roomIt->second->addClient(std::move(clientIt->second));
+		room->addClient(std::move(client));
 	}
-	incomingClients.erase(clientIt);
 }
@@ -41,13 +41,20 @@
 #include <thread>
 #include <memory>
 #include <map>
+#include <vector>
 #include "client.hpp"
 #include "room.hpp"
 
+/**
+ * Sockets are served by a pool of threads sharing one io_context. Each
+ * client socket has its own strand. Rooms are sharded by name, a shard owns
+ * its rooms and runs all their handlers in its strand, so no locking is
+ * needed and rooms in different shards are processed in parallel.
+ */
 class NatHelper {
 public:
 	NatHelper();
-	NatHelper(int port);
+	NatHelper(int port, unsigned threadCount = 0);
 	~NatHelper() = default;
 
 	void run();
@@ -59,19 +66,24 @@ private:
 	void onConnectionAccepted(const std::error_code& ec);
 	void onClientDesc(Client& client, bool success);
 
-	void cleanEmptyRooms();
+	struct Shard{
+		Shard(asio::io_context& ctx) : strand(asio::make_strand(ctx)) {  }
+		Room::Strand strand;
+		std::map<std::string, std::shared_ptr<Room>> rooms;
+	};
+	Shard& getShard(const std::string& roomName);
+	void addToRoom(Shard& shard, std::shared_ptr<Client>&& client);
 
 	int port;
+	unsigned threadCount;
 
-	asio::io_service io_service;
-	//asio::executor_work_guard<asio::io_service::executor_type> work_guard;
-	std::thread worker_thread;
+	asio::io_context io_context;
+	std::vector<std::thread> worker_threads;
 
 	asio::ip::tcp::acceptor acceptor;
 	asio::ip::tcp::socket pendingSocket;
 
-	std::map<Client *, std::shared_ptr<Client>> incomingClients;
-	std::map<std::string, std::shared_ptr<Room>> rooms;
+	std::vector<std::unique_ptr<Shard>> shards;
 };
 
 #endif //UG_NAT_HELPER
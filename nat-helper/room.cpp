@@ -38,25 +38,29 @@
 #include <iostream>
 #include "room.hpp"
 
-Room::Room(std::string name) : name(std::move(name)) {  }
+Room::Room(std::string name, Strand strand, std::function<void(Room&)> onEmpty) :
+	name(std::move(name)),
+	strand(std::move(strand)),
+	onEmpty(std::move(onEmpty))
+{  }
 
 void Room::addClient(std::shared_ptr<Client>&& client){
 	assert(!isFull());
 
 	Client *clientPtr = client.get();
 
-	for(auto& [c, _] : clients){
+	for(auto& [c, member] : clients){
 		c->sendMsg(clientPtr->getClientName());
 		c->sendMsg(clientPtr->getSdpDesc());
 
 		clientPtr->sendMsg(c->getClientName());
 		clientPtr->sendMsg(c->getSdpDesc());
-		for(const auto& candidate : c->getCandidates()){
+		for(const auto& candidate : member.candidates){
 			clientPtr->sendMsg(candidate);
 		}
 	}
 
-	clients.insert({clientPtr, std::move(client)});
+	clients.insert({clientPtr, Member{std::move(client), {}}});
 
 	using namespace std::placeholders;
 	clientPtr->readCandidate(
@@ -65,21 +69,44 @@ void Room::addClient(std::shared_ptr<Client>&& client){
 }
 
 void Room::onClientCandidate(Client& client, bool success){
+	// called from client strand, the client does not read until next readCandidate()
+	std::string candidate = success ? client.getCandidates().back() : std::string();
+	asio::post(strand,
+			[self = shared_from_this(), c = client.shared_from_this(), success, candidate = std::move(candidate)]() mutable {
+				if(success){
+					auto it = self->clients.find(c.get());
+					if(it != self->clients.end()){
+						it->second.candidates.push_back(std::move(candidate));
+					}
+				}
+				self->onClientCandidateInStrand(*c, success);
+			});
+}
+
+void Room::onClientCandidateInStrand(Client& client, bool success){
+	auto it = clients.find(&client);
+	if(it == clients.end()){
+		return;
+	}
+
 	if(!success){
 		std::cerr << "Error reading candidate, removing client "
 			<< client.getClientName() << std::endl;
 
-		clients.erase(&client);
+		clients.erase(it);
+		if(clients.empty()){
+			onEmpty(*this);
+		}
 		return;
 	}
 
 	std::cout << "Client candidate recieved" << std::endl;
 
-	for(auto& [c, cu] : clients){
+	for(auto& [c, member] : clients){
 		if(&client == c)
 			continue;
 
-		c->sendMsg(client.getCandidates().back());
+		c->sendMsg(it->second.candidates.back());
 	}
 
 	using namespace std::placeholders;
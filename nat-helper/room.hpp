@@ -39,22 +39,43 @@
 
 #include <map>
 #include <memory>
+#include <string>
+#include <vector>
+#include <asio.hpp>
 #include "client.hpp"
 
+/**
+ * Room state is accessed only from the strand of the shard owning the room.
+ */
 class Room : public std::enable_shared_from_this<Room>{
 public:
-	Room(std::string name);
+	using Strand = asio::strand<asio::io_context::executor_type>;
 
+	/**
+	 * @param onEmpty called from the strand when the last client leaves
+	 */
+	Room(std::string name, Strand strand, std::function<void(Room&)> onEmpty);
+
+	/// must be called from the strand
 	void addClient(std::shared_ptr<Client>&& client);
 
+	const std::string& getName() const { return name; }
 	bool isFull() const { return clients.size() >= 2; }
 	bool isEmpty() const { return clients.empty(); }
 
 private:
 	void onClientCandidate(Client& client, bool success);
+	void onClientCandidateInStrand(Client& client, bool success);
 
 	std::string name;
-	std::map<Client *, std::shared_ptr<Client>> clients;
+	Strand strand;
+	std::function<void(Room&)> onEmpty;
+
+	struct Member{
+		std::shared_ptr<Client> client;
+		std::vector<std::string> candidates; ///< copy owned by the strand
+	};
+	std::map<Client *, Member> clients;
 };
 
 #endif
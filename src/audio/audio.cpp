@@ -362,10 +362,6 @@ struct state_audio * audio_cfg_init(struct module *parent,
                 if(ret > 0) {
                         goto error;
                 }
-                size_t len = sizeof(struct rtp *);
-                audio_playback_ctl(s->audio_playback_device, AUDIO_PLAYBACK_PUT_NETWORK_DEVICE,
-                                        &s->audio_network_device, &len);
-
                 s->audio_tx_mode |= MODE_RECEIVER;
         } else {
                 s->audio_playback_device = audio_playback_init_null_device();
@@ -380,6 +376,12 @@ struct state_audio * audio_cfg_init(struct module *parent,
                 }
         }
 
+        if ((s->audio_tx_mode & MODE_RECEIVER) != 0U) {
+                size_t len = sizeof(struct rtp *);
+                audio_playback_ctl(s->audio_playback_device, AUDIO_PLAYBACK_PUT_NETWORK_DEVICE,
+                                        &s->audio_network_device, &len);
+        }
+
         if ((s->audio_tx_mode & MODE_SENDER) != 0U || "help"s == opt->codec_cfg) {
                 if ((s->audio_encoder = audio_codec_init_cfg(opt->codec_cfg, AUDIO_CODER)) == nullptr) {
                         goto error;
@@ -665,7 +667,7 @@ static void *audio_receiver_thread(void *arg)
                         time_ns_t curr_time = get_time_in_ns();
                         uint32_t ts = (curr_time - s->start_time) / 100'000 * 9; // at 90000 Hz
                         rtp_update(s->audio_network_device, curr_time);
-                        rtp_send_ctrl(s->audio_network_device, ts, 0, curr_time);
+                        rtp_send_ctrl(s->audio_network_device, get_local_mediatime(), 0, curr_time); // SR in media clock for A/V sync
                         struct timeval timeout;
                         timeout.tv_sec = 0;
                         // timeout.tv_usec = 999999 / 59.94; // audio goes almost always at the same rate
@@ -693,9 +695,17 @@ static void *audio_receiver_thread(void *arg)
                                         struct audio_decoder *dec_state;
                                         dec_state = (struct audio_decoder *) calloc(1, sizeof(struct audio_decoder));
 
-                                        if (get_commandline_param("low-latency-audio")) {
+                                        int pull_period = 0;
+                                        size_t pull_len = sizeof pull_period;
+                                        if (audio_playback_ctl(s->audio_playback_device, AUDIO_PLAYBACK_CTL_PULL, &pull_period, &pull_len)) {
+                                                // the device buffer absorbs the jitter, pass frames as soon as complete
+                                                pbuf_set_playout_delay(cp->playout_buffer, 0.001);
+                                        } else if (get_commandline_param("low-latency-audio")) {
                                                 pbuf_set_playout_delay(cp->playout_buffer, strcmp(get_commandline_param("low-latency-audio"), "ultra") == 0 ? 0.001 :0.005);
                                         }
+                                        if (s->receiver == NET_NATIVE) {
+                                                pbuf_set_av_sync(cp->playout_buffer, AV_SYNC_AUDIO);
+                                        }
                                         assert(dec_state != NULL);
                                         cp->decoder_state = dec_state;
                                         dec_state->enabled = true;
@@ -901,6 +911,9 @@ static struct response *audio_sender_process_message(struct state_audio *s, stru
                                 }
                         }
                         break;
+                case SENDER_MSG_ADD_FANOUT:
+                case SENDER_MSG_REMOVE_FANOUT:
+                        return new_response(RESPONSE_NOT_IMPL, NULL);
         }
         return new_response(RESPONSE_OK, NULL);
 }
@@ -988,6 +1001,7 @@ static void *audio_sender_thread(void *arg)
         struct state_audio *s = (struct state_audio *) arg;
         struct audio_frame *buffer = NULL;
         audio_frame2_resampler resampler_state;
+        audio_frame2 bf_n; // kept across iterations to reuse its buffers
 
         printf("Audio sending started.\n");
 
@@ -1002,7 +1016,7 @@ static void *audio_sender_thread(void *arg)
                         time_ns_t curr_time = get_time_in_ns();
                         uint32_t ts = (curr_time - s->start_time) / 10'0000 * 9; // at 90000 Hz
                         rtp_update(s->audio_network_device, curr_time);
-                        rtp_send_ctrl(s->audio_network_device, ts, 0, curr_time);
+                        rtp_send_ctrl(s->audio_network_device, get_local_mediatime(), 0, curr_time); // SR in media clock for A/V sync
 
                         // receive RTCP
                         struct timeval timeout;
@@ -1030,7 +1044,7 @@ static void *audio_sender_thread(void *arg)
 
                         s->filter_chain.filter(&buffer);
 
-                        audio_frame2 bf_n(buffer);
+                        bf_n.assign(buffer);
 
                         // RESAMPLE
                         int resample_to = s->resample_to;
@@ -1056,6 +1070,7 @@ static void *audio_sender_thread(void *arg)
                                                 to_send = s->fec_state->encode(to_send);
                                         }
                                         audio_tx_send(s->tx_session, s->audio_network_device, &to_send);
+                                        audio_codec_recycle(s->audio_encoder, std::move(to_send));
                                         uncompressed = NULL;
                                 }
                         }else if(s->sender == NET_STANDARD){
@@ -1063,6 +1078,7 @@ static void *audio_sender_thread(void *arg)
                             while (audio_frame2 compressed = audio_codec_compress(s->audio_encoder, uncompressed)) {
                                     //TODO to be dynamic as a function of the selected codec, now only accepting mulaw without checking errors
                                     audio_tx_send_standard(s->tx_session, s->audio_network_device, &compressed);
+                                    audio_codec_recycle(s->audio_encoder, std::move(compressed));
                                     uncompressed = NULL;
                             }
                         }
@@ -75,6 +75,21 @@ extern int audio_init_state_ok;
  * @param[in] struct rtp *
  */
 #define AUDIO_PLAYBACK_PUT_NETWORK_DEVICE   3
+/**
+ * Queries amount of audio buffered in the device and waiting for playback.
+ * Optional, used by the receiver adaptive jitter buffer to track the fill
+ * level. May be called from a different thread than the one calling putf.
+ * @param[out] int buffered samples (per channel)
+ */
+#define AUDIO_PLAYBACK_CTL_QUERY_FILL       4
+/**
+ * Queries whether the device works in pull mode (--param audio-playback-pull) -
+ * its callback consumes the audio directly from a lock-free buffer, so the
+ * receiver should pass frames as soon as they are complete and keep the device
+ * buffer at network jitter plus one period. Optional.
+ * @param[out] int device period (callback length) in samples, 0 if not yet known
+ */
+#define AUDIO_PLAYBACK_CTL_PULL             5
 /// @}
 
 struct audio_playback_info {
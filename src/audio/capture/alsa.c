@@ -68,6 +68,7 @@
 #include <alsa/asoundlib.h>
 
 #define MOD_NAME "[ALSA cap.] "
+#define MMAP_WAIT_TIMEOUT_MS 100
 
 struct state_alsa_capture {
         snd_pcm_t *handle;
@@ -81,6 +82,11 @@ struct state_alsa_capture {
         long long int captured_samples;
 
         bool non_interleaved;
+
+        bool mmap; ///< read directly from the device ring buffer
+        char *frame_data; ///< allocated frame data, frame.data may point to the mmap area
+        snd_pcm_uframes_t mmap_offset;
+        snd_pcm_uframes_t mmap_frames; ///< frames returned by last read, committed by the next one
 };
 
 static void audio_cap_alsa_probe(struct device_info **available_devices, int *count)
@@ -111,6 +117,7 @@ static void * audio_cap_alsa_init(const char *cfg)
                 color_printf(TERM_BOLD "\t-s alsa:opts=<opts>\n\n" TERM_RESET);
                 color_printf(TERM_BOLD "\t<opts>" TERM_RESET " can be in format key1=value1:key2=value2, options are:\n");
                 color_printf(TERM_BOLD "\t\tframes=<frames>" TERM_RESET " number of audio frames captured at a moment\n");
+                color_printf(TERM_BOLD "\t\tmmap" TERM_RESET " pass the samples directly from the device ring buffer (interleaved access only)\n");
 
                 printf("\nAvailable ALSA capture devices\n");
                 audio_cap_alsa_help(NULL);
@@ -155,6 +162,8 @@ static void * audio_cap_alsa_init(const char *cfg)
                 while ((item = strtok_r(opts, ":", &save_ptr)) != NULL) {
                         if (strncmp(item, "frames=", strlen("frames=")) == 0) {
                                 s->frames = atoi(item + strlen("frames="));
+                        } else if (strcmp(item, "mmap") == 0) {
+                                s->mmap = true;
                         } else {
                                 fprintf(stderr, "[ALSA cap.] Unknown option: %s\n", item);
                                 goto error;
@@ -213,7 +222,13 @@ static void * audio_cap_alsa_init(const char *cfg)
                 }
         }
 
-        if (!snd_pcm_hw_params_test_access(s->handle, params, SND_PCM_ACCESS_RW_INTERLEAVED)) {
+        if (s->mmap && snd_pcm_hw_params_test_access(s->handle, params, SND_PCM_ACCESS_MMAP_INTERLEAVED) != 0) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Mmap interleaved access not supported, using read.\n");
+                s->mmap = false;
+        }
+        if (s->mmap) {
+                s->non_interleaved = false;
+        } else if (!snd_pcm_hw_params_test_access(s->handle, params, SND_PCM_ACCESS_RW_INTERLEAVED)) {
                 s->non_interleaved = false;
         } else if (!snd_pcm_hw_params_test_access(s->handle, params, SND_PCM_ACCESS_RW_NONINTERLEAVED)) {
                 if (s->frame.ch_count > 1) {
@@ -232,7 +247,7 @@ static void * audio_cap_alsa_init(const char *cfg)
         /* Set the desired hardware parameters. */
 
         /* Access mode */
-        rc = snd_pcm_hw_params_set_access(s->handle, params,
+        rc = snd_pcm_hw_params_set_access(s->handle, params, s->mmap ? SND_PCM_ACCESS_MMAP_INTERLEAVED :
                 s->non_interleaved ? SND_PCM_ACCESS_RW_NONINTERLEAVED : SND_PCM_ACCESS_RW_INTERLEAVED);
         if (rc < 0) {
                 fprintf(stderr, MOD_NAME "unable to set interleaved mode: %s\n",
@@ -306,7 +321,7 @@ static void * audio_cap_alsa_init(const char *cfg)
         /* Use a buffer large enough to hold one period */
         snd_pcm_hw_params_get_period_size(params, &s->frames, &dir);
         s->frame.max_size = s->frames  * s->frame.ch_count * s->frame.bps;
-        s->frame.data = (char *) malloc(s->frame.max_size);
+        s->frame.data = s->frame_data = (char *) malloc(s->frame.max_size);
 
         s->tmp_data = malloc(s->frames  * s->min_device_channels * s->frame.bps);
 
@@ -314,6 +329,9 @@ static void * audio_cap_alsa_init(const char *cfg)
                        "%ld samples per frame.\n", s->frame.ch_count,
                        s->frame.ch_count == 1 ? "" : "s", s->frame.bps,
                        s->frame.sample_rate, s->frames);
+        if (s->mmap) {
+                log_msg(LOG_LEVEL_INFO, MOD_NAME "Using mmap access.\n");
+        }
 
         free(tmp);
         return s;
@@ -324,12 +342,97 @@ error:
         return NULL;
 }
 
+static bool handle_mmap_error(struct state_alsa_capture *s, int rc)
+{
+        if (rc == -EPIPE) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "overrun occurred\n");
+        } else {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "error from mmap read: %s\n", snd_strerror(rc));
+                if (rc == -ENODEV) {
+                        log_msg(LOG_LEVEL_FATAL, MOD_NAME "Device removed, exiting!\n");
+                        exit_uv(EXIT_FAIL_AUDIO);
+                        return false;
+                }
+        }
+        return snd_pcm_recover(s->handle, rc, 1) == 0;
+}
+
+/**
+ * Waits for a period and returns frame pointing directly to the device
+ * buffer. The area is returned to the device with next call.
+ */
+static struct audio_frame *audio_cap_alsa_read_mmap(struct state_alsa_capture *s)
+{
+        if (s->mmap_frames > 0) {
+                snd_pcm_sframes_t committed = snd_pcm_mmap_commit(s->handle, s->mmap_offset, s->mmap_frames);
+                s->mmap_frames = 0;
+                if (committed < 0) {
+                        handle_mmap_error(s, committed);
+                        return NULL;
+                }
+        }
+        if (snd_pcm_state(s->handle) == SND_PCM_STATE_PREPARED) {
+                int rc = snd_pcm_start(s->handle);
+                if (rc < 0) {
+                        handle_mmap_error(s, rc);
+                        return NULL;
+                }
+        }
+
+        snd_pcm_sframes_t avail = snd_pcm_avail_update(s->handle);
+        if (avail >= 0 && avail < (snd_pcm_sframes_t) s->frames) {
+                int rc = snd_pcm_wait(s->handle, MMAP_WAIT_TIMEOUT_MS);
+                if (rc <= 0) {
+                        if (rc < 0) {
+                                handle_mmap_error(s, rc);
+                        }
+                        return NULL;
+                }
+                avail = snd_pcm_avail_update(s->handle);
+        }
+        if (avail < 0) {
+                handle_mmap_error(s, avail);
+                return NULL;
+        }
+
+        const snd_pcm_channel_area_t *areas = NULL;
+        snd_pcm_uframes_t offset = 0;
+        snd_pcm_uframes_t frames = s->frames; // may be shortened at the end of the ring
+        int rc = snd_pcm_mmap_begin(s->handle, &areas, &offset, &frames);
+        if (rc < 0) {
+                handle_mmap_error(s, rc);
+                return NULL;
+        }
+        char *src = (char *) areas[0].addr + (areas[0].first + offset * areas[0].step) / 8;
+        s->mmap_offset = offset;
+        s->mmap_frames = frames;
+
+        if ((int) s->min_device_channels > s->frame.ch_count && s->frame.ch_count == 1) {
+                demux_channel(s->frame_data, src, s->frame.bps,
+                                frames * s->frame.bps * s->min_device_channels,
+                                s->min_device_channels, 0);
+                s->frame.data = s->frame_data;
+        } else {
+                s->frame.data = src;
+        }
+        s->frame.data_len = frames * s->frame.bps * s->frame.ch_count;
+        if (s->frame.bps == 1) {
+                signed2unsigned(s->frame.data, s->frame.data, s->frame.data_len);
+        }
+        s->captured_samples += frames;
+        return &s->frame;
+}
+
 static struct audio_frame *audio_cap_alsa_read(void *state)
 {
         struct state_alsa_capture *s = (struct state_alsa_capture *) state;
         int rc;
         char *discard_data;
 
+        if (s->mmap) {
+                return audio_cap_alsa_read_mmap(s);
+        }
+
         char *read_ptr[s->min_device_channels];
         read_ptr[0] = s->frame.data;
         if((int) s->min_device_channels > s->frame.ch_count && s->frame.ch_count == 1) {
@@ -392,7 +495,7 @@ static void audio_cap_alsa_done(void *state)
                         s->captured_samples / tv_diff(t, s->start_time));
         snd_pcm_drop(s->handle);
         snd_pcm_close(s->handle);
-        free(s->frame.data);
+        free(s->frame_data);
         free(s->tmp_data);
         free(s);
 }
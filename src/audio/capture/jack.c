@@ -99,7 +99,8 @@ static int jack_process_callback(jack_nframes_t nframes, void *arg)
                 mux_channel(s->tmp, (char *) in, sizeof(int32_t), channel_size, s->frame.ch_count, i, 1.0);
         }
 
-        ring_buffer_write(s->data, s->tmp, channel_size * s->frame.ch_count);
+        // RT context - no locking or printing, overflows are reported by the reader
+        ring_buffer_try_write(s->data, s->tmp, channel_size * s->frame.ch_count);
 
         return 0;
 }
@@ -271,6 +272,11 @@ static struct audio_frame *audio_cap_jack_read(void *state)
 {
         struct state_jack_capture *s = (struct state_jack_capture *) state;
 
+        long long dropped = ring_buffer_fetch_dropped(s->data);
+        if (dropped > 0) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Buffer overflow, dropped %lld B!\n", dropped);
+        }
+
         s->frame.data_len = ring_buffer_read(s->data, s->frame.data, s->frame.max_size);
         float2int((char *) s->frame.data, (char *) s->frame.data, s->frame.max_size);
 
@@ -277,11 +277,12 @@ static int callback( const void *inputBuffer, void *outputBuffer,
         UNUSED(timeInfo);
         UNUSED(statusFlags);
 
-        pthread_mutex_lock(&s->lock);
-        ring_buffer_write(s->buffer, inputBuffer, framesPerBuffer * s->frame.ch_count *
+        /* The callback doesn't take the lock to avoid priority inversion with
+         * the reader. If the signal is missed because the reader is just about
+         * to wait, it is woken by the next callback. */
+        ring_buffer_try_write(s->buffer, inputBuffer, framesPerBuffer * s->frame.ch_count *
                         s->frame.bps);
         pthread_cond_signal(&s->cv);
-        pthread_mutex_unlock(&s->lock);
 
         return paContinue;
 
@@ -295,6 +296,11 @@ static struct audio_frame * audio_cap_portaudio_read(void *state)
 
         int ret = 0; 
 
+        long long dropped = ring_buffer_fetch_dropped(s->buffer);
+        if (dropped > 0) {
+                log_msg(LOG_LEVEL_WARNING, MODULE_NAME "Buffer overflow, dropped %lld B!\n", dropped);
+        }
+
         pthread_mutex_lock(&s->lock);
         while((ret = ring_buffer_read(s->buffer, s->frame.data, s->frame.max_size)) == 0) {
                 pthread_cond_wait(&s->cv, &s->lock);
@@ -32,6 +32,7 @@
 #endif
 
 #include <audioclient.h>
+#include <avrt.h>
 #include <iomanip>
 #include <iostream>
 #include <mfapi.h>
@@ -76,11 +77,15 @@ struct state_acap_wasapi {
         IAudioClient *pAudioClient;
         IAudioCaptureClient *pCaptureClient;
         UINT32 bufferSize;
+        HANDLE event;       ///< signalled by WASAPI when a period of data is ready
+        bool mmcss_registered;
 };
 
 static string get_name(IMMDevice *pDevice);
 static void show_help();
 string wasapi_get_default_device_id(EDataFlow dataFlow, IMMDeviceEnumerator *enumerator);
+HRESULT wasapi_init_audio_client(IMMDevice *pDevice, IAudioClient **pAudioClient, const WAVEFORMATEX *pwfx,
+                bool exclusive, int period_ms, REFERENCE_TIME buffer_duration, HANDLE event);
 
 #define SAFE_RELEASE(u) \
     do { if ((u) != NULL) (u)->Release(); (u) = NULL; } while(0)
@@ -180,9 +185,59 @@ string wasapi_get_default_device_id(EDataFlow dataFlow, IMMDeviceEnumerator *enu
         return ret;
 }
 
+/**
+ * Initializes the audio client in the event-driven mode (shared for both
+ * capture and playback).
+ *
+ * In the exclusive mode, the buffer is a single device period (the minimal one
+ * if period_ms is 0), which is where the low latency comes from. If the device
+ * requires an aligned buffer size, the client is re-activated and initialized
+ * with the aligned period (as documented for IAudioClient::Initialize).
+ *
+ * @param buffer_duration  buffer length used in the shared mode
+ */
+HRESULT wasapi_init_audio_client(IMMDevice *pDevice, IAudioClient **pAudioClient, const WAVEFORMATEX *pwfx,
+                bool exclusive, int period_ms, REFERENCE_TIME buffer_duration, HANDLE event)
+{
+        const AUDCLNT_SHAREMODE mode = exclusive ? AUDCLNT_SHAREMODE_EXCLUSIVE : AUDCLNT_SHAREMODE_SHARED;
+        if (exclusive) {
+                REFERENCE_TIME default_period = 0;
+                REFERENCE_TIME min_period = 0;
+                HRESULT hr = (*pAudioClient)->GetDevicePeriod(&default_period, &min_period);
+                if (FAILED(hr)) {
+                        return hr;
+                }
+                buffer_duration = period_ms * REFTIMES_PER_MILLISEC > min_period ? period_ms * REFTIMES_PER_MILLISEC : min_period;
+        }
+        HRESULT hr = (*pAudioClient)->Initialize(mode, AUDCLNT_STREAMFLAGS_EVENTCALLBACK, buffer_duration,
+                        exclusive ? buffer_duration : 0, pwfx, NULL);
+        if (hr == AUDCLNT_E_BUFFER_SIZE_NOT_ALIGNED) {
+                UINT32 frames = 0;
+                if (FAILED(hr = (*pAudioClient)->GetBufferSize(&frames))) {
+                        return hr;
+                }
+                buffer_duration = (REFERENCE_TIME) ((double) REFTIMES_PER_SEC * frames / pwfx->nSamplesPerSec + 0.5);
+                SAFE_RELEASE(*pAudioClient);
+                if (FAILED(hr = pDevice->Activate(IID_IAudioClient, CLSCTX_ALL, NULL, (void **) pAudioClient))) {
+                        return hr;
+                }
+                hr = (*pAudioClient)->Initialize(mode, AUDCLNT_STREAMFLAGS_EVENTCALLBACK, buffer_duration,
+                                buffer_duration, pwfx, NULL);
+        }
+        if (FAILED(hr)) {
+                return hr;
+        }
+        if (exclusive) {
+                LOG(LOG_LEVEL_INFO) << "[WASAPI] Exclusive mode, period " << buffer_duration / (double) REFTIMES_PER_MILLISEC << " ms\n";
+        }
+        return (*pAudioClient)->SetEventHandle(event);
+}
+
 static void show_help() {
         cout << "Usage:\n" <<
-                style::bold << fg::red << "\t-s wasapi" << fg::reset << "[:<index>|:<ID>]\n" << style::reset <<
+                style::bold << fg::red << "\t-s wasapi" << fg::reset << "[:<index>|:<ID>][:exclusive][:period=<ms>]\n" << style::reset <<
+                style::bold << "\texclusive" << style::reset << " - use the device exclusively (lower latency, the format must be supported by the device)\n" <<
+                style::bold << "\tperiod" << style::reset << " - device period in the exclusive mode (default is the minimal one)\n" <<
                 "\nAvailable devices:\n";
 
         HRESULT hr = CoInitializeEx(NULL, COINIT_MULTITHREADED);
@@ -225,16 +280,30 @@ static void * audio_cap_wasapi_init(const char *cfg)
         wchar_t deviceID[1024] = L"";
         WAVEFORMATEX *pwfx = NULL;
         int index = -1;
+        bool exclusive = false;
+        int period_ms = 0;
         if (cfg && strlen(cfg) > 0) {
                 if (strcmp(cfg, "help") == 0) {
                         show_help();
                         return &audio_init_state_ok;
                 }
-                if (isdigit(cfg[0])) {
-                        index = atoi(cfg);
-                } else {
-                        mbtowc(deviceID, cfg, (sizeof deviceID / 2) - 1);
+                char *tmp = strdup(cfg);
+                char *save_ptr = nullptr;
+                char *item = nullptr;
+                char *fmt = tmp;
+                while ((item = strtok_r(fmt, ":", &save_ptr)) != nullptr) {
+                        fmt = nullptr;
+                        if (strcmp(item, "exclusive") == 0) {
+                                exclusive = true;
+                        } else if (strncmp(item, "period=", strlen("period=")) == 0) {
+                                period_ms = atoi(item + strlen("period="));
+                        } else if (isdigit(item[0])) {
+                                index = atoi(item);
+                        } else {
+                                mbstowcs(deviceID, item, (sizeof deviceID / sizeof deviceID[0]) - 1);
+                        }
                 }
+                free(tmp);
         }
         HRESULT hr = CoInitializeEx(NULL, COINIT_MULTITHREADED);
         if (hr != S_OK && hr != S_FALSE) {
@@ -279,7 +348,7 @@ static void * audio_cap_wasapi_init(const char *cfg)
                                 << friendlyName << "\n";
                 }
 
-                REFERENCE_TIME hnsRequestedDuration = REFTIMES_PER_SEC;
+                REFERENCE_TIME hnsRequestedDuration = REFTIMES_PER_SEC; // shared mode only
                 // get the mixer format
                 THROW_IF_FAILED(s->pAudioClient->GetMixFormat(&pwfx));
                 // set our preferences
@@ -324,13 +393,18 @@ static void * audio_cap_wasapi_init(const char *cfg)
                                 throw ug_runtime_error(oss.str());
                 }
 
-                THROW_IF_FAILED(s->pAudioClient->Initialize(
-                         AUDCLNT_SHAREMODE_SHARED,
-                         0,
-                         hnsRequestedDuration,
-                         0,
-                         pwfx,
-                         NULL));
+                if (exclusive && s->pAudioClient->IsFormatSupported(AUDCLNT_SHAREMODE_EXCLUSIVE, pwfx, NULL) != S_OK) {
+                        ostringstream oss;
+                        oss << "Format " << pwfx->nChannels << " ch, " << pwfx->nSamplesPerSec << " Hz, "
+                                << pwfx->wBitsPerSample << " bits not supported in exclusive mode";
+                        throw ug_runtime_error(oss.str());
+                }
+                s->event = CreateEvent(NULL, FALSE, FALSE, NULL);
+                if (s->event == NULL) {
+                        throw ug_runtime_error("Cannot create event");
+                }
+                THROW_IF_FAILED(wasapi_init_audio_client(s->pDevice, &s->pAudioClient, pwfx, exclusive, period_ms,
+                                        hnsRequestedDuration, s->event));
 
                 UINT32 bufferFrameCount;
                 THROW_IF_FAILED(s->pAudioClient->GetBufferSize(&bufferFrameCount));
@@ -360,8 +434,19 @@ static void * audio_cap_wasapi_init(const char *cfg)
 
 static void audio_cap_wasapi_done(void *state)
 {
+        auto s = static_cast<state_acap_wasapi *>(state);
+        if (s->pAudioClient != nullptr) {
+                s->pAudioClient->Stop();
+        }
+        SAFE_RELEASE(s->pCaptureClient);
+        SAFE_RELEASE(s->pAudioClient);
+        SAFE_RELEASE(s->pDevice);
+        if (s->event != NULL) {
+                CloseHandle(s->event);
+        }
+        free(s->frame.data);
         CoUninitialize();
-        delete static_cast<state_acap_wasapi *>(state);
+        delete s;
 }
 
 #define FAIL_IF_NOT(cmd) do {HRESULT hr = cmd; if (hr != S_OK) { LOG(LOG_LEVEL_ERROR) << MOD_NAME << #cmd << ": " << hresult_to_str(hr) << "\n"; return nullptr;}} while(0)
@@ -369,10 +454,18 @@ static struct audio_frame *audio_cap_wasapi_read(void *state)
 {
         auto s = static_cast<state_acap_wasapi *>(state);
 
+        if (!s->mmcss_registered) { // read is called from the capture thread
+                DWORD task_index = 0;
+                s->mmcss_registered = true;
+                if (AvSetMmThreadCharacteristicsW(L"Pro Audio", &task_index) == NULL) {
+                        LOG(LOG_LEVEL_WARNING) << MOD_NAME << "Cannot register thread to MMCSS: " << GetLastError() << "\n";
+                }
+        }
+
         UINT32 packetLength = 0;
         FAIL_IF_NOT(s->pCaptureClient->GetNextPacketSize(&packetLength));
         if (packetLength == 0) {
-                Sleep(10);
+                WaitForSingleObject(s->event, 100);
         }
 
         FAIL_IF_NOT(s->pCaptureClient->GetNextPacketSize(&packetLength));
@@ -44,7 +44,9 @@
 #include "audio/codec.h"
 #include "audio/utils.h"
 #include "debug.h"
+#include "host.h"
 #include "utils/misc.h"
+#include "utils/worker.h"
 
 #include "lib_common.h"
 #include "rang.hpp"
@@ -52,6 +54,7 @@
 #include <algorithm>
 #include <climits>
 #include <unordered_map>
+#include <vector>
 
 static constexpr const char *MOD_NAME = "[acodec] ";
 
@@ -75,6 +78,15 @@ static const unordered_map<audio_codec_t, audio_codec_info_t, hash<int>> audio_c
 static struct audio_codec_state *audio_codec_init_real(const char *audio_codec_cfg,
                 audio_codec_direction_t direction, bool try_init);
 
+struct audio_codec_state;
+
+/// Processes channels first, first + step, ... with their own coder states
+struct audio_codec_job {
+        struct audio_codec_state *s;
+        int first;
+        int step;
+};
+
 struct audio_codec_state {
         void **state;
         int state_count;
@@ -82,8 +94,19 @@ struct audio_codec_state {
         audio_desc desc;
         audio_codec_direction_t direction;
         int bitrate;
+
+        int threads;                     ///< max channels coded in parallel
+        bool compress;                   ///< direction of the current run
+        vector<audio_channel> in;        ///< per-channel input of the current run
+        vector<bool> has_input;
+        vector<audio_channel *> out;     ///< per-channel result of the current run
+        vector<audio_codec_job> jobs;
+        audio_frame2_pool pool;          ///< returned frames, see audio_codec_recycle()
 };
 
+ADD_TO_PARAM("audio-codec-threads", "* audio-codec-threads=<n>\n"
+                "  Maximal number of channels encoded/decoded in parallel (default: number of CPU cores, 1 - disable)\n");
+
 std::vector<std::pair<std::string, bool>> get_audio_codec_list(void){
         std::vector<std::pair<std::string, bool>> ret;
 
@@ -171,7 +194,7 @@ static struct audio_codec_state *audio_codec_init_real(const char *audio_codec_c
                 return NULL;
         }
 
-        struct audio_codec_state *s = (struct audio_codec_state *) calloc(1, sizeof(struct audio_codec_state));
+        auto *s = new audio_codec_state{};
 
         s->state = (void **) calloc(1, sizeof(void*));
         s->state[0] = state;
@@ -180,10 +203,47 @@ static struct audio_codec_state *audio_codec_init_real(const char *audio_codec_c
         s->desc.codec = audio_codec;
         s->direction = direction;
         s->bitrate = bitrate;
+        s->threads = get_cpu_core_count();
+        if (const char *threads = get_commandline_param("audio-codec-threads")) {
+                s->threads = max(atoi(threads), 1);
+        }
 
         return s;
 }
 
+static void *audio_codec_run_job(void *arg)
+{
+        auto *j = static_cast<audio_codec_job *>(arg);
+        struct audio_codec_state *s = j->s;
+        for (int i = j->first; i < (int) s->out.size(); i += j->step) {
+                s->out[i] = s->compress
+                        ? s->funcs->compress(s->state[i], s->has_input[i] ? &s->in[i] : nullptr)
+                        : s->funcs->decompress(s->state[i], &s->in[i]);
+        }
+        return nullptr;
+}
+
+/**
+ * Codes channels prepared in s->in, results are stored in s->out in channel
+ * order. Coder states of the channels are independent, so the channels are
+ * distributed to a worker pool. PCM is just copied so it is not worth it.
+ */
+static void audio_codec_run(struct audio_codec_state *s, int ch_count, bool compress)
+{
+        s->compress = compress;
+        s->out.assign(ch_count, nullptr);
+        int workers = s->desc.codec == AC_PCM ? 1 : min(s->threads, ch_count);
+        s->jobs.resize(workers);
+        for (int i = 0; i < workers; ++i) {
+                s->jobs[i] = { s, i, workers };
+        }
+        if (workers == 1) {
+                audio_codec_run_job(s->jobs.data());
+                return;
+        }
+        task_run_parallel(audio_codec_run_job, workers, s->jobs.data(), sizeof s->jobs[0], nullptr);
+}
+
 struct audio_codec_state *audio_codec_reconfigure(struct audio_codec_state *old,
                 audio_codec_t audio_codec, audio_codec_direction_t direction)
 {
@@ -224,17 +284,20 @@ audio_frame2 audio_codec_compress(struct audio_codec_state *s, const audio_frame
                 s->desc.sample_rate = frame->get_sample_rate();
         }
 
-        audio_frame2 res;
+        audio_frame2 res = s->pool.get();
+
+        s->in.resize(s->desc.ch_count);
+        s->has_input.assign(s->desc.ch_count, frame != nullptr);
+        if (frame) {
+                for (int i = 0; i < s->desc.ch_count; ++i) {
+                        audio_channel_demux(frame, i, &s->in[i]);
+                }
+        }
+        audio_codec_run(s, s->desc.ch_count, true);
 
-        audio_channel channel;
         int nonzero_channels = 0;
         for (int i = 0; i < s->desc.ch_count; ++i) {
-                audio_channel *encode_channel = NULL;
-                if(frame) {
-                        audio_channel_demux(frame, i, &channel);
-                        encode_channel = &channel;
-                }
-                audio_channel *out = s->funcs->compress(s->state[i], encode_channel);
+                audio_channel *out = s->out[i];
                 if (out == nullptr) {
                         continue;
                 }
@@ -250,6 +313,7 @@ audio_frame2 audio_codec_compress(struct audio_codec_state *s, const audio_frame
         }
 
         if (nonzero_channels == 0) {
+                s->pool.put(std::move(res));
                 return {};
         }
         return res;
@@ -275,13 +339,18 @@ audio_frame2 audio_codec_decompress(struct audio_codec_state *s, audio_frame2 *f
         }
 #endif
 
-        audio_frame2 ret;
-        audio_channel channel;
+        audio_frame2 ret = s->pool.get();
+        s->in.resize(frame->get_channel_count());
+        s->has_input.assign(frame->get_channel_count(), true);
+        for (int i = 0; i < frame->get_channel_count(); ++i) {
+                audio_channel_demux(frame, i, &s->in[i]);
+        }
+        audio_codec_run(s, frame->get_channel_count(), false);
+
         int nonzero_channels = 0;
         bool out_frame_initialized = false;
         for (int i = 0; i < frame->get_channel_count(); ++i) {
-                audio_channel_demux(frame, i, &channel);
-                audio_channel *out = s->funcs->decompress(s->state[i], &channel);
+                audio_channel *out = s->out[i];
                 if (out) {
                         if (!out_frame_initialized) {
                                 ret.init(frame->get_channel_count(), AC_PCM, out->bps, out->sample_rate);
@@ -297,6 +366,7 @@ audio_frame2 audio_codec_decompress(struct audio_codec_state *s, audio_frame2 *f
 
         if(nonzero_channels != frame->get_channel_count()) {
                 fprintf(stderr, "[Audio decompress] Empty channel returned !\n");
+                s->pool.put(std::move(ret));
                 return {};
         }
         int max_len = 0;
@@ -315,6 +385,16 @@ audio_frame2 audio_codec_decompress(struct audio_codec_state *s, audio_frame2 *f
         return ret;
 }
 
+/**
+ * Returns a frame obtained from audio_codec_compress() or
+ * audio_codec_decompress() that is no longer needed, so that its buffers are
+ * reused for the next frame instead of reallocating.
+ */
+void audio_codec_recycle(struct audio_codec_state *s, audio_frame2 &&frame)
+{
+        s->pool.put(std::move(frame));
+}
+
 const int *audio_codec_get_supported_samplerates(struct audio_codec_state *s)
 {
         return s->funcs->get_samplerates(s->state[0]);
@@ -329,7 +409,7 @@ void audio_codec_done(struct audio_codec_state *s)
         }
         free(s->state);
 
-        free(s);
+        delete s;
 }
 
 audio_codec_t get_audio_codec(const char *codec_str) {
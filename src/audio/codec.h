@@ -84,6 +84,7 @@ struct audio_codec_state *audio_codec_reconfigure(struct audio_codec_state *old,
                 audio_codec_t audio_codec, audio_codec_direction_t);
 audio_frame2 audio_codec_compress(struct audio_codec_state *, const audio_frame2 *);
 audio_frame2 audio_codec_decompress(struct audio_codec_state *, audio_frame2 *);
+void audio_codec_recycle(struct audio_codec_state *, audio_frame2 &&frame);
 const int *audio_codec_get_supported_samplerates(struct audio_codec_state *);
 void audio_codec_done(struct audio_codec_state *);
 
@@ -35,7 +35,6 @@
  * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
-
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #include "config_unix.h"
@@ -48,16 +47,23 @@
 #include "echo.h"
 
 #include <speex/speex_echo.h>
+#include <speex/speex_preprocess.h>
 
 #include <stdlib.h>
+#include <atomic>
+#include <condition_variable>
 #include <mutex>
 #include <memory>
 #include <algorithm>
 #include <chrono>
+#include <thread>
 #include "utils/ring_buffer.h"
+#include "utils/thread.h"
 #include "host.h"
 
-#define SAMPLES_PER_FRAME (1 << 9) //512, about 10ms at 48kHz, power of two for easy FFT
+#define DEFAULT_BLOCK_SIZE (1 << 8) //256, about 5ms at 48kHz, power of two for easy FFT
+#define MIN_BLOCK_SIZE 32
+#define MAX_BLOCK_SIZE 4096
 #define DEFAULT_FILTER_LENGTH (48 * 500)
 
 #define MOD_NAME "[Echo cancel] "
@@ -75,6 +81,10 @@ namespace {
                 void operator()(SpeexEchoState* echo) { speex_echo_state_destroy(echo); }
         };
 
+        struct Preprocess_state_deleter{
+                void operator()(SpeexPreprocessState* pp) { speex_preprocess_state_destroy(pp); }
+        };
+
         struct Export_state_deleter{
                 void operator()(struct audio_export* e) { audio_export_destroy(e); }
         };
@@ -82,31 +92,119 @@ namespace {
         constexpr duration get_expected_duration(int samples, int sample_rate){
                 return std::chrono::microseconds((static_cast<long long>(samples) * 1'000'000) / sample_rate);
         }
+
+        /**
+         * Writes samples to ring buffer converting them to 16 bits. Never
+         * overwrites unread data, so it can be used by the producer while the
+         * consumer reads.
+         *
+         * @returns number of samples written
+         */
+        int write_samples_s16(ring_buffer_t *ring, const char *in, int in_bps, int samples){
+                void *ptr1;
+                int size1;
+                void *ptr2;
+                int size2;
+                int written = ring_get_free_write_regions(ring, samples * 2,
+                                &ptr1, &size1, &ptr2, &size2);
+                assert(size1 % 2 == 0);
+                int in_bytes1 = (size1 / 2) * in_bps;
+                change_bps(static_cast<char *>(ptr1), 2, in, in_bps, in_bytes1);
+                if(size2 > 0){
+                        change_bps(static_cast<char *>(ptr2), 2, in + in_bytes1, in_bps, (size2 / 2) * in_bps);
+                }
+                ring_advance_write_idx(ring, written);
+                return written / 2;
+        }
+
+        /// Discards all currently readable data - must be called from the reader
+        void drain(ring_buffer_t *ring, int granularity = 1){
+                int current = ring_get_current_size(ring);
+                ring_advance_read_idx(ring, current / granularity * granularity);
+        }
 }
 
+/**
+ * The cancellation itself runs in a dedicated thread (aec_worker()):
+ *
+ * - far end (playback) thread only writes to far_end_ringbuf, it never
+ *   locks nor waits for the other threads
+ * - capture thread writes to near_end_ringbuf, wakes the worker and collects
+ *   the processed samples from out_ringbuf, waiting at most max_wait
+ * - the worker is the only reader of both far_end_ringbuf and
+ *   near_end_ringbuf, the actions requiring reader side (dropping far end
+ *   samples) are requested by the capture thread via atomics
+ *
+ * The mutex and condition variables are used only between capture thread and
+ * the worker.
+ */
 struct echo_cancellation {
         std::unique_ptr<SpeexEchoState, Echo_state_deleter> echo_state;
+        std::unique_ptr<SpeexPreprocessState, Preprocess_state_deleter> preprocess_state;
 
         std::unique_ptr<ring_buffer_t, Ring_buf_deleter> near_end_ringbuf;
         std::unique_ptr<ring_buffer_t, Ring_buf_deleter> far_end_ringbuf;
+        std::unique_ptr<ring_buffer_t, Ring_buf_deleter> out_ringbuf;
 
         std::unique_ptr<spx_int16_t[]> frame_data;
         struct audio_frame frame;
 
+        std::unique_ptr<spx_int16_t[]> near_block; ///< worker's buffers
+        std::unique_ptr<spx_int16_t[]> far_block;
+        std::unique_ptr<spx_int16_t[]> out_block;
+
+        int block_size = DEFAULT_BLOCK_SIZE;
+        int filter_length = DEFAULT_FILTER_LENGTH;
+        bool residual_suppression = false;
+        duration max_wait{};
+
         int requested_delay;
-        int prefill;
+        std::atomic<int> prefill;
+        std::atomic<bool> drop_far_end{false};
         time_point next_expected_near;
 
         std::unique_ptr<struct audio_export, Export_state_deleter> exporter;
 
+        std::thread worker;
         std::mutex lock;
+        std::condition_variable work_cv;
+        std::condition_variable done_cv;
+        bool should_exit = false;
+        bool work_pending = false;
+        unsigned long long blocks_done = 0; ///< protected by lock
 };
 
 ADD_TO_PARAM("echo-cancel-dump-audio", "* echo-cancel-dump-audio\n"
                 "  Dump near end, far end and output samples in separate channels to a wav file.\n");
 
+static void aec_worker(struct echo_cancellation *s);
+
+static void aec_worker_start(struct echo_cancellation *s)
+{
+        s->should_exit = false;
+        s->worker = std::thread(aec_worker, s);
+}
+
+static void aec_worker_stop(struct echo_cancellation *s)
+{
+        if(!s->worker.joinable()){
+                return;
+        }
+        {
+                std::lock_guard<std::mutex> lk(s->lock);
+                s->should_exit = true;
+        }
+        s->work_cv.notify_one();
+        s->worker.join();
+}
+
 static void reconfigure_echo (struct echo_cancellation *s, int sample_rate, int bps);
 
+/**
+ * Must be called with the worker stopped - the calling thread then acts as a
+ * reader of all ring buffers. The far end ring buffer may still be written to
+ * concurrently, so it is not flushed but drained.
+ */
 static void reconfigure_echo (struct echo_cancellation *s, int sample_rate, int bps)
 {
         UNUSED(bps);
@@ -115,11 +213,22 @@ static void reconfigure_echo (struct echo_cancellation *s, int sample_rate, int
         s->frame.ch_count = 1;
         s->frame.sample_rate = sample_rate;
 
-        ring_buffer_flush(s->far_end_ringbuf.get());
-        ring_buffer_flush(s->near_end_ringbuf.get());
+        drain(s->far_end_ringbuf.get());
+        drain(s->near_end_ringbuf.get());
+        drain(s->out_ringbuf.get());
 
+        speex_echo_state_reset(s->echo_state.get());
         speex_echo_ctl(s->echo_state.get(), SPEEX_ECHO_SET_SAMPLING_RATE, &sample_rate); // should the 3rd parameter be int?
 
+        if(s->residual_suppression){
+                s->preprocess_state.reset(speex_preprocess_state_init(s->block_size, sample_rate));
+                int off = 0;
+                speex_preprocess_ctl(s->preprocess_state.get(), SPEEX_PREPROCESS_SET_DENOISE, &off);
+                speex_preprocess_ctl(s->preprocess_state.get(), SPEEX_PREPROCESS_SET_ECHO_STATE, s->echo_state.get());
+        }
+
+        s->max_wait = get_expected_duration(s->block_size, sample_rate);
+
         if(get_commandline_param("echo-cancel-dump-audio")){
                 s->exporter.reset(nullptr); //previous file gets closed
                 s->exporter.reset(audio_export_init("echo_cancel_dump.wav"));
@@ -137,42 +246,60 @@ ADD_TO_PARAM("echo-cancel-filter-length", "* echo-cancel-filter-length=<samples>
 ADD_TO_PARAM("echo-cancel-delay", "* echo-cancel-delay=<samples>\n"
                 "  Echo cancellation additional delay added to far end in samples, should be slightly less than output device latency.\n");
 
-struct echo_cancellation * echo_cancellation_init(void)
-{
-        struct echo_cancellation *s = new echo_cancellation();
+ADD_TO_PARAM("echo-cancel-block", "* echo-cancel-block=<samples>\n"
+                "  Echo cancellation processing block size in samples (default " TEXTIFY(DEFAULT_BLOCK_SIZE) ", range "
+                TEXTIFY(MIN_BLOCK_SIZE) "-" TEXTIFY(MAX_BLOCK_SIZE) "). Smaller blocks lower the latency,\n"
+                "  power of two is recommended for FFT efficiency.\n");
 
-        int filter_length = DEFAULT_FILTER_LENGTH;
-        if(const char *param = get_commandline_param("echo-cancel-filter-length"); param != nullptr){
+ADD_TO_PARAM("echo-cancel-residual", "* echo-cancel-residual\n"
+                "  Additionally suppress residual echo with SpeexDSP preprocessor (higher quality, more CPU).\n");
+
+static int get_int_param(const char *name, int default_val)
+{
+        if(const char *param = get_commandline_param(name); param != nullptr){
                 char *end;
-                int len = strtol(param, &end, 10);
+                int val = strtol(param, &end, 10);
                 if(end != param)
-                        filter_length = len;
+                        return val;
         }
+        return default_val;
+}
 
-        if(const char *param = get_commandline_param("echo-cancel-delay"); param != nullptr){
-                char *end;
-                int len = strtol(param, &end, 10);
-                if(end != param)
-                        s->requested_delay = len;
+struct echo_cancellation * echo_cancellation_init(void)
+{
+        struct echo_cancellation *s = new echo_cancellation();
+
+        s->filter_length = get_int_param("echo-cancel-filter-length", DEFAULT_FILTER_LENGTH);
+        s->requested_delay = get_int_param("echo-cancel-delay", 0);
+        s->block_size = get_int_param("echo-cancel-block", DEFAULT_BLOCK_SIZE);
+        if(s->block_size < MIN_BLOCK_SIZE || s->block_size > MAX_BLOCK_SIZE){
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Block size %d out of range, using %d.\n", s->block_size, DEFAULT_BLOCK_SIZE);
+                s->block_size = DEFAULT_BLOCK_SIZE;
         }
+        s->residual_suppression = get_commandline_param("echo-cancel-residual") != nullptr;
 
-        s->echo_state.reset(speex_echo_state_init(SAMPLES_PER_FRAME, filter_length));
+        s->echo_state.reset(speex_echo_state_init(s->block_size, s->filter_length));
+        s->near_block = std::make_unique<spx_int16_t[]>(s->block_size);
+        s->far_block = std::make_unique<spx_int16_t[]>(s->block_size);
+        s->out_block = std::make_unique<spx_int16_t[]>(s->block_size);
 
         s->frame.data = NULL;
         s->frame.sample_rate = s->frame.bps = 0;
 
-        const int ringbuf_sample_count = 2 << 15; //should be divisable by SAMPLES_PER_FRAME
+        const int ringbuf_sample_count = 2 << 15;
         constexpr int bps = 2; //TODO: assuming bps to be 2
 
         s->far_end_ringbuf.reset(ring_buffer_init(ringbuf_sample_count * bps));
         s->near_end_ringbuf.reset(ring_buffer_init(ringbuf_sample_count * bps));
+        s->out_ringbuf.reset(ring_buffer_init(ringbuf_sample_count * bps));
 
         s->frame_data = std::make_unique<spx_int16_t[]>(ringbuf_sample_count);
         s->frame.data = reinterpret_cast<char *>(s->frame_data.get());
         s->frame.max_size = ringbuf_sample_count * sizeof(s->frame_data[0]);
         static_assert(sizeof(s->frame_data[0]) == bps);
 
-        log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Echo cancellation initialized with filter length %d samples.\n", filter_length);
+        log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Echo cancellation initialized with filter length %d samples, block %d samples%s.\n",
+                        s->filter_length, s->block_size, s->residual_suppression ? ", residual echo suppression" : "");
 
         s->prefill = 0;
 
@@ -181,13 +308,15 @@ struct echo_cancellation * echo_cancellation_init(void)
 
 void echo_cancellation_destroy(struct echo_cancellation *s)
 {
+        aec_worker_stop(s);
         delete s;
 }
 
+/**
+ * Called from the playback path. Doesn't lock and doesn't allocate.
+ */
 void echo_play(struct echo_cancellation *s, struct audio_frame *frame)
 {
-        std::lock_guard(s->lock);
-
         if(frame->ch_count != 1) {
                 static int prints = 0;
                 if(prints++ % 100 == 0) {
@@ -197,55 +326,97 @@ void echo_play(struct echo_cancellation *s, struct audio_frame *frame)
                 return;
         }
 
-        if(s->prefill){
-                int target = std::max(SAMPLES_PER_FRAME, (s->prefill / SAMPLES_PER_FRAME) * SAMPLES_PER_FRAME);
-                int current = ring_get_current_size(s->far_end_ringbuf.get());
-                //buffer can contain small remainder (<SAMPLES_PER_FRAME)
-                int to_fill = target - current;
-                s->prefill = 0;
+        if(int prefill = s->prefill.exchange(0); prefill){
+                int target = std::max(s->block_size, (prefill / s->block_size) * s->block_size);
+                int current = ring_get_current_size(s->far_end_ringbuf.get()) / 2;
+                //buffer can contain small remainder (<block_size)
+                int to_fill = std::min(target - current, ring_get_available_write_size(s->far_end_ringbuf.get()) / 2);
                 if(to_fill < 0){
                         log_msg(LOG_LEVEL_WARNING, MOD_NAME "Pre fill requested to %d, but the buffer is already %d!\n", target, current);
                 } else {
-                        ring_advance_write_idx(s->far_end_ringbuf.get(), to_fill);
+                        ring_fill(s->far_end_ringbuf.get(), 0, to_fill * 2);
                         log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Pre filling far end with %d samples\n", to_fill);
                 }
         }
 
-        size_t samples = frame->data_len / frame->bps;
-        size_t ringbuf_free_samples = ring_get_available_write_size(s->far_end_ringbuf.get()) / 2;
+        int samples = frame->data_len / frame->bps;
+        int written = write_samples_s16(s->far_end_ringbuf.get(), frame->data, frame->bps, samples);
+        if(written < samples){
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Far end ringbuf overflow, %d samples dropped!\n", samples - written);
+        }
+}
 
-        if(samples > ringbuf_free_samples){
-                samples = ringbuf_free_samples;
-                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Far end ringbuf overflow!\n");
+/**
+ * Processes all whole blocks available in near end ring buffer.
+ */
+static void aec_process(struct echo_cancellation *s)
+{
+        const int block = s->block_size;
+        const int block_bytes = block * 2;
+        spx_int16_t *near_arr = s->near_block.get();
+        spx_int16_t *far_arr = s->far_block.get();
+        spx_int16_t *out_arr = s->out_block.get();
+
+        if(s->drop_far_end.exchange(false)){
+                //drop only whole blocks
+                drain(s->far_end_ringbuf.get(), block_bytes);
         }
 
-        if(frame->bps != 2) {
-                void *ptr1;
-                int size1;
-                void *ptr2;
-                int size2;
-                ring_get_write_regions(s->far_end_ringbuf.get(), samples * 2,
-                                &ptr1, &size1, &ptr2, &size2);
+        while(ring_get_current_size(s->near_end_ringbuf.get()) >= block_bytes){
+                const void *export_channels[] = {near_arr, far_arr, out_arr, nullptr};
 
-                assert(size1 % 2 == 0);
-                int in_bytes1 = (size1 / 2) * frame->bps;
-                change_bps(static_cast<char *>(ptr1), 2, frame->data, frame->bps, in_bytes1);
-                if(ptr2){
-                        change_bps(static_cast<char *>(ptr2), 2, frame->data + in_bytes1, frame->bps, frame->data_len - in_bytes1);
+                ring_buffer_read(s->near_end_ringbuf.get(), reinterpret_cast<char *>(near_arr), block_bytes);
+                if(ring_get_current_size(s->far_end_ringbuf.get()) >= block_bytes){
+                        ring_buffer_read(s->far_end_ringbuf.get(), reinterpret_cast<char *>(far_arr), block_bytes);
+
+                        speex_echo_cancellation(s->echo_state.get(), near_arr, far_arr, out_arr);
+                        if(s->preprocess_state){
+                                speex_preprocess_run(s->preprocess_state.get(), out_arr);
+                        }
+                } else {
+                        std::copy_n(near_arr, block, out_arr);
+                        export_channels[0] = out_arr;
+                        export_channels[1] = out_arr;
+                }
+
+                if(s->exporter){
+                        audio_export_raw_ch(s->exporter.get(), export_channels, block);
                 }
 
-                ring_advance_write_idx(s->far_end_ringbuf.get(), samples * 2);
-        } else {
-                ring_buffer_write(s->far_end_ringbuf.get(), frame->data, samples * 2);
+                if(ring_buffer_try_write(s->out_ringbuf.get(), reinterpret_cast<char *>(out_arr), block_bytes) < block_bytes){
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Output ringbuf overflow!\n");
+                }
+
+                std::lock_guard<std::mutex> lk(s->lock);
+                s->blocks_done += 1;
+                s->done_cv.notify_one();
         }
 }
 
-struct audio_frame * echo_cancel(struct echo_cancellation *s, struct audio_frame *frame)
+static void aec_worker(struct echo_cancellation *s)
 {
-        struct audio_frame *res;
-
-        std::lock_guard(s->lock);
+        set_thread_name(__func__);
+        while(true){
+                {
+                        std::unique_lock<std::mutex> lk(s->lock);
+                        s->work_cv.wait(lk, [s]{ return s->work_pending || s->should_exit; });
+                        if(s->should_exit){
+                                return;
+                        }
+                        s->work_pending = false;
+                }
+                aec_process(s);
+        }
+}
 
+/**
+ * Called from the capture path. Hands the samples over to the worker and
+ * returns the processed samples. Waits at most one block duration for the
+ * processing of the just captured samples to finish, if it doesn't, the
+ * remaining samples are returned by a subsequent call.
+ */
+struct audio_frame * echo_cancel(struct echo_cancellation *s, struct audio_frame *frame)
+{
         if(frame->ch_count != 1) {
                 static int prints = 0;
                 if(prints++ % 100 == 0)
@@ -257,16 +428,9 @@ struct audio_frame * echo_cancel(struct echo_cancellation *s, struct audio_frame
 
         if(frame->sample_rate != s->frame.sample_rate ||
                         frame->bps != s->frame.bps) {
+                aec_worker_stop(s);
                 reconfigure_echo(s, frame->sample_rate, frame->bps);
-        }
-
-
-        size_t in_frame_samples = frame->data_len / frame->bps;
-
-        size_t ringbuf_free_samples = ring_get_available_write_size(s->near_end_ringbuf.get()) / 2;
-        if(in_frame_samples > ringbuf_free_samples){
-                in_frame_samples = ringbuf_free_samples;
-                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Near end ringbuf overflow\n");
+                aec_worker_start(s);
         }
 
         if(s->next_expected_near < steady_clock::now()){
@@ -280,80 +444,42 @@ struct audio_frame * echo_cancel(struct echo_cancellation *s, struct audio_frame
                 long long delay = std::chrono::duration_cast<std::chrono::microseconds>(diff).count();
                 log_msg(LOG_LEVEL_WARNING, MOD_NAME "Near samples late by %lldus\n", delay);
 
-                int current = ring_get_current_size(s->far_end_ringbuf.get());
-                //drop only whole frames
-                current = (current / SAMPLES_PER_FRAME) * SAMPLES_PER_FRAME;
-                ring_advance_read_idx(s->far_end_ringbuf.get(), current);
+                s->drop_far_end = true;
         }
         s->next_expected_near = steady_clock::now() + std::chrono::seconds(1);
 
-        if(frame->bps != 2){
-                //Need to change bps, put whole incoming frame into ringbuf
-                void *ptr1;
-                int size1;
-                void *ptr2;
-                int size2;
-                ring_get_write_regions(s->near_end_ringbuf.get(), in_frame_samples * 2,
-                                &ptr1, &size1, &ptr2, &size2);
-
-                int in_bytes1 = (size1 / 2) * frame->bps;
-                change_bps(static_cast<char *>(ptr1), 2, frame->data, frame->bps, in_bytes1);
-                if(ptr2){
-                        change_bps(static_cast<char *>(ptr2), 2, frame->data + in_bytes1, frame->bps, frame->data_len - in_bytes1);
-                }
-                ring_advance_write_idx(s->near_end_ringbuf.get(), in_frame_samples * 2);
-        } else {
-                ring_buffer_write(s->near_end_ringbuf.get(), frame->data, frame->data_len);
+        int in_frame_samples = frame->data_len / frame->bps;
+        int written = write_samples_s16(s->near_end_ringbuf.get(), frame->data, frame->bps, in_frame_samples);
+        if(written < in_frame_samples){
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Near end ringbuf overflow, %d samples dropped\n", in_frame_samples - written);
         }
 
-        size_t near_end_samples = ring_get_current_size(s->near_end_ringbuf.get()) / 2;
-        size_t far_end_samples = ring_get_current_size(s->far_end_ringbuf.get()) / 2;
+        int near_end_samples = ring_get_current_size(s->near_end_ringbuf.get()) / 2;
+        int far_end_samples = ring_get_current_size(s->far_end_ringbuf.get()) / 2;
 
         if(far_end_samples < near_end_samples){
-                log_msg(LOG_LEVEL_INFO, MOD_NAME "Not enough far end samples (%zu near, %zu far)\n", near_end_samples, far_end_samples);
+                log_msg(LOG_LEVEL_INFO, MOD_NAME "Not enough far end samples (%d near, %d far)\n", near_end_samples, far_end_samples);
 
                 //The delay between far end and near end will always be at least
                 //recorded frame length
                 s->prefill = in_frame_samples + s->requested_delay;
         }
 
-        size_t frames_to_process = near_end_samples / SAMPLES_PER_FRAME;
-        if(!frames_to_process){
-                return NULL;
+        {
+                const int blocks_pending = near_end_samples / s->block_size;
+                std::unique_lock<std::mutex> lk(s->lock);
+                const unsigned long long target = s->blocks_done + blocks_pending;
+                s->work_pending = true;
+                s->work_cv.notify_one();
+                s->done_cv.wait_for(lk, s->max_wait, [s, target]{ return s->blocks_done >= target; });
         }
 
-        size_t out_size = frames_to_process * SAMPLES_PER_FRAME * 2;
-        assert(static_cast<size_t>(s->frame.max_size) >= out_size);
-        s->frame.data_len = out_size;
-        res = &s->frame;
-
-        spx_int16_t *out_ptr = (spx_int16_t *)(void *) s->frame.data;
-        for(size_t i = 0; i < frames_to_process; i++){
-                spx_int16_t near_arr[SAMPLES_PER_FRAME];
-                spx_int16_t far_arr[SAMPLES_PER_FRAME];
-
-                const void *export_channels[] = {near_arr, far_arr, out_ptr, nullptr};
-                if(far_end_samples >= SAMPLES_PER_FRAME){
-                        ring_buffer_read(s->far_end_ringbuf.get(), reinterpret_cast<char *>(far_arr), SAMPLES_PER_FRAME * 2);
-                        ring_buffer_read(s->near_end_ringbuf.get(), reinterpret_cast<char *>(near_arr), SAMPLES_PER_FRAME * 2);
-
-                        speex_echo_cancellation(s->echo_state.get(), near_arr, far_arr, out_ptr); 
-                        far_end_samples -= SAMPLES_PER_FRAME;
-
-                } else {
-                        ring_buffer_read(s->near_end_ringbuf.get(), reinterpret_cast<char *>(out_ptr), SAMPLES_PER_FRAME * 2);
-                        export_channels[0] = out_ptr;
-                        export_channels[1] = out_ptr;
-                        export_channels[2] = out_ptr;
-                }
-
-                if(s->exporter){
-                        audio_export_raw_ch(s->exporter.get(), export_channels, SAMPLES_PER_FRAME);
-                }
-
-                out_ptr += SAMPLES_PER_FRAME;
+        int out_size = std::min(ring_get_current_size(s->out_ringbuf.get()), s->frame.max_size);
+        if(out_size == 0){
+                return NULL;
         }
+        s->frame.data_len = ring_buffer_read(s->out_ringbuf.get(), s->frame.data, out_size);
 
-        return res;
+        return &s->frame;
 }
 
@@ -44,6 +44,7 @@
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "audio/audio.h"
@@ -55,9 +56,17 @@
 #include "utils/ring_buffer.h"
 
 #define CACHE_SECONDS                   10
+#define WRITE_INTERVAL_MS               500 ///< writer wakes up at least this often
+#define WRITE_BLOCK_LEN                 (1024 * 1024) ///< max length of a single write
+#define WRITE_ALIGN                     4096
+#define HEADER_UPDATE_SEC               5 ///< interval to update WAV header sizes (file is valid if interrupted)
 
 /*
- * we do not need to have possible stalls, so IO is performend in a separate thread
+ * We do not need to have possible stalls, so IO is performed in a separate
+ * thread. The audio thread only writes to the lock-free SPSC ring (dropping
+ * samples if the writer cannot keep up) and wakes the writer once a quarter
+ * of the ring is filled. Otherwise, the writer wakes up periodically and
+ * writes everything buffered at once, so the writes are big and coalesced.
  */
 static void *audio_export_thread(void *arg);
 static bool configure(struct audio_export *s, struct audio_desc fmt);
@@ -69,12 +78,11 @@ struct audio_export {
         struct audio_desc saved_format;
 
         ring_buffer_t *ring;
+        int wakeup_threshold; ///< ring fill level to wake the writer at
 
         pthread_t thread_id;
         pthread_mutex_t lock;
         pthread_cond_t worker_cv;
-        volatile bool new_work_ready;
-        volatile bool worker_waiting;
 
         volatile bool should_exit_worker;
 };
@@ -82,40 +90,47 @@ struct audio_export {
 static void *audio_export_thread(void *arg)
 {
         struct audio_export *s = arg;
+        const int sample_size = s->saved_format.bps * s->saved_format.ch_count;
+        const int block_len = WRITE_BLOCK_LEN / sample_size * sample_size;
+        char *data = aligned_malloc(block_len, WRITE_ALIGN);
+        assert(data);
+        time_t last_header_update = time(NULL);
 
-        while(!s->should_exit_worker) {
+        while (true) {
                 pthread_mutex_lock(&s->lock);
-                while(!s->new_work_ready) {
-                        s->worker_waiting = true;
-                        pthread_cond_wait(&s->worker_cv, &s->lock);
-                        s->worker_waiting = false;
+                if (!s->should_exit_worker && ring_get_current_size(s->ring) < s->wakeup_threshold) {
+                        struct timespec ts;
+                        clock_gettime(CLOCK_REALTIME, &ts);
+                        ts.tv_nsec += WRITE_INTERVAL_MS * 1000000L;
+                        ts.tv_sec += ts.tv_nsec / 1000000000L;
+                        ts.tv_nsec %= 1000000000L;
+                        pthread_cond_timedwait(&s->worker_cv, &s->lock, &ts);
                 }
-
-                int size = ring_get_current_size(s->ring);
-
-                if(s->should_exit_worker && size == 0) {
-                        pthread_mutex_unlock(&s->lock);
-                        break;
-                }
-
-                char *data = malloc(size);
-                assert(data);
-                size_t res = ring_buffer_read(s->ring, data, size);
-                assert(res == (size_t) size);
-                assert(ring_get_current_size(s->ring) == 0);
-                s->new_work_ready = false;
-
+                bool should_exit = s->should_exit_worker;
                 pthread_mutex_unlock(&s->lock);
 
-                const int sample_size = s->saved_format.bps * s->saved_format.ch_count;
-                int rc = wav_writer_write(s->wav, size / sample_size, data);
-                if (rc != 0) {
-                        fprintf(stderr, "[Audio export] Problem writing audio samples: %s\n", ug_strerror(-rc));
+                int size = 0;
+                while ((size = ring_buffer_read(s->ring, data, block_len)) > 0) {
+                        int rc = wav_writer_write(s->wav, size / sample_size, data);
+                        if (rc != 0) {
+                                fprintf(stderr, "[Audio export] Problem writing audio samples: %s\n", ug_strerror(-rc));
+                        }
                 }
 
-                free(data);
+                long long dropped = ring_buffer_fetch_dropped(s->ring);
+                if (dropped > 0) {
+                        log_msg(LOG_LEVEL_WARNING, "[Audio export] Writing too slow, %lld bytes of audio dropped!\n", dropped);
+                }
+                if (time(NULL) - last_header_update >= HEADER_UPDATE_SEC) {
+                        wav_writer_update_header(s->wav);
+                        last_header_update = time(NULL);
+                }
+                if (should_exit) {
+                        break;
+                }
         }
 
+        aligned_free(data);
         return NULL;
 }
 
@@ -129,6 +144,7 @@ static bool configure(struct audio_export *s, struct audio_desc fmt) {
 
         s->ring = ring_buffer_init(CACHE_SECONDS * fmt.sample_rate * fmt.bps *
                         fmt.ch_count);
+        s->wakeup_threshold = CACHE_SECONDS * fmt.sample_rate * fmt.bps * fmt.ch_count / 4;
 
         return true;
 }
@@ -170,8 +186,6 @@ struct audio_export * audio_export_init(const char *filename)
 
         pthread_mutex_init(&s->lock, NULL);
         pthread_cond_init(&s->worker_cv, NULL);
-        s->new_work_ready = false;
-        s->worker_waiting = false;
         s->should_exit_worker = false;
 
         s->saved_format = (struct audio_desc) { 0, 0, 0, 0 };
@@ -185,10 +199,7 @@ void audio_export_destroy(struct audio_export *s)
                 if(s->thread_id) {
                         pthread_mutex_lock(&s->lock);
                         s->should_exit_worker = true;
-                        s->new_work_ready = true;
-                        if(s->worker_waiting) {
-                                pthread_cond_signal(&s->worker_cv);
-                        }
+                        pthread_cond_signal(&s->worker_cv);
                         pthread_mutex_unlock(&s->lock);
                         pthread_join(s->thread_id, NULL);
                 }
@@ -206,16 +217,21 @@ void audio_export_destroy(struct audio_export *s)
         }
 }
 
-void audio_export_raw(struct audio_export *s, void *data, unsigned len){
-        assert(s->saved_format.ch_count != 0 && "Export not configured");
-        pthread_mutex_lock(&s->lock);
-        ring_buffer_write(s->ring, data, len);
-        s->new_work_ready = true;
-
-        if(s->worker_waiting) {
+/**
+ * Wakes the writer if enough data is buffered. Does not lock so that the audio
+ * thread is never blocked, a missed wakeup is caught by the writer timeout.
+ */
+static void wake_writer(struct audio_export *s)
+{
+        if (ring_get_current_size(s->ring) >= s->wakeup_threshold) {
                 pthread_cond_signal(&s->worker_cv);
         }
-        pthread_mutex_unlock(&s->lock);
+}
+
+void audio_export_raw(struct audio_export *s, void *data, unsigned len){
+        assert(s->saved_format.ch_count != 0 && "Export not configured");
+        ring_buffer_try_write(s->ring, data, len);
+        wake_writer(s);
 }
 
 void audio_export(struct audio_export *s, const struct audio_frame *frame)
@@ -268,12 +284,12 @@ void audio_export_raw_ch(struct audio_export *s,
 
         int len = s->saved_format.ch_count * s->saved_format.bps * sample_count;
 
-        pthread_mutex_lock(&s->lock);
         void *ptr1;
         int size1;
         void *ptr2;
         int size2;
-        int avail = ring_get_write_regions(s->ring, len, &ptr1, &size1, &ptr2, &size2);
+        // only the free space (the rest is dropped), ring is filled by whole samples
+        int avail = ring_get_free_write_regions(s->ring, len, &ptr1, &size1, &ptr2, &size2);
 
         assert((size1 % (bps * ch_count)) == 0);
         assert(!ptr2 || (size2 % (bps * ch_count)) == 0);
@@ -284,11 +300,5 @@ void audio_export_raw_ch(struct audio_export *s,
         }
 
         ring_advance_write_idx(s->ring, avail);
-
-        s->new_work_ready = true;
-        if(s->worker_waiting) {
-                pthread_cond_signal(&s->worker_cv);
-        }
-        pthread_mutex_unlock(&s->lock);
+        wake_writer(s);
 }
-
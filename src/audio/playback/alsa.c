@@ -64,6 +64,7 @@
 #define BUF_LEN_DEFAULT_SYNC 200 // default buffer len for sync API
 #define MOD_NAME "[ALSA play.] "
 #define SCRATCHPAD_SIZE (1024*1024)
+#define MMAP_WAIT_TIMEOUT_MS 100 ///< max wait for a period so that exit request is noticed
 
 /**
  * Speex jitter buffer use is currently not stable and not ready for production use.
@@ -110,6 +111,7 @@ struct state_alsa_playback {
         snd_config_t * local_config;
 
         bool non_interleaved;
+        bool mmap; ///< samples are written directly to the device ring buffer (thread API only)
         playback_mode_t playback_mode;
 
         snd_pcm_uframes_t period_size;
@@ -173,9 +175,106 @@ static long get_sched_latency_ns(void)
         return atol(buf);
 }
 
+#ifndef USE_SPEEX_JITTER_BUFFER
+static bool handle_mmap_error(struct state_alsa_playback *s, int rc)
+{
+        if (rc == -EPIPE) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "underrun occurred\n");
+        } else {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "mmap playback error: %s\n", snd_strerror(rc));
+                if (rc == -ENODEV) {
+                        log_msg(LOG_LEVEL_FATAL, MOD_NAME "Device removed, exiting!\n");
+                        exit_uv(EXIT_FAIL_AUDIO);
+                        return false;
+                }
+        }
+        return snd_pcm_recover(s->handle, rc, 1) == 0;
+}
+
+/**
+ * Worker for the mmap access - waits until a period of the device buffer is
+ * free and reads the buffered audio directly to it.
+ */
+static void *worker_mmap(struct state_alsa_playback *s) {
+        const int frame_bytes = s->desc.bps * s->desc.ch_count;
+
+        while (1) {
+                pthread_mutex_lock(&s->lock);
+                bool should_exit = s->should_exit_thread;
+                pthread_mutex_unlock(&s->lock);
+                if (should_exit) {
+                        return NULL;
+                }
+
+                snd_pcm_sframes_t avail = snd_pcm_avail_update(s->handle);
+                if (avail < 0) {
+                        if (!handle_mmap_error(s, avail)) {
+                                return NULL;
+                        }
+                        continue;
+                }
+                if (avail < (snd_pcm_sframes_t) s->period_size) {
+                        if (snd_pcm_state(s->handle) == SND_PCM_STATE_PREPARED) {
+                                CHECK_OK(snd_pcm_start(s->handle));
+                        }
+                        int rc = snd_pcm_wait(s->handle, MMAP_WAIT_TIMEOUT_MS);
+                        if (rc < 0 && !handle_mmap_error(s, rc)) {
+                                return NULL;
+                        }
+                        continue;
+                }
+
+                const snd_pcm_channel_area_t *areas = NULL;
+                snd_pcm_uframes_t offset = 0;
+                snd_pcm_uframes_t frames = s->period_size;
+                int rc = snd_pcm_mmap_begin(s->handle, &areas, &offset, &frames);
+                if (rc < 0) {
+                        if (!handle_mmap_error(s, rc)) {
+                                return NULL;
+                        }
+                        continue;
+                }
+                char *dst = (char *) areas[0].addr + (areas[0].first + offset * areas[0].step) / 8;
+                int len = frames * frame_bytes;
+
+                pthread_mutex_lock(&s->lock);
+                int ret = audio_buffer_read(s->buf, dst, len);
+                pthread_mutex_unlock(&s->lock);
+                if (ret < 0) {
+                        ret = 0;
+                }
+                memset(dst + ret, 0, len - ret);
+                if (s->desc.bps == 1) { // convert to unsigned
+                        signed2unsigned(dst, dst, len);
+                }
+
+                struct timeval now;
+                gettimeofday(&now, NULL);
+                if (ret > 0) {
+                        s->last_audio_read = now;
+                } else if (tv_diff(now, s->last_audio_read) < 2.0) {
+                        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "empty buffer\n");
+                }
+
+                snd_pcm_sframes_t committed = snd_pcm_mmap_commit(s->handle, offset, frames);
+                if (committed < 0 || (snd_pcm_uframes_t) committed != frames) {
+                        if (!handle_mmap_error(s, committed >= 0 ? -EPIPE : committed)) {
+                                return NULL;
+                        }
+                }
+        }
+}
+#endif // ! defined USE_SPEEX_JITTER_BUFFER
+
 static void *worker(void *args) {
         struct state_alsa_playback *s = args;
 
+#ifndef USE_SPEEX_JITTER_BUFFER
+        if (s->mmap) {
+                return worker_mmap(s);
+        }
+#endif
+
         struct audio_frame f = { .bps = s->desc.bps,
                 .sample_rate = s->desc.sample_rate,
                 .ch_count = s->desc.ch_count };
@@ -373,6 +472,14 @@ static bool audio_play_alsa_ctl(void *state, int request, void *data, size_t *le
         switch (request) {
         case AUDIO_PLAYBACK_CTL_QUERY_FORMAT:
                 return audio_play_alsa_query_format(s, data, len);
+        case AUDIO_PLAYBACK_CTL_QUERY_FILL:
+                // only the buffered modes, in the direct one the fill is kept by ALSA
+                if (*len < sizeof(int) || s->buf == NULL) {
+                        return false;
+                }
+                *(int *) data = audio_buffer_get_fill(s->buf);
+                *len = sizeof(int);
+                return true;
         default:
                 return false;
         }
@@ -429,6 +536,8 @@ ADD_TO_PARAM("alsa-playback-buffer", "* alsa-playback-buffer=<len>\n"
                                 "  Buffer length. Can be used to balance robustness and latency, in microseconds.\n");
 ADD_TO_PARAM("alsa-play-period-size", "* alsa-play-period-size=<frames>\n"
                                     "  ALSA playback period size in frames (default is device minimum) .\n");
+ADD_TO_PARAM("alsa-play-mmap", "* alsa-play-mmap\n"
+                                    "  Write samples directly to the ALSA ring buffer, one period at a time (thread API only).\n");
 /**
  * @todo
  * Consider using snd_pcm_hw_params_set_buffer_time_first() by default, it works fine
@@ -484,8 +593,25 @@ static int audio_play_alsa_reconfigure(void *state, struct audio_desc desc)
 
         /* Set the desired hardware parameters. */
 
+        s->mmap = false;
+        if (get_commandline_param("alsa-play-mmap")) {
+#ifdef USE_SPEEX_JITTER_BUFFER
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Mmap access is not supported with Speex jitter buffer.\n");
+#else
+                if (s->playback_mode != THREAD) {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Mmap access is supported only with thread API.\n");
+                } else if ((rc = snd_pcm_hw_params_set_access(s->handle, params, SND_PCM_ACCESS_MMAP_INTERLEAVED)) < 0) {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "cannot set mmap interleaved hw access: %s\n",
+                                        snd_strerror(rc));
+                } else {
+                        s->mmap = true;
+                        s->non_interleaved = false;
+                }
+#endif
+        }
+
         /* Interleaved mode */
-        rc = snd_pcm_hw_params_set_access(s->handle, params,
+        rc = s->mmap ? 0 : snd_pcm_hw_params_set_access(s->handle, params,
                         SND_PCM_ACCESS_RW_INTERLEAVED);
         if (rc < 0) {
                 log_msg(LOG_LEVEL_ERROR, MOD_NAME "cannot set interleaved hw access: %s\n",
@@ -619,6 +745,18 @@ static int audio_play_alsa_reconfigure(void *state, struct audio_desc desc)
 #endif
         }
 
+        if (s->mmap) {
+                snd_pcm_sw_params_t *sw_params;
+                CHECK_OK(snd_pcm_sw_params_malloc(&sw_params));
+                CHECK_OK(snd_pcm_sw_params_current(s->handle, sw_params));
+                // start as soon as 2 periods are queued, wake up every period
+                CHECK_OK(snd_pcm_sw_params_set_start_threshold(s->handle, sw_params, MIN(2 * s->period_size, s->buffer_size)));
+                CHECK_OK(snd_pcm_sw_params_set_avail_min(s->handle, sw_params, s->period_size));
+                CHECK_OK(snd_pcm_sw_params(s->handle, sw_params));
+                snd_pcm_sw_params_free(sw_params);
+                log_msg(LOG_LEVEL_INFO, MOD_NAME "Using mmap access.\n");
+        }
+
         if (s->playback_mode == THREAD) {
                 s->timestamp = 0;
                 pthread_create(&s->thread_id, NULL, worker, s);
@@ -78,6 +78,7 @@ struct state_jack_playback {
         char *tmp; ///< temporary buffer used to demux data
 
         long int first_channel;
+        bool pull; ///< pull mode, see AUDIO_PLAYBACK_CTL_PULL
 };
 
 static int jack_samplerate_changed_callback(jack_nframes_t nframes, void *arg);
@@ -111,15 +112,18 @@ static int jack_process_callback(jack_nframes_t nframes, void *arg)
 
         len = s->buffer_fns->read(s->data, s->tmp, req_len);
         if (len != req_len) {
-                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Buffer underflow detected.\n");
+                if (!s->pull || len > 0) { // pull buffer returns nothing while priming
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Buffer underflow detected.\n");
+                }
                 nframes_available = len / s->desc.ch_count / sizeof(float);
         }
 
         for (int i = 0; i < s->desc.ch_count; ++i) {
                 jack_default_audio_sample_t *out =
-                        s->libjack->port_get_buffer (s->output_port[i], nframes_available);
+                        s->libjack->port_get_buffer (s->output_port[i], nframes);
                 assert(out != NULL);
                 demux_channel((char *) out, s->tmp, sizeof(float), len, s->desc.ch_count, i);
+                memset(out + nframes_available, 0, (nframes - nframes_available) * sizeof(float));
         }
 
         return 0;
@@ -209,6 +213,7 @@ static void * audio_play_jack_init(const char *cfg)
         dup = NULL;
 
         s->jack_ports_pattern = strdup(source_name);
+        s->pull = get_commandline_param("audio-playback-pull") != NULL;
 
         s->client = s->libjack->client_open(client_name, JackNullOption, &status);
         if(status & JackFailure) {
@@ -291,6 +296,19 @@ static bool audio_play_jack_ctl(void *state, int request, void *data, size_t *le
         switch (request) {
         case AUDIO_PLAYBACK_CTL_QUERY_FORMAT:
                 return audio_play_jack_query_format(s, data, len);
+        case AUDIO_PLAYBACK_CTL_QUERY_FILL:
+        case AUDIO_PLAYBACK_CTL_PULL:
+                if (!s->pull || *len < sizeof(int)) {
+                        return false;
+                }
+                if (s->data == NULL) {
+                        *(int *) data = 0;
+                } else {
+                        *(int *) data = request == AUDIO_PLAYBACK_CTL_PULL ? audio_pull_buffer_get_period(s->data)
+                                : audio_pull_buffer_get_fill(s->data);
+                }
+                *len = sizeof(int);
+                return true;
         default:
                 return false;
         }
@@ -331,7 +349,10 @@ static int audio_play_jack_reconfigure(void *state, struct audio_desc desc)
                         buf_len_ms = atoi(get_commandline_param("audio-buffer-len"));
                         assert(buf_len_ms > 0 && buf_len_ms < MAX_LEN_MS);
                 }
-                if (get_commandline_param("audio-disable-adaptive-buffer")) {
+                if (s->pull) {
+                        s->data = audio_pull_buffer_init(desc.sample_rate, sizeof(float), desc.ch_count, MAX_LEN_MS);
+                        s->buffer_fns = &audio_pull_buffer_fns;
+                } else if (get_commandline_param("audio-disable-adaptive-buffer")) {
                         int buf_len = desc.bps * desc.ch_count * (desc.sample_rate * buf_len_ms / 1000);
                         s->data = ring_buffer_init(buf_len);
                         s->buffer_fns = &ring_buffer_fns;
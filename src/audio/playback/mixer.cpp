@@ -52,7 +52,11 @@
 #include "rtp/rtp.h"
 #include "transmit.h"
 #include "utils/audio_buffer.h"
+#include "utils/macros.h"
+#include "utils/misc.h"
 #include "utils/thread.h"
+#include "utils/worker.h"
+#include <algorithm>
 #include <chrono>
 #include <iostream>
 #include <map>
@@ -140,6 +144,10 @@ struct am_participant {
                         LOG(LOG_LEVEL_ERROR) << "Audio coder init failed!\n";
                         throw 1;
                 }
+
+                // allocated once, only resized (without reallocation) every frame
+                m_frame.init(CHANNELS, AC_PCM, BPS, SAMPLE_RATE);
+                m_frame.reserve(SAMPLES_PER_FRAME * sizeof(sample_type_source) * CHANNELS);
         }
         ~am_participant() {
                 if (m_tx_session) {
@@ -161,6 +169,7 @@ struct am_participant {
 		m_network_device = move(other.m_network_device);
 		m_tx_session = move(other.m_tx_session);
 		last_seen = move(other.last_seen);
+		m_frame = move(other.m_frame);
 		other.m_audio_coder = nullptr;
 		other.m_buffer = nullptr;
 		other.m_tx_session = nullptr;
@@ -175,21 +184,23 @@ struct am_participant {
         struct rtp *m_network_device;
         struct tx *m_tx_session;
         chrono::steady_clock::time_point last_seen;
+        audio_frame2 m_frame; ///< participant's own signal, replaced by the mix-minus in place
 };
 
+/**
+ * Mixing algorithms are stateless and resolved at compile time - the per-sample
+ * operations are inlined into the kernels below so that the compiler can
+ * vectorize them. Only the kernel itself is selected at runtime.
+ */
 template<typename source_t, typename intermediate_t>
-class generic_mix_algo {
-public:
-        virtual ~generic_mix_algo() {}
-        virtual intermediate_t add_to_mix(intermediate_t dst, source_t sample) {
+struct generic_mix_algo {
+        static intermediate_t add_to_mix(intermediate_t dst, source_t sample) {
                 return dst + sample;
         }
 
-        virtual intermediate_t get_mixed_without_source_sample(intermediate_t mix, source_t source_sample) {
+        static intermediate_t get_mixed_without_source_sample(intermediate_t mix, source_t source_sample) {
                 return mix - source_sample;
         }
-
-        virtual intermediate_t normalize(intermediate_t sample) = 0;
 };
 
 /**
@@ -199,9 +210,8 @@ public:
  * substracted with substracted source may be ok.
  */
 template<typename source_t, typename intermediate_t>
-class linear_mix_algo : public generic_mix_algo<source_t, intermediate_t> {
-public:
-        intermediate_t normalize(intermediate_t sample) override {
+struct linear_mix_algo : public generic_mix_algo<source_t, intermediate_t> {
+        static intermediate_t normalize(intermediate_t sample) {
                 // clamp the value since linear mixer doesn't normalize values
                 return min<intermediate_t>(max<intermediate_t>(sample, numeric_limits<source_t>::min()), numeric_limits<source_t>::max());
         }
@@ -215,24 +225,56 @@ public:
  * Threshold is 0.5.
  */
 template<typename source_t, typename intermediate_t>
-class logarithmic_mix_algo : public generic_mix_algo<source_t, intermediate_t> {
-public:
+struct logarithmic_mix_algo : public generic_mix_algo<source_t, intermediate_t> {
         static constexpr double t = 0.5;
         static constexpr double alpha = 5.71144;
-        intermediate_t normalize(intermediate_t sample) override {
-		if (sample >= numeric_limits<source_t>::min() / 2 &&
-				sample <= numeric_limits<source_t>::max() / 2) {
-			return sample;
-		} else {
-                        double sample_norm = (double) sample / numeric_limits<source_t>::max();
-                        double ret = sample_norm / fabs(sample_norm) * (t + (1.0 - t) * log(1.0 + alpha * (fabs(sample_norm) - t) / (2 - t)) / log(1.0 + alpha)) * numeric_limits<source_t>::max();
-                        return ret;
+        static intermediate_t normalize(intermediate_t sample) {
+                if (sample >= numeric_limits<source_t>::min() / 2 &&
+                                sample <= numeric_limits<source_t>::max() / 2) {
+                        return sample;
                 }
+                return compress(sample);
+        }
+private:
+        [[gnu::noinline]] static intermediate_t compress(intermediate_t sample) {
+                double sample_norm = (double) sample / numeric_limits<source_t>::max();
+                double ret = sample_norm / fabs(sample_norm) * (t + (1.0 - t) * log(1.0 + alpha * (fabs(sample_norm) - t) / (2 - t)) / log(1.0 + alpha)) * numeric_limits<source_t>::max();
+                return ret;
         }
 };
 
+/// adds src to the accumulator dst
+template<typename algo, typename source_t, typename intermediate_t>
+static void mix_accumulate(intermediate_t * __restrict dst, const source_t * __restrict src, size_t count)
+{
+        OPTIMIZED_FOR (size_t i = 0; i < count; ++i) {
+                dst[i] = algo::add_to_mix(dst[i], src[i]);
+        }
+}
+
+/// replaces participant's signal in part by the normalized mix without it
+template<typename algo, typename source_t, typename intermediate_t>
+static void mix_minus(const intermediate_t * __restrict mix, source_t * __restrict part, size_t count)
+{
+        OPTIMIZED_FOR (size_t i = 0; i < count; ++i) {
+                part[i] = algo::normalize(algo::get_mixed_without_source_sample(mix[i], part[i]));
+        }
+}
+
+struct mix_kernels {
+        void (*accumulate)(sample_type_mixed *, const sample_type_source *, size_t);
+        void (*subtract)(const sample_type_mixed *, sample_type_source *, size_t);
+};
+
+template<typename algo>
+static constexpr mix_kernels get_mix_kernels() {
+        return { mix_accumulate<algo, sample_type_source, sample_type_mixed>,
+                mix_minus<algo, sample_type_source, sample_type_mixed> };
+}
+
 struct state_audio_mixer final {
         state_audio_mixer(const char *cfg) {
+                int threads = get_cpu_core_count();
                 if (cfg) {
                         shared_ptr<char> tmp(strdup(cfg), free);
                         char *item, *save_ptr;
@@ -244,13 +286,19 @@ struct state_audio_mixer final {
                                 } else if (strncmp(item, "algo=", strlen("algo=")) == 0) {
                                         string algo = item + strlen("algo=");
                                         if (algo == "linear") {
-                                                mixing_algorithm = decltype(mixing_algorithm)(new linear_mix_algo<sample_type_source, sample_type_mixed>());
+                                                kernels = get_mix_kernels<linear_mix_algo<sample_type_source, sample_type_mixed>>();
                                         } else if (algo == "logarithmic") {
-                                                mixing_algorithm = decltype(mixing_algorithm)(new logarithmic_mix_algo<sample_type_source, sample_type_mixed>());
+                                                kernels = get_mix_kernels<logarithmic_mix_algo<sample_type_source, sample_type_mixed>>();
                                         } else {
                                                 LOG(LOG_LEVEL_ERROR) << "Unknown mixing algorithm: " << algo << "\n";
                                                 throw 1;
                                         }
+                                } else if (strncmp(item, "threads=", strlen("threads=")) == 0) {
+                                        threads = atoi(item + strlen("threads="));
+                                        if (threads <= 0) {
+                                                LOG(LOG_LEVEL_ERROR) << "Wrong number of threads: " << item + strlen("threads=") << "\n";
+                                                throw 1;
+                                        }
                                 } else {
                                         LOG(LOG_LEVEL_ERROR) << "Unknown option: " << item << "\n";
                                         throw 1;
@@ -268,6 +316,13 @@ struct state_audio_mixer final {
                         audio_codec_done(audio_coder);
                 }
 
+                jobs.resize(threads);
+                for (auto & j : jobs) {
+                        j.s = this;
+                        j.partial_mix.resize(SAMPLES_PER_FRAME * CHANNELS);
+                }
+                mixed.resize(SAMPLES_PER_FRAME * CHANNELS);
+
                 thread_id = thread(&state_audio_mixer::worker, this);
         }
         ~state_audio_mixer() {
@@ -283,10 +338,105 @@ struct state_audio_mixer final {
         struct socket_udp_local *recv_socket{};
         string audio_codec{"PCM"};
 private:
+        /// range of participants processed by one worker thread
+        struct mix_job {
+                state_audio_mixer *s;
+                size_t first;
+                size_t last;
+                vector<sample_type_mixed> partial_mix; ///< sum of the signals in range
+        };
+        static void *read_and_mix(void *arg);
+        static void *subtract_and_send(void *arg);
+
         thread thread_id;
-        unique_ptr<generic_mix_algo<sample_type_source, sample_type_mixed>> mixing_algorithm{new linear_mix_algo<sample_type_source, sample_type_mixed>()};
+        mix_kernels kernels = get_mix_kernels<linear_mix_algo<sample_type_source, sample_type_mixed>>();
+
+        // preallocated, reused every frame
+        vector<am_participant *> active;
+        vector<sample_type_mixed> mixed;
+        vector<mix_job> jobs;
+
+        /// how close the ticks come to their deadlines, reported periodically
+        struct tick_stats {
+                void add(chrono::steady_clock::duration processing, bool late);
+                void report(size_t participant_count, chrono::steady_clock::duration budget);
+                chrono::steady_clock::time_point last_report = chrono::steady_clock::now();
+                chrono::steady_clock::duration total{};
+                chrono::steady_clock::duration max{};
+                int ticks = 0;
+                int late = 0;
+        } stats;
 };
 
+void state_audio_mixer::tick_stats::add(chrono::steady_clock::duration processing, bool is_late)
+{
+        total += processing;
+        max = std::max(max, processing);
+        ticks += 1;
+        late += is_late ? 1 : 0;
+}
+
+void state_audio_mixer::tick_stats::report(size_t participant_count, chrono::steady_clock::duration budget)
+{
+        auto now = chrono::steady_clock::now();
+        if (now - last_report < seconds(5) || ticks == 0) {
+                return;
+        }
+        auto to_ms = [](chrono::steady_clock::duration d) { return duration_cast<duration<double, milli>>(d).count(); };
+        int level = late > 0 ? LOG_LEVEL_WARNING : LOG_LEVEL_VERBOSE;
+        LOG(level) << "[Audio mixer] " << participant_count
+                << " participants, tick processing avg " << to_ms(total / ticks) << " ms, max "
+                << to_ms(max) << " ms of " << to_ms(budget) << " ms budget, "
+                << late << "/" << ticks << " ticks late\n";
+        *this = {};
+        last_report = now;
+}
+
+/**
+ * Reads the participants' signals and sums them to the job's partial mix.
+ */
+void *state_audio_mixer::read_and_mix(void *arg)
+{
+        auto *j = static_cast<mix_job *>(arg);
+        const size_t data_len_source = SAMPLES_PER_FRAME * sizeof(sample_type_source) * CHANNELS;
+        static_assert(CHANNELS == 1, "Currently only one channel is implemented here.");
+
+        fill(j->partial_mix.begin(), j->partial_mix.end(), 0);
+        for (size_t i = j->first; i < j->last; ++i) {
+                am_participant *p = j->s->active[i];
+                p->m_frame.resize(0, data_len_source);
+                char *particip_data = p->m_frame.get_data(0);
+                int ret = audio_buffer_read(p->m_buffer, particip_data, data_len_source);
+                memset(particip_data + ret, 0, data_len_source - ret);
+                j->s->kernels.accumulate(j->partial_mix.data(), (sample_type_source *)(void *) particip_data,
+                                SAMPLES_PER_FRAME * CHANNELS);
+        }
+        return nullptr;
+}
+
+/**
+ * Substracts each source signal from the mix coming to that participant, then
+ * encodes and sends the result. Participants have independent coder and
+ * transmit states, so the ranges can be processed concurrently.
+ */
+void *state_audio_mixer::subtract_and_send(void *arg)
+{
+        auto *j = static_cast<mix_job *>(arg);
+        for (size_t i = j->first; i < j->last; ++i) {
+                am_participant *p = j->s->active[i];
+                j->s->kernels.subtract(j->s->mixed.data(), (sample_type_source *)(void *) p->m_frame.get_data(0),
+                                SAMPLES_PER_FRAME * CHANNELS);
+
+                audio_frame2 *uncompressed = &p->m_frame;
+                while (audio_frame2 compressed = audio_codec_compress(p->m_audio_coder, uncompressed)) {
+                        audio_tx_send(p->m_tx_session, p->m_network_device, &compressed);
+                        audio_codec_recycle(p->m_audio_coder, std::move(compressed));
+                        uncompressed = nullptr;
+                }
+        }
+        return nullptr;
+}
+
 void state_audio_mixer::worker()
 {
         set_thread_name(__func__);
@@ -317,54 +467,35 @@ void state_audio_mixer::worker()
                         }
                 }
 
-                size_t data_len_source = SAMPLES_PER_FRAME * sizeof(sample_type_source) * CHANNELS;
-                vector<sample_type_mixed> mixed(SAMPLES_PER_FRAME * CHANNELS);
-                vector<audio_frame2> participant_frames(participants.size());
-                int participant_index = 0;
-
-                // mix all together
+                active.clear();
                 for (auto & p : participants) {
-                        participant_frames[participant_index].init(CHANNELS, AC_PCM, BPS, SAMPLE_RATE);
-                        static_assert(CHANNELS == 1, "Currently only one channel is implemented here.");
-                        participant_frames[participant_index].resize(0, data_len_source);
-                        char *particip_data = participant_frames[participant_index].get_data(0);
-                        int ret = audio_buffer_read(p.second.m_buffer, particip_data, data_len_source);
-                        memset(particip_data, 0, data_len_source - ret);
-
-                        sample_type_source *src = (sample_type_source *)(void *) particip_data;
-                        auto dst = mixed.begin();
-                        for (int i = 0; i < SAMPLES_PER_FRAME * CHANNELS; ++i) {
-                                *dst = mixing_algorithm->add_to_mix(*dst, *src);
-                                ++dst;
-                                ++src;
-                        }
-                        participant_index++;
+                        active.push_back(&p.second);
+                }
+                if (active.empty()) {
+                        continue;
                 }
 
-                // substract each source signal from the mix coming to that participant
-                for (auto & pb : participant_frames) {
-                        auto mix = mixed.begin();
-                        sample_type_source *part = (sample_type_source *)(void *) pb.get_data(0);
-                        for (int i = 0; i < SAMPLES_PER_FRAME * CHANNELS; ++i) {
-                                *part = mixing_algorithm->normalize(mixing_algorithm->get_mixed_without_source_sample(*mix, *part));
-                                ++mix;
-                                ++part;
-                        }
+                int threads = min<int>(jobs.size(), active.size());
+                for (int i = 0; i < threads; ++i) {
+                        jobs[i].first = active.size() * i / threads;
+                        jobs[i].last = active.size() * (i + 1) / threads;
                 }
 
-                // send
-                participant_index = 0;
-                for (auto & p : participants) {
-                        audio_frame2 *uncompressed = &participant_frames[participant_index];
-                        while (audio_frame2 compressed = audio_codec_compress(p.second.m_audio_coder, uncompressed)) {
-                                audio_tx_send(p.second.m_tx_session, p.second.m_network_device, &compressed);
-                                uncompressed = nullptr;
+                // mix all together
+                task_run_parallel(read_and_mix, threads, jobs.data(), sizeof jobs[0], nullptr);
+                copy(jobs[0].partial_mix.begin(), jobs[0].partial_mix.end(), mixed.begin());
+                for (int i = 1; i < threads; ++i) {
+                        OPTIMIZED_FOR (size_t k = 0; k < mixed.size(); ++k) {
+                                mixed[k] += jobs[i].partial_mix[k];
                         }
-
-
-                        participant_index++;
                 }
+
+                task_run_parallel(subtract_and_send, threads, jobs.data(), sizeof jobs[0], nullptr);
                 plk.unlock();
+
+                auto done = chrono::steady_clock::now();
+                stats.add(done - now, done > next_frame_time);
+                stats.report(active.size(), interval);
         }
 }
 
@@ -375,7 +506,7 @@ static void audio_play_mixer_help(const char *driver_name [[gnu::unused]])
 static void usage()
 {
         printf("Usage:\n"
-               "\t%s -r mixer[:codec=<codec>][:algo={linear|logarithmic}]\n"
+               "\t%s -r mixer[:codec=<codec>][:algo={linear|logarithmic}][:threads=<n>]\n"
                "\n"
                "<codec>\n"
                "\taudio codec to use\n"
@@ -383,6 +514,8 @@ static void usage()
                "\tlinear sum of signals (with clamping)\n"
                "logarithmic\n"
                "\tlinear sum of signals to threshold, above threshold logarithmic dynamic range compression is used\n"
+               "<n>\n"
+               "\tnumber of threads mixing, encoding and sending participants' streams (default: number of CPU cores)\n"
                "\n"
                "Notes:\n"
                "1)\tYou do not need to specify audio participants explicitly,\n"
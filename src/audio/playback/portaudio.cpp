@@ -86,6 +86,7 @@ struct state_portaudio_playback {
         int max_output_channels;
 
         struct audio_buffer *data;
+        struct audio_pull_buffer *pull_data; ///< used instead of data in pull mode (see AUDIO_PLAYBACK_CTL_PULL)
 
         steady_clock::time_point last_audio_read;
         bool quiet;
@@ -221,6 +222,8 @@ static void cleanup(struct state_portaudio_playback * s)
         s->stream = NULL;
         audio_buffer_destroy(s->data);
         s->data = NULL;
+        audio_pull_buffer_destroy(s->pull_data);
+        s->pull_data = NULL;
 	Pa_Terminate();
 }
 
@@ -295,6 +298,26 @@ static bool audio_play_portaudio_ctl(void *state, int request, void *data, size_
                 } else {
                         return false;
                 }
+        case AUDIO_PLAYBACK_CTL_QUERY_FILL:
+        {
+                auto *s = (state_portaudio_playback *) state;
+                if (*len < sizeof(int) || (s->data == nullptr && s->pull_data == nullptr)) {
+                        return false;
+                }
+                *(int *) data = s->pull_data != nullptr ? audio_pull_buffer_get_fill(s->pull_data) : audio_buffer_get_fill(s->data);
+                *len = sizeof(int);
+                return true;
+        }
+        case AUDIO_PLAYBACK_CTL_PULL:
+        {
+                auto *s = (state_portaudio_playback *) state;
+                if (*len < sizeof(int) || s->pull_data == nullptr) {
+                        return false;
+                }
+                *(int *) data = audio_pull_buffer_get_period(s->pull_data);
+                *len = sizeof(int);
+                return true;
+        }
         default:
                 return false;
         }
@@ -318,7 +341,11 @@ static int audio_play_portaudio_reconfigure(void *state, struct audio_desc desc)
         if (get_commandline_param("audio-buffer-len")) {
                 audio_buf_len_ms = atoi(get_commandline_param("audio-buffer-len"));
         }
-        s->data = audio_buffer_init(desc.sample_rate, desc.bps, desc.ch_count, audio_buf_len_ms);
+        if (get_commandline_param("audio-playback-pull")) {
+                s->pull_data = audio_pull_buffer_init(desc.sample_rate, desc.bps, desc.ch_count, BUFFER_LEN_SEC * 1000);
+        } else {
+                s->data = audio_buffer_init(desc.sample_rate, desc.bps, desc.ch_count, audio_buf_len_ms);
+        }
         s->desc = desc;
         
 	printf("(Re)initializing portaudio playback.\n");
@@ -408,10 +435,11 @@ static int callback( const void *inputBuffer, void *outputBuffer,
         UNUSED(statusFlags);
 
         ssize_t req_bytes = framesPerBuffer * s->desc.ch_count * s->desc.bps;
-        ssize_t bytes_read = audio_buffer_read(s->data, (char *) outputBuffer, req_bytes);
+        ssize_t bytes_read = s->pull_data != nullptr ? audio_pull_buffer_read(s->pull_data, (char *) outputBuffer, req_bytes)
+                : audio_buffer_read(s->data, (char *) outputBuffer, req_bytes);
 
         if (bytes_read < req_bytes) {
-                if (!s->quiet)
+                if (!s->quiet && (s->pull_data == nullptr || bytes_read > 0)) // pull buffer returns nothing while priming
                         log_msg(LOG_LEVEL_INFO, "[Portaudio] Buffer underflow.\n");
                 memset((int8_t *) outputBuffer + bytes_read, 0, req_bytes - bytes_read);
                 if (!s->quiet && duration_cast<seconds>(steady_clock::now() - s->last_audio_read).count() > NO_DATA_STOP_SEC) {
@@ -453,7 +481,11 @@ static void audio_play_portaudio_put_frame(void *state, const struct audio_frame
                 out_channels = s->max_output_channels;
         }
         
-        audio_buffer_write(s->data, buffer->data, samples_count * buffer->bps * out_channels);
+        if (s->pull_data != nullptr) {
+                audio_pull_buffer_write(s->pull_data, buffer->data, samples_count * buffer->bps * out_channels);
+        } else {
+                audio_buffer_write(s->data, buffer->data, samples_count * buffer->bps * out_channels);
+        }
 }
 
 static const struct audio_playback_info aplay_portaudio_info = {
@@ -34,12 +34,16 @@
 #include "config_win32.h"
 #endif
 
+#include <algorithm>
+#include <atomic>
 #include <audioclient.h>
+#include <avrt.h>
 #include <iostream>
 #include <mfapi.h>
 #include <mmdeviceapi.h>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <windows.h>
 
 #include "audio/audio_playback.h"
@@ -49,6 +53,7 @@
 #include "rang.hpp"
 #include "ug_runtime_error.hpp"
 #include "utils/hresult.h"
+#include "utils/ring_buffer.h"
 
 #define DEFAULT_WASAPI_BUFLEN_MS 67
 #define MOD_NAME "[WASAPI play.] "
@@ -67,6 +72,8 @@ const static GUID UG_KSDATAFORMAT_SUBTYPE_PCM = { STATIC_KSDATAFORMAT_SUBTYPE_PC
 using rang::fg;
 using rang::style;
 using std::cout;
+using std::max;
+using std::min;
 using std::ostringstream;
 using std::string;
 using std::wcout;
@@ -78,10 +85,19 @@ struct state_aplay_wasapi {
         IAudioClient *pAudioClient;
         IAudioRenderClient *pRenderClient;
         UINT32 bufferSize;
+
+        bool exclusive;
+        int period_ms;
+        HANDLE event;                  ///< signalled by WASAPI when it needs data
+        struct ring_buffer *buffer;    ///< put_frame() -> render thread
+        std::thread render_thread;
+        std::atomic<bool> should_exit;
 };
 
 static void show_help();
 string wasapi_get_default_device_id(EDataFlow dataFlow, IMMDeviceEnumerator *enumerator); // defined in WASAPI capture
+HRESULT wasapi_init_audio_client(IMMDevice *pDevice, IAudioClient **pAudioClient, const WAVEFORMATEX *pwfx,
+                bool exclusive, int period_ms, REFERENCE_TIME buffer_duration, HANDLE event); // ditto
 
 #define SAFE_RELEASE(u) \
     do { if ((u) != NULL) (u)->Release(); (u) = NULL; } while(0)
@@ -167,7 +183,10 @@ static void audio_play_wasapi_help(const char *driver_name)
 
 static void show_help() {
         cout << "Usage:\n" <<
-                style::bold << fg::red << "\t-r wasapi" << fg::reset << "[:<index>|:<ID>] --param audio-buffer-len=<ms>\n" << style::reset <<
+                style::bold << fg::red << "\t-r wasapi" << fg::reset << "[:<index>|:<ID>][:exclusive][:period=<ms>] --param audio-buffer-len=<ms>\n" << style::reset <<
+                style::bold << "\texclusive" << style::reset << " - use the device exclusively (lower latency, the format must be supported by the device)\n" <<
+                style::bold << "\tperiod" << style::reset << " - device period in the exclusive mode (default is the minimal one)\n" <<
+                style::bold << "\taudio-buffer-len" << style::reset << " - maximal amount of buffered audio (default " << DEFAULT_WASAPI_BUFLEN_MS << " ms)\n" <<
                 "\nAvailable devices:\n";
 
         HRESULT hr = CoInitializeEx(NULL, COINIT_MULTITHREADED);
@@ -210,22 +229,38 @@ static void * audio_play_wasapi_init(const char *cfg)
 {
         wchar_t deviceID[1024] = L"";
         int index = -1;
+        bool exclusive = false;
+        int period_ms = 0;
         if (cfg && strlen(cfg) > 0) {
                 if (strcmp(cfg, "help") == 0) {
                         show_help();
                         return &audio_init_state_ok;
                 }
-                if (isdigit(cfg[0])) {
-                        index = atoi(cfg);
-                } else {
-                        mbtowc(deviceID, cfg, (sizeof deviceID / 2) - 1);
+                char *tmp = strdup(cfg);
+                char *save_ptr = nullptr;
+                char *item = nullptr;
+                char *fmt = tmp;
+                while ((item = strtok_r(fmt, ":", &save_ptr)) != nullptr) {
+                        fmt = nullptr;
+                        if (strcmp(item, "exclusive") == 0) {
+                                exclusive = true;
+                        } else if (strncmp(item, "period=", strlen("period=")) == 0) {
+                                period_ms = atoi(item + strlen("period="));
+                        } else if (isdigit(item[0])) {
+                                index = atoi(item);
+                        } else {
+                                mbstowcs(deviceID, item, (sizeof deviceID / sizeof deviceID[0]) - 1);
+                        }
                 }
+                free(tmp);
         }
         HRESULT hr = CoInitializeEx(NULL, COINIT_MULTITHREADED);
         if (hr != S_OK && hr != S_FALSE) {
                 return nullptr;
         }
         auto s = new state_aplay_wasapi();
+        s->exclusive = exclusive;
+        s->period_ms = period_ms;
         IMMDeviceEnumerator *enumerator = nullptr;
         try {
 
@@ -274,10 +309,35 @@ static void * audio_play_wasapi_init(const char *cfg)
         return s;
 }
 
+static void stop_playback(struct state_aplay_wasapi *s)
+{
+        if (s->render_thread.joinable()) {
+                s->should_exit = true;
+                SetEvent(s->event);
+                s->render_thread.join();
+                s->should_exit = false;
+        }
+        if (s->pAudioClient != nullptr) {
+                s->pAudioClient->Stop();
+        }
+        SAFE_RELEASE(s->pRenderClient);
+        if (s->buffer != nullptr) {
+                ring_buffer_destroy(s->buffer);
+                s->buffer = nullptr;
+        }
+}
+
 static void audio_play_wasapi_done(void *state)
 {
+        auto s = static_cast<state_aplay_wasapi *>(state);
+        stop_playback(s);
+        SAFE_RELEASE(s->pAudioClient);
+        SAFE_RELEASE(s->pDevice);
+        if (s->event != NULL) {
+                CloseHandle(s->event);
+        }
         CoUninitialize();
-        delete static_cast<state_aplay_wasapi *>(state);
+        delete s;
 }
 
 static DWORD get_channel_mask(int *count) {
@@ -327,10 +387,11 @@ static bool audio_play_wasapi_ctl(void *state, int request, void *data, size_t *
                         desc.codec = AC_PCM;
 
                         fmt = audio_format_to_waveformatex(&desc);
+                        // in the exclusive mode there is no closest match, the format is either supported or not
                         hr = s->pAudioClient->IsFormatSupported(
-                                        AUDCLNT_SHAREMODE_SHARED,
+                                        s->exclusive ? AUDCLNT_SHAREMODE_EXCLUSIVE : AUDCLNT_SHAREMODE_SHARED,
                                         (WAVEFORMATEX *) &fmt,
-                                        &closestMatch);
+                                        s->exclusive ? NULL : &closestMatch);
                         if (hr != S_OK && hr != S_FALSE) {
                                 LOG(LOG_LEVEL_ERROR) << MOD_NAME "Unable to get format: " << hresult_to_str(hr) << "\n";
                                 return false;
@@ -350,6 +411,65 @@ static bool audio_play_wasapi_ctl(void *state, int request, void *data, size_t *
         }
 }
 
+/**
+ * Waits for the WASAPI event and fills the device buffer from the ring buffer.
+ * In the exclusive mode, whole buffer (one period) must be written every time,
+ * missing samples are replaced with silence.
+ */
+static void render_loop(struct state_aplay_wasapi *s)
+{
+        CoInitializeEx(NULL, COINIT_MULTITHREADED);
+        DWORD task_index = 0;
+        HANDLE mmcss = AvSetMmThreadCharacteristicsW(L"Pro Audio", &task_index);
+        if (mmcss == NULL) {
+                LOG(LOG_LEVEL_WARNING) << MOD_NAME "Cannot register thread to MMCSS: " << GetLastError() << "\n";
+        }
+        const int frame_size = s->desc.ch_count * s->desc.bps;
+        long long underrun_frames = 0;
+
+        while (!s->should_exit) {
+                if (WaitForSingleObject(s->event, 500) != WAIT_OBJECT_0) {
+                        continue;
+                }
+                UINT32 padding = 0;
+                if (!s->exclusive && s->pAudioClient->GetCurrentPadding(&padding) != S_OK) {
+                        continue;
+                }
+                UINT32 frames = s->bufferSize - padding;
+                if (frames == 0) {
+                        continue;
+                }
+                int available = ring_get_current_size(s->buffer) / frame_size;
+                if (!s->exclusive) { // in shared mode, we may write less
+                        frames = min<UINT32>(frames, available);
+                        if (frames == 0) {
+                                continue;
+                        }
+                }
+                BYTE *data = nullptr;
+                HRESULT hr = s->pRenderClient->GetBuffer(frames, &data);
+                if (hr != S_OK) {
+                        LOG(LOG_LEVEL_ERROR) << MOD_NAME "GetBuffer: " << hresult_to_str(hr) << "\n";
+                        continue;
+                }
+                int read = ring_buffer_read(s->buffer, (char *) data, frames * frame_size);
+                if (read < (int) (frames * frame_size)) {
+                        memset(data + read, 0, frames * frame_size - read);
+                        underrun_frames += frames - read / frame_size;
+                }
+                s->pRenderClient->ReleaseBuffer(frames, 0);
+                if (underrun_frames >= s->desc.sample_rate) {
+                        LOG(LOG_LEVEL_WARNING) << MOD_NAME "Buffer underrun - " << underrun_frames << " samples of silence played.\n";
+                        underrun_frames = 0;
+                }
+        }
+
+        if (mmcss != NULL) {
+                AvRevertMmThreadCharacteristics(mmcss);
+        }
+        CoUninitialize();
+}
+
 #define FAIL_IF_NOT(cmd) do {HRESULT hr = cmd; if (hr != S_OK) { LOG(LOG_LEVEL_ERROR) << MOD_NAME << #cmd << ": " << hresult_to_str(hr) << "\n"; return FALSE;}} while(0)
 static int audio_play_wasapi_reconfigure(void *state, struct audio_desc desc)
 {
@@ -361,36 +481,44 @@ static int audio_play_wasapi_reconfigure(void *state, struct audio_desc desc)
         }
         REFERENCE_TIME bufferDuration = buflen_ms * REFTIMES_PER_MILLISEC;
         WAVEFORMATEXTENSIBLE fmt = audio_format_to_waveformatex(&desc);
-        FAIL_IF_NOT(s->pAudioClient->Initialize(AUDCLNT_SHAREMODE_SHARED, 0, bufferDuration, 0,
-                        (WAVEFORMATEX *) &fmt, NULL));
+
+        stop_playback(s);
+        if (s->desc.ch_count != 0) { // already initialized - IAudioClient can be initialized only once
+                SAFE_RELEASE(s->pAudioClient);
+                FAIL_IF_NOT(s->pDevice->Activate(IID_IAudioClient, CLSCTX_ALL, NULL, (void **) &s->pAudioClient));
+        }
+        if (s->event == NULL && (s->event = CreateEvent(NULL, FALSE, FALSE, NULL)) == NULL) {
+                LOG(LOG_LEVEL_ERROR) << MOD_NAME "Cannot create event!\n";
+                return FALSE;
+        }
+        FAIL_IF_NOT(wasapi_init_audio_client(s->pDevice, &s->pAudioClient, (WAVEFORMATEX *) &fmt, s->exclusive,
+                                s->period_ms, bufferDuration, s->event));
         FAIL_IF_NOT(s->pAudioClient->GetService(IID_IAudioRenderClient, (void **) &s->pRenderClient));
 
         FAIL_IF_NOT(s->pAudioClient->GetBufferSize(&s->bufferSize));
         LOG(LOG_LEVEL_INFO) << MOD_NAME "Buffer size: " << s->bufferSize << " frames\n";
+        s->desc = desc;
 
+        const int frame_size = desc.ch_count * desc.bps;
+        // at least two device buffers to be able to fill one while the other is played
+        int ring_frames = max<int>(desc.sample_rate * buflen_ms / 1000, 2 * s->bufferSize);
+        s->buffer = ring_buffer_init(ring_frames * frame_size);
+
+        s->render_thread = std::thread(render_loop, s);
         FAIL_IF_NOT(s->pAudioClient->Start());
 
         return TRUE;
 }
 
-#define CHECK(cmd) do {HRESULT hr = cmd; if (hr != S_OK) { LOG(LOG_LEVEL_ERROR) << MOD_NAME << #cmd ": " << hresult_to_str(hr) << "\n"; return;}} while(0)
 static void audio_play_wasapi_put_frame(void *state, const struct audio_frame *buffer)
 {
         auto s = static_cast<struct state_aplay_wasapi *>(state);
-        UINT32 numFramesPadding;
-
-        CHECK(s->pAudioClient->GetCurrentPadding(&numFramesPadding));
-
-        UINT32 NumFramesRequested = buffer->data_len / buffer->ch_count / buffer->bps;
-        if (s->bufferSize - numFramesPadding < NumFramesRequested) {
+        if (s->buffer == nullptr) { // reconfiguration failed
+                return;
+        }
+        if (ring_buffer_try_write(s->buffer, buffer->data, buffer->data_len) < buffer->data_len) {
                 LOG(LOG_LEVEL_WARNING) << MOD_NAME "Buffer overflow!\n";
-                NumFramesRequested = s->bufferSize - numFramesPadding;
         }
-        BYTE *data;
-        CHECK(s->pRenderClient->GetBuffer(NumFramesRequested, &data));
-        memcpy(data, buffer->data, NumFramesRequested * buffer->ch_count * buffer->bps);
-        CHECK(s->pRenderClient->ReleaseBuffer(NumFramesRequested, 0));
-
 }
 
 static const struct audio_playback_info aplay_wasapi_info = {
@@ -51,6 +51,8 @@
 #include <speex/speex_resampler.h>
 #endif
 
+#include <algorithm>
+#include <cmath>
 #include <sstream>
 #include <stdexcept>
 
@@ -80,7 +82,7 @@ audio_desc::operator string() const
 
 
 audio_frame2_resampler::audio_frame2_resampler() : resampler(nullptr), resample_from(0),
-        resample_ch_count(0), resample_to(0)
+        resample_ch_count(0), resample_to(0), resample_ratio_num(0), resample_ratio_den(0)
 {
 }
 
@@ -104,16 +106,25 @@ audio_frame2::audio_frame2() :
  * @brief creates audio_frame2 from POD audio_frame
  */
 audio_frame2::audio_frame2(const struct audio_frame *old) :
-                bps(old ? old->bps : 0), sample_rate(old ? old->sample_rate : 0),
-                channels(old ? old->ch_count : 0),
-                codec(old ? AC_PCM : AC_NONE), duration(0.0)
-{
-        if (old) {
-                for (int i = 0; i < old->ch_count; i++) {
-                        resize(i, old->data_len / old->ch_count);
-                        char *data = channels[i].data.get();
-                        demux_channel(data, old->data, old->bps, old->data_len, old->ch_count, i);
-                }
+                bps(0), sample_rate(0), codec(AC_NONE), duration(0.0)
+{
+        assign(old);
+}
+
+/**
+ * @brief sets content from POD audio_frame, already allocated buffers are reused
+ */
+void audio_frame2::assign(const struct audio_frame *old)
+{
+        if (!old) {
+                init(0, AC_NONE, 0, 0);
+                return;
+        }
+        init(old->ch_count, AC_PCM, old->bps, old->sample_rate);
+        for (int i = 0; i < old->ch_count; i++) {
+                resize(i, old->data_len / old->ch_count);
+                char *data = channels[i].data.get();
+                demux_channel(data, old->data, old->bps, old->data_len, old->ch_count, i);
         }
 }
 
@@ -128,12 +139,16 @@ audio_frame2::operator bool() const
 }
 
 /**
- * @brief Initializes audio_frame2 for use. If already initialized, data are dropped.
+ * @brief Initializes audio_frame2 for use. If already initialized, data are dropped
+ * but the buffers of the kept channels are retained for reuse.
  */
 void audio_frame2::init(int nr_channels, audio_codec_t c, int b, int sr)
 {
-        channels.clear();
         channels.resize(nr_channels);
+        for (auto &ch : channels) {
+                ch.len = 0;
+                ch.fec_params = {};
+        }
         bps = b;
         codec = c;
         sample_rate = sr;
@@ -194,6 +209,26 @@ void audio_frame2::reserve(int channel, size_t length)
         }
 }
 
+/**
+ * Returns scratch buffer of the channel of at least len bytes. Its content is
+ * made the channel data by swap_spare().
+ */
+char *audio_frame2::get_spare(int channel, size_t len)
+{
+        if (channels[channel].spare_max_len < len) {
+                channels[channel].spare = unique_ptr<char []>(new char[len]);
+                channels[channel].spare_max_len = len;
+        }
+        return channels[channel].spare.get();
+}
+
+void audio_frame2::swap_spare(int channel, size_t new_len)
+{
+        swap(channels[channel].data, channels[channel].spare);
+        swap(channels[channel].max_len, channels[channel].spare_max_len);
+        channels[channel].len = new_len;
+}
+
 /**
  * Changes actual size of channel.
  */
@@ -326,28 +361,23 @@ void  audio_frame2::change_bps(int new_bps)
                 return;
         }
 
-        std::vector<channel> new_channels(channels.size());
-
         for (size_t i = 0; i < channels.size(); i++) {
                 size_t new_size = channels[i].len / bps * new_bps;
-                new_channels[i] = {unique_ptr<char []>(new char[new_size]), new_size, new_size, {}};
-        }
-
-        for (size_t i = 0; i < channels.size(); i++) {
-                ::change_bps(new_channels[i].data.get(), new_bps, get_data(i), get_bps(),
+                ::change_bps(get_spare(i, new_size), new_bps, get_data(i), get_bps(),
                                 get_data_len(i));
+                swap_spare(i, new_size);
         }
 
         bps = new_bps;
-        channels = move(new_channels);
 }
 
 ADD_TO_PARAM("resampler-quality", "* resampler-quality=[0-10]\n"
                 "  Sets audio resampler quality in range 0 (worst) and 10 (best), default " TOSTRING(DEFAULT_RESAMPLE_QUALITY) "\n");
 
-bool audio_frame2::resample([[maybe_unused]] audio_frame2_resampler & resampler_state, int new_sample_rate)
+bool audio_frame2::resample([[maybe_unused]] audio_frame2_resampler & resampler_state, int new_sample_rate,
+                [[maybe_unused]] double drift)
 {
-        if (new_sample_rate == sample_rate) {
+        if (new_sample_rate == sample_rate && drift == 1.0) {
                 return true;
         }
 
@@ -358,8 +388,6 @@ bool audio_frame2::resample([[maybe_unused]] audio_frame2_resampler & resampler_
                 throw logic_error("Only 16 bits per sample are currently for resampling supported!");
         }
 
-        std::vector<channel> new_channels(channels.size());
-
         if (sample_rate != resampler_state.resample_from || new_sample_rate != resampler_state.resample_to || channels.size() != resampler_state.resample_ch_count) {
                 if (resampler_state.resampler) {
                         speex_resampler_destroy((SpeexResamplerState *) resampler_state.resampler);
@@ -380,12 +408,18 @@ bool audio_frame2::resample([[maybe_unused]] audio_frame2_resampler & resampler_
                 resampler_state.resample_from = sample_rate;
                 resampler_state.resample_to = new_sample_rate;
                 resampler_state.resample_ch_count = channels.size();
+                resampler_state.resample_ratio_num = sample_rate;
+                resampler_state.resample_ratio_den = new_sample_rate;
         }
 
-        for (size_t i = 0; i < channels.size(); i++) {
-                // allocate new storage + 10 ms headroom
-                size_t new_size = channels[i].len * new_sample_rate / sample_rate + new_sample_rate * sizeof(int16_t) / 100;
-                new_channels[i] = {unique_ptr<char []>(new char[new_size]), new_size, new_size, {}};
+        // the ratio is kept in 1/1000 Hz to allow sub-ppm adjustments
+        uint32_t ratio_num = drift == 1.0 ? sample_rate : lround(sample_rate * drift * 1000.0);
+        uint32_t ratio_den = drift == 1.0 ? new_sample_rate : new_sample_rate * 1000U;
+        if (ratio_num != resampler_state.resample_ratio_num || ratio_den != resampler_state.resample_ratio_den) {
+                speex_resampler_set_rate_frac((SpeexResamplerState *) resampler_state.resampler,
+                                ratio_num, ratio_den, sample_rate, new_sample_rate);
+                resampler_state.resample_ratio_num = ratio_num;
+                resampler_state.resample_ratio_den = ratio_den;
         }
 
         /// @todo
@@ -393,30 +427,61 @@ bool audio_frame2::resample([[maybe_unused]] audio_frame2_resampler & resampler_
         /// Parallel resampling would reduce latency (and improve performance if there is not
         /// enough single-core power).
         for (size_t i = 0; i < channels.size(); i++) {
+                // output storage + 10 ms headroom
+                size_t new_size = channels[i].len * new_sample_rate / sample_rate / min(drift, 1.0) + new_sample_rate * sizeof(int16_t) / 100;
+                char *out = get_spare(i, new_size);
                 uint32_t in_frames = get_data_len(i) / sizeof(int16_t);
                 uint32_t in_frames_orig = in_frames;
-                uint32_t write_frames = new_channels[i].len;
+                uint32_t write_frames = new_size / sizeof(int16_t);
 
                 speex_resampler_process_int(
                                 (SpeexResamplerState *) resampler_state.resampler,
                                 i,
                                 (const spx_int16_t *)(const void *) get_data(i), &in_frames,
-                                (spx_int16_t *)(void *) new_channels[i].data.get(), &write_frames);
+                                (spx_int16_t *)(void *) out, &write_frames);
                 if (in_frames != in_frames_orig) {
                         LOG(LOG_LEVEL_WARNING) << "Audio frame resampler: not all samples resampled!\n";
                 }
-                new_channels[i].len = write_frames * sizeof(int16_t);
+                swap_spare(i, write_frames * sizeof(int16_t));
         }
 
         sample_rate = new_sample_rate;
-        channels = move(new_channels);
         return true;
 #else
         UNUSED(resampler_state.resample_from);
         UNUSED(resampler_state.resample_to);
         UNUSED(resampler_state.resample_ch_count);
+        UNUSED(resampler_state.resample_ratio_num);
+        UNUSED(resampler_state.resample_ratio_den);
         LOG(LOG_LEVEL_ERROR) << "Audio frame resampler: cannot resample, SpeexDSP was not compiled in!\n";
         return false;
 #endif
 }
 
+audio_frame2_pool::audio_frame2_pool(size_t max) : max_frames(max)
+{
+        frames.reserve(max_frames);
+}
+
+/**
+ * @returns empty frame (evaluating to false), possibly with preallocated
+ * buffers that are reused by audio_frame2::init()
+ */
+audio_frame2 audio_frame2_pool::get()
+{
+        if (frames.empty()) {
+                return {};
+        }
+        audio_frame2 ret = std::move(frames.back());
+        frames.pop_back();
+        ret.reset();
+        ret.codec = AC_NONE;
+        return ret;
+}
+
+void audio_frame2_pool::put(audio_frame2 &&frame)
+{
+        if (frames.size() < max_frames) {
+                frames.push_back(std::move(frame));
+        }
+}
@@ -127,6 +127,8 @@ private:
         int resample_from;
         size_t resample_ch_count;
         int resample_to;
+        uint32_t resample_ratio_num; ///< ratio actually set (including drift)
+        uint32_t resample_ratio_den;
 
         friend class audio_frame2;
 };
@@ -143,6 +145,7 @@ public:
         audio_frame2(audio_frame2 const &) = delete;
         audio_frame2(audio_frame2 &&) = default;
         explicit audio_frame2(const struct audio_frame *);
+        void assign(const struct audio_frame *);
         audio_frame2& operator=(audio_frame2 const &) = delete;
         audio_frame2& operator=(audio_frame2 &&) = default;
         bool operator!() const;
@@ -181,17 +184,26 @@ public:
          *                        to use it only in a stream that may change sometimes but
          *                        do not eg. share it between two streams that has different
          *                        properties.
+         * @param drift          ratio of the sender clock to the receiver clock - the
+         *                        output is compressed (drift > 1) or stretched (drift < 1)
+         *                        accordingly. Changing it doesn't reinitialize the
+         *                        resampler so it can be adjusted continuously.
          * @retval false          if SpeexDSP was not compiled in
          */
-        bool resample(audio_frame2_resampler &resampler_state, int new_sample_rate);
+        bool resample(audio_frame2_resampler &resampler_state, int new_sample_rate, double drift = 1.0);
 private:
+        friend class audio_frame2_pool;
         struct channel {
                 std::unique_ptr<char []> data;
                 size_t len;
                 size_t max_len;
                 struct fec_desc fec_params;
+                std::unique_ptr<char []> spare; ///< scratch for out-of-place conversions, swapped with data
+                size_t spare_max_len;
         };
         void reserve(int channel, size_t len);
+        char *get_spare(int channel, size_t len);
+        void swap_spare(int channel, size_t new_len);
         int bps;                /* bytes per sample */
         int sample_rate;
         std::vector<channel> channels; /* data should be at least 4B aligned */
@@ -199,6 +211,24 @@ private:
         double duration; ///< for compressed formats where this cannot be directly determined from samples/sample_rate
 };
 
+/**
+ * Keeps released audio_frame2 instances so that their buffers can be reused
+ * in the next iteration instead of being freed and allocated again. Once the
+ * buffers grow to the stream size, get() and put() do not allocate.
+ *
+ * Not thread-safe - intended to be owned by the stage producing the frames
+ * and fed back by the consumer in the same thread.
+ */
+class audio_frame2_pool {
+public:
+        explicit audio_frame2_pool(size_t max_frames = 4);
+        audio_frame2 get();
+        void put(audio_frame2 &&frame);
+private:
+        std::vector<audio_frame2> frames;
+        size_t max_frames;
+};
+
 #endif // __cplusplus
 
 #endif // defined AUDIO_TYPES_H
@@ -54,6 +54,7 @@
 #include "audio/utils.h"
 #include "debug.h"
 #include "host.h" // ADD_TO_PARAM
+#include "utils/macros.h"
 
 #ifdef WORDS_BIGENDIAN
 #error "This code will not run with a big-endian machine. Please report a bug to " PACKAGE_BUGREPORT " if you reach here."
@@ -109,6 +110,20 @@ template<> void store_sample<4>(char *data, int32_t val) {
         *reinterpret_cast<int32_t *>(data) = val;
 }
 
+/**
+ * Instantiates kernel template for the runtime BPS value (1-4) so that the
+ * per-sample loops have constant-size loads and stores and can be vectorized.
+ */
+#define DISPATCH_BPS(bps, kernel, ...) do { \
+        switch (bps) { \
+        case 1: kernel<1>(__VA_ARGS__); break; \
+        case 2: kernel<2>(__VA_ARGS__); break; \
+        case 3: kernel<3>(__VA_ARGS__); break; \
+        case 4: kernel<4>(__VA_ARGS__); break; \
+        default: abort(); \
+        } \
+} while (0)
+
 /**
  * @brief Calculates mean and peak RMS from audio samples
  *
@@ -242,6 +257,40 @@ void change_bps(char *out, int out_bps, const char *in, int in_bps, int in_len /
         change_bps2(out, out_bps, in, in_bps, in_len, dither);
 }
 
+template<int IN_BPS, int OUT_BPS>
+static void change_bps_kernel(char * __restrict out, const char * __restrict in, int samples, bool dither)
+{
+        if constexpr (IN_BPS < OUT_BPS) {
+                OPTIMIZED_FOR (int i = 0; i < samples; i++) {
+                        int32_t in_value = load_sample<IN_BPS>(in + i * IN_BPS);
+                        store_sample<OUT_BPS>(out + i * OUT_BPS, in_value * (1 << (OUT_BPS * 8 - IN_BPS * 8)));
+                }
+        } else if (dither) { // downsampling
+                const int downshift = IN_BPS * 8 - OUT_BPS * 8;
+                for (int i = 0; i < samples; i++) {
+                        int32_t in_value = load_sample<IN_BPS>(in + i * IN_BPS);
+                        store_sample<OUT_BPS>(out + i * OUT_BPS, downshift_with_dither(in_value, downshift));
+                }
+        } else { // no dithering
+                OPTIMIZED_FOR (int i = 0; i < samples; i++) {
+                        int32_t in_value = load_sample<IN_BPS>(in + i * IN_BPS);
+                        store_sample<OUT_BPS>(out + i * OUT_BPS, in_value >> (IN_BPS * 8 - OUT_BPS * 8));
+                }
+        }
+}
+
+template<int IN_BPS>
+static void change_bps_from(char *out, int out_bps, const char *in, int samples, bool dither)
+{
+        switch (out_bps) {
+        case 1: change_bps_kernel<IN_BPS, 1>(out, in, samples, dither); break;
+        case 2: change_bps_kernel<IN_BPS, 2>(out, in, samples, dither); break;
+        case 3: change_bps_kernel<IN_BPS, 3>(out, in, samples, dither); break;
+        case 4: change_bps_kernel<IN_BPS, 4>(out, in, samples, dither); break;
+        default: abort();
+        }
+}
+
 void change_bps2(char *out, int out_bps, const char *in, int in_bps, int in_len /* bytes */, bool dither)
 {
         assert ((unsigned int) out_bps <= sizeof(int32_t));
@@ -252,37 +301,7 @@ void change_bps2(char *out, int out_bps, const char *in, int in_bps, int in_len
                 return;
         }
 
-        if (in_bps < out_bps ) {
-                for (int i = 0; i < in_len / in_bps; i++) {
-                        int32_t in_value = format_from_in_bps(in, in_bps);
-                        int32_t out_value = in_value << (out_bps * 8 - in_bps * 8);
-                        format_to_out_bps(out, out_bps, out_value);
-                        in += in_bps;
-                        out += out_bps;
-                }
-                return;
-        }
-
-        // downsampling
-        if (dither) {
-                const int downshift = in_bps * 8 - out_bps * 8;
-                for (int i = 0; i < in_len / in_bps; i++) {
-                        int32_t in_value = format_from_in_bps(in, in_bps);
-                        int32_t out_value = downshift_with_dither(in_value, downshift);
-                        format_to_out_bps(out, out_bps, out_value);
-                        in += in_bps;
-                        out += out_bps;
-                }
-                return;
-        }
-        // no dithering
-        for (int i = 0; i < in_len / in_bps; i++) {
-                int32_t in_value = format_from_in_bps(in, in_bps);
-                int32_t out_value = in_value >> (in_bps * 8 - out_bps * 8);
-                format_to_out_bps(out, out_bps, out_value);
-                in += in_bps;
-                out += out_bps;
-        }
+        DISPATCH_BPS(in_bps, change_bps_from, out, out_bps, in, in_len / in_bps, dither);
 }
 
 void copy_channel(char *out, const char *in, int bps, int in_len /* bytes */, int out_channel_count)
@@ -313,93 +332,73 @@ void audio_frame_multiply_channel(struct audio_frame *frame, int new_channel_cou
         copy_channel(frame->data, frame->data, frame->bps, frame->data_len, new_channel_count);
 }
 
-void demux_channel(char *out, char *in, int bps, int in_len, int in_stream_channels, int pos_in_stream)
+/// copies samples between (possibly) interleaved streams
+template<int BPS>
+static void copy_strided(char * __restrict out, int out_stride, const char * __restrict in, int in_stride, int samples)
 {
-        int samples = in_len / (in_stream_channels * bps);
-        int i;
-
-        assert (bps <= 4);
-
-        in += pos_in_stream * bps;
-
-        for (i = 0; i < samples; ++i) {
-                memcpy(out, in, bps);
+        OPTIMIZED_FOR (int i = 0; i < samples; ++i) {
+                memcpy(out + i * out_stride * BPS, in + i * in_stride * BPS, BPS);
+        }
+}
 
-                out += bps;
-                in += in_stream_channels * bps;
+template<int BPS>
+static void scale_strided(char * __restrict out, int out_stride, const char * __restrict in, int samples, double scale)
+{
+        for (int i = 0; i < samples; ++i) {
+                int32_t in_value = load_sample<BPS>(in + i * BPS);
+                store_sample<BPS>(out + i * out_stride * BPS, in_value * scale);
+        }
+}
 
+template<int BPS>
+static void mix_strided(char * __restrict out, int out_stride, const char * __restrict in, int samples, double scale)
+{
+        for (int i = 0; i < samples; ++i) {
+                int32_t in_value = load_sample<BPS>(in + i * BPS);
+                int32_t out_value = load_sample<BPS>(out + i * out_stride * BPS);
+                store_sample<BPS>(out + i * out_stride * BPS, (double) in_value * scale + out_value);
         }
 }
 
-void remux_channel(char *out, const char *in, int bps, int in_len, int in_stream_channels, int out_stream_channels, int pos_in_stream, int pos_out_stream)
+void demux_channel(char *out, char *in, int bps, int in_len, int in_stream_channels, int pos_in_stream)
 {
         int samples = in_len / (in_stream_channels * bps);
-        int i;
 
         assert (bps <= 4);
 
-        in += pos_in_stream * bps;
-        out += pos_out_stream * bps;
+        DISPATCH_BPS(bps, copy_strided, out, 1, in + pos_in_stream * bps, in_stream_channels, samples);
+}
 
-        for (i = 0; i < samples; ++i) {
-                memcpy(out, in, bps);
+void remux_channel(char *out, const char *in, int bps, int in_len, int in_stream_channels, int out_stream_channels, int pos_in_stream, int pos_out_stream)
+{
+        int samples = in_len / (in_stream_channels * bps);
 
-                out += bps * out_stream_channels;
-                in += bps * in_stream_channels;
+        assert (bps <= 4);
 
-        }
+        DISPATCH_BPS(bps, copy_strided, out + pos_out_stream * bps, out_stream_channels, in + pos_in_stream * bps,
+                        in_stream_channels, samples);
 }
 
 void mux_channel(char *out, const char *in, int bps, int in_len, int out_stream_channels, int pos_in_stream, double scale)
 {
         int samples = in_len / bps;
-        int i;
-        
+
         assert (bps <= 4);
 
         out += pos_in_stream * bps;
 
         if(scale == 1.0) {
-                for (i = 0; i < samples; ++i) {
-                        memcpy(out, in, bps);
-
-                        in += bps;
-                        out += out_stream_channels * bps;
-
-                }
+                DISPATCH_BPS(bps, copy_strided, out, out_stream_channels, in, 1, samples);
         } else {
-                for (i = 0; i < samples; ++i) {
-                        int32_t in_value = format_from_in_bps(in, bps);
-
-                        in_value *= scale;
-
-                        format_to_out_bps(out, bps, in_value);
-
-                        in += bps;
-                        out += out_stream_channels * bps;
-                }
+                DISPATCH_BPS(bps, scale_strided, out, out_stream_channels, in, samples, scale);
         }
 }
 
 void mux_and_mix_channel(char *out, const char *in, int bps, int in_len, int out_stream_channels, int pos_in_stream, double scale)
 {
-        int i;
-
         assert (bps <= 4);
 
-        out += pos_in_stream * bps;
-
-        for(i = 0; i < in_len / bps; i++) {
-                int32_t in_value = format_from_in_bps(in, bps);
-                int32_t out_value = format_from_in_bps(out, bps);
-
-                int32_t new_value = (double)in_value * scale + out_value;
-
-                format_to_out_bps(out, bps, new_value);
-
-                in += bps;
-                out += out_stream_channels * bps;
-        }
+        DISPATCH_BPS(bps, mix_strided, out + pos_in_stream * bps, out_stream_channels, in, in_len / bps, scale);
 }
 
 template<int BPS>
@@ -445,11 +444,9 @@ void float2int(char *out, const char *in, int len)
         int32_t *outi = (int32_t *)(void *) out;
         int items = len / sizeof(int32_t);
 
-        while(items-- > 0) {
-                float sample = *inf++;
-                if(sample > 1.0) sample = 1.0;
-                if(sample < -1.0) sample = -1.0;
-                *outi++ = sample * INT_MAX_FLT;
+        OPTIMIZED_FOR (int i = 0; i < items; ++i) {
+                float sample = min(max(inf[i], -1.0F), 1.0F);
+                outi[i] = sample * INT_MAX_FLT;
         }
 }
 
@@ -459,8 +456,8 @@ void int2float(char *out, const char *in, int len)
         float *outf = (float *)(void *) out;
         int items = len / sizeof(int32_t);
 
-        while(items-- > 0) {
-                *outf++ = (float) *ini++ / (float) INT_MAX;
+        OPTIMIZED_FOR (int i = 0; i < items; ++i) {
+                outf[i] = (float) ini[i] / (float) INT_MAX;
         }
 }
 
@@ -470,8 +467,9 @@ void short_int2float(char *out, const char *in, int in_len)
         float *outf = (float *)(void *) out;
         int items = in_len / sizeof(int16_t);
 
-        while(items-- > 0) {
-                *outf++ = (float) *ini++ / SHRT_MAX;
+        // runs backwards - the output is wider so it can be used in situ
+        for (int i = items - 1; i >= 0; --i) {
+                outf[i] = (float) ini[i] / SHRT_MAX;
         }
 }
 
@@ -527,19 +525,58 @@ void format_to_out_bps(char *out, int bps, int32_t out_value) {
 
 void interleaved2noninterleaved(char *out, const char *in, int bps, int in_len, int channel_count)
 {
-        vector<char *> out_ch(channel_count);
+        int samples = in_len / bps / channel_count;
         for (int i = 0; i < channel_count; ++i) {
-                out_ch[i] = out + in_len / channel_count * i;
+                DISPATCH_BPS(bps, copy_strided, out + in_len / channel_count * i, 1, in + i * bps, channel_count, samples);
         }
+}
 
-        int offset = 0;
-        int index = 0;
-        while (offset < in_len) {
-                memcpy(out_ch[index], in, bps);
-                out_ch[index] += bps;
-                index = (index + 1) % channel_count;
-                in += bps;
-                offset += bps;
+template<int BPS>
+static void to_planar_float(float * __restrict out, const char * __restrict in, int in_stride, int samples)
+{
+        const float k = 1.0F / (1U << (BPS * 8U - 1U));
+        OPTIMIZED_FOR (int i = 0; i < samples; ++i) {
+                out[i] = load_sample<BPS>(in + i * in_stride * BPS) * k;
+        }
+}
+
+template<int BPS>
+static void from_planar_float(char * __restrict out, int out_stride, const float * __restrict in, int samples)
+{
+        const float k = BPS == 4 ? INT_MAX_FLT : (float) (1U << (BPS * 8U - 1U));
+        const float lo = BPS == 4 ? (float) INT_MIN : -k;
+        const float hi = BPS == 4 ? INT_MAX_FLT : k - 1.0F;
+        OPTIMIZED_FOR (int i = 0; i < samples; ++i) {
+                float val = min(max(in[i] * k, lo), hi);
+                store_sample<BPS>(out + i * out_stride * BPS, static_cast<int32_t>(val));
+        }
+}
+
+void audio_interleaved_to_planar_float(float *const *out, const char *in, int bps, int sample_count, int channel_count)
+{
+        for (int i = 0; i < channel_count; ++i) {
+                DISPATCH_BPS(bps, to_planar_float, out[i], in + i * bps, channel_count, sample_count);
+        }
+}
+
+void audio_planar_float_to_interleaved(char *out, int bps, const float *const *in, int sample_count, int channel_count)
+{
+        for (int i = 0; i < channel_count; ++i) {
+                DISPATCH_BPS(bps, from_planar_float, out + i * bps, channel_count, in[i], sample_count);
+        }
+}
+
+void audio_planar_float_mix(float * __restrict out, const float * __restrict in, float scale, int sample_count)
+{
+        OPTIMIZED_FOR (int i = 0; i < sample_count; ++i) {
+                out[i] += in[i] * scale;
+        }
+}
+
+void audio_planar_float_scale(float *data, float scale, int sample_count)
+{
+        OPTIMIZED_FOR (int i = 0; i < sample_count; ++i) {
+                data[i] *= scale;
         }
 }
 
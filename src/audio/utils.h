@@ -138,6 +138,24 @@ void signed2unsigned(char *out, const char *in, int in_len);
 
 struct audio_desc audio_desc_from_frame(const struct audio_frame *frame);
 
+/**
+ * @name Planar float fast path
+ * Samples are normalized floats, one buffer per channel. Intended for
+ * processing of many channels - only the edges (devices, codecs) convert
+ * from/to integer interleaved formats, remapping, scaling and mixing in
+ * between are done by the vectorized kernels below. Exact for up to 24 bits
+ * per sample.
+ * @{
+ */
+/// @param channel_count interleaved channels in in, out holds channel_count buffers of sample_count samples
+void audio_interleaved_to_planar_float(float *const *out, const char *in, int bps, int sample_count, int channel_count);
+/// converts back with clamping, in holds channel_count buffers of sample_count samples
+void audio_planar_float_to_interleaved(char *out, int bps, const float *const *in, int sample_count, int channel_count);
+/// out += in * scale
+void audio_planar_float_mix(float *out, const float *in, float scale, int sample_count);
+void audio_planar_float_scale(float *data, float scale, int sample_count);
+/// @}
+
 int32_t format_from_in_bps(const char * in, int bps);
 void format_to_out_bps(char *out, int bps, int32_t out_value);
 
@@ -166,42 +166,61 @@ int wav_writer_write(struct wav_writer_file *wav, long long sample_count, const
         return 0;
 }
 
-bool wav_writer_close(struct wav_writer_file *wav)
+/**
+ * Writes the current chunk sizes to the header, file position is left after
+ * the size of the data chunk.
+ */
+static bool write_sizes(struct wav_writer_file *wav, int padding_byte_len, bool warn_oversize)
 {
-        int padding_byte_len = 0;
-        if ((wav->fmt.ch_count * wav->fmt.bps * wav->samples_written) % 2 == 1) {
-                char padding_byte = '\0';
-                padding_byte_len = 1;
-                if (fwrite(&padding_byte, sizeof(padding_byte), 1, wav->outfile) != 1) {
-                        goto error;
-                }
-        }
-
         int64_t ret = _fseeki64(wav->outfile, CK_MASTER_SIZE_OFFSET, SEEK_SET);
         if (ret != 0) {
-                goto error;
+                return false;
         }
         long long ck_master_size = 4 + FMT_CHUNK_SIZE_BRUT + (DATA_CHUNK_HDR_SIZE + wav->fmt.bps *
                         wav->fmt.ch_count * wav->samples_written + padding_byte_len);
-        if (ck_master_size > UINT32_MAX) {
+        if (ck_master_size > UINT32_MAX && warn_oversize) {
                 fprintf(stderr, "[WAV writer] Data size exceeding 4 GiB, resulting file may be incompatible!\n");
         }
 
         uint32_t val = ck_master_size < UINT32_MAX ? ck_master_size : UINT32_MAX;
         size_t res = fwrite(&val, sizeof val, 1, wav->outfile);
         if(res != 1) {
-                goto error;
+                return false;
         }
 
         ret = _fseeki64(wav->outfile, CK_DATA_SIZE_OFFSET, SEEK_SET);
         if (ret != 0) {
-                goto error;
+                return false;
         }
         long long ck_data_size = wav->fmt.bps *
                         wav->fmt.ch_count * wav->samples_written;
         val = ck_data_size < UINT32_MAX ? ck_data_size : UINT32_MAX;
         res = fwrite(&val, sizeof val, 1, wav->outfile);
-        if(res != 1) {
+        return res == 1;
+}
+
+bool wav_writer_update_header(struct wav_writer_file *wav)
+{
+        bool ret = write_sizes(wav, 0, false) && _fseeki64(wav->outfile, 0, SEEK_END) == 0 &&
+                fflush(wav->outfile) == 0;
+        if (!ret) {
+                fprintf(stderr, "[WAV writer] Could not update header.\n");
+        }
+        return ret;
+}
+
+bool wav_writer_close(struct wav_writer_file *wav)
+{
+        int padding_byte_len = 0;
+        if ((wav->fmt.ch_count * wav->fmt.bps * wav->samples_written) % 2 == 1) {
+                char padding_byte = '\0';
+                padding_byte_len = 1;
+                if (fwrite(&padding_byte, sizeof(padding_byte), 1, wav->outfile) != 1) {
+                        goto error;
+                }
+        }
+
+        if (!write_sizes(wav, padding_byte_len, true)) {
                 goto error;
         }
 
@@ -214,4 +233,3 @@ error:
         free(wav);
         return false;
 }
-
@@ -66,6 +66,12 @@ struct wav_writer_file *wav_writer_create(const char *filename, struct audio_des
  */
 int wav_writer_write(struct wav_writer_file *wav, long long sample_count, const char *data);
 
+/**
+ * Updates the sizes in the header to the samples written so far so that the
+ * file is valid even if not closed properly. Writing then continues at the end.
+ */
+bool wav_writer_update_header(struct wav_writer_file *wav);
+
 /**
  * @param wav file returned by wav_write_header, will be closed by this call
  *            and must not be used after
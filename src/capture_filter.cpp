@@ -47,13 +47,17 @@
 #include "module.h"
 #include "utils/color_out.h"
 #include "utils/list.h"
+#include "utils/worker.h"
 #include "video.h"
 
+#include <vector>
+
 using namespace std;
 
 struct capture_filter {
         struct module mod;
         struct simple_linked_list *filters;
+        bool decimated_upstream; ///< first filter's decimation is done by the capture
 };
 
 struct capture_filter_instance {
@@ -177,11 +181,19 @@ static struct response *process_message(struct capture_filter *s, struct msg_uni
                                         index);
                         return new_response(RESPONSE_INT_SERV_ERR, NULL);
                 } else {
+                        if (index == 0 && s->decimated_upstream) {
+                                log_msg(LOG_LEVEL_WARNING, "Capture filter #0 was decimating the capture itself, frame rate stays reduced.\n");
+                                s->decimated_upstream = false;
+                        }
                         printf("Capture filter #%d removed successfully.\n", index);
                         inst->functions->done(inst->state);
                         free(inst);
                 }
         } else if (strcmp("flush", msg->text) == 0) {
+                if (s->decimated_upstream) {
+                        log_msg(LOG_LEVEL_WARNING, "Capture filter #0 was decimating the capture itself, frame rate stays reduced.\n");
+                        s->decimated_upstream = false;
+                }
                 while(simple_linked_list_size(s->filters) > 0) {
                         struct capture_filter_instance *inst = (struct capture_filter_instance *) simple_linked_list_pop(s->filters);
                         inst->functions->done(inst->state);
@@ -209,6 +221,79 @@ static struct response *process_message(struct capture_filter *s, struct msg_uni
         return new_response(RESPONSE_OK, NULL);
 }
 
+/**
+ * @returns n if the capture may deliver only every n-th frame because the
+ * first filter would drop the others anyway, 1 otherwise
+ */
+int capture_filter_get_decimation(struct capture_filter *s)
+{
+        if (simple_linked_list_size(s->filters) == 0) {
+                return 1;
+        }
+        auto *inst = static_cast<struct capture_filter_instance *>(simple_linked_list_first(s->filters));
+        if (inst->functions->get_decimation == nullptr) {
+                return 1;
+        }
+        return inst->functions->get_decimation(inst->state);
+}
+
+/**
+ * Tells the first filter that the capture honors capture_filter_get_decimation().
+ */
+void capture_filter_set_decimated_upstream(struct capture_filter *s)
+{
+        assert(capture_filter_get_decimation(s) > 1);
+        auto *inst = static_cast<struct capture_filter_instance *>(simple_linked_list_first(s->filters));
+        inst->functions->set_decimated_upstream(inst->state);
+        s->decimated_upstream = true;
+}
+
+static bool has_line_kernel(struct capture_filter_instance *inst, codec_t codec)
+{
+        return inst->functions->filter_line != nullptr && inst->functions->line_supported != nullptr
+                && inst->functions->line_supported(inst->state, codec);
+}
+
+struct fused_run {
+        codec_t codec;
+        size_t linesize;
+        const vector<struct capture_filter_instance *> *filters;
+};
+
+/// processes a horizontal stripe, lines ping-pong between output and a scratch line
+static void fused_run_stripe(void *in, void *out, size_t data_len, void *udata)
+{
+        auto *r = static_cast<struct fused_run *>(udata);
+        vector<unsigned char> scratch(r->linesize);
+        size_t count = r->filters->size();
+        for (size_t off = 0; off < data_len; off += r->linesize) {
+                const unsigned char *src = static_cast<unsigned char *>(in) + off;
+                unsigned char *out_line = static_cast<unsigned char *>(out) + off;
+                // last kernel must write to out_line
+                unsigned char *dst = count % 2 == 1 ? out_line : scratch.data();
+                for (auto *inst : *r->filters) {
+                        inst->functions->filter_line(inst->state, r->codec, dst, src, r->linesize);
+                        src = dst;
+                        dst = dst == out_line ? scratch.data() : out_line;
+                }
+        }
+}
+
+/**
+ * Applies the filters (all having line kernel) in a single pass.
+ */
+static struct video_frame *run_fused(const vector<struct capture_filter_instance *> &filters, struct video_frame *in)
+{
+        struct video_frame *out = vf_alloc_desc_data(video_desc_from_frame(in));
+        out->callbacks.dispose = vf_free;
+        for (unsigned int i = 0; i < in->tile_count; ++i) {
+                struct fused_run r{in->color_spec, (size_t) vc_get_linesize(in->tiles[i].width, in->color_spec), &filters};
+                respawn_parallel(in->tiles[i].data, out->tiles[i].data, in->tiles[i].height, r.linesize, fused_run_stripe, &r);
+        }
+        VIDEO_FRAME_DISPOSE(in);
+        return out;
+}
+
 struct video_frame *capture_filter(struct capture_filter *state, struct video_frame *frame) {
         struct capture_filter *s = state;
 
@@ -218,14 +303,26 @@ struct video_frame *capture_filter(struct capture_filter *state, struct video_fr
                 free_message(msg, r);
         }
 
+        vector<struct capture_filter_instance *> fused;
         for(void *it = simple_linked_list_it_init(s->filters);
                         it != NULL;
            ) {
                 struct capture_filter_instance *inst = (struct capture_filter_instance *) simple_linked_list_it_next(&it);
+                if (has_line_kernel(inst, frame->color_spec)) {
+                        fused.push_back(inst);
+                        continue;
+                }
+                if (!fused.empty()) {
+                        frame = run_fused(fused, frame);
+                        fused.clear();
+                }
                 frame = inst->functions->filter(inst->state, frame);
                 if(!frame)
                         return NULL;
         }
+        if (!fused.empty()) {
+                frame = run_fused(fused, frame);
+        }
         return frame;
 }
 
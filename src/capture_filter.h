@@ -38,7 +38,9 @@
 #ifndef CAPTURE_FILTER_H_
 #define CAPTURE_FILTER_H_
 
-#define CAPTURE_FILTER_ABI_VERSION 2
+#define CAPTURE_FILTER_ABI_VERSION 4
+
+#include "types.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -67,6 +69,23 @@ struct capture_filter_info {
         /// This behavior may change towards use of shared_ptr<video_frame>
         /// in future.
         struct video_frame *(*filter)(void *state, struct video_frame *f);
+        /// @brief Optional - tells whether filter_line() can be used for the codec
+        /// Consecutive filters providing a line kernel for the frame codec are
+        /// fused - applied line by line within a single pass over the frame
+        /// instead of calling filter().
+        bool (*line_supported)(void *state, codec_t codec);
+        /// @brief Optional - processes a single line, the format must be kept
+        /// @param dst  output line, never overlaps with src
+        /// @param len  line length in bytes
+        void (*filter_line)(void *state, codec_t codec, unsigned char * __restrict dst,
+                        const unsigned char * __restrict src, size_t len);
+        /// @brief Optional - returns n if the filter passes exactly every n-th
+        /// frame regardless of its content (1 otherwise)
+        /// Used to hint the capture that it may produce only those frames.
+        int (*get_decimation)(void *state);
+        /// @brief Optional (required if get_decimation is set) - the capture
+        /// already decimates the frames, the filter must pass all frames
+        void (*set_decimated_upstream)(void *state);
 };
 
 struct capture_filter;
@@ -79,6 +98,8 @@ struct video_frame;
 int capture_filter_init(struct module *parent, const char *cfg, struct capture_filter **state);
 void capture_filter_destroy(struct capture_filter *state);
 struct video_frame *capture_filter(struct capture_filter *state, struct video_frame *frame);
+int capture_filter_get_decimation(struct capture_filter *state);
+void capture_filter_set_decimated_upstream(struct capture_filter *state);
 
 #ifdef __cplusplus
 }
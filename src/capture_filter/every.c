@@ -59,6 +59,7 @@ struct state_every {
         int num;
         int denom;
         int current;
+        bool decimated_upstream; ///< capture delivers only the passed frames
 };
 
 static void usage() {
@@ -67,6 +68,8 @@ static void usage() {
         printf("\tevery:numerator[/denominator]\n\n");
         printf("Example: every:2 - every second frame will be dropped\n");
         printf("The special case every:0 can be used to discard all frames\n");
+        printf("\nIf every:n (without denominator) is the first capture filter, capture\n"
+               "drivers that support it (testcard, import) skip the frames themselves.\n");
 }
 
 static int init(struct module *parent, const char *cfg, void **state)
@@ -113,10 +116,26 @@ static void dispose_frame(struct video_frame *f) {
         vf_free(f);
 }
 
+static int get_decimation(void *state)
+{
+        struct state_every *s = state;
+        return s->num > 0 && s->denom == 1 ? s->num : 1;
+}
+
+static void set_decimated_upstream(void *state)
+{
+        struct state_every *s = state;
+        s->decimated_upstream = true;
+}
+
 static struct video_frame *filter(void *state, struct video_frame *in)
 {
         struct state_every *s = state;
 
+        if (s->decimated_upstream) {
+                return in;
+        }
+
         if (s->num == 0) {
                 VIDEO_FRAME_DISPOSE(in);
                 return NULL;
@@ -143,6 +162,8 @@ static const struct capture_filter_info capture_filter_every = {
         .init = init,
         .done = done,
         .filter = filter,
+        .get_decimation = get_decimation,
+        .set_decimated_upstream = set_decimated_upstream,
 };
 
 REGISTER_MODULE(every, &capture_filter_every, LIBRARY_CLASS_CAPTURE_FILTER, CAPTURE_FILTER_ABI_VERSION);
@@ -41,9 +41,9 @@
 #include "config_win32.h"
 #endif /* HAVE_CONFIG_H */
 
+#include <algorithm>
 #include <iostream>
 #include <stdexcept>
-#include <thread>
 #include <vector>
 
 #include "capture_filter.h"
@@ -51,6 +51,7 @@
 #include "lib_common.h"
 #include "rang.hpp"
 #include "utils/color_out.h"
+#include "utils/misc.h"
 #include "utils/worker.h"
 #include "video.h"
 #include "video_codec.h"
@@ -60,10 +61,11 @@ constexpr const char *MOD_NAME = "[gamma cap. f.] ";
 
 using std::cout;
 using std::exception;
+using std::max;
+using std::min;
 using std::numeric_limits;
 using rang::style;
 using std::vector;
-using std::thread;
 
 struct state_capture_filter_gamma {
 public:
@@ -107,20 +109,59 @@ public:
                 }
         }
 
+        /// applies LUT (single-threaded) if input and output depths equal
+        void apply_gamma_line(codec_t codec, size_t len, const void * __restrict in, void * __restrict out) {
+                if (codec == RGB) {
+                        apply_lut_line<uint8_t, uint8_t>(len, lut8, in, out);
+                } else {
+                        apply_lut_line<uint16_t, uint16_t>(len, lut16, in, out);
+                }
+        }
+
 private:
+        template<typename inT, typename outT>
+        static void apply_lut_line(size_t len, const vector<outT> &lut, const void *in, void *out) {
+                const auto *in_data = static_cast<const inT *>(in);
+                auto *out_data = static_cast<outT *>(out);
+                for (size_t i = 0; i < len / sizeof(inT); ++i) {
+                        out_data[i] = lut[in_data[i]];
+                }
+        }
+
         template<typename inT, typename outT>
         struct data {
                 size_t len;
-                const vector<outT> &lut;
+                const outT *lut;
                 const inT *in;
                 outT *out;
         };
 
+        /**
+         * The 8-bit tables (256 entries) stay resident in L1 so scalar
+         * loads are already gather-free; a byte-shuffle LUT would need 16
+         * PSHUFBs plus blends per 16 samples, which is slower than this
+         * without VBMI. The loop is unrolled so that the independent
+         * loads overlap.
+         */
         template<typename inT, typename outT>
         static void *compute(void *arg) {
                 auto *d = static_cast<struct data<inT, outT> *>(arg);
-                for (size_t i = 0; i < d->len; ++i) {
-                        d->out[i] = d->lut[d->in[i]];
+                const inT *__restrict in = d->in;
+                outT *__restrict out = d->out;
+                const outT *__restrict lut = d->lut;
+                size_t i = 0;
+                for ( ; i + 4 <= d->len; i += 4) {
+                        outT o0 = lut[in[i]];
+                        outT o1 = lut[in[i + 1]];
+                        outT o2 = lut[in[i + 2]];
+                        outT o3 = lut[in[i + 3]];
+                        out[i] = o0;
+                        out[i + 1] = o1;
+                        out[i + 2] = o2;
+                        out[i + 3] = o3;
+                }
+                for ( ; i < d->len; ++i) {
+                        out[i] = lut[in[i]];
                 }
                 return nullptr;
         }
@@ -129,21 +170,23 @@ private:
         {
                 auto *in_data = static_cast<const inT*>(in);
                 auto *out_data = static_cast<outT*>(out);
-                unsigned int cpus = thread::hardware_concurrency();
                 in_len /= sizeof(inT);
-                vector<data<inT, outT>> d;
-                vector<task_result_handle_t> handles(cpus);
-                for (unsigned int i = 0; i < cpus; i++) {
-                        d.push_back({in_len / cpus, lut, in_data + i * (in_len / cpus), out_data + i * (in_len / cpus)});
-                }
-                for (unsigned int i = 0; i < cpus; i++) {
-                        handles[i] = task_run_async(state_capture_filter_gamma::compute<inT, outT>, static_cast<void *>(&(d[i])));
+                int threads = max<int>(1, min<size_t>(get_cpu_core_count(), in_len * sizeof(inT) / MIN_JOB_LEN));
+                vector<data<inT, outT>> d(threads);
+                for (int i = 0; i < threads; i++) {
+                        size_t start = in_len * i / threads;
+                        size_t end = in_len * (i + 1) / threads;
+                        d[i] = { end - start, lut.data(), in_data + start, out_data + start };
                 }
-                for (unsigned int i = 0; i < cpus; i++) {
-                        wait_task(handles[i]);
+                if (threads == 1) {
+                        compute<inT, outT>(d.data());
+                } else {
+                        task_run_parallel(state_capture_filter_gamma::compute<inT, outT>, threads, d.data(), sizeof d[0], nullptr);
                 }
         }
 
+        static constexpr size_t MIN_JOB_LEN = 256 * 1024; ///< do not split smaller chunks among threads
+
         vector<uint8_t>  lut8;
         vector<uint16_t> lut16;
         vector<uint8_t>  lut16_8;
@@ -227,6 +270,17 @@ static auto filter(void *state, struct video_frame *in) -> video_frame *
         return out;
 }
 
+static bool line_supported(void *state, codec_t codec)
+{
+        auto *s = static_cast<state_capture_filter_gamma *>(state);
+        return (codec == RGB || codec == RG48) && (s->out_depth == 0 || s->out_depth == get_bits_per_component(codec));
+}
+
+static void filter_line(void *state, codec_t codec, unsigned char * __restrict dst, const unsigned char * __restrict src, size_t len)
+{
+        static_cast<state_capture_filter_gamma *>(state)->apply_gamma_line(codec, len, src, dst);
+}
+
 static void vo_pp_set_out_buffer(void *state, char *buffer)
 {
         auto *s = (state_capture_filter_gamma *) state;
@@ -237,6 +291,8 @@ static const struct capture_filter_info capture_filter_gamma = {
         .init = init,
         .done = done,
         .filter = filter,
+        .line_supported = line_supported,
+        .filter_line = filter_line,
 };
 
 REGISTER_MODULE(gamma, &capture_filter_gamma, LIBRARY_CLASS_CAPTURE_FILTER, CAPTURE_FILTER_ABI_VERSION);
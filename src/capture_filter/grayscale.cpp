@@ -103,6 +103,19 @@ static struct video_frame *filter(void *state, struct video_frame *in)
         return out;
 }
 
+static bool line_supported(void *, codec_t codec)
+{
+        return codec == UYVY;
+}
+
+static void filter_line(void *, codec_t, unsigned char * __restrict dst, const unsigned char * __restrict src, size_t len)
+{
+        for (size_t i = 0; i < len; i += 2) {
+                dst[i] = 127;
+                dst[i + 1] = src[i + 1];
+        }
+}
+
 static void vo_pp_set_out_buffer(void *state, char *buffer)
 {
         auto *s = static_cast<struct state_grayscale *>(state);
@@ -114,6 +127,8 @@ static const struct capture_filter_info capture_filter_grayscale = {
         .init = init,
         .done = done,
         .filter = filter,
+        .line_supported = line_supported,
+        .filter_line = filter_line,
 };
 
 REGISTER_MODULE(grayscale, &capture_filter_grayscale, LIBRARY_CLASS_CAPTURE_FILTER, CAPTURE_FILTER_ABI_VERSION);
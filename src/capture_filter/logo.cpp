@@ -47,6 +47,7 @@
 #include "capture_filter.h"
 #include "debug.h"
 #include "lib_common.h"
+#include "utils/overlay.h"
 #include "utils/pam.hpp"
 #include "video.h"
 #include "video_codec.h"
@@ -57,8 +58,11 @@ struct state_capture_filter_logo {
         unsigned char *logo = NULL;
         unsigned int width{}, height{};
         int x{}, y{};
+        struct overlay *overlay = nullptr; ///< logo prerendered for saved_desc
+        struct video_desc saved_desc{};
         ~state_capture_filter_logo() {
                 free(logo);
+                overlay_destroy(overlay);
         }
 };
 
@@ -151,31 +155,58 @@ static void done(void *state)
         delete s;
 }
 
+/// computes the logo position in the frame, returns false if it doesn't fit
+static bool get_logo_position(struct state_capture_filter_logo *s, struct video_frame *in, int *rect_x, int *rect_y)
+{
+        *rect_x = s->x;
+        *rect_y = s->y;
+        if (*rect_x < 0 || *rect_x + s->width > in->tiles[0].width) {
+                *rect_x = in->tiles[0].width - s->width;
+        }
+        assert(get_pf_block_bytes(in->color_spec) > 0);
+        *rect_x = (*rect_x / get_pf_block_bytes(in->color_spec)) * get_pf_block_bytes(in->color_spec);
+
+        if (*rect_y < 0 || *rect_y + s->height > in->tiles[0].height) {
+                *rect_y = in->tiles[0].height - s->height;
+        }
+
+        return *rect_x >= 0 && *rect_y >= 0;
+}
+
 static struct video_frame *filter(void *state, struct video_frame *in)
 {
         struct state_capture_filter_logo *s = (struct state_capture_filter_logo *)
                 state;
+        int rect_x = 0;
+        int rect_y = 0;
+
+        // the logo is converted to the frame codec once and only its visible part is blended
+        if (overlay_codec_supported(in->color_spec)) {
+                if (s->saved_desc != video_desc_from_frame(in)) {
+                        overlay_destroy(s->overlay);
+                        s->overlay = nullptr;
+                        if (get_logo_position(s, in, &rect_x, &rect_y)) {
+                                s->overlay = overlay_create(s->logo, s->width, s->height, in->color_spec,
+                                                in->tiles[0].width, rect_x, rect_y);
+                        }
+                        s->saved_desc = video_desc_from_frame(in);
+                }
+                if (s->overlay != nullptr) {
+                        overlay_blend(s->overlay, in->tiles[0].data,
+                                        vc_get_linesize(in->tiles[0].width, in->color_spec));
+                }
+                return in;
+        }
+
         decoder_t decoder, coder;
         decoder = get_decoder_from_to(in->color_spec, RGB);
         coder = get_decoder_from_to(RGB, in->color_spec);
-        int rect_x = s->x;
-        int rect_y = s->y;
         assert(coder != NULL && decoder != NULL);
 
         if (decoder == NULL || coder == NULL)
                 return in;
 
-        if (rect_x < 0 || rect_x + s->width > in->tiles[0].width) {
-                rect_x = in->tiles[0].width - s->width;
-        }
-        assert(get_pf_block_bytes(in->color_spec) > 0);
-        rect_x = (rect_x / get_pf_block_bytes(in->color_spec)) * get_pf_block_bytes(in->color_spec);
-
-        if (rect_y < 0 || rect_y + s->height > in->tiles[0].height) {
-                rect_y = in->tiles[0].height - s->height;
-        }
-
-        if (rect_x < 0 || rect_y < 0)
+        if (!get_logo_position(s, in, &rect_x, &rect_y))
                 return in;
 
         int dec_width = s->width;
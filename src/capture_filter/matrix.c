@@ -41,22 +41,47 @@
 #include "config_win32.h"
 #endif /* HAVE_CONFIG_H */
 
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+
 #include "capture_filter.h"
 #include "debug.h"
 #include "lib_common.h"
 #include "utils/color_out.h"
+#include "utils/misc.h"
+#include "utils/worker.h"
 #include "video.h"
 #include "video_codec.h"
 #include "vo_postprocess/capture_filter_wrapper.h"
 
 #define MOD_NAME "[matrix cap. f.] "
+#define MIN_JOB_LEN (256 * 1024) ///< do not split smaller chunks among threads
+#define SIMD_SHIFT 12            ///< fractional bits of 16-bit SIMD coefficients
+#define WIDE_SHIFT 24            ///< fractional bits of 64-bit scalar coefficients
+
+/// integer (fixed-point) form of the transformation matrix
+struct fixed_matrix {
+        int64_t c[9];
+        int shift;
+};
 
 struct state_capture_filter_matrix {
         double transform_matrix[9];
-        bool check_bounds;
+        struct fixed_matrix m8;  ///< used for 8-bit codecs, Q12 if fits int16_t (SIMD), Q24 otherwise
+        struct fixed_matrix m16; ///< used for 10- and 16-bit codecs (Q24)
+        bool simd;               ///< m8 coefficients fit int16_t
         void *vo_pp_out_buffer; ///< buffer to write to if we use vo_pp wrapper (otherwise unused)
 };
 
+static void set_fixed_matrix(struct fixed_matrix *m, const double *matrix, int shift)
+{
+        m->shift = shift;
+        for (int i = 0; i < 9; ++i) {
+                m->c[i] = llround(matrix[i] * (1LL << shift));
+        }
+}
+
 static int init(struct module *parent, const char *cfg, void **state)
 {
         UNUSED(parent);
@@ -67,13 +92,12 @@ static int init(struct module *parent, const char *cfg, void **state)
                 color_printf(TERM_BOLD "\t--capture-filter matrix:a:b:c:d:e:f:g:h:i[:no-bounds-check]\n" TERM_RESET);
                 printf("where numbers a-i are members of 3x3 transformation matrix [a b c; d e f; g h i], decimals.\n"
                        "Coefficients are applied at unpacked pixels (eg. on Y Cb and Cr channels of UYVY). Result is marked as RGB.\n"
-                       "Currently only RGB and UYVY is supported on input. No additional color transformation is performed.\n");
-                printf("\nOptional \"no-bounds-check\" options disables check for overflows/underflows which improves performance\n"
-                                "but may give incorrect results if operation oveflows or underflows.\n");
+                       "Currently RGB, RG48, UYVY and v210 (output is RG48) is supported on input. No additional color transformation is performed.\n");
+                printf("\nOptional \"no-bounds-check\" option is accepted for compatibility only - results are always\n"
+                                "saturated because clamping comes for free with the fixed-point kernels.\n");
                 return 1;
         }
         struct state_capture_filter_matrix *s = calloc(1, sizeof(struct state_capture_filter_matrix));
-        s->check_bounds = true;
         char *cfg_c = strdup(cfg);
         char *item = NULL;
         char *save_ptr = NULL;
@@ -81,9 +105,7 @@ static int init(struct module *parent, const char *cfg, void **state)
         int i = 0;
         while ((item = strtok_r(tmp, ":", &save_ptr)) != NULL) {
                 if (i == 9) {
-                        if (strcmp(item, "no-bound-check") == 0) {
-                                s->check_bounds = false;
-                        } else {
+                        if (strcmp(item, "no-bounds-check") != 0 && strcmp(item, "no-bound-check") != 0) {
                                 log_msg(LOG_LEVEL_WARNING, MOD_NAME "Excess initializer given: %s\n", item);
                         }
                         break;
@@ -104,6 +126,23 @@ static int init(struct module *parent, const char *cfg, void **state)
                 return -1;
         }
 
+        for (i = 0; i < 9; ++i) {
+                if (fabs(s->transform_matrix[i]) >= (1 << (31 - WIDE_SHIFT))) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Coefficient %f out of range!\n", s->transform_matrix[i]);
+                        free(s);
+                        return -1;
+                }
+        }
+        set_fixed_matrix(&s->m16, s->transform_matrix, WIDE_SHIFT);
+        s->simd = true;
+        for (i = 0; i < 9; ++i) {
+                if (llround(s->transform_matrix[i] * (1 << SIMD_SHIFT)) != (int16_t) llround(s->transform_matrix[i] * (1 << SIMD_SHIFT))) {
+                        s->simd = false;
+                }
+        }
+        set_fixed_matrix(&s->m8, s->transform_matrix, s->simd ? SIMD_SHIFT : WIDE_SHIFT);
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Using %s coefficients for 8-bit codecs.\n", s->simd ? "16-bit" : "64-bit");
+
         *state = s;
         return 0;
 }
@@ -113,12 +152,228 @@ static void done(void *state)
         free(state);
 }
 
+struct matrix_job {
+        const struct state_capture_filter_matrix *s;
+        codec_t in_codec;
+        int width;
+        int rows;
+        const unsigned char *in;
+        size_t in_pitch;
+        unsigned char *out;
+        size_t out_pitch;
+};
+
+/**
+ * @param off input component offsets subtracted before the multiplication
+ * @param[out] bias per-output-component constant including rounding
+ */
+static void get_bias(const struct fixed_matrix *m, const int *off, int64_t *bias)
+{
+        for (int k = 0; k < 3; ++k) {
+                bias[k] = (1LL << (m->shift - 1)) - m->c[3 * k] * off[0] - m->c[3 * k + 1] * off[1] - m->c[3 * k + 2] * off[2];
+        }
+}
+
+static inline int64_t mat_mul(const struct fixed_matrix *m, const int64_t *bias, int k, int a0, int a1, int a2)
+{
+        return (m->c[3 * k] * a0 + m->c[3 * k + 1] * a1 + m->c[3 * k + 2] * a2 + bias[k]) >> m->shift;
+}
+
+#ifdef __SSSE3__
+/**
+ * Converts 8 pixels of (8-bit RGB or UYVY) into 8 pixels of RGB (24 B). Input
+ * components are shuffled directly into 16-bit pairs (a0, a1) and (a2, 0) that
+ * are multiplied with the coefficient pairs by PMADDWD; saturating packs then
+ * clamp the result to 0-255.
+ */
+static inline void mat_mul8_ssse3(__m128i a01_lo, __m128i a2_lo, __m128i a01_hi, __m128i a2_hi,
+                const __m128i *c01, const __m128i *c2, const __m128i *bias, unsigned char *out)
+{
+        __m128i ch[3];
+        for (int k = 0; k < 3; ++k) {
+                __m128i lo = _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(a01_lo, c01[k]), _mm_madd_epi16(a2_lo, c2[k])), bias[k]);
+                __m128i hi = _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(a01_hi, c01[k]), _mm_madd_epi16(a2_hi, c2[k])), bias[k]);
+                ch[k] = _mm_packs_epi32(_mm_srai_epi32(lo, SIMD_SHIFT), _mm_srai_epi32(hi, SIMD_SHIFT));
+        }
+        __m128i rg = _mm_packus_epi16(ch[0], ch[1]); // R0-R7 G0-G7
+        __m128i bb = _mm_packus_epi16(ch[2], ch[2]); // B0-B7 B0-B7
+        __m128i out0 = _mm_or_si128(
+                        _mm_shuffle_epi8(rg, _mm_setr_epi8(0, 8, -1, 1, 9, -1, 2, 10, -1, 3, 11, -1, 4, 12, -1, 5)),
+                        _mm_shuffle_epi8(bb, _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1)));
+        __m128i out1 = _mm_or_si128(
+                        _mm_shuffle_epi8(rg, _mm_setr_epi8(13, -1, 6, 14, -1, 7, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+                        _mm_shuffle_epi8(bb, _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, -1, -1, -1, -1, -1, -1)));
+        _mm_storeu_si128((__m128i *)(void *) out, out0);
+        _mm_storel_epi64((__m128i *)(void *) (out + 16), out1);
+}
+
+/// @returns number of pixels processed (multiple of 8)
+static int mat_mul_row_ssse3(const struct fixed_matrix *m, const int64_t *bias, bool uyvy,
+                const unsigned char *in, unsigned char *out, int width)
+{
+        __m128i c01[3];
+        __m128i c2[3];
+        __m128i b[3];
+        for (int k = 0; k < 3; ++k) {
+                c01[k] = _mm_set1_epi32((int) ((uint32_t) (uint16_t) m->c[3 * k] | (uint32_t) (uint16_t) m->c[3 * k + 1] << 16U));
+                c2[k] = _mm_set1_epi32((uint16_t) m->c[3 * k + 2]);
+                b[k] = _mm_set1_epi32((int32_t) bias[k]);
+        }
+        int x = 0;
+        if (uyvy) { // (Y, Cb) and (Cr, 0) pairs
+                const __m128i a01_lo_mask = _mm_setr_epi8(1, -1, 0, -1, 3, -1, 0, -1, 5, -1, 4, -1, 7, -1, 4, -1);
+                const __m128i a2_lo_mask = _mm_setr_epi8(2, -1, -1, -1, 2, -1, -1, -1, 6, -1, -1, -1, 6, -1, -1, -1);
+                const __m128i a01_hi_mask = _mm_setr_epi8(9, -1, 8, -1, 11, -1, 8, -1, 13, -1, 12, -1, 15, -1, 12, -1);
+                const __m128i a2_hi_mask = _mm_setr_epi8(10, -1, -1, -1, 10, -1, -1, -1, 14, -1, -1, -1, 14, -1, -1, -1);
+                for ( ; x + 8 <= width; x += 8) {
+                        __m128i pix = _mm_loadu_si128((const __m128i *)(const void *) in);
+                        mat_mul8_ssse3(_mm_shuffle_epi8(pix, a01_lo_mask), _mm_shuffle_epi8(pix, a2_lo_mask),
+                                        _mm_shuffle_epi8(pix, a01_hi_mask), _mm_shuffle_epi8(pix, a2_hi_mask),
+                                        c01, c2, b, out);
+                        in += 16;
+                        out += 24;
+                }
+        } else { // (R, G) and (B, 0) pairs, pixels 4-7 are loaded from offset 8
+                const __m128i a01_lo_mask = _mm_setr_epi8(0, -1, 1, -1, 3, -1, 4, -1, 6, -1, 7, -1, 9, -1, 10, -1);
+                const __m128i a2_lo_mask = _mm_setr_epi8(2, -1, -1, -1, 5, -1, -1, -1, 8, -1, -1, -1, 11, -1, -1, -1);
+                const __m128i a01_hi_mask = _mm_setr_epi8(4, -1, 5, -1, 7, -1, 8, -1, 10, -1, 11, -1, 13, -1, 14, -1);
+                const __m128i a2_hi_mask = _mm_setr_epi8(6, -1, -1, -1, 9, -1, -1, -1, 12, -1, -1, -1, 15, -1, -1, -1);
+                for ( ; x + 8 <= width; x += 8) {
+                        __m128i lo = _mm_loadu_si128((const __m128i *)(const void *) in);
+                        __m128i hi = _mm_loadu_si128((const __m128i *)(const void *) (in + 8));
+                        mat_mul8_ssse3(_mm_shuffle_epi8(lo, a01_lo_mask), _mm_shuffle_epi8(lo, a2_lo_mask),
+                                        _mm_shuffle_epi8(hi, a01_hi_mask), _mm_shuffle_epi8(hi, a2_hi_mask),
+                                        c01, c2, b, out);
+                        in += 24;
+                        out += 24;
+                }
+        }
+        return x;
+}
+#endif // defined __SSSE3__
+
+static void matrix_row_rgb(const struct state_capture_filter_matrix *s, const unsigned char *in, unsigned char *out, int width)
+{
+        const struct fixed_matrix *m = &s->m8;
+        int64_t bias[3];
+        get_bias(m, (int[]){ 0, 0, 0 }, bias);
+        int x = 0;
+#ifdef __SSSE3__
+        if (s->simd) {
+                x = mat_mul_row_ssse3(m, bias, false, in, out, width);
+                in += 3 * x;
+                out += 3 * x;
+        }
+#endif
+        for ( ; x < width; ++x) {
+                for (int k = 0; k < 3; ++k) {
+                        int64_t val = mat_mul(m, bias, k, in[0], in[1], in[2]);
+                        *out++ = CLAMP(val, 0, 255);
+                }
+                in += 3;
+        }
+}
+
+static void matrix_row_uyvy(const struct state_capture_filter_matrix *s, const unsigned char *in, unsigned char *out, int width)
+{
+        const struct fixed_matrix *m = &s->m8;
+        int64_t bias[3];
+        get_bias(m, (int[]){ 16, 128, 128 }, bias);
+        int x = 0;
+#ifdef __SSSE3__
+        if (s->simd) {
+                x = mat_mul_row_ssse3(m, bias, true, in, out, width);
+                in += 2 * x;
+                out += 3 * x;
+        }
+#endif
+        for ( ; x < width; ++x) {
+                int y = in[2 * (x % 2) + 1];
+                for (int k = 0; k < 3; ++k) {
+                        int64_t val = mat_mul(m, bias, k, y, in[0], in[2]);
+                        *out++ = CLAMP(val, 0, 255);
+                }
+                if (x % 2 == 1) {
+                        in += 4;
+                }
+        }
+}
+
+static void matrix_row_rg48(const struct state_capture_filter_matrix *s, const unsigned char *in, unsigned char *out, int width)
+{
+        const struct fixed_matrix *m = &s->m16;
+        int64_t bias[3];
+        get_bias(m, (int[]){ 0, 0, 0 }, bias);
+        const uint16_t *in16 = (const uint16_t *)(const void *) in;
+        uint16_t *out16 = (uint16_t *)(void *) out;
+        for (int x = 0; x < width; ++x) {
+                for (int k = 0; k < 3; ++k) {
+                        int64_t val = mat_mul(m, bias, k, in16[0], in16[1], in16[2]);
+                        *out16++ = CLAMP(val, 0, 65535);
+                }
+                in16 += 3;
+        }
+}
+
+/// v210 -> RG48, computed on 10-bit values
+static void matrix_row_v210(const struct state_capture_filter_matrix *s, const unsigned char *in, unsigned char *out, int width)
+{
+        const struct fixed_matrix *m = &s->m16;
+        int64_t bias[3];
+        get_bias(m, (int[]){ 64, 512, 512 }, bias);
+        const uint32_t *in32 = (const uint32_t *)(const void *) in;
+        uint16_t *out16 = (uint16_t *)(void *) out;
+        for (int x = 0; x < width; x += 6) {
+                int y[6];
+                int cb[3];
+                int cr[3];
+                uint32_t w0 = *in32++;
+                uint32_t w1 = *in32++;
+                uint32_t w2 = *in32++;
+                uint32_t w3 = *in32++;
+                cb[0] = w0 & 0x3FFU; y[0] = (w0 >> 10U) & 0x3FFU; cr[0] = (w0 >> 20U) & 0x3FFU;
+                y[1] = w1 & 0x3FFU; cb[1] = (w1 >> 10U) & 0x3FFU; y[2] = (w1 >> 20U) & 0x3FFU;
+                cr[1] = w2 & 0x3FFU; y[3] = (w2 >> 10U) & 0x3FFU; cb[2] = (w2 >> 20U) & 0x3FFU;
+                y[4] = w3 & 0x3FFU; cr[2] = (w3 >> 10U) & 0x3FFU; y[5] = (w3 >> 20U) & 0x3FFU;
+                for (int i = 0; i < 6 && x + i < width; ++i) {
+                        for (int k = 0; k < 3; ++k) {
+                                int64_t val = mat_mul(m, bias, k, y[i], cb[i / 2], cr[i / 2]);
+                                *out16++ = CLAMP(val, 0, 1023) << 6U;
+                        }
+                }
+        }
+}
+
+static void *matrix_job(void *arg)
+{
+        struct matrix_job *j = arg;
+        void (*row_fn)(const struct state_capture_filter_matrix *, const unsigned char *, unsigned char *, int) = NULL;
+        switch (j->in_codec) {
+        case RGB: row_fn = matrix_row_rgb; break;
+        case RG48: row_fn = matrix_row_rg48; break;
+        case UYVY: row_fn = matrix_row_uyvy; break;
+        case v210: row_fn = matrix_row_v210; break;
+        default: abort();
+        }
+        for (int y = 0; y < j->rows; ++y) {
+                row_fn(j->s, j->in + y * j->in_pitch, j->out + y * j->out_pitch, j->width);
+        }
+        return NULL;
+}
+
 static struct video_frame *filter(void *state, struct video_frame *in)
 {
         struct state_capture_filter_matrix *s = state;
+        if (in->color_spec != UYVY && in->color_spec != RGB && in->color_spec != RG48 && in->color_spec != v210) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Only UYVY, v210, RGB or RG48 is currently supported!\n");
+                VIDEO_FRAME_DISPOSE(in);
+                return NULL;
+        }
         struct video_desc desc = video_desc_from_frame(in);
         if (in->color_spec == UYVY) {
                 desc.color_spec = RGB;
+        } else if (in->color_spec == v210) {
+                desc.color_spec = RG48;
         }
         struct video_frame *out = vf_alloc_desc(desc);
         if (s->vo_pp_out_buffer) {
@@ -129,168 +384,23 @@ static struct video_frame *filter(void *state, struct video_frame *in)
         }
         out->callbacks.dispose = vf_free;
 
-        if (s->check_bounds) {
-                if (in->color_spec == UYVY) {
-                        unsigned char *in_data = (unsigned char *) in->tiles[0].data;
-                        unsigned char *out_data = (unsigned char *) out->tiles[0].data;
-
-                        for (unsigned int i = 0; i < in->tiles[0].data_len; i += 4) {
-                                double a[3];
-                                double b[3];
-                                a[1] = b[1] = *in_data++;
-                                a[0] = *in_data++;
-                                a[2] = b[2] = *in_data++;
-                                b[0] = *in_data++;
-                                int val = s->transform_matrix[0] * (a[0] - 16) +
-                                                        s->transform_matrix[1] * (a[1] - 128) +
-                                                        s->transform_matrix[2] * (a[2] - 128);
-                                *out_data++ = CLAMP(val, 0, 255);
-                                val = s->transform_matrix[3] * (a[0] - 16) +
-                                                        s->transform_matrix[4] * (a[1] - 128) +
-                                                        s->transform_matrix[5] * (a[2] - 128);
-                                *out_data++ = CLAMP(val, 0, 255);
-                                val = s->transform_matrix[6] * (a[0] - 16) +
-                                                        s->transform_matrix[7] * (a[1] - 128) +
-                                                        s->transform_matrix[8] * (a[2] - 128);
-                                *out_data++ = CLAMP(val, 0, 255);
-                                val = s->transform_matrix[0] * (b[0] - 16) +
-                                                        s->transform_matrix[1] * (b[1] - 128) +
-                                                        s->transform_matrix[2] * (b[2] - 128);
-                                *out_data++ = CLAMP(val, 0, 255);
-                                val = s->transform_matrix[3] * (b[0] - 16) +
-                                                        s->transform_matrix[4] * (b[1] - 128) +
-                                                        s->transform_matrix[5] * (b[2] - 128);
-                                *out_data++ = CLAMP(val, 0, 255);
-                                val = s->transform_matrix[6] * (b[0] - 16) +
-                                                        s->transform_matrix[7] * (b[1] - 128) +
-                                                        s->transform_matrix[8] * (b[2] - 128),
-                                *out_data++ = CLAMP(val, 0, 255);
-                        }
-                } else if (in->color_spec == RGB) {
-                        unsigned char *in_data = (unsigned char *) in->tiles[0].data;
-                        unsigned char *out_data = (unsigned char *) out->tiles[0].data;
-
-                        for (unsigned int i = 0; i < in->tiles[0].data_len; i += 3) {
-                                double a[3];
-                                a[0] = *in_data++;
-                                a[1] = *in_data++;
-                                a[2] = *in_data++;
-                                int val = s->transform_matrix[0] * a[0] +
-                                                        s->transform_matrix[1] * a[1] +
-                                                        s->transform_matrix[2] * a[2];
-                                *out_data++ = CLAMP(val, 0, 255);
-                                val = s->transform_matrix[3] * a[0] +
-                                                        s->transform_matrix[4] * a[1] +
-                                                        s->transform_matrix[5] * a[2];
-                                *out_data++ = CLAMP(val, 0, 255);
-                                val = s->transform_matrix[6] * a[0] +
-                                                        s->transform_matrix[7] * a[1] +
-                                                        s->transform_matrix[8] * a[2];
-                                *out_data++ = CLAMP(val, 0, 255);
-                        }
-                } else if (in->color_spec == RG48) {
-                        uint16_t *in_data = (uint16_t *)(void *) in->tiles[0].data;
-                        uint16_t *out_data = (uint16_t *)(void *) out->tiles[0].data;
-
-                        for (unsigned int i = 0; i < in->tiles[0].data_len; i += 6) {
-                                double a[3];
-                                a[0] = *in_data++;
-                                a[1] = *in_data++;
-                                a[2] = *in_data++;
-                                int val = s->transform_matrix[0] * a[0] +
-                                                        s->transform_matrix[1] * a[1] +
-                                                        s->transform_matrix[2] * a[2];
-                                *out_data++ = CLAMP(val, 0, 255);
-                                val = s->transform_matrix[3] * a[0] +
-                                                        s->transform_matrix[4] * a[1] +
-                                                        s->transform_matrix[5] * a[2];
-                                *out_data++ = CLAMP(val, 0, 255);
-                                val = s->transform_matrix[6] * a[0] +
-                                                        s->transform_matrix[7] * a[1] +
-                                                        s->transform_matrix[8] * a[2];
-                                *out_data++ = CLAMP(val, 0, 255);
-                        }
-                } else {
-                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Only UYVY, RGB or RG48 is currently supported!\n");
-                        VIDEO_FRAME_DISPOSE(in);
-                        vf_free(out);
-                        return NULL;
-                }
+        int height = in->tiles[0].height;
+        int threads = MAX(1, MIN(get_cpu_core_count(), (int) (out->tiles[0].data_len / MIN_JOB_LEN)));
+        threads = MIN(threads, MAX(height, 1));
+        struct matrix_job jobs[threads];
+        size_t in_pitch = vc_get_linesize(in->tiles[0].width, in->color_spec);
+        size_t out_pitch = vc_get_linesize(in->tiles[0].width, desc.color_spec);
+        for (int i = 0; i < threads; ++i) {
+                int start = height * i / threads;
+                int end = height * (i + 1) / threads;
+                jobs[i] = (struct matrix_job) { s, in->color_spec, in->tiles[0].width, end - start,
+                        (unsigned char *) in->tiles[0].data + start * in_pitch, in_pitch,
+                        (unsigned char *) out->tiles[0].data + start * out_pitch, out_pitch };
+        }
+        if (threads == 1) {
+                matrix_job(&jobs[0]);
         } else {
-                if (in->color_spec == UYVY) {
-                        unsigned char *in_data = (unsigned char *) in->tiles[0].data;
-                        unsigned char *out_data = (unsigned char *) out->tiles[0].data;
-
-                        for (unsigned int i = 0; i < in->tiles[0].data_len; i += 4) {
-                                double a[3];
-                                double b[3];
-                                a[1] = b[1] = *in_data++;
-                                a[0] = *in_data++;
-                                a[2] = b[2] = *in_data++;
-                                b[0] = *in_data++;
-                                *out_data++ = s->transform_matrix[0] * (a[0] - 16) +
-                                                        s->transform_matrix[1] * (a[1] - 128) +
-                                                        s->transform_matrix[2] * (a[2] - 128);
-                                *out_data++ = s->transform_matrix[3] * (a[0] - 16) +
-                                                        s->transform_matrix[4] * (a[1] - 128) +
-                                                        s->transform_matrix[5] * (a[2] - 128);
-                                *out_data++ = s->transform_matrix[6] * (a[0] - 16) +
-                                                        s->transform_matrix[7] * (a[1] - 128) +
-                                                        s->transform_matrix[8] * (a[2] - 128);
-                                *out_data++ = s->transform_matrix[0] * (b[0] - 16) +
-                                                        s->transform_matrix[1] * (b[1] - 128) +
-                                                        s->transform_matrix[2] * (b[2] - 128);
-                                *out_data++ = s->transform_matrix[3] * (b[0] - 16) +
-                                                        s->transform_matrix[4] * (b[1] - 128) +
-                                                        s->transform_matrix[5] * (b[2] - 128);
-                                *out_data++ = s->transform_matrix[6] * (b[0] - 16) +
-                                                        s->transform_matrix[7] * (b[1] - 128) +
-                                                        s->transform_matrix[8] * (b[2] - 128);
-                        }
-                } else if (in->color_spec == RGB) {
-                        unsigned char *in_data = (unsigned char *) in->tiles[0].data;
-                        unsigned char *out_data = (unsigned char *) out->tiles[0].data;
-
-                        for (unsigned int i = 0; i < in->tiles[0].data_len; i += 3) {
-                                double a[3];
-                                a[0] = *in_data++;
-                                a[1] = *in_data++;
-                                a[2] = *in_data++;
-                                *out_data++ = s->transform_matrix[0] * a[0] +
-                                                        s->transform_matrix[1] * a[1] +
-                                                        s->transform_matrix[2] * a[2];
-                                *out_data++ = s->transform_matrix[3] * a[0] +
-                                                        s->transform_matrix[4] * a[1] +
-                                                        s->transform_matrix[5] * a[2];
-                                *out_data++ = s->transform_matrix[6] * a[0] +
-                                                        s->transform_matrix[7] * a[1] +
-                                                        s->transform_matrix[8] * a[2];
-                        }
-                } else if (in->color_spec == RG48) {
-                        uint16_t *in_data = (uint16_t *)(void *) in->tiles[0].data;
-                        uint16_t *out_data = (uint16_t *)(void *) out->tiles[0].data;
-
-                        for (unsigned int i = 0; i < in->tiles[0].data_len; i += 6) {
-                                double a[3];
-                                a[0] = *in_data++;
-                                a[1] = *in_data++;
-                                a[2] = *in_data++;
-                                *out_data++ = s->transform_matrix[0] * a[0] +
-                                                        s->transform_matrix[1] * a[1] +
-                                                        s->transform_matrix[2] * a[2];
-                                *out_data++ = s->transform_matrix[3] * a[0] +
-                                                        s->transform_matrix[4] * a[1] +
-                                                        s->transform_matrix[5] * a[2];
-                                *out_data++ = s->transform_matrix[6] * a[0] +
-                                                        s->transform_matrix[7] * a[1] +
-                                                        s->transform_matrix[8] * a[2];
-                        }
-                } else {
-                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Only UYVY, RGB or RG48 is currently supported!\n");
-                        VIDEO_FRAME_DISPOSE(in);
-                        vf_free(out);
-                        return NULL;
-                }
+                task_run_parallel(matrix_job, threads, jobs, sizeof jobs[0], NULL);
         }
 
         VIDEO_FRAME_DISPOSE(in);
@@ -122,6 +122,16 @@ static struct video_frame *filter(void *state, struct video_frame *in)
         return out;
 }
 
+static bool line_supported(void *, codec_t codec)
+{
+        return codec == UYVY;
+}
+
+static void filter_line(void *, codec_t, unsigned char * __restrict dst, const unsigned char * __restrict src, size_t len)
+{
+        mirror_line_UYVY(dst, src, len);
+}
+
 static void vo_pp_set_out_buffer(void *state, char *buffer)
 {
         auto *s = static_cast<struct state_mirror *>(state);
@@ -132,6 +142,8 @@ static const struct capture_filter_info capture_filter_mirror = {
         .init = init,
         .done = done,
         .filter = filter,
+        .line_supported = line_supported,
+        .filter_line = filter_line,
 };
 
 REGISTER_MODULE(mirror, &capture_filter_mirror, LIBRARY_CLASS_CAPTURE_FILTER, CAPTURE_FILTER_ABI_VERSION);
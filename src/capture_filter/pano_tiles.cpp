@@ -0,0 +1,248 @@
+/**
+ * @file   capture_filter/pano_tiles.cpp
+ *
+ * Viewport-dependent quality of an equirectangular panorama. The frame is
+ * divided into a grid of tiles and tiles that the receiving display (pano_gl,
+ * openxr_gl) reports as out of its viewport are low-passed so that the
+ * compression spends most of the bitrate on the visible part.
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ * 
+ *      This product includes software developed by CESNET z.s.p.o.
+ * 
+ * 4. Neither the name of the CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <algorithm>
+#include <cstring>
+
+#include "capture_filter.h"
+#include "debug.h"
+#include "lib_common.h"
+#include "utils/color_out.h"
+#include "utils/macros.h"
+#include "utils/viewport_tiles.h"
+#include "video.h"
+#include "video_codec.h"
+
+#define MOD_NAME "[pano_tiles] "
+#define DEFAULT_COLS 8
+#define DEFAULT_ROWS 4
+#define DEFAULT_LOW 8
+#define MAX_BLOCK_BYTES 16
+
+struct state_pano_tiles {
+        int cols = DEFAULT_COLS;
+        int rows = DEFAULT_ROWS;
+        int low = DEFAULT_LOW; ///< size of averaged block of out-of-view tiles
+        int last_degraded = -1;
+};
+
+static void usage()
+{
+        col() << TRED(TBOLD("pano_tiles")) << " keeps full quality only in parts of a panorama visible at the receiver\n\n";
+        col() << "Usage:\n\t" << TBOLD(TRED("--capture-filter pano_tiles") << "[:grid=<c>x<r>][:low=<n>]") << "\n\n";
+        col() << "where\n";
+        col() << TBOLD("\t<c>x<r>") << " - tile grid (default " << DEFAULT_COLS << "x" << DEFAULT_ROWS << ")\n";
+        col() << TBOLD("\t    <n>") << " - tiles out of viewport are averaged in <n>x<n> blocks (default " << DEFAULT_LOW << ")\n\n";
+        col() << "The receiver displays the stream with " << TBOLD("pano_gl") << " or " << TBOLD("openxr_gl")
+                << " which report their viewport\nin RTCP. Until a report arrives (and "
+                "if it times out), the whole frame is passed\nunchanged. The RTCP interval may be shortened "
+                "at the receiver with\n" << TBOLD("--param rtcp-min-interval=<s>") << ".\n";
+}
+
+static int init(struct module *, const char *cfg, void **state)
+{
+        if (strcmp(cfg, "help") == 0) {
+                usage();
+                return 1;
+        }
+        auto *s = new state_pano_tiles();
+        char *tmp = strdup(cfg);
+        char *save_ptr = nullptr;
+        char *item = nullptr;
+        char *cfg_it = tmp;
+        while ((item = strtok_r(cfg_it, ":", &save_ptr)) != nullptr) {
+                cfg_it = nullptr;
+                if (strncmp(item, "grid=", strlen("grid=")) == 0) {
+                        if (sscanf(item + strlen("grid="), "%dx%d", &s->cols, &s->rows) != 2) {
+                                s->cols = 0;
+                        }
+                } else if (strncmp(item, "low=", strlen("low=")) == 0) {
+                        s->low = atoi(item + strlen("low="));
+                } else {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unknown option: %s\n", item);
+                        s->low = 0;
+                }
+        }
+        free(tmp);
+        if (s->cols <= 0 || s->rows <= 0 || s->low <= 1) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong configuration!\n");
+                usage();
+                delete s;
+                return -1;
+        }
+        *state = s;
+        return 0;
+}
+
+static void done(void *state)
+{
+        delete static_cast<state_pano_tiles *>(state);
+}
+
+/// tile is requested if it overlaps any of cells requested by the receiver
+static bool tile_requested(const struct viewport_tiles *req, int cols, int rows, int col, int row)
+{
+        int c_start = col * VIEWPORT_TILES_COLS / cols;
+        int c_end = std::max(c_start + 1, ((col + 1) * VIEWPORT_TILES_COLS + cols - 1) / cols);
+        int r_start = row * VIEWPORT_TILES_ROWS / rows;
+        int r_end = std::max(r_start + 1, ((row + 1) * VIEWPORT_TILES_ROWS + rows - 1) / rows);
+        for (int r = r_start; r < std::min(r_end, VIEWPORT_TILES_ROWS); ++r) {
+                for (int c = c_start; c < std::min(c_end, VIEWPORT_TILES_COLS); ++c) {
+                        if (viewport_tiles_is_set(req, c, r)) {
+                                return true;
+                        }
+                }
+        }
+        return false;
+}
+
+/**
+ * Replaces each low x low block of the rectangle with its average. Pixel
+ * blocks of the codec (eg. UYVY macropixel) are averaged per byte position.
+ */
+static void degrade_rect(unsigned char *data, int linesize, int block_bytes, int block_pixels,
+                int x0, int x1, int y0, int y1, int low)
+{
+        const int step_x = std::max(1, low / block_pixels); // in pixel blocks
+        unsigned sum[MAX_BLOCK_BYTES];
+        for (int y = y0; y < y1; y += low) {
+                int h = std::min(low, y1 - y);
+                for (int x = x0 / block_pixels; x < x1 / block_pixels; x += step_x) {
+                        int w = std::min(step_x, x1 / block_pixels - x);
+                        std::fill_n(sum, block_bytes, 0);
+                        for (int yy = 0; yy < h; ++yy) {
+                                const unsigned char *src = data + (y + yy) * linesize + x * block_bytes;
+                                for (int i = 0; i < w * block_bytes; ++i) {
+                                        sum[i % block_bytes] += src[i];
+                                }
+                        }
+                        unsigned char avg[MAX_BLOCK_BYTES];
+                        for (int i = 0; i < block_bytes; ++i) {
+                                avg[i] = sum[i] / (w * h);
+                        }
+                        for (int yy = 0; yy < h; ++yy) {
+                                unsigned char *dst = data + (y + yy) * linesize + x * block_bytes;
+                                for (int i = 0; i < w; ++i) {
+                                        memcpy(dst + i * block_bytes, avg, block_bytes);
+                                }
+                        }
+                }
+        }
+}
+
+static struct video_frame *filter(void *state, struct video_frame *in)
+{
+        auto *s = static_cast<state_pano_tiles *>(state);
+        struct viewport_tiles req{};
+        if (!viewport_tiles_get_requested(&req)) {
+                return in;
+        }
+        codec_t codec = in->color_spec;
+        if (codec_is_planar(codec) || get_bits_per_component(codec) != 8 || get_pf_block_bytes(codec) > MAX_BLOCK_BYTES) {
+                log_msg_once(LOG_LEVEL_WARNING, to_fourcc('P', 'A', 'T', 'L'), MOD_NAME "Only packed 8-bit pixel formats are supported!\n");
+                return in;
+        }
+
+        int degraded = 0;
+        for (int row = 0; row < s->rows; ++row) {
+                for (int col = 0; col < s->cols; ++col) {
+                        degraded += tile_requested(&req, s->cols, s->rows, col, row) ? 0 : 1;
+                }
+        }
+        if (degraded != s->last_degraded) {
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "%d of %d tiles out of viewport\n", degraded, s->cols * s->rows);
+                s->last_degraded = degraded;
+        }
+        if (degraded == 0) {
+                return in;
+        }
+
+        struct video_frame *out = vf_alloc_desc(video_desc_from_frame(in));
+        out->callbacks.dispose = vf_free;
+        out->callbacks.data_deleter = vf_data_deleter;
+        for (unsigned i = 0; i < in->tile_count; ++i) {
+                struct tile *t = &out->tiles[i];
+                t->data = static_cast<char *>(malloc(t->data_len));
+                memcpy(t->data, in->tiles[i].data, t->data_len);
+
+                const int block_pixels = get_pf_block_pixels(codec);
+                const int linesize = vc_get_linesize(t->width, codec);
+                for (int row = 0; row < s->rows; ++row) {
+                        for (int col = 0; col < s->cols; ++col) {
+                                if (tile_requested(&req, s->cols, s->rows, col, row)) {
+                                        continue;
+                                }
+                                int x0 = col * t->width / s->cols / block_pixels * block_pixels;
+                                int x1 = (col + 1) * t->width / s->cols / block_pixels * block_pixels;
+                                degrade_rect(reinterpret_cast<unsigned char *>(t->data), linesize,
+                                                get_pf_block_bytes(codec), block_pixels, x0, x1,
+                                                row * t->height / s->rows, (row + 1) * t->height / s->rows,
+                                                s->low);
+                        }
+                }
+        }
+
+        VIDEO_FRAME_DISPOSE(in);
+
+        return out;
+}
+
+static const struct capture_filter_info capture_filter_pano_tiles = {
+        .init = init,
+        .done = done,
+        .filter = filter,
+        .line_supported = nullptr,
+        .filter_line = nullptr,
+};
+
+REGISTER_MODULE(pano_tiles, &capture_filter_pano_tiles, LIBRARY_CLASS_CAPTURE_FILTER, CAPTURE_FILTER_ABI_VERSION);
+
@@ -211,7 +211,8 @@ static struct video_frame *filter(void *state, struct video_frame *in){
         int scale = ipc_frame_get_scale_factor(tile->width, tile->height,
                         s->target_width, s->target_height);
 
-        if(ipc_frame_from_ug_frame(ipc_frame.get(), in, RGB, scale)){
+        if(ipc_frame_from_ug_frame(ipc_frame.get(), in,
+                                ipc_frame_get_preview_codec(in->color_spec), scale)){
                 std::lock_guard<std::mutex> lock(s->mut);
                 s->frame_queue.push(std::move(ipc_frame));
                 s->frame_submitted_cv.notify_one();
@@ -97,6 +97,7 @@ struct state_resize {
     struct resize_param param;
     struct video_desc saved_desc;
     struct video_desc out_desc;
+    bool native; ///< use resize_frame_native() (keeping pixel format)
     char *vo_pp_out_buffer; ///< buffer to write to if we use vo_pp wrapper (otherwise unused)
 };
 
@@ -209,7 +210,21 @@ static struct video_frame *filter(void *state, struct video_frame *in)
             desc.width = in->tiles[0].width * s->param.num / s->param.denom;
             desc.height = in->tiles[0].height * s->param.num / s->param.denom;
         }
-        desc.color_spec = RGB;
+        s->native = resize_native_supported(desc.color_spec);
+        if (s->native) {
+            if (desc.color_spec == UYVY) {
+                desc.width = desc.width / 2 * 2;
+            }
+        } else {
+#ifdef HAVE_OPENCV_RESIZE
+            desc.color_spec = RGB;
+#else
+            log_msg(LOG_LEVEL_ERROR, "[RESIZE ERROR] Unsupported codec %s (compiled without OpenCV)!\n", get_codec_name(desc.color_spec));
+            VIDEO_FRAME_DISPOSE(in);
+            s->saved_desc = {};
+            return NULL;
+#endif
+        }
         if (s->param.force_interlaced) {
                 desc.interlacing = INTERLACED_MERGED;
         } else if (s->param.force_progressive) {
@@ -229,11 +244,17 @@ static struct video_frame *filter(void *state, struct video_frame *in)
 
     for (unsigned int i = 0; i < frame->tile_count; i++) {
         int res;
-        if (s->param.mode == resize_param::resize_mode::USE_DIMENSIONS) {
+        if (s->native) {
+            res = resize_frame_native(in->tiles[i].data, in->color_spec, frame->tiles[i].data, in->tiles[i].width, in->tiles[i].height,
+                            s->out_desc.width, s->out_desc.height, s->param.mode == resize_param::resize_mode::USE_DIMENSIONS);
+        }
+#ifdef HAVE_OPENCV_RESIZE
+        else if (s->param.mode == resize_param::resize_mode::USE_DIMENSIONS) {
             res = resize_frame(in->tiles[i].data, in->color_spec, frame->tiles[i].data, in->tiles[i].width, in->tiles[i].height, s->param.target_width, s->param.target_height);
         } else {
             res = resize_frame(in->tiles[i].data, in->color_spec, frame->tiles[i].data, in->tiles[i].width, in->tiles[i].height, (double)s->param.num/s->param.denom);
         }
+#endif
 
         if(res!=0){
             error_msg("\n[RESIZE ERROR] Unable to resize with scale factor configured [%d/%d] in tile number %d\n", s->param.num, s->param.denom, i);
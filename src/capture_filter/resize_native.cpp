@@ -0,0 +1,248 @@
+/**
+ * @file   capture_filter/resize_native.cpp
+ *
+ * Bilinear resize working directly on packed pixel formats without
+ * conversion to RGB.
+ */
+/*
+ * Copyright (c) 2023 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "capture_filter/resize_utils.h"
+#include "utils/macros.h"
+#include "utils/misc.h"
+#include "utils/worker.h"
+#include "video_codec.h"
+
+using std::min;
+using std::vector;
+
+namespace {
+
+/**
+ * For every byte of the output line (or every output row) holds indices of
+ * the two nearest source samples of the same component and the weight of the
+ * second one in 1/256.
+ */
+struct axis_map {
+    vector<int> s0;
+    vector<int> s1;
+    vector<uint16_t> w;
+};
+
+void map_axis(int dst_n, int src_n, int i, int *s0, int *s1, int *w)
+{
+    double f = (i + 0.5) * src_n / dst_n - 0.5;
+    f = f < 0.0 ? 0.0 : f;
+    int a = min(static_cast<int>(f), src_n - 1);
+    *s0 = a;
+    *s1 = min(a + 1, src_n - 1);
+    *w = static_cast<int>(lround((f - a) * 256));
+}
+
+void build_row_map(codec_t codec, int src_w, int dst_w, axis_map *m)
+{
+    int len = vc_get_linesize(dst_w, codec);
+    m->s0.resize(len);
+    m->s1.resize(len);
+    m->w.resize(len);
+    for (int i = 0; i < len; ++i) {
+        int a = 0;
+        int b = 0;
+        int w = 0;
+        if (codec == UYVY) {
+            int k = i % 4;
+            if (k % 2 == 0) { // chroma
+                map_axis(dst_w / 2, src_w / 2, i / 4, &a, &b, &w);
+                m->s0[i] = a * 4 + k;
+                m->s1[i] = b * 4 + k;
+            } else { // luma
+                map_axis(dst_w, src_w, i / 4 * 2 + k / 2, &a, &b, &w);
+                m->s0[i] = a / 2 * 4 + 1 + a % 2 * 2;
+                m->s1[i] = b / 2 * 4 + 1 + b % 2 * 2;
+            }
+        } else {
+            int bpp = codec == RGB ? 3 : 4;
+            map_axis(dst_w, src_w, i / bpp, &a, &b, &w);
+            m->s0[i] = a * bpp + i % bpp;
+            m->s1[i] = b * bpp + i % bpp;
+        }
+        m->w[i] = w;
+    }
+}
+
+struct resize_job {
+    const axis_map *x;
+    const axis_map *y;
+    const unsigned char *in;
+    size_t in_linesize;
+    unsigned char *out; ///< first byte of the target rectangle
+    size_t out_linesize;
+    int row_start;
+    int row_end;
+};
+
+/// @param out component values multiplied by 256
+void hresample(const unsigned char * __restrict src, const axis_map *m, uint16_t * __restrict out)
+{
+    const int *s0 = m->s0.data();
+    const int *s1 = m->s1.data();
+    const uint16_t *w = m->w.data();
+    size_t len = m->w.size();
+    for (size_t i = 0; i < len; ++i) {
+        out[i] = src[s0[i]] * (256 - w[i]) + src[s1[i]] * w[i];
+    }
+}
+
+void *resize_rows(void *arg)
+{
+    auto *j = static_cast<resize_job *>(arg);
+    size_t len = j->x->w.size();
+    vector<uint16_t> row0(len);
+    vector<uint16_t> row1(len);
+    int cached0 = -1;
+    int cached1 = -1;
+    for (int y = j->row_start; y < j->row_end; ++y) {
+        int y0 = j->y->s0[y];
+        int y1 = j->y->s1[y];
+        if (y0 == cached1) { // moved by one source line - reuse
+            swap(row0, row1);
+            cached0 = cached1;
+            cached1 = -1;
+        }
+        if (y0 != cached0) {
+            hresample(j->in + y0 * j->in_linesize, j->x, row0.data());
+            cached0 = y0;
+        }
+        if (y1 != cached1) {
+            hresample(j->in + y1 * j->in_linesize, j->x, row1.data());
+            cached1 = y1;
+        }
+        unsigned wy = j->y->w[y];
+        const uint16_t *r0 = row0.data();
+        const uint16_t *r1 = row1.data();
+        unsigned char *dst = j->out + y * j->out_linesize;
+        OPTIMIZED_FOR (size_t i = 0; i < len; ++i) {
+            dst[i] = (r0[i] * (256 - wy) + r1[i] * wy + (1U << 15U)) >> 16U;
+        }
+    }
+    return nullptr;
+}
+
+} // end of anonymous namespace
+
+bool resize_native_supported(codec_t codec)
+{
+    return codec == RGB || codec == RGBA || codec == UYVY;
+}
+
+/**
+ * Resizes the frame to target_width x target_height keeping the pixel format.
+ * If keep_aspect is true, the picture is centered and margins are black.
+ * Output lines are distributed to all CPU cores.
+ */
+int resize_frame_native(const char *indata, codec_t codec, char *outdata, unsigned int width, unsigned int height,
+        unsigned int target_width, unsigned int target_height, bool keep_aspect)
+{
+    if (indata == nullptr || outdata == nullptr || !resize_native_supported(codec)) {
+        return 1;
+    }
+    const int align = codec == UYVY ? 2 : 1; // keep macropixels
+    unsigned int rect_x = 0;
+    unsigned int rect_y = 0;
+    unsigned int rect_w = target_width;
+    unsigned int rect_h = target_height;
+    size_t out_linesize = vc_get_linesize(target_width, codec);
+    if (keep_aspect) {
+        double in_aspect = (double) width / height;
+        double out_aspect = (double) target_width / target_height;
+        if (in_aspect > out_aspect) {
+            rect_h = target_width / in_aspect;
+            rect_y = (target_height - rect_h) / 2;
+        } else if (in_aspect < out_aspect) {
+            rect_w = static_cast<unsigned int>(target_height * in_aspect) / align * align;
+            rect_x = (target_width - rect_w) / 2 / align * align;
+        }
+        if (rect_h < target_height) {
+            clear_video_buffer((unsigned char *) outdata, out_linesize, out_linesize, rect_y, codec);
+            clear_video_buffer((unsigned char *) outdata + (rect_y + rect_h) * out_linesize, out_linesize,
+                    out_linesize, target_height - rect_y - rect_h, codec);
+        }
+        if (rect_w < target_width) {
+            clear_video_buffer((unsigned char *) outdata, vc_get_linesize(rect_x, codec), out_linesize,
+                    target_height, codec);
+            size_t right = vc_get_linesize(rect_x + rect_w, codec);
+            clear_video_buffer((unsigned char *) outdata + right, out_linesize - right, out_linesize,
+                    target_height, codec);
+        }
+    }
+    if (rect_w == 0 || rect_h == 0) {
+        return 0;
+    }
+
+    axis_map x;
+    axis_map y;
+    build_row_map(codec, width, rect_w, &x);
+    y.s0.resize(rect_h);
+    y.s1.resize(rect_h);
+    y.w.resize(rect_h);
+    for (unsigned int i = 0; i < rect_h; ++i) {
+        int w = 0;
+        map_axis(rect_h, height, i, &y.s0[i], &y.s1[i], &w);
+        y.w[i] = w;
+    }
+
+    int threads = min<int>(get_cpu_core_count(), rect_h);
+    vector<resize_job> jobs(threads);
+    for (int i = 0; i < threads; ++i) {
+        jobs[i] = { &x, &y, (const unsigned char *) indata, (size_t) vc_get_linesize(width, codec),
+            (unsigned char *) outdata + rect_y * out_linesize + vc_get_linesize(rect_x, codec), out_linesize,
+            (int) (rect_h * i / threads), (int) (rect_h * (i + 1) / threads) };
+    }
+    task_run_parallel(resize_rows, threads, jobs.data(), sizeof jobs[0], nullptr);
+
+    return 0;
+}
+
+/* vim: set expandtab sw=4: */
@@ -47,7 +47,15 @@
 
 #include "types.h"
 
+#ifdef HAVE_OPENCV_RESIZE
+// OpenCV implementation, output is RGB
 int resize_frame(char *indata, codec_t in_color, char *outdata, unsigned int width, unsigned int height, double scale_factor);
 int resize_frame(char *indata, codec_t in_color, char *outdata, unsigned int width, unsigned int height, unsigned int target_width, unsigned int target_height);
+#endif
+
+// native implementation, output has the same pixel format as input
+bool resize_native_supported(codec_t codec);
+int resize_frame_native(const char *indata, codec_t codec, char *outdata, unsigned int width, unsigned int height,
+        unsigned int target_width, unsigned int target_height, bool keep_aspect);
 
 #endif// RESIZE_UTILS_H_
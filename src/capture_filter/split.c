@@ -100,6 +100,11 @@ static void done(void *state)
         free(state);
 }
 
+static void dispose_frame(struct video_frame *f) {
+        VIDEO_FRAME_DISPOSE((struct video_frame *) f->callbacks.dispose_udata);
+        vf_free(f);
+}
+
 static struct video_frame *filter(void *state, struct video_frame *in)
 {
         struct state_split *s = state;
@@ -108,6 +113,16 @@ static struct video_frame *filter(void *state, struct video_frame *in)
         desc.tile_count = s->x * s->y;
         desc.width /= s->x;
         desc.height /= s->y;
+
+        if (s->x == 1) {
+                // tiles are contiguous parts of the input - no need to copy
+                struct video_frame *out = vf_alloc_desc(desc);
+                vf_split_horizontal(out, in, s->y);
+                out->callbacks.dispose = dispose_frame;
+                out->callbacks.dispose_udata = in;
+                return out;
+        }
+
         struct video_frame *out = vf_alloc_desc_data(desc);
         vf_split(out, in, s->x, s->y, 0);
         out->callbacks.dispose = vf_free;
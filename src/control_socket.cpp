@@ -44,12 +44,20 @@
 #include "control_socket.h"
 #include "compat/platform_pipe.h"
 
-#include <condition_variable>
+#include <algorithm>
+#include <list>
 #include <mutex>
 #include <queue>
 #include <stdio.h>
 #include <string>
 #include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
 
 #include "debug.h"
 #include "host.h"
@@ -57,8 +65,10 @@
 #include "module.h"
 #include "rtp/net_udp.h" // socket_error
 #include "tv.h"
+#include "utils/metrics.h"
 #include "utils/net.h"
 #include "utils/thread.h"
+#include "utils/trace_events.h"
 
 #define MAX_CLIENTS 16
 
@@ -70,13 +80,45 @@ typedef void *sso_val_type;
 
 using namespace std;
 
+#define MAX_CLIENT_OUT_BUFFER (1024 * 1024) ///< stats/events for a client not reading them are dropped above this
+
 struct client {
         fd_t fd;
+        bool internal;       ///< internal pipe, output is discarded
         char buff[1024];
-        int buff_len;
+        int buff_len = 0;
+
+        string out;          ///< pending output, written when the socket becomes writable
+        size_t out_pos = 0;  ///< already written part of out
+        bool want_write = false; ///< write readiness is being polled
+        bool close_after_flush = false;
+        bool closed = false;
+        unsigned long dropped = 0; ///< stats/event lines dropped since last report
 
-        struct client *prev;
-        struct client *next;
+        client(fd_t f, bool i) : fd(f), internal(i) {}
+};
+
+/**
+ * Readiness notification for the control thread - epoll on Linux, select()
+ * elsewhere. All sockets are polled for reading, sockets with pending output
+ * also for writing.
+ */
+class control_poller {
+public:
+        enum { EV_IN = 1, EV_OUT = 2 };
+        control_poller();
+        ~control_poller();
+        void add(fd_t fd);
+        void set_write(fd_t fd, bool write);
+        void remove(fd_t fd);
+        /// @returns number of ready sockets stored to events, -1 on error
+        int wait(vector<pair<fd_t, int>> &events);
+private:
+#ifdef __linux__
+        int m_epoll_fd;
+#else
+        unordered_map<fd_t, bool> m_fds; ///< fd -> write interest
+#endif
 };
 
 enum connection_type {
@@ -102,9 +144,7 @@ struct control_state {
 
         bool started;
 
-        thread stat_event_thread_id;
-        condition_variable stat_event_cv;
-        queue<string> stat_event_queue;
+        queue<string> stat_event_queue; ///< lines (including CRLF) broadcast by control thread, guarded by stats_lock
 
         bool stats_on;
 };
@@ -113,11 +153,11 @@ struct control_state {
 #define CONTROL_CLOSE_HANDLE -2
 
 static bool parse_msg(char *buffer, int buffer_len, /* out */ char *message, int *new_buffer_len);
-static int process_msg(struct control_state *s, fd_t client_fd, char *message, struct client *clients);
+static int process_msg(struct control_state *s, struct client *c, char *message);
 static ssize_t write_all(fd_t fd, const void *buf, size_t count);
 static void * control_thread(void *args);
-static void * stat_event_thread(void *args);
-static void send_response(fd_t fd, struct response *resp);
+static void send_response(struct client *c, struct response *resp);
+static void client_write(struct client *c, const char *data, size_t len, bool droppable);
 static void print_control_help();
 
 #ifndef MSG_NOSIGNAL
@@ -294,21 +334,23 @@ void control_start(struct control_state *s)
 
         platform_pipe_init(s->internal_fd);
 
+#ifndef _WIN32
+        // the stats reporting threads only wake up the control thread, they must never block
+        fcntl(s->internal_fd[1], F_SETFL, O_NONBLOCK);
+#endif
         s->control_thread_id = thread(control_thread, s);
-        s->stat_event_thread_id = thread(stat_event_thread, s);
 
         s->started = true;
 }
 
 #define prefix_matches(x,y) strncasecmp(x, y, strlen(y)) == 0
 #define suffix(x,y) x + strlen(y)
-#define is_internal_port(x) (x == s->internal_fd[0])
 
 /**
   * @retval -1 exit thread
   * @retval -2 close handle
   */
-static int process_msg(struct control_state *s, fd_t client_fd, char *message, struct client *clients)
+static int process_msg(struct control_state *s, struct client *c, char *message)
 {
         int ret = 0;
         struct response *resp = NULL;
@@ -360,33 +402,7 @@ static int process_msg(struct control_state *s, fd_t client_fd, char *message, s
         } else if (strcasecmp(message, "noop") == 0) {
                 return ret;
         } else if (prefix_matches(message, "stats ") || prefix_matches(message, "event ")) {
-                if (is_internal_port(client_fd)) {
-                        struct client *cur = clients;
-                        char *new_msg = NULL;
-
-                        while (cur) {
-                                if(is_internal_port(cur->fd)) { // skip local FD
-                                        cur = cur->next;
-                                        continue;
-                                }
-                                if (!new_msg) {
-                                        // append <CR><LF> again
-                                        new_msg = (char *) malloc(strlen(message) + 1 + 2);
-                                        strcpy(new_msg, message);
-                                        new_msg[strlen(message)] = '\r';
-                                        new_msg[strlen(message) + 1] = '\n';
-                                        new_msg[strlen(message) + 2] = '\0';
-                                }
-
-                                int ret = write_all(cur->fd, new_msg, strlen(new_msg));
-                                if (ret != (int) strlen(new_msg)) {
-                                        log_msg(LOG_LEVEL_WARNING, "Cannot write stats/event!\n");
-                                }
-                                cur = cur->next;
-                        }
-                        free(new_msg);
-                        return ret;
-                } else if (prefix_matches(message, "stats ")) {
+                if (prefix_matches(message, "stats ")) {
                         const char *toggle = suffix(message, "stats ");
                         if (strcasecmp(toggle, "on") == 0) {
                                 s->stats_on = true;
@@ -592,6 +608,17 @@ static int process_msg(struct control_state *s, fd_t client_fd, char *message, s
         } else if(strcasecmp(message, "bye") == 0) {
                 ret = CONTROL_CLOSE_HANDLE;
                 resp = new_response(RESPONSE_OK, NULL);
+        } else if (strcasecmp(message, "metrics") == 0 || strcasecmp(message, "metrics json") == 0) {
+                std::string metrics = strcasecmp(message, "metrics") == 0 ? metrics_format_openmetrics()
+                        : metrics_format_json() + "\r\n";
+                client_write(c, metrics.c_str(), metrics.length(), false);
+                resp = new_response(RESPONSE_OK, NULL);
+        } else if (strcasecmp(message, "trace stop") == 0) {
+                trace_events_stop();
+                resp = new_response(RESPONSE_OK, NULL);
+        } else if (strcasecmp(message, "trace start") == 0 || prefix_matches(message, "trace start ")) {
+                const char *filename = strlen(message) > strlen("trace start ") ? suffix(message, "trace start ") : NULL;
+                resp = new_response(trace_events_start(filename) ? RESPONSE_OK : RESPONSE_INT_SERV_ERR, NULL);
         } else if(strcmp(message, "dump-tree") == 0) {
                 dump_tree(s->root_module, 0);
                 resp = new_response(RESPONSE_OK, NULL);
@@ -614,12 +641,41 @@ static int process_msg(struct control_state *s, fd_t client_fd, char *message, s
                 snprintf(buf, sizeof(buf), "(unknown path: %s)", path);
                 resp = new_response(RESPONSE_INT_SERV_ERR, buf);
         }
-        send_response(client_fd, resp);
+        send_response(c, resp);
 
         return ret;
 }
 
-static void send_response(fd_t fd, struct response *resp)
+/**
+ * Queues output for the client, it is written asynchronously by the control thread.
+ *
+ * @param c         client, NULL means stdout (commands executed internally)
+ * @param droppable stats/events - dropped if the client doesn't keep up reading them
+ */
+static void client_write(struct client *c, const char *data, size_t len, bool droppable)
+{
+        if (c == nullptr) {
+                if (write_all(1, data, len) != (ssize_t) len) {
+                        perror("[control socket] write");
+                }
+                return;
+        }
+        if (c->internal || c->closed) {
+                return;
+        }
+        if (c->out.length() - c->out_pos + len > MAX_CLIENT_OUT_BUFFER) {
+                if (droppable) {
+                        c->dropped += 1;
+                        return;
+                }
+                log_msg(LOG_LEVEL_WARNING, "[control socket] Client not reading responses, closing.\n");
+                c->closed = true;
+                return;
+        }
+        c->out.append(data, len);
+}
+
+static void send_response(struct client *c, struct response *resp)
 {
         char buffer[1024];
 
@@ -632,10 +688,7 @@ static void send_response(fd_t fd, struct response *resp)
         }
         strcat(buffer, "\r\n");
 
-        ssize_t ret = write_all(fd, buffer, strlen(buffer));
-        if (ret < 0) {
-                socket_error("Unable to write response");
-        }
+        client_write(c, buffer, strlen(buffer), false);
 
         free_response(resp);
 }
@@ -672,23 +725,6 @@ static bool parse_msg(char *buffer, int buffer_len, /* out */ char *message, int
         return ret;
 }
 
-/**
- * prepends itself at the head of the list
- */
-static struct client *add_client(struct client *clients, fd_t fd) {
-        struct client *new_client = (struct client *)
-                malloc(sizeof(struct client));
-        new_client->fd = fd;
-        new_client->prev = NULL;
-        new_client->next = clients;
-        if (new_client->next) {
-                new_client->next->prev = new_client;
-        }
-        new_client->buff_len = 0;
-
-        return new_client;
-}
-
 static void process_messages(struct control_state *s)
 {
         struct message *msg;
@@ -706,7 +742,7 @@ static void process_messages(struct control_state *s)
                         }
                         free_message(msg, r);
                 } else if (strstr(m->text, "execute ") == m->text) {
-                        process_msg(s, 1, m->text + strlen("execute "), nullptr);
+                        process_msg(s, nullptr, m->text + strlen("execute "));
                         free_message(msg, new_response(RESPONSE_OK, nullptr));
                 } else {
                         log_msg(LOG_LEVEL_WARNING, "[control] Unrecognized command: %s\n", m->text);
@@ -718,7 +754,7 @@ static void process_messages(struct control_state *s)
 
 static void set_socket_nonblock(fd_t fd) {
 #ifdef _WIN32
-    unsigned long ul;
+    unsigned long ul = 1;
     ioctlsocket(fd, FIONBIO, &ul);
 #else
     if (fcntl(fd, F_SETFL, O_NONBLOCK) == -1) {
@@ -727,75 +763,219 @@ static void set_socket_nonblock(fd_t fd) {
 #endif
 }
 
+#ifdef __linux__
+control_poller::control_poller() : m_epoll_fd(epoll_create1(EPOLL_CLOEXEC)) {
+        if (m_epoll_fd == -1) {
+                perror("[control socket] epoll_create1");
+        }
+}
+
+control_poller::~control_poller() {
+        if (m_epoll_fd != -1) {
+                close(m_epoll_fd);
+        }
+}
+
+void control_poller::add(fd_t fd) {
+        struct epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+                perror("[control socket] epoll_ctl");
+        }
+}
+
+void control_poller::set_write(fd_t fd, bool write) {
+        struct epoll_event ev{};
+        ev.events = write ? EPOLLIN | EPOLLOUT : EPOLLIN;
+        ev.data.fd = fd;
+        if (epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, fd, &ev) != 0) {
+                perror("[control socket] epoll_ctl");
+        }
+}
+
+void control_poller::remove(fd_t fd) {
+        epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+}
+
+int control_poller::wait(vector<pair<fd_t, int>> &events) {
+        struct epoll_event ev[64];
+        int rc = epoll_wait(m_epoll_fd, ev, sizeof ev / sizeof ev[0], -1);
+        events.clear();
+        for (int i = 0; i < rc; ++i) {
+                // errors and hang-ups are reported by the subsequent read
+                int flags = (ev[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP) ? EV_IN : 0) |
+                        (ev[i].events & EPOLLOUT ? EV_OUT : 0);
+                fd_t fd = ev[i].data.fd;
+                events.emplace_back(fd, flags);
+        }
+        return rc < 0 && errno == EINTR ? 0 : rc;
+}
+#else
+control_poller::control_poller() {}
+control_poller::~control_poller() {}
+void control_poller::add(fd_t fd) { m_fds[fd] = false; }
+void control_poller::set_write(fd_t fd, bool write) { m_fds[fd] = write; }
+void control_poller::remove(fd_t fd) { m_fds.erase(fd); }
+
+int control_poller::wait(vector<pair<fd_t, int>> &events) {
+        fd_set rfds;
+        fd_set wfds;
+        FD_ZERO(&rfds);
+        FD_ZERO(&wfds);
+        fd_t max_fd = 0;
+        for (auto const &fd : m_fds) {
+                FD_SET(fd.first, &rfds);
+                if (fd.second) {
+                        FD_SET(fd.first, &wfds);
+                }
+                max_fd = max(max_fd, fd.first + 1);
+        }
+        int rc = select(max_fd, &rfds, &wfds, NULL, NULL);
+        events.clear();
+        if (rc <= 0) {
+                return rc < 0 && errno == EINTR ? 0 : rc;
+        }
+        for (auto const &fd : m_fds) {
+                int flags = (FD_ISSET(fd.first, &rfds) ? EV_IN : 0) | (FD_ISSET(fd.first, &wfds) ? EV_OUT : 0);
+                if (flags != 0) {
+                        events.emplace_back(fd.first, flags);
+                }
+        }
+        return events.size();
+}
+#endif
+
+/**
+ * Writes as much of pending output as the socket accepts without blocking.
+ */
+static void client_flush(struct client *c)
+{
+        while (c->out_pos < c->out.length()) {
+                ssize_t ret = send(c->fd, c->out.data() + c->out_pos, c->out.length() - c->out_pos, MSG_NOSIGNAL);
+                if (ret < 0) {
+#ifdef _WIN32
+                        bool would_block = WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+                        bool would_block = errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+                        if (!would_block) {
+                                c->closed = true;
+                        }
+                        break;
+                }
+                c->out_pos += ret;
+        }
+        if (c->out_pos == c->out.length()) {
+                c->out.clear();
+                c->out_pos = 0;
+                if (c->close_after_flush) {
+                        shutdown(c->fd, SHUT_RDWR); // the following read returns 0 and closes the handle
+                        c->close_after_flush = false;
+                }
+        } else if (c->out_pos > MAX_CLIENT_OUT_BUFFER / 2) { // drop already sent data
+                c->out.erase(0, c->out_pos);
+                c->out_pos = 0;
+        }
+        if (c->dropped > 0 && c->out.length() < MAX_CLIENT_OUT_BUFFER / 2) {
+                log_msg(LOG_LEVEL_WARNING, "[control socket] %lu stats/event lines dropped for a slow client.\n", c->dropped);
+                c->dropped = 0;
+        }
+}
+
+/**
+ * Passes queued stats and events to all remote clients.
+ */
+static void broadcast_stats_events(struct control_state *s, list<client> &clients)
+{
+        queue<string> lines;
+        {
+                std::lock_guard<std::mutex> lk(s->stats_lock);
+                swap(lines, s->stat_event_queue);
+        }
+        for ( ; !lines.empty(); lines.pop()) {
+                for (auto &c : clients) {
+                        client_write(&c, lines.front().c_str(), lines.front().length(), true);
+                }
+        }
+}
+
 ADD_TO_PARAM("control-accept-global", "* control-accept-global\n"
                 "  Open control socket to public network.\n");
 static void * control_thread(void *args)
 {
         set_thread_name(__func__);
         struct control_state *s = (struct control_state *) args;
-        struct client *clients = NULL;
+        list<client> clients;
+        unordered_map<fd_t, client *> client_by_fd;
+        control_poller poller;
 
         assert(s->socket_fd != INVALID_SOCKET);
         assert(s->internal_fd[0] != INVALID_SOCKET);
 
+        auto add_client = [&](fd_t fd, bool internal) {
+                clients.emplace_back(fd, internal);
+                client_by_fd[fd] = &clients.back();
+                poller.add(fd);
+        };
+
         if(s->connection_type == CLIENT) {
-                clients = add_client(clients, s->socket_fd);
+                set_socket_nonblock(s->socket_fd);
+                add_client(s->socket_fd, false);
+        } else {
+                poller.add(s->socket_fd);
         }
         struct sockaddr_storage client_addr;
         socklen_t len = sizeof client_addr;
 
         errno = 0;
 
-        clients = add_client(clients, s->internal_fd[0]);
+        add_client(s->internal_fd[0], true);
 
         bool should_exit = false;
-
-        struct timeval last_report_sent;
-        const int report_interval_sec = 5;
-        gettimeofday(&last_report_sent, NULL);
+        vector<pair<fd_t, int>> events;
 
         while(!should_exit) {
                 process_messages(s);
+                broadcast_stats_events(s, clients);
 
-                fd_t max_fd = 0;
-                fd_set fds;
-                FD_ZERO(&fds);
-                if (s->connection_type == SERVER) {
-                        FD_SET(s->socket_fd, &fds);
-                        max_fd = s->socket_fd + 1;
+                // write what can be written, poll for writability the rest
+                for (auto &c : clients) {
+                        if (!c.out.empty() && !c.closed) {
+                                client_flush(&c);
+                        }
+                        bool want_write = !c.out.empty() && !c.closed;
+                        if (want_write != c.want_write) {
+                                poller.set_write(c.fd, want_write);
+                                c.want_write = want_write;
+                        }
                 }
-
-                struct client *cur = clients;
-
-                while(cur) {
-                        FD_SET(cur->fd, &fds);
-                        if(cur->fd + 1 > max_fd) {
-                                max_fd = cur->fd + 1;
+                for (auto it = clients.begin(); it != clients.end(); ) {
+                        if (!it->closed) {
+                                ++it;
+                                continue;
                         }
-                        cur = cur->next;
+                        poller.remove(it->fd);
+                        client_by_fd.erase(it->fd);
+                        CLOSESOCKET(it->fd);
+                        it = clients.erase(it);
                 }
 
-                struct timeval timeout;
-                timeout.tv_sec = report_interval_sec;
-                timeout.tv_usec = 0;
-
-                struct timeval *timeout_ptr = NULL;
-                if(clients->next != NULL) { // some remote client
-                        timeout_ptr = &timeout;
+                if (poller.wait(events) < 0) {
+                        socket_error("[control socket] poll");
+                        continue;
                 }
 
-                int rc;
-
-                if ((rc = select(max_fd, &fds, NULL, NULL, timeout_ptr)) >= 1) {
-                        if(s->connection_type == SERVER && FD_ISSET(s->socket_fd, &fds)) {
+                for (auto const &ev : events) {
+                        if (s->connection_type == SERVER && ev.first == s->socket_fd) {
+                                len = sizeof client_addr;
                                 fd_t fd = accept(s->socket_fd, (struct sockaddr *) &client_addr, &len);
                                 if (fd == INVALID_SOCKET) {
                                         socket_error("[control socket] accept");
                                         continue;
                                 }
 
-                                // all remote sockets are written sequentially so
-                                // we don't want to block if one gets stuck
+                                // data are written asynchronously, a stuck client must not block the others
                                 set_socket_nonblock(fd);
 
                                 // refuse remote connections by default
@@ -808,76 +988,63 @@ static void * control_thread(void *args)
                                         continue;
                                 }
 
-                                // add to list
-                                clients = add_client(clients, fd);
+                                add_client(fd, false);
+                                continue;
                         }
 
-                        struct client *cur = clients;
-
-                        while(cur) {
-                                if(FD_ISSET(cur->fd, &fds)) {
-                                        ssize_t ret = PLATFORM_PIPE_READ(cur->fd, cur->buff + cur->buff_len,
-                                                        sizeof(cur->buff) - cur->buff_len);
-                                        if(ret == -1) {
-                                                fprintf(stderr, "Error reading socket, closing!!!\n");
-                                        }
-                                        if(ret <= 0) {
-                                                struct client *next;
-                                                CLOSESOCKET(cur->fd);
-                                                if (cur->prev) {
-                                                        cur->prev->next = cur->next;
-                                                } else {
-                                                        clients = cur->next;
-                                                }
-                                                if (cur->next) {
-                                                        cur->next->prev = cur->prev;
-                                                }
-                                                next = cur->next;
-                                                free(cur);
-                                                cur = next;
-                                                continue;
-                                        }
-                                        cur->buff_len += ret;
-                                }
-                                cur = cur->next;
+                        auto it = client_by_fd.find(ev.first);
+                        if (it == client_by_fd.end()) {
+                                continue;
                         }
-                } else if (rc < 0) {
-                        socket_error("[control socket] select");
-                }
+                        struct client *c = it->second;
+                        if ((ev.second & control_poller::EV_OUT) != 0) {
+                                client_flush(c);
+                        }
+                        if ((ev.second & control_poller::EV_IN) == 0) {
+                                continue;
+                        }
+                        ssize_t ret = PLATFORM_PIPE_READ(c->fd, c->buff + c->buff_len,
+                                        sizeof(c->buff) - c->buff_len);
+                        if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+                                continue;
+                        }
+                        if(ret == -1) {
+                                fprintf(stderr, "Error reading socket, closing!!!\n");
+                        }
+                        if(ret <= 0) {
+                                c->closed = true;
+                                continue;
+                        }
+                        c->buff_len += ret;
 
-                cur = clients;
-                while(cur) {
-                        char msg[sizeof(cur->buff) + 1];
+                        char msg[sizeof(c->buff) + 1];
                         int cur_buffer_len;
-                        while(parse_msg(cur->buff, cur->buff_len, msg, &cur_buffer_len)) {
-                                cur->buff_len = cur_buffer_len;
-                                int ret = process_msg(s, cur->fd, msg, clients);
-                                if(ret == CONTROL_EXIT && is_internal_port(cur->fd)) {
+                        while(parse_msg(c->buff, c->buff_len, msg, &cur_buffer_len)) {
+                                c->buff_len = cur_buffer_len;
+                                int ret = process_msg(s, c, msg);
+                                if(ret == CONTROL_EXIT && c->internal) {
                                         should_exit = true;
                                 } else if(ret == CONTROL_CLOSE_HANDLE) {
-                                        shutdown(cur->fd, SHUT_RDWR);
+                                        c->close_after_flush = true;
                                 }
                         }
-                        if(cur->buff_len == sizeof(cur->buff)) {
+                        if(c->buff_len == sizeof(c->buff)) {
                                 fprintf(stderr, "Socket buffer full and no delimited message. Discarding.\n");
-                                cur->buff_len = 0;
+                                c->buff_len = 0;
                         }
-
-                        cur = cur->next;
                 }
         }
 
         // notify clients about exit
-        struct client *cur = clients;
-        while(cur) {
-                struct client *tmp = cur;
-                if (!is_internal_port(cur->fd)) {
+        for (auto &c : clients) {
+                if (!c.internal && !c.closed) {
                         const char *msg = "event exit\r\n";
-                        write_all(cur->fd, msg, strlen(msg));
+                        client_write(&c, msg, strlen(msg), true);
+                        client_flush(&c); // best effort, don't wait for slow clients
+                }
+                if (!c.internal) {
+                        CLOSESOCKET(c.fd);
                 }
-                CLOSESOCKET(cur->fd);
-                cur = cur->next;
-                free(tmp);
         }
 
         platform_pipe_close(s->internal_fd[0]);
@@ -885,30 +1052,6 @@ static void * control_thread(void *args)
         return NULL;
 }
 
-static void *stat_event_thread(void *args)
-{
-        set_thread_name(__func__);
-        struct control_state *s = (struct control_state *) args;
-
-        while (1) {
-                std::unique_lock<std::mutex> lk(s->stats_lock);
-                s->stat_event_cv.wait(lk, [s] { return s->stat_event_queue.size() > 0; });
-                string &line = s->stat_event_queue.front();
-
-                if (line.empty()) {
-                        break;
-                }
-
-                int ret = write_all(s->internal_fd[1], line.c_str(), line.length());
-                s->stat_event_queue.pop();
-                if (ret <= 0) {
-                        fprintf(stderr, "Cannot write stat line!\n");
-                }
-        }
-
-        return NULL;
-}
-
 void control_done(struct control_state *s)
 {
         if(!s) {
@@ -918,12 +1061,6 @@ void control_done(struct control_state *s)
         module_done(&s->mod);
 
         if(s->started) {
-                s->stats_lock.lock();
-                s->stat_event_queue.push({});
-                s->stats_lock.unlock();
-                s->stat_event_cv.notify_one();
-                s->stat_event_thread_id.join();
-
                 int ret = write_all(s->internal_fd[1], "quit\r\n", 6);
                 if (ret > 0) {
                         s->control_thread_id.join();
@@ -945,13 +1082,19 @@ static void control_report_stats_event(struct control_state *s, const std::strin
 {
         std::unique_lock<std::mutex> lk(s->stats_lock);
 
+        bool wake = s->stat_event_queue.empty();
         if (s->stat_event_queue.size() < MAX_STAT_EVENT_QUEUE) {
                 s->stat_event_queue.push(report_line);
         } else {
-                log_msg(LOG_LEVEL_WARNING, "Cannot write stats/event - queue full!!!");
+                log_msg(LOG_LEVEL_WARNING, "Cannot write stats/event - queue full!!!\n");
         }
         lk.unlock();
-        s->stat_event_cv.notify_one();
+        if (wake && s->started) {
+                // the control thread writes to the clients, just wake it up (non-blocking)
+                if (PLATFORM_PIPE_WRITE(s->internal_fd[1], "noop\r\n", 6) <= 0) {
+                        log_msg(LOG_LEVEL_DEBUG, "[control] Cannot wake up control thread!\n");
+                }
+        }
 }
 
 void control_report_stats(struct control_state *s, const std::string &report_line)
@@ -993,6 +1136,8 @@ static void print_control_help() {
                         "\tmute\n"
                                 "\t\tthe three items above apply to receiver\n"
                         "\tpostprocess <new_postprocess>|flush\n"
+                        "\ttrace {start [<file>]|stop}\n"
+                        "\tmetrics [json] - OpenMetrics text (terminated by \"# EOF\") or JSON\n"
                         "\tdump-tree\n");
         printf("\nOther commands can be issued directly to individual "
                         "modules (see \"dump-tree\"), eg.:\n"
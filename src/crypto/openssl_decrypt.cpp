@@ -51,9 +51,14 @@
 
 #include <string.h>
 #include <openssl/aes.h>
+#include <openssl/evp.h>
+
+#define MOD_NAME "[decrypt] "
 
 struct openssl_decrypt {
         AES_KEY key;
+        EVP_CIPHER_CTX *gcm128_ctx; ///< key is set, IV set per packet
+        EVP_CIPHER_CTX *gcm256_ctx;
 
         unsigned char ivec[AES_BLOCK_SIZE];
         unsigned char ecount[AES_BLOCK_SIZE];
@@ -78,6 +83,20 @@ static int openssl_decrypt_init(struct openssl_decrypt **state,
         AES_set_encrypt_key(hash, 128, &s->key);
         // for ECB it should be AES_set_decrypt_key(hash, 128, &s->key);
 
+        unsigned char key256[32];
+        EVP_Digest(passphrase, strlen(passphrase), key256, NULL, EVP_sha256(), NULL);
+        s->gcm128_ctx = EVP_CIPHER_CTX_new();
+        s->gcm256_ctx = EVP_CIPHER_CTX_new();
+        if (s->gcm128_ctx == NULL || s->gcm256_ctx == NULL ||
+                        EVP_DecryptInit_ex(s->gcm128_ctx, EVP_aes_128_gcm(), NULL, hash, NULL) != 1 ||
+                        EVP_DecryptInit_ex(s->gcm256_ctx, EVP_aes_256_gcm(), NULL, key256, NULL) != 1) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot initialize AES-GCM!\n");
+                EVP_CIPHER_CTX_free(s->gcm128_ctx);
+                EVP_CIPHER_CTX_free(s->gcm256_ctx);
+                free(s);
+                return -1;
+        }
+
         *state = s;
         return 0;
 }
@@ -86,9 +105,42 @@ static void openssl_decrypt_destroy(struct openssl_decrypt *s)
 {
         if(!s)
                 return;
+        EVP_CIPHER_CTX_free(s->gcm128_ctx);
+        EVP_CIPHER_CTX_free(s->gcm256_ctx);
         free(s);
 }
 
+/**
+ * Decrypts and authenticates data in format produced by openssl_encrypt_gcm().
+ * @retval 0 if authentication failed
+ */
+static int openssl_decrypt_gcm(EVP_CIPHER_CTX *ctx,
+                const char *ciphertext, int ciphertext_len,
+                const char *aad, int aad_len,
+                char *plaintext)
+{
+        uint32_t data_len;
+        if (ciphertext_len < (int) (sizeof(uint32_t) + GCM_IV_LEN + GCM_TAG_LEN)) {
+                return 0;
+        }
+        memcpy(&data_len, ciphertext, sizeof(uint32_t));
+        if (data_len != ciphertext_len - sizeof(uint32_t) - GCM_IV_LEN - GCM_TAG_LEN) {
+                return 0;
+        }
+        const unsigned char *iv = (const unsigned char *) ciphertext + sizeof(uint32_t);
+        const unsigned char *in = iv + GCM_IV_LEN;
+
+        int len = 0;
+        if (EVP_DecryptInit_ex(ctx, NULL, NULL, NULL, iv) != 1 ||
+                        (aad_len > 0 && EVP_DecryptUpdate(ctx, NULL, &len, (const unsigned char *) aad, aad_len) != 1) ||
+                        EVP_DecryptUpdate(ctx, (unsigned char *) plaintext, &len, in, data_len) != 1 ||
+                        EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, GCM_TAG_LEN, const_cast<unsigned char *>(in) + data_len) != 1 ||
+                        EVP_DecryptFinal_ex(ctx, (unsigned char *) plaintext + len, &len) != 1) {
+                return 0; // authentication failed
+        }
+        return data_len;
+}
+
 static void openssl_decrypt_block(struct openssl_decrypt *s,
                 const unsigned char *ciphertext, unsigned char *plaintext, const char *ivec_or_nonce_and_counter,
                 int len, enum openssl_mode mode)
@@ -132,7 +184,11 @@ static int openssl_decrypt(struct openssl_decrypt *decrypt,
                 const char *aad, int aad_len,
                 char *plaintext, enum openssl_mode mode)
 {
-        UNUSED(ciphertext_len);
+        if (mode == MODE_AES128_GCM || mode == MODE_AES256_GCM) {
+                return openssl_decrypt_gcm(mode == MODE_AES128_GCM ? decrypt->gcm128_ctx : decrypt->gcm256_ctx,
+                                ciphertext, ciphertext_len, aad, aad_len, plaintext);
+        }
+
         uint32_t data_len;
         memcpy(&data_len, ciphertext, sizeof(uint32_t));
         ciphertext += sizeof(uint32_t);
@@ -49,10 +49,15 @@
 
 #include <string.h>
 #include <openssl/aes.h>
+#include <openssl/evp.h>
 #include <openssl/rand.h>
 
+#define MOD_NAME "[encrypt] "
+
 struct openssl_encrypt {
         AES_KEY key;
+        EVP_CIPHER_CTX *ctx; ///< GCM modes only
+        unsigned char gcm_iv[GCM_IV_LEN]; ///< random salt + 64-bit packet counter
 
         enum openssl_mode mode;
 
@@ -81,7 +86,26 @@ static int openssl_encrypt_init(struct openssl_encrypt **state, const char *pass
                 return -1;
         }
         s->mode = mode;
-        assert(s->mode == MODE_AES128_CFB || MODE_AES128_CTR); // only functional by now
+        assert(s->mode == MODE_AES128_CFB || s->mode == MODE_AES128_CTR
+                        || s->mode == MODE_AES128_GCM || s->mode == MODE_AES256_GCM); // only functional by now
+
+        if (s->mode == MODE_AES128_GCM || s->mode == MODE_AES256_GCM) {
+                unsigned char key256[32];
+                if (s->mode == MODE_AES256_GCM) {
+                        EVP_Digest(passphrase, strlen(passphrase), key256, NULL, EVP_sha256(), NULL);
+                }
+                // whole IV is random initially, so that different senders
+                // using the same passphrase won't collide
+                s->ctx = EVP_CIPHER_CTX_new();
+                if (s->ctx == NULL || !RAND_bytes(s->gcm_iv, sizeof s->gcm_iv) ||
+                                EVP_EncryptInit_ex(s->ctx, s->mode == MODE_AES128_GCM ? EVP_aes_128_gcm() : EVP_aes_256_gcm(),
+                                        NULL, s->mode == MODE_AES128_GCM ? hash : key256, NULL) != 1) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot initialize AES-GCM!\n");
+                        EVP_CIPHER_CTX_free(s->ctx);
+                        free(s);
+                        return -1;
+                }
+        }
 
         *state = s;
         return 0;
@@ -127,17 +151,51 @@ static void openssl_encrypt_block(struct openssl_encrypt *s, unsigned char *plai
                         AES_ecb_encrypt(plaintext, ciphertext,
                                         &s->key, AES_ENCRYPT);
                         break;
+                default:
+                        abort();
         }
 }
 
 static void openssl_encrypt_destroy(struct openssl_encrypt *s)
 {
+        EVP_CIPHER_CTX_free(s->ctx);
         free(s);
 }
 
+/**
+ * Output format: data_len (4 B) | IV (12 B) | ciphertext | tag (16 B)
+ */
+static int openssl_encrypt_gcm(struct openssl_encrypt *s,
+                char *plaintext, int data_len, char *aad, int aad_len, char *ciphertext)
+{
+        memcpy(ciphertext, &data_len, sizeof(uint32_t));
+        unsigned char *iv = (unsigned char *) ciphertext + sizeof(uint32_t);
+        unsigned char *out = iv + GCM_IV_LEN;
+
+        // IV must never repeat for a key - increment the counter (last 8 B)
+        for (int i = GCM_IV_LEN - 1; i >= GCM_IV_LEN - 8 && ++s->gcm_iv[i] == 0; --i)
+                ;
+        memcpy(iv, s->gcm_iv, GCM_IV_LEN);
+
+        int len = 0;
+        if (EVP_EncryptInit_ex(s->ctx, NULL, NULL, NULL, iv) != 1 ||
+                        (aad_len > 0 && EVP_EncryptUpdate(s->ctx, NULL, &len, (unsigned char *) aad, aad_len) != 1) ||
+                        EVP_EncryptUpdate(s->ctx, out, &len, (unsigned char *) plaintext, data_len) != 1 ||
+                        EVP_EncryptFinal_ex(s->ctx, out + len, &len) != 1 ||
+                        EVP_CIPHER_CTX_ctrl(s->ctx, EVP_CTRL_GCM_GET_TAG, GCM_TAG_LEN, out + data_len) != 1) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "AES-GCM encryption failed!\n");
+                return 0;
+        }
+        return sizeof(uint32_t) + GCM_IV_LEN + data_len + GCM_TAG_LEN;
+}
+
 static int openssl_encrypt(struct openssl_encrypt *encryption,
                 char *plaintext, int data_len, char *aad, int aad_len, char *ciphertext)
 {
+        if (encryption->mode == MODE_AES128_GCM || encryption->mode == MODE_AES256_GCM) {
+                return openssl_encrypt_gcm(encryption, plaintext, data_len, aad, aad_len, ciphertext);
+        }
+
         uint32_t crc = 0xffffffff;
         memcpy(ciphertext, &data_len, sizeof(uint32_t));
         ciphertext += sizeof(uint32_t);
@@ -174,6 +232,9 @@ static int openssl_get_overhead(struct openssl_encrypt *s)
                 case MODE_AES128_CTR:
                         return sizeof(uint32_t) /* data_len */ +
                                 16 /* nonce + counter */ + sizeof(uint32_t) /* crc */;
+                case MODE_AES128_GCM:
+                case MODE_AES256_GCM:
+                        return sizeof(uint32_t) /* data_len */ + GCM_IV_LEN + GCM_TAG_LEN;
                 default:
                         abort();
         }
@@ -46,12 +46,16 @@ enum openssl_mode {
         MODE_AES128_NONE = 0,
         MODE_AES128_CTR = 1, // no autenticity, only integrity (CRC)
         MODE_AES128_CFB = 2,
-        MODE_AES128_MAX = MODE_AES128_CFB,
+        MODE_AES128_GCM = 3, // authenticated encryption (EVP, uses AES-NI where available)
+        MODE_AES256_GCM = 4,
+        MODE_AES128_MAX = MODE_AES256_GCM,
         MODE_AES128_ECB = -1, // do not use
 };
 
+#define GCM_IV_LEN 12
+#define GCM_TAG_LEN 16
 
-#define MAX_CRYPTO_EXTRA_DATA 24 // == maximal overhead of available encryptions
+#define MAX_CRYPTO_EXTRA_DATA 32 // == maximal overhead of available encryptions (GCM)
 #define MAX_CRYPTO_PAD 0 // CTR does not need padding
 #define MAX_CRYPTO_EXCEED (MAX_CRYPTO_EXTRA_DATA + MAX_CRYPTO_PAD)
 
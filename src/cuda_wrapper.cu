@@ -61,6 +61,7 @@ static inline enum cudaMemcpyKind map_cuda_memcpy_kind(int our_kind) {
         struct kind_mapping mapping[] = {
                 { cudaMemcpyHostToDevice, CUDA_WRAPPER_MEMCPY_HOST_TO_DEVICE },
                 { cudaMemcpyDeviceToHost, CUDA_WRAPPER_MEMCPY_DEVICE_TO_HOST },
+                { cudaMemcpyDefault, CUDA_WRAPPER_MEMCPY_DEVICE_TO_DEVICE }, // UVA - also peer copy
         };
 
         int i;
@@ -88,6 +89,16 @@ CUDA_DLL_API int cuda_wrapper_host_alloc(void **pHost, size_t size, unsigned int
         return map_cuda_error(cudaHostAlloc(pHost, size, flags));
 }
 
+CUDA_DLL_API int cuda_wrapper_host_register(void *ptr, size_t size, unsigned int flags)
+{
+        return map_cuda_error(cudaHostRegister(ptr, size, flags));
+}
+
+CUDA_DLL_API int cuda_wrapper_host_unregister(void *ptr)
+{
+        return map_cuda_error(cudaHostUnregister(ptr));
+}
+
 CUDA_DLL_API int cuda_wrapper_malloc(void **buffer, size_t data_len)
 {
         return map_cuda_error(cudaMalloc(buffer, data_len));
@@ -106,6 +117,12 @@ CUDA_DLL_API int cuda_wrapper_memcpy(void *dst, const void *src,
                                 map_cuda_memcpy_kind(kind)));
 }
 
+/// waits for all work enqueued to the current device
+CUDA_DLL_API int cuda_wrapper_device_synchronize(void)
+{
+        return map_cuda_error(cudaDeviceSynchronize());
+}
+
 CUDA_DLL_API const char *cuda_wrapper_last_error_string(void)
 {
         return cudaGetErrorString(cudaGetLastError());
@@ -127,3 +144,18 @@ CUDA_DLL_API int cuda_wrapper_set_device(int index)
                         cudaSetDevice(index));
 }
 
+/**
+ * Creates a stream that doesn't synchronize with the legacy default stream,
+ * so that work of multiple streams can overlap.
+ */
+CUDA_DLL_API int cuda_wrapper_stream_create(cuda_wrapper_stream_t *stream)
+{
+        return map_cuda_error(
+                        cudaStreamCreateWithFlags((cudaStream_t *) stream, cudaStreamNonBlocking));
+}
+
+CUDA_DLL_API int cuda_wrapper_stream_destroy(cuda_wrapper_stream_t stream)
+{
+        return map_cuda_error(
+                        cudaStreamDestroy((cudaStream_t) stream));
+}
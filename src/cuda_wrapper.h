@@ -61,6 +61,12 @@ extern "C" {
 /// @{
 #define CUDA_WRAPPER_MEMCPY_HOST_TO_DEVICE 0
 #define CUDA_WRAPPER_MEMCPY_DEVICE_TO_HOST 1
+#define CUDA_WRAPPER_MEMCPY_DEVICE_TO_DEVICE 2 ///< buffers may reside on different devices
+/// @}
+
+/// @{
+#define CUDA_WRAPPER_HOST_ALLOC_PORTABLE 0x01 ///< cudaHostAllocPortable
+#define CUDA_WRAPPER_HOST_REGISTER_PORTABLE 0x01 ///< cudaHostRegisterPortable
 /// @}
 
 typedef void *cuda_wrapper_stream_t;
@@ -68,14 +74,19 @@ typedef void *cuda_wrapper_stream_t;
 CUDA_DLL_API int cuda_wrapper_free(void *buffer);
 CUDA_DLL_API int cuda_wrapper_free_host(void *buffer);
 CUDA_DLL_API int cuda_wrapper_host_alloc(void **pHost, size_t size, unsigned int flags);
+CUDA_DLL_API int cuda_wrapper_host_register(void *ptr, size_t size, unsigned int flags);
+CUDA_DLL_API int cuda_wrapper_host_unregister(void *ptr);
 CUDA_DLL_API int cuda_wrapper_malloc(void **buffer, size_t data_len);
 CUDA_DLL_API int cuda_wrapper_malloc_host(void **buffer, size_t data_len);
 CUDA_DLL_API int cuda_wrapper_memcpy(void *dst, const void *src,
                 size_t count, int kind);
+CUDA_DLL_API int cuda_wrapper_device_synchronize(void);
 CUDA_DLL_API const char *cuda_wrapper_last_error_string(void);
 CUDA_DLL_API int cuda_wrapper_set_device(int index);
 CUDA_DLL_API int cuda_wrapper_get_last_error(void);
 CUDA_DLL_API const char * cuda_wrapper_get_error_string(int error);
+CUDA_DLL_API int cuda_wrapper_stream_create(cuda_wrapper_stream_t *stream);
+CUDA_DLL_API int cuda_wrapper_stream_destroy(cuda_wrapper_stream_t stream);
 
 #ifdef __cplusplus
 }
@@ -68,6 +68,9 @@ struct exporter {
         bool noaudio;
         bool novideo;
         pthread_mutex_t lock;
+        /// protects audio_export only so that the audio path does not wait
+        /// for video export holding lock (audio_export() itself never blocks)
+        pthread_mutex_t audio_lock;
 
         long long int limit; ///< number of video frames to record, -1 == unlimited (default)
 };
@@ -126,6 +129,7 @@ struct exporter *export_init(struct module *parent, const char *cfg, bool should
 {
         struct exporter *s = calloc(1, sizeof(struct exporter));
         pthread_mutex_init(&s->lock, NULL);
+        pthread_mutex_init(&s->audio_lock, NULL);
         s->limit = -1;
 
         if (cfg) {
@@ -180,10 +184,13 @@ static bool enable_export(struct exporter *s)
         if (!s->noaudio) {
                 char name[MAX_PATH_SIZE];
                 snprintf(name, sizeof name, "%s/sound.wav", s->dir);
-                s->audio_export = audio_export_init(name);
-                if (!s->audio_export) {
+                struct audio_export *audio_export = audio_export_init(name);
+                if (!audio_export) {
                         goto error;
                 }
+                pthread_mutex_lock(&s->audio_lock);
+                s->audio_export = audio_export;
+                pthread_mutex_unlock(&s->audio_lock);
         }
 
         s->exporting = true;
@@ -279,9 +286,12 @@ static bool create_dir(struct exporter *s)
 }
 
 static void disable_export(struct exporter *s) {
-        audio_export_destroy(s->audio_export);
-        video_export_destroy(s->video_export);
+        pthread_mutex_lock(&s->audio_lock);
+        struct audio_export *audio_export = s->audio_export;
         s->audio_export = NULL;
+        pthread_mutex_unlock(&s->audio_lock);
+        audio_export_destroy(audio_export); // flushes the buffered samples
+        video_export_destroy(s->video_export);
         s->video_export = NULL;
         if (s->dir_auto) {
                 free(s->dir);
@@ -294,6 +304,7 @@ void export_destroy(struct exporter *s) {
         disable_export(s);
 
         pthread_mutex_destroy(&s->lock);
+        pthread_mutex_destroy(&s->audio_lock);
         module_done(&s->mod);
         free(s->dir);
         free(s);
@@ -331,11 +342,11 @@ void export_audio(struct exporter *s, struct audio_frame *frame)
 
         process_messages(s);
 
-        pthread_mutex_lock(&s->lock);
-        if (s->exporting) {
+        pthread_mutex_lock(&s->audio_lock);
+        if (s->audio_export) { // set only while exporting
                 audio_export(s->audio_export, frame);
         }
-        pthread_mutex_unlock(&s->lock);
+        pthread_mutex_unlock(&s->audio_lock);
 }
 
 void export_video(struct exporter *s, struct video_frame *frame)
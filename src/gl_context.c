@@ -56,6 +56,7 @@
 
 #include "debug.h"
 #include "gl_context.h"
+#include "gl_program_cache.h"
 #include "utils/macros.h"
 
 /**
@@ -154,6 +155,9 @@ GLuint glsl_compile_link(const char *vprogram, const char *fprogram)
         GLint status;
 
         phandle = glCreateProgram();
+        if (gl_program_cache_load(phandle, vprogram, fprogram)) {
+                return phandle;
+        }
         vhandle = glCreateShader(GL_VERTEX_SHADER);
         fhandle = glCreateShader(GL_FRAGMENT_SHADER);
 
@@ -199,6 +203,7 @@ GLuint glsl_compile_link(const char *vprogram, const char *fprogram)
         if (strlen(log) > 0) {
                 log_msg(LOG_LEVEL_INFO, "Link Log: %s\n", log);
         }
+        gl_program_cache_store(phandle, vprogram, fprogram);
 
         // check GL errors
         gl_check_error();
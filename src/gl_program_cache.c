@@ -0,0 +1,197 @@
+/**
+ * @file   gl_program_cache.c
+ * @brief  Persistent cache of linked GLSL program binaries
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#if defined HAVE_LINUX || defined WIN32
+#include <GL/glew.h>
+#define GL_PROGRAM_CACHE_SUPPORTED 1 ///< legacy macOS GL doesn't have glGetProgramBinary
+#endif
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "debug.h"
+#include "gl_program_cache.h"
+#include "host.h"
+#include "utils/fs.h"
+
+#define MOD_NAME "[GL program cache] "
+#define DISABLE_PARAM "gl-disable-program-cache"
+#define CACHE_MAGIC 0x42504755U ///< "UGPB" (little endian)
+#define MAX_BINARY_SIZE (64 * 1024 * 1024)
+
+ADD_TO_PARAM(DISABLE_PARAM, "* " DISABLE_PARAM "\n"
+                "  Do not load/store linked GLSL programs from/to the cache directory.\n");
+
+struct entry_header {
+        uint32_t magic;
+        uint32_t format;
+        uint32_t length;
+};
+
+#ifdef GL_PROGRAM_CACHE_SUPPORTED
+static void fnv1a(uint64_t *hash, const char *str)
+{
+        if (str == NULL) {
+                str = "";
+        }
+        do {
+                *hash = (*hash ^ (unsigned char) *str) * 0x100000001b3ULL;
+        } while (*str++ != '\0');
+}
+
+static bool get_entry_path(const char *vprogram, const char *fprogram, char *path, size_t len)
+{
+        if (get_commandline_param(DISABLE_PARAM) != NULL) {
+                return false;
+        }
+        if (!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary) {
+                return false;
+        }
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        const char *dir = get_cache_dir();
+        if (formats <= 0 || dir == NULL) {
+                return false;
+        }
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        fnv1a(&hash, (const char *) glGetString(GL_VENDOR));
+        fnv1a(&hash, (const char *) glGetString(GL_RENDERER));
+        fnv1a(&hash, (const char *) glGetString(GL_VERSION));
+        fnv1a(&hash, vprogram);
+        fnv1a(&hash, fprogram);
+        return snprintf(path, len, "%sglsl_%016" PRIx64 ".bin", dir, hash) < (int) len;
+}
+#endif // defined GL_PROGRAM_CACHE_SUPPORTED
+
+bool gl_program_cache_load(unsigned int program, const char *vprogram, const char *fprogram)
+{
+#ifdef GL_PROGRAM_CACHE_SUPPORTED
+        char path[MAX_PATH_SIZE];
+        if (!get_entry_path(vprogram, fprogram, path, sizeof path)) {
+                return false;
+        }
+
+        FILE *f = fopen(path, "rb");
+        if (f == NULL) {
+                glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+                return false;
+        }
+        struct entry_header hdr;
+        void *data = NULL;
+        GLint status = GL_FALSE;
+        if (fread(&hdr, sizeof hdr, 1, f) == 1 && hdr.magic == CACHE_MAGIC
+                        && hdr.length > 0 && hdr.length <= MAX_BINARY_SIZE
+                        && (data = malloc(hdr.length)) != NULL
+                        && fread(data, hdr.length, 1, f) == 1) {
+                glProgramBinary(program, hdr.format, data, (GLsizei) hdr.length);
+                (void) glGetError(); // GL_INVALID_ENUM if the format is no longer supported
+                glGetProgramiv(program, GL_LINK_STATUS, &status);
+        }
+        free(data);
+        fclose(f);
+
+        if (status != GL_TRUE) { // driver update etc.
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Discarding stale entry %s\n", path);
+                remove(path);
+                glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+                return false;
+        }
+        log_msg(LOG_LEVEL_DEBUG, MOD_NAME "Loaded program from %s\n", path);
+        return true;
+#else
+        (void) program, (void) vprogram, (void) fprogram;
+        return false;
+#endif
+}
+
+void gl_program_cache_store(unsigned int program, const char *vprogram, const char *fprogram)
+{
+#ifdef GL_PROGRAM_CACHE_SUPPORTED
+        char path[MAX_PATH_SIZE];
+        char tmp_path[MAX_PATH_SIZE + 32];
+        GLint status = GL_FALSE;
+        GLint length = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &status);
+        if (status != GL_TRUE || !get_entry_path(vprogram, fprogram, path, sizeof path)) {
+                return;
+        }
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0 || length > MAX_BINARY_SIZE) {
+                return;
+        }
+        struct entry_header hdr = { CACHE_MAGIC, 0, 0 };
+        void *data = malloc(length);
+        GLenum format = 0;
+        GLsizei written = 0;
+        glGetProgramBinary(program, length, &written, &format, data);
+        if (glGetError() != GL_NO_ERROR || written <= 0) {
+                free(data);
+                return;
+        }
+        hdr.format = format;
+        hdr.length = written;
+
+        snprintf(tmp_path, sizeof tmp_path, "%s.tmp%ld", path, (long) getpid());
+        FILE *f = fopen(tmp_path, "wb");
+        bool ok = f != NULL && fwrite(&hdr, sizeof hdr, 1, f) == 1
+                && fwrite(data, written, 1, f) == 1;
+        if (f != NULL) {
+                ok = fclose(f) == 0 && ok;
+        }
+        free(data);
+        remove(path); // Windows rename() doesn't overwrite
+        if (!ok || rename(tmp_path, path) != 0) {
+                remove(tmp_path);
+                return;
+        }
+        log_msg(LOG_LEVEL_DEBUG, MOD_NAME "Stored program to %s\n", path);
+#else
+        (void) program, (void) vprogram, (void) fprogram;
+#endif
+}
@@ -0,0 +1,80 @@
+/**
+ * @file   gl_program_cache.h
+ * @brief  Persistent cache of linked GLSL program binaries
+ *
+ * Compiling and linking shaders takes up to hundreds of milliseconds per
+ * program with some drivers, delaying the first frame and reconfiguration.
+ * Linked programs are therefore stored (glGetProgramBinary) in the user
+ * cache directory, keyed by GL vendor, renderer and version string (which
+ * contains driver version) and by hash of the shader sources.
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GL_PROGRAM_CACHE_H_
+#define GL_PROGRAM_CACHE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+
+/**
+ * Tries to load program binary for given sources to an unlinked program.
+ *
+ * On cache miss, the program is marked as retrievable so that it can be
+ * stored by gl_program_cache_store() after linking. Must be called with a
+ * current GL context.
+ *
+ * @param program  program (GLuint) created by glCreateProgram()
+ * @param vprogram vertex shader source (may be NULL)
+ * @param fprogram fragment shader source (may be NULL)
+ * @retval true    program is linked and ready to use
+ * @retval false   program needs to be compiled and linked by the caller
+ */
+bool gl_program_cache_load(unsigned int program, const char *vprogram, const char *fprogram);
+
+/**
+ * Stores binary of successfully linked program. Does nothing if the program
+ * binary is not available.
+ */
+void gl_program_cache_store(unsigned int program, const char *vprogram, const char *fprogram);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // defined GL_PROGRAM_CACHE_H_
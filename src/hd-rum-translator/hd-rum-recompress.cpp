@@ -45,11 +45,13 @@
 #include "config_win32.h"
 #endif
 
+#include <algorithm>
 #include <cinttypes>
 #include <chrono>
 #include <memory>
 #include <thread>
 #include <string>
+#include <vector>
 
 
 #include "hd-rum-translator/hd-rum-recompress.h"
@@ -187,10 +189,47 @@ static void recompress_worker(struct recompress_worker_ctx *ctx){
         }
 }
 
+/**
+ * Returns key identifying an encoder so that equivalent compression configs
+ * share one. Options of libavcodec are independent of order (repeated ones
+ * keep their relative order, the last one wins), so they are sorted by key;
+ * other modules' configs are compared verbatim.
+ */
+static std::string get_worker_key(const char *compress)
+{
+        std::string cfg = compress;
+        auto delim = cfg.find(':');
+        if (delim == std::string::npos || strcasecmp(cfg.substr(0, delim).c_str(), "libavcodec") != 0) {
+                return cfg;
+        }
+
+        std::vector<std::string> opts;
+        std::string opt;
+        for (size_t i = delim + 1; i <= cfg.size(); ++i) {
+                if (i == cfg.size() || (cfg[i] == ':' && cfg[i - 1] != '\\')) {
+                        if (!opt.empty()) {
+                                opts.push_back(std::move(opt));
+                        }
+                        opt.clear();
+                } else {
+                        opt += cfg[i];
+                }
+        }
+        std::stable_sort(opts.begin(), opts.end(), [](const std::string &a, const std::string &b) {
+                        return a.substr(0, a.find('=')) < b.substr(0, b.find('='));
+                        });
+
+        std::string key = "libavcodec";
+        for (const auto &o : opts) {
+                key += ":" + o;
+        }
+        return key;
+}
+
 static int move_port_to_worker(struct state_recompress *s, const char *compress,
                 recompress_output_port&& port)
 {
-        auto& worker = s->workers[compress];
+        auto& worker = s->workers[get_worker_key(compress)];
         if(!worker.compress){
                 worker.compress_cfg = compress;
                 compress_state *cmp = nullptr;
@@ -200,6 +239,9 @@ static int move_port_to_worker(struct state_recompress *s, const char *compress,
                 worker.compress.reset(cmp);
 
                 worker.thread = std::thread(recompress_worker, &worker);
+        } else {
+                log_msg(LOG_LEVEL_INFO, "[recompress] Port %s shares encoder %s.\n",
+                                port.video_rxtx->m_port_id.c_str(), worker.compress_cfg.c_str());
         }
 
         std::lock_guard<std::mutex> lock(worker.ports_mut);
@@ -228,7 +270,7 @@ int recompress_add_port(struct state_recompress *s, struct module *parent_rep,
                 return -1;
 
         int index_of_port = s->index_to_port.size();
-        s->index_to_port.emplace_back(compress, index_in_worker);
+        s->index_to_port.emplace_back(get_worker_key(compress), index_in_worker);
 
         return index_of_port;
 }
@@ -290,7 +332,7 @@ bool recompress_port_change_compress(struct state_recompress *s, int index,
         std::lock_guard<std::mutex> lock(s->mut);
         auto [old_compress, i] = s->index_to_port[index];
 
-        if(old_compress == new_compress)
+        if(old_compress == get_worker_key(new_compress))
                 return true;
 
         recompress_output_port port;
@@ -302,7 +344,7 @@ bool recompress_port_change_compress(struct state_recompress *s, int index,
                 return false;
         }
 
-        s->index_to_port[index] = {new_compress, index_in_worker};
+        s->index_to_port[index] = {get_worker_key(new_compress), index_in_worker};
 
         return true;
 }
@@ -68,14 +68,21 @@
 #include "module.h"
 #include "rang.hpp"
 #include "rtp/net_udp.h"
+#include "rtp/rtp_types.h"
 #include "utils/misc.h" // format_in_si_units, unit_evaluate
 #include "tv.h"
 #include "utils/net.h"
+#include "utils/thread.h"
 
+#include <atomic>
 #include <cinttypes>
+#include <condition_variable>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 using namespace std;
@@ -133,39 +140,102 @@ struct replica {
     };
     enum type_t type;
     socket_udp *sock;
+    int max_temporal_layer = VIDEO_HDR_MAX_TEMPORAL_LAYERS - 1; ///< higher layers are not forwarded
+};
+
+#define FANOUT_BATCH 64 ///< max packets forwarded at once
+#define RX_PUBLISH_BATCH 16 ///< max received packets before passing them to writer
+#define CACHE_LINE_SIZE 64
+#define SPIN_MAX 4096 ///< max iterations of busy waiting before parking
+
+/**
+ * Adaptive spin-then-park waiting used for receiver-writer handoff. The waiting
+ * side spins for a while and then parks on a condition variable. The other side
+ * touches the mutex only if the peer is parked, so there is no system call per
+ * packet while both sides are busy.
+ *
+ * The spin length is doubled when the condition was met while spinning and
+ * halved when the thread had to park. No spinning is done on single-CPU systems.
+ */
+struct spsc_waiter {
+    alignas(CACHE_LINE_SIZE) std::atomic<bool> parked{false};
+    std::mutex mtx;
+    std::condition_variable cv;
+    const int spin_max = std::thread::hardware_concurrency() > 1 ? SPIN_MAX : 0;
+    int spin = spin_max;
+
+    static void cpu_relax() {
+#if defined __x86_64__ || defined __i386__
+        __builtin_ia32_pause();
+#elif defined __aarch64__
+        asm volatile("yield");
+#endif
+    }
+
+    /// @param timeout_ms max time parked, condition needn't hold on return
+    template<typename T>
+    void wait(T ready, int timeout_ms) {
+        for (int i = 0; i < spin; ++i) {
+            if (ready()) {
+                spin = std::min(2 * spin, spin_max);
+                return;
+            }
+            cpu_relax();
+        }
+        unique_lock<mutex> lk(mtx);
+        parked = true; // seq_cst - pairs with the store + load in notify()
+        cv.wait_for(lk, std::chrono::milliseconds(timeout_ms), ready);
+        parked = false;
+        spin = std::max(spin / 2, spin_max / 64);
+    }
+    /// called after publishing a change, which must be a seq_cst store
+    void notify() {
+        if (parked) {
+            lock_guard<mutex> lk(mtx);
+            cv.notify_one();
+        }
+    }
+};
+
+/**
+ * Sender thread of the sharded writer mode (hd-rum-writer-threads param).
+ * It sends the packets dispatched by the writer to its subset of replicas.
+ */
+struct writer_shard {
+    std::thread thread;
+    std::mutex lock; ///< guards replicas (and their type)
+    vector<replica *> replicas;
+    struct item *pos; ///< next item to be sent
 };
 
 struct hd_rum_translator_state {
     hd_rum_translator_state() {
         module_init_default(&mod);
         mod.cls = MODULE_CLASS_ROOT;
-        pthread_mutex_init(&qempty_mtx, NULL);
-        pthread_mutex_init(&qfull_mtx, NULL);
-        pthread_cond_init(&qempty_cond, NULL);
-        pthread_cond_init(&qfull_cond, NULL);
     }
     ~hd_rum_translator_state() {
-        pthread_mutex_destroy(&qempty_mtx);
-        pthread_mutex_destroy(&qfull_mtx);
-        pthread_cond_destroy(&qempty_cond);
-        pthread_cond_destroy(&qfull_cond);
         module_done(&mod);
     }
     struct module mod;
     struct control_state *control_state = nullptr;
     struct item *queue = nullptr;
-    struct item *qhead = nullptr;
-    struct item *qtail = nullptr;
-    int qempty = 1;
-    int qfull = 0;
-    pthread_mutex_t qempty_mtx;
-    pthread_mutex_t qfull_mtx;
-    pthread_cond_t qempty_cond;
-    pthread_cond_t qfull_cond;
+    // single-producer (receiver), single-consumer (writer) ring, head and tail
+    // are kept in separate cache lines to avoid false sharing
+    alignas(CACHE_LINE_SIZE) std::atomic<struct item *> qhead{nullptr}; ///< first item not yet released by writer
+    alignas(CACHE_LINE_SIZE) std::atomic<struct item *> qtail{nullptr}; ///< first item not yet published by receiver
+    spsc_waiter qempty; ///< writer waiting for data
+    spsc_waiter qfull; ///< receiver waiting for free space
 
     vector<replica *> replicas;
     void *decompress = nullptr;
     struct state_recompress *recompress = nullptr;
+
+    // sharded writer mode
+    vector<unique_ptr<writer_shard>> shards;
+    std::atomic<struct item *> qdispatch{nullptr}; ///< items before this one were passed to shards
+    std::mutex shard_mtx;
+    std::condition_variable shard_cv;
+    bool shards_exit = false;
 };
 
 /*
@@ -231,6 +301,7 @@ struct item {
     struct item *next;
     long size;
     char *buf;
+    std::atomic<int> ref; ///< number of shards that haven't sent the item yet
 };
 
 static struct item *qinit(int qsize)
@@ -245,7 +316,7 @@ static struct item *qinit(int qsize)
 
     printf("initializing packet queue for %d items\n", qsize);
 
-    queue = (struct item *) calloc(qsize, sizeof(struct item));
+    queue = new (nothrow) struct item[qsize]();
     if (queue == NULL) {
         fprintf(stderr, "not enough memory\n");
         exit(2);
@@ -271,7 +342,7 @@ static void qdestroy(struct item *queue)
         free(q->buf);
         q = q->next;
     } while (q != queue);
-    free(queue);
+    delete [] queue;
 }
 
 #define prefix_matches(x,y) strncasecmp(x, y, strlen(y)) == 0
@@ -288,6 +359,14 @@ static struct response *change_replica_type(struct hd_rum_translator_state *s,
     } else if (strcasecmp(data->text, "recompress") == 0) {
         r->type = replica::type_t::RECOMPRESS;
         log_msg(LOG_LEVEL_NOTICE, "Output port %d is now transcoding.\n", index);
+    } else if (prefix_matches(data->text, "max-temporal-layer ")) {
+        int layer = atoi(data->text + strlen("max-temporal-layer "));
+        if (layer < 0 || layer >= VIDEO_HDR_MAX_TEMPORAL_LAYERS) {
+            log_msg(LOG_LEVEL_ERROR, "Wrong temporal layer %d\n", layer);
+            return new_response(RESPONSE_BAD_REQUEST, NULL);
+        }
+        r->max_temporal_layer = layer;
+        log_msg(LOG_LEVEL_NOTICE, "Output port %d now forwards temporal layers up to %d.\n", index, layer);
     } else if (prefix_matches(data->text, "compress ")) {
         if(recompress_port_change_compress(s->recompress, index, data->text + strlen("compress "))){
             log_msg(LOG_LEVEL_NOTICE, "Output port %d compression changed.\n", index);
@@ -351,16 +430,186 @@ static int create_output_port(struct hd_rum_translator_state *s,
         return idx;
 }
 
+ADD_TO_PARAM("hd-rum-writer-threads", "* hd-rum-writer-threads=<n>\n"
+                "  Partition forwarding replicas among <n> sender threads (default 1 - send from the writer).\n");
+
+/**
+ * @returns temporal layer of UltraGrid video packet (see video_payload_hdr_t),
+ * 0 for other packets (including FEC-protected video where the video header
+ * is not present in every packet)
+ */
+static int get_packet_temporal_layer(const char *buf, int size)
+{
+    const unsigned char *pkt = (const unsigned char *) buf;
+    if (size < 12) {
+        return 0;
+    }
+    int pt = pkt[1] & 0x7F;
+    if (pt != PT_VIDEO && pt != PT_ENCRYPT_VIDEO) {
+        return 0;
+    }
+    int hdr_len = 12 + 4 * (pkt[0] & 0xF); // fixed header + CSRCs
+    if ((pkt[0] & 0x10) != 0 && size >= hdr_len + 4) { // header extension
+        hdr_len += 4 + 4 * (pkt[hdr_len + 2] << 8 | pkt[hdr_len + 3]);
+    }
+    if (size < hdr_len + (int) sizeof(video_payload_hdr_t)) {
+        return 0;
+    }
+    uint32_t word6;
+    memcpy(&word6, pkt + hdr_len + 5 * sizeof(uint32_t), sizeof word6);
+    return (ntohl(word6) >> VIDEO_HDR_TEMPORAL_LAYER_SHIFT) & VIDEO_HDR_TEMPORAL_LAYER_MASK;
+}
+
+#ifndef WIN32
+/**
+ * Forwards packets [first, end) to replicas not requiring transcoding.
+ *
+ * Replicas are grouped by the highest forwarded temporal layer, packets of
+ * higher layers are omitted from the batch sent to the group.
+ */
+static void send_to_replicas(const vector<replica *> &replicas, struct item *first, struct item *end)
+{
+    struct iovec bufs[FANOUT_BATCH];
+    struct iovec layer_bufs[FANOUT_BATCH];
+    int layers[FANOUT_BATCH];
+    vector<socket_udp *> dsts[VIDEO_HDR_MAX_TEMPORAL_LAYERS];
+    bool layered = false;
+    for (auto *r : replicas) {
+        if (r->type == replica::type_t::USE_SOCK) {
+            dsts[r->max_temporal_layer].push_back(r->sock);
+            layered = layered || r->max_temporal_layer < VIDEO_HDR_MAX_TEMPORAL_LAYERS - 1;
+        }
+    }
+    while (first != end) {
+        int count = 0;
+        for ( ; first != end && count < FANOUT_BATCH; first = first->next) {
+            bufs[count].iov_base = first->buf;
+            bufs[count].iov_len = first->size;
+            if (layered) {
+                layers[count] = get_packet_temporal_layer(first->buf, first->size);
+            }
+            count++;
+        }
+        for (int l = 0; l < VIDEO_HDR_MAX_TEMPORAL_LAYERS; ++l) {
+            if (dsts[l].empty()) {
+                continue;
+            }
+            if (l == VIDEO_HDR_MAX_TEMPORAL_LAYERS - 1) {
+                udp_send_fanout(dsts[l].data(), dsts[l].size(), bufs, count);
+                continue;
+            }
+            int layer_count = 0;
+            for (int i = 0; i < count; ++i) {
+                if (layers[i] <= l) {
+                    layer_bufs[layer_count++] = bufs[i];
+                }
+            }
+            if (layer_count > 0) {
+                udp_send_fanout(dsts[l].data(), dsts[l].size(), layer_bufs, layer_count);
+            }
+        }
+    }
+}
+#endif
+
+/// marks item sent by a shard, the last one releases it for the reader
+static void shard_item_done(struct hd_rum_translator_state *s, struct item *it)
+{
+    if (--it->ref > 0) {
+        return;
+    }
+    // all shards process items in order, so items are released in order
+    s->qhead = it->next;
+    s->qfull.notify();
+}
+
+static void shard_sender(struct hd_rum_translator_state *s, struct writer_shard *shard)
+{
+    set_thread_name("hd-rum-sender");
+    while (1) {
+        struct item *end;
+        {
+            unique_lock<mutex> lk(s->shard_mtx);
+            s->shard_cv.wait(lk, [s, shard]{ return s->shards_exit || shard->pos != s->qdispatch; });
+            end = s->qdispatch;
+            if (shard->pos == end) {
+                return;
+            }
+        }
+        lock_guard<mutex> lk(shard->lock);
+        send_to_replicas(shard->replicas, shard->pos, end);
+        for ( ; shard->pos != end; shard->pos = shard->pos->next) {
+            shard_item_done(s, shard->pos);
+        }
+    }
+}
+
+/// @returns locks of all shards (so that replicas can be modified)
+static vector<unique_lock<mutex>> lock_shards(struct hd_rum_translator_state *s)
+{
+    vector<unique_lock<mutex>> locks;
+    for (auto &sh : s->shards) {
+        locks.emplace_back(sh->lock);
+    }
+    return locks;
+}
+
+/// assigns replicas to shards in round-robin manner, shards must be locked
+static void distribute_replicas(struct hd_rum_translator_state *s)
+{
+    for (auto &sh : s->shards) {
+        sh->replicas.clear();
+    }
+    for (unsigned int i = 0; i < s->replicas.size(); ++i) {
+        s->shards[i % s->shards.size()]->replicas.push_back(s->replicas[i]);
+    }
+}
+
+static void start_shards(struct hd_rum_translator_state *s, int count)
+{
+    s->qdispatch = s->qhead.load();
+    for (int i = 0; i < count; ++i) {
+        s->shards.emplace_back(new writer_shard());
+        s->shards.back()->pos = s->qhead;
+    }
+    distribute_replicas(s);
+    for (auto &sh : s->shards) {
+        sh->thread = std::thread(shard_sender, s, sh.get());
+    }
+    log_msg(LOG_LEVEL_NOTICE, "%sUsing %d sender threads.\n", MOD_NAME, count);
+}
+
+static void stop_shards(struct hd_rum_translator_state *s)
+{
+    {
+        lock_guard<mutex> lk(s->shard_mtx);
+        s->shards_exit = true;
+    }
+    s->shard_cv.notify_all();
+    for (auto &sh : s->shards) {
+        sh->thread.join();
+    }
+    s->shards.clear();
+}
+
 static void *writer(void *arg)
 {
     struct hd_rum_translator_state *s =
         (struct hd_rum_translator_state *) arg;
 
+#ifndef WIN32
+    if (get_commandline_param("hd-rum-writer-threads") != nullptr
+            && atoi(get_commandline_param("hd-rum-writer-threads")) > 1) {
+        start_shards(s, atoi(get_commandline_param("hd-rum-writer-threads")));
+    }
+#endif
+
     while (1) {
         // first check messages
         for (unsigned int i = 0; i < s->replicas.size(); i++) {
             struct message *msg;
             while ((msg = check_message(&s->replicas[i]->mod))) {
+                auto locks = lock_shards(s);
                 struct response *r = change_replica_type(s, &s->replicas[i]->mod, msg, i);
                 free_message(msg, r);
             }
@@ -368,6 +617,7 @@ static void *writer(void *arg)
 
         struct msg_universal *msg;
         while ((msg = (struct msg_universal *) check_message(&s->mod))) {
+            auto locks = lock_shards(s);
             struct response *r = NULL;
             if (strncasecmp(msg->text, "delete-port ", strlen("delete-port ")) == 0) {
                 char *port_spec = msg->text + strlen("delete-port ");
@@ -448,42 +698,101 @@ static void *writer(void *arg)
                 r = new_response(RESPONSE_BAD_REQUEST, NULL);
             }
 
+            if (!s->shards.empty()) {
+                distribute_replicas(s);
+            }
             free_message((struct message *) msg, r ? r : new_response(RESPONSE_OK, NULL));
         }
 
+        // sharded mode - pass the packets to sender threads
+        int dispatched = 0;
+        while (!s->shards.empty() && s->qdispatch != s->qtail) {
+            struct item *it = s->qdispatch;
+            if (it->size == 0) { // poisoned pill
+                stop_shards(s);
+                return NULL;
+            }
+            if (recompress_get_num_active_ports(s->recompress) > 0) {
+                ssize_t ret = hd_rum_decompress_write(s->decompress, it->buf, it->size);
+                if (ret < 0) {
+                    perror("hd_rum_decompress_write");
+                }
+            }
+            it->ref = s->shards.size();
+            s->qdispatch = it->next;
+            if (++dispatched % 16 == 0) {
+                s->shard_cv.notify_all();
+            }
+        }
+        if (dispatched > 0) {
+            lock_guard<mutex> lk(s->shard_mtx); // prevent lost wakeup
+            s->shard_cv.notify_all();
+        }
+
+#ifndef WIN32
+        // then process incoming packets in batches
+        while (s->shards.empty() && s->qhead != s->qtail) {
+            struct item *end = s->qhead;
+            bool poisoned = false;
+            for (int count = 0; end != s->qtail && count < FANOUT_BATCH; ++count) {
+                if (end->size == 0) { // poisoned pill
+                    poisoned = true;
+                    break;
+                }
+                // pass it for transcoding if needed
+                if (recompress_get_num_active_ports(s->recompress) > 0) {
+                    ssize_t ret = hd_rum_decompress_write(s->decompress, end->buf, end->size);
+                    if (ret < 0) {
+                        perror("hd_rum_decompress_write");
+                    }
+                }
+                end = end->next;
+            }
+
+            // distribute it to output ports that don't need transcoding
+            send_to_replicas(s->replicas, s->qhead, end);
+            s->qhead = end;
+            s->qfull.notify();
+
+            if (poisoned) {
+                return NULL;
+            }
+        }
+#else
         // then process incoming packets
-        while (s->qhead != s->qtail) {
-            if(s->qhead->size == 0) { // poisoned pill
+        while (s->shards.empty() && s->qhead != s->qtail) {
+            struct item *head = s->qhead;
+            if(head->size == 0) { // poisoned pill
                 return NULL;
             }
 
             // pass it for transcoding if needed
             if (recompress_get_num_active_ports(s->recompress) > 0) {
-                ssize_t ret = hd_rum_decompress_write(s->decompress, s->qhead->buf, s->qhead->size);
+                ssize_t ret = hd_rum_decompress_write(s->decompress, head->buf, head->size);
                 if (ret < 0) {
                     perror("hd_rum_decompress_write");
                 }
             }
 
             // distribute it to output ports that don't need transcoding
-#ifdef WIN32
             // send it asynchronously in MSW (performance optimalization)
             SleepEx(0, TRUE); // allow system to call our completion routines in APC
+            int layer = get_packet_temporal_layer(head->buf, head->size);
             int ref = 0;
             for (unsigned int i = 0; i < s->replicas.size(); i++) {
-                if(s->replicas[i]->type == replica::type_t::USE_SOCK) {
+                if(s->replicas[i]->type == replica::type_t::USE_SOCK && layer <= s->replicas[i]->max_temporal_layer) {
                     ref++;
                 }
             }
-            struct wsa_aux_storage *aux = (struct wsa_aux_storage *)(void *) ((char *) s->qhead->buf + OFFSET);
+            struct wsa_aux_storage *aux = (struct wsa_aux_storage *)(void *) ((char *) head->buf + OFFSET);
             memset(aux, 0, sizeof *aux);
             aux->overlapped = (WSAOVERLAPPED *) calloc(ref, sizeof(WSAOVERLAPPED));
             aux->ref = ref;
             int overlapped_idx = 0;
             for (unsigned int i = 0; i < s->replicas.size(); i++) {
-                if(s->replicas[i]->type == replica::type_t::USE_SOCK) {
-                    aux->overlapped[overlapped_idx].hEvent = s->qhead->buf;
-                    ssize_t ret = udp_send_wsa_async(s->replicas[i]->sock, s->qhead->buf, s->qhead->size, wsa_deleter, &aux->overlapped[overlapped_idx]);
+                if(s->replicas[i]->type == replica::type_t::USE_SOCK && layer <= s->replicas[i]->max_temporal_layer) {
+                    aux->overlapped[overlapped_idx].hEvent = head->buf;
+                    ssize_t ret = udp_send_wsa_async(s->replicas[i]->sock, head->buf, head->size, wsa_deleter, &aux->overlapped[overlapped_idx]);
                     if (ret < 0) {
                         perror("Hd-rum-translator send");
                     }
@@ -491,30 +800,14 @@ static void *writer(void *arg)
                 }
             }
             // reallocate the buffer since the last one will be freeed automaticaly
-            s->qhead->buf = (char *) malloc(SIZE);
-#else
-            for (unsigned int i = 0; i < s->replicas.size(); i++) {
-                if(s->replicas[i]->type == replica::type_t::USE_SOCK) {
-                    ssize_t ret = udp_send(s->replicas[i]->sock, s->qhead->buf, s->qhead->size);
-                    if (ret < 0) {
-                        perror("Hd-rum-translator send");
-                    }
-                }
-            }
-#endif
-            s->qhead = s->qhead->next;
-
-            pthread_mutex_lock(&s->qfull_mtx);
-            s->qfull = 0;
-            pthread_cond_signal(&s->qfull_cond);
-            pthread_mutex_unlock(&s->qfull_mtx);
+            head->buf = (char *) malloc(SIZE);
+            s->qhead = head->next;
+            s->qfull.notify();
         }
+#endif
 
-        pthread_mutex_lock(&s->qempty_mtx);
-        if (s->qempty)
-            pthread_cond_wait(&s->qempty_cond, &s->qempty_mtx);
-        s->qempty = 1;
-        pthread_mutex_unlock(&s->qempty_mtx);
+        // wake up periodically to process messages even if idle
+        s->qempty.wait([s]{ return s->qtail != (s->shards.empty() ? s->qhead : s->qdispatch); }, 100);
     }
 
     return NULL;
@@ -537,6 +830,7 @@ static void usage(const char *progname) {
         cout << "\tand " << s::underline<< "hostX_options" << s::reset << " may be:\n" <<
                 s::bold << "\t\t-P [<rx_port>:]<tx_port>" << s::reset << " - TX port to be used (optionally also RX)\n" <<
                 s::bold << "\t\t-c <compression>" << s::reset << " - compression\n" <<
+                s::bold << "\t\t-t <max_layer>" << s::reset << " - forward only temporal layers up to <max_layer> (0 - base layer only, see libavcodec temporal_layers)\n" <<
                 "\t\tFollowing options will be used only if " << s::underline << "'-c'" << s::reset << " parameter is set:\n" <<
                 s::bold << "\t\t-m <mtu>" << s::reset << " - MTU size\n" <<
                 s::bold << "\t\t-l <limiting_bitrate>" << s::reset << " - bitrate to be shaped to\n" <<
@@ -557,6 +851,7 @@ struct host_opts {
     char *fec;
     int64_t bitrate;
     int force_ip_version;
+    int max_temporal_layer;
 };
 
 struct cmdline_parameters {
@@ -613,7 +908,7 @@ static int parse_fmt(int argc, char **argv, struct cmdline_parameters *parsed)
         } else if(strcmp(argv[start_index], "--verbose") == 0) {
             parsed->verbose = true;
         } else if(strcmp(argv[start_index], "--param") == 0 && start_index < argc - 1) {
-            // already handled in common_preinit()
+            start_index++; // already handled in common_preinit()
         } else {
             LOG(LOG_LEVEL_FATAL) << MOD_NAME << "Unknown global parameter: " << argv[start_index] << "\n\n";
             usage(argv[0]);
@@ -660,6 +955,7 @@ static int parse_fmt(int argc, char **argv, struct cmdline_parameters *parsed)
     for(int i = 0; i < parsed->host_count; ++i) {
         parsed->hosts[i].bitrate = RATE_UNLIMITED;
         parsed->hosts[i].mtu = 1500;
+        parsed->hosts[i].max_temporal_layer = VIDEO_HDR_MAX_TEMPORAL_LAYERS - 1;
     }
 
     int host_idx = 0;
@@ -683,6 +979,13 @@ static int parse_fmt(int argc, char **argv, struct cmdline_parameters *parsed)
                 case 'f':
                     parsed->hosts[host_idx].fec = argv[i + 1];
                     break;
+                case 't':
+                    parsed->hosts[host_idx].max_temporal_layer = atoi(argv[i + 1]);
+                    if (parsed->hosts[host_idx].max_temporal_layer < 0 || parsed->hosts[host_idx].max_temporal_layer >= VIDEO_HDR_MAX_TEMPORAL_LAYERS) {
+                        LOG(LOG_LEVEL_FATAL) << MOD_NAME << "Error: wrong temporal layer - " << argv[i + 1] << "\n";
+                        exit(EXIT_FAIL_USAGE);
+                    }
+                    break;
                 case 'l':
                     if (strcmp(argv[i + 1], "unlimited") == 0) {
                         parsed->hosts[host_idx].bitrate = RATE_UNLIMITED;
@@ -840,7 +1143,7 @@ int main(int argc, char **argv)
     }
 
     state.qhead = state.qtail = state.queue = qinit(qsize);
-    if (!state.qhead) {
+    if (!state.queue) {
         EXIT(EXIT_FAILURE);
     }
 
@@ -893,6 +1196,7 @@ int main(int argc, char **argv)
         if(idx < 0) {
             EXIT(EXIT_FAILURE);
         }
+        state.replicas[idx]->max_temporal_layer = h.max_temporal_layer;
     }
 
     if (pthread_create(&thread, NULL, writer, (void *) &state)) {
@@ -908,15 +1212,29 @@ int main(int argc, char **argv)
 
     std::vector<Conf_participant> participants;
 
+    // received items not yet published to the writer are [state.qtail, tail)
+    struct item *tail = state.qtail;
+    int unpublished = 0;
+
     /* main loop */
     while (!should_exit) {
-        while (state.qtail->next != state.qhead && !should_exit) {
-            struct timeval timeout = { 1, 0 };
+        while (tail->next != state.qhead && !should_exit) {
+            struct timeval timeout = { 0, 0 };
 
             struct sockaddr_storage sin = {};
             socklen_t addrlen = sizeof(sin);
-            state.qtail->size = udp_recvfrom_timeout(sock_in, state.qtail->buf, SIZE, &timeout, (sockaddr *) &sin, &addrlen);
-            if(state.qtail->size <= 0)
+            tail->size = udp_recvfrom_timeout(sock_in, tail->buf, SIZE, &timeout, (sockaddr *) &sin, &addrlen);
+            if (tail->size <= 0 && unpublished > 0) {
+                // socket drained - publish what we have before blocking
+                state.qtail = tail;
+                state.qempty.notify();
+                unpublished = 0;
+            }
+            if (tail->size <= 0) {
+                timeout = { 1, 0 };
+                tail->size = udp_recvfrom_timeout(sock_in, tail->buf, SIZE, &timeout, (sockaddr *) &sin, &addrlen);
+            }
+            if(tail->size <= 0)
                 break;
 
             struct timeval t;
@@ -982,14 +1300,14 @@ int main(int argc, char **argv)
                     }
             }
 
-            received_data += state.qtail->size;
-
-            state.qtail = state.qtail->next;
+            received_data += tail->size;
 
-            pthread_mutex_lock(&state.qempty_mtx);
-            state.qempty = 0;
-            pthread_cond_signal(&state.qempty_cond);
-            pthread_mutex_unlock(&state.qempty_mtx);
+            tail = tail->next;
+            if (++unpublished == RX_PUBLISH_BATCH) {
+                state.qtail = tail;
+                state.qempty.notify();
+                unpublished = 0;
+            }
 
             double seconds = tv_diff(t, t0);
             if (seconds > 5.0) {
@@ -1001,29 +1319,28 @@ int main(int argc, char **argv)
             }
         }
 
-        if (state.qtail->size <= 0)
+        if (unpublished > 0) {
+            state.qtail = tail;
+            state.qempty.notify();
+            unpublished = 0;
+        }
+
+        if (tail->size <= 0)
             continue;
 
-        pthread_mutex_lock(&state.qfull_mtx);
-        if (state.qfull)
-            pthread_cond_wait(&state.qfull_cond, &state.qfull_mtx);
-        state.qfull = 1;
-        pthread_mutex_unlock(&state.qfull_mtx);
+        // queue full
+        state.qfull.wait([&]{ return tail->next != state.qhead; }, 1000);
     }
 
-    if (state.qtail->size < 0 && !should_exit) {
+    if (tail->size < 0 && !should_exit) {
         printf("read: %s\n", strerror(err));
         EXIT(2);
     }
 
     // pass poisoned pill to the worker
-    state.qtail->size = 0;
-    state.qtail = state.qtail->next;
-
-    pthread_mutex_lock(&state.qempty_mtx);
-    state.qempty = 0;
-    pthread_cond_signal(&state.qempty_cond);
-    pthread_mutex_unlock(&state.qempty_mtx);
+    tail->size = 0;
+    state.qtail = tail->next;
+    state.qempty.notify();
 
     pthread_join(thread, NULL);
 
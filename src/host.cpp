@@ -61,6 +61,7 @@
 #include "rang.hpp"
 #include "utils/color_out.h" // unit_evaluate
 #include "utils/misc.h" // unit_evaluate
+#include "utils/probe_cache.hpp"
 #include "video_capture.h"
 #include "video_compress.h"
 #include "video_display.h"
@@ -537,21 +538,23 @@ void print_capabilities(struct module *root, bool use_vidcap)
                 get_libraries_for_class(LIBRARY_CLASS_VIDEO_DISPLAY, VIDEO_DISPLAY_ABI_VERSION);
         for (auto const & it : display_capabilities) {
                 auto vdi = static_cast<const struct video_display_info *>(it.second);
-                int count = 0;
-                struct device_info *devices;
-                void (*deleter)(void *) = nullptr;
-                vdi->probe(&devices, &count, &deleter);
-                cout << "[cap][display] " << it.first << std::endl;
-                for (int i = 0; i < count; ++i) {
-                        cout << "[capability][device] {"
-                                "\"purpose\":\"video_disp\", "
-                                "\"module\":" << std::quoted(it.first) << ", "
-                                "\"device\":" << std::quoted(devices[i].dev) << ", "
-                                "\"name\":" << std::quoted(devices[i].name) << ", "
-                                "\"extra\": {" << devices[i].extra << "}, "
-                                "\"repeatable\":\"" << devices[i].repeatable << "\"}\n";
-                }
-                deleter ? deleter(devices) : free(devices);
+                cout << probe_cache_get("video_disp." + it.first, [&](ostream &out) {
+                        int count = 0;
+                        struct device_info *devices;
+                        void (*deleter)(void *) = nullptr;
+                        vdi->probe(&devices, &count, &deleter);
+                        out << "[cap][display] " << it.first << std::endl;
+                        for (int i = 0; i < count; ++i) {
+                                out << "[capability][device] {"
+                                        "\"purpose\":\"video_disp\", "
+                                        "\"module\":" << std::quoted(it.first) << ", "
+                                        "\"device\":" << std::quoted(devices[i].dev) << ", "
+                                        "\"name\":" << std::quoted(devices[i].name) << ", "
+                                        "\"extra\": {" << devices[i].extra << "}, "
+                                        "\"repeatable\":\"" << devices[i].repeatable << "\"}\n";
+                        }
+                        deleter ? deleter(devices) : free(devices);
+                });
         }
 
         cout << "[cap] Audio capturers:" << endl;
@@ -559,19 +562,21 @@ void print_capabilities(struct module *root, bool use_vidcap)
                 get_libraries_for_class(LIBRARY_CLASS_AUDIO_CAPTURE, AUDIO_CAPTURE_ABI_VERSION);
         for (auto const & it : audio_cap_capabilities) {
                 auto aci = static_cast<const struct audio_capture_info *>(it.second);
-                int count = 0;
-                struct device_info *devices;
-                aci->probe(&devices, &count);
-                cout << "[cap][audio_cap] " << it.first << std::endl;
-                for (int i = 0; i < count; ++i) {
-                        cout << "[capability][device] {"
-                                "\"purpose\":\"audio_cap\", "
-                                "\"module\":" << std::quoted(it.first) << ", "
-                                "\"device\":" << std::quoted(devices[i].dev) << ", "
-                                "\"extra\": {" << devices[i].extra << "}, "
-                                "\"name\":" << std::quoted(devices[i].name) << "}\n";
-                }
-                free(devices);
+                cout << probe_cache_get("audio_cap." + it.first, [&](ostream &out) {
+                        int count = 0;
+                        struct device_info *devices;
+                        aci->probe(&devices, &count);
+                        out << "[cap][audio_cap] " << it.first << std::endl;
+                        for (int i = 0; i < count; ++i) {
+                                out << "[capability][device] {"
+                                        "\"purpose\":\"audio_cap\", "
+                                        "\"module\":" << std::quoted(it.first) << ", "
+                                        "\"device\":" << std::quoted(devices[i].dev) << ", "
+                                        "\"extra\": {" << devices[i].extra << "}, "
+                                        "\"name\":" << std::quoted(devices[i].name) << "}\n";
+                        }
+                        free(devices);
+                });
         }
 
         cout << "[cap] Audio playback:" << endl;
@@ -579,19 +584,21 @@ void print_capabilities(struct module *root, bool use_vidcap)
                 get_libraries_for_class(LIBRARY_CLASS_AUDIO_PLAYBACK, AUDIO_PLAYBACK_ABI_VERSION);
         for (auto const & it : audio_play_capabilities) {
                 auto api = static_cast<const struct audio_playback_info *>(it.second);
-                int count = 0;
-                struct device_info *devices;
-                api->probe(&devices, &count);
-                cout << "[cap][audio_play] " << it.first << std::endl;
-                for (int i = 0; i < count; ++i) {
-                        cout << "[capability][device] {"
-                                "\"purpose\":\"audio_play\", "
-                                "\"module\":" << std::quoted(it.first) << ", "
-                                "\"device\":" << std::quoted(devices[i].dev) << ", "
-                                "\"extra\": {" << devices[i].extra << "}, "
-                                "\"name\":" << std::quoted(devices[i].name) << "}\n";
-                }
-                free(devices);
+                cout << probe_cache_get("audio_play." + it.first, [&](ostream &out) {
+                        int count = 0;
+                        struct device_info *devices;
+                        api->probe(&devices, &count);
+                        out << "[cap][audio_play] " << it.first << std::endl;
+                        for (int i = 0; i < count; ++i) {
+                                out << "[capability][device] {"
+                                        "\"purpose\":\"audio_play\", "
+                                        "\"module\":" << std::quoted(it.first) << ", "
+                                        "\"device\":" << std::quoted(devices[i].dev) << ", "
+                                        "\"extra\": {" << devices[i].extra << "}, "
+                                        "\"name\":" << std::quoted(devices[i].name) << "}\n";
+                        }
+                        free(devices);
+                });
         }
 
         // audio compressions
@@ -602,6 +609,8 @@ void print_capabilities(struct module *root, bool use_vidcap)
 
         cout << "[capability][end]" << endl;
 
+        probe_cache_refresh_expired();
+
         cout.flags(flags);
         cout.precision(precision);
 }
@@ -853,6 +862,8 @@ ADD_TO_PARAM("audio-cap-frames", "* audio-cap-frames=<f>\n"
                 "  Sets number of audio frames captured at once (CoreAudio)\n");
 ADD_TO_PARAM("audio-disable-adaptive-buffer", "* audio-disable-adaptive-buffer\n"
                 "  Disables audio adaptive playback buffer (CoreAudio/JACK)\n");
+ADD_TO_PARAM("audio-playback-pull", "* audio-playback-pull\n"
+                "  Device callback pulls the audio directly from a lock-free buffer kept at network jitter plus one period (JACK/Portaudio)\n");
 ADD_TO_PARAM("color", "* color=CT\n"
                 "  [experimental] Color space to use, C - colorimetry: 0 - undefined, 1 - BT.709, 2 - BT.2020/2100, 3 - P3; T - transfer fn: 0 - undefined, 1 - 709, 2 - HLG; 3 - PQ (signalized to GLFW on mac, NDI receiver)\n");
 #ifdef DEBUG
@@ -48,6 +48,8 @@
 #include "config_win32.h"
 #endif // defined HAVE_CONFIG_H
 
+#include <stdint.h>
+
 #include "hwaccel_vaapi.h"
 
 #include "debug.h"
@@ -176,7 +178,6 @@ int vaapi_init(struct AVCodecContext *s,
                 struct hw_accel_state *state,
                 codec_t out_codec)
 {
-        (void)(out_codec);
         struct vaapi_ctx *ctx = calloc(1, sizeof(struct vaapi_ctx));
         if(!ctx){
                 return -1;
@@ -220,7 +221,7 @@ int vaapi_init(struct AVCodecContext *s,
                 goto fail;
         }
         state->type = HWACCEL_VAAPI;
-        state->copy = true;
+        state->copy = out_codec != HW_VAAPI;
         state->ctx = ctx;
         state->uninit = vaapi_uninit;
 
@@ -261,3 +262,34 @@ fail:
         free(ctx);
         return ret;
 }
+
+hw_vaapi_frame *hw_vaapi_frame_from_avframe(hw_vaapi_frame *dst, const AVFrame *src){
+        dst->av_frame = av_frame_clone(src);
+        return dst;
+}
+
+void hw_vaapi_recycle_callback(struct video_frame *frame){
+        for(unsigned i = 0; i < frame->tile_count; i++){
+                hw_vaapi_frame *va_frame = (hw_vaapi_frame *)(void *) frame->tiles[i].data;
+                av_frame_free(&va_frame->av_frame);
+        }
+
+        frame->callbacks.recycle = NULL;
+}
+
+void hw_vaapi_copy_callback(struct video_frame *frame){
+        for(unsigned i = 0; i < frame->tile_count; i++){
+                hw_vaapi_frame *va_frame = (hw_vaapi_frame *)(void *) frame->tiles[i].data;
+                va_frame->av_frame = av_frame_clone(va_frame->av_frame);
+        }
+}
+
+VADisplay hw_vaapi_frame_get_display(const hw_vaapi_frame *frame){
+        AVHWFramesContext *frame_ctx = (AVHWFramesContext *)(void *) frame->av_frame->hw_frames_ctx->data;
+        AVVAAPIDeviceContext *va_ctx = (AVVAAPIDeviceContext *) frame_ctx->device_ctx->hwctx;
+        return va_ctx->display;
+}
+
+VASurfaceID hw_vaapi_frame_get_surface(const hw_vaapi_frame *frame){
+        return (VASurfaceID) (uintptr_t) frame->av_frame->data[3];
+}
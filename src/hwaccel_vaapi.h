@@ -76,6 +76,40 @@ struct vaapi_ctx{
 #endif
 };
 
+/**
+ * hw_vaapi_frame represents a VAAPI hw surface passed to the display without
+ * download (HW_VAAPI codec). Holds a reference to the decoded AVFrame, which
+ * keeps the surface (data[3]) and its device context alive.
+ */
+typedef struct hw_vaapi_frame{
+        AVFrame *av_frame;
+} hw_vaapi_frame;
+
+/**
+ * @brief Fills dst with a new reference to src
+ */
+hw_vaapi_frame *hw_vaapi_frame_from_avframe(hw_vaapi_frame *dst, const AVFrame *src);
+
+/**
+ * @brief Releases references held by all tiles of frame
+ */
+void hw_vaapi_recycle_callback(struct video_frame *frame);
+
+/**
+ * @brief Makes new references for all tiles of frame
+ */
+void hw_vaapi_copy_callback(struct video_frame *frame);
+
+/**
+ * @brief Returns VADisplay the surface was decoded with
+ */
+VADisplay hw_vaapi_frame_get_display(const hw_vaapi_frame *frame);
+
+/**
+ * @brief Returns VASurfaceID of the frame
+ */
+VASurfaceID hw_vaapi_frame_get_surface(const hw_vaapi_frame *frame);
+
 void vaapi_uninit(struct hw_accel_state *s);
 int vaapi_create_context(struct vaapi_ctx *ctx, AVCodecContext *codec_ctx);
 int vaapi_init(struct AVCodecContext *s,
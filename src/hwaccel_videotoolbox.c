@@ -45,6 +45,7 @@
 #include "config_win32.h"
 
 #include "debug.h"
+#include "hwaccel_libav_common.h"
 #include "hwaccel_videotoolbox.h"
 
 #include <libavutil/pixdesc.h>
@@ -38,13 +38,26 @@
 #ifndef HWACCEL_VIDEOTOOLBOX_H_FB662D24_EA6D_4723_9F06_F9EABB79D0A6
 #define HWACCEL_VIDEOTOOLBOX_H_FB662D24_EA6D_4723_9F06_F9EABB79D0A6
 
-#include "hwaccel_libav_common.h"
 #include "types.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+struct AVCodecContext;
+struct hw_accel_state;
+struct __CVBuffer;
+
+/**
+ * hw_vtb_frame is a tile of HW_VTB frame - an IOSurface-backed pixel buffer
+ * passed from capture to the VideoToolbox encoder without a CPU copy. The
+ * frame holds a reference (CFRetain) to the buffer, released by its dispose
+ * callback.
+ */
+typedef struct hw_vtb_frame {
+        struct __CVBuffer *pixbuf; ///< CVPixelBufferRef
+} hw_vtb_frame;
+
 int videotoolbox_init(struct AVCodecContext *s, struct hw_accel_state *state, codec_t out_codec);
 
 #ifdef __cplusplus
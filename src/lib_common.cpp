@@ -45,16 +45,24 @@
 #include <dlfcn.h>
 #include <glob.h>
 #include <libgen.h>
+#include <sys/stat.h>
 #endif
 
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
 #include <map>
+#include <set>
+#include <sstream>
+#include <vector>
 
 #include "debug.h"
 #include "host.h"
 
 #include "lib_common.h"
 #include "rang.hpp"
+#include "utils/fs.h"
 
 using namespace std;
 
@@ -171,6 +179,182 @@ static int running_from_path(char * uv_argv[]) {
 }
 #endif
 
+/*
+ * Plugin manifest
+ *
+ * The first start (or a start after the set of plugins changed) opens all
+ * plugins and records which modules each of them registers to a manifest in
+ * the user's cache directory. Subsequent starts only read the manifest and
+ * dlopen() a plugin once one of its modules is requested (load_library()) or a
+ * whole class is enumerated (help, decompress autoselection). Plugins are
+ * keyed by size and mtime so that a rebuilt or reinstalled plugin invalidates
+ * the manifest.
+ */
+#define MANIFEST_VERSION "UltraGrid plugin manifest 1"
+
+ADD_TO_PARAM("plugins-eager", "* plugins-eager\n"
+                "  Open all plugins on startup (do not use the cached plugin manifest)\n");
+
+struct plugin_file {
+        string path;
+        long long size;
+        long long mtime;
+        vector<pair<int, string>> modules; ///< (class, name) registered by the plugin
+        string error;                     ///< dlopen() error, empty if OK
+        bool opened;
+        bool in_manifest;
+};
+
+static plugin_file *plugin_being_opened; ///< set while dlopen() runs the constructors
+
+#ifdef BUILD_LIBRARIES
+static list<void *> *opened_libs;
+static vector<plugin_file> plugin_files;
+
+static string get_manifest_path(const string &lib_pattern) {
+        const char *dir = get_cache_dir();
+        if (dir == nullptr) {
+                return {};
+        }
+        string key = lib_pattern;
+        for (auto &c : key) {
+                if (c == '/' || c == '*') {
+                        c = '_';
+                }
+        }
+        return string(dir) + "plugins" + key + ".manifest";
+}
+
+static bool stat_plugin(const char *path, plugin_file *out) {
+        struct stat st;
+        if (stat(path, &st) != 0) {
+                return false;
+        }
+        *out = { path, (long long) st.st_size, (long long) st.st_mtime, {}, {}, false, false };
+        return true;
+}
+
+/// @returns true if manifest exists and describes exactly the current files
+static bool read_manifest(const string &manifest_path, vector<plugin_file> &files) {
+        ifstream in(manifest_path);
+        string line;
+        if (!getline(in, line) || line != MANIFEST_VERSION) {
+                return false;
+        }
+        size_t idx = SIZE_MAX;
+        while (getline(in, line)) {
+                istringstream iss(line);
+                string type;
+                iss >> type;
+                if (type == "F") {
+                        long long size = 0;
+                        long long mtime = 0;
+                        string path;
+                        iss >> size >> mtime >> ws;
+                        getline(iss, path);
+                        for (idx = 0; idx < files.size() && files[idx].path != path; ++idx)
+                                ;
+                        if (idx == files.size() || files[idx].size != size || files[idx].mtime != mtime) {
+                                return false; // removed or changed plugin
+                        }
+                        files[idx].in_manifest = true;
+                } else if (idx >= files.size()) {
+                        return false;
+                } else if (type == "M") {
+                        int cls = 0;
+                        string name;
+                        iss >> cls >> name;
+                        files[idx].modules.emplace_back(cls, name);
+                } else if (type == "E") {
+                        getline(iss >> ws, files[idx].error);
+                } else {
+                        return false;
+                }
+        }
+        return all_of(files.begin(), files.end(), [](const plugin_file &f) { return f.in_manifest; }); // new plugin?
+}
+
+static void write_manifest(const string &manifest_path, const vector<plugin_file> &files) {
+        string tmp_path = manifest_path + ".tmp";
+        {
+                ofstream out(tmp_path);
+                out << MANIFEST_VERSION << "\n";
+                for (auto const &f : files) {
+                        out << "F " << f.size << " " << f.mtime << " " << f.path << "\n";
+                        for (auto const &m : f.modules) {
+                                out << "M " << m.first << " " << m.second << "\n";
+                        }
+                        if (!f.error.empty()) {
+                                string err = f.error;
+                                replace(err.begin(), err.end(), '\n', ' ');
+                                out << "E " << err << "\n";
+                        }
+                }
+                if (!out) {
+                        remove(tmp_path.c_str());
+                        return;
+                }
+        }
+        if (rename(tmp_path.c_str(), manifest_path.c_str()) != 0) {
+                remove(tmp_path.c_str());
+        }
+}
+
+/**
+ * @param flags RTLD_NOW for the first (recording) open, RTLD_LAZY for plugins
+ *              known from the manifest to resolve completely
+ */
+static bool open_plugin(plugin_file &f, int flags) {
+        if (f.opened) {
+                return true;
+        }
+        f.opened = true;
+        plugin_being_opened = &f;
+        void *handle = dlopen(f.path.c_str(), flags | RTLD_GLOBAL);
+        plugin_being_opened = nullptr;
+        if (!handle) {
+                char *error = dlerror();
+                verbose_msg("Library %s opening warning: %s \n", f.path.c_str(), error);
+                char *tmp = strdup(f.path.c_str());
+                char *filename = basename(tmp);
+                if (filename && error) {
+                        lib_errors.emplace(filename, error);
+                        f.error = error;
+                }
+                free(tmp);
+                return false;
+        }
+        opened_libs->push_back(handle);
+        return true;
+}
+
+/**
+ * Opens plugins from the manifest that register module name (any name if
+ * nullptr) of class cls (any class if LIBRARY_CLASS_UNDEFINED).
+ */
+static void open_plugins_for(enum library_class cls, const char *name) {
+        for (auto &f : plugin_files) {
+                if (f.opened || !f.error.empty()) {
+                        continue;
+                }
+                for (auto const &m : f.modules) {
+                        if ((cls == LIBRARY_CLASS_UNDEFINED || m.first == cls)
+                                        && (name == nullptr || strcasecmp(m.second.c_str(), name) == 0)) {
+                                if (!open_plugin(f, RTLD_LAZY)) {
+                                        // probably depends on another plugin - resolve the old way
+                                        LOG(LOG_LEVEL_VERBOSE) << "Lazy load of " << f.path << " failed, opening all plugins\n";
+                                        for (auto &g : plugin_files) {
+                                                open_plugin(g, RTLD_NOW);
+                                        }
+                                        return;
+                                }
+                                break;
+                        }
+                }
+        }
+}
+#endif // defined BUILD_LIBRARIES
+
 void open_all(const char *pattern, list<void *> &libs) {
 #ifdef BUILD_LIBRARIES
         char path[512];
@@ -188,22 +372,39 @@ void open_all(const char *pattern, list<void *> &libs) {
 
         glob(path, 0, NULL, &glob_buf);
 
+        opened_libs = &libs;
+        plugin_files.clear();
         for(unsigned int i = 0; i < glob_buf.gl_pathc; ++i) {
-                void *handle = dlopen(glob_buf.gl_pathv[i], RTLD_NOW|RTLD_GLOBAL);
-                if (!handle) {
-                        char *error = dlerror();
-                        verbose_msg("Library %s opening warning: %s \n", glob_buf.gl_pathv[i],
-                                        error);
-                        char *filename = basename(glob_buf.gl_pathv[i]);
-                        if (filename && error) {
-                                lib_errors.emplace(filename, error);
+                plugin_file f;
+                if (stat_plugin(glob_buf.gl_pathv[i], &f)) {
+                        plugin_files.push_back(move(f));
+                }
+        }
+        globfree(&glob_buf);
+
+        char *real_pattern = realpath(dirname(path), nullptr);
+        string manifest_path = real_pattern != nullptr ? get_manifest_path(real_pattern) : string();
+        free(real_pattern);
+        if (!manifest_path.empty() && get_commandline_param("plugins-eager") == nullptr
+                        && read_manifest(manifest_path, plugin_files)) {
+                for (auto const &f : plugin_files) {
+                        if (!f.error.empty()) {
+                                char *tmp = strdup(f.path.c_str());
+                                lib_errors.emplace(basename(tmp), f.error);
+                                free(tmp);
                         }
-                        continue;
                 }
-                libs.push_back(handle);
+                return; // plugins will be opened on demand
         }
 
-        globfree(&glob_buf);
+        for (auto &f : plugin_files) {
+                f.modules.clear();
+                f.error.clear();
+                open_plugin(f, RTLD_NOW);
+        }
+        if (!manifest_path.empty()) {
+                write_manifest(manifest_path, plugin_files);
+        }
 #else
         UNUSED(libs);
         UNUSED(pattern);
@@ -252,10 +453,16 @@ void register_library(const char *name, const void *data, enum library_class cls
                 LOG(LOG_LEVEL_ERROR) << "Module \"" << name << "\" (class " << cls << ") multiple initialization!\n";
         }
         map[name] = {data, abi_version, static_cast<bool>(hidden)};
+        if (plugin_being_opened != nullptr) {
+                plugin_being_opened->modules.emplace_back(cls, name);
+        }
 }
 
 const void *load_library(const char *name, enum library_class cls, int abi_version)
 {
+#ifdef BUILD_LIBRARIES
+        open_plugins_for(cls, name);
+#endif
         auto it_cls = get_libmap().find(cls);
         if (it_cls != get_libmap().end()) {
                 auto it_module = it_cls->second.find(name);
@@ -305,6 +512,9 @@ void list_modules(enum library_class cls, int abi_version, bool full) {
  */
 bool list_all_modules() {
         bool ret = true;
+#ifdef BUILD_LIBRARIES
+        open_plugins_for(LIBRARY_CLASS_UNDEFINED, nullptr);
+#endif
 
         auto& libraries = get_libmap();
         for (auto cls_it = library_class_info.begin(); cls_it != library_class_info.end();
@@ -334,6 +544,9 @@ bool list_all_modules() {
 map<string, const void *> get_libraries_for_class(enum library_class cls, int abi_version, bool include_hidden)
 {
         map<string, const void *> ret;
+#ifdef BUILD_LIBRARIES
+        open_plugins_for(cls, nullptr);
+#endif
         auto& libraries = get_libmap();
         auto it = libraries.find(cls);
         if (it != libraries.end()) {
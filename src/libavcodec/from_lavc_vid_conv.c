@@ -57,6 +57,7 @@
 #include "color.h"
 #include "config_common.h"
 #include "host.h"
+#include "hwaccel_vaapi.h"
 #include "hwaccel_vdpau.h"
 #include "hwaccel_rpi4.h"
 #include "libavcodec/from_lavc_vid_conv.h"
@@ -81,16 +82,184 @@
 #pragma GCC diagnostic ignored "-Wunknown-pragmas"
 #pragma clang diagnostic warning "-Wpass-failed"
 
+/*
+ * AVX2 kernels of the most common conversions. They are compiled regardless
+ * of the baseline ISA and used if vc_avx2_enabled(). Each of them converts
+ * the beginning of a line (or a pair of lines) and returns the number of
+ * pixels processed, the rest is done by the generic code. Results are
+ * bit-exact with the generic code.
+ */
+#if defined __x86_64__ && (defined __GNUC__ || defined __clang__)
+#define HAVE_AVX2_DISPATCH 1
+#include <immintrin.h>
+#define TARGET_AVX2 __attribute__((target("avx2")))
+
+TARGET_AVX2 static int nv12_to_uyvy_avx2(const unsigned char *src_y, const unsigned char *src_cbcr, unsigned char *dst, int width)
+{
+        int x = 0;
+        for (; x + 32 <= width; x += 32) {
+                __m256i y = _mm256_loadu_si256((const __m256i *)(const void *) (src_y + x));
+                __m256i cbcr = _mm256_loadu_si256((const __m256i *)(const void *) (src_cbcr + x));
+                __m256i lo = _mm256_unpacklo_epi8(cbcr, y);
+                __m256i hi = _mm256_unpackhi_epi8(cbcr, y);
+                _mm256_storeu_si256((__m256i *)(void *) (dst + 2 * x), _mm256_permute2x128_si256(lo, hi, 0x20));
+                _mm256_storeu_si256((__m256i *)(void *) (dst + 2 * x + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+        }
+        return x;
+}
+
+/**
+ * Packs 12 pixels to 8 v210 words. Each 128-bit lane of y contains 6 luma
+ * samples (words 0-5), uv 3 Cb (words 0-2) and 3 Cr (words 4-6) samples.
+ */
+TARGET_AVX2 static inline __m256i v210_pack_avx2(__m256i y, __m256i uv)
+{
+#define SHUF32(a, b, c, d) _mm256_setr_epi8(a, (a) < 0 ? -1 : (a) + 1, -1, -1, b, (b) < 0 ? -1 : (b) + 1, -1, -1, \
+                c, (c) < 0 ? -1 : (c) + 1, -1, -1, d, (d) < 0 ? -1 : (d) + 1, -1, -1, \
+                a, (a) < 0 ? -1 : (a) + 1, -1, -1, b, (b) < 0 ? -1 : (b) + 1, -1, -1, \
+                c, (c) < 0 ? -1 : (c) + 1, -1, -1, d, (d) < 0 ? -1 : (d) + 1, -1, -1)
+        // word k = c0 | c1 << 10 | c2 << 20, components in order Cb Y Cr Y Cb Y Cr Y Cb Y Cr Y
+        __m256i c0 = _mm256_or_si256(_mm256_shuffle_epi8(y, SHUF32(-1, 2, -1, 8)), _mm256_shuffle_epi8(uv, SHUF32(0, -1, 10, -1)));
+        __m256i c1 = _mm256_or_si256(_mm256_shuffle_epi8(y, SHUF32(0, -1, 6, -1)), _mm256_shuffle_epi8(uv, SHUF32(-1, 2, -1, 12)));
+        __m256i c2 = _mm256_or_si256(_mm256_shuffle_epi8(y, SHUF32(-1, 4, -1, 10)), _mm256_shuffle_epi8(uv, SHUF32(8, -1, 4, -1)));
+#undef SHUF32
+        return _mm256_or_si256(_mm256_or_si256(c0, _mm256_slli_epi32(c1, 10)), _mm256_slli_epi32(c2, 20));
+}
+
+/// loads 8 samples from src and src+6 (6 pixels are used from each) to respective lanes
+TARGET_AVX2 static inline __m256i load_6x2_words_avx2(const uint16_t *src)
+{
+        return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(const void *) src)),
+                        _mm_loadu_si128((const __m128i *)(const void *) (src + 6)), 1);
+}
+
+/// loads 3 Cb and 3 Cr samples of 6 pixels to each lane as expected by v210_pack_avx2()
+TARGET_AVX2 static inline __m256i load_cb_cr_3x2_avx2(const uint16_t *src_cb, const uint16_t *src_cr)
+{
+        __m128i lo = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)(const void *) src_cb),
+                        _mm_loadl_epi64((const __m128i *)(const void *) src_cr));
+        __m128i hi = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)(const void *) (src_cb + 3)),
+                        _mm_loadl_epi64((const __m128i *)(const void *) (src_cr + 3)));
+        return _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+}
+
+TARGET_AVX2 static int yuv422p10le_to_v210_avx2(const uint16_t *src_y, const uint16_t *src_cb, const uint16_t *src_cr, uint32_t *dst, int width)
+{
+        int x = 0;
+        // loads reach 2 pixels past the block
+        for (; x + 18 <= width / 6 * 6; x += 12) {
+                __m256i uv = load_cb_cr_3x2_avx2(src_cb + x / 2, src_cr + x / 2);
+                _mm256_storeu_si256((__m256i *)(void *) (dst + x / 6 * 4), v210_pack_avx2(load_6x2_words_avx2(src_y + x), uv));
+        }
+        return x;
+}
+
+TARGET_AVX2 static int yuv420p10le_to_v210_avx2(const uint16_t *src_y1, const uint16_t *src_y2, const uint16_t *src_cb, const uint16_t *src_cr,
+                uint32_t *dst1, uint32_t *dst2, int width)
+{
+        int x = 0;
+        for (; x + 18 <= width / 6 * 6; x += 12) {
+                __m256i uv = load_cb_cr_3x2_avx2(src_cb + x / 2, src_cr + x / 2);
+                _mm256_storeu_si256((__m256i *)(void *) (dst1 + x / 6 * 4), v210_pack_avx2(load_6x2_words_avx2(src_y1 + x), uv));
+                _mm256_storeu_si256((__m256i *)(void *) (dst2 + x / 6 * 4), v210_pack_avx2(load_6x2_words_avx2(src_y2 + x), uv));
+        }
+        return x;
+}
+
+TARGET_AVX2 static int p010le_to_v210_avx2(const uint16_t *src_y1, const uint16_t *src_y2, const uint16_t *src_cbcr,
+                uint32_t *dst1, uint32_t *dst2, int width)
+{
+        const __m256i deinterleave = _mm256_setr_epi8(0, 1, 4, 5, 8, 9, -1, -1, 2, 3, 6, 7, 10, 11, -1, -1,
+                        0, 1, 4, 5, 8, 9, -1, -1, 2, 3, 6, 7, 10, 11, -1, -1);
+        int x = 0;
+        for (; x + 18 <= width / 6 * 6; x += 12) {
+                __m256i uv = _mm256_shuffle_epi8(_mm256_srli_epi16(load_6x2_words_avx2(src_cbcr + x), 6), deinterleave);
+                __m256i y1 = _mm256_srli_epi16(load_6x2_words_avx2(src_y1 + x), 6);
+                __m256i y2 = _mm256_srli_epi16(load_6x2_words_avx2(src_y2 + x), 6);
+                _mm256_storeu_si256((__m256i *)(void *) (dst1 + x / 6 * 4), v210_pack_avx2(y1, uv));
+                _mm256_storeu_si256((__m256i *)(void *) (dst2 + x / 6 * 4), v210_pack_avx2(y2, uv));
+        }
+        return x;
+}
+
+/// stores 8 pixels of 10-bit R, G and B (32-bit lanes) as R10k
+TARGET_AVX2 static inline void store_r10k_avx2(unsigned char *dst, __m256i r, __m256i g, __m256i b)
+{
+        const __m256i bswap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+        __m256i val = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi32(r, 22), _mm256_slli_epi32(g, 12)), _mm256_slli_epi32(b, 2));
+        _mm256_storeu_si256((__m256i *)(void *) dst, _mm256_shuffle_epi8(val, bswap));
+}
+
+TARGET_AVX2 static inline __m256i load_8_words_avx2(const uint16_t *src)
+{
+        return _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(const void *) src));
+}
+
+/// @note expects valid in_depth-bit samples (higher bits are not masked out as in the generic code)
+TARGET_AVX2 static int gbrpXXle_to_r10k_avx2(const uint16_t *src_g, const uint16_t *src_b, const uint16_t *src_r, unsigned char *dst,
+                int width, unsigned int in_depth)
+{
+        const __m128i shift = _mm_cvtsi32_si128(in_depth - 10);
+        int x = 0;
+        for (; x + 8 <= width; x += 8) {
+                store_r10k_avx2(dst + 4 * x, _mm256_srl_epi32(load_8_words_avx2(src_r + x), shift),
+                                _mm256_srl_epi32(load_8_words_avx2(src_g + x), shift),
+                                _mm256_srl_epi32(load_8_words_avx2(src_b + x), shift));
+        }
+        return x;
+}
+
+TARGET_AVX2 static int yuv444pXXle_to_r10k_avx2(const uint16_t *src_y, const uint16_t *src_cb, const uint16_t *src_cr, unsigned char *dst,
+                int width, int depth)
+{
+        const __m256i y_off = _mm256_set1_epi32(1<<(depth-4));
+        const __m256i c_off = _mm256_set1_epi32(1<<(depth-1));
+        const __m256i y_scale = _mm256_set1_epi32(Y_SCALE);
+        const __m256i r_cr = _mm256_set1_epi32(SCALED(R_CR(KR_709,KB_709)));
+        const __m256i g_cb = _mm256_set1_epi32(SCALED(G_CB(KR_709,KB_709)));
+        const __m256i g_cr = _mm256_set1_epi32(SCALED(G_CR(KR_709,KB_709)));
+        const __m256i b_cb = _mm256_set1_epi32(SCALED(B_CB(KR_709,KB_709)));
+        const __m256i foot = _mm256_set1_epi32(FULL_FOOT(10));
+        const __m256i head = _mm256_set1_epi32(FULL_HEAD(10));
+        const __m128i shift = _mm_cvtsi32_si128(COMP_BASE-10+depth);
+        int x = 0;
+        for (; x + 8 <= width; x += 8) {
+                __m256i y = _mm256_mullo_epi32(y_scale, _mm256_sub_epi32(load_8_words_avx2(src_y + x), y_off));
+                __m256i cb = _mm256_sub_epi32(load_8_words_avx2(src_cb + x), c_off);
+                __m256i cr = _mm256_sub_epi32(load_8_words_avx2(src_cr + x), c_off);
+                __m256i r = _mm256_sra_epi32(_mm256_add_epi32(y, _mm256_mullo_epi32(cr, r_cr)), shift);
+                __m256i g = _mm256_sra_epi32(_mm256_add_epi32(_mm256_add_epi32(y, _mm256_mullo_epi32(cb, g_cb)), _mm256_mullo_epi32(cr, g_cr)), shift);
+                __m256i b = _mm256_sra_epi32(_mm256_add_epi32(y, _mm256_mullo_epi32(cb, b_cb)), shift);
+                store_r10k_avx2(dst + 4 * x, _mm256_min_epi32(_mm256_max_epi32(r, foot), head),
+                                _mm256_min_epi32(_mm256_max_epi32(g, foot), head),
+                                _mm256_min_epi32(_mm256_max_epi32(b, foot), head));
+        }
+        return x;
+}
+#endif // defined __x86_64__ && (defined __GNUC__ || defined __clang__)
+
 static void nv12_to_uyvy(char * __restrict dst_buffer, AVFrame * __restrict in_frame,
                 int width, int height, int pitch, const int * __restrict rgb_shift)
 {
         UNUSED(rgb_shift);
+        bool avx2 = vc_avx2_enabled();
         for(int y = 0; y < (int) height; ++y) {
                 char *src_y = (char *) in_frame->data[0] + in_frame->linesize[0] * y;
                 char *src_cbcr = (char *) in_frame->data[1] + in_frame->linesize[1] * (y / 2);
                 char *dst = dst_buffer + pitch * y;
 
-                OPTIMIZED_FOR (int x = 0; x < width / 2; ++x) {
+                int x = 0;
+#ifdef HAVE_AVX2_DISPATCH
+                if (avx2) {
+                        int done = nv12_to_uyvy_avx2((unsigned char *) src_y, (unsigned char *) src_cbcr, (unsigned char *) dst, width);
+                        src_y += done;
+                        src_cbcr += done;
+                        dst += 2 * done;
+                        x = done / 2;
+                }
+#endif
+                OPTIMIZED_FOR (; x < width / 2; ++x) {
                         *dst++ = *src_cbcr++;
                         *dst++ = *src_y++;
                         *dst++ = *src_cbcr++;
@@ -216,13 +385,24 @@ static inline void gbrpXXle_to_r10k(char * __restrict dst_buffer, AVFrame * __re
         assert((uintptr_t) frame->linesize[2] % 2 == 0);
 
         UNUSED(rgb_shift);
+        bool avx2 = vc_avx2_enabled();
         for (int y = 0; y < height; ++y) {
                 uint16_t *src_g = (uint16_t *)(void *) (frame->data[0] + frame->linesize[0] * y);
                 uint16_t *src_b = (uint16_t *)(void *) (frame->data[1] + frame->linesize[1] * y);
                 uint16_t *src_r = (uint16_t *)(void *) (frame->data[2] + frame->linesize[2] * y);
                 unsigned char *dst = (unsigned char *) dst_buffer + y * pitch;
 
-                OPTIMIZED_FOR (int x = 0; x < width; ++x) {
+                int x = 0;
+#ifdef HAVE_AVX2_DISPATCH
+                if (avx2) {
+                        x = gbrpXXle_to_r10k_avx2(src_g, src_b, src_r, dst, width, in_depth);
+                        src_g += x;
+                        src_b += x;
+                        src_r += x;
+                        dst += 4 * x;
+                }
+#endif
+                OPTIMIZED_FOR (; x < width; ++x) {
                         *dst++ = *src_r >> (in_depth - 8U);
                         *dst++ = ((*src_r++ >> (in_depth - 10U)) & 0x3U) << 6U | *src_g >> (in_depth - 6U);
                         *dst++ = ((*src_g++ >> (in_depth - 10U)) & 0xFU) << 4U | *src_b >> (in_depth - 4U);
@@ -256,13 +436,24 @@ static inline void yuv444pXXle_to_r10k(int depth, char * __restrict dst_buffer,
         assert((uintptr_t) frame->linesize[2] % 2 == 0);
 
         UNUSED(rgb_shift);
+        bool avx2 = vc_avx2_enabled();
         for (int y = 0; y < height; ++y) {
                 uint16_t *src_y = (uint16_t *)(void *) (frame->data[0] + frame->linesize[0] * y);
                 uint16_t *src_cb = (uint16_t *)(void *) (frame->data[1] + frame->linesize[1] * y);
                 uint16_t *src_cr = (uint16_t *)(void *) (frame->data[2] + frame->linesize[2] * y);
 		unsigned char *dst = (unsigned char *) dst_buffer + y * pitch;
 
-                OPTIMIZED_FOR (int x = 0; x < width; ++x) {
+                int x = 0;
+#ifdef HAVE_AVX2_DISPATCH
+                if (avx2) {
+                        x = yuv444pXXle_to_r10k_avx2(src_y, src_cb, src_cr, dst, width, depth);
+                        src_y += x;
+                        src_cb += x;
+                        src_cr += x;
+                        dst += 4 * x;
+                }
+#endif
+                OPTIMIZED_FOR (; x < width; ++x) {
                         comp_type_t y = (Y_SCALE * (*src_y++ - (1<<(depth-4))));
                         comp_type_t cr = *src_cr++ - (1<<(depth-1));
                         comp_type_t cb = *src_cb++ - (1<<(depth-1));
@@ -1173,6 +1364,7 @@ static void yuv420p10le_to_v210(char * __restrict dst_buffer, AVFrame * __restri
                 int width, int height, int pitch, const int * __restrict rgb_shift)
 {
         UNUSED(rgb_shift);
+        bool avx2 = vc_avx2_enabled();
         for(int y = 0; y < height / 2; ++y) {
                 uint16_t *src_y1 = (uint16_t *)(void *)(in_frame->data[0] + in_frame->linesize[0] * y * 2);
                 uint16_t *src_y2 = (uint16_t *)(void *)(in_frame->data[0] + in_frame->linesize[0] * (y * 2 + 1));
@@ -1181,7 +1373,20 @@ static void yuv420p10le_to_v210(char * __restrict dst_buffer, AVFrame * __restri
                 uint32_t *dst1 = (uint32_t *)(void *)(dst_buffer + (y * 2) * pitch);
                 uint32_t *dst2 = (uint32_t *)(void *)(dst_buffer + (y * 2 + 1) * pitch);
 
-                OPTIMIZED_FOR (int x = 0; x < width / 6; ++x) {
+                int x = 0;
+#ifdef HAVE_AVX2_DISPATCH
+                if (avx2) {
+                        int done = yuv420p10le_to_v210_avx2(src_y1, src_y2, src_cb, src_cr, dst1, dst2, width);
+                        src_y1 += done;
+                        src_y2 += done;
+                        src_cb += done / 2;
+                        src_cr += done / 2;
+                        dst1 += done / 6 * 4;
+                        dst2 += done / 6 * 4;
+                        x = done / 6;
+                }
+#endif
+                OPTIMIZED_FOR (; x < width / 6; ++x) {
                         uint32_t w0_0, w0_1, w0_2, w0_3;
                         uint32_t w1_0, w1_1, w1_2, w1_3;
 
@@ -1236,13 +1441,25 @@ static void yuv422p10le_to_v210(char * __restrict dst_buffer, AVFrame * __restri
                 int width, int height, int pitch, const int * __restrict rgb_shift)
 {
         UNUSED(rgb_shift);
+        bool avx2 = vc_avx2_enabled();
         for(int y = 0; y < height; ++y) {
                 uint16_t *src_y = (uint16_t *)(void *)(in_frame->data[0] + in_frame->linesize[0] * y);
                 uint16_t *src_cb = (uint16_t *)(void *)(in_frame->data[1] + in_frame->linesize[1] * y);
                 uint16_t *src_cr = (uint16_t *)(void *)(in_frame->data[2] + in_frame->linesize[2] * y);
                 uint32_t *dst = (uint32_t *)(void *)(dst_buffer + y * pitch);
 
-                OPTIMIZED_FOR (int x = 0; x < width / 6; ++x) {
+                int x = 0;
+#ifdef HAVE_AVX2_DISPATCH
+                if (avx2) {
+                        int done = yuv422p10le_to_v210_avx2(src_y, src_cb, src_cr, dst, width);
+                        src_y += done;
+                        src_cb += done / 2;
+                        src_cr += done / 2;
+                        dst += done / 6 * 4;
+                        x = done / 6;
+                }
+#endif
+                OPTIMIZED_FOR (; x < width / 6; ++x) {
                         uint32_t w0_0, w0_1, w0_2, w0_3;
 
                         w0_0 = *src_cb++;
@@ -1624,6 +1841,7 @@ static void p010le_to_v210(char * __restrict dst_buffer, AVFrame * __restrict in
         assert((uintptr_t) in_frame->data[0] % 2 == 0);
         assert((uintptr_t) in_frame->data[1] % 2 == 0);
         assert((uintptr_t) dst_buffer % 4 == 0 && pitch % 4 == 0);
+        bool avx2 = vc_avx2_enabled();
         for(int y = 0; y < height / 2; ++y) {
                 uint16_t *src_y1 = (uint16_t *)(void *) (in_frame->data[0] + in_frame->linesize[0] * y * 2);
                 uint16_t *src_y2 = (uint16_t *)(void *) (in_frame->data[0] + in_frame->linesize[0] * (y * 2 + 1));
@@ -1631,7 +1849,19 @@ static void p010le_to_v210(char * __restrict dst_buffer, AVFrame * __restrict in
                 uint32_t *dst1 = (uint32_t *)(void *)(dst_buffer + (y * 2) * pitch);
                 uint32_t *dst2 = (uint32_t *)(void *)(dst_buffer + (y * 2 + 1) * pitch);
 
-                OPTIMIZED_FOR (int x = 0; x < width / 6; ++x) {
+                int x = 0;
+#ifdef HAVE_AVX2_DISPATCH
+                if (avx2) {
+                        int done = p010le_to_v210_avx2(src_y1, src_y2, src_cbcr, dst1, dst2, width);
+                        src_y1 += done;
+                        src_y2 += done;
+                        src_cbcr += done;
+                        dst1 += done / 6 * 4;
+                        dst2 += done / 6 * 4;
+                        x = done / 6;
+                }
+#endif
+                OPTIMIZED_FOR (; x < width / 6; ++x) {
                         uint32_t w0_0, w0_1, w0_2, w0_3;
                         uint32_t w1_0, w1_1, w1_2, w1_3;
 
@@ -1757,6 +1987,26 @@ static void av_vdpau_to_ug_vdpau(char * __restrict dst_buffer, AVFrame * __restr
 }
 #endif
 
+#ifdef HWACC_VAAPI
+static void av_vaapi_to_ug_vaapi(char * __restrict dst_buffer, AVFrame * __restrict in_frame,
+                int width, int height, int pitch, const int * __restrict rgb_shift)
+{
+        UNUSED(width);
+        UNUSED(height);
+        UNUSED(pitch);
+        UNUSED(rgb_shift);
+
+        struct video_frame_callbacks *callbacks = in_frame->opaque;
+
+        hw_vaapi_frame *out = (hw_vaapi_frame *)(void *) dst_buffer;
+
+        hw_vaapi_frame_from_avframe(out, in_frame);
+
+        callbacks->recycle = hw_vaapi_recycle_callback;
+        callbacks->copy = hw_vaapi_copy_callback;
+}
+#endif
+
 #ifdef HWACC_RPI4
 static void av_rpi4_8_to_ug(char * __restrict dst_buffer, AVFrame * __restrict in_frame,
                 int width, int height, int pitch, int * __restrict rgb_shift)
@@ -1951,6 +2201,9 @@ const struct av_to_uv_conversion *get_av_to_uv_conversions() {
                 // HW acceleration
                 {AV_PIX_FMT_VDPAU, HW_VDPAU, av_vdpau_to_ug_vdpau, false},
 #endif
+#ifdef HWACC_VAAPI
+                {AV_PIX_FMT_VAAPI, HW_VAAPI, av_vaapi_to_ug_vaapi, false},
+#endif
 #ifdef HWACC_RPI4
                 {AV_PIX_FMT_RPI4_8, RPI4_8, av_rpi4_8_to_ug, false},
 #endif
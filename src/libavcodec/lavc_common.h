@@ -66,6 +66,9 @@ extern "C" {
 /// compat
 ///
 // avcodec
+#ifndef AV_CODEC_CAP_DRAW_HORIZ_BAND
+#define AV_CODEC_CAP_DRAW_HORIZ_BAND CODEC_CAP_DRAW_HORIZ_BAND
+#endif
 #ifndef AV_CODEC_CAP_FRAME_THREADS
 #define AV_CODEC_CAP_FRAME_THREADS CODEC_CAP_FRAME_THREADS
 #endif
@@ -76,8 +76,187 @@
 #pragma GCC diagnostic ignored "-Wunknown-pragmas"
 #pragma clang diagnostic warning "-Wpass-failed"
 
+/*
+ * AVX2 kernels of the most common conversions. They are compiled regardless
+ * of the baseline ISA and used if vc_avx2_enabled(). Each of them converts
+ * the beginning of a line (or a pair of lines) and returns the number of
+ * pixels processed, the rest is done by the generic code. Results are
+ * bit-exact with the generic code.
+ */
+#if defined __x86_64__ && (defined __GNUC__ || defined __clang__)
+#define HAVE_AVX2_DISPATCH 1
+#include <immintrin.h>
+#define TARGET_AVX2 __attribute__((target("avx2")))
+
+/// converts 32 UYVY pixels of 2 lines to luma of both and 8-bit interleaved CbCr average
+TARGET_AVX2 static inline void uyvy_line_pair_avx2(const unsigned char *src, const unsigned char *src2, __m256i *y1, __m256i *y2, __m256i *cbcr)
+{
+        const __m256i lo_mask = _mm256_set1_epi16(0xFF);
+        __m256i a0 = _mm256_loadu_si256((const __m256i *)(const void *) src);
+        __m256i a1 = _mm256_loadu_si256((const __m256i *)(const void *) (src + 32));
+        __m256i b0 = _mm256_loadu_si256((const __m256i *)(const void *) src2);
+        __m256i b1 = _mm256_loadu_si256((const __m256i *)(const void *) (src2 + 32));
+        // packus interleaves 128-bit lanes, 0xD8 puts the qwords back in order
+        *y1 = _mm256_permute4x64_epi64(_mm256_packus_epi16(_mm256_srli_epi16(a0, 8), _mm256_srli_epi16(a1, 8)), 0xD8);
+        *y2 = _mm256_permute4x64_epi64(_mm256_packus_epi16(_mm256_srli_epi16(b0, 8), _mm256_srli_epi16(b1, 8)), 0xD8);
+        __m256i c0 = _mm256_srli_epi16(_mm256_add_epi16(_mm256_and_si256(a0, lo_mask), _mm256_and_si256(b0, lo_mask)), 1);
+        __m256i c1 = _mm256_srli_epi16(_mm256_add_epi16(_mm256_and_si256(a1, lo_mask), _mm256_and_si256(b1, lo_mask)), 1);
+        *cbcr = _mm256_permute4x64_epi64(_mm256_packus_epi16(c0, c1), 0xD8);
+}
+
+TARGET_AVX2 static int uyvy_to_yuv420p_avx2(const unsigned char *src, const unsigned char *src2, unsigned char *dst_y, unsigned char *dst_y2,
+                unsigned char *dst_cb, unsigned char *dst_cr, int width)
+{
+        const __m256i deinterleave = _mm256_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15,
+                        0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+        int x = 0;
+        for (; x + 32 <= width; x += 32) {
+                __m256i y1, y2, cbcr;
+                uyvy_line_pair_avx2(src + 2 * x, src2 + 2 * x, &y1, &y2, &cbcr);
+                _mm256_storeu_si256((__m256i *)(void *) (dst_y + x), y1);
+                _mm256_storeu_si256((__m256i *)(void *) (dst_y2 + x), y2);
+                cbcr = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(cbcr, deinterleave), 0xD8);
+                _mm_storeu_si128((__m128i *)(void *) (dst_cb + x / 2), _mm256_castsi256_si128(cbcr));
+                _mm_storeu_si128((__m128i *)(void *) (dst_cr + x / 2), _mm256_extracti128_si256(cbcr, 1));
+        }
+        return x;
+}
+
+TARGET_AVX2 static int uyvy_to_nv12_avx2(const unsigned char *src, const unsigned char *src2, unsigned char *dst_y, unsigned char *dst_y2,
+                unsigned char *dst_cbcr, int width)
+{
+        int x = 0;
+        for (; x + 32 <= width; x += 32) {
+                __m256i y1, y2, cbcr;
+                uyvy_line_pair_avx2(src + 2 * x, src2 + 2 * x, &y1, &y2, &cbcr);
+                _mm256_storeu_si256((__m256i *)(void *) (dst_y + x), y1);
+                _mm256_storeu_si256((__m256i *)(void *) (dst_y2 + x), y2);
+                _mm256_storeu_si256((__m256i *)(void *) (dst_cbcr + x), cbcr);
+        }
+        return x;
+}
+
+/**
+ * Unpacks 8 v210 words (12 pixels) to 16-bit components. Each 128-bit lane
+ * of p contains components 0 (bits 0-9) and then components 1 (bits 10-19)
+ * of 4 words, q contains components 2 (bits 20-29).
+ */
+TARGET_AVX2 static inline void v210_unpack_avx2(const uint32_t *src, __m256i *p, __m256i *q)
+{
+        const __m256i mask = _mm256_set1_epi32(0x3FF);
+        __m256i w = _mm256_loadu_si256((const __m256i *)(const void *) src);
+        __m256i c0 = _mm256_and_si256(w, mask);
+        __m256i c1 = _mm256_and_si256(_mm256_srli_epi32(w, 10), mask);
+        __m256i c2 = _mm256_and_si256(_mm256_srli_epi32(w, 20), mask);
+        *p = _mm256_packus_epi32(c0, c1);
+        *q = _mm256_packus_epi32(c2, c2);
+}
+
+#define SHUF16(a, b, c, d, e, f) \
+        (a) < 0 ? -1 : 2 * (a), (a) < 0 ? -1 : 2 * (a) + 1, (b) < 0 ? -1 : 2 * (b), (b) < 0 ? -1 : 2 * (b) + 1, \
+        (c) < 0 ? -1 : 2 * (c), (c) < 0 ? -1 : 2 * (c) + 1, (d) < 0 ? -1 : 2 * (d), (d) < 0 ? -1 : 2 * (d) + 1, \
+        (e) < 0 ? -1 : 2 * (e), (e) < 0 ? -1 : 2 * (e) + 1, (f) < 0 ? -1 : 2 * (f), (f) < 0 ? -1 : 2 * (f) + 1, \
+        -1, -1, -1, -1
+/// picks 16-bit words of p and q (as produced by v210_unpack_avx2) to low 6 words of each lane
+#define V210_PICK_AVX2(p, q, p0, p1, p2, p3, p4, p5, q0, q1, q2, q3, q4, q5) \
+        _mm256_or_si256(_mm256_shuffle_epi8(p, _mm256_setr_epi8(SHUF16(p0, p1, p2, p3, p4, p5), SHUF16(p0, p1, p2, p3, p4, p5))), \
+                        _mm256_shuffle_epi8(q, _mm256_setr_epi8(SHUF16(q0, q1, q2, q3, q4, q5), SHUF16(q0, q1, q2, q3, q4, q5))))
+// luma is c1 of w0, c0 of w1, c2 of w1, c1 of w2, c0 of w3, c2 of w3
+#define V210_Y_AVX2(p, q) V210_PICK_AVX2(p, q, 4, 1, -1, 6, 3, -1, -1, -1, 1, -1, -1, 3)
+// Cb is c0 of w0, c1 of w1, c2 of w2
+#define V210_CB_AVX2(p, q) V210_PICK_AVX2(p, q, 0, 5, -1, -1, -1, -1, -1, -1, 2, -1, -1, -1)
+// Cr is c2 of w0, c0 of w2, c1 of w3
+#define V210_CR_AVX2(p, q) V210_PICK_AVX2(p, q, -1, 2, 7, -1, -1, -1, 0, -1, -1, -1, -1, -1)
+#define V210_CBCR_AVX2(p, q) V210_PICK_AVX2(p, q, 0, -1, 5, 2, -1, 7, -1, 0, -1, -1, 2, -1)
+
+/// stores low 6 words of each lane consecutively, overwrites 2 more words
+TARGET_AVX2 static inline void store_6x2_words_avx2(uint16_t *dst, __m256i val)
+{
+        _mm_storeu_si128((__m128i *)(void *) dst, _mm256_castsi256_si128(val));
+        _mm_storeu_si128((__m128i *)(void *) (dst + 6), _mm256_extracti128_si256(val, 1));
+}
+
+/// stores low 3 words of each lane consecutively, overwrites 1 more word
+TARGET_AVX2 static inline void store_3x2_words_avx2(uint16_t *dst, __m256i val)
+{
+        _mm_storel_epi64((__m128i *)(void *) dst, _mm256_castsi256_si128(val));
+        _mm_storel_epi64((__m128i *)(void *) (dst + 3), _mm256_extracti128_si256(val, 1));
+}
+
+/// @param width  count of pixels to be converted (multiple of 6), the stores
+///               overlap so that the last 6 pixels are left to the caller
+TARGET_AVX2 static int v210_to_yuv422p10le_avx2(const uint32_t *src, uint16_t *dst_y, uint16_t *dst_cb, uint16_t *dst_cr, int width)
+{
+        int x = 0;
+        for (; x + 18 <= width; x += 12) {
+                __m256i p, q;
+                v210_unpack_avx2(src, &p, &q);
+                src += 8;
+                store_6x2_words_avx2(dst_y + x, V210_Y_AVX2(p, q));
+                store_3x2_words_avx2(dst_cb + x / 2, V210_CB_AVX2(p, q));
+                store_3x2_words_avx2(dst_cr + x / 2, V210_CR_AVX2(p, q));
+        }
+        return x;
+}
+
+/// @copydetails v210_to_yuv422p10le_avx2
+TARGET_AVX2 static int v210_to_p010le_avx2(const uint32_t *src, const uint32_t *src2, uint16_t *dst_y, uint16_t *dst_y2, uint16_t *dst_cbcr, int width)
+{
+        int x = 0;
+        for (; x + 18 <= width; x += 12) {
+                __m256i p1, q1, p2, q2;
+                v210_unpack_avx2(src, &p1, &q1);
+                v210_unpack_avx2(src2, &p2, &q2);
+                src += 8;
+                src2 += 8;
+                store_6x2_words_avx2(dst_y + x, _mm256_slli_epi16(V210_Y_AVX2(p1, q1), 6));
+                store_6x2_words_avx2(dst_y2 + x, _mm256_slli_epi16(V210_Y_AVX2(p2, q2), 6));
+                __m256i cbcr = _mm256_srli_epi16(_mm256_add_epi16(V210_CBCR_AVX2(p1, q1), V210_CBCR_AVX2(p2, q2)), 1);
+                store_6x2_words_avx2(dst_cbcr + x, _mm256_slli_epi16(cbcr, 6));
+        }
+        return x;
+}
+
+/// loads 8 3-byte groups (24 B) and expands each to the low bytes of a 32-bit word
+TARGET_AVX2 static inline __m256i load_expand_3to4_avx2(const unsigned char *src)
+{
+        const __m128i expand = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+        __m128i lo = _mm_loadu_si128((const __m128i *)(const void *) src);
+        __m128i hi = _mm_loadl_epi64((const __m128i *)(const void *) (src + 16));
+        hi = _mm_alignr_epi8(hi, lo, 12);
+        return _mm256_set_m128i(_mm_shuffle_epi8(hi, expand), _mm_shuffle_epi8(lo, expand));
+}
+
+TARGET_AVX2 static int rgb_rgba_to_gbrp_avx2(const unsigned char *src, unsigned char *dst_g, unsigned char *dst_b, unsigned char *dst_r, int width, int bpp)
+{
+        // per lane R0-3 G0-3 B0-3 X0-3, then per vector R0-7 G0-7 B0-7 X0-7
+        const __m256i deinterleave = _mm256_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15,
+                        0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+        const __m256i perm = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+        int x = 0;
+        for (; x + 32 <= width; x += 32) {
+                __m256i v[4];
+                for (int i = 0; i < 4; ++i) {
+                        v[i] = bpp == 4 ? _mm256_loadu_si256((const __m256i *)(const void *) (src + 32 * i))
+                                : load_expand_3to4_avx2(src + 24 * i);
+                        v[i] = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(v[i], deinterleave), perm);
+                }
+                src += 32 * bpp;
+                __m256i rb01 = _mm256_unpacklo_epi64(v[0], v[1]);
+                __m256i rb23 = _mm256_unpacklo_epi64(v[2], v[3]);
+                __m256i g01 = _mm256_unpackhi_epi64(v[0], v[1]);
+                __m256i g23 = _mm256_unpackhi_epi64(v[2], v[3]);
+                _mm256_storeu_si256((__m256i *)(void *) (dst_r + x), _mm256_permute2x128_si256(rb01, rb23, 0x20));
+                _mm256_storeu_si256((__m256i *)(void *) (dst_b + x), _mm256_permute2x128_si256(rb01, rb23, 0x31));
+                _mm256_storeu_si256((__m256i *)(void *) (dst_g + x), _mm256_permute2x128_si256(g01, g23, 0x20));
+        }
+        return x;
+}
+#endif // defined __x86_64__ && (defined __GNUC__ || defined __clang__)
+
 static void uyvy_to_yuv420p(AVFrame * __restrict out_frame, const unsigned char * __restrict in_data, int width, int height)
 {
+        bool avx2 = vc_avx2_enabled();
         int y;
         for (y = 0; y < height - 1; y += 2) {
                 /*  every even row */
@@ -89,8 +268,19 @@ static void uyvy_to_yuv420p(AVFrame * __restrict out_frame, const unsigned char
                 unsigned char *dst_cb = out_frame->data[1] + out_frame->linesize[1] * (y / 2);
                 unsigned char *dst_cr = out_frame->data[2] + out_frame->linesize[2] * (y / 2);
 
-                int x;
-                OPTIMIZED_FOR (x = 0; x < width - 1; x += 2) {
+                int x = 0;
+#ifdef HAVE_AVX2_DISPATCH
+                if (avx2) {
+                        x = uyvy_to_yuv420p_avx2(src, src2, dst_y, dst_y2, dst_cb, dst_cr, width);
+                        src += 2 * x;
+                        src2 += 2 * x;
+                        dst_y += x;
+                        dst_y2 += x;
+                        dst_cb += x / 2;
+                        dst_cr += x / 2;
+                }
+#endif
+                OPTIMIZED_FOR (; x < width - 1; x += 2) {
                         *dst_cb++ = (*src++ + *src2++) / 2;
                         *dst_y++ = *src++;
                         *dst_y2++ = *src2++;
@@ -161,6 +351,7 @@ static void uyvy_to_yuv444p(AVFrame * __restrict out_frame, const unsigned char
 
 static void uyvy_to_nv12(AVFrame * __restrict out_frame, const unsigned char * __restrict in_data, int width, int height)
 {
+        bool avx2 = vc_avx2_enabled();
         for(int y = 0; y < height; y += 2) {
                 /*  every even row */
                 const unsigned char *src = in_data + y * (width * 2);
@@ -171,6 +362,16 @@ static void uyvy_to_nv12(AVFrame * __restrict out_frame, const unsigned char * _
                 unsigned char *dst_cbcr = out_frame->data[1] + out_frame->linesize[1] * y / 2;
 
                 int x = 0;
+#ifdef HAVE_AVX2_DISPATCH
+                if (avx2) {
+                        x = uyvy_to_nv12_avx2(src, src2, dst_y, dst_y2, dst_cbcr, width);
+                        src += 2 * x;
+                        src2 += 2 * x;
+                        dst_y += x;
+                        dst_y2 += x;
+                        dst_cbcr += x;
+                }
+#endif
 #ifdef __SSE3__
                 __m128i yuv;
                 __m128i yuv2;
@@ -315,13 +516,25 @@ static void v210_to_yuv422p10le(AVFrame * __restrict out_frame, const unsigned c
         assert((uintptr_t) out_frame->linesize[1] % 2 == 0);
         assert((uintptr_t) out_frame->linesize[2] % 2 == 0);
 
+        bool avx2 = vc_avx2_enabled();
         for(int y = 0; y < height; y += 1) {
                 const uint32_t *src = (const void *) (in_data + y * vc_get_linesize(width, v210));
                 uint16_t *dst_y = (uint16_t *)(void *) (out_frame->data[0] + out_frame->linesize[0] * y);
                 uint16_t *dst_cb = (uint16_t *)(void *) (out_frame->data[1] + out_frame->linesize[1] * y);
                 uint16_t *dst_cr = (uint16_t *)(void *) (out_frame->data[2] + out_frame->linesize[2] * y);
 
-                OPTIMIZED_FOR (int x = 0; x < width / 6; ++x) {
+                int x = 0;
+#ifdef HAVE_AVX2_DISPATCH
+                if (avx2) {
+                        x = v210_to_yuv422p10le_avx2(src, dst_y, dst_cb, dst_cr, width / 6 * 6);
+                        src += x / 6 * 4;
+                        dst_y += x;
+                        dst_cb += x / 2;
+                        dst_cr += x / 2;
+                        x /= 6;
+                }
+#endif
+                OPTIMIZED_FOR (; x < width / 6; ++x) {
                         uint32_t w0_0, w0_1, w0_2, w0_3;
 
                         w0_0 = *src++;
@@ -441,6 +654,7 @@ static void v210_to_p010le(AVFrame * __restrict out_frame, const unsigned char *
         assert((uintptr_t) out_frame->linesize[0] % 2 == 0);
         assert((uintptr_t) out_frame->linesize[1] % 2 == 0);
 
+        bool avx2 = vc_avx2_enabled();
         for(int y = 0; y < height; y += 2) {
                 /*  every even row */
                 const uint32_t *src = (const void *) (in_data + y * vc_get_linesize(width, v210));
@@ -450,7 +664,19 @@ static void v210_to_p010le(AVFrame * __restrict out_frame, const unsigned char *
                 uint16_t *dst_y2 = (uint16_t *)(void *) (out_frame->data[0] + out_frame->linesize[0] * (y + 1));
                 uint16_t *dst_cbcr = (uint16_t *)(void *) (out_frame->data[1] + out_frame->linesize[1] * y / 2);
 
-                OPTIMIZED_FOR (int x = 0; x < width / 6; ++x) {
+                int x = 0;
+#ifdef HAVE_AVX2_DISPATCH
+                if (avx2) {
+                        x = v210_to_p010le_avx2(src, src2, dst_y, dst_y2, dst_cbcr, width / 6 * 6);
+                        src += x / 6 * 4;
+                        src2 += x / 6 * 4;
+                        dst_y += x;
+                        dst_y2 += x;
+                        dst_cbcr += x;
+                        x /= 6;
+                }
+#endif
+                OPTIMIZED_FOR (; x < width / 6; ++x) {
 			//block 1, bits  0 -  9: U0+0
 			//block 1, bits 10 - 19: Y0
 			//block 1, bits 20 - 29: V0+1
@@ -917,13 +1143,24 @@ static inline void rgb_rgba_to_gbrp(AVFrame * __restrict out_frame, const unsign
 static inline void rgb_rgba_to_gbrp(AVFrame * __restrict out_frame, const unsigned char * __restrict in_data, int width, int height, int bpp)
 {
         int src_linesize = bpp * width;
+        bool avx2 = vc_avx2_enabled();
         for (int y = 0; y < height; ++y) {
                 const unsigned char *src = in_data + y * src_linesize;
                 unsigned char *dst_g = out_frame->data[0] + out_frame->linesize[0] * y;
                 unsigned char *dst_b = out_frame->data[1] + out_frame->linesize[1] * y;
                 unsigned char *dst_r = out_frame->data[2] + out_frame->linesize[2] * y;
 
-                OPTIMIZED_FOR (int x = 0; x < width; ++x) {
+                int x = 0;
+#ifdef HAVE_AVX2_DISPATCH
+                if (avx2) {
+                        x = rgb_rgba_to_gbrp_avx2(src, dst_g, dst_b, dst_r, width, bpp);
+                        src += x * bpp;
+                        dst_g += x;
+                        dst_b += x;
+                        dst_r += x;
+                }
+#endif
+                OPTIMIZED_FOR (; x < width; ++x) {
                         *dst_r++ = src[0];
                         *dst_g++ = src[1];
                         *dst_b++ = src[2];
@@ -97,8 +97,10 @@
 #include "utils/nat.h"
 #include "utils/net.h"
 #include "utils/thread.h"
+#include "utils/trace_events.h"
 #include "utils/wait_obj.h"
 #include "utils/udp_holepunch.h"
+#include "utils/video_frame_pool.h"
 #include "video.h"
 #include "video_capture.h"
 #include "video_display.h"
@@ -223,6 +225,8 @@ struct state_uv {
         struct module root_module;
 
         video_rxtx *state_video_rxtx;
+        /// copies of captured frames, must outlive state_video_rxtx
+        unique_ptr<video_frame_pool> capture_pool;
 
 private:
         mutex lock;
@@ -441,10 +445,72 @@ static void print_fps(steady_clock::time_point *t0, int *frames, const string &n
         }
 }
 
+#define CAPTURE_POOL_FRAMES 3 ///< max copied frames in flight
+#define CAPTURE_POOL_PROBE_INTERVAL 64 ///< frames after which the other method is re-measured
+
+ADD_TO_PARAM("capture-no-pool", "* capture-no-pool\n"
+                "  Do not copy frames of captures without dispose callback, wait for the frame to be processed before next grab instead\n");
+
+/**
+ * Copies a captured frame that is valid only until the next grab to a pooled
+ * one so that grab of next frame overlaps processing of this one.
+ *
+ * @returns copied frame, empty if the frame cannot be copied
+ */
+static shared_ptr<video_frame> capture_pool_copy(video_frame_pool &pool, video_desc &pool_desc,
+                size_t &pool_data_len, struct video_frame *f)
+{
+        if (f->mem_location != CPU_MEM || f->fragment) {
+                return {};
+        }
+        size_t max_len = 0;
+        for (unsigned i = 0; i < f->tile_count; ++i) {
+                max_len = max<size_t>(max_len, f->tiles[i].data_len);
+        }
+        video_desc desc = video_desc_from_frame(f);
+        if (!video_desc_eq(desc, pool_desc) || max_len > pool_data_len) {
+                // compressed frame sizes vary - leave some headroom
+                pool_data_len = is_codec_opaque(desc.color_spec) ? 2 * max_len : max_len;
+                pool.reconfigure(desc, pool_data_len);
+                pool_desc = desc;
+        }
+        shared_ptr<video_frame> copy = pool.get_frame();
+        for (unsigned i = 0; i < f->tile_count; ++i) {
+                memcpy(copy->tiles[i].data, f->tiles[i].data, f->tiles[i].data_len);
+                copy->tiles[i].data_len = f->tiles[i].data_len;
+        }
+        vf_copy_metadata(copy.get(), f);
+        return copy;
+}
+
+/**
+ * Decides whether copying a frame pays off - it does if waiting for the frame
+ * to be processed takes longer than the copy (eg. not with a single core or a
+ * fast sender). Both durations are measured, the less used one periodically.
+ */
+struct capture_copy_policy {
+        time_ns_t avg_copy = 0; ///< 0 - not yet measured
+        time_ns_t avg_wait = 0;
+        unsigned long frames = 0;
+
+        bool should_copy() {
+                const bool prefer_copy = avg_copy == 0 || avg_wait > avg_copy;
+                return ++frames % CAPTURE_POOL_PROBE_INTERVAL == 0 ? !prefer_copy : prefer_copy;
+        }
+        static void update(time_ns_t &avg, time_ns_t val) {
+                avg = avg == 0 ? val : (15 * avg + val) / 16;
+        }
+};
+
 /**
  * This function captures video and possibly compresses it.
  * It then delegates sending to another thread.
  *
+ * Frames of captures without dispose callback are copied to a pool (unless
+ * disabled by "capture-no-pool" or it doesn't pay off, see capture_copy_policy)
+ * so that capture and compression/sending of consecutive frames overlap.
+ * Otherwise, grab waits until the previous frame is processed.
+ *
  * @param[in] arg pointer to UltraGrid (root) module
  */
 static void *capture_thread(void *arg)
@@ -457,6 +523,13 @@ static void *capture_thread(void *arg)
         steady_clock::time_point t0 = steady_clock::now();
         int frames = 0;
         bool should_print_fps = vidcap_generic_fps(uv->capture_device);
+        if (get_commandline_param("capture-no-pool") == nullptr) {
+                uv->capture_pool = make_unique<video_frame_pool>(CAPTURE_POOL_FRAMES,
+                                *frame_pool_allocator_for("capture"));
+        }
+        video_desc pool_desc{};
+        size_t pool_data_len = 0;
+        capture_copy_policy copy_policy;
 
         while (!should_exit) {
                 /* Capture and transmit video... */
@@ -473,17 +546,21 @@ static void *capture_thread(void *arg)
                                 print_fps(&t0, &frames, uv->capture_device_name);
                         }
                         //tx_frame = vf_get_copy(tx_frame);
-                        bool wait_for_cur_uncompressed_frame;
+                        bool wait_for_cur_uncompressed_frame = false;
                         shared_ptr<video_frame> frame;
-                        if (!tx_frame->callbacks.dispose) {
+                        if (tx_frame->callbacks.dispose) {
+                                frame = shared_ptr<video_frame>(tx_frame, tx_frame->callbacks.dispose);
+                        } else if (uv->capture_pool && copy_policy.should_copy()) {
+                                time_ns_t t_start = get_time_in_ns();
+                                frame = capture_pool_copy(*uv->capture_pool, pool_desc, pool_data_len, tx_frame);
+                                capture_copy_policy::update(copy_policy.avg_copy, get_time_in_ns() - t_start);
+                        }
+                        if (!frame) {
                                 wait_obj_reset(wait_obj);
                                 wait_for_cur_uncompressed_frame = true;
                                 frame = shared_ptr<video_frame>(tx_frame, [wait_obj](struct video_frame *) {
                                                         wait_obj_notify(wait_obj);
                                                 });
-                        } else {
-                                wait_for_cur_uncompressed_frame = false;
-                                frame = shared_ptr<video_frame>(tx_frame, tx_frame->callbacks.dispose);
                         }
 
                         uv->state_video_rxtx->send(move(frame)); // std::move really important here (!)
@@ -492,7 +569,9 @@ static void *capture_thread(void *arg)
                         // or sender (uncompressed video). Grab invalidates previous frame
                         // (if not defined dispose function).
                         if (wait_for_cur_uncompressed_frame) {
+                                time_ns_t t_start = get_time_in_ns();
                                 wait_obj_wait(wait_obj);
+                                capture_copy_policy::update(copy_policy.avg_wait, get_time_in_ns() - t_start);
                                 tx_frame->callbacks.dispose = NULL;
                                 tx_frame->callbacks.dispose_udata = NULL;
                         }
@@ -505,9 +584,10 @@ static void *capture_thread(void *arg)
 }
 
 static bool parse_bitrate(char *optarg, long long int *bitrate) {
-        map<const char *, long long int> bitrate_spec_map = {
+        map<string, long long int> bitrate_spec_map = {
                 { "auto", RATE_AUTO },
                 { "dynamic", RATE_DYNAMIC },
+                { "cc", RATE_CC },
                 { "unlimited", RATE_UNLIMITED },
         };
 
@@ -518,10 +598,11 @@ static bool parse_bitrate(char *optarg, long long int *bitrate) {
         if (strcmp(optarg, "help") == 0) {
 #               define NUMERIC_PATTERN "{1-9}{0-9}*[kMG][!][E]"
                 col() << "Usage:\n" <<
-                        "\tuv " << TERM_BOLD "-l [auto | dynamic | unlimited | " << NUMERIC_PATTERN << "]\n" TERM_RESET <<
+                        "\tuv " << TERM_BOLD "-l [auto | dynamic | cc | unlimited | " << NUMERIC_PATTERN << "]\n" TERM_RESET <<
                         "where\n"
                         "\t" << TBOLD("auto") << " - spread packets across frame time\n"
                         "\t" << TBOLD("dynamic") << " - similar to \"auto\" but more relaxed - occasional huge frame can spread 1.5x frame time (default)\n"
+                        "\t" << TBOLD("cc") << " - congestion control - rate (and libavcodec bitrate) adapts to loss and RTT reported by receivers (see also \"--param help\" for tx-cc-*)\n"
                         "\t" << TBOLD("unlimited") << " - send packets at a wire speed (in bursts)\n"
                         "\t" << TBOLD(NUMERIC_PATTERN) << " - send packets at most at specified bitrate\n\n" <<
                         TBOLD("Notes: ") << "Use an exclamation mark to indicate intentionally very low bitrate. 'E' to use the value as a fixed bitrate, not cap /i. e. even the frames that may be sent at lower bitrate are sent at the nominal bitrate)\n" <<
@@ -1495,6 +1576,9 @@ int main(int argc, char *argv[])
 #endif /* HAVE_SCHED_SETSCHEDULER */
 #endif /* USE_RT */
 
+        if (get_commandline_param("trace-events") != nullptr) {
+                trace_events_start(get_commandline_param("trace-events"));
+        }
         control_start(control);
         kc.start();
 
@@ -1673,6 +1757,7 @@ cleanup:
         if(uv.audio)
                 audio_done(uv.audio);
         delete uv.state_video_rxtx;
+        uv.capture_pool = nullptr;
 
         if (uv.capture_device)
                 vidcap_done(uv.capture_device);
@@ -1683,6 +1768,7 @@ cleanup:
 
         kc.stop();
         control_done(control);
+        trace_events_stop();
 
         uv.stop();
         common_cleanup(init);
@@ -45,6 +45,7 @@
 
 #include "messaging.h"
 
+#include <climits>
 #include <condition_variable>
 #include <iostream>
 #include <memory>
@@ -103,6 +104,22 @@ void free_message_for_child(void *m, struct response *r) {
 
 }
 
+/**
+ * Appends msg to the receiver queue and publishes the new length for check_message().
+ * @returns the oldest message removed from the queue to keep at most max_len messages, NULL otherwise
+ */
+static struct message *msg_queue_push(struct module *receiver, struct message *msg, int max_len)
+{
+        pthread_mutex_guard guard(receiver->msg_queue_lock);
+        struct message *dropped = nullptr;
+        if (simple_linked_list_size(receiver->msg_queue) >= max_len) {
+                dropped = (struct message *) simple_linked_list_pop(receiver->msg_queue);
+        }
+        simple_linked_list_append(receiver->msg_queue, msg);
+        __atomic_store_n(&receiver->msg_queue_len, simple_linked_list_size(receiver->msg_queue), __ATOMIC_RELEASE);
+        return dropped;
+}
+
 /**
  * Stores message to module message box. If new_message callback is present it is called. Otherwise it
  * may take a long time until module reads the message therefore setting timeout_ms is strongly
@@ -202,17 +219,11 @@ static struct response *send_message_common(struct module *root, const char *con
 
         //pthread_mutex_guard guard(receiver->lock, lock_guard_retain_ownership_t());
 
-        pthread_mutex_lock(&receiver->msg_queue_lock);
-        int size = simple_linked_list_size(receiver->msg_queue);
-        pthread_mutex_unlock(&receiver->msg_queue_lock);
-        if (size >= MAX_MESSAGES) {
-                struct message *m = (struct message *) simple_linked_list_pop(receiver->msg_queue);
-                free_message(m, new_response(RESPONSE_INT_SERV_ERR, "Too many unprocessed messages"));
+        struct message *dropped = msg_queue_push(receiver, msg, MAX_MESSAGES);
+        if (dropped != nullptr) {
+                free_message(dropped, new_response(RESPONSE_INT_SERV_ERR, "Too many unprocessed messages"));
                 printf("Dropping some messages for %s - queue full.\n", const_path);
         }
-        pthread_mutex_lock(&receiver->msg_queue_lock);
-        simple_linked_list_append(receiver->msg_queue, msg);
-        pthread_mutex_unlock(&receiver->msg_queue_lock);
 
         if (receiver->new_message) {
                 receiver->new_message(receiver);
@@ -282,9 +293,7 @@ void module_check_undelivered_messages(struct module *node)
 
 struct response *send_message_to_receiver(struct module *receiver, struct message *msg)
 {
-        pthread_mutex_lock(&receiver->msg_queue_lock);
-        simple_linked_list_append(receiver->msg_queue, msg);
-        pthread_mutex_unlock(&receiver->msg_queue_lock);
+        msg_queue_push(receiver, msg, INT_MAX);
 
         pthread_mutex_guard guard(receiver->lock);
         if (receiver->new_message) {
@@ -387,10 +396,17 @@ const char *response_status_to_text(int status)
 
 struct message *check_message(struct module *mod)
 {
+        // called per frame or packet in hot loops, don't lock unless there is something
+        if (__atomic_load_n(&mod->msg_queue_len, __ATOMIC_ACQUIRE) == 0) {
+                return NULL;
+        }
+
         pthread_mutex_guard guard(mod->msg_queue_lock);
 
         if(simple_linked_list_size(mod->msg_queue) > 0) {
-                return (struct message *) simple_linked_list_pop(mod->msg_queue);
+                struct message *ret = (struct message *) simple_linked_list_pop(mod->msg_queue);
+                __atomic_store_n(&mod->msg_queue_len, simple_linked_list_size(mod->msg_queue), __ATOMIC_RELEASE);
+                return ret;
         } else {
                 return NULL;
         }
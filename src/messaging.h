@@ -97,6 +97,8 @@ enum msg_sender_type {
         SENDER_MSG_CHANGE_FEC,
         SENDER_MSG_QUERY_VIDEO_MODE,
         SENDER_MSG_RESET_SSRC,
+        SENDER_MSG_ADD_FANOUT,          ///< add an additional receiver of the same stream
+        SENDER_MSG_REMOVE_FANOUT,       ///< remove receiver added with SENDER_MSG_ADD_FANOUT
 };
 
 struct msg_sender {
@@ -109,6 +111,10 @@ struct msg_sender {
                 };
                 char receiver[128];
                 char fec_cfg[1024];
+                struct {
+                        char addr[128];
+                        int port;
+                } fanout; ///< SENDER_MSG_ADD_FANOUT, SENDER_MSG_REMOVE_FANOUT
         };
 };
 
@@ -121,6 +121,8 @@ struct module {
 
         pthread_mutex_t msg_queue_lock; // protects msg_queue
         struct simple_linked_list *msg_queue;
+        int msg_queue_len; ///< length of msg_queue, written with msg_queue_lock held, read atomically
+                           ///< without it so that check_message() locks only if something is queued
 
         struct simple_linked_list *msg_queue_childs; ///< messages for childern that were not delivered
 
@@ -19,6 +19,7 @@
 #include "compat/gettimeofday.h"
 
 #include "ntp.h"
+#include "utils/ptp_clock.h"
 
 #define SECS_BETWEEN_1900_1970 2208988800u
 
@@ -27,6 +28,13 @@ void ntp64_time(uint32_t * ntp_sec, uint32_t * ntp_frac)
         struct timeval now;
         uint32_t tmp;           /* now.tv_usec is signed on many platforms; compensate */
 
+        if (ptp_clock_enabled()) { /* PTP time in sender reports, see utils/ptp_clock.h */
+                time_ns_t ptp = ptp_clock_get_ns();
+                *ntp_sec = ptp / NS_IN_SEC + SECS_BETWEEN_1900_1970;
+                *ntp_frac = ((uint64_t) (ptp % NS_IN_SEC) << 32U) / NS_IN_SEC;
+                return;
+        }
+
         gettimeofday(&now, NULL);
 
         /* NB ntp_frac is in units of 1 / (2^32 - 1) secs. */
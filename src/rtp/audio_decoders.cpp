@@ -70,6 +70,7 @@
 #include <algorithm>
 #include <cctype>
 #include <chrono>
+#include <cmath>
 #include <cstring>
 #include <ctime>
 #include <iomanip>
@@ -78,6 +79,7 @@
 #include <utility>
 #include <vector>
 
+using std::chrono::duration;
 using std::chrono::duration_cast;
 using std::chrono::seconds;
 using std::chrono::steady_clock;
@@ -186,6 +188,146 @@ public:
         }
 };
 
+ADD_TO_PARAM("audio-jitter-buffer", "* audio-jitter-buffer=off|auto|<min_ms>\n"
+                "  Adaptive audio jitter buffer with clock drift compensation (needs SpeexDSP). Keeps the playback\n"
+                "  buffer at minimal safe delay given the network jitter. auto (default) - enabled if the playback\n"
+                "  device reports its buffer fill, <min_ms> - always enabled with the minimal delay in ms\n");
+/**
+ * Adaptive jitter buffer - tracks the playback buffer fill level and network
+ * jitter and computes drift compensation applied by the resampler. The fill
+ * is driven towards the minimal safe delay by a PI controller, the integral
+ * part of which converges to the clock drift between sender and receiver.
+ *
+ * If the playback device doesn't report the fill (AUDIO_PLAYBACK_CTL_QUERY_FILL),
+ * it is modelled as the audio delivered minus the wall-clock time elapsed.
+ * The model has unknown offset, so only the initial fill is held then.
+ *
+ * With a pull-mode device (AUDIO_PLAYBACK_CTL_PULL), the minimal delay is one
+ * device period instead of the default (unless set explicitly).
+ */
+struct audio_jitter_buffer {
+        static constexpr double MAX_PPM = 2000; ///< maximal correction - about 3.5 cents of pitch
+        static constexpr double KP = 0.02;      ///< correction per excess second of fill
+        static constexpr double KI = KP / 60;   ///< integral time 1 minute
+        static constexpr double FILL_TAU = 2.0; ///< fill smoothing time constant [s]
+        static constexpr double WARMUP = 2.0;   ///< no correction before this time [s]
+
+        void init() {
+                const char *cfg = get_commandline_param("audio-jitter-buffer");
+                if (cfg == nullptr || strcmp(cfg, "auto") == 0) {
+                        mode = AUTO;
+                } else if (strcmp(cfg, "off") == 0) {
+                        mode = OFF;
+                } else {
+                        mode = FORCED;
+                        min_delay = atof(cfg) / 1000.0;
+                }
+#ifndef HAVE_SPEEXDSP
+                if (mode == FORCED) {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Jitter buffer requires SpeexDSP, disabling.\n");
+                }
+                mode = OFF;
+#endif
+        }
+
+        void reset(audio_playback_ctl_t ctl, void *state) {
+                int fill = 0;
+                size_t len = sizeof fill;
+                model_fill = !ctl(state, AUDIO_PLAYBACK_CTL_QUERY_FILL, &fill, &len);
+                len = sizeof fill;
+                pull = ctl(state, AUDIO_PLAYBACK_CTL_PULL, &fill, &len);
+                enabled = mode == FORCED || (mode == AUTO && !model_fill);
+                frames = 0;
+                elapsed = delivered = jitter = fill_avg = integral = 0.0;
+                drift = 1.0;
+                if (enabled) {
+                        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Adaptive jitter buffer enabled (%s fill).\n",
+                                        model_fill ? "modelled" : "device reported");
+                }
+        }
+
+        /**
+         * @param in_duration  duration of the received frame (at sender rate)
+         * @param out_rate     playback sample rate
+         * @returns            drift to be passed to audio_frame2::resample()
+         */
+        double update(audio_playback_ctl_t ctl, void *state, double in_duration, int out_rate) {
+                if (!enabled) {
+                        return 1.0;
+                }
+                auto now = steady_clock::now();
+                if (frames++ == 0) {
+                        t0 = last_arrival = now;
+                        last_duration = in_duration;
+                        delivered = in_duration;
+                        return drift;
+                }
+                // RFC 3550 interarrival jitter
+                double d = duration<double>(now - last_arrival).count() - last_duration;
+                jitter += (fabs(d) - jitter) / 16;
+                last_arrival = now;
+                last_duration = in_duration;
+                elapsed += in_duration;
+
+                double fill = delivered - duration<double>(now - t0).count();
+                if (!model_fill) {
+                        int samples = 0;
+                        size_t len = sizeof samples;
+                        if (ctl(state, AUDIO_PLAYBACK_CTL_QUERY_FILL, &samples, &len)) {
+                                fill = (double) samples / out_rate;
+                        }
+                }
+                delivered += in_duration / drift;
+                double alpha = std::min(in_duration / FILL_TAU, 1.0);
+                fill_avg = elapsed <= in_duration ? fill : fill_avg + alpha * (fill - fill_avg);
+
+                if (elapsed < WARMUP) {
+                        target = fill_avg;
+                        return drift;
+                }
+                if (!model_fill) {
+                        double floor = min_delay;
+                        int period = 0;
+                        size_t len = sizeof period;
+                        if (pull && mode != FORCED && ctl(state, AUDIO_PLAYBACK_CTL_PULL, &period, &len)) {
+                                floor = (double) period / out_rate;
+                        }
+                        target = std::max(floor, 3 * jitter + in_duration);
+                }
+                double err = fill_avg - target;
+                integral = std::clamp(integral + KI * err * in_duration * 1e6, -MAX_PPM, MAX_PPM);
+                double ppm = std::clamp(KP * err * 1e6 + integral, -MAX_PPM, MAX_PPM);
+                drift = 1.0 + ppm / 1e6;
+
+                if (duration_cast<seconds>(now - last_report).count() >= CUMULATIVE_REPORTS_INTERVAL) {
+                        LOG(LOG_LEVEL_VERBOSE) << MOD_NAME << "Jitter buffer: fill " << fill_avg * 1000 << " ms (target "
+                                << target * 1000 << " ms), jitter " << jitter * 1000 << " ms, drift compensation "
+                                << ppm << " ppm\n";
+                        last_report = now;
+                }
+                return drift;
+        }
+
+private:
+        enum { OFF, AUTO, FORCED } mode = OFF;
+        double min_delay = 0.02; ///< [s]
+        bool enabled = false;
+        bool model_fill = false;
+        bool pull = false;
+        int frames = 0;
+        steady_clock::time_point t0;
+        steady_clock::time_point last_arrival;
+        steady_clock::time_point last_report;
+        double last_duration = 0.0;
+        double elapsed = 0.0;   ///< received audio duration since restart [s]
+        double delivered = 0.0; ///< delivered audio duration after compensation [s]
+        double jitter = 0.0;    ///< [s]
+        double fill_avg = 0.0;  ///< [s]
+        double target = 0.0;    ///< [s]
+        double integral = 0.0;  ///< [ppm]
+        double drift = 1.0;
+};
+
 struct state_audio_decoder {
         uint32_t magic;
 
@@ -221,6 +363,11 @@ struct state_audio_decoder {
         fec_desc fec_state_desc;
 
         struct state_audio_decoder_summary summary;
+        struct audio_jitter_buffer jitter_buffer;
+
+        vector<float> mix_planes;      ///< planar float output channels (reused)
+        vector<float *> mix_plane_ptrs;
+        vector<float> input_plane;
 };
 
 constexpr double VOL_UP = 1.1;
@@ -260,6 +407,7 @@ void *audio_decoder_init(char *audio_channel_map, const char *audio_scale, const
         assert(audio_scale != NULL);
 
         s = new struct state_audio_decoder();
+        s->jitter_buffer.init();
         s->magic = AUDIO_DECODER_MAGIC;
         s->audio_playback_ctl_func = c;
         s->audio_playback_state = p_state;
@@ -503,6 +651,7 @@ static bool audio_decoder_reconfigure(struct state_audio_decoder *decoder, struc
         decoder->decoded.init(input_channels, AC_PCM,
                         device_desc.bps, device_desc.sample_rate);
         decoder->decoded.reserve(device_desc.bps * device_desc.sample_rate * 6);
+        decoder->jitter_buffer.reset(decoder->audio_playback_ctl_func, decoder->audio_playback_state);
 
         decoder->audio_decompress = audio_codec_reconfigure(decoder->audio_decompress, audio_codec, AUDIO_DECODER);
         if(!decoder->audio_decompress) {
@@ -514,6 +663,52 @@ static bool audio_decoder_reconfigure(struct state_audio_decoder *decoder, struc
         return true;
 }
 
+/**
+ * Remaps, scales and mixes decompressed channels to the interleaved output
+ * buffer - channels are converted to planar float once, mixed with the
+ * vectorized kernels and interleaved back in one pass. Used up to 24 bits
+ * per sample, when the float representation is exact.
+ */
+static void audio_decoder_mix_planar(struct state_audio_decoder *decoder, struct pbuf_audio_data *s,
+                audio_frame2 &decompressed, int input_channels)
+{
+        const int bps = decompressed.get_bps();
+        const int samples = decompressed.get_data_len(0) / bps;
+        const int out_channels = s->buffer.ch_count;
+
+        decoder->mix_planes.assign((size_t) samples * out_channels, 0.0F);
+        decoder->mix_plane_ptrs.resize(out_channels);
+        for (int i = 0; i < out_channels; ++i) {
+                decoder->mix_plane_ptrs[i] = decoder->mix_planes.data() + (size_t) i * samples;
+        }
+        decoder->input_plane.resize(samples);
+        float *in = decoder->input_plane.data();
+
+        for (int channel = 0; channel < decompressed.get_channel_count(); ++channel) {
+                int channel_samples = std::min<int>(decompressed.get_data_len(channel) / bps, samples);
+                audio_interleaved_to_planar_float(&in, decompressed.get_data(channel), bps, channel_samples, 1);
+                if (decoder->channel_remapping) {
+                        if (channel >= decoder->channel_map.size) {
+                                continue;
+                        }
+                        for (int i = 0; i < decoder->channel_map.sizes[channel]; ++i) {
+                                int new_position = decoder->channel_map.map[channel][i];
+                                if (new_position >= out_channels) {
+                                        continue;
+                                }
+                                audio_planar_float_mix(decoder->mix_plane_ptrs[new_position], in,
+                                                decoder->scale.at(decoder->fixed_scale ? 0 : new_position).scale, channel_samples);
+                        }
+                } else if (channel < out_channels) {
+                        audio_planar_float_mix(decoder->mix_plane_ptrs[channel], in,
+                                        decoder->scale.at(decoder->fixed_scale ? 0 : input_channels).scale, channel_samples);
+                }
+        }
+
+        audio_planar_float_to_interleaved(s->buffer.data + s->buffer.data_len, s->buffer.bps,
+                        decoder->mix_plane_ptrs.data(), samples, out_channels);
+}
+
 static bool audio_fec_decode(struct pbuf_audio_data *s, vector<pair<vector<char>, map<int, int>>> &fec_data, uint32_t fec_params, audio_frame2 &received_frame)
 {
         struct state_audio_decoder *decoder = s->decoder;
@@ -567,6 +762,67 @@ static bool audio_fec_decode(struct pbuf_audio_data *s, vector<pair<vector<char>
         return true;
 }
 
+/**
+ * Processes all segments of a PT_AUDIO_PACKED packet.
+ */
+static bool audio_decode_packed(struct pbuf_audio_data *s, rtp_packet *pckt, audio_frame2 &received_frame,
+                int *input_channels, int *bufnum)
+{
+        struct state_audio_decoder *decoder = s->decoder;
+        const int seg_hdr_len = sizeof(audio_packed_segment_hdr_t);
+        const char *end = pckt->data + pckt->data_len;
+
+        /* the packet with m-bit carries the last channel as the last segment,
+         * thus the channel count can be set only from it */
+        if (pckt->m) {
+                for (const char *p = pckt->data; end - p >= seg_hdr_len; ) {
+                        audio_packed_segment_hdr_t hdr;
+                        memcpy(hdr, p, sizeof hdr);
+                        *input_channels = ((ntohl(hdr[1]) >> 22) & 0x3ff) + 1;
+                        p += seg_hdr_len + ntohl(hdr[0]);
+                }
+        }
+        if (*input_channels <= 0) {
+                return false;
+        }
+
+        for (const char *p = pckt->data; end - p >= seg_hdr_len; ) {
+                audio_packed_segment_hdr_t hdr;
+                memcpy(hdr, p, sizeof hdr);
+                unsigned int length = ntohl(hdr[0]);
+                const char *data = p + seg_hdr_len;
+                if (length > (size_t) (end - data)) {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Malformed packed audio packet!\n");
+                        return false;
+                }
+                p = data + length;
+
+                const uint32_t *audio_hdr = hdr + 1;
+                int channel = (ntohl(audio_hdr[0]) >> 22) & 0x3ff;
+                *bufnum = ntohl(audio_hdr[0]) & ((1U<<BUFNUM_BITS) - 1U);
+                int sample_rate = ntohl(audio_hdr[3]) & 0x3fffff;
+                unsigned int offset = ntohl(audio_hdr[1]);
+                unsigned int buffer_len = ntohl(audio_hdr[2]);
+                int bps = (ntohl(audio_hdr[3]) >> 26) / 8;
+                uint32_t audio_tag = ntohl(audio_hdr[4]);
+
+                if (channel >= *input_channels) {
+                        continue;
+                }
+                if (packet_counter_get_channels(decoder->packet_counter) != *input_channels) {
+                        packet_counter_destroy(decoder->packet_counter);
+                        decoder->packet_counter = packet_counter_init(*input_channels);
+                }
+                if (!audio_decoder_reconfigure(decoder, s, received_frame, *input_channels, bps, sample_rate, audio_tag)) {
+                        return false;
+                }
+                received_frame.replace(channel, offset, data, length);
+                received_frame.resize(channel, buffer_len);
+                packet_counter_register_packet(decoder->packet_counter, channel, *bufnum, offset, length);
+        }
+        return true;
+}
+
 int decode_audio_frame(struct coded_data *cdata, void *pbuf_data, struct pbuf_stats *)
 {
         struct pbuf_audio_data *s = (struct pbuf_audio_data *) pbuf_data;
@@ -624,6 +880,18 @@ int decode_audio_frame(struct coded_data *cdata, void *pbuf_data, struct pbuf_st
                         return FALSE;
                 }
 
+                if (pt == PT_AUDIO_PACKED) {
+                        if (!audio_decode_packed(s, cdata->data, received_frame, &input_channels, &bufnum)) {
+                                return FALSE;
+                        }
+                        if (first) {
+                                memcpy(&s->source, ((char *) cdata->data) + RTP_MAX_PACKET_LEN, sizeof(struct sockaddr_storage));
+                                first = false;
+                        }
+                        cdata = cdata->nxt;
+                        continue;
+                }
+
                 unsigned int length;
                 char plaintext[cdata->data->data_len]; // plaintext will be actually shorter
                 size_t main_hdr_len = PT_AUDIO_HAS_FEC(pt) ? sizeof(fec_payload_hdr_t) : sizeof(audio_payload_hdr_t);
@@ -722,11 +990,14 @@ int decode_audio_frame(struct coded_data *cdata, void *pbuf_data, struct pbuf_st
                 return FALSE;
         }
 
-        if (s->buffer.sample_rate != decompressed.get_sample_rate()) {
+        double drift = decoder->jitter_buffer.update(decoder->audio_playback_ctl_func, decoder->audio_playback_state,
+                        (double) decompressed.get_data_len(0) / decompressed.get_bps() / decompressed.get_sample_rate(),
+                        s->buffer.sample_rate);
+        if (s->buffer.sample_rate != decompressed.get_sample_rate() || drift != 1.0) {
                 if (decompressed.get_bps() != 2) {
                         decompressed.change_bps(2);
                 }
-                if (!decompressed.resample(decoder->resampler, s->buffer.sample_rate)) {
+                if (!decompressed.resample(decoder->resampler, s->buffer.sample_rate, drift)) {
                         LOG(LOG_LEVEL_INFO) << MOD_NAME << "You may try to set different sampling on sender.\n";
                         return FALSE;
                 }
@@ -744,7 +1015,9 @@ int decode_audio_frame(struct coded_data *cdata, void *pbuf_data, struct pbuf_st
 
         memset(s->buffer.data + s->buffer.data_len, 0, new_data_len - s->buffer.data_len);
 
-        if (!decoder->muted) {
+        if (!decoder->muted && s->buffer.bps <= 3) {
+                audio_decoder_mix_planar(decoder, s, decompressed, input_channels);
+        } else if (!decoder->muted) {
                 // there is a mapping for channel
                 for(int channel = 0; channel < decompressed.get_channel_count(); ++channel) {
                         if(decoder->channel_remapping) {
@@ -0,0 +1,174 @@
+/**
+ * @file   rtp/av_sync.cpp
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <mutex>
+
+#include "debug.h"
+#include "host.h"
+#include "rtp/av_sync.h"
+#include "utils/macros.h"
+
+#define MOD_NAME "[AV sync] "
+#define DEFAULT_MAX_DELAY_MS 500
+#define OFFSET_SMOOTHING 0.05           ///< EWMA coefficient of per-frame offsets
+#define OFFSET_RESET_MS 1000.0          ///< larger jump is considered a new stream
+#define UPDATE_INTERVAL_NS (NS_IN_SEC / 2)
+#define STALE_NS (2 * NS_IN_SEC)        ///< stream not reported for this long is not synchronized
+#define CORRECTION_GAIN 0.3
+#define MAX_STEP_MS 20.0                ///< max correction step per update not to disturb playout
+#define DEADBAND_MS 1.0
+
+using std::clamp;
+using std::lock_guard;
+using std::mutex;
+
+ADD_TO_PARAM("av-sync", "* av-sync[=<max_ms>]\n"
+                "  Align audio and video playout using RTP timestamps and RTCP SR (UltraGrid RTP only),\n"
+                "  delaying the stream that is ahead by at most max_ms (default " TOSTRING(DEFAULT_MAX_DELAY_MS) ").\n"
+                "  The stream sender must send SR timestamps in the media clock.\n");
+
+namespace {
+struct av_sync_state {
+        av_sync_state() {
+                const char *param = get_commandline_param("av-sync");
+                enabled = param != nullptr;
+                if (enabled && param[0] != '\0') {
+                        max_delay_ms = atoi(param);
+                }
+                if (enabled) {
+                        LOG(LOG_LEVEL_NOTICE) << MOD_NAME << "A/V synchronization enabled, maximal delay " << max_delay_ms << " ms.\n";
+                }
+        }
+
+        bool enabled;
+        int max_delay_ms = DEFAULT_MAX_DELAY_MS;
+
+        mutex lock;
+        struct {
+                bool valid;
+                double offset_ms; ///< smoothed playout time minus sender time
+                time_ns_t last_report;
+        } media[AV_SYNC_MEDIA_COUNT]{};
+        double video_minus_audio_ms = 0; ///< current correction, positive delays video
+        time_ns_t last_update = 0;
+
+        std::atomic<int> delay_ms[AV_SYNC_MEDIA_COUNT]{};
+
+        void update(time_ns_t now);
+};
+
+av_sync_state &get_state() {
+        static av_sync_state state;
+        return state;
+}
+
+void av_sync_state::update(time_ns_t now)
+{
+        for (auto &m : media) {
+                if (!m.valid || now - m.last_report > STALE_NS) {
+                        return;
+                }
+        }
+        last_update = now;
+
+        // positive - audio is played out later than video for the same sender time
+        double err = media[AV_SYNC_AUDIO].offset_ms - media[AV_SYNC_VIDEO].offset_ms;
+        if (fabs(err) < DEADBAND_MS) {
+                return;
+        }
+        video_minus_audio_ms += clamp(err * CORRECTION_GAIN, -MAX_STEP_MS, MAX_STEP_MS);
+        video_minus_audio_ms = clamp<double>(video_minus_audio_ms, -max_delay_ms, max_delay_ms);
+        delay_ms[AV_SYNC_VIDEO] = lround(std::max(video_minus_audio_ms, 0.0));
+        delay_ms[AV_SYNC_AUDIO] = lround(std::max(-video_minus_audio_ms, 0.0));
+        LOG(LOG_LEVEL_DEBUG) << MOD_NAME << "A-V offset difference " << err << " ms, delaying audio by "
+                << delay_ms[AV_SYNC_AUDIO] << " ms, video by " << delay_ms[AV_SYNC_VIDEO] << " ms\n";
+}
+} // end of anonymous namespace
+
+bool av_sync_enabled(void)
+{
+        return get_state().enabled;
+}
+
+/**
+ * @param playout_time local time when the frame is played out
+ * @param sender_time  sender wall-clock time corresponding to frame RTP timestamp
+ */
+void av_sync_report(enum av_sync_media media, time_ns_t playout_time, time_ns_t sender_time)
+{
+        auto &s = get_state();
+        if (!s.enabled || media < 0 || media >= AV_SYNC_MEDIA_COUNT) {
+                return;
+        }
+        double offset_ms = (double) (playout_time - sender_time) / (NS_IN_SEC_DBL / 1000);
+
+        lock_guard<mutex> lk(s.lock);
+        auto &m = s.media[media];
+        if (!m.valid || fabs(offset_ms - m.offset_ms) > OFFSET_RESET_MS) {
+                m.offset_ms = offset_ms;
+                m.valid = true;
+        } else {
+                m.offset_ms += OFFSET_SMOOTHING * (offset_ms - m.offset_ms);
+        }
+        m.last_report = playout_time;
+        if (playout_time - s.last_update > UPDATE_INTERVAL_NS) {
+                s.update(playout_time);
+        }
+}
+
+/**
+ * @returns additional playout delay of the media in ms
+ */
+int av_sync_get_delay_ms(enum av_sync_media media)
+{
+        auto &s = get_state();
+        if (!s.enabled || media < 0 || media >= AV_SYNC_MEDIA_COUNT) {
+                return 0;
+        }
+        return s.delay_ms[media];
+}
+
+/* vim: set expandtab sw=8: */
@@ -0,0 +1,73 @@
+/**
+ * @file   rtp/av_sync.h
+ * @brief  Shared media clock aligning audio and video playout
+ *
+ * Both receivers report, for every played frame, the offset between the local
+ * playout time and the sender wall-clock time of the frame (derived from the
+ * RTP timestamp and the RTCP SR NTP/RTP timestamp pair). The difference of the
+ * audio and video offsets is then compensated by delaying the stream that is
+ * ahead.
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef RTP_AV_SYNC_H_
+#define RTP_AV_SYNC_H_
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+
+#include "tv.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum av_sync_media {
+        AV_SYNC_NONE = -1,
+        AV_SYNC_AUDIO = 0,
+        AV_SYNC_VIDEO,
+        AV_SYNC_MEDIA_COUNT
+};
+
+bool av_sync_enabled(void);
+void av_sync_report(enum av_sync_media media, time_ns_t playout_time, time_ns_t sender_time);
+int av_sync_get_delay_ms(enum av_sync_media media);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // defined RTP_AV_SYNC_H_
+
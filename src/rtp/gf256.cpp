@@ -0,0 +1,291 @@
+/**
+ * @file   rtp/gf256.cpp
+ * @author Martin Pulec     <pulec@cesnet.cz>
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#if (defined __x86_64__ || defined __i386__) && defined __GNUC__
+#include <immintrin.h>
+#define GF256_X86_DISPATCH 1
+#endif
+#if defined __aarch64__ && defined __ARM_NEON
+#include <arm_neon.h>
+#define GF256_NEON 1
+#endif
+
+#include "debug.h"
+#include "host.h"
+#include "rtp/gf256.h"
+
+#define MOD_NAME "[GF256] "
+#define GF256_POLY 0x11d
+
+using std::vector;
+
+namespace {
+struct gf256_tables {
+        gf256_tables();
+        uint8_t exp[510];
+        uint8_t log[256];
+        uint8_t mul[256][256];
+        /// split tables - products with low and high nibble
+        alignas(32) uint8_t mul_lo[256][16];
+        alignas(32) uint8_t mul_hi[256][16];
+};
+
+gf256_tables::gf256_tables()
+{
+        unsigned int x = 1;
+        for (int i = 0; i < 255; ++i) {
+                exp[i] = exp[i + 255] = x;
+                log[x] = i;
+                x <<= 1;
+                if (x & 0x100) {
+                        x ^= GF256_POLY;
+                }
+        }
+        log[0] = 0;
+        for (int a = 0; a < 256; ++a) {
+                for (int b = 0; b < 256; ++b) {
+                        mul[a][b] = a == 0 || b == 0 ? 0 : exp[log[a] + log[b]];
+                }
+                for (int i = 0; i < 16; ++i) {
+                        mul_lo[a][i] = mul[a][i];
+                        mul_hi[a][i] = mul[a][i << 4];
+                }
+        }
+}
+
+const gf256_tables &get_tables()
+{
+        static const gf256_tables tables;
+        return tables;
+}
+
+typedef void (*region_fn_t)(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len);
+
+template<bool add>
+void region_scalar(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+{
+        const uint8_t *row = get_tables().mul[c];
+        for (size_t i = 0; i < len; ++i) {
+                dst[i] = (add ? dst[i] : 0) ^ row[src[i]];
+        }
+}
+
+#ifdef GF256_X86_DISPATCH
+template<bool add>
+__attribute__((target("ssse3"))) void region_ssse3(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+{
+        const __m128i lo = _mm_load_si128((const __m128i *)(const void *) get_tables().mul_lo[c]);
+        const __m128i hi = _mm_load_si128((const __m128i *)(const void *) get_tables().mul_hi[c]);
+        const __m128i mask = _mm_set1_epi8(0x0f);
+        size_t i = 0;
+        for ( ; i + 16 <= len; i += 16) {
+                __m128i in = _mm_loadu_si128((const __m128i *)(const void *)(src + i));
+                __m128i out = _mm_xor_si128(_mm_shuffle_epi8(lo, _mm_and_si128(in, mask)),
+                                _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi64(in, 4), mask)));
+                if (add) {
+                        out = _mm_xor_si128(out, _mm_loadu_si128((const __m128i *)(void *)(dst + i)));
+                }
+                _mm_storeu_si128((__m128i *)(void *)(dst + i), out);
+        }
+        region_scalar<add>(dst + i, src + i, c, len - i);
+}
+
+template<bool add>
+__attribute__((target("avx2"))) void region_avx2(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+{
+        const __m256i lo = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)(const void *) get_tables().mul_lo[c]));
+        const __m256i hi = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)(const void *) get_tables().mul_hi[c]));
+        const __m256i mask = _mm256_set1_epi8(0x0f);
+        size_t i = 0;
+        for ( ; i + 32 <= len; i += 32) {
+                __m256i in = _mm256_loadu_si256((const __m256i *)(const void *)(src + i));
+                __m256i out = _mm256_xor_si256(_mm256_shuffle_epi8(lo, _mm256_and_si256(in, mask)),
+                                _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi64(in, 4), mask)));
+                if (add) {
+                        out = _mm256_xor_si256(out, _mm256_loadu_si256((const __m256i *)(void *)(dst + i)));
+                }
+                _mm256_storeu_si256((__m256i *)(void *)(dst + i), out);
+        }
+        region_scalar<add>(dst + i, src + i, c, len - i);
+}
+#endif // defined GF256_X86_DISPATCH
+
+#ifdef GF256_NEON
+template<bool add>
+void region_neon(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+{
+        const uint8x16_t lo = vld1q_u8(get_tables().mul_lo[c]);
+        const uint8x16_t hi = vld1q_u8(get_tables().mul_hi[c]);
+        const uint8x16_t mask = vdupq_n_u8(0x0f);
+        size_t i = 0;
+        for ( ; i + 16 <= len; i += 16) {
+                uint8x16_t in = vld1q_u8(src + i);
+                uint8x16_t out = veorq_u8(vqtbl1q_u8(lo, vandq_u8(in, mask)),
+                                vqtbl1q_u8(hi, vshrq_n_u8(in, 4)));
+                if (add) {
+                        out = veorq_u8(out, vld1q_u8(dst + i));
+                }
+                vst1q_u8(dst + i, out);
+        }
+        region_scalar<add>(dst + i, src + i, c, len - i);
+}
+#endif // defined GF256_NEON
+
+struct gf256_impl {
+        const char *name;
+        region_fn_t mul;
+        region_fn_t mul_add;
+        bool (*supported)();
+};
+
+const struct gf256_impl impls[] = {
+#ifdef GF256_X86_DISPATCH
+        { "avx2", region_avx2<false>, region_avx2<true>, []{ return (bool) __builtin_cpu_supports("avx2"); } },
+        { "ssse3", region_ssse3<false>, region_ssse3<true>, []{ return (bool) __builtin_cpu_supports("ssse3"); } },
+#endif
+#ifdef GF256_NEON
+        { "neon", region_neon<false>, region_neon<true>, []{ return true; } },
+#endif
+        { "scalar", region_scalar<false>, region_scalar<true>, []{ return true; } },
+};
+
+/**
+ * Selects the fastest supported implementation (may be overriden by
+ * gf256-impl param).
+ */
+const struct gf256_impl &get_impl()
+{
+        static const struct gf256_impl &impl = []() -> const struct gf256_impl & {
+                const char *req = get_commandline_param("gf256-impl");
+                for (const auto &i : impls) {
+                        if ((req == nullptr || strcmp(req, i.name) == 0) && i.supported()) {
+                                LOG(LOG_LEVEL_VERBOSE) << MOD_NAME "Using " << i.name << " implementation.\n";
+                                return i;
+                        }
+                }
+                LOG(LOG_LEVEL_WARNING) << MOD_NAME "Implementation " << req << " not available!\n";
+                return impls[sizeof impls / sizeof impls[0] - 1];
+        }();
+        return impl;
+}
+} // end of anonymous namespace
+
+ADD_TO_PARAM("gf256-impl", "* gf256-impl={avx2|ssse3|neon|scalar}\n"
+                "  Force GF(2^8) arithmetic implementation used by RS FEC.\n");
+
+uint8_t gf256_mul(uint8_t a, uint8_t b)
+{
+        return get_tables().mul[a][b];
+}
+
+/// dst = c * src
+void gf256_mul_region(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+{
+        if (c == 0) {
+                memset(dst, 0, len);
+                return;
+        }
+        get_impl().mul(dst, src, c, len);
+}
+
+/// dst ^= c * src
+void gf256_mul_add_region(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+{
+        if (c == 0) {
+                return;
+        }
+        get_impl().mul_add(dst, src, c, len);
+}
+
+/**
+ * Inverts n x n matrix (row-major) in place with Gauss-Jordan elimination.
+ * @retval false matrix is singular
+ */
+bool gf256_invert_matrix(uint8_t *matrix, unsigned int n)
+{
+        const gf256_tables &t = get_tables();
+        vector<uint8_t> inv(n * n);
+        for (unsigned int i = 0; i < n; ++i) {
+                inv[i * n + i] = 1;
+        }
+        for (unsigned int col = 0; col < n; ++col) {
+                unsigned int pivot = col;
+                while (pivot < n && matrix[pivot * n + col] == 0) {
+                        pivot++;
+                }
+                if (pivot == n) {
+                        return false;
+                }
+                if (pivot != col) {
+                        std::swap_ranges(matrix + pivot * n, matrix + pivot * n + n, matrix + col * n);
+                        std::swap_ranges(inv.begin() + pivot * n, inv.begin() + pivot * n + n, inv.begin() + col * n);
+                }
+                uint8_t c = t.exp[255 - t.log[matrix[col * n + col]]]; // inverse of the pivot
+                for (unsigned int j = 0; j < n; ++j) {
+                        matrix[col * n + j] = t.mul[c][matrix[col * n + j]];
+                        inv[col * n + j] = t.mul[c][inv[col * n + j]];
+                }
+                for (unsigned int row = 0; row < n; ++row) {
+                        uint8_t f = matrix[row * n + col];
+                        if (row == col || f == 0) {
+                                continue;
+                        }
+                        for (unsigned int j = 0; j < n; ++j) {
+                                matrix[row * n + j] ^= t.mul[f][matrix[col * n + j]];
+                                inv[row * n + j] ^= t.mul[f][inv[col * n + j]];
+                        }
+                }
+        }
+        memcpy(matrix, inv.data(), n * n);
+        return true;
+}
+
+const char *gf256_get_impl_name(void)
+{
+        return get_impl().name;
+}
+
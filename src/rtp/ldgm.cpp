@@ -41,6 +41,7 @@
 #include "config_win32.h"
 #endif /* HAVE_CONFIG_H */
 
+#include <algorithm>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
@@ -69,6 +70,7 @@
 #include "rtp/rtp.h"
 #include "rtp/rtp_callback.h"
 #include "transmit.h"
+#include "utils/misc.h" // get_cpu_core_count
 #include "video.h"
 
 using namespace std;
@@ -201,6 +203,8 @@ void ldgm::set_params(unsigned int k, unsigned int m, unsigned int c, unsigned i
 
 ADD_TO_PARAM("ldgm-device", "* ldgm-device={CPU|GPU}\n"
                 "  specify whether use CPU or GPU for LDGM\n");
+ADD_TO_PARAM("ldgm-threads", "* ldgm-threads=<n>\n"
+                "  number of threads used by CPU LDGM to encode/decode a frame (default number of cores)\n");
 
 void ldgm::init(unsigned int k, unsigned int m, unsigned int c, unsigned int seed)
 {
@@ -223,7 +227,11 @@ void ldgm::init(unsigned int k, unsigned int m, unsigned int c, unsigned int see
 
                 }
         } else {
-                m_coding_session = unique_ptr<LDGM_session>(new LDGM_session_cpu());
+                unsigned int threads = get_cpu_core_count();
+                if (get_commandline_param("ldgm-threads")) {
+                        threads = max(atoi(get_commandline_param("ldgm-threads")), 1);
+                }
+                m_coding_session = unique_ptr<LDGM_session>(new LDGM_session_cpu(threads));
         }
 
         set_params(k, m, c, seed);
@@ -54,22 +54,53 @@
 #include "compat/vsnprintf.h"
 #include "net_udp.h"
 #include "rtp.h"
+#include "utils/macros.h"
+#include "utils/mem_budget.h"
+#include "utils/metrics.h"
 #include "utils/misc.h"
 #include "utils/net.h"
+#include "utils/profile_timer.hpp"
+#include "utils/synchronized_queue.h" // queue_instrumentation
 #include "utils/thread.h"
 
+#include "tv.h"
+
 #ifdef NEED_ADDRINFO_H
 #include "addrinfo.h"
 #endif
 
+#ifdef __linux__
+#include <linux/filter.h> // SKF_AD_RANDOM
+#include <linux/net_tstamp.h> // struct sock_txtime
+#ifdef HAVE_LINUX_IF_XDP_H
+#include <linux/bpf.h>
+#include <linux/if_link.h> // XDP_FLAGS_*
+#include <linux/if_xdp.h>
+#include <net/if.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define HAVE_AF_XDP 1
+#endif
+#if defined SO_TXTIME && defined SCM_TXTIME
+#define HAVE_SO_TXTIME 1
+#endif
+#endif
+
 #include <algorithm>
 #include <array>
 #include <condition_variable>
+#include <cstddef> // max_align_t
 #include <chrono>
+#include <cmath>
+#include <memory>
 #include <mutex>
 #include <queue>
+#include <random>
 #include <string>
+#include <thread>
 #include <utility> // std::swap
+#include <vector>
 
 using std::array;
 using std::condition_variable;
@@ -82,6 +113,11 @@ using std::to_string;
 using std::unique_lock;
 
 #define DEFAULT_MAX_UDP_READER_QUEUE_LEN (1920/3*8*1080/1152) //< 10-bit FullHD frame divided by 1280 MTU packets (minus headers)
+#ifdef HAVE_RECVMMSG
+#define DEFAULT_UDP_READER_BATCH_SIZE 32 ///< max datagrams received by a single recvmmsg() call
+#else
+#define DEFAULT_UDP_READER_BATCH_SIZE 1
+#endif
 
 static int resolve_address(socket_udp *s, const char *addr, uint16_t tx_port);
 static void *udp_reader(void *arg);
@@ -137,6 +173,140 @@ struct ip_mreq {
 #define INADDR_NONE 0xffffffff
 #endif
 
+/**
+ * Header preceding every buffer returned by udp_packet_alloc() or taken from
+ * a udp_packet_pool. It is hidden from the user who sees only the memory after
+ * it and identifies the pool the buffer should be returned to (if any).
+ */
+struct alignas(std::max_align_t) udp_packet_prefix {
+        struct udp_packet_pool *pool;
+};
+
+/**
+ * Base of packet buffer pools. Pool outlives its socket until the last
+ * outstanding buffer is returned by udp_packet_free().
+ */
+struct udp_packet_pool {
+        virtual ~udp_packet_pool() = default;
+        virtual void put(struct udp_packet_prefix *buf) = 0;
+        void release();
+
+        mutex lock;
+        unsigned int outstanding = 0; ///< buffers passed to the user
+        bool orphaned = false; ///< owning socket was destroyed
+protected:
+        void put_done(unique_lock<mutex> &lk);
+};
+
+/**
+ * Called by socket owner when it no longer uses the pool.
+ */
+void udp_packet_pool::release()
+{
+        unique_lock<mutex> lk(lock);
+        orphaned = true;
+        if (outstanding == 0) {
+                lk.unlock();
+                delete this;
+        }
+}
+
+/// to be called by put() implementations with the lock held
+void udp_packet_pool::put_done(unique_lock<mutex> &lk)
+{
+        if (--outstanding == 0 && orphaned) {
+                lk.unlock();
+                delete this;
+        }
+}
+
+/**
+ * Fixed-size slab of datagram buffers owned by a multithreaded socket.
+ *
+ * Buffers are recycled by udp_packet_free() called from the RTP layer (pbuf)
+ * once the packet is processed. If the slab is exhausted, buffers are
+ * allocated from heap and freed when returned. Both are accounted to
+ * MEM_UDP_RX of the memory budget.
+ */
+struct udp_packet_slab final : public udp_packet_pool {
+        explicit udp_packet_slab(unsigned int count);
+        ~udp_packet_slab() override;
+        void get(uint8_t **bufs, unsigned int count);
+        void put(struct udp_packet_prefix *buf) override;
+
+        static constexpr size_t entry_size = (sizeof(struct udp_packet_prefix) + RTP_MAX_PACKET_LEN
+                        + sizeof(struct sockaddr_storage) + 63) / 64 * 64;
+        std::vector<struct udp_packet_prefix *> free_list;
+        char *slab;
+        size_t slab_len;
+};
+
+udp_packet_slab::udp_packet_slab(unsigned int count) :
+        slab((char *) malloc(count * entry_size)), slab_len(count * entry_size)
+{
+        assert(slab != nullptr);
+        free_list.reserve(count);
+        for (unsigned int i = 0; i < count; ++i) {
+                auto *buf = (struct udp_packet_prefix *)(void *)(slab + (count - i - 1) * entry_size);
+                buf->pool = this;
+                free_list.push_back(buf);
+        }
+        mem_budget_add(MEM_UDP_RX, slab_len);
+}
+
+udp_packet_slab::~udp_packet_slab()
+{
+        free(slab);
+        mem_budget_add(MEM_UDP_RX, -(long long) slab_len);
+}
+
+/**
+ * Fills bufs with count datagram buffers (holding the lock only once).
+ */
+void udp_packet_slab::get(uint8_t **bufs, unsigned int count)
+{
+        unique_lock<mutex> lk(lock);
+        outstanding += count;
+        for (unsigned int i = 0; i < count; ++i) {
+                struct udp_packet_prefix *buf = nullptr;
+                if (!free_list.empty()) {
+                        buf = free_list.back();
+                        free_list.pop_back();
+                } else {
+                        buf = (struct udp_packet_prefix *) malloc(entry_size);
+                        buf->pool = this;
+                        mem_budget_add(MEM_UDP_RX, entry_size);
+                }
+                bufs[i] = (uint8_t *)(buf + 1);
+        }
+}
+
+void udp_packet_slab::put(struct udp_packet_prefix *buf)
+{
+        unique_lock<mutex> lk(lock);
+        if ((char *) buf >= slab && (char *) buf < slab + slab_len) {
+                free_list.push_back(buf);
+        } else {
+                free(buf);
+                mem_budget_add(MEM_UDP_RX, -(long long) entry_size);
+        }
+        put_done(lk);
+}
+
+/// source of packet arrival time (udp-timestamping)
+enum udp_timestamping {
+        UDP_TS_USER,     ///< taken by the reader thread
+        UDP_TS_SOFTWARE, ///< kernel RX timestamp (SO_TIMESTAMPING)
+        UDP_TS_HARDWARE, ///< NIC RX timestamp (SO_TIMESTAMPING), PHC must be synchronized to system clock
+};
+
+/// state of one reader thread, multiple readers are used with udp-rx-threads
+struct udp_reader_ctx {
+        socket_udp *s;
+        fd_t fd;
+        pthread_t thread_id;
+};
+
 struct item {
     inline item(uint8_t *b, int s, struct sockaddr *src_addr = nullptr,
                     socklen_t addrlen = 0) :
@@ -151,6 +321,219 @@ struct item {
     socklen_t addrlen;
 };
 
+/**
+ * Emulated network impairments (see udp-impair param) applied on datagrams
+ * received by a multithreaded socket before they are passed to the consumer,
+ * so that loss, reordering, jitter and a bottleneck link can be reproduced
+ * without netem or root privileges. Uses a seeded PRNG, so that runs with the
+ * same input are reproducible.
+ *
+ * Datagrams wait in a delay line until their release time, then they are
+ * moved to socket_udp_local::packets. Guarded by socket_udp_local::lock.
+ */
+struct udp_impair {
+        using clock = std::chrono::steady_clock;
+
+        static std::unique_ptr<udp_impair> create(const char *cfg);
+        ~udp_impair();
+        void push(const struct item &it, queue<struct item> &out);
+        void release(clock::time_point now, queue<struct item> &out);
+        void wait(condition_variable &cv, unique_lock<mutex> &lk, clock::time_point deadline,
+                        queue<struct item> &out);
+
+        double loss = 0;        ///< average loss ratio
+        double burst = 1;       ///< mean loss burst length [datagrams]
+        double delay = 0;       ///< one-way delay [s]
+        double jitter = 0;      ///< max delay variation (uniform +-jitter) [s]
+        double reorder = 0;     ///< ratio of datagrams held back by gap
+        double gap = 0.001;     ///< additional delay of reordered datagrams [s]
+        double rate = 0;        ///< bottleneck rate [bps], 0 - unlimited
+        double queue_len = 0.1; ///< bottleneck queue (tail-drop) length [s]
+
+        std::mt19937_64 rng{1};
+        std::uniform_real_distribution<double> uniform{0.0, 1.0};
+        bool loss_state = false; ///< Gilbert-Elliott state, true - bad (losing)
+        clock::time_point link_free; ///< time when bottleneck finishes the last datagram
+
+        struct pending {
+                clock::time_point release;
+                uint64_t seq;
+                struct item it;
+                bool operator>(const pending &other) const {
+                        return release != other.release ? release > other.release : seq > other.seq;
+                }
+        };
+        std::priority_queue<pending, std::vector<pending>, std::greater<pending>> delayed;
+        uint64_t seq = 0;
+
+        // statistics
+        uint64_t received = 0;
+        uint64_t lost = 0;
+        uint64_t rate_dropped = 0;
+        uint64_t reordered = 0;
+};
+
+ADD_TO_PARAM("udp-impair",
+                "* udp-impair=[loss=<%>][:burst=<len>][:delay=<ms>][:jitter=<ms>][:reorder=<%>][:gap=<ms>][:rate=<bps>][:queue=<ms>][:seed=<n>]\n"
+                "  Emulate network impairments on received datagrams (multithreaded sockets), eg. to test FEC\n"
+                "  or playout buffer: loss with mean burst length (Gilbert-Elliott), delay with uniform\n"
+                "  jitter, reorder - percentage of datagrams delayed by additional gap (default 1 ms),\n"
+                "  rate - bottleneck link with tail-drop queue (default 100 ms), seed of the PRNG (default 1)\n");
+/**
+ * @returns impairment state or nullptr if cfg is invalid
+ */
+std::unique_ptr<udp_impair> udp_impair::create(const char *cfg)
+{
+        auto impair = std::unique_ptr<udp_impair>(new udp_impair());
+        string tmp = cfg;
+        char *save_ptr = nullptr;
+        char *opt = nullptr;
+        char *c = &tmp[0];
+        while ((opt = strtok_r(c, ":", &save_ptr)) != nullptr) {
+                c = nullptr;
+                const char *val = strchr(opt, '=');
+                if (val == nullptr) {
+                        LOG(LOG_LEVEL_ERROR) << MOD_NAME << "Wrong udp-impair option: " << opt << "\n";
+                        return {};
+                }
+                val += 1;
+                const double num = strstr(opt, "rate=") == opt ? unit_evaluate_dbl(val) : atof(val);
+                if (std::isnan(num) || num < 0) {
+                        LOG(LOG_LEVEL_ERROR) << MOD_NAME << "Wrong udp-impair value: " << opt << "\n";
+                        return {};
+                }
+                if (strstr(opt, "loss=") == opt) {
+                        impair->loss = std::min(num / 100.0, 1.0);
+                } else if (strstr(opt, "burst=") == opt) {
+                        impair->burst = max(num, 1.0);
+                } else if (strstr(opt, "delay=") == opt) {
+                        impair->delay = num / 1000.0;
+                } else if (strstr(opt, "jitter=") == opt) {
+                        impair->jitter = num / 1000.0;
+                } else if (strstr(opt, "reorder=") == opt) {
+                        impair->reorder = std::min(num / 100.0, 1.0);
+                } else if (strstr(opt, "gap=") == opt) {
+                        impair->gap = num / 1000.0;
+                } else if (strstr(opt, "rate=") == opt) {
+                        impair->rate = num;
+                } else if (strstr(opt, "queue=") == opt) {
+                        impair->queue_len = num / 1000.0;
+                } else if (strstr(opt, "seed=") == opt) {
+                        impair->rng.seed(strtoull(val, nullptr, 0));
+                } else {
+                        LOG(LOG_LEVEL_ERROR) << MOD_NAME << "Unknown udp-impair option: " << opt << "\n";
+                        return {};
+                }
+        }
+        LOG(LOG_LEVEL_WARNING) << MOD_NAME << "Emulating impairments on received datagrams: loss "
+                << impair->loss * 100 << " % (burst " << impair->burst << "), delay "
+                << impair->delay * 1000 << " +- " << impair->jitter * 1000 << " ms, reorder "
+                << impair->reorder * 100 << " % (gap " << impair->gap * 1000 << " ms), rate "
+                << (impair->rate > 0 ? to_string((long long) impair->rate) + " bps" : string("unlimited")) << "\n";
+        return impair;
+}
+
+udp_impair::~udp_impair()
+{
+        while (!delayed.empty()) {
+                udp_packet_free(delayed.top().it.buf);
+                delayed.pop();
+        }
+        if (received > 0) {
+                LOG(LOG_LEVEL_INFO) << MOD_NAME << "Impairments: " << received << " datagrams received, "
+                        << lost << " lost, " << rate_dropped << " dropped by rate limit, "
+                        << reordered << " reordered\n";
+        }
+}
+
+/**
+ * Passes the datagram through the impairment models. It is either discarded
+ * (and freed), put into the delay line or directly to out if it is due.
+ */
+void udp_impair::push(const struct item &it, queue<struct item> &out)
+{
+        received += 1;
+        bool drop = false;
+        if (loss >= 1.0) {
+                drop = true;
+        } else if (burst <= 1.0) {
+                drop = uniform(rng) < loss;
+        } else if (loss > 0) {
+                // two-state model with loss in the bad state only, its stationary
+                // probability equals to loss and mean sojourn to burst
+                const double p_bg = 1.0 / burst;
+                const double p_gb = loss * p_bg / (1.0 - loss);
+                loss_state = uniform(rng) < (loss_state ? 1.0 - p_bg : p_gb);
+                drop = loss_state;
+        }
+        if (drop) {
+                lost += 1;
+                udp_packet_free(it.buf);
+                return;
+        }
+
+        const auto now = clock::now();
+        auto depart = now;
+        if (rate > 0) {
+                depart = std::max(now, link_free);
+                if (std::chrono::duration<double>(depart - now).count() > queue_len) {
+                        rate_dropped += 1;
+                        udp_packet_free(it.buf);
+                        return;
+                }
+                depart += std::chrono::duration_cast<clock::duration>(
+                                std::chrono::duration<double>(it.size * 8.0 / rate));
+                link_free = depart;
+        }
+        double extra = delay;
+        if (jitter > 0) {
+                extra = max(extra + jitter * (2.0 * uniform(rng) - 1.0), 0.0);
+        }
+        if (reorder > 0 && uniform(rng) < reorder) {
+                reordered += 1;
+                extra += gap;
+        }
+        const auto release_time = depart + std::chrono::duration_cast<clock::duration>(
+                        std::chrono::duration<double>(extra));
+        if (release_time <= now && delayed.empty()) {
+                out.push(it);
+                return;
+        }
+        delayed.push({release_time, seq++, it});
+}
+
+/// moves datagrams due at now from the delay line to out
+void udp_impair::release(clock::time_point now, queue<struct item> &out)
+{
+        while (!delayed.empty() && delayed.top().release <= now) {
+                out.push(delayed.top().it);
+                delayed.pop();
+        }
+}
+
+/**
+ * Waits until out is non-empty, releasing the delayed datagrams, or until
+ * the deadline passes.
+ * @param lk locked socket_udp_local::lock
+ */
+void udp_impair::wait(condition_variable &cv, unique_lock<mutex> &lk, clock::time_point deadline,
+                queue<struct item> &out)
+{
+        while (true) {
+                const auto now = clock::now();
+                release(now, out);
+                if (!out.empty() || now >= deadline) {
+                        return;
+                }
+                const auto until = delayed.empty() ? deadline : std::min(deadline, delayed.top().release);
+                if (until == clock::time_point::max()) {
+                        cv.wait(lk);
+                } else {
+                        cv.wait_until(lk, until);
+                }
+        }
+}
+
 /*
  * Local part of the socket
  *
@@ -166,12 +549,21 @@ struct socket_udp_local {
 #endif
 
         // for multithreaded receiving
-        pthread_t thread_id;
+        std::vector<struct udp_reader_ctx> readers; ///< readers[0] reads rx_fd, others SO_REUSEPORT shards
         queue<struct item> packets;
         unsigned int max_packets;
+        unsigned int batch_size; ///< number of datagrams read by reader at once
+        int busy_poll_us; ///< udp-busy-poll - reader and consumer spin instead of sleeping if nonzero
+        enum udp_timestamping timestamping; ///< source of rtp_packet::rx_time
+        struct udp_packet_slab *packet_pool;
+#ifdef HAVE_AF_XDP
+        struct udp_xdp *xdp;
+#endif
         mutex lock;
         condition_variable boss_cv;
         condition_variable reader_cv;
+        std::unique_ptr<queue_instrumentation> queue_stats; ///< guarded by lock
+        std::unique_ptr<udp_impair> impair; ///< guarded by lock, set by udp-impair
 
         bool should_exit;
         fd_t should_exit_fd[2];
@@ -196,6 +588,22 @@ struct _socket_udp {
         int overlapped_max;
         int overlapped_count;
 #endif
+#ifdef HAVE_SENDMMSG
+        // datagrams queued by udp_sendv() between udp_async_start() and udp_async_wait()
+        bool tx_batch_active;
+        std::vector<struct mmsghdr> tx_msgs;
+        std::vector<struct iovec> tx_iovs;
+        std::vector<std::pair<size_t, size_t>> tx_msg_iovs; ///< offset+count to tx_iovs per msg
+        std::vector<void *> tx_dispose;
+#endif
+#ifdef HAVE_SO_TXTIME
+        int txtime_state; ///< 0 - not yet set, 1 - SO_TXTIME enabled, -1 - unsupported
+        clockid_t txtime_clock;
+        long txtime_interval; ///< [ns], 0 - no SCM_TXTIME is attached
+        uint64_t txtime_next; ///< earliest launch time of next datagram
+        std::vector<uint64_t> tx_times; ///< launch times of batched datagrams
+        std::vector<char> tx_cmsgs;
+#endif
 };
 
 static void udp_clean_async_state(socket_udp *s);
@@ -784,9 +1192,142 @@ static bool set_sock_opts_and_bind(fd_t fd, bool ipv6, uint16_t rx_port, int ttl
         return true;
 }
 
+ADD_TO_PARAM("udp-rx-threads",
+                "* udp-rx-threads=<n>\n"
+                "  Receive unicast with n reader threads using n sockets bound with SO_REUSEPORT\n"
+                "  (Linux kernel distributes flows by hash, see also udp-rx-steering)\n");
+ADD_TO_PARAM("udp-rx-steering",
+                "* udp-rx-steering=random\n"
+                "  Distribute packets of udp-rx-threads randomly regardless of flow (even a single\n"
+                "  flow gets spread, at the cost of reordering handled by the playout buffer)\n");
+/**
+ * Opens additional sockets bound to the same port as s->local->rx_fd with
+ * SO_REUSEPORT and registers a reader for every of them so that the receive
+ * load is spread across multiple threads. All readers feed the same queue.
+ */
+static void udp_add_reader_shards(socket_udp *s, const char *addr, int count, int ttl)
+{
+#ifdef SO_REUSEPORT
+        if (count <= 1) {
+                return;
+        }
+        if (is_addr_multicast(addr)) {
+                LOG(LOG_LEVEL_WARNING) << MOD_NAME << "Multiple RX threads not supported for multicast!\n";
+                return;
+        }
+        int port = udp_get_udp_rx_port(s);
+        if (port <= 0) {
+                return;
+        }
+        for (int i = 1; i < count; ++i) {
+                fd_t fd = socket(s->sock.ss_family, SOCK_DGRAM, 0);
+                if (fd == INVALID_SOCKET) {
+                        socket_error("Unable to initialize RX shard socket");
+                        break;
+                }
+                if (!set_sock_opts_and_bind(fd, s->local->mode == IPv6, port, ttl)) {
+                        CLOSESOCKET(fd);
+                        break;
+                }
+                s->local->readers.push_back({s, fd, {}});
+        }
+#if defined __linux__ && defined SO_ATTACH_REUSEPORT_CBPF
+        const char *steering = get_commandline_param("udp-rx-steering");
+        if (steering != nullptr && strcmp(steering, "random") == 0) {
+                struct sock_filter code[] = {
+                        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, (uint32_t) (SKF_AD_OFF + SKF_AD_RANDOM)),
+                        BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, (uint32_t) s->local->readers.size()),
+                        BPF_STMT(BPF_RET | BPF_A, 0),
+                };
+                struct sock_fprog prog = { sizeof code / sizeof code[0], code };
+                if (SETSOCKOPT(s->local->rx_fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof prog) != 0) {
+                        socket_error("setsockopt SO_ATTACH_REUSEPORT_CBPF");
+                }
+        }
+#endif
+        LOG(LOG_LEVEL_VERBOSE) << MOD_NAME << "Using " << s->local->readers.size() << " RX threads.\n";
+#else
+        UNUSED(addr);
+        UNUSED(ttl);
+        if (count > 1) {
+                LOG(LOG_LEVEL_WARNING) << MOD_NAME << "Multiple RX threads not supported on this platform!\n";
+        }
+#endif
+}
+
+#ifdef HAVE_AF_XDP
+ADD_TO_PARAM("udp-xdp",
+                "* udp-xdp=<iface>[:<queue>]\n"
+                "  Receive IPv4 unicast on NIC queue (default 0) with AF_XDP bypassing kernel UDP stack.\n"
+                "  Steer the stream to the queue (eg. ethtool -N), frames must fit 3.7 KB (no jumbo).\n");
+#endif
 ADD_TO_PARAM("udp-queue-len",
                 "* udp-queue-len=<l>\n"
                 "  Use different queue size than default DEFAULT_MAX_UDP_READER_QUEUE_LEN\n");
+ADD_TO_PARAM("udp-busy-poll",
+                "* udp-busy-poll[=<us>]\n"
+                "  Reader threads and the packet consumer spin instead of sleeping, sockets\n"
+                "  busy-poll the NIC for us microseconds (SO_BUSY_POLL, default 50, Linux only).\n"
+                "  Every spinning thread occupies a CPU core, pin them with thread-affinity\n"
+                "  (threads udp_reader and the receiver), NAPI IRQ deferral is configured\n"
+                "  system-wide (napi_defer_hard_irqs, gro_flush_timeout)\n");
+/**
+ * Enables kernel busy polling of the NIC queue for the socket (udp-busy-poll).
+ */
+static void udp_set_busy_poll(fd_t fd, int busy_poll_us, int budget)
+{
+#ifdef SO_BUSY_POLL
+        if (SETSOCKOPT(fd, SOL_SOCKET, SO_BUSY_POLL, (sockopt_t) &busy_poll_us, sizeof busy_poll_us) != 0) {
+                socket_error("setsockopt SO_BUSY_POLL");
+                LOG(LOG_LEVEL_WARNING) << MOD_NAME << "Kernel busy polling not set (requires CAP_NET_ADMIN above net.core.busy_read), spinning only.\n";
+        }
+#ifdef SO_PREFER_BUSY_POLL
+        int prefer = 1;
+        SETSOCKOPT(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, (sockopt_t) &prefer, sizeof prefer);
+#endif
+#ifdef SO_BUSY_POLL_BUDGET
+        SETSOCKOPT(fd, SOL_SOCKET, SO_BUSY_POLL_BUDGET, (sockopt_t) &budget, sizeof budget);
+#else
+        UNUSED(budget);
+#endif
+#else
+        UNUSED(fd);
+        UNUSED(busy_poll_us);
+        UNUSED(budget);
+#endif
+}
+
+ADD_TO_PARAM("udp-timestamping",
+                "* udp-timestamping[=sw|hw]\n"
+                "  Packet arrival times (jitter, latency trace) taken by kernel (sw, default) or NIC (hw)\n"
+                "  instead of the reader thread, Linux only. Hardware timestamps require RX timestamping\n"
+                "  enabled on the NIC (eg. hwstamp_ctl -r 1) and its clock synchronized (phc2sys)\n");
+/**
+ * Requests RX timestamps for the socket (udp-timestamping).
+ */
+static enum udp_timestamping udp_set_timestamping(fd_t fd, const char *cfg)
+{
+#ifdef SO_TIMESTAMPING
+        const bool hw = strcmp(cfg, "hw") == 0;
+        int flags = hw ? SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE
+                : SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+        if (SETSOCKOPT(fd, SOL_SOCKET, SO_TIMESTAMPING, (sockopt_t) &flags, sizeof flags) != 0) {
+                socket_error("setsockopt SO_TIMESTAMPING");
+                return UDP_TS_USER;
+        }
+        return hw ? UDP_TS_HARDWARE : UDP_TS_SOFTWARE;
+#else
+        UNUSED(fd);
+        UNUSED(cfg);
+        LOG(LOG_LEVEL_WARNING) << MOD_NAME << "Kernel timestamping not supported on this platform!\n";
+        return UDP_TS_USER;
+#endif
+}
+
+ADD_TO_PARAM("udp-batch-size",
+                "* udp-batch-size=<n>\n"
+                "  Max number of datagrams received by the UDP reader thread with one syscall (default "
+                TOSTRING(DEFAULT_UDP_READER_BATCH_SIZE) ", 1 disables batching)\n");
 #ifdef WIN32
 ADD_TO_PARAM("udp-disable-multi-socket",
                 "* udp-disable-multi-socket\n"
@@ -809,6 +1350,447 @@ ADD_TO_PARAM("udp-disable-multi-socket",
  *
  * @returns a pointer to a socket_udp structure on success, NULL otherwise.
  **/
+#ifdef HAVE_AF_XDP
+/*
+ * AF_XDP receive backend (udp-xdp param)
+ *
+ * An XDP program redirects IPv4 UDP datagrams destined to the socket port on
+ * selected NIC queue to an AF_XDP socket. Frames are received to UMEM and
+ * handed to the RTP layer without copying - the UDP payload is prepended by
+ * the rtp_packet header that fits into the Ethernet/IP/UDP headers and the
+ * UMEM headroom. Frames are returned to the fill ring by udp_packet_free().
+ * Other traffic is passed to the kernel stack (and received by the regular
+ * reader).
+ */
+#define XDP_FRAME_COUNT 4096
+#define XDP_FRAME_SIZE 4096
+#define XDP_RING_SIZE 2048
+#define XDP_HDRS_LEN (14 + 20 + 8) ///< Ethernet + IPv4 (no options) + UDP
+/// aligns the rtp_packet header preceding UDP payload to 8 B
+#define XDP_UMEM_HEADROOM ((8 - (XDP_PACKET_HEADROOM + XDP_HDRS_LEN - RTP_PACKET_HEADER_SIZE) % 8) % 8)
+static_assert(XDP_PACKET_HEADROOM + XDP_HDRS_LEN >= RTP_PACKET_HEADER_SIZE + sizeof(struct udp_packet_prefix),
+                "not enough room for packet headers");
+
+struct udp_xdp_ring {
+        uint32_t *producer;
+        uint32_t *consumer;
+        void *ring;
+        void *map;
+        size_t map_len;
+};
+
+/// UMEM area, chunks are identified by offsets to area
+struct udp_xdp_umem final : public udp_packet_pool {
+        udp_xdp_umem(char *a, size_t l) : area(a), len(l) {}
+        ~udp_xdp_umem() override {
+                munmap(area, len);
+        }
+        void put(struct udp_packet_prefix *buf) override {
+                unique_lock<mutex> lk(lock);
+                free_chunks.push_back(((char *) buf - area) / XDP_FRAME_SIZE * XDP_FRAME_SIZE);
+                put_done(lk);
+        }
+        char *area;
+        size_t len;
+        std::vector<uint64_t> free_chunks; ///< returned by user, to be put to fill ring
+};
+
+struct udp_xdp {
+        fd_t xsk_fd = -1;
+        int map_fd = -1;
+        int prog_fd = -1;
+        int link_fd = -1;
+        struct udp_xdp_ring fill{};
+        struct udp_xdp_ring comp{};
+        struct udp_xdp_ring rx{};
+        struct udp_xdp_umem *umem = nullptr;
+        pthread_t thread_id;
+};
+
+static long sys_bpf(int cmd, union bpf_attr *attr)
+{
+        return syscall(__NR_bpf, cmd, attr, sizeof *attr);
+}
+
+static struct bpf_insn bpf_insn(uint8_t code, uint8_t dst, uint8_t src, int16_t off, int32_t imm)
+{
+        struct bpf_insn insn{};
+        insn.code = code;
+        insn.dst_reg = dst;
+        insn.src_reg = src;
+        insn.off = off;
+        insn.imm = imm;
+        return insn;
+}
+
+/**
+ * Builds an XDP program passing IPv4 UDP datagrams (not fragmented, without
+ * IP options) destined to port to the XSKMAP map_fd, rest to the stack.
+ */
+static int udp_xdp_load_prog(int map_fd, uint16_t port)
+{
+        enum { R0, R1, R2, R3, R4, R5 };
+        const int16_t PASS = 0; // placeholder, fixed below
+        std::vector<struct bpf_insn> p = {
+                bpf_insn(BPF_LDX | BPF_MEM | BPF_W, R2, R1, offsetof(struct xdp_md, data), 0),
+                bpf_insn(BPF_LDX | BPF_MEM | BPF_W, R3, R1, offsetof(struct xdp_md, data_end), 0),
+                bpf_insn(BPF_ALU64 | BPF_MOV | BPF_X, R4, R2, 0, 0),
+                bpf_insn(BPF_ALU64 | BPF_ADD | BPF_K, R4, 0, 0, XDP_HDRS_LEN),
+                bpf_insn(BPF_JMP | BPF_JGT | BPF_X, R4, R3, PASS, 0),
+                bpf_insn(BPF_LDX | BPF_MEM | BPF_H, R5, R2, 12, 0), // ethertype
+                bpf_insn(BPF_JMP | BPF_JNE | BPF_K, R5, 0, PASS, htons(0x0800)),
+                bpf_insn(BPF_LDX | BPF_MEM | BPF_B, R5, R2, 14, 0), // IP version + IHL
+                bpf_insn(BPF_JMP | BPF_JNE | BPF_K, R5, 0, PASS, 0x45),
+                bpf_insn(BPF_LDX | BPF_MEM | BPF_H, R5, R2, 20, 0), // flags + fragment offset
+                bpf_insn(BPF_ALU64 | BPF_AND | BPF_K, R5, 0, 0, htons(0x3fff)),
+                bpf_insn(BPF_JMP | BPF_JNE | BPF_K, R5, 0, PASS, 0),
+                bpf_insn(BPF_LDX | BPF_MEM | BPF_B, R5, R2, 23, 0), // protocol
+                bpf_insn(BPF_JMP | BPF_JNE | BPF_K, R5, 0, PASS, IPPROTO_UDP),
+                bpf_insn(BPF_LDX | BPF_MEM | BPF_H, R5, R2, 36, 0), // UDP dst port
+                bpf_insn(BPF_JMP | BPF_JNE | BPF_K, R5, 0, PASS, htons(port)),
+                bpf_insn(BPF_LDX | BPF_MEM | BPF_W, R2, R1, offsetof(struct xdp_md, rx_queue_index), 0),
+                bpf_insn(BPF_LD | BPF_DW | BPF_IMM, R1, BPF_PSEUDO_MAP_FD, 0, map_fd),
+                bpf_insn(0, 0, 0, 0, 0),
+                bpf_insn(BPF_ALU64 | BPF_MOV | BPF_K, R3, 0, 0, XDP_PASS), // if not in map
+                bpf_insn(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map),
+                bpf_insn(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+        };
+        const int pass_idx = p.size();
+        p.push_back(bpf_insn(BPF_ALU64 | BPF_MOV | BPF_K, R0, 0, 0, XDP_PASS));
+        p.push_back(bpf_insn(BPF_JMP | BPF_EXIT, 0, 0, 0, 0));
+        for (int i = 0; i < pass_idx; ++i) {
+                uint8_t op = BPF_OP(p[i].code);
+                if (BPF_CLASS(p[i].code) == BPF_JMP && op != BPF_CALL && op != BPF_EXIT) {
+                        p[i].off = pass_idx - (i + 1);
+                }
+        }
+
+        char log[4096] = "";
+        union bpf_attr attr{};
+        attr.prog_type = BPF_PROG_TYPE_XDP;
+        attr.insns = (uintptr_t) p.data();
+        attr.insn_cnt = p.size();
+        attr.license = (uintptr_t) "Dual BSD/GPL";
+        attr.log_buf = (uintptr_t) log;
+        attr.log_size = sizeof log;
+        attr.log_level = 1;
+        int fd = sys_bpf(BPF_PROG_LOAD, &attr);
+        if (fd < 0) {
+                socket_error("XDP program load");
+                LOG(LOG_LEVEL_VERBOSE) << MOD_NAME << "Verifier log:\n" << log << "\n";
+        }
+        return fd;
+}
+
+static bool udp_xdp_map_ring(fd_t fd, struct udp_xdp_ring *r, const struct xdp_ring_offset *off,
+                size_t desc_size, off_t pgoff)
+{
+        r->map_len = off->desc + XDP_RING_SIZE * desc_size;
+        r->map = mmap(nullptr, r->map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, pgoff);
+        if (r->map == MAP_FAILED) {
+                socket_error("XDP ring mmap");
+                r->map = nullptr;
+                return false;
+        }
+        r->producer = (uint32_t *)(void *)((char *) r->map + off->producer);
+        r->consumer = (uint32_t *)(void *)((char *) r->map + off->consumer);
+        r->ring = (char *) r->map + off->desc;
+        return true;
+}
+
+/// moves chunks returned by the user to the fill ring
+static void udp_xdp_refill(struct udp_xdp *x)
+{
+        unique_lock<mutex> lk(x->umem->lock);
+        uint32_t prod = *x->fill.producer;
+        uint32_t cons = __atomic_load_n(x->fill.consumer, __ATOMIC_ACQUIRE);
+        uint32_t space = XDP_RING_SIZE - (prod - cons);
+        auto *ring = (uint64_t *) x->fill.ring;
+        while (space-- > 0 && !x->umem->free_chunks.empty()) {
+                ring[prod++ & (XDP_RING_SIZE - 1)] = x->umem->free_chunks.back();
+                x->umem->free_chunks.pop_back();
+        }
+        __atomic_store_n(x->fill.producer, prod, __ATOMIC_RELEASE);
+}
+
+static void udp_xdp_destroy(struct udp_xdp *x)
+{
+        if (x->link_fd >= 0) {
+                close(x->link_fd);
+        }
+        if (x->prog_fd >= 0) {
+                close(x->prog_fd);
+        }
+        if (x->map_fd >= 0) {
+                close(x->map_fd);
+        }
+        for (auto *r : { &x->fill, &x->comp, &x->rx }) {
+                if (r->map != nullptr) {
+                        munmap(r->map, r->map_len);
+                }
+        }
+        if (x->xsk_fd >= 0) {
+                close(x->xsk_fd);
+        }
+        if (x->umem != nullptr) {
+                x->umem->release();
+        }
+        delete x;
+}
+
+/**
+ * @param cfg  <iface>[:<queue>]
+ */
+static struct udp_xdp *udp_xdp_init(const char *cfg, uint16_t port)
+{
+        string iface = cfg;
+        uint32_t queue = 0;
+        if (iface.find(':') != string::npos) {
+                queue = stoi(iface.substr(iface.find(':') + 1));
+                iface = iface.substr(0, iface.find(':'));
+        }
+        unsigned int ifindex = if_nametoindex(iface.c_str());
+        if (ifindex == 0) {
+                LOG(LOG_LEVEL_ERROR) << MOD_NAME << "Unknown interface " << iface << " for XDP!\n";
+                return nullptr;
+        }
+
+        auto *x = new udp_xdp();
+        size_t umem_len = (size_t) XDP_FRAME_COUNT * XDP_FRAME_SIZE;
+        void *area = mmap(nullptr, umem_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (area == MAP_FAILED) {
+                socket_error("XDP UMEM mmap");
+                delete x;
+                return nullptr;
+        }
+        x->umem = new udp_xdp_umem((char *) area, umem_len);
+
+        x->xsk_fd = socket(AF_XDP, SOCK_RAW, 0);
+        if (x->xsk_fd < 0) {
+                socket_error("AF_XDP socket");
+                udp_xdp_destroy(x);
+                return nullptr;
+        }
+        struct xdp_umem_reg mr{};
+        mr.addr = (uintptr_t) area;
+        mr.len = umem_len;
+        mr.chunk_size = XDP_FRAME_SIZE;
+        mr.headroom = XDP_UMEM_HEADROOM;
+        int ring_size = XDP_RING_SIZE;
+        struct xdp_mmap_offsets off{};
+        socklen_t optlen = sizeof off;
+        if (setsockopt(x->xsk_fd, SOL_XDP, XDP_UMEM_REG, &mr, sizeof mr) != 0 ||
+                        setsockopt(x->xsk_fd, SOL_XDP, XDP_UMEM_FILL_RING, &ring_size, sizeof ring_size) != 0 ||
+                        setsockopt(x->xsk_fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &ring_size, sizeof ring_size) != 0 ||
+                        setsockopt(x->xsk_fd, SOL_XDP, XDP_RX_RING, &ring_size, sizeof ring_size) != 0 ||
+                        getsockopt(x->xsk_fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen) != 0) {
+                socket_error("AF_XDP setsockopt");
+                udp_xdp_destroy(x);
+                return nullptr;
+        }
+        if (!udp_xdp_map_ring(x->xsk_fd, &x->fill, &off.fr, sizeof(uint64_t), XDP_UMEM_PGOFF_FILL_RING) ||
+                        !udp_xdp_map_ring(x->xsk_fd, &x->comp, &off.cr, sizeof(uint64_t), XDP_UMEM_PGOFF_COMPLETION_RING) ||
+                        !udp_xdp_map_ring(x->xsk_fd, &x->rx, &off.rx, sizeof(struct xdp_desc), XDP_PGOFF_RX_RING)) {
+                udp_xdp_destroy(x);
+                return nullptr;
+        }
+        for (unsigned int i = 0; i < XDP_FRAME_COUNT; ++i) {
+                x->umem->free_chunks.push_back((uint64_t) i * XDP_FRAME_SIZE);
+        }
+        udp_xdp_refill(x);
+
+        struct sockaddr_xdp sxdp{};
+        sxdp.sxdp_family = AF_XDP;
+        sxdp.sxdp_ifindex = ifindex;
+        sxdp.sxdp_queue_id = queue;
+        sxdp.sxdp_flags = XDP_ZEROCOPY;
+        if (bind(x->xsk_fd, (struct sockaddr *) &sxdp, sizeof sxdp) != 0) {
+                sxdp.sxdp_flags = XDP_COPY;
+                if (bind(x->xsk_fd, (struct sockaddr *) &sxdp, sizeof sxdp) != 0) {
+                        socket_error("AF_XDP bind");
+                        udp_xdp_destroy(x);
+                        return nullptr;
+                }
+        }
+
+        union bpf_attr attr{};
+        attr.map_type = BPF_MAP_TYPE_XSKMAP;
+        attr.key_size = sizeof(uint32_t);
+        attr.value_size = sizeof(uint32_t);
+        attr.max_entries = queue + 1;
+        if ((x->map_fd = sys_bpf(BPF_MAP_CREATE, &attr)) < 0) {
+                socket_error("XSKMAP create");
+                udp_xdp_destroy(x);
+                return nullptr;
+        }
+        uint32_t xsk_fd = x->xsk_fd;
+        attr = {};
+        attr.map_fd = x->map_fd;
+        attr.key = (uintptr_t) &queue;
+        attr.value = (uintptr_t) &xsk_fd;
+        if (sys_bpf(BPF_MAP_UPDATE_ELEM, &attr) != 0) {
+                socket_error("XSKMAP update");
+                udp_xdp_destroy(x);
+                return nullptr;
+        }
+        if ((x->prog_fd = udp_xdp_load_prog(x->map_fd, port)) < 0) {
+                udp_xdp_destroy(x);
+                return nullptr;
+        }
+        for (uint32_t mode : { XDP_FLAGS_DRV_MODE, XDP_FLAGS_SKB_MODE }) {
+                attr = {};
+                attr.link_create.prog_fd = x->prog_fd;
+                attr.link_create.target_ifindex = ifindex;
+                attr.link_create.attach_type = BPF_XDP;
+                attr.link_create.flags = mode;
+                if ((x->link_fd = sys_bpf(BPF_LINK_CREATE, &attr)) >= 0) {
+                        break;
+                }
+        }
+        if (x->link_fd < 0) {
+                socket_error("XDP attach to %s", iface.c_str());
+                udp_xdp_destroy(x);
+                return nullptr;
+        }
+        LOG(LOG_LEVEL_NOTICE) << MOD_NAME << "Receiving port " << port << " on " << iface << " queue "
+                << queue << " with AF_XDP (" << (sxdp.sxdp_flags == XDP_ZEROCOPY ? "zero-copy" : "copy")
+                << " mode).\n";
+        return x;
+}
+
+/**
+ * Reader thread for the AF_XDP socket, enqueues received frames to the same
+ * queue as udp_reader().
+ */
+/**
+ * Enqueues received datagram for the consumer, passing it through the
+ * impairment emulation if configured.
+ * @note s->local->lock must be held
+ */
+static void udp_reader_enqueue(socket_udp *s, const struct item &it)
+{
+        if (s->local->impair) {
+                s->local->impair->push(it, s->local->packets);
+        } else {
+                s->local->packets.push(it);
+        }
+}
+
+/**
+ * Waits until the reader queue has space for count packets (or exit is requested).
+ * If the memory budget is reached, only half of the queue is used so that
+ * the (further) packets are dropped by the kernel rather than buffered.
+ * @param lk locked s->local->lock
+ */
+static void udp_reader_wait_for_space(socket_udp *s, unique_lock<mutex> &lk, unsigned count)
+{
+        auto has_space = [s, count]{
+                size_t limit = s->local->max_packets;
+                if (mem_budget_exceeded()) {
+                        limit = max<size_t>(limit / 2, count);
+                }
+                return s->local->packets.size() + count <= limit || s->local->should_exit;
+        };
+        if (!has_space() && s->local->packets.size() + count <= s->local->max_packets) {
+                mem_budget_backpressure(MEM_UDP_RX);
+        }
+        if (s->local->queue_stats && !has_space()) {
+                auto t0 = std::chrono::steady_clock::now();
+                s->local->reader_cv.wait(lk, has_space);
+                s->local->queue_stats->push_blocked(std::chrono::steady_clock::now() - t0);
+        } else {
+                s->local->reader_cv.wait(lk, has_space);
+        }
+}
+
+static void *udp_reader_xdp(void *arg)
+{
+        set_thread_name(__func__);
+        socket_udp *s = (socket_udp *) arg;
+        struct udp_xdp *x = s->local->xdp;
+        const unsigned int batch = s->local->batch_size;
+
+        while (1) {
+                struct pollfd fds[2] = { { x->xsk_fd, POLLIN, 0 }, { s->local->should_exit_fd[0], POLLIN, 0 } };
+                if (poll(fds, 2, -1) <= 0) {
+                        continue;
+                }
+                if (fds[1].revents != 0) {
+                        break;
+                }
+                uint32_t cons = *x->rx.consumer;
+                uint32_t count = __atomic_load_n(x->rx.producer, __ATOMIC_ACQUIRE) - cons;
+                count = std::min(count, batch);
+                if (count == 0) {
+                        continue;
+                }
+
+                unique_lock<mutex> lk(s->local->lock);
+                udp_reader_wait_for_space(s, lk, count);
+                if (s->local->should_exit) {
+                        break;
+                }
+                const time_ns_t rx_time = get_time_in_ns();
+                auto *descs = (struct xdp_desc *) x->rx.ring;
+                unique_lock<mutex> ulk(x->umem->lock);
+                // pbuf may hold packets longer than UMEM lasts - copy when the
+                // half of it is outstanding
+                const bool copy = x->umem->outstanding >= XDP_FRAME_COUNT / 2;
+                if (!copy) {
+                        x->umem->outstanding += count;
+                }
+                ulk.unlock();
+                uint8_t *copy_bufs[XDP_RING_SIZE];
+                if (copy) {
+                        s->local->packet_pool->get(copy_bufs, count);
+                }
+                for (uint32_t i = 0; i < count; ++i) {
+                        const struct xdp_desc *d = &descs[(cons + i) & (XDP_RING_SIZE - 1)];
+                        uint8_t *frame = (uint8_t *) x->umem->area + d->addr;
+                        int len = std::min<int>((frame[38] << 8 | frame[39]) - 8, // UDP length minus header
+                                        d->len - XDP_HDRS_LEN);
+                        struct sockaddr_in src{};
+                        src.sin_family = AF_INET;
+                        memcpy(&src.sin_addr, frame + 26, sizeof src.sin_addr);
+                        memcpy(&src.sin_port, frame + 34, sizeof src.sin_port);
+                        uint8_t *buf = frame + XDP_HDRS_LEN - RTP_PACKET_HEADER_SIZE;
+                        struct sockaddr_in *src_addr = nullptr;
+                        if (copy) {
+                                memcpy(copy_bufs[i] + RTP_PACKET_HEADER_SIZE, frame + XDP_HDRS_LEN, len);
+                                buf = copy_bufs[i];
+                                src_addr = (struct sockaddr_in *)(void *)(buf + RTP_MAX_PACKET_LEN);
+                        } else {
+                                ((struct udp_packet_prefix *)(void *) buf - 1)->pool = x->umem;
+                                // source address is stored at the end of the frame
+                                src_addr = (struct sockaddr_in *)(void *) ((char *) x->umem->area
+                                                + (d->addr / XDP_FRAME_SIZE + 1) * XDP_FRAME_SIZE) - 1;
+                        }
+                        *src_addr = src;
+                        ((rtp_packet *)(void *) buf)->rx_time = rx_time;
+                        udp_reader_enqueue(s, {buf, len, (struct sockaddr *) src_addr, sizeof *src_addr});
+                }
+                if (s->local->queue_stats) {
+                        s->local->queue_stats->pushed(s->local->packets.size());
+                }
+                lk.unlock();
+                s->local->boss_cv.notify_one();
+
+                if (copy) {
+                        ulk.lock();
+                        for (uint32_t i = 0; i < count; ++i) {
+                                x->umem->free_chunks.push_back(descs[(cons + i) & (XDP_RING_SIZE - 1)].addr
+                                                / XDP_FRAME_SIZE * XDP_FRAME_SIZE);
+                        }
+                        ulk.unlock();
+                }
+                __atomic_store_n(x->rx.consumer, cons + count, __ATOMIC_RELEASE);
+                udp_xdp_refill(x);
+        }
+
+        return NULL;
+}
+#endif // defined HAVE_AF_XDP
+
 socket_udp *udp_init_if(const char *addr, const char *iface, uint16_t rx_port,
                         uint16_t tx_port, int ttl, int force_ip_version, bool multithreaded)
 {
@@ -917,8 +1899,56 @@ socket_udp *udp_init_if(const char *addr, const char *iface, uint16_t rx_port,
                 } else {
                         s->local->max_packets = atoi(get_commandline_param("udp-queue-len"));
                 }
+                s->local->batch_size = DEFAULT_UDP_READER_BATCH_SIZE;
+                if (get_commandline_param("udp-batch-size")) {
+                        s->local->batch_size = max(atoi(get_commandline_param("udp-batch-size")), 1);
+#ifndef HAVE_RECVMMSG
+                        if (s->local->batch_size > 1) {
+                                LOG(LOG_LEVEL_WARNING) << MOD_NAME << "Batched receive not supported on this platform!\n";
+                                s->local->batch_size = 1;
+                        }
+#endif
+                }
+                // the whole batch must fit into the queue
+                s->local->batch_size = std::min(s->local->batch_size, s->local->max_packets);
+                if (get_commandline_param("udp-impair") != nullptr) {
+                        s->local->impair = udp_impair::create(get_commandline_param("udp-impair"));
+                        if (!s->local->impair) {
+                                goto error;
+                        }
+                }
+                s->local->readers.push_back({s, s->local->rx_fd, {}});
+                if (get_commandline_param("udp-rx-threads")) {
+                        udp_add_reader_shards(s, addr, atoi(get_commandline_param("udp-rx-threads")), ttl);
+                }
+                if (const char *busy = get_commandline_param("udp-busy-poll")) {
+                        s->local->busy_poll_us = strlen(busy) > 0 ? max(atoi(busy), 1) : 50;
+                        for (auto &r : s->local->readers) {
+                                udp_set_busy_poll(r.fd, s->local->busy_poll_us, s->local->batch_size);
+                        }
+                }
+                if (const char *ts_cfg = get_commandline_param("udp-timestamping")) {
+                        for (auto &r : s->local->readers) {
+                                s->local->timestamping = udp_set_timestamping(r.fd, ts_cfg);
+                        }
+                }
+                s->local->packet_pool = new udp_packet_slab(s->local->max_packets + s->local->readers.size() * s->local->batch_size);
+                char port_label[32];
+                snprintf(port_label, sizeof port_label, "port=%d", udp_get_udp_rx_port(s));
+                s->local->queue_stats = queue_instrumentation::create(nullptr, "udp_reader", port_label);
                 platform_pipe_init(s->local->should_exit_fd);
-                pthread_create(&s->local->thread_id, NULL, udp_reader, s);
+                for (auto &r : s->local->readers) {
+                        pthread_create(&r.thread_id, NULL, udp_reader, &r);
+                }
+#ifdef HAVE_AF_XDP
+                if (get_commandline_param("udp-xdp") != nullptr) {
+                        if (udp_is_ipv6(s)) {
+                                LOG(LOG_LEVEL_WARNING) << MOD_NAME << "AF_XDP supports only IPv4!\n";
+                        } else if ((s->local->xdp = udp_xdp_init(get_commandline_param("udp-xdp"), udp_get_udp_rx_port(s))) != nullptr) {
+                                pthread_create(&s->local->xdp->thread_id, NULL, udp_reader_xdp, s);
+                        }
+                }
+#endif
         }
 
         return s;
@@ -1014,13 +2044,27 @@ void udp_exit(socket_udp * s)
                         int ret = PLATFORM_PIPE_WRITE(s->local->should_exit_fd[1], &c, 1);
                         assert (ret == 1);
                         s->local->should_exit = true;
-                        s->local->reader_cv.notify_one();
-                        pthread_join(s->local->thread_id, NULL);
+                        s->local->reader_cv.notify_all();
+                        for (auto &r : s->local->readers) {
+                                pthread_join(r.thread_id, NULL);
+                                if (r.fd != s->local->rx_fd) {
+                                        CLOSESOCKET(r.fd);
+                                }
+                        }
+#ifdef HAVE_AF_XDP
+                        if (s->local->xdp != nullptr) {
+                                pthread_join(s->local->xdp->thread_id, NULL);
+                                udp_xdp_destroy(s->local->xdp);
+                        }
+#endif
                         while (!s->local->packets.empty()) {
                                 auto it = s->local->packets.front();
-                                free(it.buf);
+                                udp_packet_free(it.buf);
                                 s->local->packets.pop();
                         }
+                        s->local->impair.reset();
+                        s->local->packet_pool->release();
+                        platform_pipe_close(s->local->should_exit_fd[0]);
                         platform_pipe_close(s->local->should_exit_fd[1]);
                 }
                 CLOSESOCKET(s->local->rx_fd);
@@ -1060,6 +2104,53 @@ int udp_sendto(socket_udp * s, char *buffer, int buflen, struct sockaddr *dst_ad
         return sendto(s->local->tx_fd, buffer, buflen, 0, dst_addr, addrlen);
 }
 
+/**
+ * Sends the datagram with the Don't Fragment bit set regardless of the path
+ * MTU cached by the kernel (used for path MTU probing). Other datagrams are
+ * sent as before.
+ *
+ * @returns same as udp_send(), -1 with errno EMSGSIZE if the datagram
+ * exceeds the local interface MTU, -1 with errno ENOTSUP if unsupported
+ */
+int udp_send_dont_fragment(socket_udp *s, char *buffer, int buflen)
+{
+#if defined IP_MTU_DISCOVER && defined IP_PMTUDISC_PROBE
+        const int level = s->local->mode == IPv6 ? IPPROTO_IPV6 : IPPROTO_IP;
+        const int opt = s->local->mode == IPv6 ? IPV6_MTU_DISCOVER : IP_MTU_DISCOVER;
+        int orig = 0;
+        socklen_t orig_len = sizeof orig;
+        int probe = IP_PMTUDISC_PROBE;
+        if (GETSOCKOPT(s->local->tx_fd, level, opt, &orig, &orig_len) != 0 ||
+                        SETSOCKOPT(s->local->tx_fd, level, opt, &probe, sizeof probe) != 0) {
+                socket_error("setsockopt IP_MTU_DISCOVER");
+                return -1;
+        }
+        int ret = udp_send(s, buffer, buflen);
+        const int saved_errno = errno;
+        SETSOCKOPT(s->local->tx_fd, level, opt, &orig, sizeof orig);
+        errno = saved_errno;
+        return ret;
+#elif defined WIN32 && defined IP_DONTFRAGMENT
+        const int level = s->local->mode == IPv6 ? IPPROTO_IPV6 : IPPROTO_IP;
+        const int opt = s->local->mode == IPv6 ? IPV6_DONTFRAG : IP_DONTFRAGMENT;
+        DWORD enable = TRUE;
+        DWORD disable = FALSE;
+        if (SETSOCKOPT(s->local->tx_fd, level, opt, (char *) &enable, sizeof enable) != 0) {
+                socket_error("setsockopt IP_DONTFRAGMENT");
+                return -1;
+        }
+        int ret = udp_send(s, buffer, buflen);
+        SETSOCKOPT(s->local->tx_fd, level, opt, (char *) &disable, sizeof disable);
+        return ret;
+#else
+        UNUSED(s);
+        UNUSED(buffer);
+        UNUSED(buflen);
+        errno = ENOTSUP;
+        return -1;
+#endif
+}
+
 #ifdef WIN32
 int udp_sendv(socket_udp * s, LPWSABUF vector, int count, void *d)
 {
@@ -1084,12 +2175,51 @@ int udp_sendv(socket_udp * s, LPWSABUF vector, int count, void *d)
         }
 }
 #else
+#ifdef HAVE_SO_TXTIME
+/// returns launch time for next paced datagram
+static uint64_t udp_get_next_txtime(socket_udp *s)
+{
+        struct timespec ts;
+        clock_gettime(s->txtime_clock, &ts);
+        uint64_t now = ts.tv_sec * NS_IN_SEC + ts.tv_nsec;
+        uint64_t txtime = max(now, s->txtime_next);
+        s->txtime_next = txtime + s->txtime_interval;
+        return txtime;
+}
+
+/// @param cmsg_buf buffer of CMSG_SPACE(sizeof(uint64_t)) bytes
+static void udp_set_txtime_cmsg(struct msghdr *msg, char *cmsg_buf, uint64_t txtime)
+{
+        msg->msg_control = cmsg_buf;
+        msg->msg_controllen = CMSG_SPACE(sizeof txtime);
+        struct cmsghdr *cm = CMSG_FIRSTHDR(msg);
+        cm->cmsg_level = SOL_SOCKET;
+        cm->cmsg_type = SCM_TXTIME;
+        cm->cmsg_len = CMSG_LEN(sizeof txtime);
+        memcpy(CMSG_DATA(cm), &txtime, sizeof txtime);
+}
+#endif // defined HAVE_SO_TXTIME
+
 int udp_sendv(socket_udp * s, struct iovec *vector, int count, void *d)
 {
         struct msghdr msg;
 
         assert(s != NULL);
 
+#ifdef HAVE_SENDMMSG
+        if (s->tx_batch_active) {
+                s->tx_msg_iovs.emplace_back(s->tx_iovs.size(), count);
+                s->tx_iovs.insert(s->tx_iovs.end(), vector, vector + count);
+                s->tx_dispose.push_back(d);
+#ifdef HAVE_SO_TXTIME
+                if (s->txtime_state == 1) {
+                        s->tx_times.push_back(s->txtime_interval > 0 ? udp_get_next_txtime(s) : 0);
+                }
+#endif
+                return 0;
+        }
+#endif
+
         msg.msg_name = (void *) & s->sock;
         msg.msg_namelen = s->sock_len;
         msg.msg_iov = vector;
@@ -1098,6 +2228,12 @@ int udp_sendv(socket_udp * s, struct iovec *vector, int count, void *d)
         msg.msg_control = 0;
         msg.msg_controllen = 0;
         msg.msg_flags = 0;
+#ifdef HAVE_SO_TXTIME
+        alignas(struct cmsghdr) char cmsg_buf[CMSG_SPACE(sizeof(uint64_t))];
+        if (s->txtime_interval > 0) {
+                udp_set_txtime_cmsg(&msg, cmsg_buf, udp_get_next_txtime(s));
+        }
+#endif
 
         int ret = sendmsg(s->local->tx_fd, &msg, 0);
         free(d);
@@ -1106,34 +2242,175 @@ int udp_sendv(socket_udp * s, struct iovec *vector, int count, void *d)
 #endif // WIN32
 
 /**
- * When receiving data in separate thread, this function fetches data
- * from socket and puts it in queue.
+ * Blocks until there are data to be read from the socket or the reader thread
+ * is requested to exit.
+ *
+ * @retval true  data ready
+ * @retval false reader should exit
  */
-static void *udp_reader(void *arg)
+static bool udp_reader_wait_for_data(socket_udp *s, fd_t fd)
 {
-        set_thread_name(__func__);
-        socket_udp *s = (socket_udp *) arg;
-
         while (1) {
                 fd_set fds;
                 FD_ZERO(&fds);
-                FD_SET(s->local->rx_fd, &fds);
+                FD_SET(fd, &fds);
                 FD_SET(s->local->should_exit_fd[0], &fds);
-                int nfds = max(s->local->rx_fd, s->local->should_exit_fd[0]) + 1;
+                int nfds = max(fd, s->local->should_exit_fd[0]) + 1;
 
-                int rc = select(nfds, &fds, NULL, NULL, NULL);
+                struct timeval poll_tv{}; // zero timeout - spin with udp-busy-poll
+                int rc = select(nfds, &fds, NULL, NULL, s->local->busy_poll_us > 0 ? &poll_tv : NULL);
+                if (rc == 0 && s->local->busy_poll_us > 0) {
+                        continue;
+                }
                 if (rc <= 0) {
                         socket_error("select");
                         continue;
                 }
-                if (FD_ISSET(s->local->should_exit_fd[0], &fds)) {
+                return !FD_ISSET(s->local->should_exit_fd[0], &fds);
+        }
+}
+
+#ifdef HAVE_RECVMMSG
+/**
+ * Variant of udp_reader() that receives up to socket_udp_local::batch_size
+ * datagrams with one recvmmsg() call and enqueues all of them while holding
+ * the queue lock only once.
+ */
+static struct metric *rx_packets_metric() {
+        static struct metric *m = metric_counter("ug_rx_packets", "UDP packets received by reader threads", nullptr);
+        return m;
+}
+
+static struct metric *rx_bytes_metric() {
+        static struct metric *m = metric_counter("ug_rx_bytes", "UDP payload bytes received by reader threads", nullptr);
+        return m;
+}
+
+static struct metric *rx_queue_metric() {
+        static struct metric *m = metric_gauge("ug_rx_queue_depth", "Packets waiting in the UDP reader queue (last socket updated)", nullptr);
+        return m;
+}
+
+/**
+ * Returns the arrival time of the datagram - kernel/NIC timestamp from the
+ * control message if present, current time otherwise.
+ */
+static time_ns_t udp_get_rx_time(struct msghdr *msg, enum udp_timestamping ts_source)
+{
+#ifdef SO_TIMESTAMPING
+        if (ts_source != UDP_TS_USER) {
+                for (struct cmsghdr *c = CMSG_FIRSTHDR(msg); c != nullptr; c = CMSG_NXTHDR(msg, c)) {
+                        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_TIMESTAMPING) {
+                                continue;
+                        }
+                        struct timespec ts[3]; // software, deprecated, raw hardware
+                        memcpy(ts, CMSG_DATA(c), sizeof ts);
+                        const struct timespec *t = &ts[ts_source == UDP_TS_HARDWARE ? 2 : 0];
+                        if (t->tv_sec != 0 || t->tv_nsec != 0) {
+                                return t->tv_sec * NS_IN_SEC + t->tv_nsec;
+                        }
+                }
+        }
+#else
+        UNUSED(msg);
+        UNUSED(ts_source);
+#endif
+        return get_time_in_ns();
+}
+
+static void udp_reader_batched(socket_udp *s, fd_t fd)
+{
+        const unsigned int batch = s->local->batch_size;
+        std::vector<uint8_t *> bufs(batch);
+        std::vector<struct mmsghdr> msgs(batch);
+        std::vector<struct iovec> iovs(batch);
+        const size_t ctrl_len = s->local->timestamping != UDP_TS_USER ? CMSG_SPACE(3 * sizeof(struct timespec)) : 0;
+        std::vector<char> ctrl(batch * ctrl_len);
+
+        s->local->packet_pool->get(bufs.data(), batch);
+
+        while (udp_reader_wait_for_data(s, fd)) {
+                for (unsigned int i = 0; i < batch; ++i) {
+                        iovs[i].iov_base = bufs[i] + RTP_PACKET_HEADER_SIZE;
+                        iovs[i].iov_len = RTP_MAX_PACKET_LEN - RTP_PACKET_HEADER_SIZE;
+                        msgs[i].msg_hdr = {};
+                        msgs[i].msg_hdr.msg_iov = &iovs[i];
+                        msgs[i].msg_hdr.msg_iovlen = 1;
+                        msgs[i].msg_hdr.msg_name = bufs[i] + RTP_MAX_PACKET_LEN;
+                        msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+                        if (ctrl_len > 0) {
+                                msgs[i].msg_hdr.msg_control = &ctrl[i * ctrl_len];
+                                msgs[i].msg_hdr.msg_controllen = ctrl_len;
+                        }
+                }
+                PROFILE_FUNC;
+                int count = recvmmsg(fd, msgs.data(), batch, MSG_WAITFORONE, nullptr);
+                if (count <= 0) {
+                        socket_error("recvmmsg");
+                        continue;
+                }
+
+                for (int i = 0; i < count; ++i) {
+                        ((rtp_packet *)(void *) bufs[i])->rx_time = udp_get_rx_time(&msgs[i].msg_hdr, s->local->timestamping);
+                }
+
+                PROFILE_DETAIL("enqueue");
+                unique_lock<mutex> lk(s->local->lock);
+                udp_reader_wait_for_space(s, lk, count);
+                if (s->local->should_exit) {
                         break;
                 }
-                uint8_t *packet = (uint8_t *) malloc(RTP_MAX_PACKET_LEN + sizeof(struct sockaddr_storage));
+                long long bytes = 0;
+                for (int i = 0; i < count; ++i) {
+                        udp_reader_enqueue(s, {bufs[i], (int) msgs[i].msg_len,
+                                        (struct sockaddr *)(void *)(bufs[i] + RTP_MAX_PACKET_LEN),
+                                        msgs[i].msg_hdr.msg_namelen});
+                        bytes += msgs[i].msg_len;
+                }
+                metric_set(rx_queue_metric(), s->local->packets.size());
+                if (s->local->queue_stats) {
+                        s->local->queue_stats->pushed(s->local->packets.size());
+                }
+                lk.unlock();
+                metric_add(rx_packets_metric(), count);
+                metric_add(rx_bytes_metric(), bytes);
+                s->local->boss_cv.notify_one();
+
+                // ownership of the enqueued buffers was passed to the consumer
+                s->local->packet_pool->get(bufs.data(), count);
+        }
+
+        for (auto *buf : bufs) {
+                udp_packet_free(buf);
+        }
+}
+#endif // defined HAVE_RECVMMSG
+
+/**
+ * When receiving data in separate thread, this function fetches data
+ * from socket and puts it in queue.
+ */
+static void *udp_reader(void *arg)
+{
+        set_thread_name(__func__);
+        auto *ctx = (struct udp_reader_ctx *) arg;
+        socket_udp *s = ctx->s;
+
+#ifdef HAVE_RECVMMSG
+        if (s->local->batch_size > 1 || s->local->timestamping != UDP_TS_USER) {
+                udp_reader_batched(s, ctx->fd);
+                return NULL;
+        }
+#endif
+
+        while (udp_reader_wait_for_data(s, ctx->fd)) {
+                PROFILE_FUNC;
+                uint8_t *packet = nullptr;
+                s->local->packet_pool->get(&packet, 1);
                 uint8_t *buffer = ((uint8_t *) packet) + RTP_PACKET_HEADER_SIZE;
                 auto src_addr = (struct sockaddr *)(void *)(packet + RTP_MAX_PACKET_LEN);
                 socklen_t addrlen = sizeof(struct sockaddr_storage);
-                int size = recvfrom(s->local->rx_fd, (char *) buffer,
+                int size = recvfrom(ctx->fd, (char *) buffer,
                                 RTP_MAX_PACKET_LEN - RTP_PACKET_HEADER_SIZE,
                                 0, src_addr, &addrlen);
 
@@ -1143,25 +2420,31 @@ static void *udp_reader(void *arg)
                         /// we got WSAECONNRESET error (noone is listening). This can have
                         /// negative performance impact.
                         socket_error("recvfrom");
-                        free(packet);
+                        udp_packet_free(packet);
                         continue;
                 }
+                ((rtp_packet *)(void *) packet)->rx_time = get_time_in_ns();
 
+                PROFILE_DETAIL("enqueue");
                 unique_lock<mutex> lk(s->local->lock);
-                s->local->reader_cv.wait(lk, [s]{return s->local->packets.size() < s->local->max_packets || s->local->should_exit;});
+                udp_reader_wait_for_space(s, lk, 1);
                 if (s->local->should_exit) {
-                        free(packet);
+                        udp_packet_free(packet);
                         break;
                 }
 
-                s->local->packets.emplace(packet, size, src_addr, addrlen);
+                udp_reader_enqueue(s, {packet, size, src_addr, addrlen});
+                metric_set(rx_queue_metric(), s->local->packets.size());
+                if (s->local->queue_stats) {
+                        s->local->queue_stats->pushed(s->local->packets.size());
+                }
 
                 lk.unlock();
+                metric_add(rx_packets_metric(), 1);
+                metric_add(rx_bytes_metric(), size);
                 s->local->boss_cv.notify_one();
         }
 
-        platform_pipe_close(s->local->should_exit_fd[0]);
-
         return NULL;
 }
 
@@ -1214,13 +2497,34 @@ bool udp_not_empty(socket_udp * s, struct timeval *timeout)
         assert(s->local->multithreaded);
 
         unique_lock<mutex> lk(s->local->lock);
-        if (timeout) {
+        auto t0 = s->local->queue_stats && s->local->packets.empty() ? std::chrono::steady_clock::now()
+                : std::chrono::steady_clock::time_point();
+        if (s->local->impair) {
+                auto deadline = udp_impair::clock::time_point::max();
+                if (timeout) {
+                        deadline = udp_impair::clock::now() + std::chrono::microseconds(
+                                        timeout->tv_sec * 1000000ll + timeout->tv_usec);
+                }
+                s->local->impair->wait(s->local->boss_cv, lk, deadline, s->local->packets);
+        } else if (s->local->busy_poll_us > 0) { // spin instead of sleeping on the condition variable
+                auto deadline = timeout ? std::chrono::steady_clock::now() + std::chrono::microseconds(
+                                timeout->tv_sec * 1000000ll + timeout->tv_usec)
+                        : std::chrono::steady_clock::time_point::max();
+                while (s->local->packets.empty() && std::chrono::steady_clock::now() < deadline) {
+                        lk.unlock();
+                        std::this_thread::yield();
+                        lk.lock();
+                }
+        } else if (timeout) {
                 std::chrono::microseconds tmout_us =
                         std::chrono::microseconds(timeout->tv_sec * 1000000ll + timeout->tv_usec);
                 s->local->boss_cv.wait_for(lk, tmout_us, [s]{return !s->local->packets.empty();});
         } else {
                 s->local->boss_cv.wait(lk, [s]{return !s->local->packets.empty();});
         }
+        if (t0 != std::chrono::steady_clock::time_point()) {
+                s->local->queue_stats->pop_waited(std::chrono::steady_clock::now() - t0);
+        }
         return !s->local->packets.empty();
 }
 
@@ -1252,7 +2556,8 @@ int udp_recvfrom(socket_udp *s, char *buffer, int buflen, struct sockaddr *src_a
  * Receives data from multithreaded socket.
  *
  * @param[in] s       UDP socket state
- * @param[out] buffer data received from socket. Must be freed by caller!
+ * @param[out] buffer data received from socket. Must be freed by caller
+ *                    with udp_packet_free()!
  * @returns           length of the received datagram
  */
 int udp_recvfrom_data(socket_udp * s, char **buffer,
@@ -1274,6 +2579,9 @@ int udp_recvfrom_data(socket_udp * s, char **buffer,
         }
         ret = it.size;
         s->local->packets.pop();
+        if (s->local->queue_stats) {
+                s->local->queue_stats->popped();
+        }
 
         lk.unlock();
         s->local->reader_cv.notify_one();
@@ -1443,6 +2751,12 @@ bool udp_set_recv_buf(socket_udp *s, int size)
                 socket_error("Unable to set socket buffer size");
                 return false;
         }
+        for (auto &r : s->local->readers) {
+                if (r.fd != s->local->rx_fd && SETSOCKOPT(r.fd, SOL_SOCKET, SO_RCVBUF, (sockopt_t) &size,
+                                        sizeof(size)) != 0) {
+                        socket_error("Unable to set socket buffer size");
+                }
+        }
 
         opt_size = sizeof(opt);
         if(GETSOCKOPT (s->local->rx_fd, SOL_SOCKET, SO_RCVBUF, (sockopt_t)&opt,
@@ -1514,10 +2828,147 @@ void udp_flush_recv_buf(socket_udp *s)
         free(buf);
 }
 
+#ifdef HAVE_SENDMMSG
+#ifndef UIO_MAXIOV
+#define UIO_MAXIOV 1024
+#endif
+/**
+ * Submits datagrams queued by udp_sendv() in batch mode with (ideally) one
+ * sendmmsg() call.
+ */
+static void udp_send_batch(socket_udp *s)
+{
+        const size_t count = s->tx_msg_iovs.size();
+        s->tx_msgs.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+                struct msghdr *msg = &s->tx_msgs[i].msg_hdr;
+                *msg = {};
+                msg->msg_name = (void *) &s->sock;
+                msg->msg_namelen = s->sock_len;
+                msg->msg_iov = &s->tx_iovs[s->tx_msg_iovs[i].first];
+                msg->msg_iovlen = s->tx_msg_iovs[i].second;
+        }
+#ifdef HAVE_SO_TXTIME
+        if (!s->tx_times.empty()) {
+                assert(s->tx_times.size() == count);
+                const size_t cmsg_len = CMSG_ALIGN(CMSG_SPACE(sizeof(uint64_t)));
+                s->tx_cmsgs.resize(count * cmsg_len + alignof(struct cmsghdr));
+                char *cmsg_base = (char *) CMSG_ALIGN((uintptr_t) s->tx_cmsgs.data());
+                for (size_t i = 0; i < count; ++i) {
+                        if (s->tx_times[i] != 0) {
+                                udp_set_txtime_cmsg(&s->tx_msgs[i].msg_hdr, cmsg_base + i * cmsg_len, s->tx_times[i]);
+                        }
+                }
+                s->tx_times.clear();
+        }
+#endif
+
+        size_t sent = 0;
+        while (sent < count) {
+                // vlen is limited by UIO_MAXIOV in the kernel
+                unsigned int vlen = std::min<size_t>(count - sent, UIO_MAXIOV);
+                int ret = sendmmsg(s->local->tx_fd, &s->tx_msgs[sent], vlen, 0);
+                if (ret == -1) {
+                        if (errno == EINTR) {
+                                continue;
+                        }
+                        socket_error("sendmmsg");
+                        ret = 1; // skip the offending datagram
+                }
+                sent += ret;
+        }
+
+        for (auto *d : s->tx_dispose) {
+                free(d);
+        }
+        s->tx_msg_iovs.clear();
+        s->tx_iovs.clear();
+        s->tx_dispose.clear();
+}
+#endif // defined HAVE_SENDMMSG
+
+#ifndef WIN32
+/**
+ * Sends each of buf_count datagrams to all of dst_count destinations.
+ *
+ * If sendmmsg() is available, the datagrams for destinations sharing a local
+ * socket are submitted together with (ideally) one system call, otherwise
+ * one per local socket. Datagrams are interleaved so that each buffer is sent
+ * to all destinations before the next one.
+ *
+ * @retval  0 all datagrams were sent
+ * @retval -1 some of the datagrams failed to be sent
+ */
+int udp_send_fanout(socket_udp **dsts, int dst_count, struct iovec *bufs, int buf_count)
+{
+        int rc = 0;
+#ifdef HAVE_SENDMMSG
+        thread_local static std::vector<struct mmsghdr> msgs;
+        thread_local static std::vector<socket_udp *> group;
+        std::vector<bool> handled(dst_count);
+
+        for (int i = 0; i < dst_count; ++i) {
+                if (handled[i]) {
+                        continue;
+                }
+                fd_t fd = dsts[i]->local->tx_fd;
+                group.clear();
+                for (int j = i; j < dst_count; ++j) {
+                        if (!handled[j] && dsts[j]->local->tx_fd == fd) {
+                                handled[j] = true;
+                                group.push_back(dsts[j]);
+                        }
+                }
+
+                msgs.resize(group.size() * buf_count);
+                size_t count = 0;
+                for (int b = 0; b < buf_count; ++b) {
+                        for (auto *d : group) {
+                                struct msghdr *msg = &msgs[count++].msg_hdr;
+                                *msg = {};
+                                msg->msg_name = (void *) &d->sock;
+                                msg->msg_namelen = d->sock_len;
+                                msg->msg_iov = &bufs[b];
+                                msg->msg_iovlen = 1;
+                        }
+                }
+
+                size_t sent = 0;
+                while (sent < count) {
+                        unsigned int vlen = std::min<size_t>(count - sent, UIO_MAXIOV);
+                        int ret = sendmmsg(fd, &msgs[sent], vlen, 0);
+                        if (ret == -1) {
+                                if (errno == EINTR) {
+                                        continue;
+                                }
+                                socket_error("sendmmsg");
+                                rc = -1;
+                                ret = 1; // skip the offending datagram
+                        }
+                        sent += ret;
+                }
+        }
+#else
+        for (int b = 0; b < buf_count; ++b) {
+                for (int i = 0; i < dst_count; ++i) {
+                        if (udp_send(dsts[i], (char *) bufs[b].iov_base, bufs[b].iov_len) < 0) {
+                                socket_error("udp_send");
+                                rc = -1;
+                        }
+                }
+        }
+#endif
+        return rc;
+}
+#endif // ! defined WIN32
+
 /**
- * By calling this function under MSW, caller indicates that following packets
+ * By calling this function, caller indicates that following packets
  * can be send in asynchronous manner. Caller should then call udp_async_wait()
  * to ensure that all packets were actually sent.
+ *
+ * In MSW, overlapped I/O is used. If sendmmsg() is available, the datagrams
+ * are queued and submitted together in udp_async_flush() or udp_async_wait().
  */
 void udp_async_start(socket_udp *s, int nr_packets)
 {
@@ -1540,12 +2991,32 @@ void udp_async_start(socket_udp *s, int nr_packets)
 
         s->overlapped_count = 0;
         s->overlapping_active = true;
+#elif defined HAVE_SENDMMSG
+        s->tx_msg_iovs.reserve(nr_packets);
+        s->tx_dispose.reserve(nr_packets);
+        s->tx_batch_active = true;
 #else
         UNUSED(nr_packets);
         UNUSED(s);
 #endif
 }
 
+/**
+ * Submits all datagrams queued since udp_async_start() or last flush without
+ * leaving the async mode. Buffers may be reused after return only with
+ * sendmmsg() batching - in MSW, udp_async_wait() must be still called.
+ */
+void udp_async_flush(socket_udp *s)
+{
+#ifdef HAVE_SENDMMSG
+        if (s->tx_batch_active) {
+                udp_send_batch(s);
+        }
+#else
+        UNUSED(s);
+#endif
+}
+
 void udp_async_wait(socket_udp *s)
 {
 #ifdef WIN32
@@ -1568,11 +3039,55 @@ void udp_async_wait(socket_udp *s)
                 free(s->dispose_udata[i]);
         }
         s->overlapping_active = false;
+#elif defined HAVE_SENDMMSG
+        if (s->tx_batch_active) {
+                udp_send_batch(s);
+                s->tx_batch_active = false;
+        }
 #else
         UNUSED(s);
 #endif
 }
 
+ADD_TO_PARAM("udp-txtime-clock", "* udp-txtime-clock={monotonic|tai}\n"
+                "  Clock used for SO_TXTIME packet launch times - monotonic for fq qdisc (default), tai for ETF\n");
+/**
+ * Sets kernel-timed pacing of following datagrams - each datagram is launched
+ * interval_ns after the previous one by the qdisc (fq or ETF) using SO_TXTIME.
+ *
+ * @param interval_ns  inter-packet interval, 0 to disable stamping
+ * @retval true  kernel pacing is active (or disabled on request)
+ * @retval false SO_TXTIME not supported, caller should pace itself
+ */
+bool udp_set_txtime_pacing(socket_udp *s, long interval_ns)
+{
+#ifdef HAVE_SO_TXTIME
+        if (interval_ns > 0 && s->txtime_state == 0) {
+                const char *clock = get_commandline_param("udp-txtime-clock");
+                s->txtime_clock = clock != nullptr && strcmp(clock, "tai") == 0 ? CLOCK_TAI : CLOCK_MONOTONIC;
+                struct sock_txtime cfg{};
+                cfg.clockid = s->txtime_clock;
+                if (SETSOCKOPT(s->local->tx_fd, SOL_SOCKET, SO_TXTIME, &cfg, sizeof cfg) != 0) {
+                        socket_error("setsockopt SO_TXTIME");
+                        LOG(LOG_LEVEL_WARNING) << MOD_NAME << "Kernel pacing unavailable, using user-space pacing.\n";
+                        s->txtime_state = -1;
+                } else {
+                        LOG(LOG_LEVEL_VERBOSE) << MOD_NAME << "Using SO_TXTIME kernel pacing.\n";
+                        s->txtime_state = 1;
+                }
+        }
+        if (s->txtime_state == -1) {
+                s->txtime_interval = 0;
+                return interval_ns == 0;
+        }
+        s->txtime_interval = interval_ns;
+        return true;
+#else
+        UNUSED(s);
+        return interval_ns == 0;
+#endif
+}
+
 static void udp_clean_async_state(socket_udp *s)
 {
 #ifdef WIN32
@@ -1712,7 +3227,7 @@ int udp_recvfrom_timeout(socket_udp *s, char *buffer, int buflen,
                         if (len > 0) {
                                 memcpy(buffer, data, len);
                         }
-                        free(data);
+                        udp_packet_free(data);
                 }
         } else {
                 udp_fd_zero_r(&fd);
@@ -1752,3 +3267,34 @@ int udp_get_udp_rx_port(socket_udp *s)
         return htons(ss.ss_family == AF_INET ? ((struct sockaddr_in *) &ss)->sin_port : ((struct sockaddr_in6 *) &ss)->sin6_port);
 }
 
+
+/**
+ * Allocates a buffer for a received datagram that is not backed by any
+ * socket's pool. It can be freed by udp_packet_free() as the pooled ones.
+ */
+void *udp_packet_alloc(size_t len)
+{
+        auto *buf = (struct udp_packet_prefix *) malloc(sizeof(struct udp_packet_prefix) + len);
+        if (buf == nullptr) {
+                return nullptr;
+        }
+        buf->pool = nullptr;
+        return buf + 1;
+}
+
+/**
+ * Frees buffer obtained from udp_packet_alloc() or udp_recvfrom_data(). In
+ * the later case, the buffer is returned to the pool of the originating socket.
+ */
+void udp_packet_free(void *buf)
+{
+        if (buf == nullptr) {
+                return;
+        }
+        auto *prefix = (struct udp_packet_prefix *) buf - 1;
+        if (prefix->pool != nullptr) {
+                prefix->pool->put(prefix);
+        } else {
+                free(prefix);
+        }
+}
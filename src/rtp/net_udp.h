@@ -71,14 +71,18 @@ int         udp_recvfrom_timeout(socket_udp *s, char *buffer, int buflen,
 int         udp_recvfrom(socket_udp *s, char *buffer, int buflen, struct sockaddr *src_addr, socklen_t *addrlen);
 int         udp_send(socket_udp *s, char *buffer, int buflen);
 int         udp_sendto(socket_udp *s, char *buffer, int buflen, struct sockaddr *dst_addr, socklen_t addrlen);
+int         udp_send_dont_fragment(socket_udp *s, char *buffer, int buflen);
 
 int         udp_recvv(socket_udp *s, struct msghdr *m);
 void        udp_async_start(socket_udp *s, int nr_packets);
+void        udp_async_flush(socket_udp *s);
 void        udp_async_wait(socket_udp *s);
+bool        udp_set_txtime_pacing(socket_udp *s, long interval_ns);
 #ifdef WIN32
 int         udp_sendv(socket_udp *s, LPWSABUF vector, int count, void *d);
 #else
 int         udp_sendv(socket_udp *s, struct iovec *vector, int count, void *d);
+int         udp_send_fanout(socket_udp **dsts, int dst_count, struct iovec *bufs, int buf_count);
 #endif
 
 char       *udp_host_addr(socket_udp *s);
@@ -107,6 +111,8 @@ int         udp_recv_data(socket_udp * s, char **buffer);
 int         udp_recvfrom_data(socket_udp * s, char **buffer,
                 struct sockaddr *src_addr, socklen_t *addrlen);
 bool        udp_not_empty(socket_udp *s, struct timeval *timeout);
+void       *udp_packet_alloc(size_t len);
+void        udp_packet_free(void *buf);
 int         udp_port_pair_is_free(int force_ip_version, int even_port);
 bool        udp_is_ipv6(socket_udp *s);
 
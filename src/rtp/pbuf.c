@@ -58,14 +58,25 @@
 #include "config_win32.h"
 
 #include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stddef.h>
 
 #include "debug.h"
+#include "host.h"
+#include "rtp/av_sync.h"
+#include "rtp/net_udp.h" // udp_packet_free
 #include "rtp/rtp.h"
 #include "rtp/rtp_callback.h"
+#include "rtp/rtp_types.h"
 #include "rtp/ptime.h"
 #include "rtp/pbuf.h"
 #include "tv.h"
 #include "utils/color_out.h"
+#include "utils/macros.h"
+#include "utils/metrics.h"
+#include "utils/profile_timer.hpp"
+#include "utils/ptp_clock.h"
 
 #define PBUF_MAGIC	0xcafebabe
 
@@ -75,11 +86,25 @@ static_assert(DEFAULT_STATS_INTERVAL % STAT_INT_MIN_DIVISOR == 0,
                 "STATS_INTERVAL must be divisible by (sizeof(ull) * CHAR_BIT)");
 #define MOD_NAME "[Pbuf] "
 
+#define PBUF_RING_SLOTS 32 ///< number of frames held by the ring variant
+#define PBUF_RING_MIN_PKTS 64 ///< initial packet array capacity
+#define PBUF_ARENA_BLOCK_ITEMS 256 ///< coded_data/pbuf_node items allocated at once
+#define PBUF_INDEX_HEADROOM 64 ///< index slots reserved for packets preceding the first received one
+#define PBUF_NACK_QUEUE_LEN 4096 ///< max packets waiting for NACK
+#define PBUF_NACK_MAX_GAP 512 ///< longer losses are considered outage and not requested
+#define PBUF_NACK_GRACE_NS (NS_IN_SEC / 1000) ///< time for reordered packets to arrive before NACK
+#define PBUF_DEADLINE_CLOCK 90000 ///< RTP clock rate of video
+#define PBUF_DEADLINE_WINDOW 128 ///< frames after which the transit minimum is renewed (clock drift)
+#define PBUF_PTP_PLAYOUT_DEFAULT_MS 100
+#define SECS_BETWEEN_1900_1970 2208988800LL
+#define PBUF_DEADLINE_MAX_JUMP (10 * PBUF_DEADLINE_CLOCK) ///< larger RTP TS jumps restart the mapping
+
 struct pbuf_node {
         struct pbuf_node *nxt;
         struct pbuf_node *prv;
         uint32_t rtp_timestamp; /* RTP timestamp for the frame           */
         time_ns_t arrival_time;    /* Arrival time of first packet in frame */
+        time_ns_t last_arrival_time; /* Arrival time of last packet in frame */
         time_ns_t playout_time;    /* Playout time for the frame            */
         time_ns_t deletion_time;   /* Deletion time for the frame            */
         struct coded_data *cdata;       /*                                       */
@@ -87,6 +112,74 @@ struct pbuf_node {
         int mbit;               /* determines if mbit of frame had been seen */
         uint32_t magic;         /* For debugging                         */
         bool completed;
+
+        // completeness tracking - the frame is complete if all packets from
+        // first_seq up to last_seq (with M bit) were received
+        unsigned int received;  ///< number of distinct packets stored
+        uint16_t first_seq;     ///< seq of the first packet of the frame, valid if first_known
+        uint16_t last_seq;      ///< seq of the packet with M bit, valid if mbit
+        bool first_known;
+        time_ns_t ready_time;   ///< incomplete frame may be decoded since (see pbuf-reorder-window)
+
+        // linked-list variant only, kept when the node is recycled
+        struct coded_data **index; ///< index[i] - packet with seq base_seq + i (NULL if missing)
+        unsigned int index_len;
+        unsigned int index_capacity;
+        uint16_t base_seq;
+};
+
+/// arena block holding PBUF_ARENA_BLOCK_ITEMS of coded_data or pbuf_node
+struct pbuf_arena_block {
+        struct pbuf_arena_block *nxt;
+        max_align_t items[];
+};
+
+/**
+ * Frame slot of the ring playout buffer variant. Packets are stored in an
+ * array indexed by sequence number offset from base_seq, the array is kept
+ * when the slot is reused so that no per-packet allocations are needed in
+ * steady state. The coded_data list passed to the decoder is linked when the
+ * frame is decoded.
+ */
+struct pbuf_ring_slot {
+        struct pbuf_node node;
+        struct coded_data *pkts; ///< pkts[i] holds packet with seq base_seq + i (data == NULL if missing)
+        unsigned int capacity;
+        unsigned int span; ///< highest used index + 1
+        uint16_t base_seq;
+};
+
+/// missing packets to be requested for retransmission (see pbuf_get_nacks())
+struct pbuf_nack_state {
+        bool started;
+        uint16_t highest; ///< highest sequence number received
+        unsigned long long seen[(1<<16) / sizeof(unsigned long long) / 8]; ///< received seq bitmap
+        struct {
+                uint16_t seq;
+                time_ns_t due;
+        } queue[PBUF_NACK_QUEUE_LEN]; ///< ordered by due time
+        unsigned int first;
+        unsigned int count;
+};
+
+/**
+ * Concurrent mode state (see pbuf_set_concurrent()). Producer only appends
+ * to pkts, consumer swaps the arrays and files the packets without the lock.
+ */
+struct pbuf_handoff {
+        pthread_mutex_t lock;
+        pthread_cond_t cv;
+        rtp_packet **pkts;  ///< packets inserted by the producer, not yet filed
+        rtp_packet **spare; ///< consumer-side array swapped with pkts
+        int count;
+        int max;
+        long long dropped;
+
+        // setters called from the producer thread
+        bool sr_pending;
+        uint32_t sr_ntp_sec, sr_ntp_frac, sr_rtp_ts;
+        bool delay_pending;
+        double playout_delay;
 };
 
 struct pbuf {
@@ -107,10 +200,100 @@ struct pbuf {
         int out_of_order_pkts;
         int max_out_of_order_dist;
         int dups; // duplicite packets
+        // arrival timing (rtp_packet::rx_time - kernel timestamp with udp-timestamping)
+        uint32_t jitter_last_ts;
+        time_ns_t jitter_last_rx;
+        double jitter_ns; // RFC 3550 interarrival jitter of frames (first packets)
+        long long host_delay_sum, host_delay_max; // from arrival to pbuf (receiver scheduling)
+        int host_delay_count;
+
+        // free lists of the linked-list variant, items are allocated from arena blocks
+        struct coded_data *cdata_free_list;
+        struct pbuf_node *node_free_list;
+        struct pbuf_arena_block *arena;
+
+        // ring variant (pbuf-ring param)
+        struct pbuf_ring_slot *ring; ///< NULL if the linked-list variant is used
+        unsigned int ring_first; ///< index of the oldest frame
+        unsigned int ring_count; ///< number of frames held
+
+        time_ns_t reorder_window_ns; ///< see pbuf-reorder-window param
+        struct pbuf_nack_state *nack; ///< allocated by the first pbuf_get_nacks() call
+
+        // A/V sync (see rtp/av_sync.h)
+        enum av_sync_media av_sync_media;
+        bool sr_valid;
+        uint32_t sr_rtp_ts; ///< RTP timestamp of last SR
+        time_ns_t sr_ntp_ns; ///< sender wall-clock time of last SR
+
+        time_ns_t ptp_playout_ns; ///< fixed delay from capture (PTP time) to presentation, 0 if not used
+
+        struct pbuf_handoff *handoff; ///< NULL unless pbuf_set_concurrent() was called
+
+        /// mapping of RTP timestamps to local time for frame deadlines, see pbuf_frame_deadline()
+        struct pbuf_deadline_map {
+                bool valid;
+                uint32_t last_ts;
+                long long ts_ext;     ///< RTP timestamp extended to 64 bits (relative to the first frame)
+                long long transit;    ///< minimal (arrival - RTP time) in ns, ie. transit of the fastest frame
+                long long window_min; ///< minimal transit in the current window
+                int window_frames;
+        } deadline_map;
 };
 
-static void free_cdata(struct coded_data *head);
-static int frame_complete(struct pbuf_node *frame);
+/// @returns total playout delay including user and A/V sync offsets
+static long long pbuf_get_playout_delay_us(struct pbuf *playout_buf)
+{
+        return playout_buf->playout_delay_us + 1000 * ((playout_buf->offset_ms ? *playout_buf->offset_ms : 0)
+                        + av_sync_get_delay_ms(playout_buf->av_sync_media));
+}
+
+/**
+ * Computes target presentation time of the frame - RTP timestamp mapped to
+ * the local clock plus the playout delay. The mapping uses the minimal
+ * transit seen (renewed every PBUF_DEADLINE_WINDOW frames to follow clock
+ * drift), so that frames delayed by jitter or a burst get their original
+ * schedule and don't shift the following ones.
+ */
+static time_ns_t pbuf_frame_deadline(struct pbuf *playout_buf, const struct pbuf_node *node)
+{
+        struct pbuf_deadline_map *m = &playout_buf->deadline_map;
+        int32_t diff = (int32_t) (node->rtp_timestamp - m->last_ts);
+        if (!m->valid || diff > PBUF_DEADLINE_MAX_JUMP || diff < -PBUF_DEADLINE_MAX_JUMP) {
+                m->valid = true;
+                m->ts_ext = 0;
+                m->transit = m->window_min = node->arrival_time;
+                m->window_frames = 0;
+        } else {
+                m->ts_ext += diff;
+        }
+        m->last_ts = node->rtp_timestamp;
+
+        long long rtp_ns = m->ts_ext * NS_IN_SEC / PBUF_DEADLINE_CLOCK;
+        long long transit = node->arrival_time - rtp_ns;
+        m->transit = MIN(m->transit, transit);
+        m->window_min = MIN(m->window_min, transit);
+        if (++m->window_frames == PBUF_DEADLINE_WINDOW) {
+                m->transit = m->window_min;
+                m->window_min = LLONG_MAX;
+                m->window_frames = 0;
+        }
+        time_ns_t deadline = m->transit + rtp_ns + pbuf_get_playout_delay_us(playout_buf) * 1000;
+
+        // absolute schedule - sender (capture) PTP time from the SR mapping + fixed delay
+        if (playout_buf->ptp_playout_ns > 0 && playout_buf->sr_valid) {
+                int32_t ts_diff = (int32_t) (node->rtp_timestamp - playout_buf->sr_rtp_ts);
+                time_ns_t sender_time = playout_buf->sr_ntp_ns - SECS_BETWEEN_1900_1970 * NS_IN_SEC
+                        + (time_ns_t) ts_diff * NS_IN_SEC / PBUF_DEADLINE_CLOCK;
+                deadline = sender_time + playout_buf->ptp_playout_ns - ptp_clock_get_offset_ns();
+        }
+        return deadline;
+}
+
+static void free_cdata(struct pbuf *playout_buf, struct coded_data *head);
+static void pbuf_set_sr_internal(struct pbuf *playout_buf, uint32_t ntp_sec, uint32_t ntp_frac, uint32_t rtp_ts);
+static void pbuf_handoff_drain(struct pbuf *playout_buf);
+static int frame_complete(struct pbuf *playout_buf, struct pbuf_node *frame, time_ns_t curr_time);
 
 /*********************************************************************************/
 
@@ -182,12 +365,416 @@ struct pbuf *pbuf_init(volatile int *delay_ms)
                 playout_buf->playout_delay_us = 0.032 * 1000 * 1000;
                 playout_buf->last_report_seq = -1;
                 playout_buf->stats_interval = DEFAULT_STATS_INTERVAL;
+                playout_buf->av_sync_media = AV_SYNC_NONE;
+                if (get_commandline_param("pbuf-ring") != NULL) {
+                        playout_buf->ring = calloc(PBUF_RING_SLOTS, sizeof(struct pbuf_ring_slot));
+                }
+                if (get_commandline_param("pbuf-reorder-window") != NULL) {
+                        playout_buf->reorder_window_ns = atof(get_commandline_param("pbuf-reorder-window")) * NS_IN_SEC_DBL / 1000;
+                }
+                const char *ptp_playout = get_commandline_param("ptp-playout");
+                if (ptp_playout != NULL) {
+                        if (ptp_clock_enabled()) {
+                                playout_buf->ptp_playout_ns = (strlen(ptp_playout) > 0 ? atof(ptp_playout)
+                                                : PBUF_PTP_PLAYOUT_DEFAULT_MS) * NS_IN_SEC_DBL / 1000;
+                        } else {
+                                log_msg_once(LOG_LEVEL_WARNING, to_fourcc('P', 'B', 'P', 'T'), "ptp-playout requires ptp-clock, ignored.\n");
+                        }
+                }
         } else {
                 debug_msg("Failed to allocate memory for playout buffer\n");
         }
         return playout_buf;
 }
 
+/**
+ * Allocates a new arena block for items of item_size.
+ * @returns pointer to the first item or NULL
+ */
+static void *pbuf_arena_alloc_block(struct pbuf *playout_buf, size_t item_size)
+{
+        struct pbuf_arena_block *block = malloc(sizeof(struct pbuf_arena_block) + PBUF_ARENA_BLOCK_ITEMS * item_size);
+        if (block == NULL) {
+                return NULL;
+        }
+        block->nxt = playout_buf->arena;
+        playout_buf->arena = block;
+        return block->items;
+}
+
+static struct coded_data *alloc_cdata(struct pbuf *playout_buf)
+{
+        if (playout_buf->cdata_free_list == NULL) {
+                struct coded_data *items = pbuf_arena_alloc_block(playout_buf, sizeof *items);
+                if (items == NULL) {
+                        return NULL;
+                }
+                for (int i = 0; i < PBUF_ARENA_BLOCK_ITEMS; ++i) {
+                        items[i].nxt = playout_buf->cdata_free_list;
+                        playout_buf->cdata_free_list = &items[i];
+                }
+        }
+        struct coded_data *ret = playout_buf->cdata_free_list;
+        playout_buf->cdata_free_list = ret->nxt;
+        return ret;
+}
+
+static struct pbuf_node *alloc_pnode(struct pbuf *playout_buf)
+{
+        if (playout_buf->node_free_list == NULL) {
+                struct pbuf_node *items = pbuf_arena_alloc_block(playout_buf, sizeof *items);
+                if (items == NULL) {
+                        return NULL;
+                }
+                for (int i = 0; i < PBUF_ARENA_BLOCK_ITEMS; ++i) {
+                        items[i].nxt = playout_buf->node_free_list;
+                        items[i].index = NULL;
+                        items[i].index_capacity = 0;
+                        playout_buf->node_free_list = &items[i];
+                }
+        }
+        struct pbuf_node *ret = playout_buf->node_free_list;
+        playout_buf->node_free_list = ret->nxt;
+        struct coded_data **index = ret->index;
+        unsigned int index_capacity = ret->index_capacity;
+        memset(ret, 0, sizeof *ret);
+        ret->index = index;
+        ret->index_capacity = index_capacity;
+        return ret;
+}
+
+static void free_pnode(struct pbuf *playout_buf, struct pbuf_node *node)
+{
+        node->nxt = playout_buf->node_free_list;
+        playout_buf->node_free_list = node;
+}
+
+ADD_TO_PARAM("ptp-playout", "* ptp-playout[=<ms>]\n"
+                "  Present video frames at a fixed delay (default " TOSTRING(PBUF_PTP_PLAYOUT_DEFAULT_MS) " ms) after their capture in PTP time\n"
+                "  (RTCP SR mapping), so that receivers play out frame-synchronously (requires ptp-clock\n"
+                "  on both sides, enables display-scheduler).\n");
+
+ADD_TO_PARAM("pbuf-reorder-window", "* pbuf-reorder-window=<ms>\n"
+                "  Wait up to <ms> for reordered packets of an incomplete frame after its last packet\n"
+                "  or a packet of a subsequent frame was received (default 0 - decode immediately).\n");
+
+/**
+ * @returns true if pkt carries the beginning of the frame (substream 0 at
+ * offset 0) - applicable to UltraGrid video, audio and FEC payloads, which
+ * share the first 3 header words
+ */
+static bool pbuf_pkt_is_frame_start(const rtp_packet *pkt)
+{
+        if (!(pkt->pt == PT_VIDEO || pkt->pt == PT_ENCRYPT_VIDEO || PT_VIDEO_HAS_FEC(pkt->pt)
+                                || pkt->pt == PT_AUDIO || pkt->pt == PT_ENCRYPT_AUDIO || PT_AUDIO_HAS_FEC(pkt->pt))
+                        || pkt->data_len < (int) (3 * sizeof(uint32_t))) {
+                return false;
+        }
+        const uint32_t *hdr = (const uint32_t *)(const void *) pkt->data;
+        return ntohl(hdr[0]) >> 22U == 0 && ntohl(hdr[1]) == 0;
+}
+
+/**
+ * Marks the frame as finished by the sender (a packet of a subsequent frame
+ * was received) and starts the reordering window.
+ */
+static void pbuf_node_set_completed(struct pbuf *playout_buf, struct pbuf_node *node, time_ns_t now)
+{
+        node->completed = true;
+        if (node->ready_time == 0) {
+                node->ready_time = now + playout_buf->reorder_window_ns;
+        }
+}
+
+/**
+ * Accounts a newly stored (non-duplicate) packet of the frame.
+ */
+static void pbuf_node_account_pkt(struct pbuf *playout_buf, struct pbuf_node *node, const rtp_packet *pkt)
+{
+        time_ns_t now = get_time_in_ns();
+        node->received += 1;
+        node->last_arrival_time = pkt->rx_time;
+        if (pkt->m && !node->mbit) {
+                node->mbit = 1;
+                node->last_seq = pkt->seq;
+                if (node->ready_time == 0) {
+                        node->ready_time = now + playout_buf->reorder_window_ns;
+                }
+        }
+        if (pbuf_pkt_is_frame_start(pkt)) {
+                node->first_seq = pkt->seq;
+                node->first_known = true;
+        }
+}
+
+static bool pbuf_node_index_reserve(struct pbuf_node *node, unsigned int count)
+{
+        if (count <= node->index_capacity) {
+                return true;
+        }
+        unsigned int new_capacity = MAX(MAX(node->index_capacity * 2, count), PBUF_RING_MIN_PKTS);
+        struct coded_data **index = realloc(node->index, new_capacity * sizeof *index);
+        if (index == NULL) {
+                return false;
+        }
+        node->index = index;
+        node->index_capacity = new_capacity;
+        return true;
+}
+
+/**
+ * Returns the index slot for seq of the (linked-list variant) frame, the
+ * index is grown or rebased if needed.
+ * @returns NULL if out of memory
+ */
+static struct coded_data **pbuf_node_index_slot(struct pbuf_node *node, uint16_t seq)
+{
+        uint16_t idx = seq - node->base_seq;
+        if (idx >= 1U<<15U) { // packet preceding base_seq - shift the index
+                unsigned int shift = (uint16_t) (node->base_seq - seq) + PBUF_INDEX_HEADROOM;
+                if (!pbuf_node_index_reserve(node, node->index_len + shift)) {
+                        return NULL;
+                }
+                memmove(node->index + shift, node->index, node->index_len * sizeof *node->index);
+                memset(node->index, 0, shift * sizeof *node->index);
+                node->index_len += shift;
+                node->base_seq -= shift;
+                idx = seq - node->base_seq;
+        }
+        if (idx >= node->index_len) {
+                if (!pbuf_node_index_reserve(node, idx + 1)) {
+                        return NULL;
+                }
+                memset(node->index + node->index_len, 0, (idx + 1 - node->index_len) * sizeof *node->index);
+                node->index_len = idx + 1;
+        }
+        return &node->index[idx];
+}
+
+ADD_TO_PARAM("pbuf-ring", "* pbuf-ring\n"
+                "  Use playout buffer with preallocated frame slots instead of linked lists (lower CPU\n"
+                "  usage at high packet rates).\n");
+
+static struct pbuf_ring_slot *pbuf_ring_slot(struct pbuf *playout_buf, unsigned int i)
+{
+        return &playout_buf->ring[(playout_buf->ring_first + i) % PBUF_RING_SLOTS];
+}
+
+static void pbuf_ring_free_slot(struct pbuf_ring_slot *slot)
+{
+        for (unsigned int i = 0; i < slot->span; ++i) {
+                if (slot->pkts[i].data != NULL) {
+                        udp_packet_free(slot->pkts[i].data);
+                        slot->pkts[i].data = NULL;
+                }
+        }
+        slot->span = 0;
+}
+
+static void pbuf_ring_destroy(struct pbuf *playout_buf)
+{
+        if (playout_buf->ring == NULL) {
+                return;
+        }
+        for (unsigned int i = 0; i < PBUF_RING_SLOTS; ++i) {
+                pbuf_ring_free_slot(&playout_buf->ring[i]);
+                free(playout_buf->ring[i].pkts);
+        }
+        free(playout_buf->ring);
+}
+
+static bool pbuf_ring_reserve(struct pbuf_ring_slot *slot, unsigned int count)
+{
+        if (count <= slot->capacity) {
+                return true;
+        }
+        unsigned int new_capacity = MAX(MAX(slot->capacity * 2, count), PBUF_RING_MIN_PKTS);
+        struct coded_data *pkts = realloc(slot->pkts, new_capacity * sizeof *pkts);
+        if (pkts == NULL) {
+                return false;
+        }
+        memset(pkts + slot->capacity, 0, (new_capacity - slot->capacity) * sizeof *pkts);
+        slot->pkts = pkts;
+        slot->capacity = new_capacity;
+        return true;
+}
+
+/**
+ * Estimates number of packets of the frame from the first received packet
+ * (for UltraGrid video, the payload header contains the buffer length).
+ */
+static unsigned int pbuf_ring_estimate_pkts(const rtp_packet *pkt)
+{
+        if ((pkt->pt == PT_VIDEO || pkt->pt == PT_ENCRYPT_VIDEO || PT_VIDEO_HAS_FEC(pkt->pt))
+                        && pkt->data_len > (int) sizeof(video_payload_hdr_t)) {
+                uint32_t buffer_length = ntohl(((uint32_t *)(void *) pkt->data)[2]);
+                return buffer_length / (pkt->data_len - sizeof(video_payload_hdr_t)) + 1;
+        }
+        return PBUF_RING_MIN_PKTS;
+}
+
+static void pbuf_ring_new_frame(struct pbuf *playout_buf, rtp_packet *pkt)
+{
+        if (playout_buf->ring_count == PBUF_RING_SLOTS) {
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Ring full, dropping oldest frame (RTP TS=%u)!\n",
+                                playout_buf->ring[playout_buf->ring_first].node.rtp_timestamp);
+                pbuf_ring_free_slot(&playout_buf->ring[playout_buf->ring_first]);
+                playout_buf->ring_first = (playout_buf->ring_first + 1) % PBUF_RING_SLOTS;
+                playout_buf->ring_count -= 1;
+        }
+        struct pbuf_node *prev = NULL;
+        if (playout_buf->ring_count > 0) {
+                prev = &pbuf_ring_slot(playout_buf, playout_buf->ring_count - 1)->node;
+                pbuf_node_set_completed(playout_buf, prev, get_time_in_ns());
+        }
+        struct pbuf_ring_slot *slot = pbuf_ring_slot(playout_buf, playout_buf->ring_count);
+        long long playout_delay_us = pbuf_get_playout_delay_us(playout_buf);
+        memset(&slot->node, 0, sizeof slot->node);
+        if (prev != NULL && prev->mbit) {
+                slot->node.first_seq = prev->last_seq + 1;
+                slot->node.first_known = true;
+        }
+        slot->node.magic = PBUF_MAGIC;
+        slot->node.rtp_timestamp = pkt->ts;
+        slot->node.playout_time = slot->node.last_arrival_time =
+                slot->node.arrival_time = pkt->rx_time;
+        slot->node.playout_time += playout_delay_us * 1000;
+        slot->node.deletion_time = slot->node.playout_time + playout_delay_us * 1000;
+        slot->base_seq = pkt->seq;
+        slot->span = 0;
+        pbuf_ring_reserve(slot, pbuf_ring_estimate_pkts(pkt));
+        playout_buf->ring_count += 1;
+}
+
+static void pbuf_ring_add_pkt(struct pbuf *playout_buf, struct pbuf_ring_slot *slot, rtp_packet *pkt)
+{
+        uint16_t idx = pkt->seq - slot->base_seq;
+        if (idx >= 1U<<15U) { // packet preceding base_seq (reordered) - shift the array
+                unsigned int shift = (uint16_t) (slot->base_seq - pkt->seq);
+                if (!pbuf_ring_reserve(slot, slot->span + shift)) {
+                        udp_packet_free(pkt);
+                        return;
+                }
+                memmove(slot->pkts + shift, slot->pkts, slot->span * sizeof *slot->pkts);
+                memset(slot->pkts, 0, shift * sizeof *slot->pkts);
+                slot->span += shift;
+                slot->base_seq = pkt->seq;
+                idx = 0;
+        }
+        if (!pbuf_ring_reserve(slot, idx + 1)) {
+                udp_packet_free(pkt);
+                return;
+        }
+        if (slot->pkts[idx].data != NULL) { // duplicate
+                udp_packet_free(pkt);
+                return;
+        }
+        slot->pkts[idx].seqno = pkt->seq;
+        slot->pkts[idx].data = pkt;
+        slot->span = MAX(slot->span, (unsigned int) idx + 1);
+        pbuf_node_account_pkt(playout_buf, &slot->node, pkt);
+}
+
+static void pbuf_ring_insert(struct pbuf *playout_buf, rtp_packet *pkt)
+{
+        if (playout_buf->ring_count == 0 ||
+                        pbuf_ring_slot(playout_buf, playout_buf->ring_count - 1)->node.rtp_timestamp < pkt->ts) {
+                pbuf_ring_new_frame(playout_buf, pkt);
+        }
+        // the packet belongs most likely to the last frame, search back from there
+        for (unsigned int i = playout_buf->ring_count; i > 0; --i) {
+                struct pbuf_ring_slot *slot = pbuf_ring_slot(playout_buf, i - 1);
+                if (slot->node.rtp_timestamp == pkt->ts) {
+                        if (slot->node.decoded) {
+                                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Late data for already decoded frame!\n");
+                        }
+                        pbuf_ring_add_pkt(playout_buf, slot, pkt);
+                        return;
+                }
+                if (slot->node.rtp_timestamp < pkt->ts) {
+                        break;
+                }
+        }
+        debug_msg("A packet for a frame that is not present - discarded\n");
+        udp_packet_free(pkt);
+}
+
+/// links received packets to the list in descending sequence number order (as the linked-list variant)
+static struct coded_data *pbuf_ring_link(struct pbuf_ring_slot *slot)
+{
+        struct coded_data *head = NULL;
+        struct coded_data *prv = NULL;
+        for (unsigned int i = slot->span; i > 0; --i) {
+                struct coded_data *cur = &slot->pkts[i - 1];
+                if (cur->data == NULL) {
+                        continue;
+                }
+                cur->prv = prv;
+                cur->nxt = NULL;
+                if (prv != NULL) {
+                        prv->nxt = cur;
+                } else {
+                        head = cur;
+                }
+                prv = cur;
+        }
+        return head;
+}
+
+static void pbuf_report_av_sync(struct pbuf *playout_buf, struct pbuf_node *node, time_ns_t curr_time)
+{
+        if (playout_buf->av_sync_media == AV_SYNC_NONE || !playout_buf->sr_valid) {
+                return;
+        }
+        // UltraGrid RTP uses 90 kHz clock both for audio and video
+        int32_t ts_diff = (int32_t) (node->rtp_timestamp - playout_buf->sr_rtp_ts);
+        time_ns_t sender_time = playout_buf->sr_ntp_ns + (time_ns_t) ts_diff * NS_IN_SEC / 90000;
+        av_sync_report(playout_buf->av_sync_media, curr_time, sender_time);
+}
+
+static int pbuf_ring_decode(struct pbuf *playout_buf, time_ns_t curr_time,
+                             decode_frame_t decode_func, void *data)
+{
+        for (unsigned int i = 0; i < playout_buf->ring_count; ++i) {
+                struct pbuf_node *curr = &pbuf_ring_slot(playout_buf, i)->node;
+                if (curr->decoded || curr_time <= curr->playout_time) {
+                        continue;
+                }
+                if (frame_complete(playout_buf, curr, curr_time)) {
+                        struct pbuf_stats stats = { playout_buf->received_pkts_cum,
+                                playout_buf->expected_pkts_cum, curr->arrival_time,
+                                curr->last_arrival_time, pbuf_frame_deadline(playout_buf, curr) };
+                        curr->cdata = pbuf_ring_link(pbuf_ring_slot(playout_buf, i));
+                        curr->decoded = 1;
+                        if (curr->cdata == NULL) {
+                                return 0;
+                        }
+                        pbuf_report_av_sync(playout_buf, curr, curr_time);
+                        return decode_func(curr->cdata, data, &stats);
+                }
+                if (curr_time > curr->playout_time + 1 * NS_IN_SEC) {
+                        curr->completed = true;
+                        curr->ready_time = curr_time;
+                }
+                debug_msg("Unable to decode frame due to missing data (RTP TS=%u)\n",
+                                curr->rtp_timestamp);
+        }
+        return 0;
+}
+
+static void pbuf_ring_remove(struct pbuf *playout_buf, time_ns_t curr_time)
+{
+        while (playout_buf->ring_count > 0) {
+                struct pbuf_ring_slot *slot = &playout_buf->ring[playout_buf->ring_first];
+                if (curr_time <= slot->node.deletion_time || !frame_complete(playout_buf, &slot->node, curr_time)) {
+                        break;
+                }
+                pbuf_ring_free_slot(slot);
+                playout_buf->ring_first = (playout_buf->ring_first + 1) % PBUF_RING_SLOTS;
+                playout_buf->ring_count -= 1;
+        }
+}
+
 void pbuf_destroy(struct pbuf *playout_buf) {
         if (playout_buf) {
                 pbuf_validate(playout_buf);
@@ -201,6 +788,23 @@ void pbuf_destroy(struct pbuf *playout_buf) {
                                         playout_buf->expected_pkts_cum * 100.0);
                 }
 
+                if (playout_buf->handoff != NULL) {
+                        struct pbuf_handoff *h = playout_buf->handoff;
+                        for (int i = 0; i < h->count; ++i) {
+                                udp_packet_free(h->pkts[i]);
+                        }
+                        if (h->dropped > 0) {
+                                log_msg(LOG_LEVEL_INFO, MOD_NAME "%lld packets dropped due to full handoff queue.\n", h->dropped);
+                        }
+                        pthread_mutex_destroy(&h->lock);
+                        pthread_cond_destroy(&h->cv);
+                        free(h->pkts);
+                        free(h->spare);
+                        free(h);
+                }
+                pbuf_ring_destroy(playout_buf);
+                free(playout_buf->nack);
+
                 struct pbuf_node *curr = playout_buf->frst;
                 while (curr != NULL) {
                         struct pbuf_node *temp = curr->nxt;
@@ -216,10 +820,18 @@ void pbuf_destroy(struct pbuf *playout_buf) {
                         if (curr->prv != NULL) {
                                 curr->prv->nxt = curr->nxt;
                         }
-                        free_cdata(curr->cdata);
-                        free(curr);
+                        free_cdata(playout_buf, curr->cdata);
+                        free_pnode(playout_buf, curr);
                         curr = temp;
                 }
+                for (curr = playout_buf->node_free_list; curr != NULL; curr = curr->nxt) {
+                        free(curr->index);
+                }
+                while (playout_buf->arena != NULL) {
+                        struct pbuf_arena_block *nxt = playout_buf->arena->nxt;
+                        free(playout_buf->arena);
+                        playout_buf->arena = nxt;
+                }
                 free(playout_buf);
         }
 }
@@ -227,77 +839,82 @@ void pbuf_destroy(struct pbuf *playout_buf) {
 /** Add "pkt" to the frame represented by "node". The "node" has
  * previously been created, and has some coded data already...
  *
- * New arrivals are filed to the list in descending sequence number order
+ * New arrivals are filed to the list in descending sequence number order,
+ * position of reordered packets is looked up in the node index (the nearest
+ * received packet with a higher sequence number) instead of the list scan.
  */
-static void add_coded_unit(struct pbuf_node *node, rtp_packet * pkt)
+static void add_coded_unit(struct pbuf *playout_buf, struct pbuf_node *node, rtp_packet * pkt)
 {
         assert(node->rtp_timestamp == pkt->ts);
         assert(node->cdata != NULL);
 
-        struct coded_data *tmp = (struct coded_data *) malloc(sizeof(struct coded_data));
+        struct coded_data **slot = pbuf_node_index_slot(node, pkt->seq);
+        if (slot == NULL || *slot != NULL) {
+                /* out of memory or duplicate packet, drop it... */
+                udp_packet_free(pkt);
+                return;
+        }
+        struct coded_data *tmp = alloc_cdata(playout_buf);
         if (tmp == NULL) {
                 /* this is bad, out of memory, drop the packet... */
-                free(pkt);
+                udp_packet_free(pkt);
                 return;
         }
 
         tmp->seqno = pkt->seq;
         tmp->data = pkt;
-        node->mbit |= pkt->m;
-        if((int16_t)(tmp->seqno - node->cdata->seqno) > 0){
-                tmp->prv = NULL;
+        *slot = tmp;
+        pbuf_node_account_pkt(playout_buf, node, pkt);
+
+        struct coded_data *prv = NULL;
+        for (unsigned int i = slot - node->index + 1; i < node->index_len; ++i) {
+                if (node->index[i] != NULL) {
+                        prv = node->index[i];
+                        break;
+                }
+        }
+        tmp->prv = prv;
+        if (prv == NULL) {
                 tmp->nxt = node->cdata;
                 node->cdata->prv = tmp;
                 node->cdata = tmp;
         } else {
-                struct coded_data *curr = node->cdata;
-                struct coded_data *prv = NULL;
-                while (curr != NULL &&  ((int16_t)(tmp->seqno - curr->seqno) < 0)){
-                        prv = curr;
-                        curr = curr->nxt;
-                }
-                if (curr == NULL) {
-                        tmp->nxt = NULL;
-                        tmp->prv = prv;
-                        prv->nxt = tmp;
-                }else if ((int16_t)(tmp->seqno - curr->seqno) > 0){
-                        tmp->nxt = curr;
-                        tmp->prv = curr->prv;
-                        tmp->prv->nxt = tmp;
-                        curr->prv = tmp;
-                } else {
-                        /* this is bad, something went terribly wrong... */
-                        free(pkt);
-                        free(tmp);
+                tmp->nxt = prv->nxt;
+                if (prv->nxt != NULL) {
+                        prv->nxt->prv = tmp;
                 }
+                prv->nxt = tmp;
         }
 }
 
-static struct pbuf_node *create_new_pnode(rtp_packet * pkt, long long playout_delay_us)
+static struct pbuf_node *create_new_pnode(struct pbuf *playout_buf, rtp_packet * pkt, long long playout_delay_us)
 {
-        struct pbuf_node *tmp = calloc(1, sizeof(struct pbuf_node));
+        struct pbuf_node *tmp = alloc_pnode(playout_buf);
         if (tmp != NULL) {
                 tmp->magic = PBUF_MAGIC;
                 tmp->rtp_timestamp = pkt->ts;
-                tmp->mbit = pkt->m;
-                tmp->playout_time =
-                        tmp->arrival_time = get_time_in_ns();
+                tmp->playout_time = tmp->last_arrival_time =
+                        tmp->arrival_time = pkt->rx_time;
                 tmp->playout_time += playout_delay_us * 1000;
                 tmp->deletion_time = tmp->playout_time + playout_delay_us * 1000;
+                tmp->base_seq = pkt->seq - PBUF_INDEX_HEADROOM;
 
-                tmp->cdata = (struct coded_data *) malloc(sizeof(struct coded_data));
+                struct coded_data **slot = pbuf_node_index_slot(tmp, pkt->seq);
+                tmp->cdata = slot != NULL ? alloc_cdata(playout_buf) : NULL;
                 if (tmp->cdata != NULL) {
                         tmp->cdata->nxt = NULL;
                         tmp->cdata->prv = NULL;
                         tmp->cdata->seqno = pkt->seq;
                         tmp->cdata->data = pkt;
+                        *slot = tmp->cdata;
+                        pbuf_node_account_pkt(playout_buf, tmp, pkt);
                 } else {
-                        free(pkt);
-                        free(tmp);
+                        udp_packet_free(pkt);
+                        free_pnode(playout_buf, tmp);
                         return NULL;
                 }
         } else {
-                free(pkt);
+                udp_packet_free(pkt);
         }
         return tmp;
 }
@@ -349,13 +966,36 @@ static inline void pbuf_process_stats(struct pbuf *playout_buf, rtp_packet * pkt
                 playout_buf->dups += 1;
         }
         playout_buf->packets[pkt->seq / NUMBER_WORD_BITS] |= current_bit;
+
+        // network jitter is computed from arrival times of first packets of
+        // frames, so that the sender pacing is not included
+        if (pkt->ts != playout_buf->jitter_last_ts) {
+                if (playout_buf->jitter_last_rx != 0) {
+                        long long d = (pkt->rx_time - playout_buf->jitter_last_rx)
+                                - (long long) (int32_t) (pkt->ts - playout_buf->jitter_last_ts) * NS_IN_SEC / PBUF_DEADLINE_CLOCK;
+                        playout_buf->jitter_ns += (llabs(d) - playout_buf->jitter_ns) / 16;
+                }
+                playout_buf->jitter_last_ts = pkt->ts;
+                playout_buf->jitter_last_rx = pkt->rx_time;
+        }
+        long long host_delay = get_time_in_ns() - pkt->rx_time;
+        playout_buf->host_delay_sum += host_delay;
+        playout_buf->host_delay_max = MAX(playout_buf->host_delay_max, host_delay);
+        playout_buf->host_delay_count += 1;
+
         uint16_t dist = (uint16_t) (pkt->seq - playout_buf->last_report_seq);
         if (dist >= playout_buf->stats_interval * 2 && dist < 1U<<15U) {
+                static struct metric *lost_metric;
+                if (lost_metric == NULL) {
+                        lost_metric = metric_counter("ug_rx_packets_lost", "RTP packets not received (per playout buffer accounting)", NULL);
+                }
                 uint16_t report_seq_until = (uint16_t) ((pkt->seq / playout_buf->stats_interval * playout_buf->stats_interval) - playout_buf->stats_interval); // sum up only up to current-playout_buf->stats_interval to be able to catch out-of-order packets
                 for (uint16_t i = playout_buf->last_report_seq;
                                 i != report_seq_until; i += NUMBER_WORD_BITS) {
+                        int received = __builtin_popcountll(playout_buf->packets[i / NUMBER_WORD_BITS]);
                         playout_buf->expected_pkts += NUMBER_WORD_BITS;
-                        playout_buf->received_pkts += __builtin_popcountll(playout_buf->packets[i / NUMBER_WORD_BITS]);
+                        playout_buf->received_pkts += received;
+                        metric_add(lost_metric, NUMBER_WORD_BITS - received);
                         compute_longest_gap(&playout_buf->longest_gap, playout_buf->packets[i / NUMBER_WORD_BITS]);
                         playout_buf->packets[i / NUMBER_WORD_BITS] = 0;
                 }
@@ -380,9 +1020,20 @@ static inline void pbuf_process_stats(struct pbuf *playout_buf, rtp_packet * pkt
                 if (playout_buf->dups > 0) {
                         snprintf(oo_dups_str + strlen(oo_dups_str), sizeof oo_dups_str - strlen(oo_dups_str), ", %d dups", playout_buf->dups);
                 }
-                log_msg(LOG_LEVEL_INFO, "SSRC 0x%08" PRIx32 ": %d/%d packets received (%s%.4f%%" TERM_FG_RESET "), %d lost, max loss %d%s\n",
+                double host_delay_ms = playout_buf->host_delay_count > 0 ? (double) playout_buf->host_delay_sum / playout_buf->host_delay_count / 1000000.0 : 0.0;
+                log_msg(LOG_LEVEL_INFO, "SSRC 0x%08" PRIx32 ": %d/%d packets received (%s%.4f%%" TERM_FG_RESET "), %d lost, max loss %d%s, "
+                                "jitter %.2f ms, host delay %.2f ms (max %.2f)\n",
                                 pkt->ssrc, playout_buf->received_pkts, playout_buf->expected_pkts, (loss_pct < 100.0 ? TERM_FG_RED : ""), loss_pct,
-                                playout_buf->expected_pkts - playout_buf->received_pkts, playout_buf->longest_gap, oo_dups_str);
+                                playout_buf->expected_pkts - playout_buf->received_pkts, playout_buf->longest_gap, oo_dups_str,
+                                playout_buf->jitter_ns / 1000000.0, host_delay_ms, playout_buf->host_delay_max / 1000000.0);
+                static struct metric *jitter_metric;
+                static struct metric *host_delay_metric;
+                if (jitter_metric == NULL) {
+                        jitter_metric = metric_gauge("ug_rx_network_jitter_ms", "Interarrival jitter of frames (last stream reported)", NULL);
+                        host_delay_metric = metric_gauge("ug_rx_host_delay_ms", "Average delay from packet arrival to playout buffer (last stream reported)", NULL);
+                }
+                metric_set(jitter_metric, playout_buf->jitter_ns / 1000000.0);
+                metric_set(host_delay_metric, host_delay_ms);
 
                 if (playout_buf->max_out_of_order_dist >= playout_buf->stats_interval) {
                         size_t new_val = (playout_buf->max_out_of_order_dist + STAT_INT_MIN_DIVISOR - 1) / STAT_INT_MIN_DIVISOR * STAT_INT_MIN_DIVISOR;
@@ -397,19 +1048,95 @@ static inline void pbuf_process_stats(struct pbuf *playout_buf, rtp_packet * pkt
                 playout_buf->out_of_order_pkts = 0;
                 playout_buf->max_out_of_order_dist = 0;
                 playout_buf->dups = 0;
+                playout_buf->host_delay_sum = playout_buf->host_delay_max = 0;
+                playout_buf->host_delay_count = 0;
         }
 }
 
-void pbuf_insert(struct pbuf *playout_buf, rtp_packet * pkt)
+/**
+ * Records received packet and queues the gap before it (if any) to be
+ * requested for retransmission after PBUF_NACK_GRACE_NS.
+ */
+static void pbuf_nack_track(struct pbuf_nack_state *n, uint16_t seq)
+{
+#       define NACK_BIT(seq) (1ULL << ((seq) % NUMBER_WORD_BITS))
+        n->seen[seq / NUMBER_WORD_BITS] |= NACK_BIT(seq);
+        if (!n->started) {
+                n->started = true;
+                n->highest = seq;
+                return;
+        }
+        uint16_t gap = seq - n->highest;
+        if (gap >= 1U<<15U) { // older packet (reordered or retransmitted)
+                if ((uint16_t) (n->highest - seq) > PBUF_NACK_QUEUE_LEN * 2) { // stream restarted
+                        memset(n->seen, 0, sizeof n->seen);
+                        n->seen[seq / NUMBER_WORD_BITS] |= NACK_BIT(seq);
+                        n->highest = seq;
+                        n->count = 0;
+                }
+                return;
+        }
+        if (gap > 1 && gap <= PBUF_NACK_MAX_GAP) {
+                time_ns_t due = get_time_in_ns() + PBUF_NACK_GRACE_NS;
+                for (uint16_t i = n->highest + 1; i != seq && n->count < PBUF_NACK_QUEUE_LEN; ++i) {
+                        unsigned int idx = (n->first + n->count++) % PBUF_NACK_QUEUE_LEN;
+                        n->queue[idx].seq = i;
+                        n->queue[idx].due = due;
+                }
+        }
+        // forget the half of sequence space ahead so that bits are valid after wrap-around
+        for (uint16_t i = n->highest + 1; i != (uint16_t) (seq + 1); ++i) {
+                uint16_t ahead = i + (1U<<15U);
+                n->seen[ahead / NUMBER_WORD_BITS] &= ~NACK_BIT(ahead);
+        }
+        n->highest = seq;
+}
+
+/**
+ * Returns packets that are still missing after the grace period, so that
+ * the caller can request their retransmission (rtp_send_nack()). The first
+ * call enables the tracking.
+ *
+ * @returns number of sequence numbers stored to seqs (in ascending order)
+ */
+int pbuf_get_nacks(struct pbuf *playout_buf, time_ns_t curr_time, uint16_t *seqs, int max)
+{
+        pbuf_handoff_drain(playout_buf);
+        struct pbuf_nack_state *n = playout_buf->nack;
+        if (n == NULL) {
+                playout_buf->nack = calloc(1, sizeof *playout_buf->nack);
+                return 0;
+        }
+        int count = 0;
+        while (n->count > 0 && count < max && n->queue[n->first].due <= curr_time) {
+                uint16_t seq = n->queue[n->first].seq;
+                n->first = (n->first + 1) % PBUF_NACK_QUEUE_LEN;
+                n->count -= 1;
+                if ((n->seen[seq / NUMBER_WORD_BITS] & NACK_BIT(seq)) == 0) {
+                        seqs[count++] = seq;
+                }
+        }
+        return count;
+}
+
+static void pbuf_insert_pkt(struct pbuf *playout_buf, rtp_packet * pkt)
 {
         struct pbuf_node *tmp;
 
         pbuf_validate(playout_buf);
         pbuf_process_stats(playout_buf, pkt);
+        if (playout_buf->nack != NULL) {
+                pbuf_nack_track(playout_buf->nack, pkt->seq);
+        }
+
+        if (playout_buf->ring != NULL) {
+                pbuf_ring_insert(playout_buf, pkt);
+                return;
+        }
 
         if (playout_buf->frst == NULL && playout_buf->last == NULL) {
                 /* playout buffer is empty - add new frame */
-                playout_buf->frst = create_new_pnode(pkt, playout_buf->playout_delay_us + 1000 * (playout_buf->offset_ms ? *playout_buf->offset_ms : 0));
+                playout_buf->frst = create_new_pnode(playout_buf, pkt, pbuf_get_playout_delay_us(playout_buf));
                 playout_buf->last = playout_buf->frst;
                 return;
         }
@@ -420,13 +1147,20 @@ void pbuf_insert(struct pbuf *playout_buf, rtp_packet * pkt)
                 }
                 /* Packet belongs to last frame in playout_buf this is the */
                 /* most likely scenario - although...                      */
-                add_coded_unit(playout_buf->last, pkt);
+                add_coded_unit(playout_buf, playout_buf->last, pkt);
         } else {
                 if (playout_buf->last->rtp_timestamp < pkt->ts) {
                         /* Packet belongs to a new frame... */
-                        tmp = create_new_pnode(pkt, playout_buf->playout_delay_us + 1000 * (playout_buf->offset_ms ? *playout_buf->offset_ms : 0));
+                        tmp = create_new_pnode(playout_buf, pkt, pbuf_get_playout_delay_us(playout_buf));
+                        if (tmp == NULL) {
+                                return;
+                        }
+                        if (playout_buf->last->mbit && !tmp->first_known) {
+                                tmp->first_seq = playout_buf->last->last_seq + 1;
+                                tmp->first_known = true;
+                        }
                         playout_buf->last->nxt = tmp;
-                        playout_buf->last->completed = true;
+                        pbuf_node_set_completed(playout_buf, playout_buf->last, tmp->arrival_time);
                         tmp->prv = playout_buf->last;
                         playout_buf->last = tmp;
                 } else {
@@ -444,7 +1178,7 @@ void pbuf_insert(struct pbuf *playout_buf, rtp_packet * pkt)
                                 }
                                 if (curr->rtp_timestamp == pkt->ts) {
                                         /* Packet belongs to a previous existing frame... */
-                                        add_coded_unit(curr, pkt);
+                                        add_coded_unit(playout_buf, curr, pkt);
                                 } else {
                                         /* Packet belongs to a frame that is not present */
                                         discard_pkt = true;
@@ -455,23 +1189,131 @@ void pbuf_insert(struct pbuf *playout_buf, rtp_packet * pkt)
                                         debug_msg
                                                 ("Oops... dropped packet with M bit set\n");
                                 }
-                                free(pkt);
+                                udp_packet_free(pkt);
                         }
                 }
         }
         pbuf_validate(playout_buf);
 }
 
-static void free_cdata(struct coded_data *head)
+void pbuf_insert(struct pbuf *playout_buf, rtp_packet * pkt)
 {
-        struct coded_data *tmp;
+        struct pbuf_handoff *h = playout_buf->handoff;
+        if (h != NULL) {
+                pthread_mutex_lock(&h->lock);
+                if (h->count == h->max) {
+                        h->dropped += 1;
+                        pthread_mutex_unlock(&h->lock);
+                        udp_packet_free(pkt);
+                        return;
+                }
+                h->pkts[h->count++] = pkt;
+                pthread_cond_signal(&h->cv);
+                pthread_mutex_unlock(&h->lock);
+                return;
+        }
+        C_PROFILER_PUSH("pbuf_insert");
+        pbuf_insert_pkt(playout_buf, pkt);
+        C_PROFILER_POP;
+}
 
-        while (head != NULL) {
-                free(head->data);
-                tmp = head;
-                head = head->nxt;
-                free(tmp);
+/**
+ * Files packets (and applies settings) passed by the producer in the
+ * concurrent mode. Called from the consumer side functions.
+ */
+static void pbuf_handoff_drain(struct pbuf *playout_buf)
+{
+        struct pbuf_handoff *h = playout_buf->handoff;
+        if (h == NULL) {
+                return;
+        }
+        pthread_mutex_lock(&h->lock);
+        rtp_packet **pkts = h->pkts;
+        int count = h->count;
+        h->pkts = h->spare;
+        h->spare = pkts;
+        h->count = 0;
+        if (h->sr_pending) {
+                pbuf_set_sr_internal(playout_buf, h->sr_ntp_sec, h->sr_ntp_frac, h->sr_rtp_ts);
+                h->sr_pending = false;
+        }
+        if (h->delay_pending) {
+                playout_buf->playout_delay_us = h->playout_delay * 1000 * 1000;
+                h->delay_pending = false;
+        }
+        pthread_mutex_unlock(&h->lock);
+
+        C_PROFILER_PUSH("pbuf_insert");
+        for (int i = 0; i < count; ++i) {
+                pbuf_insert_pkt(playout_buf, pkts[i]);
         }
+        C_PROFILER_POP;
+}
+
+/**
+ * Switches the playout buffer to the concurrent mode - pbuf_insert(),
+ * pbuf_set_sr() and pbuf_set_playout_delay() may then be called from a
+ * different (producer) thread than the rest of the API. Inserted packets are
+ * only queued (at most max_pending, excessive ones are dropped) and filed by
+ * the consumer, so that the producer is never blocked by the decoding.
+ *
+ * Must be called before the producer and consumer start running concurrently.
+ */
+void pbuf_set_concurrent(struct pbuf *playout_buf, int max_pending)
+{
+        if (playout_buf->handoff != NULL) {
+                return;
+        }
+        struct pbuf_handoff *h = calloc(1, sizeof *h);
+        h->pkts = malloc(max_pending * sizeof h->pkts[0]);
+        h->spare = malloc(max_pending * sizeof h->spare[0]);
+        h->max = max_pending;
+        pthread_mutex_init(&h->lock, NULL);
+        pthread_cond_init(&h->cv, NULL);
+        playout_buf->handoff = h;
+}
+
+/**
+ * Waits (in the concurrent mode) until the producer inserts some packets or
+ * the timeout elapses.
+ * @retval TRUE  packets are waiting to be filed
+ */
+int pbuf_wait(struct pbuf *playout_buf, time_ns_t timeout)
+{
+        struct pbuf_handoff *h = playout_buf->handoff;
+        assert(h != NULL);
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        time_ns_t deadline = (time_ns_t) ts.tv_sec * NS_IN_SEC + ts.tv_nsec + timeout;
+        ts.tv_sec = deadline / NS_IN_SEC;
+        ts.tv_nsec = deadline % NS_IN_SEC;
+        pthread_mutex_lock(&h->lock);
+        while (h->count == 0) {
+                if (pthread_cond_timedwait(&h->cv, &h->lock, &ts) != 0) {
+                        break;
+                }
+        }
+        int ret = h->count > 0;
+        pthread_mutex_unlock(&h->lock);
+        return ret;
+}
+
+/// frees packets of the frame and returns the whole chain to the free list
+static void free_cdata(struct pbuf *playout_buf, struct coded_data *head)
+{
+        if (head == NULL) {
+                return;
+        }
+        struct coded_data *tail = head;
+        while (1) {
+                udp_packet_free(tail->data);
+                if (tail->nxt == NULL) {
+                        break;
+                }
+                tail = tail->nxt;
+        }
+        tail->nxt = playout_buf->cdata_free_list;
+        playout_buf->cdata_free_list = head;
 }
 
 void pbuf_remove(struct pbuf *playout_buf, time_ns_t curr_time)
@@ -482,12 +1324,18 @@ void pbuf_remove(struct pbuf *playout_buf, time_ns_t curr_time)
 
         struct pbuf_node *curr, *temp;
 
+        pbuf_handoff_drain(playout_buf);
+        if (playout_buf->ring != NULL) {
+                pbuf_ring_remove(playout_buf, curr_time);
+                return;
+        }
+
         pbuf_validate(playout_buf);
 
         curr = playout_buf->frst;
         while (curr != NULL) {
                 temp = curr->nxt;
-                if (curr_time > curr->deletion_time && frame_complete(curr)) {
+                if (curr_time > curr->deletion_time && frame_complete(playout_buf, curr, curr_time)) {
                         if (curr == playout_buf->frst) {
                                 playout_buf->frst = curr->nxt;
                         }
@@ -500,8 +1348,8 @@ void pbuf_remove(struct pbuf *playout_buf, time_ns_t curr_time)
                         if (curr->prv != NULL) {
                                 curr->prv->nxt = curr->nxt;
                         }
-                        free_cdata(curr->cdata);
-                        free(curr);
+                        free_cdata(playout_buf, curr->cdata);
+                        free_pnode(playout_buf, curr);
                 } else {
                         /* The playout buffer is stored in order, so once  */
                         /* we see one packet that has not yet reached it's */
@@ -516,7 +1364,7 @@ void pbuf_remove(struct pbuf *playout_buf, time_ns_t curr_time)
         return;
 }
 
-static int frame_complete(struct pbuf_node *frame)
+static int frame_complete(struct pbuf *playout_buf, struct pbuf_node *frame, time_ns_t curr_time)
 {
         /* Return non-zero if the list of coded_data represents a    */
         /* complete frame of video. This might have to be passed the */
@@ -526,11 +1374,24 @@ static int frame_complete(struct pbuf_node *frame)
         /* the packtes of a frame being present - perhaps we should  */
         /* keep a bit vector in pbuf_node? LG.  */
 
-        return (frame->mbit == 1 || frame->completed == true);
+        /* Now we do (counters in pbuf_node), so that a complete frame can */
+        /* be decoded regardless of the reordering window.               */
+        if (frame->mbit && frame->first_known &&
+                        frame->received == (uint16_t) (frame->last_seq - frame->first_seq) + 1U) {
+                return 1;
+        }
+        if (frame->mbit == 0 && !frame->completed) {
+                return 0;
+        }
+        return playout_buf->reorder_window_ns == 0 || curr_time >= frame->ready_time;
 }
 
 int pbuf_is_empty(struct pbuf *playout_buf)
 {
+        pbuf_handoff_drain(playout_buf);
+        if (playout_buf->ring != NULL) {
+                return playout_buf->ring_count == 0;
+        }
         if (playout_buf->frst == NULL)
                 return TRUE;
         else
@@ -546,6 +1407,11 @@ pbuf_decode(struct pbuf *playout_buf, time_ns_t curr_time,
         /* decoded, but otherwise leave it in the playout buffer.      */
         struct pbuf_node *curr;
 
+        pbuf_handoff_drain(playout_buf);
+        if (playout_buf->ring != NULL) {
+                return pbuf_ring_decode(playout_buf, curr_time, decode_func, data);
+        }
+
         pbuf_validate(playout_buf);
 
         curr = playout_buf->frst;
@@ -553,15 +1419,18 @@ pbuf_decode(struct pbuf *playout_buf, time_ns_t curr_time,
                 if (!curr->decoded 
                                 && curr_time > curr->playout_time
                    ) {
-                        if (frame_complete(curr)) {
+                        if (frame_complete(playout_buf, curr, curr_time)) {
                                 struct pbuf_stats stats = { playout_buf->received_pkts_cum,
-                                        playout_buf->expected_pkts_cum };
+                                        playout_buf->expected_pkts_cum, curr->arrival_time,
+                                        curr->last_arrival_time, pbuf_frame_deadline(playout_buf, curr) };
+                                pbuf_report_av_sync(playout_buf, curr, curr_time);
                                 int ret = decode_func(curr->cdata, data, &stats);
                                 curr->decoded = 1;
                                 return ret;
                         } else {
                                 if (curr_time > curr->playout_time + 1 * NS_IN_SEC) {
                                         curr->completed = true;
+                                        curr->ready_time = curr_time;
                                 }
                                 debug_msg
                                     ("Unable to decode frame due to missing data (RTP TS=%u)\n",
@@ -575,6 +1444,51 @@ pbuf_decode(struct pbuf *playout_buf, time_ns_t curr_time,
 
 void pbuf_set_playout_delay(struct pbuf *playout_buf, double playout_delay)
 {
+        struct pbuf_handoff *h = playout_buf->handoff;
+        if (h != NULL) {
+                pthread_mutex_lock(&h->lock);
+                h->playout_delay = playout_delay;
+                h->delay_pending = true;
+                pthread_mutex_unlock(&h->lock);
+                return;
+        }
         playout_buf->playout_delay_us = playout_delay * 1000 * 1000;
 }
 
+/**
+ * Enables reporting of played out frames to the A/V sync engine and applying
+ * its delay. Does nothing if A/V sync is disabled.
+ */
+void pbuf_set_av_sync(struct pbuf *playout_buf, enum av_sync_media media)
+{
+        if (av_sync_enabled()) {
+                playout_buf->av_sync_media = media;
+        }
+}
+
+/**
+ * Sets the mapping of RTP timestamps to the sender wall-clock from a RTCP
+ * sender report.
+ */
+void pbuf_set_sr(struct pbuf *playout_buf, uint32_t ntp_sec, uint32_t ntp_frac, uint32_t rtp_ts)
+{
+        struct pbuf_handoff *h = playout_buf->handoff;
+        if (h != NULL) {
+                pthread_mutex_lock(&h->lock);
+                h->sr_ntp_sec = ntp_sec;
+                h->sr_ntp_frac = ntp_frac;
+                h->sr_rtp_ts = rtp_ts;
+                h->sr_pending = true;
+                pthread_mutex_unlock(&h->lock);
+                return;
+        }
+        pbuf_set_sr_internal(playout_buf, ntp_sec, ntp_frac, rtp_ts);
+}
+
+static void pbuf_set_sr_internal(struct pbuf *playout_buf, uint32_t ntp_sec, uint32_t ntp_frac, uint32_t rtp_ts)
+{
+        playout_buf->sr_rtp_ts = rtp_ts;
+        playout_buf->sr_ntp_ns = (time_ns_t) ntp_sec * NS_IN_SEC + (time_ns_t) (((uint64_t) ntp_frac * NS_IN_SEC) >> 32U);
+        playout_buf->sr_valid = true;
+}
+
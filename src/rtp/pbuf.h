@@ -60,6 +60,7 @@
 /******************************************************************************/
 
 #include "audio/types.h"
+#include "rtp/av_sync.h"
 #include "rtp/rtp.h"
 #include "tv.h"
 
@@ -78,6 +79,9 @@ struct coded_data {
 struct pbuf_stats {
         long long int received_pkts_cum;
         long long int expected_pkts_cum;
+        time_ns_t first_arrival; ///< arrival time of the first packet of the frame
+        time_ns_t last_arrival;  ///< arrival time of the last packet of the frame
+        time_ns_t deadline;      ///< target presentation time of the frame (video only)
 };
 
 /* The playout buffer */
@@ -121,6 +125,11 @@ int 	 	 pbuf_decode(struct pbuf *playout_buf, time_ns_t curr_time,
                              //struct video_frame *framebuffer, int i, struct state_decoder *decoder);
 void		 pbuf_remove(struct pbuf *playout_buf, time_ns_t curr_time);
 void		 pbuf_set_playout_delay(struct pbuf *playout_buf, double playout_delay);
+void		 pbuf_set_av_sync(struct pbuf *playout_buf, enum av_sync_media media);
+void		 pbuf_set_sr(struct pbuf *playout_buf, uint32_t ntp_sec, uint32_t ntp_frac, uint32_t rtp_ts);
+int		 pbuf_get_nacks(struct pbuf *playout_buf, time_ns_t curr_time, uint16_t *seqs, int max);
+void		 pbuf_set_concurrent(struct pbuf *playout_buf, int max_pending);
+int		 pbuf_wait(struct pbuf *playout_buf, time_ns_t timeout);
 
 #ifdef __cplusplus
 }
@@ -41,14 +41,20 @@
 #include "config_win32.h"
 #endif
 
+#include <algorithm>
 #include <bitset>
 #include <stdlib.h>
+#include <vector>
 
 #include "debug.h"
+#include "host.h"
+#include "rtp/gf256.h"
 #include "rtp/rs.h"
 #include "rtp/rtp_callback.h"
 #include "transmit.h"
 #include "ug_runtime_error.hpp"
+#include "utils/misc.h" // get_cpu_core_count
+#include "utils/worker.h"
 #include "video.h"
 
 #define DEFAULT_K 200
@@ -57,6 +63,10 @@
 #define MAX_K 255
 #define MAX_N 255
 
+#define MOD_NAME "[RS] "
+#define MIN_BYTES_PER_WORKER (512 * 1024) ///< minimal amount of source data per FEC worker thread
+#define MUL_BLOCK_SIZE 4096 ///< processed at once for all rows to keep sources in cache
+
 #ifdef HAVE_ZFEC
 extern "C" {
 #ifndef _MSC_VER
@@ -83,6 +93,7 @@ rs::rs(unsigned int k, unsigned int n)
 #ifdef HAVE_ZFEC
         state = fec_new(m_k, m_n);
         assert(state != NULL);
+        check_simd();
 #else
         LOG(LOG_LEVEL_ERROR) << "zfec support is not compiled in, error correction is disabled\n";
 #endif
@@ -115,6 +126,7 @@ rs::rs(const char *c_cfg)
 #ifdef HAVE_ZFEC
         state = fec_new(m_k, m_n);
         assert(state != NULL);
+        check_simd();
 #else
         throw ug_runtime_error("zfec support is not compiled in");
 #endif
@@ -129,6 +141,107 @@ rs::~rs()
 #endif
 }
 
+#ifdef HAVE_ZFEC
+/**
+ * Enables own GF(2^8) kernels (see rtp/gf256.h) if they give the same
+ * result as zfec for the encoding matrix obtained from zfec state.
+ */
+void rs::check_simd()
+{
+        if (get_commandline_param("rs-zfec") != nullptr) {
+                return;
+        }
+        const size_t ss = 64;
+        vector<char> data(m_n * ss);
+        for (size_t i = 0; i < m_k * ss; ++i) {
+                data[i] = i * 31 + i / ss;
+        }
+        vector<char> ref((m_n - m_k) * ss);
+        vector<char *> src(m_k), dst(m_n - m_k), ref_dst(m_n - m_k);
+        vector<unsigned int> dst_idx(m_n - m_k);
+        for (unsigned int k = 0; k < m_k; ++k) {
+                src[k] = data.data() + k * ss;
+        }
+        for (unsigned int m = 0; m < m_n - m_k; ++m) {
+                dst[m] = data.data() + (m_k + m) * ss;
+                ref_dst[m] = ref.data() + m * ss;
+                dst_idx[m] = m_k + m;
+        }
+        fec_encode((const fec_t *) state, (gf **) src.data(), (gf **) ref_dst.data(), dst_idx.data(), m_n - m_k, ss);
+        m_simd = true;
+        encode_parity(src.data(), dst.data(), ss);
+        m_simd = memcmp(data.data() + m_k * ss, ref.data(), ref.size()) == 0;
+        if (m_simd) {
+                LOG(LOG_LEVEL_VERBOSE) << MOD_NAME "Using " << gf256_get_impl_name() << " GF(2^8) arithmetic.\n";
+        } else {
+                LOG(LOG_LEVEL_WARNING) << MOD_NAME "GF(2^8) kernels do not match zfec, using zfec arithmetic.\n";
+        }
+}
+
+namespace {
+struct mul_matrix_task {
+        const uint8_t *rows;
+        unsigned int row_count;
+        unsigned int col_count;
+        char *const *src;
+        char *const *dst;
+        size_t off;
+        size_t len;
+};
+}
+
+/// computes the assigned byte range of dst[r] = sum_c rows[r][c] * src[c]
+static void *mul_matrix_worker(void *arg)
+{
+        auto *t = (struct mul_matrix_task *) arg;
+        for (size_t off = t->off; off < t->off + t->len; off += MUL_BLOCK_SIZE) {
+                size_t len = min<size_t>(MUL_BLOCK_SIZE, t->off + t->len - off);
+                for (unsigned int r = 0; r < t->row_count; ++r) {
+                        const uint8_t *row = t->rows + r * t->col_count;
+                        auto *dst = (uint8_t *) t->dst[r] + off;
+                        gf256_mul_region(dst, (uint8_t *) t->src[0] + off, row[0], len);
+                        for (unsigned int c = 1; c < t->col_count; ++c) {
+                                gf256_mul_add_region(dst, (uint8_t *) t->src[c] + off, row[c], len);
+                        }
+                }
+        }
+        return nullptr;
+}
+
+/**
+ * Multiplies m_k source blocks of size ss with row_count x m_k matrix rows.
+ * Large frames are split by byte ranges among worker threads.
+ */
+void rs::mul_matrix(const uint8_t *rows, unsigned int row_count, char *const *src, char *const *dst, size_t ss)
+{
+        int workers = clamp<int>(ss * m_k / MIN_BYTES_PER_WORKER, 1, get_cpu_core_count());
+        size_t chunk = (ss + workers - 1) / workers;
+        chunk = (chunk + MUL_BLOCK_SIZE - 1) / MUL_BLOCK_SIZE * MUL_BLOCK_SIZE;
+        vector<struct mul_matrix_task> tasks;
+        for (size_t off = 0; off < ss; off += chunk) {
+                tasks.push_back({rows, row_count, m_k, src, dst, off, min(chunk, ss - off)});
+        }
+        task_run_parallel(mul_matrix_worker, tasks.size(), tasks.data(), sizeof tasks[0], nullptr);
+}
+
+void rs::encode_parity(char **src, char **dst, size_t ss)
+{
+        if (m_simd) {
+                mul_matrix(((const fec_t *) state)->enc_matrix + m_k * m_k, m_n - m_k, src, dst, ss);
+                return;
+        }
+        unsigned int dst_idx[m_n-m_k];
+        for (unsigned int m = 0; m < m_n-m_k; ++m) {
+                dst_idx[m] = m_k + m;
+        }
+        fec_encode((const fec_t *)state, (gf **) src,
+                        (gf **) dst, dst_idx, m_n-m_k, ss);
+}
+#endif // defined HAVE_ZFEC
+
+ADD_TO_PARAM("rs-zfec", "* rs-zfec\n"
+                "  Use zfec arithmetic for RS FEC instead of SIMD kernels.\n");
+
 shared_ptr<video_frame> rs::encode(shared_ptr<video_frame> in)
 {
 #ifdef HAVE_ZFEC
@@ -153,30 +266,15 @@ shared_ptr<video_frame> rs::encode(shared_ptr<video_frame> in)
         memcpy(out_data + sizeof(len32) + hdr_len, data, len);
         memset(out_data + sizeof(len32) + hdr_len + len, 0, ss * m_k - (sizeof(len32) + hdr_len + len));
 
-#if 0
-        void *src[m_k];
-        for (int k = 0; k < m_k; ++k) {
-                src[k] = *out + ss * k;
-        }
-
-        for (int m = 0; m < m_n - m_k; ++m) {
-                fec_encode(state, src, *out + ss * (m_k + m), m, ss);
-        }
-#else
-        void *src[m_k];
+        char *src[m_k];
         for (unsigned int k = 0; k < m_k; ++k) {
                 src[k] = out_data + ss * k;
         }
-        void *dst[m_n-m_k];
-        unsigned int dst_idx[m_n-m_k];
+        char *dst[m_n-m_k];
         for (unsigned int m = 0; m < m_n-m_k; ++m) {
                 dst[m] = out_data + ss * (m_k + m);
-                dst_idx[m] = m_k + m;
         }
-
-        fec_encode((const fec_t *)state, (gf **) src,
-                        (gf **) dst, dst_idx, m_n-m_k, ss);
-#endif
+        encode_parity(src, dst, ss);
 
         out->tiles[0].data_len = buffer_len;
         out->fec_params = fec_desc(FEC_RS, m_k, m_n - m_k, 0, 0, ss);
@@ -217,20 +315,17 @@ audio_frame2 rs::encode(const audio_frame2 &in)
 
                 out.set_fec_params(i, fec_desc(FEC_RS, m_k, m_n - m_k, 0, 0, ss));
 
-                void *src[m_k];
+                char *src[m_k];
                 for (unsigned int k = 0; k < m_k; ++k) {
                         src[k] = out.get_data(i) + ss * k;
                 }
 
-                void *dst[m_n-m_k];
-                unsigned int dst_idx[m_n-m_k];
+                char *dst[m_n-m_k];
                 for (unsigned int m = 0; m < m_n-m_k; ++m) {
                         dst[m] = out.get_data(i) + ss * (m_k + m);
-                        dst_idx[m] = m_k + m;
                 }
 
-                fec_encode((const fec_t *)state, (gf **) src,
-                                (gf **) dst, dst_idx, m_n-m_k, ss);
+                encode_parity(src, dst, ss);
         }
 
         return out;
@@ -375,6 +470,37 @@ bool rs::decode(char *in, int in_len, char **out, int *len,
                 return false;
         }
 
+        if (m_simd) {
+                // rows of inverted matrix of received blocks give the missing ones
+                const gf *enc_matrix = ((const fec_t *) state)->enc_matrix;
+                vector<uint8_t> dec_matrix(m_k * m_k);
+                for (unsigned int j = 0; j < m_k; ++j) {
+                        memcpy(&dec_matrix[j * m_k], enc_matrix + index[j] * m_k, m_k);
+                }
+                if (!gf256_invert_matrix(dec_matrix.data(), m_k)) {
+                        LOG(LOG_LEVEL_ERROR) << MOD_NAME "Singular decoding matrix!\n";
+                        *len = get_buf_len(in, c_m);
+                        *out = (char *) in + sizeof(uint32_t);
+                        return false;
+                }
+                vector<uint8_t> rows;
+                vector<char *> dst;
+                for (unsigned int j = 0; j < m_k; ++j) {
+                        if (repaired_slots.test(j)) {
+                                rows.insert(rows.end(), &dec_matrix[j * m_k], &dec_matrix[(j + 1) * m_k]);
+                                dst.push_back(in + j * ss);
+                        }
+                }
+                if (!dst.empty()) {
+                        mul_matrix(rows.data(), dst.size(), (char *const *) pkt, dst.data(), ss);
+                }
+                uint32_t out_sz;
+                memcpy(&out_sz, in, sizeof(out_sz));
+                *len = out_sz;
+                *out = (char *) in + sizeof(uint32_t);
+                return true;
+        }
+
         char **output = (char **) malloc(m_k * sizeof(char *));
         for (unsigned int i = 0; i < m_k; ++i) {
                 output[i] = (char *) malloc(ss);
@@ -56,10 +56,14 @@ struct rs : public fec {
                 const std::map<int, int> &) override;
 
 private:
+        void check_simd();
+        void mul_matrix(const uint8_t *rows, unsigned int row_count, char *const *src, char *const *dst, size_t ss);
+        void encode_parity(char **src, char **dst, size_t ss);
         int get_ss(int hdr_len, int len);
         uint32_t get_buf_len(const char *buf, std::map<int, int> const & c_m);
         void *state = nullptr;
         unsigned int m_k, m_n;
+        bool m_simd = false; ///< use own GF(2^8) kernels instead of zfec
 };
 
 #endif /* __RS_H__ */
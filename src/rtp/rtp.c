@@ -77,9 +77,11 @@
 #endif // defined HAVE_CONFIG_H
 
 #include <inttypes.h>
+#include <pthread.h>
 
 #include "memory.h"
 #include "debug.h"
+#include "host.h"
 #include "net_udp.h"
 #include "crypto/random.h"
 #include "compat/drand48.h"
@@ -91,6 +93,7 @@
 #include "crypto/md5.h"
 #include "ntp.h"
 #include "rtp.h"
+#include "rtp_types.h"
 #include "utils/misc.h"
 #include "utils/net.h"
 
@@ -104,6 +107,11 @@
  */
 #define MAX_ENCRYPTION_PAD 16
 
+#define RTP_RETRANSMIT_SLOTS 8192 ///< sent packets kept for retransmission, power of 2
+#define RTP_NACK_APP_NAME "NACK" ///< RTCP APP carrying RFC 4585 generic NACK FCI entries
+#define RTP_PLI_APP_NAME "PLI_"  ///< RTCP APP requesting a keyframe (as RFC 4585 Picture Loss Indication)
+#define RTP_MTU_APP_NAME "MTU_"  ///< RTCP APP acknowledging a path MTU probe (PT_MTU_PROBE)
+
 static bool rijndael_initialize(struct rtp *session, u_char * hash,
                                int hash_len);
 static bool rijndael_decrypt(struct rtp *session, unsigned char *data,
@@ -138,6 +146,10 @@ static void rtp_process_data(struct rtp *session, uint32_t curr_rtp_ts,
 #define RTCP_BYE  203
 #define RTCP_APP  204
 #define RTCP_RX   205
+#define RTCP_PSFB 206 ///< payload-specific feedback (RFC 4585)
+
+#define RTCP_PSFB_PLI 1 ///< Picture Loss Indication FMT (RFC 4585)
+#define RTCP_PSFB_FIR 4 ///< Full Intra Request FMT (RFC 5104)
 
 typedef struct {
 #ifdef WORDS_BIGENDIAN
@@ -243,6 +255,13 @@ typedef struct _source {
 /* participants is a sensible limit so we set this to 11.       */
 #define RTP_DB_SIZE	11
 
+/* In addition to the chains above (used for iteration), sources are    */
+/* indexed by an open addressing (linear probing) hash table, so lookup */
+/* by SSRC stays O(1) independently of the number of participants. The */
+/* table is grown to keep the load (including tombstones) under 3/4.   */
+#define RTP_SRC_IDX_MIN_SIZE 16
+#define RTP_SRC_IDX_DELETED ((source *) 1)
+
 /*
  *  Options for an RTP session are stored in the "options" struct.
  */
@@ -277,6 +296,9 @@ struct rtp {
         uint32_t my_ssrc;
         int last_advertised_csrc;
         source *db[RTP_DB_SIZE];
+        source **src_idx;       /* open addressing index of db by SSRC (see RTP_SRC_IDX_MIN_SIZE) */
+        uint32_t src_idx_mask;  /* capacity of src_idx - 1, capacity is a power of two */
+        uint32_t src_idx_used;  /* occupied slots in src_idx, including tombstones */
         rtcp_rr_wrapper rr[RTP_DB_SIZE][RTP_DB_SIZE];   /* Indexed by [hash(reporter)][hash(reportee)] */
         options *opt;
         uint8_t *userdata;
@@ -310,6 +332,15 @@ struct rtp {
         uint16_t new_rtt;       /* flag change in value of the RTT */
         /* tfrc recevier variables */
         uint32_t rcv_rtt;       /* rtt receiver extracts from rtp packets */
+        /* latest receiver report about our own stream (see rtp_get_tx_feedback) */
+        uint32_t fb_count;      /* number of reports received so far */
+        uint8_t fb_fract_lost;  /* fraction lost, fixed point /256 */
+        uint32_t fb_rtt_us;     /* round-trip time in usec, 0 if unknown */
+        uint32_t pli_count;     /* keyframe requests received (see rtp_get_keyframe_request) */
+        bool fir_seen;          /* a FIR was already received, fir_seq is valid */
+        uint8_t fir_seq;        /* sequence number of the last FIR, repetitions are ignored */
+        uint32_t mtu_ack_count; /* MTU probe acks received (see rtp_get_mtu_ack) */
+        int mtu_ack_max;        /* largest MTU acked since last rtp_get_mtu_ack() */
 
         char *encryption_algorithm;
         int encryption_enabled;
@@ -329,9 +360,28 @@ struct rtp {
         rtp_callback callback;
         struct msghdr *mhdr;
         bool mt_recv; /* whether the receiver uses separate thread for receiving */
+        struct rtp_retransmit *retransmit; /* sent packets for NACK retransmission, NULL if disabled */
         uint32_t magic;         /* For debugging...  */
 };
 
+/// copy of a sent RTP packet (see rtp_set_retransmit())
+struct rtp_retransmit_slot {
+        uint8_t *buf;
+        int len;
+        int capacity;
+        uint16_t seq;
+        bool resent;
+        time_ns_t sent;
+};
+
+struct rtp_retransmit {
+        pthread_mutex_t lock; ///< slots are filled by sender and read by RTCP processing
+        time_ns_t max_age;
+        unsigned long long requested;
+        unsigned long long resent;
+        struct rtp_retransmit_slot slots[RTP_RETRANSMIT_SLOTS];
+};
+
 static inline int filter_event(struct rtp *session, uint32_t ssrc)
 {
         return session->opt->filter_my_packets
@@ -383,6 +433,84 @@ static inline int ssrc_hash(uint32_t ssrc)
         return ssrc % RTP_DB_SIZE;
 }
 
+static inline uint32_t src_idx_hash(uint32_t ssrc)
+{
+        /* SSRCs needn't be uniformly distributed (see above) so mix */
+        /* the bits (Murmur3 finalizer) before masking.              */
+        ssrc ^= ssrc >> 16;
+        ssrc *= 0x85ebca6b;
+        ssrc ^= ssrc >> 13;
+        ssrc *= 0xc2b2ae35;
+        ssrc ^= ssrc >> 16;
+        return ssrc;
+}
+
+static source *src_idx_find(struct rtp *session, uint32_t ssrc)
+{
+        if (session->src_idx == NULL) {
+                return NULL;
+        }
+        for (uint32_t i = src_idx_hash(ssrc) & session->src_idx_mask; ;
+                        i = (i + 1) & session->src_idx_mask) {
+                source *s = session->src_idx[i];
+                if (s == NULL) {
+                        return NULL;
+                }
+                if (s != RTP_SRC_IDX_DELETED && s->ssrc == ssrc) {
+                        return s;
+                }
+        }
+}
+
+static void src_idx_insert(struct rtp *session, source *s);
+
+/* Rebuilds the index from db with capacity fitting ssrc_count sources. */
+static void src_idx_rebuild(struct rtp *session, int ssrc_count)
+{
+        uint32_t size = RTP_SRC_IDX_MIN_SIZE;
+        while (size * 3 / 4 <= (uint32_t) ssrc_count * 2) {
+                size *= 2;
+        }
+        free(session->src_idx);
+        session->src_idx = (source **) calloc(size, sizeof(source *));
+        session->src_idx_mask = size - 1;
+        session->src_idx_used = 0;
+        for (int h = 0; h < RTP_DB_SIZE; h++) {
+                for (source *s = session->db[h]; s != NULL; s = s->next) {
+                        src_idx_insert(session, s);
+                }
+        }
+}
+
+static void src_idx_insert(struct rtp *session, source *s)
+{
+        if (session->src_idx == NULL ||
+                        (session->src_idx_used + 1) * 4 > (session->src_idx_mask + 1) * 3) {
+                /* s is already linked in db, so it gets inserted by the rebuild */
+                src_idx_rebuild(session, session->ssrc_count + 1);
+                return;
+        }
+        uint32_t i = src_idx_hash(s->ssrc) & session->src_idx_mask;
+        while (session->src_idx[i] != NULL && session->src_idx[i] != RTP_SRC_IDX_DELETED) {
+                i = (i + 1) & session->src_idx_mask;
+        }
+        if (session->src_idx[i] == NULL) {
+                session->src_idx_used++;
+        }
+        session->src_idx[i] = s;
+}
+
+static void src_idx_remove(struct rtp *session, uint32_t ssrc)
+{
+        for (uint32_t i = src_idx_hash(ssrc) & session->src_idx_mask;
+                        session->src_idx[i] != NULL; i = (i + 1) & session->src_idx_mask) {
+                if (session->src_idx[i] != RTP_SRC_IDX_DELETED && session->src_idx[i]->ssrc == ssrc) {
+                        session->src_idx[i] = RTP_SRC_IDX_DELETED;
+                        return;
+                }
+        }
+}
+
 static void insert_rr(struct rtp *session, uint32_t reporter_ssrc, rtcp_rr * rr,
                       rtcp_rx * rx)
 {
@@ -599,13 +727,11 @@ static inline source *get_source(struct rtp *session, uint32_t ssrc)
         source *s;
 
         check_database(session);
-        for (s = session->db[ssrc_hash(ssrc)]; s != NULL; s = s->next) {
-                if (s->ssrc == ssrc) {
-                        check_source(s);
-                        return s;
-                }
+        s = src_idx_find(session, ssrc);
+        if (s != NULL) {
+                check_source(s);
         }
-        return NULL;
+        return s;
 }
 
 static source *really_create_source(struct rtp *session, uint32_t ssrc,
@@ -639,6 +765,7 @@ static source *really_create_source(struct rtp *session, uint32_t ssrc,
                 session->db[h]->prev = s;
         }
         session->db[ssrc_hash(ssrc)] = s;
+        src_idx_insert(session, s);
         session->ssrc_count++;
         check_database(session);
 
@@ -683,6 +810,7 @@ static void delete_source(struct rtp *session, uint32_t ssrc)
 
         check_source(s);
         check_database(session);
+        src_idx_remove(session, ssrc);
         if (session->db[h] == s) {
                 /* It's the first entry in this chain... */
                 session->db[h] = s->next;
@@ -830,6 +958,9 @@ static int update_seq(source * s, uint16_t seq)
         return 1;
 }
 
+ADD_TO_PARAM("rtcp-min-interval", "* rtcp-min-interval=<sec>\n"
+                "  Minimal average RTCP report interval (default 5 s as in RFC 3550), lower value gives\n"
+                "  the sender congestion control (-l cc) faster feedback\n");
 static double rtcp_interval(struct rtp *session)
 {
         /* Minimum average time between RTCP packets from this site (in   */
@@ -853,6 +984,9 @@ static double rtcp_interval(struct rtp *session)
 
         double t;               /* interval */
         double rtcp_min_time = RTCP_MIN_TIME;
+        if (get_commandline_param("rtcp-min-interval") != NULL) {
+                rtcp_min_time = atof(get_commandline_param("rtcp-min-interval"));
+        }
         int n;                  /* no. of members for computation */
         double rtcp_bw = session->rtcp_bw;
 
@@ -1224,7 +1358,7 @@ rtp_t rtp_init_with_udp_socket(struct socket_udp_local *l, struct sockaddr *sa,
         session->send_rtcp_to_origin = true;
 
         session->rtp_socket = udp_init_with_local(l, sa, len);
-        session->rtcp_socket = udp_init_if("localhost", NULL, 0, 0, ttl, true, false);
+        session->rtcp_socket = udp_init_if("localhost", NULL, 0, 0, ttl, 0, false);
 
         init_opt(session);
 
@@ -1326,6 +1460,7 @@ bool rtp_set_my_ssrc(struct rtp *session, uint32_t ssrc)
         h = ssrc_hash(ssrc);
         /* Put source back        */
         session->db[h] = s;
+        src_idx_rebuild(session, session->ssrc_count);
         return true;
 }
 
@@ -1437,6 +1572,15 @@ uint32_t rtp_my_ssrc(struct rtp * session)
         return session->my_ssrc;
 }
 
+/**
+ * Returns the sequence number the next RTP data packet sent by the session
+ * will carry (used eg. to form extended sequence numbers of a payload).
+ */
+uint16_t rtp_get_next_seq(struct rtp *session)
+{
+        return session->rtp_seq;
+}
+
 static bool validate_rtp2(rtp_packet * packet, int len, int vlen)
 {
         /* Check for valid payload types..... 72-76 are RTCP payload type numbers, with */
@@ -1524,7 +1668,11 @@ process_rtp(struct rtp *session, uint32_t curr_rtp_ts, rtp_packet * packet,
         if (session->tfrc_on)
                 compute_loss_intervals(session, packet);
 
-        transit = curr_rtp_ts - packet->ts;
+        // arrival time (in 90 kHz) is used instead of processing time
+        // (curr_rtp_ts) so that the jitter doesn't include receiver scheduling
+        UNUSED(curr_rtp_ts);
+        uint32_t arrival_rtp_ts = packet->rx_time / 100000 * 9 + packet->rx_time % 100000 * 9 / 100000;
+        transit = arrival_rtp_ts - packet->ts;
         d = transit - s->transit;
         s->transit = transit;
         if (d < 0) {
@@ -1553,6 +1701,23 @@ int rtp_send_raw_rtp_data(struct rtp *session, char *data, int buflen)
         return udp_send(session->rtp_socket, data, buflen);
 }
 
+static void send_mtu_ack(struct rtp *session, uint32_t rtp_ts, uint32_t ssrc, uint32_t mtu);
+
+/**
+ * Acknowledges received MTU probe (sent by rtp_send_mtu_probe()), the probe
+ * itself is not passed to the application.
+ */
+static void process_mtu_probe(struct rtp *session, rtp_packet *packet)
+{
+        uint32_t mtu = 0;
+        if (packet->data_len < (int) sizeof mtu) {
+                return;
+        }
+        memcpy(&mtu, packet->data, sizeof mtu);
+        debug_msg("MTU probe %" PRIu32 " B received from 0x%08" PRIx32 "\n", ntohl(mtu), packet->ssrc);
+        send_mtu_ack(session, packet->ts, packet->ssrc, ntohl(mtu));
+}
+
 static int rtp_recv_data(struct rtp *session, uint32_t curr_rtp_ts)
 {
         int buflen;
@@ -1566,7 +1731,7 @@ static int rtp_recv_data(struct rtp *session, uint32_t curr_rtp_ts)
                 buffer = ((uint8_t *) packet) + RTP_PACKET_HEADER_SIZE;
         } else {
                 if (!session->opt->reuse_bufs || (packet == NULL)) {
-                        packet = (rtp_packet *) malloc(RTP_MAX_PACKET_LEN + (session->opt->record_source ? sizeof(struct sockaddr_storage) : 0));
+                        packet = (rtp_packet *) udp_packet_alloc(RTP_MAX_PACKET_LEN + (session->opt->record_source ? sizeof(struct sockaddr_storage) : 0));
                         buffer = ((uint8_t *) packet) + RTP_PACKET_HEADER_SIZE;
                 }
                 struct sockaddr_storage *sin = NULL;
@@ -1580,7 +1745,9 @@ static int rtp_recv_data(struct rtp *session, uint32_t curr_rtp_ts)
                                         RTP_MAX_PACKET_LEN - RTP_PACKET_HEADER_SIZE,
                                         (struct sockaddr *) sin, sin ? &addrlen : 0);
                 if (buflen <= 0) {
-                        free(packet);
+                        udp_packet_free(packet);
+                } else {
+                        packet->rx_time = get_time_in_ns();
                 }
         }
 
@@ -1661,6 +1828,13 @@ static void rtp_process_data(struct rtp *session, uint32_t curr_rtp_ts,
                         packet->data_len -= ((packet->extn_len + 1) * 4);
                 }
                 if (validate_rtp(session, packet, buflen, vlen)) {
+                        if (packet->pt == PT_MTU_PROBE) {
+                                process_mtu_probe(session, packet);
+                                if (!session->opt->reuse_bufs) {
+                                        udp_packet_free(packet);
+                                }
+                                return;
+                        }
                         if (session->opt->wait_for_rtcp) {
                                 s = create_source(session, packet->ssrc, TRUE);
                         } else {
@@ -1699,7 +1873,7 @@ static void rtp_process_data(struct rtp *session, uint32_t curr_rtp_ts,
                 }
 
                 if (!session->opt->reuse_bufs) {
-                        free(packet);
+                        udp_packet_free(packet);
                 }
         }
 }
@@ -1880,6 +2054,27 @@ static int validate_rtcp(uint8_t * packet, int len)
         return is_okay;
 }
 
+/*
+ * Keeps loss and RTT from a report about the stream we are sending, so that
+ * the sender can adapt its rate (see rtp_get_tx_feedback()).
+ */
+static void store_tx_feedback(struct rtp *session, const rtcp_rr *rr)
+{
+        uint32_t rtt_us = 0;
+        if (rr->lsr != 0) {
+                uint32_t ntp_sec, ntp_frac;
+                ntp64_time(&ntp_sec, &ntp_frac);
+                uint32_t now = ntp64_to_ntp32(ntp_sec, ntp_frac);
+                // otherwise bogus (wrong echoed timestamp or delay miscalculated by remote)
+                if (now - rr->lsr >= rr->dlsr && now - rr->lsr - rr->dlsr < 10 * 65536) {
+                        rtt_us = (uint32_t) ((now - rr->lsr - rr->dlsr) * 1000000ULL / 65536);
+                }
+        }
+        session->fb_fract_lost = rr->fract_lost;
+        session->fb_rtt_us = rtt_us;
+        session->fb_count += 1;
+}
+
 static void process_report_blocks(struct rtp *session, rtcp_t * packet,
                                   uint32_t ssrc, rtcp_rr * rrp, rtcp_rx * rrx)
 {
@@ -1921,6 +2116,10 @@ static void process_report_blocks(struct rtp *session, rtcp_t * packet,
                         /* Store the RR for later use... */
                         insert_rr(session, ssrc, rr, rx);
 
+                        if (rr->ssrc == session->my_ssrc && ssrc != session->my_ssrc) {
+                                store_tx_feedback(session, rr);
+                        }
+
                         /* Call the event handler... */
                         if (!filter_event(session, ssrc)) {
                                 event.ssrc = ssrc;
@@ -2110,6 +2309,51 @@ static void process_rtcp_bye(struct rtp *session, rtcp_t * packet)
         }
 }
 
+/**
+ * Resends the requested packet if it is still held and was not yet resent.
+ * @note r->lock must be held
+ */
+static void rtp_retransmit_packet(struct rtp *session, struct rtp_retransmit *r, uint16_t seq, time_ns_t now)
+{
+        struct rtp_retransmit_slot *slot = &r->slots[seq % RTP_RETRANSMIT_SLOTS];
+        r->requested += 1;
+        if (slot->len == 0 || slot->seq != seq || slot->resent || now - slot->sent > r->max_age) {
+                return;
+        }
+        if (udp_send(session->rtp_socket, (char *) slot->buf, slot->len) == -1) {
+                log_msg(LOG_LEVEL_WARNING, "resending RTP packet: %s", ug_strerror(errno));
+                return;
+        }
+        slot->resent = true;
+        r->resent += 1;
+}
+
+/**
+ * Processes NACK APP payload - media SSRC followed by generic NACK entries
+ * (PID and bitmask of following lost packets, RFC 4585 section 6.2.1).
+ */
+static void rtp_retransmit_process_nack(struct rtp *session, const char *data, int data_len)
+{
+        struct rtp_retransmit *r = session->retransmit;
+        const uint32_t *fci = (const uint32_t *)(const void *) data;
+        if (data_len < 8 || ntohl(fci[0]) != session->my_ssrc) {
+                return;
+        }
+        time_ns_t now = get_time_in_ns();
+        pthread_mutex_lock(&r->lock);
+        for (int i = 1; i < data_len / 4; ++i) {
+                uint32_t item = ntohl(fci[i]);
+                uint16_t pid = item >> 16U;
+                rtp_retransmit_packet(session, r, pid, now);
+                for (unsigned int b = 0; b < 16; ++b) {
+                        if (item & (1U << b)) {
+                                rtp_retransmit_packet(session, r, (uint16_t) (pid + b + 1), now);
+                        }
+                }
+        }
+        pthread_mutex_unlock(&r->lock);
+}
+
 static void process_rtcp_app(struct rtp *session, rtcp_t * packet)
 {
         uint32_t ssrc;
@@ -2144,6 +2388,27 @@ static void process_rtcp_app(struct rtp *session, rtcp_t * packet)
         data_len = (app->length - 2) * 4;
         memcpy(app->data, packet->r.app.data, data_len);
 
+        if (session->retransmit != NULL && strncmp(app->name, RTP_NACK_APP_NAME, 4) == 0) {
+                rtp_retransmit_process_nack(session, app->data, data_len);
+                free(app);
+                return;
+        }
+        if (strncmp(app->name, RTP_PLI_APP_NAME, 4) == 0) {
+                session->pli_count += 1;
+                free(app);
+                return;
+        }
+        if (strncmp(app->name, RTP_MTU_APP_NAME, 4) == 0) {
+                if (data_len >= 8) {
+                        uint32_t mtu = 0;
+                        memcpy(&mtu, app->data + 4, sizeof mtu);
+                        session->mtu_ack_max = MAX(session->mtu_ack_max, (int) ntohl(mtu));
+                        session->mtu_ack_count += 1;
+                }
+                free(app);
+                return;
+        }
+
         /* Callback to the application to process the app packet... */
         if (!filter_event(session, ssrc)) {
                 event.ssrc = ssrc;
@@ -2155,6 +2420,41 @@ static void process_rtcp_app(struct rtp *session, rtcp_t * packet)
         }
 }
 
+/**
+ * Processes standard payload-specific feedback of receivers not using the
+ * APP-based PLI (see rtp_send_pli()) - PLI and FIR are both counted as
+ * a keyframe request (see rtp_get_keyframe_request()).
+ */
+static void process_rtcp_psfb(struct rtp *session, rtcp_t * packet)
+{
+        const uint32_t *words = (const uint32_t *)(void *) packet;
+        const int len = ntohs(packet->common.length) + 1; // in words
+        if (len < 3) {
+                return;
+        }
+        if (packet->common.count == RTCP_PSFB_PLI) {
+                if (ntohl(words[2]) == rtp_my_ssrc(session)) { // media source SSRC
+                        session->pli_count += 1;
+                }
+                return;
+        }
+        if (packet->common.count != RTCP_PSFB_FIR) {
+                return;
+        }
+        // FCI entries - SSRC and 8-bit sequence number followed by 24 reserved bits
+        for (int i = 3; i + 1 < len; i += 2) {
+                if (ntohl(words[i]) != rtp_my_ssrc(session)) {
+                        continue;
+                }
+                uint8_t seq = ntohl(words[i + 1]) >> 24;
+                if (!session->fir_seen || seq != session->fir_seq) {
+                        session->fir_seen = true;
+                        session->fir_seq = seq;
+                        session->pli_count += 1;
+                }
+        }
+}
+
 static
 uint32_t compute_rtt(struct rtp *session, rtcp_rx * rrx)
 {
@@ -2281,6 +2581,9 @@ static void rtp_process_ctrl(struct rtp *session, uint8_t * buffer, int buflen)
                                         }
                                         process_rtcp_app(session, packet);
                                         break;
+                                case RTCP_PSFB:
+                                        process_rtcp_psfb(session, packet);
+                                        break;
                                 default:
                                         debug_msg
                                             ("RTCP packet with unknown type (%d) ignored.\n",
@@ -2460,6 +2763,46 @@ bool rtcp_recv_r(struct rtp *session, struct timeval *timeout, uint32_t curr_rtp
         return false;
 }
 
+/**
+ * Returns descriptors of the session sockets to be watched by an external
+ * event loop (see rtp/rtp_event_loop.h).
+ *
+ * @retval false if the session receives RTP in a separate thread
+ *               (multithreaded) so its RTP socket cannot be polled
+ */
+bool rtp_get_fds(struct rtp *session, int *rtp_fd, int *rtcp_fd)
+{
+        if (session->mt_recv) {
+                return false;
+        }
+        *rtp_fd = udp_fd(session->rtp_socket);
+        *rtcp_fd = udp_fd(session->rtcp_socket);
+        return true;
+}
+
+/**
+ * Processes data on session sockets reported readable by an external event
+ * loop - counterpart of rtp_recv_r() without waiting.
+ */
+void rtp_recv_ready(struct rtp *session, bool rtp_readable, bool rtcp_readable, uint32_t curr_rtp_ts)
+{
+        check_database(session);
+        if (rtp_readable) {
+                rtp_recv_data(session, curr_rtp_ts);
+        }
+        if (rtcp_readable) {
+                uint8_t buffer[RTP_MAX_PACKET_LEN];
+                session->rtcp_dest_len = sizeof(session->rtcp_dest);
+                int buflen = udp_recvfrom(session->rtcp_socket, (char *)buffer,
+                                RTP_MAX_PACKET_LEN,
+                                (struct sockaddr *) &session->rtcp_dest, &session->rtcp_dest_len);
+                if (buflen > 0) {
+                        rtp_process_ctrl(session, buffer, buflen);
+                }
+        }
+        check_database(session);
+}
+
 /**
  * rtp_recv_poll_r:
  * The meaning is as above with except that this function polls for first
@@ -2787,6 +3130,39 @@ int rtp_send_data(struct rtp *session, uint32_t rtp_ts, char pt, int m,
                                  data, data_len, extn, extn_len, extn_type);
 }
 
+/// keeps copy of the packet being sent (header, payload header and data) for retransmission
+static void rtp_retransmit_store(struct rtp_retransmit *r, uint16_t seq,
+                const uint8_t *hdr, int hdr_len, const char *phdr, int phdr_len,
+                const char *data, int data_len)
+{
+        struct rtp_retransmit_slot *slot = &r->slots[seq % RTP_RETRANSMIT_SLOTS];
+        const int len = hdr_len + (phdr != NULL ? phdr_len : 0) + data_len;
+        pthread_mutex_lock(&r->lock);
+        if (slot->capacity < len) {
+                uint8_t *buf = realloc(slot->buf, len);
+                if (buf == NULL) {
+                        slot->len = 0;
+                        pthread_mutex_unlock(&r->lock);
+                        return;
+                }
+                slot->buf = buf;
+                slot->capacity = len;
+        }
+        memcpy(slot->buf, hdr, hdr_len);
+        if (phdr != NULL) {
+                memcpy(slot->buf + hdr_len, phdr, phdr_len);
+                hdr_len += phdr_len;
+        }
+        if (data_len > 0) {
+                memcpy(slot->buf + hdr_len, data, data_len);
+        }
+        slot->len = len;
+        slot->seq = seq;
+        slot->resent = false;
+        slot->sent = get_time_in_ns();
+        pthread_mutex_unlock(&r->lock);
+}
+
 int
 rtp_send_data_hdr(struct rtp *session,
                   uint32_t rtp_ts, char pt, int m,
@@ -2851,12 +3227,14 @@ rtp_send_data_hdr(struct rtp *session,
         /* Allocate memory for the packet... */
         assert(buffer_len < RTP_MAX_PACKET_LEN);
         /* we dont always need 20 (12|16) but this seems to work. LG */
+        /* CSRC list and header extension are stored after it.      */
+        const int hdr_alloc_len = MAX(buffer_len, 20) + RTP_PACKET_HEADER_SIZE;
 #ifdef WIN32
-        d = (uint8_t *) malloc(3 * sizeof(WSABUF) + 20 + RTP_PACKET_HEADER_SIZE);
+        d = (uint8_t *) malloc(3 * sizeof(WSABUF) + hdr_alloc_len);
         send_vector = d;
         buffer = (uint8_t *) d + 3 * sizeof(WSABUF);
 #else
-        d = buffer = (uint8_t *) malloc(20 + RTP_PACKET_HEADER_SIZE);
+        d = buffer = (uint8_t *) malloc(hdr_alloc_len);
 #endif
         packet = (rtp_packet *)(void *) buffer;
 
@@ -2880,6 +3258,8 @@ rtp_send_data_hdr(struct rtp *session,
                 packet->data += (extn_len + 1) * 4;
         }
 #endif
+        packet->csrc = (uint32_t *)(void *) (buffer + RTP_PACKET_HEADER_SIZE + vlen);
+        packet->extn = buffer + RTP_PACKET_HEADER_SIZE + vlen + (4 * cc);
         /* ...and the actual packet header... */
         packet->v = 2;
         packet->p = pad;
@@ -2955,6 +3335,11 @@ rtp_send_data_hdr(struct rtp *session,
                                          buffer_len, initVec);
         }
 
+        if (session->retransmit != NULL) {
+                rtp_retransmit_store(session->retransmit, session->rtp_seq - 1,
+                                buffer + RTP_PACKET_HEADER_SIZE, buffer_len, phdr, phdr_len, data, data_len);
+        }
+
         rc = udp_sendv(session->rtp_socket, send_vector, send_vector_len, d);
         if (rc == -1) {
                 log_msg(LOG_LEVEL_WARNING, "sending RTP packet: %s", ug_strerror(errno));
@@ -3738,6 +4123,18 @@ void rtp_done(struct rtp *session)
          }
          */
 
+        if (session->retransmit != NULL) {
+                if (session->retransmit->requested > 0) {
+                        log_msg(LOG_LEVEL_INFO, "[RTP] Retransmitted %llu of %llu packets requested by NACK.\n",
+                                        session->retransmit->resent, session->retransmit->requested);
+                }
+                for (int i = 0; i < RTP_RETRANSMIT_SLOTS; ++i) {
+                        free(session->retransmit->slots[i].buf);
+                }
+                pthread_mutex_destroy(&session->retransmit->lock);
+                free(session->retransmit);
+        }
+        free(session->src_idx);
         udp_exit(session->rtp_socket);
         udp_exit(session->rtcp_socket);
         free(session->opt);
@@ -4006,6 +4403,41 @@ uint64_t rtp_get_bytes_sent(struct rtp *session)
         return session->rtp_bytes_sent;
 }
 
+/**
+ * Returns the latest receiver feedback for the stream we are sending.
+ *
+ * @param[in,out] count  number of reports already seen by the caller, updated
+ * @param[out] fract_lost fraction of lost packets (fixed point, /256)
+ * @param[out] rtt_us    round-trip time in microseconds, 0 if not known
+ * @retval true if there was a new report since *count
+ */
+bool rtp_get_tx_feedback(struct rtp *session, uint32_t *count, uint8_t *fract_lost, uint32_t *rtt_us)
+{
+        if (session->fb_count == *count) {
+                return false;
+        }
+        *fract_lost = session->fb_fract_lost;
+        *rtt_us = session->fb_rtt_us;
+        *count = session->fb_count;
+        return true;
+}
+
+/**
+ * Checks whether a receiver requested a keyframe (see rtp_send_pli(), standard
+ * RTCP PLI or FIR is accepted as well).
+ *
+ * @param[in,out] count  number of requests already seen by the caller, updated
+ * @retval true if there was a new request since *count
+ */
+bool rtp_get_keyframe_request(struct rtp *session, uint32_t *count)
+{
+        if (session->pli_count == *count) {
+                return false;
+        }
+        *count = session->pli_count;
+        return true;
+}
+
 int rtp_compute_fract_lost(struct rtp *session, uint32_t ssrc)
 {
         int h;
@@ -4063,16 +4495,178 @@ void rtp_async_start(struct rtp *session, int nr_packets)
        udp_async_start(session->rtp_socket, nr_packets);
 }
 
+void rtp_async_flush(struct rtp *session)
+{
+       udp_async_flush(session->rtp_socket);
+}
+
 void rtp_async_wait(struct rtp *session)
 {
        udp_async_wait(session->rtp_socket);
 }
 
+bool rtp_set_txtime_pacing(struct rtp *session, long interval_ns)
+{
+       return udp_set_txtime_pacing(session->rtp_socket, interval_ns);
+}
+
 struct socket_udp_local *rtp_get_udp_local_socket(struct rtp *session)
 {
         return udp_get_local(session->rtp_socket);
 }
 
+/**
+ * Keeps copies of packets sent in last max_age_ms milliseconds (at most
+ * RTP_RETRANSMIT_SLOTS) and resends them when requested by a NACK from the
+ * receiver (see rtp_send_nack()). Should be at least the playout delay of
+ * the receiver, later retransmissions would be discarded anyways.
+ */
+bool rtp_set_retransmit(struct rtp *session, int max_age_ms)
+{
+        if (session->retransmit == NULL) {
+                session->retransmit = calloc(1, sizeof *session->retransmit);
+                if (session->retransmit == NULL) {
+                        return false;
+                }
+                pthread_mutex_init(&session->retransmit->lock, NULL);
+        }
+        session->retransmit->max_age = (time_ns_t) max_age_ms * NS_IN_SEC / 1000;
+        return true;
+}
+
+/// APP packet (NACK or PLI) to be appended to the RTCP compound by send_rtcp()
+static _Thread_local rtcp_app *feedback_app;
+
+static rtcp_app *feedback_app_callback(struct rtp *session, uint32_t rtp_ts, int max_size)
+{
+        UNUSED(session);
+        UNUSED(rtp_ts);
+        rtcp_app *app = feedback_app;
+        feedback_app = NULL;
+        if (app != NULL && (app->length + 1) * 4 > max_size) {
+                return NULL;
+        }
+        return app;
+}
+
+/**
+ * Immediately sends RTCP (receiver report followed by NACK APP) requesting
+ * retransmission of given packets from the sender with ssrc.
+ *
+ * @param seqs  ascending sequence numbers of lost packets, at most RTP_NACK_MAX_SEQS
+ */
+void rtp_send_nack(struct rtp *session, uint32_t rtp_ts, uint32_t ssrc, const uint16_t *seqs, int count)
+{
+        uint32_t buf[3 /* hdr+SSRC+name */ + 1 /* media SSRC */ + RTP_NACK_MAX_SEQS];
+        rtcp_app *app = (rtcp_app *)(void *) buf;
+        uint32_t *fci = (uint32_t *)(void *) app->data;
+        int n = 0;
+
+        assert(count <= RTP_NACK_MAX_SEQS);
+        fci[n++] = htonl(ssrc);
+        for (int i = 0; i < count; ) {
+                uint16_t pid = seqs[i++];
+                uint16_t blp = 0;
+                while (i < count && (uint16_t) (seqs[i] - pid) >= 1 && (uint16_t) (seqs[i] - pid) <= 16) {
+                        blp |= 1U << ((uint16_t) (seqs[i] - pid) - 1);
+                        i++;
+                }
+                fci[n++] = htonl((uint32_t) pid << 16U | blp);
+        }
+        app->p = 0;
+        app->subtype = 1; // generic NACK FMT
+        memcpy(app->name, RTP_NACK_APP_NAME, sizeof app->name);
+        app->length = 2 + n; // in 32-bit words minus one
+        feedback_app = app;
+        send_rtcp(session, rtp_ts, feedback_app_callback);
+        feedback_app = NULL;
+}
+
+/**
+ * Immediately sends RTCP (receiver report followed by PLI APP) requesting a
+ * keyframe from the sender with ssrc, eg. when the decoder had to drop
+ * reference frames.
+ */
+void rtp_send_pli(struct rtp *session, uint32_t rtp_ts, uint32_t ssrc)
+{
+        uint32_t buf[3 /* hdr+SSRC+name */ + 1 /* media SSRC */];
+        rtcp_app *app = (rtcp_app *)(void *) buf;
+        uint32_t *fci = (uint32_t *)(void *) app->data;
+
+        fci[0] = htonl(ssrc);
+        app->p = 0;
+        app->subtype = 1; // PLI FMT
+        memcpy(app->name, RTP_PLI_APP_NAME, sizeof app->name);
+        app->length = 3; // in 32-bit words minus one
+        feedback_app = app;
+        send_rtcp(session, rtp_ts, feedback_app_callback);
+        feedback_app = NULL;
+}
+
+/// Sends RTCP (receiver report followed by MTU APP) acknowledging MTU probe from ssrc.
+static void send_mtu_ack(struct rtp *session, uint32_t rtp_ts, uint32_t ssrc, uint32_t mtu)
+{
+        uint32_t buf[3 /* hdr+SSRC+name */ + 2 /* media SSRC + MTU */];
+        rtcp_app *app = (rtcp_app *)(void *) buf;
+        uint32_t *fci = (uint32_t *)(void *) app->data;
+
+        fci[0] = htonl(ssrc);
+        fci[1] = htonl(mtu);
+        app->p = 0;
+        app->subtype = 0;
+        memcpy(app->name, RTP_MTU_APP_NAME, sizeof app->name);
+        app->length = 4; // in 32-bit words minus one
+        feedback_app = app;
+        send_rtcp(session, rtp_ts, feedback_app_callback);
+        feedback_app = NULL;
+}
+
+/**
+ * Sends a path MTU probe - an RTP packet (PT_MTU_PROBE) padded so that the IP
+ * datagram is exactly mtu bytes long, with Don't Fragment set. The receiver
+ * acknowledges it with RTCP APP, see rtp_get_mtu_ack().
+ *
+ * The probe doesn't consume a sequence number so that it doesn't disturb
+ * loss statistics and retransmissions when it gets lost.
+ *
+ * @retval false if the probe could not be sent (eg. larger than the local
+ * interface MTU or unsupported by the platform)
+ */
+bool rtp_send_mtu_probe(struct rtp *session, int mtu)
+{
+        const int len = mtu - (rtp_is_ipv6(session) ? 40 : 20) - 8; // IP + UDP hdr
+        if (len < 12 /* RTP hdr */ + 4 || len > RTP_MAX_MTU) {
+                return false;
+        }
+        char buffer[RTP_MAX_MTU];
+        memset(buffer, 0, len);
+        buffer[0] = 2 << 6; // V=2
+        buffer[1] = PT_MTU_PROBE;
+        uint32_t ssrc = htonl(rtp_my_ssrc(session));
+        memcpy(buffer + 8, &ssrc, sizeof ssrc);
+        uint32_t mtu_n = htonl(mtu);
+        memcpy(buffer + 12, &mtu_n, sizeof mtu_n);
+        return udp_send_dont_fragment(session->rtp_socket, buffer, len) == len;
+}
+
+/**
+ * Checks whether a receiver acknowledged MTU probes (see rtp_send_mtu_probe()).
+ *
+ * @param[in,out] count  number of acks already seen by the caller, updated
+ * @param[out]    mtu    largest MTU acknowledged since last call
+ * @retval true if there was a new ack since *count
+ */
+bool rtp_get_mtu_ack(struct rtp *session, uint32_t *count, int *mtu)
+{
+        if (session->mtu_ack_count == *count) {
+                return false;
+        }
+        *count = session->mtu_ack_count;
+        *mtu = session->mtu_ack_max;
+        session->mtu_ack_max = 0;
+        return true;
+}
+
 int rtp_get_udp_rx_port(struct rtp *session)
 {
         return udp_get_udp_rx_port(session->rtp_socket);
@@ -84,6 +84,7 @@ typedef struct __attribute__((packed)) {
 	uint32_t	*csrc;
 	char		*data;
 	int		 data_len;
+	int64_t		 rx_time;	/* Arrival time (ns, get_time_in_ns() clock), taken by kernel/NIC with udp-timestamping */
 	unsigned char	*extn;
 	uint16_t	 extn_len;	/* Size of the extension in 32 bit words minus one */
 	uint16_t	 extn_type;	/* Extension type field in the RTP packet header   */
@@ -257,6 +258,9 @@ bool             rtcp_recv_r(struct rtp *session,
                           struct timeval *timeout, uint32_t curr_rtp_ts);
 int 		 rtp_recv_poll_r(struct rtp **sessions, 
 			  struct timeval *timeout, uint32_t curr_rtp_ts);
+bool             rtp_get_fds(struct rtp *session, int *rtp_fd, int *rtcp_fd);
+void             rtp_recv_ready(struct rtp *session, bool rtp_readable, bool rtcp_readable,
+                          uint32_t curr_rtp_ts);
 int 		 rtp_send_raw_rtp_data(struct rtp *session, char *buffer, int buffer_len);
 
 int 		 rtp_send_data(struct rtp *session, 
@@ -275,6 +279,7 @@ void 		 rtp_send_ctrl(struct rtp *session, uint32_t rtp_ts,
 void 		 rtp_update(struct rtp *session, time_ns_t curr_time);
 
 uint32_t	 rtp_my_ssrc(struct rtp *session);
+uint16_t         rtp_get_next_seq(struct rtp *session);
 bool             rtp_add_csrc(struct rtp *session, uint32_t csrc);
 bool             rtp_del_csrc(struct rtp *session, uint32_t csrc);
 
@@ -299,21 +304,38 @@ void             rtp_flush_recv_buf(struct rtp *session);
 int              rtp_get_udp_rx_port(struct rtp *session);
 uint64_t         rtp_get_bytes_sent(struct rtp *session);
 int              rtp_compute_fract_lost(struct rtp *session, uint32_t ssrc);
+bool             rtp_get_tx_feedback(struct rtp *session, uint32_t *count, uint8_t *fract_lost, uint32_t *rtt_us);
 bool             rtp_is_ipv6(struct rtp *session);
 bool             rtp_has_receiver(struct rtp *session);
 
+#define RTP_NACK_MAX_SEQS 64 ///< max packets requested by one rtp_send_nack() call
+bool             rtp_set_retransmit(struct rtp *session, int max_age_ms);
+void             rtp_send_nack(struct rtp *session, uint32_t rtp_ts, uint32_t ssrc,
+                               const uint16_t *seqs, int count);
+void             rtp_send_pli(struct rtp *session, uint32_t rtp_ts, uint32_t ssrc);
+bool             rtp_get_keyframe_request(struct rtp *session, uint32_t *count);
+bool             rtp_send_mtu_probe(struct rtp *session, int mtu);
+bool             rtp_get_mtu_ack(struct rtp *session, uint32_t *count, int *mtu);
+
 /*
- * Async API - MSW specific
+ * Async API - MSW overlapped I/O or sendmmsg() batching where available
  *
  * Using async API hugely improves performance.
  * Usage is simple - prior to sending a bulk of packets (eg. video frame), rtp_async_start()
  * is started. Then, all packets are sent as usual, exept that neither data nor headers should
  * be altered up to rtp_async_wait() call, which waits upon completition of async operations
  * started after rtp_async_start(). Caller is responsible that rtp_send_data_hdr() is not called
- * more than nr_packet times.
+ * more than nr_packet times. rtp_async_flush() can be used to submit the packets queued so
+ * far (eg. at the end of a pacing burst).
  */
 void             rtp_async_start(struct rtp *session, int nr_packets);
+void             rtp_async_flush(struct rtp *session);
 void             rtp_async_wait(struct rtp *session);
+/**
+ * Lets kernel (fq/ETF qdisc) pace following packets by interval_ns using
+ * SO_TXTIME. Returns false if unsupported - the caller should pace itself.
+ */
+bool             rtp_set_txtime_pacing(struct rtp *session, long interval_ns);
 
 struct socket_udp_local *rtp_get_udp_local_socket(struct rtp *session);
 
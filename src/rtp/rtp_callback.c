@@ -73,6 +73,7 @@
 #include "rtp/pbuf.h"
 #include "rtp/rtp_callback.h"
 #include "tfrc.h"
+#include "utils/viewport_tiles.h"
 
 extern char *frame;
 
@@ -221,6 +222,10 @@ void rtp_recv_callback(struct rtp *session, rtp_event * e)
         case RX_RTCP_FINISH:
                 break;
         case RX_SR:
+                if (state != NULL) {
+                        const rtcp_sr *sr = (const rtcp_sr *) e->data;
+                        pbuf_set_sr(state->playout_buffer, sr->ntp_sec, sr->ntp_frac, sr->rtp_ts);
+                }
                 break;
         case RX_RR:
                 process_rr(session, e);
@@ -236,7 +241,11 @@ void rtp_recv_callback(struct rtp *session, rtp_event * e)
                         assert(pckt_app->length == 3);
                         assert(pckt_app->subtype == 0);
 //                      tfrc_recv_rtt(state->tfrc_state, get_time_in_ns(), ntohl(*((int *) pckt_app->data)));
+                } else if (strncmp(pckt_app->name, VIEWPORT_TILES_APP_NAME, 4) == 0) {
+                        viewport_tiles_put_feedback((unsigned char *) pckt_app->data,
+                                        (pckt_app->length - 2) * 4);
                 }
+                free(pckt_app);
                 break;
         case RX_BYE:
                 break;
@@ -0,0 +1,481 @@
+/**
+ * @file   rtp/rtp_event_loop.c
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#if defined __linux__
+#include <sys/epoll.h>
+#define EVENT_LOOP_EPOLL 1
+#elif defined __APPLE__ || defined __FreeBSD__ || defined __NetBSD__ || defined __OpenBSD__
+#include <sys/event.h>
+#define EVENT_LOOP_KQUEUE 1
+#endif
+
+#if defined EVENT_LOOP_EPOLL || defined EVENT_LOOP_KQUEUE
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#include "debug.h"
+#include "rtp/rtp.h"
+#include "rtp/rtp_event_loop.h"
+#include "utils/thread.h"
+
+#define MOD_NAME "[RTP loop] "
+
+#if defined EVENT_LOOP_EPOLL || defined EVENT_LOOP_KQUEUE
+
+#define WHEEL_SLOTS 256
+#define WHEEL_TICK_NS (NS_IN_SEC / 200) ///< 5 ms, horizon is WHEEL_SLOTS * WHEEL_TICK_NS
+#define MAX_EVENTS 64
+#define RTCP_FD_TAG ((uintptr_t) 1) ///< event tag of RTCP socket (low bit of the aligned pointer)
+
+struct loop_session {
+        struct rtp *session;
+        int flags;
+        int rtp_fd;
+        int rtcp_fd;
+        time_ns_t rtcp_interval;
+        time_ns_t deadline;
+        struct loop_session *next;        ///< list of the thread sessions
+        struct loop_session *wheel_next;  ///< timer wheel slot list
+        struct loop_session **wheel_pprev;
+};
+
+struct loop_cmd {
+        bool add;
+        struct loop_session *ls;
+        bool done;
+        struct loop_cmd *next;
+};
+
+struct loop_thread {
+        pthread_t thread;
+        int poll_fd;        ///< epoll or kqueue
+        int wakeup_pipe[2];
+        int session_count;  ///< guarded by rtp_event_loop::lock
+        bool should_exit;   ///< guarded by lock
+
+        pthread_mutex_t lock;
+        pthread_cond_t cmd_done_cv;
+        struct loop_cmd *cmds;
+
+        // owned by the thread
+        struct loop_session *sessions;
+        struct loop_session *wheel[WHEEL_SLOTS];
+        unsigned int wheel_pos;
+        time_ns_t wheel_time; ///< start of the current slot
+        int timer_count;
+};
+
+struct rtp_event_loop {
+        pthread_mutex_t lock;
+        int thread_count;
+        struct loop_thread *threads;
+};
+
+static bool poll_add(struct loop_thread *t, int fd, void *udata)
+{
+#ifdef EVENT_LOOP_EPOLL
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = udata };
+        return epoll_ctl(t->poll_fd, EPOLL_CTL_ADD, fd, &ev) == 0;
+#else
+        struct kevent ev;
+        EV_SET(&ev, fd, EVFILT_READ, EV_ADD, 0, 0, udata);
+        return kevent(t->poll_fd, &ev, 1, NULL, 0, NULL) == 0;
+#endif
+}
+
+static void poll_del(struct loop_thread *t, int fd)
+{
+#ifdef EVENT_LOOP_EPOLL
+        struct epoll_event ev = { 0 };
+        epoll_ctl(t->poll_fd, EPOLL_CTL_DEL, fd, &ev);
+#else
+        struct kevent ev;
+        EV_SET(&ev, fd, EVFILT_READ, EV_DELETE, 0, 0, NULL);
+        kevent(t->poll_fd, &ev, 1, NULL, 0, NULL);
+#endif
+}
+
+static void wheel_insert(struct loop_thread *t, struct loop_session *ls)
+{
+        time_ns_t ticks = (ls->deadline - t->wheel_time) / WHEEL_TICK_NS;
+        ticks = ticks < 1 ? 1 : ticks; // current slot is being processed
+        struct loop_session **slot = &t->wheel[(t->wheel_pos + ticks) % WHEEL_SLOTS];
+        ls->wheel_next = *slot;
+        if (*slot != NULL) {
+                (*slot)->wheel_pprev = &ls->wheel_next;
+        }
+        ls->wheel_pprev = slot;
+        *slot = ls;
+}
+
+static void wheel_unlink(struct loop_session *ls)
+{
+        if (ls->wheel_pprev == NULL) {
+                return;
+        }
+        *ls->wheel_pprev = ls->wheel_next;
+        if (ls->wheel_next != NULL) {
+                ls->wheel_next->wheel_pprev = ls->wheel_pprev;
+        }
+        ls->wheel_next = NULL;
+        ls->wheel_pprev = NULL;
+}
+
+/// fires timers of the slots passed until now
+static void wheel_advance(struct loop_thread *t, time_ns_t now)
+{
+        while (t->wheel_time + WHEEL_TICK_NS <= now) {
+                t->wheel_time += WHEEL_TICK_NS;
+                t->wheel_pos = (t->wheel_pos + 1) % WHEEL_SLOTS;
+                // detach expired entries first, they may be rescheduled to the same slot
+                struct loop_session *expired = NULL;
+                struct loop_session *ls = t->wheel[t->wheel_pos];
+                while (ls != NULL) {
+                        struct loop_session *nxt = ls->wheel_next;
+                        if (ls->deadline < t->wheel_time + WHEEL_TICK_NS) {
+                                wheel_unlink(ls);
+                                ls->wheel_next = expired;
+                                expired = ls;
+                        }
+                        ls = nxt;
+                }
+                while (expired != NULL) {
+                        struct loop_session *nxt = expired->wheel_next;
+                        rtp_update(expired->session, now);
+                        rtp_send_ctrl(expired->session, get_local_mediatime(), NULL, now);
+                        expired->deadline += expired->rtcp_interval;
+                        if (expired->deadline <= now) { // we are late, do not fire repeatedly
+                                expired->deadline = now + expired->rtcp_interval;
+                        }
+                        wheel_insert(t, expired);
+                        expired = nxt;
+                }
+        }
+}
+
+static void process_cmds(struct loop_thread *t)
+{
+        pthread_mutex_lock(&t->lock);
+        struct loop_cmd *cmd = t->cmds;
+        t->cmds = NULL;
+        for ( ; cmd != NULL; cmd = cmd->next) {
+                struct loop_session *ls = cmd->ls;
+                if (cmd->add) {
+                        bool ok = poll_add(t, ls->rtcp_fd, (void *) ((uintptr_t) ls | RTCP_FD_TAG));
+                        if ((ls->flags & RTP_EVENT_LOOP_RTCP_ONLY) == 0) {
+                                ok = ok && poll_add(t, ls->rtp_fd, ls);
+                        }
+                        if (!ok) {
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot watch session sockets!\n");
+                        }
+                        ls->next = t->sessions;
+                        t->sessions = ls;
+                        if (ls->rtcp_interval > 0) {
+                                if (t->timer_count++ == 0) {
+                                        t->wheel_time = get_time_in_ns();
+                                }
+                                ls->deadline = t->wheel_time + ls->rtcp_interval;
+                                wheel_insert(t, ls);
+                        }
+                } else {
+                        poll_del(t, ls->rtcp_fd);
+                        if ((ls->flags & RTP_EVENT_LOOP_RTCP_ONLY) == 0) {
+                                poll_del(t, ls->rtp_fd);
+                        }
+                        if (ls->wheel_pprev != NULL) {
+                                wheel_unlink(ls);
+                                t->timer_count -= 1;
+                        }
+                        for (struct loop_session **it = &t->sessions; *it != NULL; it = &(*it)->next) {
+                                if (*it == ls) {
+                                        *it = ls->next;
+                                        break;
+                                }
+                        }
+                        free(ls);
+                }
+                cmd->done = true;
+        }
+        pthread_cond_broadcast(&t->cmd_done_cv);
+        pthread_mutex_unlock(&t->lock);
+}
+
+static void *loop_thread_run(void *arg)
+{
+        struct loop_thread *t = arg;
+        set_thread_name("rtp_event_loop");
+
+        while (true) {
+                pthread_mutex_lock(&t->lock);
+                bool should_exit = t->should_exit;
+                pthread_mutex_unlock(&t->lock);
+                if (should_exit) {
+                        break;
+                }
+
+                int timeout_ms = -1;
+                if (t->timer_count > 0) {
+                        time_ns_t wait_ns = t->wheel_time + WHEEL_TICK_NS - get_time_in_ns();
+                        timeout_ms = wait_ns <= 0 ? 0 : (int) ((wait_ns + NS_IN_SEC / 1000 - 1) / (NS_IN_SEC / 1000));
+                }
+                void *ready[MAX_EVENTS];
+                int n = 0;
+#ifdef EVENT_LOOP_EPOLL
+                struct epoll_event events[MAX_EVENTS];
+                n = epoll_wait(t->poll_fd, events, MAX_EVENTS, timeout_ms);
+                for (int i = 0; i < n; ++i) {
+                        ready[i] = events[i].data.ptr;
+                }
+#else
+                struct kevent events[MAX_EVENTS];
+                struct timespec ts = { timeout_ms / 1000, (timeout_ms % 1000) * 1000000L };
+                n = kevent(t->poll_fd, NULL, 0, events, MAX_EVENTS, timeout_ms < 0 ? NULL : &ts);
+                for (int i = 0; i < n; ++i) {
+                        ready[i] = events[i].udata;
+                }
+#endif
+                bool wakeup = false;
+                uint32_t rtp_ts = get_local_mediatime();
+                for (int i = 0; i < n; ++i) {
+                        if (ready[i] == NULL) {
+                                wakeup = true;
+                                continue;
+                        }
+                        bool rtcp = ((uintptr_t) ready[i] & RTCP_FD_TAG) != 0;
+                        struct loop_session *ls = (struct loop_session *) ((uintptr_t) ready[i] & ~RTCP_FD_TAG);
+                        rtp_recv_ready(ls->session, !rtcp, rtcp, rtp_ts);
+                }
+                if (wakeup) {
+                        char buf[64];
+                        while (read(t->wakeup_pipe[0], buf, sizeof buf) > 0) {
+                        }
+                        process_cmds(t);
+                }
+                if (t->timer_count > 0) {
+                        wheel_advance(t, get_time_in_ns());
+                }
+        }
+        return NULL;
+}
+
+static void submit_cmd(struct loop_thread *t, struct loop_cmd *cmd)
+{
+        pthread_mutex_lock(&t->lock);
+        cmd->next = t->cmds;
+        t->cmds = cmd;
+        pthread_mutex_unlock(&t->lock);
+        char c = 0;
+        if (write(t->wakeup_pipe[1], &c, 1) != 1) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Cannot wake up the loop!\n");
+        }
+        pthread_mutex_lock(&t->lock);
+        while (!cmd->done) {
+                pthread_cond_wait(&t->cmd_done_cv, &t->lock);
+        }
+        pthread_mutex_unlock(&t->lock);
+}
+
+static bool loop_thread_init(struct loop_thread *t)
+{
+#ifdef EVENT_LOOP_EPOLL
+        t->poll_fd = epoll_create1(EPOLL_CLOEXEC);
+#else
+        t->poll_fd = kqueue();
+#endif
+        if (t->poll_fd == -1) {
+                return false;
+        }
+        if (pipe(t->wakeup_pipe) != 0) {
+                close(t->poll_fd);
+                return false;
+        }
+        fcntl(t->wakeup_pipe[0], F_SETFL, O_NONBLOCK);
+        poll_add(t, t->wakeup_pipe[0], NULL);
+        pthread_mutex_init(&t->lock, NULL);
+        pthread_cond_init(&t->cmd_done_cv, NULL);
+        if (pthread_create(&t->thread, NULL, loop_thread_run, t) != 0) {
+                pthread_mutex_destroy(&t->lock);
+                pthread_cond_destroy(&t->cmd_done_cv);
+                close(t->wakeup_pipe[0]);
+                close(t->wakeup_pipe[1]);
+                close(t->poll_fd);
+                return false;
+        }
+        return true;
+}
+
+static void loop_thread_done(struct loop_thread *t)
+{
+        pthread_mutex_lock(&t->lock);
+        t->should_exit = true;
+        pthread_mutex_unlock(&t->lock);
+        char c = 0;
+        if (write(t->wakeup_pipe[1], &c, 1) != 1) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Cannot wake up the loop!\n");
+        }
+        pthread_join(t->thread, NULL);
+        while (t->sessions != NULL) {
+                struct loop_session *nxt = t->sessions->next;
+                free(t->sessions);
+                t->sessions = nxt;
+        }
+        pthread_mutex_destroy(&t->lock);
+        pthread_cond_destroy(&t->cmd_done_cv);
+        close(t->wakeup_pipe[0]);
+        close(t->wakeup_pipe[1]);
+        close(t->poll_fd);
+}
+
+struct rtp_event_loop *rtp_event_loop_init(int threads)
+{
+        struct rtp_event_loop *loop = calloc(1, sizeof *loop);
+        loop->threads = calloc(threads, sizeof loop->threads[0]);
+        pthread_mutex_init(&loop->lock, NULL);
+        for ( ; loop->thread_count < threads; loop->thread_count++) {
+                if (!loop_thread_init(&loop->threads[loop->thread_count])) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot start event loop thread!\n");
+                        rtp_event_loop_done(loop);
+                        return NULL;
+                }
+        }
+        return loop;
+}
+
+bool rtp_event_loop_add(struct rtp_event_loop *loop, struct rtp *session, int flags,
+                time_ns_t rtcp_interval)
+{
+        struct loop_session *ls = calloc(1, sizeof *ls);
+        if (!rtp_get_fds(session, &ls->rtp_fd, &ls->rtcp_fd)) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Session with multithreaded receiving cannot be added!\n");
+                free(ls);
+                return false;
+        }
+        ls->session = session;
+        ls->flags = flags;
+        ls->rtcp_interval = rtcp_interval;
+
+        pthread_mutex_lock(&loop->lock);
+        struct loop_thread *t = &loop->threads[0];
+        for (int i = 1; i < loop->thread_count; ++i) {
+                if (loop->threads[i].session_count < t->session_count) {
+                        t = &loop->threads[i];
+                }
+        }
+        t->session_count += 1;
+        pthread_mutex_unlock(&loop->lock);
+
+        struct loop_cmd cmd = { .add = true, .ls = ls };
+        submit_cmd(t, &cmd);
+        return true;
+}
+
+void rtp_event_loop_remove(struct rtp_event_loop *loop, struct rtp *session)
+{
+        pthread_mutex_lock(&loop->lock);
+        struct loop_thread *t = NULL;
+        struct loop_session *ls = NULL;
+        for (int i = 0; i < loop->thread_count && ls == NULL; ++i) {
+                // the session list is modified only by the thread in process_cmds() under the lock
+                pthread_mutex_lock(&loop->threads[i].lock);
+                for (ls = loop->threads[i].sessions; ls != NULL && ls->session != session; ls = ls->next) {
+                }
+                pthread_mutex_unlock(&loop->threads[i].lock);
+                t = &loop->threads[i];
+        }
+        if (ls != NULL) {
+                t->session_count -= 1;
+        }
+        pthread_mutex_unlock(&loop->lock);
+        if (ls == NULL) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Removing unknown session!\n");
+                return;
+        }
+
+        struct loop_cmd cmd = { .add = false, .ls = ls };
+        submit_cmd(t, &cmd);
+}
+
+void rtp_event_loop_done(struct rtp_event_loop *loop)
+{
+        if (loop == NULL) {
+                return;
+        }
+        for (int i = 0; i < loop->thread_count; ++i) {
+                loop_thread_done(&loop->threads[i]);
+        }
+        pthread_mutex_destroy(&loop->lock);
+        free(loop->threads);
+        free(loop);
+}
+
+#else // ! (defined EVENT_LOOP_EPOLL || defined EVENT_LOOP_KQUEUE)
+
+struct rtp_event_loop *rtp_event_loop_init(int threads)
+{
+        UNUSED(threads);
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Not supported on this platform.\n");
+        return NULL;
+}
+
+bool rtp_event_loop_add(struct rtp_event_loop *loop, struct rtp *session, int flags,
+                time_ns_t rtcp_interval)
+{
+        UNUSED(loop), UNUSED(session), UNUSED(flags), UNUSED(rtcp_interval);
+        return false;
+}
+
+void rtp_event_loop_remove(struct rtp_event_loop *loop, struct rtp *session)
+{
+        UNUSED(loop), UNUSED(session);
+}
+
+void rtp_event_loop_done(struct rtp_event_loop *loop)
+{
+        UNUSED(loop);
+}
+
+#endif // defined EVENT_LOOP_EPOLL || defined EVENT_LOOP_KQUEUE
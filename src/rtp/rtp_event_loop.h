@@ -0,0 +1,83 @@
+/**
+ * @file   rtp/rtp_event_loop.h
+ * @brief  Shared epoll/kqueue driven receive loop for many RTP sessions
+ *
+ * Instead of a thread polling every session with rtp_recv_r() and a timeout,
+ * sessions are registered to a loop with a fixed number of threads. Every
+ * session is served by one of the threads - readable sockets are processed
+ * with rtp_recv_ready() and RTCP (rtp_update() and rtp_send_ctrl()) is driven
+ * by a timer wheel, so the count of threads and wakeups does not grow with
+ * the number of sessions.
+ *
+ * Sessions with multithreaded receiving (see rtp_init_if()) cannot be added.
+ * Only Linux (epoll) and macOS/BSD (kqueue) are supported, elsewhere
+ * rtp_event_loop_init() returns NULL and callers should keep polling.
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef RTP_RTP_EVENT_LOOP_H_
+#define RTP_RTP_EVENT_LOOP_H_
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+
+#include "tv.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct rtp;
+struct rtp_event_loop;
+
+enum rtp_event_loop_flags {
+        RTP_EVENT_LOOP_RTCP_ONLY = 1 << 0, ///< sender-only session, RTP socket is not read (cf. rtcp_recv_r())
+};
+
+struct rtp_event_loop *rtp_event_loop_init(int threads);
+/**
+ * @param rtcp_interval  period of rtp_update()/rtp_send_ctrl() calls, 0 to disable
+ */
+bool                   rtp_event_loop_add(struct rtp_event_loop *loop, struct rtp *session, int flags,
+                                time_ns_t rtcp_interval);
+/// blocks until the session is no longer used by the loop
+void                   rtp_event_loop_remove(struct rtp_event_loop *loop, struct rtp *session);
+void                   rtp_event_loop_done(struct rtp_event_loop *loop);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // defined RTP_RTP_EVENT_LOOP_H_
@@ -70,6 +70,8 @@
 #define PT_ENCRYPT_VIDEO_RS   30
 #define PT_AUDIO_RS           35
 #define PT_ENCRYPT_AUDIO_RS   36
+#define PT_AUDIO_PACKED       37   /* multiple channel segments per packet, see audio_packed_segment_hdr_t */
+#define PT_MTU_PROBE          38   /* path MTU probe (padding), acknowledged by RTCP APP, see rtp_send_mtu_probe() */
 #define PT_Unassign_Type95  95 /* reserved for future, backward compatible use with UG (metadata etc.) */
 #define PT_DynRTP_Type96    96 /* usually H.264 */
 #define PT_DynRTP_Type97    97 /* mU-law stereo amongst others */
@@ -99,9 +101,14 @@
  * bits 13 - 16 FPSd
  * bit 17 Fd
  * bit 18 Fi
+ * bits 19 - 20 temporal layer (0 - base layer, higher layers may be dropped)
  */
 typedef uint32_t video_payload_hdr_t[6];
 
+#define VIDEO_HDR_TEMPORAL_LAYER_SHIFT 11
+#define VIDEO_HDR_TEMPORAL_LAYER_MASK 0x3
+#define VIDEO_HDR_MAX_TEMPORAL_LAYERS 4
+
 /*
  * Audio payload
  *
@@ -124,6 +131,19 @@ typedef uint32_t video_payload_hdr_t[6];
  */
 typedef uint32_t audio_payload_hdr_t[5];
 
+/*
+ * Packed audio payload (PT_AUDIO_PACKED) is a sequence of segments, each
+ * consisting of this header followed by segment data. Segments are not
+ * aligned.
+ *
+ * 1st word
+ * bits 0 - 31 segment data length
+ *
+ * 2nd - 6th word
+ * audio_payload_hdr_t of the segment
+ */
+typedef uint32_t audio_packed_segment_hdr_t[6];
+
 /*
  * FEC payload
  *
@@ -158,7 +178,7 @@ typedef uint32_t crypto_payload_hdr_t[1];
 
 #define PT_AUDIO_HAS_FEC(pt) ((pt) == PT_AUDIO_RS || (pt) == PT_ENCRYPT_AUDIO_RS)
 #define PT_AUDIO_IS_ENCRYPTED(pt) ((pt) == PT_ENCRYPT_AUDIO || (pt) == PT_ENCRYPT_AUDIO_RS)
-#define PT_IS_AUDIO(pt) ((pt) == PT_AUDIO || (pt) == PT_AUDIO_RS || (pt) == PT_ENCRYPT_AUDIO || (pt) == PT_ENCRYPT_AUDIO_RS)
+#define PT_IS_AUDIO(pt) ((pt) == PT_AUDIO || (pt) == PT_AUDIO_RS || (pt) == PT_ENCRYPT_AUDIO || (pt) == PT_ENCRYPT_AUDIO_RS || (pt) == PT_AUDIO_PACKED)
 #define PT_VIDEO_HAS_FEC(pt) (pt == PT_VIDEO_LDGM || pt == PT_ENCRYPT_VIDEO_LDGM || pt == PT_VIDEO_RS || pt == PT_ENCRYPT_VIDEO_RS)
 #define PT_VIDEO_IS_ENCRYPTED(pt) (pt == PT_ENCRYPT_VIDEO || pt == PT_ENCRYPT_VIDEO_LDGM || pt == PT_ENCRYPT_VIDEO_RS)
 
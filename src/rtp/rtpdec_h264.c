@@ -53,39 +53,35 @@
 #include "rtp/rtpdec_h264.h"
 #include "utils/h264_stream.h"
 #include "utils/bs.h"
+#include "video_codec.h"
 #include "video_frame.h"
 
-// NAL values >23 are invalid in H.264 codestream but used by RTP
-#define RTP_STAP_A 24
-#define RTP_STAP_B 25
-#define RTP_MTAP16 26
-#define RTP_MTAP24 27
-#define RTP_FU_A   28
-#define RTP_FU_B   29
-/// type was 1-23 representing H.264 NAL type
-#define H264_NAL   32
+#define HEVC_NAL_HDR_GET_TYPE(nal) (((nal) >> 1U) & 0x3FU)
+#define HEVC_NAL_IRAP_MIN 16 ///< BLA_W_LP
+#define HEVC_NAL_IRAP_MAX 23 ///< RSV_IRAP_VCL23
+#define HEVC_NAL_VCL_MAX  31
 
 static const uint8_t start_sequence[] = { 0, 0, 0, 1 };
 
-int fill_coded_frame_from_sps(struct video_frame *rx_data, unsigned char *data, int data_len);
-
 /**
  * This function extracts important data for futher processing of the stream,
  * eg. frame type - for prepending RTSP/SDP sprop-parameter-sets to I-frame and
  * parsing dimensions from SPS NAL.
  *
- * Should be run in 1st pass - it sets frame_type according to which does the
- * decoder deduce offset in 2nd pass.
- *
  * @retval H.264 or RTP NAL type
  */
-static uint8_t process_nal(uint8_t nal, struct video_frame *frame, uint8_t *data, int data_len) {
+static uint8_t process_nal(uint8_t nal, struct decode_data_h264 *d, uint8_t *data, int data_len) {
+    struct video_frame *frame = d->frame;
     uint8_t type = NALU_HDR_GET_TYPE(nal);
     uint8_t nri = NALU_HDR_GET_NRI(nal);
     log_msg(LOG_LEVEL_DEBUG2, "NAL type %d (nri: %d)\n", (int) type, (int) nri);
 
     if (type == NAL_SPS) {
-        fill_coded_frame_from_sps(frame, data, data_len);
+        uint32_t width, height;
+        if (h264_sps_cache_get_dimensions(d->sps_cache, data, data_len, &width, &height) == 0) {
+            vf_get_tile(frame, 0)->width = width;
+            vf_get_tile(frame, 0)->height = height;
+        }
     }
 
     if (type >= NAL_MIN && type <= NAL_MAX) {
@@ -98,73 +94,108 @@ static uint8_t process_nal(uint8_t nal, struct video_frame *frame, uint8_t *data
     return type;
 }
 
-static _Bool decode_nal_unit(struct video_frame *frame, int *total_length, int pass, unsigned char **dst, uint8_t *data, int data_len) {
-    int fu_length = 0;
+/// HEVC counterpart of process_nal(), dimensions are not parsed from SPS
+static void process_nal_hevc(uint8_t nal, struct video_frame *frame) {
+    uint8_t type = HEVC_NAL_HDR_GET_TYPE(nal);
+    log_msg(LOG_LEVEL_DEBUG2, "HEVC NAL type %d\n", (int) type);
+
+    if (type >= HEVC_NAL_IRAP_MIN && type <= HEVC_NAL_IRAP_MAX) {
+        frame->frame_type = INTRA;
+    } else if (type <= HEVC_NAL_VCL_MAX && frame->frame_type == BFRAME && (type % 2 == 1 || type > 14)) {
+        frame->frame_type = OTHER; // sub-layer reference picture
+    }
+}
+
+/**
+ * Appends data to the frame at position *pos, enlarging the buffer if needed.
+ * MAX_PADDING bytes are always kept allocated after the buffer_len bytes.
+ */
+static _Bool append(struct decode_data_h264 *d, unsigned *pos, const void *data, unsigned len) {
+    struct tile *tile = &d->frame->tiles[0];
+    if (*pos + len > d->buffer_len) {
+        unsigned new_len = MAX(2 * d->buffer_len, *pos + len);
+        char *new_data = realloc(tile->data, new_len + MAX_PADDING);
+        if (new_data == NULL) {
+            error_msg("Cannot enlarge H.264 frame buffer to %u B!\n", new_len);
+            return FALSE;
+        }
+        log_msg(LOG_LEVEL_VERBOSE, "Enlarging H.264 frame buffer to %u B.\n", new_len);
+        tile->data = new_data;
+        d->buffer_len = new_len;
+    }
+    memcpy(tile->data + *pos, data, len);
+    *pos += len;
+    return TRUE;
+}
+
+static _Bool append_nal(struct decode_data_h264 *d, unsigned *pos, const void *data, unsigned len) {
+    return append(d, pos, start_sequence, sizeof start_sequence) && append(d, pos, data, len);
+}
+
+/**
+ * Processes aggregation packet payload (RFC 6184 STAP-A or RFC 7798 AP) - a
+ * sequence of 16-bit NAL sizes followed by the NAL units.
+ */
+static _Bool depacketize_aggregated(struct decode_data_h264 *d, unsigned *pos, uint8_t *data, int data_len, _Bool hevc) {
+    while (data_len > 2) {
+        uint16_t nal_size;
+        memcpy(&nal_size, data, sizeof(uint16_t));
+        nal_size = ntohs(nal_size);
+
+        data += 2;
+        data_len -= 2;
+
+        if (nal_size > data_len || nal_size == 0) {
+            error_msg("NAL size exceeds length: %u %d\n", nal_size, data_len);
+            return FALSE;
+        }
+        if (hevc) {
+            process_nal_hevc(data[0], d->frame);
+        } else {
+            process_nal(data[0], d, data, nal_size);
+        }
+        if (!append_nal(d, pos, data, nal_size)) {
+            return FALSE;
+        }
+        data += nal_size;
+        data_len -= nal_size;
+    }
+    return TRUE;
+}
+
+static _Bool depacketize_h264(struct decode_data_h264 *d, unsigned *pos, uint8_t *data, int data_len) {
     uint8_t nal = data[0];
-    uint8_t type = pass == 0 ? process_nal(nal, frame, data, data_len) : NALU_HDR_GET_TYPE(nal);
+    uint8_t type = NALU_HDR_GET_TYPE(nal);
+
     if (type >= NAL_MIN && type <= NAL_MAX) {
-        type = H264_NAL;
+        process_nal(nal, d, data, data_len);
+        return append_nal(d, pos, data, data_len);
     }
 
     switch (type) {
-        case H264_NAL:
-            if (pass == 0) {
-                *total_length += sizeof(start_sequence) + data_len;
-            } else {
-                *dst -= data_len + sizeof(start_sequence);
-                memcpy(*dst, start_sequence, sizeof(start_sequence));
-                memcpy(*dst + sizeof(start_sequence), data, data_len);
-            }
-            break;
         case RTP_STAP_A:
+            return depacketize_aggregated(d, pos, data + 1, data_len - 1, FALSE);
+        case RTP_FU_A:
         {
-            int nal_sizes[100];
-            unsigned nal_count = 0;
-            data++;
-            data_len--;
-
-            while (data_len > 2) {
-                uint16_t nal_size;
-                memcpy(&nal_size, data, sizeof(uint16_t));
-                nal_size = ntohs(nal_size);
-
-                data += 2;
-                data_len -= 2;
-
-                log_msg(LOG_LEVEL_DEBUG2, "STAP-A subpacket NAL type %d (nri: %d)\n", (int) NALU_HDR_GET_TYPE(data[0]), (int) NALU_HDR_GET_NRI(nal));
-
-                if (nal_size <= data_len) {
-                    if (pass == 0) {
-                        *total_length += sizeof(start_sequence) + nal_size;
-                        process_nal(data[0], frame, data, data_len);
-                    } else {
-                        assert(nal_count < sizeof nal_sizes / sizeof nal_sizes[0] - 1);
-                        nal_sizes[nal_count++] = nal_size;
-                    }
-                } else {
-                    error_msg("NAL size exceeds length: %u %d\n", nal_size, data_len);
-                    return FALSE;
-                }
-                data += nal_size;
-                data_len -= nal_size;
-
-                if (data_len < 0) {
-                    error_msg("Consumed more bytes than we got! (%d)\n", data_len);
-                    return FALSE;
-                }
-
+            if (data_len <= 2) {
+                error_msg("Too short data for FU-A H264 RTP packet\n");
+                return FALSE;
             }
-            if (pass > 0) {
-                for (int i = nal_count - 1; i >= 0; i--) {
-                    int nal_size = nal_sizes[i];
-                    data -= nal_size;
-                    *dst -= nal_size + sizeof(start_sequence);
-                    memcpy(*dst, start_sequence, sizeof(start_sequence));
-                    memcpy(*dst + sizeof(start_sequence), data, nal_size);
-                    data -= 2;
+            uint8_t fu_header = data[1];
+            uint8_t start_bit = fu_header >> 7;
+            /* The original nal forbidden bit and NRI are stored in this
+             * packet's nal. */
+            uint8_t reconstructed_nal = (nal & 0xe0) | NALU_HDR_GET_TYPE(fu_header);
+            data += 2;
+            data_len -= 2;
+
+            if (start_bit) {
+                process_nal(reconstructed_nal, d, data, data_len);
+                if (!append_nal(d, pos, &reconstructed_nal, sizeof reconstructed_nal)) {
+                    return FALSE;
                 }
             }
-            break;
+            return append(d, pos, data, data_len);
         }
         case RTP_STAP_B:
         case RTP_MTAP16:
@@ -172,164 +203,113 @@ static _Bool decode_nal_unit(struct video_frame *frame, int *total_length, int p
         case RTP_FU_B:
             error_msg("Unhandled NAL type %d\n", type);
             return FALSE;
-        case RTP_FU_A:
-            data++;
-            data_len--;
-
-            if (data_len > 1) {
-                uint8_t fu_header = *data;
-                uint8_t start_bit = fu_header >> 7;
-                uint8_t end_bit       = (fu_header & 0x40) >> 6;
-                uint8_t nal_type = NALU_HDR_GET_TYPE(fu_header);
-                uint8_t reconstructed_nal;
-
-                // Reconstruct this packet's true nal; only the data follows.
-                /* The original nal forbidden bit and NRI are stored in this
-                 * packet's nal. */
-                reconstructed_nal = nal & 0xe0;
-                reconstructed_nal |= nal_type;
-
-                // skip the fu_header
-                data++;
-                data_len--;
-
-                if (pass == 0) {
-                    if (end_bit) {
-                        fu_length = data_len;
-                    } else {
-                        fu_length += data_len;
-                    }
-                    if (start_bit) {
-                        *total_length += sizeof(start_sequence) + sizeof(reconstructed_nal) + data_len;
-                        process_nal(reconstructed_nal, frame, data, fu_length);
-                    } else {
-                        *total_length += data_len;
-                    }
-                } else {
-                    if (start_bit) {
-                        *dst -= sizeof(start_sequence) + sizeof(reconstructed_nal) + data_len;
-                        memcpy(*dst, start_sequence, sizeof(start_sequence));
-                        memcpy(*dst + sizeof(start_sequence), &reconstructed_nal, sizeof(reconstructed_nal));
-                        memcpy(*dst + sizeof(start_sequence) + sizeof(reconstructed_nal), data, data_len);
-                    } else {
-                        *dst -= data_len;
-                        memcpy(*dst, data, data_len);
-                    }
-                }
-            } else {
-                error_msg("Too short data for FU-A H264 RTP packet\n");
-                return FALSE;
-            }
-            break;
         default:
             error_msg("Unknown NAL type %d\n", type);
             return FALSE;
     }
-    return TRUE;
 }
 
-int decode_frame_h264(struct coded_data *cdata, void *decode_data) {
-    struct coded_data *orig = cdata;
-
-    int total_length = 0;
-
-    struct decode_data_h264 *data = (struct decode_data_h264 *) decode_data;
-    struct video_frame *frame = data->frame;
-    frame->frame_type = BFRAME;
-
-    for (int pass = 0; pass < 2; pass++) {
-        unsigned char *dst = NULL;
-
-        if (pass > 0) {
-            cdata = orig;
-            if(frame->frame_type == INTRA){
-                total_length+=data->offset_len;
-            }
-            frame->tiles[0].data_len = total_length;
-            dst = (unsigned char *) frame->tiles[0].data + total_length;
-        }
+/**
+ * @note DONL fields (sprop-max-don-diff > 0) are not supported
+ */
+static _Bool depacketize_hevc(struct decode_data_h264 *d, unsigned *pos, uint8_t *data, int data_len) {
+    if (data_len < 3) {
+        error_msg("Too short HEVC RTP packet\n");
+        return FALSE;
+    }
+    uint8_t type = HEVC_NAL_HDR_GET_TYPE(data[0]);
 
-        while (cdata != NULL) {
-            rtp_packet *pckt = cdata->data;
+    if (type < RTP_HEVC_AP) {
+        process_nal_hevc(data[0], d->frame);
+        return append_nal(d, pos, data, data_len);
+    }
 
-            if (!decode_nal_unit(frame, &total_length, pass, &dst, (uint8_t *) pckt->data, pckt->data_len)) {
-                return FALSE;
+    switch (type) {
+        case RTP_HEVC_AP:
+            return depacketize_aggregated(d, pos, data + 2, data_len - 2, TRUE);
+        case RTP_HEVC_FU:
+        {
+            uint8_t fu_header = data[2];
+            uint8_t start_bit = fu_header >> 7;
+            uint8_t reconstructed_nal[2] = {
+                (uint8_t) ((data[0] & 0x81) | (fu_header & 0x3F) << 1), // F + LayerId MSB + FuType
+                data[1],                                                // LayerId + TID
+            };
+            data += 3;
+            data_len -= 3;
+
+            if (start_bit) {
+                process_nal_hevc(reconstructed_nal[0], d->frame);
+                if (!append_nal(d, pos, reconstructed_nal, sizeof reconstructed_nal)) {
+                    return FALSE;
+                }
             }
-
-            cdata = cdata->nxt;
+            return append(d, pos, data, data_len);
         }
+        default:
+            error_msg("Unhandled HEVC payload type %d\n", type);
+            return FALSE;
     }
-
-    return TRUE;
 }
 
-int fill_coded_frame_from_sps(struct video_frame *rx_data, unsigned char *data, int data_len){
-    uint32_t width, height;
-    sps_t* sps = (sps_t*)malloc(sizeof(sps_t));
-    uint8_t* rbsp_buf = (uint8_t*)malloc(data_len);
-    if (nal_to_rbsp(data, &data_len, rbsp_buf, &data_len) < 0){
-        free(rbsp_buf);
-        free(sps);
-        return -1;
+/**
+ * Depacketizes the frame in a single pass - the payload is copied directly
+ * from the RTP packets to the frame buffer in sequence order.
+ */
+static int decode_frame_h2645(struct coded_data *cdata, void *decode_data, _Bool hevc) {
+    struct decode_data_h264 *d = (struct decode_data_h264 *) decode_data;
+    struct video_frame *frame = d->frame;
+    frame->frame_type = BFRAME;
+
+    // pbuf keeps the packets in descending sequence number order
+    while (cdata->nxt != NULL) {
+        cdata = cdata->nxt;
     }
-    bs_t* b = bs_new(rbsp_buf, data_len);
-    if(read_seq_parameter_set_rbsp(sps,b) < 0){
-        bs_free(b);
-        free(rbsp_buf);
-        free(sps);
-        return -1;
+
+    // space for sprop parameter sets the caller prepends to I-frames
+    unsigned pos = d->offset_len;
+    if (pos > d->buffer_len) {
+        return FALSE;
     }
-    width = (sps->pic_width_in_mbs_minus1 + 1) * 16;
-    height = (2 - sps->frame_mbs_only_flag) * (sps->pic_height_in_map_units_minus1 + 1) * 16;
-    //NOTE: frame_mbs_only_flag = 1 --> only progressive frames
-    //      frame_mbs_only_flag = 0 --> some type of interlacing (there are 3 types contemplated in the standard)
-    if (sps->frame_cropping_flag){
-        width -= (sps->frame_crop_left_offset*2 + sps->frame_crop_right_offset*2);
-        height -= (sps->frame_crop_top_offset*2 + sps->frame_crop_bottom_offset*2);
+
+    for ( ; cdata != NULL; cdata = cdata->prv) {
+        rtp_packet *pckt = cdata->data;
+        if (pckt->data_len <= 0) {
+            continue;
+        }
+        _Bool ret = hevc ? depacketize_hevc(d, &pos, (uint8_t *) pckt->data, pckt->data_len)
+            : depacketize_h264(d, &pos, (uint8_t *) pckt->data, pckt->data_len);
+        if (!ret) {
+            return FALSE;
+        }
     }
 
-    if((width != rx_data->tiles[0].width) || (height != rx_data->tiles[0].height)) {
-        vf_get_tile(rx_data, 0)->width = width;
-        vf_get_tile(rx_data, 0)->height = height;
-//        free(rx_data->tiles[0].data);
-//        rx_data->tiles[0].data = calloc(1, rx_data->h264_width * rx_data->h264_height);
+    if (frame->frame_type != INTRA) {
+        // not filled by the caller, zero bytes before a start code are allowed (trailing_zero_8bits)
+        memset(frame->tiles[0].data, 0, d->offset_len);
     }
+    frame->tiles[0].data_len = pos;
+    memset(frame->tiles[0].data + pos, 0, MAX_PADDING); // as required by libavcodec
 
-    bs_free(b);
-    free(rbsp_buf);
-    free(sps);
+    return TRUE;
+}
 
-    return 0;
+int decode_frame_h264(struct coded_data *cdata, void *decode_data) {
+    return decode_frame_h2645(cdata, decode_data, FALSE);
+}
+
+int decode_frame_hevc(struct coded_data *cdata, void *decode_data) {
+    return decode_frame_h2645(cdata, decode_data, TRUE);
 }
 
 int width_height_from_SDP(int *widthOut, int *heightOut , unsigned char *data, int data_len){
     uint32_t width, height;
-    sps_t* sps = (sps_t*)malloc(sizeof(sps_t));
-    uint8_t* rbsp_buf = (uint8_t*)malloc(data_len);
-    if (nal_to_rbsp(data, &data_len, rbsp_buf, &data_len) < 0){
-        free(rbsp_buf);
-        free(sps);
+    if (h264_sps_get_dimensions(data, data_len, &width, &height) < 0) {
         return -1;
     }
-    bs_t* b = bs_new(rbsp_buf, data_len);
-    if(read_seq_parameter_set_rbsp(sps,b) < 0){
-        bs_free(b);
-        free(rbsp_buf);
-        free(sps);
-        return -1;
-    }
-    width = (sps->pic_width_in_mbs_minus1 + 1) * 16;
-    height = (2 - sps->frame_mbs_only_flag) * (sps->pic_height_in_map_units_minus1 + 1) * 16;
-    //NOTE: frame_mbs_only_flag = 1 --> only progressive frames
-    //      frame_mbs_only_flag = 0 --> some type of interlacing (there are 3 types contemplated in the standard)
-    if (sps->frame_cropping_flag){
-        width -= (sps->frame_crop_left_offset*2 + sps->frame_crop_right_offset*2);
-        height -= (sps->frame_crop_top_offset*2 + sps->frame_crop_bottom_offset*2);
-    }
 
     debug_msg("\n\n[width_height_from_SDP] width: %d   height: %d\n\n",width,height);
 
-
     if(width > 0){
         *widthOut = width;
     }
@@ -337,10 +317,6 @@ int width_height_from_SDP(int *widthOut, int *heightOut , unsigned char *data, i
         *heightOut = height;
     }
 
-    bs_free(b);
-    free(rbsp_buf);
-    free(sps);
-
     return 0;
 }
 
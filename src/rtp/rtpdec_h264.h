@@ -54,12 +54,31 @@ extern "C" {
 #define NAL_SPS     7
 #define NAL_MAX    23
 
+#define SEI_RECOVERY_POINT 6 ///< SEI payload type (both H.264 and HEVC)
+
+// NAL values >23 are invalid in H.264 codestream but used by RTP
+#define RTP_STAP_A 24
+#define RTP_STAP_B 25
+#define RTP_MTAP16 26
+#define RTP_MTAP24 27
+#define RTP_FU_A   28
+#define RTP_FU_B   29
+
+// HEVC payload types (RFC 7798), 0-47 is a single NAL unit
+#define RTP_HEVC_AP   48
+#define RTP_HEVC_FU   49
+#define RTP_HEVC_PACI 50
+
+struct h264_sps_cache;
 struct video_frame;
 
+/// used both for H.264 and HEVC
 struct decode_data_h264 {
         struct video_frame *frame;
-        int offset_len;
+        int offset_len;           ///< space to be left at the beginning of I-frames for parameter sets
         int video_pt;
+        unsigned buffer_len;      ///< allocated length of frame->tiles[0].data (excl. MAX_PADDING), may be enlarged by the decoder
+        struct h264_sps_cache *sps_cache; ///< avoids re-parsing repeated SPS (H.264 only), may be NULL
 };
 
 struct coded_data;
@@ -68,6 +87,7 @@ struct coded_data;
 #define NALU_HDR_GET_NRI(nal) (((nal) & 0x60U) >> 5U)
 
 int decode_frame_h264(struct coded_data *cdata, void *decode_data);
+int decode_frame_hevc(struct coded_data *cdata, void *decode_data);
 int width_height_from_SDP(int *widthOut, int *heightOut , unsigned char *data, int data_len);
 
 #ifdef __cplusplus
@@ -54,10 +54,7 @@
 #include <stdint.h>
 
 #include "rtp/rtpenc_h264.h"
-
-static uint32_t get4Bytes(const unsigned char *ptr) {
-        return (ptr[0] << 24) | (ptr[1] << 16) | (ptr[2] << 8) | ptr[3];
-}
+#include "utils/byte_scan.h"
 
 /**
  * Returns pointer to next NAL unit in stream.
@@ -67,22 +64,15 @@ static uint32_t get4Bytes(const unsigned char *ptr) {
  */
 static const unsigned char *get_next_nal(const unsigned char *start, long len, _Bool with_start_code) {
         const unsigned char * const stop = start + len;
-        while (stop - start >= 4) {
-                uint32_t next4Bytes = get4Bytes(start);
-                if (next4Bytes == 0x00000001) {
-                        return start + (with_start_code ? 0 : 4);
-                }
-                if ((next4Bytes & 0xFFFFFF00) == 0x00000100) {
-                        return start + (with_start_code ? 0 : 3);
-                }
-                // We save at least some of "next4Bytes".
-                if ((unsigned) (next4Bytes & 0xFF) > 1) {
-                        // Common case: 0x00000001 or 0x000001 definitely doesn't begin anywhere in "next4Bytes", so we save all of it:
-                        start += 4;
-                } else {
-                        // Save the first byte, and continue testing the rest:
-                        start += 1;
-                }
+        const unsigned char *p = find_start_code(start, stop);
+        if (p == NULL) {
+                return NULL;
+        }
+        if (p - 3 >= start && p[-3] == 0) {
+                return with_start_code ? p - 3 : p + 1;
+        }
+        if (p + 1 < stop) { // 3-byte start code must be followed by NAL header
+                return with_start_code ? p - 2 : p + 1;
         }
         return NULL;
 }
@@ -111,9 +111,17 @@
 #include "rtp/fec.h"
 #include "rtp/rtp.h"
 #include "rtp/rtp_callback.h"
+#include "rtp/rtpdec_h264.h"
+#include "rtp/rtpenc_h264.h"
 #include "rtp/pbuf.h"
 #include "rtp/video_decoders.h"
+#include "utils/frame_trace.h"
+#include "utils/lockfree_queue.hpp"
 #include "utils/macros.h"
+#include "utils/mem_budget.h"
+#include "utils/metrics.h"
+#include "utils/misc.h"
+#include "utils/profile_timer.hpp"
 #include "utils/synchronized_queue.h"
 #include "utils/thread.h"
 #include "utils/timed_message.h"
@@ -162,12 +170,12 @@ typedef void (*change_il_t)(char *dst, char *src, int linesize, int height, void
 
 // prototypes
 static bool reconfigure_decoder(struct state_video_decoder *decoder,
-                struct video_desc desc, codec_t comp_int_fmt);
+                struct video_desc desc, codec_t comp_int_fmt, bool keep_decompress = false);
 static int check_for_mode_change(struct state_video_decoder *decoder, uint32_t *hdr);
 static void wait_for_framebuffer_swap(struct state_video_decoder *decoder);
 static void *fec_thread(void *args);
 static void *decompress_thread(void *args);
-static void cleanup(struct state_video_decoder *decoder);
+static void cleanup(struct state_video_decoder *decoder, bool keep_decompress = false);
 static void decoder_process_message(struct module *);
 
 static int sum_map(map<int, int> const & m) {
@@ -208,6 +216,33 @@ struct line_decoder {
         unsigned int         dst_linesize; ///< destination linesize
         unsigned int         dst_pitch;    ///< framebuffer pitch - it can be larger if SDL resolution is larger than data */
         unsigned int         src_linesize; ///< source linesize
+        bool                 direct;       ///< payload can be placed to the framebuffer as-is (same codec and linesizes)
+        struct decoder_chain chain;        ///< used instead of decode_line if conversion has multiple steps
+};
+
+static inline void line_decoder_decode(const struct line_decoder *ld, unsigned char *dst, const unsigned char *src, int dst_len)
+{
+        if (ld->chain.hops > 1) {
+                decoder_chain_decode(&ld->chain, dst, src, dst_len, ld->shifts[0], ld->shifts[1], ld->shifts[2]);
+        } else {
+                ld->decode_line(dst, src, dst_len, ld->shifts[0], ld->shifts[1], ld->shifts[2]);
+        }
+}
+
+/// process-wide metrics exported through the control socket (see utils/metrics.h)
+struct decoder_metrics {
+        struct metric *displayed = metric_counter("ug_video_decoder_frames", "Frames processed by video decoder", "result=displayed");
+        struct metric *corrupted = metric_counter("ug_video_decoder_frames", "Frames processed by video decoder", "result=corrupted");
+        struct metric *missing = metric_counter("ug_video_decoder_frames", "Frames processed by video decoder", "result=missing");
+        struct metric *fec_ok = metric_counter("ug_video_decoder_fec", "FEC-protected frames by outcome", "result=noerr");
+        struct metric *fec_corrected = metric_counter("ug_video_decoder_fec", "FEC-protected frames by outcome", "result=ok");
+        struct metric *fec_nok = metric_counter("ug_video_decoder_fec", "FEC-protected frames by outcome", "result=nok");
+        struct metric *decompress_ms = metric_histogram("ug_decompress_duration_ms", "Video decompress duration", nullptr, nullptr, 0);
+        struct metric *g2g_ms = metric_histogram("ug_glass_to_glass_latency_ms", "Capture to display put latency (needs frame-trace)", nullptr, nullptr, 0);
+        static decoder_metrics &get() {
+                static decoder_metrics m;
+                return m;
+        }
 };
 
 struct reported_statistics_cumul {
@@ -218,8 +253,13 @@ struct reported_statistics_cumul {
         chrono::steady_clock::time_point t_last = chrono::steady_clock::now();
         unsigned long int displayed = 0, dropped = 0, corrupted = 0, missing = 0;
         atomic_ulong fec_ok = 0, fec_corrected = 0, fec_nok = 0;
+        atomic_ulong overload_skipped = 0; ///< frames skipped by the decoder overload protection
         void print() {
                 ostringstream fec;
+                ostringstream overload;
+                if (overload_skipped > 0) {
+                        overload << " Overload skipped: " << style::bold << overload_skipped << style::reset;
+                }
                 if (fec_ok + fec_nok + fec_corrected > 0) {
                         fec << " FEC noerr/OK/NOK: "
                                 << style::bold << fec_ok << style::reset
@@ -238,7 +278,7 @@ struct reported_statistics_cumul {
                         << style::bold << corrupted << style::reset
                         << " corr / "
                         << style::bold << missing << style::reset
-                        << " missing." << fec.str() << "\n";
+                        << " missing." << fec.str() << overload.str() << "\n";
         }
         void update(int buffer_number) {
                 if (last_buffer_number != -1) {
@@ -247,8 +287,10 @@ struct reported_statistics_cumul {
                         diff = (diff + (1U<<BUFNUM_BITS)) % (1U<<BUFNUM_BITS);
                         if (diff < (1U<<BUFNUM_BITS) / 2) {
                                 missing += diff;
+                                metric_add(decoder_metrics::get().missing, diff);
                         } else { // frames may have been reordered, add arbitrary 1
                                 missing += 1;
+                                metric_add(decoder_metrics::get().missing, 1);
                         }
                 }
                 last_buffer_number = buffer_number;
@@ -274,23 +316,39 @@ struct frame_msg {
                                 received_bytes += sum_map(pckt_list[i]);
                         }
                         int expected_bytes = vf_get_data_len(recv_frame);
+                        auto &m = decoder_metrics::get();
                         if (recv_frame->fec_params.type != FEC_NONE) {
                                 if (is_corrupted) {
                                         stats.fec_nok += 1;
+                                        metric_add(m.fec_nok, 1);
                                 } else {
                                         if (received_bytes == expected_bytes) {
                                                 stats.fec_ok += 1;
+                                                metric_add(m.fec_ok, 1);
                                         } else {
                                                 stats.fec_corrected += 1;
+                                                metric_add(m.fec_corrected, 1);
                                         }
                                 }
                         }
                         stats.corrupted += is_corrupted;
                         stats.displayed += is_displayed;
+                        metric_add(m.corrupted, is_corrupted);
+                        metric_add(m.displayed, is_displayed);
                 }
+                mem_budget_add(MEM_DECODER, -accounted_bytes);
                 vf_free(recv_frame);
                 vf_free(nofec_frame);
         }
+        /// accounts the buffers of recv_frame owned by the message (not the display framebuffer)
+        void account_recv_frame() {
+                for (unsigned int i = 0; i < recv_frame->tile_count; ++i) {
+                        if (recv_frame->tiles[i].data != nullptr) {
+                                accounted_bytes += recv_frame->tiles[i].data_len;
+                        }
+                }
+                mem_budget_add(MEM_DECODER, accounted_bytes);
+        }
         struct control_state *control;
         vector <uint32_t> buffer_num;
         struct video_frame *recv_frame; ///< received frame with FEC and/or compression
@@ -300,6 +358,7 @@ struct frame_msg {
         struct reported_statistics_cumul &stats;
         bool is_displayed = false;
         bool is_corrupted = false;
+        long long accounted_bytes = 0; ///< see account_recv_frame()
 };
 
 struct main_msg_reconfigure {
@@ -330,9 +389,13 @@ struct state_video_decoder
                 mod.priv_data = this;
                 mod.new_message = decoder_process_message;
                 module_register(&mod, parent);
+                fec_queue.instrument(&mod, "fec");
+                decompress_queue.instrument(&mod, "decompress");
                 control = (struct control_state *) get_module(get_root_module(parent), "control");
+                trace_stats = frame_trace_stats_init(control);
         }
         ~state_video_decoder() {
+                frame_trace_stats_destroy(trace_stats);
                 module_done(&mod);
         }
         struct module mod;
@@ -367,12 +430,12 @@ struct state_video_decoder
                               * has been processed and we can write to a new one */
         condition_variable buffer_swapped_cv; ///< condition variable associated with @ref buffer_swapped
 
-        synchronized_queue<unique_ptr<frame_msg>, 1> decompress_queue;
+        lockfree_queue<unique_ptr<frame_msg>, 1> decompress_queue;
 
         codec_t           out_codec = VIDEO_CODEC_NONE;
         int               pitch = 0;
 
-        synchronized_queue<unique_ptr<frame_msg>, 1> fec_queue;
+        lockfree_queue<unique_ptr<frame_msg>, 1> fec_queue;
 
         enum video_mode   video_mode = {} ;  ///< video mode set for this decoder
         bool          merged_fb = false; ///< flag if the display device driver requires tiled video or not
@@ -383,12 +446,27 @@ struct state_video_decoder
 
         const struct openssl_decrypt_info *dec_funcs = NULL; ///< decrypt state
         struct openssl_decrypt      *decrypt = NULL; ///< decrypt state
+        std::vector<struct openssl_decrypt *> decrypt_workers; ///< additional states for parallel decryption
+        std::vector<char> decrypt_buf; ///< plaintexts of packets of the frame decrypted in parallel
 
 #ifdef RECONFIGURE_IN_FUTURE_THREAD
         std::future<bool> reconfiguration_future;
         bool             reconfiguration_in_progress = false;
 #endif
         struct reported_statistics_cumul stats = {}; ///< stats to be reported through control socket
+        struct frame_trace_stats *trace_stats = nullptr; ///< latency trace percentiles (used by decompress thread)
+
+        /**
+         * Overload protection (see decoder_overload_check()), used by the
+         * decompress thread except of keyframe_requested.
+         */
+        struct {
+                double decompress_ns = 0.0;          ///< EWMA of decompress duration
+                bool waiting_for_keyframe = false;   ///< a reference frame was dropped
+                time_ns_t last_keyframe_request = 0;
+                atomic<bool> keyframe_requested{false}; ///< to be sent to the sender by the RTP receiver
+                atomic<bool> reference_lost{false};     ///< incomplete interframe dropped by the FEC thread
+        } overload;
 };
 
 /**
@@ -406,12 +484,75 @@ static void wait_for_framebuffer_swap(struct state_video_decoder *decoder) {
 #define NOT_ENCRYPTED_ERR "Receiving unencrypted video data " \
         "while expecting encrypted.\n"
 
+struct fec_decode_task {
+        fec *state;
+        struct tile *tile;
+        const map<int, int> *pckt_list;
+        char *out;
+        int out_len;
+        bool ret;
+};
+
+static void *fec_decode_worker(void *arg) {
+        auto *t = (struct fec_decode_task *) arg;
+        t->out = NULL;
+        t->out_len = 0;
+        t->ret = t->state->decode(t->tile->data, t->tile->data_len,
+                        &t->out, &t->out_len, *t->pckt_list);
+        return NULL;
+}
+
+#define LINE_DECODE_MIN_LINES 32 ///< min lines per a parallel line decode task
+
+struct line_decode_task {
+        const struct line_decoder *ld;
+        unsigned char *dst;
+        const unsigned char *src;
+        size_t dst_step;
+        int lines;
+};
+
+static void *line_decode_worker(void *arg) {
+        auto *t = (struct line_decode_task *) arg;
+        unsigned char *dst = t->dst;
+        const unsigned char *src = t->src;
+        for (int i = 0; i < t->lines; ++i) {
+                line_decoder_decode(t->ld, dst, src, t->ld->dst_linesize);
+                src += t->ld->src_linesize;
+                dst += t->dst_step;
+        }
+        return NULL;
+}
+
+/**
+ * Decodes lines of one tile, in row ranges processed in parallel if the tile
+ * is large enough.
+ */
+static void line_decode_parallel(const struct line_decoder *ld, unsigned char *dst,
+                const unsigned char *src, size_t dst_step, int lines)
+{
+        const int workers = max(1, min<int>(get_cpu_core_count(), lines / LINE_DECODE_MIN_LINES));
+        vector<line_decode_task> tasks(workers);
+        for (int i = 0; i < workers; ++i) {
+                const int first = lines * i / workers;
+                const int last = lines * (i + 1) / workers;
+                tasks[i] = { ld, dst + first * dst_step, src + (size_t) first * ld->src_linesize, dst_step, last - first };
+        }
+        if (workers == 1) {
+                line_decode_worker(&tasks[0]);
+        } else {
+                task_run_parallel(line_decode_worker, workers, tasks.data(), sizeof tasks[0], NULL);
+        }
+}
+
 static void *fec_thread(void *args) {
         set_thread_name(__func__);
         struct state_video_decoder *decoder =
                 (struct state_video_decoder *) args;
 
-        fec *fec_state = NULL;
+        // one FEC state per substream so that substreams can be decoded concurrently
+        vector<unique_ptr<fec>> fec_states;
+        vector<fec_decode_task> fec_tasks;
         struct fec_desc desc(FEC_NONE);
 
         while(1) {
@@ -421,25 +562,38 @@ static void *fec_thread(void *args) {
                         decoder->decompress_queue.push(move(data));
                         break; // exit from loop
                 }
+                PROFILE_FUNC;
 
                 struct video_frame *frame = decoder->frame;
                 struct tile *tile = NULL;
 
                 if (data->recv_frame->fec_params.type != FEC_NONE) {
-                        if(!fec_state || desc.k != data->recv_frame->fec_params.k ||
+                        if(fec_states.empty() || desc.k != data->recv_frame->fec_params.k ||
                                         desc.m != data->recv_frame->fec_params.m ||
                                         desc.c != data->recv_frame->fec_params.c ||
                                         desc.seed != data->recv_frame->fec_params.seed
                           ) {
-                                delete fec_state;
+                                fec_states.clear();
                                 desc = data->recv_frame->fec_params;
-                                fec_state = fec::create_from_desc(desc);
-                                if(fec_state == NULL) {
+                        }
+                        int substreams = get_video_mode_tiles_x(decoder->video_mode)
+                                * get_video_mode_tiles_y(decoder->video_mode);
+                        while ((int) fec_states.size() < substreams) {
+                                fec_states.emplace_back(fec::create_from_desc(desc));
+                                if (!fec_states.back()) {
+                                        fec_states.clear();
                                         log_msg(LOG_LEVEL_FATAL, "[decoder] Unable to initialize FEC.\n");
                                         exit_uv(1);
                                         goto cleanup;
                                 }
                         }
+
+                        fec_tasks.resize(substreams);
+                        for (int pos = 0; pos < substreams; ++pos) {
+                                fec_tasks[pos] = { fec_states[pos].get(), &data->recv_frame->tiles[pos],
+                                        &data->pckt_list[pos], NULL, 0, false };
+                        }
+                        task_run_parallel(fec_decode_worker, substreams, fec_tasks.data(), sizeof fec_tasks[0], NULL);
                 }
 
                 data->nofec_frame = vf_alloc(data->recv_frame->tile_count);
@@ -449,8 +603,8 @@ static void *fec_thread(void *args) {
                         bool buffer_swapped = false;
                         for (int pos = 0; pos < get_video_mode_tiles_x(decoder->video_mode)
                                         * get_video_mode_tiles_y(decoder->video_mode); ++pos) {
-                                char *fec_out_buffer = NULL;
-                                int fec_out_len = 0;
+                                char *fec_out_buffer = fec_tasks[pos].out;
+                                int fec_out_len = fec_tasks[pos].out_len;
 
                                 if (data->recv_frame->tiles[pos].data_len != (unsigned int) sum_map(data->pckt_list[pos])) {
                                         debug_msg("Frame incomplete - substream %d, buffer %d: expected %u bytes, got %u.\n", pos,
@@ -459,17 +613,14 @@ static void *fec_thread(void *args) {
                                                         (unsigned int) sum_map(data->pckt_list[pos]));
                                 }
 
-                                bool ret = fec_state->decode(data->recv_frame->tiles[pos].data,
-                                                data->recv_frame->tiles[pos].data_len,
-                                                &fec_out_buffer, &fec_out_len, data->pckt_list[pos]);
-
-                                if (ret == false) {
+                                if (!fec_tasks[pos].ret) {
                                         data->is_corrupted = true;
                                         verbose_msg("[decoder] FEC: unable to reconstruct data.\n");
                                         if (fec_out_len < (int) sizeof(video_payload_hdr_t)) {
                                                 goto cleanup;
                                         }
                                         if (decoder->decoder_type == EXTERNAL_DECODER && !decoder->accepts_corrupted_frame) {
+                                                decoder->overload.reference_lost = true;
                                                 goto cleanup;
                                         }
                                 }
@@ -516,17 +667,14 @@ static void *fec_thread(void *args) {
                                         struct line_decoder *line_decoder =
                                                 &decoder->line_decoder[pos];
 
-                                        int data_pos = 0;
                                         char *src = fec_out_buffer;
                                         char *dst = tile->data + line_decoder->base_offset;
-                                        while(data_pos < (int) fec_out_len) {
-                                                line_decoder->decode_line((unsigned char*)dst, (unsigned char *) src, line_decoder->dst_linesize,
-                                                                line_decoder->shifts[0],
-                                                                line_decoder->shifts[1],
-                                                                line_decoder->shifts[2]);
-                                                src += line_decoder->src_linesize;
-                                                dst += vc_get_linesize(tile->width ,frame->color_spec);
-                                                data_pos += line_decoder->src_linesize;
+                                        if (line_decoder->direct) {
+                                                memcpy(dst, src, min<size_t>(fec_out_len, tile->data_len - line_decoder->base_offset));
+                                        } else if (fec_out_len > 0) {
+                                                const int lines = (fec_out_len + line_decoder->src_linesize - 1) / line_decoder->src_linesize;
+                                                line_decode_parallel(line_decoder, (unsigned char *) dst, (unsigned char *) src,
+                                                                vc_get_linesize(tile->width, frame->color_spec), lines);
                                         }
                                 }
                         }
@@ -543,19 +691,20 @@ static void *fec_thread(void *args) {
                                                         decoder->decoder_type == EXTERNAL_DECODER && !decoder->accepts_corrupted_frame ? " dropped.\n" : "");
                                         data->is_corrupted = true;
                                         if(decoder->decoder_type == EXTERNAL_DECODER && !decoder->accepts_corrupted_frame) {
+                                                decoder->overload.reference_lost = true;
                                                 goto cleanup;
                                         }
                                 }
                         }
                 }
 
+                frame_trace_stamp(&data->recv_frame->trace, FT_FEC_DONE);
+                PROFILE_DETAIL("wait for decompress");
                 decoder->decompress_queue.push(move(data));
 cleanup:
                 ;
         }
 
-        delete fec_state;
-
         return NULL;
 }
 
@@ -599,6 +748,139 @@ static void *decompress_worker(void *data)
         return d;
 }
 
+ADD_TO_PARAM("decrypt-threads", "* decrypt-threads=<n>\n"
+                "  Number of threads decrypting received video (default: number of CPU cores).\n");
+
+enum frame_ref_type {
+        FRAME_UNKNOWN, ///< reference structure cannot be determined for the codec
+        FRAME_KEY,     ///< keyframe (or an intra-only codec)
+        FRAME_REF,     ///< inter frame used as a reference
+        FRAME_NONREF,  ///< inter frame not referenced by other frames (may be skipped)
+};
+
+/**
+ * Classifies H.264/HEVC access unit (Annex B) according to its VCL NAL units,
+ * other interframe codecs are not parsed. A recovery point SEI (start of
+ * a gradual intra refresh) is considered a keyframe as well.
+ */
+static enum frame_ref_type get_frame_ref_type(codec_t codec, const struct video_frame *frame)
+{
+        if (codec != H264 && codec != H265) {
+                return is_codec_interframe(codec) ? FRAME_UNKNOWN : FRAME_KEY;
+        }
+        enum frame_ref_type ret = FRAME_UNKNOWN;
+        const unsigned char *start = (const unsigned char *) frame->tiles[0].data;
+        const long len = frame->tiles[0].data_len;
+        const unsigned char *nal = start;
+        const unsigned char *endptr = start;
+        while ((nal = rtpenc_h264_get_next_nal(nal, len - (nal - start), &endptr))) {
+                bool vcl = false;
+                bool ref = true;
+                if (codec == H264) {
+                        int type = nal[0] & 0x1F;
+                        if (type == NAL_IDR || (type == NAL_SEI && endptr - nal > 1 && nal[1] == SEI_RECOVERY_POINT)) {
+                                return FRAME_KEY;
+                        }
+                        vcl = type >= 1 && type <= 4;
+                        ref = (nal[0] & 0x60) != 0; // nal_ref_idc
+                } else {
+                        int type = (nal[0] >> 1) & 0x3F;
+                        if (type >= 16 && type <= 23) { // IRAP
+                                return FRAME_KEY;
+                        }
+                        if (type == 39 /* prefix SEI */ && endptr - nal > 2 && nal[2] == SEI_RECOVERY_POINT) {
+                                return FRAME_KEY;
+                        }
+                        vcl = type <= 31;
+                        ref = type > 14 || type % 2 == 1; // sub-layer non-reference are even types 0-14
+                }
+                if (vcl) {
+                        ret = ref || ret == FRAME_REF ? FRAME_REF : FRAME_NONREF;
+                }
+                nal = endptr;
+        }
+        return ret;
+}
+
+/**
+ * Marks that the sender should be asked for a keyframe (see
+ * video_decoder_keyframe_requested()), requests are rate-limited.
+ */
+static void decoder_request_keyframe(struct state_video_decoder *decoder, time_ns_t now)
+{
+        constexpr time_ns_t KEYFRAME_REQUEST_INTERVAL = NS_IN_SEC / 2;
+        auto &o = decoder->overload;
+        if (now - o.last_keyframe_request > KEYFRAME_REQUEST_INTERVAL) {
+                o.keyframe_requested = true;
+                o.last_keyframe_request = now;
+        }
+}
+
+enum overload_action {
+        OVERLOAD_NONE,
+        OVERLOAD_SKIP_PRESENT, ///< decode (to keep references) but do not display
+        OVERLOAD_SKIP_DECODE,
+};
+
+/**
+ * Decides whether the frame should be skipped because the decoder doesn't
+ * keep up. Frames expected to be decompressed later than
+ * OVERLOAD_LATE_FRAMES frame intervals after their deadline are not
+ * displayed (or not decoded at all if not referenced). If the backlog
+ * exceeds OVERLOAD_DROP_REF_FRAMES intervals, even reference frames are
+ * dropped until the next keyframe, which is requested from the sender.
+ */
+static enum overload_action decoder_overload_check(struct state_video_decoder *decoder, const struct video_frame *frame,
+                enum frame_ref_type type)
+{
+        constexpr double OVERLOAD_LATE_FRAMES = 2.0;
+        constexpr double OVERLOAD_DROP_REF_FRAMES = 8.0;
+        auto &o = decoder->overload;
+        const codec_t codec = decoder->received_vid_desc.color_spec;
+        const time_ns_t now = get_time_in_ns();
+        auto request_keyframe = [&]() { decoder_request_keyframe(decoder, now); };
+
+        if (o.waiting_for_keyframe) {
+                if (type == FRAME_REF || type == FRAME_NONREF) {
+                        request_keyframe();
+                        return OVERLOAD_SKIP_DECODE;
+                }
+                o.waiting_for_keyframe = false;
+        }
+        if (frame->deadline == 0 || decoder->received_vid_desc.fps <= 0.0) {
+                return OVERLOAD_NONE;
+        }
+        const double interval_ns = NS_IN_SEC_DBL / decoder->received_vid_desc.fps;
+        const double late_ns = now + o.decompress_ns - frame->deadline;
+        if (late_ns <= OVERLOAD_LATE_FRAMES * interval_ns) {
+                return OVERLOAD_NONE;
+        }
+        if (!is_codec_interframe(codec) || type == FRAME_NONREF) {
+                return OVERLOAD_SKIP_DECODE;
+        }
+        if (type == FRAME_REF && late_ns > OVERLOAD_DROP_REF_FRAMES * interval_ns) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Decoder overloaded (%.0f ms behind), dropping frames until next keyframe.\n",
+                                late_ns / 1000000.0);
+                o.waiting_for_keyframe = true;
+                request_keyframe();
+                return OVERLOAD_SKIP_DECODE;
+        }
+        return OVERLOAD_SKIP_PRESENT;
+}
+
+/**
+ * Returns true if the decoder requested a keyframe since the last call -
+ * the caller (RTP receiver) is supposed to pass the request to the sender.
+ */
+bool video_decoder_keyframe_requested(struct state_video_decoder *decoder)
+{
+        return decoder->overload.keyframe_requested.exchange(false);
+}
+
+ADD_TO_PARAM("decoder-full-reconf",
+                "* decoder-full-reconf\n"
+                "  Rebuild whole decoder on every format change (do not keep configuration\n"
+                "  on FPS/interlacing change nor decompressors on resolution change).\n");
 ADD_TO_PARAM("decoder-drop-policy",
                 "* decoder-drop-policy=blocking|nonblock\n"
                 "  Force specified blocking policy (default nonblock).\n");
@@ -625,15 +907,47 @@ static void *decompress_thread(void *args) {
                 return -1;
         }();
 
+        // keyframe on demand - the sender is asked for a keyframe if the stream
+        // was joined in the middle of a GOP, after a loss of an interframe or if
+        // the decompressor stops producing frames (eg. missing parameter sets)
+        constexpr int KEYFRAME_NO_OUTPUT_FRAMES = 5; ///< more than reordering delay of temporal layers
+        bool keyframe_seen = false;
+        int frames_without_output = 0;
+
         while(1) {
                 unique_ptr<frame_msg> msg = decoder->decompress_queue.pop();
 
                 if(!msg->recv_frame) { // poisoned
                         break;
                 }
+                PROFILE_FUNC;
 
                 auto t0 = std::chrono::high_resolution_clock::now();
                 unique_ptr<char[]> tmp;
+                enum overload_action overload_action = OVERLOAD_NONE;
+
+                // intra-only frames missing the deadline needn't be decompressed at all
+                if (!is_codec_interframe(decoder->received_vid_desc.color_spec)
+                                && display_frame_is_late(decoder->display, msg->recv_frame)) {
+                        goto skip_frame;
+                }
+
+                {
+                        const enum frame_ref_type ref_type = get_frame_ref_type(decoder->received_vid_desc.color_spec, msg->nofec_frame);
+                        if (ref_type == FRAME_KEY) {
+                                keyframe_seen = true;
+                        } else if (!keyframe_seen && ref_type != FRAME_UNKNOWN) {
+                                decoder_request_keyframe(decoder, get_time_in_ns());
+                        }
+                        if (decoder->overload.reference_lost.exchange(false)) {
+                                decoder_request_keyframe(decoder, get_time_in_ns());
+                        }
+                        overload_action = decoder_overload_check(decoder, msg->nofec_frame, ref_type);
+                }
+                if (overload_action == OVERLOAD_SKIP_DECODE) {
+                        decoder->stats.overload_skipped += 1;
+                        goto skip_frame;
+                }
 
                 if (decoder->out_codec == VIDEO_CODEC_END) {
                         tmp = unique_ptr<char[]>(new char[tile_height * (tile_width * MAX_BPS + MAX_PADDING)]);
@@ -677,6 +991,10 @@ static void *decompress_thread(void *args) {
                                         decoder->msg_queue.push(new main_msg_reconfigure(decoder->received_vid_desc, nullptr, true, data[pos].internal_codec));
                                         goto skip_frame;
                                 }
+                                if (data[pos].ret == DECODER_NO_FRAME && is_codec_interframe(decoder->received_vid_desc.color_spec)
+                                                && ++frames_without_output >= KEYFRAME_NO_OUTPUT_FRAMES) {
+                                        decoder_request_keyframe(decoder, get_time_in_ns());
+                                }
                                 if (data[pos].ret != DECODER_GOT_FRAME){
                                         if (data[pos].ret == DECODER_CANT_DECODE){
                                                 if(blacklist_current_out_codec(decoder))
@@ -685,6 +1003,7 @@ static void *decompress_thread(void *args) {
                                         goto skip_frame;
                                 }
                         }
+                        frames_without_output = 0;
                 } else {
                         if (decoder->frame->decoder_overrides_data_len == TRUE) {
                                 for (unsigned int i = 0; i < decoder->frame->tile_count; ++i) {
@@ -693,8 +1012,20 @@ static void *decompress_thread(void *args) {
                         }
                 }
 
-                LOG(LOG_LEVEL_DEBUG) << MOD_NAME << "Decompress duration: " <<
-                        duration_cast<nanoseconds>(high_resolution_clock::now() - t0).count() / 1000000.0 << " ms\n";
+                {
+                        double decompress_ms = duration_cast<nanoseconds>(high_resolution_clock::now() - t0).count() / 1000000.0;
+                        LOG(LOG_LEVEL_DEBUG) << MOD_NAME << "Decompress duration: " << decompress_ms << " ms\n";
+                        metric_observe(decoder_metrics::get().decompress_ms, decompress_ms);
+                        double &ewma = decoder->overload.decompress_ns;
+                        ewma = ewma == 0.0 ? decompress_ms * 1000000.0 : ewma + 0.1 * (decompress_ms * 1000000.0 - ewma);
+                }
+                frame_trace_stamp(&msg->recv_frame->trace, FT_DECOMPRESS_DONE);
+                PROFILE_DETAIL("display");
+
+                if (overload_action == OVERLOAD_SKIP_PRESENT) {
+                        decoder->stats.overload_skipped += 1;
+                        goto skip_frame;
+                }
 
                 if(decoder->change_il) {
                         for(unsigned int i = 0; i < decoder->frame->tile_count; ++i) {
@@ -708,10 +1039,19 @@ static void *decompress_thread(void *args) {
                         int putf_flags = force_putf_flag != -1 ? force_putf_flag : PUTF_NONBLOCK; // originally was BLOCKING when !is_codec_interframe(decoder->received_vid_desc.color_spec)
 
                         decoder->frame->ssrc = msg->nofec_frame->ssrc;
+                        frame_trace_stamp(&msg->recv_frame->trace, FT_DISPLAY_PUT);
+                        decoder->frame->trace = msg->recv_frame->trace;
+                        decoder->frame->deadline = msg->recv_frame->deadline;
                         int ret = display_put_frame(decoder->display,
                                         decoder->frame, putf_flags);
                         if (ret == 0) {
                                 msg->is_displayed = true;
+                                frame_trace_stats_add(decoder->trace_stats, &msg->recv_frame->trace);
+                                const struct frame_trace *tr = &msg->recv_frame->trace;
+                                if (tr->ts[FT_CAPTURE] != 0) {
+                                        metric_observe(decoder_metrics::get().g2g_ms,
+                                                        (tr->ts[FT_DISPLAY_PUT] - tr->ts[FT_CAPTURE]) / 1000000.0);
+                                }
                         }
                         decoder->frame = display_get_frame(decoder->display);
                 }
@@ -769,6 +1109,16 @@ struct state_video_decoder *video_decoder_init(struct module *parent,
                         delete s;
                         return NULL;
                 }
+                // decryption states are not thread-safe, so each worker has its own
+                int threads = get_commandline_param("decrypt-threads") ?
+                        atoi(get_commandline_param("decrypt-threads")) : get_cpu_core_count();
+                for (int i = 1; i < threads; ++i) {
+                        struct openssl_decrypt *d = nullptr;
+                        if (s->dec_funcs->init(&d, encryption) != 0) {
+                                break;
+                        }
+                        s->decrypt_workers.push_back(d);
+                }
         }
 
         decoder_set_video_mode(s, video_mode);
@@ -925,13 +1275,19 @@ void video_decoder_remove_display(struct state_video_decoder *decoder)
         }
 }
 
-static void cleanup(struct state_video_decoder *decoder)
+/**
+ * @param keep_decompress do not destroy decompressors (and keep decoder type),
+ *                        so that they can be reconfigured to a new resolution
+ */
+static void cleanup(struct state_video_decoder *decoder, bool keep_decompress)
 {
-        decoder->decoder_type = UNSET;
-        for (auto &d : decoder->decompress_state) {
-                decompress_done(d);
+        if (!keep_decompress) {
+                decoder->decoder_type = UNSET;
+                for (auto &d : decoder->decompress_state) {
+                        decompress_done(d);
+                }
+                decoder->decompress_state.clear();
         }
-        decoder->decompress_state.clear();
         if(decoder->line_decoder) {
                 free(decoder->line_decoder);
                 decoder->line_decoder = NULL;
@@ -954,6 +1310,9 @@ void video_decoder_destroy(struct state_video_decoder *decoder)
 
         if (decoder->dec_funcs) {
                 decoder->dec_funcs->destroy(decoder->decrypt);
+                for (auto *d : decoder->decrypt_workers) {
+                        decoder->dec_funcs->destroy(d);
+                }
         }
 
         video_decoder_remove_display(decoder);
@@ -968,7 +1327,9 @@ void video_decoder_destroy(struct state_video_decoder *decoder)
 /**
  * Reorders display codecs to match compression internal format.
  *
- * First try to add HW-accelerated codecs, then exactly comp_int_fmt (if
+ * First try to add HW-accelerated and GPU-resident codecs (so that a GPU
+ * decompress can pass the frame to the display without a download), then
+ * exactly comp_int_fmt (if
  * available) and then sort the rest - matching color-space first, higher bit
  * depths first.
  *
@@ -982,7 +1343,7 @@ static vector<pair<codec_t, codec_t>> video_decoder_order_output_codecs(codec_t
         set<codec_t> used;
         // first add hw-accelerated codecs
         for (auto codec : display_codecs) {
-                if (codec_is_hw_accelerated(codec)) {
+                if (codec_is_hw_accelerated(codec) || codec_is_gpu_resident(codec)) {
                         ret.push_back({comp_int_fmt, codec});
                         if (comp_int_fmt != VIDEO_CODEC_NONE) {
                                 ret.push_back({VIDEO_CODEC_NONE, codec});
@@ -1053,12 +1414,14 @@ static vector<pair<codec_t, codec_t>> video_decoder_order_output_codecs(codec_t
  * @param[in]  desc        incoming video description
  * @param[out] decode_line If chosen decoder is a linedecoder, this variable contains the
  *                         decoding function.
+ * @param[out] chain       If chosen decoder is a linedecoder, conversion (possibly in multiple steps)
  * @return                 Output codec, if no decoding function found, -1 is returned.
  */
 static codec_t choose_codec_and_decoder(struct state_video_decoder *decoder, struct video_desc desc,
-                                decoder_t *decode_line, codec_t comp_int_fmt)
+                                decoder_t *decode_line, struct decoder_chain *chain, codec_t comp_int_fmt)
 {
         codec_t out_codec = VIDEO_CODEC_NONE;
+        chain->hops = 0;
 
         /* first check if the codec is natively supported */
         for (auto &codec : decoder->native_codecs) {
@@ -1077,6 +1440,7 @@ static codec_t choose_codec_and_decoder(struct state_video_decoder *decoder, str
                         }
 
                         out_codec = codec;
+                        *chain = { 1, { *decode_line }, { desc.color_spec, out_codec } };
                         goto after_linedecoder_lookup;
                 }
         }
@@ -1084,8 +1448,9 @@ static codec_t choose_codec_and_decoder(struct state_video_decoder *decoder, str
         {
                 vector<codec_t> native_codecs_copy = decoder->native_codecs;
                 native_codecs_copy.push_back(VIDEO_CODEC_NONE); // this needs to be NULL-terminated
-                *decode_line = get_best_decoder_from(desc.color_spec, native_codecs_copy.data(), &out_codec, true);
-                if (*decode_line) {
+                *decode_line = nullptr;
+                if (get_best_decoder_chain_from(desc.color_spec, native_codecs_copy.data(), &out_codec, chain)) {
+                        *decode_line = chain->dec[0];
                         decoder->decoder_type = LINE_DECODER;
                         goto after_linedecoder_lookup;
                 }
@@ -1188,11 +1553,73 @@ static change_il_t select_il_func(enum interlacing_t in_il, enum interlacing_t *
  * @invariant
  * decoder->display != NULL
  */
+/**
+ * @param keep_decompress reuse already initialized decompressors (only
+ *                        decompress_reconfigure() is called with the new
+ *                        format), see @ref can_keep_decompress
+ */
+/// passes metadata to receiver thread (it can tweak parameters)
+static void notify_video_prop_changed(struct state_video_decoder *decoder)
+{
+        struct msg_receiver *msg = (struct msg_receiver *)
+                new_message(sizeof(struct msg_receiver));
+        msg->type = RECEIVER_MSG_VIDEO_PROP_CHANGED;
+        msg->new_desc = decoder->received_vid_desc;
+        struct response *resp =
+                send_message_to_receiver(decoder->mod.parent, (struct message *) msg);
+        free_response(resp);
+}
+
+/**
+ * Applies a format change that doesn't influence decoding - frame rate or
+ * interlacing if it is handled by the same conversion (and display mode) as
+ * before. Decoding pipeline is not flushed, decompressors and display stay
+ * configured as they are.
+ *
+ * @retval true  change applied, no further reconfiguration needed
+ * @retval false full reconfiguration is required
+ */
+static bool reconfigure_decoder_light(struct state_video_decoder *decoder,
+                struct video_desc old_desc, struct video_desc desc)
+{
+        if (decoder->out_codec == VIDEO_CODEC_NONE || decoder->out_codec == VIDEO_CODEC_END
+                        || !video_desc_eq_excl_param(old_desc, desc,
+                                PARAM_TILE_COUNT | PARAM_FPS | PARAM_INTERLACING)) {
+                return false;
+        }
+        if (desc.interlacing != old_desc.interlacing) {
+                enum interlacing_t display_il = PROGRESSIVE;
+                change_il_t change_il = select_il_func(desc.interlacing, decoder->disp_supported_il,
+                                decoder->disp_supported_il_cnt, &display_il);
+                if (change_il != decoder->change_il || display_il != decoder->display_desc.interlacing) {
+                        return false;
+                }
+        }
+        LOG(LOG_LEVEL_VERBOSE) << MOD_NAME << "Format change doesn't affect decoding, keeping current configuration.\n";
+        notify_video_prop_changed(decoder);
+        return true;
+}
+
+/**
+ * Decompressors can be kept over a change of resolution if the compression
+ * stays the same - reinitialization of those (eg. libavcodec, GPUJPEG) is
+ * the costliest part of reconfiguration.
+ */
+static bool can_keep_decompress(struct state_video_decoder *decoder,
+                struct video_desc old_desc, struct video_desc desc, bool force)
+{
+        return !force && decoder->decoder_type == EXTERNAL_DECODER
+                && decoder->out_codec != VIDEO_CODEC_NONE && decoder->out_codec != VIDEO_CODEC_END
+                && old_desc.color_spec == desc.color_spec
+                && decoder->decompress_state.size() == (unsigned) decoder->max_substreams;
+}
+
 static bool reconfigure_decoder(struct state_video_decoder *decoder,
-                struct video_desc desc, codec_t comp_int_fmt)
+                struct video_desc desc, codec_t comp_int_fmt, bool keep_decompress)
 {
         codec_t out_codec;
         decoder_t decode_line;
+        struct decoder_chain chain;
         enum interlacing_t display_il = PROGRESSIVE;
         //struct video_frame *frame;
         int display_requested_pitch = PITCH_DEFAULT;
@@ -1205,12 +1632,19 @@ static bool reconfigure_decoder(struct state_video_decoder *decoder,
         decoder->frame = NULL;
         video_decoder_start_threads(decoder);
 
-        cleanup(decoder);
+        cleanup(decoder, keep_decompress);
 
         desc.tile_count = get_video_mode_tiles_x(decoder->video_mode)
                         * get_video_mode_tiles_y(decoder->video_mode);
 
-        out_codec = choose_codec_and_decoder(decoder, desc, &decode_line, comp_int_fmt);
+        if (keep_decompress) {
+                LOG(LOG_LEVEL_VERBOSE) << MOD_NAME << "Reusing decompressor for the new format.\n";
+                out_codec = decoder->out_codec;
+                decode_line = nullptr;
+                chain.hops = 0;
+        } else {
+                out_codec = choose_codec_and_decoder(decoder, desc, &decode_line, &chain, comp_int_fmt);
+        }
         if (out_codec == VIDEO_CODEC_NONE) {
                 LOG(LOG_LEVEL_ERROR) << "Could not find neither line conversion nor decompress from " <<
                         get_codec_name(desc.color_spec) << " to display supported formats (" << codec_list_to_str(decoder->native_codecs) << ").\n";
@@ -1350,6 +1784,17 @@ static bool reconfigure_decoder(struct state_video_decoder *decoder,
                         }
                         decoder->merged_fb = false;
                 }
+                for (int i = 0; i < src_x_tiles * src_y_tiles; ++i) {
+                        struct line_decoder *out = &decoder->line_decoder[i];
+                        out->chain = chain;
+                        out->direct = out->decode_line == vc_memcpy &&
+                                out->conv_num == out->conv_den &&
+                                out->src_linesize == out->dst_linesize &&
+                                out->dst_linesize == out->dst_pitch;
+                }
+                if (decoder->line_decoder[0].direct) {
+                        LOG(LOG_LEVEL_VERBOSE) << MOD_NAME << "Placing received data directly to the display framebuffer.\n";
+                }
         } else if (decoder->decoder_type == EXTERNAL_DECODER) {
                 int buf_size;
 
@@ -1373,14 +1818,7 @@ static bool reconfigure_decoder(struct state_video_decoder *decoder,
                 decoder->accepts_corrupted_frame = ret && res;
         }
 
-        // Pass metadata to receiver thread (it can tweak parameters)
-        struct msg_receiver *msg = (struct msg_receiver *)
-                new_message(sizeof(struct msg_receiver));
-        msg->type = RECEIVER_MSG_VIDEO_PROP_CHANGED;
-        msg->new_desc = decoder->received_vid_desc;
-        struct response *resp =
-                send_message_to_receiver(decoder->mod.parent, (struct message *) msg);
-        free_response(resp);
+        notify_video_prop_changed(decoder);
 
         if (out_codec != VIDEO_CODEC_END) {
                 decoder->frame = display_get_frame(decoder->display);
@@ -1434,10 +1872,16 @@ static int reconfigure_if_needed(struct state_video_decoder *decoder,
         if(!desc_changed && !force)
                 return FALSE;
 
+        struct video_desc old_desc = decoder->received_vid_desc;
+        bool incremental = get_commandline_param("decoder-full-reconf") == nullptr;
         if (desc_changed) {
                 LOG(LOG_LEVEL_NOTICE) << "[video dec.] New incoming video format detected: " << network_desc << endl;
                 decoder->received_vid_desc = network_desc;
+                if (incremental && !force && reconfigure_decoder_light(decoder, old_desc, network_desc)) {
+                        return FALSE;
+                }
         }
+        bool keep_decompress = incremental && can_keep_decompress(decoder, old_desc, network_desc, force);
 
         if(force){
                 log_msg(LOG_LEVEL_VERBOSE, "forced reconf\n");
@@ -1448,7 +1892,7 @@ static int reconfigure_if_needed(struct state_video_decoder *decoder,
         decoder->reconfiguration_future = std::async(std::launch::async,
                         [decoder](){ return reconfigure_decoder(decoder, decoder->received_vid_desc); });
 #else
-        int ret = reconfigure_decoder(decoder, decoder->received_vid_desc, comp_int_fmt);
+        int ret = reconfigure_decoder(decoder, decoder->received_vid_desc, comp_int_fmt, keep_decompress);
         if (!ret) {
                 log_msg(LOG_LEVEL_ERROR, "[video dec.] Reconfiguration failed!!!\n");
                 decoder->frame = NULL;
@@ -1477,6 +1921,94 @@ static int check_for_mode_change(struct state_video_decoder *decoder,
 #define ERROR_GOTO_CLEANUP ret = FALSE; goto cleanup;
 #define max(a, b)       (((a) > (b))? (a): (b))
 
+#define MIN_DECRYPT_PACKETS_PER_THREAD 64
+
+/**
+ * Locates ciphertext of an encrypted video packet.
+ * @retval false  packet is not encrypted or uses unknown cipher mode
+ */
+static bool get_video_ciphertext(rtp_packet *pckt, char **data, int *len,
+                int *aad_len, enum openssl_mode *mode)
+{
+        if (!PT_VIDEO_IS_ENCRYPTED(pckt->pt)) {
+                return false;
+        }
+        size_t media_hdr_len = pckt->pt == PT_ENCRYPT_VIDEO ? sizeof(video_payload_hdr_t) : sizeof(fec_payload_hdr_t);
+        *aad_len = media_hdr_len;
+        *len = pckt->data_len - sizeof(crypto_payload_hdr_t) - media_hdr_len;
+        *data = pckt->data + sizeof(crypto_payload_hdr_t) + media_hdr_len;
+        uint32_t crypto_hdr = ntohl(*(uint32_t *)(void *)(pckt->data + media_hdr_len));
+        *mode = (enum openssl_mode) (crypto_hdr >> 24);
+        return *mode != MODE_AES128_NONE && *mode <= MODE_AES128_MAX;
+}
+
+struct decrypted_packet {
+        rtp_packet *pckt;
+        size_t out_off; ///< offset of plaintext in state_video_decoder::decrypt_buf
+        int len;        ///< plaintext length, 0 if the packet was rejected
+};
+
+struct decrypt_task {
+        struct state_video_decoder *decoder;
+        struct openssl_decrypt *state;
+        struct decrypted_packet *pkts;
+        int count;
+};
+
+static void *decrypt_worker(void *arg)
+{
+        auto *t = (struct decrypt_task *) arg;
+        for (int i = 0; i < t->count; ++i) {
+                struct decrypted_packet *p = &t->pkts[i];
+                char *data;
+                int len, aad_len;
+                enum openssl_mode mode;
+                if (!get_video_ciphertext(p->pckt, &data, &len, &aad_len, &mode)) {
+                        continue;
+                }
+                p->len = t->decoder->dec_funcs->decrypt(t->state, data, len,
+                                p->pckt->data, aad_len,
+                                t->decoder->decrypt_buf.data() + p->out_off, mode);
+        }
+        return NULL;
+}
+
+/**
+ * Decrypts all packets of a frame across worker threads ahead of decoding, so
+ * that decryption doesn't slow down the single-threaded copy to framebuffer.
+ * @returns decrypted packets in order of cdata, empty if decrypting in parallel
+ *          isn't worth it (the packets are then decrypted inline)
+ */
+static vector<decrypted_packet> decrypt_frame_parallel(struct state_video_decoder *decoder,
+                struct coded_data *cdata)
+{
+        vector<decrypted_packet> pkts;
+        size_t total = 0;
+        for (auto *it = cdata; it != NULL; it = it->nxt) {
+                pkts.push_back({it->data, total, 0});
+                total += it->data->data_len;
+        }
+        int threads = std::min<int>(decoder->decrypt_workers.size() + 1,
+                        pkts.size() / MIN_DECRYPT_PACKETS_PER_THREAD);
+        if (threads <= 1) {
+                pkts.clear();
+                return pkts;
+        }
+        if (decoder->decrypt_buf.size() < total) {
+                decoder->decrypt_buf.resize(total);
+        }
+
+        vector<decrypt_task> tasks(threads);
+        for (int i = 0; i < threads; ++i) {
+                size_t first = pkts.size() * i / threads;
+                size_t last = pkts.size() * (i + 1) / threads;
+                tasks[i] = { decoder, i == 0 ? decoder->decrypt : decoder->decrypt_workers[i - 1],
+                        pkts.data() + first, (int) (last - first) };
+        }
+        task_run_parallel(decrypt_worker, threads, tasks.data(), sizeof tasks[0], NULL);
+        return pkts;
+}
+
 /**
  * @brief Decodes a participant buffer representing one video frame.
  * @param cdata        PBUF buffer
@@ -1488,6 +2020,7 @@ static int check_for_mode_change(struct state_video_decoder *decoder,
  */
 int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf_stats *stats)
 {
+        PROFILE_FUNC;
         struct vcodec_state *pbuf_data = (struct vcodec_state *) decoder_data;
         struct state_video_decoder *decoder = pbuf_data->decoder;
 
@@ -1511,6 +2044,9 @@ int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf
         int buffer_length = 0;
         int pt = 0;
         bool buffer_swapped = false;
+        vector<decrypted_packet> decrypted;
+        int pckt_idx = 0;
+        const time_ns_t pbuf_complete = get_time_in_ns();
 
         // We have no framebuffer assigned, exitting
         if(!decoder->display) {
@@ -1554,6 +2090,10 @@ int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf
                 delete msg_reconf;
         }
 
+        if (decoder->decrypt) {
+                decrypted = decrypt_frame_parallel(decoder, cdata);
+        }
+
         while (cdata != NULL) {
                 uint32_t tmp;
                 uint32_t *hdr;
@@ -1574,6 +2114,9 @@ int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf
                 buffer_number = tmp & 0x3fffff;
                 buffer_length = ntohl(hdr[2]);
                 ssrc = pckt->ssrc;
+                if (pckt->m && pckt->extn != NULL) {
+                        frame_trace_read_extn(pckt->extn, &frame->trace);
+                }
 
                 if (PT_VIDEO_HAS_FEC(pt)) {
                         tmp = ntohl(hdr[3]);
@@ -1609,12 +2152,8 @@ int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf
                 case PT_ENCRYPT_VIDEO_LDGM:
                 case PT_ENCRYPT_VIDEO_RS:
                         {
-				size_t media_hdr_len = pt == PT_ENCRYPT_VIDEO ? sizeof(video_payload_hdr_t) : sizeof(fec_payload_hdr_t);
-                                len = pckt->data_len - sizeof(crypto_payload_hdr_t) - media_hdr_len;
-				data = (char *) hdr + sizeof(crypto_payload_hdr_t) + media_hdr_len;
-                                uint32_t crypto_hdr = ntohl(*(uint32_t *)(void *)((char *) hdr + media_hdr_len));
-                                crypto_mode = (enum openssl_mode) (crypto_hdr >> 24);
-				if (crypto_mode == MODE_AES128_NONE || crypto_mode > MODE_AES128_MAX) {
+                                int aad_len;
+                                if (!get_video_ciphertext(pckt, &data, &len, &aad_len, &crypto_mode)) {
 					log_msg(LOG_LEVEL_WARNING, "Unknown cipher mode: %d\n", (int) crypto_mode);
 					ret = FALSE;
 					goto cleanup;
@@ -1653,19 +2192,26 @@ int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf
                         goto cleanup;
                 }
 
-                char plaintext[len]; // will be actually shorter
+                char plaintext[decrypted.empty() ? len : 1]; // will be actually shorter
                 if (PT_VIDEO_IS_ENCRYPTED(pt)) {
                         int data_len;
 
-                        if((data_len = decoder->dec_funcs->decrypt(decoder->decrypt,
-                                        data, len,
-                                        (char *) hdr, pt == PT_ENCRYPT_VIDEO ?
-                                        sizeof(video_payload_hdr_t) : sizeof(fec_payload_hdr_t),
-                                        plaintext, crypto_mode)) == 0) {
+                        if (!decrypted.empty()) { // already decrypted by decrypt_frame_parallel()
+                                assert(decrypted[pckt_idx].pckt == pckt);
+                                data_len = decrypted[pckt_idx].len;
+                                data = decoder->decrypt_buf.data() + decrypted[pckt_idx].out_off;
+                        } else {
+                                data_len = decoder->dec_funcs->decrypt(decoder->decrypt,
+                                                data, len,
+                                                (char *) hdr, pt == PT_ENCRYPT_VIDEO ?
+                                                sizeof(video_payload_hdr_t) : sizeof(fec_payload_hdr_t),
+                                                plaintext, crypto_mode);
+                                data = (char *) plaintext;
+                        }
+                        if (data_len == 0) {
                                 LOG(LOG_LEVEL_WARNING) << MOD_NAME << "Warning: Packet dropped AES - wrong CRC!\n";
                                 goto next_packet;
                         }
-                        data = (char *) plaintext;
                         len = data_len;
                 }
 
@@ -1733,6 +2279,20 @@ int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf
                         /* pointer to data payload in packet */
                         source = (unsigned char*)(data);
 
+                        /* same layout on both sides - place the whole packet at once */
+                        if (line_decoder->direct) {
+                                if (line_decoder->base_offset + data_pos + len <= tile->data_len) {
+                                        memcpy(tile->data + line_decoder->base_offset + data_pos, source, len);
+                                } else {
+                                        if((prints % 100) == 0) {
+                                                log_msg(LOG_LEVEL_ERROR, "WARNING!! Discarding input data as frame buffer is too small.\n"
+                                                                "Well this should not happened. Expect troubles pretty soon.\n");
+                                        }
+                                        prints++;
+                                }
+                                len = 0;
+                        }
+
                         /* copy whole packet that can span several lines.
                          * we need to clip data (v210 case) or center data (RGBA, R10k cases)
                          */
@@ -1758,9 +2318,7 @@ int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf
                                          * we have offset for destination
                                          * we update source contiguously
                                          * we pass {r,g,b}shifts */
-                                        line_decoder->decode_line((unsigned char*)tile->data + line_decoder->base_offset + offset, source, l,
-                                                        line_decoder->shifts[0], line_decoder->shifts[1],
-                                                        line_decoder->shifts[2]);
+                                        line_decoder_decode(line_decoder, (unsigned char*)tile->data + line_decoder->base_offset + offset, source, l);
                                         /* we decoded one line (or a part of one line) to the end of the line
                                          * so decrease *source* len by 1 line (or that part of the line */
                                         len -= line_decoder->src_linesize - s_x;
@@ -1802,6 +2360,7 @@ int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf
 
 next_packet:
                 cdata = cdata->nxt;
+                pckt_idx++;
         }
 
         if(!pckt) {
@@ -1851,8 +2410,14 @@ next_packet:
                 fec_msg->pckt_list = std::move(pckt_list);
                 fec_msg->received_pkts_cum = stats->received_pkts_cum;
                 fec_msg->expected_pkts_cum = stats->expected_pkts_cum;
+                fec_msg->recv_frame->trace.ts[FT_RX_FIRST] = stats->first_arrival;
+                fec_msg->recv_frame->trace.ts[FT_RX_LAST] = stats->last_arrival;
+                fec_msg->recv_frame->trace.ts[FT_PBUF_COMPLETE] = pbuf_complete;
+                fec_msg->recv_frame->deadline = stats->deadline;
+                fec_msg->account_recv_frame();
 
                 auto t0 = std::chrono::high_resolution_clock::now();
+                PROFILE_DETAIL("wait for FEC");
                 decoder->fec_queue.push(move(fec_msg));
                 auto t1 = std::chrono::high_resolution_clock::now();
                 double tpf = 1.0 / decoder->display_desc.fps;
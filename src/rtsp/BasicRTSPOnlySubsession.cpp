@@ -47,8 +47,13 @@
 #include <RTSPServer.hh>
 #include <GroupsockHelper.hh>
 
+#include "host.h"
 #include "messaging.h"
 
+ADD_TO_PARAM("rtsp-shared", "* rtsp-shared\n"
+		"  RTSP server serves any number of video clients simultaneously from one\n"
+		"  encoded and packetized stream (clients may also request multicast)\n");
+
 BasicRTSPOnlySubsession*
 BasicRTSPOnlySubsession::createNew(UsageEnvironment& env,
 		Boolean reuseFirstSource, struct module *mod, rtps_types_t avType,
@@ -88,11 +93,39 @@ char const* BasicRTSPOnlySubsession::sdpLines() {
 	if (fSDPLines == NULL) {
 		setSDPLines();
 	}
+	if (isShared()) {
+		return fSDPLines;
+	}
 	if (Adestination != NULL || Vdestination != NULL)
 		return NULL;
 	return fSDPLines;
 }
 
+/**
+ * In shared mode every video client is an additional receiver (fan-out) of
+ * the sender, audio still serves only the first client.
+ */
+bool BasicRTSPOnlySubsession::isShared() const {
+	return (avType == video || avType == av)
+		&& get_commandline_param("rtsp-shared") != NULL;
+}
+
+void BasicRTSPOnlySubsession::sendFanoutMessage(enum msg_sender_type type,
+		Destinations const& dest) {
+	char path[1024] = "";
+	enum module_class path_sender[] = { MODULE_CLASS_SENDER,
+			MODULE_CLASS_NONE };
+	append_message_path(path, sizeof(path), path_sender);
+
+	struct msg_sender *msg = (struct msg_sender *) new_message(
+			sizeof(struct msg_sender));
+	strncpy(msg->fanout.addr, inet_ntoa(dest.addr),
+			sizeof(msg->fanout.addr) - 1);
+	msg->fanout.port = ntohs(dest.rtpPort.num());
+	msg->type = type;
+	free_response(send_message(fmod, path, (struct message *) msg));
+}
+
 void BasicRTSPOnlySubsession::setSDPLines() {
 	//TODO: should be more dynamic
 	//VStream
@@ -179,13 +212,35 @@ void BasicRTSPOnlySubsession::setSDPLines() {
 	}
 }
 
-void BasicRTSPOnlySubsession::getStreamParameters(unsigned /* clientSessionId */,
+void BasicRTSPOnlySubsession::getStreamParameters(unsigned clientSessionId,
 		netAddressBits clientAddress, Port const& clientRTPPort,
 		Port const& clientRTCPPort, int /* tcpSocketNum */,
 		unsigned char /* rtpChannelId */, unsigned char /* rtcpChannelId */,
 		netAddressBits& destinationAddress, uint8_t& /*destinationTTL*/,
-		Boolean& /* isMulticast */, Port& serverRTPPort, Port& serverRTCPPort,
+		Boolean& isMulticast, Port& serverRTPPort, Port& serverRTCPPort,
 		void*& /* streamToken */) {
+	if (isShared()) {
+		serverRTPPort = Port(rtp_port);
+		serverRTCPPort = Port(rtp_port + 1);
+		if (fSDPLines == NULL) {
+			setSDPLines();
+		}
+		struct in_addr destinationAddr;
+		Port destinationPort = clientRTPPort;
+		// a client-chosen destination is honored only for a multicast group,
+		// which is then shared by all clients requesting it (on our port)
+		if (destinationAddress != 0 && IN_MULTICAST(ntohl(destinationAddress))) {
+			isMulticast = True;
+			destinationPort = serverRTPPort;
+		} else {
+			destinationAddress = clientAddress;
+		}
+		destinationAddr.s_addr = destinationAddress;
+		fSharedClients.erase(clientSessionId);
+		fSharedClients.emplace(clientSessionId, SharedClient{
+				Destinations(destinationAddr, destinationPort, clientRTCPPort), false});
+		return;
+	}
 	if (Vdestination == NULL && (avType == video || avType == av)) {
 		Port rtp(rtp_port);
 		serverRTPPort = rtp;
@@ -222,7 +277,7 @@ void BasicRTSPOnlySubsession::getStreamParameters(unsigned /* clientSessionId */
 	}
 }
 
-void BasicRTSPOnlySubsession::startStream(unsigned /* clientSessionId */,
+void BasicRTSPOnlySubsession::startStream(unsigned clientSessionId,
 		void* /* streamToken */, TaskFunc* /* rtcpRRHandler */,
 		void* /* rtcpRRHandlerClientData */, unsigned short& /* rtpSeqNum */,
 		unsigned& /* rtpTimestamp */,
@@ -230,6 +285,15 @@ void BasicRTSPOnlySubsession::startStream(unsigned /* clientSessionId */,
 		void* /* serverRequestAlternativeByteHandlerClientData */) {
 	struct response *resp = NULL;
 
+	if (isShared()) {
+		auto it = fSharedClients.find(clientSessionId);
+		if (it != fSharedClients.end() && !it->second.started) {
+			sendFanoutMessage(SENDER_MSG_ADD_FANOUT, it->second.dest);
+			it->second.started = true;
+		}
+		return;
+	}
+
 	if (Vdestination != NULL) {
 		if (avType == video || avType == av) {
 			char pathV[1024];
@@ -291,8 +355,18 @@ void BasicRTSPOnlySubsession::startStream(unsigned /* clientSessionId */,
 	}
 }
 
-void BasicRTSPOnlySubsession::deleteStream(unsigned /* clientSessionId */,
+void BasicRTSPOnlySubsession::deleteStream(unsigned clientSessionId,
 		void*& /* streamToken */) {
+	if (isShared()) {
+		auto it = fSharedClients.find(clientSessionId);
+		if (it != fSharedClients.end()) {
+			if (it->second.started) {
+				sendFanoutMessage(SENDER_MSG_REMOVE_FANOUT, it->second.dest);
+			}
+			fSharedClients.erase(it);
+		}
+		return;
+	}
 	if (Vdestination != NULL) {
 		if (avType == video || avType == av) {
 			char pathV[1024];
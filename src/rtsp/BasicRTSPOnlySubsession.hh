@@ -48,6 +48,8 @@
 #include <ServerMediaSession.hh>
 #endif
 
+#include <map>
+
 #include "rtsp/rtsp_utils.h"
 #include "audio/types.h"
 #include "module.h"
@@ -133,9 +135,18 @@ protected:
     Destinations* Vdestination;
     Destinations* Adestination;
 
+    /// video clients in shared mode (--param rtsp-shared), by clientSessionId
+    struct SharedClient {
+        Destinations dest;
+        bool started;
+    };
+    std::map<unsigned, SharedClient> fSharedClients;
+
 private:
 
     void setSDPLines();
+    bool isShared() const;
+    void sendFanoutMessage(enum msg_sender_type type, Destinations const& dest);
 
     MAYBE_UNUSED_ATTRIBUTE Boolean fReuseFirstSource;
     MAYBE_UNUSED_ATTRIBUTE void* fLastStreamToken;
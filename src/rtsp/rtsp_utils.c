@@ -42,6 +42,7 @@ int get_rtsp_server_port(const char *cconfig){
 void rtps_server_usage(){
         printf("\n[RTSP SERVER] usage:\n");
         printf("\t--rtsp-server[=port:number]\n");
-        printf("\t\tdefault rtsp server port number: 8554\n\n");
+        printf("\t\tdefault rtsp server port number: 8554\n");
+        printf("\tuse \"--param rtsp-shared\" to serve multiple video clients at once\n\n");
 }
 
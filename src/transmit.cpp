@@ -75,16 +75,24 @@
 #include "rtp/fec.h"
 #include "rtp/rtp.h"
 #include "rtp/rtp_callback.h"
+#include "rtp/rtpdec_h264.h" // RTP_* NAL types
 #include "rtp/rtpenc_h264.h"
 #include "tv.h"
 #include "transmit.h"
+#include "utils/frame_trace.h"
 #include "utils/jpeg_reader.h"
+#include "utils/macros.h" // TOSTRING
+#include "utils/metrics.h"
 #include "utils/misc.h" // unit_evaluate
+#include "utils/profile_timer.hpp"
+#include "utils/ptp_clock.h"
+#include "utils/worker.h"
 #include "video.h"
 #include "video_codec.h"
 
 #include <algorithm>
 #include <array>
+#include <iterator>
 #include <iostream>
 #include <vector>
 
@@ -108,16 +116,23 @@
 
 #define DEFAULT_CIPHER_MODE MODE_AES128_CFB
 
+#ifdef HAVE_SENDMMSG
+#define DEFAULT_TX_MAX_BURST 32 ///< max packets submitted at once (sendmmsg)
+#else
+#define DEFAULT_TX_MAX_BURST 1
+#endif
+#define TX_MAX_BURST_DURATION_NS 100'000 ///< max duration of a paced burst
+
 using std::array;
 using std::vector;
 
-static void tx_update(struct tx *tx, struct video_frame *frame, int substream);
+static void tx_update(struct tx *tx, struct tx_tile_ctx *ctx, struct video_frame *frame, int substream);
 static void tx_done(struct module *tx);
 static uint32_t format_interl_fps_hdr_row(enum interlacing_t interlacing, double input_fps);
 
 static void
-tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
-                uint32_t ts, int send_m,
+tx_send_base(struct tx *tx, struct tx_tile_ctx *ctx, struct video_frame *frame, struct rtp **rtp_sessions,
+                int session_count, uint32_t ts, int send_m,
                 unsigned int substream,
                 int fragment_offset);
 
@@ -131,6 +146,140 @@ struct rate_limit_dyn {
         static constexpr int EXCESS_GAP = 4; ///< minimal gap between excessive frames
 };
 
+/**
+ * Sender congestion control used with @ref RATE_CC, driven by RTCP receiver
+ * reports.
+ *
+ * Follows the loss-based controller of the GCC sender - rate is decreased
+ * proportionally when more than 10 % of packets is lost and increased
+ * multiplicatively when the loss is below 2 %. The target is capped to 1.5x
+ * the rate actually sent so that it doesn't grow unboundedly while the
+ * compression doesn't use it.
+ *
+ * RTT is not used as a congestion signal since RTCP is processed between
+ * frames so that it also contains the sender latency (which grows when the
+ * rate is too low for the stream, eg. an uncompressed one).
+ */
+struct congestion_ctl {
+        long long rate;          ///< current target rate [bps]
+        long long min_rate;
+        long long max_rate;
+        uint32_t report_count;   ///< RTCP reports already processed (rtp_get_tx_feedback())
+        uint64_t last_bytes_sent; ///< to compute the actual send rate between reports
+        time_ns_t last_report_time;
+        long long compress_rate; ///< rate last passed to the compression
+        time_ns_t last_compress_update;
+
+        static constexpr double LOSS_HIGH = 0.10;
+        static constexpr double LOSS_LOW = 0.02;
+        static constexpr double INCREASE = 1.08;
+        static constexpr double MAX_OVER_ACTUAL = 1.5; ///< target is capped to 1.5x real send rate (as in GCC)
+        static constexpr double COMPRESS_RATE_FRACTION = 0.9; ///< leave headroom for FEC and headers
+        static constexpr double COMPRESS_UPDATE_THRESHOLD = 0.1; ///< min relative change to reconfigure
+        static constexpr time_ns_t COMPRESS_UPDATE_INTERVAL = 2 * NS_IN_SEC;
+};
+
+/**
+ * Automatic FEC (-f auto) driven by RTCP receiver reports.
+ *
+ * LDGM redundancy is chosen as the smallest of LEVELS covering MARGIN times
+ * the smoothed packet loss reported by the receiver, so that the loss
+ * remaining after the recovery (even for bursts) stays below the target.
+ * FEC is turned off while the reported loss is below the target. The loss
+ * estimate rises immediately but decays slowly and the redundancy is
+ * decreased at most once per RELEASE_INTERVAL to avoid oscillation.
+ */
+struct fec_ctl {
+        bool enabled;
+        double target;           ///< tolerated residual loss [%]
+        uint32_t report_count;   ///< RTCP reports already processed (rtp_get_tx_feedback())
+        double loss;             ///< smoothed reported loss [%]
+        double level;            ///< LDGM loss currently configured [%], 0 if FEC is off
+        time_ns_t last_change;
+
+        static constexpr double LEVELS[] = { 1, 2, 3, 5, 8, 12, 20, 30, 50 }; ///< LDGM loss levels [%]
+        static constexpr double MARGIN = 2.0;
+        static constexpr double DECAY = 0.2; ///< weight of the new report when the loss decreases
+        static constexpr double DEFAULT_TARGET = 0.1;
+        static constexpr time_ns_t RELEASE_INTERVAL = 10 * NS_IN_SEC;
+};
+
+/**
+ * Packetization of video tiles cached between frames (tx_send_base()).
+ *
+ * Packet lengths (and their end offsets) and the payload header template
+ * depend only on the frame properties, FEC parameters and MTU so they are
+ * computed once and only extended when a longer tile arrives. Per-packet
+ * headers are also kept, only fields that differ between frames (buffer
+ * index, length and offset) are rewritten for every packet.
+ *
+ * The plan is dropped by tx_update() when the frame properties change.
+ */
+struct tx_pkt_plan {
+        bool valid;
+        // key
+        unsigned width, height;
+        codec_t color_spec;
+        enum interlacing_t interlacing;
+        double fps;
+        struct fec_desc fec;
+        int mtu;              ///< payload size (tx->mtu - headers)
+        bool encryption;
+
+        int *lens;            ///< packet payload lengths
+        unsigned *ends;       ///< end offset of the packet payload in tile
+        size_t count;
+        size_t alloc;
+        int fec_symbol_offset; ///< get_video_pkt_len() state to continue the plan
+
+        uint32_t hdr[100];    ///< payload header template
+        int hdr_len;
+        uint32_t *headers;    ///< per-packet headers, initialized from hdr
+        size_t headers_count;
+};
+
+/**
+ * Path MTU discovery (--param tx-mtu-discovery) with in-band probes.
+ *
+ * Padded RTP probes with Don't Fragment set are sent between frames and
+ * acknowledged by the receiver in RTCP (rtp_send_mtu_probe()). The MTU is
+ * bisected between the verified one and the ceiling; the MTU given by the
+ * user (-m) is assumed to be always safe. The search is repeated every
+ * RESEARCH_INTERVAL, starting with verification of the current MTU, so that
+ * the MTU is lowered when the path changes.
+ */
+struct pmtu_ctl {
+        bool enabled;
+        int floor;            ///< MTU given by the user
+        int ceiling;          ///< largest MTU probed
+        int lo;               ///< verified MTU
+        int hi;               ///< smallest MTU known not to pass minus one
+        int probe;            ///< MTU being probed, 0 if none
+        int attempts;         ///< probes sent for the current MTU
+        time_ns_t probe_time; ///< last probe sent
+        time_ns_t round_start;
+        uint32_t ack_count;   ///< acks already processed (rtp_get_mtu_ack())
+
+        static constexpr int MAX_ATTEMPTS = 3; ///< probe considered lost after that many attempts (not only congestion)
+        static constexpr int GRANULARITY = 32;
+        static constexpr time_ns_t PROBE_TIMEOUT = NS_IN_SEC / 2;
+        static constexpr time_ns_t RESEARCH_INTERVAL = 60 * NS_IN_SEC;
+};
+
+/**
+ * Sender state kept for every tile sent in parallel (see tx_send_tiles()),
+ * sequential send uses the first one.
+ */
+struct tx_tile_ctx {
+        bool parallel;       ///< sent concurrently with other tiles
+        unsigned buffer;     ///< buffer ID of the tile
+        struct tx_pkt_plan pkt_plan;
+        struct rate_limit_dyn dyn_rate_limit_state;
+        char *enc_buffer; ///< ciphertexts of a frame kept until async send finishes
+        size_t enc_buffer_len;
+};
+enum { TX_MAX_PARALLEL_TILES = 16 };
+
 struct tx {
         struct module mod;
 
@@ -154,17 +303,62 @@ struct tx {
 
         const struct openssl_encrypt_info *enc_funcs;
         struct openssl_encrypt *encryption;
+        enum openssl_mode enc_mode;
+        char *pack_buffer; ///< packed audio packets kept until async send finishes
+        size_t pack_buffer_len;
+        struct h26x_nal *h26x_nals; ///< NAL units of the currently sent H.264/HEVC frame
+        size_t h26x_nals_len;
+        struct h26x_packet *h26x_packets; ///< packets planned for the currently sent H.264/HEVC frame
+        size_t h26x_packets_len;
+        char *h26x_agg_buffer; ///< STAP-A/AP packets kept until async send finishes
+        size_t h26x_agg_buffer_len;
+        uint32_t (*jpeg_hdrs)[3]; ///< RTP/JPEG main + restart headers kept until async send finishes
+        size_t jpeg_hdrs_len;
         long long int bitrate;
-        struct rate_limit_dyn dyn_rate_limit_state;
+        struct congestion_ctl cc;
+        struct fec_ctl fec_ctl;
+        struct pmtu_ctl pmtu;
+        struct tx_tile_ctx tiles[TX_MAX_PARALLEL_TILES]; ///< per-tile sender state
+        uint32_t keyframe_req_count; ///< keyframe requests already processed (rtp_get_keyframe_request())
+        time_ns_t last_keyframe_req; ///< time of the last keyframe request passed to the compression
+        bool kernel_pacing; ///< use SO_TXTIME pacing instead of waiting in the send loop
 		
         char tmp_packet[RTP_MAX_MTU];
 };
 
-static void tx_update(struct tx *tx, struct video_frame *frame, int substream)
+/**
+ * Configures LDGM for tx->max_loss and given average frame length.
+ */
+static void tx_set_ldgm_percents(struct tx *tx, int avg_len)
+{
+        int data_len = tx->mtu -  (40 + (sizeof(fec_payload_hdr_t)));
+        data_len = (data_len / 48) * 48;
+
+        struct msg_sender *msg = (struct msg_sender *)
+                new_message(sizeof(struct msg_sender));
+        snprintf(msg->fec_cfg, sizeof(msg->fec_cfg), "LDGM percents %d %d %f",
+                        data_len, avg_len, tx->max_loss);
+        msg->type = SENDER_MSG_CHANGE_FEC;
+        struct response *resp = send_message_to_receiver(get_parent_module(&tx->mod),
+                        (struct message *) msg);
+        free_response(resp);
+        tx->avg_len_last = avg_len;
+}
+
+static void tx_update(struct tx *tx, struct tx_tile_ctx *ctx, struct video_frame *frame, int substream)
 {
         if(!frame) {
                 return;
         }
+
+        struct tx_pkt_plan *plan = &ctx->pkt_plan;
+        const struct tile *tile = &frame->tiles[substream];
+        if (plan->valid && (plan->width != tile->width || plan->height != tile->height ||
+                                plan->color_spec != frame->color_spec ||
+                                plan->interlacing != frame->interlacing || plan->fps != frame->fps ||
+                                memcmp(&plan->fec, &frame->fec_params, sizeof plan->fec) != 0)) {
+                plan->valid = false;
+        }
         
         uint64_t tmp_avg = tx->avg_len * tx->sent_frames + frame->tiles[substream].data_len *
                 (frame->fec_params.type != FEC_NONE ?
@@ -175,19 +369,7 @@ static void tx_update(struct tx *tx, struct video_frame *frame, int substream)
         if(tx->sent_frames >= 100) {
                 if(tx->fec_scheme == FEC_LDGM && tx->max_loss > 0.0) {
                         if(abs(tx->avg_len_last - tx->avg_len) > tx->avg_len / 3) {
-                                int data_len = tx->mtu -  (40 + (sizeof(fec_payload_hdr_t)));
-                                data_len = (data_len / 48) * 48;
-                                //void *fec_state_old = tx->fec_state;
-
-                                struct msg_sender *msg = (struct msg_sender *)
-                                        new_message(sizeof(struct msg_sender));
-                                snprintf(msg->fec_cfg, sizeof(msg->fec_cfg), "LDGM percents %d %d %f",
-                                                data_len, tx->avg_len, tx->max_loss);
-                                msg->type = SENDER_MSG_CHANGE_FEC;
-                                struct response *resp = send_message_to_receiver(get_parent_module(&tx->mod),
-                                                (struct message *) msg);
-                                free_response(resp);
-                                tx->avg_len_last = tx->avg_len;
+                                tx_set_ldgm_percents(tx, tx->avg_len);
                         }
                 }
                 tx->avg_len = 0;
@@ -195,6 +377,253 @@ static void tx_update(struct tx *tx, struct video_frame *frame, int substream)
         }
 }
 
+ADD_TO_PARAM("tx-cc-start", "* tx-cc-start=<bps>\n"
+                "  Initial rate of congestion control (-l cc, default 10M)\n");
+ADD_TO_PARAM("tx-cc-min", "* tx-cc-min=<bps>\n"
+                "  Minimal rate of congestion control (-l cc, default 1M)\n");
+ADD_TO_PARAM("tx-cc-max", "* tx-cc-max=<bps>\n"
+                "  Maximal rate of congestion control (-l cc, default 1G)\n");
+static void cc_init(struct congestion_ctl *cc)
+{
+        auto param = [](const char *name, long long default_val) {
+                const char *val = get_commandline_param(name);
+                long long ret = val ? unit_evaluate(val) : default_val;
+                return ret > 0 ? ret : default_val;
+        };
+        cc->min_rate = param("tx-cc-min", 1000'000);
+        cc->max_rate = std::max(param("tx-cc-max", 1000'000'000), cc->min_rate);
+        cc->rate = std::clamp(param("tx-cc-start", 10'000'000), cc->min_rate, cc->max_rate);
+        LOG(LOG_LEVEL_INFO) << "[Transmit] Congestion control initial rate " << format_in_si_units(cc->rate) << "bps.\n";
+}
+
+/**
+ * Updates congestion control state from new RTCP feedback (if any) and
+ * propagates the new rate to the compression.
+ */
+static void cc_update(struct tx *tx, struct rtp *rtp_session)
+{
+        struct congestion_ctl *cc = &tx->cc;
+        uint8_t fract_lost = 0;
+        uint32_t rtt_us = 0;
+        if (!rtp_get_tx_feedback(rtp_session, &cc->report_count, &fract_lost, &rtt_us)) {
+                return;
+        }
+
+        double loss = fract_lost / 256.0;
+        double new_rate = cc->rate;
+        if (loss > cc->LOSS_HIGH) {
+                new_rate *= 1.0 - 0.5 * loss;
+        } else if (loss < cc->LOSS_LOW) {
+                new_rate *= cc->INCREASE;
+        }
+        time_ns_t now = get_time_in_ns();
+        uint64_t bytes_sent = rtp_get_bytes_sent(rtp_session);
+        if (cc->last_report_time != 0 && now > cc->last_report_time) {
+                double actual_rate = (bytes_sent - cc->last_bytes_sent) * 8.0 * NS_IN_SEC / (now - cc->last_report_time);
+                new_rate = std::min(new_rate, cc->MAX_OVER_ACTUAL * actual_rate);
+        }
+        cc->last_bytes_sent = bytes_sent;
+        cc->last_report_time = now;
+        cc->rate = std::clamp((long long) new_rate, cc->min_rate, cc->max_rate);
+        LOG(LOG_LEVEL_VERBOSE) << "[Transmit] Congestion control: loss " << loss * 100.0 << " %, RTT "
+                << rtt_us << " us, rate " << format_in_si_units(cc->rate) << "bps\n";
+
+        if (tx->media_type != TX_MEDIA_VIDEO) {
+                return;
+        }
+        long long compress_rate = cc->rate * cc->COMPRESS_RATE_FRACTION / tx->mult_count;
+        if (std::abs(compress_rate - cc->compress_rate) < cc->compress_rate * cc->COMPRESS_UPDATE_THRESHOLD ||
+                        now - cc->last_compress_update < cc->COMPRESS_UPDATE_INTERVAL) {
+                return;
+        }
+        auto *msg = (struct msg_change_compress_data *)
+                new_message(sizeof(struct msg_change_compress_data));
+        msg->what = CHANGE_PARAMS;
+        snprintf(msg->config_string, sizeof msg->config_string, "bitrate=%lld", compress_rate);
+        struct response *resp = send_message(get_parent_module(&tx->mod), "compress", (struct message *) msg);
+        free_response(resp);
+        cc->compress_rate = compress_rate;
+        cc->last_compress_update = now;
+}
+
+/**
+ * Updates automatic FEC from new RTCP feedback (if any), see @ref fec_ctl.
+ */
+static void fec_ctl_update(struct tx *tx, struct rtp *rtp_session, const struct video_frame *frame)
+{
+        struct fec_ctl *fc = &tx->fec_ctl;
+        uint8_t fract_lost = 0;
+        uint32_t rtt_us = 0;
+        if (!fc->enabled || frame->fragment // no support for FEC with fragments
+                        || !rtp_get_tx_feedback(rtp_session, &fc->report_count, &fract_lost, &rtt_us)) {
+                return;
+        }
+
+        double loss = fract_lost * 100.0 / 256.0;
+        fc->loss = loss > fc->loss ? loss : fc->loss + fc->DECAY * (loss - fc->loss);
+        double level = 0.0;
+        if (fc->loss > fc->target) {
+                level = fc->LEVELS[std::size(fc->LEVELS) - 1];
+                for (double l : fc->LEVELS) {
+                        if (l >= fc->loss * fc->MARGIN) {
+                                level = l;
+                                break;
+                        }
+                }
+        }
+        time_ns_t now = get_time_in_ns();
+        if (level == fc->level || (level < fc->level && now - fc->last_change < fc->RELEASE_INTERVAL)) {
+                return;
+        }
+        LOG(LOG_LEVEL_NOTICE) << "[Transmit] Auto FEC: reported loss " << fc->loss << " %, "
+                << (level > 0.0 ? "setting LDGM for " + std::to_string((int) level) + " % loss" : "disabling FEC") << "\n";
+        fc->level = level;
+        fc->last_change = now;
+        tx->max_loss = level;
+        if (level == 0.0) {
+                tx->fec_scheme = FEC_NONE;
+                struct msg_sender *msg = (struct msg_sender *)
+                        new_message(sizeof(struct msg_sender));
+                msg->type = SENDER_MSG_CHANGE_FEC;
+                snprintf(msg->fec_cfg, sizeof(msg->fec_cfg), "flush");
+                struct response *resp = send_message_to_receiver(get_parent_module(&tx->mod),
+                                (struct message *) msg);
+                free_response(resp);
+                return;
+        }
+        tx->fec_scheme = FEC_LDGM;
+        int avg_len = tx->sent_frames > 0 ? tx->avg_len : tx->avg_len_last;
+        if (avg_len > 0) {
+                tx_set_ldgm_percents(tx, avg_len);
+        } // otherwise created by tx_update() when average frame size is known
+}
+
+/**
+ * Passes a keyframe request from the receiver (see rtp_send_pli()), eg. after
+ * its decoder dropped reference frames, to the compression.
+ *
+ * Requests arriving shortly after the previous one (eg. from multiple
+ * receivers affected by the same loss) are served by the keyframe already
+ * requested.
+ */
+static void tx_request_keyframe(struct tx *tx)
+{
+        constexpr time_ns_t KEYFRAME_REQ_MIN_INTERVAL = NS_IN_SEC / 4;
+        const time_ns_t now = get_time_in_ns();
+        if (now - tx->last_keyframe_req < KEYFRAME_REQ_MIN_INTERVAL) {
+                return;
+        }
+        tx->last_keyframe_req = now;
+        LOG(LOG_LEVEL_VERBOSE) << "[Transmit] Keyframe requested by the receiver.\n";
+        auto *msg = (struct msg_change_compress_data *)
+                new_message(sizeof(struct msg_change_compress_data));
+        msg->what = CHANGE_PARAMS;
+        snprintf(msg->config_string, sizeof msg->config_string, "keyframe");
+        struct response *resp = send_message(get_parent_module(&tx->mod), "compress", (struct message *) msg);
+        free_response(resp);
+}
+
+/**
+ * Changes the video MTU at runtime, packetization plans are rebuilt for the
+ * new MTU, LDGM configured by loss percentage is recomputed.
+ */
+static void tx_set_mtu(struct tx *tx, int mtu)
+{
+        if ((int) tx->mtu == mtu) {
+                return;
+        }
+        LOG(LOG_LEVEL_NOTICE) << "[Transmit] Path MTU " << (mtu > (int) tx->mtu ? "raised" : "lowered")
+                << " to " << mtu << " B.\n";
+        tx->mtu = mtu;
+        if (tx->fec_scheme == FEC_LDGM && tx->max_loss > 0.0 && tx->avg_len_last > 0) {
+                tx_set_ldgm_percents(tx, tx->avg_len_last);
+        }
+}
+
+static void pmtu_send_probe(struct tx *tx, struct rtp *rtp_session, int mtu, time_ns_t now)
+{
+        struct pmtu_ctl *p = &tx->pmtu;
+        if (p->probe != mtu) {
+                p->probe = mtu;
+                p->attempts = 0;
+        }
+        p->attempts += 1;
+        p->probe_time = now;
+        if (!rtp_send_mtu_probe(rtp_session, mtu)) { // exceeds local interface MTU or unsupported
+                LOG(LOG_LEVEL_DEBUG) << "[Transmit] Cannot send MTU probe " << mtu << " B: " << strerror(errno) << "\n";
+                p->attempts = p->MAX_ATTEMPTS;
+                p->probe_time = 0;
+        }
+}
+
+/// Path MTU discovery step, see @ref pmtu_ctl
+static void pmtu_update(struct tx *tx, struct rtp *rtp_session)
+{
+        struct pmtu_ctl *p = &tx->pmtu;
+        if (!p->enabled) {
+                return;
+        }
+        time_ns_t now = get_time_in_ns();
+        int acked = 0;
+        if (rtp_get_mtu_ack(rtp_session, &p->ack_count, &acked) && p->probe != 0 && acked >= p->probe) {
+                p->lo = p->probe;
+                p->probe = 0;
+                tx_set_mtu(tx, p->lo);
+        } else if (p->probe != 0 && now - p->probe_time > p->PROBE_TIMEOUT) {
+                if (p->attempts < p->MAX_ATTEMPTS) {
+                        pmtu_send_probe(tx, rtp_session, p->probe, now);
+                        return;
+                }
+                if (p->probe == p->lo) { // current MTU doesn't pass anymore
+                        p->lo = p->floor;
+                        tx_set_mtu(tx, p->floor);
+                }
+                p->hi = p->probe - 1;
+                p->probe = 0;
+        }
+        if (p->probe != 0) {
+                return;
+        }
+        if (p->hi - p->lo >= p->GRANULARITY) {
+                pmtu_send_probe(tx, rtp_session, p->hi == p->ceiling ? p->hi : (p->lo + p->hi + 1) / 2, now);
+        } else if (now - p->round_start > p->RESEARCH_INTERVAL) {
+                p->round_start = now;
+                p->hi = p->ceiling;
+                if (p->lo > p->floor) {
+                        pmtu_send_probe(tx, rtp_session, p->lo, now); // verify current first
+                }
+        }
+}
+
+/**
+ * Per-frame updates preceding sending of a tile - statistics and processing
+ * of the receiver feedback. Not thread-safe, called before the tiles are
+ * sent in parallel.
+ */
+static void tx_send_prepare(struct tx *tx, struct tx_tile_ctx *ctx, struct video_frame *frame, struct rtp *rtp_session, int substream)
+{
+        tx_update(tx, ctx, frame, substream);
+        if (tx->bitrate == RATE_CC) {
+                cc_update(tx, rtp_session);
+        }
+        fec_ctl_update(tx, rtp_session, frame);
+        if (rtp_get_keyframe_request(rtp_session, &tx->keyframe_req_count)) {
+                tx_request_keyframe(tx);
+        }
+        if (substream == 0) {
+                pmtu_update(tx, rtp_session);
+        }
+}
+
+ADD_TO_PARAM("crypto-mode", "* crypto-mode={cfb|ctr|gcm|gcm256}\n"
+                "  Cipher mode used with --encryption (default cfb), GCM modes authenticate the data\n"
+                "  and are hardware accelerated, but require recent receivers\n");
+ADD_TO_PARAM("tx-mtu-discovery", "* tx-mtu-discovery[=<max_mtu>]\n"
+                "  Raise video MTU at runtime up to max_mtu (default " TOSTRING(RTP_MAX_MTU) ") as the path allows,\n"
+                "  -m is used as a safe minimum, requires receivers supporting it\n");
+ADD_TO_PARAM("tx-pacing", "* tx-pacing={user|kernel}\n"
+                "  Video packet pacing - busy-waiting in the sender (default) or launch times\n"
+                "  evaluated by kernel (SO_TXTIME, requires fq or ETF qdisc, Linux only)\n");
 struct tx *tx_init(struct module *parent, unsigned mtu, enum tx_media_type media_type,
                 const char *fec, const char *encryption, long long int bitrate)
 {
@@ -241,8 +670,26 @@ struct tx *tx_init(struct module *parent, unsigned mtu, enum tx_media_type media
                         module_done(&tx->mod);
                         return NULL;
                 }
+                tx->enc_mode = DEFAULT_CIPHER_MODE;
+                if (const char *mode = get_commandline_param("crypto-mode")) {
+                        const struct { const char *name; enum openssl_mode mode; } modes[] = {
+                                { "cfb", MODE_AES128_CFB }, { "ctr", MODE_AES128_CTR },
+                                { "gcm", MODE_AES128_GCM }, { "gcm256", MODE_AES256_GCM },
+                        };
+                        tx->enc_mode = MODE_AES128_NONE;
+                        for (const auto &m : modes) {
+                                if (strcasecmp(mode, m.name) == 0) {
+                                        tx->enc_mode = m.mode;
+                                }
+                        }
+                        if (tx->enc_mode == MODE_AES128_NONE) {
+                                log_msg(LOG_LEVEL_ERROR, "Unknown crypto mode: %s\n", mode);
+                                module_done(&tx->mod);
+                                return NULL;
+                        }
+                }
                 if (tx->enc_funcs->init(&tx->encryption,
-                                        encryption, DEFAULT_CIPHER_MODE) != 0) {
+                                        encryption, tx->enc_mode) != 0) {
                         fprintf(stderr, "Unable to initialize encryption\n");
                         module_done(&tx->mod);
                         return NULL;
@@ -250,6 +697,18 @@ struct tx *tx_init(struct module *parent, unsigned mtu, enum tx_media_type media
         }
 
         tx->bitrate = bitrate;
+        if (bitrate == RATE_CC) {
+                cc_init(&tx->cc);
+        }
+        const char *pacing = get_commandline_param("tx-pacing");
+        tx->kernel_pacing = pacing != nullptr && strcmp(pacing, "kernel") == 0;
+        const char *pmtu = get_commandline_param("tx-mtu-discovery");
+        if (pmtu != nullptr && media_type == TX_MEDIA_VIDEO) {
+                tx->pmtu.enabled = true;
+                tx->pmtu.floor = tx->pmtu.lo = mtu;
+                tx->pmtu.ceiling = tx->pmtu.hi = strlen(pmtu) > 0 ? std::clamp(atoi(pmtu), (int) mtu, RTP_MAX_MTU) : RTP_MAX_MTU;
+                tx->pmtu.round_start = get_time_in_ns();
+        }
 
         return tx;
 }
@@ -265,6 +724,7 @@ static bool set_fec(struct tx *tx, const char *fec_const)
                 *delim = '\0';
                 fec_cfg = delim + 1;
         }
+        tx->fec_ctl.enabled = false;
 
         struct msg_sender *msg = (struct msg_sender *)
                 new_message(sizeof(struct msg_sender));
@@ -292,13 +752,25 @@ static bool set_fec(struct tx *tx, const char *fec_const)
                         }
                         tx->fec_scheme = FEC_LDGM;
                 }
+        } else if (strcasecmp(fec, "auto") == 0) {
+                if (tx->media_type == TX_MEDIA_AUDIO) {
+                        fprintf(stderr, "Automatic FEC is not currently supported for audio!\n");
+                        ret = false;
+                } else {
+                        tx->fec_ctl = {};
+                        tx->fec_ctl.enabled = true;
+                        tx->fec_ctl.target = fec_cfg ? atof(fec_cfg) : fec_ctl::DEFAULT_TARGET;
+                        tx->max_loss = 0.0;
+                        tx->fec_scheme = FEC_NONE;
+                }
         } else if(strcasecmp(fec, "RS") == 0) {
                 snprintf(msg->fec_cfg, sizeof(msg->fec_cfg), "RS cfg %s",
                                 fec_cfg ? fec_cfg : "");
                 tx->fec_scheme = FEC_RS;
         } else if(strcasecmp(fec, "help") == 0) {
                 std::cout << "Usage:\n"
-                        "\t-f [A:|V:]{ mult:count | ldgm[:params] | rs[:params] }\n";
+                        "\t-f [A:|V:]{ mult:count | ldgm[:params] | rs[:params] | auto[:<residual_loss_%>] }\n"
+                        "\tauto - LDGM redundancy adapted to the loss reported by the receiver (video only)\n";
                 ret = false;
         } else {
                 fprintf(stderr, "Unknown FEC: %s\n", fec);
@@ -343,6 +815,9 @@ static void fec_check_messages(struct tx *tx)
                         text += strlen("rate ");
                         auto new_rate = unit_evaluate(text);
                         if (new_rate >= RATE_MIN) {
+                                if (new_rate == RATE_CC && tx->cc.rate == 0) {
+                                        cc_init(&tx->cc);
+                                }
                                 tx->bitrate = new_rate;
                                 r = new_response(RESPONSE_OK, nullptr);
                                 LOG(LOG_LEVEL_NOTICE) << "[Transmit] Bitrate set to: " << text << (new_rate > 0 ? "B" : "") << "\n";
@@ -363,15 +838,54 @@ static void tx_done(struct module *mod)
 {
         struct tx *tx = (struct tx *) mod->priv_data;
         assert(tx->magic == TRANSMIT_MAGIC);
+        if (tx->encryption) {
+                tx->enc_funcs->destroy(tx->encryption);
+        }
+        free(tx->pack_buffer);
+        free(tx->h26x_nals);
+        free(tx->h26x_packets);
+        free(tx->h26x_agg_buffer);
+        free(tx->jpeg_hdrs);
+        for (auto &ctx : tx->tiles) {
+                free(ctx.pkt_plan.lens);
+                free(ctx.pkt_plan.ends);
+                free(ctx.pkt_plan.headers);
+                free(ctx.enc_buffer);
+        }
         free(tx);
 }
 
+/**
+ * @returns RTP timestamp of a video frame - the current media time or, with
+ * the PTP clock enabled, the capture time of the frame in PTP time (so that
+ * frames captured simultaneously by different senders share the timestamp)
+ */
+static uint32_t tx_get_video_ts(const struct video_frame *frame)
+{
+        if (ptp_clock_enabled() && frame->trace.ts[FT_CAPTURE] != 0) {
+                return ptp_to_mediatime(frame->trace.ts[FT_CAPTURE] + ptp_clock_get_offset_ns());
+        }
+        return get_local_mediatime();
+}
+
 /*
  * sends one or more frames (tiles) with same TS in one RTP stream. Only one m-bit is set.
  */
 void
 tx_send(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session)
 {
+        tx_send_fanout(tx, frame, &rtp_session, 1);
+}
+
+/**
+ * Same as tx_send() but the frame is sent to multiple sessions. Packets are
+ * built (including FEC and encryption) only once, just RTP headers are written
+ * for every session and each burst is submitted as a batch per session.
+ */
+void
+tx_send_fanout(struct tx *tx, struct video_frame *frame, struct rtp **rtp_sessions, int session_count)
+{
+        PROFILE_FUNC;
         unsigned int i;
         uint32_t ts = 0;
 
@@ -379,7 +893,10 @@ tx_send(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session)
         assert(!frame->fragment || frame->tile_count); // multiple tile are not currently supported for fragmented send
         fec_check_messages(tx);
 
-        ts = get_local_mediatime();
+        static struct metric *frames = metric_counter("ug_tx_frames", "Frames sent", "media=video");
+        metric_add(frames, 1);
+
+        ts = tx_get_video_ts(frame);
         if(frame->fragment &&
                         tx->last_frame_fragment_id == frame->frame_fragment_id) {
                 ts = tx->last_ts;
@@ -400,7 +917,7 @@ tx_send(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session)
                 if(frame->fragment)
                         fragment_offset = vf_get_tile(frame, i)->offset;
 
-                tx_send_base(tx, frame, rtp_session, ts, last,
+                tx_send_base(tx, &tx->tiles[0], frame, rtp_sessions, session_count, ts, last,
                                 i, fragment_offset);
         }
         tx->buffer++;
@@ -419,6 +936,7 @@ void format_video_header(struct video_frame *frame, int tile_idx, int buffer_idx
 
         /* word 6 */
         video_hdr[5] = format_interl_fps_hdr_row(frame->interlacing, frame->fps);
+        video_hdr[5] |= htonl((frame->temporal_layer & VIDEO_HDR_TEMPORAL_LAYER_MASK) << VIDEO_HDR_TEMPORAL_LAYER_SHIFT);
 }
 
 void format_audio_header(const audio_frame2 *frame, int channel, int buffer_idx, uint32_t *audio_hdr)
@@ -450,7 +968,7 @@ tx_send_tile(struct tx *tx, struct video_frame *frame, int pos, struct rtp *rtp_
         assert(!frame->fragment || frame->tile_count); // multiple tile are not currently supported for fragmented send
         fec_check_messages(tx);
 
-        ts = get_local_mediatime();
+        ts = tx_get_video_ts(frame);
         if(frame->fragment &&
                         tx->last_frame_fragment_id == frame->frame_fragment_id) {
                 ts = tx->last_ts;
@@ -462,11 +980,67 @@ tx_send_tile(struct tx *tx, struct video_frame *frame, int pos, struct rtp *rtp_
                 last = TRUE;
         if(frame->fragment)
                 fragment_offset = vf_get_tile(frame, pos)->offset;
-        tx_send_base(tx, frame, rtp_session, ts, last, pos,
+        tx_send_base(tx, &tx->tiles[0], frame, &rtp_session, 1, ts, last, pos,
                         fragment_offset);
         tx->buffer ++;
 }
 
+struct tx_send_tile_task {
+        struct tx *tx;
+        struct video_frame *frame;
+        struct rtp *rtp_session;
+        uint32_t ts;
+        int pos;
+};
+
+static void *tx_send_tile_task(void *arg)
+{
+        auto *t = (struct tx_send_tile_task *) arg;
+        tx_send_base(t->tx, &t->tx->tiles[t->pos], t->frame, &t->rtp_session, 1, t->ts, TRUE, t->pos, 0);
+        return nullptr;
+}
+
+/**
+ * Sends tile i of the frame to rtp_sessions[i] (as tx_send_tile() called for
+ * every tile) - the tiles are sent concurrently, each from its own thread
+ * with its own pacing, so that the frame takes only as long as the largest
+ * tile.
+ *
+ * Falls back to sequential send for fragmented frames, encryption (the
+ * cipher state is not thread-safe) or too many tiles.
+ */
+void
+tx_send_tiles(struct tx *tx, struct video_frame *frame, struct rtp **rtp_sessions)
+{
+        if (frame->fragment || tx->encryption || frame->tile_count == 1 ||
+                        frame->tile_count > TX_MAX_PARALLEL_TILES) {
+                for (unsigned i = 0; i < frame->tile_count; ++i) {
+                        tx_send_tile(tx, frame, i, rtp_sessions[i]);
+                }
+                return;
+        }
+        fec_check_messages(tx);
+
+        uint32_t ts = tx_get_video_ts(frame);
+        tx->last_frame_fragment_id = frame->frame_fragment_id;
+        tx->last_ts = ts;
+
+        struct tx_send_tile_task tasks[TX_MAX_PARALLEL_TILES];
+        for (unsigned i = 0; i < frame->tile_count; ++i) {
+                struct tx_tile_ctx *ctx = &tx->tiles[i];
+                ctx->parallel = true;
+                ctx->buffer = tx->buffer++;
+                if (rtp_has_receiver(rtp_sessions[i])) {
+                        tx_send_prepare(tx, ctx, frame, rtp_sessions[i], i);
+                }
+                tasks[i] = { tx, frame, rtp_sessions[i], ts, (int) i };
+        }
+        task_run_parallel(tx_send_tile_task, frame->tile_count, tasks, sizeof tasks[0], nullptr);
+        for (unsigned i = 0; i < frame->tile_count; ++i) {
+                tx->tiles[i].parallel = false;
+        }
+}
+
 static uint32_t format_interl_fps_hdr_row(enum interlacing_t interlacing, double input_fps)
 {
         unsigned int fpsd, fd, fps, fi;
@@ -518,9 +1092,9 @@ static inline int get_video_pkt_len(bool with_fec, int mtu,
 
 static inline void check_symbol_size(int fec_symbol_size, int payload_len)
 {
-        thread_local static bool status_printed = false;
+        thread_local static int status_printed_for = -1; ///< payload_len, changes with MTU
 
-        if (status_printed) {
+        if (status_printed_for == payload_len) {
                 return;
         }
 
@@ -532,40 +1106,113 @@ static inline void check_symbol_size(int fec_symbol_size, int payload_len)
                                 payload_len / fec_symbol_size << ", payload size: " <<
                                 payload_len / fec_symbol_size * fec_symbol_size << "\n";
         }
-        status_printed = true;
+        status_printed_for = payload_len;
 }
 
-/// @param mtu is tx->mtu - hdrs_len
-static vector<int> get_packet_sizes(struct video_frame *frame, int substream, int mtu) {
-        unsigned int fec_symbol_size = frame->fec_params.symbol_size;
-        vector<int> ret;
+/**
+ * Extends the plan packet lengths to cover data_len bytes.
+ * @returns number of packets for data_len
+ */
+static size_t tx_pkt_plan_extend(struct tx_pkt_plan *plan, unsigned data_len)
+{
+        const bool with_fec = plan->fec.type != FEC_NONE;
+        const int pf_block_size = is_codec_opaque(plan->color_spec) ? 1 : PIX_BLOCK_LCM / get_pf_block_pixels(plan->color_spec) * get_pf_block_bytes(plan->color_spec);
+        while (plan->count == 0 || plan->ends[plan->count - 1] < data_len) {
+                if (plan->count == plan->alloc) {
+                        plan->alloc = std::max<size_t>(2 * plan->alloc, 1024);
+                        plan->lens = (int *) realloc(plan->lens, plan->alloc * sizeof plan->lens[0]);
+                        plan->ends = (unsigned *) realloc(plan->ends, plan->alloc * sizeof plan->ends[0]);
+                }
+                int len = get_video_pkt_len(with_fec, plan->mtu, plan->fec.symbol_size,
+                                &plan->fec_symbol_offset, pf_block_size);
+                plan->lens[plan->count] = len;
+                plan->ends[plan->count] = (plan->count > 0 ? plan->ends[plan->count - 1] : 0) + len;
+                plan->count += 1;
+        }
+        return std::lower_bound(plan->ends, plan->ends + plan->count, data_len) - plan->ends + 1;
+}
+
+/**
+ * Returns the packetization plan for the tile, creates a new one if the
+ * cached is not usable.
+ *
+ * @param mtu is tx->mtu - hdrs_len
+ */
+static struct tx_pkt_plan *tx_get_pkt_plan(struct tx *tx, struct tx_tile_ctx *ctx, struct video_frame *frame, int substream, int mtu)
+{
+        struct tx_pkt_plan *plan = &ctx->pkt_plan;
+        const bool encryption = tx->encryption != nullptr;
+        if (plan->valid && plan->mtu == mtu && plan->encryption == encryption) {
+                return plan;
+        }
+
+        struct tile *tile = &frame->tiles[substream];
+        plan->valid = true;
+        plan->width = tile->width;
+        plan->height = tile->height;
+        plan->color_spec = frame->color_spec;
+        plan->interlacing = frame->interlacing;
+        plan->fps = frame->fps;
+        plan->fec = frame->fec_params;
+        plan->mtu = mtu;
+        plan->encryption = encryption;
+        plan->count = 0;
+        plan->fec_symbol_offset = 0;
+        plan->headers_count = 0;
 
         if (frame->fec_params.type != FEC_NONE) {
-                check_symbol_size(fec_symbol_size, mtu);
+                check_symbol_size(frame->fec_params.symbol_size, mtu);
         }
 
-        int fec_symbol_offset = 0;
-        int pf_block_size = is_codec_opaque(frame->color_spec) ? 1 : PIX_BLOCK_LCM / get_pf_block_pixels(frame->color_spec) * get_pf_block_bytes(frame->color_spec);
-        unsigned pos = 0;
-        do {
-                int len = get_video_pkt_len(frame->fec_params.type != FEC_NONE, mtu,
-                                        fec_symbol_size, &fec_symbol_offset, pf_block_size);
-                pos += len;
-                ret.push_back(len);
-        } while (pos < frame->tiles[substream].data_len);
-        return ret;
+        uint32_t *rtp_hdr = plan->hdr;
+        if (frame->fec_params.type == FEC_NONE) {
+                plan->hdr_len = sizeof(video_payload_hdr_t);
+                format_video_header(frame, substream, ctx->buffer, rtp_hdr);
+        } else {
+                plan->hdr_len = sizeof(fec_payload_hdr_t);
+                // see definition in rtp_callback.h
+                rtp_hdr[3] = htonl(
+                             frame->fec_params.k << 19 |
+                             frame->fec_params.m << 6 |
+                             frame->fec_params.c);
+                rtp_hdr[4] = htonl(frame->fec_params.seed);
+        }
+        if (tx->encryption) {
+                rtp_hdr[plan->hdr_len / sizeof(uint32_t)] = htonl(tx->enc_mode << 24);
+                plan->hdr_len += sizeof(crypto_payload_hdr_t);
+        }
+        return plan;
+}
+
+/**
+ * Returns per-packet header array for at least packet_count packets.
+ * Buffer index, length and offset words needs to be set by the caller.
+ */
+static uint32_t *tx_pkt_plan_headers(struct tx_pkt_plan *plan, size_t packet_count)
+{
+        const size_t hdr_words = plan->hdr_len / sizeof(uint32_t);
+        if (plan->headers_count < packet_count) {
+                const size_t new_count = std::max<size_t>(packet_count, 2 * plan->headers_count);
+                plan->headers = (uint32_t *) realloc(plan->headers, new_count * plan->hdr_len);
+                for (size_t i = plan->headers_count; i < new_count; ++i) {
+                        memcpy(plan->headers + i * hdr_words, plan->hdr, plan->hdr_len);
+                }
+                plan->headers_count = new_count;
+        }
+        return plan->headers;
 }
 
 /**
  * Returns inter-packet interval in nanoseconds.
  */
 static long
-get_packet_rate(struct tx *tx, struct video_frame *frame, int substream, long packet_count)
+get_packet_rate(struct tx *tx, struct tx_tile_ctx *ctx, struct video_frame *frame, int substream, long packet_count)
 {
         if (tx->bitrate == RATE_UNLIMITED) {
                 return 0;
         }
-        double time_for_frame = 1.0 / frame->fps / frame->tile_count;
+        // tiles sent in parallel can be spread over the whole frame time
+        double time_for_frame = 1.0 / frame->fps / (ctx->parallel ? 1 : frame->tile_count);
         double interval_between_pkts = time_for_frame / tx->mult_count / packet_count;
         // use only 75% of the time - we less likely overshot the frame time and
         // can minimize risk of swapping packets between 2 frames (out-of-order ones)
@@ -578,17 +1225,17 @@ get_packet_rate(struct tx *tx, struct video_frame *frame, int substream, long pa
                return packet_rate_auto;
         }
         if (tx->bitrate == RATE_DYNAMIC) {
-                if (frame->tiles[substream].data_len > 2 * tx->dyn_rate_limit_state.avg_frame_size
-                                && tx->dyn_rate_limit_state.last_excess > rate_limit_dyn::EXCESS_GAP) {
+                if (frame->tiles[substream].data_len > 2 * ctx->dyn_rate_limit_state.avg_frame_size
+                                && ctx->dyn_rate_limit_state.last_excess > rate_limit_dyn::EXCESS_GAP) {
                         packet_rate_auto /= 2; // double packet rate for this frame
-                        tx->dyn_rate_limit_state.last_excess = 0;
+                        ctx->dyn_rate_limit_state.last_excess = 0;
                 } else {
-                        tx->dyn_rate_limit_state.last_excess += 1;
+                        ctx->dyn_rate_limit_state.last_excess += 1;
                 }
-                tx->dyn_rate_limit_state.avg_frame_size = (9 * tx->dyn_rate_limit_state.avg_frame_size + frame->tiles[substream].data_len) / 10;
+                ctx->dyn_rate_limit_state.avg_frame_size = (9 * ctx->dyn_rate_limit_state.avg_frame_size + frame->tiles[substream].data_len) / 10;
                 return packet_rate_auto;
         }
-        long long int bitrate = tx->bitrate & ~RATE_FLAG_FIXED_RATE;
+        long long int bitrate = tx->bitrate == RATE_CC ? tx->cc.rate : tx->bitrate & ~RATE_FLAG_FIXED_RATE;
         int avg_packet_size = frame->tiles[substream].data_len / packet_count;
         long packet_rate = 1000'000'000L * avg_packet_size * 8 / bitrate; // fixed rate
         if ((tx->bitrate & RATE_FLAG_FIXED_RATE) == 0) { // adaptive capped rate
@@ -597,23 +1244,51 @@ get_packet_rate(struct tx *tx, struct video_frame *frame, int substream, long pa
         return packet_rate;
 }
 
+ADD_TO_PARAM("tx-max-burst", "* tx-max-burst=<n>\n"
+                "  Max number of video packets submitted to network stack at once (default "
+                TOSTRING(DEFAULT_TX_MAX_BURST) ", 1 - no batching)\n");
+/**
+ * Returns number of packets that are sent together without pacing.
+ *
+ * If packets are paced, the burst is limited not to take longer than
+ * TX_MAX_BURST_DURATION_NS so that the packet spreading is preserved.
+ */
+static long get_burst_size(long packet_rate, long packet_count)
+{
+        static long max_burst = get_commandline_param("tx-max-burst") ?
+                std::max(atol(get_commandline_param("tx-max-burst")), 1L) :
+                DEFAULT_TX_MAX_BURST;
+        long burst = max_burst;
+        if (packet_rate > 0) {
+                burst = std::clamp<long>(TX_MAX_BURST_DURATION_NS / packet_rate, 1L, max_burst);
+        }
+        return std::min(burst, packet_count);
+}
+
 static void
-tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
-                uint32_t ts, int send_m,
+tx_send_base(struct tx *tx, struct tx_tile_ctx *ctx, struct video_frame *frame, struct rtp **rtp_sessions,
+                int session_count, uint32_t ts, int send_m,
                 unsigned int substream,
                 int fragment_offset)
 {
-        if (!rtp_has_receiver(rtp_session)) {
+        thread_local static vector<struct rtp *> sessions;
+        sessions.clear();
+        bool ipv6 = false;
+        for (int i = 0; i < session_count; ++i) {
+                if (rtp_has_receiver(rtp_sessions[i])) {
+                        sessions.push_back(rtp_sessions[i]);
+                        ipv6 = ipv6 || rtp_is_ipv6(rtp_sessions[i]);
+                }
+        }
+        if (sessions.empty()) {
                 return;
         }
+        struct rtp *rtp_session = sessions[0]; ///< primary session (congestion control)
 
         struct tile *tile = &frame->tiles[substream];
 
         int data_len;
-        // see definition in rtp_callback.h
 
-        uint32_t rtp_hdr[100];
-        int rtp_hdr_len;
         int pt = fec_pt_from_fec_type(TX_MEDIA_VIDEO, frame->fec_params.type, tx->encryption);            /* A value specified in our packet format */
 #ifdef HAVE_LINUX
         struct timespec start, stop;
@@ -626,60 +1301,81 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
         array <int, FEC_MAX_MULT> mult_pos{};
         int mult_index = 0;
 
-        int hdrs_len = (rtp_is_ipv6(rtp_session) ? 40 : 20) + 8 + 12; // IP hdr size + UDP hdr size + RTP hdr size
+        int hdrs_len = (ipv6 ? 40 : 20) + 8 + 12; // IP hdr size + UDP hdr size + RTP hdr size
+        uint32_t trace_extn[FRAME_TRACE_EXTN_WORDS];
+        const bool send_trace = send_m && frame_trace_enabled();
+        if (send_trace) { // the extension is sent only in the last packet but keep packet sizes uniform
+                hdrs_len += (1 + FRAME_TRACE_EXTN_WORDS) * sizeof(uint32_t);
+        }
 
         assert(tx->magic == TRANSMIT_MAGIC);
 
-        tx_update(tx, frame, substream);
-
-        if (frame->fec_params.type == FEC_NONE) {
-                hdrs_len += (sizeof(video_payload_hdr_t));
-                rtp_hdr_len = sizeof(video_payload_hdr_t);
-                format_video_header(frame, substream, tx->buffer, rtp_hdr);
-        } else {
-                hdrs_len += (sizeof(fec_payload_hdr_t));
-                rtp_hdr_len = sizeof(fec_payload_hdr_t);
-                uint32_t tmp = substream << 22;
-                tmp |= 0x3fffff & tx->buffer;
-                // see definition in rtp_callback.h
-                rtp_hdr[0] = htonl(tmp);
-                rtp_hdr[2] = htonl(tile->data_len);
-                rtp_hdr[3] = htonl(
-                             frame->fec_params.k << 19 |
-                             frame->fec_params.m << 6 |
-                             frame->fec_params.c);
-                rtp_hdr[4] = htonl(frame->fec_params.seed);
+        if (!ctx->parallel) {
+                ctx->buffer = tx->buffer;
+                tx_send_prepare(tx, ctx, frame, rtp_session, substream);
         }
 
+        hdrs_len += frame->fec_params.type == FEC_NONE ? sizeof(video_payload_hdr_t) : sizeof(fec_payload_hdr_t);
         if (tx->encryption) {
                 hdrs_len += sizeof(crypto_payload_hdr_t) + tx->enc_funcs->get_overhead(tx->encryption);
-                rtp_hdr[rtp_hdr_len / sizeof(uint32_t)] = htonl(DEFAULT_CIPHER_MODE << 24);
-                rtp_hdr_len += sizeof(crypto_payload_hdr_t);
         }
 
-        vector<int> packet_sizes = get_packet_sizes(frame, substream, tx->mtu - hdrs_len);
-        long packet_count = packet_sizes.size() * (tx->fec_scheme == FEC_MULT ? tx->mult_count : 1);
+        struct tx_pkt_plan *plan = tx_get_pkt_plan(tx, ctx, frame, substream, tx->mtu - hdrs_len);
+        const int rtp_hdr_len = plan->hdr_len;
+        const long tile_packet_count = tx_pkt_plan_extend(plan, tile->data_len);
+        long packet_count = tile_packet_count * (tx->fec_scheme == FEC_MULT ? tx->mult_count : 1);
+        // fields differing between frames, see definition in rtp_callback.h
+        const uint32_t hdr_buffer_idx = htonl(substream << 22 | (0x3fffff & ctx->buffer));
+        const uint32_t hdr_data_len = htonl(tile->data_len);
+
+        long packet_rate = get_packet_rate(tx, ctx, frame, substream, packet_count);
+        if (tx->kernel_pacing) {
+                bool paced = true;
+                for (auto *session : sessions) {
+                        paced = paced && rtp_set_txtime_pacing(session, packet_rate);
+                }
+                if (paced) {
+                        packet_rate = 0; // paced by kernel
+                } else {
+                        tx->kernel_pacing = false;
+                        for (auto *session : sessions) {
+                                rtp_set_txtime_pacing(session, 0);
+                        }
+                }
+        }
+        long burst = get_burst_size(packet_rate, packet_count);
+        long burst_pkts = 0;
 
-        long packet_rate = get_packet_rate(tx, frame, substream, packet_count);
+        // header array initialized from the plan, buffer index, length and
+        // offset set for every packet below
+        uint32_t *rtp_hdr_packet = tx_pkt_plan_headers(plan, packet_count);
 
-        // initialize header array with values (except offset which is different among
-        // different packts)
-        void *rtp_headers = malloc(packet_count * rtp_hdr_len);
-        uint32_t *rtp_hdr_packet = (uint32_t *) rtp_headers;
-        for (int i = 0; i < packet_count; ++i) {
-                memcpy(rtp_hdr_packet, rtp_hdr, rtp_hdr_len);
-                rtp_hdr_packet += rtp_hdr_len / sizeof(uint32_t);
+        // every packet is encrypted to its own slot, so that the buffers
+        // stay valid until the batched (async) send completes
+        char *enc_slot = nullptr;
+        const size_t enc_slot_len = tx->mtu + MAX_CRYPTO_EXCEED;
+        if (tx->encryption) {
+                if (ctx->enc_buffer_len < packet_count * enc_slot_len) {
+                        free(ctx->enc_buffer);
+                        ctx->enc_buffer_len = packet_count * enc_slot_len;
+                        ctx->enc_buffer = (char *) malloc(ctx->enc_buffer_len);
+                }
+                enc_slot = ctx->enc_buffer;
+        }
+        for (auto *session : sessions) {
+                rtp_async_start(session, packet_count);
         }
-        rtp_hdr_packet = (uint32_t *) rtp_headers;
 
-        if (!tx->encryption) {
-                rtp_async_start(rtp_session, packet_count);
+        if (frame->trace.ts[FT_TX_FIRST] == 0) {
+                frame_trace_stamp(&frame->trace, FT_TX_FIRST);
         }
 
         int packet_idx = 0;
         unsigned pos = 0;
         do {
-                GET_STARTTIME;
+                if (burst_pkts == 0) {
+                        GET_STARTTIME;
+                }
                 int m = 0;
                 if(tx->fec_scheme == FEC_MULT) {
                         pos = mult_pos[mult_index];
@@ -687,10 +1383,13 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
 
                 int offset = pos + fragment_offset;
 
+                rtp_hdr_packet[0] = hdr_buffer_idx;
                 rtp_hdr_packet[1] = htonl(offset);
+                rtp_hdr_packet[2] = hdr_data_len;
 
                 char *data = tile->data + pos;
-                data_len = packet_sizes.at(packet_idx);
+                assert(packet_idx < tile_packet_count);
+                data_len = plan->lens[packet_idx];
                 if (pos + data_len >= (unsigned int) tile->data_len) {
                         if (send_m) {
                                 m = 1;
@@ -699,21 +1398,29 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
                 }
                 pos += data_len;
                 if(data_len) { /* check needed for FEC_MULT */
-                        char encrypted_data[data_len + MAX_CRYPTO_EXCEED];
-
                         if (tx->encryption) {
                                 data_len = tx->enc_funcs->encrypt(tx->encryption,
                                                 data, data_len,
                                                 (char *) rtp_hdr_packet,
                                                 frame->fec_params.type != FEC_NONE ? sizeof(fec_payload_hdr_t) :
                                                 sizeof(video_payload_hdr_t),
-                                                encrypted_data);
-                                data = encrypted_data;
+                                                enc_slot);
+                                data = enc_slot;
+                                enc_slot += enc_slot_len;
                         }
 
-                        rtp_send_data_hdr(rtp_session, ts, pt, m, 0, 0,
-                                  (char *) rtp_hdr_packet, rtp_hdr_len,
-                                  data, data_len, 0, 0, 0);
+                        int trace_extn_len = 0;
+                        if (m && send_trace) {
+                                frame_trace_stamp(&frame->trace, FT_TX_LAST);
+                                trace_extn_len = frame_trace_write_extn(&frame->trace, trace_extn);
+                        }
+                        for (auto *session : sessions) {
+                                rtp_send_data_hdr(session, ts, pt, m, 0, 0,
+                                          (char *) rtp_hdr_packet, rtp_hdr_len,
+                                          data, data_len,
+                                          trace_extn_len > 0 ? (char *) trace_extn : nullptr,
+                                          trace_extn_len, FRAME_TRACE_EXTN_TYPE);
+                        }
                 }
 
                 if (mult_index + 1 == tx->mult_count) {
@@ -728,20 +1435,87 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
                 rtp_hdr_packet += rtp_hdr_len / sizeof(uint32_t);
 
                 // TRAFFIC SHAPER
-                if (pos < (unsigned int) tile->data_len) { // wait for all but last packet
+                if (pos < (unsigned int) tile->data_len && ++burst_pkts == burst) { // wait for all but last burst
+                        for (auto *session : sessions) {
+                                rtp_async_flush(session);
+                        }
                         do {
                                 GET_STOPTIME;
                                 GET_DELTA;
-                        } while (packet_rate - delta - overslept > 0);
-                        overslept = -(packet_rate - delta - overslept);
+                        } while (packet_rate * burst_pkts - delta - overslept > 0);
+                        overslept = -(packet_rate * burst_pkts - delta - overslept);
+                        burst_pkts = 0;
                         //fprintf(stdout, "%ld ", overslept);
                 }
         } while (pos < tile->data_len || mult_index != 0); // when multiplying, we need all streams go to the end
 
-        if (!tx->encryption) {
-                rtp_async_wait(rtp_session);
+        for (auto *session : sessions) {
+                rtp_async_wait(session);
         }
-        free(rtp_headers);
+
+        static struct metric *packets = metric_counter("ug_tx_packets", "RTP packets sent", "media=video");
+        static struct metric *bytes = metric_counter("ug_tx_bytes", "Payload bytes sent (including FEC)", "media=video");
+        metric_add(packets, packet_count);
+        metric_add(bytes, tile->data_len);
+}
+
+ADD_TO_PARAM("audio-pack-channels", "* audio-pack-channels\n"
+                "  Pack multiple audio channels to one packet (up to MTU) if neither FEC nor encryption is used.\n"
+                "  Reduces packet rate for many channels, requires receiver supporting it.\n");
+/**
+ * Sends the frame as PT_AUDIO_PACKED - every packet is filled with as many
+ * channel segments as fit to MTU, a channel may continue in the next packet.
+ * All packets of the frame are sent in one batch.
+ */
+static void audio_tx_send_packed(struct tx *tx, struct rtp *rtp_session, const audio_frame2 *buffer, uint32_t timestamp)
+{
+        const int space = tx->mtu - ((rtp_is_ipv6(rtp_session) ? 40 : 20) + 8 + 12); // MTU - IP hdr - UDP hdr - RTP hdr
+        const int seg_hdr_len = sizeof(audio_packed_segment_hdr_t);
+        assert(space > seg_hdr_len);
+
+        // upper bound - every packet break adds one segment header
+        size_t total_len = 0;
+        for (int channel = 0; channel < buffer->get_channel_count(); ++channel) {
+                total_len += buffer->get_data_len(channel) + seg_hdr_len;
+        }
+        const int packet_count = total_len / (space - seg_hdr_len) + buffer->get_channel_count() + 1;
+        if (tx->pack_buffer_len < (size_t) packet_count * space) {
+                free(tx->pack_buffer);
+                tx->pack_buffer_len = (size_t) packet_count * space;
+                tx->pack_buffer = (char *) malloc(tx->pack_buffer_len);
+        }
+
+        rtp_async_start(rtp_session, packet_count);
+        char *packet = tx->pack_buffer;
+        int used = 0;
+        int channel = 0;
+        unsigned pos = 0;
+        while (channel < buffer->get_channel_count()) {
+                unsigned chan_len = buffer->get_data_len(channel);
+                unsigned len = std::min<unsigned>(chan_len - pos, space - used - seg_hdr_len);
+
+                audio_packed_segment_hdr_t hdr;
+                hdr[0] = htonl(len);
+                format_audio_header(buffer, channel, tx->buffer, hdr + 1);
+                hdr[2] = htonl(pos);
+                memcpy(packet + used, hdr, sizeof hdr);
+                memcpy(packet + used + seg_hdr_len, buffer->get_data(channel) + pos, len);
+                used += seg_hdr_len + len;
+                pos += len;
+                if (pos == chan_len) {
+                        channel += 1;
+                        pos = 0;
+                }
+
+                bool last = channel == buffer->get_channel_count();
+                if (last || space - used <= seg_hdr_len) {
+                        rtp_send_data_hdr(rtp_session, timestamp, PT_AUDIO_PACKED, last, 0, 0,
+                                        nullptr, 0, packet, used, 0, 0, 0);
+                        packet += space;
+                        used = 0;
+                }
+        }
+        rtp_async_wait(rtp_session);
 }
 
 /* 
@@ -754,6 +1528,22 @@ void audio_tx_send(struct tx* tx, struct rtp *rtp_session, const audio_frame2 *
                 return;
         }
 
+        static struct metric *frames = metric_counter("ug_tx_frames", "Frames sent", "media=audio");
+        static struct metric *bytes = metric_counter("ug_tx_bytes", "Payload bytes sent (including FEC)", "media=audio");
+        metric_add(frames, 1);
+        for (int i = 0; i < buffer->get_channel_count(); ++i) {
+                metric_add(bytes, buffer->get_data_len(i));
+        }
+
+        static const bool pack_channels = get_commandline_param("audio-pack-channels") != nullptr;
+        if (pack_channels && buffer->get_fec_params(0).type == FEC_NONE && !tx->encryption
+                        && tx->fec_scheme != FEC_MULT) {
+                fec_check_messages(tx);
+                audio_tx_send_packed(tx, rtp_session, buffer, get_local_mediatime());
+                tx->buffer ++;
+                return;
+        }
+
         int pt = fec_pt_from_fec_type(TX_MEDIA_AUDIO, buffer->get_fec_params(0).type, tx->encryption); /* PT set for audio in our packet format */
         unsigned m = 0u;
         const char *chan_data;
@@ -807,7 +1597,7 @@ void audio_tx_send(struct tx* tx, struct rtp *rtp_session, const audio_frame2 *
 
                 if (tx->encryption) {
                         hdrs_len += sizeof(crypto_payload_hdr_t) + tx->enc_funcs->get_overhead(tx->encryption);
-                        rtp_hdr[rtp_hdr_len / sizeof(uint32_t)] = htonl(DEFAULT_CIPHER_MODE << 24);
+                        rtp_hdr[rtp_hdr_len / sizeof(uint32_t)] = htonl(tx->enc_mode << 24);
                         rtp_hdr_len += sizeof(crypto_payload_hdr_t);
                 }
 
@@ -987,119 +1777,251 @@ void audio_tx_send_standard(struct tx* tx, struct rtp *rtp_session,
 }
 
 /**
- *  H.264 standard transmission
+ * One RTP packet of tx_send_h264(). The headers are stored here because they
+ * need to stay valid until the batched (async) send completes.
+ */
+struct h26x_packet {
+        unsigned char hdr[3];   ///< FU indicator/payload header and FU header
+        int hdr_len;
+        const char *data;       ///< NAL data in the frame, NULL for aggregation packets
+        long agg_offset;        ///< offset of the aggregation packet in tx->h26x_agg_buffer
+        int data_len;
+};
+
+struct h26x_nal {
+        const unsigned char *data;
+        unsigned len;
+};
+
+static struct h26x_packet *h26x_add_packet(struct tx *tx, int *count)
+{
+        if ((size_t) *count == tx->h26x_packets_len) {
+                tx->h26x_packets_len = MAX(64, 2 * tx->h26x_packets_len);
+                tx->h26x_packets = (struct h26x_packet *) realloc(tx->h26x_packets,
+                                tx->h26x_packets_len * sizeof(struct h26x_packet));
+        }
+        struct h26x_packet *pkt = &tx->h26x_packets[(*count)++];
+        pkt->hdr_len = 0;
+        pkt->data = nullptr;
+        pkt->agg_offset = -1;
+        return pkt;
+}
+
+/**
+ * Creates STAP-A (H.264) or AP (HEVC) packet from the NAL units. Unlike other
+ * packets, the (small) NAL units are copied.
+ */
+static void h26x_add_aggregation(struct tx *tx, int *count, const struct h26x_nal *nals, int nal_count,
+                bool hevc, size_t *agg_len)
+{
+        size_t needed = *agg_len + 2;
+        for (int i = 0; i < nal_count; ++i) {
+                needed += 2 + nals[i].len;
+        }
+        if (needed > tx->h26x_agg_buffer_len) {
+                tx->h26x_agg_buffer_len = MAX(2 * tx->h26x_agg_buffer_len, needed);
+                tx->h26x_agg_buffer = (char *) realloc(tx->h26x_agg_buffer, tx->h26x_agg_buffer_len);
+        }
+        struct h26x_packet *pkt = h26x_add_packet(tx, count);
+        pkt->agg_offset = *agg_len;
+        unsigned char *out = (unsigned char *) tx->h26x_agg_buffer + *agg_len;
+        unsigned char *aggregation_hdr = out;
+        if (hevc) { // F = 0, lowest LayerId and TID of the aggregated units
+                unsigned layer_id = 0x3F;
+                unsigned tid = 0x7;
+                for (int i = 0; i < nal_count; ++i) {
+                        layer_id = MIN(layer_id, ((nals[i].data[0] & 0x1U) << 5U) | nals[i].data[1] >> 3U);
+                        tid = MIN(tid, nals[i].data[1] & 0x7U);
+                }
+                out[0] = RTP_HEVC_AP << 1 | layer_id >> 5;
+                out[1] = (layer_id & 0x1F) << 3 | tid;
+                out += 2;
+        } else { // F is OR and NRI the maximum of the aggregated units
+                unsigned f = 0;
+                unsigned nri = 0;
+                for (int i = 0; i < nal_count; ++i) {
+                        f |= nals[i].data[0] & 0x80U;
+                        nri = MAX(nri, nals[i].data[0] & 0x60U);
+                }
+                out[0] = f | nri | RTP_STAP_A;
+                out += 1;
+        }
+        for (int i = 0; i < nal_count; ++i) {
+                *out++ = nals[i].len >> 8;
+                *out++ = nals[i].len & 0xFF;
+                memcpy(out, nals[i].data, nals[i].len);
+                out += nals[i].len;
+        }
+        pkt->data_len = out - aggregation_hdr;
+        *agg_len += pkt->data_len;
+}
+
+/**
+ * Splits a NAL unit larger than max_len to FU-A (H.264) or FU (HEVC) packets.
+ */
+static void h26x_add_fragmented(struct tx *tx, int *count, const struct h26x_nal *nal, bool hevc, unsigned max_len)
+{
+        const unsigned nal_hdr_len = hevc ? 2 : 1;
+        const unsigned fu_hdr_len = nal_hdr_len + 1;
+        const unsigned char *data = nal->data + nal_hdr_len; // NAL header is replaced by FU headers
+        unsigned remaining = nal->len - nal_hdr_len;
+        bool first = true;
+
+        while (remaining > 0) {
+                unsigned len = MIN(remaining, max_len - fu_hdr_len);
+                struct h26x_packet *pkt = h26x_add_packet(tx, count);
+                unsigned char fu_hdr = 0;
+                if (hevc) {
+                        pkt->hdr[0] = (nal->data[0] & 0x81) | RTP_HEVC_FU << 1; // F, LayerId MSB
+                        pkt->hdr[1] = nal->data[1]; // LayerId, TID
+                        fu_hdr = (nal->data[0] >> 1) & 0x3F;
+                } else {
+                        pkt->hdr[0] = (nal->data[0] & 0xE0) | RTP_FU_A; // FU indicator
+                        fu_hdr = nal->data[0] & 0x1F;
+                }
+                if (first) {
+                        fu_hdr |= 0x80; // S bit
+                }
+                if (len == remaining) {
+                        fu_hdr |= 0x40; // E bit
+                }
+                pkt->hdr[nal_hdr_len] = fu_hdr;
+                pkt->hdr_len = fu_hdr_len;
+                pkt->data = (const char *) data;
+                pkt->data_len = len;
+                data += len;
+                remaining -= len;
+                first = false;
+        }
+}
+
+/**
+ *  H.264 and HEVC standard transmission (RFC 6184 and RFC 7798)
+ *
+ * Frame may be fragmented (eg. a group of slices passed as soon as it is
+ * encoded) - fragments with the same frame_fragment_id share RTP timestamp
+ * and m-bit is set only on the last packet of the last fragment, so that the
+ * receiver sees the same stream as for non-fragmented frames. Every fragment
+ * must consist of complete NAL units.
+ *
+ * The NAL units are sent directly from the frame (only sequences of small
+ * units like parameter sets are copied to aggregation packets) and all packets
+ * of the frame are submitted in one batch.
  */
 void tx_send_h264(struct tx *tx, struct video_frame *frame,
 		struct rtp *rtp_session) {
+        tx_send_h264_fanout(tx, frame, &rtp_session, 1);
+}
+
+/**
+ * Same as tx_send_h264() but the frame is sent to multiple sessions. The frame
+ * is packetized only once - for every session just the RTP headers are
+ * written and the packets are submitted in a batch.
+ */
+void tx_send_h264_fanout(struct tx *tx, struct video_frame *frame,
+                struct rtp **rtp_sessions, int session_count) {
         assert(frame->tile_count == 1); // std transmit doesn't handle more than one tile
         assert(!frame->fragment || tx->fec_scheme == FEC_NONE); // currently no support for FEC with fragments
         assert(!frame->fragment || frame->tile_count); // multiple tiles are not currently supported for fragmented send
         uint32_t ts = get_std_video_local_mediatime();
+        if (frame->fragment &&
+                        tx->last_frame_fragment_id == frame->frame_fragment_id) {
+                ts = tx->last_ts;
+        } else {
+                tx->last_frame_fragment_id = frame->frame_fragment_id;
+                tx->last_ts = ts;
+        }
+        const bool last_fragment = !frame->fragment || frame->last_fragment;
+        const bool hevc = frame->color_spec == H265;
+
+        // keyframe requests (RTCP PLI/FIR) of all sessions, the sum changes
+        // with a request from any of them
+        uint32_t keyframe_req_count = 0;
+        for (int k = 0; k < session_count; ++k) {
+                uint32_t count = 0;
+                rtp_get_keyframe_request(rtp_sessions[k], &count);
+                keyframe_req_count += count;
+        }
+        if (keyframe_req_count != tx->keyframe_req_count) {
+                tx->keyframe_req_count = keyframe_req_count;
+                tx_request_keyframe(tx);
+        }
         struct tile *tile = &frame->tiles[0];
 
-	char pt =  PT_DynRTP_Type96;
-	unsigned char hdr[2];
-	int cc = 0;
-	uint32_t csrc = 0;
-	int m = 0;
-	char *extn = 0;
-	uint16_t extn_len = 0;
-	uint16_t extn_type = 0;
-	const uint8_t *start = (uint8_t *) tile->data;
-	int data_len = tile->data_len;
-	unsigned maxPacketSize = tx->mtu - 40;
-
-        const unsigned char *endptr = 0;
-        const unsigned char *nal = start;
+        char pt = PT_DynRTP_Type96;
+        const unsigned char *start = (uint8_t *) tile->data;
+        const long data_len = tile->data_len;
+        const unsigned maxPacketSize = tx->mtu - 40;
+        const unsigned agg_hdr_len = hevc ? 2 : 1;
+        const unsigned min_nal_len = hevc ? 3 : 2; // NAL header + some payload
 
+        // find all NAL units first
+        int nal_count = 0;
+        const unsigned char *endptr = start;
+        const unsigned char *nal = start;
         while ((nal = rtpenc_h264_get_next_nal(nal, data_len - (nal - start), &endptr))) {
-                unsigned int nalsize = endptr - nal;
-                bool eof = endptr == start + data_len;
-                bool lastNALUnitFragment = false; // by default
-                unsigned curNALOffset = 0;
-                char *nalc = const_cast<char *>(reinterpret_cast<const char *>(nal));
-
-		while(!lastNALUnitFragment){
-			// We have NAL unit data in the buffer.  There are three cases to consider:
-			// 1. There is a new NAL unit in the buffer, and it's small enough to deliver
-			//    to the RTP sink (as is).
-			// 2. There is a new NAL unit in the buffer, but it's too large to deliver to
-			//    the RTP sink in its entirety.  Deliver the first fragment of this data,
-			//    as a FU packet, with one extra preceding header byte (for the "FU header").
-			// 3. There is a NAL unit in the buffer, and we've already delivered some
-			//    fragment(s) of this.  Deliver the next fragment of this data,
-			//    as a FU packet, with two (H.264) extra preceding header bytes
-			//    (for the "NAL header" and the "FU header").
-			if (curNALOffset == 0) { // case 1 or 2
-				if (nalsize	<= maxPacketSize) { // case 1
-
-					if (eof) m = 1;
-					if (rtp_send_data(rtp_session, ts, pt, m, cc, &csrc,
-							nalc, nalsize,
-							extn, extn_len, extn_type) < 0) {
-						error_msg("There was a problem sending the RTP packet\n");
-					}
-					lastNALUnitFragment = true;
-				} else { // case 2
-					// We need to send the NAL unit data as FU packets.  Deliver the first
-					// packet now.  Note that we add "NAL header" and "FU header" bytes to the front
-					// of the packet (overwriting the existing "NAL header").
-					hdr[0] = (nal[0] & 0xE0) | 28; //FU indicator
-					hdr[1] = 0x80 | (nal[0] & 0x1F); // FU header (with S bit)
-
-					if (rtp_send_data_hdr(rtp_session, ts, pt, m, cc, &csrc,
-									(char *) hdr, 2,
-									nalc + 1, maxPacketSize - 2,
-									extn, extn_len, extn_type) < 0) {
-										error_msg("There was a problem sending the RTP packet\n");
-					}
-					curNALOffset += maxPacketSize - 1;
-					lastNALUnitFragment = false;
-					nalsize -= maxPacketSize - 1;
-				}
-			} else { // case 3
-				// We are sending this NAL unit data as FU packets.  We've already sent the
-				// first packet (fragment).  Now, send the next fragment.  Note that we add
-				// "NAL header" and "FU header" bytes to the front.  (We reuse these bytes that
-				// we already sent for the first fragment, but clear the S bit, and add the E
-				// bit if this is the last fragment.)
-				hdr[1] = hdr[1] & ~0x80;// FU header (no S bit)
-
-				if (nalsize + 1 > maxPacketSize) {
-					// We can't send all of the remaining data this time:
-					if (rtp_send_data_hdr(rtp_session, ts, pt, m, cc, &csrc,
-							(char *) hdr, 2,
-							nalc + curNALOffset,
-							maxPacketSize - 2, extn, extn_len,
-							extn_type) < 0) {
-								error_msg("There was a problem sending the RTP packet\n");
-					}
-					curNALOffset += maxPacketSize - 2;
-					lastNALUnitFragment = false;
-					nalsize -= maxPacketSize - 2;
-
-				} else {
-					// This is the last fragment:
-					if (eof) m = 1;
-
-					hdr[1] |= 0x40;// set the E bit in the FU header
-
-					if (rtp_send_data_hdr(rtp_session, ts, pt, m, cc, &csrc,
-									(char *) hdr, 2,
-									nalc + curNALOffset,
-									nalsize, extn, extn_len, extn_type) < 0) {
-										error_msg("There was a problem sending the RTP packet\n");
-					}
-					lastNALUnitFragment = true;
-				}
-			}
-		}
-	}
-        if (endptr != start + data_len) {
+                if ((size_t) nal_count == tx->h26x_nals_len) {
+                        tx->h26x_nals_len = MAX(64, 2 * tx->h26x_nals_len);
+                        tx->h26x_nals = (struct h26x_nal *) realloc(tx->h26x_nals,
+                                        tx->h26x_nals_len * sizeof(struct h26x_nal));
+                }
+                if (endptr - nal >= min_nal_len) {
+                        tx->h26x_nals[nal_count++] = { nal, (unsigned) (endptr - nal) };
+                }
+                nal = endptr;
+        }
+        if (endptr != start + data_len || nal_count == 0) {
                 error_msg("No NAL found!\n");
         }
+
+        // plan the packets
+        int packet_count = 0;
+        size_t agg_len = 0;
+        for (int i = 0; i < nal_count; ) {
+                int j = i;
+                unsigned agg_size = agg_hdr_len;
+                while (j < nal_count && agg_size + 2 + tx->h26x_nals[j].len <= maxPacketSize) {
+                        agg_size += 2 + tx->h26x_nals[j++].len;
+                }
+                if (j - i >= 2) {
+                        h26x_add_aggregation(tx, &packet_count, &tx->h26x_nals[i], j - i, hevc, &agg_len);
+                        i = j;
+                        continue;
+                }
+                if (tx->h26x_nals[i].len <= maxPacketSize) {
+                        struct h26x_packet *pkt = h26x_add_packet(tx, &packet_count);
+                        pkt->data = (const char *) tx->h26x_nals[i].data;
+                        pkt->data_len = tx->h26x_nals[i].len;
+                } else {
+                        h26x_add_fragmented(tx, &packet_count, &tx->h26x_nals[i], hevc, maxPacketSize);
+                }
+                i += 1;
+        }
+
+        for (int k = 0; k < session_count; ++k) {
+                struct rtp *rtp_session = rtp_sessions[k];
+                rtp_async_start(rtp_session, packet_count);
+                for (int i = 0; i < packet_count; ++i) {
+                        struct h26x_packet *pkt = &tx->h26x_packets[i];
+                        int m = last_fragment && i == packet_count - 1;
+                        char *data = pkt->data ? const_cast<char *>(pkt->data) : tx->h26x_agg_buffer + pkt->agg_offset;
+                        if (rtp_send_data_hdr(rtp_session, ts, pt, m, 0, nullptr,
+                                                pkt->hdr_len > 0 ? (char *) pkt->hdr : nullptr, pkt->hdr_len,
+                                                data, pkt->data_len, nullptr, 0, 0) < 0) {
+                                error_msg("There was a problem sending the RTP packet\n");
+                        }
+                }
+                rtp_async_wait(rtp_session);
+        }
 }
 
+/**
+ * Standard RTP/JPEG transmission (RFC 2435)
+ *
+ * Scan data is referenced directly from the frame (only the few bytes of
+ * RTP/JPEG headers are stored per packet) and all packets of the frame are
+ * submitted in one batch.
+ */
 void tx_send_jpeg(struct tx *tx, struct video_frame *frame,
                struct rtp *rtp_session) {
         uint32_t ts = 0;
@@ -1144,24 +2066,36 @@ void tx_send_jpeg(struct tx *tx, struct video_frame *frame,
         int bytes_left = tile->data_len - ((char *) d.data - tile->data);
         int max_mtu = tx->mtu - ((rtp_is_ipv6(rtp_session) ? 40 : 20) + 8 + 12); // IP hdr size + UDP hdr size + RTP hdr size
 
+        // the payload is sent directly from the frame, only the headers of
+        // subsequent packets (differing in fragment offset) are stored
+        const int first_hdr_len = hdr_off * sizeof(uint32_t);
+        const int next_hdr_len = 8 + (d.restart_interval > 0 ? 4 : 0);
+        const int first_data_len = MIN(bytes_left, max_mtu - first_hdr_len);
+        const int next_max_data_len = max_mtu - next_hdr_len;
+        const int packet_count = 1 + (bytes_left - first_data_len + next_max_data_len - 1) / next_max_data_len;
+        if ((size_t) packet_count > tx->jpeg_hdrs_len) {
+                tx->jpeg_hdrs_len = MAX(64, packet_count);
+                free(tx->jpeg_hdrs);
+                tx->jpeg_hdrs = (uint32_t (*)[3]) malloc(tx->jpeg_hdrs_len * sizeof tx->jpeg_hdrs[0]);
+        }
+
+        rtp_async_start(rtp_session, packet_count);
         int fragment_offset = 0;
-        do {
-                int hdr_len;
-                if (fragment_offset == 0) { // include quantization header only in 1st pkt
-                        hdr_len = hdr_off * sizeof(uint32_t);
-                } else {
-                        hdr_len = 8 + (d.restart_interval > 0 ? 4 : 0);
-                }
-                int data_len = max_mtu - hdr_len;
-                int m = 0;
-                if (bytes_left <= data_len) {
-                        data_len = bytes_left;
-                        m = 1;
+        for (int i = 0; i < packet_count; ++i) {
+                uint32_t *hdr = jpeg_hdr;
+                int hdr_len = first_hdr_len;
+                int data_len = first_data_len;
+                if (i > 0) { // include quantization header only in 1st pkt
+                        hdr = tx->jpeg_hdrs[i];
+                        hdr_len = next_hdr_len;
+                        memcpy(hdr, jpeg_hdr, hdr_len);
+                        data_len = MIN(bytes_left, next_max_data_len);
                 }
-                jpeg_hdr[0] = htonl(type_spec << 24u | fragment_offset);
+                hdr[0] = htonl(type_spec << 24u | fragment_offset);
+                int m = i == packet_count - 1;
 
                 int ret = rtp_send_data_hdr(rtp_session, ts, pt, m, 0, 0,
-                                (char *) &jpeg_hdr, hdr_len,
+                                (char *) hdr, hdr_len,
                                 data, data_len, 0, 0, 0);
                 if (ret < 0) {
                         log_msg(LOG_LEVEL_ERROR, "Error sending RTP/JPEG packet!\n");
@@ -1169,7 +2103,8 @@ void tx_send_jpeg(struct tx *tx, struct video_frame *frame,
                 data += data_len;
                 bytes_left -= data_len;
                 fragment_offset += data_len;
-        } while (bytes_left > 0);
+        }
+        rtp_async_wait(rtp_session);
 }
 
 int tx_get_buffer_id(struct tx *tx)
@@ -50,9 +50,18 @@
 #include "debug.h"
 #include "crypto/random.h"
 #include "tv.h"
+#include "utils/ptp_clock.h"
 
+/**
+ * @returns current media time (90 kHz) - randomly offset system time or, with
+ * the PTP clock enabled, PTP time (common to synchronized hosts)
+ */
 uint32_t get_local_mediatime(void)
 {
+        if (ptp_clock_enabled()) {
+                return ptp_to_mediatime(ptp_clock_get_ns());
+        }
+
         static struct timeval start_time;
         static uint32_t random_offset;
         static int first = 0;
@@ -69,6 +78,14 @@ uint32_t get_local_mediatime(void)
         return (tv_diff(curr_time, start_time) * 90000) + random_offset;
 }
 
+/**
+ * Converts PTP time (ns) to 90 kHz media time (wrapped to 32 bits).
+ */
+uint32_t ptp_to_mediatime(time_ns_t ptp_ns)
+{
+        return (uint64_t) ptp_ns / NS_IN_US * 9 / 100;
+}
+
 double tv_diff(struct timeval curr_time, struct timeval prev_time)
 {
         /* Return (curr_time - prev_time) in seconds */
@@ -72,6 +72,7 @@ uint32_t get_std_audio_local_mediatime(double samples, int rate);
 uint32_t get_std_video_local_mediatime(void);
 
 typedef long long time_ns_t;
+uint32_t ptp_to_mediatime(time_ns_t ptp_ns);
 #define US_IN_SEC 1000000LL
 #define US_IN_SEC_DBL ((double) US_IN_SEC)
 #define NS_IN_SEC 1000000000LL
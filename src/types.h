@@ -88,6 +88,7 @@ typedef enum {
         J2K,      ///< JPEG 2000
         J2KR,     ///< JPEG 2000 RGB
         HW_VDPAU, ///< VDPAU hardware surface
+        HW_VAAPI, ///< VAAPI hardware surface
         RPI4_8,   ///< Raspberry pi 4 hw decoded (SAND)
         HFYU,     ///< HuffYUV
         FFV1,     ///< FFV1
@@ -104,6 +105,11 @@ typedef enum {
         PRORES_422,       ///< Apple ProRes 422
         PRORES_422_PROXY, ///< Apple ProRes 422 (Proxy)
         PRORES_422_LT,    ///< Apple ProRes 422 (LT)
+        CUDA_RGBA,        ///< RGBA in CUDA device memory (see @ref codec_is_gpu_resident)
+        CUDA_UYVY,        ///< UYVY in CUDA device memory
+        CUDA_DXT1,        ///< DXT1 in CUDA device memory
+        CUDA_DXT5,        ///< DXT5 YCoCg in CUDA device memory
+        HW_VTB,           ///< VideoToolbox (IOSurface-backed) CVPixelBuffer, see hw_vtb_frame
         VIDEO_CODEC_COUNT, ///< count of known video codecs (including VIDEO_CODEC_NONE)
         VIDEO_CODEC_END = VIDEO_CODEC_COUNT
 } codec_t;
@@ -253,6 +259,35 @@ enum mem_location_t {
         CUDA_MEM
 };
 
+/**
+ * @brief Stages of the video pipeline stamped in @ref frame_trace
+ * @see utils/frame_trace.h
+ */
+enum frame_trace_stage {
+        FT_CAPTURE,        ///< frame grabbed by vidcap
+        FT_FILTER,         ///< capture filters applied
+        FT_COMPRESS_IN,    ///< frame passed to compress_frame()
+        FT_COMPRESS_OUT,   ///< compressed frame returned by the compressor
+        FT_TX_FIRST,       ///< first packet sent
+        FT_TX_LAST,        ///< last packet sent
+        FT_SENDER_STAGES,  ///< number of sender stages (transmitted to the receiver)
+        FT_RX_FIRST = FT_SENDER_STAGES, ///< first packet received
+        FT_RX_LAST,        ///< last packet received
+        FT_PBUF_COMPLETE,  ///< frame passed from playout buffer to the decoder
+        FT_FEC_DONE,       ///< FEC decoded (or skipped)
+        FT_DECOMPRESS_DONE,///< frame decompressed
+        FT_DISPLAY_PUT,    ///< frame passed to the display
+        FT_STAGE_COUNT
+};
+
+/**
+ * Per-frame latency trace - wall-clock timestamps (ns, see get_time_in_ns())
+ * of the pipeline stages, 0 if the stage was not (yet) stamped.
+ */
+struct frame_trace {
+        long long ts[FT_STAGE_COUNT];
+};
+
 /**
  * @brief Struct video_frame represents a video frame and contains video description.
  */
@@ -287,6 +322,9 @@ struct video_frame {
         uint64_t compress_start; ///< in ms from epoch
         uint64_t compress_end; ///< in ms from epoch
         unsigned int paused_play:1;
+        struct frame_trace trace; ///< latency trace, see utils/frame_trace.h
+        long long deadline; ///< target presentation time (ns, see get_time_in_ns()), 0 if unknown
+        int temporal_layer; ///< temporal layer of a compressed frame (0 - base), see libavcodec temporal_layers
 #define VF_METADATA_END tile_count
 
         /// tiles contain actual video frame data. A frame usually contains exactly one
@@ -175,7 +175,14 @@ void audio_buffer_write(struct audio_buffer *buf, const char *in, int len)
         } else {
                 buf->in_pkt_size = len;
         }
-        ring_buffer_write(buf->ring, in, len);
+        if (ring_buffer_try_write(buf->ring, in, len) < len) {
+                log_msg(LOG_LEVEL_WARNING, "Audio buffer overflow, dropped %lld B!\n", ring_buffer_fetch_dropped(buf->ring));
+        }
+}
+
+int audio_buffer_get_fill(struct audio_buffer *buf)
+{
+        return ring_get_current_size(buf->ring) / (buf->desc.bps * buf->desc.ch_count);
 }
 
 struct audio_buffer_api audio_buffer_fns = {
@@ -184,3 +191,69 @@ struct audio_buffer_api audio_buffer_fns = {
         (void (*)(void *, const char *, int)) audio_buffer_write,
 };
 
+
+struct audio_pull_buffer {
+        ring_buffer_t *ring;
+        int frame_size; ///< bytes per sample (all channels)
+        int in_len;     ///< length of the last written frame [B]
+        int out_len;    ///< length of the last read [B]
+        bool priming;
+};
+
+struct audio_pull_buffer *audio_pull_buffer_init(int sample_rate, int bps, int ch_count, int max_len_ms)
+{
+        struct audio_pull_buffer *buf = calloc(1, sizeof(struct audio_pull_buffer));
+        buf->frame_size = bps * ch_count;
+        buf->ring = ring_buffer_init(buf->frame_size * sample_rate * max_len_ms / 1000);
+        buf->priming = true;
+        return buf;
+}
+
+void audio_pull_buffer_destroy(struct audio_pull_buffer *buf)
+{
+        if (!buf) {
+                return;
+        }
+        ring_buffer_destroy(buf->ring);
+        free(buf);
+}
+
+int audio_pull_buffer_read(struct audio_pull_buffer *buf, char *out, int max_len)
+{
+        buf->out_len = max_len;
+        if (buf->priming) {
+                if (ring_get_current_size(buf->ring) < buf->in_len + max_len) {
+                        return 0;
+                }
+                buf->priming = false;
+        }
+        int ret = ring_buffer_read(buf->ring, out, max_len);
+        if (ret < max_len) {
+                buf->priming = true;
+        }
+        return ret;
+}
+
+void audio_pull_buffer_write(struct audio_pull_buffer *buf, const char *in, int len)
+{
+        buf->in_len = len;
+        if (ring_buffer_try_write(buf->ring, in, len) < len) {
+                log_msg(LOG_LEVEL_WARNING, "Audio buffer overflow, dropped %lld B!\n", ring_buffer_fetch_dropped(buf->ring));
+        }
+}
+
+int audio_pull_buffer_get_fill(struct audio_pull_buffer *buf)
+{
+        return ring_get_current_size(buf->ring) / buf->frame_size;
+}
+
+int audio_pull_buffer_get_period(struct audio_pull_buffer *buf)
+{
+        return buf->out_len / buf->frame_size;
+}
+
+struct audio_buffer_api audio_pull_buffer_fns = {
+        (void (*)(void *)) audio_pull_buffer_destroy,
+        (int (*)(void *, char *, int)) audio_pull_buffer_read,
+        (void (*)(void *, const char *, int)) audio_pull_buffer_write,
+};
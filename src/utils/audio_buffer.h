@@ -49,6 +49,8 @@ struct audio_buffer *audio_buffer_init(int sample_rate, int bps, int ch_count, i
 void audio_buffer_destroy(struct audio_buffer *buf);
 int audio_buffer_read(struct audio_buffer *buf, char *out, int max_len);
 void audio_buffer_write(struct audio_buffer *buf, const char *in, int len);
+/// @returns buffered samples (per channel), can be called from both reader and writer
+int audio_buffer_get_fill(struct audio_buffer *buf);
 
 // used also for ring buffer;
 struct audio_buffer_api {
@@ -59,6 +61,26 @@ struct audio_buffer_api {
 
 extern struct audio_buffer_api audio_buffer_fns;
 
+/**
+ * Buffer for the pull-mode playback (see AUDIO_PLAYBACK_CTL_PULL) - the device
+ * callback reads directly from a lock-free ring buffer (wait-free, doesn't
+ * allocate) without any adaptive dropping, the fill is controlled by the
+ * receiver jitter buffer. At start and after an underrun, reads return no
+ * data until one incoming frame and one read period is buffered.
+ */
+struct audio_pull_buffer;
+
+struct audio_pull_buffer *audio_pull_buffer_init(int sample_rate, int bps, int ch_count, int max_len_ms);
+void audio_pull_buffer_destroy(struct audio_pull_buffer *buf);
+int audio_pull_buffer_read(struct audio_pull_buffer *buf, char *out, int max_len);
+void audio_pull_buffer_write(struct audio_pull_buffer *buf, const char *in, int len);
+/// @returns buffered samples (per channel), can be called from both reader and writer
+int audio_pull_buffer_get_fill(struct audio_pull_buffer *buf);
+/// @returns length of the last read in samples (per channel), 0 if none yet
+int audio_pull_buffer_get_period(struct audio_pull_buffer *buf);
+
+extern struct audio_buffer_api audio_pull_buffer_fns;
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,224 @@
+/**
+ * @file   utils/byte_scan.c
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if (defined __x86_64__ || defined __i386__) && defined __GNUC__
+#include <immintrin.h>
+#define BYTE_SCAN_AVX2 1
+#endif
+#if defined __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined __aarch64__ && defined __ARM_NEON
+#include <arm_neon.h>
+#define BYTE_SCAN_NEON 1
+#endif
+
+#include "utils/byte_scan.h"
+
+/*
+ * Both scanners evaluate the whole predicate (the byte and its neighbours)
+ * for a block of positions at once using overlapping unaligned loads, so
+ * that only real matches leave the vector loop. The scalar tail handles the
+ * rest of the buffer (and everything on platforms without SIMD).
+ */
+
+static const unsigned char *find_start_code_scalar(const unsigned char *p, const unsigned char *end)
+{
+        for ( ; p < end; ++p) {
+                if (p[0] == 1 && p[-1] == 0 && p[-2] == 0) {
+                        return p;
+                }
+        }
+        return NULL;
+}
+
+static const unsigned char *find_jpeg_marker_scalar(const unsigned char *p, const unsigned char *end)
+{
+        for ( ; p + 1 < end; ++p) {
+                if (p[0] == 0xFF && p[1] != 0) {
+                        return p;
+                }
+        }
+        return NULL;
+}
+
+#ifdef BYTE_SCAN_AVX2
+__attribute__((target("avx2")))
+static const unsigned char *find_start_code_avx2(const unsigned char *p, const unsigned char *end)
+{
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i one = _mm256_set1_epi8(1);
+        for ( ; end - p >= 32; p += 32) {
+                __m256i m = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(const void *) p), one),
+                                _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(const void *)(p - 1)), zero),
+                                        _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(const void *)(p - 2)), zero)));
+                unsigned mask = _mm256_movemask_epi8(m);
+                if (mask != 0) {
+                        return p + __builtin_ctz(mask);
+                }
+        }
+        return find_start_code_scalar(p, end);
+}
+
+__attribute__((target("avx2")))
+static const unsigned char *find_jpeg_marker_avx2(const unsigned char *p, const unsigned char *end)
+{
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i ff = _mm256_set1_epi8((char) 0xFF);
+        for ( ; end - p >= 33; p += 32) {
+                __m256i m = _mm256_andnot_si256(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(const void *)(p + 1)), zero),
+                                _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(const void *) p), ff));
+                unsigned mask = _mm256_movemask_epi8(m);
+                if (mask != 0) {
+                        return p + __builtin_ctz(mask);
+                }
+        }
+        return find_jpeg_marker_scalar(p, end);
+}
+#endif // defined BYTE_SCAN_AVX2
+
+#ifdef __SSE2__
+static const unsigned char *find_start_code_sse2(const unsigned char *p, const unsigned char *end)
+{
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i one = _mm_set1_epi8(1);
+        for ( ; end - p >= 16; p += 16) {
+                __m128i m = _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(const void *) p), one),
+                                _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(const void *)(p - 1)), zero),
+                                        _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(const void *)(p - 2)), zero)));
+                unsigned mask = _mm_movemask_epi8(m);
+                if (mask != 0) {
+                        return p + __builtin_ctz(mask);
+                }
+        }
+        return find_start_code_scalar(p, end);
+}
+
+static const unsigned char *find_jpeg_marker_sse2(const unsigned char *p, const unsigned char *end)
+{
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i ff = _mm_set1_epi8((char) 0xFF);
+        for ( ; end - p >= 17; p += 16) {
+                __m128i m = _mm_andnot_si128(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(const void *)(p + 1)), zero),
+                                _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(const void *) p), ff));
+                unsigned mask = _mm_movemask_epi8(m);
+                if (mask != 0) {
+                        return p + __builtin_ctz(mask);
+                }
+        }
+        return find_jpeg_marker_scalar(p, end);
+}
+#endif // defined __SSE2__
+
+#ifdef BYTE_SCAN_NEON
+/// @returns index of first non-zero byte of m or -1
+static inline int neon_first_set(uint8x16_t m)
+{
+        // narrowing shift packs every byte of the mask to a nibble
+        uint64_t bits = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+        return bits == 0 ? -1 : __builtin_ctzll(bits) / 4;
+}
+
+static const unsigned char *find_start_code_neon(const unsigned char *p, const unsigned char *end)
+{
+        for ( ; end - p >= 16; p += 16) {
+                uint8x16_t m = vandq_u8(vceqq_u8(vld1q_u8(p), vdupq_n_u8(1)),
+                                vandq_u8(vceqzq_u8(vld1q_u8(p - 1)), vceqzq_u8(vld1q_u8(p - 2))));
+                int idx = neon_first_set(m);
+                if (idx >= 0) {
+                        return p + idx;
+                }
+        }
+        return find_start_code_scalar(p, end);
+}
+
+static const unsigned char *find_jpeg_marker_neon(const unsigned char *p, const unsigned char *end)
+{
+        for ( ; end - p >= 17; p += 16) {
+                uint8x16_t m = vandq_u8(vceqq_u8(vld1q_u8(p), vdupq_n_u8(0xFF)), vtstq_u8(vld1q_u8(p + 1), vld1q_u8(p + 1)));
+                int idx = neon_first_set(m);
+                if (idx >= 0) {
+                        return p + idx;
+                }
+        }
+        return find_jpeg_marker_scalar(p, end);
+}
+#endif // defined BYTE_SCAN_NEON
+
+const unsigned char *find_start_code(const unsigned char *start, const unsigned char *end)
+{
+        if (end - start < 3) {
+                return NULL;
+        }
+        const unsigned char *p = start + 2;
+#ifdef BYTE_SCAN_AVX2
+        if (__builtin_cpu_supports("avx2")) {
+                return find_start_code_avx2(p, end);
+        }
+#endif
+#if defined __SSE2__
+        return find_start_code_sse2(p, end);
+#elif defined BYTE_SCAN_NEON
+        return find_start_code_neon(p, end);
+#else
+        return find_start_code_scalar(p, end);
+#endif
+}
+
+const unsigned char *find_jpeg_marker(const unsigned char *start, const unsigned char *end)
+{
+#ifdef BYTE_SCAN_AVX2
+        if (__builtin_cpu_supports("avx2")) {
+                return find_jpeg_marker_avx2(start, end);
+        }
+#endif
+#if defined __SSE2__
+        return find_jpeg_marker_sse2(start, end);
+#elif defined BYTE_SCAN_NEON
+        return find_jpeg_marker_neon(start, end);
+#else
+        return find_jpeg_marker_scalar(start, end);
+#endif
+}
@@ -0,0 +1,66 @@
+/**
+ * @file   utils/byte_scan.h
+ *
+ * Vectorized search for start codes/markers in compressed bitstreams.
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_BYTE_SCAN_H_5C0F2A8E_6B1D_4E59_A3E2_0D9B3F4C7A61
+#define UTILS_BYTE_SCAN_H_5C0F2A8E_6B1D_4E59_A3E2_0D9B3F4C7A61
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Finds first byte 0x01 preceded by two zero bytes (H.264/HEVC start code
+ * 00 00 01) within [start + 2, end).
+ *
+ * @returns pointer to the 0x01 byte or NULL if not found
+ */
+const unsigned char *find_start_code(const unsigned char *start, const unsigned char *end);
+
+/**
+ * Finds first 0xFF followed by a non-zero byte (JPEG marker or fill byte,
+ * stuffed 0xFF 0x00 is skipped) within [start, end - 1).
+ *
+ * @returns pointer to the 0xFF byte or NULL if not found
+ */
+const unsigned char *find_jpeg_marker(const unsigned char *start, const unsigned char *end);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // defined UTILS_BYTE_SCAN_H_5C0F2A8E_6B1D_4E59_A3E2_0D9B3F4C7A61
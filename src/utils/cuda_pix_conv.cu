@@ -4,6 +4,8 @@
 #include <cuda_runtime.h>
 #include <time.h>
 
+#include "utils/cuda_pix_conv.h"
+
         __global__
 void kern_RGBtoRGBA(unsigned char *dst,
                 size_t dstPitch,
@@ -29,6 +31,31 @@ void kern_RGBtoRGBA(unsigned char *dst,
         *dst_px = make_uchar4(px.x, px.y, px.z, 0);
 }
 
+        __global__
+void kern_BGRAtoRGBA(unsigned char *dst,
+                size_t dstPitch,
+                unsigned char *src,
+                size_t srcPitch,
+                size_t width,
+                size_t height)
+{
+        const int x = (blockIdx.x * blockDim.x) + threadIdx.x;
+        const int y = (blockIdx.y * blockDim.y) + threadIdx.y;
+
+        if(x >= width)
+                return;
+
+        if(y >= height)
+                return;
+
+        uchar4 *src_px = (uchar4 *) (src + y * srcPitch) + x;
+        uchar4 *dst_px = (uchar4 *) (dst + y * dstPitch) + x;
+
+        const uchar4 px = *src_px;
+
+        *dst_px = make_uchar4(px.z, px.y, px.x, px.w);
+}
+
         __global__
 void kern_RGBAtoRGB(unsigned char *dst,
                 size_t dstPitch,
@@ -164,6 +191,21 @@ void cuda_RGBA_to_RGB(unsigned char *dst,
         kern_RGBAtoRGB<<<numBlocks, blockSize, 0, stream>>>(dst, dstPitch, src, srcPitch, width, height);
 }
 
+void cuda_BGRA_to_RGBA(unsigned char *dst,
+                size_t dstPitch,
+                unsigned char *src,
+                size_t srcPitch,
+                size_t width,
+                size_t height,
+                CUstream_st *stream){
+
+        dim3 blockSize(32,32);
+        dim3 numBlocks((width + blockSize.x - 1) / blockSize.x,
+                        (height + blockSize.y - 1) / blockSize.y);
+
+        kern_BGRAtoRGBA<<<numBlocks, blockSize, 0, stream>>>(dst, dstPitch, src, srcPitch, width, height);
+}
+
 void cuda_RGBA_to_UYVY(unsigned char *dst,
                 size_t dstPitch,
                 unsigned char *src,
@@ -193,3 +235,690 @@ void cuda_UYVY_to_RGBA(unsigned char *dst,
 
         kern_UYVYtoRGBA<<<numBlocks, blockSize, 0, stream>>>(dst, dstPitch, src, srcPitch, width, height);
 }
+
+static dim3 get_grid_size(size_t threads_x, size_t threads_y, dim3 blockSize)
+{
+        return dim3((threads_x + blockSize.x - 1) / blockSize.x,
+                        (threads_y + blockSize.y - 1) / blockSize.y);
+}
+
+/*
+ * 10-bit YUV 4:2:2 (v210) - a thread processes one 6-pixel group (16 B)
+ */
+__device__ static inline unsigned v210_comp(uint32_t w, int i)
+{
+        return (w >> (10 * i)) & 0x3FFU;
+}
+
+/// unpacks a v210 group to 6 luma and 3+3 chroma 10-bit samples
+__device__ static inline void v210_unpack(const uint32_t *s, unsigned *yy, unsigned *u, unsigned *v)
+{
+        const uint32_t w0 = s[0];
+        const uint32_t w1 = s[1];
+        const uint32_t w2 = s[2];
+        const uint32_t w3 = s[3];
+        u[0] = v210_comp(w0, 0); yy[0] = v210_comp(w0, 1); v[0] = v210_comp(w0, 2);
+        yy[1] = v210_comp(w1, 0); u[1] = v210_comp(w1, 1); yy[2] = v210_comp(w1, 2);
+        v[1] = v210_comp(w2, 0); yy[3] = v210_comp(w2, 1); u[2] = v210_comp(w2, 2);
+        yy[4] = v210_comp(w3, 0); v[2] = v210_comp(w3, 1); yy[5] = v210_comp(w3, 2);
+}
+
+__device__ static inline void v210_pack(uint32_t *d, const unsigned *yy, const unsigned *u, const unsigned *v)
+{
+        d[0] = u[0] | yy[0] << 10U | v[0] << 20U;
+        d[1] = yy[1] | u[1] << 10U | yy[2] << 20U;
+        d[2] = v[1] | yy[3] << 10U | u[2] << 20U;
+        d[3] = yy[4] | v[2] << 10U | yy[5] << 20U;
+}
+
+__global__
+void kern_v210toUYVY(unsigned char *dst, size_t dstPitch, unsigned char *src, size_t srcPitch,
+                size_t width, size_t height)
+{
+        const int x = (blockIdx.x * blockDim.x) + threadIdx.x;
+        const int y = (blockIdx.y * blockDim.y) + threadIdx.y;
+
+        if (x * 6 >= width || y >= height)
+                return;
+
+        unsigned yy[6], u[3], v[3];
+        v210_unpack((const uint32_t *) (src + y * srcPitch) + x * 4, yy, u, v);
+        uchar4 *dst_px = (uchar4 *) (dst + y * dstPitch) + x * 3;
+        for (int i = 0; i < 3 && x * 6 + i * 2 < width; ++i) {
+                dst_px[i] = make_uchar4(u[i] >> 2, yy[2 * i] >> 2, v[i] >> 2, yy[2 * i + 1] >> 2);
+        }
+}
+
+__global__
+void kern_UYVYtov210(unsigned char *dst, size_t dstPitch, unsigned char *src, size_t srcPitch,
+                size_t width, size_t height)
+{
+        const int x = (blockIdx.x * blockDim.x) + threadIdx.x;
+        const int y = (blockIdx.y * blockDim.y) + threadIdx.y;
+
+        if (x * 6 >= width || y >= height)
+                return;
+
+        const int last = (width + 1) / 2 - 1;
+        const uchar4 *src_px = (const uchar4 *) (src + y * srcPitch);
+        unsigned yy[6], u[3], v[3];
+        for (int i = 0; i < 3; ++i) {
+                const uchar4 block = src_px[min(x * 3 + i, last)];
+                u[i] = block.x << 2;
+                yy[2 * i] = block.y << 2;
+                v[i] = block.z << 2;
+                yy[2 * i + 1] = block.w << 2;
+        }
+        v210_pack((uint32_t *) (dst + y * dstPitch) + x * 4, yy, u, v);
+}
+
+__global__
+void kern_v210toY416(unsigned char *dst, size_t dstPitch, unsigned char *src, size_t srcPitch,
+                size_t width, size_t height)
+{
+        const int x = (blockIdx.x * blockDim.x) + threadIdx.x;
+        const int y = (blockIdx.y * blockDim.y) + threadIdx.y;
+
+        if (x * 6 >= width || y >= height)
+                return;
+
+        unsigned yy[6], u[3], v[3];
+        v210_unpack((const uint32_t *) (src + y * srcPitch) + x * 4, yy, u, v);
+        ushort4 *dst_px = (ushort4 *) (dst + y * dstPitch) + x * 6;
+        for (int i = 0; i < 6 && x * 6 + i < width; ++i) {
+                dst_px[i] = make_ushort4(u[i / 2] << 6, yy[i] << 6, v[i / 2] << 6, 0xFFFFU);
+        }
+}
+
+__global__
+void kern_Y416tov210(unsigned char *dst, size_t dstPitch, unsigned char *src, size_t srcPitch,
+                size_t width, size_t height)
+{
+        const int x = (blockIdx.x * blockDim.x) + threadIdx.x;
+        const int y = (blockIdx.y * blockDim.y) + threadIdx.y;
+
+        if (x * 6 >= width || y >= height)
+                return;
+
+        const ushort4 *src_px = (const ushort4 *) (src + y * srcPitch);
+        unsigned yy[6], u[3], v[3];
+        for (int i = 0; i < 3; ++i) {
+                const ushort4 a = src_px[min(x * 6 + 2 * i, (int) width - 1)];
+                const ushort4 b = src_px[min(x * 6 + 2 * i + 1, (int) width - 1)];
+                u[i] = (a.x + b.x) / 2 >> 6;
+                yy[2 * i] = a.y >> 6;
+                v[i] = (a.z + b.z) / 2 >> 6;
+                yy[2 * i + 1] = b.y >> 6;
+        }
+        v210_pack((uint32_t *) (dst + y * dstPitch) + x * 4, yy, u, v);
+}
+
+/*
+ * UYVY <-> Y416 - a thread processes one UYVY macropixel
+ */
+__global__
+void kern_UYVYtoY416(unsigned char *dst, size_t dstPitch, unsigned char *src, size_t srcPitch,
+                size_t width, size_t height)
+{
+        const int x = (blockIdx.x * blockDim.x) + threadIdx.x;
+        const int y = (blockIdx.y * blockDim.y) + threadIdx.y;
+
+        if (x * 2 >= width || y >= height)
+                return;
+
+        const uchar4 block = ((const uchar4 *) (src + y * srcPitch))[x];
+        ushort4 *dst_px = (ushort4 *) (dst + y * dstPitch) + x * 2;
+        dst_px[0] = make_ushort4(block.x << 8, block.y << 8, block.z << 8, 0xFFFFU);
+        if (x * 2 + 1 < width) {
+                dst_px[1] = make_ushort4(block.x << 8, block.w << 8, block.z << 8, 0xFFFFU);
+        }
+}
+
+__global__
+void kern_Y416toUYVY(unsigned char *dst, size_t dstPitch, unsigned char *src, size_t srcPitch,
+                size_t width, size_t height)
+{
+        const int x = (blockIdx.x * blockDim.x) + threadIdx.x;
+        const int y = (blockIdx.y * blockDim.y) + threadIdx.y;
+
+        if (x * 2 >= width || y >= height)
+                return;
+
+        const ushort4 *src_px = (const ushort4 *) (src + y * srcPitch);
+        const ushort4 a = src_px[x * 2];
+        const ushort4 b = src_px[min(x * 2 + 1, (int) width - 1)];
+        ((uchar4 *) (dst + y * dstPitch))[x] = make_uchar4((a.x + b.x) / 2 >> 8, a.y >> 8,
+                        (a.z + b.z) / 2 >> 8, b.y >> 8);
+}
+
+/*
+ * Y416 <-> RG48, BT.709 limited range YCbCr <-> full range RGB
+ */
+__global__
+void kern_Y416toRG48(unsigned char *dst, size_t dstPitch, unsigned char *src, size_t srcPitch,
+                size_t width, size_t height)
+{
+        const int x = (blockIdx.x * blockDim.x) + threadIdx.x;
+        const int y = (blockIdx.y * blockDim.y) + threadIdx.y;
+
+        if (x >= width || y >= height)
+                return;
+
+        const ushort4 px = ((const ushort4 *) (src + y * srcPitch))[x];
+        const float luma = (px.y - 4096.0f) / 56064.0f;
+        const float u = (px.x - 32768.0f) / 57344.0f;
+        const float v = (px.z - 32768.0f) / 57344.0f;
+        uint16_t *dst_px = (uint16_t *) (dst + y * dstPitch) + x * 3;
+        dst_px[0] = __saturatef(luma + 1.5748f * v) * 65535.0f + 0.5f;
+        dst_px[1] = __saturatef(luma - 0.1873f * u - 0.4681f * v) * 65535.0f + 0.5f;
+        dst_px[2] = __saturatef(luma + 1.8556f * u) * 65535.0f + 0.5f;
+}
+
+__global__
+void kern_RG48toY416(unsigned char *dst, size_t dstPitch, unsigned char *src, size_t srcPitch,
+                size_t width, size_t height)
+{
+        const int x = (blockIdx.x * blockDim.x) + threadIdx.x;
+        const int y = (blockIdx.y * blockDim.y) + threadIdx.y;
+
+        if (x >= width || y >= height)
+                return;
+
+        const uint16_t *src_px = (const uint16_t *) (src + y * srcPitch) + x * 3;
+        const float r = src_px[0] / 65535.0f;
+        const float g = src_px[1] / 65535.0f;
+        const float b = src_px[2] / 65535.0f;
+        const float luma = 4096.0f + 56064.0f * (0.2126f * r + 0.7152f * g + 0.0722f * b);
+        const float u = 32768.0f + 57344.0f * (-0.1146f * r - 0.3854f * g + 0.5f * b);
+        const float v = 32768.0f + 57344.0f * (0.5f * r - 0.4542f * g - 0.0458f * b);
+        ((ushort4 *) (dst + y * dstPitch))[x] = make_ushort4(u + 0.5f, luma + 0.5f, v + 0.5f, 0xFFFFU);
+}
+
+/*
+ * R10k (big-endian RGBX 10-bit) <-> RG48 - a thread processes one pixel
+ */
+__global__
+void kern_R10ktoRG48(unsigned char *dst, size_t dstPitch, unsigned char *src, size_t srcPitch,
+                size_t width, size_t height)
+{
+        const int x = (blockIdx.x * blockDim.x) + threadIdx.x;
+        const int y = (blockIdx.y * blockDim.y) + threadIdx.y;
+
+        if (x >= width || y >= height)
+                return;
+
+        const uchar4 px = ((const uchar4 *) (src + y * srcPitch))[x];
+        uint16_t *dst_px = (uint16_t *) (dst + y * dstPitch) + x * 3;
+        dst_px[0] = (px.x << 2 | px.y >> 6) << 6;
+        dst_px[1] = ((px.y & 0x3FU) << 4 | px.z >> 4) << 6;
+        dst_px[2] = ((px.z & 0xFU) << 6 | px.w >> 2) << 6;
+}
+
+__global__
+void kern_RG48toR10k(unsigned char *dst, size_t dstPitch, unsigned char *src, size_t srcPitch,
+                size_t width, size_t height)
+{
+        const int x = (blockIdx.x * blockDim.x) + threadIdx.x;
+        const int y = (blockIdx.y * blockDim.y) + threadIdx.y;
+
+        if (x >= width || y >= height)
+                return;
+
+        const uint16_t *src_px = (const uint16_t *) (src + y * srcPitch) + x * 3;
+        const unsigned r = src_px[0] >> 6;
+        const unsigned g = src_px[1] >> 6;
+        const unsigned b = src_px[2] >> 6;
+        ((uchar4 *) (dst + y * dstPitch))[x] = make_uchar4(r >> 2, (r & 0x3U) << 6 | g >> 4,
+                        (g & 0xFU) << 4 | b >> 6, (b & 0x3FU) << 2 | 0x3U);
+}
+
+/*
+ * R12L (8 pixels packed to 36 B little-endian) <-> RG48 - a thread
+ * processes one 8-pixel group
+ */
+__global__
+void kern_R12LtoRG48(unsigned char *dst, size_t dstPitch, unsigned char *src, size_t srcPitch,
+                size_t width, size_t height)
+{
+        const int x = (blockIdx.x * blockDim.x) + threadIdx.x;
+        const int y = (blockIdx.y * blockDim.y) + threadIdx.y;
+
+        if (x * 8 >= width || y >= height)
+                return;
+
+        const unsigned char *s = src + y * srcPitch + x * 36;
+        uint16_t *dst_px = (uint16_t *) (dst + y * dstPitch) + x * 8 * 3;
+        const int count = min((int) width - x * 8, 8) * 3;
+        for (int i = 0; i < count; i += 2) {
+                const unsigned char *b = s + i / 2 * 3;
+                dst_px[i] = (b[0] | (b[1] & 0xFU) << 8) << 4;
+                if (i + 1 < count) {
+                        dst_px[i + 1] = (b[1] >> 4 | b[2] << 4) << 4;
+                }
+        }
+}
+
+__global__
+void kern_RG48toR12L(unsigned char *dst, size_t dstPitch, unsigned char *src, size_t srcPitch,
+                size_t width, size_t height)
+{
+        const int x = (blockIdx.x * blockDim.x) + threadIdx.x;
+        const int y = (blockIdx.y * blockDim.y) + threadIdx.y;
+
+        if (x * 8 >= width || y >= height)
+                return;
+
+        const uint16_t *src_line = (const uint16_t *) (src + y * srcPitch);
+        unsigned char *d = dst + y * dstPitch + x * 36;
+        for (int i = 0; i < 24; i += 2) {
+                const int px_a = min(x * 8 + i / 3, (int) width - 1);
+                const int px_b = min(x * 8 + (i + 1) / 3, (int) width - 1);
+                const unsigned a = src_line[px_a * 3 + i % 3] >> 4;
+                const unsigned b = src_line[px_b * 3 + (i + 1) % 3] >> 4;
+                d[0] = a & 0xFFU;
+                d[1] = a >> 8 | (b & 0xFU) << 4;
+                d[2] = b >> 4;
+                d += 3;
+        }
+}
+
+/*
+ * RG48 <-> RGBA - a thread processes one pixel
+ */
+__global__
+void kern_RG48toRGBA(unsigned char *dst, size_t dstPitch, unsigned char *src, size_t srcPitch,
+                size_t width, size_t height)
+{
+        const int x = (blockIdx.x * blockDim.x) + threadIdx.x;
+        const int y = (blockIdx.y * blockDim.y) + threadIdx.y;
+
+        if (x >= width || y >= height)
+                return;
+
+        const uint16_t *src_px = (const uint16_t *) (src + y * srcPitch) + x * 3;
+        ((uchar4 *) (dst + y * dstPitch))[x] = make_uchar4(src_px[0] >> 8, src_px[1] >> 8, src_px[2] >> 8, 0);
+}
+
+__global__
+void kern_RGBAtoRG48(unsigned char *dst, size_t dstPitch, unsigned char *src, size_t srcPitch,
+                size_t width, size_t height)
+{
+        const int x = (blockIdx.x * blockDim.x) + threadIdx.x;
+        const int y = (blockIdx.y * blockDim.y) + threadIdx.y;
+
+        if (x >= width || y >= height)
+                return;
+
+        const uchar4 px = ((const uchar4 *) (src + y * srcPitch))[x];
+        uint16_t *dst_px = (uint16_t *) (dst + y * dstPitch) + x * 3;
+        dst_px[0] = px.x << 8 | px.x;
+        dst_px[1] = px.y << 8 | px.y;
+        dst_px[2] = px.z << 8 | px.z;
+}
+
+/*
+ * 4:2:0 (I420, NV12, P010) <-> 4:2:2/4:4:4 packed - a thread processes
+ * a 2x2 pixel block
+ */
+__global__
+void kern_420to422(unsigned char *dst, size_t dstPitch, const unsigned char *luma, size_t lumaPitch,
+                const unsigned char *cb, const unsigned char *cr, size_t chromaPitch, int chromaStep,
+                size_t width, size_t height)
+{
+        const int x = (blockIdx.x * blockDim.x) + threadIdx.x;
+        const int y = (blockIdx.y * blockDim.y) + threadIdx.y;
+
+        if (x * 2 >= width || y * 2 >= height)
+                return;
+
+        const unsigned char u = cb[y * chromaPitch + x * chromaStep];
+        const unsigned char v = cr[y * chromaPitch + x * chromaStep];
+        for (int row = y * 2; row < min(y * 2 + 2, (int) height); ++row) {
+                const unsigned char *l = luma + row * lumaPitch + x * 2;
+                ((uchar4 *) (dst + row * dstPitch))[x] = make_uchar4(u, l[0], v,
+                                x * 2 + 1 < width ? l[1] : l[0]);
+        }
+}
+
+__global__
+void kern_422to420(unsigned char *luma, size_t lumaPitch, unsigned char *cb, unsigned char *cr,
+                size_t chromaPitch, int chromaStep, const unsigned char *src, size_t srcPitch,
+                size_t width, size_t height)
+{
+        const int x = (blockIdx.x * blockDim.x) + threadIdx.x;
+        const int y = (blockIdx.y * blockDim.y) + threadIdx.y;
+
+        if (x * 2 >= width || y * 2 >= height)
+                return;
+
+        const uchar4 a = ((const uchar4 *) (src + y * 2 * srcPitch))[x];
+        const uchar4 b = ((const uchar4 *) (src + min(y * 2 + 1, (int) height - 1) * srcPitch))[x];
+        cb[y * chromaPitch + x * chromaStep] = (a.x + b.x + 1) / 2;
+        cr[y * chromaPitch + x * chromaStep] = (a.z + b.z + 1) / 2;
+        unsigned char *l = luma + y * 2 * lumaPitch + x * 2;
+        l[0] = a.y;
+        if (x * 2 + 1 < width)
+                l[1] = a.w;
+        if (y * 2 + 1 < height) {
+                l += lumaPitch;
+                l[0] = b.y;
+                if (x * 2 + 1 < width)
+                        l[1] = b.w;
+        }
+}
+
+__global__
+void kern_P010toY416(unsigned char *dst, size_t dstPitch, const unsigned char *luma, size_t lumaPitch,
+                const unsigned char *chroma, size_t chromaPitch, size_t width, size_t height)
+{
+        const int x = (blockIdx.x * blockDim.x) + threadIdx.x;
+        const int y = (blockIdx.y * blockDim.y) + threadIdx.y;
+
+        if (x >= width || y >= height)
+                return;
+
+        const ushort2 uv = ((const ushort2 *) (chroma + y / 2 * chromaPitch))[x / 2];
+        const uint16_t l = ((const uint16_t *) (luma + y * lumaPitch))[x];
+        ((ushort4 *) (dst + y * dstPitch))[x] = make_ushort4(uv.x, l, uv.y, 0xFFFFU);
+}
+
+__global__
+void kern_Y416toP010(unsigned char *luma, size_t lumaPitch, unsigned char *chroma, size_t chromaPitch,
+                const unsigned char *src, size_t srcPitch, size_t width, size_t height)
+{
+        const int x = (blockIdx.x * blockDim.x) + threadIdx.x;
+        const int y = (blockIdx.y * blockDim.y) + threadIdx.y;
+
+        if (x * 2 >= width || y * 2 >= height)
+                return;
+
+        unsigned u = 0;
+        unsigned v = 0;
+        for (int row = 0; row < 2; ++row) {
+                const int src_y = min(y * 2 + row, (int) height - 1);
+                const ushort4 *src_px = (const ushort4 *) (src + src_y * srcPitch);
+                uint16_t *l = (uint16_t *) (luma + src_y * lumaPitch);
+                for (int col = 0; col < 2; ++col) {
+                        const int src_x = min(x * 2 + col, (int) width - 1);
+                        const ushort4 px = src_px[src_x];
+                        u += px.x;
+                        v += px.z;
+                        l[src_x] = px.y & 0xFFC0U;
+                }
+        }
+        ((ushort2 *) (chroma + y * chromaPitch))[x] = make_ushort2((u + 2) / 4 & 0xFFC0U, (v + 2) / 4 & 0xFFC0U);
+}
+
+/*
+ * 10-bit planar (yuv422p10le/yuv444p10le) <-> v210/Y416
+ */
+__global__
+void kern_YUV422P10tov210(unsigned char *dst, size_t dstPitch, const unsigned char *py, size_t pitchY,
+                const unsigned char *pu, size_t pitchU, const unsigned char *pv, size_t pitchV,
+                size_t width, size_t height)
+{
+        const int x = (blockIdx.x * blockDim.x) + threadIdx.x;
+        const int y = (blockIdx.y * blockDim.y) + threadIdx.y;
+
+        if (x * 6 >= width || y >= height)
+                return;
+
+        const uint16_t *sy = (const uint16_t *) (py + y * pitchY);
+        const uint16_t *su = (const uint16_t *) (pu + y * pitchU);
+        const uint16_t *sv = (const uint16_t *) (pv + y * pitchV);
+        unsigned yy[6], u[3], v[3];
+        for (int i = 0; i < 6; ++i) {
+                yy[i] = sy[min(x * 6 + i, (int) width - 1)] & 0x3FFU;
+        }
+        for (int i = 0; i < 3; ++i) {
+                const int cx = min(x * 3 + i, ((int) width + 1) / 2 - 1);
+                u[i] = su[cx] & 0x3FFU;
+                v[i] = sv[cx] & 0x3FFU;
+        }
+        v210_pack((uint32_t *) (dst + y * dstPitch) + x * 4, yy, u, v);
+}
+
+__global__
+void kern_v210toYUV422P10(unsigned char *py, size_t pitchY, unsigned char *pu, size_t pitchU,
+                unsigned char *pv, size_t pitchV, const unsigned char *src, size_t srcPitch,
+                size_t width, size_t height)
+{
+        const int x = (blockIdx.x * blockDim.x) + threadIdx.x;
+        const int y = (blockIdx.y * blockDim.y) + threadIdx.y;
+
+        if (x * 6 >= width || y >= height)
+                return;
+
+        unsigned yy[6], u[3], v[3];
+        v210_unpack((const uint32_t *) (src + y * srcPitch) + x * 4, yy, u, v);
+        uint16_t *dy = (uint16_t *) (py + y * pitchY) + x * 6;
+        uint16_t *du = (uint16_t *) (pu + y * pitchU) + x * 3;
+        uint16_t *dv = (uint16_t *) (pv + y * pitchV) + x * 3;
+        for (int i = 0; i < 6 && x * 6 + i < width; ++i) {
+                dy[i] = yy[i];
+                if (i % 2 == 0) {
+                        du[i / 2] = u[i / 2];
+                        dv[i / 2] = v[i / 2];
+                }
+        }
+}
+
+__global__
+void kern_YUV444P10toY416(unsigned char *dst, size_t dstPitch, const unsigned char *py, size_t pitchY,
+                const unsigned char *pu, size_t pitchU, const unsigned char *pv, size_t pitchV,
+                size_t width, size_t height)
+{
+        const int x = (blockIdx.x * blockDim.x) + threadIdx.x;
+        const int y = (blockIdx.y * blockDim.y) + threadIdx.y;
+
+        if (x >= width || y >= height)
+                return;
+
+        const unsigned l = ((const uint16_t *) (py + y * pitchY))[x] & 0x3FFU;
+        const unsigned u = ((const uint16_t *) (pu + y * pitchU))[x] & 0x3FFU;
+        const unsigned v = ((const uint16_t *) (pv + y * pitchV))[x] & 0x3FFU;
+        ((ushort4 *) (dst + y * dstPitch))[x] = make_ushort4(u << 6, l << 6, v << 6, 0xFFFFU);
+}
+
+__global__
+void kern_Y416toYUV444P10(unsigned char *py, size_t pitchY, unsigned char *pu, size_t pitchU,
+                unsigned char *pv, size_t pitchV, const unsigned char *src, size_t srcPitch,
+                size_t width, size_t height)
+{
+        const int x = (blockIdx.x * blockDim.x) + threadIdx.x;
+        const int y = (blockIdx.y * blockDim.y) + threadIdx.y;
+
+        if (x >= width || y >= height)
+                return;
+
+        const ushort4 px = ((const ushort4 *) (src + y * srcPitch))[x];
+        ((uint16_t *) (py + y * pitchY))[x] = px.y >> 6;
+        ((uint16_t *) (pu + y * pitchU))[x] = px.x >> 6;
+        ((uint16_t *) (pv + y * pitchV))[x] = px.z >> 6;
+}
+
+/**
+ * Defines an asynchronous wrapper for a packed->packed kernel. Each thread
+ * processes px_per_thread horizontally adjacent pixels.
+ */
+#define CUDA_PACKED_CONV(name, kernel, px_per_thread) \
+void name(unsigned char *dst, size_t dstPitch, unsigned char *src, size_t srcPitch, \
+                size_t width, size_t height, CUstream_st *stream) \
+{ \
+        dim3 blockSize(32, 8); \
+        dim3 numBlocks = get_grid_size((width + (px_per_thread) - 1) / (px_per_thread), height, blockSize); \
+        kernel<<<numBlocks, blockSize, 0, stream>>>(dst, dstPitch, src, srcPitch, width, height); \
+}
+
+CUDA_PACKED_CONV(cuda_v210_to_UYVY, kern_v210toUYVY, 6)
+CUDA_PACKED_CONV(cuda_UYVY_to_v210, kern_UYVYtov210, 6)
+CUDA_PACKED_CONV(cuda_v210_to_Y416, kern_v210toY416, 6)
+CUDA_PACKED_CONV(cuda_Y416_to_v210, kern_Y416tov210, 6)
+CUDA_PACKED_CONV(cuda_UYVY_to_Y416, kern_UYVYtoY416, 2)
+CUDA_PACKED_CONV(cuda_Y416_to_UYVY, kern_Y416toUYVY, 2)
+CUDA_PACKED_CONV(cuda_Y416_to_RG48, kern_Y416toRG48, 1)
+CUDA_PACKED_CONV(cuda_RG48_to_Y416, kern_RG48toY416, 1)
+CUDA_PACKED_CONV(cuda_R10k_to_RG48, kern_R10ktoRG48, 1)
+CUDA_PACKED_CONV(cuda_RG48_to_R10k, kern_RG48toR10k, 1)
+CUDA_PACKED_CONV(cuda_R12L_to_RG48, kern_R12LtoRG48, 8)
+CUDA_PACKED_CONV(cuda_RG48_to_R12L, kern_RG48toR12L, 8)
+CUDA_PACKED_CONV(cuda_RG48_to_RGBA, kern_RG48toRGBA, 1)
+CUDA_PACKED_CONV(cuda_RGBA_to_RG48, kern_RGBAtoRG48, 1)
+
+/// I420 planes are stored contiguously, chroma pitch is half of srcPitch
+void cuda_I420_to_UYVY(unsigned char *dst, size_t dstPitch, unsigned char *src, size_t srcPitch,
+                size_t width, size_t height, CUstream_st *stream)
+{
+        const size_t chromaPitch = (srcPitch + 1) / 2;
+        const unsigned char *cb = src + srcPitch * height;
+        const unsigned char *cr = cb + chromaPitch * ((height + 1) / 2);
+        dim3 blockSize(32, 8);
+        dim3 numBlocks = get_grid_size((width + 1) / 2, (height + 1) / 2, blockSize);
+        kern_420to422<<<numBlocks, blockSize, 0, stream>>>(dst, dstPitch, src, srcPitch, cb, cr, chromaPitch, 1,
+                        width, height);
+}
+
+/// @copydetails cuda_I420_to_UYVY
+void cuda_UYVY_to_I420(unsigned char *dst, size_t dstPitch, unsigned char *src, size_t srcPitch,
+                size_t width, size_t height, CUstream_st *stream)
+{
+        const size_t chromaPitch = (dstPitch + 1) / 2;
+        unsigned char *cb = dst + dstPitch * height;
+        unsigned char *cr = cb + chromaPitch * ((height + 1) / 2);
+        dim3 blockSize(32, 8);
+        dim3 numBlocks = get_grid_size((width + 1) / 2, (height + 1) / 2, blockSize);
+        kern_422to420<<<numBlocks, blockSize, 0, stream>>>(dst, dstPitch, cb, cr, chromaPitch, 1, src, srcPitch,
+                        width, height);
+}
+
+void cuda_NV12_to_UYVY(unsigned char *dst, size_t dstPitch, const struct cuda_planes *src,
+                size_t width, size_t height, CUstream_st *stream)
+{
+        dim3 blockSize(32, 8);
+        dim3 numBlocks = get_grid_size((width + 1) / 2, (height + 1) / 2, blockSize);
+        kern_420to422<<<numBlocks, blockSize, 0, stream>>>(dst, dstPitch, src->data[0], src->pitch[0],
+                        src->data[1], src->data[1] + 1, src->pitch[1], 2, width, height);
+}
+
+void cuda_UYVY_to_NV12(struct cuda_planes *dst, unsigned char *src, size_t srcPitch,
+                size_t width, size_t height, CUstream_st *stream)
+{
+        dim3 blockSize(32, 8);
+        dim3 numBlocks = get_grid_size((width + 1) / 2, (height + 1) / 2, blockSize);
+        kern_422to420<<<numBlocks, blockSize, 0, stream>>>(dst->data[0], dst->pitch[0], dst->data[1],
+                        dst->data[1] + 1, dst->pitch[1], 2, src, srcPitch, width, height);
+}
+
+void cuda_P010_to_Y416(unsigned char *dst, size_t dstPitch, const struct cuda_planes *src,
+                size_t width, size_t height, CUstream_st *stream)
+{
+        dim3 blockSize(32, 8);
+        dim3 numBlocks = get_grid_size(width, height, blockSize);
+        kern_P010toY416<<<numBlocks, blockSize, 0, stream>>>(dst, dstPitch, src->data[0], src->pitch[0],
+                        src->data[1], src->pitch[1], width, height);
+}
+
+void cuda_Y416_to_P010(struct cuda_planes *dst, unsigned char *src, size_t srcPitch,
+                size_t width, size_t height, CUstream_st *stream)
+{
+        dim3 blockSize(32, 8);
+        dim3 numBlocks = get_grid_size((width + 1) / 2, (height + 1) / 2, blockSize);
+        kern_Y416toP010<<<numBlocks, blockSize, 0, stream>>>(dst->data[0], dst->pitch[0], dst->data[1],
+                        dst->pitch[1], src, srcPitch, width, height);
+}
+
+void cuda_YUV422P10_to_v210(unsigned char *dst, size_t dstPitch, const struct cuda_planes *src,
+                size_t width, size_t height, CUstream_st *stream)
+{
+        dim3 blockSize(32, 8);
+        dim3 numBlocks = get_grid_size((width + 5) / 6, height, blockSize);
+        kern_YUV422P10tov210<<<numBlocks, blockSize, 0, stream>>>(dst, dstPitch, src->data[0], src->pitch[0],
+                        src->data[1], src->pitch[1], src->data[2], src->pitch[2], width, height);
+}
+
+void cuda_v210_to_YUV422P10(struct cuda_planes *dst, unsigned char *src, size_t srcPitch,
+                size_t width, size_t height, CUstream_st *stream)
+{
+        dim3 blockSize(32, 8);
+        dim3 numBlocks = get_grid_size((width + 5) / 6, height, blockSize);
+        kern_v210toYUV422P10<<<numBlocks, blockSize, 0, stream>>>(dst->data[0], dst->pitch[0], dst->data[1],
+                        dst->pitch[1], dst->data[2], dst->pitch[2], src, srcPitch, width, height);
+}
+
+void cuda_YUV444P10_to_Y416(unsigned char *dst, size_t dstPitch, const struct cuda_planes *src,
+                size_t width, size_t height, CUstream_st *stream)
+{
+        dim3 blockSize(32, 8);
+        dim3 numBlocks = get_grid_size(width, height, blockSize);
+        kern_YUV444P10toY416<<<numBlocks, blockSize, 0, stream>>>(dst, dstPitch, src->data[0], src->pitch[0],
+                        src->data[1], src->pitch[1], src->data[2], src->pitch[2], width, height);
+}
+
+void cuda_Y416_to_YUV444P10(struct cuda_planes *dst, unsigned char *src, size_t srcPitch,
+                size_t width, size_t height, CUstream_st *stream)
+{
+        dim3 blockSize(32, 8);
+        dim3 numBlocks = get_grid_size(width, height, blockSize);
+        kern_Y416toYUV444P10<<<numBlocks, blockSize, 0, stream>>>(dst->data[0], dst->pitch[0], dst->data[1],
+                        dst->pitch[1], dst->data[2], dst->pitch[2], src, srcPitch, width, height);
+}
+
+static const struct {
+        codec_t in;
+        codec_t out;
+        cuda_pix_conv_t *conv;
+} cuda_conversions[] = {
+        { RGB, RGBA, cuda_RGB_to_RGBA },
+        { RGBA, RGB, cuda_RGBA_to_RGB },
+        { RGBA, UYVY, cuda_RGBA_to_UYVY },
+        { UYVY, RGBA, cuda_UYVY_to_RGBA },
+        { v210, UYVY, cuda_v210_to_UYVY },
+        { UYVY, v210, cuda_UYVY_to_v210 },
+        { v210, Y416, cuda_v210_to_Y416 },
+        { Y416, v210, cuda_Y416_to_v210 },
+        { UYVY, Y416, cuda_UYVY_to_Y416 },
+        { Y416, UYVY, cuda_Y416_to_UYVY },
+        { Y416, RG48, cuda_Y416_to_RG48 },
+        { RG48, Y416, cuda_RG48_to_Y416 },
+        { R10k, RG48, cuda_R10k_to_RG48 },
+        { RG48, R10k, cuda_RG48_to_R10k },
+        { R12L, RG48, cuda_R12L_to_RG48 },
+        { RG48, R12L, cuda_RG48_to_R12L },
+        { RG48, RGBA, cuda_RG48_to_RGBA },
+        { RGBA, RG48, cuda_RGBA_to_RG48 },
+        { I420, UYVY, cuda_I420_to_UYVY },
+        { UYVY, I420, cuda_UYVY_to_I420 },
+};
+
+cuda_pix_conv_t *get_cuda_conversion_from_to(codec_t in, codec_t out)
+{
+        for (unsigned i = 0; i < sizeof cuda_conversions / sizeof cuda_conversions[0]; ++i) {
+                if (cuda_conversions[i].in == in && cuda_conversions[i].out == out) {
+                        return cuda_conversions[i].conv;
+                }
+        }
+        return NULL;
+}
+
+bool get_cuda_conversion_chain(codec_t in, codec_t out, cuda_pix_conv_t **first,
+                codec_t *intermediate, cuda_pix_conv_t **second)
+{
+        if ((*first = get_cuda_conversion_from_to(in, out)) != NULL) {
+                *intermediate = VIDEO_CODEC_NONE;
+                *second = NULL;
+                return true;
+        }
+        for (unsigned i = 0; i < sizeof cuda_conversions / sizeof cuda_conversions[0]; ++i) {
+                if (cuda_conversions[i].in != in) {
+                        continue;
+                }
+                cuda_pix_conv_t *next = get_cuda_conversion_from_to(cuda_conversions[i].out, out);
+                if (next != NULL) {
+                        *first = cuda_conversions[i].conv;
+                        *intermediate = cuda_conversions[i].out;
+                        *second = next;
+                        return true;
+                }
+        }
+        return false;
+}
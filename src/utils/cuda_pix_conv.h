@@ -1,9 +1,27 @@
+/**
+ * @file   utils/cuda_pix_conv.h
+ *
+ * Pixel format conversions of frames residing in GPU memory. All functions
+ * are asynchronous - work is only enqueued to the given CUDA stream.
+ *
+ * Packed formats follow the UltraGrid codec_t layouts (see video_codec.c),
+ * I420 uses contiguous planes with the luma pitch passed as the pitch of
+ * the buffer. Formats not represented by codec_t (NV12, P010, 10-bit planar
+ * YUV) are passed as a struct cuda_planes.
+ */
+
 #include <cuda_runtime.h>
 
+#include "types.h"
+
 #ifndef CUDA_RGB_RGBA_H
 #define CUDA_RGB_RGBA_H
 
-void cuda_RGB_to_RGBA(unsigned char *dst,
+/**
+ * Common signature of the packed-format conversions, usable with
+ * get_cuda_conversion_from_to().
+ */
+typedef void cuda_pix_conv_t(unsigned char *dst,
                 size_t dstPitch,
                 unsigned char *src,
                 size_t srcPitch,
@@ -11,28 +29,75 @@ void cuda_RGB_to_RGBA(unsigned char *dst,
                 size_t height,
                 struct CUstream_st *stream);
 
-void cuda_RGBA_to_RGB(unsigned char *dst,
-                size_t dstPitch,
-                unsigned char *src,
-                size_t srcPitch,
-                size_t width,
-                size_t height,
-                struct CUstream_st *stream);
+/**
+ * Planar buffer description. Plane count and sample size depend on format:
+ * - NV12 - data[0] 8-bit Y, data[1] interleaved CbCr subsampled 2x2
+ * - P010 - as NV12 with 16-bit little-endian samples (10 MSBs used)
+ * - YUV422P10/YUV444P10 - Y, Cb, Cr planes with 16-bit little-endian
+ *   samples (10 LSBs used, libavcodec yuv4xxp10le)
+ */
+struct cuda_planes {
+        unsigned char *data[3];
+        size_t pitch[3];
+};
 
-void cuda_RGBA_to_UYVY(unsigned char *dst,
-                size_t dstPitch,
-                unsigned char *src,
-                size_t srcPitch,
-                size_t width,
-                size_t height,
-                struct CUstream_st *stream);
+cuda_pix_conv_t cuda_RGB_to_RGBA;
+cuda_pix_conv_t cuda_RGBA_to_RGB;
+cuda_pix_conv_t cuda_RGBA_to_UYVY;
+cuda_pix_conv_t cuda_UYVY_to_RGBA;
+/// swaps R and B, BGRA has no codec_t (eg. DXGI desktop images)
+cuda_pix_conv_t cuda_BGRA_to_RGBA;
 
-void cuda_UYVY_to_RGBA(unsigned char *dst,
-                size_t dstPitch,
-                unsigned char *src,
-                size_t srcPitch,
-                size_t width,
-                size_t height,
-                struct CUstream_st *stream);
+cuda_pix_conv_t cuda_v210_to_UYVY;
+cuda_pix_conv_t cuda_UYVY_to_v210;
+cuda_pix_conv_t cuda_v210_to_Y416;
+cuda_pix_conv_t cuda_Y416_to_v210;
+cuda_pix_conv_t cuda_UYVY_to_Y416;
+cuda_pix_conv_t cuda_Y416_to_UYVY;
+cuda_pix_conv_t cuda_Y416_to_RG48;
+cuda_pix_conv_t cuda_RG48_to_Y416;
+cuda_pix_conv_t cuda_R10k_to_RG48;
+cuda_pix_conv_t cuda_RG48_to_R10k;
+cuda_pix_conv_t cuda_R12L_to_RG48;
+cuda_pix_conv_t cuda_RG48_to_R12L;
+cuda_pix_conv_t cuda_RG48_to_RGBA;
+cuda_pix_conv_t cuda_RGBA_to_RG48;
+cuda_pix_conv_t cuda_I420_to_UYVY;
+cuda_pix_conv_t cuda_UYVY_to_I420;
+
+void cuda_NV12_to_UYVY(unsigned char *dst, size_t dstPitch, const struct cuda_planes *src,
+                size_t width, size_t height, struct CUstream_st *stream);
+void cuda_UYVY_to_NV12(struct cuda_planes *dst, unsigned char *src, size_t srcPitch,
+                size_t width, size_t height, struct CUstream_st *stream);
+void cuda_P010_to_Y416(unsigned char *dst, size_t dstPitch, const struct cuda_planes *src,
+                size_t width, size_t height, struct CUstream_st *stream);
+void cuda_Y416_to_P010(struct cuda_planes *dst, unsigned char *src, size_t srcPitch,
+                size_t width, size_t height, struct CUstream_st *stream);
+void cuda_YUV422P10_to_v210(unsigned char *dst, size_t dstPitch, const struct cuda_planes *src,
+                size_t width, size_t height, struct CUstream_st *stream);
+void cuda_v210_to_YUV422P10(struct cuda_planes *dst, unsigned char *src, size_t srcPitch,
+                size_t width, size_t height, struct CUstream_st *stream);
+void cuda_YUV444P10_to_Y416(unsigned char *dst, size_t dstPitch, const struct cuda_planes *src,
+                size_t width, size_t height, struct CUstream_st *stream);
+void cuda_Y416_to_YUV444P10(struct cuda_planes *dst, unsigned char *src, size_t srcPitch,
+                size_t width, size_t height, struct CUstream_st *stream);
+
+/**
+ * Returns direct GPU conversion from in to out or NULL if there is none.
+ */
+cuda_pix_conv_t *get_cuda_conversion_from_to(codec_t in, codec_t out);
+
+/**
+ * Finds GPU conversion from in to out, possibly through one intermediate
+ * codec (the caller then needs a temporary GPU buffer for it).
+ *
+ * @param[out] first        first (or only) conversion step
+ * @param[out] intermediate intermediate codec, VIDEO_CODEC_NONE if direct
+ * @param[out] second       second conversion step, NULL if direct
+ * @retval true  conversion found
+ * @retval false no conversion available
+ */
+bool get_cuda_conversion_chain(codec_t in, codec_t out, cuda_pix_conv_t **first,
+                codec_t *intermediate, cuda_pix_conv_t **second);
 
 #endif
@@ -0,0 +1,234 @@
+/**
+ * @file   utils/frame_trace.cpp
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+#include "control_socket.h"
+#include "debug.h"
+#include "host.h"
+#include "utils/frame_trace.h"
+
+#define MOD_NAME "[frame trace] "
+#define REPORT_INTERVAL_NS (5 * NS_IN_SEC)
+#define MISSING_DELTA UINT32_MAX
+
+using std::fixed;
+using std::nth_element;
+using std::ostringstream;
+using std::setprecision;
+using std::vector;
+
+ADD_TO_PARAM("frame-trace", "* frame-trace\n"
+                "  Send per-frame latency trace (capture, filter, compress, TX timestamps) in RTP header\n"
+                "  extension. The receiver reports percentiles of stage durations (also via control socket).\n"
+                "  Network transit is valid only if sender and receiver clocks are synchronized.\n");
+
+namespace {
+/// reported stage intervals
+const struct {
+        const char *name;
+        enum frame_trace_stage from;
+        enum frame_trace_stage to;
+} intervals[] = {
+        { "filter", FT_CAPTURE, FT_FILTER },
+        { "compress_queue", FT_FILTER, FT_COMPRESS_IN },
+        { "compress", FT_COMPRESS_IN, FT_COMPRESS_OUT },
+        { "tx_queue", FT_COMPRESS_OUT, FT_TX_FIRST },
+        { "tx", FT_TX_FIRST, FT_TX_LAST },
+        { "network", FT_TX_LAST, FT_RX_LAST },
+        { "rx", FT_RX_FIRST, FT_RX_LAST },
+        { "pbuf", FT_RX_LAST, FT_PBUF_COMPLETE },
+        { "fec", FT_PBUF_COMPLETE, FT_FEC_DONE },
+        { "decompress", FT_FEC_DONE, FT_DECOMPRESS_DONE },
+        { "display", FT_DECOMPRESS_DONE, FT_DISPLAY_PUT },
+        { "total", FT_CAPTURE, FT_DISPLAY_PUT },
+};
+constexpr int INTERVAL_COUNT = sizeof intervals / sizeof intervals[0];
+
+void store_be32(unsigned char *dst, uint32_t val) {
+        val = htonl(val);
+        memcpy(dst, &val, sizeof val);
+}
+
+uint32_t load_be32(const unsigned char *src) {
+        uint32_t val = 0;
+        memcpy(&val, src, sizeof val);
+        return ntohl(val);
+}
+
+/// @returns p-th percentile (0-100) of vals, vals are reordered
+long long percentile(vector<long long> &vals, int p) {
+        auto nth = vals.begin() + (vals.size() - 1) * p / 100;
+        nth_element(vals.begin(), nth, vals.end());
+        return *nth;
+}
+} // end of anonymous namespace
+
+struct frame_trace_stats {
+        struct control_state *control;
+        time_ns_t t_last = get_time_in_ns();
+        int frames = 0;
+        vector<long long> durations_us[INTERVAL_COUNT];
+
+        void report();
+};
+
+void frame_trace_stats::report()
+{
+        ostringstream log;
+        ostringstream ctrl;
+        log << fixed << setprecision(2) << frames << " frames, p50/p95/p99 [ms]:";
+        ctrl << "FTRACE frames " << frames;
+        for (int i = 0; i < INTERVAL_COUNT; ++i) {
+                auto &vals = durations_us[i];
+                if (vals.empty()) {
+                        continue;
+                }
+                long long p50 = percentile(vals, 50);
+                long long p95 = percentile(vals, 95);
+                long long p99 = percentile(vals, 99);
+                log << " " << intervals[i].name << " " << p50 / 1000.0 << "/" << p95 / 1000.0 << "/" << p99 / 1000.0;
+                ctrl << " " << intervals[i].name << "_us " << p50 << "/" << p95 << "/" << p99;
+                vals.clear();
+        }
+        LOG(LOG_LEVEL_INFO) << MOD_NAME << log.str() << "\n";
+        control_report_stats(control, ctrl.str());
+        frames = 0;
+}
+
+bool frame_trace_enabled(void)
+{
+        static const bool enabled = get_commandline_param("frame-trace") != nullptr;
+        return enabled;
+}
+
+/**
+ * Serializes the sender stages of the trace to the RTP header extension
+ * payload - capture time (64-bit ns) followed by 32-bit offsets of the other
+ * stages from the capture (in us, UINT32_MAX if not stamped).
+ *
+ * @param[out] extn buffer of at least FRAME_TRACE_EXTN_WORDS words
+ * @returns    length of the extension in 32-bit words, 0 if the frame carries no trace
+ */
+int frame_trace_write_extn(const struct frame_trace *t, uint32_t *extn)
+{
+        const long long capture = t->ts[FT_CAPTURE];
+        if (capture == 0) {
+                return 0;
+        }
+        auto *out = reinterpret_cast<unsigned char *>(extn);
+        store_be32(out, static_cast<unsigned long long>(capture) >> 32U);
+        store_be32(out + 4, static_cast<uint32_t>(capture));
+        out += 8;
+        for (int i = FT_CAPTURE + 1; i < FT_SENDER_STAGES; ++i) {
+                long long delta = (t->ts[i] - capture) / NS_IN_US;
+                store_be32(out, t->ts[i] == 0 || delta < 0 || delta >= MISSING_DELTA ? MISSING_DELTA : delta);
+                out += 4;
+        }
+        return FRAME_TRACE_EXTN_WORDS;
+}
+
+/**
+ * Restores sender stages of the trace from the RTP header extension.
+ *
+ * @param extn pointer to the RTP header extension (including the extension
+ *             header), may be NULL
+ * @retval false if the extension is not a frame trace
+ */
+bool frame_trace_read_extn(const unsigned char *extn, struct frame_trace *t)
+{
+        if (extn == nullptr || load_be32(extn) >> 16U != FRAME_TRACE_EXTN_TYPE
+                        || (load_be32(extn) & 0xFFFFU) < FRAME_TRACE_EXTN_WORDS) {
+                return false;
+        }
+        const unsigned char *in = extn + 4;
+        const long long capture = (static_cast<unsigned long long>(load_be32(in)) << 32U) | load_be32(in + 4);
+        in += 8;
+        t->ts[FT_CAPTURE] = capture;
+        for (int i = FT_CAPTURE + 1; i < FT_SENDER_STAGES; ++i) {
+                uint32_t delta = load_be32(in);
+                t->ts[i] = delta == MISSING_DELTA ? 0 : capture + delta * NS_IN_US;
+                in += 4;
+        }
+        return true;
+}
+
+struct frame_trace_stats *frame_trace_stats_init(struct control_state *control)
+{
+        auto *s = new frame_trace_stats();
+        s->control = control;
+        return s;
+}
+
+/**
+ * Accounts a displayed frame. Only frames carrying the sender trace are
+ * accounted, stats are reported every REPORT_INTERVAL_NS.
+ */
+void frame_trace_stats_add(struct frame_trace_stats *s, const struct frame_trace *t)
+{
+        if (t->ts[FT_CAPTURE] == 0) {
+                return;
+        }
+        for (int i = 0; i < INTERVAL_COUNT; ++i) {
+                long long from = t->ts[intervals[i].from];
+                long long to = t->ts[intervals[i].to];
+                if (from != 0 && to != 0) {
+                        s->durations_us[i].push_back((to - from) / NS_IN_US);
+                }
+        }
+        s->frames += 1;
+        time_ns_t now = get_time_in_ns();
+        if (now - s->t_last >= REPORT_INTERVAL_NS) {
+                s->report();
+                s->t_last = now;
+        }
+}
+
+void frame_trace_stats_destroy(struct frame_trace_stats *s)
+{
+        delete s;
+}
+
@@ -0,0 +1,89 @@
+/**
+ * @file   utils/frame_trace.h
+ * @brief  End-to-end per-frame latency tracing
+ *
+ * Every video frame carries wall-clock timestamps of the pipeline stages
+ * (@ref frame_trace). If enabled on the sender, the sender stages are passed
+ * to the receiver in an RTP header extension of the last packet of the frame.
+ * The receiver adds its own stages and periodically reports percentiles of
+ * the per-stage durations to the log and the control socket.
+ *
+ * The network transit (TX -> RX) is meaningful only if the clocks of the
+ * sender and the receiver are synchronized (eg. with NTP or PTP).
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_FRAME_TRACE_H_
+#define UTILS_FRAME_TRACE_H_
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#include <stdint.h>
+#else
+#include <cstdint>
+#endif
+
+#include "tv.h"
+#include "types.h"
+
+#define FRAME_TRACE_EXTN_TYPE 0x5554 ///< RTP header extension profile ("UT")
+/// RTP header extension length (in 32-bit words, without the extension header)
+#define FRAME_TRACE_EXTN_WORDS (2 + FT_SENDER_STAGES - 1)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct control_state;
+struct frame_trace_stats;
+
+bool frame_trace_enabled(void);
+
+static inline void frame_trace_stamp(struct frame_trace *t, enum frame_trace_stage stage) {
+        t->ts[stage] = get_time_in_ns();
+}
+
+int frame_trace_write_extn(const struct frame_trace *t, uint32_t *extn);
+bool frame_trace_read_extn(const unsigned char *extn, struct frame_trace *t);
+
+struct frame_trace_stats *frame_trace_stats_init(struct control_state *control);
+void frame_trace_stats_add(struct frame_trace_stats *s, const struct frame_trace *t);
+void frame_trace_stats_destroy(struct frame_trace_stats *s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // defined UTILS_FRAME_TRACE_H_
+
@@ -44,6 +44,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "utils/fs.h"
 
@@ -74,6 +75,43 @@ const char *get_temp_dir(void)
         return temp_dir;
 }
 
+/**
+ * Returns per-user UltraGrid cache directory (created if needed), ending
+ * with path delimiter, or NULL if it cannot be determined. It is
+ * $XDG_CACHE_HOME/ultragrid/ (~/.cache/ultragrid/) or %LOCALAPPDATA%\UltraGrid\
+ * in Windows.
+ */
+const char *get_cache_dir(void)
+{
+        static __thread char cache_dir[MAX_PATH_SIZE];
+
+        if (cache_dir[0] != '\0') {
+                return cache_dir;
+        }
+
+#ifdef _WIN32
+        const char *base = getenv("LOCALAPPDATA");
+        const char *sub = "\\UltraGrid\\";
+#else
+        const char *base = getenv("XDG_CACHE_HOME");
+        const char *sub = "/ultragrid/";
+        char home_cache[MAX_PATH_SIZE];
+        if (base == NULL && getenv("HOME") != NULL) {
+                snprintf(home_cache, sizeof home_cache, "%s/.cache", getenv("HOME"));
+                platform_mkdir(home_cache);
+                base = home_cache;
+        }
+#endif
+        if (base == NULL || strlen(base) + strlen(sub) >= sizeof cache_dir) {
+                return NULL;
+        }
+        strcpy(cache_dir, base);
+        strcat(cache_dir, sub);
+        platform_mkdir(cache_dir);
+
+        return cache_dir;
+}
+
 #ifdef _WIN32
 int get_exec_path(char* path) {
         return GetModuleFileNameA(NULL, path, MAX_PATH_SIZE) != 0;
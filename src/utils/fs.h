@@ -64,6 +64,7 @@ int get_exec_path(char* path);
 
 
 const char *get_temp_dir(void);
+const char *get_cache_dir(void);
 
 #ifdef __cplusplus
 } // extern "C"
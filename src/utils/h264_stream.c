@@ -29,6 +29,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "debug.h"
 #include "h264_stream.h"
@@ -331,6 +332,99 @@ void read_rbsp_trailing_bits(bs_t* b)
     }
 }
 
+/***************************** helpers ******************************/
+
+/**
+   Parse picture dimensions (with cropping applied) from an SPS NAL unit.
+   @param[in] nal      SPS NAL unit including the 1-byte NAL header, without start code
+   @return  0 on success, -1 on error
+ */
+int h264_sps_get_dimensions(const uint8_t* nal, int nal_len, uint32_t* width, uint32_t* height)
+{
+    sps_t sps;
+    uint8_t* rbsp_buf = (uint8_t*)malloc(nal_len);
+    if (rbsp_buf == NULL || nal_to_rbsp(nal, &nal_len, rbsp_buf, &nal_len) < 0)
+    {
+        free(rbsp_buf);
+        return -1;
+    }
+    bs_t b;
+    bs_init(&b, rbsp_buf, nal_len);
+    int ret = read_seq_parameter_set_rbsp(&sps, &b);
+    free(rbsp_buf);
+    if (ret < 0)
+    {
+        return -1;
+    }
+
+    *width = (sps.pic_width_in_mbs_minus1 + 1) * 16;
+    *height = (2 - sps.frame_mbs_only_flag) * (sps.pic_height_in_map_units_minus1 + 1) * 16;
+    //NOTE: frame_mbs_only_flag = 1 --> only progressive frames
+    //      frame_mbs_only_flag = 0 --> some type of interlacing (there are 3 types contemplated in the standard)
+    if (sps.frame_cropping_flag)
+    {
+        *width -= (sps.frame_crop_left_offset*2 + sps.frame_crop_right_offset*2);
+        *height -= (sps.frame_crop_top_offset*2 + sps.frame_crop_bottom_offset*2);
+    }
+    return 0;
+}
+
+/**
+   Same as h264_sps_get_dimensions() but the SPS is fully parsed only if it differs
+   from the one last seen with the same seq_parameter_set_id. Encoders usually repeat
+   an identical SPS with every IDR frame so the common case is a memcmp.
+ */
+int h264_sps_cache_get_dimensions(struct h264_sps_cache* cache, const uint8_t* nal, int nal_len, uint32_t* width, uint32_t* height)
+{
+    // header, profile_idc, constraint flags, level_idc, then ue(v) seq_parameter_set_id;
+    // the id is read directly unless an emulation prevention byte could precede it
+    if (cache == NULL || nal_len < 5 || (nal[2] == 0 && nal[3] == 0))
+    {
+        return h264_sps_get_dimensions(nal, nal_len, width, height);
+    }
+    bs_t b;
+    bs_init(&b, (uint8_t*) nal + 4, nal_len - 4);
+    uint32_t id = bs_read_ue(&b);
+    if (id >= H264_MAX_SPS_COUNT)
+    {
+        return h264_sps_get_dimensions(nal, nal_len, width, height);
+    }
+
+    struct h264_sps_cache_entry* e = &cache->entries[id];
+    if (e->nal != NULL && e->len == nal_len && memcmp(e->nal, nal, nal_len) == 0)
+    {
+        *width = e->width;
+        *height = e->height;
+        return 0;
+    }
+
+    if (h264_sps_get_dimensions(nal, nal_len, width, height) < 0)
+    {
+        return -1;
+    }
+    uint8_t* copy = (uint8_t*)realloc(e->nal, nal_len);
+    if (copy == NULL)
+    {
+        return 0; // parsed fine, just not cached
+    }
+    memcpy(copy, nal, nal_len);
+    e->nal = copy;
+    e->len = nal_len;
+    e->width = *width;
+    e->height = *height;
+    return 0;
+}
+
+void h264_sps_cache_clear(struct h264_sps_cache* cache)
+{
+    for (int i = 0; i < H264_MAX_SPS_COUNT; i++)
+    {
+        free(cache->entries[i].nal);
+        cache->entries[i].nal = NULL;
+        cache->entries[i].len = 0;
+    }
+}
+
 /***************************** debug ******************************/
 
 void debug_sps(sps_t* sps)
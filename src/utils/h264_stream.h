@@ -156,6 +156,28 @@ void read_rbsp_trailing_bits(bs_t* b);
 
 void debug_sps(sps_t* sps);
 
+int h264_sps_get_dimensions(const uint8_t* nal, int nal_len, uint32_t* width, uint32_t* height);
+
+#define H264_MAX_SPS_COUNT 32
+
+/**
+   Last seen SPS per seq_parameter_set_id together with its parsed dimensions.
+   Zero-initialized structure is an empty cache, release with h264_sps_cache_clear().
+ */
+struct h264_sps_cache
+{
+    struct h264_sps_cache_entry
+    {
+        uint8_t* nal;
+        int len;
+        uint32_t width;
+        uint32_t height;
+    } entries[H264_MAX_SPS_COUNT];
+};
+
+int h264_sps_cache_get_dimensions(struct h264_sps_cache* cache, const uint8_t* nal, int nal_len, uint32_t* width, uint32_t* height);
+void h264_sps_cache_clear(struct h264_sps_cache* cache);
+
 #define SAR_Extended      255
 
 #ifdef __cplusplus
@@ -55,6 +55,7 @@
 #include "utils/jpeg_reader.h"
 
 #include "debug.h"
+#include "utils/byte_scan.h"
 
 u_char lum_dc_codelens[] = {
         0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0,
@@ -791,3 +792,137 @@ bool jpeg_get_rtp_hdr_data(uint8_t *jpeg_data, int len, struct jpeg_rtp_data *hd
 	return true;
 }
 
+static int gcd(int a, int b) { while (b != 0) { int t = a % b; a = b; b = t; } return a; }
+
+/**
+ * Splits a baseline single-scan JPEG with restart intervals to up to max_parts
+ * horizontal stripes, each being a standalone JPEG that can be decoded
+ * independently (and thus in parallel). Stripe boundaries are placed at MCU
+ * rows starting with a restart interval. The headers are copied to every
+ * stripe with the height in SOF0 adjusted and restart markers are renumbered
+ * to start from RST0.
+ *
+ * @param[in,out] buf      buffer holding the stripes, reallocated as needed,
+ *                         followed by JPEG_SPLIT_PADDING zero bytes
+ * @param[in,out] buf_len  allocated length of buf
+ * @param[out]    parts    array of at least max_parts parts
+ * @returns number of stripes, 0 if the image cannot be split (no restart
+ * intervals, multiple scans, corrupted data or too small)
+ */
+int jpeg_split_restart(uint8_t *image, int len, int max_parts, uint8_t **buf, int *buf_len, struct jpeg_part *parts)
+{
+        if (len < 4 || image[0] != 0xFF || image[1] != JPEG_MARKER_SOI) {
+                return 0;
+        }
+        // locate SOF0 height field (jpeg_read_info() doesn't store position)
+        int sof_height_off = -1;
+        for (int off = 2; off + 4 <= len && image[off] == 0xFF && image[off + 1] != JPEG_MARKER_SOS; ) {
+                if (image[off + 1] == 0xFF) { // fill byte
+                        off += 1;
+                        continue;
+                }
+                if (image[off + 1] == JPEG_MARKER_SOF0) {
+                        sof_height_off = off + 5;
+                        break;
+                }
+                off += 2 + (image[off + 2] << 8 | image[off + 3]);
+        }
+        struct jpeg_info info;
+        if (sof_height_off < 0 || sof_height_off + 2 > len || jpeg_read_info(image, len, &info) != 0
+                        || !info.interleaved || info.restart_interval == 0) {
+                return 0;
+        }
+
+        int h_max = 1;
+        int v_max = 1;
+        if (info.comp_count > 1) { // single component scan has always 8x8 MCUs
+                for (int i = 0; i < info.comp_count; ++i) {
+                        h_max = MAX(h_max, info.sampling_factor_h[i]);
+                        v_max = MAX(v_max, info.sampling_factor_v[i]);
+                }
+        }
+        int mcu_h = 8 * v_max;
+        int mcus_x = (info.width + 8 * h_max - 1) / (8 * h_max);
+        int mcus_y = (info.height + mcu_h - 1) / mcu_h;
+        int ri = info.restart_interval;
+        int interval_count = (mcus_x * mcus_y + ri - 1) / ri;
+        int align = ri / gcd(ri, mcus_x); ///< MCU rows between rows starting with an interval
+        int part_count = MIN(max_parts, mcus_y / align);
+        if (part_count < 2) {
+                return 0;
+        }
+
+        // find restart markers, we need only those at stripe boundaries but
+        // all must be checked to be sure that the stream is as expected
+        int *rst = malloc(interval_count * sizeof *rst); ///< offsets of RST markers, last is EOI
+        int found = 0;
+        uint8_t *end = image + len;
+        for (uint8_t *p = info.data; ; p += 2) {
+                p = (uint8_t *) find_jpeg_marker(p, end);
+                if (p == NULL) {
+                        break;
+                }
+                if (p[1] == 0xFF) { // fill byte
+                        p -= 1;
+                        continue;
+                }
+                if (p[1] == JPEG_MARKER_EOI || (p[1] >= JPEG_MARKER_RST0 && p[1] <= JPEG_MARKER_RST7)) {
+                        if (found == interval_count) {
+                                found = -1;
+                                break;
+                        }
+                        rst[found++] = p - image;
+                        if (p[1] == JPEG_MARKER_EOI) {
+                                break;
+                        }
+                        continue;
+                }
+                found = -1; // another scan or unexpected marker
+                break;
+        }
+        if (found != interval_count || image[rst[interval_count - 1] + 1] != JPEG_MARKER_EOI) {
+                free(rst);
+                return 0;
+        }
+
+        int hdr_len = info.data - image;
+        int needed = part_count * (hdr_len + 2) + len + JPEG_SPLIT_PADDING;
+        if (*buf_len < needed) {
+                free(*buf);
+                *buf = malloc(needed);
+                *buf_len = *buf == NULL ? 0 : needed;
+                if (*buf == NULL) {
+                        free(rst);
+                        return 0;
+                }
+        }
+
+        uint8_t *out = *buf;
+        for (int i = 0; i < part_count; ++i) {
+                int row_start = mcus_y * i / part_count / align * align;
+                int row_end = i == part_count - 1 ? mcus_y : mcus_y * (i + 1) / part_count / align * align;
+                int first = row_start * mcus_x / ri;
+                int last = i == part_count - 1 ? interval_count : row_end * mcus_x / ri; // exclusive
+                int data_start = first == 0 ? hdr_len : rst[first - 1] + 2;
+                int data_len = rst[last - 1] - data_start;
+
+                parts[i].data = out;
+                parts[i].y = row_start * mcu_h;
+                parts[i].height = MIN(info.height, row_end * mcu_h) - parts[i].y;
+                memcpy(out, image, hdr_len);
+                out[sof_height_off] = parts[i].height >> 8;
+                out[sof_height_off + 1] = parts[i].height & 0xFF;
+                memcpy(out + hdr_len, image + data_start, data_len);
+                for (int k = first; k < last - 1; ++k) {
+                        out[hdr_len + rst[k] - data_start + 1] = JPEG_MARKER_RST0 + (k - first) % 8;
+                }
+                out[hdr_len + data_len] = 0xFF;
+                out[hdr_len + data_len + 1] = JPEG_MARKER_EOI;
+                parts[i].len = hdr_len + data_len + 2;
+                out += parts[i].len;
+        }
+        memset(out, 0, JPEG_SPLIT_PADDING);
+        free(rst);
+
+        return part_count;
+}
@@ -71,12 +71,23 @@ struct jpeg_rtp_data {
         uint8_t *data; // entropy-coded data start
 };
 
+#define JPEG_SPLIT_PADDING 64 ///< zeroed bytes after the last stripe (required eg. by libavcodec)
+
+/// horizontal stripe of a JPEG image that is a standalone JPEG, see jpeg_split_restart()
+struct jpeg_part {
+        uint8_t *data;
+        int len;
+        int y;      ///< first row of the stripe in the original image
+        int height; ///< number of rows of the stripe
+};
+
 #ifdef __cplusplus
 extern "C" {
 #endif // defined __cplusplus
 
 int jpeg_read_info(uint8_t *image, int len, struct jpeg_info *info);
 bool jpeg_get_rtp_hdr_data(uint8_t *jpeg_data, int len, struct jpeg_rtp_data *hdr_data);
+int jpeg_split_restart(uint8_t *image, int len, int max_parts, uint8_t **buf, int *buf_len, struct jpeg_part *parts);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,270 @@
+/**
+ * @file   utils/lockfree_queue.hpp
+ * @brief  Bounded lock-free MPMC queue with the synchronized_queue interface
+ *
+ * Drop-in replacement of synchronized_queue for the per-frame hand-offs
+ * between pipeline threads. The data path is a Vyukov-style ring of
+ * sequenced cells; threads only touch a mutex/condition variable when they
+ * have to sleep, after a short busy-wait.
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_LOCKFREE_QUEUE_HPP_
+#define UTILS_LOCKFREE_QUEUE_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include "utils/synchronized_queue.h" // queue_instrumentation
+
+static inline void lockfree_queue_cpu_relax()
+{
+#if defined __x86_64__ || defined __i386__
+        __builtin_ia32_pause();
+#elif defined __aarch64__
+        __asm__ __volatile__("yield");
+#else
+        std::this_thread::yield();
+#endif
+}
+
+/**
+ * @brief bounded lock-free queue
+ *
+ * Semantics match synchronized_queue: push() blocks while the queue holds
+ * max_len items, pop() blocks while it is empty (unless nonblocking, when
+ * it returns T()). Unlike synchronized_queue, the queue must be bounded.
+ *
+ * Both sides first spin for about SPIN_ITERATIONS tries and only then park
+ * on a condition variable. The other side takes the mutex only if someone
+ * is actually parked, so in the steady state push/pop do not syscall.
+ *
+ * @tparam T       type to be stored (default constructible, movable)
+ * @tparam max_len maximal length of the queue until it blocks
+ */
+template<typename T, int max_len = 1>
+class lockfree_queue {
+        static_assert(max_len > 0, "lockfree_queue must be bounded");
+        static constexpr int SPIN_ITERATIONS = 256;
+        static constexpr size_t ring_size() {
+                size_t s = 2; // at least 2 cells so that sequence numbers are unambiguous
+                while (s < (size_t) max_len) {
+                        s *= 2;
+                }
+                return s;
+        }
+public:
+        lockfree_queue() {
+                for (size_t i = 0; i < ring_size(); ++i) {
+                        m_cells[i].seq.store(i, std::memory_order_relaxed);
+                }
+        }
+
+        int size()
+        {
+                return m_count.load(std::memory_order_acquire);
+        }
+
+        void push(T const & message)
+        {
+                T copy = message;
+                push(std::move(copy));
+        }
+
+        void push(T && message)
+        {
+                if (!try_reserve()) {
+                        wait(m_waiting_producers, [this]{ return try_reserve(); }, true);
+                }
+                enqueue(std::move(message));
+                notify(m_waiting_consumers);
+        }
+
+        T pop(bool nonblocking = false)
+        {
+                T ret;
+                if (!try_dequeue(ret)) {
+                        if (nonblocking) {
+                                return T();
+                        }
+                        wait(m_waiting_consumers, [this, &ret]{ return try_dequeue(ret); }, false);
+                }
+                notify(m_waiting_producers);
+                return ret;
+        }
+
+        /// non-blocking push, @retval false if the queue is full (message is left untouched)
+        bool try_push(T && message)
+        {
+                if (!try_reserve()) {
+                        return false;
+                }
+                enqueue(std::move(message));
+                notify(m_waiting_consumers);
+                return true;
+        }
+
+        /// non-blocking pop, @retval false if the queue is empty
+        bool try_pop(T &out)
+        {
+                if (!try_dequeue(out)) {
+                        return false;
+                }
+                notify(m_waiting_producers);
+                return true;
+        }
+
+        /// @copydoc synchronized_queue::instrument
+        void instrument(struct module *owner, const char *name)
+        {
+                m_instr = queue_instrumentation::create(owner, name);
+        }
+
+private:
+        struct alignas(64) cell {
+                std::atomic<size_t> seq;
+                T data;
+        };
+
+        /// reserves space for one item respecting max_len
+        bool try_reserve()
+        {
+                int count = m_count.load(std::memory_order_relaxed);
+                while (count < max_len) {
+                        if (m_count.compare_exchange_weak(count, count + 1, std::memory_order_acq_rel)) {
+                                return true;
+                        }
+                }
+                return false;
+        }
+
+        /// space is already reserved so there's always a free cell
+        void enqueue(T && message)
+        {
+                size_t pos = m_enqueue_pos.fetch_add(1, std::memory_order_relaxed);
+                cell &c = m_cells[pos & (ring_size() - 1)];
+                while (c.seq.load(std::memory_order_acquire) != pos) {
+                        lockfree_queue_cpu_relax(); // consumer is still moving the previous item out
+                }
+                c.data = std::move(message);
+                c.seq.store(pos + 1, std::memory_order_release);
+                if (m_instr) {
+                        std::lock_guard<std::mutex> lk(m_instr_lock);
+                        m_instr->pushed(size());
+                }
+        }
+
+        bool try_dequeue(T &out)
+        {
+                size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+                for (;;) {
+                        cell &c = m_cells[pos & (ring_size() - 1)];
+                        size_t seq = c.seq.load(std::memory_order_acquire);
+                        auto dif = (ptrdiff_t) seq - (ptrdiff_t) (pos + 1);
+                        if (dif == 0) {
+                                if (m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                                        out = std::move(c.data);
+                                        c.data = T();
+                                        c.seq.store(pos + ring_size(), std::memory_order_release);
+                                        m_count.fetch_sub(1, std::memory_order_acq_rel);
+                                        if (m_instr) {
+                                                std::lock_guard<std::mutex> lk(m_instr_lock);
+                                                m_instr->popped();
+                                        }
+                                        return true;
+                                }
+                        } else if (dif < 0) {
+                                return false; // empty
+                        } else {
+                                pos = m_dequeue_pos.load(std::memory_order_relaxed);
+                        }
+                }
+        }
+
+        template<typename Pred>
+        void wait(std::atomic<int> &waiting, Pred pred, bool producer)
+        {
+                for (int i = 0; i < SPIN_ITERATIONS; ++i) {
+                        lockfree_queue_cpu_relax();
+                        if (pred()) {
+                                return;
+                        }
+                }
+                auto t0 = std::chrono::steady_clock::now();
+                std::unique_lock<std::mutex> lk(m_park_lock);
+                waiting.fetch_add(1, std::memory_order_seq_cst);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                // the other side notifies under m_park_lock so the wakeup cannot be lost
+                m_park_cv.wait(lk, pred);
+                waiting.fetch_sub(1, std::memory_order_relaxed);
+                lk.unlock();
+                if (m_instr) {
+                        std::lock_guard<std::mutex> ilk(m_instr_lock);
+                        if (producer) {
+                                m_instr->push_blocked(std::chrono::steady_clock::now() - t0);
+                        } else {
+                                m_instr->pop_waited(std::chrono::steady_clock::now() - t0);
+                        }
+                }
+        }
+
+        void notify(std::atomic<int> &waiting)
+        {
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (waiting.load(std::memory_order_seq_cst) > 0) {
+                        std::lock_guard<std::mutex> lk(m_park_lock);
+                        m_park_cv.notify_all();
+                }
+        }
+
+        cell m_cells[ring_size()];
+        alignas(64) std::atomic<size_t> m_enqueue_pos{0};
+        alignas(64) std::atomic<size_t> m_dequeue_pos{0};
+        alignas(64) std::atomic<int> m_count{0};
+        std::atomic<int> m_waiting_producers{0};
+        std::atomic<int> m_waiting_consumers{0};
+        std::mutex m_park_lock;
+        std::condition_variable m_park_cv;
+        std::mutex m_instr_lock; ///< serializes m_instr calls
+        std::unique_ptr<queue_instrumentation> m_instr;
+};
+
+#endif // defined UTILS_LOCKFREE_QUEUE_HPP_
+
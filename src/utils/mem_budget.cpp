@@ -0,0 +1,118 @@
+/**
+ * @file   utils/mem_budget.cpp
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <atomic>
+
+#include "debug.h"
+#include "host.h"
+#include "utils/macros.h"
+#include "utils/mem_budget.h"
+#include "utils/metrics.h"
+#include "utils/misc.h"
+
+#define MOD_NAME "[mem_budget] "
+
+using std::atomic;
+using std::memory_order_relaxed;
+
+ADD_TO_PARAM("mem-budget", "* mem-budget=<size>\n"
+                "  Memory budget for frame pools, UDP receive buffers and decoder queues (eg. 2G).\n"
+                "  When reached, pools stop caching free frames and producers wait for consumers.\n");
+
+namespace {
+const char *const subsystem_names[MEM_SUBSYSTEM_COUNT] = { "udp_rx", "frame_pool", "decoder" };
+
+struct mem_budget_state {
+        mem_budget_state() {
+                const char *cfg = get_commandline_param("mem-budget");
+                if (cfg != nullptr) {
+                        budget = unit_evaluate(cfg);
+                        if (budget <= 0) {
+                                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Wrong budget \"%s\", ignoring.\n", cfg);
+                                budget = 0;
+                        }
+                }
+                metric_set(metric_gauge("ug_memory_budget_bytes", "Configured memory budget (0 if unlimited)", nullptr), budget);
+                for (int i = 0; i < MEM_SUBSYSTEM_COUNT; ++i) {
+                        char labels[64];
+                        snprintf(labels, sizeof labels, "subsystem=%s", subsystem_names[i]);
+                        usage_metric[i] = metric_gauge("ug_memory_bytes", "Memory accounted to the subsystem", labels);
+                        backpressure_metric[i] = metric_counter("ug_memory_backpressure",
+                                        "Allocations postponed or dropped because of the memory budget", labels);
+                }
+        }
+        long long budget = 0; ///< 0 - unlimited
+        atomic<long long> total{0};
+        atomic<long long> used[MEM_SUBSYSTEM_COUNT] = {};
+        struct metric *usage_metric[MEM_SUBSYSTEM_COUNT];
+        struct metric *backpressure_metric[MEM_SUBSYSTEM_COUNT];
+};
+
+/// intentionally leaked so that buffers may be released until exit
+mem_budget_state &get_state() {
+        static auto *s = new mem_budget_state();
+        return *s;
+}
+} // end of anonymous namespace
+
+void mem_budget_add(enum mem_subsystem subsystem, long long bytes)
+{
+        auto &s = get_state();
+        long long used = s.used[subsystem].fetch_add(bytes, memory_order_relaxed) + bytes;
+        long long total = s.total.fetch_add(bytes, memory_order_relaxed) + bytes;
+        metric_set(s.usage_metric[subsystem], used);
+        if (s.budget > 0 && bytes > 0 && total >= s.budget && total - bytes < s.budget) {
+                log_msg_once(LOG_LEVEL_WARNING, to_fourcc('M', 'B', 'U', 'D'), MOD_NAME "Memory budget reached, "
+                                "shrinking pools and throttling producers.\n");
+        }
+}
+
+bool mem_budget_exceeded(void)
+{
+        auto &s = get_state();
+        return s.budget > 0 && s.total.load(memory_order_relaxed) >= s.budget;
+}
+
+void mem_budget_backpressure(enum mem_subsystem subsystem)
+{
+        metric_add(get_state().backpressure_metric[subsystem], 1);
+}
@@ -0,0 +1,73 @@
+/**
+ * @file   utils/mem_budget.h
+ * @brief  Process-wide memory budget with per-subsystem accounting
+ *
+ * Subsystems holding big buffers (frame pools, UDP receive buffers, decoder)
+ * report allocations and releases here. The usage is exported as the
+ * "ug_memory_bytes" metric. If a budget is set with "--param mem-budget",
+ * the subsystems check mem_budget_exceeded() to stop caching free buffers
+ * and to apply backpressure to the producers.
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_MEM_BUDGET_H_
+#define UTILS_MEM_BUDGET_H_
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum mem_subsystem {
+        MEM_UDP_RX,     ///< UDP reader buffers (including packets held by pbuf)
+        MEM_FRAME_POOL, ///< video_frame_pool instances
+        MEM_DECODER,    ///< received frames queued in the video decoder
+        MEM_SUBSYSTEM_COUNT,
+};
+
+/// @param bytes allocated (positive) or released (negative) amount
+void mem_budget_add(enum mem_subsystem subsystem, long long bytes);
+/// @returns true if the budget is set and the accounted memory reached it
+bool mem_budget_exceeded(void);
+/// counts one event when the subsystem postponed or dropped an allocation due to the budget
+void mem_budget_backpressure(enum mem_subsystem subsystem);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // defined UTILS_MEM_BUDGET_H_
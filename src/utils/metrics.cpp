@@ -0,0 +1,347 @@
+/**
+ * @file   utils/metrics.cpp
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "utils/metrics.h"
+
+#define SHARDS 16      ///< number of per-thread update slots
+#define MAX_BUCKETS 16 ///< max histogram buckets (without +Inf)
+
+using std::atomic;
+using std::lock_guard;
+using std::map;
+using std::memory_order_relaxed;
+using std::mutex;
+using std::ostringstream;
+using std::pair;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+namespace {
+const double default_bounds[] = { 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000 };
+
+atomic<unsigned> next_shard{0};
+thread_local const unsigned shard_idx = next_shard++ % SHARDS;
+
+void atomic_add(atomic<double> &a, double val) {
+        double old = a.load(memory_order_relaxed);
+        while (!a.compare_exchange_weak(old, old + val, memory_order_relaxed)) {
+        }
+}
+} // end of anonymous namespace
+
+struct metric {
+        enum metric_type type;
+        string name;
+        string help;
+        vector<pair<string, string>> labels;
+        vector<double> bounds; ///< histogram bucket upper bounds
+
+        struct alignas(64) shard {
+                atomic<long long> count{0}; ///< counter value or histogram observation count
+                atomic<double> sum{0.0};
+                atomic<long long> buckets[MAX_BUCKETS + 1] = {};
+        } shards[SHARDS];
+        atomic<double> gauge{0.0};
+
+        long long get_count() const {
+                long long ret = 0;
+                for (const auto &s : shards) {
+                        ret += s.count.load(memory_order_relaxed);
+                }
+                return ret;
+        }
+        double get_sum() const {
+                double ret = 0;
+                for (const auto &s : shards) {
+                        ret += s.sum.load(memory_order_relaxed);
+                }
+                return ret;
+        }
+        /// @returns cumulative count of observations <= bounds[i] (i == bounds.size() for +Inf)
+        long long get_bucket(size_t i) const {
+                long long ret = 0;
+                for (const auto &s : shards) {
+                        for (size_t j = 0; j <= i; ++j) {
+                                ret += s.buckets[j].load(memory_order_relaxed);
+                        }
+                }
+                return ret;
+        }
+};
+
+namespace {
+struct metrics_registry {
+        mutex lock;
+        map<string, unique_ptr<metric>> metrics; ///< keyed by name + labels so that families are adjacent
+};
+
+/// intentionally leaked so that the metrics may be used until exit
+metrics_registry &get_registry() {
+        static auto *r = new metrics_registry();
+        return *r;
+}
+
+vector<pair<string, string>> parse_labels(const char *labels) {
+        vector<pair<string, string>> ret;
+        if (labels == nullptr) {
+                return ret;
+        }
+        std::istringstream iss(labels);
+        string item;
+        while (getline(iss, item, ',')) {
+                auto eq = item.find('=');
+                assert(eq != string::npos);
+                ret.emplace_back(item.substr(0, eq), item.substr(eq + 1));
+        }
+        return ret;
+}
+
+struct metric *get_metric(enum metric_type type, const char *name, const char *help, const char *labels,
+                const double *bounds, int bound_count) {
+        auto &r = get_registry();
+        string key = string(name) + '\0' + (labels != nullptr ? labels : "");
+        lock_guard<mutex> lk(r.lock);
+        auto &m = r.metrics[key];
+        if (m) {
+                assert(m->type == type);
+                return m.get();
+        }
+        m = std::make_unique<metric>();
+        m->type = type;
+        m->name = name;
+        m->help = help;
+        m->labels = parse_labels(labels);
+        if (type == METRIC_HISTOGRAM) {
+                if (bounds == nullptr) {
+                        bounds = default_bounds;
+                        bound_count = sizeof default_bounds / sizeof default_bounds[0];
+                }
+                assert(bound_count <= MAX_BUCKETS);
+                m->bounds.assign(bounds, bounds + bound_count);
+        }
+        return m.get();
+}
+
+string escape(const string &str) {
+        string ret;
+        for (char c : str) {
+                if (c == '"' || c == '\\') {
+                        ret += '\\';
+                } else if (c == '\n') {
+                        ret += "\\n";
+                        continue;
+                }
+                ret += c;
+        }
+        return ret;
+}
+
+string format_labels(const metric &m, const char *extra_key = nullptr, const string &extra_val = {}) {
+        if (m.labels.empty() && extra_key == nullptr) {
+                return {};
+        }
+        string ret = "{";
+        for (const auto &l : m.labels) {
+                ret += (ret.size() > 1 ? "," : "") + l.first + "=\"" + escape(l.second) + "\"";
+        }
+        if (extra_key != nullptr) {
+                ret += (ret.size() > 1 ? "," : "") + string(extra_key) + "=\"" + extra_val + "\"";
+        }
+        return ret + "}";
+}
+
+string format_double(double val) {
+        if (std::isinf(val)) {
+                return val > 0 ? "+Inf" : "-Inf";
+        }
+        ostringstream oss;
+        oss << val;
+        return oss.str();
+}
+
+const char *type_name(enum metric_type type) {
+        switch (type) {
+        case METRIC_COUNTER: return "counter";
+        case METRIC_GAUGE: return "gauge";
+        case METRIC_HISTOGRAM: return "histogram";
+        }
+        return "unknown";
+}
+} // end of anonymous namespace
+
+struct metric *metric_counter(const char *name, const char *help, const char *labels)
+{
+        return get_metric(METRIC_COUNTER, name, help, labels, nullptr, 0);
+}
+
+struct metric *metric_gauge(const char *name, const char *help, const char *labels)
+{
+        return get_metric(METRIC_GAUGE, name, help, labels, nullptr, 0);
+}
+
+struct metric *metric_histogram(const char *name, const char *help, const char *labels,
+                const double *bounds, int bound_count)
+{
+        return get_metric(METRIC_HISTOGRAM, name, help, labels, bounds, bound_count);
+}
+
+void metric_add(struct metric *m, long long val)
+{
+        m->shards[shard_idx].count.fetch_add(val, memory_order_relaxed);
+}
+
+void metric_set(struct metric *m, double val)
+{
+        m->gauge.store(val, memory_order_relaxed);
+}
+
+void metric_observe(struct metric *m, double val)
+{
+        size_t i = 0;
+        while (i < m->bounds.size() && val > m->bounds[i]) {
+                ++i;
+        }
+        auto &s = m->shards[shard_idx];
+        s.buckets[i].fetch_add(1, memory_order_relaxed);
+        s.count.fetch_add(1, memory_order_relaxed);
+        atomic_add(s.sum, val);
+}
+
+/**
+ * @returns all metrics in OpenMetrics text exposition format (terminated by "# EOF")
+ */
+std::string metrics_format_openmetrics()
+{
+        auto &r = get_registry();
+        lock_guard<mutex> lk(r.lock);
+        ostringstream out;
+        const string *last_family = nullptr;
+        for (const auto &it : r.metrics) {
+                const metric &m = *it.second;
+                if (last_family == nullptr || *last_family != m.name) {
+                        out << "# TYPE " << m.name << " " << type_name(m.type) << "\n";
+                        out << "# HELP " << m.name << " " << escape(m.help) << "\n";
+                        last_family = &m.name;
+                }
+                switch (m.type) {
+                case METRIC_COUNTER:
+                        out << m.name << "_total" << format_labels(m) << " " << m.get_count() << "\n";
+                        break;
+                case METRIC_GAUGE:
+                        out << m.name << format_labels(m) << " " << format_double(m.gauge.load(memory_order_relaxed)) << "\n";
+                        break;
+                case METRIC_HISTOGRAM:
+                        for (size_t i = 0; i <= m.bounds.size(); ++i) {
+                                string le = format_double(i < m.bounds.size() ? m.bounds[i] : INFINITY);
+                                out << m.name << "_bucket" << format_labels(m, "le", le) << " " << m.get_bucket(i) << "\n";
+                        }
+                        out << m.name << "_count" << format_labels(m) << " " << m.get_count() << "\n";
+                        out << m.name << "_sum" << format_labels(m) << " " << format_double(m.get_sum()) << "\n";
+                        break;
+                }
+        }
+        out << "# EOF\n";
+        return out.str();
+}
+
+/**
+ * @returns all metrics as a single-line JSON object
+ */
+std::string metrics_format_json()
+{
+        auto &r = get_registry();
+        lock_guard<mutex> lk(r.lock);
+        ostringstream out;
+        out << "{\"metrics\":[";
+        bool first = true;
+        for (const auto &it : r.metrics) {
+                const metric &m = *it.second;
+                out << (first ? "" : ",") << "{\"name\":\"" << m.name << "\",\"type\":\"" << type_name(m.type) << "\"";
+                first = false;
+                if (!m.labels.empty()) {
+                        out << ",\"labels\":{";
+                        for (size_t i = 0; i < m.labels.size(); ++i) {
+                                out << (i > 0 ? "," : "") << "\"" << m.labels[i].first << "\":\"" << escape(m.labels[i].second) << "\"";
+                        }
+                        out << "}";
+                }
+                switch (m.type) {
+                case METRIC_COUNTER:
+                        out << ",\"value\":" << m.get_count();
+                        break;
+                case METRIC_GAUGE: {
+                        double val = m.gauge.load(memory_order_relaxed);
+                        out << ",\"value\":";
+                        if (std::isfinite(val)) {
+                                out << val;
+                        } else {
+                                out << "null";
+                        }
+                        break;
+                }
+                case METRIC_HISTOGRAM:
+                        out << ",\"count\":" << m.get_count() << ",\"sum\":" << m.get_sum() << ",\"buckets\":[";
+                        for (size_t i = 0; i < m.bounds.size(); ++i) {
+                                out << (i > 0 ? "," : "") << "[" << m.bounds[i] << "," << m.get_bucket(i) << "]";
+                        }
+                        out << "]";
+                        break;
+                }
+                out << "}";
+        }
+        out << "]}";
+        return out.str();
+}
+
@@ -0,0 +1,86 @@
+/**
+ * @file   utils/metrics.h
+ * @brief  Registry of counters, gauges and histograms
+ *
+ * Modules obtain a metric once (eg. to a function-local static variable) and
+ * update it from any thread. Counters and histograms are sharded per thread
+ * so updates are lock-free and do not contend. The registry is exposed over
+ * the control socket by the "metrics [json]" command in the OpenMetrics text
+ * format or as JSON.
+ *
+ * Metrics live until program exit, obtaining the same name and labels again
+ * returns the same metric, so that values of multiple instances of a module
+ * are aggregated.
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_METRICS_H_
+#define UTILS_METRICS_H_
+
+#ifdef __cplusplus
+#include <string>
+extern "C" {
+#endif
+
+enum metric_type {
+        METRIC_COUNTER,
+        METRIC_GAUGE,
+        METRIC_HISTOGRAM,
+};
+
+struct metric;
+
+/**
+ * @param name   metric name (counters without the "_total" suffix, it is added on output)
+ * @param labels comma-separated list of key=value pairs, may be NULL
+ */
+struct metric *metric_counter(const char *name, const char *help, const char *labels);
+struct metric *metric_gauge(const char *name, const char *help, const char *labels);
+/// @param bounds ascending bucket upper bounds, NULL for the default latency buckets (in ms)
+struct metric *metric_histogram(const char *name, const char *help, const char *labels,
+                const double *bounds, int bound_count);
+
+void metric_add(struct metric *m, long long val);
+void metric_set(struct metric *m, double val);
+void metric_observe(struct metric *m, double val);
+
+#ifdef __cplusplus
+}
+
+std::string metrics_format_openmetrics();
+std::string metrics_format_json();
+#endif
+
+#endif // defined UTILS_METRICS_H_
+
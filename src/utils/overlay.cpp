@@ -0,0 +1,202 @@
+/**
+ * @file   utils/overlay.cpp
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ * 
+ *      This product includes software developed by CESNET z.s.p.o.
+ * 
+ * 4. Neither the name of the CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "utils/overlay.h"
+#include "video_codec.h"
+
+using std::max;
+using std::min;
+using std::vector;
+
+/**
+ * For every byte of the bounding box the frame byte is replaced by
+ * (premult + in * inv_alpha) >> 8, where premult = color * alpha + 128 and
+ * inv_alpha = 256 - alpha (alpha scaled to 0-256), which fits 16 bits.
+ */
+struct overlay {
+        size_t x_offset;        ///< offset of the bounding box from the line start (bytes)
+        int y;                  ///< first line of the bounding box
+        size_t linesize;        ///< bounding box line length (bytes)
+        int height;             ///< bounding box height (lines)
+        vector<uint16_t> premult;
+        vector<uint16_t> inv_alpha;
+};
+
+bool overlay_codec_supported(codec_t codec)
+{
+        return codec == RGB || codec == RGBA || codec == UYVY;
+}
+
+/**
+ * @param rgba          overlay image (RGBA, not premultiplied)
+ * @param frame_width   width of the frames the overlay will be blended to
+ * @param x,y           position of the overlay in the frame, the overlay must fit
+ * @returns             overlay or NULL if codec is not supported
+ */
+struct overlay *overlay_create(const unsigned char *rgba, int width, int height,
+                codec_t codec, int frame_width, int x, int y)
+{
+        if (!overlay_codec_supported(codec)) {
+                return nullptr;
+        }
+        auto *o = new overlay();
+
+        // bounding box of the non-transparent pixels
+        int x0 = width, x1 = 0, y0 = height, y1 = 0;
+        for (int j = 0; j < height; ++j) {
+                for (int i = 0; i < width; ++i) {
+                        if (rgba[4 * (j * width + i) + 3] != 0) {
+                                x0 = min(x0, i);
+                                x1 = max(x1, i + 1);
+                                y0 = min(y0, j);
+                                y1 = max(y1, j + 1);
+                        }
+                }
+        }
+        if (x0 >= x1) { // fully transparent
+                return o;
+        }
+        // align to the pixel block of the frame (eg. UYVY macropixel)
+        const int block = get_pf_block_pixels(codec);
+        int fx0 = (x + x0) / block * block;
+        int fx1 = min((x + x1 + block - 1) / block * block, frame_width);
+        const int box_w = fx1 - fx0;
+
+        o->x_offset = vc_get_linesize(fx0, codec);
+        o->y = y + y0;
+        o->linesize = vc_get_linesize(box_w, codec);
+        o->height = y1 - y0;
+        o->premult.resize(o->linesize * o->height);
+        o->inv_alpha.resize(o->linesize * o->height);
+
+        decoder_t coder = get_decoder_from_to(RGB, codec);
+        vector<unsigned char> rgb_line(3 * box_w);
+        vector<unsigned char> alpha_line(box_w);
+        vector<unsigned char> native_line(o->linesize);
+        for (int j = 0; j < o->height; ++j) {
+                for (int i = 0; i < box_w; ++i) {
+                        int src_x = fx0 + i - x;
+                        const unsigned char *px = src_x >= 0 && src_x < width ?
+                                rgba + 4 * ((y0 + j) * width + src_x) : nullptr;
+                        for (int c = 0; c < 3; ++c) {
+                                rgb_line[3 * i + c] = px ? px[c] : 0;
+                        }
+                        alpha_line[i] = px ? px[3] : 0;
+                }
+                if (block == 2) { // do not let transparent pixels affect the subsampled chroma
+                        for (int i = 0; i + 1 < box_w; i += 2) {
+                                int src = alpha_line[i] == 0 ? i + 1 : alpha_line[i + 1] == 0 ? i : -1;
+                                if (src >= 0) {
+                                        std::copy_n(&rgb_line[3 * src], 3, &rgb_line[3 * (src ^ 1)]);
+                                }
+                        }
+                }
+                if (coder == nullptr) { // RGB
+                        std::copy(rgb_line.begin(), rgb_line.end(), native_line.begin());
+                } else {
+                        coder(native_line.data(), rgb_line.data(), o->linesize, 0, 8, 16);
+                }
+                for (size_t b = 0; b < o->linesize; ++b) {
+                        unsigned alpha = 0;
+                        if (codec == UYVY) { // U Y0 V Y1 - chroma has average alpha of both pixels
+                                int px = b / 4 * 2;
+                                alpha = b % 2 == 1 ? alpha_line[px + b % 4 / 2]
+                                        : (alpha_line[px] + alpha_line[px + 1] + 1) / 2;
+                        } else {
+                                alpha = alpha_line[b / get_pf_block_bytes(codec)];
+                        }
+                        alpha += alpha >> 7; // 0-255 -> 0-256
+                        o->premult[j * o->linesize + b] = native_line[b] * alpha + 128;
+                        o->inv_alpha[j * o->linesize + b] = 256 - alpha;
+                }
+        }
+
+        return o;
+}
+
+/**
+ * Blends the overlay over the frame data (tile 0) with given pitch.
+ */
+void overlay_blend(const struct overlay *o, char *data, size_t pitch)
+{
+        for (int j = 0; j < o->height; ++j) {
+                auto *out = (unsigned char *) data + (o->y + j) * pitch + o->x_offset;
+                const uint16_t *premult = o->premult.data() + j * o->linesize;
+                const uint16_t *inv_alpha = o->inv_alpha.data() + j * o->linesize;
+                size_t i = 0;
+#ifdef __SSE2__
+                const __m128i zero = _mm_setzero_si128();
+                for (; i + 16 <= o->linesize; i += 16) {
+                        __m128i in = _mm_loadu_si128((const __m128i *)(void *) (out + i));
+                        __m128i lo = _mm_add_epi16(_mm_loadu_si128((const __m128i *)(const void *) (premult + i)),
+                                        _mm_mullo_epi16(_mm_unpacklo_epi8(in, zero),
+                                                _mm_loadu_si128((const __m128i *)(const void *) (inv_alpha + i))));
+                        __m128i hi = _mm_add_epi16(_mm_loadu_si128((const __m128i *)(const void *) (premult + i + 8)),
+                                        _mm_mullo_epi16(_mm_unpackhi_epi8(in, zero),
+                                                _mm_loadu_si128((const __m128i *)(const void *) (inv_alpha + i + 8))));
+                        _mm_storeu_si128((__m128i *)(void *) (out + i),
+                                        _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+                }
+#endif
+                for (; i < o->linesize; ++i) {
+                        out[i] = (uint16_t) (premult[i] + out[i] * inv_alpha[i]) >> 8;
+                }
+        }
+}
+
+void overlay_destroy(struct overlay *o)
+{
+        delete o;
+}
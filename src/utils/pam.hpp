@@ -65,13 +65,13 @@ MAYBE_UNUSED static bool pam_read(const char *filename, unsigned int *width, uns
                 getline(file, line);
                 *width = 0, *height = 0, *depth = 0;
                 while (!file.eof()) {
-                        if (line.compare(0, std::string("WIDTH ").length(), "WIDTH") == 0) {
+                        if (line.compare(0, std::string("WIDTH ").length(), "WIDTH ") == 0) {
                                 *width = atoi(line.c_str() + std::string("WIDTH ").length());
-                        } else if (line.compare(0, std::string("HEIGHT ").length(), "HEIGHT") == 0) {
+                        } else if (line.compare(0, std::string("HEIGHT ").length(), "HEIGHT ") == 0) {
                                 *height = atoi(line.c_str() + std::string("HEIGHT ").length());
-                        } else if (line.compare(0, std::string("DEPTH ").length(), "DEPTH") == 0) {
+                        } else if (line.compare(0, std::string("DEPTH ").length(), "DEPTH ") == 0) {
                                 *depth = atoi(line.c_str() + std::string("DEPTH ").length());
-                        } else if (line.compare(0, std::string("MAXVAL ").length(), "MAXVAL") == 0) {
+                        } else if (line.compare(0, std::string("MAXVAL ").length(), "MAXVAL ") == 0) {
                                 if (atoi(line.c_str() + std::string("MAXVAL ").length()) != 255) {
                                         throw std::string("Only supported maxval is 255.");
                                 }
@@ -79,6 +79,6 @@ void parallel_pix_conv(int height, char *out, int out_linesize, const char *in,
                 }
         }
 
-        task_run_parallel(parallel_pix_conv_task, threads, data, sizeof data[0], NULL);
+        task_run_parallel_pinned(parallel_pix_conv_task, threads, data, sizeof data[0], NULL);
 }
 
@@ -0,0 +1,298 @@
+/**
+ * @file   utils/probe_cache.cpp
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <unistd.h>
+#endif
+
+#include "debug.h"
+#include "host.h"
+#include "utils/fs.h"
+#include "utils/macros.h"
+#include "utils/probe_cache.hpp"
+
+#define MOD_NAME "[probe cache] "
+#define PROBE_CACHE_VERSION "UG-PROBE-CACHE 1"
+#define DEFAULT_TTL_S 300
+#define REFRESH_LOCK_TIMEOUT_S 120 ///< lock of a crashed prober is ignored after that
+
+using std::ifstream;
+using std::ofstream;
+using std::ostream;
+using std::ostringstream;
+using std::set;
+using std::string;
+using std::vector;
+
+#ifndef _WIN32
+extern char **environ;
+#endif
+
+ADD_TO_PARAM("probe-cache", "* probe-cache=<sec>|no\n"
+                "  Validity of cached device probe results (default " TOSTRING(DEFAULT_TTL_S) " s), no - disable the cache\n");
+ADD_TO_PARAM("probe-cache-refresh", "* probe-cache-refresh=<key>[:<key>...]\n"
+                "  Re-probe given cache entries (used internally by the background prober)\n");
+
+namespace {
+
+set<string> expired_keys; ///< expired entries returned by this process
+
+long get_ttl()
+{
+        const char *val = get_commandline_param("probe-cache");
+        if (val == nullptr) {
+                return DEFAULT_TTL_S;
+        }
+        if (strcmp(val, "no") == 0) {
+                return -1;
+        }
+        return strtol(val, nullptr, 10);
+}
+
+bool is_refreshed_by_us(const string &key)
+{
+        const char *val = get_commandline_param("probe-cache-refresh");
+        if (val == nullptr) {
+                return false;
+        }
+        string list = string(":") + val + ":";
+        return list.find(":" + key + ":") != string::npos;
+}
+
+string get_entry_path(const string &key)
+{
+        const char *dir = get_cache_dir();
+        if (dir == nullptr) {
+                return {};
+        }
+        string name = key;
+        std::replace_if(name.begin(), name.end(), [](char c) { return isalnum((unsigned char) c) == 0 && c != '.'; }, '_');
+        return string(dir) + "probe_" + name + ".cache";
+}
+
+void fnv1a(uint64_t *hash, const string &str)
+{
+        for (unsigned char c : str + '\0') {
+                *hash = (*hash ^ c) * 0x100000001b3ULL;
+        }
+}
+
+/**
+ * Hash of things that change when a device is (un)plugged, so that the
+ * cached entries are invalidated immediately and not only after the TTL.
+ * Contains also the build version because probe output format may change.
+ */
+string get_hotplug_fingerprint()
+{
+        static string fingerprint;
+        if (!fingerprint.empty()) {
+                return fingerprint;
+        }
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        fnv1a(&hash, get_version_details());
+#ifndef _WIN32
+        for (const char *dir : { "/dev", "/dev/snd", "/dev/dri", "/sys/bus/usb/devices" }) {
+                DIR *d = opendir(dir);
+                if (d == nullptr) {
+                        continue;
+                }
+                vector<string> names;
+                while (struct dirent *ent = readdir(d)) {
+                        names.emplace_back(ent->d_name);
+                }
+                closedir(d);
+                std::sort(names.begin(), names.end());
+                fnv1a(&hash, dir);
+                for (auto const &n : names) {
+                        fnv1a(&hash, n);
+                }
+        }
+        ifstream cards("/proc/asound/cards");
+        ostringstream oss;
+        oss << cards.rdbuf();
+        fnv1a(&hash, oss.str());
+#endif
+        char buf[17];
+        snprintf(buf, sizeof buf, "%016" PRIx64, hash);
+        return fingerprint = buf;
+}
+
+/// @retval false  entry missing, unreadable or invalidated by hotplug
+bool read_entry(const string &path, string *out, long long *age)
+{
+        ifstream in(path);
+        string magic;
+        if (!getline(in, magic) || magic != PROBE_CACHE_VERSION) {
+                return false;
+        }
+        long long timestamp = 0;
+        string fingerprint;
+        if (!(in >> timestamp >> fingerprint) || fingerprint != get_hotplug_fingerprint()) {
+                return false;
+        }
+        in.ignore(1); // newline
+        ostringstream oss;
+        oss << in.rdbuf();
+        *out = oss.str();
+        *age = (long long) time(nullptr) - timestamp;
+        return true;
+}
+
+void write_entry(const string &path, const string &content)
+{
+        string tmp_path = path + ".tmp" + std::to_string(getpid());
+        {
+                ofstream out(tmp_path);
+                out << PROBE_CACHE_VERSION << "\n" << (long long) time(nullptr) << " " << get_hotplug_fingerprint() << "\n" << content;
+                if (!out) {
+                        remove(tmp_path.c_str());
+                        return;
+                }
+        }
+        remove(path.c_str()); // Windows rename() doesn't overwrite
+        if (rename(tmp_path.c_str(), path.c_str()) != 0) {
+                remove(tmp_path.c_str());
+        }
+}
+
+string get_refresh_lock_path()
+{
+        const char *dir = get_cache_dir();
+        return dir != nullptr ? string(dir) + "probe_refresh.lock" : string();
+}
+
+} // end of anonymous namespace
+
+std::string probe_cache_get(const std::string &key,
+                const std::function<void(std::ostream &)> &probe)
+{
+        long ttl = get_ttl();
+        string path = ttl >= 0 ? get_entry_path(key) : string();
+        if (!path.empty() && !is_refreshed_by_us(key)) {
+                string cached;
+                long long age = 0;
+                if (read_entry(path, &cached, &age)) {
+                        if (age <= ttl) {
+                                return cached;
+                        }
+#ifndef _WIN32
+                        // serve the old result, the background prober updates it
+                        expired_keys.insert(key);
+                        return cached;
+#endif
+                }
+        }
+
+        ostringstream oss;
+        probe(oss);
+        if (!path.empty()) {
+                write_entry(path, oss.str());
+        }
+        return oss.str();
+}
+
+void probe_cache_refresh_expired()
+{
+        string lock_path = get_refresh_lock_path();
+        if (get_commandline_param("probe-cache-refresh") != nullptr) { // we are the prober
+                if (!lock_path.empty()) {
+                        remove(lock_path.c_str());
+                }
+                return;
+        }
+        if (expired_keys.empty() || lock_path.empty()) {
+                return;
+        }
+#ifndef _WIN32
+        int fd = open(lock_path.c_str(), O_CREAT | O_EXCL | O_WRONLY, 0600);
+        if (fd == -1) {
+                struct stat st{};
+                if (stat(lock_path.c_str(), &st) == 0 && time(nullptr) - st.st_mtime < REFRESH_LOCK_TIMEOUT_S) {
+                        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Refresh already in progress.\n");
+                        return;
+                }
+                fd = open(lock_path.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0600); // stale lock
+                if (fd == -1) {
+                        return;
+                }
+        }
+        close(fd);
+
+        string keys;
+        for (auto const &k : expired_keys) {
+                keys += (keys.empty() ? "" : ":") + k;
+        }
+        string exe = get_executable_path();
+        string param = "probe-cache-refresh=" + keys;
+        char *argv[] = { const_cast<char *>(exe.c_str()), const_cast<char *>("--param"),
+                const_cast<char *>(param.c_str()), const_cast<char *>("--capabilities"), nullptr };
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        for (int i = 0; i <= 2; ++i) { // do not hold stdout pipe of the caller (GUI)
+                posix_spawn_file_actions_addopen(&actions, i, "/dev/null", i == 0 ? O_RDONLY : O_WRONLY, 0);
+        }
+        pid_t pid = 0;
+        int ret = exe.empty() ? -1 : posix_spawn(&pid, exe.c_str(), &actions, nullptr, argv, environ);
+        posix_spawn_file_actions_destroy(&actions);
+        if (ret != 0) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Cannot start background prober: %s\n", strerror(ret == -1 ? ENOENT : ret));
+                remove(lock_path.c_str());
+                return;
+        }
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Refreshing %s in background (PID %ld).\n", keys.c_str(), (long) pid);
+#endif
+}
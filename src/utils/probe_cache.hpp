@@ -0,0 +1,67 @@
+/**
+ * @file   utils/probe_cache.hpp
+ * @brief  Persistent cache of device probe results
+ *
+ * Probing some modules (DeckLink, AJA, NDI, V4L2...) takes up to several
+ * seconds, which makes repeated `--capabilities` calls (as done by the GUI)
+ * slow. Results are therefore cached in the user cache directory. An entry
+ * is valid until its TTL expires or the set of present devices changes
+ * (hotplug). Expired entries are served as they are and refreshed by a
+ * background prober process.
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_PROBE_CACHE_HPP_
+#define UTILS_PROBE_CACHE_HPP_
+
+#include <functional>
+#include <ostream>
+#include <string>
+
+/**
+ * Returns output of probe identified by key, either from the cache or by
+ * running probe (which writes the output to the stream passed).
+ *
+ * @param key  unique identification of the probed module, eg. "video_cap.v4l2"
+ */
+std::string probe_cache_get(const std::string &key,
+                const std::function<void(std::ostream &)> &probe);
+
+/**
+ * Starts the background prober refreshing the entries that were returned
+ * expired by probe_cache_get(). Doesn't wait for completion.
+ */
+void probe_cache_refresh_expired(void);
+
+#endif // defined UTILS_PROBE_CACHE_HPP_
@@ -133,10 +133,23 @@ extern "C" {
 
 #else //BUILD_PROFILED
 
-#define PROFILE_FUNC
-#define PROFILE_DETAIL(name)
-#define C_PROFILER_PUSH(name)
-#define C_PROFILER_POP
+// record to the runtime-toggleable backend
+#include "utils/trace_events.h"
+
+#ifdef __cplusplus
+#define PROFILE_FUNC \
+        Trace_scope PROFILER_PROFILE_TIMER_FUNC(__PRETTY_FUNCTION__); \
+        Trace_scope PROFILER_PROFILE_TIMER_DETAIL(nullptr);
+
+#define PROFILE_DETAIL(name) \
+        PROFILER_PROFILE_TIMER_DETAIL.next((name));
+#endif //__cplusplus
+
+#define C_PROFILER_PUSH(name) \
+        trace_events_push((name))
+
+#define C_PROFILER_POP \
+        trace_events_pop()
 
 #endif //BUILD_PROFILED
 
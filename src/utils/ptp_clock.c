@@ -0,0 +1,145 @@
+/**
+ * @file   utils/ptp_clock.c
+ * @brief  PTP (IEEE 1588) reference clock read from a PTP hardware clock
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif
+
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#ifdef HAVE_LINUX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "debug.h"
+#include "host.h"
+#include "utils/ptp_clock.h"
+
+#define MOD_NAME "[PTP] "
+#define DEFAULT_PTP_DEVICE "/dev/ptp0"
+
+#ifdef HAVE_LINUX
+// dynamic POSIX clock of a character device, see linux/posix-timers.h
+#define CLOCKFD 3
+#define FD_TO_CLOCKID(fd) ((clockid_t) ((((unsigned int) ~(fd)) << 3U) | CLOCKFD))
+#endif
+
+static pthread_once_t ptp_clock_once = PTHREAD_ONCE_INIT;
+static bool ptp_clock_ok;
+#ifdef HAVE_LINUX
+static clockid_t ptp_clock_id;
+#endif
+
+ADD_TO_PARAM("ptp-clock", "* ptp-clock[=<dev>|tai]\n"
+                "  Take media timestamps and RTCP sender report times from PTP time - the PTP hardware\n"
+                "  clock <dev> (default " DEFAULT_PTP_DEVICE ") or CLOCK_TAI (disciplined by phc2sys). Linux only.\n");
+
+static void ptp_clock_init(void)
+{
+        const char *dev = get_commandline_param("ptp-clock");
+        if (dev == NULL) {
+                return;
+        }
+#ifdef HAVE_LINUX
+        if (strcmp(dev, "tai") == 0) {
+                ptp_clock_id = CLOCK_TAI;
+        } else {
+                if (strlen(dev) == 0) {
+                        dev = DEFAULT_PTP_DEVICE;
+                }
+                int fd = open(dev, O_RDONLY);
+                if (fd == -1) {
+                        log_perror(LOG_LEVEL_ERROR, MOD_NAME "Cannot open PTP clock");
+                        return;
+                }
+                ptp_clock_id = FD_TO_CLOCKID(fd); // kept open for the lifetime of the process
+        }
+        struct timespec ts;
+        if (clock_gettime(ptp_clock_id, &ts) != 0) {
+                log_perror(LOG_LEVEL_ERROR, MOD_NAME "Cannot read PTP clock");
+                return;
+        }
+        ptp_clock_ok = true;
+        log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Using %s as the reference clock.\n", dev);
+#else
+        log_msg(LOG_LEVEL_ERROR, MOD_NAME "PTP clock is supported only on Linux, using system clock.\n");
+#endif
+}
+
+/**
+ * @returns true if the PTP clock was requested and can be used
+ */
+bool ptp_clock_enabled(void)
+{
+        pthread_once(&ptp_clock_once, ptp_clock_init);
+        return ptp_clock_ok;
+}
+
+/**
+ * @returns current PTP time in ns (or system time if PTP clock is not enabled)
+ */
+time_ns_t ptp_clock_get_ns(void)
+{
+#ifdef HAVE_LINUX
+        if (ptp_clock_enabled()) {
+                struct timespec ts;
+                clock_gettime(ptp_clock_id, &ts);
+                return ts.tv_sec * NS_IN_SEC + ts.tv_nsec;
+        }
+#endif
+        return get_time_in_ns();
+}
+
+/**
+ * @returns offset of PTP time to get_time_in_ns() clock (PTP - system), to
+ * convert between timestamps in the two clocks
+ */
+time_ns_t ptp_clock_get_offset_ns(void)
+{
+        if (!ptp_clock_enabled()) {
+                return 0;
+        }
+        // PHC read can take microseconds (PCIe) - compare to the middle of the read
+        time_ns_t before = get_time_in_ns();
+        time_ns_t ptp = ptp_clock_get_ns();
+        time_ns_t after = get_time_in_ns();
+        return ptp - (before + (after - before) / 2);
+}
@@ -44,6 +44,9 @@
 #include <memory>
 #include <atomic>
 
+/// indices written by different threads are kept in separate cache lines
+static constexpr size_t CACHE_LINE_SIZE = 64;
+
 struct ring_buffer {
         std::unique_ptr<char[]> data;
         int len;
@@ -59,8 +62,16 @@ struct ring_buffer {
          *
          * When the range is doubled, full buffer has start == end in modulo
          * ring->len, but not in modulo 2*ring->len.
+         *
+         * Each side keeps a private copy of the other side's index and reloads
+         * it only when the copy doesn't suffice, so that the cache line
+         * owned by the other thread is not touched on every call.
          */
-        std::atomic<int> start, end;
+        alignas(CACHE_LINE_SIZE) std::atomic<int> start; ///< written by reader
+        int reader_cached_end;
+        alignas(CACHE_LINE_SIZE) std::atomic<int> end; ///< written by writer
+        int writer_cached_start;
+        alignas(CACHE_LINE_SIZE) std::atomic<long long> dropped; ///< bytes not written by ring_buffer_try_write()
 };
 
 struct ring_buffer *ring_buffer_init(int size) {
@@ -71,6 +82,9 @@ struct ring_buffer *ring_buffer_init(int size) {
         ring->len = size;
         ring->start = 0;
         ring->end = 0;
+        ring->reader_cached_end = 0;
+        ring->writer_cached_start = 0;
+        ring->dropped = 0;
         return ring;
 }
 
@@ -97,14 +111,17 @@ int ring_get_read_regions(struct ring_buffer *ring, int max_len,
                 void **ptr1, int *size1,
                 void **ptr2, int *size2)
 {
-        /* end index is modified by the writer thread, use acquire order to ensure
-         * that all writes by the writer thread made before the modification are
-         * observable in this (reader) thread */
-        int end = std::atomic_load_explicit(&ring->end, std::memory_order_acquire);
         // start index is modified only by this (reader) thread, so relaxed is enough
         int start = std::atomic_load_explicit(&ring->start, std::memory_order_relaxed);
 
-        int read_len = calculate_avail_read(start, end, ring->len);
+        int read_len = calculate_avail_read(start, ring->reader_cached_end, ring->len);
+        if (read_len < max_len) {
+                /* end index is modified by the writer thread, use acquire order to ensure
+                 * that all writes by the writer thread made before the modification are
+                 * observable in this (reader) thread */
+                ring->reader_cached_end = std::atomic_load_explicit(&ring->end, std::memory_order_acquire);
+                read_len = calculate_avail_read(start, ring->reader_cached_end, ring->len);
+        }
         if(read_len > max_len)
                 read_len = max_len;
 
@@ -159,6 +176,8 @@ void ring_buffer_flush(struct ring_buffer * buf) {
          */
         buf->start = 0;
         buf->end = 0;
+        buf->reader_cached_end = 0;
+        buf->writer_cached_start = 0;
 }
 
 int ring_get_write_regions(struct ring_buffer *ring, int requested_len,
@@ -189,10 +208,34 @@ int ring_get_write_regions(struct ring_buffer *ring, int requested_len,
         return *size1 + *size2;
 }
 
+/**
+ * Returns space available for writing as seen by the writer. The cached start
+ * index is refreshed only if it doesn't indicate enough space for needed.
+ */
+static int writer_avail_write(struct ring_buffer *ring, int end, int needed) {
+        int avail = calculate_avail_write(ring->writer_cached_start, end, ring->len);
+        if (avail < needed) {
+                // pairs with the release in ring_advance_read_idx() - reader is done with the memory
+                ring->writer_cached_start = std::atomic_load_explicit(&ring->start, std::memory_order_acquire);
+                avail = calculate_avail_write(ring->writer_cached_start, end, ring->len);
+        }
+        return avail;
+}
+
+int ring_get_free_write_regions(struct ring_buffer *ring, int max_len,
+                void **ptr1, int *size1,
+                void **ptr2, int *size2)
+{
+        // end index is modified only by this (writer) thread, so relaxed is enough
+        int end = std::atomic_load_explicit(&ring->end, std::memory_order_relaxed);
+        int avail = writer_avail_write(ring, end, max_len);
+        return ring_get_write_regions(ring, avail < max_len ? avail : max_len, ptr1, size1, ptr2, size2);
+}
+
 bool ring_advance_write_idx(struct ring_buffer *ring, int amount) {
-        const int start = std::atomic_load_explicit(&ring->start, std::memory_order_acquire);
         // end index is modified only by this (writer) thread, so relaxed is enough
         const int end = std::atomic_load_explicit(&ring->end, std::memory_order_relaxed);
+        const int avail = writer_avail_write(ring, end, amount);
 
         /* Use release order to ensure that all writes to the buffer are
          * completed before advancing the end index (no reads or writes in the
@@ -201,7 +244,7 @@ bool ring_advance_write_idx(struct ring_buffer *ring, int amount) {
         std::atomic_store_explicit(&ring->end,
                         (end + amount) % (2*ring->len), std::memory_order_release);
 
-        return amount > calculate_avail_write(start, end, ring->len);
+        return amount > avail;
 }
 
 void ring_buffer_write(struct ring_buffer * ring, const char *in, int len) {
@@ -224,6 +267,29 @@ void ring_buffer_write(struct ring_buffer * ring, const char *in, int len) {
         }
 }
 
+int ring_buffer_try_write(struct ring_buffer *ring, const char *in, int len) {
+        void *ptr1;
+        int size1;
+        void *ptr2;
+        int size2;
+        int written = ring_get_free_write_regions(ring, len, &ptr1, &size1, &ptr2, &size2);
+
+        memcpy(ptr1, in, size1);
+        if (ptr2) {
+                memcpy(ptr2, in + size1, size2);
+        }
+        ring_advance_write_idx(ring, written);
+
+        if (written < len) {
+                std::atomic_fetch_add_explicit(&ring->dropped, (long long) len - written, std::memory_order_relaxed);
+        }
+        return written;
+}
+
+long long ring_buffer_fetch_dropped(struct ring_buffer *ring) {
+        return std::atomic_exchange_explicit(&ring->dropped, 0LL, std::memory_order_relaxed);
+}
+
 int ring_get_size(struct ring_buffer * ring) {
         return ring->len;
 }
@@ -53,6 +53,12 @@ extern "C" {
 /**
  * @warining ring_buffer is generally not thread safe. The exception is when
  * one thread reads and the other writes to the ring buffer (producer-consumer).
+ *
+ * In that setting, all read and write functions are wait-free and do not
+ * allocate, so they can be called from real-time audio callbacks. Prefer
+ * ring_buffer_try_write() or ring_get_free_write_regions() there - the other
+ * write functions overwrite unread data on overflow, which races with the
+ * reader, and ring_buffer_write() also prints a warning.
  */
 struct ring_buffer;
 typedef struct ring_buffer ring_buffer_t;
@@ -67,6 +73,19 @@ void ring_buffer_destroy(struct ring_buffer * ring);
  */
 int ring_buffer_read(struct ring_buffer * ring, char *out, int max_len);
 void ring_buffer_write(struct ring_buffer * ring, const char *in, int len);
+/**
+ * Writes as much of the data as fits without overwriting unread data, the
+ * rest is dropped and accounted (see ring_buffer_fetch_dropped()). Doesn't
+ * print anything.
+ *
+ * @return               actual data length written (ranges between 0 and len)
+ */
+int ring_buffer_try_write(struct ring_buffer *ring, const char *in, int len);
+/**
+ * Returns number of bytes dropped by ring_buffer_try_write() since the last
+ * call and resets the counter. May be called from any thread.
+ */
+long long ring_buffer_fetch_dropped(struct ring_buffer *ring);
 int ring_get_size(struct ring_buffer * ring);
 /**
  * Flushes all data from ring buffer. Not thread safe - needs external
@@ -137,6 +156,18 @@ int ring_get_write_regions(struct ring_buffer *ring, int requested_len,
  */
 bool ring_advance_write_idx(struct ring_buffer *ring, int amount);
 
+/**
+ * Same as ring_get_write_regions() but the returned regions are capped to the
+ * free space, so that writing to them never overwrites unread data. Use
+ * ring_advance_write_idx() with the returned size after writing.
+ *
+ * @param max_len          maximal amount you want to write
+ * @return                 size1 + size2 (ranges between 0 and max_len)
+ */
+int ring_get_free_write_regions(struct ring_buffer *ring, int max_len,
+                void **ptr1, int *size1,
+                void **ptr2, int *size2);
+
 void ring_fill(struct ring_buffer *ring, int c, int size);
 
 extern struct audio_buffer_api ring_buffer_fns;
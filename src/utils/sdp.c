@@ -204,7 +204,7 @@ int sdp_add_audio(struct sdp *sdp, int port, int sample_rate, int channels, audi
  */
 int sdp_add_video(struct sdp *sdp, int port, codec_t codec)
 {
-    if (codec != H264 && codec != JPEG && codec != MJPG) {
+    if (codec != H264 && codec != H265 && codec != JPEG && codec != MJPG) {
         return -2;
     }
 
@@ -212,9 +212,10 @@ int sdp_add_video(struct sdp *sdp, int port, codec_t codec)
     if (index < 0) {
         return -1;
     }
-    snprintf(sdp->stream[index].media_info, STR_LENGTH, "m=video %d RTP/AVP %d\n", port, codec == H264 ? PT_DynRTP_Type96 : PT_JPEG);
-    if (codec == H264) {
-        snprintf(sdp->stream[index].rtpmap, STR_LENGTH, "a=rtpmap:%d H264/90000\n", PT_DynRTP_Type96);
+    const bool dynamic_pt = codec == H264 || codec == H265;
+    snprintf(sdp->stream[index].media_info, STR_LENGTH, "m=video %d RTP/AVP %d\n", port, dynamic_pt ? PT_DynRTP_Type96 : PT_JPEG);
+    if (dynamic_pt) {
+        snprintf(sdp->stream[index].rtpmap, STR_LENGTH, "a=rtpmap:%d %s/90000\n", PT_DynRTP_Type96, codec == H264 ? "H264" : "H265");
     }
     return 0;
 }
@@ -42,6 +42,76 @@
 #define NO_EXTERN_MSGQ_MSG
 #include "utils/synchronized_queue.h"
 
-template class synchronized_queue<msg *, -1>;
-template class synchronized_queue<msg *, 1>;
+#include "host.h"
+#include "module.h"
+#include "utils/metrics.h"
 
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::string;
+using std::unique_ptr;
+
+ADD_TO_PARAM("queue-stats", "* queue-stats\n"
+                "  Collect depth high-water mark, blocking times and throughput of inter-thread\n"
+                "  queues (exported with the control socket \"metrics\" command)\n");
+
+unique_ptr<queue_instrumentation> queue_instrumentation::create(struct module *owner, const char *name,
+                const char *extra_labels)
+{
+        if (get_commandline_param("queue-stats") == nullptr) {
+                return {};
+        }
+        return unique_ptr<queue_instrumentation>(new queue_instrumentation(owner, name, extra_labels));
+}
+
+queue_instrumentation::queue_instrumentation(struct module *owner, const char *name, const char *extra_labels) :
+        m_owner(owner), m_name(name), m_extra_labels(extra_labels != nullptr ? extra_labels : "")
+{
+}
+
+void queue_instrumentation::resolve()
+{
+        if (m_items != nullptr) {
+                return;
+        }
+        string labels;
+        char path[1024];
+        if (m_owner != nullptr && module_get_path_str(m_owner, path, sizeof path)) {
+                labels = string("module=") + path + ",";
+        }
+        labels += "queue=" + m_name;
+        if (!m_extra_labels.empty()) {
+                labels += "," + m_extra_labels;
+        }
+        m_depth_max = metric_gauge("ug_queue_depth_max", "Queue depth high-water mark", labels.c_str());
+        m_push_blocked = metric_counter("ug_queue_push_blocked_us", "Time producers spent blocked on a full queue", labels.c_str());
+        m_pop_waited = metric_counter("ug_queue_pop_wait_us", "Time consumers spent waiting on an empty queue", labels.c_str());
+        m_items = metric_counter("ug_queue_items", "Items passed through the queue", labels.c_str());
+}
+
+void queue_instrumentation::pushed(size_t depth)
+{
+        resolve();
+        if (depth > m_depth_hw) {
+                m_depth_hw = depth;
+                metric_set(m_depth_max, depth);
+        }
+}
+
+void queue_instrumentation::popped(int count)
+{
+        resolve();
+        metric_add(m_items, count);
+}
+
+void queue_instrumentation::push_blocked(std::chrono::steady_clock::duration d)
+{
+        resolve();
+        metric_add(m_push_blocked, duration_cast<microseconds>(d).count());
+}
+
+void queue_instrumentation::pop_waited(std::chrono::steady_clock::duration d)
+{
+        resolve();
+        metric_add(m_pop_waited, duration_cast<microseconds>(d).count());
+}
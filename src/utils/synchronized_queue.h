@@ -38,17 +38,58 @@
 #ifndef SYNCHRONIZED_QUEUE_H_
 #define SYNCHRONIZED_QUEUE_H_
 
+#include <chrono>
 #include <condition_variable>
+#include <memory>
 #include <mutex>
 #include <queue>
+#include <string>
 #include <utility>
 
+struct metric;
+struct module;
+
 struct msg {
         virtual ~msg() {}
 };
 
 struct msg_quit : public msg {};
 
+/**
+ * @brief optional per-queue statistics exported as metrics (utils/metrics.h)
+ *
+ * Collected only if "--param queue-stats" is given, otherwise create()
+ * returns nullptr and the queue keeps its original cost.
+ *
+ * Series are labelled with the owning module path and the queue name, eg.
+ * `ug_queue_depth_max{module="root.receiver.decoder",queue="fec"}`. The path
+ * is resolved on the first event so that the owner needn't be registered in
+ * the module tree yet when the queue is instrumented. Methods are expected to
+ * be called with the queue lock held.
+ */
+class queue_instrumentation {
+public:
+        /// @param owner module owning the queue, may be nullptr
+        /// @param extra_labels additional labels (key=value[,...]) or nullptr
+        static std::unique_ptr<queue_instrumentation> create(struct module *owner, const char *name,
+                        const char *extra_labels = nullptr);
+        queue_instrumentation(struct module *owner, const char *name, const char *extra_labels);
+        void pushed(size_t depth);   ///< call with the depth after enqueue
+        void popped(int count = 1);
+        void push_blocked(std::chrono::steady_clock::duration d);
+        void pop_waited(std::chrono::steady_clock::duration d);
+private:
+        void resolve();
+        struct module *m_owner;
+        std::string m_name;
+        std::string m_extra_labels;
+        struct metric *m_depth_max = nullptr;
+        struct metric *m_push_blocked = nullptr;
+        struct metric *m_pop_waited = nullptr;
+        struct metric *m_items = nullptr;
+        size_t m_depth_hw = 0;
+};
+
 /**
  * @brief simple blocking synchronized queue
  *
@@ -70,10 +111,11 @@ public:
         void push(T const & message)
         {
                 std::unique_lock<std::mutex> l(m_lock);
-                if (max_len != -1) {
-                        m_queue_decremented.wait(l, [this]{return m_queue.size() < (unsigned int) max_len;});
-                }
+                wait_for_space(l);
                 m_queue.push(message);
+                if (m_instr) {
+                        m_instr->pushed(m_queue.size());
+                }
                 l.unlock();
                 m_queue_incremented.notify_one();
         }
@@ -81,10 +123,11 @@ public:
         void push(T && message)
         {
                 std::unique_lock<std::mutex> l(m_lock);
-                if (max_len != -1) {
-                        m_queue_decremented.wait(l, [this]{return m_queue.size() < (unsigned int) max_len;});
-                }
+                wait_for_space(l);
                 m_queue.push(std::move(message));
+                if (m_instr) {
+                        m_instr->pushed(m_queue.size());
+                }
                 l.unlock();
                 m_queue_incremented.notify_one();
         }
@@ -96,21 +139,54 @@ public:
                         return T();
                 }
 
-                m_queue_incremented.wait(l, [this]{return m_queue.size() > 0;});
+                if (m_instr && m_queue.size() == 0) {
+                        auto t0 = std::chrono::steady_clock::now();
+                        m_queue_incremented.wait(l, [this]{return m_queue.size() > 0;});
+                        m_instr->pop_waited(std::chrono::steady_clock::now() - t0);
+                } else {
+                        m_queue_incremented.wait(l, [this]{return m_queue.size() > 0;});
+                }
                 T ret = std::move(m_queue.front());
                 m_queue.pop();
+                if (m_instr) {
+                        m_instr->popped();
+                }
 
                 l.unlock();
                 m_queue_decremented.notify_one();
                 return ret;
         }
 
+        /**
+         * Enables statistics for this queue (if requested by the user).
+         * Must be called before the queue is shared with other threads.
+         */
+        void instrument(struct module *owner, const char *name)
+        {
+                m_instr = queue_instrumentation::create(owner, name);
+        }
 
 private:
+        void wait_for_space(std::unique_lock<std::mutex> &l)
+        {
+                if (max_len == -1) {
+                        return;
+                }
+                auto has_space = [this]{return m_queue.size() < (unsigned int) max_len;};
+                if (m_instr && !has_space()) {
+                        auto t0 = std::chrono::steady_clock::now();
+                        m_queue_decremented.wait(l, has_space);
+                        m_instr->push_blocked(std::chrono::steady_clock::now() - t0);
+                } else {
+                        m_queue_decremented.wait(l, has_space);
+                }
+        }
+
         std::queue<T>           m_queue;
         std::mutex              m_lock;
         std::condition_variable m_queue_decremented;
         std::condition_variable m_queue_incremented;
+        std::unique_ptr<queue_instrumentation> m_instr;
 };
 
 #ifndef NO_EXTERN_MSGQ_MSG
@@ -42,6 +42,10 @@
 #endif
 
 #include <libgen.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
 #ifdef HAVE_SETTHREADDESCRIPTION
 #include <processthreadsapi.h>
 // TODO: not yet present in MinGW headers - remove when available
@@ -51,6 +55,105 @@ HRESULT SetThreadDescription( HANDLE hThread, PCWSTR lpThreadDescription);
 #include "debug.h"
 #include "host.h"
 #include "utils/thread.h"
+#include "utils/trace_events.h"
+
+#define MOD_NAME "[thread] "
+
+ADD_TO_PARAM("thread-affinity", "* thread-affinity=<stage>=<cpus>[/<prio>][:<stage>=<cpus>[/<prio>]...]|help\n"
+                "  Pins threads of pipeline stage <stage> (a thread name as passed to set_thread_name,\n"
+                "  eg. udp_reader, fec_thread, decompress_thread, display; trailing '*' matches a prefix)\n"
+                "  to <cpus> (eg. 3, 2-5 or 0-1+8), optionally with SCHED_FIFO priority <prio>.\n"
+                "  Memory of the stage (first-touched by its threads) then lands on the local NUMA node.\n"
+                "  \"help\" prints names of the threads as they start.\n");
+
+static bool stage_matches(const char *stage, size_t stage_len, const char *name)
+{
+        if (stage_len > 0 && stage[stage_len - 1] == '*') {
+                return strncmp(stage, name, stage_len - 1) == 0;
+        }
+        return strlen(name) == stage_len && strncmp(stage, name, stage_len) == 0;
+}
+
+#ifdef HAVE_LINUX
+/// @param cpus list of CPUs or ranges separated by '+', terminated by '/', ':' or '\0'
+static bool parse_cpus(const char *cpus, cpu_set_t *set)
+{
+        CPU_ZERO(set);
+        while (*cpus != '\0' && *cpus != '/' && *cpus != ':') {
+                char *end = NULL;
+                long first = strtol(cpus, &end, 10);
+                long last = first;
+                if (end == cpus || first < 0) {
+                        return false;
+                }
+                if (*end == '-') {
+                        cpus = end + 1;
+                        last = strtol(cpus, &end, 10);
+                        if (end == cpus || last < first) {
+                                return false;
+                        }
+                }
+                for (long i = first; i <= last && i < CPU_SETSIZE; ++i) {
+                        CPU_SET(i, set);
+                }
+                cpus = *end == '+' ? end + 1 : end;
+        }
+        return CPU_COUNT(set) > 0;
+}
+#endif
+
+/**
+ * Applies the thread-affinity param entry matching the thread name (if any)
+ * to the calling thread.
+ */
+static void apply_thread_placement(const char *name)
+{
+        const char *cfg = get_commandline_param("thread-affinity");
+        if (cfg == NULL) {
+                return;
+        }
+        if (strcmp(cfg, "help") == 0) {
+                log_msg(LOG_LEVEL_INFO, MOD_NAME "Started thread \"%s\"\n", name);
+                return;
+        }
+        for (const char *item = cfg; item != NULL && *item != '\0'; item = strchr(item, ':') ? strchr(item, ':') + 1 : NULL) {
+                const char *eq = strchr(item, '=');
+                const char *item_end = strchr(item, ':');
+                if (eq == NULL || (item_end != NULL && eq > item_end)) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong thread-affinity item: %s\n", item);
+                        continue;
+                }
+                if (!stage_matches(item, eq - item, name)) {
+                        continue;
+                }
+#ifdef HAVE_LINUX
+                cpu_set_t set;
+                if (!parse_cpus(eq + 1, &set)) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong CPU list for %s: %s\n", name, eq + 1);
+                        return;
+                }
+                int rc = pthread_setaffinity_np(pthread_self(), sizeof set, &set);
+                if (rc != 0) {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Cannot set affinity of %s: %s\n", name, strerror(rc));
+                } else {
+                        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Thread %s pinned to %d CPU(s)\n", name, CPU_COUNT(&set));
+                }
+                const char *prio = strchr(eq, '/');
+                int fifo_prio = prio != NULL && (item_end == NULL || prio < item_end) ? atoi(prio + 1) : -1;
+                if (fifo_prio >= 0) {
+                        struct sched_param sp = { .sched_priority = fifo_prio };
+                        rc = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp);
+                        if (rc != 0) {
+                                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Cannot set SCHED_FIFO priority %d for %s: %s\n",
+                                                fifo_prio, name, strerror(rc));
+                        }
+                }
+#else
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Thread placement not supported on this platform!\n");
+#endif
+                return;
+        }
+}
 
 #if ! defined  WIN32 || defined HAVE_SETTHREADDESCRIPTION
 static inline char *get_argv_program_name(void) {
@@ -66,7 +169,13 @@ static inline char *get_argv_program_name(void) {
 }
 #endif
 
+/**
+ * Names the calling thread. The name also identifies the pipeline stage
+ * for the thread-affinity param, which is applied here.
+ */
 void set_thread_name(const char *name) {
+        trace_events_set_thread_name(name);
+        apply_thread_placement(name);
 #ifdef HAVE_LINUX
 // thread name can have at most 16 chars (including terminating null char)
         char *prog_name = get_argv_program_name();
@@ -0,0 +1,359 @@
+/**
+ * @file   utils/trace_events.cpp
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "debug.h"
+#include "host.h"
+#include "utils/misc.h"
+#include "utils/thread.h"
+#include "utils/trace_events.h"
+
+#define MOD_NAME "[trace] "
+#define DEFAULT_FILENAME "ug-trace.json"
+#define RING_SIZE 8192        ///< events per thread, must be power of 2
+#define FLUSH_INTERVAL_MS 100
+#define MAX_PUSH_DEPTH 32     ///< max nesting of trace_events_push()
+#define MAX_THREAD_NAME 32
+
+using std::atomic;
+using std::condition_variable;
+using std::lock_guard;
+using std::memory_order_acquire;
+using std::memory_order_relaxed;
+using std::memory_order_release;
+using std::mutex;
+using std::shared_ptr;
+using std::thread;
+using std::unique_lock;
+using std::vector;
+
+ADD_TO_PARAM("trace-events", "* trace-events[=<file>]\n"
+                "  Record trace of annotated code paths to Chrome trace JSON (default " DEFAULT_FILENAME ").\n"
+                "  Can be also toggled at runtime with control socket command \"trace {start [<file>]|stop}\".\n");
+
+namespace {
+struct trace_event {
+        const char *name;
+        long long start; ///< ns from trace start
+        long long dur;   ///< ns
+};
+
+/// single-producer (owning thread) single-consumer (flusher) ring
+struct thread_ring {
+        trace_event events[RING_SIZE];
+        atomic<unsigned long> head{0};
+        atomic<unsigned long> tail{0};
+        atomic<unsigned long> dropped{0};
+        atomic<bool> orphaned{false}; ///< owning thread exited
+        int tid = 0;
+        char name[MAX_THREAD_NAME] = ""; ///< protected by trace_state::lock
+        bool name_written = false;       ///< protected by trace_state::lock
+};
+
+struct trace_state {
+        atomic<bool> active{false};
+        long long start_ns = 0; ///< written before active is set
+
+        mutex lock; ///< protects everything below
+        vector<shared_ptr<thread_ring>> rings;
+        int next_tid = 1;
+        FILE *out = nullptr;
+        bool first_event = true;
+        bool should_stop = false;
+        condition_variable cv;
+        thread flusher;
+        mutex control_lock; ///< serializes start/stop
+};
+
+/// intentionally leaked so that it outlives thread-local destructors
+trace_state &get_state() {
+        static trace_state *s = new trace_state();
+        return *s;
+}
+
+struct thread_trace_ctx {
+        ~thread_trace_ctx() {
+                if (ring) {
+                        ring->orphaned.store(true, memory_order_release);
+                }
+        }
+        shared_ptr<thread_ring> ring;
+        char name[MAX_THREAD_NAME] = "";
+        struct {
+                const char *name;
+                long long start;
+        } stack[MAX_PUSH_DEPTH];
+        int depth = 0;
+};
+thread_local thread_trace_ctx ctx;
+
+long long now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+thread_ring *get_ring() {
+        if (!ctx.ring) {
+                auto ring = std::make_shared<thread_ring>();
+                auto &s = get_state();
+                lock_guard<mutex> lk(s.lock);
+                ring->tid = s.next_tid++;
+                snprintf(ring->name, sizeof ring->name, "%s", ctx.name);
+                s.rings.push_back(ring);
+                ctx.ring = std::move(ring);
+        }
+        return ctx.ring.get();
+}
+
+void record(const char *name, long long start, long long end) {
+        thread_ring *r = get_ring();
+        unsigned long h = r->head.load(memory_order_relaxed);
+        if (h - r->tail.load(memory_order_acquire) >= RING_SIZE) {
+                r->dropped.fetch_add(1, memory_order_relaxed);
+                return;
+        }
+        r->events[h % RING_SIZE] = { name, start - get_state().start_ns, end - start };
+        r->head.store(h + 1, memory_order_release);
+}
+
+void write_escaped(FILE *out, const char *str) {
+        for (; *str != '\0'; ++str) {
+                if (*str == '"' || *str == '\\') {
+                        fputc('\\', out);
+                } else if ((unsigned char) *str < ' ') {
+                        continue;
+                }
+                fputc(*str, out);
+        }
+}
+
+/// @note to be called with trace_state::lock held
+void write_separator(trace_state &s) {
+        fputs(s.first_event ? "\n" : ",\n", s.out);
+        s.first_event = false;
+}
+
+/// @note to be called with trace_state::lock held
+void drain_rings(trace_state &s) {
+        for (auto it = s.rings.begin(); it != s.rings.end(); ) {
+                thread_ring &r = **it;
+                if (!r.name_written && r.name[0] != '\0') {
+                        write_separator(s);
+                        fprintf(s.out, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"", r.tid);
+                        write_escaped(s.out, r.name);
+                        fputs("\"}}", s.out);
+                        r.name_written = true;
+                }
+                // orphaned must be read before head so that no event is missed
+                bool orphaned = r.orphaned.load(memory_order_acquire);
+                unsigned long h = r.head.load(memory_order_acquire);
+                unsigned long t = r.tail.load(memory_order_relaxed);
+                for ( ; t != h; ++t) {
+                        const trace_event &e = r.events[t % RING_SIZE];
+                        write_separator(s);
+                        fputs("{\"name\":\"", s.out);
+                        write_escaped(s.out, e.name);
+                        fprintf(s.out, "\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                                        r.tid, e.start / 1000.0, e.dur / 1000.0);
+                }
+                r.tail.store(t, memory_order_release);
+                if (orphaned) {
+                        unsigned long dropped = r.dropped.load(memory_order_relaxed);
+                        if (dropped > 0) {
+                                log_msg(LOG_LEVEL_WARNING, MOD_NAME "%lu events of thread %d dropped (ring full)\n", dropped, r.tid);
+                        }
+                        it = s.rings.erase(it);
+                } else {
+                        ++it;
+                }
+        }
+}
+
+void flusher(trace_state *s) {
+        set_thread_name(__func__);
+        unique_lock<mutex> lk(s->lock);
+        while (!s->should_stop) {
+                s->cv.wait_for(lk, std::chrono::milliseconds(FLUSH_INTERVAL_MS));
+                drain_rings(*s);
+        }
+        fflush(s->out);
+}
+} // end of anonymous namespace
+
+/**
+ * Starts recording a trace to filename (DEFAULT_FILENAME if NULL or empty).
+ * @retval false if already active or file could not be opened
+ */
+bool trace_events_start(const char *filename)
+{
+        auto &s = get_state();
+        lock_guard<mutex> control_lk(s.control_lock);
+        if (s.active.load(memory_order_relaxed)) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Tracing already active!\n");
+                return false;
+        }
+        if (filename == nullptr || filename[0] == '\0') {
+                filename = DEFAULT_FILENAME;
+        }
+        FILE *out = fopen(filename, "w");
+        if (out == nullptr) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot open %s: %s\n", filename, ug_strerror(errno));
+                return false;
+        }
+        {
+                lock_guard<mutex> lk(s.lock);
+                s.out = out;
+                s.first_event = true;
+                s.should_stop = false;
+                fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", out);
+                write_separator(s);
+                fputs("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"", out);
+                write_escaped(out, uv_argv != nullptr && uv_argv[0] != nullptr ? uv_argv[0] : "uv");
+                fputs("\"}}", out);
+                for (auto &r : s.rings) { // discard leftovers of a previous session
+                        r->tail.store(r->head.load(memory_order_acquire), memory_order_release);
+                        r->dropped.store(0, memory_order_relaxed);
+                        r->name_written = false;
+                }
+                s.start_ns = now_ns();
+        }
+        s.flusher = thread(flusher, &s);
+        s.active.store(true, memory_order_release);
+        log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Recording trace to %s\n", filename);
+        return true;
+}
+
+void trace_events_stop(void)
+{
+        auto &s = get_state();
+        lock_guard<mutex> control_lk(s.control_lock);
+        if (!s.active.exchange(false)) {
+                return;
+        }
+        {
+                lock_guard<mutex> lk(s.lock);
+                s.should_stop = true;
+        }
+        s.cv.notify_one();
+        s.flusher.join();
+
+        lock_guard<mutex> lk(s.lock);
+        unsigned long dropped = 0;
+        for (auto &r : s.rings) {
+                dropped += r->dropped.exchange(0, memory_order_relaxed);
+        }
+        fputs("\n]}\n", s.out);
+        fclose(s.out);
+        s.out = nullptr;
+        log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Trace recording stopped%s\n", dropped > 0 ? " (some events were dropped)" : "");
+}
+
+bool trace_events_active(void)
+{
+        return get_state().active.load(memory_order_acquire);
+}
+
+/**
+ * Starts a nested event in the calling thread, to be ended by
+ * trace_events_pop(). Intended for C code, C++ should use Trace_scope.
+ */
+void trace_events_push(const char *name)
+{
+        if (ctx.depth < MAX_PUSH_DEPTH) {
+                bool active = trace_events_active();
+                ctx.stack[ctx.depth] = { active ? name : nullptr, active ? now_ns() : 0 };
+        }
+        ctx.depth += 1;
+}
+
+void trace_events_pop(void)
+{
+        if (ctx.depth == 0) {
+                return;
+        }
+        ctx.depth -= 1;
+        if (ctx.depth < MAX_PUSH_DEPTH && ctx.stack[ctx.depth].name != nullptr
+                        && trace_events_active()) {
+                record(ctx.stack[ctx.depth].name, ctx.stack[ctx.depth].start, now_ns());
+        }
+}
+
+/// called from set_thread_name() - names the thread in the trace
+void trace_events_set_thread_name(const char *name)
+{
+        snprintf(ctx.name, sizeof ctx.name, "%s", name);
+        if (ctx.ring) {
+                auto &s = get_state();
+                lock_guard<mutex> lk(s.lock);
+                snprintf(ctx.ring->name, sizeof ctx.ring->name, "%s", name);
+                ctx.ring->name_written = false;
+        }
+}
+
+void Trace_scope::begin(const char *n)
+{
+        if (n == nullptr || n[0] == '\0' || !trace_events_active()) {
+                name = nullptr;
+                return;
+        }
+        name = n;
+        start = now_ns();
+}
+
+void Trace_scope::end()
+{
+        if (name != nullptr && trace_events_active()) {
+                record(name, start, now_ns());
+        }
+        name = nullptr;
+}
+
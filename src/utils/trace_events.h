@@ -0,0 +1,102 @@
+/**
+ * @file   utils/trace_events.h
+ * @brief  Runtime-toggleable tracing backend producing Chrome trace JSON
+ *
+ * Events are recorded to per-thread lock-free rings and written to the file
+ * by a background thread, so the overhead in the annotated code is a couple
+ * of clock reads when tracing is active and a single atomic load otherwise.
+ * The output can be loaded to chrome://tracing or https://ui.perfetto.dev.
+ *
+ * Unless compiled with BUILD_PROFILED, the annotations from
+ * utils/profile_timer.hpp (PROFILE_FUNC, PROFILE_DETAIL, C_PROFILER_PUSH and
+ * C_PROFILER_POP) record to this backend.
+ *
+ * @note Event names are not copied - they must be string literals or
+ * otherwise outlive the tracing session.
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_TRACE_EVENTS_H_
+#define UTILS_TRACE_EVENTS_H_
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+bool trace_events_start(const char *filename);
+void trace_events_stop(void);
+bool trace_events_active(void);
+void trace_events_push(const char *name);
+void trace_events_pop(void);
+void trace_events_set_thread_name(const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef __cplusplus
+/**
+ * Records a complete event spanning the lifetime of the object. The event
+ * is recorded only if the tracing was active when the scope was entered.
+ */
+class Trace_scope {
+public:
+        explicit Trace_scope(const char *name) {
+                begin(name);
+        }
+        ~Trace_scope() {
+                end();
+        }
+        Trace_scope(const Trace_scope &) = delete;
+        Trace_scope &operator=(const Trace_scope &) = delete;
+        /// ends the current event and starts a new one (if name is not empty)
+        void next(const char *name) {
+                end();
+                begin(name);
+        }
+private:
+        void begin(const char *name);
+        void end();
+
+        const char *name = nullptr;
+        long long start = 0;
+};
+#endif // defined __cplusplus
+
+#endif // defined UTILS_TRACE_EVENTS_H_
+
@@ -50,6 +50,7 @@
 
 #include "debug.h"
 #include "lib_common.h"
+#include "tv.h"
 
 #ifdef _WIN32
 #include <windows.h>
@@ -65,6 +66,8 @@
 #define MAX_MSG_LEN 2048
 #define MSG_HEADER_LEN 5
 #define MOD_NAME "[HOLEPUNCH] "
+#define CHECK_POLL_MS 20      ///< how often to check agent state while waiting for candidates
+#define CHECK_TIMEOUT_SEC 30  ///< connectivity checks give up after this
 
 /* Coordination protocol description
  *
@@ -170,13 +173,14 @@ static juice_agent_t *create_agent(const struct Holepunch_config *c, void *usr_p
 }
 
 
-static void recv_msg(int sock, char *buf, size_t buf_len){
+/// @returns false if the connection was closed or the message is malformed
+static bool recv_msg(int sock, char *buf, size_t buf_len){
         char header[MSG_HEADER_LEN + 1];
         buf[0] = '\0';
 
         int bytes = recv(sock, header, MSG_HEADER_LEN, MSG_WAITALL);
         if(bytes != MSG_HEADER_LEN){
-                return;
+                return false;
         }
         header[MSG_HEADER_LEN] = '\0';
 
@@ -184,14 +188,19 @@ static void recv_msg(int sock, char *buf, size_t buf_len){
         char *end;
         expected_len = strtol(header, &end, 10);
         if(header == end){
-                return;
+                return false;
         }
 
         if(expected_len > buf_len - 1)
                 expected_len = buf_len - 1;
 
         bytes = recv(sock, buf, expected_len, MSG_WAITALL);
+        if(bytes < 0 || (unsigned) bytes != expected_len){
+                buf[0] = '\0';
+                return false;
+        }
         buf[bytes] = '\0';
+        return true;
 }
 
 static bool connect_to_coordinator(const char *coord_srv_addr,
@@ -224,7 +233,7 @@ static bool connect_to_coordinator(const char *coord_srv_addr,
         return true;
 }
 
-static void exchange_coord_desc(juice_agent_t *agent, fd_t coord_sock){
+static bool exchange_coord_desc(juice_agent_t *agent, fd_t coord_sock){
         char sdp[JUICE_MAX_SDP_STRING_LEN];
         juice_get_local_description(agent, sdp, JUICE_MAX_SDP_STRING_LEN);
         log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Local description:\n%s\n", sdp);
@@ -232,40 +241,68 @@ static void exchange_coord_desc(juice_agent_t *agent, fd_t coord_sock){
         send_msg(coord_sock, sdp);
 
         char msg_buf[MAX_MSG_LEN];
-        recv_msg(coord_sock, msg_buf, sizeof(msg_buf));
+        if(!recv_msg(coord_sock, msg_buf, sizeof(msg_buf))){
+                error_msg(MOD_NAME "Coordination server closed connection\n");
+                return false;
+        }
         log_msg(LOG_LEVEL_INFO, MOD_NAME "Remote client name: %s\n", msg_buf);
-        recv_msg(coord_sock, msg_buf, sizeof(msg_buf));
+        if(!recv_msg(coord_sock, msg_buf, sizeof(msg_buf))){
+                error_msg(MOD_NAME "Coordination server closed connection\n");
+                return false;
+        }
         log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Remote desc: %s\n", msg_buf);
 
         juice_set_remote_description(agent, msg_buf);
+        return true;
 }
 
+/**
+ * Forwards remote candidates to the agent as they arrive (the agent checks
+ * the pairs concurrently) until the agent completes, fails or times out.
+ */
 static void discover_and_xchg_candidates(juice_agent_t *agent, fd_t coord_sock) {
         juice_gather_candidates(agent);
 
-        fd_set rfds;
-        FD_ZERO(&rfds);
-
-        struct timeval tv;
-        tv.tv_sec = 0;
-        tv.tv_usec = 300000;
+        const time_ns_t deadline = get_time_in_ns() + CHECK_TIMEOUT_SEC * NS_IN_SEC;
+        bool coord_open = true;
 
         while(1){
+                juice_state_t state = juice_get_state(agent);
+                if(state == JUICE_STATE_COMPLETED || state == JUICE_STATE_FAILED)
+                        break;
+                if(get_time_in_ns() > deadline){
+                        error_msg(MOD_NAME "Connectivity checks timed out\n");
+                        break;
+                }
+
+                // select() may modify the timeout, so it is set every time
+                struct timeval tv = { 0, CHECK_POLL_MS * 1000 };
+                if(!coord_open){
+                        select(0, NULL, NULL, NULL, &tv);
+                        continue;
+                }
+                fd_set rfds;
+                FD_ZERO(&rfds);
                 FD_SET(coord_sock, &rfds);
-                select(coord_sock + 1, &rfds, NULL, NULL, &tv);
-                if(FD_ISSET(coord_sock, &rfds)){
+                if(select(coord_sock + 1, &rfds, NULL, NULL, &tv) > 0 && FD_ISSET(coord_sock, &rfds)){
                         char msg_buf[MAX_MSG_LEN];
-                        recv_msg(coord_sock, msg_buf, sizeof(msg_buf));
+                        if(!recv_msg(coord_sock, msg_buf, sizeof(msg_buf))){
+                                // candidates already received may still succeed
+                                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Coordination server closed connection\n");
+                                coord_open = false;
+                                continue;
+                        }
                         log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Received remote candidate\n");
                         juice_add_remote_candidate(agent, msg_buf);
                 }
-                juice_state_t state = juice_get_state(agent);
-                if(state == JUICE_STATE_COMPLETED)
-                        break;
         }
 }
 
-static bool initialize_punch(struct Punch_ctx *ctx,
+/**
+ * Connects to the coordination server and joins the room. Can be done
+ * before the agent is created since the server waits for the description.
+ */
+static bool join_room(struct Punch_ctx *ctx,
                 const struct Holepunch_config *c,
                 const char *room_suffix)
 {
@@ -285,11 +322,17 @@ static bool initialize_punch(struct Punch_ctx *ctx,
         send_msg(ctx->coord_sock, c->client_name);
         send_msg(ctx->coord_sock, room_name);
 
-        ctx->juice_agent = create_agent(c, ctx);
+        return true;
+}
 
-        exchange_coord_desc(ctx->juice_agent, ctx->coord_sock);
+static bool start_agent(struct Punch_ctx *ctx, const struct Holepunch_config *c){
+        ctx->juice_agent = create_agent(c, ctx);
+        if(!ctx->juice_agent){
+                error_msg(MOD_NAME "Failed to create ICE agent\n");
+                return false;
+        }
 
-        return true;
+        return exchange_coord_desc(ctx->juice_agent, ctx->coord_sock);
 }
 
 static bool split_host_port(char *pair, int *port){
@@ -340,14 +383,19 @@ static bool run_punch(struct Punch_ctx *ctx, char *local, char *remote){
 }
 
 static void cleanup_punch(struct Punch_ctx *ctx){
-        juice_destroy(ctx->juice_agent);
-        CLOSESOCKET(ctx->coord_sock);
-
+        if(ctx->juice_agent){
+                juice_destroy(ctx->juice_agent);
+                ctx->juice_agent = NULL;
+        }
+        if(ctx->coord_sock != INVALID_SOCKET){
+                CLOSESOCKET(ctx->coord_sock);
+                ctx->coord_sock = INVALID_SOCKET;
+        }
 }
 
 bool punch_udp(struct Holepunch_config c){
-        struct Punch_ctx video_ctx = {0};
-        struct Punch_ctx audio_ctx = {0};
+        struct Punch_ctx video_ctx = { .coord_sock = INVALID_SOCKET };
+        struct Punch_ctx audio_ctx = { .coord_sock = INVALID_SOCKET };
 
         juice_set_log_level(JUICE_LOG_LEVEL_DEBUG);
         juice_set_log_handler(juice_log_handler);
@@ -361,34 +409,45 @@ bool punch_udp(struct Holepunch_config c){
                 c.client_name = name;
         }
 
-        if(!initialize_punch(&video_ctx, &c, "_video")){
-                return false;
+        /* Both rooms are joined up front so that the audio coordination
+         * round-trips overlap with the video connectivity checks. The audio
+         * agent itself is created only after the video is punched because it
+         * has to be bound to the same local address. */
+        if(!join_room(&video_ctx, &c, "_video") || !join_room(&audio_ctx, &c, "_audio")){
+                goto error;
         }
 
-        if(!run_punch(&video_ctx, local, remote))
-                return false;
+        if(!start_agent(&video_ctx, &c) || !run_punch(&video_ctx, local, remote))
+                goto error;
 
         *c.video_rx_port = video_ctx.local_candidate_port;
-        assert(split_host_port(remote, c.video_tx_port));
-        assert(split_host_port(local, NULL));
+        if(!split_host_port(remote, c.video_tx_port) || !split_host_port(local, NULL)){
+                error_msg(MOD_NAME "Malformed selected address\n");
+                goto error;
+        }
 
         strncpy(c.host_addr, remote, c.host_addr_len);
 
         c.bind_addr = local;
-        if(!initialize_punch(&audio_ctx, &c, "_audio")){
-                cleanup_punch(&video_ctx);
-                return false;
+        if(!start_agent(&audio_ctx, &c)){
+                goto error;
         }
 
         cleanup_punch(&video_ctx);
 
         if(!run_punch(&audio_ctx, local, remote))
-                return false;
+                goto error;
 
         *c.audio_rx_port = audio_ctx.local_candidate_port;
-        assert(split_host_port(remote, c.audio_tx_port));
+        if(!split_host_port(remote, c.audio_tx_port)){
+                error_msg(MOD_NAME "Malformed selected address\n");
+                goto error;
+        }
 
-        assert(strcmp(c.host_addr, remote) == 0);
+        if(strcmp(c.host_addr, remote) != 0){
+                error_msg(MOD_NAME "Video and audio punched to different hosts (%s, %s)\n", c.host_addr, remote);
+                goto error;
+        }
 
         log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Cleaning up\n");
         cleanup_punch(&audio_ctx);
@@ -397,6 +456,9 @@ bool punch_udp(struct Holepunch_config c){
 
 
         return true;
-}
 
-REGISTER_MODULE(udp_holepunch, punch_udp, LIBRARY_CLASS_UNDEFINED, HOLEPUNCH_ABI_VERSION);
+error:
+        cleanup_punch(&video_ctx);
+        cleanup_punch(&audio_ctx);
+        return false;
+}
@@ -42,70 +42,97 @@
 #include "config_win32.h"
 #endif // HAVE_CONFIG_H
 
+#include <algorithm>
 #include <stdio.h>
 #include <string.h>
+#include <vector>
+
+#include "utils/misc.h"
 #include "utils/vf_split.h"
+#include "utils/worker.h"
 #include "video.h"
 #include "video_codec.h"
 
+using namespace std;
+
+#define VF_SPLIT_MIN_LINES_PER_THREAD 64
+
+struct vf_split_task {
+        struct video_frame *out;
+        const struct video_frame *src;
+        unsigned int x_count;
+        unsigned int first_line; ///< first source line to be copied
+        unsigned int last_line;  ///< one past last source line
+};
+
+/**
+ * Copies source lines [first_line, last_line) to respective tiles.
+ */
+static void *vf_split_worker(void *arg)
+{
+        auto *t = (struct vf_split_task *) arg;
+        const struct tile *src_tile = &t->src->tiles[0];
+        const unsigned int tile_height = t->out->tiles[0].height;
+        const size_t src_linesize = vc_get_linesize(src_tile->width, t->src->color_spec);
+        const size_t out_linesize = vc_get_linesize(t->out->tiles[0].width, t->src->color_spec);
+
+        unsigned int line_idx = t->first_line;
+        while (line_idx < t->last_line) {
+                unsigned int tile_row = line_idx / tile_height;
+                unsigned int tile_line = line_idx % tile_height;
+                unsigned int lines = min(t->last_line - line_idx, tile_height - tile_line);
+                struct tile *cur_tiles = &t->out->tiles[tile_row * t->x_count];
+                const char *src = src_tile->data + line_idx * src_linesize;
+
+                if (t->x_count == 1) { // both source and tile lines are contiguous
+                        memcpy(cur_tiles[0].data + tile_line * out_linesize, src, lines * out_linesize);
+                } else {
+                        for (unsigned int i = 0; i < lines; ++i) {
+                                for (unsigned int x = 0; x < t->x_count; ++x) {
+                                        memcpy(cur_tiles[x].data + (tile_line + i) * out_linesize,
+                                                        src + x * out_linesize, out_linesize);
+                                }
+                                src += src_linesize;
+                        }
+                }
+                line_idx += lines;
+        }
+        return NULL;
+}
+
 void vf_split(struct video_frame *out, struct video_frame *src,
               unsigned int x_count, unsigned int y_count, int preallocate)
 {
-        unsigned int        tile_idx, line_idx;
-        struct tile        *cur_tiles;
-        unsigned int        tile_line = 0;
-        int                 out_linesize = 0;
-        int                 src_linesize;
-
         out->color_spec = src->color_spec;
         out->fps = src->fps;
         //out->aux = src->aux | AUX_TILED;
 
         assert(vf_get_tile(src, 0)->width % x_count == 0u && vf_get_tile(src, 0)->height % y_count == 0u);
 
-        src_linesize = vc_get_linesize(src->tiles[0].width,
-                        src->color_spec);
-
         assert(x_count * y_count > 0);
-        for(tile_idx = 0u; tile_idx < x_count * y_count; ++tile_idx) {
+        for (unsigned int tile_idx = 0u; tile_idx < x_count * y_count; ++tile_idx) {
                 out->tiles[tile_idx].width = vf_get_tile(src, 0)->width / x_count;
                 out->tiles[tile_idx].height = vf_get_tile(src, 0)->height / y_count;
 
-                out_linesize = vc_get_linesize(out->tiles[tile_idx].width,
+                int out_linesize = vc_get_linesize(out->tiles[tile_idx].width,
                                 src->color_spec);
                 out->tiles[tile_idx].data_len = out_linesize * out->tiles[tile_idx].height;
-        }
-
-        cur_tiles = &out->tiles[0];
-        for(line_idx = 0u; line_idx < vf_get_tile(src, 0)->height; ++line_idx, ++tile_line) {
-                unsigned int cur_tile_idx;
-                unsigned int byte = 0u;
-
-                if (line_idx % (vf_get_tile(src, 0)->height / y_count) == 0u) /* next tiles*/
-                {
-                        tile_line = 0u;
-                        if (line_idx != 0u)
-                                cur_tiles += x_count;
-                        if (preallocate) {
-                                for (cur_tile_idx = 0u; cur_tile_idx < x_count;
-                                               ++cur_tile_idx) {
-                                        cur_tiles[cur_tile_idx].data = (char *)
-                                                malloc(cur_tiles[cur_tile_idx].
-                                                                data_len);
-                                }
-                        }
+                if (preallocate) {
+                        out->tiles[tile_idx].data = (char *) malloc(out->tiles[tile_idx].data_len);
                 }
+        }
 
-                for(cur_tile_idx = 0u; cur_tile_idx < x_count; ++cur_tile_idx) {
-                        memcpy((void *) &cur_tiles[cur_tile_idx].data[
-                                        tile_line *
-                                        out_linesize],
-                                        (void *) &src->tiles[0].data[line_idx *
-                                        src_linesize + byte],
-                                        cur_tiles[cur_tile_idx].width *
-                                        get_bpp(src->color_spec));
-                        byte += cur_tiles[cur_tile_idx].width * get_bpp(src->color_spec);
-                }
+        unsigned int height = vf_get_tile(src, 0)->height;
+        int threads = min<int>(get_cpu_core_count(), height / VF_SPLIT_MIN_LINES_PER_THREAD);
+        threads = max(threads, 1);
+        vector<struct vf_split_task> tasks(threads);
+        for (int i = 0; i < threads; ++i) {
+                tasks[i] = { out, src, x_count, height * i / threads, height * (i + 1) / threads };
+        }
+        if (threads == 1) {
+                vf_split_worker(&tasks[0]);
+        } else {
+                task_run_parallel(vf_split_worker, threads, tasks.data(), sizeof tasks[0], NULL);
         }
 }
 
@@ -130,8 +157,6 @@ void vf_split_horizontal(struct video_frame *out, struct video_frame *src,
         }
 }
 
-using namespace std;
-
 vector<shared_ptr<video_frame>> vf_separate_tiles(shared_ptr<video_frame> frame)
 {
         vector<shared_ptr<video_frame>> ret(frame->tile_count);
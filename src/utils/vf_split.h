@@ -59,12 +59,19 @@ extern "C" {
  * @param preallocate  used for preallocating buffers because determining right
  *                     size can be cumbersome. Anyway only .data are allocated.
  *
+ * Lines are copied by multiple threads for larger frames. If the tiles can
+ * reference the source frame memory, use vf_split_horizontal() (x_count == 1)
+ * instead, which doesn't copy at all.
+ *
  * @deprecated this function should not be used
  */
 void vf_split(struct video_frame *out, struct video_frame *src,
               unsigned int x_count, unsigned int y_count, int preallocate);
 
 /**
+ * Splits the frame to y_count tiles pointing to the data of src (no copy is
+ * performed), so src must outlive out.
+ *
  * @deprecated this function should not be used
  */
 void vf_split_horizontal(struct video_frame *out, struct video_frame *src,
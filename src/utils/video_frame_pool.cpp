@@ -42,12 +42,39 @@
 #include "config_unix.h"
 #include "config_win32.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
 #include <functional>
 #include <iostream>
 #include <stdexcept>
+#include <string>
+#include <thread>
+#include "utils/mem_budget.h"
 #include "video_frame_pool.h"
 
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif !defined _WIN32
+#include <sys/mman.h>
+#endif
+
+#define MOD_NAME "[video_frame_pool] "
+#define MEM_BUDGET_WAIT_MS 100 ///< max wait for a returned frame if the memory budget is reached
+
+using std::string;
+using std::unique_ptr;
+
+ADD_TO_PARAM("frame-pool-alloc", "* frame-pool-alloc=<class>=<alloc>[:<class>=<alloc>...]\n"
+                "  Allocator for video frame pools of <class> (capture, compress, display or * for all),\n"
+                "  <alloc> is default|pinned[-cuda]|huge[1g][@<numa_node>][+<n>] - page-locked memory\n"
+                "  (optionally also CUDA-registered) or 2 MB (or 1 GB) huge pages, optionally bound\n"
+                "  to a NUMA node; n frames are pre-faulted on format change\n");
+
 void *default_data_allocator::allocate(size_t size) {
         return malloc(size);
 }
@@ -58,37 +85,319 @@ struct video_frame_pool_allocator *default_data_allocator::clone() const {
         return new default_data_allocator(*this);
 }
 
+#ifdef __linux__
+/// size of the mapping is stored before the returned pointer, keeps 64B alignment
+#define HUGEPAGE_HDR_LEN 64
+#ifndef MPOL_BIND
+#define MPOL_BIND 2
+#endif
+static void *mmap_hugetlb(size_t len, size_t page_size) {
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+#ifdef MAP_HUGE_SHIFT
+        flags |= (page_size == hugepage_data_allocator::PAGE_1G ? 30 : 21) << MAP_HUGE_SHIFT;
+#else
+        if (page_size != hugepage_data_allocator::PAGE_2M) {
+                return MAP_FAILED;
+        }
+#endif
+        return mmap(nullptr, len, PROT_READ | PROT_WRITE, flags, -1, 0);
+}
+
+void *hugepage_data_allocator::allocate(size_t size) {
+        size_t page_size = m_page_size;
+        size_t len = (size + HUGEPAGE_HDR_LEN + page_size - 1) / page_size * page_size;
+        void *base = mmap_hugetlb(len, page_size);
+        if (base == MAP_FAILED && page_size != PAGE_2M) { // no reserved 1 GB pages
+                page_size = PAGE_2M;
+                len = (size + HUGEPAGE_HDR_LEN + page_size - 1) / page_size * page_size;
+                base = mmap_hugetlb(len, page_size);
+        }
+        if (base == MAP_FAILED) { // no reserved huge pages - try THP
+                base = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (base == MAP_FAILED) {
+                        return nullptr;
+                }
+#ifdef MADV_HUGEPAGE
+                madvise(base, len, MADV_HUGEPAGE);
+#endif
+        }
+#ifdef SYS_mbind
+        if (m_numa_node >= 0) { // before the first touch so that pages are allocated from the node
+                unsigned long nodemask[4] = {};
+                if ((size_t) m_numa_node < sizeof nodemask * 8) {
+                        nodemask[m_numa_node / (sizeof nodemask[0] * 8)] |= 1UL << (m_numa_node % (sizeof nodemask[0] * 8));
+                }
+                if (syscall(SYS_mbind, base, len, MPOL_BIND, nodemask, sizeof nodemask * 8, 0) != 0) {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Cannot bind frame memory to NUMA node %d: %s\n",
+                                        m_numa_node, strerror(errno));
+                }
+        }
+#endif
+        *static_cast<size_t *>(base) = len;
+        return static_cast<char *>(base) + HUGEPAGE_HDR_LEN;
+}
+void hugepage_data_allocator::deallocate(void *ptr) {
+        if (ptr == nullptr) {
+                return;
+        }
+        void *base = static_cast<char *>(ptr) - HUGEPAGE_HDR_LEN;
+        munmap(base, *static_cast<size_t *>(base));
+}
+#else
+void *hugepage_data_allocator::allocate(size_t size) {
+        return malloc(size);
+}
+void hugepage_data_allocator::deallocate(void *ptr) {
+        free(ptr);
+}
+#endif
+struct video_frame_pool_allocator *hugepage_data_allocator::clone() const {
+        return new hugepage_data_allocator(*this);
+}
+
+void *pinned_data_allocator::allocate(size_t size) {
+        // the first alignment block holds the length so that the data stay aligned
+        size_t data_len = (size + m_alignment - 1) / m_alignment * m_alignment;
+        char *base = static_cast<char *>(aligned_malloc(data_len + m_alignment, m_alignment));
+        if (base == nullptr) {
+                return nullptr;
+        }
+        *reinterpret_cast<size_t *>(base) = data_len;
+        char *ptr = base + m_alignment;
+#ifdef _WIN32
+        bool locked = VirtualLock(ptr, data_len);
+#else
+        bool locked = mlock(ptr, data_len) == 0;
+#endif
+        if (!locked) {
+                static bool warned = false;
+                if (!warned) {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Cannot lock frame memory (%s), consider raising the memlock limit.\n",
+                                        strerror(errno));
+                        warned = true;
+                }
+        }
+#ifdef HAVE_CUDA
+        if (m_cuda_register && cuda_wrapper_host_register(ptr, data_len, CUDA_WRAPPER_HOST_REGISTER_PORTABLE) != CUDA_WRAPPER_SUCCESS) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Cannot register frame memory with CUDA: %s\n",
+                                cuda_wrapper_last_error_string());
+        }
+#endif
+        return ptr;
+}
+void pinned_data_allocator::deallocate(void *ptr) {
+        if (ptr == nullptr) {
+                return;
+        }
+        char *base = static_cast<char *>(ptr) - m_alignment;
+        size_t data_len = *reinterpret_cast<size_t *>(base);
+#ifdef HAVE_CUDA
+        if (m_cuda_register) {
+                cuda_wrapper_host_unregister(ptr);
+        }
+#endif
+#ifdef _WIN32
+        VirtualUnlock(ptr, data_len);
+#else
+        munlock(ptr, data_len);
+#endif
+        aligned_free(base);
+}
+struct video_frame_pool_allocator *pinned_data_allocator::clone() const {
+        return new pinned_data_allocator(*this);
+}
+
+/**
+ * Parses one <alloc> item of frame-pool-alloc (see the param doc).
+ */
+static unique_ptr<video_frame_pool_allocator> parse_allocator(const string &spec) {
+        if (spec == "default") {
+                return unique_ptr<video_frame_pool_allocator>(new default_data_allocator());
+        }
+        if (spec == "pinned" || spec == "pinned-cuda") {
+                return unique_ptr<video_frame_pool_allocator>(new pinned_data_allocator(
+                                        pinned_data_allocator::DEFAULT_ALIGNMENT, spec == "pinned-cuda"));
+        }
+        if (spec.compare(0, 4, "huge") != 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unknown allocator: %s\n", spec.c_str());
+                return {};
+        }
+        size_t pos = 4;
+        size_t page_size = hugepage_data_allocator::PAGE_2M;
+        if (spec.compare(pos, 2, "1g") == 0) {
+                page_size = hugepage_data_allocator::PAGE_1G;
+                pos += 2;
+        }
+        int node = -1;
+        unsigned prefault = 0;
+        while (pos < spec.length()) {
+                char kind = spec[pos];
+                size_t end = 0;
+                unsigned long val = 0;
+                try {
+                        val = std::stoul(spec.substr(pos + 1), &end);
+                } catch (std::exception &) {
+                        end = 0;
+                }
+                if ((kind != '@' && kind != '+') || end == 0) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong allocator spec: %s\n", spec.c_str());
+                        return {};
+                }
+                if (kind == '@') {
+                        node = val;
+                } else {
+                        prefault = val;
+                }
+                pos += 1 + end;
+        }
+        return unique_ptr<video_frame_pool_allocator>(new hugepage_data_allocator(page_size, node, prefault));
+}
+
+unique_ptr<video_frame_pool_allocator> get_configured_frame_pool_allocator(const char *pool_class) {
+        const char *cfg = get_commandline_param("frame-pool-alloc");
+        if (cfg == nullptr) {
+                return {};
+        }
+        string items = cfg;
+        size_t start = 0;
+        while (start < items.length()) {
+                size_t end = items.find(':', start);
+                string item = items.substr(start, end == string::npos ? string::npos : end - start);
+                size_t eq = item.find('=');
+                if (eq == string::npos) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong frame-pool-alloc item: %s\n", item.c_str());
+                } else if (item.compare(0, eq, pool_class) == 0 || item.compare(0, eq, "*") == 0) {
+                        return parse_allocator(item.substr(eq + 1));
+                }
+                if (end == string::npos) {
+                        break;
+                }
+                start = end + 1;
+        }
+        return {};
+}
+
+unique_ptr<video_frame_pool_allocator> frame_pool_allocator_for(const char *pool_class, video_frame_pool_allocator const &dflt) {
+        auto ret = get_configured_frame_pool_allocator(pool_class);
+        return ret ? std::move(ret) : unique_ptr<video_frame_pool_allocator>(dflt.clone());
+}
+
 video_frame_pool::video_frame_pool(unsigned int max_used_frames, video_frame_pool_allocator const &alloc) : m_allocator(alloc.clone()), m_generation(0), m_desc(), m_max_data_len(0), m_unreturned_frames(0), m_max_used_frames(max_used_frames) {
 }
 
 video_frame_pool::~video_frame_pool() {
         std::unique_lock<std::mutex> lk(m_lock);
-        remove_free_frames();
         // wait also for all frames we gave out to return us
+        m_waiting += 1;
         m_frame_returned.wait(lk, [this] {return m_unreturned_frames == 0;});
+        m_waiting -= 1;
+        while (m_returning > 0) { // last returner may still be touching us
+                std::this_thread::yield();
+        }
+        remove_free_frames();
 }
 
 void video_frame_pool::reconfigure(struct video_desc new_desc, size_t new_size) {
         std::unique_lock<std::mutex> lk(m_lock);
         m_desc = new_desc;
         m_max_data_len = new_size != SIZE_MAX ? new_size : new_desc.height * vc_get_linesize(new_desc.width, new_desc.color_spec);
-        remove_free_frames();
         m_generation++;
+        remove_free_frames();
+        prefault_frames();
+}
+
+/**
+ * Allocates and touches the frames that will be needed after the format
+ * change so that the first frames do not pay for page faults.
+ * @note called with m_lock held
+ */
+void video_frame_pool::prefault_frames() {
+        unsigned int count = m_allocator->prefault_frames();
+        if (m_max_used_frames > 0) {
+                count = std::min(count, m_max_used_frames);
+        }
+        for (unsigned int i = 0; i < count; ++i) {
+                struct video_frame *frame = vf_alloc_desc(m_desc);
+                for (unsigned int j = 0; j < m_desc.tile_count; ++j) {
+                        frame->tiles[j].data = (char *) m_allocator->allocate(m_max_data_len);
+                        if (frame->tiles[j].data == NULL) {
+                                deallocate_frame(frame, m_max_data_len);
+                                return;
+                        }
+                        mem_budget_add(MEM_FRAME_POOL, m_max_data_len);
+                        memset(frame->tiles[j].data, 0, m_max_data_len);
+                        frame->tiles[j].data_len = m_max_data_len;
+                }
+                put_free_frame(frame, m_generation, m_max_data_len);
+        }
+}
+
+/// stores frame to the lock-free ring, if full to the overflow queue
+void video_frame_pool::put_free_frame(struct video_frame *frame, int generation, size_t data_len) {
+        free_frame item{frame, generation, data_len};
+        if (m_free_ring.try_push(std::move(item))) {
+                return;
+        }
+        std::unique_lock<std::mutex> lk(m_overflow_lock);
+        m_overflow_frames.push(item);
+        m_overflow_count += 1;
+}
+
+/**
+ * @returns free frame of the current generation or nullptr (stale frames
+ * from before the last reconfigure() are freed)
+ */
+struct video_frame *video_frame_pool::get_free_frame(int *generation, size_t *data_len) {
+        free_frame item{};
+        while (true) {
+                if (!m_free_ring.try_pop(item)) {
+                        if (m_overflow_count == 0) {
+                                return nullptr;
+                        }
+                        std::unique_lock<std::mutex> lk(m_overflow_lock);
+                        if (m_overflow_frames.empty()) {
+                                return nullptr;
+                        }
+                        item = m_overflow_frames.front();
+                        m_overflow_frames.pop();
+                        m_overflow_count -= 1;
+                }
+                if (item.generation == m_generation) {
+                        *generation = item.generation;
+                        *data_len = item.data_len;
+                        return item.frame;
+                }
+                deallocate_frame(item.frame, item.data_len);
+        }
 }
 
 std::shared_ptr<video_frame> video_frame_pool::get_frame() {
         assert(m_generation != 0);
         struct video_frame *ret = NULL;
-        std::unique_lock<std::mutex> lk(m_lock);
-        if (!m_free_frames.empty()) {
-                ret = m_free_frames.front();
-                m_free_frames.pop();
-        } else if (m_max_used_frames > 0 && m_max_used_frames == m_unreturned_frames) {
-                m_frame_returned.wait(lk, [this] {return m_unreturned_frames < m_max_used_frames;});
-                assert(!m_free_frames.empty());
-                ret = m_free_frames.front();
-                m_free_frames.pop();
-        } else {
+        int generation = 0;
+        size_t data_len = 0;
+        bool budget_waited = false;
+        while ((ret = get_free_frame(&generation, &data_len)) == NULL) {
+                std::unique_lock<std::mutex> lk(m_lock);
+                if (m_max_used_frames > 0 && m_unreturned_frames >= m_max_used_frames) {
+                        m_waiting += 1;
+                        m_frame_returned.wait(lk, [this] {return m_unreturned_frames < m_max_used_frames;});
+                        m_waiting -= 1;
+                        continue; // the returned frame is in the free list now (unless stale)
+                }
+                // budget reached - rather wait (bounded, the consumer may wait for us) for a returned frame
+                if (!budget_waited && m_unreturned_frames > 0 && mem_budget_exceeded()) {
+                        mem_budget_backpressure(MEM_FRAME_POOL);
+                        budget_waited = true;
+                        unsigned int unreturned = m_unreturned_frames;
+                        m_waiting += 1;
+                        m_frame_returned.wait_for(lk, std::chrono::milliseconds(MEM_BUDGET_WAIT_MS),
+                                        [this, unreturned] {return m_unreturned_frames < unreturned;});
+                        m_waiting -= 1;
+                        continue;
+                }
+                generation = m_generation;
+                data_len = m_max_data_len;
                 try {
                         ret = vf_alloc_desc(m_desc);
                         for (unsigned int i = 0; i < m_desc.tile_count; ++i) {
@@ -97,28 +406,33 @@ std::shared_ptr<video_frame> video_frame_pool::get_frame() {
                                 if (ret->tiles[i].data == NULL) {
                                         throw std::runtime_error("Cannot allocate data");
                                 }
+                                mem_budget_add(MEM_FRAME_POOL, m_max_data_len);
                                 ret->tiles[i].data_len = m_max_data_len;
                         }
                 } catch (std::exception &e) {
                         std::cerr << e.what() << std::endl;
-                        deallocate_frame(ret);
+                        deallocate_frame(ret, m_max_data_len);
                         throw e;
                 }
+                break;
         }
         m_unreturned_frames += 1;
-        return std::shared_ptr<video_frame>(ret, std::bind([this](struct video_frame *frame, int generation) {
-                                std::unique_lock<std::mutex> lk(m_lock);
-
+        return std::shared_ptr<video_frame>(ret, std::bind([this](struct video_frame *frame, int generation, size_t data_len) {
+                                m_returning += 1;
+                                // over budget, the pool shrinks by not keeping returned frames
+                                if (this->m_generation != generation || mem_budget_exceeded()) {
+                                        this->deallocate_frame(frame, data_len);
+                                } else {
+                                        this->put_free_frame(frame, generation, data_len);
+                                }
                                 assert(m_unreturned_frames > 0);
                                 m_unreturned_frames -= 1;
-                                m_frame_returned.notify_one();
-
-                                if (this->m_generation != generation) {
-                                this->deallocate_frame(frame);
-                                } else {
-                                m_free_frames.push(frame);
+                                if (m_waiting > 0) {
+                                        std::unique_lock<std::mutex> lk(m_lock);
+                                        m_frame_returned.notify_all();
                                 }
-                                }, std::placeholders::_1, m_generation));
+                                m_returning -= 1; // must be the last access to this
+                                }, std::placeholders::_1, generation, data_len));
 }
 
 struct video_frame *video_frame_pool::get_disposable_frame() {
@@ -147,24 +461,32 @@ video_frame_pool_allocator const & video_frame_pool::get_allocator() {
 }
 
 void video_frame_pool::remove_free_frames() {
-        while (!m_free_frames.empty()) {
-                struct video_frame *frame = m_free_frames.front();
-                m_free_frames.pop();
-                deallocate_frame(frame);
+        free_frame item{};
+        while (m_free_ring.try_pop(item)) {
+                deallocate_frame(item.frame, item.data_len);
         }
+        std::unique_lock<std::mutex> lk(m_overflow_lock);
+        while (!m_overflow_frames.empty()) {
+                deallocate_frame(m_overflow_frames.front().frame, m_overflow_frames.front().data_len);
+                m_overflow_frames.pop();
+        }
+        m_overflow_count = 0;
 }
 
-void video_frame_pool::deallocate_frame(struct video_frame *frame) {
+void video_frame_pool::deallocate_frame(struct video_frame *frame, size_t data_len) {
         if (frame == NULL)
                 return;
         for (unsigned int i = 0; i < frame->tile_count; ++i) {
+                if (frame->tiles[i].data != NULL) {
+                        mem_budget_add(MEM_FRAME_POOL, -(long long) data_len);
+                }
                 m_allocator->deallocate(frame->tiles[i].data);
         }
         vf_free(frame);
 }
 
 void *video_frame_pool_init(struct video_desc desc, int len) {
-        auto *out = new video_frame_pool(len, default_data_allocator());
+        auto *out = new video_frame_pool(len, *frame_pool_allocator_for("capture"));
         out->reconfigure(desc);
         return (void *) out;
 }
@@ -41,19 +41,27 @@
 #include "debug.h"
 #include "host.h"
 #include "video.h"
+#ifdef HAVE_CUDA
+#include "cuda_wrapper.h"
+#endif
 
 #ifdef __cplusplus
 
+#include <atomic>
 #include <condition_variable>
 #include <cstdint>
 #include <mutex>
 #include <memory>
 #include <queue>
 
+#include "utils/lockfree_queue.hpp"
+
 struct video_frame_pool_allocator {
         virtual void *allocate(size_t size) = 0;
         virtual void deallocate(void *ptr) = 0;
         virtual struct video_frame_pool_allocator *clone() const = 0;
+        /// number of frames the pool allocates and touches on reconfigure()
+        virtual unsigned int prefault_frames() const { return 0; }
         virtual ~video_frame_pool_allocator() {}
 };
 
@@ -63,6 +71,88 @@ struct default_data_allocator : public video_frame_pool_allocator {
         struct video_frame_pool_allocator *clone() const override;
 };
 
+#ifdef HAVE_CUDA
+/**
+ * Allocates page-locked (pinned) host memory so that host<->device copies of
+ * the frames are done by DMA (and may be asynchronous). Memory is portable,
+ * ie. usable from any CUDA context.
+ * @note user must link with cuda_wrapper ($CUDA_COMMON_OBJ)
+ */
+struct cuda_host_data_allocator : public video_frame_pool_allocator {
+        void *allocate(size_t size) override {
+                void *ptr = nullptr;
+                if (cuda_wrapper_host_alloc(&ptr, size, CUDA_WRAPPER_HOST_ALLOC_PORTABLE) != CUDA_WRAPPER_SUCCESS) {
+                        log_msg(LOG_LEVEL_ERROR, "[video_frame_pool] Cannot allocate pinned memory: %s\n",
+                                        cuda_wrapper_last_error_string());
+                        return nullptr;
+                }
+                return ptr;
+        }
+        void deallocate(void *ptr) override {
+                cuda_wrapper_free_host(ptr);
+        }
+        struct video_frame_pool_allocator *clone() const override {
+                return new cuda_host_data_allocator(*this);
+        }
+};
+#endif // defined HAVE_CUDA
+
+/**
+ * Allocates the buffers from huge pages (if available, otherwise transparent
+ * huge pages are requested) to reduce TLB pressure for big (4K+) frames.
+ * Falls back to malloc on platforms without mmap().
+ */
+struct hugepage_data_allocator : public video_frame_pool_allocator {
+        static constexpr size_t PAGE_2M = 2 * 1024 * 1024;
+        static constexpr size_t PAGE_1G = 1024 * 1024 * 1024;
+        /**
+         * @param page_size  PAGE_2M or PAGE_1G (1 GB pages do not fall back to THP
+         *                   but to 2 MB pages)
+         * @param numa_node  node to bind the memory to, -1 for the default policy
+         * @param prefault   see video_frame_pool_allocator::prefault_frames()
+         */
+        explicit hugepage_data_allocator(size_t page_size = PAGE_2M, int numa_node = -1, unsigned int prefault = 0)
+                : m_page_size(page_size), m_numa_node(numa_node), m_prefault(prefault) {}
+        void *allocate(size_t size) override;
+        void deallocate(void *ptr) override;
+        struct video_frame_pool_allocator *clone() const override;
+        unsigned int prefault_frames() const override { return m_prefault; }
+private:
+        size_t m_page_size;
+        int m_numa_node;
+        unsigned int m_prefault;
+};
+
+/**
+ * Returns allocator requested for pools of class pool_class (eg. "capture",
+ * "compress") with "--param frame-pool-alloc", nullptr if not set.
+ */
+/**
+ * Page-aligned and page-locked memory that capture and playback cards can DMA
+ * to or from directly, optionally also registered with CUDA so that the frames
+ * can be uploaded to the GPU without a staging copy.
+ */
+struct pinned_data_allocator : public video_frame_pool_allocator {
+        static constexpr size_t DEFAULT_ALIGNMENT = 4096;
+        /**
+         * @param alignment      buffer alignment (power of 2, at least the page size)
+         * @param cuda_register  register the memory as CUDA pinned (ignored if built without CUDA)
+         */
+        explicit pinned_data_allocator(size_t alignment = DEFAULT_ALIGNMENT, bool cuda_register = false)
+                : m_alignment(alignment), m_cuda_register(cuda_register) {}
+        void *allocate(size_t size) override;
+        void deallocate(void *ptr) override;
+        struct video_frame_pool_allocator *clone() const override;
+private:
+        size_t m_alignment;
+        bool m_cuda_register;
+};
+
+std::unique_ptr<video_frame_pool_allocator> get_configured_frame_pool_allocator(const char *pool_class);
+/// @returns configured allocator (see above) or a clone of dflt
+std::unique_ptr<video_frame_pool_allocator> frame_pool_allocator_for(const char *pool_class,
+                video_frame_pool_allocator const &dflt = default_data_allocator());
+
 struct video_frame_pool {
         public:
                 /**
@@ -96,17 +186,34 @@ struct video_frame_pool {
                 video_frame_pool_allocator const & get_allocator();
 
         private:
+                struct free_frame {
+                        struct video_frame *frame;
+                        int generation; ///< m_generation when the frame was allocated
+                        size_t data_len; ///< allocated length of each tile
+                };
+                /// free frames are kept in a lock-free ring. The overflow queue
+                /// is used only if more than FREE_RING_LEN frames are idle.
+                static constexpr int FREE_RING_LEN = 32;
+
+                void prefault_frames();
+                void put_free_frame(struct video_frame *frame, int generation, size_t data_len);
+                struct video_frame *get_free_frame(int *generation, size_t *data_len);
                 void remove_free_frames();
-                void deallocate_frame(struct video_frame *frame);
+                void deallocate_frame(struct video_frame *frame, size_t data_len);
 
                 std::unique_ptr<video_frame_pool_allocator> m_allocator;
-                std::queue<struct video_frame *> m_free_frames;
-                std::mutex        m_lock;
+                lockfree_queue<free_frame, FREE_RING_LEN> m_free_ring;
+                std::mutex        m_overflow_lock;
+                std::queue<free_frame> m_overflow_frames;
+                std::atomic<int>  m_overflow_count{0};
+                std::mutex        m_lock; ///< reconfigure, allocation and exhaustion waits
                 std::condition_variable m_frame_returned;
-                int               m_generation;
+                std::atomic<int>  m_waiting{0}; ///< threads waiting for m_frame_returned
+                std::atomic<int>  m_returning{0}; ///< frame deleters in progress
+                std::atomic<int>  m_generation;
                 struct video_desc m_desc;
                 size_t            m_max_data_len;
-                unsigned int      m_unreturned_frames;
+                std::atomic<unsigned int> m_unreturned_frames;
                 unsigned int      m_max_used_frames;
 };
 #endif //  __cplusplus
@@ -0,0 +1,435 @@
+/**
+ * @file   utils/video_shm.c
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ * 
+ *      This product includes software developed by CESNET z.s.p.o.
+ * 
+ * 4. Neither the name of the CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include "debug.h"
+#include "tv.h"
+#include "utils/video_shm.h"
+#include "video_codec.h"
+
+#define MOD_NAME "[video_shm] "
+
+size_t video_shm_get_tile_stride(struct video_desc desc) {
+        // includes padding for conversions reading beyond the end (see MAX_PADDING)
+        return (vc_get_datalen(desc.width, desc.height, desc.color_spec) + 2 * MAX_PADDING - 1) / MAX_PADDING * MAX_PADDING;
+}
+
+#ifndef _WIN32
+
+#define VIDEO_SHM_MAGIC 0x55475653 // "UGVS"
+#define VIDEO_SHM_VERSION 1
+/// slot referenced by a reader for longer is considered leaked (crashed reader)
+#define STALE_REF_TIMEOUT_NS (5 * NS_IN_SEC)
+
+struct video_shm_slot {
+        int32_t refcount;
+        uint64_t seq;             ///< number of contained frame, 0 if none
+        time_ns_t ref_time;       ///< when the last reference was taken
+        struct video_desc desc;
+        uint64_t data_len;
+};
+
+struct video_shm_header {
+        uint32_t magic;
+        uint32_t version;
+        int32_t slot_count;
+        uint32_t obsolete;        ///< segment was replaced/closed by the writer
+        uint64_t slot_size;       ///< bytes per slot, multiple of page size
+        uint64_t data_offset;     ///< offset of the first slot in the segment
+        uint64_t seq;             ///< number of the last published frame
+        int32_t last_slot;        ///< slot with frame seq, referenced by the segment
+        int32_t next_slot;        ///< where the writer starts looking for a free slot
+        pthread_mutex_t lock;
+        pthread_cond_t cond;      ///< signalled when a frame is published
+        struct video_shm_slot slots[VIDEO_SHM_MAX_SLOTS];
+};
+
+struct video_shm {
+        struct video_shm_header *hdr;
+        size_t len;
+        bool writer;
+        ino_t ino;
+        char path[128];
+};
+
+static void get_path(char *path, size_t len, const char *name) {
+        snprintf(path, len, "/ug_shm_%s", name);
+}
+
+static void shm_lock(struct video_shm_header *hdr) {
+        int rc = pthread_mutex_lock(&hdr->lock);
+#ifdef __linux__
+        if (rc == EOWNERDEAD) { // peer crashed while holding the lock, the state is consistent anyways
+                pthread_mutex_consistent(&hdr->lock);
+        }
+#else
+        (void) rc;
+#endif
+}
+
+static void shm_unlock(struct video_shm_header *hdr) {
+        pthread_mutex_unlock(&hdr->lock);
+}
+
+static struct video_shm *shm_map(const char *path, int fd, size_t len, bool writer) {
+        void *map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot map %s: %s\n", path, strerror(errno));
+                return NULL;
+        }
+#ifdef MADV_HUGEPAGE
+        madvise(map, len, MADV_HUGEPAGE); // honoured for shmem if enabled in the system
+#endif
+        struct stat st;
+        fstat(fd, &st);
+
+        struct video_shm *shm = calloc(1, sizeof *shm);
+        shm->hdr = map;
+        shm->len = len;
+        shm->writer = writer;
+        shm->ino = st.st_ino;
+        strncpy(shm->path, path, sizeof shm->path - 1);
+        return shm;
+}
+
+/// notifies readers of a previous segment with the same name (if any)
+static void obsolete_previous(const char *path) {
+        int fd = shm_open(path, O_RDWR, 0);
+        if (fd == -1) {
+                return;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == 0 && (size_t) st.st_size >= sizeof(struct video_shm_header)) {
+                struct video_shm_header *hdr = mmap(NULL, sizeof *hdr, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                if (hdr != MAP_FAILED) {
+                        if (hdr->magic == VIDEO_SHM_MAGIC && hdr->version == VIDEO_SHM_VERSION) {
+                                shm_lock(hdr);
+                                hdr->obsolete = 1;
+                                pthread_cond_broadcast(&hdr->cond);
+                                shm_unlock(hdr);
+                        }
+                        munmap(hdr, sizeof *hdr);
+                }
+        }
+        close(fd);
+        shm_unlink(path);
+}
+
+struct video_shm *video_shm_create(const char *name, int slot_count, size_t slot_size) {
+        if (slot_count < 1 || slot_count > VIDEO_SHM_MAX_SLOTS) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Slot count must be 1-%d!\n", VIDEO_SHM_MAX_SLOTS);
+                return NULL;
+        }
+        char path[128];
+        get_path(path, sizeof path, name);
+        obsolete_previous(path);
+
+        const size_t page = sysconf(_SC_PAGESIZE);
+        slot_size = (slot_size + page - 1) / page * page;
+        const size_t data_offset = (sizeof(struct video_shm_header) + page - 1) / page * page;
+        const size_t len = data_offset + slot_count * slot_size;
+
+        int fd = shm_open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd == -1) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot create %s: %s\n", path, strerror(errno));
+                return NULL;
+        }
+        if (ftruncate(fd, len) == -1) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot allocate %zu B: %s\n", len, strerror(errno));
+                close(fd);
+                shm_unlink(path);
+                return NULL;
+        }
+        struct video_shm *shm = shm_map(path, fd, len, true);
+        close(fd);
+        if (!shm) {
+                shm_unlink(path);
+                return NULL;
+        }
+
+        struct video_shm_header *hdr = shm->hdr;
+        pthread_mutexattr_t mattr;
+        pthread_mutexattr_init(&mattr);
+        pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
+#ifdef __linux__
+        pthread_mutexattr_setrobust(&mattr, PTHREAD_MUTEX_ROBUST);
+#endif
+        pthread_mutex_init(&hdr->lock, &mattr);
+        pthread_mutexattr_destroy(&mattr);
+        pthread_condattr_t cattr;
+        pthread_condattr_init(&cattr);
+        pthread_condattr_setpshared(&cattr, PTHREAD_PROCESS_SHARED);
+        pthread_cond_init(&hdr->cond, &cattr);
+        pthread_condattr_destroy(&cattr);
+
+        hdr->slot_count = slot_count;
+        hdr->slot_size = slot_size;
+        hdr->data_offset = data_offset;
+        hdr->last_slot = -1;
+        hdr->version = VIDEO_SHM_VERSION;
+        __sync_synchronize();
+        hdr->magic = VIDEO_SHM_MAGIC; // readers check it last
+
+        log_msg(LOG_LEVEL_INFO, MOD_NAME "Created %s with %d slots of %zu B.\n", path, slot_count, slot_size);
+        return shm;
+}
+
+struct video_shm *video_shm_open(const char *name) {
+        char path[128];
+        get_path(path, sizeof path, name);
+        int fd = shm_open(path, O_RDWR, 0);
+        if (fd == -1) {
+                return NULL;
+        }
+        struct stat st;
+        struct video_shm *shm = NULL;
+        if (fstat(fd, &st) == 0 && (size_t) st.st_size >= sizeof(struct video_shm_header)) {
+                shm = shm_map(path, fd, st.st_size, false);
+        }
+        close(fd);
+        if (shm && (shm->hdr->magic != VIDEO_SHM_MAGIC || shm->hdr->version != VIDEO_SHM_VERSION
+                                || shm->hdr->data_offset + shm->hdr->slot_count * shm->hdr->slot_size > shm->len)) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "%s is not initialized or has incompatible version.\n", path);
+                video_shm_close(shm);
+                return NULL;
+        }
+        return shm;
+}
+
+void video_shm_close(struct video_shm *shm) {
+        if (!shm) {
+                return;
+        }
+        if (shm->writer) {
+                shm_lock(shm->hdr);
+                shm->hdr->obsolete = 1;
+                pthread_cond_broadcast(&shm->hdr->cond);
+                shm_unlock(shm->hdr);
+                // unlink only if not already replaced by another writer
+                int fd = shm_open(shm->path, O_RDONLY, 0);
+                if (fd != -1) {
+                        struct stat st;
+                        if (fstat(fd, &st) == 0 && st.st_ino == shm->ino) {
+                                shm_unlink(shm->path);
+                        }
+                        close(fd);
+                }
+        }
+        munmap(shm->hdr, shm->len);
+        free(shm);
+}
+
+size_t video_shm_get_slot_size(struct video_shm *shm) {
+        return shm->hdr->slot_size;
+}
+
+char *video_shm_get_slot_data(struct video_shm *shm, int slot) {
+        return (char *) shm->hdr + shm->hdr->data_offset + slot * shm->hdr->slot_size;
+}
+
+int video_shm_acquire(struct video_shm *shm) {
+        struct video_shm_header *hdr = shm->hdr;
+        const time_ns_t now = get_time_in_ns();
+        int ret = -1;
+
+        shm_lock(hdr);
+        for (int i = 0; i < hdr->slot_count && ret == -1; ++i) {
+                int slot = (hdr->next_slot + i) % hdr->slot_count;
+                if (hdr->slots[slot].refcount == 0) {
+                        ret = slot;
+                }
+        }
+        for (int i = 0; i < hdr->slot_count && ret == -1; ++i) {
+                if (i != hdr->last_slot && now - hdr->slots[i].ref_time > STALE_REF_TIMEOUT_NS) {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Reclaiming slot %d held for too long (crashed reader?).\n", i);
+                        ret = i;
+                }
+        }
+        if (ret != -1) {
+                hdr->slots[ret].refcount = 1;
+                hdr->slots[ret].ref_time = now;
+                hdr->slots[ret].seq = 0;
+                hdr->next_slot = (ret + 1) % hdr->slot_count;
+        }
+        shm_unlock(hdr);
+        return ret;
+}
+
+void video_shm_publish(struct video_shm *shm, int slot, struct video_desc desc, size_t data_len) {
+        struct video_shm_header *hdr = shm->hdr;
+
+        shm_lock(hdr);
+        if (hdr->last_slot != -1) {
+                hdr->slots[hdr->last_slot].refcount -= 1;
+        }
+        hdr->slots[slot].desc = desc;
+        hdr->slots[slot].data_len = data_len;
+        hdr->slots[slot].seq = ++hdr->seq;
+        hdr->last_slot = slot;
+        pthread_cond_broadcast(&hdr->cond);
+        shm_unlock(hdr);
+}
+
+int video_shm_wait(struct video_shm *shm, uint64_t *last_seq, int timeout_ms,
+                struct video_desc *desc, size_t *data_len) {
+        struct video_shm_header *hdr = shm->hdr;
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec += 1;
+                deadline.tv_nsec -= 1000000000L;
+        }
+
+        int ret = -1;
+        shm_lock(hdr);
+        while (!hdr->obsolete && (hdr->last_slot == -1 || hdr->seq == *last_seq)) {
+                int rc = pthread_cond_timedwait(&hdr->cond, &hdr->lock, &deadline);
+#ifdef __linux__
+                if (rc == EOWNERDEAD) {
+                        pthread_mutex_consistent(&hdr->lock);
+                }
+#endif
+                if (rc == ETIMEDOUT) {
+                        break;
+                }
+        }
+        if (hdr->obsolete) {
+                ret = -2;
+        } else if (hdr->last_slot != -1 && hdr->seq != *last_seq) {
+                ret = hdr->last_slot;
+                hdr->slots[ret].refcount += 1;
+                hdr->slots[ret].ref_time = get_time_in_ns();
+                *last_seq = hdr->seq;
+                *desc = hdr->slots[ret].desc;
+                *data_len = hdr->slots[ret].data_len;
+        }
+        shm_unlock(hdr);
+
+        if (ret == -1) { // check if the segment wasn't replaced by a restarted (crashed) writer
+                int fd = shm_open(shm->path, O_RDONLY, 0);
+                struct stat st;
+                if (fd == -1 || (fstat(fd, &st) == 0 && st.st_ino != shm->ino)) {
+                        ret = -2;
+                }
+                if (fd != -1) {
+                        close(fd);
+                }
+        }
+        return ret;
+}
+
+void video_shm_release(struct video_shm *shm, int slot) {
+        shm_lock(shm->hdr);
+        if (shm->hdr->slots[slot].refcount > 0) {
+                shm->hdr->slots[slot].refcount -= 1;
+        }
+        shm_unlock(shm->hdr);
+}
+
+#else // defined _WIN32
+
+struct video_shm *video_shm_create(const char *name, int slot_count, size_t slot_size) {
+        (void) name, (void) slot_count, (void) slot_size;
+        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Not supported on this platform!\n");
+        return NULL;
+}
+
+struct video_shm *video_shm_open(const char *name) {
+        (void) name;
+        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Not supported on this platform!\n");
+        return NULL;
+}
+
+void video_shm_close(struct video_shm *shm) {
+        (void) shm;
+}
+
+size_t video_shm_get_slot_size(struct video_shm *shm) {
+        (void) shm;
+        return 0;
+}
+
+char *video_shm_get_slot_data(struct video_shm *shm, int slot) {
+        (void) shm, (void) slot;
+        return NULL;
+}
+
+int video_shm_acquire(struct video_shm *shm) {
+        (void) shm;
+        return -1;
+}
+
+void video_shm_publish(struct video_shm *shm, int slot, struct video_desc desc, size_t data_len) {
+        (void) shm, (void) slot, (void) desc, (void) data_len;
+}
+
+int video_shm_wait(struct video_shm *shm, uint64_t *last_seq, int timeout_ms,
+                struct video_desc *desc, size_t *data_len) {
+        (void) shm, (void) last_seq, (void) timeout_ms, (void) desc, (void) data_len;
+        return -2;
+}
+
+void video_shm_release(struct video_shm *shm, int slot) {
+        (void) shm, (void) slot;
+}
+
+#endif // defined _WIN32
+
@@ -0,0 +1,112 @@
+/**
+ * @file   utils/video_shm.h
+ *
+ * Ring of video frame slots in named POSIX shared memory connecting one
+ * writer process (display/shm.cpp) with any number of reader processes
+ * (video_capture/shm.cpp). Slots are reference counted - the writer fills
+ * an unreferenced slot, the most recently published frame is held by the
+ * segment itself and each reader holds its slot until it disposes the
+ * frame, so frames are neither copied nor overwritten while being read.
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ * 
+ *      This product includes software developed by CESNET z.s.p.o.
+ * 
+ * 4. Neither the name of the CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef UTILS_VIDEO_SHM_H_
+#define UTILS_VIDEO_SHM_H_
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#else
+#include <cstddef>
+#include <cstdint>
+#endif
+
+#include "types.h"
+
+#define VIDEO_SHM_MAX_SLOTS 16
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct video_shm;
+
+/**
+ * Creates (replaces) segment /ug_shm_<name>. Readers of a replaced segment
+ * are notified to reopen.
+ * @param slot_size maximal frame data length (incl. padding)
+ */
+struct video_shm *video_shm_create(const char *name, int slot_count, size_t slot_size);
+/// Opens an existing segment for reading, NULL if there is none (yet)
+struct video_shm *video_shm_open(const char *name);
+/// Unmaps the segment, writer also marks it obsolete and unlinks it
+void video_shm_close(struct video_shm *shm);
+
+/// tiles of a frame are placed one after another in the slot with this stride
+size_t video_shm_get_tile_stride(struct video_desc desc);
+size_t video_shm_get_slot_size(struct video_shm *shm);
+char *video_shm_get_slot_data(struct video_shm *shm, int slot);
+
+/**
+ * Writer - takes a free slot.
+ * @returns slot index, -1 if all slots are referenced by the readers
+ */
+int video_shm_acquire(struct video_shm *shm);
+/// Writer - publishes frame in acquired slot, the reference passes to the segment
+void video_shm_publish(struct video_shm *shm, int slot, struct video_desc desc, size_t data_len);
+
+/**
+ * Reader - waits for a frame newer than *last_seq and references its slot.
+ * @retval >=0 slot index, *last_seq is updated
+ * @retval -1  timeout
+ * @retval -2  segment was replaced or removed by the writer, reopen it
+ */
+int video_shm_wait(struct video_shm *shm, uint64_t *last_seq, int timeout_ms,
+                struct video_desc *desc, size_t *data_len);
+
+/// Drops a slot reference taken by video_shm_acquire() or video_shm_wait()
+void video_shm_release(struct video_shm *shm, int slot);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UTILS_VIDEO_SHM_H_
+
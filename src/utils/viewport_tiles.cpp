@@ -0,0 +1,155 @@
+/**
+ * @file   utils/viewport_tiles.cpp
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ * 
+ *      This product includes software developed by CESNET z.s.p.o.
+ * 
+ * 4. Neither the name of the CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <chrono>
+#include <mutex>
+
+#include "debug.h"
+#include "utils/viewport_tiles.h"
+
+#define MOD_NAME "[viewport] "
+/// requested mask is discarded if not refreshed (RTCP interval is >= 5 s by default)
+constexpr std::chrono::seconds VIEWPORT_FEEDBACK_TIMEOUT{15};
+
+using std::chrono::steady_clock;
+
+namespace {
+struct viewport_tiles_state {
+        std::mutex lock;
+        // receiver side
+        bool reported = false;
+        struct viewport_tiles pending{};
+        struct viewport_tiles last_sent{};
+        // sender side
+        bool requested_valid = false;
+        struct viewport_tiles requested{};
+        steady_clock::time_point requested_time;
+};
+
+viewport_tiles_state &get_state() {
+        static viewport_tiles_state s;
+        return s;
+}
+
+bool is_empty(const struct viewport_tiles *t) {
+        for (auto b : t->bits) {
+                if (b != 0) {
+                        return false;
+                }
+        }
+        return true;
+}
+} // end of anonymous namespace
+
+void viewport_tiles_report(const struct viewport_tiles *visible)
+{
+        auto &s = get_state();
+        std::lock_guard<std::mutex> lk(s.lock);
+        for (unsigned i = 0; i < sizeof s.pending.bits / sizeof s.pending.bits[0]; ++i) {
+                s.pending.bits[i] |= visible->bits[i];
+        }
+        s.reported = true;
+}
+
+int viewport_tiles_get_feedback(unsigned char *buf, int max_len)
+{
+        auto &s = get_state();
+        std::lock_guard<std::mutex> lk(s.lock);
+        if (!s.reported || max_len < VIEWPORT_TILES_PAYLOAD_LEN) {
+                return 0;
+        }
+        if (!is_empty(&s.pending)) { // otherwise nothing rendered in meanwhile, repeat last
+                s.last_sent = s.pending;
+                s.pending = {};
+        }
+        for (auto b : s.last_sent.bits) {
+                for (int i = 7; i >= 0; --i) { // network byte order
+                        *buf++ = (b >> (i * 8)) & 0xFF;
+                }
+        }
+        return VIEWPORT_TILES_PAYLOAD_LEN;
+}
+
+void viewport_tiles_put_feedback(const unsigned char *buf, int len)
+{
+        if (len < VIEWPORT_TILES_PAYLOAD_LEN) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Short viewport feedback (%d B)!\n", len);
+                return;
+        }
+        struct viewport_tiles t{};
+        for (auto &b : t.bits) {
+                for (int i = 0; i < 8; ++i) {
+                        b = b << 8 | *buf++;
+                }
+        }
+        auto &s = get_state();
+        std::lock_guard<std::mutex> lk(s.lock);
+        if (!s.requested_valid) {
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Received viewport feedback.\n");
+        }
+        s.requested = t;
+        s.requested_valid = true;
+        s.requested_time = steady_clock::now();
+}
+
+bool viewport_tiles_get_requested(struct viewport_tiles *tiles)
+{
+        auto &s = get_state();
+        std::lock_guard<std::mutex> lk(s.lock);
+        if (!s.requested_valid) {
+                return false;
+        }
+        if (steady_clock::now() - s.requested_time > VIEWPORT_FEEDBACK_TIMEOUT) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Viewport feedback timed out, sending full quality.\n");
+                s.requested_valid = false;
+                return false;
+        }
+        *tiles = s.requested;
+        return true;
+}
+
+/* vim: set expandtab sw=8 tw=120: */
@@ -0,0 +1,110 @@
+/**
+ * @file   utils/viewport_tiles.h
+ *
+ * Viewport feedback for panoramic (equirectangular) video. The receiving
+ * display reports which parts of the panorama are in or near its viewport,
+ * the mask is carried to the sender in an RTCP APP packet and the sender side
+ * (capture_filter/pano_tiles.cpp) keeps full quality only in those parts.
+ *
+ * The mask uses a fixed grid of VIEWPORT_TILES_COLS x VIEWPORT_TILES_ROWS
+ * cells independent of the sender tiling, so that both sides need not agree
+ * on any parameters.
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ * 
+ *      This product includes software developed by CESNET z.s.p.o.
+ * 
+ * 4. Neither the name of the CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef UTILS_VIEWPORT_TILES_H_
+#define UTILS_VIEWPORT_TILES_H_
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#include <stdint.h>
+#else
+#include <cstdint>
+#endif
+
+#define VIEWPORT_TILES_COLS 16
+#define VIEWPORT_TILES_ROWS 8
+#define VIEWPORT_TILES_APP_NAME "VPRT" ///< RTCP APP packet name
+#define VIEWPORT_TILES_PAYLOAD_LEN 16  ///< RTCP APP data length in bytes
+
+/// cell (col, row) is bit row * VIEWPORT_TILES_COLS + col
+struct viewport_tiles {
+        uint64_t bits[VIEWPORT_TILES_COLS * VIEWPORT_TILES_ROWS / 64];
+};
+
+static inline void viewport_tiles_set(struct viewport_tiles *t, int col, int row) {
+        int idx = row * VIEWPORT_TILES_COLS + col;
+        t->bits[idx / 64] |= (uint64_t) 1 << (idx % 64);
+}
+
+static inline bool viewport_tiles_is_set(const struct viewport_tiles *t, int col, int row) {
+        int idx = row * VIEWPORT_TILES_COLS + col;
+        return (t->bits[idx / 64] & ((uint64_t) 1 << (idx % 64))) != 0;
+}
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Called by a display when rendering. Masks reported between two feedback
+ * packets are merged (eg. both eyes of a HMD).
+ */
+void viewport_tiles_report(const struct viewport_tiles *visible);
+/**
+ * Receiver side - writes RTCP APP payload with the viewport mask.
+ * @returns payload length, 0 if no display reported its viewport
+ */
+int viewport_tiles_get_feedback(unsigned char *buf, int max_len);
+
+/// Sender side - processes RTCP APP payload received from the receiver
+void viewport_tiles_put_feedback(const unsigned char *buf, int len);
+/**
+ * Sender side - returns mask requested by the receiver.
+ * @retval false no (recent) feedback received, whole panorama should be sent
+ * in full quality
+ */
+bool viewport_tiles_get_requested(struct viewport_tiles *tiles);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UTILS_VIEWPORT_TILES_H_
+
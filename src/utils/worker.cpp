@@ -46,8 +46,12 @@
 #include "utils/worker.h"
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
 #include <queue>
 #include <set>
+#include <thread>
 #include <vector>
 
 using namespace std;
@@ -311,6 +315,140 @@ void task_run_parallel(runnable_t task, int worker_count, void *data, size_t dat
         }
 }
 
+/**
+ * @brief Persistent pool of CPU-pinned threads for short data-parallel jobs
+ *
+ * Unlike worker_pool, a job is not dispatched per worker - all threads are
+ * woken at once (a generation counter works as a barrier), pick the items
+ * from a shared atomic index and the caller participates, too. Threads spin
+ * shortly before going to sleep so that jobs issued every frame mostly do
+ * not need any syscall.
+ */
+class pinned_pool {
+public:
+        pinned_pool() : m_spin_max(thread::hardware_concurrency() > 1 ? SPIN_MAX : 0) {
+                int count = get_cpu_core_count() - 1; // caller is the remaining one
+                for (int i = 0; i < count; ++i) {
+                        m_threads.emplace_back(&pinned_pool::run, this, i + 1);
+                }
+        }
+        ~pinned_pool() {
+                {
+                        unique_lock<mutex> lk(m_lock);
+                        m_exit = true;
+                        m_generation++;
+                }
+                m_job_cv.notify_all();
+                for (auto &t : m_threads) {
+                        t.join();
+                }
+        }
+        /// @returns false if the pool is busy (eg. nested call), caller should run the job by other means
+        bool run_job(runnable_t task, int count, void *data, size_t data_size, void **res) {
+                unique_lock<mutex> job_lk(m_job_lock, try_to_lock);
+                if (!job_lk.owns_lock() || m_threads.empty()) {
+                        return false;
+                }
+                m_task = task;
+                m_data = (char *) data;
+                m_data_size = data_size;
+                m_res = res;
+                m_count = count;
+                m_next.store(0, memory_order_relaxed);
+                m_pending.store(m_threads.size(), memory_order_relaxed);
+                {
+                        unique_lock<mutex> lk(m_lock);
+                        m_generation.fetch_add(1, memory_order_release);
+                }
+                m_job_cv.notify_all();
+                process_items();
+                // wait for all threads to leave the job so that it can be safely replaced by next one
+                for (int spin = 0; m_pending.load(memory_order_acquire) != 0; ++spin) {
+                        if (spin >= m_spin_max) {
+                                unique_lock<mutex> lk(m_lock);
+                                m_done_cv.wait(lk, [this]{ return m_pending.load(memory_order_acquire) == 0; });
+                                break;
+                        }
+                }
+                return true;
+        }
+private:
+        static constexpr int SPIN_MAX = 4096;
+        void process_items() {
+                int i;
+                while ((i = m_next.fetch_add(1, memory_order_relaxed)) < m_count) {
+                        void *ret = m_task(m_data + i * m_data_size);
+                        if (m_res != nullptr) {
+                                m_res[i] = ret;
+                        }
+                }
+        }
+        void run(int cpu) {
+                set_thread_name("conv_worker");
+                pin_to_cpu(cpu);
+                unsigned long generation = 0;
+                while (true) {
+                        for (int spin = 0; m_generation.load(memory_order_acquire) == generation; ++spin) {
+                                if (spin >= m_spin_max) {
+                                        unique_lock<mutex> lk(m_lock);
+                                        m_job_cv.wait(lk, [&]{ return m_generation.load(memory_order_acquire) != generation; });
+                                        break;
+                                }
+                        }
+                        generation = m_generation.load(memory_order_acquire);
+                        if (m_exit) {
+                                return;
+                        }
+                        process_items();
+                        if (m_pending.fetch_sub(1, memory_order_acq_rel) == 1) {
+                                unique_lock<mutex> lk(m_lock); // pairs with the wait in run_job
+                                m_done_cv.notify_one();
+                        }
+                }
+        }
+        static void pin_to_cpu(int cpu) {
+#ifdef HAVE_LINUX
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                CPU_SET(cpu % get_cpu_core_count(), &set);
+                pthread_setaffinity_np(pthread_self(), sizeof set, &set);
+#else
+                (void) cpu;
+#endif
+        }
+
+        const int m_spin_max;
+        vector<thread> m_threads;
+        mutex m_job_lock; ///< one job at a time
+        mutex m_lock;
+        condition_variable m_job_cv;
+        condition_variable m_done_cv;
+        atomic<unsigned long> m_generation{0};
+        bool m_exit = false;
+
+        runnable_t m_task = nullptr;
+        char *m_data = nullptr;
+        size_t m_data_size = 0;
+        void **m_res = nullptr;
+        int m_count = 0;
+        atomic<int> m_next{0};
+        atomic<size_t> m_pending{0}; ///< threads that haven't finished current job yet
+};
+
+/**
+ * Same as task_run_parallel() but runs the tasks in a persistent pool of
+ * CPU-pinned threads (the calling thread participates). Suitable for
+ * short jobs repeated every frame, like pixel format conversions. If the pool
+ * is currently used (eg. by other thread), falls back to task_run_parallel().
+ */
+void task_run_parallel_pinned(runnable_t task, int worker_count, void *data, size_t data_size, void **res)
+{
+        static pinned_pool pool;
+        if (worker_count == 1 || !pool.run_job(task, worker_count, data, data_size, res)) {
+                task_run_parallel(task, worker_count, data, data_size, res);
+        }
+}
+
 struct respawn_parallel_data {
         respawn_parallel_callback_t c;
         void *in;
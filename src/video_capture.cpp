@@ -61,7 +61,10 @@
 #include "debug.h"
 #include "lib_common.h"
 #include "module.h"
+#include "utils/frame_trace.h"
+#include "utils/metrics.h"
 #include "utils/config_file.h"
+#include "utils/probe_cache.hpp"
 #include "video_capture.h"
 
 #include <string>
@@ -93,41 +96,41 @@ void print_available_capturers()
         const auto & vidcaps = get_libraries_for_class(LIBRARY_CLASS_VIDEO_CAPTURE, VIDEO_CAPTURE_ABI_VERSION);
         for (auto && item : vidcaps) {
                 auto vci = static_cast<const struct video_capture_info *>(item.second);
-
-                void (*deleter)(void *) = nullptr;
-                struct vidcap_type *vt = vci->probe(true, &deleter);
-                if (vt == nullptr) {
-                        continue;
-                }
-                std::cout << "[cap][capture] " << item.first << "\n";
-                for (int i = 0; i < vt->card_count; ++i) {
-                        std::cout << "[capability][device] {"
-                                "\"purpose\":\"video_cap\", "
-                                "\"module\":" << std::quoted(vt->name) << ", "
-                                "\"device\":" << std::quoted(vt->cards[i].dev) << ", "
-                                "\"name\":" << std::quoted(vt->cards[i].name) << ", "
-                                "\"extra\": {" << vt->cards[i].extra << "}, "
-                                "\"modes\": [";
-                        for (unsigned int j = 0; j < sizeof vt->cards[i].modes
-                                        / sizeof vt->cards[i].modes[0]; j++) {
-                                if (vt->cards[i].modes[j].id[0] == '\0') { // last item
-                                        break;
-                                }
-                                if (j > 0) {
-                                        printf(", ");
-                                }
-                                std::cout << "{\"name\":" << std::quoted(vt->cards[i].modes[j].name) << ", "
-                                        "\"opts\":" << vt->cards[i].modes[j].id << "}";
+                std::cout << probe_cache_get("video_cap." + item.first, [&](std::ostream &out) {
+                        void (*deleter)(void *) = nullptr;
+                        struct vidcap_type *vt = vci->probe(true, &deleter);
+                        if (vt == nullptr) {
+                                return;
                         }
+                        out << "[cap][capture] " << item.first << "\n";
+                        for (int i = 0; i < vt->card_count; ++i) {
+                                out << "[capability][device] {"
+                                        "\"purpose\":\"video_cap\", "
+                                        "\"module\":" << std::quoted(vt->name) << ", "
+                                        "\"device\":" << std::quoted(vt->cards[i].dev) << ", "
+                                        "\"name\":" << std::quoted(vt->cards[i].name) << ", "
+                                        "\"extra\": {" << vt->cards[i].extra << "}, "
+                                        "\"modes\": [";
+                                for (unsigned int j = 0; j < sizeof vt->cards[i].modes
+                                                / sizeof vt->cards[i].modes[0]; j++) {
+                                        if (vt->cards[i].modes[j].id[0] == '\0') { // last item
+                                                break;
+                                        }
+                                        if (j > 0) {
+                                                out << ", ";
+                                        }
+                                        out << "{\"name\":" << std::quoted(vt->cards[i].modes[j].name) << ", "
+                                                "\"opts\":" << vt->cards[i].modes[j].id << "}";
+                                }
 
-                        std::cout << "]}\n";
-                }
-                if(!deleter)
-                        deleter = free;
-
-                deleter(vt->cards);
-                deleter(vt);
+                                out << "]}\n";
+                        }
+                        if(!deleter)
+                                deleter = free;
 
+                        deleter(vt->cards);
+                        deleter(vt);
+                });
         }
 
         char buf[1024] = "";
@@ -184,8 +187,23 @@ int initialize_video_capture(struct module *parent,
         d->mod.cls = MODULE_CLASS_CAPTURE;
         module_register(&d->mod, parent);
 
+        // filters are created first so that the driver gets the decimation hint
+        int ret = capture_filter_init(&d->mod, vidcap_params_get_capture_filter(param),
+                &d->capture_filter);
+        if (ret < 0) {
+                log_msg(LOG_LEVEL_ERROR, "Unable to initialize capture filter: %s.\n",
+                        vidcap_params_get_capture_filter(param));
+        }
+
+        if (ret != 0) {
+                module_done(&d->mod);
+                free(d);
+                return ret;
+        }
+
         vidcap_params_set_parent(param, &d->mod);
-        int ret = vci->init(param, &d->state);
+        vidcap_params_set_decimation(param, capture_filter_get_decimation(d->capture_filter));
+        ret = vci->init(param, &d->state);
 
         switch (ret) {
         case VIDCAP_INIT_OK:
@@ -203,22 +221,16 @@ int initialize_video_capture(struct module *parent,
                 break;
         }
         if (ret != 0) {
+                capture_filter_destroy(d->capture_filter);
                 module_done(&d->mod);
                 free(d);
                 return ret;
         }
 
-        ret = capture_filter_init(&d->mod, vidcap_params_get_capture_filter(param),
-                &d->capture_filter);
-        if (ret < 0) {
-                log_msg(LOG_LEVEL_ERROR, "Unable to initialize capture filter: %s.\n",
-                        vidcap_params_get_capture_filter(param));
-        }
-
-        if (ret != 0) {
-                module_done(&d->mod);
-                free(d);
-                return ret;
+        if (vidcap_params_decimation_accepted(param)) {
+                log_msg(LOG_LEVEL_INFO, "Capture delivers only every %d. frame.\n",
+                                vidcap_params_get_decimation(param));
+                capture_filter_set_decimated_upstream(d->capture_filter);
         }
 
         *state = d;
@@ -253,8 +265,18 @@ struct video_frame *vidcap_grab(struct vidcap *state, struct audio_frame **audio
         assert(state->magic == VIDCAP_MAGIC);
         struct video_frame *frame;
         frame = state->funcs->grab(state->state, audio);
-        if (frame != NULL)
+        if (frame != NULL) {
+                static struct metric *frames = metric_counter("ug_capture_frames", "Video frames captured", nullptr);
+                metric_add(frames, 1);
+                // the frame may be reused by the driver or replaced by a filter
+                struct frame_trace trace = {};
+                frame_trace_stamp(&trace, FT_CAPTURE);
                 frame = capture_filter(state->capture_filter, frame);
+                if (frame != NULL) {
+                        frame->trace = trace;
+                        frame_trace_stamp(&frame->trace, FT_FILTER);
+                }
+        }
         return frame;
 }
 
@@ -43,6 +43,7 @@
 #include "debug.h"
 #include "host.h"
 #include "lib_common.h"
+#include "utils/thread.h"
 #include "video.h"
 #include "video_capture.h"
 
@@ -50,8 +51,17 @@
 
 #include "audio/types.h"
 
+#include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#define MOD_NAME "[aggregate] "
+#define AGG_QUEUE_LEN 3 ///< max frames queued per device, oldest are dropped
+#define AGG_GRAB_TIMEOUT_MS 100
+#define AGG_DEFAULT_SKEW_NS (20 * NS_IN_SEC / 1000) ///< skew if FPS is not known
+#define AGG_MAX_AUDIO_SEC 2 ///< max audio buffered between grabs
 
 /* prototypes of functions defined in this module */
 static void show_help(void);
@@ -60,21 +70,55 @@ static void show_help()
 {
         printf("Aggregate capture\n");
         printf("Usage\n");
-        printf("\t-t aggregate -t <dev1_config> -t <dev2_config> ....]\n");
+        printf("\t-t aggregate[:skew=<ms>] -t <dev1_config> -t <dev2_config> ....]\n");
         printf("\t\twhere devn_config is a complete configuration string of device involved in an aggregate device\n");
+        printf("\t\tskew - max difference of capture times of frames of one tile set (default half of frame time)\n");
+        printf("\n\tThe devices are grabbed in parallel, each one by its own thread.\n");
 
 }
 
+struct aggregate_queued_frame {
+        struct video_frame *frame;
+        time_ns_t           ts; ///< time when the frame was grabbed
+};
+
+struct vidcap_aggregate_state;
+
+struct aggregate_device {
+        struct vidcap_aggregate_state *parent;
+        int                 index;
+        struct vidcap      *device;
+        pthread_t           thread;
+        bool                thread_started;
+
+        struct aggregate_queued_frame queue[AGG_QUEUE_LEN];
+        int                 queue_len;
+        /// last frame of the device has no dispose callback (its data are
+        /// valid only until next vidcap_grab()) and it is either queued or
+        /// used in an output frame - the device must not be grabbed until
+        /// the frame is dropped or released
+        bool                blocked;
+};
+
 struct vidcap_aggregate_state {
-        struct vidcap     **devices;
+        struct aggregate_device *devices;
         int                 devices_cnt;
 
+        pthread_mutex_t     lock;
+        pthread_cond_t      frame_ready;    ///< signalized by grabbing threads
+        pthread_cond_t      frame_released; ///< signalized to blocked grabbing threads
+        bool                should_exit_threads;
+        time_ns_t           skew_ns; ///< -1 - half of frame time
+
         struct video_frame      **captured_frames;
         struct video_frame       *frame; 
         int frames;
+        int dropped;
         struct       timeval t, t0;
 
         int          audio_source_index;
+        struct audio_frame audio_acc; ///< accumulated from the source device
+        struct audio_frame audio_out; ///< returned from grab, valid until next one
 };
 
 
@@ -93,6 +137,99 @@ vidcap_aggregate_probe(bool verbose, void (**deleter)(void *))
 	return vt;
 }
 
+/// @note called with s->lock locked
+static void aggregate_append_audio(struct vidcap_aggregate_state *s, const struct audio_frame *audio)
+{
+        struct audio_frame *acc = &s->audio_acc;
+        if (acc->bps != audio->bps || acc->ch_count != audio->ch_count ||
+                        acc->sample_rate != audio->sample_rate) {
+                acc->bps = audio->bps;
+                acc->ch_count = audio->ch_count;
+                acc->sample_rate = audio->sample_rate;
+                acc->data_len = 0;
+        }
+        const int max_len = AGG_MAX_AUDIO_SEC * audio->sample_rate * audio->ch_count * audio->bps;
+        if (acc->data_len + audio->data_len > max_len) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Audio not grabbed, dropping.\n");
+                acc->data_len = 0;
+        }
+        if (acc->data_len + audio->data_len > acc->max_size) {
+                acc->max_size = acc->data_len + audio->data_len;
+                acc->data = realloc(acc->data, acc->max_size);
+        }
+        memcpy(acc->data + acc->data_len, audio->data, audio->data_len);
+        acc->data_len += audio->data_len;
+}
+
+/// @note called with s->lock locked
+static void aggregate_drop_head(struct aggregate_device *d)
+{
+        struct video_frame *frame = d->queue[0].frame;
+        if (frame->callbacks.dispose) {
+                VIDEO_FRAME_DISPOSE(frame);
+        } else {
+                d->blocked = false;
+                pthread_cond_broadcast(&d->parent->frame_released);
+        }
+        memmove(d->queue, d->queue + 1, (d->queue_len - 1) * sizeof d->queue[0]);
+        d->queue_len -= 1;
+}
+
+static void *aggregate_grab_thread(void *arg)
+{
+        set_thread_name("aggregate_grab");
+        struct aggregate_device *d = arg;
+        struct vidcap_aggregate_state *s = d->parent;
+
+        while (true) {
+                pthread_mutex_lock(&s->lock);
+                while (d->blocked && !s->should_exit_threads) {
+                        pthread_cond_wait(&s->frame_released, &s->lock);
+                }
+                bool exit_thread = s->should_exit_threads;
+                pthread_mutex_unlock(&s->lock);
+                if (exit_thread) {
+                        break;
+                }
+
+                struct audio_frame *audio = NULL;
+                struct video_frame *frame = vidcap_grab(d->device, &audio);
+                const time_ns_t ts = get_time_in_ns();
+
+                pthread_mutex_lock(&s->lock);
+                if (audio != NULL) {
+                        if (s->audio_source_index == -1) {
+                                log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Locking device #%d as an audio source.\n",
+                                                d->index);
+                                s->audio_source_index = d->index;
+                        }
+                        if (s->audio_source_index == d->index) {
+                                aggregate_append_audio(s, audio);
+                        }
+                }
+                if (frame != NULL) {
+                        if (d->queue_len == AGG_QUEUE_LEN) {
+                                aggregate_drop_head(d);
+                                s->dropped += 1;
+                        }
+                        d->queue[d->queue_len].frame = frame;
+                        d->queue[d->queue_len].ts = ts;
+                        d->queue_len += 1;
+                        if (!frame->callbacks.dispose) {
+                                d->blocked = true;
+                        }
+                        pthread_cond_signal(&s->frame_ready);
+                }
+                pthread_mutex_unlock(&s->lock);
+                AUDIO_FRAME_DISPOSE(audio);
+        }
+
+        return NULL;
+}
+
+static void
+vidcap_aggregate_done(void *state);
+
 static int
 vidcap_aggregate_init(struct vidcap_params *params, void **state)
 {
@@ -108,13 +245,33 @@ vidcap_aggregate_init(struct vidcap_params *params, void **state)
 	}
 
         s->audio_source_index = -1;
+        s->skew_ns = -1;
         s->frames = 0;
         gettimeofday(&s->t0, NULL);
+        pthread_mutex_init(&s->lock, NULL);
+        pthread_cond_init(&s->frame_ready, NULL);
+        pthread_cond_init(&s->frame_released, NULL);
 
         if(vidcap_params_get_fmt(params) && strcmp(vidcap_params_get_fmt(params), "") != 0) {
-                show_help();
-                free(s);
-                return VIDCAP_INIT_NOERR;
+                char *fmt = strdup(vidcap_params_get_fmt(params));
+                char *save_ptr = NULL;
+                char *item = NULL;
+                char *tmp = fmt;
+                bool help = false;
+                while ((item = strtok_r(tmp, ":", &save_ptr)) != NULL) {
+                        tmp = NULL;
+                        if (strncmp(item, "skew=", strlen("skew=")) == 0) {
+                                s->skew_ns = (time_ns_t) (atof(item + strlen("skew=")) * NS_IN_SEC / 1000);
+                        } else {
+                                help = true;
+                        }
+                }
+                free(fmt);
+                if (help) {
+                        show_help();
+                        vidcap_aggregate_done(s);
+                        return VIDCAP_INIT_NOERR;
+                }
         }
 
 
@@ -127,12 +284,15 @@ vidcap_aggregate_init(struct vidcap_params *params, void **state)
                         break;
         }
 
-        s->devices = calloc(s->devices_cnt, sizeof(struct vidcap *));
+        s->devices = calloc(s->devices_cnt, sizeof(struct aggregate_device));
+        s->captured_frames = calloc(s->devices_cnt, sizeof(struct video_frame *));
         tmp = params;
         for (int i = 0; i < s->devices_cnt; ++i) {
                 tmp = vidcap_params_get_next(tmp);
 
-                int ret = initialize_video_capture(NULL, (struct vidcap_params *) tmp, &s->devices[i]);
+                s->devices[i].parent = s;
+                s->devices[i].index = i;
+                int ret = initialize_video_capture(NULL, (struct vidcap_params *) tmp, &s->devices[i].device);
                 if(ret != 0) {
                         fprintf(stderr, "[aggregate] Unable to initialize device %d (%s:%s).\n",
                                         i, vidcap_params_get_driver(tmp),
@@ -141,23 +301,21 @@ vidcap_aggregate_init(struct vidcap_params *params, void **state)
                 }
         }
 
-        s->captured_frames = calloc(s->devices_cnt, sizeof(struct video_frame *));
-
         s->frame = vf_alloc(s->devices_cnt);
+
+        for (int i = 0; i < s->devices_cnt; ++i) {
+                if (pthread_create(&s->devices[i].thread, NULL, aggregate_grab_thread, &s->devices[i]) != 0) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unable to create grabbing thread!\n");
+                        goto error;
+                }
+                s->devices[i].thread_started = true;
+        }
         
         *state = s;
 	return VIDCAP_INIT_OK;
 
 error:
-        if(s->devices) {
-                int i;
-                for (i = 0u; i < s->devices_cnt; ++i) {
-                        if(s->devices[i]) {
-                                 vidcap_done(s->devices[i]);
-                        }
-                }
-        }
-        free(s);
+        vidcap_aggregate_done(s);
         return VIDCAP_INIT_FAIL;
 }
 
@@ -168,47 +326,129 @@ vidcap_aggregate_done(void *state)
 
 	assert(s != NULL);
 
-	if (s != NULL) {
-                int i;
-		for (i = 0; i < s->devices_cnt; ++i) {
-                         vidcap_done(s->devices[i]);
-		}
-	}
-        
+        pthread_mutex_lock(&s->lock);
+        s->should_exit_threads = true;
+        pthread_cond_broadcast(&s->frame_released);
+        pthread_mutex_unlock(&s->lock);
+
+        for (int i = 0; i < s->devices_cnt; ++i) {
+                struct aggregate_device *d = &s->devices[i];
+                if (d->thread_started) {
+                        pthread_join(d->thread, NULL);
+                }
+                VIDEO_FRAME_DISPOSE(s->captured_frames[i]);
+                while (d->queue_len > 0) {
+                        aggregate_drop_head(d);
+                }
+                if (d->device) {
+                        vidcap_done(d->device);
+                }
+        }
+
+        pthread_cond_destroy(&s->frame_released);
+        pthread_cond_destroy(&s->frame_ready);
+        pthread_mutex_destroy(&s->lock);
         vf_free(s->frame);
+        free(s->captured_frames);
+        free(s->devices);
+        free(s->audio_acc.data);
+        free(s->audio_out.data);
+        free(s);
+}
+
+/**
+ * Drops queued frames so that the oldest frames of all devices are within the
+ * skew tolerance from the newest of them.
+ *
+ * @note called with s->lock locked
+ * @retval true every device has a frame matching the others at queue head
+ */
+static bool aggregate_sync_heads(struct vidcap_aggregate_state *s)
+{
+        bool dropped_any;
+        do {
+                dropped_any = false;
+                time_ns_t newest = 0;
+                for (int i = 0; i < s->devices_cnt; ++i) {
+                        if (s->devices[i].queue_len == 0) {
+                                return false;
+                        }
+                        newest = MAX(newest, s->devices[i].queue[0].ts);
+                }
+                time_ns_t skew = s->skew_ns;
+                if (skew < 0) {
+                        const double fps = s->devices[0].queue[0].frame->fps;
+                        skew = fps > 0.0 ? (time_ns_t) (NS_IN_SEC_DBL / fps / 2) : AGG_DEFAULT_SKEW_NS;
+                }
+                for (int i = 0; i < s->devices_cnt; ++i) {
+                        struct aggregate_device *d = &s->devices[i];
+                        while (d->queue_len > 0 && d->queue[0].ts < newest - skew) {
+                                aggregate_drop_head(d);
+                                s->dropped += 1;
+                                dropped_any = true;
+                        }
+                }
+        } while (dropped_any);
+        return true;
 }
 
 static struct video_frame *
 vidcap_aggregate_grab(void *state, struct audio_frame **audio)
 {
 	struct vidcap_aggregate_state *s = (struct vidcap_aggregate_state *) state;
-        struct audio_frame *audio_frame = NULL;
         struct video_frame *frame = NULL;
 
+        pthread_mutex_lock(&s->lock);
         for (int i = 0; i < s->devices_cnt; ++i) {
-                VIDEO_FRAME_DISPOSE(s->captured_frames[i]);
+                if (s->captured_frames[i] == NULL) {
+                        continue;
+                }
+                if (s->captured_frames[i]->callbacks.dispose) {
+                        VIDEO_FRAME_DISPOSE(s->captured_frames[i]);
+                } else {
+                        s->devices[i].blocked = false;
+                }
+                s->captured_frames[i] = NULL;
         }
+        pthread_cond_broadcast(&s->frame_released);
 
         *audio = NULL;
+        if (s->audio_acc.data_len > 0) {
+                struct audio_frame tmp = s->audio_out;
+                s->audio_out = s->audio_acc;
+                s->audio_acc = tmp;
+                s->audio_acc.data_len = 0;
+                *audio = &s->audio_out;
+        }
 
-        for (int i = 0; i < s->devices_cnt; ++i) {
-                frame = NULL;
-                while(!frame) {
-                        frame = vidcap_grab(s->devices[i], &audio_frame);
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += AGG_GRAB_TIMEOUT_MS * 1000 * 1000;
+        deadline.tv_sec += deadline.tv_nsec / NS_IN_SEC;
+        deadline.tv_nsec %= NS_IN_SEC;
+        while (!aggregate_sync_heads(s)) {
+                if (pthread_cond_timedwait(&s->frame_ready, &s->lock, &deadline) == ETIMEDOUT) {
+                        pthread_mutex_unlock(&s->lock);
+                        return NULL;
                 }
+        }
+
+        for (int i = 0; i < s->devices_cnt; ++i) {
+                struct aggregate_device *d = &s->devices[i];
+                frame = d->queue[0].frame;
+                memmove(d->queue, d->queue + 1, (d->queue_len - 1) * sizeof d->queue[0]);
+                d->queue_len -= 1;
+                s->captured_frames[i] = frame;
+        }
+        pthread_mutex_unlock(&s->lock);
+
+        for (int i = 0; i < s->devices_cnt; ++i) {
+                frame = s->captured_frames[i];
                 if (i == 0) {
                         s->frame->color_spec = frame->color_spec;
                         s->frame->interlacing = frame->interlacing;
                         s->frame->fps = frame->fps;
                 }
-                if (s->audio_source_index == -1 && audio_frame != NULL) {
-                        fprintf(stderr, "[aggregate] Locking device #%d as an audio source.\n",
-                                        i);
-                        s->audio_source_index = i;
-                }
-                if (s->audio_source_index == i) {
-                        *audio = audio_frame;
-                }
                 if (frame->color_spec != s->frame->color_spec ||
                                 frame->fps != s->frame->fps ||
                                 frame->interlacing != s->frame->interlacing) {
@@ -227,16 +467,17 @@ vidcap_aggregate_grab(void *state, struct audio_frame **audio)
                 vf_get_tile(s->frame, i)->height = vf_get_tile(frame, 0)->height;
                 vf_get_tile(s->frame, i)->data_len = vf_get_tile(frame, 0)->data_len;
                 vf_get_tile(s->frame, i)->data = vf_get_tile(frame, 0)->data;
-                s->captured_frames[i] = frame;
         }
         s->frames++;
         gettimeofday(&s->t, NULL);
         double seconds = tv_diff(s->t, s->t0);    
         if (seconds >= 5) {
             float fps  = s->frames / seconds;
-            log_msg(LOG_LEVEL_INFO, "[aggregate cap.] %d frames in %g seconds = %g FPS\n", s->frames, seconds, fps);
+            log_msg(LOG_LEVEL_INFO, "[aggregate cap.] %d frames in %g seconds = %g FPS (%d dropped to synchronize)\n",
+                            s->frames, seconds, fps, s->dropped);
             s->t0 = s->t;
             s->frames = 0;
+            s->dropped = 0;
         }  
 
 	return s->frame;
@@ -251,4 +492,3 @@ static const struct video_capture_info vidcap_aggregate_info = {
 };
 
 REGISTER_MODULE(aggregate, &vidcap_aggregate_info, LIBRARY_CLASS_VIDEO_CAPTURE, VIDEO_CAPTURE_ABI_VERSION);
-
@@ -41,6 +41,7 @@
 #endif
 
 #include "debug.h"
+#include "hwaccel_videotoolbox.h"
 #include "lib_common.h"
 #include "video.h"
 #include "video_capture.h"
@@ -102,6 +103,7 @@ using std::chrono::milliseconds;
 	chrono::steady_clock::time_point m_t0;
         double m_fps_req;
 	int m_frames;
+        bool m_hwframes; ///< pass IOSurface-backed buffers as HW_VTB
 }
 
 - (void)captureOutput:(AVCaptureOutput *)captureOutput didOutputSampleBuffer:(CMSampleBufferRef)sampleBuffer
@@ -117,8 +119,10 @@ fromConnection:(AVCaptureConnection *)connection;
 + (void)usage: (BOOL) verbose
 {
         cout << "AV Foundation capture usage:" << "\n";
-        cout << "\t-t avfoundation[:device=<dev>][:preset=<preset>][:mode=<mode>[:fps=<fps>|:fr_idx=<fr_idx>]]" << "\n";
+        cout << "\t-t avfoundation[:device=<dev>][:preset=<preset>][:mode=<mode>[:fps=<fps>|:fr_idx=<fr_idx>]][:hwframes]" << "\n";
         cout << "\n";
+        cout << "hwframes - pass captured IOSurface-backed NV12 buffers without copying (HW_VTB),\n"
+                "           to be encoded with a VideoToolbox encoder (eg. \"-c lavc:encoder=h264_videotoolbox\")\n";
         cout << "<fps> is a number of frames per second (can be a number with a decimal point)\n";
         cout << "<fr_idx> is index of frame rate obtained from '-t avfoundation:fullhelp'\n";
         cout << "\n";
@@ -130,6 +134,7 @@ fromConnection:(AVCaptureConnection *)connection;
         cout << "\t-t avfoundation:preset=high" << "\n";
         cout << "\t-t avfoundation:device=0:preset=high" << "\n";
         cout << "\t-t avfoundation:device=0:mode=24:fps=30 (advanced)" << "\n";
+        cout << "\t-t avfoundation:hwframes -c lavc:encoder=hevc_videotoolbox" << "\n";
         cout << "\n";
         cout << "Available AV foundation capture devices and modes:" << "\n";
         cout << "(Type -t avfoundation:fullhelp to see available framerates)" << "\n\n";
@@ -186,6 +191,7 @@ static void (^cb)(BOOL) = ^void(BOOL granted) {
 	m_t0 = chrono::steady_clock::now();
 	m_frames = 0;
         m_fps_req = 0.0;
+        m_hwframes = [params valueForKey:@"hwframes"] != nil;
 
 #ifdef __MAC_10_14
         AVAuthorizationStatus authorization_status = [AVCaptureDevice authorizationStatusForMediaType:AVMediaTypeVideo];
@@ -259,7 +265,7 @@ static void (^cb)(BOOL) = ^void(BOOL granted) {
 #endif
 
         // check if all options we get are recognized
-        id objects[] = { @"device", @"mode", @"fps", @"fr_idx", @"preset"};
+        id objects[] = { @"device", @"mode", @"fps", @"fr_idx", @"preset", @"hwframes"};
         NSUInteger count = sizeof(objects) / sizeof(id);
         NSArray *knownKeys = [NSArray arrayWithObjects:objects
                 count:count];
@@ -354,6 +360,14 @@ static void (^cb)(BOOL) = ^void(BOOL granted) {
                 m_session.sessionPreset = preset;
         }
 
+        if (m_hwframes) {
+                // let the capture pipeline deliver buffers VideoToolbox can consume directly
+                output.videoSettings = @{
+                        (id) kCVPixelBufferPixelFormatTypeKey: @(kCVPixelFormatType_420YpCbCr8BiPlanarVideoRange),
+                        (id) kCVPixelBufferIOSurfacePropertiesKey: @{},
+                };
+        }
+
 	// set device frame rate also to capture output to prevent rate oscilation
         AVCaptureConnection *conn = [output connectionWithMediaType: AVMediaTypeVideo];
         if (conn.isVideoMinFrameDurationSupported)
@@ -415,6 +429,10 @@ fromConnection:(AVCaptureConnection *)connection
 	CMTime dur = CMSampleBufferGetOutputDuration(sampleBuffer);
 	FourCharCode fcc = CMFormatDescriptionGetMediaSubType(videoDesc);
 
+        if (m_hwframes) {
+                return [self hwFrameFromSampleBuffer: sampleBuffer dimensions: dim duration: dur];
+        }
+
 	auto codec_it = av_to_uv.find(fcc);
 	if (codec_it == av_to_uv.end()) {
 		NSLog(@"Unhandled codec: %.4s!\n", (const char *) &fcc);
@@ -469,6 +487,40 @@ fromConnection:(AVCaptureConnection *)connection
 	return ret;
 }
 
+/**
+ * Wraps the sample's pixel buffer to a HW_VTB frame. The buffer is only
+ * retained, not locked nor copied - it is passed as it is to VideoToolbox.
+ */
+- (struct video_frame *) hwFrameFromSampleBuffer:(CMSampleBufferRef) sampleBuffer
+        dimensions:(CMVideoDimensions) dim duration:(CMTime) dur
+{
+        CVImageBufferRef imageBuffer = CMSampleBufferGetImageBuffer(sampleBuffer);
+        if (imageBuffer == NULL || CVPixelBufferGetIOSurface(imageBuffer) == NULL) {
+                LOG(LOG_LEVEL_ERROR) << "[AVFoundation] Captured buffer is not IOSurface-backed, cannot pass it as HW_VTB!\n";
+                return NULL;
+        }
+
+        struct video_desc desc{};
+        desc.color_spec = HW_VTB;
+        desc.width = dim.width;
+        desc.height = dim.height;
+        desc.fps = m_fps_req != 0 ? m_fps_req : 1.0 / CMTimeGetSeconds(dur);
+        desc.tile_count = 1;
+        desc.interlacing = PROGRESSIVE;
+
+        struct video_frame *ret = vf_alloc_desc(desc);
+        ret->tiles[0].data_len = sizeof(hw_vtb_frame);
+        ret->tiles[0].data = (char *) malloc(sizeof(hw_vtb_frame));
+        ((hw_vtb_frame *)(void *) ret->tiles[0].data)->pixbuf = (CVPixelBufferRef) CFRetain(imageBuffer);
+        ret->callbacks.data_deleter = vf_data_deleter;
+        static auto dispose = [](struct video_frame *frame) {
+                CFRelease(((hw_vtb_frame *)(void *) frame->tiles[0].data)->pixbuf);
+                vf_free(frame);
+        };
+        ret->callbacks.dispose = dispose;
+        return ret;
+}
+
 - (struct video_frame *) grab
 {
         unique_lock<mutex> lock(m_lock);
@@ -53,12 +53,14 @@
 #include "config_win32.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <condition_variable>
 #include <chrono>
 #include <iostream>
 #include <iomanip>
 #include <list>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <queue>
@@ -74,6 +76,7 @@
 #include "rang.hpp"
 #include "tv.h"
 #include "utils/color_out.h"
+#include "utils/video_frame_pool.h"
 #include "video.h"
 #include "video_capture.h"
 
@@ -86,6 +89,7 @@ constexpr const size_t MAX_AUDIO_PACKETS = 10;
 #endif
 
 #define RELEASE_IF_NOT_NULL(x) if (x != nullptr) { x->Release(); x = nullptr; }
+#define HUGEPAGES_PARAM "decklink-capture-hugepages"
 
 using namespace std;
 using namespace std::chrono;
@@ -135,12 +139,92 @@ using std::mutex;
 
 class VideoDelegate;
 
+/**
+ * Memory allocator for SDK input frames taking the buffers from
+ * video_frame_pool_allocator (eg. huge pages). Released buffers are kept
+ * for reuse until the buffer size changes or Decommit() is called.
+ */
+class DeckLinkFrameAllocator : public IDeckLinkMemoryAllocator {
+public:
+        explicit DeckLinkFrameAllocator(video_frame_pool_allocator const &alloc) : m_alloc(alloc.clone()) {
+        }
+        virtual ~DeckLinkFrameAllocator() {
+                Decommit();
+        }
+        virtual HRESULT STDMETHODCALLTYPE QueryInterface(REFIID, LPVOID *) override { return E_NOINTERFACE; }
+        virtual ULONG STDMETHODCALLTYPE AddRef() override {
+                return ++m_refCount;
+        }
+        virtual ULONG STDMETHODCALLTYPE Release() override {
+                ULONG ret = --m_refCount;
+                if (ret == 0) {
+                        delete this;
+                }
+                return ret;
+        }
+        virtual HRESULT STDMETHODCALLTYPE AllocateBuffer(uint32_t bufferSize, void **allocatedBuffer) override {
+                unique_lock<mutex> lk(m_lock);
+                if (bufferSize != m_bufferSize) {
+                        free_cached();
+                        m_bufferSize = bufferSize;
+                }
+                if (!m_free.empty()) {
+                        *allocatedBuffer = m_free.back();
+                        m_free.pop_back();
+                        return S_OK;
+                }
+                *allocatedBuffer = m_alloc->allocate(bufferSize);
+                if (*allocatedBuffer == nullptr) {
+                        return E_OUTOFMEMORY;
+                }
+                m_sizes[*allocatedBuffer] = bufferSize;
+                return S_OK;
+        }
+        virtual HRESULT STDMETHODCALLTYPE ReleaseBuffer(void *buffer) override {
+                unique_lock<mutex> lk(m_lock);
+                auto it = m_sizes.find(buffer);
+                if (it == m_sizes.end()) {
+                        return E_INVALIDARG;
+                }
+                if (it->second == m_bufferSize) {
+                        m_free.push_back(buffer);
+                } else {
+                        m_alloc->deallocate(buffer);
+                        m_sizes.erase(it);
+                }
+                return S_OK;
+        }
+        virtual HRESULT STDMETHODCALLTYPE Commit() override {
+                return S_OK;
+        }
+        virtual HRESULT STDMETHODCALLTYPE Decommit() override {
+                unique_lock<mutex> lk(m_lock);
+                free_cached();
+                return S_OK;
+        }
+private:
+        void free_cached() {
+                for (void *buf : m_free) {
+                        m_alloc->deallocate(buf);
+                        m_sizes.erase(buf);
+                }
+                m_free.clear();
+        }
+        unique_ptr<video_frame_pool_allocator> m_alloc;
+        atomic<ULONG>           m_refCount{1};
+        mutex                   m_lock;
+        uint32_t                m_bufferSize{};
+        vector<void *>          m_free;
+        map<void *, uint32_t>   m_sizes;
+};
+
 struct device_state {
         IDeckLink                  *deckLink              = nullptr;
         IDeckLinkInput             *deckLinkInput         = nullptr;
         unique_ptr<VideoDelegate>  delegate;
         IDeckLinkProfileAttributes *deckLinkAttributes    = nullptr;
         IDeckLinkConfiguration     *deckLinkConfiguration = nullptr;
+        DeckLinkFrameAllocator     *allocator             = nullptr;
         string                      device_id = "0"; // either numeric value or device name
 };
 
@@ -345,7 +429,6 @@ VideoDelegate::VideoInputFrameArrived (IDeckLinkVideoInputFrame *videoFrame, IDe
         }
 
         if (videoFrame && newFrameReady && (!nosig || !lastFrame)) {
-                /// @todo videoFrame should be actually retained until the data are processed
                 videoFrame->GetBytes(&pixelFrame);
 
                 RELEASE_IF_NOT_NULL(lastFrame);
@@ -1036,6 +1119,8 @@ static bool decklink_cap_configure_audio(struct vidcap_decklink_state *s, unsign
         return true;
 }
 
+ADD_TO_PARAM(HUGEPAGES_PARAM, "* " HUGEPAGES_PARAM "\n"
+                "  Let the SDK capture to buffers allocated from huge pages.\n");
 static int
 vidcap_decklink_init(struct vidcap_params *params, void **state)
 {
@@ -1195,6 +1280,14 @@ vidcap_decklink_init(struct vidcap_params *params, void **state)
                         CALL_AND_CHECK(deckLinkConfiguration->SetFlag(bmdDeckLinkConfigCapture1080pAsPsF, s->use1080psf != 0), "Unable to set output as PsF");
                 }
 
+                if (auto alloc = get_configured_frame_pool_allocator("capture")) {
+                        s->state[i].allocator = new DeckLinkFrameAllocator(*alloc);
+                        CALL_AND_CHECK(deckLinkInput->SetVideoInputFrameMemoryAllocator(s->state[i].allocator), "SetVideoInputFrameMemoryAllocator");
+                } else if (get_commandline_param(HUGEPAGES_PARAM) != nullptr) {
+                        s->state[i].allocator = new DeckLinkFrameAllocator(hugepage_data_allocator());
+                        CALL_AND_CHECK(deckLinkInput->SetVideoInputFrameMemoryAllocator(s->state[i].allocator), "SetVideoInputFrameMemoryAllocator");
+                }
+
                 // set Callback which returns frames
                 s->state[i].delegate = make_unique<VideoDelegate>(s, i);
                 deckLinkInput->SetCallback(s->state[i].delegate.get());
@@ -1425,6 +1518,7 @@ static void cleanup_common(struct vidcap_decklink_state *s) {
                 RELEASE_IF_NOT_NULL(s->state[i].deckLinkConfiguration);
                 RELEASE_IF_NOT_NULL(s->state[i].deckLinkAttributes);
                 RELEASE_IF_NOT_NULL(s->state[i].deckLinkInput);
+                RELEASE_IF_NOT_NULL(s->state[i].allocator);
                 RELEASE_IF_NOT_NULL(s->state[i].deckLink);
         }
 
@@ -1547,6 +1641,70 @@ static audio_frame *process_new_audio_packets(struct vidcap_decklink_state *s) {
         return &s->audio;
 }
 
+static void release_captured_frame_refs(struct video_frame *f)
+{
+        auto *refs = static_cast<vector<IDeckLinkVideoFrame *> *>(f->callbacks.dispose_udata);
+        for (auto *ref : *refs) {
+                ref->Release();
+        }
+        delete refs;
+}
+
+/**
+ * Wraps the SDK buffers of last captured frames into a new video_frame
+ * without copying. The SDK frames are retained until the frame is disposed so
+ * that the SDK doesn't reuse the buffers while the frame is still being
+ * processed. Must be called with s->lock held.
+ *
+ * @returns the frame or NULL if some tile is missing
+ */
+static struct video_frame *
+retain_captured_frame(struct vidcap_decklink_state *s)
+{
+        struct video_frame *out = vf_alloc_desc(video_desc_from_frame(s->frame));
+        vf_copy_metadata(out, s->frame);
+        auto *refs = new vector<IDeckLinkVideoFrame *>();
+        out->callbacks.dispose_udata = refs;
+        out->callbacks.data_deleter = release_captured_frame_refs;
+        out->callbacks.dispose = vf_free;
+
+        auto retain = [refs](IDeckLinkVideoFrame *f) {
+                f->AddRef();
+                refs->push_back(f);
+        };
+        /* count returned tiles */
+        int count = 0;
+        if(s->stereo) {
+                VideoDelegate *delegate = s->state[0].delegate.get();
+                if (delegate->pixelFrame != NULL &&
+                                delegate->pixelFrameRight != NULL) {
+                        out->tiles[0].data = (char*)delegate->pixelFrame;
+                        out->tiles[1].data = (char*)delegate->pixelFrameRight;
+                        retain(delegate->lastFrame);
+                        retain(delegate->rightEyeFrame);
+                        ++count;
+                } // else count == 0 -> return NULL
+        } else {
+                for (int i = 0; i < s->devices_cnt; ++i) {
+                        VideoDelegate *delegate = s->state[i].delegate.get();
+                        if (delegate->pixelFrame == NULL) {
+                                break;
+                        }
+                        out->tiles[i].data = (char*)delegate->pixelFrame;
+                        retain(delegate->lastFrame);
+                        ++count;
+                }
+        }
+        for (unsigned i = 0; i < out->tile_count; ++i) {
+                out->tiles[i].data_len = s->frame->tiles[i].data_len;
+        }
+        if (count < s->devices_cnt) {
+                vf_free(out);
+                return NULL;
+        }
+        return out;
+}
+
 static struct video_frame *
 vidcap_decklink_grab(void *state, struct audio_frame **audio)
 {
@@ -1624,50 +1782,30 @@ vidcap_decklink_grab(void *state, struct audio_frame **audio)
 
         *audio = process_new_audio_packets(s); // return audio even if there is no video to avoid
                                                //  hoarding and then dropping of audio packets
+        struct video_frame *out = frame_ready ? retain_captured_frame(s) : nullptr;
 // UNLOCK - UNLOCK - UNLOCK - UNLOCK - UNLOCK - UNLOCK - UNLOCK - UNLOCK - UN //
 	lk.unlock();
 
-	if(!frame_ready)
+	if (out == nullptr)
 		return NULL;
 
-        /* count returned tiles */
-        int count = 0;
-        if(s->stereo) {
-                if (s->state[0].delegate->pixelFrame != NULL &&
-                                s->state[0].delegate->pixelFrameRight != NULL) {
-                        s->frame->tiles[0].data = (char*)s->state[0].delegate->pixelFrame;
-                        s->frame->tiles[1].data = (char*)s->state[0].delegate->pixelFrameRight;
-                        ++count;
-                } // else count == 0 -> return NULL
-        } else {
-                for (i = 0; i < s->devices_cnt; ++i) {
-                        if (s->state[i].delegate->pixelFrame == NULL) {
-                                break;
-                        }
-                        s->frame->tiles[i].data = (char*)s->state[i].delegate->pixelFrame;
-                        ++count;
-                }
-        }
-        if (count < s->devices_cnt) {
-                return NULL;
-        }
         if (s->codec == RGBA) {
-                for (unsigned i = 0; i < s->frame->tile_count; ++i) {
-                        vc_copylineToRGBA_inplace((unsigned char*) s->frame->tiles[i].data,
-                                        (unsigned char*)s->frame->tiles[i].data,
-                                        s->frame->tiles[i].data_len, 16, 8, 0);
+                for (unsigned i = 0; i < out->tile_count; ++i) {
+                        vc_copylineToRGBA_inplace((unsigned char*) out->tiles[i].data,
+                                        (unsigned char*)out->tiles[i].data,
+                                        out->tiles[i].data_len, 16, 8, 0);
                 }
         }
         if (s->codec == R10k && get_commandline_param(R10K_FULL_OPT) == nullptr) {
-                for (unsigned i = 0; i < s->frame->tile_count; ++i) {
-                        r10k_limited_to_full(s->frame->tiles[i].data, s->frame->tiles[i].data,
-                                        s->frame->tiles[i].data_len);
+                for (unsigned i = 0; i < out->tile_count; ++i) {
+                        r10k_limited_to_full(out->tiles[i].data, out->tiles[i].data,
+                                        out->tiles[i].data_len);
                 }
         }
 
         s->frames++;
-        s->frame->timecode = s->state[0].delegate->timecode;
-        return s->frame;
+        out->timecode = s->state[0].delegate->timecode;
+        return out;
 }
 
 /* function from DeckLink SDK sample DeviceList */
@@ -85,6 +85,7 @@
 
 static const double AUDIO_RATIO = 1.05; ///< at this ratio the audio frame can be longer than the video frame
 #define FILE_DEFAULT_QUEUE_LEN 1
+#define FILE_DEFAULT_PREFETCH 2
 #define MAGIC to_fourcc('u', 'g', 'l', 'f')
 #define MOD_NAME "[File cap.] "
 
@@ -114,13 +115,18 @@ struct vidcap_state_lavf_decoder {
 
         struct simple_linked_list *video_frame_queue;
         int max_queue_len;
+        struct simple_linked_list *decoded_queue; ///< AVFrames waiting for conversion
+        int prefetch; ///< max decoded_queue len
         struct audio_frame audio_frame;
         pthread_mutex_t audio_frame_lock;
 
         pthread_t thread_id;
+        pthread_t conv_thread_id; ///< converts decoded frames, not used with nodecode
         pthread_mutex_t lock;
         pthread_cond_t new_frame_ready;
         pthread_cond_t frame_consumed;
+        pthread_cond_t decoded_ready;
+        pthread_cond_t decoded_consumed;
         pthread_cond_t paused_cv;
         struct timeval last_frame;
 
@@ -130,7 +136,7 @@ struct vidcap_state_lavf_decoder {
 static void vidcap_file_show_help(bool full) {
         color_printf("Usage:\n");
         color_printf(TERM_BOLD TERM_FG_RED "\t-t file:<name>" TERM_FG_RESET "[:loop][:nodecode][:codec=<c>]%s\n" TERM_RESET,
-                        full ? "[:opportunistic_audio][:queue=<len>][:threads=<n>[FS]]" : "");
+                        full ? "[:opportunistic_audio][:queue=<len>][:prefetch=<n>][:threads=<n>[FS]]" : "");
         color_printf("where\n");
         color_printf(TERM_BOLD "\tloop\n" TERM_RESET);
         color_printf("\t\tloop the playback\n");
@@ -143,6 +149,8 @@ static void vidcap_file_show_help(bool full) {
                 color_printf("\t\tgrab audio if not present but do not fail if not\n");
                 color_printf(TERM_BOLD "\tqueue\n" TERM_RESET);
                 color_printf("\t\tmax queue len (default: %d), increasing may help if video stutters\n", FILE_DEFAULT_QUEUE_LEN);
+                color_printf(TERM_BOLD "\tprefetch\n" TERM_RESET);
+                color_printf("\t\tnumber of decoded frames waiting for pixel format conversion (default: %d)\n", FILE_DEFAULT_PREFETCH);
                 color_printf(TERM_BOLD "\tthreads\n" TERM_RESET);
                 color_printf("\t\tnumber of threads (0 is default), 'S' and/or 'F' to use slice/frame threads, use at least one flag\n");
         } else {
@@ -169,15 +177,22 @@ static void vidcap_file_common_cleanup(struct vidcap_state_lavf_decoder *s) {
         while ((f = simple_linked_list_pop(s->video_frame_queue)) != NULL) {
                 VIDEO_FRAME_DISPOSE(f);
         }
+        AVFrame *frame = NULL;
+        while ((frame = simple_linked_list_pop(s->decoded_queue)) != NULL) {
+                av_frame_free(&frame);
+        }
 
         pthread_mutex_destroy(&s->audio_frame_lock);
         pthread_mutex_destroy(&s->lock);
         pthread_cond_destroy(&s->frame_consumed);
         pthread_cond_destroy(&s->new_frame_ready);
         pthread_cond_destroy(&s->paused_cv);
+        pthread_cond_destroy(&s->decoded_ready);
+        pthread_cond_destroy(&s->decoded_consumed);
         free(s->src_filename);
         module_done(&s->mod);
         simple_linked_list_destroy(s->video_frame_queue);
+        simple_linked_list_destroy(s->decoded_queue);
         free(s);
 }
 
@@ -253,6 +268,119 @@ static void vidcap_file_process_messages(struct vidcap_state_lavf_decoder *s) {
         }
 }
 
+/**
+ * Passes the frame to grab, blocks while the queue is full.
+ * @retval false if exiting (frame is disposed)
+ */
+static bool vidcap_file_enqueue_video(struct vidcap_state_lavf_decoder *s, struct video_frame *out) {
+        pthread_mutex_lock(&s->lock);
+        while (!s->should_exit && simple_linked_list_size(s->video_frame_queue) > s->max_queue_len) {
+                pthread_cond_wait(&s->frame_consumed, &s->lock);
+        }
+        if (s->should_exit) {
+                pthread_mutex_unlock(&s->lock);
+                VIDEO_FRAME_DISPOSE(out);
+                return false;
+        }
+        simple_linked_list_append(s->video_frame_queue, out);
+        pthread_mutex_unlock(&s->lock);
+        pthread_cond_signal(&s->new_frame_ready);
+        return true;
+}
+
+/**
+ * Sends the packet (NULL to drain) to the decoder and passes all frames
+ * it outputs to the conversion thread.
+ * @retval false if exiting
+ */
+static bool vidcap_file_decode_video(struct vidcap_state_lavf_decoder *s, AVPacket *pkt) {
+        struct timeval t0;
+        gettimeofday(&t0, NULL);
+        int ret = avcodec_send_packet(s->vid_ctx, pkt);
+        if (ret < 0 && ret != AVERROR(EAGAIN)) {
+                print_decoder_error(MOD_NAME, ret);
+                return true;
+        }
+        bool resend = ret == AVERROR(EAGAIN); // decoder full - receive first, then send again
+        while (1) {
+                AVFrame *frame = av_frame_alloc();
+                ret = avcodec_receive_frame(s->vid_ctx, frame);
+                if (ret != 0) {
+                        if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
+                                print_decoder_error(MOD_NAME, ret);
+                        }
+                        av_frame_free(&frame);
+                        if (ret == AVERROR(EAGAIN) && resend) {
+                                resend = false;
+                                if ((ret = avcodec_send_packet(s->vid_ctx, pkt)) == 0) {
+                                        continue;
+                                }
+                                print_decoder_error(MOD_NAME, ret);
+                        }
+                        break;
+                }
+                struct timeval t1;
+                gettimeofday(&t1, NULL);
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Video decompress duration: %f\n", tv_diff(t1, t0));
+                t0 = t1;
+
+                pthread_mutex_lock(&s->lock);
+                while (!s->should_exit && simple_linked_list_size(s->decoded_queue) >= s->prefetch) {
+                        pthread_cond_wait(&s->decoded_consumed, &s->lock);
+                }
+                if (s->should_exit) {
+                        pthread_mutex_unlock(&s->lock);
+                        av_frame_free(&frame);
+                        return false;
+                }
+                simple_linked_list_append(s->decoded_queue, frame);
+                pthread_mutex_unlock(&s->lock);
+                pthread_cond_signal(&s->decoded_ready);
+        }
+        return true;
+}
+
+/**
+ * Converts decoded frames to UltraGrid pixel format so that conversion
+ * of a frame runs in parallel with decoding of the following ones.
+ */
+static void *vidcap_file_conv_worker(void *state) {
+        set_thread_name(__func__);
+        struct vidcap_state_lavf_decoder *s = (struct vidcap_state_lavf_decoder *) state;
+        while (1) {
+                pthread_mutex_lock(&s->lock);
+                while (!s->should_exit && simple_linked_list_size(s->decoded_queue) == 0) {
+                        pthread_cond_wait(&s->decoded_ready, &s->lock);
+                }
+                if (s->should_exit) {
+                        pthread_mutex_unlock(&s->lock);
+                        return NULL;
+                }
+                AVFrame *frame = simple_linked_list_pop(s->decoded_queue);
+                pthread_mutex_unlock(&s->lock);
+                pthread_cond_signal(&s->decoded_consumed);
+
+                struct video_frame *out = vf_alloc_desc_data(s->video_desc);
+
+                /* copy decoded frame to destination buffer:
+                 * this is required since rawvideo expects non aligned data */
+                int video_dst_linesize[4] = { vc_get_linesize(out->tiles[0].width, out->color_spec) };
+                uint8_t *dst[4] = { (uint8_t *) out->tiles[0].data };
+                if (s->conv_uv) {
+                        int rgb_shift[] = DEFAULT_RGB_SHIFT_INIT;
+                        s->conv_uv(out->tiles[0].data, frame, out->tiles[0].width, out->tiles[0].height, video_dst_linesize[0], rgb_shift);
+                } else {
+                        sws_scale(s->sws_ctx, (const uint8_t * const *) frame->data, frame->linesize, 0,
+                                        frame->height, dst, video_dst_linesize);
+                }
+                av_frame_free(&frame);
+                out->callbacks.dispose = vf_free;
+                if (!vidcap_file_enqueue_video(s, out)) {
+                        return NULL;
+                }
+        }
+}
+
 #define FAIL_WORKER { pthread_mutex_lock(&s->lock); s->failed = true; pthread_mutex_unlock(&s->lock); pthread_cond_signal(&s->new_frame_ready); return NULL; }
 static void *vidcap_file_worker(void *state) {
         set_thread_name(__func__);
@@ -282,6 +410,12 @@ static void *vidcap_file_worker(void *state) {
 
                 int ret = av_read_frame(s->fmt_ctx, pkt);
                 if (ret == AVERROR_EOF) {
+                        if (!s->no_decode) { // get the frames buffered in decoder, keep it open for next loop
+                                if (!vidcap_file_decode_video(s, NULL)) {
+                                        break;
+                                }
+                                avcodec_flush_buffers(s->vid_ctx);
+                        }
                         if (s->loop) {
                                 CHECK_FF(avformat_seek_file(s->fmt_ctx, -1, INT64_MIN, s->fmt_ctx->start_time, INT64_MAX, 0), FAIL_WORKER);
                                 continue;
@@ -330,71 +464,23 @@ static void *vidcap_file_worker(void *state) {
                         av_frame_free(&frame);
                 } else if (pkt->stream_index == s->video_stream_idx) {
                         s->last_vid_pts = pkt->pts == AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
-                        struct video_frame *out;
+                        bool cont = true;
                         if (s->no_decode) {
-                                out = vf_alloc_desc(s->video_desc);
+                                struct video_frame *out = vf_alloc_desc(s->video_desc);
                                 out->callbacks.data_deleter = vf_data_deleter;
                                 out->callbacks.dispose = vf_free;
                                 out->tiles[0].data_len = pkt->size;
                                 out->tiles[0].data = malloc(pkt->size);
                                 memcpy(out->tiles[0].data, pkt->data, pkt->size);
+                                cont = vidcap_file_enqueue_video(s, out);
                         } else {
-                                AVFrame * frame = av_frame_alloc();
-                                int got_frame = 0;
-
-                                struct timeval t0;
-                                gettimeofday(&t0, NULL);
-                                ret = avcodec_send_packet(s->vid_ctx, pkt);
-                                if (ret == 0 || ret == AVERROR(EAGAIN)) {
-                                        ret = avcodec_receive_frame(s->vid_ctx, frame);
-                                        if (ret == 0) {
-                                                got_frame = 1;
-                                        }
-                                }
-                                struct timeval t1;
-                                gettimeofday(&t1, NULL);
-                                if (ret != 0) {
-                                        print_decoder_error(MOD_NAME, ret);
-                                }
-                                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Video decompress duration: %f\n", tv_diff(t1, t0));
-
-                                if (ret < 0 || !got_frame) {
-                                        if (ret < 0) {
-                                                fprintf(stderr, "Error decoding video frame (%s)\n", av_err2str(ret));
-                                        }
-                                        av_frame_free(&frame);
-                                        continue;
-                                }
-                                out = vf_alloc_desc_data(s->video_desc);
-
-                                /* copy decoded frame to destination buffer:
-                                 * this is required since rawvideo expects non aligned data */
-                                int video_dst_linesize[4] = { vc_get_linesize(out->tiles[0].width, out->color_spec) };
-                                uint8_t *dst[4] = { (uint8_t *) out->tiles[0].data };
-                                if (s->conv_uv) {
-                                        int rgb_shift[] = DEFAULT_RGB_SHIFT_INIT;
-                                        s->conv_uv(out->tiles[0].data, frame, out->tiles[0].width, out->tiles[0].height, video_dst_linesize[0], rgb_shift);
-                                } else {
-                                        sws_scale(s->sws_ctx, (const uint8_t * const *) frame->data, frame->linesize, 0,
-                                                        frame->height, dst, video_dst_linesize);
-                                }
-                                av_frame_free(&frame);
-                                out->callbacks.dispose = vf_free;
-                        }
-                        pthread_mutex_lock(&s->lock);
-                        while (!s->should_exit && simple_linked_list_size(s->video_frame_queue) > s->max_queue_len) {
-                                pthread_cond_wait(&s->frame_consumed, &s->lock);
+                                cont = vidcap_file_decode_video(s, pkt);
                         }
-                        if (s->should_exit) {
-                                VIDEO_FRAME_DISPOSE(out);
-                                pthread_mutex_unlock(&s->lock);
+                        if (!cont) {
                                 av_packet_unref(pkt);
                                 av_packet_free(&pkt);
                                 return NULL;
                         }
-                        simple_linked_list_append(s->video_frame_queue, out);
-                        pthread_mutex_unlock(&s->lock);
-                        pthread_cond_signal(&s->new_frame_ready);
                 }
                 av_packet_unref(pkt);
         }
@@ -428,6 +514,8 @@ static bool vidcap_file_parse_fmt(struct vidcap_state_lavf_decoder *s, const cha
                         }
                 } else if (strncmp(item, "queue=", strlen("queue=")) == 0) {
                         s->max_queue_len = atoi(item + strlen("queue="));
+                } else if (strncmp(item, "prefetch=", strlen("prefetch=")) == 0) {
+                        s->prefetch = MAX(atoi(item + strlen("prefetch=")), 1);
                 } else if (strncmp(item, "threads=", strlen("threads=")) == 0) {
                         char *endptr = NULL;
                         long count = strtol(item + strlen("threads="), &endptr, 0);
@@ -483,6 +571,8 @@ static void vidcap_file_should_exit(void *state) {
         pthread_cond_signal(&s->new_frame_ready);
         pthread_cond_signal(&s->frame_consumed);
         pthread_cond_signal(&s->paused_cv);
+        pthread_cond_signal(&s->decoded_ready);
+        pthread_cond_signal(&s->decoded_consumed);
 }
 
 #define CHECK(call) { int ret = call; if (ret != 0) abort(); }
@@ -506,6 +596,8 @@ static int vidcap_file_init(struct vidcap_params *params, void **state) {
 
         struct vidcap_state_lavf_decoder *s = calloc(1, sizeof (struct vidcap_state_lavf_decoder));
         s->video_frame_queue = simple_linked_list_init();
+        s->decoded_queue = simple_linked_list_init();
+        s->prefetch = FILE_DEFAULT_PREFETCH;
         s->audio_stream_idx = -1;
         s->video_stream_idx = -1;
         s->max_queue_len = FILE_DEFAULT_QUEUE_LEN;
@@ -516,6 +608,8 @@ static int vidcap_file_init(struct vidcap_params *params, void **state) {
         CHECK(pthread_cond_init(&s->frame_consumed, NULL));
         CHECK(pthread_cond_init(&s->new_frame_ready, NULL));
         CHECK(pthread_cond_init(&s->paused_cv, NULL));
+        CHECK(pthread_cond_init(&s->decoded_ready, NULL));
+        CHECK(pthread_cond_init(&s->decoded_consumed, NULL));
         module_init_default(&s->mod);
         s->mod.priv_magic = MAGIC;
         s->mod.cls = MODULE_CLASS_DATA;
@@ -627,6 +721,9 @@ static int vidcap_file_init(struct vidcap_params *params, void **state) {
         register_should_exit_callback(&s->mod, vidcap_file_should_exit, s);
 
         pthread_create(&s->thread_id, NULL, vidcap_file_worker, s);
+        if (!s->no_decode) {
+                pthread_create(&s->conv_thread_id, NULL, vidcap_file_conv_worker, s);
+        }
 
         *state = s;
         return VIDCAP_INIT_OK;
@@ -639,6 +736,9 @@ static void vidcap_file_done(void *state) {
         vidcap_file_should_exit(s);
 
         pthread_join(s->thread_id, NULL);
+        if (!s->no_decode) {
+                pthread_join(s->conv_thread_id, NULL);
+        }
 
         vidcap_file_common_cleanup(s);
 }
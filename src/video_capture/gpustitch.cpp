@@ -83,6 +83,7 @@ static void show_help()
         printf("Usage\n");
         printf("\t-t gpustitch -t <dev1_config> -t <dev2_config> ....]\n");
         printf("\t\twhere devn_config is a complete configuration string of device involved in stitching\n");
+        printf("\tcudabuf - pass stitched frames in CUDA device memory (eg. to GPUJPEG compression) instead of downloading them\n");
 
 }
 
@@ -152,6 +153,19 @@ struct grab_worker_state {
         codec_t in_codec = VIDEO_CODEC_NONE;
 
         cudaStream_t tmp_in_frame_stream;
+
+        /**
+         * Grabbed frames are copied to pinned memory first so that the
+         * upload is an asynchronous DMA transfer overlapping with the stitching
+         * of previous frame. Two buffers are used alternately, each with events
+         * recorded on the streams that read from it.
+         */
+        struct staging_buffer {
+                unsigned char *data = nullptr;
+                std::vector<cudaEvent_t> copied;
+        } staging[2];
+        size_t staging_size = 0;
+        int staging_idx = 0;
 };
 
 static struct vidcap_type *
@@ -214,7 +228,65 @@ static bool check_in_format(grab_worker_state *gs, video_frame *in, int i){
         return true;
 }
 
+/**
+ * Copies the grabbed frame to a pinned staging buffer
+ *
+ * @returns pointer to the staged data or nullptr on error
+ */
+static unsigned char *stage_frame(grab_worker_state *gs, video_frame *in_frame)
+{
+        gs->staging_idx = (gs->staging_idx + 1) % 2;
+        auto &buf = gs->staging[gs->staging_idx];
+        for (auto &ev : buf.copied) { // uploads from this buffer (2 frames ago) must be finished
+                cudaEventSynchronize(ev);
+        }
+        if (gs->staging_size < in_frame->tiles[0].data_len) {
+                for (auto &b : gs->staging) {
+                        for (auto &ev : b.copied) {
+                                cudaEventSynchronize(ev);
+                        }
+                        cudaFreeHost(b.data);
+                        b.data = nullptr;
+                        if (cudaMallocHost(&b.data, in_frame->tiles[0].data_len) != cudaSuccess) {
+                                std::cerr << log_str << "Failed to allocate staging buffer" << std::endl;
+                                gs->staging_size = 0;
+                                return nullptr;
+                        }
+                }
+                gs->staging_size = in_frame->tiles[0].data_len;
+        }
+        memcpy(buf.data, in_frame->tiles[0].data, in_frame->tiles[0].data_len);
+        return buf.data;
+}
+
+/// records that stream has enqueued a read of the current staging buffer
+static void staging_mark_used(grab_worker_state *gs, unsigned idx, cudaStream_t stream)
+{
+        auto &events = gs->staging[gs->staging_idx].copied;
+        while (events.size() <= idx) {
+                cudaEvent_t ev;
+                cudaEventCreateWithFlags(&ev, cudaEventDisableTiming);
+                events.push_back(ev);
+        }
+        cudaEventRecord(events[idx], stream);
+}
+
+static void staging_free(grab_worker_state *gs)
+{
+        for (auto &b : gs->staging) {
+                for (auto &ev : b.copied) {
+                        cudaEventSynchronize(ev);
+                        cudaEventDestroy(ev);
+                }
+                b.copied.clear();
+                cudaFreeHost(b.data);
+                b.data = nullptr;
+        }
+        gs->staging_size = 0;
+}
+
 static bool upload_to_cuda_buf(grab_worker_state *gs, video_frame *in_frame,
+                const unsigned char *host_data,
                 size_t x_offset, size_t y_offset, size_t w, size_t h,
                 unsigned char *dst,
                 unsigned dst_pitch,
@@ -233,7 +305,7 @@ static bool upload_to_cuda_buf(grab_worker_state *gs, video_frame *in_frame,
         if(gs->conv_func){
                 if (cudaMemcpy2DAsync(gs->tmp_in_frame + offset_bytes,
                                         in_line_size,
-                                        (unsigned char *)(in_frame->tiles[0].data) + offset_bytes,
+                                        host_data + offset_bytes,
                                         in_line_size,
                                         roi_line_size, h,
                                         cudaMemcpyHostToDevice, stream) != cudaSuccess)
@@ -247,11 +319,11 @@ static bool upload_to_cuda_buf(grab_worker_state *gs, video_frame *in_frame,
                                 gs->tmp_in_frame + offset_bytes, in_line_size,
                                 w, h, stream);
         } else {
-                if (cudaMemcpy2D(dst + y_offset * dst_pitch + vc_get_linesize(x_offset, RGBA), dst_pitch,
-                                        (unsigned char*)(in_frame->tiles[0].data) + offset_bytes,
+                if (cudaMemcpy2DAsync(dst + y_offset * dst_pitch + vc_get_linesize(x_offset, RGBA), dst_pitch,
+                                        host_data + offset_bytes,
                                         in_line_size,
                                         w, h,
-                                        cudaMemcpyHostToDevice) != cudaSuccess)
+                                        cudaMemcpyHostToDevice, stream) != cudaSuccess)
                 {
                         std::cerr << "Error copying RGBA image bitmap to CUDA buffer" << std::endl;
                         return false;
@@ -262,7 +334,7 @@ static bool upload_to_cuda_buf(grab_worker_state *gs, video_frame *in_frame,
         return true;
 }
 
-static bool upload_frame(grab_worker_state *gs, video_frame *in_frame, int i){
+static bool upload_frame(grab_worker_state *gs, video_frame *in_frame, const unsigned char *host_data, int i){
         cudaStream_t stream;
         gs->s->stitcher.get_input_stream(i, &stream);
 
@@ -272,11 +344,12 @@ static bool upload_frame(grab_worker_state *gs, video_frame *in_frame, int i){
         }
 
         upload_to_cuda_buf(gs,
-                        in_frame,
+                        in_frame, host_data,
                         0, 0, gs->width, gs->height,
                         gs->tmp_rgba_frame,
                         gs->tmp_rgba_frame_pitch,
                         stream);
+        staging_mark_used(gs, 0, stream);
 
         gs->s->stitcher.submit_input_image_async(i, gs->tmp_rgba_frame,
                         gs->width, gs->height,
@@ -286,7 +359,7 @@ static bool upload_frame(grab_worker_state *gs, video_frame *in_frame, int i){
         return true;
 }
 
-static void upload_tiles(grab_worker_state *gs, video_frame *frame){
+static void upload_tiles(grab_worker_state *gs, video_frame *frame, const unsigned char *host_data){
         const int order[] = {3, 1, 2, 0};
 
         for(int i = 0; i < 4; i++){
@@ -302,12 +375,13 @@ static void upload_tiles(grab_worker_state *gs, video_frame *frame){
                 unsigned y_offset = (order[i] / 2) * tile_height;
 
                 upload_to_cuda_buf(gs,
-                                frame,
+                                frame, host_data,
                                 x_offset, y_offset, tile_width, tile_height,
                                 gs->tmp_rgba_frame,
                                 gs->tmp_rgba_frame_pitch,
                                 stream
                                 );
+                staging_mark_used(gs, i, stream);
 
                 unsigned char *src = static_cast<unsigned char *>(gs->tmp_rgba_frame);
                 src += (order[i] % 2) * tile_line_len;
@@ -359,6 +433,7 @@ static void grab_worker(grab_worker_state *gs, vidcap_params *param, int id){
                 if(gs->s->done){
                         VIDEO_FRAME_DISPOSE(frame);
                         vidcap_done(device);
+                        staging_free(gs);
                         cudaStreamDestroy(gs->tmp_in_frame_stream);
                         return;
                 }
@@ -372,13 +447,18 @@ static void grab_worker(grab_worker_state *gs, vidcap_params *param, int id){
                         frame = vidcap_grab(device, &audio_frame);
                 }
 
+                unsigned char *staged = nullptr;
                 if (check_in_format(gs, frame, id)){
+                        PROFILE_DETAIL("Stage");
+                        staged = stage_frame(gs, frame);
+                }
+                if (staged) {
                         PROFILE_DETAIL("Upload");
                         if(gs->tiled){
-                                upload_tiles(gs, frame);
+                                upload_tiles(gs, frame, staged);
 
                         } else {
-                                upload_frame(gs, frame, id);
+                                upload_frame(gs, frame, staged, id);
                         }
                 }
 
@@ -628,6 +708,7 @@ static bool allocate_result_frame(vidcap_gpustitch_state *s, unsigned width, uns
 
         s->frame->callbacks.data_deleter = NULL;
         s->frame->callbacks.recycle = NULL;
+        s->frame->mem_location = s->output_cuda_buf ? CUDA_MEM : CPU_MEM;
 
         if(!s->output_cuda_buf){
                 if(cudaMallocHost(&s->frame->tiles[0].data, s->frame->tiles[0].data_len) != cudaSuccess){
@@ -637,7 +718,7 @@ static bool allocate_result_frame(vidcap_gpustitch_state *s, unsigned width, uns
                 s->frame->callbacks.data_deleter = result_data_delete;
         }
 
-        if(s->conv_func){
+        if(s->conv_func || s->output_cuda_buf){ // in CUDA_MEM case also for the pitch removal
                 size_t size = vc_get_linesize(desc.width, s->out_fmt) * desc.height;
 
                 if(cudaMalloc(&s->conv_tmp_frame, size) != cudaSuccess){
@@ -682,6 +763,14 @@ static bool download_stitched(vidcap_gpustitch_state *s, cudaStream_t out_stream
         }
 
         if(s->output_cuda_buf){
+                if (src_pitch != row_bytes) { // consumers expect tightly packed lines
+                        if (cudaMemcpy2DAsync(s->conv_tmp_frame, row_bytes, src, src_pitch, row_bytes, h,
+                                                cudaMemcpyDeviceToDevice, out_stream) != cudaSuccess) {
+                                std::cerr << log_str << "Error copying output panorama" << std::endl;
+                                return false;
+                        }
+                        src = s->conv_tmp_frame;
+                }
                 s->frame->tiles[0].data = (char *) src;
         } else {
                 if (cudaMemcpy2DAsync(s->frame->tiles[0].data, row_bytes,
@@ -76,14 +76,23 @@
 #include <sstream>
 #include <string>
 #include <string.h>
+#ifndef WIN32
+#include <sys/mman.h>
+#endif
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <atomic>
 #include <condition_variable>
 #include <chrono>
 #include <mutex>
+#include <vector>
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
 
 #define BUFFER_LEN_MAX 40
 #define MAX_CLIENTS 16
@@ -93,6 +102,7 @@
 #define PIPE "/tmp/ultragrid_import.fifo"
 
 #define MAX_NUMBER_WORKERS 100
+#define MAX_TILES 10 ///< tile index is a single digit in file names
 #define MOD_NAME "[import] "
 
 using std::condition_variable;
@@ -110,8 +120,22 @@ struct tile_data {
         int data_len;
 };
 
+/// location of a tile in VIDEO_EXPORT_CONTAINER_DATA
+struct container_tile {
+        uint64_t offset;
+        int len; ///< -1 if the tile is missing
+};
+
+/// read-only mapping of the container, see the mmap option
+struct container_mapping {
+        char *addr;
+        size_t len;
+        std::atomic<int> refs; ///< state + every entry pointing to the mapping
+};
+
 struct processed_entry {
         struct processed_entry *next;
+        struct container_mapping *mapping; ///< tiles point to the mapping if not NULL
         int count;
         struct tile_data tiles[];
 };
@@ -193,8 +217,18 @@ struct vidcap_import_state {
         bool loop;
         bool o_direct;
         int video_reading_threads_count;
+        int read_ahead; ///< frames read concurrently, 0 - use video_reading_threads_count
+        string container; ///< path to container data file, empty for a file per frame
+        bool use_mmap;
+        struct container_mapping *mapping;
+        std::vector<struct container_tile> container_index; ///< [frame * tile_count + tile]
+#ifdef HAVE_LIBURING
+        struct io_uring ring;
+        bool use_uring;
+#endif
         bool should_exit_at_end;
         double force_fps;
+        int decimation = 1; ///< only every n-th frame of the sequence is read
 };
 
 static void * audio_reading_thread(void *args);
@@ -336,6 +370,87 @@ static video_desc parse_video_desc_info(FILE *info, long *video_frame_count) {
         return desc;
 }
 
+/**
+ * Loads index of video exported with --param video-export-container.
+ * @retval false if there is no index in the directory
+ */
+static bool load_container_index(struct vidcap_import_state *s)
+{
+        string name = string(s->directory) + "/" VIDEO_EXPORT_CONTAINER_INDEX;
+        FILE *index = fopen(name.c_str(), "r");
+        if (index == nullptr) {
+                return false;
+        }
+        int version = 0;
+        int tile_count = 0;
+        std::vector<struct container_tile> tiles;
+        char line[512];
+        while (fgets(line, sizeof line, index) != nullptr) {
+                unsigned frame = 0;
+                unsigned tile = 0;
+                unsigned long long offset = 0;
+                int len = 0;
+                if (sscanf(line, "version %d", &version) == 1 || sscanf(line, "tiles %d", &tile_count) == 1) {
+                        continue;
+                }
+                if (sscanf(line, "%u %u %llu %d", &frame, &tile, &offset, &len) != 4 || frame == 0 || tile >= MAX_TILES) {
+                        fclose(index);
+                        throw ug_runtime_error(string("Malformed container index line: ") + line);
+                }
+                size_t idx = (frame - 1) * MAX_TILES + tile;
+                if (tiles.size() <= idx) {
+                        tiles.resize(idx + 1, container_tile{0, -1});
+                }
+                tiles[idx] = { offset, len };
+        }
+        fclose(index);
+        if (version != VIDEO_EXPORT_CONTAINER_VERSION || tile_count <= 0 || tile_count > MAX_TILES) {
+                throw ug_runtime_error("Unsupported container index " + name);
+        }
+
+        s->video_desc.tile_count = tile_count;
+        s->container = string(s->directory) + "/" VIDEO_EXPORT_CONTAINER_DATA;
+        s->container_index.assign(s->video_frame_count * tile_count, container_tile{0, -1});
+        for (long i = 0; i < s->video_frame_count; ++i) {
+                for (int j = 0; j < tile_count; ++j) {
+                        if ((size_t) (i * MAX_TILES + j) < tiles.size()) {
+                                s->container_index[i * tile_count + j] = tiles[i * MAX_TILES + j];
+                        }
+                }
+        }
+        return true;
+}
+
+static void map_container(struct vidcap_import_state *s)
+{
+#ifdef WIN32
+        LOG(LOG_LEVEL_WARNING) << MOD_NAME "Mapping is not supported on this platform, reading files.\n";
+#else
+        if (s->container.empty()) {
+                LOG(LOG_LEVEL_WARNING) << MOD_NAME "Only container exports can be mapped, reading files.\n";
+                return;
+        }
+        int fd = open(s->container.c_str(), O_RDONLY);
+        struct stat sb;
+        if (fd == -1 || fstat(fd, &sb) != 0) {
+                throw ug_runtime_error("Cannot open " + s->container + ": " + strerror(errno));
+        }
+        void *addr = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (addr == MAP_FAILED) {
+                throw ug_runtime_error("Cannot map " + s->container + ": " + strerror(errno));
+        }
+        madvise(addr, sb.st_size, MADV_SEQUENTIAL);
+        for (const auto &t : s->container_index) {
+                if (t.len >= 0 && t.offset + t.len > (uint64_t) sb.st_size) {
+                        munmap(addr, sb.st_size);
+                        throw ug_runtime_error("Container " + s->container + " is truncated!");
+                }
+        }
+        s->mapping = new container_mapping{(char *) addr, (size_t) sb.st_size, {1}};
+#endif
+}
+
 static int get_tile_count(const char *directory, codec_t color_spec, char *tile_delim) {
         char name[1024];
         snprintf(name, sizeof(name), "%s/%08d.%s", directory, 1,
@@ -385,8 +500,10 @@ try {
 
         if (strlen(tmp) == 0 || strcmp(tmp, "help") == 0) {
                 color_printf("Import usage:\n"
-                                TERM_BOLD TERM_FG_RED "\t<directory>" TERM_FG_RESET "{:loop|:mt_reading=<nr_threads>|:o_direct|:exit_at_end|:fps=<fps>|frames=<n>|:disable_audio}\n" TERM_RESET
+                                TERM_BOLD TERM_FG_RED "\t<directory>" TERM_FG_RESET "{:loop|:mt_reading=<nr_threads>|:read_ahead=<depth>|:o_direct|:mmap|:exit_at_end|:fps=<fps>|frames=<n>|:disable_audio}\n" TERM_RESET
                                 "where\n"
+                                TERM_BOLD "\tmmap" TERM_RESET " - map the container (exported with --param video-export-container) to memory instead of reading it\n"
+                                TERM_BOLD "\t<depth>" TERM_RESET " - number of frames read concurrently (using io_uring if available, reading threads otherwise)\n"
                                 TERM_BOLD "\t<fps>" TERM_RESET " - overrides FPS from sequence metadata\n"
                                 TERM_BOLD "\t<n>  " TERM_RESET " - use only N first frames fron sequence (if less than available frames)\n");
                 delete s;
@@ -430,8 +547,16 @@ try {
                                         strlen("mt_reading="));
                         assert(s->video_reading_threads_count <=
                                         MAX_NUMBER_WORKERS);
+                } else if (strstr(suffix, "read_ahead=") == suffix) {
+                        s->read_ahead = atoi(strchr(suffix, '=') + 1);
+                        if (s->read_ahead <= 0 || s->read_ahead >= BUFFER_LEN_MAX) {
+                                throw ug_runtime_error("Read-ahead depth must be in range 1-"s
+                                                + to_string(BUFFER_LEN_MAX - 1) + "!");
+                        }
                 } else if (strcmp(suffix, "o_direct") == 0) {
                         s->o_direct = true;
+                } else if (strcmp(suffix, "mmap") == 0) {
+                        s->use_mmap = true;
                 } else if (strcmp(suffix, "noaudio") == 0) {
                         disable_audio = true;
                 } else if (strcmp(suffix, "opportunistic_audio") == 0) { // skip
@@ -487,7 +612,12 @@ try {
                 fclose(info);
                 info = NULL;
 
-                s->video_desc.tile_count = get_tile_count(s->directory, s->video_desc.color_spec, &s->tile_delim);
+                if (!load_container_index(s)) {
+                        s->video_desc.tile_count = get_tile_count(s->directory, s->video_desc.color_spec, &s->tile_delim);
+                }
+                if (s->use_mmap) {
+                        map_container(s);
+                }
         }
 
         // override metadata fps setting
@@ -495,12 +625,29 @@ try {
                 s->video_desc.fps = s->force_fps;
         }
 
+        // audio is read per sequence frame, so it would need to be resampled
+        if (vidcap_params_get_decimation(params) > 1 && s->has_video && !s->audio_state.has_audio) {
+                s->decimation = vidcap_params_get_decimation(params);
+                vidcap_params_accept_decimation(params);
+        }
+
         if (s->audio_state.has_audio) {
                 if(pthread_create(&s->audio_state.thread_id, NULL, audio_reading_thread, (void *) s) != 0) {
                         throw ug_runtime_error("Unable to create thread.");
                 }
         }
         if (s->has_video) {
+#ifdef HAVE_LIBURING
+                if (s->read_ahead > 0) {
+                        int ret = io_uring_queue_init(s->read_ahead * s->video_desc.tile_count, &s->ring, 0);
+                        if (ret == 0) {
+                                s->use_uring = true;
+                        } else {
+                                LOG(LOG_LEVEL_WARNING) << MOD_NAME "Cannot initialize io_uring: "
+                                        << strerror(-ret) << ", using reading threads.\n";
+                        }
+                }
+#endif
                 if (pthread_create(&s->video_thread_id, NULL, video_reading_thread, (void *) s) != 0) {
                         throw ug_runtime_error("Unable to create thread.");
                 }
@@ -561,11 +708,27 @@ static void exit_reading_threads(struct vidcap_import_state *s)
         }
 }
 
+static void unref_mapping(struct container_mapping *mapping)
+{
+        if (--mapping->refs > 0) {
+                return;
+        }
+#ifndef WIN32
+        munmap(mapping->addr, mapping->len);
+#endif
+        delete mapping;
+}
+
 static void free_entry(struct processed_entry *entry)
 {
         if (entry == NULL) {
                 return;
         }
+        if (entry->mapping != NULL) {
+                unref_mapping(entry->mapping);
+                free(entry);
+                return;
+        }
         for (int i = 0; i < entry->count; ++i) {
                 aligned_free(entry->tiles[i].data);
         }
@@ -609,6 +772,15 @@ static void cleanup_common(struct vidcap_import_state *s) {
                 fclose(s->audio_state.file);
         }
 
+#ifdef HAVE_LIBURING
+        if (s->use_uring) {
+                io_uring_queue_exit(&s->ring);
+        }
+#endif
+        if (s->mapping != nullptr) {
+                unref_mapping(s->mapping); // frames still out keep the mapping
+        }
+
         module_done(&s->mod);
 }
 
@@ -815,6 +987,8 @@ struct video_reader_data {
         unsigned int tile_count;
         struct processed_entry *entry;
         bool o_direct;
+        const char *container; ///< read from the container instead of per-frame files
+        const struct container_tile *container_tiles;
 };
 
 #define ALLOC_ALIGN 512
@@ -838,6 +1012,9 @@ static void *video_reader_callback(void *arg)
                 snprintf(name, sizeof(name), "%s%s.%s",
                                 data->file_name_prefix, tile_idx,
                                 data->file_name_suffix);
+                if (data->container != NULL) {
+                        snprintf(name, sizeof name, "%s", data->container);
+                }
 
                 struct stat sb;
 
@@ -863,6 +1040,16 @@ static void *video_reader_callback(void *arg)
                 }
 
                 data->entry->tiles[i].data_len = sb.st_size;
+                if (data->container != NULL) {
+                        data->entry->tiles[i].data_len = data->container_tiles[i].len;
+                        if (data->container_tiles[i].len < 0 ||
+                                        lseek(fd, data->container_tiles[i].offset, SEEK_SET) == (off_t) -1) {
+                                fprintf(stderr, "Missing frame in container %s\n", data->file_name_prefix);
+                                close(fd);
+                                free_entry(data->entry);
+                                return NULL;
+                        }
+                }
                 const int aligned_data_len = (data->entry->tiles[i].data_len + ALLOC_ALIGN - 1)
                         / ALLOC_ALIGN * ALLOC_ALIGN;
                 // alignment needed when using O_DIRECT flag
@@ -893,6 +1080,198 @@ static void *video_reader_callback(void *arg)
         return data;
 }
 
+#ifdef HAVE_LIBURING
+struct uring_read {
+        int fd;
+        int frame;
+        struct tile_data *tile;
+        uint64_t offset; ///< file offset of the tile
+        int done; ///< bytes already read
+};
+
+static bool uring_submit_read(struct io_uring *ring, struct uring_read *r)
+{
+        struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
+        if (sqe == NULL) {
+                io_uring_submit(ring);
+                sqe = io_uring_get_sqe(ring);
+                if (sqe == NULL) {
+                        return false;
+                }
+        }
+        unsigned len = (r->tile->data_len - r->done + ALLOC_ALIGN - 1) / ALLOC_ALIGN * ALLOC_ALIGN;
+        io_uring_prep_read(sqe, r->fd, r->tile->data + r->done, len, r->offset + r->done);
+        io_uring_sqe_set_data(sqe, r);
+        return true;
+}
+
+/**
+ * Reads count frames starting from index+1 (every s->decimation-th) with all
+ * tile reads submitted at once to io_uring so that the device queue is kept full.
+ *
+ * @param[out] entries read frames, NULL for a frame that failed to load
+ */
+static void uring_read_frames(struct vidcap_import_state *s, long index, int count,
+                struct processed_entry **entries)
+{
+        const int tile_count = s->video_desc.tile_count;
+        std::vector<struct uring_read> reads(count * tile_count);
+        std::vector<bool> failed(count);
+        int inflight = 0;
+
+        int flags = O_RDONLY;
+        if (s->o_direct) {
+                flags |= O_DIRECT;
+        }
+        for (int i = 0; i < count; ++i) {
+                entries[i] = (struct processed_entry *) calloc(1, sizeof(struct processed_entry) + tile_count * sizeof(struct tile_data));
+                assert(entries[i] != NULL);
+                entries[i]->count = tile_count;
+                for (int j = 0; j < tile_count; ++j) {
+                        struct uring_read *r = &reads[i * tile_count + j];
+                        r->fd = -1;
+                        r->frame = i;
+                        r->tile = &entries[i]->tiles[j];
+                        r->offset = 0;
+                        r->done = 0;
+                        if (failed[i]) {
+                                continue;
+                        }
+
+                        char name[1048];
+                        char tile_idx[3] = "";
+                        if (tile_count > 1) {
+                                sprintf(tile_idx, "%c%d", s->tile_delim, j);
+                        }
+                        snprintf(name, sizeof name, "%s/%08ld%s.%s", s->directory, index + i * s->decimation + 1,
+                                        tile_idx, get_codec_file_extension(s->video_desc.color_spec));
+                        if (!s->container.empty()) {
+                                snprintf(name, sizeof name, "%s", s->container.c_str());
+                        }
+                        struct stat sb;
+                        r->fd = open(name, flags);
+                        if (r->fd == -1 || fstat(r->fd, &sb) != 0) {
+                                perror("open");
+                                failed[i] = true;
+                                continue;
+                        }
+                        r->tile->data_len = sb.st_size;
+                        if (!s->container.empty()) {
+                                const struct container_tile &ct =
+                                        s->container_index[(index + i * s->decimation) * tile_count + j];
+                                if (ct.len < 0) {
+                                        failed[i] = true;
+                                        continue;
+                                }
+                                r->offset = ct.offset;
+                                r->tile->data_len = ct.len;
+                        }
+                        // alignment needed when using O_DIRECT flag
+                        r->tile->data = (char *) aligned_malloc((sb.st_size + ALLOC_ALIGN - 1)
+                                        / ALLOC_ALIGN * ALLOC_ALIGN, ALLOC_ALIGN);
+                        assert(r->tile->data != NULL);
+                        if (r->tile->data_len == 0) {
+                                continue;
+                        }
+                        if (!uring_submit_read(&s->ring, r)) {
+                                failed[i] = true;
+                                continue;
+                        }
+                        inflight += 1;
+                }
+        }
+
+        while (inflight > 0) {
+                struct io_uring_cqe *cqe = NULL;
+                int ret = io_uring_submit_and_wait(&s->ring, 1);
+                if (ret >= 0) {
+                        ret = io_uring_peek_cqe(&s->ring, &cqe);
+                }
+                if (ret < 0) {
+                        if (ret == -EINTR) {
+                                continue;
+                        }
+                        LOG(LOG_LEVEL_ERROR) << MOD_NAME "io_uring wait: " << strerror(-ret) << "\n";
+                        abort(); // submitted reads still reference the buffers
+                }
+                struct uring_read *r = (struct uring_read *) io_uring_cqe_get_data(cqe);
+                int res = cqe->res;
+                io_uring_cqe_seen(&s->ring, cqe);
+                inflight -= 1;
+
+                if (res <= 0) {
+                        LOG(LOG_LEVEL_ERROR) << MOD_NAME "read: " << strerror(res == 0 ? EIO : -res) << "\n";
+                        failed[r->frame] = true;
+                        continue;
+                }
+                r->done += res;
+                if (r->done < r->tile->data_len) { // short read
+                        if (uring_submit_read(&s->ring, r)) {
+                                inflight += 1;
+                        } else {
+                                failed[r->frame] = true;
+                        }
+                }
+        }
+
+        for (auto &r : reads) {
+                if (r.fd != -1) {
+                        close(r.fd);
+                }
+        }
+        for (int i = 0; i < count; ++i) {
+                if (failed[i]) {
+                        free_entry(entries[i]);
+                        entries[i] = NULL;
+                }
+        }
+}
+#endif // defined HAVE_LIBURING
+
+/**
+ * Creates entries for count frames starting from index+1 (every
+ * s->decimation-th) pointing into the mapped
+ * container and asks the kernel to prefetch the range.
+ */
+static void map_frames(struct vidcap_import_state *s, long index, int count,
+                struct video_reader_data *data_reader)
+{
+        const int tile_count = s->video_desc.tile_count;
+        uint64_t start = UINT64_MAX;
+        uint64_t end = 0;
+        for (int i = 0; i < count; ++i) {
+                const struct container_tile *tiles = &s->container_index[(index + i * s->decimation) * tile_count];
+                data_reader[i].entry = NULL;
+                bool missing = false;
+                for (int j = 0; j < tile_count; ++j) {
+                        missing = missing || tiles[j].len < 0;
+                }
+                if (missing) {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Frame %ld missing in container.\n", index + i * s->decimation + 1);
+                        continue;
+                }
+                struct processed_entry *entry = (struct processed_entry *) calloc(1, sizeof(struct processed_entry) + tile_count * sizeof(struct tile_data));
+                assert(entry != NULL);
+                entry->count = tile_count;
+                entry->mapping = s->mapping;
+                ++s->mapping->refs;
+                for (int j = 0; j < tile_count; ++j) {
+                        entry->tiles[j].data = s->mapping->addr + tiles[j].offset;
+                        entry->tiles[j].data_len = tiles[j].len;
+                        start = min<uint64_t>(start, tiles[j].offset);
+                        end = max<uint64_t>(end, tiles[j].offset + tiles[j].len);
+                }
+                data_reader[i].entry = entry;
+        }
+#ifndef WIN32
+        if (start < end) {
+                const uint64_t page = sysconf(_SC_PAGESIZE);
+                start = start / page * page;
+                madvise(s->mapping->addr + start, end - start, MADV_WILLNEED);
+        }
+#endif
+}
+
 static void * video_reading_thread(void *args)
 {
 	struct vidcap_import_state 	*s = (struct vidcap_import_state *) args;
@@ -921,7 +1300,7 @@ static void * video_reading_thread(void *args)
                                         paused = !paused;
                                         printf("Toggle pause\n");
 
-                                        index -= flush_processed(s->head);
+                                        index -= flush_processed(s->head) * s->decimation;
                                         s->queue_len = 0;
                                         s->head = s->tail = NULL;
 
@@ -954,19 +1333,38 @@ static void * video_reading_thread(void *args)
                 struct video_reader_data data_reader[MAX_NUMBER_WORKERS];
                 task_result_handle_t task_handle[MAX_NUMBER_WORKERS];
 
-                int number_workers = s->video_reading_threads_count;
-                if (index + number_workers >= s->video_frame_count) {
-                        number_workers = s->video_frame_count - index;
+                int number_workers = s->read_ahead > 0 ? s->read_ahead : s->video_reading_threads_count;
+                if (index + number_workers * s->decimation >= s->video_frame_count) {
+                        number_workers = (s->video_frame_count - index + s->decimation - 1) / s->decimation;
                 }
+                if (s->mapping != nullptr) {
+                        map_frames(s, index, number_workers, data_reader);
+                        for (int i = 0; i < number_workers; ++i) {
+                                task_handle[i] = NULL;
+                        }
+                } else
+#ifdef HAVE_LIBURING
+                if (s->use_uring) {
+                        struct processed_entry *entries[BUFFER_LEN_MAX];
+                        uring_read_frames(s, index, number_workers, entries);
+                        for (int i = 0; i < number_workers; ++i) {
+                                data_reader[i].entry = entries[i];
+                                task_handle[i] = NULL;
+                        }
+                } else
+#endif
                 // run workers
                 for (int i = 0; i < number_workers; ++i) {
                         struct video_reader_data *data =
                                 &data_reader[i];
                         data->o_direct = s->o_direct;
+                        data->container = s->container.empty() ? nullptr : s->container.c_str();
+                        data->container_tiles = s->container.empty() ? nullptr
+                                : &s->container_index[(index + i * s->decimation) * s->video_desc.tile_count];
                         data->tile_count = s->video_desc.tile_count;
                         data->tile_delim = s->tile_delim;
                         snprintf(data->file_name_prefix, sizeof(data->file_name_prefix),
-                                        "%s/%08ld", s->directory, index + i + 1);
+                                        "%s/%08ld", s->directory, index + i * s->decimation + 1);
                         strncpy(data->file_name_suffix,
                                         get_codec_file_extension(s->video_desc.color_spec),
                                         sizeof(data->file_name_suffix));
@@ -976,9 +1374,9 @@ static void * video_reading_thread(void *args)
 
                 // wait for workers to finish
                 for (int i = 0; i < number_workers; ++i) {
-                        struct video_reader_data *data =
-                                (struct video_reader_data *)
-                                wait_task(task_handle[i]);
+                        struct video_reader_data *data = task_handle[i] == NULL ?
+                                &data_reader[i] :
+                                (struct video_reader_data *) wait_task(task_handle[i]);
                         if (!data || data->entry == NULL)
                                 continue;
                         {
@@ -995,7 +1393,7 @@ static void * video_reading_thread(void *args)
                                 s->boss_cv.notify_one();
                         }
                 }
-                index += number_workers;
+                index += number_workers * s->decimation;
         }
 
         return NULL;
@@ -1077,6 +1475,7 @@ vidcap_import_grab(void *state, struct audio_frame **audio)
                 s->worker_cv.notify_one();
 
                 ret = vf_alloc_desc(s->video_desc);
+                ret->fps /= s->decimation;
                 ret->callbacks.dispose = vidcap_import_dispose_video_frame;
                 ret->callbacks.dispose_udata = current;
                 for (unsigned int i = 0; i < s->video_desc.tile_count; ++i) {
@@ -1118,7 +1517,7 @@ vidcap_import_grab(void *state, struct audio_frame **audio)
         }
 
         gettimeofday(&cur_time, NULL);
-        while(tv_diff_usec(cur_time, s->prev_time) < 1000000.0 / s->video_desc.fps) {
+        while(tv_diff_usec(cur_time, s->prev_time) < 1000000.0 * s->decimation / s->video_desc.fps) {
                 gettimeofday(&cur_time, NULL);
         }
         //tv_add_usec(&s->prev_time, 1000000.0 / s->frame->fps);
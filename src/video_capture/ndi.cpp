@@ -51,10 +51,15 @@
 #include <algorithm>
 #include <array>
 #include <chrono>
+#include <condition_variable>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <queue>
 #include <string>
+#include <thread>
 #include <type_traits> // static_assert
+#include <vector>
 
 #include "audio/types.h"
 #include "audio/utils.h"
@@ -64,6 +69,10 @@
 #include "rang.hpp"
 #include "utils/color_out.h"
 #include "utils/macros.h" // OPTIMIZED_FOR
+#include "utils/misc.h"
+#include "utils/thread.h"
+#include "utils/video_frame_pool.h"
+#include "utils/worker.h"
 #include "video.h"
 #include "video_capture.h"
 
@@ -73,16 +82,24 @@
 
 static constexpr double DEFAULT_AUDIO_DIVISOR = 1;
 static constexpr const char *MOD_NAME = "[NDI cap.] ";
+static constexpr size_t MAX_QUEUE_LEN = 3;
+static constexpr unsigned MIN_ROWS_PER_THREAD = 32;
 
 using std::array;
+using std::condition_variable;
 using std::cout;
 using std::max;
 using std::min;
+using std::mutex;
+using std::queue;
 using std::string;
+using std::unique_lock;
+using std::vector;
 using std::chrono::duration_cast;
 using std::chrono::steady_clock;
 
 static void vidcap_ndi_done(void *state);
+static void receiver_loop(struct vidcap_state_ndi *s);
 
 struct vidcap_state_ndi {
         static_assert(NDILIB_CPP_DEFAULT_CONSTRUCTORS == 0, "Don't use default C++ NDI constructors - we are using run-time dynamic lib load");
@@ -108,6 +125,16 @@ struct vidcap_state_ndi {
         /// sample divisor derived from audio reference level - 1 for 0 dB, 10 for 20 dB
         double audio_divisor = DEFAULT_AUDIO_DIVISOR; // NOLINT
 
+        video_frame_pool pool{0, *frame_pool_allocator_for("capture")}; ///< for converted frames
+
+        /// frames are received and converted by receiver_thread to not block grab
+        std::thread receiver_thread;
+        mutex lock; ///< protects video_queue, audio, should_exit
+        condition_variable frame_ready;
+        queue<struct video_frame *> video_queue;
+        bool should_exit = false;
+        long long dropped = 0;
+
         void print_stats() {
                 auto now = steady_clock::now();
                 double seconds = duration_cast<std::chrono::microseconds>(now - t0).count() / 1000000.0;
@@ -259,6 +286,8 @@ static int vidcap_ndi_init(struct vidcap_params *params, void **state)
                 return VIDCAP_INIT_NOERR;
         }
 
+        s->receiver_thread = std::thread(receiver_loop, s);
+
         *state = s;
         return VIDCAP_INIT_OK;
 }
@@ -267,6 +296,21 @@ static void vidcap_ndi_done(void *state)
 {
         auto s = static_cast<struct vidcap_state_ndi *>(state);
 
+        if (s->receiver_thread.joinable()) {
+                {
+                        unique_lock<mutex> lk(s->lock);
+                        s->should_exit = true;
+                }
+                s->receiver_thread.join();
+        }
+        while (!s->video_queue.empty()) {
+                VIDEO_FRAME_DISPOSE(s->video_queue.front());
+                s->video_queue.pop();
+        }
+        if (s->dropped > 0) {
+                LOG(LOG_LEVEL_INFO) << MOD_NAME << s->dropped << " frames dropped (not grabbed in time).\n";
+        }
+
         for (auto & i : s->audio) {
                 free(i.data);
         }
@@ -309,7 +353,8 @@ static void audio_append_pcm(struct vidcap_state_ndi *s, NDIlib_audio_frame_v3_t
 
         for (int i = 0; i < frame->no_samples; ++i) {
                 float *in = (float *)(void *) frame->p_data + i;
-                int32_t *out = (int32_t *)(void *) s->audio[s->audio_buf_idx].data + i * d.ch_count;
+                // appended - multiple NDI frames may be collected before grab
+                int32_t *out = (int32_t *)(void *) (s->audio[s->audio_buf_idx].data + s->audio[s->audio_buf_idx].data_len);
                 int j = 0;
                 for (; j < min(d.ch_count, frame->no_channels); ++j) {
                         if (s->audio[s->audio_buf_idx].data_len >= s->audio[s->audio_buf_idx].max_size) {
@@ -357,54 +402,89 @@ static const NDIlib_source_t *get_matching_source(struct vidcap_state_ndi *s, co
         return nullptr;
 }
 
-using convert_t = void (*)(struct video_frame *, const uint8_t *, int in_stride, int field_idx, int total_fields);
+/// converts field rows [row_start, row_end) of field field_idx (out of total_fields)
+using convert_t = void (*)(struct video_frame *, const uint8_t *, int in_stride, int field_idx, int total_fields,
+                unsigned row_start, unsigned row_end);
 
-static void convert_BGRA_RGBA(struct video_frame *out, const uint8_t *data, int in_stride, int field_idx, int total_fields)
+static void convert_BGRA_RGBA(struct video_frame *out, const uint8_t *data, int in_stride, int field_idx, int total_fields,
+                unsigned row_start, unsigned row_end)
 {
-        auto *out_p = reinterpret_cast<uint32_t *>(out->tiles[0].data) + field_idx * out->tiles[0].width;
-        for (unsigned int i = 0; i < out->tiles[0].height; i += total_fields) {
+        unsigned int width = out->tiles[0].width;
+        for (unsigned int i = row_start; i < row_end; ++i) {
                 const auto *in_p = reinterpret_cast<const uint32_t *>(data + i * in_stride);
-                unsigned int width = out->tiles[0].width;
+                auto *out_p = reinterpret_cast<uint32_t *>(out->tiles[0].data) + (i * total_fields + field_idx) * width;
                 OPTIMIZED_FOR (unsigned int j = 0; j < width; j++) {
                         uint32_t argb = *in_p++;
                         *out_p++ = (argb & 0xFF000000U) | ((argb & 0xFFU) << 16U) | (argb & 0xFF00U) | ((argb & 0xFF0000U) >> 16U);
                 }
-                out_p += (total_fields - 1) * out->tiles[0].width;
         }
 }
 
-static void convert_P216_Y216(struct video_frame *out, const uint8_t *data, [[maybe_unused]] int in_stride, int field_idx, int total_fields)
+static void convert_P216_Y216(struct video_frame *out, const uint8_t *data, [[maybe_unused]] int in_stride, int field_idx, int total_fields,
+                unsigned row_start, unsigned row_end)
 {
-        const auto *in_y = reinterpret_cast<const uint16_t *>(data);
-        const auto *in_cb_cr = reinterpret_cast<const uint16_t *>(data) + out->tiles[0].width * out->tiles[0].height;
-        auto *out_p = reinterpret_cast<uint16_t *>(out->tiles[0].data) + 2 * field_idx * out->tiles[0].width;
-        for (unsigned int i = 0; i < out->tiles[0].height;  i += total_fields) {
-                unsigned int width = out->tiles[0].width;
+        unsigned int width = out->tiles[0].width;
+        const size_t in_row_len = (width + 1) / 2 * 2;
+        const auto *in_cb_cr_plane = reinterpret_cast<const uint16_t *>(data) + (size_t) width * (out->tiles[0].height / total_fields);
+        for (unsigned int i = row_start; i < row_end; ++i) {
+                const auto *in_y = reinterpret_cast<const uint16_t *>(data) + i * in_row_len;
+                const auto *in_cb_cr = in_cb_cr_plane + i * in_row_len;
+                auto *out_p = reinterpret_cast<uint16_t *>(out->tiles[0].data) + 2 * (i * total_fields + field_idx) * width;
                 OPTIMIZED_FOR (unsigned int j = 0; j < (width + 1) / 2; j += 1) {
                         *out_p++ = *in_y++;
                         *out_p++ = *in_cb_cr++;
                         *out_p++ = *in_y++;
                         *out_p++ = *in_cb_cr++;
                 }
-                out_p += (total_fields - 1) * out->tiles[0].width * 2;
         }
 }
 
-static void convert_memcpy(struct video_frame *out, const uint8_t *data, int in_stride, int field_idx, int total_fields)
+static void convert_memcpy(struct video_frame *out, const uint8_t *data, int in_stride, int field_idx, int total_fields,
+                unsigned row_start, unsigned row_end)
 {
         size_t linesize = vc_get_linesize(out->tiles[0].width, out->color_spec);
-        auto *out_p = out->tiles[0].data + field_idx * linesize;
-        for (unsigned int i = 0; i < out->tiles[0].height; i += total_fields) {
-                memcpy(out_p, data, linesize);
-                out_p += total_fields * linesize;
-                data += in_stride;
+        for (unsigned int i = row_start; i < row_end; ++i) {
+                memcpy(out->tiles[0].data + (i * total_fields + field_idx) * linesize, data + i * in_stride, linesize);
         }
 }
 
-static struct video_frame *vidcap_ndi_grab(void *state, struct audio_frame **audio)
+struct convert_job {
+        convert_t convert;
+        struct video_frame *out;
+        const uint8_t *data;
+        int in_stride;
+        int field_idx;
+        int total_fields;
+        unsigned row_start;
+        unsigned row_end;
+};
+
+static void *convert_task(void *arg)
 {
-        auto s = static_cast<struct vidcap_state_ndi *>(state);
+        auto *j = static_cast<convert_job *>(arg);
+        j->convert(j->out, j->data, j->in_stride, j->field_idx, j->total_fields, j->row_start, j->row_end);
+        return nullptr;
+}
+
+/// runs convert on row bands in parallel
+static void convert_parallel(convert_t convert, struct video_frame *out, const uint8_t *data, int in_stride, int field_idx, int total_fields)
+{
+        const unsigned rows = out->tiles[0].height / total_fields;
+        const int threads = max<int>(1, min<int>(get_cpu_core_count(), rows / MIN_ROWS_PER_THREAD));
+        vector<convert_job> jobs(threads);
+        for (int i = 0; i < threads; ++i) {
+                jobs[i] = { convert, out, data, in_stride, field_idx, total_fields,
+                        (unsigned) (rows * i / threads), (unsigned) (rows * (i + 1) / threads) };
+        }
+        task_run_parallel(convert_task, threads, jobs.data(), sizeof jobs[0], nullptr);
+}
 
+/**
+ * Receives and (if needed) converts a frame, audio is appended to s->audio.
+ * Runs in receiver_thread.
+ */
+static struct video_frame *ndi_receive(struct vidcap_state_ndi *s)
+{
         if (s->pNDI_find == nullptr) {
                 // Create a finder
                 s->pNDI_find = s->NDIlib->find_create_v2(&s->find_create_settings);
@@ -512,6 +592,9 @@ static struct video_frame *vidcap_ndi_grab(void *state, struct audio_frame **aud
                                 LOG(LOG_LEVEL_WARNING) << MOD_NAME << "Receiving 16-bit YCbCr, if not needed, consider using \"color=\" "
                                         "option to reduce required processing power.\n";
                         }
+                        if (!is_codec_opaque(out_desc.color_spec)) {
+                                s->pool.reconfigure(out_desc);
+                        }
                 }
 
                 if (video_frame.frame_format_type == NDIlib_frame_format_type_field_0) {
@@ -525,23 +608,22 @@ static struct video_frame *vidcap_ndi_grab(void *state, struct audio_frame **aud
                 }
 
                 if (convert != nullptr) {
-                        out = vf_alloc_desc_data(out_desc);
+                        out = s->pool.get_disposable_frame();
                         int stride = video_frame.line_stride_in_bytes != 0 ? video_frame.line_stride_in_bytes : vc_get_linesize(video_frame.xres, out_desc.color_spec);
                         int field_count = video_frame.frame_format_type == NDIlib_frame_format_type_field_1 ? 2 : 1;
                         if (field_count > 1) {
                                 if (s->field_0.p_data == nullptr) {
                                         LOG(LOG_LEVEL_WARNING) << MOD_NAME << "Missing corresponding field!\n";
                                 } else {
-                                        convert(out, s->field_0.p_data, stride, 0, field_count);
+                                        convert_parallel(convert, out, s->field_0.p_data, stride, 0, field_count);
                                         s->NDIlib->recv_free_video_v2(s->pNDI_recv, &s->field_0);
                                         s->field_0 = NDIlib_video_frame_v2_t{};
                                 }
-                                convert(out, video_frame.p_data, stride, 1, field_count);
+                                convert_parallel(convert, out, video_frame.p_data, stride, 1, field_count);
                         } else {
-                                convert(out, video_frame.p_data, stride, 0, 1);
+                                convert_parallel(convert, out, video_frame.p_data, stride, 0, 1);
                         }
                         s->NDIlib->recv_free_video_v2(s->pNDI_recv, &video_frame);
-                        out->callbacks.dispose = vf_free;
                 } else {
                         out = vf_alloc_desc(out_desc);
                         out->tiles[0].data = reinterpret_cast<char*>(video_frame.p_data);
@@ -568,13 +650,12 @@ static struct video_frame *vidcap_ndi_grab(void *state, struct audio_frame **aud
         }
                 // Audio data
         case NDIlib_frame_type_audio:
-                *audio = nullptr;
                 if (s->capture_audio) {
                         if (audio_frame.FourCC == NDIlib_FourCC_audio_type_FLTP) {
+                                unique_lock<mutex> lk(s->lock);
                                 audio_append_pcm(s, &audio_frame);
-                                *audio = &s->audio[s->audio_buf_idx];
-                                s->audio_buf_idx = (s->audio_buf_idx + 1) % 2;
-                                s->audio[s->audio_buf_idx].data_len = 0;
+                                lk.unlock();
+                                s->frame_ready.notify_one();
                         } else {
                                 LOG(LOG_LEVEL_ERROR) << MOD_NAME << "Unsupported audio codec 0x" << std::hex << audio_frame.FourCC << std::dec << ", please report!\n";
                         }
@@ -599,6 +680,55 @@ static struct video_frame *vidcap_ndi_grab(void *state, struct audio_frame **aud
         return nullptr;
 }
 
+static void receiver_loop(struct vidcap_state_ndi *s)
+{
+        set_thread_name("ndi_receiver");
+        while (true) {
+                {
+                        unique_lock<mutex> lk(s->lock);
+                        if (s->should_exit) {
+                                break;
+                        }
+                }
+                struct video_frame *f = ndi_receive(s);
+                if (f == nullptr) {
+                        continue;
+                }
+                unique_lock<mutex> lk(s->lock);
+                if (s->video_queue.size() >= MAX_QUEUE_LEN) { // drop the oldest, releasing the NDI buffer
+                        VIDEO_FRAME_DISPOSE(s->video_queue.front());
+                        s->video_queue.pop();
+                        s->dropped += 1;
+                }
+                s->video_queue.push(f);
+                lk.unlock();
+                s->frame_ready.notify_one();
+        }
+}
+
+static struct video_frame *vidcap_ndi_grab(void *state, struct audio_frame **audio)
+{
+        auto s = static_cast<struct vidcap_state_ndi *>(state);
+        struct video_frame *out = nullptr;
+        *audio = nullptr;
+
+        unique_lock<mutex> lk(s->lock);
+        s->frame_ready.wait_for(lk, std::chrono::milliseconds(200), [s] {
+                return !s->video_queue.empty() || s->audio[s->audio_buf_idx].data_len > 0;
+        });
+        if (!s->video_queue.empty()) {
+                out = s->video_queue.front();
+                s->video_queue.pop();
+        }
+        if (s->audio[s->audio_buf_idx].data_len > 0) {
+                *audio = &s->audio[s->audio_buf_idx];
+                s->audio_buf_idx = (s->audio_buf_idx + 1) % 2;
+                s->audio[s->audio_buf_idx].data_len = 0;
+        }
+
+        return out;
+}
+
 static struct vidcap_type *vidcap_ndi_probe(bool verbose, void (**deleter)(void *))
 {
         *deleter = free;
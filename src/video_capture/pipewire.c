@@ -0,0 +1,687 @@
+/**
+ * @file   video_capture/pipewire.c
+ * @brief  PipeWire screen capture (Wayland) using xdg-desktop-portal
+ *
+ * The screencast session is negotiated with org.freedesktop.portal.ScreenCast
+ * (the user selects the screen or window in the compositor dialog), frames
+ * are then received from the PipeWire node given by the portal. Alternatively,
+ * a PipeWire node can be given directly with the "node" option.
+ *
+ * Buffers in RGBx/RGBA with packed lines are passed to the pipeline without
+ * copying and returned to PipeWire when the frame is disposed, other layouts
+ * are converted to a pooled frame.
+ *
+ * @todo
+ * DMA-BUF buffers are not negotiated - there is currently no way to pass them
+ * through the pipeline.
+ */
+/*
+ * Copyright (c) 2022 CESNET, z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <fcntl.h>
+#include <gio/gio.h>
+#include <gio/gunixfdlist.h>
+#include <inttypes.h>
+#include <pipewire/pipewire.h>
+#include <pthread.h>
+#include <spa/debug/types.h>
+#include <spa/param/video/format-utils.h>
+#include <spa/param/video/type-info.h>
+#include <spa/utils/result.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include "lib_common.h"
+#include "utils/color_out.h"
+#include "utils/macros.h"
+#include "utils/video_frame_pool.h"
+#include "video.h"
+#include "video_capture.h"
+
+#define MOD_NAME "[PipeWire cap.] "
+#define PORTAL_BUS_NAME "org.freedesktop.portal.Desktop"
+#define PORTAL_OBJECT_PATH "/org/freedesktop/portal/desktop"
+#define PORTAL_SCREENCAST_IFACE "org.freedesktop.portal.ScreenCast"
+#define GRAB_TIMEOUT_MS 100
+#define POOL_FRAMES 3
+
+struct vidcap_pipewire_state {
+        // portal
+        GDBusConnection *conn;
+        char *sender; ///< unique bus name in form used in request object paths
+        char *session_handle;
+        int request_counter;
+        int pw_fd;
+        uint32_t node_id; ///< PW_ID_ANY if not specified
+
+        // PipeWire
+        struct pw_thread_loop *loop;
+        struct pw_context *context;
+        struct pw_core *core;
+        struct pw_stream *stream;
+        struct spa_hook stream_listener;
+        int fps;
+
+        pthread_mutex_t lock;
+        pthread_cond_t cv;
+        struct pw_buffer *pending; ///< newest buffer not yet grabbed
+        int outstanding; ///< buffers passed to the pipeline without copy
+        struct spa_video_info_raw format;
+        bool format_changed;
+
+        struct video_desc desc;
+        void *pool;
+
+        struct timespec t0;
+        int frames;
+};
+
+struct pipewire_frame_udata {
+        struct vidcap_pipewire_state *s;
+        struct pw_buffer *buffer;
+};
+
+static void show_help(void)
+{
+        printf("PipeWire screen capture\n");
+        printf("Usage\n");
+        color_printf(TERM_BOLD TERM_FG_RED "\t-t pipewire" TERM_FG_RESET "[:fps=<fps>][:node=<id>] | -t pipewire:help\n" TERM_RESET);
+        printf("where\n");
+        color_printf(TERM_BOLD "\tfps" TERM_RESET " - requested frame rate (default 60)\n");
+        color_printf(TERM_BOLD "\tnode" TERM_RESET " - capture from given PipeWire node instead of asking xdg-desktop-portal for a screencast\n");
+}
+
+/*  ____            _        _
+ * |  _ \ ___  _ __| |_ __ _| |
+ * | |_) / _ \| '__| __/ _` | |
+ * |  __/ (_) | |  | || (_| | |
+ * |_|   \___/|_|   \__\__,_|_|
+ */
+struct portal_response {
+        GMainLoop *loop;
+        uint32_t code;
+        GVariant *results;
+};
+
+static void on_portal_response(GDBusConnection *conn, const gchar *sender_name, const gchar *object_path,
+                const gchar *interface_name, const gchar *signal_name, GVariant *parameters, gpointer user_data)
+{
+        UNUSED(conn), UNUSED(sender_name), UNUSED(object_path), UNUSED(interface_name), UNUSED(signal_name);
+        struct portal_response *r = user_data;
+        g_variant_get(parameters, "(u@a{sv})", &r->code, &r->results);
+        g_main_loop_quit(r->loop);
+}
+
+/// initializes options dictionary with a new handle_token (written to token)
+static void portal_init_options(struct vidcap_pipewire_state *s, GVariantBuilder *opts, char *token, size_t token_len)
+{
+        snprintf(token, token_len, "ultragrid%d", ++s->request_counter);
+        g_variant_builder_init(opts, G_VARIANT_TYPE_VARDICT);
+        g_variant_builder_add(opts, "{sv}", "handle_token", g_variant_new_string(token));
+}
+
+/**
+ * Calls ScreenCast portal method and waits for the response of the created request.
+ * @returns results dictionary (to be unrefed by caller) or NULL on failure
+ */
+static GVariant *portal_request(struct vidcap_pipewire_state *s, const char *method, GVariant *params, const char *token)
+{
+        char request_path[512];
+        snprintf(request_path, sizeof request_path, PORTAL_OBJECT_PATH "/request/%s/%s", s->sender, token);
+        struct portal_response resp = { g_main_loop_new(NULL, FALSE), 2, NULL };
+        guint sub = g_dbus_connection_signal_subscribe(s->conn, PORTAL_BUS_NAME, "org.freedesktop.portal.Request",
+                        "Response", request_path, NULL, G_DBUS_SIGNAL_FLAGS_NONE, on_portal_response, &resp, NULL);
+
+        GError *err = NULL;
+        GVariant *ret = g_dbus_connection_call_sync(s->conn, PORTAL_BUS_NAME, PORTAL_OBJECT_PATH, PORTAL_SCREENCAST_IFACE,
+                        method, params, NULL, G_DBUS_CALL_FLAGS_NONE, -1, NULL, &err);
+        if (ret == NULL) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "%s failed: %s\n", method, err->message);
+                g_error_free(err);
+        } else {
+                g_variant_unref(ret);
+                g_main_loop_run(resp.loop);
+        }
+        g_dbus_connection_signal_unsubscribe(s->conn, sub);
+        g_main_loop_unref(resp.loop);
+
+        if (ret != NULL && resp.code != 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "%s %s\n", method, resp.code == 1 ? "cancelled by user" : "failed");
+        }
+        if (ret == NULL || resp.code != 0) {
+                if (resp.results) {
+                        g_variant_unref(resp.results);
+                }
+                return NULL;
+        }
+        return resp.results;
+}
+
+static uint32_t portal_get_cursor_modes(struct vidcap_pipewire_state *s)
+{
+        GVariant *ret = g_dbus_connection_call_sync(s->conn, PORTAL_BUS_NAME, PORTAL_OBJECT_PATH,
+                        "org.freedesktop.DBus.Properties", "Get",
+                        g_variant_new("(ss)", PORTAL_SCREENCAST_IFACE, "AvailableCursorModes"),
+                        G_VARIANT_TYPE("(v)"), G_DBUS_CALL_FLAGS_NONE, -1, NULL, NULL);
+        if (ret == NULL) {
+                return 0;
+        }
+        GVariant *val = NULL;
+        g_variant_get(ret, "(v)", &val);
+        uint32_t modes = g_variant_is_of_type(val, G_VARIANT_TYPE_UINT32) ? g_variant_get_uint32(val) : 0;
+        g_variant_unref(val);
+        g_variant_unref(ret);
+        return modes;
+}
+
+/**
+ * Creates screencast session, lets the user select the source and opens
+ * PipeWire remote for it (s->pw_fd, s->node_id).
+ */
+static bool portal_open(struct vidcap_pipewire_state *s)
+{
+        GError *err = NULL;
+        s->conn = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, &err);
+        if (s->conn == NULL) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot connect to session bus: %s\n", err->message);
+                g_error_free(err);
+                return false;
+        }
+        s->sender = strdup(g_dbus_connection_get_unique_name(s->conn) + 1); // skip leading ':'
+        for (char *c = s->sender; *c != '\0'; ++c) {
+                if (*c == '.') {
+                        *c = '_';
+                }
+        }
+
+        char token[64];
+        GVariantBuilder opts;
+        portal_init_options(s, &opts, token, sizeof token);
+        g_variant_builder_add(&opts, "{sv}", "session_handle_token", g_variant_new_string("ultragrid"));
+        GVariant *res = portal_request(s, "CreateSession", g_variant_new("(a{sv})", &opts), token);
+        if (res == NULL) {
+                return false;
+        }
+        const char *session_handle = NULL;
+        if (g_variant_lookup(res, "session_handle", "&s", &session_handle)) {
+                s->session_handle = strdup(session_handle);
+        }
+        g_variant_unref(res);
+        if (s->session_handle == NULL) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "No session handle returned!\n");
+                return false;
+        }
+
+        portal_init_options(s, &opts, token, sizeof token);
+        g_variant_builder_add(&opts, "{sv}", "types", g_variant_new_uint32(1 | 2)); // monitor | window
+        g_variant_builder_add(&opts, "{sv}", "multiple", g_variant_new_boolean(FALSE));
+        if ((portal_get_cursor_modes(s) & 2) != 0) {
+                g_variant_builder_add(&opts, "{sv}", "cursor_mode", g_variant_new_uint32(2)); // embedded
+        }
+        res = portal_request(s, "SelectSources", g_variant_new("(oa{sv})", s->session_handle, &opts), token);
+        if (res == NULL) {
+                return false;
+        }
+        g_variant_unref(res);
+
+        portal_init_options(s, &opts, token, sizeof token);
+        res = portal_request(s, "Start", g_variant_new("(osa{sv})", s->session_handle, "", &opts), token);
+        if (res == NULL) {
+                return false;
+        }
+        GVariant *streams = g_variant_lookup_value(res, "streams", G_VARIANT_TYPE("a(ua{sv})"));
+        bool have_stream = false;
+        if (streams != NULL) {
+                GVariantIter iter;
+                GVariant *props = NULL;
+                g_variant_iter_init(&iter, streams);
+                if (g_variant_iter_next(&iter, "(u@a{sv})", &s->node_id, &props)) {
+                        have_stream = true;
+                        g_variant_unref(props);
+                }
+                g_variant_unref(streams);
+        }
+        g_variant_unref(res);
+        if (!have_stream) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "No stream returned by the portal!\n");
+                return false;
+        }
+
+        g_variant_builder_init(&opts, G_VARIANT_TYPE_VARDICT);
+        GUnixFDList *fd_list = NULL;
+        GVariant *ret = g_dbus_connection_call_with_unix_fd_list_sync(s->conn, PORTAL_BUS_NAME, PORTAL_OBJECT_PATH,
+                        PORTAL_SCREENCAST_IFACE, "OpenPipeWireRemote", g_variant_new("(oa{sv})", s->session_handle, &opts),
+                        G_VARIANT_TYPE("(h)"), G_DBUS_CALL_FLAGS_NONE, -1, NULL, &fd_list, NULL, &err);
+        if (ret == NULL) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "OpenPipeWireRemote failed: %s\n", err->message);
+                g_error_free(err);
+                return false;
+        }
+        gint32 fd_idx = 0;
+        g_variant_get(ret, "(h)", &fd_idx);
+        g_variant_unref(ret);
+        s->pw_fd = g_unix_fd_list_get(fd_list, fd_idx, &err);
+        g_object_unref(fd_list);
+        if (s->pw_fd == -1) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot get PipeWire fd: %s\n", err->message);
+                g_error_free(err);
+                return false;
+        }
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Portal returned node %" PRIu32 "\n", s->node_id);
+        return true;
+}
+
+static void portal_close(struct vidcap_pipewire_state *s)
+{
+        if (s->conn != NULL && s->session_handle != NULL) {
+                GVariant *ret = g_dbus_connection_call_sync(s->conn, PORTAL_BUS_NAME, s->session_handle,
+                                "org.freedesktop.portal.Session", "Close", NULL, NULL, G_DBUS_CALL_FLAGS_NONE, -1, NULL, NULL);
+                if (ret) {
+                        g_variant_unref(ret);
+                }
+        }
+        if (s->conn != NULL) {
+                g_object_unref(s->conn);
+        }
+        free(s->sender);
+        free(s->session_handle);
+}
+
+/*  ____  _           __        ___
+ * |  _ \(_)_ __   ___\ \      / (_)_ __ ___
+ * | |_) | | '_ \ / _ \\ \ /\ / /| | '__/ _ \
+ * |  __/| | |_) |  __/ \ V  V / | | | |  __/
+ * |_|   |_| .__/ \___|  \_/\_/  |_|_|  \___|
+ *         |_|
+ */
+static void on_param_changed(void *data, uint32_t id, const struct spa_pod *param)
+{
+        struct vidcap_pipewire_state *s = data;
+        if (param == NULL || id != SPA_PARAM_Format) {
+                return;
+        }
+        struct spa_video_info_raw info;
+        if (spa_format_video_raw_parse(param, &info) < 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot parse negotiated format!\n");
+                return;
+        }
+        log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Negotiated %" PRIu32 "x%" PRIu32 " @%" PRIu32 "/%" PRIu32 ", format %s\n",
+                        info.size.width, info.size.height, info.framerate.num, info.framerate.denom,
+                        spa_debug_type_find_short_name(spa_type_video_format, info.format));
+
+        pthread_mutex_lock(&s->lock);
+        s->format = info;
+        s->format_changed = true;
+        pthread_mutex_unlock(&s->lock);
+
+        uint8_t buffer[1024];
+        struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+        const struct spa_pod *params[1];
+        params[0] = spa_pod_builder_add_object(&b,
+                        SPA_TYPE_OBJECT_ParamBuffers, SPA_PARAM_Buffers,
+                        SPA_PARAM_BUFFERS_buffers, SPA_POD_CHOICE_RANGE_Int(POOL_FRAMES + 2, 2, 16),
+                        SPA_PARAM_BUFFERS_dataType, SPA_POD_Int((1 << SPA_DATA_MemPtr) | (1 << SPA_DATA_MemFd)));
+        pw_stream_update_params(s->stream, params, 1);
+}
+
+static void on_state_changed(void *data, enum pw_stream_state old, enum pw_stream_state state, const char *error)
+{
+        UNUSED(data), UNUSED(old);
+        log_msg(state == PW_STREAM_STATE_ERROR ? LOG_LEVEL_ERROR : LOG_LEVEL_VERBOSE, MOD_NAME "Stream state: %s%s%s\n",
+                        pw_stream_state_as_string(state), error ? " - " : "", error ? error : "");
+}
+
+/// keeps only the newest buffer, older unprocessed one is returned to PipeWire
+static void on_process(void *data)
+{
+        struct vidcap_pipewire_state *s = data;
+        struct pw_buffer *b = NULL;
+        struct pw_buffer *next = NULL;
+        while ((next = pw_stream_dequeue_buffer(s->stream)) != NULL) {
+                if (b != NULL) {
+                        pw_stream_queue_buffer(s->stream, b);
+                }
+                b = next;
+        }
+        if (b == NULL) {
+                return;
+        }
+        struct spa_data *d = &b->buffer->datas[0];
+        if (d->data == NULL || d->chunk->size == 0 || (d->chunk->flags & SPA_CHUNK_FLAG_CORRUPTED) != 0) {
+                pw_stream_queue_buffer(s->stream, b);
+                return;
+        }
+
+        pthread_mutex_lock(&s->lock);
+        struct pw_buffer *old = s->pending;
+        s->pending = b;
+        pthread_mutex_unlock(&s->lock);
+        pthread_cond_signal(&s->cv);
+        if (old != NULL) {
+                pw_stream_queue_buffer(s->stream, old);
+        }
+}
+
+static const struct pw_stream_events stream_events = {
+        .version = PW_VERSION_STREAM_EVENTS,
+        .state_changed = on_state_changed,
+        .param_changed = on_param_changed,
+        .process = on_process,
+};
+
+static bool pipewire_connect(struct vidcap_pipewire_state *s)
+{
+        s->loop = pw_thread_loop_new("ug-pipewire", NULL);
+        s->context = pw_context_new(pw_thread_loop_get_loop(s->loop), NULL, 0);
+        if (pw_thread_loop_start(s->loop) != 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot start PipeWire loop!\n");
+                return false;
+        }
+        pw_thread_loop_lock(s->loop);
+        if (s->pw_fd != -1) {
+                s->core = pw_context_connect_fd(s->context, fcntl(s->pw_fd, F_DUPFD_CLOEXEC, 3), NULL, 0);
+        } else {
+                s->core = pw_context_connect(s->context, NULL, 0);
+        }
+        if (s->core == NULL) {
+                pw_thread_loop_unlock(s->loop);
+                log_perror(LOG_LEVEL_ERROR, MOD_NAME "Cannot connect to PipeWire");
+                return false;
+        }
+        s->stream = pw_stream_new(s->core, "UltraGrid", pw_properties_new(PW_KEY_MEDIA_TYPE, "Video",
+                                PW_KEY_MEDIA_CATEGORY, "Capture", PW_KEY_MEDIA_ROLE, "Screen", NULL));
+        pw_stream_add_listener(s->stream, &s->stream_listener, &stream_events, s);
+
+        uint8_t buffer[1024];
+        struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+        const struct spa_pod *params[1];
+        struct spa_rectangle def_size = SPA_RECTANGLE(1920, 1080);
+        struct spa_rectangle min_size = SPA_RECTANGLE(1, 1);
+        struct spa_rectangle max_size = SPA_RECTANGLE(16384, 16384);
+        struct spa_fraction def_fps = SPA_FRACTION(s->fps, 1);
+        struct spa_fraction min_fps = SPA_FRACTION(0, 1);
+        struct spa_fraction max_fps = SPA_FRACTION(1000, 1);
+        params[0] = spa_pod_builder_add_object(&b,
+                        SPA_TYPE_OBJECT_Format, SPA_PARAM_EnumFormat,
+                        SPA_FORMAT_mediaType, SPA_POD_Id(SPA_MEDIA_TYPE_video),
+                        SPA_FORMAT_mediaSubtype, SPA_POD_Id(SPA_MEDIA_SUBTYPE_raw),
+                        SPA_FORMAT_VIDEO_format, SPA_POD_CHOICE_ENUM_Id(5, SPA_VIDEO_FORMAT_RGBx,
+                                SPA_VIDEO_FORMAT_RGBx, SPA_VIDEO_FORMAT_RGBA, SPA_VIDEO_FORMAT_BGRx, SPA_VIDEO_FORMAT_BGRA),
+                        SPA_FORMAT_VIDEO_size, SPA_POD_CHOICE_RANGE_Rectangle(&def_size, &min_size, &max_size),
+                        SPA_FORMAT_VIDEO_framerate, SPA_POD_CHOICE_RANGE_Fraction(&def_fps, &min_fps, &max_fps));
+
+        int ret = pw_stream_connect(s->stream, PW_DIRECTION_INPUT, s->node_id,
+                        PW_STREAM_FLAG_AUTOCONNECT | PW_STREAM_FLAG_MAP_BUFFERS, params, 1);
+        pw_thread_loop_unlock(s->loop);
+        if (ret < 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot connect stream: %s\n", spa_strerror(ret));
+                return false;
+        }
+        return true;
+}
+
+static void vidcap_pipewire_done(void *state)
+{
+        struct vidcap_pipewire_state *s = state;
+
+        if (s->loop) {
+                pw_thread_loop_lock(s->loop);
+                if (s->stream) {
+                        pw_stream_set_active(s->stream, false);
+                }
+                pw_thread_loop_unlock(s->loop);
+        }
+        // wait for the zero-copy frames to return their buffers
+        pthread_mutex_lock(&s->lock);
+        while (s->outstanding > 0) {
+                pthread_cond_wait(&s->cv, &s->lock);
+        }
+        pthread_mutex_unlock(&s->lock);
+
+        if (s->loop) {
+                pw_thread_loop_stop(s->loop);
+                if (s->stream) {
+                        pw_stream_destroy(s->stream);
+                }
+                if (s->core) {
+                        pw_core_disconnect(s->core);
+                }
+                if (s->context) {
+                        pw_context_destroy(s->context);
+                }
+                pw_thread_loop_destroy(s->loop);
+        }
+        if (s->pool) {
+                video_frame_pool_destroy(s->pool);
+        }
+        if (s->pw_fd != -1) {
+                close(s->pw_fd);
+        }
+        portal_close(s);
+        pthread_cond_destroy(&s->cv);
+        pthread_mutex_destroy(&s->lock);
+        free(s);
+        pw_deinit();
+}
+
+static int vidcap_pipewire_init(struct vidcap_params *params, void **state)
+{
+        if (vidcap_params_get_flags(params) & VIDCAP_FLAG_AUDIO_ANY) {
+                return VIDCAP_INIT_AUDIO_NOT_SUPPOTED;
+        }
+        const char *fmt = vidcap_params_get_fmt(params);
+        if (strcmp(fmt, "help") == 0) {
+                show_help();
+                return VIDCAP_INIT_NOERR;
+        }
+
+        struct vidcap_pipewire_state *s = calloc(1, sizeof(struct vidcap_pipewire_state));
+        s->pw_fd = -1;
+        s->node_id = PW_ID_ANY;
+        s->fps = 60;
+        pthread_mutex_init(&s->lock, NULL);
+        pthread_cond_init(&s->cv, NULL);
+        pw_init(NULL, NULL);
+
+        bool node_given = false;
+        char *fmt_cpy = strdup(fmt);
+        char *tmp = fmt_cpy, *item = NULL, *save_ptr = NULL;
+        while ((item = strtok_r(tmp, ":", &save_ptr)) != NULL) {
+                tmp = NULL;
+                if (strstr(item, "fps=") == item) {
+                        s->fps = atoi(item + strlen("fps="));
+                } else if (strstr(item, "node=") == item) {
+                        s->node_id = atoi(item + strlen("node="));
+                        node_given = true;
+                } else {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unknown option: %s\n", item);
+                        free(fmt_cpy);
+                        vidcap_pipewire_done(s);
+                        return VIDCAP_INIT_FAIL;
+                }
+        }
+        free(fmt_cpy);
+
+        if ((!node_given && !portal_open(s)) || !pipewire_connect(s)) {
+                vidcap_pipewire_done(s);
+                return VIDCAP_INIT_FAIL;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &s->t0);
+        *state = s;
+        return VIDCAP_INIT_OK;
+}
+
+static void return_buffer(struct vidcap_pipewire_state *s, struct pw_buffer *b)
+{
+        pw_thread_loop_lock(s->loop);
+        pw_stream_queue_buffer(s->stream, b);
+        pw_thread_loop_unlock(s->loop);
+}
+
+static void vidcap_pipewire_dispose_frame(struct video_frame *frame)
+{
+        struct pipewire_frame_udata *udata = frame->callbacks.dispose_udata;
+        struct vidcap_pipewire_state *s = udata->s;
+        return_buffer(s, udata->buffer);
+        pthread_mutex_lock(&s->lock);
+        s->outstanding -= 1;
+        pthread_mutex_unlock(&s->lock);
+        pthread_cond_signal(&s->cv);
+        free(udata);
+        vf_free(frame);
+}
+
+static struct video_frame *vidcap_pipewire_grab(void *state, struct audio_frame **audio)
+{
+        struct vidcap_pipewire_state *s = state;
+        *audio = NULL;
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += GRAB_TIMEOUT_MS * 1000 * 1000;
+        deadline.tv_sec += deadline.tv_nsec / (1000 * 1000 * 1000);
+        deadline.tv_nsec %= 1000 * 1000 * 1000;
+
+        pthread_mutex_lock(&s->lock);
+        while (s->pending == NULL) {
+                if (pthread_cond_timedwait(&s->cv, &s->lock, &deadline) != 0) {
+                        break;
+                }
+        }
+        struct pw_buffer *b = s->pending;
+        s->pending = NULL;
+        struct spa_video_info_raw format = s->format;
+        bool format_changed = s->format_changed;
+        s->format_changed = false;
+        pthread_mutex_unlock(&s->lock);
+        if (b == NULL) {
+                return NULL;
+        }
+
+        if (format_changed) {
+                s->desc = (struct video_desc) { format.size.width, format.size.height, RGBA,
+                        format.framerate.denom != 0 ? (double) format.framerate.num / format.framerate.denom : s->fps,
+                        PROGRESSIVE, 1 };
+                if (s->desc.fps == 0) { // variable frame rate
+                        s->desc.fps = s->fps;
+                }
+                if (s->pool) {
+                        video_frame_pool_destroy(s->pool);
+                }
+                s->pool = video_frame_pool_init(s->desc, POOL_FRAMES);
+        }
+
+        struct spa_data *d = &b->buffer->datas[0];
+        const unsigned char *src = (const unsigned char *) d->data + d->chunk->offset;
+        const int linesize = vc_get_linesize(s->desc.width, RGBA);
+        const int stride = d->chunk->stride != 0 ? d->chunk->stride : linesize;
+        const bool rgb_order = format.format == SPA_VIDEO_FORMAT_RGBx || format.format == SPA_VIDEO_FORMAT_RGBA;
+        if ((int) d->chunk->size < stride * (int) (s->desc.height - 1) + linesize) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Buffer too small!\n");
+                return_buffer(s, b);
+                return NULL;
+        }
+
+        struct video_frame *out = NULL;
+        if (rgb_order && stride == linesize) { // pass without copying
+                out = vf_alloc_desc(s->desc);
+                out->tiles[0].data = (char *) src;
+                out->tiles[0].data_len = linesize * s->desc.height;
+                struct pipewire_frame_udata *udata = malloc(sizeof *udata);
+                udata->s = s;
+                udata->buffer = b;
+                out->callbacks.dispose_udata = udata;
+                out->callbacks.dispose = vidcap_pipewire_dispose_frame;
+                pthread_mutex_lock(&s->lock);
+                s->outstanding += 1;
+                pthread_mutex_unlock(&s->lock);
+        } else {
+                out = video_frame_pool_get_disposable_frame(s->pool);
+                for (unsigned int y = 0; y < s->desc.height; ++y) {
+                        unsigned char *dst = (unsigned char *) out->tiles[0].data + y * linesize;
+                        if (rgb_order) {
+                                memcpy(dst, src + y * stride, linesize);
+                        } else {
+                                vc_copylineToRGBA_inplace(dst, src + y * stride, linesize, 16, 8, 0);
+                        }
+                }
+                return_buffer(s, b);
+        }
+
+        s->frames += 1;
+        struct timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        double seconds = (t.tv_sec - s->t0.tv_sec) + (t.tv_nsec - s->t0.tv_nsec) / 1e9;
+        if (seconds >= 5) {
+                log_msg(LOG_LEVEL_INFO, MOD_NAME "%d frames in %g seconds = %g FPS\n", s->frames, seconds, s->frames / seconds);
+                s->t0 = t;
+                s->frames = 0;
+        }
+
+        return out;
+}
+
+static struct vidcap_type *vidcap_pipewire_probe(bool verbose, void (**deleter)(void *))
+{
+        UNUSED(verbose);
+        *deleter = free;
+        struct vidcap_type *vt = calloc(1, sizeof(struct vidcap_type));
+        if (vt == NULL) {
+                return NULL;
+        }
+        vt->name        = "pipewire";
+        vt->description = "PipeWire screen capture";
+        return vt;
+}
+
+static const struct video_capture_info vidcap_pipewire_info = {
+        vidcap_pipewire_probe,
+        vidcap_pipewire_init,
+        vidcap_pipewire_done,
+        vidcap_pipewire_grab,
+        false
+};
+
+REGISTER_MODULE(pipewire, &vidcap_pipewire_info, LIBRARY_CLASS_VIDEO_CAPTURE, VIDEO_CAPTURE_ABI_VERSION);
+
+/* vim: set expandtab sw=8 tw=120: */
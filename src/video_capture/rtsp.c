@@ -68,7 +68,9 @@
 #include "rtp/rtp_callback.h"
 #include "rtp/rtpdec_h264.h"
 #include "rtsp/rtsp_utils.h"
+#include "utils/h264_stream.h"
 #include "utils/misc.h"
+#include "utils/video_frame_pool.h"
 #include "video_decompress.h"
 
 #include "pdb.h"
@@ -85,8 +87,11 @@
 #define VERSION_STR  "V1.0"
 
 //TODO set lower initial video recv buffer size (to find the minimal?)
+#define H264_OFFSET_BUFFER_LEN 2048 ///< buffer for parameter sets from SDP
 #define DEFAULT_VIDEO_FRAME_WIDTH 1920
 #define DEFAULT_VIDEO_FRAME_HEIGHT 1080
+#define RTSP_QUEUE_LEN 4 ///< max frames waiting in coded/decoded queue
+#define RTSP_POOL_LEN (2 * RTSP_QUEUE_LEN) ///< max idle coded frames kept for reuse
 #define INITIAL_VIDEO_RECV_BUFFER_SIZE  ((0.1*DEFAULT_VIDEO_FRAME_WIDTH*DEFAULT_VIDEO_FRAME_HEIGHT)*110/100) //command line net.core setup: sysctl -w net.core.rmem_max=9123840
 
 /* error handling macros */
@@ -139,7 +144,7 @@ static int
 rtsp_teardown(CURL *curl, const char *uri);
 
 static int
-get_nals(FILE *sdp_file, char *nals, int *width, int *height);
+get_nals(FILE *sdp_file, codec_t codec, char *nals, int *width, int *height);
 
 bool setup_codecs_and_controls_from_sdp(FILE *sdp_file, void *state);
 
@@ -166,6 +171,31 @@ static void vidcap_rtsp_done(void *state);
 
 static const uint8_t start_sequence[] = { 0, 0, 0, 1 };
 
+/// bounded FIFO of frames, protected by video_rtsp_state::lock
+struct rtsp_frame_queue {
+    struct video_frame *frames[RTSP_QUEUE_LEN];
+    int head;
+    int count;
+};
+
+/**
+ * Recycles the buffers of depacketized frames. Frames passed further (without
+ * decompress) return here when disposed, so the pool outlives the capture
+ * state until all of them are returned.
+ */
+struct rtsp_frame_pool {
+    pthread_mutex_t lock;
+    struct rtsp_buf *free_bufs[RTSP_POOL_LEN];
+    int free_count;
+    int refcount; ///< capture state + frames given out
+};
+
+struct rtsp_buf {
+    struct video_frame *frame;
+    unsigned buffer_len; ///< allocated length of frame data, see decode_data_h264::buffer_len
+    struct rtsp_frame_pool *pool;
+};
+
 /**
  * @struct rtsp_state
  */
@@ -173,7 +203,6 @@ struct video_rtsp_state {
     const char *codec;
 
     struct video_desc desc;
-    struct video_frame *out_frame;
 
     //struct std_frame_received *rx_data;
     bool decompress;
@@ -191,16 +220,23 @@ struct video_rtsp_state {
     char *mcast_if;
     int required_connections;
 
-    pthread_t vrtsp_thread_id; //the worker_id
+    pthread_t vrtsp_thread_id; ///< depacketizes received packets
+    pthread_t decode_thread_id; ///< decompresses if requested
 
     pthread_mutex_t lock;
-    pthread_cond_t worker_cv;
-    volatile bool worker_waiting;
-    pthread_cond_t boss_cv;
-    volatile bool boss_waiting;
+    pthread_cond_t worker_cv; ///< decode thread waits for coded frames
+    pthread_cond_t boss_cv;   ///< grab waits for output frames
+
+    struct rtsp_frame_pool *pool;
+    struct rtsp_frame_queue coded;   ///< depacketized frames
+    struct rtsp_frame_queue decoded; ///< decompressed frames (if decompress)
+    bool wait_for_intra;             ///< a coded frame was dropped, drop until next I-frame
+    long long dropped;
+    void *decompressed_pool;         ///< video_frame_pool for decompress output
 
     unsigned int h264_offset_len;
     unsigned char *h264_offset_buffer;
+    struct h264_sps_cache sps_cache; ///< accessed only by the depacketizing thread
 
     int pt;
 };
@@ -259,7 +295,8 @@ show_help() {
     printf("\t\t <uri> - RTSP server URI\n");
     printf("\t\t <port> - receiver port number \n");
     printf(
-        "\t\t decompress - decompress the stream (default: disabled)\n\n");
+        "\t\t decompress - decompress the stream (default: disabled), runs in a separate thread;\n"
+        "\t\t              use with \"--param use-hw-accel\" for hardware decoding (if available)\n\n");
 }
 
 static void *
@@ -294,58 +331,154 @@ int decode_frame_by_pt(struct coded_data *cdata, void *decode_data, struct pbuf_
     pckt = cdata->data;
     struct decode_data_h264 *d = (struct decode_data_h264 *) decode_data;
     if (pckt->pt == d->video_pt) {
-        return decode_frame_h264(cdata,decode_data);
+        return d->frame->color_spec == H265 ? decode_frame_hevc(cdata, decode_data)
+            : decode_frame_h264(cdata, decode_data);
     } else {
         error_msg("Wrong Payload type: %u\n", pckt->pt);
         return FALSE;
     }
 }
 
+static bool queue_push(struct rtsp_frame_queue *q, struct video_frame *f) {
+    if (q->count == RTSP_QUEUE_LEN) {
+        return false;
+    }
+    q->frames[(q->head + q->count++) % RTSP_QUEUE_LEN] = f;
+    return true;
+}
+
+static struct video_frame *queue_pop(struct rtsp_frame_queue *q) {
+    if (q->count == 0) {
+        return NULL;
+    }
+    struct video_frame *f = q->frames[q->head];
+    q->head = (q->head + 1) % RTSP_QUEUE_LEN;
+    q->count -= 1;
+    return f;
+}
+
+static struct rtsp_frame_pool *rtsp_pool_create(void) {
+    struct rtsp_frame_pool *pool = calloc(1, sizeof *pool);
+    pthread_mutex_init(&pool->lock, NULL);
+    pool->refcount = 1;
+    return pool;
+}
+
+static void rtsp_buf_free(struct rtsp_buf *buf) {
+    vf_free(buf->frame);
+    free(buf);
+}
+
+/// drops a reference, the pool is destroyed when the last one is dropped
+static void rtsp_pool_unref(struct rtsp_frame_pool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    bool last = --pool->refcount == 0;
+    pthread_mutex_unlock(&pool->lock);
+    if (!last) {
+        return;
+    }
+    for (int i = 0; i < pool->free_count; ++i) {
+        rtsp_buf_free(pool->free_bufs[i]);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+static void rtsp_buf_dispose(struct video_frame *f) {
+    struct rtsp_buf *buf = f->callbacks.dispose_udata;
+    struct rtsp_frame_pool *pool = buf->pool;
+    pthread_mutex_lock(&pool->lock);
+    if (pool->free_count < RTSP_POOL_LEN) {
+        pool->free_bufs[pool->free_count++] = buf;
+        buf = NULL;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    if (buf != NULL) {
+        rtsp_buf_free(buf);
+    }
+    rtsp_pool_unref(pool);
+}
+
+static struct rtsp_buf *rtsp_pool_get(struct rtsp_frame_pool *pool, struct video_desc desc) {
+    struct rtsp_buf *buf = NULL;
+    pthread_mutex_lock(&pool->lock);
+    if (pool->free_count > 0) {
+        buf = pool->free_bufs[--pool->free_count];
+    }
+    pool->refcount += 1;
+    pthread_mutex_unlock(&pool->lock);
+
+    if (buf == NULL) {
+        buf = calloc(1, sizeof *buf);
+        buf->frame = vf_alloc_desc_data(desc);
+        buf->buffer_len = buf->frame->tiles[0].data_len;
+        buf->pool = pool;
+        buf->frame->callbacks.dispose = rtsp_buf_dispose;
+        buf->frame->callbacks.dispose_udata = buf;
+    }
+    return buf;
+}
+
+/**
+ * Depacketizes received packets to coded frames. Packets are read from the
+ * socket by the UDP receiver thread, this thread never blocks on the
+ * consumers - if the queue is full, the frame is dropped together with the
+ * following ones up to the next I-frame.
+ */
 static void *
 vidcap_rtsp_thread(void *arg) {
     struct rtsp_state *s;
     s = (struct rtsp_state *) arg;
+    struct video_rtsp_state *vs = &s->vrtsp_state;
 
     time_ns_t start_time = get_time_in_ns();
 
-    struct video_frame *frame = vf_alloc_desc_data(s->vrtsp_state.desc);
+    struct rtsp_buf *buf = rtsp_pool_get(vs->pool, vs->desc);
 
     while (!s->should_exit) {
         time_ns_t curr_time = get_time_in_ns();
         uint32_t timestamp = (curr_time - start_time) / (100*1000) * 9; // at 90000 Hz
 
-        rtp_update(s->vrtsp_state.device, curr_time);
+        rtp_update(vs->device, curr_time);
 
         struct timeval timeout;
         timeout.tv_sec = 0;
         timeout.tv_usec = 10000;
 
-        if (!rtp_recv_r(s->vrtsp_state.device, &timeout, timestamp)) {
+        if (!rtp_recv_r(vs->device, &timeout, timestamp)) {
             pdb_iter_t it;
-            struct pdb_e *cp = pdb_iter_init(s->vrtsp_state.participants, &it);
+            struct pdb_e *cp = pdb_iter_init(vs->participants, &it);
 
             while (cp != NULL) {
                 struct decode_data_h264 d;
-                d.frame = frame;
-                d.offset_len = s->vrtsp_state.h264_offset_len;
-                d.video_pt = s->vrtsp_state.pt;
-                if (pbuf_decode(cp->playout_buffer, curr_time,
-                            decode_frame_by_pt, &d))
-                {
-                    pthread_mutex_lock(&s->vrtsp_state.lock);
-                    while (s->vrtsp_state.out_frame != NULL && !s->should_exit) {
-                        s->vrtsp_state.worker_waiting = true;
-                        pthread_cond_wait(&s->vrtsp_state.worker_cv, &s->vrtsp_state.lock);
-                        s->vrtsp_state.worker_waiting = false;
+                d.frame = buf->frame;
+                d.offset_len = vs->h264_offset_len;
+                d.video_pt = vs->pt;
+                d.buffer_len = buf->buffer_len;
+                d.sps_cache = &vs->sps_cache;
+                int ret = pbuf_decode(cp->playout_buffer, curr_time,
+                            decode_frame_by_pt, &d);
+                buf->buffer_len = d.buffer_len; // may have been enlarged
+                if (ret) {
+                    struct video_frame *frame = buf->frame;
+                    if (vs->h264_offset_len > 0 && frame->frame_type == INTRA) {
+                        memcpy(frame->tiles[0].data, vs->h264_offset_buffer, vs->h264_offset_len);
                     }
-                    if (s->vrtsp_state.out_frame == NULL) {
-                        s->vrtsp_state.out_frame = frame;
-                        frame = vf_alloc_desc_data(s->vrtsp_state.desc); // alloc new
-                        if (s->vrtsp_state.boss_waiting)
-                            pthread_cond_signal(&s->vrtsp_state.boss_cv);
-                        pthread_mutex_unlock(&s->vrtsp_state.lock);
+                    pthread_mutex_lock(&vs->lock);
+                    if (vs->wait_for_intra && frame->frame_type != INTRA) {
+                        vs->dropped += 1;
+                    } else if (queue_push(&vs->coded, frame)) {
+                        vs->wait_for_intra = false;
+                        buf = NULL;
+                        pthread_cond_signal(vs->decompress ? &vs->worker_cv : &vs->boss_cv);
                     } else {
-                        pthread_mutex_unlock(&s->vrtsp_state.lock);
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Frame queue full, dropping frames until next I-frame!\n");
+                        vs->wait_for_intra = true;
+                        vs->dropped += 1;
+                    }
+                    pthread_mutex_unlock(&vs->lock);
+                    if (buf == NULL) {
+                        buf = rtsp_pool_get(vs->pool, vs->desc);
                     }
                 }
                 pbuf_remove(cp->playout_buffer, curr_time);
@@ -355,7 +488,76 @@ vidcap_rtsp_thread(void *arg) {
             pdb_iter_done(&it);
         }
     }
-    vf_free(frame);
+    VIDEO_FRAME_DISPOSE(buf->frame);
+    return NULL;
+}
+
+/// @returns decompressed frame or NULL
+static struct video_frame *decompress_coded(struct video_rtsp_state *vs, struct video_frame *frame) {
+    struct video_desc curr_desc = video_desc_from_frame(frame);
+    curr_desc.color_spec = vs->desc.color_spec;
+    if (!video_desc_eq(vs->decompress_desc, curr_desc)) {
+        decompress_done(vs->sd);
+        vs->sd = NULL;
+        if (init_decompressor(vs, curr_desc) == 0) {
+            return NULL;
+        }
+        vs->decompress_desc = curr_desc;
+        if (vs->decompressed_pool != NULL) {
+            video_frame_pool_destroy(vs->decompressed_pool);
+            vs->decompressed_pool = NULL;
+        }
+    }
+    if (vs->decompressed_pool == NULL) {
+        struct video_desc out_desc = vs->decompress_desc;
+        out_desc.color_spec = UYVY;
+        // queued frames + one being decompressed + one being processed by the consumer
+        vs->decompressed_pool = video_frame_pool_init(out_desc, RTSP_QUEUE_LEN + 2);
+    }
+
+    struct video_frame *decompressed = video_frame_pool_get_disposable_frame(vs->decompressed_pool);
+    decompress_status ret = decompress_frame(vs->sd, (unsigned char *) decompressed->tiles[0].data,
+        (unsigned char *) frame->tiles[0].data,
+        frame->tiles[0].data_len, 0, NULL, NULL);
+    if (ret != DECODER_GOT_FRAME) {
+        VIDEO_FRAME_DISPOSE(decompressed);
+        return NULL;
+    }
+    return decompressed;
+}
+
+/**
+ * Decompresses coded frames (if requested). Runs in parallel with
+ * depacketization of the following frames.
+ */
+static void *
+vidcap_rtsp_decode_thread(void *arg) {
+    struct rtsp_state *s = arg;
+    struct video_rtsp_state *vs = &s->vrtsp_state;
+
+    pthread_mutex_lock(&vs->lock);
+    while (!s->should_exit) {
+        struct video_frame *frame = queue_pop(&vs->coded);
+        if (frame == NULL) {
+            pthread_cond_wait(&vs->worker_cv, &vs->lock);
+            continue;
+        }
+        pthread_mutex_unlock(&vs->lock);
+
+        struct video_frame *out = decompress_coded(vs, frame);
+        VIDEO_FRAME_DISPOSE(frame);
+
+        pthread_mutex_lock(&vs->lock);
+        if (out != NULL) {
+            if (!queue_push(&vs->decoded, out)) { // grab lags - drop the oldest decompressed frame
+                VIDEO_FRAME_DISPOSE(queue_pop(&vs->decoded));
+                queue_push(&vs->decoded, out);
+                vs->dropped += 1;
+            }
+            pthread_cond_signal(&vs->boss_cv);
+        }
+    }
+    pthread_mutex_unlock(&vs->lock);
     return NULL;
 }
 
@@ -382,6 +584,7 @@ static struct video_frame *
 vidcap_rtsp_grab(void *state, struct audio_frame **audio) {
     struct rtsp_state *s;
     s = (struct rtsp_state *) state;
+    struct video_rtsp_state *vs = &s->vrtsp_state;
 
     *audio = NULL;
 
@@ -389,65 +592,25 @@ vidcap_rtsp_grab(void *state, struct audio_frame **audio) {
         return emit_sps_pps(s);
     }
 
-    if(pthread_mutex_trylock(&s->vrtsp_state.lock)==0){
-        {
-            while (s->vrtsp_state.out_frame == NULL && !s->should_exit) {
-                struct timeval  tp;
-                gettimeofday(&tp, NULL);
-                struct timespec timeout = { .tv_sec = tp.tv_sec, .tv_nsec = (tp.tv_usec + 100*1000) * 1000 };
-                if (timeout.tv_nsec >= 1000L*1000*1000) {
-                    timeout.tv_nsec -= 1000L*1000*1000;
-                    timeout.tv_sec += 1;
-                }
-                s->vrtsp_state.boss_waiting = true;
-                if (pthread_cond_timedwait(&s->vrtsp_state.boss_cv, &s->vrtsp_state.lock, &timeout) == ETIMEDOUT) {
-                    pthread_mutex_unlock(&s->vrtsp_state.lock);
-                    return NULL;
-                }
-                s->vrtsp_state.boss_waiting = false;
-            }
-
-            if (s->should_exit) {
-                pthread_mutex_unlock(&s->vrtsp_state.lock);
-                return NULL;
-            }
-
-            struct video_frame *frame = s->vrtsp_state.out_frame;
-            s->vrtsp_state.out_frame = NULL;
-            pthread_mutex_unlock(&s->vrtsp_state.lock);
-            pthread_cond_signal(&s->vrtsp_state.worker_cv);
-
-            if(s->vrtsp_state.h264_offset_len>0 && frame->frame_type == INTRA){
-                    memcpy(frame->tiles[0].data, s->vrtsp_state.h264_offset_buffer, s->vrtsp_state.h264_offset_len);
-            }
-
-            if (s->vrtsp_state.decompress) {
-                struct video_desc curr_desc = video_desc_from_frame(frame);
-                curr_desc.color_spec = H264;
-                if (!video_desc_eq(s->vrtsp_state.decompress_desc, curr_desc)) {
-                    decompress_done(s->vrtsp_state.sd);
-                    if (init_decompressor(&s->vrtsp_state, curr_desc) == 0) {
-                        return NULL;
-                    }
-                    s->vrtsp_state.decompress_desc = curr_desc;
-                }
-
-                struct video_desc out_desc = s->vrtsp_state.decompress_desc;
-                out_desc.color_spec = UYVY;
-                struct video_frame *decompressed = vf_alloc_desc_data(out_desc);
+    struct rtsp_frame_queue *q = vs->decompress ? &vs->decoded : &vs->coded;
+    struct timespec timeout;
+    clock_gettime(CLOCK_REALTIME, &timeout);
+    timeout.tv_nsec += 100 * 1000 * 1000;
+    if (timeout.tv_nsec >= 1000L*1000*1000) {
+        timeout.tv_nsec -= 1000L*1000*1000;
+        timeout.tv_sec += 1;
+    }
 
-                decompress_frame(s->vrtsp_state.sd, (unsigned char *) decompressed->tiles[0].data,
-                    (unsigned char *) frame->tiles[0].data,
-                    frame->tiles[0].data_len, 0, NULL, NULL);
-                vf_free(frame);
-                frame = decompressed;
-            }
-            frame->callbacks.dispose = vf_free;
-            return frame;
+    pthread_mutex_lock(&vs->lock);
+    while (q->count == 0 && !s->should_exit) {
+        if (pthread_cond_timedwait(&vs->boss_cv, &vs->lock, &timeout) == ETIMEDOUT) {
+            break;
         }
-    } else {
-        return NULL;
     }
+    struct video_frame *frame = s->should_exit ? NULL : queue_pop(q);
+    pthread_mutex_unlock(&vs->lock);
+
+    return frame;
 }
 
 #define INIT_FAIL(msg) log_msg(LOG_LEVEL_ERROR, MOD_NAME msg); \
@@ -495,8 +658,9 @@ vidcap_rtsp_init(struct vidcap_params *params, void **state) {
     s->vrtsp_state.required_connections = 1;
 
     s->vrtsp_state.participants = pdb_init(0);
+    s->vrtsp_state.pool = rtsp_pool_create();
 
-    s->vrtsp_state.h264_offset_buffer = (unsigned char *) malloc(2048);
+    s->vrtsp_state.h264_offset_buffer = (unsigned char *) malloc(H264_OFFSET_BUFFER_LEN);
     s->vrtsp_state.h264_offset_len = 0;
 
     s->curl = NULL;
@@ -560,7 +724,7 @@ vidcap_rtsp_init(struct vidcap_params *params, void **state) {
     }
 
     s->vrtsp_state.device = rtp_init_if("localhost", s->vrtsp_state.mcast_if, s->vrtsp_state.port, 0, s->vrtsp_state.ttl, s->vrtsp_state.rtcp_bw,
-        0, rtp_recv_callback, (uint8_t *) s->vrtsp_state.participants, 0, false);
+        0, rtp_recv_callback, (uint8_t *) s->vrtsp_state.participants, 0, true);
     if (s->vrtsp_state.device == NULL) {
         log_msg(LOG_LEVEL_ERROR, "[rtsp] Cannot intialize RTP device!\n");
         vidcap_rtsp_done(s);
@@ -615,12 +779,9 @@ vidcap_rtsp_init(struct vidcap_params *params, void **state) {
 
     s->should_exit = FALSE;
 
-    s->vrtsp_state.boss_waiting = false;
-    s->vrtsp_state.worker_waiting = false;
-
     if (s->vrtsp_state.decompress) {
         struct video_desc decompress_desc = s->vrtsp_state.desc;
-        decompress_desc.color_spec = H264;
+        decompress_desc.color_spec = s->vrtsp_state.desc.color_spec == H265 ? H265 : H264;
         if (init_decompressor(&s->vrtsp_state, decompress_desc) == 0) {
             vidcap_rtsp_done(s);
             return VIDCAP_INIT_FAIL;
@@ -628,6 +789,9 @@ vidcap_rtsp_init(struct vidcap_params *params, void **state) {
     }
 
     pthread_create(&s->vrtsp_state.vrtsp_thread_id, NULL, vidcap_rtsp_thread, s);
+    if (s->vrtsp_state.decompress) {
+        pthread_create(&s->vrtsp_state.decode_thread_id, NULL, vidcap_rtsp_decode_thread, s);
+    }
     pthread_create(&s->keep_alive_rtsp_thread_id, NULL, keep_alive_thread, s);
 
     verbose_msg("[rtsp] rtsp capture init done\n");
@@ -746,8 +910,8 @@ init_rtsp(struct rtsp_state *s) {
     if (!setup_codecs_and_controls_from_sdp(sdp_file, s)) {
         goto error;
     }
-    if (strcmp(s->vrtsp_state.codec, "H264") == 0){
-        s->vrtsp_state.desc.color_spec = H264;
+    if (strcmp(s->vrtsp_state.codec, "H264") == 0 || strcmp(s->vrtsp_state.codec, "H265") == 0){
+        s->vrtsp_state.desc.color_spec = strcmp(s->vrtsp_state.codec, "H264") == 0 ? H264 : H265;
         char uri[strlen(s->uri) + 1 + strlen(s->vrtsp_state.control) + 1];
         strcpy(uri, s->uri);
         strcat(uri, "/");
@@ -777,7 +941,7 @@ init_rtsp(struct rtsp_state *s) {
     }
 
     /* get start nal size attribute from sdp file */
-    len_nals = get_nals(sdp_file, (char *) s->vrtsp_state.h264_offset_buffer, (int *) &s->vrtsp_state.desc.width, (int *) &s->vrtsp_state.desc.height);
+    len_nals = get_nals(sdp_file, s->vrtsp_state.desc.color_spec, (char *) s->vrtsp_state.h264_offset_buffer, (int *) &s->vrtsp_state.desc.width, (int *) &s->vrtsp_state.desc.height);
 
     verbose_msg("[rtsp] playing video from server (size: WxH = %d x %d)...\n", s->vrtsp_state.desc.width,s->vrtsp_state.desc.height);
 
@@ -841,6 +1005,9 @@ bool setup_codecs_and_controls_from_sdp(FILE *sdp_file, void *state) {
             int pt = 0;
             sscanf(line, " a=rtpmap:%d %*s", &pt);
             tmpBuff = strstr(line, "H264");
+            if (tmpBuff == NULL) {
+                tmpBuff = strstr(line, "H265");
+            }
             if(tmpBuff!=NULL){
                 if ((unsigned) countC < sizeof codecs / sizeof codecs[0]) {
                     //debug_msg("codec = %s\n",tmpBuff);
@@ -848,7 +1015,7 @@ bool setup_codecs_and_controls_from_sdp(FILE *sdp_file, void *state) {
                     codecs[countC][4] = '\0';
                     countC++;
                     if (pt == 0) {
-                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Missing video PT for H.264!\n");
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Missing video PT for %s!\n", codecs[countC - 1]);
                         ret = false;
                         break;
                     }
@@ -878,8 +1045,8 @@ bool setup_codecs_and_controls_from_sdp(FILE *sdp_file, void *state) {
         verbose_msg(MOD_NAME "TRACK = %s FOR CODEC = %s\n",tracks[1],codecs[1]);
 
         for(int p=0;p<2;p++){
-            if(strncmp(codecs[p],"H264",4)==0){
-                rtspState->vrtsp_state.codec = "H264";
+            if(strncmp(codecs[p],"H264",4)==0 || strncmp(codecs[p],"H265",4)==0){
+                rtspState->vrtsp_state.codec = strncmp(codecs[p],"H264",4)==0 ? "H264" : "H265";
                 free(rtspState->vrtsp_state.control);
                 rtspState->vrtsp_state.control = strdup(tracks[p]);
 
@@ -921,7 +1088,7 @@ void getNewLine(const char* buffer, int* i, char* line){
  */
 static int
 init_decompressor(struct video_rtsp_state *sr, struct video_desc desc) {
-    if (decompress_init_multi(H264, VIDEO_CODEC_NONE, UYVY, &sr->sd, 1)) {
+    if (decompress_init_multi(desc.color_spec, VIDEO_CODEC_NONE, UYVY, &sr->sd, 1)) {
         decompress_reconfigure(sr->sd, desc, 16, 8, 0,
             vc_get_linesize(desc.width, UYVY), UYVY);
     } else
@@ -1061,6 +1228,25 @@ vidcap_rtsp_done(void *state) {
     if (s->vrtsp_state.vrtsp_thread_id) {
         pthread_join(s->vrtsp_state.vrtsp_thread_id, NULL);
     }
+    if (s->vrtsp_state.decode_thread_id) {
+        pthread_join(s->vrtsp_state.decode_thread_id, NULL);
+    }
+    struct video_frame *f = NULL;
+    while ((f = queue_pop(&s->vrtsp_state.coded)) != NULL) {
+        VIDEO_FRAME_DISPOSE(f);
+    }
+    while ((f = queue_pop(&s->vrtsp_state.decoded)) != NULL) {
+        VIDEO_FRAME_DISPOSE(f);
+    }
+    if (s->vrtsp_state.pool) {
+        rtsp_pool_unref(s->vrtsp_state.pool);
+    }
+    if (s->vrtsp_state.decompressed_pool) {
+        video_frame_pool_destroy(s->vrtsp_state.decompressed_pool);
+    }
+    if (s->vrtsp_state.dropped > 0) {
+        log_msg(LOG_LEVEL_INFO, MOD_NAME "%lld frames dropped.\n", s->vrtsp_state.dropped);
+    }
     if (s->keep_alive_rtsp_thread_id) {
         pthread_join(s->keep_alive_rtsp_thread_id, NULL);
     }
@@ -1073,7 +1259,7 @@ vidcap_rtsp_done(void *state) {
     }
 
     if(s->vrtsp_state.h264_offset_buffer!=NULL) free(s->vrtsp_state.h264_offset_buffer);
-    vf_free(s->vrtsp_state.out_frame);
+    h264_sps_cache_clear(&s->vrtsp_state.sps_cache);
     free(s->vrtsp_state.control);
     free(s->artsp_state.control);
 
@@ -1094,49 +1280,57 @@ vidcap_rtsp_done(void *state) {
 
 /**
  * scan sdp file for media control attributes to generate coded frame required params (WxH and offset)
+ *
+ * For HEVC, the parameter sets are in sprop-vps, sprop-sps and sprop-pps
+ * (RFC 7798), dimensions are not parsed from them.
  */
 static int
-get_nals(FILE *sdp_file, char *nals, int *width, int *height) {
+get_nals(FILE *sdp_file, codec_t codec, char *nals, int *width, int *height) {
+    const char *h264_keys[] = { "sprop-parameter-sets=", NULL };
+    const char *hevc_keys[] = { "sprop-vps=", "sprop-sps=", "sprop-pps=", NULL };
     int max_len = 1500, len_nals = 0;
     char *s = (char *) malloc(max_len);
-    char *sprop;
     memset(s, 0, max_len);
     nals[0] = '\0';
 
     while (fgets(s, max_len - 2, sdp_file) != NULL) {
-        sprop = strstr(s, "sprop-parameter-sets=");
-        if (sprop == NULL) {
-            continue;
-        }
-        char *sprop_val = strstr(sprop, "=") + 1;
-        char *term = strchr(sprop_val, ';');
-        if (term) {
-            *term = '\0';
-        }
-
-        char *nal = 0;
-        while ((nal = strtok(sprop_val, ","))) {
-            sprop_val = NULL;
-            unsigned int length = 0;
-            //convert base64 to binary
-            unsigned char *nal_decoded = base64_decode(nal, &length);
-            if (length == 0) {
-                free(nal_decoded);
+        for (const char **key = codec == H265 ? hevc_keys : h264_keys; *key != NULL; key++) {
+            char *sprop = strstr(s, *key);
+            if (sprop == NULL) {
                 continue;
             }
+            char *sprop_val = strdup(sprop + strlen(*key));
+            char *sprop_val_it = sprop_val;
+            char *term = strchr(sprop_val, ';');
+            if (term) {
+                *term = '\0';
+            }
 
-            memcpy(nals+len_nals, start_sequence, sizeof(start_sequence));
-            len_nals += sizeof(start_sequence);
-            memcpy(nals + len_nals, nal_decoded, length);
-            len_nals += length;
-            free(nal_decoded);
-
-            uint8_t nalInfo = (uint8_t) nals[len_nals - length];
-            uint8_t type = nalInfo & 0x1f;
-            debug_msg(MOD_NAME "sprop-parameter %d (base64): %s\n", (int) type, nal);
-            if (type == NAL_SPS){
-                width_height_from_SDP(width, height, (unsigned char *) (nals+(len_nals - length)), length);
+            char *nal = 0;
+            while ((nal = strtok(sprop_val_it, ","))) {
+                sprop_val_it = NULL;
+                unsigned int length = 0;
+                //convert base64 to binary
+                unsigned char *nal_decoded = base64_decode(nal, &length);
+                if (length == 0 || len_nals + sizeof(start_sequence) + length > H264_OFFSET_BUFFER_LEN) {
+                    free(nal_decoded);
+                    continue;
+                }
+
+                memcpy(nals+len_nals, start_sequence, sizeof(start_sequence));
+                len_nals += sizeof(start_sequence);
+                memcpy(nals + len_nals, nal_decoded, length);
+                len_nals += length;
+                free(nal_decoded);
+
+                uint8_t nalInfo = (uint8_t) nals[len_nals - length];
+                uint8_t type = nalInfo & 0x1f;
+                debug_msg(MOD_NAME "%s%s (base64)\n", *key, nal);
+                if (codec != H265 && type == NAL_SPS){
+                    width_height_from_SDP(width, height, (unsigned char *) (nals+(len_nals - length)), length);
+                }
             }
+            free(sprop_val);
         }
     }
 
@@ -0,0 +1,634 @@
+/**
+ * @file   video_capture/screen_win_dxgi.cpp
+ *
+ * Screen capture using DXGI Desktop Duplication. Unlike the DirectShow
+ * screen-capture-recorder filter (GDI), the desktop image stays on the GPU and
+ * only regions reported as changed (dirty and moved rectangles) are copied to
+ * a persistent CPU-readable staging texture and to the output frame.
+ *
+ * With the "cuda" option, the desktop is passed to CUDA through D3D11 interop
+ * and the output frame resides in CUDA memory (CUDA_MEM), so that GPU
+ * compressions accepting it (GPUJPEG) do not need any download.
+ *
+ * @todo
+ * - mouse pointer is not composited into the image
+ * - rotated outputs
+ */
+/*
+ * Copyright (c) 2026 CESNET, z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <d3d11.h>
+#include <dxgi1_2.h>
+#include <vector>
+#include <windows.h>
+
+#ifdef HAVE_CUDA
+#include <cuda_d3d11_interop.h>
+#include <cuda_runtime.h>
+#include "utils/cuda_pix_conv.h"
+#endif // defined HAVE_CUDA
+
+#include "audio/types.h"
+#include "debug.h"
+#include "host.h"
+#include "lib_common.h"
+#include "tv.h"
+#include "utils/color_out.h"
+#include "utils/hresult.h"
+#include "video.h"
+#include "video_capture.h"
+#include "video_capture_params.h"
+
+#define MOD_NAME "[screen DXGI] "
+#define DEFAULT_FPS 60.0
+/// if the changed area exceeds this fraction of the screen, copy it whole
+#define FULL_COPY_THRESHOLD 0.75
+
+#define SAFE_RELEASE(u) \
+    do { if ((u) != NULL) (u)->Release(); (u) = NULL; } while(0)
+
+struct vidcap_screen_dxgi_state {
+        int adapter_idx;
+        int output_idx;
+        double fps;
+        bool use_cuda;
+
+        ID3D11Device *device;
+        ID3D11DeviceContext *context;
+        IDXGIOutputDuplication *dupl;
+        bool frame_acquired;
+        ID3D11Texture2D *staging; ///< CPU-readable copy of the desktop, updated in changed regions only
+        bool full_copy_needed;    ///< after (re)initialization
+
+        struct video_frame *frame;
+        bool frame_valid;         ///< frame contains an image (to be repeated if nothing changed)
+        time_ns_t next_frame_time;
+
+        std::vector<unsigned char> metadata;
+        std::vector<RECT> rects;
+
+        long long changed_px;     ///< statistics
+        long long total_px;
+        int frames;
+        time_ns_t t0;
+
+#ifdef HAVE_CUDA
+        ID3D11Texture2D *gpu_copy; ///< desktop copy registered with CUDA
+        cudaGraphicsResource *cuda_res;
+        cudaStream_t stream;
+        unsigned char *cuda_tmp;   ///< linear BGRA copy of gpu_copy
+        size_t cuda_tmp_pitch;
+#endif // defined HAVE_CUDA
+};
+
+static void show_help()
+{
+        printf("DXGI Desktop Duplication screen capture\n");
+        printf("Usage\n");
+        color_printf(TERM_BOLD TERM_FG_RED "\t-t screen_dxgi" TERM_FG_RESET "[:adapter=<a>][:display=<d>][:fps=<f>][:cuda]\n" TERM_RESET);
+        printf("\t\t<a> - index of the graphics adapter (default 0)\n");
+        printf("\t\t<d> - index of the display (output) of the adapter (default 0)\n");
+        printf("\t\t<f> - frame rate; if the screen doesn't change, the last frame is repeated (default %g)\n", DEFAULT_FPS);
+        printf("\t\tcuda - output the frame in CUDA memory (for GPU compressions, adapter must be NVIDIA)%s\n",
+#ifdef HAVE_CUDA
+                        ""
+#else
+                        " - not compiled in"
+#endif
+              );
+}
+
+static struct vidcap_type * vidcap_screen_dxgi_probe(bool verbose, void (**deleter)(void *))
+{
+        *deleter = free;
+        struct vidcap_type *vt = (struct vidcap_type *) calloc(1, sizeof(struct vidcap_type));
+        if (vt == NULL) {
+                return NULL;
+        }
+
+        vt->name        = "screen_dxgi";
+        vt->description = "Grabbing screen (DXGI Desktop Duplication)";
+
+        if (!verbose) {
+                return vt;
+        }
+
+        IDXGIFactory1 *factory = NULL;
+        if (FAILED(CreateDXGIFactory1(__uuidof(IDXGIFactory1), (void **) &factory))) {
+                return vt;
+        }
+        IDXGIAdapter1 *adapter = NULL;
+        for (UINT a = 0; factory->EnumAdapters1(a, &adapter) != DXGI_ERROR_NOT_FOUND; ++a) {
+                DXGI_ADAPTER_DESC1 adapter_desc;
+                adapter->GetDesc1(&adapter_desc);
+                IDXGIOutput *output = NULL;
+                for (UINT o = 0; adapter->EnumOutputs(o, &output) != DXGI_ERROR_NOT_FOUND; ++o) {
+                        DXGI_OUTPUT_DESC output_desc;
+                        output->GetDesc(&output_desc);
+                        vt->cards = (struct device_info *) realloc(vt->cards, (vt->card_count + 1) * sizeof(struct device_info));
+                        struct device_info *card = &vt->cards[vt->card_count++];
+                        memset(card, 0, sizeof *card);
+                        snprintf(card->dev, sizeof card->dev, ":adapter=%u:display=%u", a, o);
+                        snprintf(card->name, sizeof card->name, "Screen %ls (%ls)", output_desc.DeviceName,
+                                        adapter_desc.Description);
+                        SAFE_RELEASE(output);
+                }
+                SAFE_RELEASE(adapter);
+        }
+        SAFE_RELEASE(factory);
+
+        return vt;
+}
+
+static bool parse_fmt(struct vidcap_screen_dxgi_state *s, char *fmt)
+{
+        char *save_ptr = NULL;
+        char *tok = NULL;
+        while ((tok = strtok_r(fmt, ":", &save_ptr)) != NULL) {
+                fmt = NULL;
+                if (strncmp(tok, "adapter=", strlen("adapter=")) == 0) {
+                        s->adapter_idx = atoi(tok + strlen("adapter="));
+                } else if (strncmp(tok, "display=", strlen("display=")) == 0) {
+                        s->output_idx = atoi(tok + strlen("display="));
+                } else if (strncmp(tok, "fps=", strlen("fps=")) == 0) {
+                        s->fps = atof(tok + strlen("fps="));
+                        if (s->fps <= 0.0) {
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong FPS: %s\n", tok + strlen("fps="));
+                                return false;
+                        }
+                } else if (strcmp(tok, "cuda") == 0) {
+#ifdef HAVE_CUDA
+                        s->use_cuda = true;
+#else
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "CUDA support not compiled in!\n");
+                        return false;
+#endif
+                } else {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unknown option: %s\n", tok);
+                        return false;
+                }
+        }
+        return true;
+}
+
+static void release_duplication(struct vidcap_screen_dxgi_state *s)
+{
+        if (s->frame_acquired) {
+                s->dupl->ReleaseFrame();
+                s->frame_acquired = false;
+        }
+        SAFE_RELEASE(s->dupl);
+}
+
+/**
+ * (Re)creates the duplication interface. Needs to be called again after
+ * DXGI_ERROR_ACCESS_LOST (mode change, UAC prompt, fullscreen switch...).
+ */
+static bool create_duplication(struct vidcap_screen_dxgi_state *s)
+{
+        release_duplication(s);
+
+        IDXGIDevice *dxgi_device = NULL;
+        IDXGIAdapter *adapter = NULL;
+        IDXGIOutput *output = NULL;
+        IDXGIOutput1 *output1 = NULL;
+        HRESULT hr = s->device->QueryInterface(__uuidof(IDXGIDevice), (void **) &dxgi_device);
+        if (SUCCEEDED(hr)) {
+                hr = dxgi_device->GetAdapter(&adapter);
+        }
+        if (SUCCEEDED(hr)) {
+                hr = adapter->EnumOutputs(s->output_idx, &output);
+        }
+        if (SUCCEEDED(hr)) {
+                hr = output->QueryInterface(__uuidof(IDXGIOutput1), (void **) &output1);
+        }
+        if (SUCCEEDED(hr)) {
+                hr = output1->DuplicateOutput(s->device, &s->dupl);
+        }
+        SAFE_RELEASE(output1);
+        SAFE_RELEASE(output);
+        SAFE_RELEASE(adapter);
+        SAFE_RELEASE(dxgi_device);
+        if (FAILED(hr)) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot duplicate display %d: %s\n", s->output_idx, hresult_to_str(hr));
+                return false;
+        }
+        s->full_copy_needed = true;
+        return true;
+}
+
+static ID3D11Texture2D *create_texture(struct vidcap_screen_dxgi_state *s, bool staging)
+{
+        D3D11_TEXTURE2D_DESC desc{};
+        desc.Width = s->frame->tiles[0].width;
+        desc.Height = s->frame->tiles[0].height;
+        desc.MipLevels = 1;
+        desc.ArraySize = 1;
+        desc.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+        desc.SampleDesc.Count = 1;
+        desc.Usage = staging ? D3D11_USAGE_STAGING : D3D11_USAGE_DEFAULT;
+        desc.CPUAccessFlags = staging ? D3D11_CPU_ACCESS_READ : 0;
+        ID3D11Texture2D *tex = NULL;
+        HRESULT hr = s->device->CreateTexture2D(&desc, NULL, &tex);
+        if (FAILED(hr)) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot create texture: %s\n", hresult_to_str(hr));
+                return NULL;
+        }
+        return tex;
+}
+
+#ifdef HAVE_CUDA
+static bool init_cuda(struct vidcap_screen_dxgi_state *s)
+{
+        IDXGIDevice *dxgi_device = NULL;
+        IDXGIAdapter *adapter = NULL;
+        int cuda_dev = -1;
+        if (SUCCEEDED(s->device->QueryInterface(__uuidof(IDXGIDevice), (void **) &dxgi_device))
+                        && SUCCEEDED(dxgi_device->GetAdapter(&adapter))) {
+                if (cudaD3D11GetDevice(&cuda_dev, adapter) != cudaSuccess) {
+                        cuda_dev = -1;
+                }
+        }
+        SAFE_RELEASE(adapter);
+        SAFE_RELEASE(dxgi_device);
+        if (cuda_dev < 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Adapter %d is not a CUDA device!\n", s->adapter_idx);
+                return false;
+        }
+        cudaSetDevice(cuda_dev);
+
+        if ((s->gpu_copy = create_texture(s, false)) == NULL) {
+                return false;
+        }
+        const size_t width = s->frame->tiles[0].width;
+        const size_t height = s->frame->tiles[0].height;
+        if (cudaGraphicsD3D11RegisterResource(&s->cuda_res, s->gpu_copy, cudaGraphicsRegisterFlagsNone) != cudaSuccess
+                        || cudaStreamCreate(&s->stream) != cudaSuccess
+                        || cudaMallocPitch((void **) &s->cuda_tmp, &s->cuda_tmp_pitch, width * 4, height) != cudaSuccess
+                        || cudaMalloc((void **) &s->frame->tiles[0].data, s->frame->tiles[0].data_len) != cudaSuccess) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "CUDA initialization failed: %s\n", cudaGetErrorString(cudaGetLastError()));
+                return false;
+        }
+        s->frame->mem_location = CUDA_MEM;
+        log_msg(LOG_LEVEL_INFO, MOD_NAME "Using CUDA device %d, frames stay in GPU memory.\n", cuda_dev);
+        return true;
+}
+
+static void done_cuda(struct vidcap_screen_dxgi_state *s)
+{
+        if (s->cuda_res != NULL) {
+                cudaGraphicsUnregisterResource(s->cuda_res);
+        }
+        if (s->frame != NULL && s->frame->mem_location == CUDA_MEM) {
+                cudaFree(s->frame->tiles[0].data);
+                s->frame->tiles[0].data = NULL;
+        }
+        cudaFree(s->cuda_tmp);
+        if (s->stream != NULL) {
+                cudaStreamDestroy(s->stream);
+        }
+        SAFE_RELEASE(s->gpu_copy);
+}
+
+/// converts gpu_copy to the CUDA output frame
+static bool copy_to_cuda(struct vidcap_screen_dxgi_state *s)
+{
+        const size_t width = s->frame->tiles[0].width;
+        const size_t height = s->frame->tiles[0].height;
+        cudaArray_t array = NULL;
+        if (cudaGraphicsMapResources(1, &s->cuda_res, s->stream) != cudaSuccess) {
+                return false;
+        }
+        bool ret = cudaGraphicsSubResourceGetMappedArray(&array, s->cuda_res, 0, 0) == cudaSuccess
+                && cudaMemcpy2DFromArrayAsync(s->cuda_tmp, s->cuda_tmp_pitch, array, 0, 0, width * 4, height,
+                                cudaMemcpyDeviceToDevice, s->stream) == cudaSuccess;
+        cudaGraphicsUnmapResources(1, &s->cuda_res, s->stream);
+        if (ret) {
+                cuda_BGRA_to_RGBA((unsigned char *) s->frame->tiles[0].data, vc_get_linesize(width, RGBA),
+                                s->cuda_tmp, s->cuda_tmp_pitch, width, height, s->stream);
+                ret = cudaStreamSynchronize(s->stream) == cudaSuccess;
+        }
+        return ret;
+}
+#endif // defined HAVE_CUDA
+
+static void cleanup(struct vidcap_screen_dxgi_state *s)
+{
+#ifdef HAVE_CUDA
+        done_cuda(s);
+#endif // defined HAVE_CUDA
+        release_duplication(s);
+        SAFE_RELEASE(s->staging);
+        SAFE_RELEASE(s->context);
+        SAFE_RELEASE(s->device);
+        vf_free(s->frame);
+        delete s;
+}
+
+static bool initialize(struct vidcap_screen_dxgi_state *s)
+{
+        IDXGIFactory1 *factory = NULL;
+        IDXGIAdapter1 *adapter = NULL;
+        HRESULT hr = CreateDXGIFactory1(__uuidof(IDXGIFactory1), (void **) &factory);
+        if (SUCCEEDED(hr)) {
+                hr = factory->EnumAdapters1(s->adapter_idx, &adapter);
+        }
+        if (SUCCEEDED(hr)) {
+                // adapter is given so the driver type must be unknown
+                hr = D3D11CreateDevice(adapter, D3D_DRIVER_TYPE_UNKNOWN, NULL, 0, NULL, 0, D3D11_SDK_VERSION,
+                                &s->device, NULL, &s->context);
+        }
+        SAFE_RELEASE(adapter);
+        SAFE_RELEASE(factory);
+        if (FAILED(hr)) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot create D3D11 device for adapter %d: %s\n",
+                                s->adapter_idx, hresult_to_str(hr));
+                return false;
+        }
+
+        if (!create_duplication(s)) {
+                return false;
+        }
+
+        DXGI_OUTDUPL_DESC dupl_desc;
+        s->dupl->GetDesc(&dupl_desc);
+        if (dupl_desc.Rotation != DXGI_MODE_ROTATION_IDENTITY && dupl_desc.Rotation != DXGI_MODE_ROTATION_UNSPECIFIED) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Display is rotated, the image will be captured unrotated.\n");
+        }
+        if (s->fps == 0.0) {
+                const DXGI_RATIONAL &rate = dupl_desc.ModeDesc.RefreshRate;
+                s->fps = rate.Denominator != 0 && rate.Numerator != 0 ? (double) rate.Numerator / rate.Denominator : DEFAULT_FPS;
+        }
+
+        struct video_desc desc{};
+        desc.width = dupl_desc.ModeDesc.Width;
+        desc.height = dupl_desc.ModeDesc.Height;
+        desc.color_spec = RGBA;
+        desc.interlacing = PROGRESSIVE;
+        desc.fps = s->fps;
+        desc.tile_count = 1;
+        s->frame = vf_alloc_desc(desc);
+        s->frame->tiles[0].data_len = vc_get_linesize(desc.width, desc.color_spec) * desc.height;
+
+#ifdef HAVE_CUDA
+        if (s->use_cuda) {
+                return init_cuda(s);
+        }
+#endif // defined HAVE_CUDA
+        s->frame->tiles[0].data = (char *) calloc(1, s->frame->tiles[0].data_len);
+        s->frame->callbacks.data_deleter = vf_data_deleter;
+        s->staging = create_texture(s, true);
+        return s->staging != NULL;
+}
+
+static int vidcap_screen_dxgi_init(struct vidcap_params *params, void **state)
+{
+        if (vidcap_params_get_flags(params) & VIDCAP_FLAG_AUDIO_ANY) {
+                return VIDCAP_INIT_AUDIO_NOT_SUPPOTED;
+        }
+        const char *cfg = vidcap_params_get_fmt(params);
+        if (cfg && strcmp(cfg, "help") == 0) {
+                show_help();
+                return VIDCAP_INIT_NOERR;
+        }
+
+        auto *s = new vidcap_screen_dxgi_state();
+        char *fmt = strdup(cfg != NULL ? cfg : "");
+        bool ok = parse_fmt(s, fmt);
+        free(fmt);
+        if (!ok) {
+                show_help();
+                cleanup(s);
+                return VIDCAP_INIT_FAIL;
+        }
+        if (!initialize(s)) {
+                cleanup(s);
+                return VIDCAP_INIT_FAIL;
+        }
+        log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Capturing display %d of adapter %d, %dx%d @%.2f.\n", s->output_idx,
+                        s->adapter_idx, s->frame->tiles[0].width, s->frame->tiles[0].height, s->fps);
+        s->t0 = get_time_in_ns();
+
+        *state = s;
+        return VIDCAP_INIT_OK;
+}
+
+static void vidcap_screen_dxgi_done(void *state)
+{
+        cleanup((struct vidcap_screen_dxgi_state *) state);
+}
+
+/**
+ * Fills s->rects with regions changed in the acquired frame - destinations of
+ * moved rectangles and dirty rectangles. The acquired image already contains
+ * the moved content so both are just copied from it.
+ *
+ * @retval false whole screen should be copied
+ */
+static bool get_changed_rects(struct vidcap_screen_dxgi_state *s, const DXGI_OUTDUPL_FRAME_INFO *info)
+{
+        s->rects.clear();
+        if (s->full_copy_needed || info->TotalMetadataBufferSize == 0) {
+                return false;
+        }
+        if (s->metadata.size() < info->TotalMetadataBufferSize) {
+                s->metadata.resize(info->TotalMetadataBufferSize);
+        }
+        UINT move_size = 0;
+        HRESULT hr = s->dupl->GetFrameMoveRects(s->metadata.size(), (DXGI_OUTDUPL_MOVE_RECT *) s->metadata.data(), &move_size);
+        if (FAILED(hr)) {
+                return false;
+        }
+        const auto *moves = (const DXGI_OUTDUPL_MOVE_RECT *) s->metadata.data();
+        for (UINT i = 0; i < move_size / sizeof(DXGI_OUTDUPL_MOVE_RECT); ++i) {
+                s->rects.push_back(moves[i].DestinationRect);
+        }
+        UINT dirty_size = 0;
+        hr = s->dupl->GetFrameDirtyRects(s->metadata.size() - move_size, (RECT *) (s->metadata.data() + move_size), &dirty_size);
+        if (FAILED(hr)) {
+                return false;
+        }
+        const auto *dirty = (const RECT *) (s->metadata.data() + move_size);
+        for (UINT i = 0; i < dirty_size / sizeof(RECT); ++i) {
+                s->rects.push_back(dirty[i]);
+        }
+
+        long long area = 0;
+        const long long screen_area = (long long) s->frame->tiles[0].width * s->frame->tiles[0].height;
+        for (auto const &r : s->rects) {
+                area += (long long) (r.right - r.left) * (r.bottom - r.top);
+        }
+        return area < FULL_COPY_THRESHOLD * screen_area;
+}
+
+static void copy_rect_from_staging(struct vidcap_screen_dxgi_state *s, const D3D11_MAPPED_SUBRESOURCE *map, const RECT &r)
+{
+        const int linesize = vc_get_linesize(s->frame->tiles[0].width, RGBA);
+        for (LONG y = r.top; y < r.bottom; ++y) {
+                const unsigned char *src = (const unsigned char *) map->pData + y * map->RowPitch + r.left * 4;
+                unsigned char *dst = (unsigned char *) s->frame->tiles[0].data + y * linesize + r.left * 4;
+                vc_copylineRGBA(dst, src, (r.right - r.left) * 4, 16, 8, 0); // BGRA->RGBA
+        }
+}
+
+/// @returns false on device error
+static bool update_frame(struct vidcap_screen_dxgi_state *s, IDXGIResource *desktop_res, const DXGI_OUTDUPL_FRAME_INFO *info)
+{
+        ID3D11Texture2D *desktop = NULL;
+        HRESULT hr = desktop_res->QueryInterface(__uuidof(ID3D11Texture2D), (void **) &desktop);
+        if (FAILED(hr)) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot get desktop texture: %s\n", hresult_to_str(hr));
+                return false;
+        }
+        if (!get_changed_rects(s, info)) {
+                s->rects.assign(1, RECT{ 0, 0, (LONG) s->frame->tiles[0].width, (LONG) s->frame->tiles[0].height });
+        }
+        s->full_copy_needed = false;
+
+#ifdef HAVE_CUDA
+        ID3D11Texture2D *dst_tex = s->use_cuda ? s->gpu_copy : s->staging;
+#else
+        ID3D11Texture2D *dst_tex = s->staging;
+#endif
+        for (auto const &r : s->rects) {
+                D3D11_BOX box = { (UINT) r.left, (UINT) r.top, 0, (UINT) r.right, (UINT) r.bottom, 1 };
+                s->context->CopySubresourceRegion(dst_tex, 0, r.left, r.top, 0, desktop, 0, &box);
+                s->changed_px += (long long) (r.right - r.left) * (r.bottom - r.top);
+        }
+        SAFE_RELEASE(desktop);
+
+        bool ret = true;
+#ifdef HAVE_CUDA
+        if (s->use_cuda) {
+                ret = copy_to_cuda(s);
+        } else
+#endif // defined HAVE_CUDA
+        {
+                D3D11_MAPPED_SUBRESOURCE map;
+                hr = s->context->Map(s->staging, 0, D3D11_MAP_READ, 0, &map);
+                if (FAILED(hr)) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot map staging texture: %s\n", hresult_to_str(hr));
+                        return false;
+                }
+                for (auto const &r : s->rects) {
+                        copy_rect_from_staging(s, &map, r);
+                }
+                s->context->Unmap(s->staging, 0);
+        }
+        return ret;
+}
+
+static struct video_frame * vidcap_screen_dxgi_grab(void *state, struct audio_frame **audio)
+{
+        auto *s = (struct vidcap_screen_dxgi_state *) state;
+        *audio = NULL;
+
+        if (s->dupl == NULL && !create_duplication(s)) {
+                Sleep(100); // eg. secure desktop is shown, retry later
+                return NULL;
+        }
+        // the frame is held until the next grab to allow the OS to accumulate changes
+        if (s->frame_acquired) {
+                s->dupl->ReleaseFrame();
+                s->frame_acquired = false;
+        }
+
+        time_ns_t now = get_time_in_ns();
+        if (s->next_frame_time == 0) {
+                s->next_frame_time = now;
+        }
+        s->next_frame_time += (time_ns_t) (NS_IN_SEC_DBL / s->fps);
+        if (s->next_frame_time < now) { // too late, do not try to catch up
+                s->next_frame_time = now;
+        }
+        const UINT timeout_ms = (s->next_frame_time - now) / (NS_IN_SEC / 1000);
+
+        DXGI_OUTDUPL_FRAME_INFO info;
+        IDXGIResource *desktop_res = NULL;
+        HRESULT hr = s->dupl->AcquireNextFrame(timeout_ms, &info, &desktop_res);
+        if (hr == DXGI_ERROR_WAIT_TIMEOUT) {
+                return s->frame_valid ? s->frame : NULL;
+        }
+        if (hr == DXGI_ERROR_ACCESS_LOST) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Access to the display lost, reinitializing.\n");
+                release_duplication(s);
+                return s->frame_valid ? s->frame : NULL;
+        }
+        if (FAILED(hr)) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "AcquireNextFrame: %s\n", hresult_to_str(hr));
+                return NULL;
+        }
+        s->frame_acquired = true;
+
+        if (info.LastPresentTime.QuadPart != 0 || s->full_copy_needed) { // otherwise only pointer moved
+                if (!update_frame(s, desktop_res, &info)) {
+                        SAFE_RELEASE(desktop_res);
+                        return NULL;
+                }
+                s->frame_valid = true;
+        }
+        SAFE_RELEASE(desktop_res);
+
+        s->frames += 1;
+        s->total_px += (long long) s->frame->tiles[0].width * s->frame->tiles[0].height;
+        now = get_time_in_ns();
+        if (now - s->t0 >= 5 * NS_IN_SEC) {
+                log_msg(LOG_LEVEL_INFO, MOD_NAME "%d frames in %g seconds = %g FPS, %.1f %% of pixels copied\n",
+                                s->frames, (now - s->t0) / NS_IN_SEC_DBL, s->frames / ((now - s->t0) / NS_IN_SEC_DBL),
+                                100.0 * s->changed_px / s->total_px);
+                s->t0 = now;
+                s->frames = 0;
+                s->changed_px = s->total_px = 0;
+        }
+
+        return s->frame_valid ? s->frame : NULL;
+}
+
+static const struct video_capture_info vidcap_screen_dxgi_info = {
+        vidcap_screen_dxgi_probe,
+        vidcap_screen_dxgi_init,
+        vidcap_screen_dxgi_done,
+        vidcap_screen_dxgi_grab,
+        false
+};
+
+REGISTER_MODULE(screen_dxgi, &vidcap_screen_dxgi_info, LIBRARY_CLASS_VIDEO_CAPTURE, VIDEO_CAPTURE_ABI_VERSION);
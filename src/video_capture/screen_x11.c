@@ -34,10 +34,6 @@
  * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
-/**
- * @todo
- * The XGetImage() is a bit slow, consider using XShm as OBS does.
- */
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -63,9 +59,18 @@
 #include <strings.h>
 
 #include <X11/Xlib.h>
+#ifdef HAVE_XDAMAGE
+#include <sys/select.h>
+#include <X11/extensions/Xdamage.h>
+#endif // HAVE_XDAMAGE
 #ifdef HAVE_XFIXES
 #include <X11/extensions/Xfixes.h>
 #endif // HAVE_XFIXES
+#ifdef HAVE_XSHM
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <X11/extensions/XShm.h>
+#endif // HAVE_XSHM
 #include <X11/Xutil.h>
 
 #define MOD_NAME "[screen capture] "
@@ -79,16 +84,21 @@ static void show_help()
 {
         printf("Screen capture\n");
         printf("Usage\n");
-        printf("\t-t screen[:fps=<fps>][:display=<d>][:geometry=WxH[+x[+y]]|:size=WxH]\n");
+        printf("\t-t screen[:fps=<fps>][:display=<d>][:geometry=WxH[+x[+y]]|:size=WxH][:noshm][:damage]\n");
         printf("\t\t<fps> - preferred grabbing fps (otherwise unlimited)\n");
         printf("\t\tdisplay - display to capture (including the colon!)\n");
         printf("\t\tgeomoetry | size - viewport to use (both option mean the same - size is just a convenient name)\n");
+        printf("\t\tnoshm - do not use MIT-SHM extension even if available\n");
+        printf("\t\tdamage - capture the screen only if changed (XDamage), otherwise repeat last frame\n");
 }
 
 struct grabbed_data;
 
 struct grabbed_data {
-        XImage *data;
+        XImage *data; ///< NULL if the screen didn't change since last capture (XDamage)
+#ifdef HAVE_XSHM
+        XShmSegmentInfo shminfo; ///< shmaddr is NULL unless the image is SHM one
+#endif // HAVE_XSHM
         struct grabbed_data *next;
 };
 
@@ -121,8 +131,97 @@ struct vidcap_screen_x11_state {
         bool initialized;
         int cpu_count;
         char *req_display;
+
+        bool no_shm;
+        bool use_damage;
+#ifdef HAVE_XSHM
+        bool use_shm;
+        struct grabbed_data *free_shm_images; ///< SHM images returned for reuse, protected by lock
+#endif // HAVE_XSHM
+#ifdef HAVE_XDAMAGE
+        Damage damage;
+        int damage_event_base;
+        bool damage_pending; ///< capture regardless of damage events (first frame)
+#endif // HAVE_XDAMAGE
 };
 
+#ifdef HAVE_XSHM
+static bool shm_attach_failed;
+static int shm_error_handler(Display *dpy, XErrorEvent *ev)
+{
+        UNUSED(dpy);
+        UNUSED(ev);
+        shm_attach_failed = true;
+        return 0;
+}
+
+static struct grabbed_data *create_shm_image(struct vidcap_screen_x11_state *s) {
+        struct grabbed_data *item = calloc(1, sizeof(struct grabbed_data));
+        int screen = DefaultScreen(s->dpy);
+        item->data = XShmCreateImage(s->dpy, DefaultVisual(s->dpy, screen), DefaultDepth(s->dpy, screen),
+                        ZPixmap, NULL, &item->shminfo, s->tile->width, s->tile->height);
+        if (item->data == NULL) {
+                free(item);
+                return NULL;
+        }
+        item->shminfo.shmid = shmget(IPC_PRIVATE, item->data->bytes_per_line * item->data->height, IPC_CREAT | 0600);
+        if (item->shminfo.shmid == -1) {
+                log_perror(LOG_LEVEL_WARNING, MOD_NAME "shmget");
+                XDestroyImage(item->data);
+                free(item);
+                return NULL;
+        }
+        item->shminfo.shmaddr = item->data->data = shmat(item->shminfo.shmid, NULL, 0);
+        item->shminfo.readOnly = False;
+        // attach may fail eg. for a remote display - error is reported asynchronously
+        shm_attach_failed = false;
+        int (*old_handler)(Display *, XErrorEvent *) = XSetErrorHandler(shm_error_handler);
+        Status attached = XShmAttach(s->dpy, &item->shminfo);
+        XSync(s->dpy, False);
+        XSetErrorHandler(old_handler);
+        shmctl(item->shminfo.shmid, IPC_RMID, NULL); // removed after last detach
+        if (!attached || shm_attach_failed) {
+                shmdt(item->shminfo.shmaddr);
+                XDestroyImage(item->data);
+                free(item);
+                return NULL;
+        }
+        return item;
+}
+#endif // HAVE_XSHM
+
+static void destroy_item(struct vidcap_screen_x11_state *s, struct grabbed_data *item) {
+#ifdef HAVE_XSHM
+        if (item->shminfo.shmaddr != NULL) {
+                XShmDetach(s->dpy, &item->shminfo);
+                XDestroyImage(item->data);
+                shmdt(item->shminfo.shmaddr);
+                free(item);
+                return;
+        }
+#else
+        UNUSED(s);
+#endif // HAVE_XSHM
+        if (item->data) {
+                XDestroyImage(item->data);
+        }
+        free(item);
+}
+
+/// gives back the item after the image was consumed - SHM images are kept for reuse
+static void release_item(struct vidcap_screen_x11_state *s, struct grabbed_data *item) {
+#ifdef HAVE_XSHM
+        if (item->shminfo.shmaddr != NULL) {
+                pthread_mutex_lock(&s->lock);
+                item->next = s->free_shm_images;
+                s->free_shm_images = item;
+                pthread_mutex_unlock(&s->lock);
+                return;
+        }
+#endif // HAVE_XSHM
+        destroy_item(s, item);
+}
+
 static bool initialize(struct vidcap_screen_x11_state *s) {
         s->frame = vf_alloc(1);
         s->tile = vf_get_tile(s->frame, 0);
@@ -159,6 +258,28 @@ static bool initialize(struct vidcap_screen_x11_state *s) {
 
         s->should_exit_worker = false;
 
+#ifdef HAVE_XSHM
+        s->use_shm = !s->no_shm && XShmQueryExtension(s->dpy);
+        if (s->use_shm) {
+                // check that SHM actually works with the display
+                s->free_shm_images = create_shm_image(s);
+                s->use_shm = s->free_shm_images != NULL;
+        }
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "MIT-SHM %s\n", s->use_shm ? "used" : "not used");
+#endif // HAVE_XSHM
+#ifdef HAVE_XDAMAGE
+        if (s->use_damage) {
+                int error_base = 0;
+                if (XDamageQueryExtension(s->dpy, &s->damage_event_base, &error_base)) {
+                        s->damage = XDamageCreate(s->dpy, s->root, XDamageReportNonEmpty);
+                        s->damage_pending = true;
+                } else {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "XDamage extension not available, capturing every frame.\n");
+                        s->use_damage = false;
+                }
+        }
+#endif // HAVE_XDAMAGE
+
         s->frame->color_spec = RGB;
         if(s->fps > 0.0) {
                 s->frame->fps = s->fps;
@@ -176,53 +297,121 @@ static bool initialize(struct vidcap_screen_x11_state *s) {
 }
 
 
-static void *grab_thread(void *args)
-{
-        struct vidcap_screen_x11_state *s = args;
+#ifdef HAVE_XDAMAGE
+/**
+ * Waits at most one frame time for the captured screen to change.
+ * @retval true if the screen was damaged since previous capture
+ */
+static bool wait_for_damage(struct vidcap_screen_x11_state *s) {
+        bool damaged = s->damage_pending;
+        struct timeval timeout = { 0, (suseconds_t) (1000000 / s->frame->fps) };
+        while (!damaged) {
+                while (XPending(s->dpy) > 0) {
+                        XEvent ev;
+                        XNextEvent(s->dpy, &ev);
+                        if (ev.type == s->damage_event_base + XDamageNotify) {
+                                damaged = true;
+                        }
+                }
+                if (damaged) {
+                        break;
+                }
+                int fd = ConnectionNumber(s->dpy);
+                fd_set fds;
+                FD_ZERO(&fds);
+                FD_SET(fd, &fds);
+                if (select(fd + 1, &fds, NULL, NULL, &timeout) <= 0) {
+                        break; // timeout - unchanged
+                }
+        }
+        if (damaged) {
+                XDamageSubtract(s->dpy, s->damage, None, None);
+                s->damage_pending = false;
+        }
+        return damaged;
+}
+#endif // HAVE_XDAMAGE
 
-        while(!s->should_exit_worker) {
-                struct grabbed_data *new_item = malloc(sizeof(struct grabbed_data));
+static struct grabbed_data *grab_image(struct vidcap_screen_x11_state *s)
+{
+        struct grabbed_data *new_item = NULL;
 
 #ifdef HAVE_XFIXES
-                XFixesCursorImage *cursor =
-                        XFixesGetCursorImage (s->dpy);
+        XFixesCursorImage *cursor =
+                XFixesGetCursorImage (s->dpy);
 #endif // HAVE_XFIXES
+#ifdef HAVE_XSHM
+        if (s->use_shm) {
+                pthread_mutex_lock(&s->lock);
+                new_item = s->free_shm_images;
+                if (new_item) {
+                        s->free_shm_images = new_item->next;
+                }
+                pthread_mutex_unlock(&s->lock);
+                if (new_item == NULL) {
+                        new_item = create_shm_image(s);
+                }
+                if (new_item != NULL && !XShmGetImage(s->dpy, s->root, new_item->data, s->x, s->y, AllPlanes)) {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "XShmGetImage failed!\n");
+                }
+        }
+#endif // HAVE_XSHM
+        if (new_item == NULL) {
+                new_item = calloc(1, sizeof(struct grabbed_data));
                 new_item->data = XGetImage(s->dpy,s->root, s->x, s->y, s->tile->width, s->tile->height, AllPlanes, ZPixmap);
-                assert(new_item->data != NULL);
+        }
+        assert(new_item->data != NULL);
 
 #ifdef HAVE_XFIXES
-                if (cursor) {
-                        uint32_t *image_data = (uint32_t *)(void *) new_item->data->data;
-                        for(int x = 0; x < cursor->width; ++x) {
-                                for(int y = 0; y < cursor->height; ++y) {
-                                        if(cursor->x + x >= (int) s->tile->width ||
-                                                        cursor->y + y >= (int) s->tile->height)
-                                                continue;
-                                        //image_data[x + y * s->tile->width] = cursor->pixels[x + y * cursor->width];
-                                        uint_fast32_t cursor_pix = cursor->pixels[x + y * cursor->width];
-                                        ///fprintf(stderr, "%d %d\n", cursor->x + x, cursor->y + y);
-                                        int alpha = cursor_pix >> 24 & 0xff;
-                                        int r1 = cursor_pix >> 16 & 0xff,
-                                            g1 = cursor_pix >> 8 & 0xff,
-                                            b1 = cursor_pix >> 0 & 0xff;
-                                        uint_fast32_t image_pix = image_data[cursor->x + x + (cursor->y + y) * s->tile->width];
-                                        int r2 = image_pix >> 16 & 0xff,
-                                            g2 = image_pix >> 8 & 0xff,
-                                            b2 = image_pix >> 0 & 0xff;
-                                        float scale_image = (float) (255 - alpha)/ 255;
-                                        float scale_cursor = (float) alpha / 255;
-
-                                        image_data[cursor->x + x + (cursor->y + y) * s->tile->width] =
-                                                ((int) (r1 * scale_cursor + r2 * scale_image) & 0xff) << 16 |
-                                                ((int) (g1 * scale_cursor + g2 * scale_image) & 0xff) << 8 |
-                                                ((int) (b1 * scale_cursor + b2 * scale_image) & 0xff) << 0;
-                                }
+        if (cursor) {
+                uint32_t *image_data = (uint32_t *)(void *) new_item->data->data;
+                for(int x = 0; x < cursor->width; ++x) {
+                        for(int y = 0; y < cursor->height; ++y) {
+                                if(cursor->x + x >= (int) s->tile->width ||
+                                                cursor->y + y >= (int) s->tile->height)
+                                        continue;
+                                //image_data[x + y * s->tile->width] = cursor->pixels[x + y * cursor->width];
+                                uint_fast32_t cursor_pix = cursor->pixels[x + y * cursor->width];
+                                ///fprintf(stderr, "%d %d\n", cursor->x + x, cursor->y + y);
+                                int alpha = cursor_pix >> 24 & 0xff;
+                                int r1 = cursor_pix >> 16 & 0xff,
+                                    g1 = cursor_pix >> 8 & 0xff,
+                                    b1 = cursor_pix >> 0 & 0xff;
+                                uint_fast32_t image_pix = image_data[cursor->x + x + (cursor->y + y) * s->tile->width];
+                                int r2 = image_pix >> 16 & 0xff,
+                                    g2 = image_pix >> 8 & 0xff,
+                                    b2 = image_pix >> 0 & 0xff;
+                                float scale_image = (float) (255 - alpha)/ 255;
+                                float scale_cursor = (float) alpha / 255;
+
+                                image_data[cursor->x + x + (cursor->y + y) * s->tile->width] =
+                                        ((int) (r1 * scale_cursor + r2 * scale_image) & 0xff) << 16 |
+                                        ((int) (g1 * scale_cursor + g2 * scale_image) & 0xff) << 8 |
+                                        ((int) (b1 * scale_cursor + b2 * scale_image) & 0xff) << 0;
                         }
-
-                        XFree(cursor);
                 }
+
+                XFree(cursor);
+        }
 #endif // HAVE_XFIXES
 
+        return new_item;
+}
+
+static void *grab_thread(void *args)
+{
+        struct vidcap_screen_x11_state *s = args;
+
+        while(!s->should_exit_worker) {
+                struct grabbed_data *new_item = NULL;
+#ifdef HAVE_XDAMAGE
+                if (s->use_damage && !wait_for_damage(s)) {
+                        new_item = calloc(1, sizeof(struct grabbed_data));
+                }
+#endif // HAVE_XDAMAGE
+                if (new_item == NULL) {
+                        new_item = grab_image(s);
+                }
                 new_item->next = NULL;
 
                 pthread_mutex_lock(&s->lock);
@@ -312,6 +501,14 @@ static _Bool parse_fmt(struct vidcap_screen_x11_state *s, char *fmt) {
                         s->req_display = realloc(s->req_display, strlen(s->req_display) + 1 + strlen(tok) + 1);
                         strcat(s->req_display, ":");
                         strcat(s->req_display, tok);
+                } else if (strcmp(tok, "noshm") == 0) {
+                        s->no_shm = true;
+                } else if (strcmp(tok, "damage") == 0) {
+#ifdef HAVE_XDAMAGE
+                        s->use_damage = true;
+#else
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Compiled without XDamage, option ignored.\n");
+#endif // HAVE_XDAMAGE
                 } else if (strstr(tok, "geometry=") == tok || strstr(tok, "size=") == tok) {
                         char *val = strchr(tok, '=') + 1;
                         s->width = atoi(val);
@@ -410,10 +607,16 @@ static void vidcap_screen_x11_done(void *state)
                 while(s->queue_len > 0) {
                         struct grabbed_data *item = s->head;
                         s->head = s->head->next;
-                        XDestroyImage(item->data);
-                        free(item);
+                        destroy_item(s, item);
                         s->queue_len -= 1;
                 }
+#ifdef HAVE_XSHM
+                while (s->free_shm_images) {
+                        struct grabbed_data *item = s->free_shm_images;
+                        s->free_shm_images = item->next;
+                        destroy_item(s, item);
+                }
+#endif // HAVE_XSHM
         }
         pthread_mutex_unlock(&s->lock);
 
@@ -466,10 +669,11 @@ static struct video_frame * vidcap_screen_x11_grab(void *state, struct audio_fra
          * some configurations, but seems to work currently. To be corrected if there is an
          * opposite case.
          */
-        parallel_pix_conv(s->tile->height, s->tile->data, vc_get_linesize(s->tile->width, RGB), &item->data->data[0], vc_get_linesize(s->tile->width, RGBA), vc_copylineABGRtoRGB, s->cpu_count);
+        if (item->data != NULL) { // otherwise unchanged, keep the last frame
+                parallel_pix_conv(s->tile->height, s->tile->data, vc_get_linesize(s->tile->width, RGB), &item->data->data[0], vc_get_linesize(s->tile->width, RGBA), vc_copylineABGRtoRGB, s->cpu_count);
+        }
 
-        XDestroyImage(item->data);
-        free(item);
+        release_item(s, item);
 
         if(s->fps > 0.0) {
                 struct timeval cur_time;
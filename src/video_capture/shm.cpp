@@ -0,0 +1,208 @@
+/**
+ * @file   video_capture/shm.cpp
+ *
+ * Captures frames put to a shared memory ring by another UltraGrid process
+ * with "-d shm" (see utils/video_shm.h). Frames point directly to the
+ * shared memory, the slot is held until the frame is disposed.
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ * 
+ *      This product includes software developed by CESNET z.s.p.o.
+ * 
+ * 4. Neither the name of the CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "debug.h"
+#include "lib_common.h"
+#include "rang.hpp"
+#include "utils/video_shm.h"
+#include "video.h"
+#include "video_capture.h"
+
+#define MOD_NAME "[shm] "
+#define WAIT_MS 100
+
+using std::atomic;
+using std::cout;
+using std::string;
+using rang::style;
+
+namespace {
+/// segment mapping, outlives the capture state while frames reference it
+struct shm_mapping {
+        struct video_shm *shm;
+        atomic<int> refs{1};
+};
+
+struct shm_frame_ref {
+        shm_mapping *mapping;
+        int slot;
+};
+
+struct state_vidcap_shm {
+        string name;
+        shm_mapping *mapping = nullptr;
+        uint64_t last_seq = 0;
+        bool waiting_reported = false;
+};
+} // end of anonymous namespace
+
+static void mapping_unref(shm_mapping *mapping) {
+        if (--mapping->refs == 0) {
+                video_shm_close(mapping->shm);
+                delete mapping;
+        }
+}
+
+static void vidcap_shm_dispose(struct video_frame *f) {
+        auto *ref = static_cast<shm_frame_ref *>(f->callbacks.dispose_udata);
+        video_shm_release(ref->mapping->shm, ref->slot);
+        mapping_unref(ref->mapping);
+        delete ref;
+        vf_free(f);
+}
+
+static int vidcap_shm_init(struct vidcap_params *params, void **state)
+{
+        const char *fmt = vidcap_params_get_fmt(params);
+        if (strcmp(fmt, "help") == 0) {
+                cout << "Usage:\n";
+                cout << "\t" << style::bold << "-t shm:name=<name>" << style::reset << "\n";
+                cout << "where\n";
+                cout << "\t" << style::bold << "<name>" << style::reset << " - name of the segment created by \"-d shm:name=<name>\" in another process\n";
+                return VIDCAP_INIT_NOERR;
+        }
+        if (vidcap_params_get_flags(params) & VIDCAP_FLAG_AUDIO_ANY) {
+                return VIDCAP_INIT_AUDIO_NOT_SUPPOTED;
+        }
+        if (strstr(fmt, "name=") != fmt || strlen(fmt) == strlen("name=")) {
+                LOG(LOG_LEVEL_ERROR) << MOD_NAME "Segment name must be given!\n";
+                return VIDCAP_INIT_FAIL;
+        }
+        auto *s = new state_vidcap_shm();
+        s->name = fmt + strlen("name=");
+
+        *state = s;
+        return VIDCAP_INIT_OK;
+}
+
+static void vidcap_shm_done(void *state)
+{
+        auto *s = static_cast<state_vidcap_shm *>(state);
+        if (s->mapping) {
+                mapping_unref(s->mapping);
+        }
+        delete s;
+}
+
+static struct video_frame *vidcap_shm_grab(void *state, struct audio_frame **audio)
+{
+        auto *s = static_cast<state_vidcap_shm *>(state);
+        *audio = nullptr;
+
+        if (!s->mapping) {
+                struct video_shm *shm = video_shm_open(s->name.c_str());
+                if (!shm) {
+                        if (!s->waiting_reported) {
+                                LOG(LOG_LEVEL_NOTICE) << MOD_NAME "Waiting for the writer of \"" << s->name << "\".\n";
+                                s->waiting_reported = true;
+                        }
+                        std::this_thread::sleep_for(std::chrono::milliseconds(WAIT_MS));
+                        return nullptr;
+                }
+                s->mapping = new shm_mapping{shm};
+                s->last_seq = 0;
+                s->waiting_reported = false;
+        }
+
+        struct video_desc desc{};
+        size_t data_len = 0;
+        int slot = video_shm_wait(s->mapping->shm, &s->last_seq, WAIT_MS, &desc, &data_len);
+        if (slot == -2) {
+                LOG(LOG_LEVEL_VERBOSE) << MOD_NAME "Segment replaced, reopening.\n";
+                mapping_unref(s->mapping);
+                s->mapping = nullptr;
+                return nullptr;
+        }
+        if (slot == -1) {
+                return nullptr;
+        }
+
+        struct video_frame *f = vf_alloc_desc(desc);
+        const size_t tile_stride = video_shm_get_tile_stride(desc);
+        char *data = video_shm_get_slot_data(s->mapping->shm, slot);
+        for (unsigned i = 0; i < f->tile_count; ++i) {
+                f->tiles[i].data = data + i * tile_stride;
+                f->tiles[i].data_len = data_len;
+        }
+        s->mapping->refs += 1;
+        f->callbacks.dispose_udata = new shm_frame_ref{s->mapping, slot};
+        f->callbacks.dispose = vidcap_shm_dispose;
+
+        return f;
+}
+
+static struct vidcap_type *vidcap_shm_probe(bool /* verbose */, void (**deleter)(void *))
+{
+        struct vidcap_type *vt;
+        *deleter = free;
+
+        vt = (struct vidcap_type *) calloc(1, sizeof(struct vidcap_type));
+        if (vt != NULL) {
+                vt->name = "shm";
+                vt->description = "Frames from another UltraGrid process (-d shm)";
+        }
+        return vt;
+}
+
+static const struct video_capture_info vidcap_shm_info = {
+        vidcap_shm_probe,
+        vidcap_shm_init,
+        vidcap_shm_done,
+        vidcap_shm_grab,
+        true
+};
+
+REGISTER_MODULE(shm, &vidcap_shm_info, LIBRARY_CLASS_VIDEO_CAPTURE, VIDEO_CAPTURE_ABI_VERSION);
+
@@ -50,6 +50,11 @@
 #include <SpoutSDK/Spout.h>
 #include <string>
 
+#ifdef HAVE_CUDA
+#include <cuda_gl_interop.h>
+#include <cuda_runtime_api.h>
+#endif // defined HAVE_CUDA
+
 #include "debug.h"
 #include "host.h"
 #include "lib_common.h"
@@ -80,6 +85,13 @@ struct state_vidcap_spout {
 
         char server_name[256];
 
+        bool use_cuda;
+#ifdef HAVE_CUDA
+        GLuint tex;                      ///< shared texture is received to this texture
+        cudaGraphicsResource *cuda_res;  ///< tex registered with CUDA
+        struct video_frame *cuda_frame;  ///< output frame in CUDA memory (reused)
+#endif // defined HAVE_CUDA
+
         std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
         std::chrono::steady_clock::time_point last_frame_captured = std::chrono::steady_clock::now();
         int frames;
@@ -88,11 +100,16 @@ struct state_vidcap_spout {
 static void usage()
 {
         col() << "Usage:\n";
-        col() << "\t" << TBOLD(TRED("-t spout") << "[:name=<server_name>|device=<idx>][:fps=<fps>][:codec=<codec>]") << "\n";
+        col() << "\t" << TBOLD(TRED("-t spout") << "[:name=<server_name>|device=<idx>][:fps=<fps>][:codec=<codec>][:cuda]") << "\n";
         col() << "where\n";
         col() << "\t" << TBOLD("name") << "\n\t\tSPOUT server name\n";
         col() << "\t" << TBOLD("fps") << "\n\t\tFPS count (default: " << DEFAULT_FPS << ")\n";
         col() << "\t" << TBOLD("codec") << "\n\t\tvideo codec (default: " << get_codec_name(DEFAULT_CODEC) << ")\n";
+        col() << "\t" << TBOLD("cuda") << "\n\t\tkeep the shared texture on the GPU - output RGBA frame in CUDA memory (for GPU compressions)"
+#ifndef HAVE_CUDA
+                << " - " << TRED("not compiled in")
+#endif // ! defined HAVE_CUDA
+                << "\n";
         col() << "\nServers:\n";
         auto receiver = shared_ptr<SpoutReceiver>(new SpoutReceiver);
         int count = receiver->GetSenderCount();
@@ -135,6 +152,79 @@ static string vidcap_spout_get_device_name(int idx)
         return name.data();
 }
 
+static void vidcap_spout_done(void *state);
+
+#ifdef HAVE_CUDA
+/**
+ * Prepares a GL texture registered with CUDA that the shared texture is
+ * received to, and the output frame in CUDA memory. Must be called with
+ * the GL context current.
+ */
+static bool init_cuda(state_vidcap_spout *s)
+{
+        unsigned int count = 0;
+        int device = 0;
+        if (cudaGLGetDevices(&count, &device, 1, cudaGLDeviceListAll) != cudaSuccess || count == 0) {
+                cudaGetLastError(); // reset the error
+                LOG(LOG_LEVEL_ERROR) << MOD_NAME << "GL context doesn't run on a CUDA device!\n";
+                return false;
+        }
+        cudaSetDevice(device);
+
+        glGenTextures(1, &s->tex);
+        glBindTexture(GL_TEXTURE_2D, s->tex);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, s->desc.width, s->desc.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        s->cuda_frame = vf_alloc_desc(s->desc);
+        s->cuda_frame->tiles[0].data_len = vc_get_linesize(s->desc.width, RGBA) * s->desc.height;
+        s->cuda_frame->mem_location = CUDA_MEM;
+        if (cudaGraphicsGLRegisterImage(&s->cuda_res, s->tex, GL_TEXTURE_2D, cudaGraphicsRegisterFlagsReadOnly) != cudaSuccess
+                        || cudaMalloc((void **) &s->cuda_frame->tiles[0].data, s->cuda_frame->tiles[0].data_len) != cudaSuccess) {
+                LOG(LOG_LEVEL_ERROR) << MOD_NAME << "CUDA initialization failed: " << cudaGetErrorString(cudaGetLastError()) << "\n";
+                return false;
+        }
+        LOG(LOG_LEVEL_INFO) << MOD_NAME << "Using CUDA device " << device << ", frames stay in GPU memory.\n";
+        return true;
+}
+
+static void done_cuda(state_vidcap_spout *s)
+{
+        if (s->cuda_res != nullptr) {
+                cudaGraphicsUnregisterResource(s->cuda_res);
+        }
+        if (s->cuda_frame != nullptr) {
+                cudaFree(s->cuda_frame->tiles[0].data);
+                vf_free(s->cuda_frame);
+        }
+        if (s->tex != 0) {
+                glDeleteTextures(1, &s->tex);
+        }
+}
+
+/// receives the shared texture and copies it (device-to-device) to s->cuda_frame
+static bool receive_to_cuda(state_vidcap_spout *s)
+{
+        unsigned int width = s->desc.width;
+        unsigned int height = s->desc.height;
+        if (!s->spout_state->ReceiveTexture(s->server_name, width, height, s->tex, GL_TEXTURE_2D)) {
+                return false;
+        }
+        cudaArray_t array = nullptr;
+        if (cudaGraphicsMapResources(1, &s->cuda_res, nullptr) != cudaSuccess) {
+                return false;
+        }
+        size_t linesize = vc_get_linesize(s->desc.width, RGBA);
+        bool ret = cudaGraphicsSubResourceGetMappedArray(&array, s->cuda_res, 0, 0) == cudaSuccess
+                && cudaMemcpy2DFromArray(s->cuda_frame->tiles[0].data, linesize, array, 0, 0, linesize, s->desc.height,
+                                cudaMemcpyDeviceToDevice) == cudaSuccess;
+        cudaGraphicsUnmapResources(1, &s->cuda_res, nullptr);
+        return ret;
+}
+#endif // defined HAVE_CUDA
+
 static int vidcap_spout_init(struct vidcap_params *params, void **state)
 {
         state_vidcap_spout *s = new state_vidcap_spout();
@@ -170,6 +260,14 @@ static int vidcap_spout_init(struct vidcap_params *params, void **state)
                         fps = atof(item + strlen("fps="));
                 } else if (strstr(item, "codec=") == item) {
                         codec = get_codec_from_name(item + strlen("codec="));
+                } else if (strcmp(item, "cuda") == 0) {
+#ifdef HAVE_CUDA
+                        s->use_cuda = true;
+#else
+                        LOG(LOG_LEVEL_ERROR) << MOD_NAME << "CUDA support not compiled in!\n";
+                        ret = VIDCAP_INIT_FAIL;
+                        break;
+#endif // defined HAVE_CUDA
                 } else {
                         LOG(LOG_LEVEL_ERROR) << "[SPOUT] Unknown argument - " << item << "\n";
                         ret = VIDCAP_INIT_FAIL;
@@ -185,6 +283,10 @@ static int vidcap_spout_init(struct vidcap_params *params, void **state)
                 return ret;
         }
 
+        if (s->use_cuda) {
+                codec = RGBA; // the texture is copied as it is
+        }
+
         switch (codec) {
         case RGB:
                 s->gl_format = GL_RGB;
@@ -230,6 +332,14 @@ static int vidcap_spout_init(struct vidcap_params *params, void **state)
 
         s->desc = video_desc{width, height, codec, fps, PROGRESSIVE, 1};
 
+#ifdef HAVE_CUDA
+        if (s->use_cuda && !init_cuda(s)) {
+                gl_context_make_current(NULL);
+                vidcap_spout_done(s);
+                return VIDCAP_INIT_FAIL;
+        }
+#endif // defined HAVE_CUDA
+
         gl_context_make_current(NULL);
 
         *state = s;
@@ -242,6 +352,9 @@ static void vidcap_spout_done(void *state)
         state_vidcap_spout *s = (state_vidcap_spout *) state;
 
         gl_context_make_current(&s->glc);
+#ifdef HAVE_CUDA
+        done_cuda(s);
+#endif // defined HAVE_CUDA
         s->spout_state->ReleaseReceiver();
         destroy_gl_context(&s->glc);
 
@@ -251,15 +364,23 @@ static void vidcap_spout_done(void *state)
 static struct video_frame *vidcap_spout_grab(void *state, struct audio_frame **audio)
 {
         state_vidcap_spout *s = (state_vidcap_spout *) state;
+        struct video_frame *out = nullptr;
+        bool ret = false;
 
-        struct video_frame *out = vf_alloc_desc_data(s->desc);
-        out->callbacks.dispose = vf_free;
-
-        unsigned int width, height;
-        width = s->desc.width;
-        height = s->desc.height;
         gl_context_make_current(&s->glc);
-        bool ret = s->spout_state->ReceiveImage(s->server_name, width, height, (unsigned char *) out->tiles[0].data, s->gl_format);
+#ifdef HAVE_CUDA
+        if (s->use_cuda) {
+                out = s->cuda_frame;
+                ret = receive_to_cuda(s);
+        } else
+#endif // defined HAVE_CUDA
+        {
+                out = vf_alloc_desc_data(s->desc);
+                out->callbacks.dispose = vf_free;
+                unsigned int width = s->desc.width;
+                unsigned int height = s->desc.height;
+                ret = s->spout_state->ReceiveImage(s->server_name, width, height, (unsigned char *) out->tiles[0].data, s->gl_format);
+        }
         gl_context_make_current(NULL);
         if (ret) {
                 // statistics
@@ -273,7 +394,9 @@ static struct video_frame *vidcap_spout_grab(void *state, struct audio_frame **a
                         s->frames = 0;
                 }
         } else {
-                vf_free(out);
+                if (!s->use_cuda) {
+                        vf_free(out);
+                }
                 return NULL;
         }
 
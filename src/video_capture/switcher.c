@@ -48,13 +48,20 @@
 
 #include "audio/types.h"
 #include "module.h"
+#include "utils/thread.h"
+#include "utils/video_frame_pool.h"
 
 #include <inttypes.h>
 #include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 #define MOD_NAME "[switcher] "
+#define SWITCHER_GRAB_TIMEOUT_MS 100
+#define SWITCHER_POOL_LEN 4
+#define SWITCHER_MAX_AUDIO_SEC 2 ///< max audio buffered between grabs
 
 /* prototypes of functions defined in this module */
 static void show_help(void);
@@ -63,13 +70,29 @@ static void show_help()
 {
         printf("switcher capture\n");
         printf("Usage\n");
-        printf("\t--control-port <port> -t switcher[:excl_init][:fallback] -t <dev1_config> -t <dev2_config> ....]\n");
+        printf("\t--control-port <port> -t switcher[:excl_init][:fallback][:parallel] -t <dev1_config> -t <dev2_config> ....]\n");
         printf("\t\t<devn_config> is a configuration of device to be switched\n");
         printf("\t\t<port> specifies port which should be used to control switching\n");
         printf("\t\texcl_init - devices will be initialized after switching to and deinitialized after switching to another\n");
         printf("\t\tfallback - in case that capture doesn't return a frame (in time), capture from next available device(s)\n");
+        printf("\t\tparallel - all devices are grabbed continuously by own threads, switching is instant\n");
 }
 
+struct vidcap_switcher_state;
+
+/// device grabbed by its own thread in parallel mode
+struct switcher_source {
+        struct vidcap_switcher_state *parent;
+        unsigned int        index;
+        pthread_t           thread;
+        bool                thread_started;
+        /// latest grabbed frame (always with a dispose callback), exchanged
+        /// by the grabbing thread and vidcap_switcher_grab()
+        struct video_frame *_Atomic latest;
+        void               *pool; ///< for copies of frames without dispose callback
+        struct video_desc   pool_desc;
+};
+
 struct vidcap_switcher_state {
         struct module       mod;
         struct vidcap     **devices;
@@ -80,6 +103,16 @@ struct vidcap_switcher_state {
         struct vidcap_params *params;
         bool                excl_init;
         bool                fallback;
+        bool                parallel;
+
+        // parallel mode
+        struct switcher_source *sources;
+        atomic_uint         active_source; ///< selected_device for grabbing threads
+        atomic_bool         should_exit_threads;
+        pthread_mutex_t     lock;
+        pthread_cond_t      frame_ready;
+        struct audio_frame  audio_acc; ///< accumulated from the active source
+        struct audio_frame  audio_out; ///< returned from grab, valid until next one
 };
 
 
@@ -110,6 +143,125 @@ static void vidcap_switcher_register_keyboard_ctl(struct vidcap_switcher_state *
         }
 }
 
+/// @note called with s->lock locked
+static void switcher_append_audio(struct vidcap_switcher_state *s, const struct audio_frame *audio)
+{
+        struct audio_frame *acc = &s->audio_acc;
+        if (acc->bps != audio->bps || acc->ch_count != audio->ch_count ||
+                        acc->sample_rate != audio->sample_rate) {
+                acc->bps = audio->bps;
+                acc->ch_count = audio->ch_count;
+                acc->sample_rate = audio->sample_rate;
+                acc->data_len = 0;
+        }
+        const int max_len = SWITCHER_MAX_AUDIO_SEC * audio->sample_rate * audio->ch_count * audio->bps;
+        if (acc->data_len + audio->data_len > max_len) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Audio not grabbed, dropping.\n");
+                acc->data_len = 0;
+        }
+        if (acc->data_len + audio->data_len > acc->max_size) {
+                acc->max_size = acc->data_len + audio->data_len;
+                acc->data = realloc(acc->data, acc->max_size);
+        }
+        memcpy(acc->data + acc->data_len, audio->data, audio->data_len);
+        acc->data_len += audio->data_len;
+}
+
+/**
+ * Copies a frame that is valid only until next vidcap_grab() of the device
+ * to a pooled frame.
+ */
+static struct video_frame *switcher_copy_frame(struct switcher_source *src, struct video_frame *frame)
+{
+        struct video_desc desc = video_desc_from_frame(frame);
+        if (src->pool == NULL || !video_desc_eq(desc, src->pool_desc)) {
+                // pool destruction waits for its frames, so do not keep one
+                struct video_frame *old = atomic_exchange(&src->latest, NULL);
+                VIDEO_FRAME_DISPOSE(old);
+                if (src->pool != NULL) {
+                        video_frame_pool_destroy(src->pool);
+                }
+                src->pool = video_frame_pool_init(desc, SWITCHER_POOL_LEN);
+                src->pool_desc = desc;
+        }
+
+        struct video_frame *out = video_frame_pool_get_disposable_frame(src->pool);
+        for (unsigned int i = 0; i < frame->tile_count; ++i) {
+                if (frame->tiles[i].data_len > out->tiles[i].data_len) { // eg. compressed
+                        VIDEO_FRAME_DISPOSE(out);
+                        out = vf_get_copy(frame);
+                        out->callbacks.dispose = vf_free;
+                        break;
+                }
+                memcpy(out->tiles[i].data, frame->tiles[i].data, frame->tiles[i].data_len);
+                out->tiles[i].data_len = frame->tiles[i].data_len;
+        }
+        vf_copy_metadata(out, frame);
+        return out;
+}
+
+static void *switcher_grab_thread(void *arg)
+{
+        set_thread_name("switcher_grab");
+        struct switcher_source *src = arg;
+        struct vidcap_switcher_state *s = src->parent;
+
+        while (!atomic_load(&s->should_exit_threads)) {
+                struct audio_frame *audio = NULL;
+                struct video_frame *frame = vidcap_grab(s->devices[src->index], &audio);
+                const bool active = atomic_load(&s->active_source) == src->index;
+                if (audio != NULL && active) {
+                        pthread_mutex_lock(&s->lock);
+                        switcher_append_audio(s, audio);
+                        pthread_mutex_unlock(&s->lock);
+                }
+                AUDIO_FRAME_DISPOSE(audio);
+                if (frame == NULL) {
+                        continue;
+                }
+                if (!frame->callbacks.dispose) {
+                        if (!active && !s->fallback) { // no one will use it
+                                continue;
+                        }
+                        frame = switcher_copy_frame(src, frame);
+                }
+                struct video_frame *old = atomic_exchange(&src->latest, frame);
+                VIDEO_FRAME_DISPOSE(old);
+
+                pthread_mutex_lock(&s->lock);
+                pthread_cond_broadcast(&s->frame_ready);
+                pthread_mutex_unlock(&s->lock);
+        }
+
+        return NULL;
+}
+
+static void switcher_stop_threads(struct vidcap_switcher_state *s)
+{
+        if (s->sources == NULL) {
+                return;
+        }
+        atomic_store(&s->should_exit_threads, true);
+        for (unsigned int i = 0U; i < s->devices_cnt; ++i) {
+                if (s->sources[i].thread_started) {
+                        pthread_join(s->sources[i].thread, NULL);
+                }
+        }
+        for (unsigned int i = 0U; i < s->devices_cnt; ++i) {
+                struct video_frame *last = atomic_exchange(&s->sources[i].latest, NULL);
+                VIDEO_FRAME_DISPOSE(last);
+                if (s->sources[i].pool != NULL) {
+                        video_frame_pool_destroy(s->sources[i].pool);
+                }
+        }
+        free(s->sources);
+        s->sources = NULL;
+        free(s->audio_acc.data);
+        free(s->audio_out.data);
+        pthread_cond_destroy(&s->frame_ready);
+        pthread_mutex_destroy(&s->lock);
+}
+
 static int
 vidcap_switcher_init(struct vidcap_params *params, void **state)
 {
@@ -139,6 +291,8 @@ vidcap_switcher_init(struct vidcap_params *params, void **state)
                                 s->excl_init = true;
                         } else if (strcmp(item, "fallback") == 0) {
                                 s->fallback = true;
+                        } else if (strcmp(item, "parallel") == 0) {
+                                s->parallel = true;
                         } else if (strncasecmp(item, "select=", strlen("select=")) == 0) {
                                 char *val_s = item + strlen("select=");
                                 char *endptr = NULL;;
@@ -166,6 +320,10 @@ vidcap_switcher_init(struct vidcap_params *params, void **state)
                 fprintf(stderr, MOD_NAME "Options \"excl_init\" and \"fallback\" are mutualy incompatible!\n");
                 goto error;
         }
+        if (s->excl_init && s->parallel) {
+                fprintf(stderr, MOD_NAME "Options \"excl_init\" and \"parallel\" are mutualy incompatible!\n");
+                goto error;
+        }
 
         s->devices_cnt = 0;
         struct vidcap_params *tmp = params;
@@ -199,6 +357,24 @@ vidcap_switcher_init(struct vidcap_params *params, void **state)
 
         s->params = params;
 
+        if (s->parallel) {
+                atomic_init(&s->active_source, s->selected_device);
+                atomic_init(&s->should_exit_threads, false);
+                pthread_mutex_init(&s->lock, NULL);
+                pthread_cond_init(&s->frame_ready, NULL);
+                s->sources = calloc(s->devices_cnt, sizeof(struct switcher_source));
+                for (unsigned int i = 0; i < s->devices_cnt; ++i) {
+                        s->sources[i].parent = s;
+                        s->sources[i].index = i;
+                        atomic_init(&s->sources[i].latest, NULL);
+                        if (pthread_create(&s->sources[i].thread, NULL, switcher_grab_thread, &s->sources[i]) != 0) {
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unable to create grabbing thread!\n");
+                                goto error;
+                        }
+                        s->sources[i].thread_started = true;
+                }
+        }
+
         module_init_default(&s->mod);
         s->mod.cls = MODULE_CLASS_DATA;
         module_register(&s->mod, vidcap_params_get_parent(params));
@@ -209,6 +385,7 @@ vidcap_switcher_init(struct vidcap_params *params, void **state)
 	return VIDCAP_INIT_OK;
 
 error:
+        switcher_stop_threads(s);
         if(s->devices) {
                 for (unsigned int i = 0U; i < s->devices_cnt; ++i) {
                         if(s->devices[i]) {
@@ -227,6 +404,7 @@ vidcap_switcher_done(void *state)
 
 	assert(s != NULL);
 
+        switcher_stop_threads(s);
 	if (s != NULL) {
 		for (unsigned int i = 0U; i < s->devices_cnt; ++i) {
                         if (!s->excl_init || i == s->selected_device) {
@@ -238,6 +416,46 @@ vidcap_switcher_done(void *state)
         free(s);
 }
 
+/**
+ * Takes latest frame of the selected source (waiting for it if there is none)
+ * or, with fallback, of any other one if the selected doesn't have any in time.
+ */
+static struct video_frame *
+vidcap_switcher_grab_parallel(struct vidcap_switcher_state *s, struct audio_frame **audio)
+{
+        struct video_frame *frame = NULL;
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += SWITCHER_GRAB_TIMEOUT_MS * 1000 * 1000;
+        deadline.tv_sec += deadline.tv_nsec / NS_IN_SEC;
+        deadline.tv_nsec %= NS_IN_SEC;
+
+        pthread_mutex_lock(&s->lock);
+        while ((frame = atomic_exchange(&s->sources[s->selected_device].latest, NULL)) == NULL) {
+                if (pthread_cond_timedwait(&s->frame_ready, &s->lock, &deadline) == ETIMEDOUT) {
+                        break;
+                }
+        }
+        for (unsigned int i = (s->selected_device + 1U) % s->devices_cnt;
+                        frame == NULL && s->fallback && i != s->selected_device;
+                        i = (i + 1U) % s->devices_cnt) {
+                frame = atomic_exchange(&s->sources[i].latest, NULL);
+        }
+
+        *audio = NULL;
+        if (s->audio_acc.data_len > 0) {
+                struct audio_frame tmp = s->audio_out;
+                s->audio_out = s->audio_acc;
+                s->audio_acc = tmp;
+                s->audio_acc.data_len = 0;
+                *audio = &s->audio_out;
+        }
+        pthread_mutex_unlock(&s->lock);
+
+        return frame;
+}
+
 static struct video_frame *
 vidcap_switcher_grab(void *state, struct audio_frame **audio)
 {
@@ -270,6 +488,9 @@ vidcap_switcher_grab(void *state, struct audio_frame **audio)
                         }
 
                         s->selected_device = new_selected_device;
+                        if (s->parallel) {
+                                atomic_store(&s->active_source, new_selected_device);
+                        }
                         r = new_response(RESPONSE_OK, NULL);
                 } else {
                         log_msg(LOG_LEVEL_ERROR, "[switcher] Cannot switch to device %d. Device out of bounds.\n", new_selected_device);
@@ -278,6 +499,10 @@ vidcap_switcher_grab(void *state, struct audio_frame **audio)
                 free_message(msg, r);
         }
 
+        if (s->parallel) {
+                return vidcap_switcher_grab_parallel(s, audio);
+        }
+
         frame = vidcap_grab(s->devices[s->selected_device], &audio_frame);
         *audio = audio_frame;
 
@@ -287,7 +512,7 @@ vidcap_switcher_grab(void *state, struct audio_frame **audio)
         // if frame was not returned but we have a fallback behavior, try also other devices
         for (unsigned int i = (s->selected_device + 1U) % s->devices_cnt;
                         i != s->selected_device;
-                        i = (s->selected_device + 1U) % s->devices_cnt) {
+                        i = (i + 1U) % s->devices_cnt) {
                 frame = vidcap_grab(s->devices[i], &audio_frame);
                 *audio = audio_frame;
                 if (frame != NULL) {
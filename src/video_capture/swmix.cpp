@@ -36,11 +36,13 @@
  *
  * @brief SW video mix is a virtual video mixer.
  *
- * @todo
- * Reenable configuration file position matching.
+ * Inputs are composited either with OpenGL (default) or, on machines without
+ * a GL context, on CPU with the native resize engine of the resize capture
+ * filter. The GL result is read back asynchronously through a pair of PBOs,
+ * so that frame N is transferred while frame N+1 is being rendered.
  *
  * @todo
- * Refactor to use also different scalers than OpenGL (eg. libswscale)
+ * Reenable configuration file position matching.
  */
 
 #ifdef HAVE_CONFIG_H
@@ -49,6 +51,7 @@
 #include "config_win32.h"
 #endif // HAVE_CONFIG_H
 
+#include "capture_filter/resize_utils.h"
 #include "debug.h"
 #include "gl_context.h"
 #include "host.h"
@@ -56,6 +59,7 @@
 #include "utils/config_file.h"
 #include "video.h"
 #include "video_capture.h"
+#include "video_codec.h"
 
 #include "tv.h"
 
@@ -74,6 +78,11 @@ typedef enum {
         BILINEAR
 } interpolation_t;
 
+typedef enum {
+        BACKEND_GL,
+        BACKEND_CPU, ///< headless, does not need GL context
+} backend_t;
+
 /*
  * Bicubic interpolation taken from:
  * http://www.codeproject.com/Articles/236394/Bi-Cubic-and-Bi-Linear-Interpolation-with-GLSL
@@ -171,6 +180,12 @@ void main()
 static void show_help(void);
 static void *master_worker(void *arg);
 static void *slave_worker(void *arg);
+
+struct pending_readback {
+        char *buffer;
+        char *audio_data;
+        int   audio_len;
+};
 static char *get_config_name(void);
 static bool get_slave_param_from_file(FILE* config, const char *slave_name, int *x, int *y,
                                         int *width, int *height);
@@ -194,7 +209,8 @@ static void show_help()
 {
         printf("SW Mix capture\n");
         printf("Usage\n");
-        printf("\t-t swmix:<width>:<height>:<fps>[:<codec>[:interpolation=<i_type>[,<algo>]][:layout=<X>x<Y>]] "
+        printf("\t-t swmix:<width>:<height>:<fps>[:<codec>[:interpolation=<i_type>[,<algo>]][:layout=<X>x<Y>]"
+                        "[:backend=gl|cpu][:readback=sync]] "
                         "-t <dev1_config> -t <dev2_config>\n");
         printf("\tor\n");
         printf("\t-t swmix:file -t <dev1_config> -t <dev2_config> ...\n");
@@ -207,6 +223,9 @@ static void show_help()
                         "RGB or UYVY (optional, default RGBA)\n");
         printf("\t\t<i_type> can be one of 'bilinear' or 'bicubic' (default)\n");
         printf("\t\t\t<algo> bicubic interpolation algorithm: CatMullRom, BSpline (default) or Triangular\n");
+        printf("\t\tbackend=cpu - composite on CPU (bilinear only), no OpenGL context is needed\n");
+        printf("\t\treadback=sync - read the GL result synchronously (default is asynchronous\n"
+                        "\t\t\treadback adding one frame of latency, needs OpenGL 3.2)\n");
         printf("\n");
         printf("\t\tIn first variant, individual inputs are arranged automatically.\n");
         printf("\t\tWith the second variant, you provide overall layout and layout for \n"
@@ -235,6 +254,8 @@ struct vidcap_swmix_state {
         GLuint              tex_output_uyvy;
         GLuint              fbo;
         GLuint              fbo_uyvy;
+        GLuint              pbo[2];
+        GLsync              pbo_fence[2];
 
         struct video_frame *frame;
         char               *network_buffer;
@@ -264,6 +285,8 @@ struct vidcap_swmix_state {
         GLuint              bicubic_program;
         interpolation_t     interpolation;
         int                 grid_x, grid_y;
+        backend_t           backend;
+        bool                async_readback;
 };
 
 
@@ -294,6 +317,13 @@ struct slave_data {
 
         decoder_t           decoder;
         codec_t             decoder_from, decoder_to;
+
+        // CPU backend
+        char               *cpu_converted; ///< input in output pixel format
+        size_t              cpu_converted_len;
+        char               *cpu_scaled;
+        size_t              cpu_scaled_len;
+        bool                cpu_conversion_warned;
 };
 
 static struct slave_data *init_slave_data(vidcap_swmix_state *s, FILE *config) {
@@ -314,16 +344,18 @@ static struct slave_data *init_slave_data(vidcap_swmix_state *s, FILE *config) {
         }
 
         for(int i = 0; i < s->devices_cnt; ++i) {
-                glGenTextures(2, slaves_data[i].texture);
-                for(int j = 0; j < 2; ++j) {
-                        glBindTexture(GL_TEXTURE_2D, slaves_data[i].texture[j]);
-                        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-                        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-                        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-                        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-                }
+                if (s->backend == BACKEND_GL) {
+                        glGenTextures(2, slaves_data[i].texture);
+                        for(int j = 0; j < 2; ++j) {
+                                glBindTexture(GL_TEXTURE_2D, slaves_data[i].texture[j]);
+                                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+                                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+                                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+                                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+                        }
 
-                glGenFramebuffers(1, &slaves_data[i].fbo);
+                        glGenFramebuffers(1, &slaves_data[i].fbo);
+                }
 
                 slaves_data[i].fb_aspect = (double) s->frame->tiles[0].width /
                         s->frame->tiles[0].height;
@@ -357,10 +389,14 @@ static struct slave_data *init_slave_data(vidcap_swmix_state *s, FILE *config) {
         return slaves_data;
 }
 
-static void destroy_slave_data(struct slave_data *data, int count) {
+static void destroy_slave_data(struct slave_data *data, int count, bool gl) {
         for(int i = 0; i < count; ++i) {
-                glDeleteTextures(2, data[i].texture);
-                glDeleteFramebuffers(1, &data[i].fbo);
+                if (gl) {
+                        glDeleteTextures(2, data[i].texture);
+                        glDeleteFramebuffers(1, &data[i].fbo);
+                }
+                free(data[i].cpu_converted);
+                free(data[i].cpu_scaled);
         }
         free(data);
 }
@@ -606,31 +642,209 @@ static void render_slave(struct slave_data *s, interpolation_t interpolation, GL
         glEnd();
 }
 
+/**
+ * Renders all inputs and reads the result back either to read_buf or, if pbo
+ * is nonzero, to the pixel buffer object (without waiting for the transfer).
+ */
+static void render_gl(struct vidcap_swmix_state *s, GLuint to_uyvy, char *read_buf, GLuint pbo)
+{
+        // draw
+        glBindFramebuffer(GL_FRAMEBUFFER, s->fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0_EXT,
+                        GL_TEXTURE_2D, s->tex_output, 0);
+        glClearColor(0, 0, 0, 1);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        glViewport(0, 0, s->frame->tiles[0].width, s->frame->tiles[0].height);
+
+        if(s->interpolation == BICUBIC) {
+                glUseProgram(s->bicubic_program);
+                glUniform1i(glGetUniformLocation(s->bicubic_program, "image"), 0);
+        }
+
+        for(int i = 0; i < s->devices_cnt; ++i) {
+                if(s->slaves_data[i].current_frame) {
+                        render_slave(&s->slaves_data[i], s->interpolation, s->bicubic_program);
+                }
+        }
+        glUseProgram(0);
+
+        // read back
+        glBindTexture(GL_TEXTURE_2D, s->tex_output);
+        int width = s->frame->tiles[0].width;
+        GLenum format = GL_RGBA;
+        if(s->frame->color_spec == UYVY) {
+                glBindFramebuffer(GL_FRAMEBUFFER, s->fbo_uyvy);
+                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0_EXT,
+                                GL_TEXTURE_2D, s->tex_output_uyvy, 0);
+                glViewport(0, 0, s->frame->tiles[0].width / 2, s->frame->tiles[0].height);
+                glUseProgram(to_uyvy);
+                glBegin(GL_QUADS);
+                glTexCoord2f(0.0, 0.0); glVertex2f(-1.0, -1.0);
+                glTexCoord2f(1.0, 0.0); glVertex2f(1.0, -1.0);
+                glTexCoord2f(1.0, 1.0); glVertex2f(1.0, 1.0);
+                glTexCoord2f(0.0, 1.0); glVertex2f(-1.0, 1.0);
+                glEnd();
+                glUseProgram(0);
+                width /= 2;
+                glBindTexture(GL_TEXTURE_2D, s->tex_output_uyvy);
+        } else if (s->frame->color_spec == RGB) {
+                format = GL_RGB;
+        }
+
+        if (pbo != 0) {
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+        }
+        glReadPixels(0, 0, width,
+                        s->frame->tiles[0].height,
+                        format, GL_UNSIGNED_BYTE,
+                        read_buf);
+        if (pbo != 0) {
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+/**
+ * Waits for the asynchronous readback in pbo[idx] and copies it to the frame
+ * buffer which was rendered into it.
+ * @returns the finished buffer or NULL if there was no readback pending
+ */
+static char *finish_readback(struct vidcap_swmix_state *s, int idx, struct pending_readback *p,
+                char **audio_data, int *audio_len)
+{
+        char *buffer = p->buffer;
+        *audio_data = p->audio_data;
+        *audio_len = p->audio_len;
+        *p = {};
+        if (buffer == NULL) {
+                return NULL;
+        }
+
+        glClientWaitSync(s->pbo_fence[idx], GL_SYNC_FLUSH_COMMANDS_BIT, 1000 * 1000 * 1000);
+        glDeleteSync(s->pbo_fence[idx]);
+        s->pbo_fence[idx] = nullptr;
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, s->pbo[idx]);
+        if (void *ptr = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY)) {
+                memcpy(buffer, ptr, s->frame->tiles[0].data_len);
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        } else {
+                log_msg(LOG_LEVEL_ERROR, "[swmix] Unable to map readback buffer!\n");
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        return buffer;
+}
+
+static char *get_scratch(char **buf, size_t *len, size_t needed)
+{
+        if (*len < needed) {
+                free(*buf);
+                *buf = (char *) malloc(needed);
+                *len = needed;
+        }
+        return *buf;
+}
+
+/**
+ * Composites inputs on CPU - every input is converted to the output pixel
+ * format and scaled to its cell with the native (bilinear) resize.
+ */
+static void render_cpu(struct vidcap_swmix_state *s, char *out)
+{
+        struct tile *tile = &s->frame->tiles[0];
+        codec_t codec = s->frame->color_spec;
+        size_t linesize = vc_get_linesize(tile->width, codec);
+        clear_video_buffer((unsigned char *) out, linesize, linesize, tile->height, codec);
+
+        for (int i = 0; i < s->devices_cnt; ++i) {
+                struct slave_data *sd = &s->slaves_data[i];
+                struct video_frame *f = sd->current_frame;
+                if (f == NULL) {
+                        continue;
+                }
+                unsigned int src_w = f->tiles[0].width;
+                unsigned int src_h = f->tiles[0].height;
+                const char *src = f->tiles[0].data;
+                if (f->color_spec != codec) {
+                        decoder_t decoder = get_decoder_from_to(f->color_spec, codec);
+                        if (decoder == NULL) {
+                                if (!sd->cpu_conversion_warned) {
+                                        log_msg(LOG_LEVEL_ERROR, "[swmix] Cannot convert %s to %s!\n",
+                                                        get_codec_name(f->color_spec), get_codec_name(codec));
+                                        sd->cpu_conversion_warned = true;
+                                }
+                                continue;
+                        }
+                        size_t src_linesize = vc_get_linesize(src_w, f->color_spec);
+                        size_t dst_linesize = vc_get_linesize(src_w, codec);
+                        char *conv = get_scratch(&sd->cpu_converted, &sd->cpu_converted_len,
+                                        dst_linesize * src_h);
+                        for (unsigned int y = 0; y < src_h; ++y) {
+                                decoder((unsigned char *) conv + y * dst_linesize,
+                                                (const unsigned char *) src + y * src_linesize,
+                                                dst_linesize, 0, 8, 16);
+                        }
+                        src = conv;
+                }
+
+                unsigned int cell_x = sd->x * tile->width;
+                unsigned int cell_y = sd->y * tile->height;
+                unsigned int cell_w = sd->width * tile->width;
+                unsigned int cell_h = sd->height * tile->height;
+                if (codec == UYVY) {
+                        cell_x &= ~1U;
+                        cell_w &= ~1U;
+                }
+                if (cell_x >= tile->width || cell_y >= tile->height) {
+                        continue;
+                }
+                cell_w = MIN(cell_w, tile->width - cell_x);
+                cell_h = MIN(cell_h, tile->height - cell_y);
+
+                size_t cell_linesize = vc_get_linesize(cell_w, codec);
+                char *scaled = get_scratch(&sd->cpu_scaled, &sd->cpu_scaled_len, cell_linesize * cell_h);
+                resize_frame_native(src, codec, scaled, src_w, src_h, cell_w, cell_h, true);
+                char *dst = out + cell_y * linesize + vc_get_linesize(cell_x, codec);
+                for (unsigned int y = 0; y < cell_h; ++y) {
+                        memcpy(dst + y * linesize, scaled + y * cell_linesize, cell_linesize);
+                }
+        }
+}
+
 static void *master_worker(void *arg)
 {
         struct vidcap_swmix_state *s = (struct vidcap_swmix_state *) arg;
         struct timeval t0;
-        GLuint from_uyvy, to_uyvy;
+
+        GLuint from_uyvy = 0;
+        GLuint to_uyvy = 0;
 
         gettimeofday(&t0, NULL);
 
-        gl_context_make_current(&s->gl_context);
-        glEnable(GL_TEXTURE_2D);
-        from_uyvy = glsl_compile_link(vprogram, fprogram_from_uyvy);
-        to_uyvy = glsl_compile_link(vprogram, fprogram_to_uyvy);
-        assert(from_uyvy != 0);
-        assert(to_uyvy != 0);
-
-        glUseProgram(to_uyvy);
-        glUniform1i(glGetUniformLocation(to_uyvy, "image"), 0);
-        glUniform1f(glGetUniformLocation(to_uyvy, "imageWidth"),
-                        (GLfloat) s->frame->tiles[0].width);
-        glUseProgram(0);
+        if (s->backend == BACKEND_GL) {
+                gl_context_make_current(&s->gl_context);
+                glEnable(GL_TEXTURE_2D);
+                from_uyvy = glsl_compile_link(vprogram, fprogram_from_uyvy);
+                to_uyvy = glsl_compile_link(vprogram, fprogram_to_uyvy);
+                assert(from_uyvy != 0);
+                assert(to_uyvy != 0);
+
+                glUseProgram(to_uyvy);
+                glUniform1i(glGetUniformLocation(to_uyvy, "image"), 0);
+                glUniform1f(glGetUniformLocation(to_uyvy, "imageWidth"),
+                                (GLfloat) s->frame->tiles[0].width);
+                glUseProgram(0);
+        }
 
         int field = 0;
         char *tmp_buffer = (char *) malloc(s->frame->tiles[0].data_len);
 
         char *current_buffer = NULL;
+        struct pending_readback pending[2] = {};
+        int pbo_idx = 0;
 
         while(1) {
                 pthread_mutex_lock(&s->lock);
@@ -670,7 +884,7 @@ static void *master_worker(void *arg)
                 }
 
                 // check for mode change
-                for(int i = 0; i < s->devices_cnt; ++i) {
+                for(int i = 0; i < s->devices_cnt && s->backend == BACKEND_GL; ++i) {
                         if(s->slaves_data[i].current_frame) {
                                 check_for_slave_format_change(&s->slaves_data[i]);
                         }
@@ -702,54 +916,11 @@ static void *master_worker(void *arg)
                                         }
                                 }
 
-                                load_texture(&s->slaves_data[i], from_uyvy);
-
-                        }
-                }
-
-                // draw
-                glBindFramebuffer(GL_FRAMEBUFFER, s->fbo);
-                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0_EXT,
-                                GL_TEXTURE_2D, s->tex_output, 0);
-                glClearColor(0, 0, 0, 1);
-                glClear(GL_COLOR_BUFFER_BIT);
-
-                glViewport(0, 0, s->frame->tiles[0].width, s->frame->tiles[0].height);
-
-                if(s->interpolation == BICUBIC) {
-                        glUseProgram(s->bicubic_program);
-                        glUniform1i(glGetUniformLocation(s->bicubic_program, "image"), 0);
-                }
-
-                for(int i = 0; i < s->devices_cnt; ++i) {
-                        if(s->slaves_data[i].current_frame) {
-                                render_slave(&s->slaves_data[i], s->interpolation, s->bicubic_program);
+                                if (s->backend == BACKEND_GL) {
+                                        load_texture(&s->slaves_data[i], from_uyvy);
+                                }
                         }
                 }
-                glUseProgram(0);
-
-                // read back
-                glBindTexture(GL_TEXTURE_2D, s->tex_output);
-                int width = s->frame->tiles[0].width;
-                GLenum format = GL_RGBA;
-                if(s->frame->color_spec == UYVY) {
-                        glBindFramebuffer(GL_FRAMEBUFFER, s->fbo_uyvy);
-                        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0_EXT,
-                                        GL_TEXTURE_2D, s->tex_output_uyvy, 0);
-                        glViewport(0, 0, s->frame->tiles[0].width / 2, s->frame->tiles[0].height);
-                        glUseProgram(to_uyvy);
-                        glBegin(GL_QUADS);
-                        glTexCoord2f(0.0, 0.0); glVertex2f(-1.0, -1.0);
-                        glTexCoord2f(1.0, 0.0); glVertex2f(1.0, -1.0);
-                        glTexCoord2f(1.0, 1.0); glVertex2f(1.0, 1.0);
-                        glTexCoord2f(0.0, 1.0); glVertex2f(-1.0, 1.0);
-                        glEnd();
-                        glUseProgram(0);
-                        width /= 2;
-                        glBindTexture(GL_TEXTURE_2D, s->tex_output_uyvy);
-                } else if (s->frame->color_spec == RGB) {
-                        format = GL_RGB;
-                }
 
                 char *read_buf;
                 if(s->frame->interlacing == PROGRESSIVE) {
@@ -757,12 +928,18 @@ static void *master_worker(void *arg)
                 } else {
                         read_buf = tmp_buffer;
                 }
-                glReadPixels(0, 0, width,
-                                s->frame->tiles[0].height,
-                                format, GL_UNSIGNED_BYTE,
-                                read_buf);
-                glBindFramebuffer(GL_FRAMEBUFFER, 0);
-                glBindTexture(GL_TEXTURE_2D, 0);
+                if (s->backend == BACKEND_CPU) {
+                        render_cpu(s, read_buf);
+                } else if (s->async_readback) {
+                        render_gl(s, to_uyvy, NULL, s->pbo[pbo_idx]);
+                        s->pbo_fence[pbo_idx] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                        pending[pbo_idx] = { current_buffer, audio_data, audio_len };
+                        pbo_idx = 1 - pbo_idx;
+                        // pick up the previous frame that was transferred while this one rendered
+                        current_buffer = finish_readback(s, pbo_idx, &pending[pbo_idx], &audio_data, &audio_len);
+                } else {
+                        render_gl(s, to_uyvy, read_buf, 0);
+                }
 
                 if(s->frame->interlacing == INTERLACED_MERGED) {
                         int linesize =
@@ -784,6 +961,10 @@ static void *master_worker(void *arg)
                         } while(sec < 1.0 / s->frame->fps);
                         t0 = t;
 
+                        if (current_buffer == NULL) { // async readback is just being filled
+                                continue;
+                        }
+
                         pthread_mutex_lock(&s->lock);
                         while(s->completed_buffer != NULL) {
                                 pthread_cond_wait(&s->frame_sent_cv, &s->lock);
@@ -801,10 +982,24 @@ static void *master_worker(void *arg)
 
         free(tmp_buffer);
 
-        glDeleteProgram(from_uyvy);
-        glDeleteProgram(to_uyvy);
-        glDisable(GL_TEXTURE_2D);
-        gl_context_make_current(NULL);
+        if (s->backend == BACKEND_GL) {
+                for (int i = 0; i < 2; ++i) {
+                        if (s->pbo_fence[i] != nullptr) {
+                                glDeleteSync(s->pbo_fence[i]);
+                                s->pbo_fence[i] = nullptr;
+                        }
+                        if (pending[i].buffer != NULL) {
+                                pthread_mutex_lock(&s->lock);
+                                s->free_buffer_queue.push(pending[i].buffer);
+                                pthread_mutex_unlock(&s->lock);
+                        }
+                        free(pending[i].audio_data);
+                }
+                glDeleteProgram(from_uyvy);
+                glDeleteProgram(to_uyvy);
+                glDisable(GL_TEXTURE_2D);
+                gl_context_make_current(NULL);
+        }
 
         return NULL;
 }
@@ -922,7 +1117,8 @@ static bool get_device_config_from_file(FILE* config_file, char *slave_name,
 #define PARSE_FILE 2
 static int parse_config_string(const char *fmt, unsigned int *width,
                 unsigned int *height, double *fps,
-        codec_t *color_spec, interpolation_t *interpolation, char **bicubic_algo, interlacing_t *interl, int *grid_x, int *grid_y)
+        codec_t *color_spec, interpolation_t *interpolation, char **bicubic_algo, interlacing_t *interl, int *grid_x, int *grid_y,
+        backend_t *backend, bool *async_readback)
 {
         char *save_ptr = NULL;
         char *item;
@@ -986,6 +1182,18 @@ static int parse_config_string(const char *fmt, unsigned int *width,
                                                 log_msg(LOG_LEVEL_ERROR, "Error parsing layout!\n");
                                                 return PARSE_ERROR;
                                         }
+                                } else if (strncasecmp(item, "backend=", strlen("backend=")) == 0) {
+                                        const char *b = item + strlen("backend=");
+                                        if (strcasecmp(b, "gl") == 0) {
+                                                *backend = BACKEND_GL;
+                                        } else if (strcasecmp(b, "cpu") == 0) {
+                                                *backend = BACKEND_CPU;
+                                        } else {
+                                                log_msg(LOG_LEVEL_ERROR, "Unknown backend: %s\n", b);
+                                                return PARSE_ERROR;
+                                        }
+                                } else if (strcasecmp(item, "readback=sync") == 0) {
+                                        *async_readback = false;
                                 } else {
                                         log_msg(LOG_LEVEL_ERROR, "Unknown option: %s\n", item);
                                         return PARSE_ERROR;
@@ -1009,7 +1217,8 @@ static bool parse(struct vidcap_swmix_state *s, struct video_desc *desc, char *f
         int ret;
 
         ret = parse_config_string(fmt, &desc->width, &desc->height, &desc->fps, &desc->color_spec,
-                        interpolation, &s->bicubic_algo, &desc->interlacing, &s->grid_x, &s->grid_y);
+                        interpolation, &s->bicubic_algo, &desc->interlacing, &s->grid_x, &s->grid_y,
+                        &s->backend, &s->async_readback);
         if(ret == PARSE_ERROR) {
                 show_help();
                 return false;
@@ -1031,7 +1240,8 @@ static bool parse(struct vidcap_swmix_state *s, struct video_desc *desc, char *f
                 }
                 while(isspace(line[strlen(line) - 1])) line[strlen(line) - 1] = '\0'; // trim trailing spaces
                 ret = parse_config_string(line, &desc->width, &desc->height, &desc->fps, &desc->color_spec,
-                                interpolation, &s->bicubic_algo, &desc->interlacing, &s->grid_x, &s->grid_y);
+                                interpolation, &s->bicubic_algo, &desc->interlacing, &s->grid_x, &s->grid_y,
+                                &s->backend, &s->async_readback);
                 if(ret != PARSE_OK) {
                         fprintf(stderr, "Malformed input file! First line should contain config "
                                         "string same as for cmdline use (between first ':' and '#' "
@@ -1081,12 +1291,86 @@ static bool parse(struct vidcap_swmix_state *s, struct video_desc *desc, char *f
         return true;
 }
 
+/**
+ * Creates GL context and output textures. The context is left current for
+ * the calling thread.
+ */
+static bool init_gl(struct vidcap_swmix_state *s, struct video_desc desc)
+{
+        GLenum format;
+
+        if(!init_gl_context(&s->gl_context, GL_CONTEXT_LEGACY)) {
+                fprintf(stderr, "[swmix] Unable to initialize OpenGL context.\n");
+                return false;
+        }
+
+        if (s->gl_context.gl_major < 2) {
+                fprintf(stderr, "[swmix] Unsufficient OpenGL version to run SWMix.\n");
+                return false;
+        }
+
+        gl_context_make_current(&s->gl_context);
+
+        {
+                char *bicubic = strdup(bicubic_template);
+                char *algo_pos;
+                while((algo_pos = strstr(bicubic, "INTERP_ALGORITHM_PLACEHOLDER"))) {
+                        memset(algo_pos, ' ', strlen("INTERP_ALGORITHM_PLACEHOLDER"));
+                        memcpy(algo_pos, s->bicubic_algo, strlen(s->bicubic_algo));
+                }
+                printf("Using bicubic algorithm: %s\n", s->bicubic_algo);
+                s->bicubic_program = glsl_compile_link(vprogram, bicubic);
+                free(bicubic);
+        }
+
+        format = GL_RGBA;
+        if(desc.color_spec == RGB) {
+                format = GL_RGB;
+        }
+        glGenTextures(1, &s->tex_output);
+        glBindTexture(GL_TEXTURE_2D, s->tex_output);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, desc.width, desc.height,
+                        0, format, GL_UNSIGNED_BYTE, NULL);
+
+        glGenTextures(1, &s->tex_output_uyvy);
+        glBindTexture(GL_TEXTURE_2D, s->tex_output_uyvy);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, desc.width / 2, desc.height,
+                        0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+        glGenFramebuffers(1, &s->fbo);
+        glGenFramebuffers(1, &s->fbo_uyvy);
+
+        if (s->async_readback && s->gl_context.gl_major * 10 + s->gl_context.gl_minor < 32) {
+                log_msg(LOG_LEVEL_WARNING, "[swmix] OpenGL 3.2 needed for asynchronous readback, "
+                                "using synchronous.\n");
+                s->async_readback = false;
+        }
+        if (s->async_readback) {
+                glGenBuffers(2, s->pbo);
+                for (int i = 0; i < 2; ++i) {
+                        glBindBuffer(GL_PIXEL_PACK_BUFFER, s->pbo[i]);
+                        glBufferData(GL_PIXEL_PACK_BUFFER, vc_get_linesize(desc.width, desc.color_spec) * desc.height,
+                                        NULL, GL_STREAM_READ);
+                }
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+
+        return true;
+}
+
 static int
 vidcap_swmix_init(struct vidcap_params *params, void **state)
 {
 	struct vidcap_swmix_state *s;
         struct video_desc desc;
-        GLenum format;
 
 	printf("vidcap_swmix_init\n");
 
@@ -1116,6 +1400,8 @@ vidcap_swmix_init(struct vidcap_params *params, void **state)
         desc.color_spec = RGBA;
 
         s->interpolation = BICUBIC;
+        s->backend = BACKEND_GL;
+        s->async_readback = true;
         FILE *config_file = NULL;
 
         char *init_fmt = strdup(vidcap_params_get_fmt(params));
@@ -1136,30 +1422,13 @@ vidcap_swmix_init(struct vidcap_params *params, void **state)
         pthread_cond_init(&s->frame_sent_cv, NULL);
         pthread_cond_init(&s->free_buffer_queue_not_empty_cv, NULL);
 
-        if(!init_gl_context(&s->gl_context, GL_CONTEXT_LEGACY)) {
-                fprintf(stderr, "[swmix] Unable to initialize OpenGL context.\n");
-                goto error;
+        if (s->frame->interlacing != PROGRESSIVE) {
+                s->async_readback = false;
         }
-
-        if (s->gl_context.gl_major < 2) {
-                fprintf(stderr, "[swmix] Unsufficient OpenGL version to run SWMix.\n");
+        if (s->backend == BACKEND_GL && !init_gl(s, desc)) {
                 goto error;
         }
 
-        gl_context_make_current(&s->gl_context);
-
-        {
-                char *bicubic = strdup(bicubic_template);
-                char *algo_pos;
-                while((algo_pos = strstr(bicubic, "INTERP_ALGORITHM_PLACEHOLDER"))) {
-                        memset(algo_pos, ' ', strlen("INTERP_ALGORITHM_PLACEHOLDER"));
-                        memcpy(algo_pos, s->bicubic_algo, strlen(s->bicubic_algo));
-                }
-                printf("Using bicubic algorithm: %s\n", s->bicubic_algo);
-                s->bicubic_program = glsl_compile_link(vprogram, bicubic);
-                free(bicubic);
-        }
-
         s->slaves_data = init_slave_data(s, config_file);
         if(!s->slaves_data) {
                 free(config_file);
@@ -1172,32 +1441,9 @@ vidcap_swmix_init(struct vidcap_params *params, void **state)
                 config_file = nullptr;
         }
 
-        format = GL_RGBA;
-        if(desc.color_spec == RGB) {
-                format = GL_RGB;
+        if (s->backend == BACKEND_GL) {
+                gl_context_make_current(NULL);
         }
-        glGenTextures(1, &s->tex_output);
-        glBindTexture(GL_TEXTURE_2D, s->tex_output);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, desc.width, desc.height,
-                        0, format, GL_UNSIGNED_BYTE, NULL);
-
-        glGenTextures(1, &s->tex_output_uyvy);
-        glBindTexture(GL_TEXTURE_2D, s->tex_output_uyvy);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, desc.width / 2, desc.height,
-                        0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-
-        glGenFramebuffers(1, &s->fbo);
-        glGenFramebuffers(1, &s->fbo_uyvy);
-
-        gl_context_make_current(NULL);
 
         for(int i = 0; i < s->devices_cnt; ++i) {
                 pthread_mutex_init(&(s->slaves[i].lock), NULL);
@@ -1205,7 +1451,8 @@ vidcap_swmix_init(struct vidcap_params *params, void **state)
 
         s->frame->tiles[0].data_len = vc_get_linesize(s->frame->tiles[0].width,
                                 s->frame->color_spec) * s->frame->tiles[0].height;
-        for(int i = 0; i < 3; ++i) {
+        // one more buffer is held by the asynchronous readback
+        for(int i = 0; i < (s->async_readback ? 4 : 3); ++i) {
                 char *buffer = (char *) malloc(s->frame->tiles[0].data_len);
                 s->free_buffer_queue.push(buffer);
         }
@@ -1279,17 +1526,24 @@ vidcap_swmix_done(void *state)
 
         vf_free(s->frame);
 
-        gl_context_make_current(&s->gl_context);
+        if (s->backend == BACKEND_GL) {
+                gl_context_make_current(&s->gl_context);
 
-        destroy_slave_data(s->slaves_data, s->devices_cnt);
+                destroy_slave_data(s->slaves_data, s->devices_cnt, true);
 
-        glDeleteTextures(1, &s->tex_output);
-        glDeleteTextures(1, &s->tex_output_uyvy);
-        glDeleteFramebuffers(1, &s->fbo);
-        glDeleteFramebuffers(1, &s->fbo_uyvy);
+                glDeleteTextures(1, &s->tex_output);
+                glDeleteTextures(1, &s->tex_output_uyvy);
+                glDeleteFramebuffers(1, &s->fbo);
+                glDeleteFramebuffers(1, &s->fbo_uyvy);
+                if (s->async_readback) {
+                        glDeleteBuffers(2, s->pbo);
+                }
 
-        gl_context_make_current(NULL);
-        destroy_gl_context(&s->gl_context);
+                gl_context_make_current(NULL);
+                destroy_gl_context(&s->gl_context);
+        } else {
+                destroy_slave_data(s->slaves_data, s->devices_cnt, false);
+        }
 
         pthread_mutex_destroy(&s->lock);
         pthread_cond_destroy(&s->frame_ready_cv);
@@ -49,6 +49,7 @@
 
 #include <condition_variable>
 #include <chrono>
+#include <CoreVideo/CoreVideo.h>
 #include <GLUT/glut.h>
 #include <iostream>
 #include <mutex>
@@ -61,6 +62,7 @@
 #include "debug.h"
 #include "gl_context.h"
 #include "host.h"
+#include "hwaccel_videotoolbox.h"
 #include "lib_common.h"
 #include "mac_gl_common.h"
 #include "rang.hpp"
@@ -149,6 +151,8 @@ struct state_vidcap_syphon {
 
         double override_fps;
         bool use_rgb;
+        bool hwframes;             ///< render to IOSurface-backed buffers (HW_VTB) instead of read-back
+        CVPixelBufferPoolRef pool; ///< IOSurface-backed buffers for hwframes
 
         std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
         int frames;
@@ -170,8 +174,9 @@ struct state_vidcap_syphon {
                 while (q.size() > 0) {
                         video_frame *f = q.front();
                         q.pop();
-                        vf_free(f);
+                        VIDEO_FRAME_DISPOSE(f);
                 }
+                CVPixelBufferPoolRelease(pool);
         }
 };
 
@@ -181,16 +186,30 @@ static void vidcap_syphon_done(void *state);
 static struct state_vidcap_syphon *state_global;
 
 static void reconfigure(state_vidcap_syphon *s, struct video_desc desc) {
-        glBindTexture(GL_TEXTURE_2D, s->tex_id);
-        if (s->use_rgb) {
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, desc.width, desc.height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+        int width_div = s->use_rgb || s->hwframes ? 1 : 2;
+        glBindFramebufferEXT(GL_FRAMEBUFFER, s->fbo_id);
+        if (s->hwframes) { // target textures are bound per frame, see render_to_pixbuf()
+                CVPixelBufferPoolRelease(s->pool);
+                s->pool = NULL;
+                NSDictionary *attrs = @{
+                        (id) kCVPixelBufferPixelFormatTypeKey: @(kCVPixelFormatType_32BGRA),
+                        (id) kCVPixelBufferWidthKey: @(desc.width),
+                        (id) kCVPixelBufferHeightKey: @(desc.height),
+                        (id) kCVPixelBufferIOSurfacePropertiesKey: @{},
+                };
+                if (CVPixelBufferPoolCreate(kCFAllocatorDefault, NULL, (CFDictionaryRef) attrs, &s->pool) != kCVReturnSuccess) {
+                        LOG(LOG_LEVEL_ERROR) << MOD_NAME "Cannot create pixel buffer pool!\n";
+                }
         } else {
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, desc.width / 2, desc.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+                glBindTexture(GL_TEXTURE_2D, s->tex_id);
+                if (s->use_rgb) {
+                        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, desc.width, desc.height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+                } else {
+                        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, desc.width / 2, desc.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+                }
+                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0_EXT, GL_TEXTURE_2D, s->tex_id, 0);
         }
 
-        glBindFramebufferEXT(GL_FRAMEBUFFER, s->fbo_id);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0_EXT, GL_TEXTURE_2D, s->tex_id, 0);
-
         glDrawBuffer(GL_COLOR_ATTACHMENT0_EXT);
 
         glMatrixMode( GL_MODELVIEW );
@@ -198,17 +217,70 @@ static void reconfigure(state_vidcap_syphon *s, struct video_desc desc) {
         glLoadIdentity( );
         glMatrixMode( GL_PROJECTION );
         glLoadIdentity( );
-        glViewport( 0, 0, ( GLint ) desc.width / (s->use_rgb ? 1 : 2), ( GLint ) desc.height );
+        glViewport( 0, 0, ( GLint ) desc.width / width_div, ( GLint ) desc.height );
 
         glOrtho(0, desc.width, 0, desc.height, 10, -10);
 
-        if (!s->use_rgb) {
+        if (!s->use_rgb && !s->hwframes) {
                 glUniform1f(glGetUniformLocation(s->program_to_yuv422, "imageWidth"),
                                 (GLfloat) desc.width);
         }
 
 }
 
+static void draw_image(SyphonImage *img, unsigned int width, unsigned int height)
+{
+        glBindTexture(GL_TEXTURE_RECTANGLE_ARB, [img textureName]);
+        glBegin(GL_QUADS);
+        glTexCoord2i(0, height);     glVertex2i(0, 0);
+        glTexCoord2i(0, 0);          glVertex2i(0, height);
+        glTexCoord2i(width, 0);      glVertex2i(width, height);
+        glTexCoord2i(width, height); glVertex2i(width, 0);
+        glEnd();
+}
+
+/**
+ * Renders the image to an IOSurface-backed pixel buffer, so that the frame
+ * stays in GPU memory and can be passed to VideoToolbox as it is (HW_VTB).
+ */
+static struct video_frame *render_to_pixbuf(state_vidcap_syphon *s, SyphonImage *img, struct video_desc d)
+{
+        CVPixelBufferRef pixbuf = NULL;
+        if (s->pool == NULL || CVPixelBufferPoolCreatePixelBuffer(kCFAllocatorDefault, s->pool, &pixbuf) != kCVReturnSuccess) {
+                LOG(LOG_LEVEL_ERROR) << MOD_NAME "Cannot get pixel buffer!\n";
+                return NULL;
+        }
+
+        GLuint tex = 0;
+        glGenTextures(1, &tex);
+        glBindTexture(GL_TEXTURE_RECTANGLE_ARB, tex);
+        CGLError err = CGLTexImageIOSurface2D(CGLGetCurrentContext(), GL_TEXTURE_RECTANGLE_ARB, GL_RGBA, d.width, d.height,
+                        GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, CVPixelBufferGetIOSurface(pixbuf), 0);
+        if (err != kCGLNoError) {
+                LOG(LOG_LEVEL_ERROR) << MOD_NAME "Cannot bind IOSurface: " << CGLErrorString(err) << "\n";
+                glDeleteTextures(1, &tex);
+                CVPixelBufferRelease(pixbuf);
+                return NULL;
+        }
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0_EXT, GL_TEXTURE_RECTANGLE_ARB, tex, 0);
+        draw_image(img, d.width, d.height);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0_EXT, GL_TEXTURE_RECTANGLE_ARB, 0, 0);
+        glDeleteTextures(1, &tex);
+        glFlush(); // make the rendering visible to other IOSurface users
+        gl_check_error();
+
+        struct video_frame *f = vf_alloc_desc(d);
+        f->tiles[0].data_len = sizeof(hw_vtb_frame);
+        f->tiles[0].data = (char *) malloc(sizeof(hw_vtb_frame));
+        ((hw_vtb_frame *)(void *) f->tiles[0].data)->pixbuf = pixbuf; // reference from the pool
+        f->callbacks.data_deleter = vf_data_deleter;
+        f->callbacks.dispose = [](struct video_frame *frame) {
+                CVPixelBufferRelease(((hw_vtb_frame *)(void *) frame->tiles[0].data)->pixbuf);
+                vf_free(frame);
+        };
+        return f;
+}
+
 static void oneshot_init(int value [[gnu::unused]])
 {
         state_vidcap_syphon *s = state_global;
@@ -244,7 +316,7 @@ static void oneshot_init(int value [[gnu::unused]])
         glGenFramebuffersEXT(1, &s->fbo_id);
         glGenTextures(1, &s->tex_id);
 
-        if (!s->use_rgb) {
+        if (!s->use_rgb && !s->hwframes) {
                 s->program_to_yuv422 = glsl_compile_link(NULL, fp_display_rgba_to_yuv422_legacy);
                 glUseProgram(s->program_to_yuv422);
                 glUniform1i(glGetUniformLocation(s->program_to_yuv422, "image"), 0);
@@ -274,26 +346,28 @@ static void oneshot_init(int value [[gnu::unused]])
                 unsigned int width = [img textureSize].width;
                 unsigned int height = [img textureSize].height;
 
-                struct video_desc d{width, height, s->use_rgb ? RGB : UYVY, s->override_fps ? s->override_fps : FPS, PROGRESSIVE, 1};
+                codec_t codec = s->hwframes ? HW_VTB : s->use_rgb ? RGB : UYVY;
+                struct video_desc d{width, height, codec, s->override_fps ? s->override_fps : FPS, PROGRESSIVE, 1};
                 if (!video_desc_eq(s->saved_desc, d)) {
                         reconfigure(s, d);
                         s->saved_desc = d;
                 }
 
-                struct video_frame *f = vf_alloc_desc_data(d);
-
-                glBindTexture(GL_TEXTURE_RECTANGLE_ARB, [img textureName]);
-                glBegin(GL_QUADS);
-                glTexCoord2i(0, height);     glVertex2i(0, 0);
-                glTexCoord2i(0, 0);          glVertex2i(0, height);
-                glTexCoord2i(width, 0);      glVertex2i(width, height);
-                glTexCoord2i(width, height); glVertex2i(width, 0);
-                glEnd();
-
-                glReadPixels(0, 0, width / (s->use_rgb ? 1 : 2), height, s->use_rgb ? GL_RGB : GL_RGBA, GL_UNSIGNED_BYTE, f->tiles[0].data);
-                gl_check_error();
+                struct video_frame *f = NULL;
+                if (s->hwframes) {
+                        f = render_to_pixbuf(s, img, d);
+                } else {
+                        f = vf_alloc_desc_data(d);
+                        f->callbacks.dispose = vf_free;
+                        draw_image(img, width, height);
+                        glReadPixels(0, 0, width / (s->use_rgb ? 1 : 2), height, s->use_rgb ? GL_RGB : GL_RGBA, GL_UNSIGNED_BYTE, f->tiles[0].data);
+                        gl_check_error();
+                }
 
                 [img release];
+                if (f == NULL) {
+                        return;
+                }
 
                 unique_lock<mutex> lk(s->lock);
                 bool pushed = false;
@@ -302,7 +376,7 @@ static void oneshot_init(int value [[gnu::unused]])
                         pushed = true;
                 } else {
                         LOG(LOG_LEVEL_WARNING) << "[Syphon capture] Skipping frame.\n";
-                        vf_free(f);
+                        VIDEO_FRAME_DISPOSE(f);
                 }
                 lk.unlock();
 
@@ -353,12 +427,13 @@ static void syphon_mainloop(void *state)
 static void usage(bool full)
 {
         cout << "Usage:\n";
-        cout << rang::style::bold << rang::fg::red << "\t-t syphon" << rang::fg::reset << "[:name=<server_name>][:app=<app_name>][:override_fps=<fps>][:RGB]" << (full ? "[:queue_size=<len>]" : "[:fullhelp]") << "\n" << rang::style::reset;
+        cout << rang::style::bold << rang::fg::red << "\t-t syphon" << rang::fg::reset << "[:name=<server_name>][:app=<app_name>][:override_fps=<fps>][:RGB|:hwframes]" << (full ? "[:queue_size=<len>]" : "[:fullhelp]") << "\n" << rang::style::reset;
         cout << "\nwhere:\n";
         cout << rang::style::bold << "\tname\n" << rang::style::reset << "\t\tSyphon server name\n";
         cout << rang::style::bold << "\tapp\n" << rang::style::reset << "\t\tSyphon server application name\n";
         cout << rang::style::bold << "\toverride_fps\n" << rang::style::reset << "\t\toverrides FPS in metadata (but not the actual rate captured)\n";
         cout << rang::style::bold << "\tRGB\n" << rang::style::reset << "\t\tuse RGB as an output codec instead of default UYVY\n";
+        cout << rang::style::bold << "\thwframes\n" << rang::style::reset << "\t\tkeep the frames in GPU memory (HW_VTB), to be compressed by VideoToolbox (eg. \"-c lavc:encoder=hevc_videotoolbox\")\n";
         if (full) {
                 cout << rang::style::bold << "\tqueue_size=<len>\n" << rang::style::reset << "\t\tsize of internal frame queue\n";
         }
@@ -401,6 +476,8 @@ static int vidcap_syphon_init(struct vidcap_params *params, void **state)
                         s->max_queue_size = atoi(strchr(item, '=') + 1);
                 } else if (strcasecmp(item, "RGB") == 0) {
                         s->use_rgb = true;
+                } else if (strcmp(item, "hwframes") == 0) {
+                        s->hwframes = true;
                 } else {
                         LOG(LOG_LEVEL_ERROR) << "Syphon: Unknown argument - " << item << "\n";
                         ret = VIDCAP_INIT_FAIL;
@@ -456,7 +533,6 @@ static struct video_frame *vidcap_syphon_grab(void *state, struct audio_frame **
         if (s->q.size() > 0) {
                 ret = s->q.front();
                 s->q.pop();
-                ret->callbacks.dispose = vf_free;
 
                 // statistics
                 s->frames++;
@@ -72,6 +72,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <chrono>
+#include <thread>
 #include <vector>
 #include "audio/types.h"
 #include "utils/video_pattern_generator.hpp"
@@ -83,6 +84,7 @@
 constexpr int AUDIO_BUFFER_SIZE(int ch_count) { return AUDIO_SAMPLE_RATE * AUDIO_BPS * ch_count * BUFFER_SEC; }
 #define MOD_NAME "[testcard] "
 constexpr video_desc default_format = { 1920, 1080, UYVY, 25.0, INTERLACED_MERGED, 1 };
+constexpr double TESTCARD_MAX_SLEEP = 0.1; ///< [s] return from grab at least this often
 
 using namespace std;
 
@@ -105,6 +107,7 @@ struct testcard_state {
         bool grab_audio = false;
         bool still_image = false;
         string pattern{"bars"};
+        int decimation = 1; ///< generator frames per grabbed frame
 };
 
 static void configure_fallback_audio(struct testcard_state *s) {
@@ -387,6 +390,13 @@ static int vidcap_testcard_init(struct vidcap_params *params, void **state)
                 goto error;
         }
 
+        // audio is generated per frame, so it would need to be resampled
+        if (vidcap_params_get_decimation(params) > 1 && (vidcap_params_get_flags(params) & VIDCAP_FLAG_AUDIO_EMBEDDED) == 0) {
+                s->decimation = vidcap_params_get_decimation(params);
+                desc.fps /= s->decimation;
+                vidcap_params_accept_decimation(params);
+        }
+
         s->frame = vf_alloc_desc(desc);
         s->frame_linesize = vc_get_linesize(desc.width, desc.color_spec);
 
@@ -457,6 +467,20 @@ static void vidcap_testcard_done(void *state)
         delete s;
 }
 
+/**
+ * Returns a frame referencing pattern data. Those are pre-rendered in
+ * the output codec (including the panned and animated sequences) and never
+ * overwritten, so the returned frame can be held by the consumer without
+ * copying or waiting for its disposal.
+ */
+static struct video_frame *testcard_frame_ref(struct video_frame *f)
+{
+        struct video_frame *ref = vf_alloc_desc(video_desc_from_frame(f));
+        memcpy(ref->tiles, f->tiles, f->tile_count * sizeof(struct tile));
+        ref->callbacks.dispose = vf_free;
+        return ref;
+}
+
 static struct video_frame *vidcap_testcard_grab(void *arg, struct audio_frame **audio)
 {
         struct testcard_state *state;
@@ -465,9 +489,16 @@ static struct video_frame *vidcap_testcard_grab(void *arg, struct audio_frame **
         std::chrono::steady_clock::time_point curr_time =
                 std::chrono::steady_clock::now();
 
-        if (std::chrono::duration_cast<std::chrono::duration<double>>(curr_time - state->last_frame_time).count() <
-                        1.0 / state->frame->fps) {
-                return NULL;
+        std::chrono::duration<double> remaining = std::chrono::duration<double>(1.0 / state->frame->fps)
+                - (curr_time - state->last_frame_time);
+        if (remaining.count() > 0) {
+                // sleep rather than spin in the capture loop (leaves CPU to senders)
+                if (remaining.count() > TESTCARD_MAX_SLEEP) {
+                        std::this_thread::sleep_for(std::chrono::duration<double>(TESTCARD_MAX_SLEEP));
+                        return NULL;
+                }
+                std::this_thread::sleep_for(remaining);
+                curr_time = std::chrono::steady_clock::now();
         }
 
         state->last_frame_time = curr_time;
@@ -483,6 +514,9 @@ static struct video_frame *vidcap_testcard_grab(void *arg, struct audio_frame **
                 *audio = NULL;
         }
 
+        for (int i = 1; i < state->decimation; ++i) { // keep the motion speed
+                video_pattern_generator_next_frame(state->generator);
+        }
         vf_get_tile(state->frame, 0)->data = video_pattern_generator_next_frame(state->generator);
 
         if (state->tiled) {
@@ -503,9 +537,9 @@ static struct video_frame *vidcap_testcard_grab(void *arg, struct audio_frame **
                         }
                 }
 
-                return state->tiled;
+                return testcard_frame_ref(state->tiled);
         }
-        return state->frame;
+        return testcard_frame_ref(state->frame);
 }
 
 static struct vidcap_type *vidcap_testcard_probe(bool verbose, void (**deleter)(void *))
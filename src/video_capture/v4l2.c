@@ -91,6 +91,7 @@ struct vidcap_v4l2_state {
         int frames;
 
         int buffer_count;
+        enum v4l2_memory memory; ///< V4L2_MEMORY_MMAP or V4L2_MEMORY_USERPTR
 
         struct simple_linked_list *buffers_to_enqueue;
         int dequeued_buffers;
@@ -133,7 +134,9 @@ static void vidcap_v4l2_common_cleanup(struct vidcap_v4l2_state *s) {
         pthread_mutex_unlock(&s->lock);
 
         for (int i = 0; i < s->buffer_count; ++i) {
-                if (s->buffers[i].start) {
+                if (s->buffers[i].start && s->memory == V4L2_MEMORY_USERPTR) {
+                        free(s->buffers[i].start);
+                } else if (s->buffers[i].start) {
                         if (-1 == munmap(s->buffers[i].start, s->buffers[i].length)) {
                                 log_perror(LOG_LEVEL_ERROR, MOD_NAME "munmap");
                         }
@@ -156,6 +159,51 @@ static void vidcap_v4l2_common_cleanup(struct vidcap_v4l2_state *s) {
         free(s);
 }
 
+/**
+ * Allocates and enqueues buffers for V4L2_MEMORY_USERPTR streaming. The buffers
+ * are page-aligned regular (cacheable) memory, which is much faster to read by
+ * CPU than driver MMAP buffers with some (eg. DMA-contig) drivers.
+ */
+static _Bool set_v4l2_userptr_buffers(int fd, struct v4l2_requestbuffers *reqbuf, struct v4l2_buffer_data *buffers, size_t size) {
+        if (ioctl(fd, VIDIOC_REQBUFS, reqbuf) != 0) {
+                if (errno == EINVAL)
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "User pointer streaming is not supported\n");
+                else
+                        log_perror(LOG_LEVEL_ERROR, MOD_NAME "VIDIOC_REQBUFS");
+                return 0;
+        }
+        if (reqbuf->count < 2) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Not enough buffers\n");
+                return 0;
+        }
+
+        const size_t page_size = sysconf(_SC_PAGESIZE);
+        size = (size + page_size - 1) / page_size * page_size;
+        for (unsigned int i = 0; i < reqbuf->count; i++) {
+                int rc = posix_memalign(&buffers[i].start, page_size, size);
+                if (rc != 0) {
+                        buffers[i].start = NULL;
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot allocate buffer: %s\n", ug_strerror(rc));
+                        return 0;
+                }
+                buffers[i].length = size;
+
+                struct v4l2_buffer buf;
+                memset(&buf, 0, sizeof(buf));
+                buf.type = reqbuf->type;
+                buf.memory = V4L2_MEMORY_USERPTR;
+                buf.index = i;
+                buf.m.userptr = (unsigned long) buffers[i].start;
+                buf.length = size;
+
+                if (ioctl(fd, VIDIOC_QBUF, &buf) != 0) {
+                        log_perror(LOG_LEVEL_ERROR, MOD_NAME "Unable to enqueue buffer");
+                        return 0;
+                }
+        }
+        return 1;
+}
+
 static void print_fps(int fd, struct v4l2_frmivalenum *param) {
         int res = ioctl(fd, VIDIOC_ENUM_FRAMEINTERVALS, param);
 
@@ -201,7 +249,7 @@ static void show_help(_Bool full)
         printf("V4L2 capture\n");
         printf("Usage\n");
         color_printf(TERM_BOLD TERM_FG_RED "\t-t v4l2[:device=<dev>]" TERM_FG_RESET
-                        "[:codec=<pixel_fmt>][:size=<width>x<height>][:tpf=<tpf>|:fps=<fps>][:buffers=<bufcnt>][:convert=<conv>][:permissive] | -t v4l2:[short]help\n" TERM_RESET);
+                        "[:codec=<pixel_fmt>][:size=<width>x<height>][:tpf=<tpf>|:fps=<fps>][:buffers=<bufcnt>][:convert=<conv>][:permissive][:userptr] | -t v4l2:[short]help\n" TERM_RESET);
         printf("where\n");
         color_printf(TERM_BOLD "<dev> -" TERM_RESET "\tuse device to grab from (default: first usable)\n");
         color_printf(TERM_BOLD "\t<tpf>" TERM_RESET " - time per frame in format <numerator>/<denominator>\n");
@@ -220,6 +268,7 @@ static void show_help(_Bool full)
 #endif
         printf("\n");
         printf("\t\tpermissive - do not fail if configuration values (size, FPS) are adjusted by driver and not set exactly\n");
+        printf("\t\tuserptr - capture to user-allocated buffers instead of driver mmap-ed ones (faster CPU access with some drivers)\n");
         printf("\n");
 
         printf("Available devices:\n");
@@ -527,6 +576,7 @@ static int vidcap_v4l2_init(struct vidcap_params *params, void **state)
                 return VIDCAP_INIT_FAIL;
         }
         s->buffer_count = DEFAULT_BUF_COUNT;
+        s->memory = V4L2_MEMORY_MMAP;
         s->fd = -1;
         s->buffers_to_enqueue = simple_linked_list_init();
         pthread_mutex_init(&s->lock, NULL);
@@ -594,6 +644,8 @@ static int vidcap_v4l2_init(struct vidcap_params *params, void **state)
 #endif
                         } else if (strstr(item, "permissive") == item) {
                                 s->permissive = 1;
+                        } else if (strcmp(item, "userptr") == 0) {
+                                s->memory = V4L2_MEMORY_USERPTR;
                         } else {
                                 log_msg(LOG_LEVEL_ERROR, MOD_NAME "Invalid configuration argument: %s\n",
                                                 item);
@@ -728,10 +780,14 @@ static int vidcap_v4l2_init(struct vidcap_params *params, void **state)
 
         memset(&reqbuf, 0, sizeof(reqbuf));
         reqbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        reqbuf.memory = V4L2_MEMORY_MMAP;
+        reqbuf.memory = s->memory;
         reqbuf.count = s->buffer_count;
 
-        if (!set_v4l2_buffers(s->fd, &reqbuf, s->buffers)) {
+        if (s->memory == V4L2_MEMORY_USERPTR) {
+                if (!set_v4l2_userptr_buffers(s->fd, &reqbuf, s->buffers, s->src_fmt.fmt.pix.sizeimage)) {
+                        goto error;
+                }
+        } else if (!set_v4l2_buffers(s->fd, &reqbuf, s->buffers)) {
                 goto error;
         }
         s->buffer_count = reqbuf.count;
@@ -800,7 +856,7 @@ static struct video_frame * vidcap_v4l2_grab(void *state, struct audio_frame **a
         struct v4l2_buffer buf;
         memset(&buf, 0, sizeof(buf));
         buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        buf.memory = V4L2_MEMORY_MMAP;
+        buf.memory = s->memory;
 
         if(ioctl(s->fd, VIDIOC_DQBUF, &buf) != 0) {
                 log_perror(LOG_LEVEL_ERROR, MOD_NAME "Unable to dequeue buffer");
@@ -63,6 +63,8 @@ struct vidcap_params {
         struct vidcap_params *next; /**< Pointer to next vidcap params. Used by aggregate capture drivers.
                                      *   Last device in list has @ref driver set to NULL. */
         struct module *parent;
+        int decimation;           ///< capture may deliver only every n-th frame (0 or 1 - all)
+        bool decimation_accepted; ///< driver delivers only every n-th frame
 };
 
 /**
@@ -199,6 +201,36 @@ void vidcap_params_set_flags(struct vidcap_params *params, unsigned int flags)
         params->flags = flags;
 }
 
+/**
+ * @returns n if the capture filters would pass only every n-th frame, so the
+ * driver may skip the others (1 if none is skipped)
+ */
+int vidcap_params_get_decimation(const struct vidcap_params *params)
+{
+        return params->decimation > 1 ? params->decimation : 1;
+}
+
+void vidcap_params_set_decimation(struct vidcap_params *params, int decimation)
+{
+        params->decimation = decimation;
+        params->decimation_accepted = false;
+}
+
+/**
+ * Called by a driver from its init to indicate that it delivers only every
+ * n-th frame (see vidcap_params_get_decimation()) with correspondingly
+ * reduced frame rate.
+ */
+void vidcap_params_accept_decimation(struct vidcap_params *params)
+{
+        params->decimation_accepted = true;
+}
+
+bool vidcap_params_decimation_accepted(const struct vidcap_params *params)
+{
+        return params->decimation_accepted;
+}
+
 /**
  * @returns capture driver name (eg. decklink), not NULL if vidcap_params_set_device() called
  */
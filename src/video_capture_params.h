@@ -40,6 +40,10 @@
 #ifndef VIDEO_CAPTURE_PARAM_H
 #define VIDEO_CAPTURE_PARAM_H
 
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif // ! defined __cplusplus
+
 #ifdef __cplusplus
 extern "C" {
 #endif // __cplusplus
@@ -74,6 +78,10 @@ void                  vidcap_params_set_capture_filter(struct vidcap_params *par
                 const char *req_capture_filter);
 const char           *vidcap_params_get_capture_filter(const struct vidcap_params *params);
 void                  vidcap_params_set_flags(struct vidcap_params *params, unsigned int flags);
+int                   vidcap_params_get_decimation(const struct vidcap_params *params);
+void                  vidcap_params_set_decimation(struct vidcap_params *params, int decimation);
+void                  vidcap_params_accept_decimation(struct vidcap_params *params);
+bool                  vidcap_params_decimation_accepted(const struct vidcap_params *params);
 /// @}
 
 #ifdef __cplusplus
@@ -59,6 +59,7 @@
 #include "config_win32.h"
 
 #include <assert.h>
+#include <math.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -67,11 +68,17 @@
 #include "color.h"
 #include "debug.h"
 #include "host.h"
+#include "hwaccel_vaapi.h"
 #include "hwaccel_vdpau.h"
 #include "hwaccel_rpi4.h"
+#include "hwaccel_videotoolbox.h"
+#include "tv.h"
 #include "utils/macros.h" // to_fourcc, OPTIMEZED_FOR
 #include "video_codec.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #ifdef __SSSE3__
 #include "tmmintrin.h"
 #endif
@@ -172,6 +179,10 @@ static const struct codec_info_t codec_info[] = {
 #ifdef HWACC_VDPAU
         [HW_VDPAU] = {"HW_VDPAU", "VDPAU hardware surface",
                 to_fourcc('V', 'D', 'P', 'S'), sizeof(hw_vdpau_frame), 1, 0, 8, FALSE, TRUE, FALSE, TRUE, 4440, "vdpau"},
+#endif
+#ifdef HWACC_VAAPI
+        [HW_VAAPI] = {"HW_VAAPI", "VAAPI hardware surface",
+                to_fourcc('V', 'A', 'S', 'F'), sizeof(hw_vaapi_frame), 1, 0, 8, FALSE, TRUE, FALSE, TRUE, 4200, "vaapi"},
 #endif
         [RPI4_8] = {"RPI4_8", "Raspberry pi 4 hw. decoded (SAND)",
                 to_fourcc('S', 'A', 'N', 'D'), sizeof(av_frame_wrapper), 1, 0, 8, FALSE, TRUE, FALSE, TRUE, 4200, "sand"},
@@ -205,6 +216,16 @@ static const struct codec_info_t codec_info[] = {
                 to_fourcc('a','p','c','o'), 1, 1, 0, 8, FALSE, TRUE, FALSE, FALSE, 0, "apco"},
         [PRORES_422_LT] =  {"PRORES_422_LT", "Apple ProRes 422 (LT)",
                 to_fourcc('a','p','c','s'), 1, 1, 0, 8, FALSE, TRUE, FALSE, FALSE, 0, "apcs"},
+        [CUDA_RGBA] = {"CUDA_RGBA", "RGBA in CUDA device memory",
+                0, 4, 1, 1, 8, TRUE, FALSE, FALSE, FALSE, 4444, "rgba"},
+        [CUDA_UYVY] = {"CUDA_UYVY", "UYVY in CUDA device memory",
+                0, 4, 2, 2, 8, FALSE, FALSE, FALSE, FALSE, 4220, "yuv"},
+        [CUDA_DXT1] = {"CUDA_DXT1", "DXT1 in CUDA device memory",
+                0, 1, 2, 0, 2, TRUE, TRUE, FALSE, FALSE, 0, "dxt1"},
+        [CUDA_DXT5] = {"CUDA_DXT5", "DXT5 YCoCg in CUDA device memory",
+                0, 1, 1, 0, 4, FALSE, TRUE, FALSE, FALSE, 0, "yog"},
+        [HW_VTB] = {"HW_VTB", "VideoToolbox pixel buffer",
+                to_fourcc('V', 'T', 'P', 'B'), sizeof(hw_vtb_frame), 1, 0, 8, FALSE, TRUE, FALSE, TRUE, 4200, "vtb"},
 };
 
 /// for planar pixel formats
@@ -477,7 +498,18 @@ bool codec_is_const_size(codec_t codec)
 }
 
 bool codec_is_hw_accelerated(codec_t codec) {
-        return codec == HW_VDPAU;
+        return codec == HW_VDPAU || codec == HW_VAAPI || codec == HW_VTB;
+}
+
+/**
+ * Returns true if the frame data of the codec reside in GPU memory. Layout of
+ * the data is the same as for the corresponding host codec (eg. RGBA for
+ * CUDA_RGBA), tile data pointers are CUDA device pointers, so they must not
+ * be accessed from the CPU. The producer (decompress) must have finished
+ * writing the data when the frame is passed to the display.
+ */
+bool codec_is_gpu_resident(codec_t codec) {
+        return codec == CUDA_RGBA || codec == CUDA_UYVY || codec == CUDA_DXT1 || codec == CUDA_DXT5;
 }
 
 /** @brief Returns aligned linesize according to pixelformat specification (in bytes) */
@@ -692,15 +724,26 @@ static void vc_deinterlace_unaligned(unsigned char *src, long src_linesize, int
  */
 void vc_deinterlace_ex(unsigned char *src, size_t src_linesize, unsigned char *dst, size_t dst_pitch, size_t lines)
 {
-        for (size_t y = 0; y < lines; y += 2) {
-                for (size_t x = 0; x < src_linesize; ++x) {
-                        int val = (*src + src[src_linesize] + 1) >> 1;
-                        *dst = dst[dst_pitch] = val;
-                        src++;
-                        dst++;
+        for (size_t y = 0; y + 1 < lines; y += 2) {
+                const unsigned char *s0 = src + y * src_linesize;
+                const unsigned char *s1 = s0 + src_linesize;
+                unsigned char *d0 = dst + y * dst_pitch;
+                unsigned char *d1 = d0 + dst_pitch;
+                size_t x = 0;
+#ifdef __SSE2__
+                for ( ; x + 16 <= src_linesize; x += 16) {
+                        __m128i avg = _mm_avg_epu8(_mm_loadu_si128((const __m128i *)(const void *) (s0 + x)),
+                                        _mm_loadu_si128((const __m128i *)(const void *) (s1 + x)));
+                        _mm_storeu_si128((__m128i *)(void *) (d0 + x), avg);
+                        _mm_storeu_si128((__m128i *)(void *) (d1 + x), avg);
+                }
+#endif
+                for ( ; x < src_linesize; ++x) {
+                        d0[x] = d1[x] = (s0[x] + s1[x] + 1) >> 1;
                 }
-                src += src_linesize;
-                dst += dst_pitch;
+        }
+        if (lines % 2 == 1) {
+                memcpy(dst + (lines - 1) * dst_pitch, src + (lines - 1) * src_linesize, src_linesize);
         }
 }
 
@@ -825,6 +868,21 @@ static void vc_copylineYUYV(unsigned char * __restrict dst, const unsigned char
 #endif
 }
 
+/**
+ * Calls line decoder body with compile-time RGB shifts for the common RGBA
+ * and BGRA layouts so that the always-inlined body gets specialized and
+ * vectorized for them, other layouts use the runtime shifts.
+ */
+#define DISPATCH_RGB_SHIFTS(impl, dst, src, len, rshift, gshift, bshift) do { \
+        if ((rshift) == DEFAULT_R_SHIFT && (gshift) == DEFAULT_G_SHIFT && (bshift) == DEFAULT_B_SHIFT) { \
+                impl(dst, src, len, DEFAULT_R_SHIFT, DEFAULT_G_SHIFT, DEFAULT_B_SHIFT); \
+        } else if ((rshift) == DEFAULT_B_SHIFT && (gshift) == DEFAULT_G_SHIFT && (bshift) == DEFAULT_R_SHIFT) { \
+                impl(dst, src, len, DEFAULT_B_SHIFT, DEFAULT_G_SHIFT, DEFAULT_R_SHIFT); \
+        } else { \
+                impl(dst, src, len, rshift, gshift, bshift); \
+        } \
+} while (0)
+
 /**
  * @brief Converts from R10k to RGBA
  *
@@ -835,8 +893,12 @@ static void vc_copylineYUYV(unsigned char * __restrict dst, const unsigned char
  * @param[in]  gshift  destination green shift
  * @param[in]  bshift  destination blue shift
  */
-static void
-vc_copyliner10k(unsigned char * __restrict dst, const unsigned char * __restrict src, int len, int rshift,
+#if defined __GNUC__
+static inline void vc_copyliner10k_impl(unsigned char * __restrict dst, const unsigned char * __restrict src, int len, int rshift,
+                int gshift, int bshift)
+        __attribute__((always_inline));
+#endif
+static inline void vc_copyliner10k_impl(unsigned char * __restrict dst, const unsigned char * __restrict src, int len, int rshift,
                 int gshift, int bshift)
 {
         struct {
@@ -902,6 +964,12 @@ vc_copyliner10k(unsigned char * __restrict dst, const unsigned char * __restrict
         }
 }
 
+static void vc_copyliner10k(unsigned char * __restrict dst, const unsigned char * __restrict src, int len, int rshift,
+                int gshift, int bshift)
+{
+        DISPATCH_RGB_SHIFTS(vc_copyliner10k_impl, dst, src, len, rshift, gshift, bshift);
+}
+
 /**
  * @brief Converts from R12L to RGB
  *
@@ -992,8 +1060,12 @@ vc_copylineR12LtoRGB(unsigned char * __restrict dst, const unsigned char * __res
  * @param[in]  gshift  destination green shift
  * @param[in]  bshift  destination blue shift
  */
-static void
-vc_copylineR12L(unsigned char *dst, const unsigned char *src, int dstlen, int rshift,
+#if defined __GNUC__
+static inline void vc_copylineR12L_impl(unsigned char *dst, const unsigned char *src, int dstlen, int rshift,
+                int gshift, int bshift)
+        __attribute__((always_inline));
+#endif
+static inline void vc_copylineR12L_impl(unsigned char *dst, const unsigned char *src, int dstlen, int rshift,
                 int gshift, int bshift)
 {
         assert((uintptr_t) dst % sizeof(uint32_t) == 0);
@@ -1070,6 +1142,12 @@ vc_copylineR12L(unsigned char *dst, const unsigned char *src, int dstlen, int rs
         }
 }
 
+static void vc_copylineR12L(unsigned char *dst, const unsigned char *src, int dstlen, int rshift,
+                int gshift, int bshift)
+{
+        DISPATCH_RGB_SHIFTS(vc_copylineR12L_impl, dst, src, dstlen, rshift, gshift, bshift);
+}
+
 /**
  * @brief Changes color channels' order in RGBA
  *
@@ -1080,8 +1158,12 @@ vc_copylineR12L(unsigned char *dst, const unsigned char *src, int dstlen, int rs
  * @param[in]  gshift  destination green shift
  * @param[in]  bshift  destination blue shift
  */
-void
-vc_copylineRGBA(unsigned char * __restrict dst, const unsigned char * __restrict src, int len, int rshift,
+#if defined __GNUC__
+static inline void vc_copylineRGBA_impl(unsigned char * __restrict dst, const unsigned char * __restrict src, int len, int rshift,
+                int gshift, int bshift)
+        __attribute__((always_inline));
+#endif
+static inline void vc_copylineRGBA_impl(unsigned char * __restrict dst, const unsigned char * __restrict src, int len, int rshift,
                 int gshift, int bshift)
 {
         register uint32_t *d = (uint32_t *)(void *) dst;
@@ -1132,6 +1214,12 @@ vc_copylineRGBA(unsigned char * __restrict dst, const unsigned char * __restrict
         }
 }
 
+void vc_copylineRGBA(unsigned char * __restrict dst, const unsigned char * __restrict src, int len, int rshift,
+                int gshift, int bshift)
+{
+        DISPATCH_RGB_SHIFTS(vc_copylineRGBA_impl, dst, src, len, rshift, gshift, bshift);
+}
+
 /**
  * @brief Converts from DVS10 to v210
  * @copydetails vc_copylinev210
@@ -1270,7 +1358,11 @@ static void vc_copylineDVS10(unsigned char * __restrict dst, const unsigned char
  *
  * @copydetails vc_copyliner10k
  */
-static void vc_copylineRGB(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift, int gshift, int bshift)
+#if defined __GNUC__
+static inline void vc_copylineRGB_impl(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift, int gshift, int bshift)
+        __attribute__((always_inline));
+#endif
+static inline void vc_copylineRGB_impl(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift, int gshift, int bshift)
 {
         register unsigned int r, g, b;
         union {
@@ -1293,6 +1385,11 @@ static void vc_copylineRGB(unsigned char * __restrict dst, const unsigned char *
         }
 }
 
+static void vc_copylineRGB(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift, int gshift, int bshift)
+{
+        DISPATCH_RGB_SHIFTS(vc_copylineRGB_impl, dst, src, dst_len, rshift, gshift, bshift);
+}
+
 /**
  * @brief Converts from RGBA to RGB. Channels in RGBA can be differently ordered.
  *
@@ -1307,7 +1404,11 @@ static void vc_copylineRGB(unsigned char * __restrict dst, const unsigned char *
  * In opposite to the defined semantic of {r,g,b}shift, here instead of destination
  * shifts the shifts define the source codec properties.
  */
-static void vc_copylineRGBAtoRGBwithShift(unsigned char * __restrict dst2, const unsigned char * __restrict src2, int dst_len, int rshift, int gshift, int bshift)
+#if defined __GNUC__
+static inline void vc_copylineRGBAtoRGBwithShift_impl(unsigned char * __restrict dst2, const unsigned char * __restrict src2, int dst_len, int rshift, int gshift, int bshift)
+        __attribute__((always_inline));
+#endif
+static inline void vc_copylineRGBAtoRGBwithShift_impl(unsigned char * __restrict dst2, const unsigned char * __restrict src2, int dst_len, int rshift, int gshift, int bshift)
 {
 	register const uint32_t * src = (const uint32_t *)(const void *) src2;
 	register uint32_t * dst = (uint32_t *)(void *) dst2;
@@ -1341,6 +1442,11 @@ static void vc_copylineRGBAtoRGBwithShift(unsigned char * __restrict dst2, const
         }
 }
 
+static void vc_copylineRGBAtoRGBwithShift(unsigned char * __restrict dst2, const unsigned char * __restrict src2, int dst_len, int rshift, int gshift, int bshift)
+{
+        DISPATCH_RGB_SHIFTS(vc_copylineRGBAtoRGBwithShift_impl, dst2, src2, dst_len, rshift, gshift, bshift);
+}
+
 /**
  * @brief Converts from AGBR to RGB
  * @copydetails vc_copylinev210
@@ -1410,7 +1516,11 @@ void vc_copylineUYVYtoGrayscale(unsigned char * __restrict dst, const unsigned c
  * @brief Converts RGB to RGBA
  * @copydetails vc_copyliner10k
  */
-void vc_copylineRGBtoRGBA(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift, int gshift, int bshift)
+#if defined __GNUC__
+static inline void vc_copylineRGBtoRGBA_impl(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift, int gshift, int bshift)
+        __attribute__((always_inline));
+#endif
+static inline void vc_copylineRGBtoRGBA_impl(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift, int gshift, int bshift)
 {
         register unsigned int r, g, b;
         register uint32_t *d = (uint32_t *)(void *) dst;
@@ -1424,6 +1534,11 @@ void vc_copylineRGBtoRGBA(unsigned char * __restrict dst, const unsigned char *
         }
 }
 
+void vc_copylineRGBtoRGBA(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift, int gshift, int bshift)
+{
+        DISPATCH_RGB_SHIFTS(vc_copylineRGBtoRGBA_impl, dst, src, dst_len, rshift, gshift, bshift);
+}
+
 /**
  * @brief Converts RGB(A) into UYVY
  *
@@ -1537,8 +1652,14 @@ static void vc_copylineUYVYtoRG48(unsigned char * __restrict dst, const unsigned
  * @param[out] dst     output buffer for RGBA
  * @param[in]  src     input buffer with UYVY
  */
-static void vc_copylineUYVYtoRGBA(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
-                int gshift, int bshift) {
+#if defined __GNUC__
+static inline void vc_copylineUYVYtoRGBA_impl(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+        __attribute__((always_inline));
+#endif
+static inline void vc_copylineUYVYtoRGBA_impl(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
         assert((uintptr_t) dst % sizeof(uint32_t) == 0);
         uint32_t *dst32 = (uint32_t *)(void *) dst;
         OPTIMIZED_FOR (int x = 0; x <= dst_len - 8; x += 8) {
@@ -1558,6 +1679,12 @@ static void vc_copylineUYVYtoRGBA(unsigned char * __restrict dst, const unsigned
         }
 }
 
+static void vc_copylineUYVYtoRGBA(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
+        DISPATCH_RGB_SHIFTS(vc_copylineUYVYtoRGBA_impl, dst, src, dst_len, rshift, gshift, bshift);
+}
+
 /**
  * @brief Converts UYVY to RGB using SSE.
  * Uses Rec. 709 with standard SDI ceiling and floor
@@ -2024,7 +2151,12 @@ static void vc_copylineRG48toRGB(unsigned char * __restrict dst, const unsigned
         }
 }
 
-static void vc_copylineRG48toRGBA(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+#if defined __GNUC__
+static inline void vc_copylineRG48toRGBA_impl(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+        __attribute__((always_inline));
+#endif
+static inline void vc_copylineRG48toRGBA_impl(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
                 int gshift, int bshift)
 {
         assert((uintptr_t) dst % sizeof(uint32_t) == 0);
@@ -2035,6 +2167,12 @@ static void vc_copylineRG48toRGBA(unsigned char * __restrict dst, const unsigned
         }
 }
 
+static void vc_copylineRG48toRGBA(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
+        DISPATCH_RGB_SHIFTS(vc_copylineRG48toRGBA_impl, dst, src, dst_len, rshift, gshift, bshift);
+}
+
 /**
  * @brief Converts RGB to UYVY.
  * @copydetails vc_copylinev210
@@ -2463,8 +2601,11 @@ void vc_memcpy(unsigned char * __restrict dst, const unsigned char * __restrict
  * @brief Converts DPX10 to RGBA
  * @copydetails vc_copyliner10k
  */
-static void
-vc_copylineDPX10toRGBA(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift, int gshift, int bshift)
+#if defined __GNUC__
+static inline void vc_copylineDPX10toRGBA_impl(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift, int gshift, int bshift)
+        __attribute__((always_inline));
+#endif
+static inline void vc_copylineDPX10toRGBA_impl(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift, int gshift, int bshift)
 {
         
         register const unsigned int *in = (const unsigned int *)(const void *) src;
@@ -2483,6 +2624,11 @@ vc_copylineDPX10toRGBA(unsigned char * __restrict dst, const unsigned char * __r
         }
 }
 
+static void vc_copylineDPX10toRGBA(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift, int gshift, int bshift)
+{
+        DISPATCH_RGB_SHIFTS(vc_copylineDPX10toRGBA_impl, dst, src, dst_len, rshift, gshift, bshift);
+}
+
 /**
  * @brief Converts DPX10 to RGB.
  * @copydetails vc_copylinev210
@@ -2737,26 +2883,28 @@ static void vc_copylineV210toY216(unsigned char * __restrict dst, const unsigned
         UNUSED(bshift);
         assert((uintptr_t) dst % 2 == 0);
         assert((uintptr_t) src % 4 == 0);
+#define V210_COMP(w, i) ((((w) >> (10U * (i))) & 0x3FFU) << 6U)
         OPTIMIZED_FOR (int x = 0; x < dst_len / 24; ++x) {
                 const uint32_t *s = (const void *) (src + x * 16);
                 uint16_t *d = (void *) (dst + x * 24);
-                uint32_t tmp = *s++;
-                *d++ = (tmp & 0x3FU) << 6U; // U
-                *d++ = ((tmp >> 10U) & 0x3FU) << 6U; // Y
-                *d++ = ((tmp >> 20U) & 0x3FU) << 6U; // V
-                tmp = *s++;
-                *d++ = (tmp & 0x3FU) << 6U; // Y
-                *d++ = ((tmp >> 10U) & 0x3FU) << 6U; // U
-                *d++ = ((tmp >> 20U) & 0x3FU) << 6U; // Y
-                tmp = *s++;
-                *d++ = (tmp & 0x3FU) << 6U; // V
-                *d++ = ((tmp >> 10U) & 0x3FU) << 6U; // Y
-                *d++ = ((tmp >> 20U) & 0x3FU) << 6U; // U
-                tmp = *s++;
-                *d++ = (tmp & 0x3FU) << 6U; // Y
-                *d++ = ((tmp >> 10U) & 0x3FU) << 6U; // V
-                *d++ = ((tmp >> 20U) & 0x3FU) << 6U; // Y
-        }
+                uint32_t w0 = s[0];
+                uint32_t w1 = s[1];
+                uint32_t w2 = s[2];
+                uint32_t w3 = s[3];
+                *d++ = V210_COMP(w0, 1); // Y0
+                *d++ = V210_COMP(w0, 0); // U0
+                *d++ = V210_COMP(w1, 0); // Y1
+                *d++ = V210_COMP(w0, 2); // V0
+                *d++ = V210_COMP(w1, 2); // Y2
+                *d++ = V210_COMP(w1, 1); // U1
+                *d++ = V210_COMP(w2, 1); // Y3
+                *d++ = V210_COMP(w2, 0); // V1
+                *d++ = V210_COMP(w3, 0); // Y4
+                *d++ = V210_COMP(w2, 2); // U2
+                *d++ = V210_COMP(w3, 2); // Y5
+                *d++ = V210_COMP(w3, 1); // V2
+        }
+#undef V210_COMP
 }
 
 static void vc_copylineY416toV210(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
@@ -2790,6 +2938,255 @@ static void vc_copylineY416toV210(unsigned char * __restrict dst, const unsigned
         }
 }
 
+/*
+ * AVX2 variants of the hot line decoders. They are compiled regardless
+ * of the baseline ISA (distribution builds target plain x86-64) and are
+ * selected at runtime by get_decoder_item_dispatched() if the CPU supports
+ * AVX2. Results are bit-exact with the generic versions, which also handle
+ * the line remainders.
+ */
+#if defined __x86_64__ && (defined __GNUC__ || defined __clang__)
+#define HAVE_AVX2_DISPATCH 1
+#include <immintrin.h>
+#define TARGET_AVX2 __attribute__((target("avx2")))
+
+TARGET_AVX2 static void vc_copylinev210_avx2(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
+        const __m256i mask_a = _mm256_set1_epi32(0xFF);
+        const __m256i mask_b = _mm256_set1_epi32(0xFF00);
+        const __m256i mask_c = _mm256_set1_epi32(0xFF0000);
+        // drop 4th (empty) byte of each 32-bit word
+        const __m256i pack = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                        0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+        while (dst_len >= 28) { // 24 B written + 4 B overlapping store
+                __m256i w = _mm256_loadu_si256((const __m256i *)(const void *) src);
+                __m256i t = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(w, 2), mask_a),
+                                _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(w, 4), mask_b),
+                                        _mm256_and_si256(_mm256_srli_epi32(w, 6), mask_c)));
+                t = _mm256_shuffle_epi8(t, pack);
+                _mm_storeu_si128((__m128i *)(void *) dst, _mm256_castsi256_si128(t));
+                _mm_storeu_si128((__m128i *)(void *) (dst + 12), _mm256_extracti128_si256(t, 1));
+                src += 32;
+                dst += 24;
+                dst_len -= 24;
+        }
+        vc_copylinev210(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+/// loads 8 3-byte groups (24 B) and expands each to the low bytes of a 32-bit word
+TARGET_AVX2 static inline __m256i load_expand_3to4_avx2(const unsigned char *src)
+{
+        const __m128i expand = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+        __m128i lo = _mm_loadu_si128((const __m128i *)(const void *) src);
+        __m128i hi = _mm_loadl_epi64((const __m128i *)(const void *) (src + 16));
+        hi = _mm_alignr_epi8(hi, lo, 12);
+        return _mm256_set_m128i(_mm_shuffle_epi8(hi, expand), _mm_shuffle_epi8(lo, expand));
+}
+
+TARGET_AVX2 static void vc_copylineUYVYtoV210_avx2(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
+        const __m256i mask_a = _mm256_set1_epi32(0xFF);
+        const __m256i mask_b = _mm256_set1_epi32(0xFF00);
+        const __m256i mask_c = _mm256_set1_epi32(0xFF0000);
+        while (dst_len >= 32) {
+                __m256i w = load_expand_3to4_avx2(src);
+                w = _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(w, mask_a), 2),
+                                _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(w, mask_b), 4),
+                                        _mm256_slli_epi32(_mm256_and_si256(w, mask_c), 6)));
+                _mm256_storeu_si256((__m256i *)(void *) dst, w);
+                src += 24;
+                dst += 32;
+                dst_len -= 32;
+        }
+        vc_copylineUYVYtoV210(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+TARGET_AVX2 static void vc_copyliner10k_avx2(unsigned char * __restrict dst, const unsigned char * __restrict src, int len, int rshift,
+                int gshift, int bshift)
+{
+        const __m128i rs = _mm_cvtsi32_si128(rshift);
+        const __m128i gs = _mm_cvtsi32_si128(gshift);
+        const __m128i bs = _mm_cvtsi32_si128(bshift);
+        const __m256i m2 = _mm256_set1_epi32(0x3);
+        const __m256i m4 = _mm256_set1_epi32(0xF);
+        const __m256i m6 = _mm256_set1_epi32(0x3F);
+        const __m256i m8 = _mm256_set1_epi32(0xFF);
+        while (len >= 32) {
+                __m256i w = _mm256_loadu_si256((const __m256i *)(const void *) src);
+                __m256i r = _mm256_and_si256(w, m8);
+                __m256i g = _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(_mm256_srli_epi32(w, 8), m6), 2),
+                                _mm256_and_si256(_mm256_srli_epi32(w, 22), m2));
+                __m256i b = _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(_mm256_srli_epi32(w, 16), m4), 4),
+                                _mm256_and_si256(_mm256_srli_epi32(w, 28), m4));
+                __m256i out = _mm256_or_si256(_mm256_sll_epi32(r, rs),
+                                _mm256_or_si256(_mm256_sll_epi32(g, gs), _mm256_sll_epi32(b, bs)));
+                _mm256_storeu_si256((__m256i *)(void *) dst, out);
+                src += 32;
+                dst += 32;
+                len -= 32;
+        }
+        vc_copyliner10k(dst, src, len, rshift, gshift, bshift);
+}
+
+TARGET_AVX2 static void vc_copylineRGBAtoR10k_avx2(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
+        const __m256i m2 = _mm256_set1_epi32(0x3);
+        const __m256i m4 = _mm256_set1_epi32(0xF);
+        const __m256i m8 = _mm256_set1_epi32(0xFF);
+        while (dst_len >= 32) {
+                __m256i w = _mm256_loadu_si256((const __m256i *)(const void *) src);
+                __m256i r = _mm256_and_si256(w, m8);
+                __m256i g = _mm256_and_si256(_mm256_srli_epi32(w, 8), m8);
+                __m256i b = _mm256_and_si256(_mm256_srli_epi32(w, 16), m8);
+                __m256i out = _mm256_or_si256(
+                                _mm256_or_si256(r, _mm256_slli_epi32(_mm256_srli_epi32(g, 2), 8)),
+                                _mm256_or_si256(_mm256_slli_epi32(_mm256_srli_epi32(b, 4), 16),
+                                        _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(g, m2), 22),
+                                                _mm256_slli_epi32(_mm256_and_si256(b, m4), 28))));
+                _mm256_storeu_si256((__m256i *)(void *) dst, out);
+                src += 32;
+                dst += 32;
+                dst_len -= 32;
+        }
+        vc_copylineRGBAtoR10k(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+/**
+ * Converts 4 UYVY pixels (in 32-bit lanes as an int) to RGB shifted by
+ * rs/gs/bs. Computed in double precision with the same coefficients and
+ * operation order as copylineYUVtoRGB so that the result is the same.
+ */
+TARGET_AVX2 static inline __m128i yuv_to_rgb4_avx2(__m128i y, __m128i u, __m128i v, __m128i rs, __m128i gs, __m128i bs)
+{
+        const __m256d zero = _mm256_setzero_pd();
+        const __m256d max_val = _mm256_set1_pd(255);
+        __m256d yd = _mm256_mul_pd(_mm256_set1_pd(1.164), _mm256_cvtepi32_pd(_mm_sub_epi32(y, _mm_set1_epi32(16))));
+        __m256d ud = _mm256_cvtepi32_pd(_mm_sub_epi32(u, _mm_set1_epi32(128)));
+        __m256d vd = _mm256_cvtepi32_pd(_mm_sub_epi32(v, _mm_set1_epi32(128)));
+        __m256d r = _mm256_add_pd(yd, _mm256_mul_pd(_mm256_set1_pd(1.793), vd));
+        __m256d g = _mm256_sub_pd(_mm256_sub_pd(yd, _mm256_mul_pd(_mm256_set1_pd(0.534), vd)),
+                        _mm256_mul_pd(_mm256_set1_pd(0.213), ud));
+        __m256d b = _mm256_add_pd(yd, _mm256_mul_pd(_mm256_set1_pd(2.115), ud));
+        __m128i ri = _mm256_cvttpd_epi32(_mm256_min_pd(_mm256_max_pd(r, zero), max_val));
+        __m128i gi = _mm256_cvttpd_epi32(_mm256_min_pd(_mm256_max_pd(g, zero), max_val));
+        __m128i bi = _mm256_cvttpd_epi32(_mm256_min_pd(_mm256_max_pd(b, zero), max_val));
+        return _mm_or_si128(_mm_sll_epi32(ri, rs), _mm_or_si128(_mm_sll_epi32(gi, gs), _mm_sll_epi32(bi, bs)));
+}
+
+/// converts 8 UYVY pixels (16 B) to 2x4 RGB pixels in 32-bit words
+#define UYVY_TO_RGB8_AVX2(src, rs, gs, bs, out_lo, out_hi) { \
+        const __m128i y_idx = _mm_setr_epi8(1, 3, 5, 7, 9, 11, 13, 15, -1, -1, -1, -1, -1, -1, -1, -1); \
+        const __m128i u_idx = _mm_setr_epi8(0, 0, 4, 4, 8, 8, 12, 12, -1, -1, -1, -1, -1, -1, -1, -1); \
+        const __m128i v_idx = _mm_setr_epi8(2, 2, 6, 6, 10, 10, 14, 14, -1, -1, -1, -1, -1, -1, -1, -1); \
+        __m128i in = _mm_loadu_si128((const __m128i *)(const void *) (src)); \
+        __m256i y = _mm256_cvtepu8_epi32(_mm_shuffle_epi8(in, y_idx)); \
+        __m256i u = _mm256_cvtepu8_epi32(_mm_shuffle_epi8(in, u_idx)); \
+        __m256i v = _mm256_cvtepu8_epi32(_mm_shuffle_epi8(in, v_idx)); \
+        out_lo = yuv_to_rgb4_avx2(_mm256_castsi256_si128(y), _mm256_castsi256_si128(u), \
+                        _mm256_castsi256_si128(v), rs, gs, bs); \
+        out_hi = yuv_to_rgb4_avx2(_mm256_extracti128_si256(y, 1), _mm256_extracti128_si256(u, 1), \
+                        _mm256_extracti128_si256(v, 1), rs, gs, bs); \
+}
+
+TARGET_AVX2 static void vc_copylineUYVYtoRGBA_avx2(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
+        const __m128i rs = _mm_cvtsi32_si128(rshift);
+        const __m128i gs = _mm_cvtsi32_si128(gshift);
+        const __m128i bs = _mm_cvtsi32_si128(bshift);
+        while (dst_len >= 32) {
+                __m128i lo, hi;
+                UYVY_TO_RGB8_AVX2(src, rs, gs, bs, lo, hi);
+                _mm_storeu_si128((__m128i *)(void *) dst, lo);
+                _mm_storeu_si128((__m128i *)(void *) (dst + 16), hi);
+                src += 16;
+                dst += 32;
+                dst_len -= 32;
+        }
+        vc_copylineUYVYtoRGBA(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+TARGET_AVX2 static void vc_copylineUYVYtoRGB_avx2(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
+        const __m128i rs = _mm_cvtsi32_si128(0);
+        const __m128i gs = _mm_cvtsi32_si128(8);
+        const __m128i bs = _mm_cvtsi32_si128(16);
+        const __m128i pack = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+        while (dst_len >= 28) { // 24 B written + 4 B overlapping store
+                __m128i lo, hi;
+                UYVY_TO_RGB8_AVX2(src, rs, gs, bs, lo, hi);
+                _mm_storeu_si128((__m128i *)(void *) dst, _mm_shuffle_epi8(lo, pack));
+                _mm_storeu_si128((__m128i *)(void *) (dst + 12), _mm_shuffle_epi8(hi, pack));
+                src += 16;
+                dst += 24;
+                dst_len -= 24;
+        }
+        vc_copylineUYVYtoRGB(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+/**
+ * Converts 8 pixels (8-bit R, G and B in 32-bit lanes) to 4 UYVY words with
+ * the same integer arithmetic as vc_copylineToUYVY709.
+ */
+TARGET_AVX2 static inline __m128i rgb8_to_uyvy709_avx2(__m256i w)
+{
+        const __m256i m8 = _mm256_set1_epi32(0xFF);
+        const __m256i max_val = _mm256_set1_epi32((1<<24)-1);
+        const __m256i zero = _mm256_setzero_si256();
+        __m256i r = _mm256_and_si256(w, m8);
+        __m256i g = _mm256_and_si256(_mm256_srli_epi32(w, 8), m8);
+        __m256i b = _mm256_and_si256(_mm256_srli_epi32(w, 16), m8);
+#define MUL(c, x) _mm256_mullo_epi32(_mm256_set1_epi32(c), x)
+        __m256i y = _mm256_add_epi32(_mm256_add_epi32(MUL(11993, r), MUL(40239, g)),
+                        _mm256_add_epi32(MUL(4063, b), _mm256_set1_epi32(1<<20)));
+        __m256i u = _mm256_add_epi32(_mm256_add_epi32(MUL(-6619, r), MUL(-22151, g)), MUL(28770, b));
+        __m256i v = _mm256_add_epi32(_mm256_add_epi32(MUL(28770, r), MUL(-26149, g)), MUL(-2621, b));
+#undef MUL
+        // per lane: u01 u23 v01 v23
+        __m256i uv = _mm256_hadd_epi32(u, v);
+        // uv / 2 rounded towards zero (as the C division)
+        uv = _mm256_srai_epi32(_mm256_add_epi32(uv, _mm256_srli_epi32(uv, 31)), 1);
+        uv = _mm256_add_epi32(uv, _mm256_set1_epi32(1<<23));
+        uv = _mm256_srli_epi32(_mm256_min_epi32(_mm256_max_epi32(uv, zero), max_val), 16);
+        y = _mm256_srli_epi32(_mm256_min_epi32(_mm256_max_epi32(y, zero), max_val), 16);
+        // per lane bytes: u01 u23 v01 v23 y0 y1 y2 y3
+        __m256i bytes = _mm256_packus_epi16(_mm256_packus_epi32(uv, y), zero);
+        const __m256i order = _mm256_setr_epi8(0, 4, 2, 5, 1, 6, 3, 7, -1, -1, -1, -1, -1, -1, -1, -1,
+                        0, 4, 2, 5, 1, 6, 3, 7, -1, -1, -1, -1, -1, -1, -1, -1);
+        bytes = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(bytes, order), _MM_SHUFFLE(3, 1, 2, 0));
+        return _mm256_castsi256_si128(bytes);
+}
+
+TARGET_AVX2 static void vc_copylineRGBtoUYVY_avx2(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
+        while (dst_len >= 16) {
+                _mm_storeu_si128((__m128i *)(void *) dst, rgb8_to_uyvy709_avx2(load_expand_3to4_avx2(src)));
+                src += 24;
+                dst += 16;
+                dst_len -= 16;
+        }
+        vc_copylineRGBtoUYVY(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+TARGET_AVX2 static void vc_copylineRGBAtoUYVY_avx2(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
+        while (dst_len >= 16) {
+                __m256i w = _mm256_loadu_si256((const __m256i *)(const void *) src);
+                _mm_storeu_si128((__m128i *)(void *) dst, rgb8_to_uyvy709_avx2(w));
+                src += 32;
+                dst += 16;
+                dst_len -= 16;
+        }
+        vc_copylineRGBAtoUYVY(dst, src, dst_len, rshift, gshift, bshift);
+}
+#endif // defined __x86_64__ && (defined __GNUC__ || defined __clang__)
+
 struct decoder_item {
         decoder_t decoder;
         codec_t in;
@@ -2842,9 +3239,63 @@ static const struct decoder_item decoders[] = {
         { vc_copylineY216toV210,  Y216,  v210, false },
         { vc_copylineY416toUYVY,  Y416,  UYVY, false },
         { vc_copylineY416toV210,  Y416,  v210, false },
-        { vc_copylineV210toY216,  v210,  Y416, false },
+        { vc_copylineV210toY216,  v210,  Y216, false },
 };
 
+#ifdef HAVE_AVX2_DISPATCH
+/// AVX2 replacements of the decoders from @ref decoders (same in/out/slow)
+static const struct decoder_item decoders_avx2[] = {
+        { vc_copylinev210_avx2,       v210,  UYVY, false },
+        { vc_copylineUYVYtoV210_avx2, UYVY,  v210, false },
+        { vc_copyliner10k_avx2,       R10k,  RGBA, false },
+        { vc_copylineRGBAtoR10k_avx2, RGBA,  R10k, false },
+        { vc_copylineUYVYtoRGB_avx2,  UYVY,  RGB, true },
+        { vc_copylineUYVYtoRGBA_avx2, UYVY,  RGBA, true },
+        { vc_copylineRGBtoUYVY_avx2,  RGB,   UYVY, true },
+        { vc_copylineRGBAtoUYVY_avx2, RGBA,  UYVY, true },
+};
+#endif
+
+ADD_TO_PARAM("conv-isa", "* conv-isa=generic\n"
+                "  Do not use pixel format conversions optimized for the running CPU (eg. AVX2), only the generic ones\n");
+/**
+ * @returns true if runtime-dispatched AVX2 conversions can be used, ie. they
+ * were compiled in, the CPU supports them and they are not disabled by the
+ * conv-isa parameter
+ */
+bool vc_avx2_enabled(void)
+{
+#ifdef HAVE_AVX2_DISPATCH
+        static int have_avx2 = -1;
+        if (have_avx2 == -1) {
+                __builtin_cpu_init();
+                have_avx2 = __builtin_cpu_supports("avx2");
+        }
+        const char *isa = get_commandline_param("conv-isa");
+        return have_avx2 && (isa == NULL || strcmp(isa, "generic") != 0);
+#else
+        return false;
+#endif
+}
+
+/**
+ * Returns the decoder function of the item, replaced by a variant
+ * optimized for the running CPU if there is any.
+ */
+static decoder_t get_decoder_item_dispatched(const struct decoder_item *item)
+{
+#ifdef HAVE_AVX2_DISPATCH
+        if (vc_avx2_enabled()) {
+                for (unsigned int i = 0; i < sizeof decoders_avx2 / sizeof decoders_avx2[0]; ++i) {
+                        if (decoders_avx2[i].in == item->in && decoders_avx2[i].out == item->out) {
+                                return decoders_avx2[i].decoder;
+                        }
+                }
+        }
+#endif
+        return item->decoder;
+}
+
 // @param[in] slow  include also slow decoders
 static decoder_t get_decoder_from_to_internal(codec_t in, codec_t out, bool slow)
 {
@@ -2856,7 +3307,7 @@ static decoder_t get_decoder_from_to_internal(codec_t in, codec_t out, bool slow
         for (unsigned int i = 0; i < sizeof(decoders)/sizeof(struct decoder_item); ++i) {
                 if (decoders[i].in == in && decoders[i].out == out &&
                                 (decoders[i].slow == false || slow == true)) {
-                        return decoders[i].decoder;
+                        return get_decoder_item_dispatched(&decoders[i]);
                 }
         }
 
@@ -2870,26 +3321,9 @@ decoder_t get_decoder_from_to(codec_t in, codec_t out) {
         return get_decoder_from_to_internal(in, out, true);
 }
 
-// less is better
-#ifdef QSORT_S_COMP_FIRST
-static int best_decoder_cmp(void *orig_c, const void *a, const void *b) {
-#else
-static int best_decoder_cmp(const void *a, const void *b, void *orig_c) {
-#endif
-        codec_t codec_a = *(const codec_t *) a;
-        codec_t codec_b = *(const codec_t *) b;
-        codec_t orig_codec = *(codec_t *) orig_c;
-
-        if (orig_codec == codec_a || orig_codec == codec_b) { // exact match
-                return orig_codec == codec_a ? -1 : 1;
-        }
-
-        bool slow_a = get_decoder_from_to_internal(orig_codec, codec_a, false) == NULL;
-        bool slow_b = get_decoder_from_to_internal(orig_codec, codec_b, false) == NULL;
-        if (slow_a != slow_b) {
-                return slow_a ? 1 : -1;
-        }
-
+// less is better, compares bit depth and subsampling relative to orig_codec
+static int codec_quality_cmp(codec_t orig_codec, codec_t codec_a, codec_t codec_b)
+{
         int bits_a = get_bits_per_component(codec_a);
         int bits_b = get_bits_per_component(codec_b);
         if (bits_a != bits_b) {
@@ -2915,6 +3349,29 @@ static int best_decoder_cmp(const void *a, const void *b, void *orig_c) {
         return (int) codec_a - (int) codec_b;
 }
 
+// less is better
+#ifdef QSORT_S_COMP_FIRST
+static int best_decoder_cmp(void *orig_c, const void *a, const void *b) {
+#else
+static int best_decoder_cmp(const void *a, const void *b, void *orig_c) {
+#endif
+        codec_t codec_a = *(const codec_t *) a;
+        codec_t codec_b = *(const codec_t *) b;
+        codec_t orig_codec = *(codec_t *) orig_c;
+
+        if (orig_codec == codec_a || orig_codec == codec_b) { // exact match
+                return orig_codec == codec_a ? -1 : 1;
+        }
+
+        bool slow_a = get_decoder_from_to_internal(orig_codec, codec_a, false) == NULL;
+        bool slow_b = get_decoder_from_to_internal(orig_codec, codec_b, false) == NULL;
+        if (slow_a != slow_b) {
+                return slow_a ? 1 : -1;
+        }
+
+        return codec_quality_cmp(orig_codec, codec_a, codec_b);
+}
+
 /**
  * Returns best decoder for input codec.
  *
@@ -2976,10 +3433,10 @@ decoder_t get_fastest_decoder_from(codec_t in, const codec_t *out_candidates, co
                 }
                 if (decoders[i].slow == false) { // match, found fast convert
                         *out = decoders[i].out;
-                        return decoders[i].decoder;
+                        return get_decoder_item_dispatched(&decoders[i]);
                 }
                 if (current_dec == NULL) { // it is slow but store it in case we won't find fast one
-                        current_dec = decoders[i].decoder;
+                        current_dec = get_decoder_item_dispatched(&decoders[i]);
                         current_codec = decoders[i].out;
                 }
         }
@@ -2989,6 +3446,303 @@ decoder_t get_fastest_decoder_from(codec_t in, const codec_t *out_candidates, co
         return current_dec;
 }
 
+ADD_TO_PARAM("decoder-chain", "* decoder-chain=no\n"
+                "  Do not use multi-step line conversions (eg. in video decoder), only direct ones\n");
+
+#define DECODER_COUNT (sizeof decoders / sizeof decoders[0])
+#define COST_MEASURE_WIDTH 1920 ///< must be divisible by all pixel block sizes
+#define HOP_PENALTY 0.2 ///< [ns/px] overhead of every additional conversion step
+#define CHAIN_CHUNK_PX 384 ///< conversion chains run in chunks of this size (multiple of all block sizes)
+#define CHAIN_MAX_INTERMEDIATE_BPP 8
+#define CHAIN_CACHE_SIZE 16
+
+static pthread_mutex_t decoder_chain_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Measures conversion cost of a decoder in ns per pixel. Decoders already
+ * known to be slow are expected to be at least 2x slower than the measured
+ * value of a fast one so the measurement just refines the order.
+ */
+static double measure_decoder_cost(const struct decoder_item *item)
+{
+        const int src_len = vc_get_linesize(COST_MEASURE_WIDTH, item->in);
+        const int dst_len = vc_get_linesize(COST_MEASURE_WIDTH, item->out);
+        unsigned char *src = malloc(src_len + 64);
+        unsigned char *dst = malloc(dst_len + 64);
+        for (int i = 0; i < src_len; ++i) {
+                src[i] = i * 37U;
+        }
+        decoder_t dec = get_decoder_item_dispatched(item);
+        time_ns_t best = INT64_MAX;
+        for (int i = 0; i < 5; ++i) { // first iteration is warm-up
+                time_ns_t t0 = get_time_in_ns();
+                dec(dst, src, dst_len, DEFAULT_R_SHIFT, DEFAULT_G_SHIFT, DEFAULT_B_SHIFT);
+                time_ns_t t = get_time_in_ns() - t0;
+                if (i > 0 && t < best) {
+                        best = t;
+                }
+        }
+        free(src);
+        free(dst);
+        return (double) best / COST_MEASURE_WIDTH;
+}
+
+/// @returns cost of decoders[idx] in ns/px, measured at first use
+static double get_decoder_cost(unsigned int idx)
+{
+        static double cost[DECODER_COUNT];
+        static bool measured = false;
+        if (!measured) {
+                for (unsigned int i = 0; i < DECODER_COUNT; ++i) {
+                        cost[i] = measure_decoder_cost(&decoders[i]);
+                        log_msg(LOG_LEVEL_DEBUG, "Line decoder %s->%s cost: %.3f ns/px\n",
+                                        get_codec_name(decoders[i].in), get_codec_name(decoders[i].out), cost[i]);
+                }
+                measured = true;
+        }
+        return cost[idx];
+}
+
+/**
+ * Intermediate codec of a conversion chain cannot be worse (bit depth,
+ * subsampling) than both input and output and must be of the same color
+ * space if input and output are.
+ */
+static bool is_acceptable_intermediate(codec_t mid, codec_t in, codec_t out)
+{
+        if (get_bits_per_component(mid) < MIN(get_bits_per_component(in), get_bits_per_component(out))) {
+                return false;
+        }
+        if (get_subsampling(mid) < MIN(get_subsampling(in), get_subsampling(out))) {
+                return false;
+        }
+        if (codec_is_a_rgb(in) == codec_is_a_rgb(out) && codec_is_a_rgb(mid) != codec_is_a_rgb(in)) {
+                return false;
+        }
+        return get_pf_block_pixels(mid) <= CHAIN_CHUNK_PX && CHAIN_CHUNK_PX % get_pf_block_pixels(mid) == 0
+                && get_bpp(mid) <= CHAIN_MAX_INTERMEDIATE_BPP;
+}
+
+struct chain_search {
+        codec_t in;
+        bool allow_multi_hop;
+        double cost[VIDEO_CODEC_COUNT];       ///< cheapest cost to reach the codec
+        bool fast[VIDEO_CODEC_COUNT];         ///< codec is reachable with fast decoders only
+        struct decoder_chain best[VIDEO_CODEC_COUNT];
+        unsigned int path[DECODER_CHAIN_MAX_HOPS]; ///< indices to @ref decoders
+};
+
+static bool chain_contains(const struct chain_search *s, int hops, codec_t c)
+{
+        if (c == s->in) {
+                return true;
+        }
+        for (int i = 0; i < hops; ++i) {
+                if (decoders[s->path[i]].out == c) {
+                        return true;
+                }
+        }
+        return false;
+}
+
+/// enumerates all decoder chains up to DECODER_CHAIN_MAX_HOPS from s->in
+static void chain_search_dfs(struct chain_search *s, int hops, codec_t cur, double cost, bool fast)
+{
+        if (hops == DECODER_CHAIN_MAX_HOPS || (hops == 1 && !s->allow_multi_hop)) {
+                return;
+        }
+        for (unsigned int i = 0; i < DECODER_COUNT; ++i) {
+                if (decoders[i].in != cur || decoders[i].in == decoders[i].out ||
+                                chain_contains(s, hops, decoders[i].out)) {
+                        continue;
+                }
+                codec_t next = decoders[i].out;
+                s->path[hops] = i;
+                bool ok = true;
+                for (int h = 0; h < hops; ++h) {
+                        ok = ok && is_acceptable_intermediate(decoders[s->path[h]].out, s->in, next);
+                }
+                double next_cost = cost + get_decoder_cost(i) + (hops > 0 ? HOP_PENALTY : 0);
+                bool next_fast = fast && !decoders[i].slow;
+                if (ok && next_fast) {
+                        s->fast[next] = true;
+                }
+                if (ok && next_cost < s->cost[next]) {
+                        s->cost[next] = next_cost;
+                        s->best[next].hops = hops + 1;
+                        s->best[next].codec[0] = s->in;
+                        for (int h = 0; h <= hops; ++h) {
+                                s->best[next].dec[h] = get_decoder_item_dispatched(&decoders[s->path[h]]);
+                                s->best[next].codec[h + 1] = decoders[s->path[h]].out;
+                        }
+                }
+                chain_search_dfs(s, hops + 1, next, next_cost, next_fast);
+        }
+}
+
+// less is better, same as best_decoder_cmp() but slowness is given by the chain search
+#ifdef QSORT_S_COMP_FIRST
+static int best_chain_cmp(void *search, const void *a, const void *b) {
+#else
+static int best_chain_cmp(const void *a, const void *b, void *search) {
+#endif
+        codec_t codec_a = *(const codec_t *) a;
+        codec_t codec_b = *(const codec_t *) b;
+        struct chain_search *s = search;
+
+        if (s->in == codec_a || s->in == codec_b) { // exact match
+                return s->in == codec_a ? -1 : 1;
+        }
+        if (s->fast[codec_a] != s->fast[codec_b]) {
+                return s->fast[codec_a] ? -1 : 1;
+        }
+        return codec_quality_cmp(s->in, codec_a, codec_b);
+}
+
+struct chain_cache_item {
+        codec_t in;
+        codec_t out_candidates[VIDEO_CODEC_COUNT + 1];
+        codec_t out;
+        struct decoder_chain chain;
+};
+
+static bool codec_sets_equal(const codec_t *a, const codec_t *b)
+{
+        while (*a != VIDEO_CODEC_NONE && *a == *b) {
+                a++;
+                b++;
+        }
+        return *a == *b;
+}
+
+static bool get_best_decoder_chain_from_uncached(codec_t in, const codec_t *out_candidates, codec_t *out, struct decoder_chain *chain)
+{
+        struct chain_search *s = calloc(1, sizeof *s);
+        s->in = in;
+        s->allow_multi_hop = !(get_commandline_param("decoder-chain") != NULL &&
+                        strcmp(get_commandline_param("decoder-chain"), "no") == 0);
+        for (int i = 0; i < VIDEO_CODEC_COUNT; ++i) {
+                s->cost[i] = INFINITY;
+        }
+        chain_search_dfs(s, 0, in, 0, true);
+        if (get_decoder_from_to_internal(in, in, false) != NULL) { // RGB[A] shift change
+                s->best[in] = (struct decoder_chain) { 1, { get_decoder_from_to_internal(in, in, false) }, { in, in } };
+                s->fast[in] = true;
+        }
+
+        codec_t candidates[VIDEO_CODEC_END];
+        size_t count = 0;
+        for (const codec_t *it = out_candidates; *it != VIDEO_CODEC_NONE && count < VIDEO_CODEC_END; ++it) {
+                if (s->best[*it].hops > 0) {
+                        candidates[count++] = *it;
+                }
+        }
+        bool ret = count > 0;
+        if (ret) {
+                qsort_s(candidates, count, sizeof(codec_t), best_chain_cmp, s);
+                *out = candidates[0];
+                *chain = s->best[*out];
+                if (chain->hops > 1) {
+                        char desc[128] = "";
+                        for (int i = 0; i <= chain->hops; ++i) {
+                                snprintf(desc + strlen(desc), sizeof desc - strlen(desc), "%s%s", i > 0 ? "->" : "", get_codec_name(chain->codec[i]));
+                        }
+                        log_msg(LOG_LEVEL_VERBOSE, "Using line conversion chain %s (%.3f ns/px)\n", desc, s->cost[*out]);
+                }
+        }
+        free(s);
+        return ret;
+}
+
+/**
+ * Finds best conversion from in to one of out_candidates. Unlike
+ * get_best_decoder_from(), it considers also conversions in multiple steps
+ * where it is faster than the direct one (or if there is no direct one). Edges
+ * are weighted by the measured cost of the line decoders.
+ *
+ * Results are cached per (in, out_candidates).
+ *
+ * @param[out] chain  conversion to be run with decoder_chain_decode()
+ * @returns           false if there is no conversion
+ */
+bool get_best_decoder_chain_from(codec_t in, const codec_t *out_candidates, codec_t *out, struct decoder_chain *chain)
+{
+        if (codec_is_in_set(in, out_candidates) && (in != RGBA && in != RGB)) { // vc_copylineRGB[A] may change shift
+                *out = in;
+                chain->hops = 1;
+                chain->dec[0] = vc_memcpy;
+                chain->codec[0] = chain->codec[1] = in;
+                return true;
+        }
+
+        static struct chain_cache_item cache[CHAIN_CACHE_SIZE];
+        static int cache_count;
+        size_t set_len = 0;
+        while (out_candidates[set_len] != VIDEO_CODEC_NONE) {
+                set_len++;
+        }
+        pthread_mutex_lock(&decoder_chain_lock);
+        if (set_len > VIDEO_CODEC_COUNT) { // duplicities, do not cache
+                bool ret = get_best_decoder_chain_from_uncached(in, out_candidates, out, chain);
+                pthread_mutex_unlock(&decoder_chain_lock);
+                return ret;
+        }
+        for (int i = 0; i < cache_count; ++i) {
+                if (cache[i].in == in && codec_sets_equal(cache[i].out_candidates, out_candidates)) {
+                        *out = cache[i].out;
+                        *chain = cache[i].chain;
+                        pthread_mutex_unlock(&decoder_chain_lock);
+                        return chain->hops > 0;
+                }
+        }
+        struct chain_cache_item *item = &cache[cache_count < CHAIN_CACHE_SIZE ? cache_count++ : CHAIN_CACHE_SIZE - 1];
+        item->in = in;
+        memcpy(item->out_candidates, out_candidates, (set_len + 1) * sizeof out_candidates[0]);
+        item->chain.hops = 0;
+        item->out = VIDEO_CODEC_NONE;
+        get_best_decoder_chain_from_uncached(in, out_candidates, &item->out, &item->chain);
+        *out = item->out;
+        *chain = item->chain;
+        pthread_mutex_unlock(&decoder_chain_lock);
+        return chain->hops > 0;
+}
+
+/**
+ * Runs the conversion chain obtained from get_best_decoder_chain_from().
+ * Parameters are the same as for decoder_t, the intermediate results are kept
+ * in small chunks on stack so that they stay in cache.
+ */
+void decoder_chain_decode(const struct decoder_chain *chain, unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift, int gshift, int bshift)
+{
+        if (chain->hops == 1) {
+                chain->dec[0](dst, src, dst_len, rshift, gshift, bshift);
+                return;
+        }
+        uint64_t tmp[2][CHAIN_CHUNK_PX * CHAIN_MAX_INTERMEDIATE_BPP / sizeof(uint64_t)];
+        const codec_t in = chain->codec[0];
+        const codec_t out = chain->codec[chain->hops];
+        int pixels = dst_len / get_pf_block_bytes(out) * get_pf_block_pixels(out);
+        while (pixels > 0) {
+                int chunk = MIN(pixels, CHAIN_CHUNK_PX);
+                int out_len = MIN(vc_get_linesize(chunk, out), dst_len);
+                const unsigned char *hop_src = src;
+                for (int i = 0; i < chain->hops; ++i) {
+                        bool last = i == chain->hops - 1;
+                        unsigned char *hop_dst = last ? dst : (unsigned char *) tmp[i % 2];
+                        int hop_len = last ? out_len : vc_get_linesize(chunk, chain->codec[i + 1]);
+                        chain->dec[i](hop_dst, hop_src, hop_len,
+                                        last ? rshift : DEFAULT_R_SHIFT,
+                                        last ? gshift : DEFAULT_G_SHIFT,
+                                        last ? bshift : DEFAULT_B_SHIFT);
+                        hop_src = hop_dst;
+                }
+                src += vc_get_linesize(chunk, in);
+                dst += out_len;
+                dst_len -= out_len;
+                pixels -= chunk;
+        }
+}
+
 /**
  * Tries to find specified codec in set of video codecs.
  * The set must by ended by VIDEO_CODEC_NONE.
@@ -3029,6 +3783,11 @@ bool clear_video_buffer(unsigned char *data, size_t linesize, size_t pitch, size
                 case HW_VDPAU:
                         memset(data, 0,sizeof(hw_vdpau_frame));
                         return true;
+#endif
+#ifdef HWACC_VAAPI
+                case HW_VAAPI:
+                        memset(data, 0, sizeof(hw_vaapi_frame));
+                        return true;
 #endif
                 default:
                         return false;
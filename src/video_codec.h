@@ -108,6 +108,17 @@ decoder_t        get_decoder_from_to(codec_t in, codec_t out) ATTRIBUTE(const);
 decoder_t        get_best_decoder_from(codec_t in, const codec_t *out_candidates, codec_t *out, bool include_slow);
 decoder_t        get_fastest_decoder_from(codec_t in, const codec_t *out_candidates, codec_t *out);
 
+#define DECODER_CHAIN_MAX_HOPS 3
+/// sequence of line decoders converting in multiple steps, see get_best_decoder_chain_from()
+struct decoder_chain {
+        int hops;                                  ///< number of steps, 0 if there is no conversion
+        decoder_t dec[DECODER_CHAIN_MAX_HOPS];
+        codec_t codec[DECODER_CHAIN_MAX_HOPS + 1]; ///< codec[0] is input, codec[hops] output
+};
+bool             vc_avx2_enabled(void);
+bool             get_best_decoder_chain_from(codec_t in, const codec_t *out_candidates, codec_t *out, struct decoder_chain *chain);
+void             decoder_chain_decode(const struct decoder_chain *chain, unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift, int gshift, int bshift);
+
 int get_pf_block_bytes(codec_t codec) ATTRIBUTE(const);
 int get_pf_block_pixels(codec_t codec) ATTRIBUTE(const);
 int vc_get_linesize(unsigned int width, codec_t codec) ATTRIBUTE(const);
@@ -119,6 +130,7 @@ bool codec_is_a_rgb(codec_t codec) ATTRIBUTE(const);
 bool codec_is_in_set(codec_t codec, const codec_t *set) ATTRIBUTE(pure);
 bool codec_is_const_size(codec_t codec) ATTRIBUTE(const);
 bool codec_is_hw_accelerated(codec_t codec) ATTRIBUTE(const);
+bool codec_is_gpu_resident(codec_t codec) ATTRIBUTE(const);
 bool codec_is_planar(codec_t codec) ATTRIBUTE(const);
 
 void vc_deinterlace(unsigned char *src, long src_linesize, int lines);
@@ -43,7 +43,9 @@
 #include "config_win32.h"
 #endif // HAVE_CONFIG_H
 
+#include <chrono>
 #include <cinttypes>
+#include <future>
 #include <memory>
 #include <stdio.h>
 #include <string>
@@ -52,8 +54,13 @@
 #include <vector>
 
 #include "compat/platform_time.h"
+#include "host.h"
 #include "messaging.h"
 #include "module.h"
+#include "utils/frame_trace.h"
+#include "utils/lockfree_queue.hpp"
+#include "utils/metrics.h"
+#include "utils/profile_timer.hpp"
 #include "utils/synchronized_queue.h"
 #include "utils/thread.h"
 #include "utils/vf_split.h"
@@ -64,12 +71,27 @@
 #include "debug.h"
 
 static constexpr const char *MOD_NAME = "[vcompress] ";
+static constexpr const char *FRAME_THREADS_PARAM = "compress-frame-threads";
 
 using namespace std;
 
 struct compress_state;
 
 namespace {
+/**
+ * @brief One frame being compressed by a frame-parallel synchronous compress
+ * pipeline (see @ref compress_state_real::pending).
+ */
+struct compress_frame_job {
+        unsigned state_idx;            ///< index of compress driver instance used for this frame
+        struct module *state;          ///< compress driver instance used for this frame
+        shared_ptr<video_frame> frame; ///< uncompressed frame
+        compress_frame_t callback;     ///< frame compress callback
+        uint64_t compress_start;       ///< time when the frame was passed to compress_frame()
+        shared_ptr<video_frame> ret;   ///< OUT - compressed frame, NULL if failed
+        task_result_handle_t handle;   ///< worker task handle
+};
+
 /**
  * @brief This structure represents real internal compress state
  */
@@ -79,6 +101,7 @@ private:
         void          start(struct compress_state *proxy);
         void          async_consumer(struct compress_state *s);
         void          async_tile_consumer(struct compress_state *s);
+        void          frame_parallel_consumer(struct compress_state *s);
         thread        asynch_consumer_thread;
 public:
         static compress_state_real *create(struct module *parent, const char *config_string,
@@ -92,6 +115,10 @@ public:
         vector<struct module *> state;                  ///< driver internal states
         string              compress_options; ///< compress options (for reconfiguration)
         volatile bool       discard_frames;   ///< this class is no longer active
+        /// frames being compressed in parallel by synchronous API driver
+        /// (in submission order), used only if state.size() > 1
+        synchronized_queue<shared_ptr<compress_frame_job>, -1> pending;
+        synchronized_queue<unsigned, -1> idle_states; ///< indices of states not used by any job
 };
 }
 
@@ -104,8 +131,12 @@ public:
 struct compress_state {
         struct module mod;               ///< compress module data
         struct compress_state_real *ptr; ///< pointer to real compress state
-        synchronized_queue<shared_ptr<video_frame>, 1> queue;
+        lockfree_queue<shared_ptr<video_frame>, 1> queue;
         bool poisoned = false;
+        /// compressor being initialized in background, replaces ptr once
+        /// ready (see compress_switch_standby())
+        future<compress_state_real *> standby;
+        thread retire_thread; ///< destroys the replaced compressor
 };
 
 /**
@@ -116,6 +147,8 @@ struct module compress_init_noerr;
 
 static shared_ptr<video_frame> compress_frame_tiles(struct compress_state *proxy,
                 shared_ptr<video_frame> frame);
+static void compress_frame_parallel(struct compress_state *proxy,
+                shared_ptr<video_frame> frame, uint64_t t0);
 static void compress_done(struct module *mod);
 
 /// @brief Displays list of available compressions.
@@ -132,6 +165,8 @@ static void async_poison(struct compress_state_real *s){
                 for(size_t i = 0; i < s->state.size(); i++){
                         s->funcs->compress_tile_async_push_func(s->state[i], {}); // poison
                 }
+        } else if (s->funcs->compress_frame_func && s->state.size() > 1) {
+                s->pending.push({}); // poison
         }
 }
 
@@ -166,28 +201,61 @@ static void compress_process_message(struct compress_state *proxy, struct msg_ch
                 }
 
         } else {
-                struct compress_state_real *new_state;
-                char config[1024];
-                strncpy(config, data->config_string, sizeof(config));
-
-                try {
-                        new_state = compress_state_real::create(&proxy->mod, config, proxy);
-                } catch (int i) {
+                if (proxy->standby.valid()) {
                         free_message((struct message *) data,
-                                        new_response(RESPONSE_INT_SERV_ERR, NULL));
+                                        new_response(RESPONSE_BAD_REQUEST, "Compression change already in progress"));
                         return;
                 }
+                /* The new compression (that may take hundreds of ms to
+                 * initialize) is created in background while the current one
+                 * keeps compressing, compress_frame() switches to it then. */
+                string config(data->config_string, strnlen(data->config_string, sizeof data->config_string));
+                proxy->standby = async(launch::async, [proxy, config]() -> compress_state_real * {
+                        set_thread_name("compress_standby");
+                        try {
+                                return compress_state_real::create(&proxy->mod, config.c_str(), proxy);
+                        } catch (int i) {
+                                return nullptr;
+                        }
+                });
+                r = new_response(RESPONSE_ACCEPTED, NULL);
+        }
+
+        free_message((struct message *) data, r);
+}
 
-                struct compress_state_real *old = proxy->ptr;
+/**
+ * Replaces the active compressor with the standby one if its initialization
+ * has finished. Called at a frame boundary so that the first frame passed to
+ * the new compressor (a keyframe, as it is the first one of the stream) follows
+ * the last one passed to the old compressor. The replaced compressor is
+ * flushed and destroyed in background.
+ */
+static void compress_switch_standby(struct compress_state *proxy)
+{
+        if (!proxy->standby.valid() ||
+                        proxy->standby.wait_for(chrono::seconds(0)) != future_status::ready) {
+                return;
+        }
+        struct compress_state_real *new_state = proxy->standby.get();
+        if (new_state == nullptr) {
+                LOG(LOG_LEVEL_ERROR) << MOD_NAME << "Compression change failed, keeping "
+                        << proxy->ptr->funcs->name << "\n";
+                return;
+        }
+        struct compress_state_real *old = proxy->ptr;
+        old->discard_frames = true;
+        proxy->ptr = new_state;
+        if (proxy->retire_thread.joinable()) {
+                proxy->retire_thread.join();
+        }
+        proxy->retire_thread = thread([old]() {
+                set_thread_name("compress_retire");
                 // let the async processing finish
-                old->discard_frames = true;
                 async_poison(old);
                 delete old;
-                proxy->ptr = new_state;
-                r = new_response(RESPONSE_OK, NULL);
-        }
-
-        free_message((struct message *) data, r);
+        });
+        LOG(LOG_LEVEL_NOTICE) << MOD_NAME << "Switched compression to " << new_state->funcs->name << "\n";
 }
 
 /**
@@ -209,6 +277,7 @@ int compress_init(struct module *parent, const char *config_string, struct compr
         proxy->mod.cls = MODULE_CLASS_COMPRESS;
         proxy->mod.priv_data = proxy;
         proxy->mod.deleter = compress_done;
+        proxy->queue.instrument(&proxy->mod, "output");
 
         try {
                 proxy->ptr = compress_state_real::create(&proxy->mod, config_string, proxy);
@@ -252,6 +321,8 @@ compress_state_real::compress_state_real(struct module *parent, const char *conf
         compress_name = tmp;
         free(tmp);
 
+        pending.instrument(parent, "pending");
+
         auto vci = static_cast<const struct video_compress_info *>(load_library(compress_name.c_str(), LIBRARY_CLASS_VIDEO_COMPRESS, VIDEO_COMPRESS_ABI_VERSION));
         if(!vci) {
                 LOG(LOG_LEVEL_ERROR) << MOD_NAME << "Unknown or unavailable compression: " << config_string << "\n";
@@ -270,6 +341,31 @@ compress_state_real::compress_state_real(struct module *parent, const char *conf
                 if(state[0] == &compress_init_noerr) {
                         throw 1;
                 }
+                int frame_threads = 1;
+                if (get_commandline_param(FRAME_THREADS_PARAM) != nullptr) {
+                        frame_threads = atoi(get_commandline_param(FRAME_THREADS_PARAM));
+                }
+                if (frame_threads > 1 && funcs->compress_frame_func != nullptr) {
+                        LOG(LOG_LEVEL_NOTICE) << MOD_NAME << "Compressing up to " << frame_threads
+                                << " frames in parallel (latency +" << frame_threads - 1 << " frames).\n";
+                        state.resize(frame_threads);
+                        idle_states.push(0);
+                        for (int i = 1; i < frame_threads; ++i) {
+                                state[i] = funcs->init_func(parent, compress_options.c_str());
+                                if (!state[i]) {
+                                        LOG(LOG_LEVEL_ERROR) << MOD_NAME << "Compression initialization failed: " << config_string << "\n";
+                                        state.resize(i);
+                                        for (auto *st : state) {
+                                                module_done(st);
+                                        }
+                                        throw -1;
+                                }
+                                idle_states.push(i);
+                        }
+                } else if (frame_threads > 1) {
+                        LOG(LOG_LEVEL_WARNING) << MOD_NAME << FRAME_THREADS_PARAM
+                                << " is supported only by synchronous frame API compressions, ignoring.\n";
+                }
         } else {
                 throw -1;
         }
@@ -281,6 +377,8 @@ void compress_state_real::start(struct compress_state *proxy)
                 asynch_consumer_thread = thread(&compress_state_real::async_consumer, this, proxy);
         } else if (funcs->compress_tile_async_push_func){
                 asynch_consumer_thread = thread(&compress_state_real::async_tile_consumer, this, proxy);
+        } else if (funcs->compress_frame_func && state.size() > 1) {
+                asynch_consumer_thread = thread(&compress_state_real::frame_parallel_consumer, this, proxy);
         }
 }
 
@@ -340,6 +438,7 @@ void compress_frame(struct compress_state *proxy, shared_ptr<video_frame> frame)
 {
         if (!proxy)
                 abort();
+        PROFILE_FUNC;
 
         uint64_t t0 = time_since_epoch_in_ms();
 
@@ -347,11 +446,14 @@ void compress_frame(struct compress_state *proxy, shared_ptr<video_frame> frame)
         while ((msg = (struct msg_change_compress_data *) check_message(&proxy->mod))) {
                 compress_process_message(proxy, msg);
         }
+        compress_switch_standby(proxy);
 
         struct compress_state_real *s = proxy->ptr;
 
         if (!frame) {
                 proxy->poisoned = true;
+        } else {
+                frame_trace_stamp(&frame->trace, FT_COMPRESS_IN);
         }
 
         if (s->funcs->compress_frame_async_push_func) {
@@ -381,6 +483,8 @@ void compress_frame(struct compress_state *proxy, shared_ptr<video_frame> frame)
                         s->funcs->compress_tile_async_push_func(s->state[i], separate_tiles[i]);
                 }
 
+        } else if (s->funcs->compress_frame_func && s->state.size() > 1) {
+                compress_frame_parallel(proxy, move(frame), t0);
         } else {
                 if (!frame) { // pass poisoned pill
                         proxy->queue.push(shared_ptr<video_frame>());
@@ -404,11 +508,62 @@ void compress_frame(struct compress_state *proxy, shared_ptr<video_frame> frame)
 
                 sync_api_frame->compress_start = t0;
                 sync_api_frame->compress_end = time_since_epoch_in_ms();
+                sync_api_frame->trace = frame->trace;
+                frame_trace_stamp(&sync_api_frame->trace, FT_COMPRESS_OUT);
 
                 proxy->queue.push(sync_api_frame);
         }
 }
 
+/**
+ * @name Frame-parallel Synchronous API Routines
+ * If @ref FRAME_THREADS_PARAM is set, consecutive frames are compressed
+ * concurrently by separate driver instances. This is intended for intra-only
+ * codecs (each frame compressed independently). Compressed frames are passed
+ * to the queue in submission order.
+ * @{
+ */
+static void *compress_frame_job_callback(void *arg) {
+        PROFILE_FUNC;
+        auto *job = (compress_frame_job *) arg;
+
+        job->ret = job->callback(job->state, job->frame);
+        if (job->ret) {
+                job->ret->trace = job->frame->trace;
+        }
+        job->frame = nullptr;
+
+        return job;
+}
+
+/**
+ * Compresses frame with synchronous API driver instance that is currently not
+ * in use. If all instances are busy, waits until one is released by
+ * compress_state_real::frame_parallel_consumer().
+ */
+static void compress_frame_parallel(struct compress_state *proxy,
+                shared_ptr<video_frame> frame, uint64_t t0)
+{
+        struct compress_state_real *s = proxy->ptr;
+
+        if (!frame) {
+                s->pending.push({}); // poison
+                return;
+        }
+
+        auto job = make_shared<compress_frame_job>();
+        job->state_idx = s->idle_states.pop();
+        job->state = s->state[job->state_idx];
+        job->frame = move(frame);
+        job->callback = s->funcs->compress_frame_func;
+        job->compress_start = t0;
+        job->handle = task_run_async(compress_frame_job_callback, job.get());
+        s->pending.push(move(job));
+}
+/**
+ * @}
+ */
+
 /**
  * @name Tile API Routines
  * The worker callbacks here are optimization - all tiles are processed concurrently.
@@ -494,6 +649,11 @@ static shared_ptr<video_frame> compress_frame_tiles(struct compress_state *proxy
  * @}
  */
 
+ADD_TO_PARAM("compress-frame-threads",
+                "* compress-frame-threads=<n>\n"
+                "  Compress up to <n> consecutive frames in parallel with synchronous (frame API)\n"
+                "  compressions, adds up to <n>-1 frames of latency. Use only with intra-only codecs.\n");
+
 /**
  * @brief Video compression cleanup function.
  * @param mod video compress module
@@ -504,12 +664,22 @@ static void compress_done(struct module *mod)
                 return;
 
         struct compress_state *proxy = (struct compress_state *) mod->priv_data;
-        struct compress_state_real *s = proxy->ptr;
+        if (proxy->standby.valid()) { // pending change that was not switched to
+                struct compress_state_real *standby = proxy->standby.get();
+                if (standby != nullptr) {
+                        standby->discard_frames = true;
+                        async_poison(standby);
+                        delete standby;
+                }
+        }
         if (!proxy->poisoned) { // pass poisoned pill if it wasn't
                 compress_frame(proxy, {});
         }
 
-        delete s;
+        delete proxy->ptr;
+        if (proxy->retire_thread.joinable()) {
+                proxy->retire_thread.join();
+        }
         delete proxy;
 }
 
@@ -561,6 +731,7 @@ void compress_state_real::async_tile_consumer(struct compress_state *s)
                         }
 
                         ret->compress_end = time_since_epoch_in_ms();
+                        frame_trace_stamp(&ret->trace, FT_COMPRESS_OUT);
                         compressed_tiles.resize(state.size(), nullptr);
                         compressed_tiles[i] = std::move(ret);
                 }
@@ -576,11 +747,43 @@ void compress_state_real::async_tile_consumer(struct compress_state *s)
         }
 }
 
+/**
+ * Passes frames compressed by compress_frame_parallel() to the queue in the
+ * order they were submitted.
+ */
+void compress_state_real::frame_parallel_consumer(struct compress_state *s)
+{
+        set_thread_name(__func__);
+        while (true) {
+                auto job = pending.pop();
+                if (!job) {
+                        if (!discard_frames) {
+                                s->queue.push(nullptr); // poison
+                        }
+                        return;
+                }
+                wait_task(job->handle);
+                idle_states.push(job->state_idx);
+
+                // empty return value means error, don't pass it (would be a poison pill)
+                if (!job->ret || discard_frames) {
+                        continue;
+                }
+                job->ret->compress_start = job->compress_start;
+                job->ret->compress_end = time_since_epoch_in_ms();
+                frame_trace_stamp(&job->ret->trace, FT_COMPRESS_OUT);
+                s->queue.push(move(job->ret));
+        }
+}
+
 void compress_state_real::async_consumer(struct compress_state *s)
 {
         set_thread_name(__func__);
         while (true) {
                 auto frame = funcs->compress_frame_async_pop_func(state[0]);
+                if (frame) { // trace is passed only if the driver copies the metadata
+                        frame_trace_stamp(&frame->trace, FT_COMPRESS_OUT);
+                }
                 if (!discard_frames) {
                         s->queue.push(frame);
 
@@ -607,6 +810,13 @@ shared_ptr<video_frame> compress_pop(struct compress_state *proxy)
 
         auto f = proxy->queue.pop();
         if (f) {
+                static struct metric *frames = metric_counter("ug_compress_frames", "Video frames compressed", nullptr);
+                static struct metric *bytes = metric_counter("ug_compress_output_bytes", "Compressed video data size", nullptr);
+                static struct metric *duration = metric_histogram("ug_compress_duration_ms",
+                                "Video compression duration (ms)", nullptr, nullptr, 0);
+                metric_add(frames, 1);
+                metric_add(bytes, vf_get_data_len(f.get()));
+                metric_observe(duration, f->compress_end - f->compress_start);
                 log_msg(LOG_LEVEL_DEBUG, "Compressed frame size: %8u; duration: %3" PRIu64 " ms\n", vf_get_data_len(f.get()), f->compress_end - f->compress_start);
         }
         return f;
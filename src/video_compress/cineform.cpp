@@ -58,6 +58,9 @@
 
 #include "video.h"
 #include "video_codec.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <memory>
 #include <map>
 #include <mutex>
@@ -72,8 +75,13 @@
 #include "utils/misc.h" // to_fourcc
 
 #define DEFAULT_POOL_SIZE 16
-#define DEFAULT_THREAD_COUNT 8
 #define MOD_NAME "[cineform] "
+#define MIN_IN_FLIGHT 2
+
+struct queued_frame {
+        std::unique_ptr<video_frame, decltype(&vf_free)> frame;
+        std::chrono::steady_clock::time_point pushed;
+};
 
 struct state_video_compress_cineform{
         struct module module_data;
@@ -96,11 +104,16 @@ struct state_video_compress_cineform{
         uint32_t frame_seq_in;
         uint32_t frame_seq_out;
 
-        std::queue<std::unique_ptr<video_frame, decltype(&vf_free)>> frame_queue;
+        std::queue<queued_frame> frame_queue; ///< frames submitted to the pool, not yet popped
+
+        double avg_encode_time; ///< [s] moving average of push-to-pop time
+        size_t max_in_flight;   ///< frame_queue limit derived from avg_encode_time
+        bool pool_size_warned;
 
         bool started;
         bool stop;
         std::condition_variable cv;
+        std::condition_variable frame_popped_cv;
 
 #ifdef MEASUREMENT
         std::map<uint32_t, struct timespec> times_map;
@@ -127,8 +140,8 @@ struct {
         const char *opt_str;
 } usage_opts[] = {
         {"Quality", "quality", "specifies encode quality, range 1-6 (default: 4)", ":quality="},
-        {"Threads", "num_threads", "specifies number of threads for encoding (default: " TOSTRING(DEFAULT_THREAD_COUNT) ")", ":num_threads="},
-        {"Pool size", "pool_size", "specifies the size of encoding pool (default: " TOSTRING(DEFAULT_POOL_SIZE) ")", ":pool_size="},
+        {"Threads", "num_threads", "specifies number of threads for encoding (default: number of CPU cores)", ":num_threads="},
+        {"Pool size", "pool_size", "specifies the size of encoding pool, maximal number of frames in flight (default: " TOSTRING(DEFAULT_POOL_SIZE) ")", ":pool_size="},
 };
 
 static void usage() {
@@ -138,6 +151,7 @@ static void usage() {
         for(const auto& opt : usage_opts){
                 printf("\t\t<%s> %s\n", opt.key, opt.description);
         }
+        printf("\nNumber of frames actually in flight is adjusted to cover the measured encode time.\n");
 }
 
 static int parse_fmt(struct state_video_compress_cineform *s, char *fmt) {
@@ -182,7 +196,7 @@ static struct module * cineform_compress_init(struct module *parent, const char
 
         memset(&s->saved_desc, 0, sizeof(s->saved_desc));
         s->requested_quality = CFHD_ENCODING_QUALITY_DEFAULT;
-        s->requested_threads = DEFAULT_THREAD_COUNT;
+        s->requested_threads = get_cpu_core_count();
         s->requested_pool_size = DEFAULT_POOL_SIZE;
 
         char *fmt = strdup(opts);
@@ -196,7 +210,12 @@ static struct module * cineform_compress_init(struct module *parent, const char
                         return nullptr;
         }
 
-        log_msg(LOG_LEVEL_NOTICE, "[cineform] : Threads: %d.\n", s->requested_threads);
+        if (s->requested_threads <= 0 || s->requested_pool_size <= 0) {
+                log_msg(LOG_LEVEL_ERROR, "[cineform] Error: Thread count and pool size must be positive.\n");
+                delete s;
+                return nullptr;
+        }
+        log_msg(LOG_LEVEL_NOTICE, "[cineform] : Threads: %d, pool size: %d.\n", s->requested_threads, s->requested_pool_size);
         CFHD_Error status = CFHD_ERROR_OKAY;
         status = CFHD_CreateEncoderPool(&s->encoderPoolRef,
                         s->requested_threads,
@@ -217,6 +236,9 @@ static struct module * cineform_compress_init(struct module *parent, const char
 
         s->frame_seq_in = 0;
         s->frame_seq_out = 0;
+        s->avg_encode_time = 0.0;
+        s->max_in_flight = s->requested_pool_size;
+        s->pool_size_warned = false;
         s->started = false;
         s->stop = false;
 
@@ -372,7 +394,7 @@ static void cineform_compress_push(struct module *state, std::shared_ptr<video_f
 
                 lock.lock();
                 s->stop = true;
-                s->frame_queue.push(std::move(dummy));
+                s->frame_queue.push({std::move(dummy), std::chrono::steady_clock::now()});
                 lock.unlock();
 
                 status = CFHD_EncodeAsyncSample(s->encoderPoolRef,
@@ -402,7 +424,9 @@ static void cineform_compress_push(struct module *state, std::shared_ptr<video_f
         video_frame *frame_ptr = frame_copy.get();
 
         lock.lock();
-        s->frame_queue.push(std::move(frame_copy));
+        // more frames in flight would only add latency
+        s->frame_popped_cv.wait(lock, [s]{ return s->frame_queue.size() < s->max_in_flight; });
+        s->frame_queue.push({std::move(frame_copy), std::chrono::steady_clock::now()});
 
 #ifdef MEASUREMENT
         struct timespec t_0;
@@ -439,6 +463,30 @@ static void timespec_diff(struct timespec *start, struct timespec *stop,
 }
 #endif
 
+/**
+ * Sets the number of frames in flight to cover the encode time at the
+ * current frame rate (Little's law) plus one frame being pushed.
+ * @param encode_time [s] push-to-pop time of the last frame
+ */
+static void update_in_flight(struct state_video_compress_cineform *s, double encode_time)
+{
+        s->avg_encode_time = s->avg_encode_time == 0.0 ? encode_time
+                : 0.9 * s->avg_encode_time + 0.1 * encode_time;
+        size_t needed = ceil(s->avg_encode_time * s->saved_desc.fps) + 1;
+        if (needed > (size_t) s->requested_pool_size && !s->pool_size_warned) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Encoding takes %.1f ms, %zu frames in flight needed "
+                                "but pool size is %d, consider increasing pool_size or threads.\n",
+                                s->avg_encode_time * 1000.0, needed, s->requested_pool_size);
+                s->pool_size_warned = true;
+        }
+        size_t max_in_flight = std::min<size_t>(std::max<size_t>(needed, MIN_IN_FLIGHT), s->requested_pool_size);
+        if (max_in_flight != s->max_in_flight) {
+                log_msg(LOG_LEVEL_DEBUG, MOD_NAME "Encode time %.1f ms, frames in flight: %zu\n",
+                                s->avg_encode_time * 1000.0, max_in_flight);
+                s->max_in_flight = max_in_flight;
+        }
+}
+
 static std::shared_ptr<video_frame> cineform_compress_pop(struct module *state)
 {
         struct state_video_compress_cineform *s = (struct state_video_compress_cineform *) state->priv_data;
@@ -506,9 +554,12 @@ static std::shared_ptr<video_frame> cineform_compress_pop(struct module *state)
                 log_msg(LOG_LEVEL_ERROR, "[cineform] Failed to pop\n");
         } else {
                 auto &src = s->frame_queue.front();
-                vf_copy_metadata(out.get(), src.get());
+                vf_copy_metadata(out.get(), src.frame.get());
+                update_in_flight(s, std::chrono::duration<double>(std::chrono::steady_clock::now() - src.pushed).count());
+                s->frame_queue.pop();
         }
-        s->frame_queue.pop();
+        lock.unlock();
+        s->frame_popped_cv.notify_one();
 
         out->compress_end = time_since_epoch_in_ms();
 
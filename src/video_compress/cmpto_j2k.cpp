@@ -42,6 +42,12 @@
  * the GPU is powerful enough due to the fact that CUDA registers the new
  * buffers which is very slow and because of that the frames cumulate before
  * the GPU encoder.
+ *
+ * If a latency bound is given (latency option), the number of frames in
+ * flight is not fixed but driven by the measured push-to-pop time - it grows
+ * while the encoder input is saturated and the latency is within bounds and
+ * shrinks when the bound is exceeded. The depth is kept at least equal to the
+ * number of CUDA devices so that the codec can keep all of them busy.
  */
 
 #ifdef HAVE_CONFIG_H
@@ -62,10 +68,13 @@
 
 #include <cmpto_j2k_enc.h>
 
+#include <chrono>
+#include <cmath>
 #include <condition_variable>
 #include <mutex>
 #include <queue>
 #include <utility>
+#include <vector>
 
 constexpr const char *MOD_NAME = "[Cmpto J2K enc.] ";
 
@@ -86,12 +95,14 @@ constexpr const char *MOD_NAME = "[Cmpto J2K enc.] ";
 /// number of frames that encoder encodes at moment
 #define DEFAULT_TILE_LIMIT 1
 #define DEFAULT_MEM_LIMIT 1000000000LLU
+/// weight of a new sample in the push-to-pop latency moving average
+#define LATENCY_EWMA_ALPHA 0.1
 
 using namespace std;
 
 struct state_video_compress_j2k {
         state_video_compress_j2k(long long int bitrate, unsigned int pool_size, int mct)
-                : rate{bitrate}, mct(mct), pool{pool_size}, max_in_frames{pool_size} {}
+                : rate{bitrate}, mct(mct), pool{pool_size, *frame_pool_allocator_for("compress")}, pool_size(pool_size), max_in_frames{pool_size} {}
         struct module module_data{};
 
         struct cmpto_j2k_enc_ctx *context{};
@@ -99,8 +110,13 @@ struct state_video_compress_j2k {
         long long int rate; ///< bitrate in bits per second
         int mct; // force use of mct - -1 means default
         video_frame_pool pool; ///< pool for frames allocated by us but not yet consumed by encoder
+        unsigned int pool_size; ///< max frames in pool, upper bound for max_in_frames
         unsigned int max_in_frames; ///< max number of frames between push and pop
         unsigned int in_frames{};   ///< number of currently encoding frames
+        unsigned int min_in_frames{1}; ///< lower bound for max_in_frames when adapting
+        double max_latency{};       ///< latency bound for adaptation (sec), 0 - fixed max_in_frames
+        double latency_avg{};       ///< moving average of push-to-pop time (sec)
+        bool input_saturated{};     ///< push waited for in_frames < max_in_frames
         mutex lock;
         condition_variable frame_popped;
         video_desc saved_desc{}; ///< for pool reconfiguration
@@ -109,6 +125,15 @@ struct state_video_compress_j2k {
         void (*convertFunc)(video_frame *dst, video_frame *src){nullptr};
 };
 
+/**
+ * Data attached to every encoded image (cmpto_j2k_enc_img_allocate_custom_data)
+ */
+struct j2k_custom_data {
+        struct video_desc desc;      ///< to be able to reconstruct in j2k_compress_pop()
+        shared_ptr<video_frame> frame; ///< released in release_cstream()
+        chrono::steady_clock::time_point pushed;
+};
+
 static void j2k_compressed_frame_dispose(struct video_frame *frame);
 static void j2k_compress_done(struct module *mod);
 
@@ -204,6 +229,31 @@ static shared_ptr<video_frame> get_copy(struct state_video_compress_j2k *s, vide
         return ret;
 }
 
+/**
+ * Updates the latency average with a frame that has just been popped and
+ * adjusts state_video_compress_j2k::max_in_frames.
+ */
+static void adapt_in_frames(struct state_video_compress_j2k *s, double latency)
+{
+        unique_lock<mutex> lk(s->lock);
+        s->latency_avg = s->latency_avg == 0.0 ? latency
+                : LATENCY_EWMA_ALPHA * latency + (1.0 - LATENCY_EWMA_ALPHA) * s->latency_avg;
+        unsigned int old = s->max_in_frames;
+        if (s->latency_avg > s->max_latency && s->max_in_frames > s->min_in_frames) {
+                s->max_in_frames -= 1;
+                s->latency_avg *= (double) s->max_in_frames / old; // expect proportionally less queueing
+        } else if (s->input_saturated && s->latency_avg < 0.75 * s->max_latency
+                        && s->max_in_frames < s->pool_size) {
+                s->max_in_frames += 1;
+        }
+        s->input_saturated = false;
+        if (old != s->max_in_frames) {
+                LOG(LOG_LEVEL_VERBOSE) << MOD_NAME << "Frames in flight: " << s->max_in_frames
+                        << " (latency " << lround(s->latency_avg * 1000) << " ms)\n";
+                s->frame_popped.notify_one();
+        }
+}
+
 /**
  * @fn j2k_compress_pop
  * @note
@@ -225,6 +275,13 @@ start:
                                 1,
                                 &img /* Set to NULL if encoder stopped */,
                                 &status), "Encode image", HANDLE_ERROR_COMPRESS_POP);
+        if (img && s->max_latency > 0.0) {
+                struct j2k_custom_data *udata;
+                size_t len;
+                if (cmpto_j2k_enc_img_get_custom_data(img, (void **) &udata, &len) == CMPTO_OK) {
+                        adapt_in_frames(s, chrono::duration<double>(chrono::steady_clock::now() - udata->pushed).count());
+                }
+        }
         {
                 unique_lock<mutex> lk(s->lock);
                 s->in_frames--;
@@ -242,16 +299,16 @@ start:
                 log_msg(LOG_LEVEL_ERROR, "Image encoding failed: %s\n", encoding_error);
                 goto start;
         }
-        struct video_desc *desc;
+        struct j2k_custom_data *udata;
         size_t len;
-        CHECK_OK(cmpto_j2k_enc_img_get_custom_data(img, (void **) &desc, &len),
+        CHECK_OK(cmpto_j2k_enc_img_get_custom_data(img, (void **) &udata, &len),
                         "get custom data", HANDLE_ERROR_COMPRESS_POP);
         size_t size;
         void * ptr;
         CHECK_OK(cmpto_j2k_enc_img_get_cstream(img, &ptr, &size),
                         "get cstream", HANDLE_ERROR_COMPRESS_POP);
 
-        struct video_frame *out = vf_alloc_desc(*desc);
+        struct video_frame *out = vf_alloc_desc(udata->desc);
         out->tiles[0].data_len = size;
         out->tiles[0].data = (char *) malloc(size);
         memcpy(out->tiles[0].data, ptr, size);
@@ -273,6 +330,8 @@ struct {
         {"Tile limit", "tile_limit", "Number of tiles encoded at moment (less to reduce latency, more to increase performance, 0 means infinity), default: " TOSTRING(DEFAULT_TILE_LIMIT), ":tile_limit=", false},
         {"Pool size", "pool_size", "Total number of tiles encoder can hold at moment (same meaning as above), default: " TOSTRING(DEFAULT_POOL_SIZE) ", should be greater than <t>", ":pool_size=", false},
         {"Use MCT", "mct", "use MCT", ":mct", true},
+        {"Devices", "devices", "CUDA devices to encode with (comma separated), default: those given by --cuda-device", ":devices=", false},
+        {"Max latency", "latency", "adapt number of frames in flight (up to <p>) to keep encoding latency below given value in ms, default: fixed <p>", ":latency=", false},
 };
 
 static void usage() {
@@ -316,6 +375,8 @@ static struct module * j2k_compress_init(struct module *parent, const char *c_cf
         long long int mem_limit = DEFAULT_MEM_LIMIT;
         unsigned int tile_limit = DEFAULT_TILE_LIMIT;
         unsigned int pool_size = DEFAULT_POOL_SIZE;
+        unsigned int max_latency_ms = 0;
+        vector<unsigned int> devices(cuda_devices, cuda_devices + cuda_devices_count);
 
         const auto *version = cmpto_j2k_enc_get_version();
         LOG(LOG_LEVEL_INFO) << MOD_NAME << "Using codec version: " << (version == nullptr ? "(unknown)" : version->name) << "\n";
@@ -337,6 +398,22 @@ static struct module * j2k_compress_init(struct module *parent, const char *c_cf
                         ASSIGN_CHECK_VAL(tile_limit, strchr(item, '=') + 1, 0);
                 } else if (strncasecmp("pool_size=", item, strlen("pool_size=")) == 0) {
                         ASSIGN_CHECK_VAL(pool_size, strchr(item, '=') + 1, 1);
+                } else if (strncasecmp("latency=", item, strlen("latency=")) == 0) {
+                        ASSIGN_CHECK_VAL(max_latency_ms, strchr(item, '=') + 1, 1);
+                } else if (strncasecmp("devices=", item, strlen("devices=")) == 0) {
+                        devices.clear();
+                        char *dev_save_ptr = nullptr;
+                        char *dev = strchr(item, '=') + 1;
+                        while ((dev = strtok_r(dev, ",", &dev_save_ptr)) != nullptr) {
+                                unsigned int dev_idx = 0;
+                                ASSIGN_CHECK_VAL(dev_idx, dev, 0);
+                                devices.push_back(dev_idx);
+                                dev = nullptr;
+                        }
+                        if (devices.empty()) {
+                                LOG(LOG_LEVEL_ERROR) << MOD_NAME << "Empty device list!\n";
+                                return nullptr;
+                        }
                 } else if (strcasecmp("help", item) == 0) {
                         usage();
                         return &compress_init_noerr;
@@ -352,14 +429,19 @@ static struct module * j2k_compress_init(struct module *parent, const char *c_cf
         }
 
         auto *s = new state_video_compress_j2k(bitrate, pool_size, mct);
+        if (max_latency_ms > 0) {
+                s->max_latency = max_latency_ms / 1000.0;
+                s->min_in_frames = min<unsigned int>(devices.size(), pool_size);
+        }
 
         struct cmpto_j2k_enc_ctx_cfg *ctx_cfg;
         CHECK_OK(cmpto_j2k_enc_ctx_cfg_create(&ctx_cfg), "Context configuration create",
                         goto error);
-        for (unsigned int i = 0; i < cuda_devices_count; ++i) {
-                CHECK_OK(cmpto_j2k_enc_ctx_cfg_add_cuda_device(ctx_cfg, cuda_devices[i], mem_limit, tile_limit),
+        for (unsigned int dev : devices) {
+                CHECK_OK(cmpto_j2k_enc_ctx_cfg_add_cuda_device(ctx_cfg, dev, mem_limit, tile_limit),
                                 "Setting CUDA device", goto error);
         }
+        LOG(LOG_LEVEL_VERBOSE) << MOD_NAME << "Using " << devices.size() << " CUDA device(s)\n";
 
         CHECK_OK(cmpto_j2k_enc_ctx_create(ctx_cfg, &s->context), "Context create",
                         goto error);
@@ -404,7 +486,7 @@ static void j2k_compressed_frame_dispose(struct video_frame *frame)
 static void release_cstream(void * custom_data, size_t custom_data_size, const void * codestream, size_t codestream_size)
 {
         (void) codestream; (void) custom_data_size; (void) codestream_size;
-        ((shared_ptr<video_frame> *)(void *) ((char *) custom_data + sizeof(struct video_desc)))->~shared_ptr<video_frame>();
+        ((struct j2k_custom_data *) custom_data)->frame.~shared_ptr<video_frame>();
 }
 
 #define HANDLE_ERROR_COMPRESS_PUSH if (img) cmpto_j2k_enc_img_destroy(img); return
@@ -415,7 +497,7 @@ static void j2k_compress_push(struct module *state, std::shared_ptr<video_frame>
         struct cmpto_j2k_enc_img *img = NULL;
         struct video_desc desc;
         void *udata;
-        shared_ptr<video_frame> *ref;
+        struct j2k_custom_data *ref;
 
         if (tx == NULL) { // pass poison pill through encoder
                 CHECK_OK(cmpto_j2k_enc_ctx_stop(s->context), "stop", NOOP);
@@ -445,21 +527,22 @@ static void j2k_compress_push(struct module *state, std::shared_ptr<video_frame>
          */
         CHECK_OK(cmpto_j2k_enc_img_allocate_custom_data(
                                 img,
-                                sizeof(struct video_desc) + sizeof(shared_ptr<video_frame>),
+                                sizeof(struct j2k_custom_data),
                                 &udata),
                         "Allocate custom image data",
                         HANDLE_ERROR_COMPRESS_PUSH);
-        memcpy(udata, &s->compressed_desc, sizeof(s->compressed_desc));
+        ref = new (udata) j2k_custom_data{s->compressed_desc, get_copy(s, tx.get()), {}};
 
-        ref = (shared_ptr<video_frame> *)(void *)((char *) udata + sizeof(struct video_desc));
-        new (ref) shared_ptr<video_frame>(get_copy(s, tx.get()));
-
-        CHECK_OK(cmpto_j2k_enc_img_set_samples(img, ref->get()->tiles[0].data, ref->get()->tiles[0].data_len, release_cstream),
+        CHECK_OK(cmpto_j2k_enc_img_set_samples(img, ref->frame->tiles[0].data, ref->frame->tiles[0].data_len, release_cstream),
                         "Setting image samples", HANDLE_ERROR_COMPRESS_PUSH);
 
         unique_lock<mutex> lk(s->lock);
+        if (s->in_frames >= s->max_in_frames) {
+                s->input_saturated = true;
+        }
         s->frame_popped.wait(lk, [s]{return s->in_frames < s->max_in_frames;});
         lk.unlock();
+        ref->pushed = chrono::steady_clock::now();
         CHECK_OK(cmpto_j2k_enc_img_encode(img, s->enc_settings),
                         "Encode image", return);
         lk.lock();
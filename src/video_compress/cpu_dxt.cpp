@@ -0,0 +1,606 @@
+/**
+ * @file   video_compress/cpu_dxt.cpp
+ *
+ * Multi-threaded CPU DXT1 and DXT5 YCoCg compression producing the same
+ * bitstream as RTDXT (dxt_compress/dxt_encoder.c) for machines without GPU.
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ * 
+ *      This product includes software developed by CESNET z.s.p.o.
+ * 
+ * 4. Neither the name of the CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "debug.h"
+#include "host.h"
+#include "lib_common.h"
+#include "module.h"
+#include "utils/misc.h"
+#include "utils/video_frame_pool.h"
+#include "utils/worker.h"
+#include "video.h"
+#include "video_compress.h"
+
+#define MOD_NAME "[CPU DXT] "
+
+using namespace std;
+
+namespace {
+
+/*
+ * The functions below are a transcription of compress_dxt1_fp.glsl and
+ * compress_dxt5ycocg_fp.glsl - the arithmetic (including the order of
+ * operations and constants) is kept the same as in the shaders so that the
+ * output equals the one of RTDXT. Block pixels are kept as separate 16-element
+ * component arrays so that the per-pixel loops can be vectorized.
+ */
+constexpr float YCOCG_OFFSET = 128.0F / 255.0F;
+
+struct block {
+        float c[3][16]; ///< R, G, B (or Y, Co, Cg for DXT5)
+};
+
+/// GLSL round() - the GL implementations round halfway cases to even
+static inline float glsl_round(float x) {
+        return nearbyintf(x);
+}
+
+static inline float clamp01(float x) {
+        return x < 0.0F ? 0.0F : x > 1.0F ? 1.0F : x;
+}
+
+static float unorm8[256]; ///< texture sampling (value / 255)
+
+static void extract_block_rgb(struct block *b, const unsigned char *in, size_t linesize, int bpp,
+                int x, int y, int width, int height)
+{
+        for (int i = 0; i < 4; ++i) {
+                const unsigned char *line = in + min(y + i, height - 1) * linesize; // GL_CLAMP_TO_EDGE
+                for (int j = 0; j < 4; ++j) {
+                        const unsigned char *px = line + min(x + j, width - 1) * bpp;
+                        b->c[0][i * 4 + j] = unorm8[px[0]];
+                        b->c[1][i * 4 + j] = unorm8[px[1]];
+                        b->c[2][i * 4 + j] = unorm8[px[2]];
+                }
+        }
+}
+
+/// UYVY is upsampled to 4:4:4 by chroma repetition as yuv422_to_yuv444.glsl does
+static void extract_block_yuv(struct block *b, const unsigned char *in, size_t linesize,
+                int x, int y, int width, int height)
+{
+        for (int i = 0; i < 4; ++i) {
+                const unsigned char *line = in + min(y + i, height - 1) * linesize;
+                OPTIMIZED_FOR (int j = 0; j < 4; ++j) {
+                        int col = min(x + j, width - 1);
+                        const unsigned char *macropx = line + col / 2 * 4;
+                        float Y = 1.1643F * (unorm8[macropx[1 + col % 2 * 2]] - 0.0625F);
+                        float U = (unorm8[macropx[0]] - 0.5F);
+                        float V = (unorm8[macropx[2]] - 0.5F);
+
+                        b->c[0][i * 4 + j] = Y + 1.7926F * V;
+                        b->c[1][i * 4 + j] = Y - 0.2132F * U - 0.5328F * V;
+                        b->c[2][i * 4 + j] = Y + 2.1124F * U;
+                }
+        }
+}
+
+static void convert_block_to_ycocg(struct block *b)
+{
+        OPTIMIZED_FOR (int i = 0; i < 16; ++i) {
+                float r = b->c[0][i];
+                float g = b->c[1][i];
+                float bl = b->c[2][i];
+                b->c[0][i] = (r + 2.0F * g + bl) * 0.25F;
+                b->c[1][i] = ((2.0F * r - 2.0F * bl) * 0.25F + YCOCG_OFFSET);
+                b->c[2][i] = ((-r + 2.0F * g - bl) * 0.25F + YCOCG_OFFSET);
+        }
+}
+
+static void find_min_max_colors_box(const struct block *b, float mincol[3], float maxcol[3])
+{
+        for (int k = 0; k < 3; ++k) {
+                mincol[k] = b->c[k][0];
+                maxcol[k] = b->c[k][0];
+                for (int i = 1; i < 16; ++i) {
+                        mincol[k] = min(mincol[k], b->c[k][i]);
+                        maxcol[k] = max(maxcol[k], b->c[k][i]);
+                }
+        }
+}
+
+static void select_diagonal(const struct block *b, float mincol[3], float maxcol[3])
+{
+        float center[3];
+        for (int k = 0; k < 3; ++k) {
+                center[k] = (mincol[k] + maxcol[k]) * 0.5F;
+        }
+        float cov_x = 0.0F;
+        float cov_y = 0.0F;
+        for (int i = 0; i < 16; ++i) {
+                float tz = b->c[2][i] - center[2];
+                cov_x += (b->c[0][i] - center[0]) * tz;
+                cov_y += (b->c[1][i] - center[1]) * tz;
+        }
+        if (cov_x < 0.0F) {
+                swap(mincol[0], maxcol[0]);
+        }
+        if (cov_y < 0.0F) {
+                swap(mincol[1], maxcol[1]);
+        }
+}
+
+static void inset_bbox(float *mincol, float *maxcol, int count, float div)
+{
+        for (int k = 0; k < count; ++k) {
+                float inset = (maxcol[k] - mincol[k]) / div - (div / 2.0F / 255.0F) / div;
+                mincol[k] = clamp01(mincol[k] + inset);
+                maxcol[k] = clamp01(maxcol[k] - inset);
+        }
+}
+
+static uint32_t round_and_expand(float v[3])
+{
+        const float scale[3] = { 31.0F, 63.0F, 31.0F };
+        uint32_t c[3];
+        for (int k = 0; k < 3; ++k) {
+                c[k] = glsl_round(v[k] * scale[k]);
+        }
+        uint32_t w = (c[0] << 11U) | (c[1] << 5U) | c[2];
+        c[0] = (c[0] << 3U) | (c[0] >> 2U);
+        c[1] = (c[1] << 2U) | (c[1] >> 4U);
+        c[2] = (c[2] << 3U) | (c[2] >> 2U);
+        for (int k = 0; k < 3; ++k) {
+                v[k] = c[k] * (1.0F / 255.0F);
+        }
+        return w;
+}
+
+static uint32_t emit_end_points_dxt1(float mincol[3], float maxcol[3])
+{
+        uint32_t x = round_and_expand(maxcol);
+        uint32_t y = round_and_expand(mincol);
+        if (x < y) { // alternate diagonal
+                for (int k = 0; k < 3; ++k) {
+                        swap(mincol[k], maxcol[k]);
+                }
+                return y | (x << 16U);
+        }
+        return x | (y << 16U);
+}
+
+static inline float mix(float x, float y, float a) {
+        return x * (1.0F - a) + y * a;
+}
+
+/**
+ * @param comp      first component index
+ * @param ncomp     number of components
+ */
+static uint32_t emit_indices(const struct block *b, int comp, int ncomp, const float *mincol, const float *maxcol)
+{
+        float pal[4][3];
+        for (int k = 0; k < ncomp; ++k) {
+                pal[0][k] = maxcol[k];
+                pal[1][k] = mincol[k];
+                pal[2][k] = mix(pal[0][k], pal[1][k], 1.0F / 3.0F);
+                pal[3][k] = mix(pal[0][k], pal[1][k], 2.0F / 3.0F);
+        }
+
+        float dist[4][16];
+        for (int p = 0; p < 4; ++p) {
+                OPTIMIZED_FOR (int i = 0; i < 16; ++i) {
+                        float d = b->c[comp][i] - pal[p][0];
+                        float sum = d * d;
+                        for (int k = 1; k < ncomp; ++k) {
+                                d = b->c[comp + k][i] - pal[p][k];
+                                sum += d * d;
+                        }
+                        dist[p][i] = sum;
+                }
+        }
+
+        uint32_t indices = 0;
+        for (int i = 0; i < 16; ++i) {
+                uint32_t bx = dist[0][i] > dist[3][i] ? 1U : 0U;
+                uint32_t by = dist[1][i] > dist[2][i] ? 1U : 0U;
+                uint32_t bz = dist[0][i] > dist[2][i] ? 1U : 0U;
+                uint32_t bw = dist[1][i] > dist[3][i] ? 1U : 0U;
+                uint32_t b4 = dist[2][i] > dist[3][i] ? 1U : 0U;
+                uint32_t index = (bx & b4) | (((by & bz) | (bx & bw)) << 1U);
+                indices |= index << (i * 2U);
+        }
+        return indices;
+}
+
+static void store_le32(unsigned char *out, uint32_t val)
+{
+        out[0] = val & 0xFFU;
+        out[1] = (val >> 8U) & 0xFFU;
+        out[2] = (val >> 16U) & 0xFFU;
+        out[3] = val >> 24U;
+}
+
+static void compress_block_dxt1(struct block *b, unsigned char *out)
+{
+        float mincol[3];
+        float maxcol[3];
+        find_min_max_colors_box(b, mincol, maxcol);
+        select_diagonal(b, mincol, maxcol);
+        inset_bbox(mincol, maxcol, 3, 16.0F);
+
+        store_le32(out, emit_end_points_dxt1(mincol, maxcol));
+        store_le32(out + 4, emit_indices(b, 0, 3, mincol, maxcol));
+}
+
+static void select_ycocg_diagonal(const struct block *b, float mincol[2], float maxcol[2])
+{
+        float mid[2] = { (maxcol[0] + mincol[0]) * 0.5F, (maxcol[1] + mincol[1]) * 0.5F };
+        float cov = 0.0F;
+        for (int i = 0; i < 16; ++i) {
+                cov += (b->c[1][i] - mid[0]) * (b->c[2][i] - mid[1]);
+        }
+        if (cov < 0.0F) {
+                swap(mincol[1], maxcol[1]);
+        }
+}
+
+static uint32_t scale_ycocg(const float mincol[2], const float maxcol[2])
+{
+        float m = max(max(fabsf(mincol[0] - YCOCG_OFFSET), fabsf(mincol[1] - YCOCG_OFFSET)),
+                        max(fabsf(maxcol[0] - YCOCG_OFFSET), fabsf(maxcol[1] - YCOCG_OFFSET)));
+        uint32_t scale = 1;
+        if (m < 64.0F / 255.0F) {
+                scale = 2;
+        }
+        if (m < 32.0F / 255.0F) {
+                scale = 4;
+        }
+        return scale;
+}
+
+static uint32_t emit_end_points_ycocg_dxt5(float mincol[2], float maxcol[2], uint32_t scale)
+{
+        for (int k = 0; k < 2; ++k) {
+                maxcol[k] = (maxcol[k] - YCOCG_OFFSET) * (float) scale + YCOCG_OFFSET;
+                mincol[k] = (mincol[k] - YCOCG_OFFSET) * (float) scale + YCOCG_OFFSET;
+        }
+        inset_bbox(mincol, maxcol, 2, 16.0F);
+
+        const float mul[2] = { 31.0F, 63.0F };
+        uint32_t imax[2];
+        uint32_t imin[2];
+        for (int k = 0; k < 2; ++k) {
+                imax[k] = glsl_round(maxcol[k] * mul[k]);
+                imin[k] = glsl_round(mincol[k] * mul[k]);
+        }
+        uint32_t x = (imax[0] << 11U) | (imax[1] << 5U) | (scale - 1U);
+        uint32_t y = (imin[0] << 11U) | (imin[1] << 5U) | (scale - 1U);
+
+        imax[0] = (imax[0] << 3U) | (imax[0] >> 2U);
+        imax[1] = (imax[1] << 2U) | (imax[1] >> 4U);
+        imin[0] = (imin[0] << 3U) | (imin[0] >> 2U);
+        imin[1] = (imin[1] << 2U) | (imin[1] >> 4U);
+
+        for (int k = 0; k < 2; ++k) { // undo rescale
+                maxcol[k] = ((imax[k] * (1.0F / 255.0F)) - YCOCG_OFFSET) / (float) scale + YCOCG_OFFSET;
+                mincol[k] = ((imin[k] * (1.0F / 255.0F)) - YCOCG_OFFSET) / (float) scale + YCOCG_OFFSET;
+        }
+
+        return x | (y << 16U);
+}
+
+static uint32_t alpha_index(float a, const float ab[7])
+{
+        uint32_t index = 1;
+        for (int k = 0; k < 7; ++k) {
+                index += (a <= ab[k]) ? 1U : 0U;
+        }
+        index &= 7U;
+        index ^= (2U > index) ? 1U : 0U;
+        return index;
+}
+
+static void compress_block_dxt5_ycocg(struct block *b, unsigned char *out)
+{
+        convert_block_to_ycocg(b);
+
+        float mincol[3];
+        float maxcol[3];
+        find_min_max_colors_box(b, mincol, maxcol);
+        select_ycocg_diagonal(b, mincol + 1, maxcol + 1);
+        uint32_t scale = scale_ycocg(mincol + 1, maxcol + 1);
+
+        uint32_t out_z = emit_end_points_ycocg_dxt5(mincol + 1, maxcol + 1, scale);
+        uint32_t out_w = emit_indices(b, 1, 2, mincol + 1, maxcol + 1);
+
+        inset_bbox(mincol, maxcol, 1, 32.0F);
+
+        // Y in DXT5 alpha block
+        uint32_t out_x = ((uint32_t) glsl_round(mincol[0] * 255.0F) << 8U) | (uint32_t) glsl_round(maxcol[0] * 255.0F);
+
+        const float alpha_range = 7.0F;
+        float min_a = mincol[0];
+        float max_a = maxcol[0];
+        float mid = (max_a - min_a) / (2.0F * alpha_range);
+        const float ab[7] = {
+                min_a + mid,
+                (6.0F * max_a + 1.0F * min_a) * (1.0F / alpha_range) + mid,
+                (5.0F * max_a + 2.0F * min_a) * (1.0F / alpha_range) + mid,
+                (4.0F * max_a + 3.0F * min_a) * (1.0F / alpha_range) + mid,
+                (3.0F * max_a + 4.0F * min_a) * (1.0F / alpha_range) + mid,
+                (2.0F * max_a + 5.0F * min_a) * (1.0F / alpha_range) + mid,
+                (1.0F * max_a + 6.0F * min_a) * (1.0F / alpha_range) + mid,
+        };
+        uint32_t index = 1;
+        uint32_t indices_x = 0;
+        for (int i = 0; i < 6; ++i) {
+                index = alpha_index(b->c[0][i], ab);
+                indices_x |= index << (3U * i + 16U);
+        }
+        uint32_t out_y = index >> 1U;
+        for (int i = 6; i < 16; ++i) {
+                out_y |= alpha_index(b->c[0][i], ab) << (3U * i - 16U);
+        }
+        out_x |= indices_x;
+
+        store_le32(out, out_x);
+        store_le32(out + 4, out_y);
+        store_le32(out + 8, out_z);
+        store_le32(out + 12, out_w);
+}
+
+struct dxt_cpu_job {
+        const unsigned char *in;
+        size_t linesize;
+        codec_t in_codec;   ///< RGB, RGBA or UYVY
+        codec_t out_codec;  ///< DXT1 or DXT5
+        int width;
+        int height;
+        unsigned char *out;
+        int block_row_start;
+        int block_row_end;
+};
+
+void *compress_block_rows(void *arg)
+{
+        auto *j = static_cast<dxt_cpu_job *>(arg);
+        const int blocks_x = (j->width + 3) / 4;
+        const int block_size = j->out_codec == DXT1 ? 8 : 16;
+        unsigned char *out = j->out + (size_t) j->block_row_start * blocks_x * block_size;
+        for (int by = j->block_row_start; by < j->block_row_end; ++by) {
+                for (int bx = 0; bx < blocks_x; ++bx) {
+                        struct block b;
+                        if (j->in_codec == UYVY) {
+                                extract_block_yuv(&b, j->in, j->linesize, bx * 4, by * 4, j->width, j->height);
+                        } else {
+                                extract_block_rgb(&b, j->in, j->linesize, j->in_codec == RGBA ? 4 : 3,
+                                                bx * 4, by * 4, j->width, j->height);
+                        }
+                        if (j->out_codec == DXT1) {
+                                compress_block_dxt1(&b, out);
+                        } else {
+                                compress_block_dxt5_ycocg(&b, out);
+                        }
+                        out += block_size;
+                }
+        }
+        return nullptr;
+}
+
+struct state_video_compress_cpu_dxt {
+        struct module module_data;
+        codec_t out_codec;
+        struct video_desc saved_desc;
+        decoder_t decoder;   ///< NULL if input can be compressed directly
+        codec_t in_codec;
+        bool interlaced_input;
+        vector<unsigned char> decoded;
+
+        video_frame_pool pool{0, *frame_pool_allocator_for("compress")};
+};
+
+static void cpu_dxt_compress_done(struct module *mod);
+
+static bool configure_with(struct state_video_compress_cpu_dxt *s, struct video_desc desc)
+{
+        // same preference as RTDXT so that the result is the same
+        const codec_t rgb_try[] = { RGB, RGBA, UYVY };
+        const codec_t yuv_try[] = { UYVY, RGB, RGBA };
+        const codec_t *codec_try = codec_is_a_rgb(desc.color_spec) ? rgb_try : yuv_try;
+        s->decoder = nullptr;
+        s->in_codec = VIDEO_CODEC_NONE;
+        for (int i = 0; i < 3; ++i) {
+                if (desc.color_spec == codec_try[i]) {
+                        s->in_codec = codec_try[i];
+                        break;
+                }
+                if ((s->decoder = get_decoder_from_to(desc.color_spec, codec_try[i])) != nullptr) {
+                        s->in_codec = codec_try[i];
+                        break;
+                }
+        }
+        if (s->in_codec == VIDEO_CODEC_NONE) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unsupported codec: %s\n", get_codec_name(desc.color_spec));
+                return false;
+        }
+        if (get_bits_per_component(desc.color_spec) > 8) {
+                LOG(LOG_LEVEL_NOTICE) << MOD_NAME "Converting from " << get_bits_per_component(desc.color_spec) <<
+                        " to 8 bits. You may directly capture 8-bit signal to improve performance.\n";
+        }
+
+        s->interlaced_input = desc.interlacing == INTERLACED_MERGED;
+        if (s->interlaced_input) {
+                log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Enabling automatic deinterlacing.\n");
+        }
+        if (s->decoder != nullptr || s->interlaced_input) {
+                s->decoded.resize((size_t) vc_get_linesize(desc.width, s->in_codec) * desc.height);
+        }
+
+        struct video_desc compressed_desc = desc;
+        compressed_desc.color_spec = s->out_codec;
+        compressed_desc.tile_count = 1;
+        compressed_desc.interlacing = s->interlaced_input ? PROGRESSIVE : desc.interlacing;
+        size_t data_len = (desc.width + 3) / 4 * 4 * ((desc.height + 3) / 4 * 4) / (s->out_codec == DXT1 ? 2 : 1);
+        s->pool.reconfigure(compressed_desc, data_len);
+
+        return true;
+}
+
+struct module *cpu_dxt_compress_init(struct module *parent, const char *fmt)
+{
+        if (strcmp(fmt, "help") == 0) {
+                printf("CPU DXT compression usage:\n");
+                printf("\t-c cpu_dxt[:DXT1|:DXT5]\n");
+                printf("\t\tcompress with DXT1 (default) or DXT5 YCoCg, same output as RTDXT\n");
+                return &compress_init_noerr;
+        }
+
+        auto *s = new state_video_compress_cpu_dxt();
+        s->out_codec = DXT1;
+        if (strcasecmp(fmt, "DXT5") == 0) {
+                s->out_codec = DXT5;
+        } else if (strcasecmp(fmt, "DXT1") != 0 && fmt[0] != '\0') {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unknown compression: %s\n", fmt);
+                delete s;
+                return NULL;
+        }
+
+        for (int i = 0; i < 256; ++i) {
+                unorm8[i] = i / 255.0F;
+        }
+
+        module_init_default(&s->module_data);
+        s->module_data.cls = MODULE_CLASS_DATA;
+        s->module_data.priv_data = s;
+        s->module_data.deleter = cpu_dxt_compress_done;
+        module_register(&s->module_data, parent);
+
+        return &s->module_data;
+}
+
+shared_ptr<video_frame> cpu_dxt_compress_tile(struct module *mod, shared_ptr<video_frame> tx)
+{
+        auto *s = (struct state_video_compress_cpu_dxt *) mod->priv_data;
+
+        if (!video_desc_eq_excl_param(video_desc_from_frame(tx.get()), s->saved_desc, PARAM_TILE_COUNT)) {
+                if (configure_with(s, video_desc_from_frame(tx.get()))) {
+                        s->saved_desc = video_desc_from_frame(tx.get());
+                } else {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Reconfiguration failed!\n");
+                        return {};
+                }
+        }
+
+        const unsigned char *in = (const unsigned char *) tx->tiles[0].data;
+        size_t in_linesize = vc_get_linesize(tx->tiles[0].width, s->in_codec);
+        if (s->decoder != nullptr) {
+                unsigned char *dst = s->decoded.data();
+                for (unsigned int i = 0; i < tx->tiles[0].height; ++i) {
+                        s->decoder(dst, in, in_linesize, 0, 8, 16);
+                        in += vc_get_linesize(tx->tiles[0].width, tx->color_spec);
+                        dst += in_linesize;
+                }
+                in = s->decoded.data();
+        } else if (s->interlaced_input) {
+                memcpy(s->decoded.data(), in, s->decoded.size());
+                in = s->decoded.data();
+        }
+        if (s->interlaced_input) {
+                vc_deinterlace(s->decoded.data(), in_linesize, tx->tiles[0].height);
+        }
+
+        shared_ptr<video_frame> out = s->pool.get_frame();
+        int block_rows = (tx->tiles[0].height + 3) / 4;
+        int threads = min<int>(get_cpu_core_count(), block_rows);
+        vector<dxt_cpu_job> jobs(threads);
+        for (int i = 0; i < threads; ++i) {
+                jobs[i] = { in, in_linesize, s->in_codec, s->out_codec, (int) tx->tiles[0].width,
+                        (int) tx->tiles[0].height, (unsigned char *) out->tiles[0].data,
+                        block_rows * i / threads, block_rows * (i + 1) / threads };
+        }
+        task_run_parallel(compress_block_rows, threads, jobs.data(), sizeof jobs[0], nullptr);
+
+        return out;
+}
+
+static void cpu_dxt_compress_done(struct module *mod)
+{
+        delete (struct state_video_compress_cpu_dxt *) mod->priv_data;
+}
+
+static auto cpu_dxt_compress_get_presets()
+{
+        static auto compute_dxt1_bitrate = [](const struct video_desc *d){return (long)(d->width * d->height * d->fps * 4.0);};
+        static auto compute_dxt5_bitrate = [](const struct video_desc *d){return (long)(d->width * d->height * d->fps * 8.0);};
+        // lower priority than RTDXT - it is used only if GL isn't available
+        return list<compress_preset>{
+                { "DXT1", 45, compute_dxt1_bitrate,
+                        {75, 0.3, 25}, {30, 0.5, 10} },
+                { "DXT5", 60, compute_dxt5_bitrate,
+                        {75, 0.3, 35}, {40, 0.5, 20} },
+        };
+}
+
+const struct video_compress_info cpu_dxt_info = {
+        "cpu_dxt",
+        cpu_dxt_compress_init,
+        NULL,
+        cpu_dxt_compress_tile,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        cpu_dxt_compress_get_presets,
+        NULL
+};
+
+REGISTER_MODULE(cpu_dxt, &cpu_dxt_info, LIBRARY_CLASS_VIDEO_COMPRESS, VIDEO_COMPRESS_ABI_VERSION);
+
+} // end of anonymous namespace
+
+/* vim: set expandtab sw=8: */
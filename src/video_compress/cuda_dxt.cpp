@@ -41,6 +41,8 @@
 #include "config_win32.h"
 #endif // HAVE_CONFIG_H
 
+#include <atomic>
+
 #include "cuda_dxt/cuda_dxt.h"
 #include "cuda_wrapper.h"
 #include "debug.h"
@@ -56,23 +58,6 @@ using namespace std;
 
 namespace {
 
-struct cuda_buffer_data_allocator : public video_frame_pool_allocator {
-        void *allocate(size_t size) override {
-                void *ptr;
-                if (CUDA_WRAPPER_SUCCESS != cuda_wrapper_malloc_host(&ptr,
-                                        size)) {
-                        return NULL;
-                }
-                return ptr;
-        }
-        void deallocate(void *ptr) override {
-                cuda_wrapper_free(ptr);
-        }
-        video_frame_pool_allocator *clone() const override {
-                return new cuda_buffer_data_allocator(*this);
-        }
-};
-
 struct state_video_compress_cuda_dxt {
         struct module       module_data;
         struct video_desc   saved_desc;
@@ -83,10 +68,14 @@ struct state_video_compress_cuda_dxt {
         codec_t             in_codec;
         codec_t             out_codec;
         decoder_t           decoder;
+        int                 device;   ///< CUDA device used by this instance
 
-        video_frame_pool pool{0, cuda_buffer_data_allocator()};
+        video_frame_pool pool{0, cuda_host_data_allocator()};
 };
 
+/// used to spread instances (one per tile) over configured CUDA devices
+static atomic<unsigned> instance_count;
+
 static void cuda_dxt_compress_done(struct module *mod);
 
 struct module *cuda_dxt_compress_init(struct module *parent,
@@ -109,6 +98,11 @@ struct module *cuda_dxt_compress_init(struct module *parent,
                 }
         }
 
+        s->device = cuda_devices[instance_count++ % cuda_devices_count];
+        if (cuda_devices_count > 1) {
+                log_msg(LOG_LEVEL_VERBOSE, "[CUDA DXT] Instance using CUDA device %d.\n", s->device);
+        }
+
         module_init_default(&s->module_data);
         s->module_data.cls = MODULE_CLASS_DATA;
         s->module_data.priv_data = s;
@@ -121,7 +115,7 @@ struct module *cuda_dxt_compress_init(struct module *parent,
 static void cleanup(struct state_video_compress_cuda_dxt *s)
 {
         if (s->in_buffer) {
-                free(s->in_buffer);
+                cuda_wrapper_free_host(s->in_buffer);
                 s->in_buffer = NULL;
         }
         if (s->cuda_uyvy_buffer) {
@@ -162,7 +156,12 @@ static bool configure_with(struct state_video_compress_cuda_dxt *s, struct video
                 }
         }
 
-        s->in_buffer = (char *) malloc(desc.width * desc.height * 3);
+        // pinned so that the upload of converted frame is a DMA transfer
+        if (CUDA_WRAPPER_SUCCESS != cuda_wrapper_malloc_host((void **) &s->in_buffer,
+                                desc.width * desc.height * 3)) {
+                fprintf(stderr, "Could not allocate CUDA host buffer.\n");
+                return false;
+        }
 
         if (CUDA_WRAPPER_SUCCESS != cuda_wrapper_malloc((void **) &s->cuda_in_buffer,
                                 desc.width * desc.height * 3)) {
@@ -192,7 +191,7 @@ shared_ptr<video_frame> cuda_dxt_compress_tile(struct module *mod, shared_ptr<vi
         struct state_video_compress_cuda_dxt *s =
                 (struct state_video_compress_cuda_dxt *) mod->priv_data;
 
-        cuda_wrapper_set_device(cuda_devices[0]);
+        cuda_wrapper_set_device(s->device);
 
         if (!video_desc_eq_excl_param(video_desc_from_frame(tx.get()),
                                 s->saved_desc, PARAM_TILE_COUNT)) {
@@ -281,6 +280,7 @@ static void cuda_dxt_compress_done(struct module *mod)
         struct state_video_compress_cuda_dxt *s =
                 (struct state_video_compress_cuda_dxt *) mod->priv_data;
 
+        cuda_wrapper_set_device(s->device);
         cleanup(s);
 
         delete s;
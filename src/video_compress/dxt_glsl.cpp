@@ -77,7 +77,7 @@ struct state_video_compress_rtdxt {
 
         struct gl_context gl_context;
 
-        video_frame_pool pool;
+        video_frame_pool pool{0, *frame_pool_allocator_for("compress")};
 };
 
 static int configure_with(struct state_video_compress_rtdxt *s, struct video_frame *frame);
@@ -42,6 +42,9 @@
 #endif // HAVE_CONFIG_H
 
 #include "compat/platform_time.h"
+#ifdef HAVE_CUDA
+#include "cuda_wrapper.h"
+#endif
 #include "debug.h"
 #include "host.h"
 #include "video_compress.h"
@@ -74,6 +77,15 @@ using namespace std;
 namespace {
 struct state_video_compress_gpujpeg;
 
+#ifdef HAVE_CUDA
+using decoded_allocator = cuda_host_data_allocator; ///< pinned memory makes the upload to GPU a DMA transfer
+#else
+using decoded_allocator = default_data_allocator;
+#endif
+struct decoded_deleter {
+        void operator()(char *ptr) { decoded_allocator().deallocate(ptr); }
+};
+
 /**
  * @brief state for single instance of encoder running on one GPU
  */
@@ -87,13 +99,16 @@ private:
         int                                      m_device_id;
         struct gpujpeg_encoder                  *m_encoder;
         struct video_desc                        m_saved_desc;
-        video_frame_pool                         m_pool;
+        video_frame_pool                         m_pool{0, *frame_pool_allocator_for("compress")};
         decoder_t                                m_decoder;
         codec_t                                  m_enc_input_codec{};
-        unique_ptr<char []>                      m_decoded;
+        unique_ptr<char [], decoded_deleter>     m_decoded; ///< input converted to m_enc_input_codec
 
         struct gpujpeg_parameters                m_encoder_param{};
         struct gpujpeg_image_parameters          m_param_image{};
+#ifdef HAVE_CUDA
+        cuda_wrapper_stream_t                    m_stream{}; ///< own stream if pipelined, otherwise default
+#endif
 public:
         encoder_state(struct state_video_compress_gpujpeg *s, int device_id) :
                 m_parent_state(s), m_device_id(device_id), m_encoder{}, m_saved_desc{},
@@ -102,6 +117,11 @@ public:
         }
         ~encoder_state() {
                 cleanup_state();
+#ifdef HAVE_CUDA
+                if (m_stream != nullptr) {
+                        cuda_wrapper_stream_destroy(m_stream);
+                }
+#endif
         }
         void worker();
         void compress(shared_ptr<video_frame> frame);
@@ -116,11 +136,12 @@ private:
         state_video_compress_gpujpeg(struct module *parent, const char *opts);
 
         vector<struct encoder_state *> m_workers;
-        bool                           m_uses_worker_threads; ///< true if cuda_devices_count > 1
+        bool                           m_uses_worker_threads; ///< true if m_workers.size() > 1
 
         map<uint32_t, shared_ptr<struct video_frame>> m_out_frames; ///< frames decoded out of order
         uint32_t m_in_seq;  ///< seq of next frame to be encoded
         uint32_t m_out_seq; ///< seq of next frame to be decoded
+        size_t m_next_worker{}; ///< round-robin start for free worker lookup
 
         size_t m_ended_count; ///< number of workers ended
 
@@ -148,6 +169,7 @@ public:
         bool                    m_compress_alpha = false;
         int                     m_subsampling = 0; // 444, 422 or 420; 0 -> autoselect
         enum gpujpeg_color_space m_use_internal_codec = GPUJPEG_NONE; // requested internal codec
+        int                     m_pipeline_depth = 1; ///< encoder instances per GPU
 
         synchronized_queue<shared_ptr<struct video_frame>, 1> m_out_queue; ///< queue for compressed frames
         mutex                                                 m_occupancy_lock;
@@ -161,7 +183,8 @@ public:
  * CUDA device is used to avoid context switches that introduce some overhead
  * (measured ~4% performance drop).
  *
- * When there are multiple CUDA devices to be used, it is called from encoder_state::worker().
+ * When there are multiple CUDA devices or multiple encoders per device to be
+ * used, it is called from encoder_state::worker().
  */
 void encoder_state::compress(shared_ptr<video_frame> frame)
 {
@@ -184,8 +207,8 @@ void encoder_state::compress(shared_ptr<video_frame> frame)
 }
 
 /**
- * Worker thread that is used if multiple CUDA devices are used - every device
- * has its own thread.
+ * Worker thread that is used if multiple CUDA devices or pipelining are used -
+ * every encoder instance has its own thread.
  */
 void encoder_state::worker() {
         while (true) {
@@ -298,7 +321,11 @@ bool encoder_state::configure_with(struct video_desc desc)
 #else
                 codec_is_a_rgb(m_enc_input_codec) ? 8 : 4);
 #endif
+#ifdef HAVE_CUDA
+        m_encoder = gpujpeg_encoder_create(static_cast<cudaStream_t>(m_stream));
+#else
         m_encoder = gpujpeg_encoder_create(NULL);
+#endif
 
         int data_len = desc.width * desc.height * 3;
         m_pool.reconfigure(compressed_desc, data_len);
@@ -309,7 +336,11 @@ bool encoder_state::configure_with(struct video_desc desc)
                 return false;
         }
 
-        m_decoded = unique_ptr<char []>(new char[4 * desc.width * desc.height]);
+        m_decoded = unique_ptr<char [], decoded_deleter>(static_cast<char *>(decoded_allocator().allocate(4 * desc.width * desc.height)));
+        if (!m_decoded) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Failed to allocate conversion buffer.\n");
+                return false;
+        }
 
         m_saved_desc = desc;
 
@@ -354,6 +385,12 @@ bool state_video_compress_gpujpeg::parse_fmt(char *fmt)
                         } else if (strstr(tok, "subsampling=") == tok) {
                                 m_subsampling = atoi(tok + strlen("subsampling="));
                                 assert(set<int>({444, 422, 420}).count(m_subsampling) == 1);
+                        } else if (strstr(tok, "pipeline=") == tok) {
+                                m_pipeline_depth = atoi(tok + strlen("pipeline="));
+                                if (m_pipeline_depth < 1) {
+                                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Error: Pipeline depth should be positive!\n");
+                                        return false;
+                                }
                         } else if (strcmp(tok, "alpha") == 0) {
 #if GPUJPEG_VERSION_INT < GPUJPEG_MK_VERSION_INT(0, 20, 2)
                                 log_msg(LOG_LEVEL_WARNING, MOD_NAME "GPUJPEG v0.20.2 is required for alpha support, %s found.\n",
@@ -398,19 +435,29 @@ state_video_compress_gpujpeg::state_video_compress_gpujpeg(struct module *parent
 }
 
 /**
- * Creates GPUJPEG encoding state and creates GPUJPEG workers for every GPU that
- * will be used for compression (if cuda_devices_count > 1).
+ * Creates GPUJPEG encoding state and creates GPUJPEG workers - m_pipeline_depth
+ * for every GPU that will be used for compression. Worker threads are used
+ * if there is more than one worker. Frames are distributed among the free
+ * workers round-robin and reordered in pop().
  */
 state_video_compress_gpujpeg *state_video_compress_gpujpeg::create(struct module *parent, const char *opts) {
         assert(cuda_devices_count > 0);
 
         auto ret = new state_video_compress_gpujpeg(parent, opts);
 
-        for (unsigned int i = 0; i < cuda_devices_count; ++i) {
-                ret->m_workers.push_back(new encoder_state(ret, cuda_devices[i]));
+        // interleaved by device so that consecutive frames go to different GPUs
+        for (int j = 0; j < ret->m_pipeline_depth; ++j) {
+                for (unsigned int i = 0; i < cuda_devices_count; ++i) {
+                        ret->m_workers.push_back(new encoder_state(ret, cuda_devices[i]));
+                }
         }
+#ifndef HAVE_CUDA
+        if (ret->m_pipeline_depth > 1) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Compiled without CUDA, pipelined encoders will share the default stream.\n");
+        }
+#endif
 
-        if (cuda_devices_count > 1) {
+        if (ret->m_workers.size() > 1) {
                 ret->m_uses_worker_threads = true;
         }
 
@@ -455,6 +502,12 @@ static const struct {
         {"Alpha", "alpha", "alpha",
                 "\t\tCompress (keep) alpha channel of RGBA.\n",
                 ":alpha", true},
+        {"Pipeline depth", "pipeline", "pipeline",
+                "\t\tNumber of encoders per GPU, each with its own CUDA stream and\n"
+                        "\t\tpinned input buffer, so that upload, encode and download of\n"
+                        "\t\tconsecutive frames overlap (default 1). 2 is usually enough to\n"
+                        "\t\tsaturate the GPU at the expense of one frame of latency.\n",
+                ":pipeline=", false},
 };
 
 struct module * gpujpeg_compress_init(struct module *parent, const char *opts)
@@ -468,7 +521,7 @@ struct module * gpujpeg_compress_init(struct module *parent, const char *opts)
 
         if(opts && strcmp(opts, "help") == 0) {
                 cout << "GPUJPEG comperssion usage:\n";
-                col() << "\t" << TBOLD(TRED("-c GPUJPEG") << "[:<quality>[:<restart_interval>]][:interleaved][:RGB|Y601|Y601full|Y709]][:subsampling=<sub>][:alpha]\n");
+                col() << "\t" << TBOLD(TRED("-c GPUJPEG") << "[:<quality>[:<restart_interval>]][:interleaved][:RGB|Y601|Y601full|Y709]][:subsampling=<sub>][:alpha][:pipeline=<n>]\n");
                 cout << "where\n";
 
                 for(const auto& i : usage_opts){
@@ -522,6 +575,13 @@ shared_ptr<video_frame> encoder_state::compress_step(shared_ptr<video_frame> tx)
                         exit_uv(EXIT_FAILURE);
                         return {};
                 }
+#ifdef HAVE_CUDA
+                if (m_parent_state->m_pipeline_depth > 1 && m_stream == nullptr
+                                && cuda_wrapper_stream_create(&m_stream) != CUDA_WRAPPER_SUCCESS) {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Cannot create CUDA stream: %s\n", cuda_wrapper_last_error_string());
+                        m_stream = nullptr;
+                }
+#endif
         }
 
         struct video_desc desc = video_desc_from_frame(tx.get());
@@ -557,6 +617,11 @@ shared_ptr<video_frame> encoder_state::compress_step(shared_ptr<video_frame> tx)
                                 line2 += vc_get_linesize(desc.width, m_enc_input_codec);
                         }
                         jpeg_enc_input_data = (uint8_t *) m_decoded.get();
+                } else if (m_parent_state->m_pipeline_depth > 1 && tx->mem_location == CPU_MEM) {
+                        // stage to pinned memory so that the upload is asynchronous
+                        // DMA overlapping with other encoders, not a staged copy
+                        memcpy(m_decoded.get(), in_tile->data, in_tile->data_len);
+                        jpeg_enc_input_data = (uint8_t *) m_decoded.get();
                 } else {
                         jpeg_enc_input_data = (uint8_t *) in_tile->data;
                 }
@@ -607,17 +672,18 @@ void state_video_compress_gpujpeg::push(std::shared_ptr<video_frame> in_frame)
                                 worker->m_in_queue.push({});
                         }
                 } else {
-                        int index;
+                        size_t index = 0;
                         unique_lock<mutex> lk(m_occupancy_lock);
-                        // wait for/select not occupied worker
+                        // wait for/select not occupied worker, starting after the last
+                        // selected one (round-robin across GPUs if all are idle)
                         m_worker_finished.wait(lk, [this, &index]{
-                                        index = 0;
-                                        for (auto worker : m_workers) {
-                                        if (!worker->m_occupied) return true;
-                                        index++;
+                                        for (size_t i = 0; i < m_workers.size(); ++i) {
+                                                index = (m_next_worker + i) % m_workers.size();
+                                                if (!m_workers[index]->m_occupied) return true;
                                         }
                                         return false;
                                         });
+                        m_next_worker = index + 1;
                         m_workers[index]->m_occupied = true;
                         lk.unlock();
                         m_workers[index]->m_in_queue.push(in_frame);
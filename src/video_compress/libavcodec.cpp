@@ -66,7 +66,9 @@
 #include "messaging.h"
 #include "module.h"
 #include "rang.hpp"
+#include "rtp/rtpenc_h264.h"
 #include "tv.h"
+#include "utils/bs.h"
 #include "utils/macros.h"
 #include "utils/misc.h"
 #include "utils/parallel_conv.h"
@@ -80,9 +82,21 @@ extern "C"
 #include <libavutil/hwcontext.h>
 #include <libavutil/hwcontext_vaapi.h>
 }
+#include <va/va.h>
+#include <va/va_vpp.h>
 #include "hwaccel_libav_common.h"
 #endif
 
+#ifdef __APPLE__
+extern "C"
+{
+#include <libavutil/hwcontext.h>
+}
+#include <CoreVideo/CoreVideo.h>
+#include "hwaccel_libav_common.h"
+#include "hwaccel_videotoolbox.h"
+#endif
+
 #ifdef HAVE_SWSCALE
 extern "C"{
 #include <libswscale/swscale.h>
@@ -117,6 +131,7 @@ struct setparam_param {
         int periodic_intra = -1; ///< -1 default; 0 disable/not enable; 1 enable
         string thread_mode;
         int slices = -1;
+        int temporal_layers = 1; ///< number of temporal layers, 1 - no layering
 };
 
 constexpr string_view DEFAULT_NVENC_PRESET_H264 = "p4";
@@ -143,6 +158,7 @@ static void setparam_default(AVCodecContext *, struct setparam_param *);
 static void setparam_h264_h265_av1(AVCodecContext *, struct setparam_param *);
 static void setparam_jpeg(AVCodecContext *, struct setparam_param *);
 static void setparam_vp8_vp9(AVCodecContext *, struct setparam_param *);
+void set_forced_idr(AVCodecContext *codec_ctx, int value);
 static void set_codec_thread_mode(AVCodecContext *codec_ctx, struct setparam_param *param);
 
 static pixfmt_callback_t select_pixfmt_callback(AVPixelFormat fmt, codec_t src);
@@ -277,6 +293,19 @@ struct state_video_compress_libav {
 
         bool hwenc = false;
         AVFrame *hwframe = nullptr;
+        bool keyframe_requested = false; ///< by the receiver, see libavcodec_check_messages()
+#ifdef HWACC_VAAPI
+        /// VAAPI video processing used to convert UG frame to encoder surface
+        /// on GPU (instead of CPU conversion to NV12), see vaapi_vpp_init()
+        struct {
+                AVBufferRef *frames_ctx = nullptr; ///< frames context for surfaces in input format
+                AVFrame *src_surface = nullptr;    ///< uploaded input frame
+                AVFrame *upload_frame = nullptr;   ///< wraps input UG frame data for upload
+                VADisplay display = nullptr;
+                VAConfigID config = VA_INVALID_ID;
+                VAContextID context = VA_INVALID_ID;
+        } vpp;
+#endif
 
 #ifdef HAVE_SWSCALE
         struct SwsContext *sws_ctx = nullptr;
@@ -285,6 +314,19 @@ struct state_video_compress_libav {
 #endif
 
         int conv_thread_count = clamp<unsigned int>(thread::hardware_concurrency(), 1, INT_MAX); ///< number of threads used for UG conversions
+
+        /// Pipelined conversion - next frame is converted to in_frame while
+        /// frame converted previously (swapped to pipeline.in_frame) is encoded.
+        /// @see libavcodec_compress_pipelined()
+        struct {
+                bool requested = false;            ///< pipelining requested by user
+                bool active = false;               ///< pipelining used for current configuration
+                AVFrame *in_frame = nullptr;       ///< converted frame to be encoded
+                vector<AVFrame *> in_frame_part;   ///< counterpart of state_video_compress_libav::in_frame_part
+                unsigned char *decoded = nullptr;  ///< counterpart of state_video_compress_libav::decoded
+                shared_ptr<video_frame> out;       ///< output frame for pipeline.in_frame (holds metadata)
+                time_ns_t conv_duration = 0;
+        } pipeline;
 };
 
 struct codec_encoders_decoders{
@@ -362,8 +404,8 @@ static void print_codec_info(AVCodecID id, char *buf, size_t buflen)
 static void usage() {
         printf("Libavcodec encoder usage:\n");
         cout << style::bold << fg::red << "\t-c libavcodec" << fg::reset << "[:codec=<codec_name>|:encoder=<encoder>][:bitrate=<bits_per_sec>|:bpp=<bits_per_pixel>][:crf=<crf>|:cqp=<cqp>][q=<q>]"
-                        "[:subsampling=<subsampling>][:gop=<gop>]"
-                        "[:[disable_]intra_refresh][:threads=<threads>][:slices=<slices>][:<lavc_opt>=<val>]*\n" <<
+                        "[:subsampling=<subsampling>][:gop=<gop>][:temporal_layers=<n>]"
+                        "[:[disable_]intra_refresh][:threads=<threads>][:slices=<slices>][:pipelined][:<lavc_opt>=<val>]*\n" <<
                         style::reset;
         cout << "\nwhere\n";
         cout << style::bold << "\t<encoder>" << style::reset << " specifies encoder (eg. nvenc or libx264 for H.264)\n";
@@ -385,7 +427,9 @@ static void usage() {
                 cout << "\t\t" << style::bold << get_codec_name(param.first) << style::reset << " - " << avail << "\n";
 
         }
-        cout << style::bold << "\t[disable_]intra_refresh" << style::reset << " - (do not) use Periodic Intra Refresh (H.264/H.265)\n";
+        cout << style::bold << "\t[disable_]intra_refresh" << style::reset << " - (do not) use Periodic Intra Refresh (H.264/H.265) - no keyframe bursts,\n"
+                << "\t\t\tdefault for x264/x265, must be enabled explicitly for NVENC; receivers still\n"
+                << "\t\t\tget an IDR frame on request (RTCP PLI/FIR) when joining or after a loss\n";
         cout << style::bold << "\t<bits_per_sec>" << style::reset << " specifies requested bitrate\n"
                 << "\t\t\t0 means codec default (same as when parameter omitted)\n";
         cout << style::bold << "\t<bits_per_pixel>" << style::reset << " specifies requested bitrate using compressed bits per pixel\n"
@@ -397,6 +441,9 @@ static void usage() {
         cout << style::bold << "\t<threads>" << style::reset << " can be \"no\", or \"<number>[F][S][n]\" where 'F'/'S' indicate if frame/slice thr. should be used, both can be used (default slice), 'n' means none\n";
         cout << style::bold << "\t<slices>" << style::reset << " number of slices to use (default: " << DEFAULT_SLICE_COUNT << ")\n";
         cout << style::bold << "\t<gop>" << style::reset << " specifies GOP size\n";
+        cout << style::bold << "\t<n>" << style::reset << " number of temporal layers (2 or 3, H.264/HEVC), layer is marked in packets so that\n"
+                << "\t\t\thd-rum-translator may drop higher layers per host (adds 1 or 3 frames of reordering latency)\n";
+        cout << style::bold << "\tpipelined" << style::reset << " - convert next frame while encoding current one (adds 1 frame latency)\n";
         cout << style::bold << "\t<lavc_opt>" << style::reset << " arbitrary option to be passed directly to libavcodec (eg. preset=veryfast), eventual colons must be backslash-escaped (eg. for x264opts)\n";
         cout << "\nUse '" << style::bold << "-c libavcodec:encoder=<enc>:help" << style::reset << "' to display encoder specific options.\n";
         cout << "\n";
@@ -472,6 +519,14 @@ static int parse_fmt(struct state_video_compress_libav *s, char *fmt) {
                 } else if(strncasecmp("gop=", item, strlen("gop=")) == 0) {
                         char *gop = item + strlen("gop=");
                         s->requested_gop = atoi(gop);
+                } else if(strncasecmp("temporal_layers=", item, strlen("temporal_layers=")) == 0) {
+                        s->params.temporal_layers = atoi(item + strlen("temporal_layers="));
+                        if (s->params.temporal_layers < 1 || s->params.temporal_layers > 3) {
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Temporal layers count must be 1-3!\n");
+                                return -1;
+                        }
+                } else if (strcasecmp("pipelined", item) == 0) {
+                        s->pipeline.requested = true;
                 } else if (strchr(item, '=')) {
                         char *c_val_dup = strdup(strchr(item, '=') + 1);
                         replace_all(c_val_dup, DELDEL, ":");
@@ -618,10 +673,35 @@ struct module * libavcodec_compress_init(struct module *parent, const char *opts
         for(int i = 0; i < s->conv_thread_count; i++) {
                 s->in_frame_part[i] = av_frame_alloc();
         }
+        if (s->pipeline.requested) {
+                s->pipeline.in_frame_part.resize(s->conv_thread_count);
+                for (auto &f : s->pipeline.in_frame_part) {
+                        f = av_frame_alloc();
+                }
+        }
 
         return &s->module_data;
 }
 
+#ifdef __APPLE__
+/**
+ * Sets frames context for HW_VTB pixel buffers that are passed to the
+ * VideoToolbox encoder as they are (see encode_vtb_frame()).
+ */
+static int vtb_enc_init(struct AVCodecContext *s)
+{
+        AVBufferRef *device_ref = nullptr;
+        int ret = create_hw_device_ctx(AV_HWDEVICE_TYPE_VIDEOTOOLBOX, &device_ref);
+        if (ret < 0) {
+                return ret;
+        }
+        ret = create_hw_frame_ctx(device_ref, s->width, s->height, AV_PIX_FMT_VIDEOTOOLBOX,
+                        AV_PIX_FMT_NV12, 0, &s->hw_frames_ctx);
+        av_buffer_unref(&device_ref);
+        return ret;
+}
+#endif
+
 #ifdef HWACC_VAAPI
 static int vaapi_init(struct AVCodecContext *s){
 
@@ -656,6 +736,117 @@ fail:
         av_buffer_unref(&device_ref);
         return ret;
 }
+
+static void vaapi_vpp_done(struct state_video_compress_libav *s)
+{
+        if (s->vpp.context != VA_INVALID_ID) {
+                vaDestroyContext(s->vpp.display, s->vpp.context);
+                s->vpp.context = VA_INVALID_ID;
+        }
+        if (s->vpp.config != VA_INVALID_ID) {
+                vaDestroyConfig(s->vpp.display, s->vpp.config);
+                s->vpp.config = VA_INVALID_ID;
+        }
+        av_frame_free(&s->vpp.upload_frame);
+        av_frame_free(&s->vpp.src_surface);
+        av_buffer_unref(&s->vpp.frames_ctx);
+        s->vpp.display = nullptr;
+}
+
+/**
+ * Sets up conversion of the input frame to the encoder NV12 surface with
+ * VAAPI video processing - the frame is uploaded as is (eg. UYVY) and
+ * converted by the GPU so that CPU doesn't touch the pixels.
+ *
+ * @retval false conversion is not possible for given format/driver, CPU
+ *               conversion is used instead
+ */
+static bool vaapi_vpp_init(struct state_video_compress_libav *s, struct video_desc desc)
+{
+        if (get_commandline_param("lavc-vaapi-no-vpp") != nullptr) {
+                return false;
+        }
+        const AVPixelFormat sw_fmt = get_ug_to_av_pixfmt(desc.color_spec);
+        if (sw_fmt != AV_PIX_FMT_UYVY422 && sw_fmt != AV_PIX_FMT_YUYV422 &&
+                        sw_fmt != AV_PIX_FMT_RGBA && sw_fmt != AV_PIX_FMT_BGRA) {
+                return false;
+        }
+        auto *enc_frames = (AVHWFramesContext *)(void *) s->codec_ctx->hw_frames_ctx->data;
+        auto *va_dev = (AVVAAPIDeviceContext *) enc_frames->device_ctx->hwctx;
+        VAStatus status = VA_STATUS_SUCCESS;
+
+        if (create_hw_frame_ctx(enc_frames->device_ref, desc.width, desc.height,
+                                AV_PIX_FMT_VAAPI, sw_fmt, 1, &s->vpp.frames_ctx) < 0) {
+                goto fail;
+        }
+        s->vpp.src_surface = av_frame_alloc();
+        s->vpp.upload_frame = av_frame_alloc();
+        if (s->vpp.src_surface == nullptr || s->vpp.upload_frame == nullptr ||
+                        av_hwframe_get_buffer(s->vpp.frames_ctx, s->vpp.src_surface, 0) < 0) {
+                goto fail;
+        }
+        s->vpp.display = va_dev->display;
+        if ((status = vaCreateConfig(s->vpp.display, VAProfileNone, VAEntrypointVideoProc,
+                                        nullptr, 0, &s->vpp.config)) != VA_STATUS_SUCCESS) {
+                goto fail;
+        }
+        if ((status = vaCreateContext(s->vpp.display, s->vpp.config, enc_frames->width,
+                                        enc_frames->height, VA_PROGRESSIVE, nullptr, 0,
+                                        &s->vpp.context)) != VA_STATUS_SUCCESS) {
+                goto fail;
+        }
+        LOG(LOG_LEVEL_NOTICE) << MOD_NAME "Converting " << get_codec_name(desc.color_spec)
+                << " to " << av_get_pix_fmt_name(enc_frames->sw_format) << " with VAAPI VPP.\n";
+        return true;
+fail:
+        LOG(LOG_LEVEL_VERBOSE) << MOD_NAME "VAAPI VPP not available for " << get_codec_name(desc.color_spec)
+                << (status != VA_STATUS_SUCCESS ? ": "s + vaErrorStr(status) : ""s)
+                << ", using CPU conversion.\n";
+        vaapi_vpp_done(s);
+        return false;
+}
+
+/// uploads the input frame and converts it to s->hwframe with VAAPI VPP
+static bool vaapi_vpp_convert(struct state_video_compress_libav *s, struct video_frame *tx)
+{
+        AVFrame *up = s->vpp.upload_frame;
+        up->format = ((AVHWFramesContext *)(void *) s->vpp.frames_ctx->data)->sw_format;
+        up->width = tx->tiles[0].width;
+        up->height = tx->tiles[0].height;
+        up->data[0] = (uint8_t *) tx->tiles[0].data;
+        up->linesize[0] = vc_get_linesize(tx->tiles[0].width, tx->color_spec);
+        if (int ret = av_hwframe_transfer_data(s->vpp.src_surface, up, 0)) {
+                print_libav_error(LOG_LEVEL_ERROR, MOD_NAME "Cannot upload frame", ret);
+                return false;
+        }
+
+        VAProcPipelineParameterBuffer params{};
+        params.surface = (VASurfaceID)(uintptr_t) s->vpp.src_surface->data[3];
+        params.surface_color_standard = codec_is_a_rgb(tx->color_spec)
+                ? VAProcColorStandardSRGB : VAProcColorStandardBT709;
+        params.output_color_standard = VAProcColorStandardBT709;
+        const auto dst_surface = (VASurfaceID)(uintptr_t) s->hwframe->data[3];
+        VABufferID params_buf = VA_INVALID_ID;
+        VAStatus status = vaCreateBuffer(s->vpp.display, s->vpp.context,
+                        VAProcPipelineParameterBufferType, sizeof params, 1,
+                        &params, &params_buf);
+        if (status == VA_STATUS_SUCCESS) {
+                status = vaBeginPicture(s->vpp.display, s->vpp.context, dst_surface);
+        }
+        if (status == VA_STATUS_SUCCESS) {
+                status = vaRenderPicture(s->vpp.display, s->vpp.context, &params_buf, 1);
+                VAStatus end_status = vaEndPicture(s->vpp.display, s->vpp.context);
+                status = status == VA_STATUS_SUCCESS ? end_status : status;
+        }
+        if (params_buf != VA_INVALID_ID) {
+                vaDestroyBuffer(s->vpp.display, params_buf);
+        }
+        if (status != VA_STATUS_SUCCESS) {
+                LOG(LOG_LEVEL_ERROR) << MOD_NAME "VAAPI VPP conversion failed: " << vaErrorStr(status) << "\n";
+                return false;
+        }
+        return true;
+}
 #endif
 
 void print_codec_supp_pix_fmts(const enum AVPixelFormat *first) {
@@ -905,6 +1096,15 @@ static list<enum AVPixelFormat> get_available_pix_fmts(struct video_desc in_desc
 {
         list<enum AVPixelFormat> fmts;
 
+#ifdef __APPLE__
+        if (in_desc.color_spec == HW_VTB) { // pixel buffer can be only passed to VideoToolbox
+                if (regex_match(codec->name, regex(".*_videotoolbox"))) {
+                        fmts.push_back(AV_PIX_FMT_VIDEOTOOLBOX);
+                }
+                return fmts;
+        }
+#endif
+
 #ifdef HWACC_VAAPI
         if (regex_match(codec->name, regex(".*vaapi.*"))) {
                 fmts.push_back(AV_PIX_FMT_VAAPI);
@@ -1061,6 +1261,12 @@ static bool try_open_codec(struct state_video_compress_libav *s,
                 pix_fmt = AV_PIX_FMT_NV12;
         }
 #endif
+#ifdef __APPLE__
+        if (pix_fmt == AV_PIX_FMT_VIDEOTOOLBOX && vtb_enc_init(s->codec_ctx) != 0) {
+                avcodec_free_context(&s->codec_ctx);
+                return false;
+        }
+#endif
 
         if (const AVPixFmtDescriptor * desc = av_pix_fmt_desc_get(pix_fmt)) { // defaults
                 s->codec_ctx->colorspace = (desc->flags & AV_PIX_FMT_FLAG_RGB) != 0U ? AVCOL_SPC_RGB : AVCOL_SPC_BT709;
@@ -1114,7 +1320,7 @@ static bool same_linesizes(codec_t codec, AVFrame *in_frame)
         }
 }
 
-const AVCodec *get_av_codec(struct state_video_compress_libav *s, codec_t *ug_codec, bool src_rgb) {
+const AVCodec *get_av_codec(struct state_video_compress_libav *s, codec_t *ug_codec, codec_t src_codec) {
         // Open encoder specified by user if given
         if (!s->backend.empty()) {
                 const AVCodec *codec = avcodec_find_encoder_by_name(s->backend.c_str());
@@ -1136,10 +1342,22 @@ const AVCodec *get_av_codec(struct state_video_compress_libav *s, codec_t *ug_co
                 return codec;
         }
 
+        // HW_VTB pixel buffers can be encoded only by VideoToolbox
+        if (src_codec == HW_VTB) {
+                if (s->requested_codec_id == VIDEO_CODEC_NONE) {
+                        *ug_codec = H264;
+                }
+                if (*ug_codec != H264 && *ug_codec != H265) {
+                        LOG(LOG_LEVEL_ERROR) << MOD_NAME "HW_VTB input can be compressed only to H.264 or HEVC!\n";
+                        return nullptr;
+                }
+                return avcodec_find_encoder_by_name(*ug_codec == H264 ? "h264_videotoolbox" : "hevc_videotoolbox");
+        }
+
         // Else, try to open prefered encoder for requested codec
         if (codec_params.find(*ug_codec) != codec_params.end() && codec_params[*ug_codec].get_prefered_encoder) {
                 const char *prefered_encoder = codec_params[*ug_codec].get_prefered_encoder(
-                                src_rgb);
+                                codec_is_a_rgb(src_codec));
                 const AVCodec *codec = avcodec_find_encoder_by_name(prefered_encoder);
                 if (!codec) {
                         log_msg(LOG_LEVEL_WARNING, "[lavc] Warning: prefered encoder \"%s\" not found! Trying default encoder.\n",
@@ -1201,9 +1419,95 @@ static bool configure_swscale(struct state_video_compress_libav *s, struct video
 #endif //HAVE_SWSCALE
 }
 
+/**
+ * Allocates s->in_frame (and s->decoded) for given input format and sets
+ * s->in_frame_part to point to its parts for parallel conversion.
+ */
+static bool alloc_in_frame(struct state_video_compress_libav *s, struct video_desc desc)
+{
+        s->in_frame = av_frame_alloc();
+        if (!s->in_frame) {
+                log_msg(LOG_LEVEL_ERROR, "Could not allocate video frame\n");
+                return false;
+        }
+        s->in_frame->pts = -1;
+        if (s->selected_pixfmt == AV_PIX_FMT_VIDEOTOOLBOX) { // HW_VTB - only pts is used, see encode_vtb_frame()
+                return true;
+        }
+
+        s->decoded = (unsigned char *) malloc(vc_get_linesize(desc.width, s->decoded_codec) * desc.height);
+
+        AVPixelFormat fmt = (s->hwenc) ? AV_PIX_FMT_NV12 : s->selected_pixfmt;
+#if LIBAVCODEC_VERSION_MAJOR >= 53
+        s->in_frame->format = fmt;
+        s->in_frame->width = s->codec_ctx->width;
+        s->in_frame->height = s->codec_ctx->height;
+#endif
+
+        int ret = av_frame_get_buffer(s->in_frame, 0);
+        if (ret < 0) {
+                log_msg(LOG_LEVEL_ERROR, "Could not allocate raw picture buffer\n");
+                return false;
+        }
+        // conversion needed
+        if (get_ug_to_av_pixfmt(desc.color_spec) == AV_PIX_FMT_NONE
+                        || get_ug_to_av_pixfmt(desc.color_spec) != s->selected_pixfmt) {
+                for(int i = 0; i < s->conv_thread_count; ++i) {
+                        int chunk_size = s->codec_ctx->height / s->conv_thread_count & ~1;
+                        s->in_frame_part[i]->data[0] = s->in_frame->data[0] + s->in_frame->linesize[0] * i *
+                                chunk_size;
+
+                        if (av_pix_fmt_desc_get(s->selected_pixfmt)->log2_chroma_h == 1) { // eg. 4:2:0
+                                chunk_size /= 2;
+                        }
+                        s->in_frame_part[i]->data[1] = s->in_frame->data[1] + s->in_frame->linesize[1] * i *
+                                chunk_size;
+                        s->in_frame_part[i]->data[2] = s->in_frame->data[2] + s->in_frame->linesize[2] * i *
+                                chunk_size;
+                        s->in_frame_part[i]->linesize[0] = s->in_frame->linesize[0];
+                        s->in_frame_part[i]->linesize[1] = s->in_frame->linesize[1];
+                        s->in_frame_part[i]->linesize[2] = s->in_frame->linesize[2];
+                }
+        } else if (same_linesizes(s->decoded_codec, s->in_frame)) {
+                av_freep(s->in_frame->data); // allocated buffers won't be needed and pointers
+                                             // will be filled by input buffers. av_image_alloc()
+                                             // was called to fill linesizes, however.
+        }
+        return true;
+}
+
+static void pipeline_swap_buffers(struct state_video_compress_libav *s)
+{
+        swap(s->in_frame, s->pipeline.in_frame);
+        swap(s->in_frame_part, s->pipeline.in_frame_part);
+        swap(s->decoded, s->pipeline.decoded);
+}
+
+/**
+ * Enables pipelined conversion if possible - only if the frame is converted
+ * by pixfmt_conv_task to in_frame buffers (not if in_frame points to the
+ * input frame data, which can be overwritten after return).
+ */
+static void configure_pipeline(struct state_video_compress_libav *s, struct video_desc desc)
+{
+        if (s->hwenc || s->selected_pixfmt == AV_PIX_FMT_VIDEOTOOLBOX
+                        || select_pixfmt_callback(s->selected_pixfmt, s->decoded_codec) == nullptr) {
+                LOG(LOG_LEVEL_WARNING) << MOD_NAME "Pipelined conversion not possible for "
+                        << get_codec_name(desc.color_spec) << " to " << av_get_pix_fmt_name(s->selected_pixfmt) << ".\n";
+                return;
+        }
+        pipeline_swap_buffers(s);
+        bool ret = alloc_in_frame(s, desc);
+        pipeline_swap_buffers(s);
+        if (!ret) {
+                return;
+        }
+        s->pipeline.active = true;
+        LOG(LOG_LEVEL_INFO) << MOD_NAME "Using pipelined conversion.\n";
+}
+
 static bool configure_with(struct state_video_compress_libav *s, struct video_desc desc)
 {
-        int ret;
         codec_t ug_codec = s->requested_codec_id == VIDEO_CODEC_NONE ? DEFAULT_CODEC : s->requested_codec_id;
         AVPixelFormat pix_fmt;
         const AVCodec *codec = nullptr;
@@ -1217,7 +1521,7 @@ static bool configure_with(struct state_video_compress_libav *s, struct video_de
         s->params.fps = desc.fps;
         s->params.interlaced = desc.interlacing == INTERLACED_MERGED;
 
-        if ((codec = get_av_codec(s, &ug_codec, codec_is_a_rgb(desc.color_spec))) == nullptr) {
+        if ((codec = get_av_codec(s, &ug_codec, desc.color_spec)) == nullptr) {
                 log_msg(LOG_LEVEL_ERROR, "Libavcodec doesn't contain encoder for specified codec.\n"
                                 "Hint: Check if you have libavcodec-extra package installed.\n");
                 return false;
@@ -1275,7 +1579,8 @@ static bool configure_with(struct state_video_compress_libav *s, struct video_de
                                 "which is usually not supported by hw. decoders\n");
         }
 
-        if(!find_decoder(desc, s->selected_pixfmt, &s->decoded_codec, &s->decoder)){
+        if (s->selected_pixfmt != AV_PIX_FMT_VIDEOTOOLBOX
+                        && !find_decoder(desc, s->selected_pixfmt, &s->decoded_codec, &s->decoder)) {
                 log_msg(LOG_LEVEL_ERROR, "[lavc] Failed to find a way to convert %s to %s\n",
                                 get_codec_name(desc.color_spec), av_get_pix_fmt_name(s->selected_pixfmt));
                 if (!configure_swscale(s, desc, codec)) {
@@ -1283,50 +1588,22 @@ static bool configure_with(struct state_video_compress_libav *s, struct video_de
                 }
         }
 
-        s->decoded = (unsigned char *) malloc(vc_get_linesize(desc.width, s->decoded_codec) * desc.height);
-
-        s->in_frame = av_frame_alloc();
-        if (!s->in_frame) {
-                log_msg(LOG_LEVEL_ERROR, "Could not allocate video frame\n");
+        if (!alloc_in_frame(s, desc)) {
                 return false;
         }
-        s->in_frame->pts = -1;
 
-        AVPixelFormat fmt = (s->hwenc) ? AV_PIX_FMT_NV12 : s->selected_pixfmt;
-#if LIBAVCODEC_VERSION_MAJOR >= 53
-        s->in_frame->format = fmt;
-        s->in_frame->width = s->codec_ctx->width;
-        s->in_frame->height = s->codec_ctx->height;
+#ifdef HWACC_VAAPI
+        if (s->hwenc
+#ifdef HAVE_SWSCALE
+                        && s->sws_ctx == nullptr
 #endif
-
-        ret = av_frame_get_buffer(s->in_frame, 0);
-        if (ret < 0) {
-                log_msg(LOG_LEVEL_ERROR, "Could not allocate raw picture buffer\n");
-                return false;
+                        ) {
+                vaapi_vpp_init(s, desc);
         }
-        // conversion needed
-        if (get_ug_to_av_pixfmt(desc.color_spec) == AV_PIX_FMT_NONE
-                        || get_ug_to_av_pixfmt(desc.color_spec) != s->selected_pixfmt) {
-                for(int i = 0; i < s->conv_thread_count; ++i) {
-                        int chunk_size = s->codec_ctx->height / s->conv_thread_count & ~1;
-                        s->in_frame_part[i]->data[0] = s->in_frame->data[0] + s->in_frame->linesize[0] * i *
-                                chunk_size;
+#endif
 
-                        if (av_pix_fmt_desc_get(s->selected_pixfmt)->log2_chroma_h == 1) { // eg. 4:2:0
-                                chunk_size /= 2;
-                        }
-                        s->in_frame_part[i]->data[1] = s->in_frame->data[1] + s->in_frame->linesize[1] * i *
-                                chunk_size;
-                        s->in_frame_part[i]->data[2] = s->in_frame->data[2] + s->in_frame->linesize[2] * i *
-                                chunk_size;
-                        s->in_frame_part[i]->linesize[0] = s->in_frame->linesize[0];
-                        s->in_frame_part[i]->linesize[1] = s->in_frame->linesize[1];
-                        s->in_frame_part[i]->linesize[2] = s->in_frame->linesize[2];
-                }
-        } else if (same_linesizes(s->decoded_codec, s->in_frame)) {
-                av_freep(s->in_frame->data); // allocated buffers won't be needed and pointers
-                                             // will be filled by input buffers. av_image_alloc()
-                                             // was called to fill linesizes, however.
+        if (s->pipeline.requested) {
+                configure_pipeline(s, desc);
         }
 
         s->saved_desc = desc;
@@ -1370,56 +1647,15 @@ static void *pixfmt_conv_task(void *arg) {
         return NULL;
 }
 
-static shared_ptr<video_frame> libavcodec_compress_tile(struct module *mod, shared_ptr<video_frame> tx)
+/**
+ * Converts (on CPU) the input frame to s->in_frame in the encoder pixel format.
+ *
+ * @param cleanup_callbacks handlers to be called when the frame is encoded
+ */
+static void convert_to_in_frame(struct state_video_compress_libav *s, struct video_frame *tx,
+                list<unique_ptr<state_video_compress_libav, void (*)(void *)>> &cleanup_callbacks)
 {
-        struct state_video_compress_libav *s = (struct state_video_compress_libav *) mod->priv_data;
         unsigned char *decoded;
-        shared_ptr<video_frame> out{};
-        list<unique_ptr<state_video_compress_libav, void (*)(void *)>> cleanup_callbacks; // at function exit handlers
-
-        libavcodec_check_messages(s);
-
-        if(!video_desc_eq_excl_param(video_desc_from_frame(tx.get()),
-                                s->saved_desc, PARAM_TILE_COUNT)) {
-                cleanup(s);
-                int ret = configure_with(s, video_desc_from_frame(tx.get()));
-                if(!ret) {
-                        return {};
-                }
-        }
-
-        static auto dispose = [](struct video_frame *frame) {
-#if LIBAVCODEC_VERSION_MAJOR >= 54 && LIBAVCODEC_VERSION_INT < AV_VERSION_INT(57, 37, 100)
-                AVPacket *pkt = (AVPacket *) frame->callbacks.dispose_udata;
-                av_packet_unref(pkt);
-                av_packet_free(&pkt);
-#else
-                free(frame->tiles[0].data);
-#endif // LIBAVCODEC_VERSION_MAJOR >= 54
-                vf_free(frame);
-        };
-        out = shared_ptr<video_frame>(vf_alloc_desc(s->compressed_desc), dispose);
-        if (s->compressed_desc.color_spec == PRORES) {
-                assert(s->codec_ctx->codec_tag != 0);
-                out->color_spec = get_codec_from_fcc(s->codec_ctx->codec_tag);
-        }
-        vf_copy_metadata(out.get(), tx.get());
-#if LIBAVCODEC_VERSION_MAJOR >= 54 && LIBAVCODEC_VERSION_INT < AV_VERSION_INT(57, 37, 100)
-        int got_output;
-        AVPacket *pkt = av_packet_alloc();
-        pkt->data = NULL;
-        pkt->size = 0;
-        out->callbacks.dispose_udata = pkt;
-#else
-        out->tiles[0].data = (char *) malloc(s->compressed_desc.width *
-                        s->compressed_desc.height * 4);
-#endif // LIBAVCODEC_VERSION_MAJOR >= 54
-
-        if (int ret = av_frame_make_writable(s->in_frame)) {
-                print_libav_error(LOG_LEVEL_ERROR, MOD_NAME "Cannot make frame writable", ret);
-                return {};
-        }
-        s->in_frame->pts += 1;
 
         if (s->decoder != vc_memcpy) {
                 int src_linesize = vc_get_linesize(tx->tiles[0].width, tx->color_spec);
@@ -1430,7 +1666,6 @@ static shared_ptr<video_frame> libavcodec_compress_tile(struct module *mod, shar
                 decoded = (unsigned char *) tx->tiles[0].data;
         }
 
-        time_ns_t t0 = get_time_in_ns();
         auto pixfmt_conv_callback = select_pixfmt_callback(s->selected_pixfmt, s->decoded_codec);
         if (pixfmt_conv_callback != nullptr) {
                 vector<struct pixfmt_conv_task_data> data(s->conv_thread_count);
@@ -1449,7 +1684,7 @@ static shared_ptr<video_frame> libavcodec_compress_tile(struct module *mod, shar
                         data[i].in_data = decoded + i * height *
                                 vc_get_linesize(tx->tiles[0].width, s->decoded_codec);
                 }
-                task_run_parallel(pixfmt_conv_task, s->conv_thread_count, data.data(), sizeof data[0], NULL);
+                task_run_parallel_pinned(pixfmt_conv_task, s->conv_thread_count, data.data(), sizeof data[0], NULL);
         } else { // no pixel format conversion needed
                 if (codec_is_planar(s->decoded_codec) && !same_linesizes(s->decoded_codec, s->in_frame)) {
                         assert(get_bits_per_component(s->decoded_codec) == 8);
@@ -1484,14 +1719,102 @@ static shared_ptr<video_frame> libavcodec_compress_tile(struct module *mod, shar
                         cleanup_callbacks.push_back(move(clean_data_ptr));
                 }
         }
+}
 
+/// allocates output frame for compressed data of tx
+static shared_ptr<video_frame> alloc_out_frame(struct state_video_compress_libav *s, struct video_frame *tx)
+{
+        static auto dispose = [](struct video_frame *frame) {
+#if LIBAVCODEC_VERSION_MAJOR >= 54 && LIBAVCODEC_VERSION_INT < AV_VERSION_INT(57, 37, 100)
+                AVPacket *pkt = (AVPacket *) frame->callbacks.dispose_udata;
+                av_packet_unref(pkt);
+                av_packet_free(&pkt);
+#else
+                free(frame->tiles[0].data);
+#endif // LIBAVCODEC_VERSION_MAJOR >= 54
+                vf_free(frame);
+        };
+        auto out = shared_ptr<video_frame>(vf_alloc_desc(s->compressed_desc), dispose);
+        if (s->compressed_desc.color_spec == PRORES) {
+                assert(s->codec_ctx->codec_tag != 0);
+                out->color_spec = get_codec_from_fcc(s->codec_ctx->codec_tag);
+        }
+        vf_copy_metadata(out.get(), tx);
+#if LIBAVCODEC_VERSION_MAJOR >= 54 && LIBAVCODEC_VERSION_INT < AV_VERSION_INT(57, 37, 100)
+        AVPacket *pkt = av_packet_alloc();
+        pkt->data = NULL;
+        pkt->size = 0;
+        out->callbacks.dispose_udata = pkt;
+#else
+        out->tiles[0].data = (char *) malloc(s->compressed_desc.width *
+                        s->compressed_desc.height * 4);
+#endif // LIBAVCODEC_VERSION_MAJOR >= 54
+
+        return out;
+}
+
+/**
+ * Determines temporal layer of the encoded H.264/HEVC access unit (see
+ * configure_temporal_layers()) - non-referenced pictures form the top layer,
+ * referenced B-slices (H.264) or pictures with nonzero TemporalId (HEVC) the
+ * middle one, everything else is the base layer.
+ */
+static int get_temporal_layer(codec_t codec, int layers, const unsigned char *data, long len)
+{
+        const unsigned char *nal = data;
+        const unsigned char *endptr = data;
+        while ((nal = rtpenc_h264_get_next_nal(nal, len - (nal - data), &endptr)) != nullptr) {
+                if (endptr - nal < 2) {
+                        nal = endptr;
+                        continue;
+                }
+                if (codec == H264) {
+                        int type = nal[0] & 0x1F;
+                        if (type != 1) { // coded slice of a non-IDR picture
+                                nal = endptr;
+                                continue;
+                        }
+                        if ((nal[0] & 0x60) == 0) { // nal_ref_idc
+                                return layers - 1;
+                        }
+                        // beginning of the slice header doesn't contain emulation prevention bytes
+                        bs_t b;
+                        bs_init(&b, const_cast<unsigned char *>(nal + 1), endptr - nal - 1);
+                        bs_read_ue(&b); // first_mb_in_slice
+                        int slice_type = bs_read_ue(&b) % 5;
+                        return slice_type == 1 /* B */ && layers > 2 ? 1 : 0;
+                }
+                int type = (nal[0] >> 1) & 0x3F;
+                if (type > 31) { // non-VCL
+                        nal = endptr;
+                        continue;
+                }
+                if (type <= 14 && type % 2 == 0) { // sub-layer non-reference
+                        return layers - 1;
+                }
+                int tid = (nal[1] & 0x7) - 1;
+                return tid > 0 ? min(tid, layers - 1) : 0;
+        }
+        return 0;
+}
+
+/**
+ * Encodes in_frame (s->in_frame or s->pipeline.in_frame) to out.
+ *
+ * @param conv_duration duration of the conversion to in_frame (for statistics)
+ */
+static shared_ptr<video_frame> encode_frame(struct state_video_compress_libav *s, AVFrame *in_frame,
+                shared_ptr<video_frame> out, time_ns_t conv_duration)
+{
         time_ns_t t1 = get_time_in_ns();
 
-        debug_file_dump("lavc-avframe", serialize_video_avframe, s->in_frame);
-        AVFrame *frame = s->in_frame;
+        debug_file_dump("lavc-avframe", serialize_video_avframe, in_frame);
+        AVFrame *frame = in_frame;
 #ifdef HWACC_VAAPI
         if(s->hwenc){
-                av_hwframe_transfer_data(s->hwframe, s->in_frame, 0);
+                if (s->vpp.context == VA_INVALID_ID) {
+                        av_hwframe_transfer_data(s->hwframe, in_frame, 0);
+                }
                 frame = s->hwframe;
         }
 #endif
@@ -1499,10 +1822,10 @@ static shared_ptr<video_frame> libavcodec_compress_tile(struct module *mod, shar
 #ifdef HAVE_SWSCALE
         if(s->sws_ctx){
                 sws_scale(s->sws_ctx,
-                          s->in_frame->data,
-                          s->in_frame->linesize,
+                          in_frame->data,
+                          in_frame->linesize,
                           0,
-                          s->in_frame->height,
+                          in_frame->height,
                           s->sws_frame->data,
                           s->sws_frame->linesize);
                 frame = s->sws_frame;
@@ -1510,6 +1833,14 @@ static shared_ptr<video_frame> libavcodec_compress_tile(struct module *mod, shar
 #endif //HAVE_SWSCALE
         time_ns_t t2 = get_time_in_ns();
 
+        frame->pict_type = s->keyframe_requested ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+        s->keyframe_requested = false;
+
+#if LIBAVCODEC_VERSION_MAJOR >= 54 && LIBAVCODEC_VERSION_INT < AV_VERSION_INT(57, 37, 100)
+        int got_output;
+        AVPacket *pkt = (AVPacket *) out->callbacks.dispose_udata;
+#endif
+
         /* encode the image */
 #if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(57, 37, 100)
         out->tiles[0].data_len = 0;
@@ -1567,17 +1898,156 @@ static shared_ptr<video_frame> libavcodec_compress_tile(struct module *mod, shar
         }
 #endif // LIBAVCODEC_VERSION_MAJOR >= 54
         time_ns_t t3 = get_time_in_ns();
-        LOG(LOG_LEVEL_DEBUG2) << MOD_NAME << "duration pixfmt change: " << (t1 - t0) / (double) NS_IN_SEC <<
+        LOG(LOG_LEVEL_DEBUG2) << MOD_NAME << "duration pixfmt change: " << conv_duration / (double) NS_IN_SEC <<
                 " s, dump+swscale " << (t2 - t1) / (double) NS_IN_SEC <<
                 " s, compression " << (t3 - t2) / (double) NS_IN_SEC << " s\n";
 
         if (out->tiles[0].data_len == 0) { // videotoolbox returns sometimes frames with pkt->size == 0 but got_output == true
                 return {};
         }
+        out->temporal_layer = 0;
+        if (s->params.temporal_layers > 1) {
+                out->temporal_layer = get_temporal_layer(out->color_spec, s->params.temporal_layers,
+                                (const unsigned char *) out->tiles[0].data, out->tiles[0].data_len);
+        }
 
         return out;
 }
 
+
+struct pipelined_conv_data {
+        struct state_video_compress_libav *s;
+        struct video_frame *tx;
+        time_ns_t duration;
+};
+
+static void *pipelined_conv_task(void *arg)
+{
+        auto *d = (struct pipelined_conv_data *) arg;
+        time_ns_t t0 = get_time_in_ns();
+        list<unique_ptr<state_video_compress_libav, void (*)(void *)>> cleanup_callbacks; // not used - pipeline requires pixfmt_conv_task conversion
+        convert_to_in_frame(d->s, d->tx, cleanup_callbacks);
+        d->duration = get_time_in_ns() - t0;
+        return d;
+}
+
+/**
+ * Pipelined compression - tx is converted to s->in_frame in a worker thread
+ * while the frame converted in previous call is being encoded by this thread.
+ * Converted frame is then swapped to s->pipeline.in_frame to be encoded in
+ * the next call.
+ *
+ * @returns frame passed in the previous call compressed
+ */
+static shared_ptr<video_frame> libavcodec_compress_pipelined(struct state_video_compress_libav *s,
+                shared_ptr<video_frame> tx, shared_ptr<video_frame> out)
+{
+        if (int ret = av_frame_make_writable(s->in_frame)) {
+                print_libav_error(LOG_LEVEL_ERROR, MOD_NAME "Cannot make frame writable", ret);
+                return {};
+        }
+        struct pipelined_conv_data conv_data{s, tx.get(), 0};
+        task_result_handle_t conv_task = task_run_async(pipelined_conv_task, &conv_data);
+
+        shared_ptr<video_frame> ret;
+        if (s->pipeline.out) {
+                ret = encode_frame(s, s->pipeline.in_frame, move(s->pipeline.out),
+                                s->pipeline.conv_duration);
+        }
+
+        wait_task(conv_task);
+        s->in_frame->pts = s->pipeline.in_frame->pts + 1;
+        pipeline_swap_buffers(s);
+        s->pipeline.out = move(out);
+        s->pipeline.conv_duration = conv_data.duration;
+
+        return ret;
+}
+
+#ifdef __APPLE__
+/**
+ * Encodes HW_VTB frame - the CVPixelBuffer is wrapped to an AVFrame (holding
+ * its own reference) and passed to the VideoToolbox encoder without a copy.
+ */
+static shared_ptr<video_frame> encode_vtb_frame(struct state_video_compress_libav *s, struct video_frame *tx,
+                shared_ptr<video_frame> out)
+{
+        CVPixelBufferRef pixbuf = ((hw_vtb_frame *)(void *) tx->tiles[0].data)->pixbuf;
+        AVFrame *frame = av_frame_alloc();
+        if (frame == nullptr) {
+                return {};
+        }
+        frame->format = AV_PIX_FMT_VIDEOTOOLBOX;
+        frame->width = s->codec_ctx->width;
+        frame->height = s->codec_ctx->height;
+        frame->pts = s->in_frame->pts += 1;
+        frame->data[3] = (uint8_t *) pixbuf;
+        frame->buf[0] = av_buffer_create((uint8_t *) pixbuf, sizeof pixbuf,
+                        [](void *, uint8_t *data) { CFRelease((CVPixelBufferRef) data); },
+                        nullptr, AV_BUFFER_FLAG_READONLY);
+        if (frame->buf[0] != nullptr) {
+                CFRetain(pixbuf);
+        }
+        frame->hw_frames_ctx = av_buffer_ref(s->codec_ctx->hw_frames_ctx);
+        if (frame->buf[0] == nullptr || frame->hw_frames_ctx == nullptr) {
+                LOG(LOG_LEVEL_ERROR) << MOD_NAME "Cannot wrap pixel buffer!\n";
+                av_frame_free(&frame);
+                return {};
+        }
+
+        auto ret = encode_frame(s, frame, move(out), 0);
+        av_frame_free(&frame);
+        return ret;
+}
+#endif
+
+static shared_ptr<video_frame> libavcodec_compress_tile(struct module *mod, shared_ptr<video_frame> tx)
+{
+        struct state_video_compress_libav *s = (struct state_video_compress_libav *) mod->priv_data;
+        list<unique_ptr<state_video_compress_libav, void (*)(void *)>> cleanup_callbacks; // at function exit handlers
+
+        libavcodec_check_messages(s);
+
+        if(!video_desc_eq_excl_param(video_desc_from_frame(tx.get()),
+                                s->saved_desc, PARAM_TILE_COUNT)) {
+                cleanup(s);
+                int ret = configure_with(s, video_desc_from_frame(tx.get()));
+                if(!ret) {
+                        return {};
+                }
+        }
+
+        shared_ptr<video_frame> out = alloc_out_frame(s, tx.get());
+#ifdef __APPLE__
+        if (s->selected_pixfmt == AV_PIX_FMT_VIDEOTOOLBOX) {
+                return encode_vtb_frame(s, tx.get(), move(out));
+        }
+#endif
+        if (s->pipeline.active) {
+                return libavcodec_compress_pipelined(s, move(tx), move(out));
+        }
+
+        if (int ret = av_frame_make_writable(s->in_frame)) {
+                print_libav_error(LOG_LEVEL_ERROR, MOD_NAME "Cannot make frame writable", ret);
+                return {};
+        }
+        s->in_frame->pts += 1;
+
+        time_ns_t t0 = get_time_in_ns();
+#ifdef HWACC_VAAPI
+        if (s->vpp.context != VA_INVALID_ID) {
+                if (!vaapi_vpp_convert(s, tx.get())) {
+                        return {};
+                }
+        } else
+#endif
+        {
+                convert_to_in_frame(s, tx.get(), cleanup_callbacks);
+        }
+
+        return encode_frame(s, s->in_frame, move(out), get_time_in_ns() - t0);
+}
+
 static void cleanup(struct state_video_compress_libav *s)
 {
         if(s->codec_ctx) {
@@ -1607,7 +2077,15 @@ static void cleanup(struct state_video_compress_libav *s)
         }
         free(s->decoded);
         s->decoded = NULL;
+        av_frame_free(&s->pipeline.in_frame);
+        free(s->pipeline.decoded);
+        s->pipeline.decoded = nullptr;
+        s->pipeline.out = nullptr;
+        s->pipeline.active = false;
 
+#ifdef HWACC_VAAPI
+        vaapi_vpp_done(s);
+#endif
         av_frame_free(&s->hwframe);
 
 #ifdef HAVE_SWSCALE
@@ -1625,6 +2103,9 @@ static void libavcodec_compress_done(struct module *mod)
         for (auto &f : s->in_frame_part) {
                 av_free(f);
         }
+        for (auto &f : s->pipeline.in_frame_part) {
+                av_free(f);
+        }
         delete s;
 }
 
@@ -1705,6 +2186,10 @@ static void configure_amf([[maybe_unused]] AVCodecContext *codec_ctx, [[maybe_un
         }
 }
 
+#ifdef HWACC_VAAPI
+ADD_TO_PARAM("lavc-vaapi-no-vpp", "* lavc-vaapi-no-vpp\n"
+                "  Do not convert input frames with VAAPI video processing (GPU), use CPU conversion\n");
+#endif
 ADD_TO_PARAM("lavc-h264-interlaced-dct", "* lavc-h264-interlaced-dct\n"
                  "  Use interlaced DCT for H.264\n");
 ADD_TO_PARAM("lavc-rc-buffer-size-factor", "* lavc-rc-buffer-size-factor=<val>\n"
@@ -1763,6 +2248,9 @@ static void configure_x264_x265(AVCodecContext *codec_ctx, struct setparam_param
                         print_libav_error(LOG_LEVEL_WARNING, "[lavc] Unable to set x265-params", ret);
                 }
         }
+        // keyframes requested by a receiver (RTCP PLI/FIR) must be IDR even with
+        // intra refresh, otherwise a newly joined receiver wouldn't get parameter sets
+        set_forced_idr(codec_ctx, 1);
 }
 
 static void configure_qsv(AVCodecContext *codec_ctx, struct setparam_param *param)
@@ -1896,6 +2384,37 @@ static void configure_svt(AVCodecContext *codec_ctx, struct setparam_param * /*
         }
 }
 
+/**
+ * Sets dyadic temporal prediction structure - the encoders (x264, x265, NVENC)
+ * do not offer hierarchical P-frames so B-pyramid is used instead: with 2
+ * layers every other frame is a non-referenced B-frame, with 3 layers a
+ * referenced B-frame is in the middle of a 4-frame group (layer 1) and the
+ * remaining B-frames are not referenced (layer 2).
+ */
+static void configure_temporal_layers(AVCodecContext *codec_ctx, struct setparam_param *param)
+{
+        if (codec_ctx->codec_id != AV_CODEC_ID_H264 && codec_ctx->codec_id != AV_CODEC_ID_HEVC) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Temporal layers supported only for H.264 and HEVC!\n");
+                param->temporal_layers = 1;
+                return;
+        }
+        codec_ctx->max_b_frames = (1 << (param->temporal_layers - 1)) - 1;
+        const char *pyramid = param->temporal_layers > 2 ? "strict" : "none";
+        int ret = 0;
+        if (strncmp(codec_ctx->codec->name, "libx264", strlen("libx264")) == 0) {
+                ret = av_opt_set(codec_ctx->priv_data, "b-pyramid", pyramid, 0);
+        } else if (regex_match(codec_ctx->codec->name, regex(".*nvenc.*"))) {
+                ret = av_opt_set(codec_ctx->priv_data, "zerolatency", "0", 0);
+                if (ret == 0) {
+                        ret = av_opt_set(codec_ctx->priv_data, "b_ref_mode", param->temporal_layers > 2 ? "middle" : "disabled", 0);
+                }
+        } // x265 uses B-pyramid by default
+        if (ret != 0) {
+                print_libav_error(LOG_LEVEL_WARNING, MOD_NAME "Unable to set temporal layering", ret);
+        }
+        LOG(LOG_LEVEL_INFO) << MOD_NAME << "Using " << param->temporal_layers << " temporal layers (" << codec_ctx->max_b_frames << " B-frames).\n";
+}
+
 static void setparam_h264_h265_av1(AVCodecContext *codec_ctx, struct setparam_param *param)
 {
         if (regex_match(codec_ctx->codec->name, regex(".*_amf"))) {
@@ -1915,6 +2434,9 @@ static void setparam_h264_h265_av1(AVCodecContext *codec_ctx, struct setparam_pa
         } else {
                 log_msg(LOG_LEVEL_WARNING, "[lavc] Warning: Unknown encoder %s. Using default configuration values.\n", codec_ctx->codec->name);
         }
+        if (param->temporal_layers > 1) {
+                configure_temporal_layers(codec_ctx, param);
+        }
 }
 
 void show_encoder_help(string const &name) {
@@ -1992,6 +2514,11 @@ static void libavcodec_check_messages(struct state_video_compress_libav *s)
                 struct msg_change_compress_data *data =
                         (struct msg_change_compress_data *) msg;
                 struct response *r;
+                if (strcmp(data->config_string, "keyframe") == 0) {
+                        s->keyframe_requested = true;
+                        free_message(msg, new_response(RESPONSE_OK, NULL));
+                        continue;
+                }
                 if (parse_fmt(s, data->config_string) == 0) {
                         log_msg(LOG_LEVEL_NOTICE, "[Libavcodec] Compression successfully changed.\n");
                         r = new_response(RESPONSE_OK, NULL);
@@ -154,7 +154,7 @@ struct module * uyvy_compress_init(struct module *parent, const char *)
 
         gl_context_make_current(NULL);
 
-        s->pool = new video_frame_pool();
+        s->pool = new video_frame_pool(0, *frame_pool_allocator_for("compress"));
 
         module_init_default(&s->module_data);
         s->module_data.cls = MODULE_CLASS_DATA;
@@ -0,0 +1,407 @@
+/**
+ * @file   video_decompress/cpu_dxt.cpp
+ *
+ * Multi-threaded CPU DXT1 and DXT5 YCoCg decompression for receivers without
+ * GL (eg. SDL or DeckLink output), counterpart of video_compress/cpu_dxt.cpp.
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ * 
+ *      This product includes software developed by CESNET z.s.p.o.
+ * 
+ * 4. Neither the name of the CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "color.h"
+#include "debug.h"
+#include "host.h"
+#include "lib_common.h"
+#include "utils/macros.h"
+#include "utils/misc.h"
+#include "utils/worker.h"
+#include "video.h"
+#include "video_decompress.h"
+
+#define MOD_NAME "[CPU DXT decompress] "
+
+using std::max;
+using std::min;
+using std::vector;
+
+namespace {
+
+/*
+ * A block row is decoded to planar 8-bit components in a per-thread scratch
+ * buffer (4 lines) first and then written line by line in the output
+ * pixelformat. The per-pixel loops work on 16-element arrays so that they
+ * can be vectorized.
+ */
+struct block {
+        uint8_t c[3][16]; ///< R, G, B (Y, Cb, Cr for DXT1_YUV)
+};
+
+static inline unsigned load_le16(const unsigned char *in) {
+        return in[0] | in[1] << 8U;
+}
+
+static inline uint32_t load_le32(const unsigned char *in) {
+        return in[0] | in[1] << 8U | in[2] << 16U | (uint32_t) in[3] << 24U;
+}
+
+static inline uint8_t clamp_u8(float x) {
+        return (uint8_t) (min(max(x, 0.0F), 255.0F) + 0.5F);
+}
+
+/**
+ * Decodes color part of a DXT1 or DXT5 block. DXT5 always uses the
+ * 4-color mode, DXT1 the 3-color one (with black) if c0 <= c1.
+ */
+static void decode_color_block(const unsigned char *in, bool dxt1, struct block *b)
+{
+        const unsigned c0 = load_le16(in);
+        const unsigned c1 = load_le16(in + 2);
+        const unsigned e[2][3] = {
+                { (c0 >> 11U) << 3U | (c0 >> 13U), ((c0 >> 5U) & 0x3FU) << 2U | ((c0 >> 9U) & 0x3U), (c0 & 0x1FU) << 3U | ((c0 >> 2U) & 0x7U) },
+                { (c1 >> 11U) << 3U | (c1 >> 13U), ((c1 >> 5U) & 0x3FU) << 2U | ((c1 >> 9U) & 0x3U), (c1 & 0x1FU) << 3U | ((c1 >> 2U) & 0x7U) },
+        };
+        uint8_t pal[3][4];
+        for (int k = 0; k < 3; ++k) {
+                pal[k][0] = e[0][k];
+                pal[k][1] = e[1][k];
+                if (!dxt1 || c0 > c1) {
+                        pal[k][2] = (2 * e[0][k] + e[1][k] + 1) / 3;
+                        pal[k][3] = (e[0][k] + 2 * e[1][k] + 1) / 3;
+                } else {
+                        pal[k][2] = (e[0][k] + e[1][k] + 1) / 2;
+                        pal[k][3] = 0;
+                }
+        }
+
+        const uint32_t indices = load_le32(in + 4);
+        OPTIMIZED_FOR (int i = 0; i < 16; ++i) {
+                unsigned idx = (indices >> (2U * i)) & 0x3U;
+                b->c[0][i] = pal[0][idx];
+                b->c[1][i] = pal[1][idx];
+                b->c[2][i] = pal[2][idx];
+        }
+}
+
+/// decodes DXT5 alpha block (carrying Y in DXT5 YCoCg)
+static void decode_alpha_block(const unsigned char *in, uint8_t a[16])
+{
+        const unsigned a0 = in[0];
+        const unsigned a1 = in[1];
+        uint8_t pal[8] = { (uint8_t) a0, (uint8_t) a1 };
+        if (a0 > a1) {
+                for (unsigned i = 1; i <= 6; ++i) {
+                        pal[i + 1] = ((7 - i) * a0 + i * a1 + 3) / 7;
+                }
+        } else {
+                for (unsigned i = 1; i <= 4; ++i) {
+                        pal[i + 1] = ((5 - i) * a0 + i * a1 + 2) / 5;
+                }
+                pal[6] = 0;
+                pal[7] = 255;
+        }
+
+        uint64_t indices = 0;
+        for (int k = 0; k < 6; ++k) {
+                indices |= (uint64_t) in[2 + k] << (8U * k);
+        }
+        for (int i = 0; i < 16; ++i) {
+                a[i] = pal[(indices >> (3U * i)) & 0x7U];
+        }
+}
+
+/// same computation as display_dxt5ycocg_fp.glsl, blue carries the Co/Cg scale
+static void ycocg_to_rgb(struct block *b, const uint8_t y[16])
+{
+        OPTIMIZED_FOR (int i = 0; i < 16; ++i) {
+                float inv_scale = 1.0F / (b->c[2][i] * (1.0F / 8.0F) + 1.0F);
+                float co = (b->c[0][i] - 128) * inv_scale;
+                float cg = (b->c[1][i] - 128) * inv_scale;
+                float Y = y[i];
+                b->c[0][i] = clamp_u8(Y + co - cg);
+                b->c[1][i] = clamp_u8(Y + cg);
+                b->c[2][i] = clamp_u8(Y - co - cg);
+        }
+}
+
+static void yuv_to_rgb(struct block *b)
+{
+        OPTIMIZED_FOR (int i = 0; i < 16; ++i) {
+                comp_type_t y = Y_SCALE * (b->c[0][i] - 16);
+                comp_type_t cb = b->c[1][i] - 128;
+                comp_type_t cr = b->c[2][i] - 128;
+                comp_type_t r = (YCBCR_TO_R_709_SCALED(y, cb, cr) >> COMP_BASE);
+                comp_type_t g = (YCBCR_TO_G_709_SCALED(y, cb, cr) >> COMP_BASE);
+                comp_type_t bl = (YCBCR_TO_B_709_SCALED(y, cb, cr) >> COMP_BASE);
+                b->c[0][i] = CLAMP_FULL(r, 8);
+                b->c[1][i] = CLAMP_FULL(g, 8);
+                b->c[2][i] = CLAMP_FULL(bl, 8);
+        }
+}
+
+static void write_line_rgba(unsigned char *dst, const uint8_t *const src[3], int width, const int rgb_shift[3])
+{
+        const uint32_t alpha_mask = ~(0xFFU << rgb_shift[0] | 0xFFU << rgb_shift[1] | 0xFFU << rgb_shift[2]);
+        OPTIMIZED_FOR (int x = 0; x < width; ++x) {
+                uint32_t val = alpha_mask | (uint32_t) src[0][x] << rgb_shift[0] |
+                        (uint32_t) src[1][x] << rgb_shift[1] | (uint32_t) src[2][x] << rgb_shift[2];
+                memcpy(dst + 4 * x, &val, sizeof val);
+        }
+}
+
+static void write_line_uyvy_from_rgb(unsigned char *dst, const uint8_t *const src[3], int width)
+{
+        const uint8_t *r = src[0];
+        const uint8_t *g = src[1];
+        const uint8_t *b = src[2];
+        for (int x = 0; x < width; x += 2) {
+                int x1 = min(x + 1, width - 1);
+                comp_type_t y0 = (RGB_TO_Y_709_SCALED(r[x], g[x], b[x]) >> COMP_BASE) + 16;
+                comp_type_t y1 = (RGB_TO_Y_709_SCALED(r[x1], g[x1], b[x1]) >> COMP_BASE) + 16;
+                comp_type_t cb = (RGB_TO_CB_709_SCALED(r[x] + r[x1], g[x] + g[x1], b[x] + b[x1]) >> (COMP_BASE + 1)) + 128;
+                comp_type_t cr = (RGB_TO_CR_709_SCALED(r[x] + r[x1], g[x] + g[x1], b[x] + b[x1]) >> (COMP_BASE + 1)) + 128;
+                *dst++ = CLAMP_LIMITED_CBCR(cb, 8);
+                *dst++ = CLAMP_LIMITED_Y(y0, 8);
+                *dst++ = CLAMP_LIMITED_CBCR(cr, 8);
+                *dst++ = CLAMP_LIMITED_Y(y1, 8);
+        }
+}
+
+static void write_line_uyvy_from_yuv(unsigned char *dst, const uint8_t *const src[3], int width)
+{
+        for (int x = 0; x < width; x += 2) {
+                int x1 = min(x + 1, width - 1);
+                *dst++ = (src[1][x] + src[1][x1] + 1) / 2;
+                *dst++ = src[0][x];
+                *dst++ = (src[2][x] + src[2][x1] + 1) / 2;
+                *dst++ = src[0][x1];
+        }
+}
+
+struct dxt_decompress_job {
+        const unsigned char *in;
+        codec_t in_codec;  ///< DXT1, DXT1_YUV or DXT5
+        codec_t out_codec; ///< RGBA or UYVY
+        int width;
+        int height;
+        unsigned char *out;
+        int pitch;
+        const int *rgb_shift;
+        uint8_t *scratch;  ///< 3 planes of 4 lines, (width + 3) / 4 * 4 pixels each
+        int block_row_start;
+        int block_row_end;
+};
+
+void *decompress_block_rows(void *arg)
+{
+        auto *j = static_cast<dxt_decompress_job *>(arg);
+        const int blocks_x = (j->width + 3) / 4;
+        const int plane_width = blocks_x * 4;
+        const int block_size = j->in_codec == DXT5 ? 16 : 8;
+        const bool yuv_out = j->out_codec == UYVY;
+        const bool yuv_in = j->in_codec == DXT1_YUV;
+        const unsigned char *in = j->in + (size_t) j->block_row_start * blocks_x * block_size;
+
+        for (int by = j->block_row_start; by < j->block_row_end; ++by) {
+                for (int bx = 0; bx < blocks_x; ++bx) {
+                        struct block b;
+                        if (j->in_codec == DXT5) {
+                                uint8_t y[16];
+                                decode_alpha_block(in, y);
+                                decode_color_block(in + 8, false, &b);
+                                ycocg_to_rgb(&b, y);
+                        } else {
+                                decode_color_block(in, true, &b);
+                                if (yuv_in && !yuv_out) {
+                                        yuv_to_rgb(&b);
+                                }
+                        }
+                        for (int k = 0; k < 3; ++k) {
+                                for (int i = 0; i < 4; ++i) {
+                                        memcpy(j->scratch + (k * 4 + i) * plane_width + bx * 4, &b.c[k][i * 4], 4);
+                                }
+                        }
+                        in += block_size;
+                }
+
+                for (int i = 0; i < 4 && by * 4 + i < j->height; ++i) {
+                        const uint8_t *src[3] = { j->scratch + i * plane_width,
+                                j->scratch + (4 + i) * plane_width, j->scratch + (8 + i) * plane_width };
+                        unsigned char *dst = j->out + (size_t) (by * 4 + i) * j->pitch;
+                        if (!yuv_out) {
+                                write_line_rgba(dst, src, j->width, j->rgb_shift);
+                        } else if (yuv_in) {
+                                write_line_uyvy_from_yuv(dst, src, j->width);
+                        } else {
+                                write_line_uyvy_from_rgb(dst, src, j->width);
+                        }
+                }
+        }
+        return nullptr;
+}
+
+struct state_decompress_cpu_dxt {
+        struct video_desc desc;
+        size_t compressed_len;
+        int rgb_shift[3];
+        int pitch;
+        codec_t out_codec;
+        vector<vector<uint8_t>> scratch; ///< per thread
+};
+
+static void *cpu_dxt_decompress_init()
+{
+        return new state_decompress_cpu_dxt();
+}
+
+static int cpu_dxt_decompress_reconfigure(void *state, struct video_desc desc,
+                int rshift, int gshift, int bshift, int pitch, codec_t out_codec)
+{
+        auto *s = static_cast<state_decompress_cpu_dxt *>(state);
+
+        if (desc.color_spec != DXT1 && desc.color_spec != DXT1_YUV && desc.color_spec != DXT5) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unsupported codec: %s\n", get_codec_name(desc.color_spec));
+                return FALSE;
+        }
+        if (out_codec != RGBA && out_codec != UYVY) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unsupported output codec: %s\n", get_codec_name(out_codec));
+                return FALSE;
+        }
+
+        s->desc = desc;
+        s->rgb_shift[0] = rshift;
+        s->rgb_shift[1] = gshift;
+        s->rgb_shift[2] = bshift;
+        s->pitch = pitch;
+        s->out_codec = out_codec;
+        s->compressed_len = (size_t) (desc.width + 3) / 4 * ((desc.height + 3) / 4) * (desc.color_spec == DXT5 ? 16 : 8);
+
+        int block_rows = (desc.height + 3) / 4;
+        s->scratch.resize(min<int>(get_cpu_core_count(), block_rows));
+        for (auto &scratch : s->scratch) {
+                scratch.resize((size_t) 3 * 4 * ((desc.width + 3) / 4 * 4));
+        }
+
+        return TRUE;
+}
+
+static decompress_status cpu_dxt_decompress(void *state, unsigned char *dst, unsigned char *buffer,
+                unsigned int src_len, int frame_seq, struct video_frame_callbacks *callbacks, codec_t *internal_codec)
+{
+        auto *s = static_cast<state_decompress_cpu_dxt *>(state);
+        UNUSED(frame_seq);
+        UNUSED(callbacks);
+        UNUSED(internal_codec);
+
+        if (src_len < s->compressed_len) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Frame too short (%u B, expected %zu B)!\n", src_len, s->compressed_len);
+                return DECODER_NO_FRAME;
+        }
+
+        int block_rows = (s->desc.height + 3) / 4;
+        int threads = s->scratch.size();
+        vector<dxt_decompress_job> jobs(threads);
+        for (int i = 0; i < threads; ++i) {
+                jobs[i] = { buffer, s->desc.color_spec, s->out_codec, (int) s->desc.width, (int) s->desc.height,
+                        dst, s->pitch, s->rgb_shift, s->scratch[i].data(),
+                        block_rows * i / threads, block_rows * (i + 1) / threads };
+        }
+        task_run_parallel(decompress_block_rows, threads, jobs.data(), sizeof jobs[0], nullptr);
+
+        return DECODER_GOT_FRAME;
+}
+
+static int cpu_dxt_decompress_get_property(void *state, int property, void *val, size_t *len)
+{
+        UNUSED(state);
+
+        switch (property) {
+                case DECOMPRESS_PROPERTY_ACCEPTS_CORRUPTED_FRAME:
+                        if (*len >= sizeof(int)) {
+                                *(int *) val = TRUE;
+                                *len = sizeof(int);
+                                return TRUE;
+                        }
+                        return FALSE;
+                default:
+                        return FALSE;
+        }
+}
+
+static void cpu_dxt_decompress_done(void *state)
+{
+        delete static_cast<state_decompress_cpu_dxt *>(state);
+}
+
+static const struct decode_from_to *cpu_dxt_decompress_get_decoders() {
+        // lower priority than RTDXT - it is used only if GL isn't available
+        static constexpr decode_from_to decoders[] = {
+                decode_from_to{ DXT1, VIDEO_CODEC_NONE, RGBA, 600 },
+                decode_from_to{ DXT1_YUV, VIDEO_CODEC_NONE, RGBA, 600 },
+                decode_from_to{ DXT5, VIDEO_CODEC_NONE, RGBA, 600 },
+                decode_from_to{ DXT1, VIDEO_CODEC_NONE, UYVY, 600 },
+                decode_from_to{ DXT1_YUV, VIDEO_CODEC_NONE, UYVY, 600 },
+                decode_from_to{ DXT5, VIDEO_CODEC_NONE, UYVY, 600 },
+                decode_from_to{ VIDEO_CODEC_NONE, VIDEO_CODEC_NONE, VIDEO_CODEC_NONE, 0 },
+        };
+        return decoders;
+}
+
+const struct video_decompress_info cpu_dxt_decompress_info = {
+        cpu_dxt_decompress_init,
+        cpu_dxt_decompress_reconfigure,
+        cpu_dxt_decompress,
+        cpu_dxt_decompress_get_property,
+        cpu_dxt_decompress_done,
+        cpu_dxt_decompress_get_decoders,
+};
+
+REGISTER_MODULE(cpu_dxt, &cpu_dxt_decompress_info, LIBRARY_CLASS_VIDEO_DECOMPRESS, VIDEO_DECOMPRESS_ABI_VERSION);
+
+} // end of anonymous namespace
+
+/* vim: set expandtab sw=8: */
@@ -71,13 +71,6 @@ static int configure_with(struct state_decompress_rtdxt *decompressor, struct vi
 {
         enum dxt_type type;
 
-        if(!init_gl_context(&decompressor->context, GL_CONTEXT_ANY)) {
-                fprintf(stderr, "[RTDXT decompress] Failed to create GL context.\n");
-                exit_uv(EXIT_FAILURE);
-                decompressor->compressed_len = 0;
-                return FALSE;
-        }
-
         if(desc.color_spec == DXT5) {
                 type = DXT_TYPE_DXT5_YCOCG;
         } else if(desc.color_spec == DXT1) {
@@ -114,6 +107,14 @@ static void * dxt_glsl_decompress_init(void)
         s = (struct state_decompress_rtdxt *) malloc(sizeof(struct state_decompress_rtdxt));
         s->configured = FALSE;
 
+        // created here so that the CPU decompressor (cpu_dxt) is used instead if GL isn't available
+        if(!init_gl_context(&s->context, GL_CONTEXT_ANY)) {
+                log_msg(LOG_LEVEL_WARNING, "[RTDXT decompress] Failed to create GL context.\n");
+                free(s);
+                return NULL;
+        }
+        gl_context_make_current(NULL);
+
         return s;
 }
 
@@ -128,14 +129,12 @@ static int dxt_glsl_decompress_reconfigure(void *state, struct video_desc desc,
         s->gshift = gshift;
         s->bshift = bshift;
         s->out_codec = out_codec;
-        if(!s->configured) {
-                ret = configure_with(s, desc);
-        } else {
-                gl_context_make_current(&s->context);
+        gl_context_make_current(&s->context);
+        if(s->configured) {
                 dxt_decoder_destroy(s->decoder);
-                destroy_gl_context(&s->context);
-                ret = configure_with(s, desc);
+                s->configured = FALSE;
         }
+        ret = configure_with(s, desc);
 
         gl_context_make_current(NULL);
 
@@ -225,8 +224,8 @@ static void dxt_glsl_decompress_done(void *state)
                 gl_context_make_current(&s->context);
                 dxt_decoder_destroy(s->decoder);
                 gl_context_make_current(NULL);
-                destroy_gl_context(&s->context);
         }
+        destroy_gl_context(&s->context);
         free(s);
 }
 
@@ -95,6 +95,14 @@ static int configure_with(struct state_decompress_gpujpeg *s, struct video_desc
                 gpujpeg_decoder_set_output_format(s->decoder, GPUJPEG_YCBCR_BT709,
                                 GPUJPEG_420_U8_P0P1P2);
                 break;
+        case CUDA_RGBA:
+                gpujpeg_decoder_set_output_format(s->decoder, GPUJPEG_RGB,
+                                GPUJPEG_444_U8_P012A);
+                break;
+        case CUDA_UYVY:
+                gpujpeg_decoder_set_output_format(s->decoder, GPUJPEG_YCBCR_BT709,
+                                GPUJPEG_422_U8_P1020);
+                break;
         case RGBA:
                 gpujpeg_decoder_set_output_format(s->decoder, GPUJPEG_RGB,
                                 s->out_codec == RGBA && s->rshift == 0 && s->gshift == 8 && s->bshift == 16 && vc_get_linesize(desc.width, RGBA) == s->pitch ?
@@ -149,7 +157,13 @@ static int gpujpeg_decompress_reconfigure(void *state, struct video_desc desc,
         struct state_decompress_gpujpeg *s = (struct state_decompress_gpujpeg *) state;
         
         assert(out_codec == I420 || out_codec == RGB || out_codec == RGBA
-                        || out_codec == UYVY || out_codec == VIDEO_CODEC_NONE);
+                        || out_codec == UYVY || out_codec == CUDA_RGBA || out_codec == CUDA_UYVY
+                        || out_codec == VIDEO_CODEC_NONE);
+        if (codec_is_gpu_resident(out_codec) && (pitch != vc_get_linesize(desc.width, out_codec)
+                                || (out_codec == CUDA_RGBA && (rshift != 0 || gshift != 8 || bshift != 16)))) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Output to device memory requires native pitch and RGB shifts!\n");
+                return FALSE;
+        }
 
         if(s->out_codec == out_codec &&
                         s->pitch == pitch &&
@@ -223,6 +237,12 @@ static decompress_status gpujpeg_decompress(void *state, unsigned char *dst, uns
         
         gpujpeg_set_device(cuda_devices[0]);
 
+        if (codec_is_gpu_resident(s->out_codec)) { // dst is in device memory, decoded data stay in GPU
+                gpujpeg_decoder_output_set_custom_cuda(&decoder_output, dst);
+                ret = gpujpeg_decoder_decode(s->decoder, (uint8_t*) buffer, src_len, &decoder_output);
+                return ret == 0 ? DECODER_GOT_FRAME : DECODER_NO_FRAME;
+        }
+
         if (s->pitch == linesize && (s->out_codec == UYVY || s->out_codec == RGB
                                 || (s->out_codec == RGBA && s->rshift == 0 && s->gshift == 8 && s->bshift == 16)
                         )) {
@@ -295,6 +315,13 @@ static void gpujpeg_decompress_done(void *state)
 static const struct decode_from_to *gpujpeg_decompress_get_decoders() {
         static const struct decode_from_to ret[] = {
 		{ JPEG, VIDEO_CODEC_NONE, VIDEO_CODEC_NONE, 50 }, // for probe
+                // output to CUDA device memory, if supported by display (no download)
+		{ JPEG, RGB, CUDA_RGBA, 150 },
+		{ JPEG, RGBA, CUDA_RGBA, 150 },
+		{ JPEG, UYVY, CUDA_UYVY, 150 },
+		{ JPEG, I420, CUDA_UYVY, 150 },
+		{ JPEG, VIDEO_CODEC_NONE, CUDA_RGBA, 150 },
+		{ JPEG, VIDEO_CODEC_NONE, CUDA_UYVY, 150 },
 		{ JPEG, RGB, RGB, 200 },
 		{ JPEG, RGBA, RGBA, 200 },
                 { JPEG, UYVY, UYVY, 200 },
@@ -315,6 +342,11 @@ static const struct decode_from_to *gpujpeg_decompress_get_decoders() {
                 // decoder because those files doesn't has much independent
                 // segments (1 per MCU row -> 68 for HD) -> lavd may be better
 		{ MJPG, VIDEO_CODEC_NONE, VIDEO_CODEC_NONE, 90 },
+		{ MJPG, RGB, CUDA_RGBA, 500 },
+		{ MJPG, UYVY, CUDA_UYVY, 500 },
+		{ MJPG, I420, CUDA_UYVY, 500 },
+		{ MJPG, VIDEO_CODEC_NONE, CUDA_RGBA, 500 },
+		{ MJPG, VIDEO_CODEC_NONE, CUDA_UYVY, 500 },
 		{ MJPG, RGB, RGB, 600 },
 		{ MJPG, RGB, RGBA, 600 },
 		{ MJPG, UYVY, UYVY, 600 },
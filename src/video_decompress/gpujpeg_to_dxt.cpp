@@ -54,6 +54,7 @@
 #include "host.h"
 #include "utils/synchronized_queue.h"
 #include "video.h"
+#include "video_codec.h"
 #include "video_decompress.h"
 
 #define MOD_NAME "[GPUJPEG to DXT] "
@@ -63,7 +64,7 @@ namespace {
 struct thread_data {
         thread_data() :
                 gpujpeg_decoder(0), desc(), out_codec(), ppb(), dxt_out_buff(0),
-                cuda_dev_index(-1)
+                dxt_out_buff_on_device(false), cuda_dev_index(-1)
         {}
         synchronized_queue<msg *, 1> m_in;
         // currently only for output frames
@@ -74,6 +75,7 @@ struct thread_data {
         codec_t                  out_codec;
         int                      ppb;
         char                    *dxt_out_buff;
+        bool                     dxt_out_buff_on_device; ///< for CUDA_DXT1/CUDA_DXT5, pinned host memory otherwise
 
         int                      cuda_dev_index;
 };
@@ -102,6 +104,12 @@ struct msg_frame : public msg {
         int data_len;
 };
 
+/// output frame stored in device memory of the worker (GPU-resident output)
+struct msg_frame_device : public msg {
+        explicit msg_frame_device(char *d) : data(d) {}
+        char *data;
+};
+
 struct state_decompresss_gpujpeg_to_dxt {
         struct thread_data       thread_data[MAX_CUDA_DEVICES];
         pthread_t                thread_id[MAX_CUDA_DEVICES];
@@ -118,6 +126,7 @@ struct state_decompresss_gpujpeg_to_dxt {
 } // namespace
 
 static int reconfigure_thread(struct thread_data *s, struct video_desc desc, int ppb);
+static void free_dxt_out_buff(struct thread_data *s);
 
 static void *worker_thread(void *arg)
 {
@@ -132,9 +141,9 @@ static void *worker_thread(void *arg)
                         break;
                 } else if (dynamic_cast<msg_reconfigure *>(message)) {
                         msg_reconfigure *reconf = dynamic_cast<msg_reconfigure *>(message);
+                        s->out_codec = reconf->out_codec;
                         bool ret = reconfigure_thread(s, reconf->desc, reconf->ppb);
                         s->desc = reconf->desc;
-                        s->out_codec = reconf->out_codec;
                         s->ppb = reconf->ppb;
 
                         msg_reconfigure_status *status = new msg_reconfigure_status(ret);
@@ -157,6 +166,17 @@ static void *worker_thread(void *arg)
                                                 -s->desc.height, 0);
                         }
 
+                        if (codec_is_gpu_resident(s->out_codec)) {
+                                // data remain in dxt_out_buff until next frame is passed to this thread
+                                if (cuda_wrapper_device_synchronize() != CUDA_WRAPPER_SUCCESS) {
+                                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "DXT compression failed: %s\n",
+                                                        cuda_wrapper_last_error_string());
+                                }
+                                s->m_out.push(new msg_frame_device(s->dxt_out_buff));
+                                delete frame_msg;
+                                continue;
+                        }
+
                         msg_frame *output_frame = new msg_frame(s->desc.width * s->desc.height / s->ppb);
 
                         if (cuda_wrapper_memcpy((char*) output_frame->data, s->dxt_out_buff,
@@ -175,7 +195,7 @@ static void *worker_thread(void *arg)
                 gpujpeg_decoder_destroy(s->gpujpeg_decoder);
         }
 
-        cuda_wrapper_free(s->dxt_out_buff);
+        free_dxt_out_buff(s);
 
         return NULL;
 }
@@ -213,9 +233,7 @@ static void flush(struct state_decompresss_gpujpeg_to_dxt *s)
                 for (unsigned int i = 0; i < cuda_devices_count; ++i) {
                         if (i == s->free)
                                 continue;
-                        struct msg_frame *completed =
-                                dynamic_cast<msg_frame *>(s->thread_data[(s->free+1)%cuda_devices_count].m_out.pop());
-                        delete completed;
+                        delete s->thread_data[(s->free+1)%cuda_devices_count].m_out.pop();
                 }
                 s->occupied_count = 0;
         }
@@ -236,8 +254,8 @@ static int gpujpeg_to_dxt_decompress_reconfigure(void *state, struct video_desc
         UNUSED(rshift);
         UNUSED(gshift);
         UNUSED(bshift);
-        assert(out_codec == DXT1 || out_codec == DXT5);
-        if(out_codec == DXT1) {
+        assert(out_codec == DXT1 || out_codec == DXT5 || out_codec == CUDA_DXT1 || out_codec == CUDA_DXT5);
+        if(out_codec == DXT1 || out_codec == CUDA_DXT1) {
                 s->ppb = 2;
         } else { // DXT5
                 s->ppb = 1;
@@ -268,6 +286,19 @@ static int gpujpeg_to_dxt_decompress_reconfigure(void *state, struct video_desc
         return TRUE;
 }
 
+static void free_dxt_out_buff(struct thread_data *s)
+{
+        if (s->dxt_out_buff == NULL) {
+                return;
+        }
+        if (s->dxt_out_buff_on_device) {
+                cuda_wrapper_free(s->dxt_out_buff);
+        } else {
+                cuda_wrapper_free_host(s->dxt_out_buff);
+        }
+        s->dxt_out_buff = NULL;
+}
+
 /**
  * @return maximal buffer size needed to image with such a properties
  */
@@ -280,12 +311,12 @@ static int reconfigure_thread(struct thread_data *s, struct video_desc desc, int
                 gpujpeg_init_device(cuda_devices[s->cuda_dev_index], 0);
         }
 
-        if(s->dxt_out_buff != NULL) {
-                cuda_wrapper_free(s->dxt_out_buff);
-                s->dxt_out_buff = NULL;
-        }
+        free_dxt_out_buff(s);
 
-        if(cuda_wrapper_malloc_host((void **) &s->dxt_out_buff, desc.width * desc.height / ppb)
+        s->dxt_out_buff_on_device = codec_is_gpu_resident(s->out_codec);
+        if((s->dxt_out_buff_on_device ?
+                                cuda_wrapper_malloc((void **) &s->dxt_out_buff, desc.width * desc.height / ppb) :
+                                cuda_wrapper_malloc_host((void **) &s->dxt_out_buff, desc.width * desc.height / ppb))
                         != CUDA_WRAPPER_SUCCESS) {
                 fprintf(stderr, "Could not allocate CUDA output buffer.\n");
                 return false;
@@ -323,10 +354,19 @@ static decompress_status gpujpeg_to_dxt_decompress(void *state, unsigned char *d
 
                 s->free = (s->free + 1) % cuda_devices_count;
 
-                struct msg_frame *completed =
-                        dynamic_cast<msg_frame *>(s->thread_data[s->free].m_out.pop());
-                assert(completed != NULL);
-                memcpy(dst, completed->data, s->desc.width * s->desc.height / s->ppb);
+                msg *completed = s->thread_data[s->free].m_out.pop();
+                if (auto *completed_dev = dynamic_cast<msg_frame_device *>(completed)) {
+                        // dst is in device memory as well (see codec_is_gpu_resident())
+                        if (cuda_wrapper_memcpy(dst, completed_dev->data, s->desc.width * s->desc.height / s->ppb,
+                                                CUDA_WRAPPER_MEMCPY_DEVICE_TO_DEVICE) != CUDA_WRAPPER_SUCCESS) {
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "unable to copy to output buffer: %s\n",
+                                                cuda_wrapper_last_error_string());
+                        }
+                } else {
+                        auto *completed_host = dynamic_cast<msg_frame *>(completed);
+                        assert(completed_host != NULL);
+                        memcpy(dst, completed_host->data, s->desc.width * s->desc.height / s->ppb);
+                }
 
                 delete completed;
         }
@@ -368,6 +408,8 @@ static void gpujpeg_to_dxt_decompress_done(void *state)
 
 static const struct decode_from_to *gpujpeg_to_dxt_decompress_get_decoders() {
         static const struct decode_from_to ret[] = {
+		{ JPEG, VIDEO_CODEC_NONE, CUDA_DXT1, 850 }, // no host round-trip if display supports it
+		{ JPEG, VIDEO_CODEC_NONE, CUDA_DXT5, 850 },
 		{ JPEG, VIDEO_CODEC_NONE, DXT1, 900 },
 		{ JPEG, VIDEO_CODEC_NONE, DXT5, 900 },
 		{ VIDEO_CODEC_NONE, VIDEO_CODEC_NONE, VIDEO_CODEC_NONE, 0 },
@@ -50,6 +50,7 @@
 #include "tv.h"
 #include "rtp/rtpdec_h264.h"
 #include "rtp/rtpenc_h264.h"
+#include "utils/jpeg_reader.h"
 #include "utils/misc.h" // get_cpu_core_count()
 #include "utils/worker.h"
 #include "video.h"
@@ -70,6 +71,7 @@
 #include "hwaccel_videotoolbox.h"
 
 #define MOD_NAME "[lavd] "
+#define MAX_RESTART_PARTS 32
 
 struct state_libavcodec_decompress {
         AVCodecContext  *codec_ctx;
@@ -82,7 +84,7 @@ struct state_libavcodec_decompress {
         int              max_compressed_len;
         codec_t          internal_codec;
         codec_t          out_codec;
-        bool             blacklist_vdpau;
+        bool             blacklist_hw_surface;
         bool             block_accel[HWACCEL_COUNT];
         int              consecutive_failed_decodes;
 
@@ -103,10 +105,51 @@ struct state_libavcodec_decompress {
         struct hw_accel_state hwaccel;
 
         _Bool h264_sps_found; ///< to avoid initial error flood, start decoding after SPS was received
+
+        /// conversion of decoded bands fused with decoding, see draw_horiz_band_callback()
+        struct {
+                pthread_mutex_t lock;
+                unsigned char *dst;        ///< output buffer, set only while the decoder runs
+                const uint8_t *frame_data; ///< data[0] of the frame being converted
+                av_to_uv_convert_p convert;
+                int rows_done;
+                bool failed;               ///< bands not usable for current frame, use full-frame conversion
+        } band;
+
+        /// decoding straight to the output buffer, see get_buffer2_callback()
+        struct {
+                bool enabled;       ///< intra-only codec, not disabled by the user
+                unsigned char *dst; ///< output buffer, set only while the decoder runs
+        } dr;
+
+        /// parallel decoding of JPEG stripes split at restart markers, see restart_split_decode()
+        struct {
+                int count; ///< number of initialized decoders
+                AVCodecContext *ctx[MAX_RESTART_PARTS];
+                AVFrame *frame[MAX_RESTART_PARTS];
+                AVPacket *pkt[MAX_RESTART_PARTS];
+                uint8_t *buf;
+                int buf_len;
+                bool disabled; ///< stream cannot be split, decode whole frames
+        } rst;
 };
 
 static enum AVPixelFormat get_format_callback(struct AVCodecContext *s, const enum AVPixelFormat *fmt);
 
+static void restart_split_cleanup(struct state_libavcodec_decompress *s)
+{
+        for (int i = 0; i < s->rst.count; ++i) {
+                avcodec_free_context(&s->rst.ctx[i]);
+                av_frame_free(&s->rst.frame[i]);
+                av_packet_free(&s->rst.pkt[i]);
+        }
+        s->rst.count = 0;
+        free(s->rst.buf);
+        s->rst.buf = NULL;
+        s->rst.buf_len = 0;
+        s->rst.disabled = false;
+}
+
 static void deconfigure(struct state_libavcodec_decompress *s)
 {
 #if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(57, 37, 100)
@@ -137,6 +180,7 @@ static void deconfigure(struct state_libavcodec_decompress *s)
         av_packet_free(&s->pkt);
 
         hwaccel_state_reset(&s->hwaccel);
+        restart_split_cleanup(s);
 
 #ifdef HAVE_SWSCALE
         s->sws.ctx = NULL;
@@ -253,10 +297,150 @@ ADD_TO_PARAM("force-lavd-decoder", "* force-lavd-decoder=<decoder>[:<decoder2>..
                 "  Forces specified Libavcodec decoder. If more need to be specified, use colon as a delimiter.\n"
                 "  Use '-c libavcodec:help' to see available decoders.\n");
 
+static av_to_uv_convert_p get_band_convert(enum AVPixelFormat av_codec, codec_t out_codec)
+{
+        const AVPixFmtDescriptor *fmt_desc = av_pix_fmt_desc_get(av_codec);
+        if (fmt_desc == NULL || (fmt_desc->flags & AV_PIX_FMT_FLAG_HWACCEL) != 0 ||
+                        codec_is_const_size(out_codec) || get_av_to_ug_pixfmt(av_codec) == out_codec) {
+                return NULL;
+        }
+        for (const struct av_to_uv_conversion *c = get_av_to_uv_conversions(); c->uv_codec != VIDEO_CODEC_NONE; c++) {
+                if (c->av_codec == av_codec && c->uv_codec == out_codec) {
+                        return c->convert;
+                }
+        }
+        return NULL;
+}
+
+/**
+ * Converts a band of the frame to the output buffer as soon as it is decoded
+ * so that the conversion overlaps with decoding of the rest of the frame and
+ * it is done while the band is still in cache. If all rows of the output frame
+ * were converted this way, the full-frame conversion is skipped, otherwise
+ * (field pictures, frame reordering, bands of another frame) the band state
+ * is marked as failed and the frame is converted as usual.
+ *
+ * May be called from multiple decoder threads at once.
+ */
+static void draw_horiz_band_callback(struct AVCodecContext *ctx, const AVFrame *src,
+                int offset[AV_NUM_DATA_POINTERS], int y, int type, int height)
+{
+        struct state_libavcodec_decompress *s = (struct state_libavcodec_decompress *) ctx->opaque;
+
+        pthread_mutex_lock(&s->band.lock);
+        bool usable = s->band.dst != NULL && !s->band.failed && type == 3 /* whole frame */ &&
+                ctx->has_b_frames == 0 && (ctx->active_thread_type & FF_THREAD_FRAME) == 0 &&
+                src->width == (int) s->desc.width && src->height == (int) s->desc.height &&
+                y % 2 == 0 && (height % 2 == 0 || y + height == src->height); // 4:2:0 converts line pairs
+        if (usable && s->band.frame_data == NULL) {
+                s->band.frame_data = src->data[0];
+                s->band.convert = get_band_convert(src->format, s->out_codec);
+        }
+        usable = usable && s->band.frame_data == src->data[0] && s->band.convert != NULL;
+        if (!usable) {
+                s->band.failed = true;
+        }
+        unsigned char *dst = s->band.dst;
+        pthread_mutex_unlock(&s->band.lock);
+        if (!usable) {
+                return;
+        }
+
+        AVFrame part;
+        memcpy(part.linesize, src->linesize, sizeof part.linesize);
+        for (int plane = 0; plane < AV_NUM_DATA_POINTERS; ++plane) {
+                part.data[plane] = src->data[plane] == NULL ? NULL : src->data[plane] + offset[plane];
+        }
+        s->band.convert((char *) dst + y * s->pitch, &part, s->desc.width, height, s->pitch, s->rgb_shift);
+
+        pthread_mutex_lock(&s->band.lock);
+        s->band.rows_done += height;
+        pthread_mutex_unlock(&s->band.lock);
+}
+
+/// @param dst output buffer for the bands decoded from now on, NULL when decoding ends
+static void band_convert_set_dst(struct state_libavcodec_decompress *s, unsigned char *dst)
+{
+        pthread_mutex_lock(&s->band.lock);
+        s->band.dst = dst;
+        if (dst != NULL) {
+                s->band.frame_data = NULL;
+                s->band.rows_done = 0;
+                s->band.failed = false;
+        }
+        pthread_mutex_unlock(&s->band.lock);
+}
+
+/// @returns true if the whole frame was already converted by draw_horiz_band_callback()
+static bool band_convert_done(struct state_libavcodec_decompress *s, const AVFrame *frame)
+{
+        pthread_mutex_lock(&s->band.lock);
+        bool ret = !s->band.failed && s->band.frame_data == frame->data[0] && s->band.rows_done == (int) s->desc.height;
+        s->band.frame_data = NULL;
+        s->band.rows_done = 0;
+        pthread_mutex_unlock(&s->band.lock);
+        return ret;
+}
+
+#define DR_PTR_ALIGN 64 ///< max SIMD alignment that decoders may expect of data pointers
+
+static void dr_buffer_free(void *opaque, uint8_t *data)
+{
+        UNUSED(opaque);
+        UNUSED(data);
+}
+
+/**
+ * Lets the decoder decode straight to the output buffer if the decoded pixel
+ * format is the requested one, so that the frame is not copied afterwards.
+ * The output buffer must satisfy the decoder's alignment requirements
+ * including the padded dimensions, otherwise (and for other pixel formats)
+ * the default (pooled) allocator is used.
+ *
+ * Installed only for intra-only decoders without frame threading - the
+ * decoder then never reads the picture again nor returns it after the
+ * decompress call, which is when the output buffer is handed to the display.
+ */
+static int get_buffer2_callback(struct AVCodecContext *ctx, AVFrame *frame, int flags)
+{
+        struct state_libavcodec_decompress *s = (struct state_libavcodec_decompress *) ctx->opaque;
+        unsigned char *dst = s->dr.dst;
+
+        if (dst == NULL || get_av_to_ug_pixfmt(frame->format) != s->out_codec || codec_is_planar(s->out_codec) ||
+                        frame->width != (int) s->desc.width || frame->height != (int) s->desc.height ||
+                        s->rgb_shift[0] != 0 || s->rgb_shift[1] != 8 || s->rgb_shift[2] != 16) {
+                return avcodec_default_get_buffer2(ctx, frame, flags);
+        }
+
+        int width = frame->width;
+        int height = frame->height;
+        int linesize_align[AV_NUM_DATA_POINTERS];
+        avcodec_align_dimensions2(ctx, &width, &height, linesize_align);
+        if (height != frame->height || vc_get_linesize(width, s->out_codec) > s->pitch ||
+                        s->pitch % linesize_align[0] != 0 || (uintptr_t) dst % DR_PTR_ALIGN != 0) {
+                log_msg_once(LOG_LEVEL_VERBOSE, to_fourcc('L', 'D', 'D', 'R'), MOD_NAME "Output buffer layout "
+                                "doesn't allow direct rendering, decoded frames will be copied.\n");
+                return avcodec_default_get_buffer2(ctx, frame, flags);
+        }
+
+        frame->buf[0] = av_buffer_create(dst, s->pitch * height, dr_buffer_free, NULL, 0);
+        if (frame->buf[0] == NULL) {
+                return AVERROR(ENOMEM);
+        }
+        frame->data[0] = dst;
+        frame->linesize[0] = s->pitch;
+        frame->extended_data = frame->data;
+        return 0;
+}
+
 #ifdef HWACC_COMMON_IMPL
 ADD_TO_PARAM("use-hw-accel", "* use-hw-accel\n"
                 "  Tries to use hardware acceleration. \n");
 #endif
+ADD_TO_PARAM("lavd-fused-convert", "* lavd-fused-convert=no\n"
+                "  Do not convert decoded bands of the frame while the rest is being decoded.\n");
+ADD_TO_PARAM("lavd-direct-rendering", "* lavd-direct-rendering=no\n"
+                "  Do not let intra-only decoders decode directly to the display buffer.\n");
 static bool configure_with(struct state_libavcodec_decompress *s,
                 struct video_desc desc, void *extradata, int extradata_size)
 {
@@ -362,6 +546,24 @@ static bool configure_with(struct state_libavcodec_decompress *s,
                 log_msg(LOG_LEVEL_NOTICE, "[lavd] Using decoder: %s\n", (*codec_it)->name);
                 log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Codec %s capabilities: 0x%08X; using thread type %d, count %d\n",
                                 (*codec_it)->name, (*codec_it)->capabilities, s->codec_ctx->thread_type, s->codec_ctx->thread_count);
+                const char *fused = get_commandline_param("lavd-fused-convert");
+                // frame threads would call the callback after the decompress call returned
+                if (((*codec_it)->capabilities & AV_CODEC_CAP_DRAW_HORIZ_BAND) != 0 &&
+                                (s->codec_ctx->active_thread_type & FF_THREAD_FRAME) == 0 &&
+                                (fused == NULL || strcmp(fused, "no") != 0)) {
+                        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Converting decoded bands during decoding.\n");
+                        s->codec_ctx->draw_horiz_band = draw_horiz_band_callback;
+                }
+                const AVCodecDescriptor *codec_desc = avcodec_descriptor_get((*codec_it)->id);
+                const char *dr = get_commandline_param("lavd-direct-rendering");
+                s->dr.enabled = ((*codec_it)->capabilities & AV_CODEC_CAP_DR1) != 0 &&
+                                codec_desc != NULL && (codec_desc->props & AV_CODEC_PROP_INTRA_ONLY) != 0 &&
+                                (s->codec_ctx->active_thread_type & FF_THREAD_FRAME) == 0 &&
+                                (dr == NULL || strcmp(dr, "no") != 0);
+                if (s->dr.enabled) {
+                        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Decoding directly to the output buffer if pixel formats match.\n");
+                        s->codec_ctx->get_buffer2 = get_buffer2_callback;
+                }
                 break;
         }
 
@@ -405,6 +607,7 @@ static void * libavcodec_decompress_init(void)
         s->pkt->size = 0;
 
         hwaccel_state_init(&s->hwaccel);
+        pthread_mutex_init(&s->band.lock, NULL);
 
         return s;
 }
@@ -420,7 +623,7 @@ static int libavcodec_decompress_reconfigure(void *state, struct video_desc desc
         s->rgb_shift[G] = gshift;
         s->rgb_shift[B] = bshift;
         s->internal_codec = VIDEO_CODEC_NONE;
-        s->blacklist_vdpau = false;
+        s->blacklist_hw_surface = false;
         for(int i = 0; i < HWACCEL_COUNT; i++){
                 s->block_accel[i] = false;
         }
@@ -501,20 +704,21 @@ static enum AVPixelFormat get_format_callback(struct AVCodecContext *s, const en
                 enum AVPixelFormat pix_fmt;
                 enum hw_accel_type accel_type;
                 int (*init_func)(AVCodecContext *, struct hw_accel_state *, codec_t);
+                codec_t hw_codec; ///< UG codec carrying the surface without download (if any)
         } accels[] = {
 #ifdef HWACC_VDPAU
-                {AV_PIX_FMT_VDPAU, HWACCEL_VDPAU, vdpau_init},
+                {AV_PIX_FMT_VDPAU, HWACCEL_VDPAU, vdpau_init, HW_VDPAU},
 #endif
 #ifdef HWACC_VAAPI
-                {AV_PIX_FMT_VAAPI, HWACCEL_VAAPI, vaapi_init},
+                {AV_PIX_FMT_VAAPI, HWACCEL_VAAPI, vaapi_init, HW_VAAPI},
 #endif
 #ifdef HAVE_MACOSX
-                {AV_PIX_FMT_VIDEOTOOLBOX, HWACCEL_VIDEOTOOLBOX, videotoolbox_init},
+                {AV_PIX_FMT_VIDEOTOOLBOX, HWACCEL_VIDEOTOOLBOX, videotoolbox_init, VIDEO_CODEC_NONE},
 #endif
 #ifdef HWACCEL_RPI4
-                {AV_PIX_FMT_RPI4_8, HWACCEL_RPI4, rpi4_hwacc_init},
+                {AV_PIX_FMT_RPI4_8, HWACCEL_RPI4, rpi4_hwacc_init, VIDEO_CODEC_NONE},
 #endif
-                {AV_PIX_FMT_NONE, HWACCEL_NONE, NULL}
+                {AV_PIX_FMT_NONE, HWACCEL_NONE, NULL, VIDEO_CODEC_NONE}
         };
 
         if (hwaccel && state->out_codec != VIDEO_CODEC_NONE) { // not probing internal format
@@ -526,6 +730,9 @@ static enum AVPixelFormat get_format_callback(struct AVCodecContext *s, const en
                 }
                 for(const enum AVPixelFormat *it = fmt; *it != AV_PIX_FMT_NONE; it++){
                         for(unsigned i = 0; i < sizeof(accels) / sizeof(accels[0]); i++){
+                                if (codec_is_hw_accelerated(state->out_codec) && accels[i].hw_codec != state->out_codec) {
+                                        continue; // surface of another API would not be understood by the display
+                                }
                                 if(*it == accels[i].pix_fmt && !state->block_accel[accels[i].accel_type])
                                 {
                                         int ret = accels[i].init_func(s, &state->hwaccel, state->out_codec);
@@ -538,8 +745,8 @@ static enum AVPixelFormat get_format_callback(struct AVCodecContext *s, const en
                         }
                 }
                 log_msg(LOG_LEVEL_WARNING, "[lavd] Falling back to software decoding!\n");
-                if (state->out_codec == HW_VDPAU) {
-                        state->blacklist_vdpau = true;
+                if (codec_is_hw_accelerated(state->out_codec)) {
+                        state->blacklist_hw_surface = true;
                         return AV_PIX_FMT_NONE;
                 }
         }
@@ -702,7 +909,7 @@ static void parallel_convert(av_to_uv_convert_p convert, char *dst, AVFrame *in,
                 }
                 d[i] = (struct convert_task_data){convert, part_dst, &parts[i], width, row_height, pitch, rgb_shift};
         }
-        task_run_parallel(convert_task, cpu_count, d, sizeof d[0], NULL);
+        task_run_parallel_pinned(convert_task, cpu_count, d, sizeof d[0], NULL);
 }
 
 /**
@@ -729,7 +936,14 @@ static int change_pixfmt(AVFrame *frame, unsigned char *dst, int av_codec, codec
 
         if (get_av_to_ug_pixfmt(av_codec) == out_codec) {
                 if (!codec_is_planar(out_codec)) {
-                        memcpy(dst, frame->data[0], vc_get_datalen(width, height, out_codec));
+                        int linesize = vc_get_linesize(width, out_codec);
+                        if (frame->linesize[0] == linesize && pitch == linesize) {
+                                memcpy(dst, frame->data[0], vc_get_datalen(width, height, out_codec));
+                        } else {
+                                for (int y = 0; y < height; ++y) {
+                                        memcpy(dst + y * pitch, frame->data[0] + y * frame->linesize[0], linesize);
+                                }
+                        }
                         return TRUE;
                 }
                 log_msg(LOG_LEVEL_ERROR, MOD_NAME "Planar pixfmts not support here, please report a bug!\n");
@@ -828,6 +1042,132 @@ static _Bool check_first_h264_sps(struct state_libavcodec_decompress *s, unsigne
         return 0;
 }
 
+ADD_TO_PARAM("lavd-jpeg-split", "* lavd-jpeg-split=no\n"
+                "  Do not decode JPEG stripes delimited by restart markers in parallel.\n");
+
+struct restart_part_task {
+        AVCodecContext *ctx;
+        AVFrame *frame;
+        AVPacket *pkt;
+        struct jpeg_part part;
+        unsigned char *dst;
+        codec_t out_codec;
+        int width;
+        int pitch;
+        int *rgb_shift;
+        enum { PART_OK, PART_DECODE_ERROR, PART_NO_CONVERSION } status;
+};
+
+static void *restart_part_decode(void *arg)
+{
+        struct restart_part_task *t = arg;
+        t->pkt->data = t->part.data;
+        t->pkt->size = t->part.len;
+        t->status = PART_DECODE_ERROR;
+        int ret = avcodec_send_packet(t->ctx, t->pkt);
+        if (ret == 0) {
+                ret = avcodec_receive_frame(t->ctx, t->frame);
+        }
+        if (ret != 0 || t->frame->width != t->width || t->frame->height != t->part.height) {
+                return NULL;
+        }
+        av_to_uv_convert_p convert = get_band_convert(t->frame->format, t->out_codec);
+        if (convert == NULL) {
+                t->status = PART_NO_CONVERSION;
+                return NULL;
+        }
+        convert((char *) t->dst + t->part.y * t->pitch, t->frame, t->width, t->part.height, t->pitch, t->rgb_shift);
+        t->status = PART_OK;
+        return NULL;
+}
+
+static bool restart_split_init(struct state_libavcodec_decompress *s, int count)
+{
+        const AVCodec *codec = avcodec_find_decoder(AV_CODEC_ID_MJPEG);
+        if (codec == NULL) {
+                return false;
+        }
+        for ( ; s->rst.count < count; s->rst.count++) {
+                int i = s->rst.count;
+                s->rst.ctx[i] = avcodec_alloc_context3(codec);
+                s->rst.frame[i] = av_frame_alloc();
+                s->rst.pkt[i] = av_packet_alloc();
+                if (s->rst.ctx[i] == NULL || s->rst.frame[i] == NULL || s->rst.pkt[i] == NULL) {
+                        s->rst.count++; // free in cleanup
+                        return false;
+                }
+                s->rst.ctx[i]->thread_count = 1; // parallelized by stripes
+                s->rst.ctx[i]->flags2 |= AV_CODEC_FLAG2_FAST;
+                if (avcodec_open2(s->rst.ctx[i], codec, NULL) < 0) {
+                        s->rst.count++;
+                        return false;
+                }
+        }
+        return true;
+}
+
+/**
+ * Decodes JPEG (eg. from GPUJPEG) that has restart intervals by splitting it
+ * to horizontal stripes at restart markers (jpeg_split_restart()) that are
+ * decoded and converted concurrently by separate single-threaded decoder
+ * instances. The libavcodec MJPEG decoder alone uses one thread per frame.
+ *
+ * @retval true  frame was handled, *res is set
+ * @retval false frame cannot be decoded this way, use the generic path
+ */
+static bool restart_split_decode(struct state_libavcodec_decompress *s, unsigned char *dst,
+                unsigned char *src, unsigned int src_len, decompress_status *res)
+{
+        if (s->rst.disabled) {
+                return false;
+        }
+        const char *param = get_commandline_param("lavd-jpeg-split");
+        int max_parts = MIN(get_cpu_core_count(), MAX_RESTART_PARTS);
+        if ((param != NULL && strcmp(param, "no") == 0) || max_parts < 2 || s->out_codec == VIDEO_CODEC_NONE
+                        || codec_is_hw_accelerated(s->out_codec) || codec_is_const_size(s->out_codec)) {
+                s->rst.disabled = true;
+                return false;
+        }
+
+        struct jpeg_part parts[MAX_RESTART_PARTS];
+        int count = jpeg_split_restart(src, src_len, max_parts, &s->rst.buf, &s->rst.buf_len, parts);
+        if (count == 0) {
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "JPEG cannot be split at restart markers, decoding whole frames.\n");
+                s->rst.disabled = true;
+                return false;
+        }
+        if (s->rst.count < count && !restart_split_init(s, count)) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Cannot initialize JPEG stripe decoders.\n");
+                s->rst.disabled = true;
+                return false;
+        }
+
+        struct restart_part_task tasks[MAX_RESTART_PARTS];
+        for (int i = 0; i < count; ++i) {
+                tasks[i] = (struct restart_part_task){ s->rst.ctx[i], s->rst.frame[i], s->rst.pkt[i], parts[i],
+                        dst, s->out_codec, s->desc.width, s->pitch, s->rgb_shift, PART_OK };
+        }
+        task_run_parallel(restart_part_decode, count, tasks, sizeof tasks[0], NULL);
+
+        *res = DECODER_GOT_FRAME;
+        for (int i = 0; i < count; ++i) {
+                if (tasks[i].status == PART_NO_CONVERSION) {
+                        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "No direct conversion from %s to %s for JPEG stripes.\n",
+                                        av_get_pix_fmt_name(tasks[i].frame->format), get_codec_name(s->out_codec));
+                        s->rst.disabled = true;
+                        return false;
+                }
+                if (tasks[i].status == PART_DECODE_ERROR) {
+                        *res = DECODER_NO_FRAME;
+                }
+        }
+        if (*res == DECODER_NO_FRAME) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Error while decoding JPEG stripes.\n");
+        }
+        log_msg(LOG_LEVEL_DEBUG, MOD_NAME "Decoded JPEG in %d stripes.\n", count);
+        return true;
+}
+
 static decompress_status libavcodec_decompress(void *state, unsigned char *dst, unsigned char *src,
                 unsigned int src_len, int frame_seq, struct video_frame_callbacks *callbacks, codec_t *internal_codec)
 {
@@ -848,6 +1188,15 @@ static decompress_status libavcodec_decompress(void *state, unsigned char *dst,
                 src_len -= extradata_size + sizeof(uint32_t);
         }
 
+        if ((s->desc.color_spec == JPEG || s->desc.color_spec == MJPG) &&
+                        restart_split_decode(s, dst, src, src_len, &res)) {
+                if (res == DECODER_GOT_FRAME) {
+                        s->last_frame_seq_initialized = true;
+                        s->last_frame_seq = frame_seq;
+                }
+                return res;
+        }
+
         s->pkt->size = src_len;
         s->pkt->data = src;
 
@@ -855,6 +1204,8 @@ static decompress_status libavcodec_decompress(void *state, unsigned char *dst,
                 int len;
                 struct timeval t0, t1;
                 gettimeofday(&t0, NULL);
+                band_convert_set_dst(s, s->out_codec != VIDEO_CODEC_NONE ? dst : NULL);
+                s->dr.dst = s->dr.enabled && s->out_codec != VIDEO_CODEC_NONE ? dst : NULL;
 #if LIBAVCODEC_VERSION_INT < AV_VERSION_INT(57, 37, 100)
                 len = avcodec_decode_video2(s->codec_ctx, s->frame, &got_frame, s->pkt);
 #else
@@ -880,14 +1231,16 @@ static decompress_status libavcodec_decompress(void *state, unsigned char *dst,
                                         s->block_accel[s->hwaccel.type] = true;
                                         deconfigure(s);
                                         configure_with(s, s->desc, NULL, 0);
-                                        if(s->out_codec == HW_VDPAU){
-                                                s->blacklist_vdpau = true;
+                                        if(codec_is_hw_accelerated(s->out_codec)){
+                                                s->blacklist_hw_surface = true;
                                         }
                                 }
                         }
                 }
                 len = s->pkt->size;
 #endif
+                band_convert_set_dst(s, NULL);
+                s->dr.dst = NULL;
                 gettimeofday(&t1, NULL);
 
                 /*
@@ -936,7 +1289,9 @@ static decompress_status libavcodec_decompress(void *state, unsigned char *dst,
 #endif
 
                                 if (s->out_codec != VIDEO_CODEC_NONE) {
-                                        bool ret = change_pixfmt(s->frame, dst, s->frame->format, s->out_codec, s->desc.width,
+                                        bool ret = s->frame->data[0] == dst || // decoded directly
+                                                band_convert_done(s, s->frame) ||
+                                                change_pixfmt(s->frame, dst, s->frame->format, s->out_codec, s->desc.width,
                                                         s->desc.height, s->pitch, s->rgb_shift, &s->sws);
                                         if(ret == TRUE) {
                                                 s->last_frame_seq_initialized = true;
@@ -979,9 +1334,9 @@ static decompress_status libavcodec_decompress(void *state, unsigned char *dst,
                 return DECODER_CANT_DECODE;
         }
 
-        if (s->blacklist_vdpau) {
-                assert(s->out_codec == HW_VDPAU);
-                s->blacklist_vdpau = false;
+        if (s->blacklist_hw_surface) {
+                assert(codec_is_hw_accelerated(s->out_codec));
+                s->blacklist_hw_surface = false;
                 return DECODER_CANT_DECODE;
         }
 
@@ -1035,6 +1390,7 @@ static void libavcodec_decompress_done(void *state)
                 (struct state_libavcodec_decompress *) state;
 
         deconfigure(s);
+        pthread_mutex_destroy(&s->band.lock);
 
         free(s);
 }
@@ -1122,6 +1478,12 @@ static const struct decode_from_to *libavcodec_decompress_get_decoders() {
                         (struct decode_from_to) {H264, VIDEO_CODEC_NONE, HW_VDPAU, 200};
                 ret[ret_idx++] =
                         (struct decode_from_to) {H265, VIDEO_CODEC_NONE, HW_VDPAU, 200};
+#ifdef HWACC_VAAPI
+                ret[ret_idx++] =
+                        (struct decode_from_to) {H264, VIDEO_CODEC_NONE, HW_VAAPI, 200};
+                ret[ret_idx++] =
+                        (struct decode_from_to) {H265, VIDEO_CODEC_NONE, HW_VAAPI, 200};
+#endif
                 ret[ret_idx++] =
                         (struct decode_from_to) {H265, VIDEO_CODEC_NONE, RPI4_8, 200};
         }
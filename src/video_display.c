@@ -68,11 +68,15 @@
 #include "tv.h"
 #include "utils/thread.h"
 #include "utils/color_out.h"
+#include "utils/macros.h"
+#include "utils/profile_timer.hpp"
 #include "video.h"
 #include "video_display.h"
 #include "vo_postprocess.h"
 
 #define DISPLAY_MAGIC 0x01ba7ef1
+#define DEFAULT_SCHED_TOLERANCE_MS 5
+#define MAX_SCHED_WAIT_NS NS_IN_SEC ///< longer waits are considered a wrong deadline
 
 /// @brief This struct represents initialized video display state.
 struct display {
@@ -85,12 +89,22 @@ struct display {
         _Bool thread_started;
 
         struct vo_postprocess_state *postprocess;
+        bool pp_bypass; ///< postprocess work (scaling, cropping) is done by the display itself
+        bool pp_in_place; ///< postprocess is run directly on the display framebuffer
+        bool pp_crop_set; ///< the display has been asked to crop, see @ref DISPLAY_PROPERTY_CROP
         int pp_output_frames_count, display_pitch;
         struct video_desc saved_desc;
         enum video_mode saved_mode;
 
         time_ns_t t0;
         int frames;
+
+        /// frame scheduling by deadline (video_frame::deadline), see display_sched_frame()
+        struct {
+                bool enabled;
+                long long tolerance_ns; ///< how late may the frame be to be still displayed
+                int dropped;            ///< late frames dropped (since last FPS report)
+        } sched;
 };
 
 /**This variable represents a pseudostate and may be returned when initialization
@@ -172,6 +186,14 @@ int initialize_video_display(struct module *parent, const char *requested_displa
 
         d->t0 = get_time_in_ns();
         d->display_name = strdup(requested_display);
+        if (get_commandline_param("display-scheduler") != NULL) {
+                d->sched.enabled = true;
+                const char *tolerance = get_commandline_param("display-scheduler");
+                d->sched.tolerance_ns = (strlen(tolerance) > 0 ? atof(tolerance) : DEFAULT_SCHED_TOLERANCE_MS) * NS_IN_SEC_DBL / 1000;
+        } else if (get_commandline_param("ptp-playout") != NULL) { // synchronized playout needs the scheduling
+                d->sched.enabled = true;
+                d->sched.tolerance_ns = DEFAULT_SCHED_TOLERANCE_MS * NS_IN_SEC_DBL / 1000;
+        }
 
         *out = d;
         return 0;
@@ -343,13 +365,53 @@ struct video_frame *display_get_frame(struct display *d)
         }
 
         assert(d->magic == DISPLAY_MAGIC);
-        if (d->postprocess) {
+        if (d->postprocess && !d->pp_bypass && !d->pp_in_place) {
                 return vo_postprocess_getf(d->postprocess);
         } else {
                 return d->funcs->getf(d->state);
         }
 }
 
+ADD_TO_PARAM("display-scheduler", "* display-scheduler[=<tolerance_ms>]\n"
+                "  Schedule received frames to their presentation time (RTP timestamp + playout\n"
+                "  delay) - frames later than tolerance (default " TOSTRING(DEFAULT_SCHED_TOLERANCE_MS) " ms) are dropped, early\n"
+                "  ones are held so that at most one frame is queued in the display.\n");
+
+/**
+ * @returns true if the display scheduler is enabled and the frame has already
+ * missed its deadline (and would be dropped by display_put_frame())
+ */
+bool display_frame_is_late(struct display *d, const struct video_frame *frame)
+{
+        return d->sched.enabled && frame->deadline != 0
+                && get_time_in_ns() > frame->deadline + d->sched.tolerance_ns;
+}
+
+/**
+ * Schedules the frame according to its deadline. The frame is held until one
+ * frame interval before the deadline, so that the display (presenting frames
+ * at vsync) has at most one frame queued ahead, and late frames are dropped.
+ * Thus a burst of delayed frames doesn't accumulate latency.
+ *
+ * @retval false the frame should be dropped
+ */
+static bool display_sched_frame(struct display *d, const struct video_frame *frame)
+{
+        if (!d->sched.enabled || frame->deadline == 0) {
+                return true;
+        }
+        if (display_frame_is_late(d, frame)) {
+                d->sched.dropped += 1;
+                return false;
+        }
+        long long frame_ns = frame->fps > 0.0 ? NS_IN_SEC_DBL / frame->fps : 0;
+        long long wait_ns = frame->deadline - frame_ns - get_time_in_ns();
+        if (wait_ns > 0 && wait_ns < MAX_SCHED_WAIT_NS) {
+                usleep(wait_ns / 1000);
+        }
+        return true;
+}
+
 /**
  * @brief Puts filled video frame.
  * After calling this function, video frame cannot be used.
@@ -369,7 +431,19 @@ int display_put_frame(struct display *d, struct video_frame *frame, int flag)
                 return d->funcs->putf(d->state, frame, flag);
         }
 
-        if (d->postprocess) {
+        if (flag != PUTF_DISCARD && !display_sched_frame(d, frame)) {
+                if (!d->postprocess || d->pp_bypass || d->pp_in_place) { // otherwise postprocess-owned frame
+                        d->funcs->putf(d->state, frame, PUTF_DISCARD);
+                }
+                return 1;
+        }
+
+        if (d->postprocess && d->pp_in_place) {
+                if (!vo_postprocess_in_place(d->postprocess, frame, d->display_pitch)) {
+                        d->funcs->putf(d->state, frame, PUTF_DISCARD);
+                        return 1;
+                }
+        } else if (d->postprocess && !d->pp_bypass) {
                 int display_ret = 0;
 		for (int i = 0; i < d->pp_output_frames_count; ++i) {
 			struct video_frame *display_frame = d->funcs->getf(d->state);
@@ -383,11 +457,15 @@ int display_put_frame(struct display *d, struct video_frame *frame, int flag)
 				return 1;
 			}
 
+			C_PROFILER_PUSH("display_put_frame");
 			display_ret = d->funcs->putf(d->state, display_frame, flag);
+			C_PROFILER_POP;
 		}
                 return display_ret;
         }
+        C_PROFILER_PUSH("display_put_frame");
         int ret = d->funcs->putf(d->state, frame, flag);
+        C_PROFILER_POP;
         if (ret != 0 || !d->funcs->use_generic_fps_indicator) {
                 return ret;
         }
@@ -400,6 +478,10 @@ int display_put_frame(struct display *d, struct video_frame *frame, int flag)
                                 d->display_name,
                                 d->frames, (double) seconds_ns / NS_IN_SEC,
                                 (double) d->frames * NS_IN_SEC / seconds_ns);
+                if (d->sched.dropped > 0) {
+                        log_msg(LOG_LEVEL_INFO, "[%s] %d late frames dropped\n", d->display_name, d->sched.dropped);
+                        d->sched.dropped = 0;
+                }
                 d->frames = 0;
                 d->t0 = t;
         }
@@ -424,8 +506,65 @@ int display_reconfigure(struct display *d, struct video_desc desc, enum video_mo
 
         d->saved_desc = desc;
         d->saved_mode = video_mode;
+        d->pp_bypass = false;
+        d->pp_in_place = false;
+
+        if (d->pp_crop_set) {
+                int no_crop[4] = { 0, 0, 0, 0 };
+                size_t crop_len = sizeof no_crop;
+                d->funcs->ctl_property(d->state, DISPLAY_PROPERTY_CROP, no_crop, &crop_len);
+                d->pp_crop_set = false;
+        }
 
         if (d->postprocess) {
+                int scale_size[2];
+                size_t scale_len = sizeof scale_size;
+                if (video_mode == VIDEO_NORMAL && desc.tile_count == 1 &&
+                                vo_postprocess_get_property(d->postprocess, VO_PP_PROPERTY_DISPLAY_SCALE,
+                                        scale_size, &scale_len) && scale_len == sizeof scale_size &&
+                                d->funcs->ctl_property(d->state, DISPLAY_PROPERTY_SCALE_TO, scale_size, &scale_len)) {
+                        // frames are uploaded once and scaled by the display
+                        log_msg(LOG_LEVEL_INFO, "[display] Scaling to %dx%d offloaded to display %s.\n",
+                                        scale_size[0], scale_size[1], d->display_name);
+                        d->pp_bypass = true;
+                        return d->funcs->reconfigure_video(d->state, desc);
+                }
+
+                if (video_mode == VIDEO_NORMAL && desc.tile_count == 1) {
+                        if (!vo_postprocess_reconfigure(d->postprocess, desc)) {
+                                log_msg(LOG_LEVEL_ERROR, "[video dec.] Unable to reconfigure video "
+                                                "postprocess.\n");
+                                return false;
+                        }
+                        int crop[4];
+                        size_t crop_len = sizeof crop;
+                        if (vo_postprocess_get_property(d->postprocess, VO_PP_PROPERTY_DISPLAY_CROP,
+                                                crop, &crop_len) && crop_len == sizeof crop &&
+                                        d->funcs->ctl_property(d->state, DISPLAY_PROPERTY_CROP, crop, &crop_len)) {
+                                // the decoder writes to the display buffer, only the region is shown
+                                log_msg(LOG_LEVEL_INFO, "[display] Cropping to %dx%d+%d+%d offloaded to display %s.\n",
+                                                crop[2], crop[3], crop[0], crop[1], d->display_name);
+                                d->pp_bypass = true;
+                                d->pp_crop_set = true;
+                                return d->funcs->reconfigure_video(d->state, desc);
+                        }
+                        bool in_place = false;
+                        size_t in_place_len = sizeof in_place;
+                        if (vo_postprocess_get_property(d->postprocess, VO_PP_PROPERTY_IN_PLACE,
+                                                &in_place, &in_place_len) && in_place) {
+                                int rc = d->funcs->reconfigure_video(d->state, desc);
+                                size_t len = sizeof d->display_pitch;
+                                d->display_pitch = PITCH_DEFAULT;
+                                d->funcs->ctl_property(d->state, DISPLAY_PROPERTY_BUF_PITCH,
+                                                &d->display_pitch, &len);
+                                if (d->display_pitch == PITCH_DEFAULT) {
+                                        d->display_pitch = vc_get_linesize(desc.width, desc.color_spec);
+                                }
+                                d->pp_in_place = true;
+                                return rc;
+                        }
+                }
+
                 bool pp_does_change_tiling_mode = false;
                 size_t len = sizeof(pp_does_change_tiling_mode);
                 if (vo_postprocess_get_property(d->postprocess, VO_PP_DOES_CHANGE_TILING_MODE,
@@ -504,7 +643,7 @@ static void restrict_returned_codecs(codec_t *display_codecs,
 int display_ctl_property(struct display *d, int property, void *val, size_t *len)
 {
         assert(d->magic == DISPLAY_MAGIC);
-        if (d->postprocess) {
+        if (d->postprocess && (!(d->pp_bypass || d->pp_in_place) || property != DISPLAY_PROPERTY_BUF_PITCH)) {
                 switch (property) {
                 case DISPLAY_PROPERTY_BUF_PITCH:
                         *(int *) val = PITCH_DEFAULT;
@@ -131,6 +131,10 @@ enum display_property {
         DISPLAY_PROPERTY_SUPPORTS_MULTI_SOURCES = 5, ///< whether display supports receiving data from - returns (struct multi_sources_supp_info *)
                                                      ///< multiple network sources concurrently
         DISPLAY_PROPERTY_AUDIO_FORMAT = 6, ///< @see audio_display_info::query_format - in/out parameter is struct audio_desc
+        DISPLAY_PROPERTY_SCALE_TO = 7, ///< asks the display to scale frames to given size itself (on GPU) - in parameter is int[2]
+                                       ///< (width, height), TRUE is returned if the display will do so
+        DISPLAY_PROPERTY_CROP = 8, ///< asks the display to show only a region of the frames - in parameter is int[4]
+                                   ///< (x, y, width, height), TRUE is returned if the display will do so, zero width resets
 };
 
 #define PITCH_DEFAULT -1 ///< default pitch, i. e. respective linesize
@@ -192,6 +196,7 @@ enum display_put_frame_flags {
 
 // documented at definition
 int                      display_put_frame(struct display *d, struct video_frame *frame, int flag);
+bool                     display_frame_is_late(struct display *d, const struct video_frame *frame);
 int                      display_reconfigure(struct display *d, struct video_desc desc, enum video_mode mode);
 /** @brief Get/set property (similar to ioctl)
  *  @retval TRUE  if succeeds
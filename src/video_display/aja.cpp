@@ -80,6 +80,7 @@
 #include "lib_common.h"
 #include "video_display.h"
 #include "rang.hpp"
+#include "utils/video_frame_pool.h"
 #include "video.h"
 
 #include "aja_common.h" // should be included last (overrides log_msg etc.)
@@ -170,6 +171,8 @@ struct display {
         CNTV2Card mDevice;
         NTV2DeviceID mDeviceID;
         struct video_desc desc{};
+        /// frames returned by getf, the card DMAs directly from them (page-locked)
+        video_frame_pool mPool{0, *frame_pool_allocator_for("display", pinned_data_allocator())};
         bool mDoMultiChannel; ///< Use multi-format
         NTV2EveryFrameTaskMode mSavedTaskMode = NTV2_TASK_MODE_INVALID; ///< Used to restore the prior task mode
         NTV2Channel mOutputChannel;
@@ -910,6 +913,7 @@ LINK_SPEC int display_aja_reconfigure(void *state, struct video_desc desc)
 
         // deinit?
         s->desc = desc;
+        s->mPool.reconfigure(desc);
         try {
                 s->Init();
         } catch (runtime_error &e) {
@@ -1009,7 +1013,7 @@ LINK_SPEC struct video_frame *display_aja_getf(void *state)
 {
         auto s = static_cast<struct aja::display *>(state);
 
-        return vf_alloc_desc_data(s->desc);
+        return s->mPool.get_pod_frame();
 }
 
 LINK_SPEC int display_aja_putf(void *state, struct video_frame *frame, int nonblock)
@@ -1017,10 +1021,10 @@ LINK_SPEC int display_aja_putf(void *state, struct video_frame *frame, int nonbl
         auto s = static_cast<struct aja::display *>(state);
 
         if (frame && frame->color_spec == R12L) {
-                char *tmp = (char *) malloc(frame->tiles[0].data_len);
-                vc_copylineR12LtoR12A((unsigned char *) tmp, (unsigned char *) frame->tiles[0].data, frame->tiles[0].data_len, 0, 0, 0);
-                free(frame->tiles[0].data);
-                frame->tiles[0].data = tmp;
+                struct video_frame *converted = s->mPool.get_pod_frame();
+                vc_copylineR12LtoR12A((unsigned char *) converted->tiles[0].data, (unsigned char *) frame->tiles[0].data, frame->tiles[0].data_len, 0, 0, 0);
+                vf_free(frame);
+                frame = converted;
         }
 
         return s->Putf(frame, nonblock);
@@ -45,9 +45,15 @@
 #include "config_win32.h"
 #include "debug.h"
 #include "lib_common.h"
+#include "utils/misc.h"
+#include "utils/worker.h"
 #include "video.h"
 #include "video_display.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include <cinttypes>
 #include <condition_variable>
 #include <chrono>
@@ -58,6 +64,7 @@
 #include <mutex>
 #include <queue>
 #include <unordered_map>
+#include <vector>
 
 using namespace std;
 
@@ -66,6 +73,7 @@ static constexpr int BUFFER_LEN = 5;
 static constexpr chrono::milliseconds SOURCE_TIMEOUT(500);
 static constexpr unsigned int IN_QUEUE_MAX_BUFFER_LEN = 5;
 static constexpr int SKIP_FIRST_N_FRAMES_IN_STREAM = 5;
+static constexpr size_t MIN_BLEND_JOB_LEN = 256 * 1024; ///< do not split smaller chunks among threads
 
 struct state_blend_common {
         ~state_blend_common() {
@@ -155,6 +163,69 @@ static void *display_blend_init(struct module *parent, const char *fmt, unsigned
         return s;
 }
 
+struct blend_job {
+        const unsigned char *old_data;
+        const unsigned char *new_data;
+        unsigned char *out;
+        size_t len;
+        unsigned int new_weight; ///< 0-256
+};
+
+static void *blend_task(void *arg)
+{
+        auto *job = (struct blend_job *) arg;
+        const unsigned char *__restrict old_data = job->old_data;
+        const unsigned char *__restrict new_data = job->new_data;
+        unsigned char *__restrict out = job->out;
+        const unsigned int new_weight = job->new_weight;
+        const unsigned int old_weight = 256 - new_weight;
+        size_t i = 0;
+        // fixed-point with 16-bit intermediates
+#ifdef __SSE2__
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i nw = _mm_set1_epi16(new_weight);
+        const __m128i ow = _mm_set1_epi16(old_weight);
+        const __m128i round = _mm_set1_epi16(128);
+        for (; i + 16 <= job->len; i += 16) {
+                __m128i o = _mm_loadu_si128((const __m128i *)(const void *) (old_data + i));
+                __m128i n = _mm_loadu_si128((const __m128i *)(const void *) (new_data + i));
+                __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(n, zero), nw),
+                                _mm_mullo_epi16(_mm_unpacklo_epi8(o, zero), ow));
+                __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(n, zero), nw),
+                                _mm_mullo_epi16(_mm_unpackhi_epi8(o, zero), ow));
+                lo = _mm_srli_epi16(_mm_add_epi16(lo, round), 8);
+                hi = _mm_srli_epi16(_mm_add_epi16(hi, round), 8);
+                _mm_storeu_si128((__m128i *)(void *) (out + i), _mm_packus_epi16(lo, hi));
+        }
+#endif
+        for (; i < job->len; ++i) {
+                out[i] = (uint16_t) (new_data[i] * new_weight + old_data[i] * old_weight + 128) >> 8;
+        }
+        return nullptr;
+}
+
+/**
+ * Cross-fades old_data to new_data with weight transition/TRANSITION_COUNT
+ * of the new one (bytewise); the work is split among worker threads.
+ */
+static void blend_frames(const char *old_data, const char *new_data, char *out, size_t len, int transition)
+{
+        int threads = max<int>(1, min<size_t>(get_cpu_core_count(), len / MIN_BLEND_JOB_LEN));
+        vector<blend_job> jobs(threads);
+        for (int i = 0; i < threads; ++i) {
+                size_t start = len * i / threads;
+                size_t end = len * (i + 1) / threads;
+                jobs[i] = { (const unsigned char *) old_data + start, (const unsigned char *) new_data + start,
+                        (unsigned char *) out + start, end - start,
+                        (unsigned int) (transition * 256 / TRANSITION_COUNT) };
+        }
+        if (threads == 1) {
+                blend_task(jobs.data());
+        } else {
+                task_run_parallel(blend_task, threads, jobs.data(), sizeof jobs[0], nullptr);
+        }
+}
+
 static void check_reconf(struct state_blend_common *s, struct video_desc desc)
 {
         if (!video_desc_eq(desc, s->display_desc)) {
@@ -270,12 +341,9 @@ static void display_blend_run(void *state)
                                         struct video_frame *real_display_frame = display_get_frame(s->real_display);
 
                                         if (video_desc_eq(old_desc, new_desc)) {
-                                                for (unsigned int i = 0; i < new_frame->tiles[0].data_len; ++i) {
-                                                        int old_val = ((unsigned char *) old_frame->tiles[0].data)[i];
-                                                        int new_val = ((unsigned char *) new_frame->tiles[0].data)[i];
-                                                        ((unsigned char *) real_display_frame->tiles[0].data)[i] =
-                                                                ((new_val * s->transition) + (old_val * (TRANSITION_COUNT - s->transition))) / TRANSITION_COUNT;
-                                                }
+                                                blend_frames(old_frame->tiles[0].data, new_frame->tiles[0].data,
+                                                                real_display_frame->tiles[0].data,
+                                                                new_frame->tiles[0].data_len, s->transition);
                                         } else {
                                                 // new desc is different than old desc!
                                                 fprintf(stderr, "SMOLIK4!\n");
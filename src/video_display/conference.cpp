@@ -47,6 +47,7 @@
 #include "module.h"
 #include "utils/misc.h"
 #include "utils/sv_parse_num.hpp"
+#include "utils/worker.h"
 
 #include <cinttypes>
 #include <condition_variable>
@@ -85,6 +86,7 @@ struct Participant{
         void to_cv_frame();
         void frame_recieved(unique_frame &&f);
         void set_pos_keep_aspect(int x, int y, int w, int h);
+        void composite(cv::Mat& mixed_luma, cv::Mat& mixed_chroma);
 
         unique_frame frame;
         clock::time_point last_time_recieved;
@@ -98,6 +100,11 @@ struct Participant{
 
         cv::Mat luma;
         cv::Mat chroma;
+
+        /// scaled image cached until a new frame arrives or the cell changes
+        cv::Mat scaled_luma;
+        cv::Mat scaled_chroma;
+        bool dirty = true;
 };
 
 void Participant::frame_recieved(unique_frame &&f){
@@ -106,6 +113,7 @@ void Participant::frame_recieved(unique_frame &&f){
 
         src_w = frame->tiles[0].width;
         src_h = frame->tiles[0].height;
+        dirty = true;
 }
 
 void Participant::set_pos_keep_aspect(int x, int y, int w, int h){
@@ -124,6 +132,28 @@ void Participant::set_pos_keep_aspect(int x, int y, int w, int h){
 
         this->x = x;
         this->y = y;
+        dirty = true;
+}
+
+/**
+ * Scales the participant into its layout cell. The cells of different
+ * participants do not overlap so this may run concurrently for all of them.
+ */
+void Participant::composite(cv::Mat& mixed_luma, cv::Mat& mixed_chroma){
+        if(width == 0 || height == 0)
+                return;
+
+        if(dirty){
+                to_cv_frame();
+                if(luma.empty())
+                        return;
+                cv::resize(luma, scaled_luma, cv::Size(width, height), 0, 0);
+                cv::resize(chroma, scaled_chroma, cv::Size(width / 2, height), 0, 0);
+                dirty = false;
+        }
+
+        scaled_luma.copyTo(mixed_luma(cv::Rect(x, y, width, height)));
+        scaled_chroma.copyTo(mixed_chroma(cv::Rect(x / 2, y, width / 2, height)));
 }
 
 void Participant::to_cv_frame(){
@@ -317,17 +347,26 @@ void Video_mixer::get_mixed(video_frame *result){
         if(recompute)
                 recompute_layout();
 
+        PROFILE_DETAIL("resize participants");
+        struct composite_job{
+                Participant *p;
+                cv::Mat *luma;
+                cv::Mat *chroma;
+        };
+        std::vector<composite_job> jobs;
+        jobs.reserve(participants.size());
         for(auto&& [ssrc, p] : participants){
                 (void) ssrc;
-                p.to_cv_frame();
-
-                PROFILE_DETAIL("resize participant");
-                cv::Size l_size(p.width, p.height);
-                cv::Size c_size(p.width / 2, p.height);
-                cv::resize(p.luma, mixed_luma(cv::Rect(p.x, p.y, p.width, p.height)), l_size, 0, 0);
-                cv::resize(p.chroma, mixed_chroma(cv::Rect(p.x / 2, p.y, p.width / 2, p.height)), c_size, 0, 0);
-                PROFILE_DETAIL("");
+                jobs.push_back({&p, &mixed_luma, &mixed_chroma});
+        }
+        if(!jobs.empty()){
+                task_run_parallel([](void *arg) -> void * {
+                                auto job = static_cast<composite_job *>(arg);
+                                job->p->composite(*job->luma, *job->chroma);
+                                return nullptr;
+                                }, static_cast<int>(jobs.size()), jobs.data(), sizeof jobs[0], nullptr);
         }
+        PROFILE_DETAIL("");
 
         unsigned char *dst = reinterpret_cast<unsigned char *>(result->tiles[0].data);
         unsigned char *chroma_src = mixed_chroma.ptr(0);
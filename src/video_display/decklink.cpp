@@ -353,6 +353,10 @@ struct state_decklink {
         buffer_pool_t       buffer_pool;
 
         bool                low_latency       = true;
+        unsigned int        sched_depth       = 2; ///< target count of buffered frames in scheduled mode
+        BMDTimeValue        sched_time        = 0; ///< stream time of the next scheduled frame
+        bool                sched_resync      = true;
+        int                 sched_over_cnt    = 0; ///< consecutive frames with buffer over sched_depth
 
         mutex               reconfiguration_lock; ///< for audio and video reconf to be mutually exclusive
         bool                keep_device_defaults = false;
@@ -386,6 +390,7 @@ static void show_help(bool full)
                 cout << style::bold << "\ttimecode" << style::reset << "\temit timecode\n";
                 cout << style::bold << "\t[no-]quad-square" << style::reset << " set Quad-link SDI is output in Square Division Quad Split mode\n";
                 cout << style::bold << "\t[no-]low-latency" << style::reset << " do not use low-latency mode (use regular scheduled mode; low-latency is default)\n";
+                cout << style::bold << "\tsched-depth=<n>" << style::reset << "\ttarget number of buffered frames in scheduled mode (default " << state_decklink{}.sched_depth << ")\n";
                 cout << style::bold << "\tconversion" << style::reset << "\toutput size conversion, can be:\n" <<
                                 style::bold << "\t\tnone" << style::reset << " - no conversion\n" <<
                                 style::bold << "\t\tltbx" << style::reset << " - down-converted letterbox SD\n" <<
@@ -577,6 +582,44 @@ static void update_timecode(DeckLinkTimecode *tc, double fps)
         tc->SetBCD(bcd);
 }
 
+/**
+ * Keeps the count of frames buffered by the device in scheduled mode near
+ * s->sched_depth. After reconfiguration or on underrun, the schedule is moved
+ * to the actual stream time plus sched_depth frames (preroll). Excess that
+ * persists for a second (eg. due to clock drift) is trimmed by dropping a frame.
+ *
+ * @param buffered  count of frames currently buffered by the device
+ * @returns false if the frame should be dropped
+ */
+static bool schedule_adjust_depth(struct state_decklink *s, uint32_t buffered)
+{
+        if (s->sched_resync || buffered == 0) {
+                BMDTimeValue stream_time = 0;
+                double speed = 0.0;
+                if (s->state[0].deckLinkOutput->GetScheduledStreamTime(s->frameRateScale, &stream_time, &speed) != S_OK) {
+                        stream_time = 0;
+                }
+                if (!s->sched_resync) {
+                        LOG(LOG_LEVEL_VERBOSE) << MOD_NAME "Video buffer underrun, rescheduling.\n";
+                }
+                stream_time = stream_time / s->frameRateDuration * s->frameRateDuration;
+                s->sched_time = max<BMDTimeValue>(s->sched_time, stream_time + s->sched_depth * s->frameRateDuration);
+                s->sched_resync = false;
+                s->sched_over_cnt = 0;
+                return true;
+        }
+        if (buffered <= s->sched_depth) {
+                s->sched_over_cnt = 0;
+                return true;
+        }
+        if (++s->sched_over_cnt < max(1, (int) s->vid_desc.fps)) {
+                return true;
+        }
+        s->sched_over_cnt = 0;
+        LOG(LOG_LEVEL_VERBOSE) << MOD_NAME << buffered << " frames buffered (target " << s->sched_depth << "), dropping a frame.\n";
+        return false;
+}
+
 static int display_decklink_putf(void *state, struct video_frame *frame, int flag)
 {
         struct state_decklink *s = (struct state_decklink *)state;
@@ -588,7 +631,8 @@ static int display_decklink_putf(void *state, struct video_frame *frame, int fla
 
         uint32_t i;
         s->state.at(0).deckLinkOutput->GetBufferedVideoFrameCount(&i);
-        if ((flag == PUTF_NONBLOCK && i > 2) || flag == PUTF_DISCARD) {
+        if ((flag == PUTF_NONBLOCK && i > 2) || flag == PUTF_DISCARD ||
+                        (!s->low_latency && !schedule_adjust_depth(s, i))) {
                 if (flag == PUTF_NONBLOCK) {
                         log_msg(LOG_LEVEL_WARNING, MOD_NAME "Frame dropped!\n");
                 }
@@ -621,9 +665,10 @@ static int display_decklink_putf(void *state, struct video_frame *frame, int fla
                         deckLinkFrame->Release();
                 } else {
                         s->state[j].deckLinkOutput->ScheduleVideoFrame(deckLinkFrame,
-                                        s->frames * s->frameRateDuration, s->frameRateDuration, s->frameRateScale);
+                                        s->sched_time, s->frameRateDuration, s->frameRateScale);
                 }
         }
+        s->sched_time += s->frameRateDuration;
         s->frames++;
         if(s->emit_timecode) {
                 update_timecode(s->timecode, s->vid_desc.fps);
@@ -858,6 +903,8 @@ display_decklink_reconfigure_video(void *state, struct video_desc desc)
                 for(int i = 0; i < s->devices_cnt; ++i) {
                         EXIT_IF_FAILED(s->state.at(i).deckLinkOutput->StartScheduledPlayback(0, s->frameRateScale, (double) s->frameRateDuration), "StartScheduledPlayback (video)");
                 }
+                s->sched_time = 0;
+                s->sched_resync = true;
         }
 
         s->initialized_video = true;
@@ -1034,6 +1081,13 @@ static bool settings_init(struct state_decklink *s, const char *fmt,
                         }
                 } else if (strcasecmp(ptr, "low-latency") == 0 || strcasecmp(ptr, "no-low-latency") == 0) {
                         s->low_latency = strcasecmp(ptr, "low-latency") == 0;
+                } else if (strncasecmp(ptr, "sched-depth=", strlen("sched-depth=")) == 0) {
+                        int depth = atoi(ptr + strlen("sched-depth="));
+                        if (depth <= 0) {
+                                LOG(LOG_LEVEL_ERROR) << MOD_NAME << "Wrong scheduling depth: " << ptr + strlen("sched-depth=") << "\n";
+                                return false;
+                        }
+                        s->sched_depth = depth;
                 } else if (strcasecmp(ptr, "quad-square") == 0 || strcasecmp(ptr, "no-quad-square") == 0) {
                         s->quad_square_division_split = strcasecmp(ptr, "quad-square") == 0;
                 } else if (strncasecmp(ptr, "hdr", strlen("hdr")) == 0) {
@@ -59,6 +59,7 @@
 
 #include <array>
 #include <algorithm>
+#include <cmath>
 #include <condition_variable>
 #include <csetjmp>
 #include <fstream>
@@ -67,6 +68,8 @@
 #include <queue>
 #include <string>
 #include <string_view>
+#include <thread>
+#include <vector>
 
 #include "color.h"
 #include "debug.h"
@@ -77,7 +80,9 @@
 #include "messaging.h"
 #include "module.h"
 #include "utils/color_out.h"
+#include "utils/frame_trace.h"
 #include "utils/macros.h" // OPTIMIZED_FOR
+#include "utils/metrics.h"
 #include "utils/misc.h"
 #include "video.h"
 #include "video_display.h"
@@ -89,11 +94,20 @@
 #define DEFAULT_WIN_NAME "Ultragrid - OpenGL Display"
 #define GL_DISABLE_10B_OPT_PARAM_NAME "gl-disable-10b"
 #define GL_WINDOW_HINT_OPT_PARAM_NAME "glfw-window-hint"
+#define GL_DISABLE_CUDA_OPT_PARAM_NAME "gl-disable-cuda"
 #define MAX_BUFFER_SIZE 1
 #define ADAPTIVE_VSYNC -1
 #define SYSTEM_VSYNC 0xFE
 #define SINGLE_BUF 0xFF // use single buffering instead of double
+#define PBO_RING_SIZE 4 // decoded + queued + displayed frame and one spare
+#define PRESENT_EWMA_WEIGHT 0.05
+#define PACING_MARGIN_NS (1500 * NS_IN_US) ///< slack between the render start and predicted vblank
+#if ! defined HAVE_MACOSX && defined GL_ARB_buffer_storage
+#define GL_PERSISTENT_PBO 1
+#endif
 
+#include "gl_cuda.hpp"
+#include "gl_vaapi.hpp"
 #include "gl_vdpau.hpp"
 
 using namespace std;
@@ -135,6 +149,26 @@ void main()
 }
 )raw";
 
+/// planar luma + interleaved chroma (NV12/P010 layers of HW_VAAPI surfaces)
+static const char * nv12_to_rgb_fp = R"raw(
+#version 110
+uniform sampler2D image;
+uniform sampler2D image_uv;
+void main()
+{
+        vec4 yuv;
+        yuv.r = texture2D(image, gl_TexCoord[0].xy).r;
+        yuv.gb = texture2D(image_uv, gl_TexCoord[0].xy).rg;
+        yuv.r = Y_SCALED_PLACEHOLDER * (yuv.r - 0.0625);
+        yuv.g = yuv.g - 0.5;
+        yuv.b = yuv.b - 0.5;
+        gl_FragColor.r = yuv.r + R_CR_PLACEHOLDER * yuv.b;
+        gl_FragColor.g = yuv.r + G_CB_PLACEHOLDER * yuv.g + G_CR_PLACEHOLDER * yuv.b;
+        gl_FragColor.b = yuv.r + B_CB_PLACEHOLDER * yuv.g;
+        gl_FragColor.a = 1.0;
+}
+)raw";
+
 /// with courtesy of https://stackoverflow.com/questions/20317882/how-can-i-correctly-unpack-a-v210-video-frame-using-glsl
 /// adapted to GLSL 1.1 with help of https://stackoverflow.com/questions/5879403/opengl-texture-coordinates-in-pixel-space/5879551#5879551
 static const char * v210_to_rgb_fp = R"raw(
@@ -296,12 +330,26 @@ static constexpr array keybindings{
         pair<int64_t, string_view>{K_CTRL_UP, "make window 10% bigger"}
 };
 
+/**
+ * Persistently mapped pixel buffer whose memory is handed to the decoder as
+ * frame data, so that decoded frame is uploaded to the texture without a copy.
+ */
+struct gl_pbo_buffer {
+        GLuint id = 0;
+#ifdef GL_PERSISTENT_PBO
+        GLsync fence = nullptr; ///< signals that the last upload from the buffer finished
+#endif
+        struct video_frame *frame = nullptr; ///< frame pointing to the mapped memory
+        bool outstanding = false; ///< frame held by decoder (not in free_frame_queue)
+};
+
 struct state_gl {
         GLuint          PHandle_uyvy = 0;
         GLuint          PHandle_yuva = 0;
         GLuint          PHandle_v210 = 0;
         GLuint          PHandle_dxt = 0;
         GLuint          PHandle_dxt5 = 0;
+        GLuint          PHandle_nv12 = 0;
         GLuint          current_program = 0;
 
         // Framebuffer
@@ -336,6 +384,13 @@ struct state_gl {
         int             dxt_height = 0;
 
         int             vsync = 1;
+        /// present timing measured from swap completion (only with vsync and the pacing option)
+        struct {
+                bool      pacing = false;       ///< start rendering just before the predicted vblank
+                time_ns_t last_vblank = 0;      ///< completion time of the last buffer swap
+                double    period_ns = 0.0;      ///< refresh period estimate
+                double    render_ns = 0.0;      ///< EWMA of upload + render duration
+        } present;
         bool            paused = false;
         enum show_cursor_t { SC_TRUE, SC_FALSE, SC_AUTOHIDE } show_cursor = SC_AUTOHIDE;
         chrono::steady_clock::time_point                      cursor_shown_from{}; ///< indicates time point from which is cursor show if show_cursor == SC_AUTOHIDE, timepoint() means cursor is not currently shown
@@ -355,10 +410,18 @@ struct state_gl {
         enum modeset_t { MODESET = -2, MODESET_SIZE_ONLY = GLFW_DONT_CARE, NOMODESET = 0 } modeset = NOMODESET; ///< positive vals force framerate
         bool nodecorate = false;
         int use_pbo = -1;
+        vector<gl_pbo_buffer> pbo_ring; ///< buffers for current_display_desc, modified only by the GL thread with lock held
+        vector<gl_pbo_buffer> pbo_retired; ///< buffers of previous format still held by decoder
 
 #ifdef HWACC_VDPAU
         struct state_vdpau vdp;
 #endif
+#ifdef HAVE_GL_VAAPI
+        struct state_vaapi vaapi; ///< initialized only if DMA-BUF import is usable
+#endif
+#ifdef HAVE_GL_CUDA
+        struct state_gl_cuda cuda; ///< initialized only if the GL context runs on the CUDA device
+#endif
 
         state_gl(struct module *parent) {
                 if (ref_count_init_once<int>()(glfwInit, glfw_init_count).value_or(GLFW_TRUE) == GLFW_FALSE) {
@@ -380,8 +443,17 @@ struct state_gl {
 };
 
 static constexpr array gl_supp_codecs = {
+#ifdef HAVE_GL_CUDA
+        CUDA_RGBA,
+        CUDA_UYVY,
+        CUDA_DXT1,
+        CUDA_DXT5,
+#endif
 #ifdef HWACC_VDPAU
         HW_VDPAU,
+#endif
+#ifdef HAVE_GL_VAAPI
+        HW_VAAPI,
 #endif
         UYVY,
         v210,
@@ -413,7 +485,14 @@ static void glfw_close_callback(GLFWwindow *win);
 static void display_gl_set_sync_on_vblank(int value);
 static void screenshot(struct video_frame *frame);
 static void upload_texture(struct state_gl *s, char *data);
+#ifdef HAVE_GL_CUDA
+static void upload_compressed_texture_cuda(struct state_gl *s, char *data, GLenum format, GLsizei data_size);
+#endif
 static bool check_rpi_pbo_quirks();
+static void gl_pbo_ring_reconfigure(struct state_gl *s, struct video_desc desc);
+static void gl_pbo_ring_collect_retired(struct state_gl *s);
+static void gl_pbo_ring_destroy(struct state_gl *s);
+static void gl_release_frame(struct state_gl *s, struct video_frame *frame);
 
 static void gl_print_monitors(bool fullhelp) {
         if (ref_count_init_once<int>()(glfwInit, glfw_init_count).value_or(GLFW_TRUE) == GLFW_FALSE) {
@@ -460,8 +539,8 @@ static void gl_print_monitors(bool fullhelp) {
  */
 static void gl_show_help(bool full) {
         col() << "usage:\n";
-        col() << SBOLD(SRED("\t-d gl") << "[:d|:fs[=<monitor>]|:aspect=<v>/<h>|:cursor|:size=X%%|:syphon[=<name>]|:spout[=<name>]|:modeset[=<fps>]|:nodecorate|:fixed_size[=WxH]|:vsync[=<x>|single]]* | gl:[full]help"
-                << (full ? " [--param " GL_DISABLE_10B_OPT_PARAM_NAME "|" GL_WINDOW_HINT_OPT_PARAM_NAME "=<k>=<v>]" : "")) << "\n\n";
+        col() << SBOLD(SRED("\t-d gl") << "[:d|:fs[=<monitor>]|:aspect=<v>/<h>|:cursor|:size=X%%|:syphon[=<name>]|:spout[=<name>]|:modeset[=<fps>]|:nodecorate|:fixed_size[=WxH]|:vsync[=<x>|single]|:pacing]* | gl:[full]help"
+                << (full ? " [--param " GL_DISABLE_10B_OPT_PARAM_NAME "|" GL_DISABLE_CUDA_OPT_PARAM_NAME "|" GL_WINDOW_HINT_OPT_PARAM_NAME "=<k>=<v>]" : "")) << "\n\n";
         col() << "options:\n";
         col() << TBOLD("\taspect=<w>/<h>") << "\trequested video aspect (eg. 16/9). Leave unset if PAR = 1.\n";
         col() << TBOLD("\tcursor")      << "\t\tshow visible cursor\n";
@@ -472,6 +551,7 @@ static void gl_show_help(bool full) {
         col() << TBOLD("\tmodeset[=<fps>]")<< "\tset received video mode as display mode (in fullscreen); modeset=<fps>|size - set specified FPS or only size\n";
         col() << TBOLD("\tnodecorate")  << "\tdisable window decorations\n";
         col() << TBOLD("\tnovsync")     << "\t\tdo not turn sync on VBlank\n";
+        col() << TBOLD("\tpacing")      << "\t\tmeasure present time and render just before VBlank (lower latency, needs vsync)\n";
         col() << TBOLD("\t[no]pbo")     << "\t\tWhether or not use PBO (ignore if not sure)\n";
         col() << TBOLD("\tsingle")      << "\t\tuse single buffer (instead of double-buffering)\n";
         col() << TBOLD("\tsize")        << "\t\tspecifies desired size of window compared "
@@ -481,6 +561,7 @@ static void gl_show_help(bool full) {
         col() << TBOLD("\tvsync=<x>")   << "\tsets vsync to: 0 - disable; 1 - enable; -1 - adaptive vsync; D - leaves system default\n";
         if (full) {
                 col() << TBOLD("\t--param " GL_DISABLE_10B_OPT_PARAM_NAME)     << "\tdo not set 10-bit framebuffer (performance issues)\n";
+                col() << TBOLD("\t--param " GL_DISABLE_CUDA_OPT_PARAM_NAME)    << "\tdo not accept frames in CUDA device memory (CUDA-GL interop)\n";
                 col() << TBOLD("\t--param " GL_WINDOW_HINT_OPT_PARAM_NAME) << "<k>=<v>[:<k2>=<v2>] set GLFW window hint key <k> to value <v>, eg. 0x20006=1 to autoiconify (experts only)\n";
         }
 
@@ -595,6 +676,8 @@ static void *display_gl_parse_fmt(struct state_gl *s, char *ptr) {
                         s->gamma = stof(strchr(tok, '=') + 1);
                 } else if (!strcasecmp(tok, "hide-window")) {
                         s->hide_window = true;
+                } else if (!strcasecmp(tok, "pacing")) {
+                        s->present.pacing = true;
                 } else if (strcasecmp(tok, "pbo") == 0 || strcasecmp(tok, "nopbo") == 0) {
                         s->use_pbo = strcasecmp(tok, "pbo") == 0 ? 1 : 0;
                 } else if(!strncmp(tok, "size=",
@@ -646,6 +729,10 @@ static void * display_gl_init(struct module *parent, const char *fmt, unsigned i
         }
 
         s->use_pbo = s->use_pbo == -1 ? !check_rpi_pbo_quirks() : s->use_pbo; // don't use PBO for Raspberry Pi (better performance)
+        if (s->present.pacing && (s->vsync == 0 || s->vsync == SINGLE_BUF)) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Frame pacing requires vsync, disabling.\n");
+                s->present.pacing = false;
+        }
 
         log_msg(LOG_LEVEL_INFO,"GL setup: fullscreen: %s, deinterlace: %s\n",
                         s->fs ? "ON" : "OFF", s->deinterlace ? "ON" : "OFF");
@@ -775,7 +862,8 @@ static void gl_reconfigure_screen(struct state_gl *s, struct video_desc desc)
 {
         assert(s->magic == MAGIC_GL);
 
-        if(desc.color_spec == DXT1 || desc.color_spec == DXT1_YUV || desc.color_spec == DXT5) {
+        if(desc.color_spec == DXT1 || desc.color_spec == DXT1_YUV || desc.color_spec == DXT5
+                        || desc.color_spec == CUDA_DXT1 || desc.color_spec == CUDA_DXT5) {
                 s->dxt_height = (desc.height + 3) / 4 * 4;
         } else {
                 s->dxt_height = desc.height;
@@ -795,7 +883,7 @@ static void gl_reconfigure_screen(struct state_gl *s, struct video_desc desc)
 
         gl_check_error();
 
-        if(desc.color_spec == DXT1 || desc.color_spec == DXT1_YUV) {
+        if(desc.color_spec == DXT1 || desc.color_spec == DXT1_YUV || desc.color_spec == CUDA_DXT1) {
                 glBindTexture(GL_TEXTURE_2D,s->texture_display);
                 size_t data_len = ((desc.width + 3) / 4 * 4* s->dxt_height)/2;
                 char *buffer = (char *) malloc(data_len);
@@ -812,7 +900,7 @@ static void gl_reconfigure_screen(struct state_gl *s, struct video_desc desc)
                         glBindTexture(GL_TEXTURE_2D,s->texture_display);
                         glUseProgram(s->PHandle_dxt);
                 }
-        } else if (desc.color_spec == UYVY) {
+        } else if (desc.color_spec == UYVY || desc.color_spec == CUDA_UYVY) {
                 glActiveTexture(GL_TEXTURE0 + 2);
                 glBindTexture(GL_TEXTURE_2D,s->texture_raw);
                 glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA,
@@ -854,7 +942,7 @@ static void gl_reconfigure_screen(struct state_gl *s, struct video_desc desc)
                                 desc.width, desc.height, 0,
                                 GL_RGBA, GL_UNSIGNED_SHORT,
                                 NULL);
-        } else if (desc.color_spec == RGBA) {
+        } else if (desc.color_spec == RGBA || desc.color_spec == CUDA_RGBA) {
                 glBindTexture(GL_TEXTURE_2D,s->texture_display);
                 glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA,
                                 desc.width, desc.height, 0,
@@ -872,7 +960,7 @@ static void gl_reconfigure_screen(struct state_gl *s, struct video_desc desc)
                                 desc.width, desc.height, 0,
                                 GL_RGBA, GL_UNSIGNED_INT_2_10_10_10_REV,
                                 nullptr);
-        } else if (desc.color_spec == DXT5) {
+        } else if (desc.color_spec == DXT5 || desc.color_spec == CUDA_DXT5) {
                 glUseProgram(s->PHandle_dxt5);
 
                 glBindTexture(GL_TEXTURE_2D,s->texture_display);
@@ -886,12 +974,25 @@ static void gl_reconfigure_screen(struct state_gl *s, struct video_desc desc)
         else if (desc.color_spec == HW_VDPAU) {
                 s->vdp.init();
         }
+#endif
+#ifdef HAVE_GL_VAAPI
+        else if (desc.color_spec == HW_VAAPI) {
+                glBindTexture(GL_TEXTURE_2D,s->texture_display);
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA,
+                                desc.width, desc.height, 0,
+                                GL_RGBA, GL_UNSIGNED_BYTE,
+                                NULL);
+                s->current_program = s->PHandle_nv12;
+        }
 #endif
         if (s->current_program) {
                 glUseProgram(s->current_program);
                 if (GLint l = glGetUniformLocation(s->current_program, "image"); l != -1) {
                         glUniform1i(l, 2);
                 }
+                if (GLint l = glGetUniformLocation(s->current_program, "image_uv"); l != -1) {
+                        glUniform1i(l, 3);
+                }
                 if (GLint l = glGetUniformLocation(s->current_program, "imageWidth"); l != -1) {
                         glUniform1f(l, (GLfloat) desc.width);
                 }
@@ -909,6 +1010,8 @@ static void gl_reconfigure_screen(struct state_gl *s, struct video_desc desc)
         if (!s->fixed_size) {
                 glfw_resize_window(s->window, s->fs, desc.height, s->aspect, desc.fps, s->window_size_factor);
                 gl_resize(s->window, desc.width, desc.height);
+        } else if (s->fixed_w && s->fixed_h && !s->fs) {
+                glfwSetWindowSize(s->window, s->fixed_w, s->fixed_h);
         }
         int width, height;
         glfwGetFramebufferSize(s->window, &width, &height);
@@ -935,6 +1038,7 @@ static void gl_reconfigure_screen(struct state_gl *s, struct video_desc desc)
 
         s->scratchpad.resize(desc.width * desc.height * 8);
         s->current_display_desc = desc;
+        gl_pbo_ring_reconfigure(s, desc);
 }
 
 static void gl_render(struct state_gl *s, char *data)
@@ -966,11 +1070,17 @@ static void gl_render(struct state_gl *s, char *data)
                 case UYVY:
                 case v210:
                 case Y416:
+#ifdef HAVE_GL_CUDA
+                case CUDA_UYVY:
+#endif
                         gl_render_glsl(s, data);
                         break;
                 case R10k:
                 case RGB:
                 case RGBA:
+#ifdef HAVE_GL_CUDA
+                case CUDA_RGBA:
+#endif
                         upload_texture(s, data);
                         break;
                 case DXT5:                        
@@ -980,10 +1090,25 @@ static void gl_render(struct state_gl *s, char *data)
                                         (s->current_display_desc.width + 3) / 4 * 4 * s->dxt_height,
                                         data);
                         break;
+#ifdef HAVE_GL_CUDA
+                case CUDA_DXT1:
+                        upload_compressed_texture_cuda(s, data, GL_COMPRESSED_RGBA_S3TC_DXT1_EXT,
+                                        ((s->current_display_desc.width + 3) / 4 * 4 * s->dxt_height)/2);
+                        break;
+                case CUDA_DXT5:
+                        upload_compressed_texture_cuda(s, data, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,
+                                        (s->current_display_desc.width + 3) / 4 * 4 * s->dxt_height);
+                        break;
+#endif
 #ifdef HWACC_VDPAU
                 case HW_VDPAU:
                         s->vdp.loadFrame(reinterpret_cast<hw_vdpau_frame *>(data));
                         break;
+#endif
+#ifdef HAVE_GL_VAAPI
+                case HW_VAAPI:
+                        gl_render_glsl(s, data);
+                        break;
 #endif
                 default:
                         log_msg(LOG_LEVEL_ERROR, MOD_NAME "error: received unsupported codec %s.\n",
@@ -1004,6 +1129,67 @@ static void pop_frame(struct state_gl *s, unique_lock<mutex> &lk)
         s->frame_consumed_cv.notify_one();
 }
 
+/**
+ * Sleeps until the rendering needs to start to catch the next predicted vblank
+ * so that the frame is not left waiting in the swap chain for up to a period.
+ */
+static void gl_pace_wait(struct state_gl *s)
+{
+        auto &p = s->present;
+        if (p.last_vblank == 0 || p.period_ns <= 0.0) {
+                return;
+        }
+        const double lead_ns = p.render_ns + PACING_MARGIN_NS;
+        const time_ns_t now = get_time_in_ns();
+        const double vblanks = ceil((now + lead_ns - p.last_vblank) / p.period_ns);
+        const double sleep_ns = p.last_vblank + vblanks * p.period_ns - lead_ns - now;
+        if (sleep_ns > 0.0 && sleep_ns < p.period_ns) {
+                this_thread::sleep_for(chrono::nanoseconds((long long) sleep_ns));
+        }
+}
+
+/**
+ * Records the present time of the frame. With vsync on, glFinish() after the
+ * swap returns once the buffer was flipped, so the timestamp approximates the
+ * vblank at which the frame was shown.
+ */
+static void gl_present_done(struct state_gl *s, const struct video_frame *frame, time_ns_t render_start, time_ns_t render_end)
+{
+        static struct metric *display_ms = metric_histogram("ug_display_latency_ms", "Display put to present latency (GL, needs frame-trace)", nullptr, nullptr, 0);
+        static struct metric *g2p_ms = metric_histogram("ug_glass_to_present_latency_ms", "Capture to present latency (GL, needs frame-trace)", nullptr, nullptr, 0);
+        auto &p = s->present;
+
+        glFinish();
+        const time_ns_t now = get_time_in_ns();
+
+        if (p.period_ns <= 0.0) {
+                GLFWmonitor *mon = glfwGetWindowMonitor(s->window) ? glfwGetWindowMonitor(s->window) : glfwGetPrimaryMonitor();
+                const GLFWvidmode *mode = mon ? glfwGetVideoMode(mon) : nullptr;
+                p.period_ns = mode && mode->refreshRate > 0 ? NS_IN_SEC_DBL / mode->refreshRate : 0.0;
+        }
+        if (p.last_vblank != 0) {
+                const double interval = now - p.last_vblank;
+                if (p.period_ns <= 0.0) {
+                        p.period_ns = interval;
+                } else {
+                        const double vblanks = round(interval / p.period_ns);
+                        if (vblanks >= 1.0 && vblanks <= 4.0) { // ignore stalls
+                                p.period_ns += PRESENT_EWMA_WEIGHT * (interval / vblanks - p.period_ns);
+                        }
+                }
+        }
+        p.last_vblank = now;
+        const double render_ns = render_end - render_start;
+        p.render_ns = p.render_ns == 0.0 ? render_ns : p.render_ns + PRESENT_EWMA_WEIGHT * (render_ns - p.render_ns);
+
+        if (frame->trace.ts[FT_DISPLAY_PUT] != 0) {
+                metric_observe(display_ms, (now - frame->trace.ts[FT_DISPLAY_PUT]) / 1000000.0);
+        }
+        if (frame->trace.ts[FT_CAPTURE] != 0) {
+                metric_observe(g2p_ms, (now - frame->trace.ts[FT_CAPTURE]) / 1000000.0);
+        }
+}
+
 static void gl_process_frames(struct state_gl *s)
 {
         struct video_frame *frame;
@@ -1057,23 +1243,28 @@ static void gl_process_frames(struct state_gl *s)
                         pop_frame(s, lk);
                         return;
                 }
+                gl_pbo_ring_collect_retired(s);
                 if (s->paused) {
-                        vf_recycle(frame);
-                        s->free_frame_queue.push(frame);
+                        gl_release_frame(s, frame);
                         pop_frame(s, lk);
                         return;
                 }
                 if (s->current_frame) {
-                        vf_recycle(s->current_frame);
-                        s->free_frame_queue.push(s->current_frame);
+                        gl_release_frame(s, s->current_frame);
                 }
                 s->current_frame = frame;
         }
 
         if (!video_desc_eq(video_desc_from_frame(frame), s->current_display_desc)) {
                 gl_reconfigure_screen(s, video_desc_from_frame(frame));
+                s->present.last_vblank = 0; // modeset may have changed refresh rate
+                s->present.period_ns = 0.0;
         }
 
+        if (s->present.pacing) {
+                gl_pace_wait(s);
+        }
+        const time_ns_t render_start = get_time_in_ns();
         gl_render(s, frame->tiles[0].data);
         gl_draw(s->aspect, (s->dxt_height - s->current_display_desc.height) / (float) s->dxt_height * 2, s->vsync != SINGLE_BUF);
 
@@ -1090,7 +1281,11 @@ static void gl_process_frames(struct state_gl *s)
         if (s->vsync == SINGLE_BUF) {
                 glFlush();
         } else {
+                const time_ns_t render_end = get_time_in_ns();
                 glfwSwapBuffers(s->window);
+                if (s->present.pacing) {
+                        gl_present_done(s, frame, render_start, render_end);
+                }
         }
         log_msg(LOG_LEVEL_DEBUG, "Render buffer %dx%d\n", frame->tiles[0].width, frame->tiles[0].height);
         {
@@ -1369,6 +1564,9 @@ static void set_gamma(struct state_gl *s) {
 ADD_TO_PARAM(GL_DISABLE_10B_OPT_PARAM_NAME ,
          "* " GL_DISABLE_10B_OPT_PARAM_NAME "\n"
          "  Disable 10 bit codec processing to improve performance\n");
+ADD_TO_PARAM(GL_DISABLE_CUDA_OPT_PARAM_NAME ,
+         "* " GL_DISABLE_CUDA_OPT_PARAM_NAME "\n"
+         "  Do not receive GPU-decoded frames in CUDA device memory\n");
 ADD_TO_PARAM(GL_WINDOW_HINT_OPT_PARAM_NAME ,
          "* " GL_WINDOW_HINT_OPT_PARAM_NAME "=<k>=<v>[:<k2>=<v2>...]\n"
          "  Set window hint <k> to value <v>\n");
@@ -1411,6 +1609,12 @@ static bool display_gl_init_opengl(struct state_gl *s)
                 height = mode->height;
                 glfwWindowHint(GLFW_REFRESH_RATE, mode->refreshRate);
         }
+#if defined HAVE_GL_VAAPI && defined GLFW_EGL_CONTEXT_API
+        if (get_commandline_param("use-hw-accel") != nullptr) {
+                // DMA-BUF import of VAAPI surfaces needs EGL context
+                glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+        }
+#endif
         display_gl_set_user_window_hints();
         if ((s->window = glfwCreateWindow(width, height, IF_NOT_NULL_ELSE(get_commandline_param("window-title"), DEFAULT_WIN_NAME), nullptr, nullptr)) == nullptr) {
                 return false;
@@ -1466,6 +1670,7 @@ static bool display_gl_init_opengl(struct state_gl *s)
         s->PHandle_uyvy = gl_substitute_compile_link(vert, uyvy_to_rgb_fp);
         s->PHandle_yuva = gl_substitute_compile_link(vert, yuva_to_rgb_fp);
         s->PHandle_v210 = gl_substitute_compile_link(vert, v210_to_rgb_fp);
+        s->PHandle_nv12 = gl_substitute_compile_link(vert, nv12_to_rgb_fp);
         // Create fbo
         glGenFramebuffersEXT(1, &s->fbo_id);
         s->PHandle_dxt = glsl_compile_link(vert, fp_display_dxt1);
@@ -1478,6 +1683,16 @@ static bool display_gl_init_opengl(struct state_gl *s)
                                                // 4 bytes which won't work on row-unaligned RGB
 
         glGenBuffersARB(1, &s->pbo_id);
+#ifdef HAVE_GL_VAAPI
+        if (get_commandline_param("use-hw-accel") != nullptr && !s->vaapi.init()) {
+                LOG(LOG_LEVEL_WARNING) << MOD_NAME "VAAPI-GL interop not available, VAAPI surfaces will be downloaded.\n";
+        }
+#endif
+#ifdef HAVE_GL_CUDA
+        if (get_commandline_param(GL_DISABLE_CUDA_OPT_PARAM_NAME) == nullptr) {
+                s->cuda.init();
+        }
+#endif
         glfwMakeContextCurrent(nullptr);
 
         return true;
@@ -1493,10 +1708,18 @@ static void display_gl_cleanup_opengl(struct state_gl *s){
         glDeleteProgram(s->PHandle_yuva);
         glDeleteProgram(s->PHandle_dxt);
         glDeleteProgram(s->PHandle_dxt5);
+        glDeleteProgram(s->PHandle_nv12);
+#ifdef HAVE_GL_VAAPI
+        s->vaapi.uninit();
+#endif
+#ifdef HAVE_GL_CUDA
+        s->cuda.uninit();
+#endif
         glDeleteTextures(1, &s->texture_display);
         glDeleteTextures(1, &s->texture_raw);
         glDeleteFramebuffersEXT(1, &s->fbo_id);
         glDeleteBuffersARB(1, &s->pbo_id);
+        gl_pbo_ring_destroy(s);
         glfwDestroyWindow(s->window);
 
         if (s->syphon_spout) {
@@ -1566,7 +1789,8 @@ static void upload_texture(struct state_gl *s, char *data)
                 type = GL_UNSIGNED_SHORT;
         }
         GLint width = s->current_display_desc.width;
-        if (s->current_display_desc.color_spec == UYVY || s->current_display_desc.color_spec == v210) {
+        if (s->current_display_desc.color_spec == UYVY || s->current_display_desc.color_spec == v210
+                        || s->current_display_desc.color_spec == CUDA_UYVY) {
                 width = vc_get_linesize(width, s->current_display_desc.color_spec) / 4;
         }
         auto byte_swap_r10k = [](uint32_t * __restrict out, const uint32_t *__restrict in, long data_len) {
@@ -1581,7 +1805,31 @@ static void upload_texture(struct state_gl *s, char *data)
                 DEBUG_TIMER_STOP(byte_swap_r10k);
         };
         int data_size = vc_get_linesize(s->current_display_desc.width, s->current_display_desc.color_spec) * s->current_display_desc.height;
-        if (s->use_pbo) {
+#ifdef HAVE_GL_CUDA
+        if (codec_is_gpu_resident(s->current_display_desc.color_spec)) {
+                if (GLuint pbo = s->cuda.loadFrame(data, data_size)) {
+                        glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, pbo);
+                        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, s->current_display_desc.height, format, type, nullptr);
+                        glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+                } else if (s->cuda.download(s->scratchpad.data(), data, data_size)) {
+                        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, s->current_display_desc.height, format, type, s->scratchpad.data());
+                }
+                return;
+        }
+#endif
+        auto ring_buf = find_if(s->pbo_ring.begin(), s->pbo_ring.end(), [data](const gl_pbo_buffer &b) {
+                        return b.frame->tiles[0].data == data; });
+        if (ring_buf != s->pbo_ring.end()) { // decoded directly to the mapped buffer
+                glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, ring_buf->id);
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, s->current_display_desc.height, format, type, nullptr);
+                glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+#ifdef GL_PERSISTENT_PBO
+                if (ring_buf->fence != nullptr) {
+                        glDeleteSync(ring_buf->fence);
+                }
+                ring_buf->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+#endif
+        } else if (s->use_pbo) {
                 glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, s->pbo_id); // current pbo
                 glBufferDataARB(GL_PIXEL_UNPACK_BUFFER_ARB, data_size, 0, GL_STREAM_DRAW_ARB);
                 if (void *ptr = glMapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, GL_WRITE_ONLY_ARB)) {
@@ -1626,6 +1874,24 @@ static bool check_rpi_pbo_quirks()
 #endif
 }
 
+#ifdef HAVE_GL_CUDA
+/**
+ * Uploads DXT compressed data residing in CUDA device memory, the data are
+ * copied to a PBO on the GPU and the texture is updated from there.
+ */
+static void upload_compressed_texture_cuda(struct state_gl *s, char *data, GLenum format, GLsizei data_size)
+{
+        GLsizei width = (s->current_display_desc.width + 3) / 4 * 4;
+        if (GLuint pbo = s->cuda.loadFrame(data, data_size)) {
+                glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, pbo);
+                glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, s->dxt_height, format, data_size, nullptr);
+                glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+        } else if (s->cuda.download(s->scratchpad.data(), data, data_size)) {
+                glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, s->dxt_height, format, data_size, s->scratchpad.data());
+        }
+}
+#endif
+
 static void gl_render_glsl(struct state_gl *s, char *data)
 {
         int status;
@@ -1650,7 +1916,14 @@ static void gl_render_glsl(struct state_gl *s, char *data)
 
         glViewport( 0, 0, s->current_display_desc.width, s->current_display_desc.height);
 
-        upload_texture(s, data);
+#ifdef HAVE_GL_VAAPI
+        if (s->current_display_desc.color_spec == HW_VAAPI) {
+                s->vaapi.loadFrame(reinterpret_cast<hw_vaapi_frame *>(data));
+        } else
+#endif
+        {
+                upload_texture(s, data);
+        }
         gl_check_error();
 
         glUseProgram(s->current_program);
@@ -1721,22 +1994,34 @@ static void glfw_close_callback(GLFWwindow *win)
 
 static int display_gl_get_property(void *state, int property, void *val, size_t *len)
 {
-        UNUSED(state);
+        auto *s = (struct state_gl *) state;
         enum interlacing_t supported_il_modes[] = {PROGRESSIVE, INTERLACED_MERGED, SEGMENTED_FRAME};
         int rgb_shift[] = {0, 8, 16};
 
         switch (property) {
                 case DISPLAY_PROPERTY_CODECS:
                         if (sizeof gl_supp_codecs <= *len) {
-                                auto filter_codecs = [](codec_t c) {
+                                auto filter_codecs = [s](codec_t c) {
+#ifdef HAVE_GL_VAAPI
+                                        if (c == HW_VAAPI && !s->vaapi.initialized) {
+                                                return false;
+                                        }
+#endif
+#ifdef HAVE_GL_CUDA
+                                        if (codec_is_gpu_resident(c) && !s->cuda.initialized) {
+                                                return false;
+                                        }
+#endif
+#if ! defined HAVE_GL_VAAPI && ! defined HAVE_GL_CUDA
+                                        UNUSED(s);
+#endif
                                         return get_bits_per_component(c) <= 8 || commandline_params.find(GL_DISABLE_10B_OPT_PARAM_NAME) == commandline_params.end(); // option to disable 10-bit processing
                                 };
-                                copy_if(gl_supp_codecs.begin(), gl_supp_codecs.end(), (codec_t *) val, filter_codecs);
+                                codec_t *end = copy_if(gl_supp_codecs.begin(), gl_supp_codecs.end(), (codec_t *) val, filter_codecs);
+                                *len = (end - (codec_t *) val) * sizeof(codec_t);
                         } else {
                                 return FALSE;
                         }
-
-                        *len = sizeof gl_supp_codecs;
                         break;
                 case DISPLAY_PROPERTY_RGB_SHIFT:
                         if(sizeof(rgb_shift) > *len) {
@@ -1757,6 +2042,17 @@ static int display_gl_get_property(void *state, int property, void *val, size_t
                         }
                         *len = sizeof(supported_il_modes);
                         break;
+                case DISPLAY_PROPERTY_SCALE_TO:
+                        if (*len < 2 * sizeof(int)) {
+                                return FALSE;
+                        }
+                        // texture is scaled to the window when drawn, just keep the window size (unless set by user)
+                        if (!s->fixed_size || s->fixed_w == 0) {
+                                s->fixed_size = true;
+                                s->fixed_w = ((int *) val)[0];
+                                s->fixed_h = ((int *) val)[1];
+                        }
+                        break;
                 default:
                         return FALSE;
         }
@@ -1788,6 +2084,162 @@ static void display_gl_done(void *state)
         delete s;
 }
 
+static bool gl_has_buffer_storage() {
+#ifdef GL_PERSISTENT_PBO
+        return GLEW_ARB_buffer_storage;
+#else
+        return false;
+#endif
+}
+
+/// @returns PBO (current or retired) backing frame or nullptr if the frame is in system memory
+static struct gl_pbo_buffer *gl_pbo_find(struct state_gl *s, struct video_frame *frame) {
+        for (auto *ring : { &s->pbo_ring, &s->pbo_retired }) {
+                for (auto &b : *ring) {
+                        if (b.frame == frame) {
+                                return &b;
+                        }
+                }
+        }
+        return nullptr;
+}
+
+static void gl_pbo_buffer_destroy(struct gl_pbo_buffer *b) {
+#ifdef GL_PERSISTENT_PBO
+        if (b->fence != nullptr) {
+                glDeleteSync(b->fence);
+        }
+        glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, b->id);
+        glUnmapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB);
+        glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+        glDeleteBuffersARB(1, &b->id);
+#endif
+        vf_free(b->frame); // data are not owned by the frame
+}
+
+/**
+ * Returns frame to free_frame_queue. If the PBO ring is active, frames in
+ * system memory are freed instead so that the decoder gets only PBO frames.
+ * Before a PBO frame can be written again, its last upload must have finished.
+ * @note lock must be held
+ */
+static void gl_release_frame(struct state_gl *s, struct video_frame *frame) {
+        vf_recycle(frame);
+        gl_pbo_buffer *pbo = gl_pbo_find(s, frame);
+        if (pbo == nullptr) {
+                if (s->pbo_ring.empty()) {
+                        s->free_frame_queue.push(frame);
+                } else {
+                        vf_free(frame);
+                }
+                return;
+        }
+#ifdef GL_PERSISTENT_PBO
+        // fence is set only by GL thread in upload_texture(), other threads release only never-uploaded frames
+        if (pbo->fence != nullptr && glfwGetCurrentContext() == s->window) {
+                glClientWaitSync(pbo->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000 * 1000 * 1000);
+                glDeleteSync(pbo->fence);
+                pbo->fence = nullptr;
+        }
+#endif
+        pbo->outstanding = false;
+        s->free_frame_queue.push(frame);
+}
+
+/**
+ * Destroys retired buffers that are not held by decoder.
+ * @note lock must be held, called from GL thread
+ */
+static void gl_pbo_ring_collect_retired(struct state_gl *s) {
+        if (s->pbo_retired.empty()) {
+                return;
+        }
+        // drop retired frames from free queue, collected ones must not be handed out
+        queue<struct video_frame *> keep;
+        while (!s->free_frame_queue.empty()) {
+                struct video_frame *f = s->free_frame_queue.front();
+                s->free_frame_queue.pop();
+                if (none_of(s->pbo_retired.begin(), s->pbo_retired.end(), [f](const gl_pbo_buffer &b) { return b.frame == f; })) {
+                        keep.push(f);
+                }
+        }
+        s->free_frame_queue = move(keep);
+
+        for (auto it = s->pbo_retired.begin(); it != s->pbo_retired.end(); ) {
+                if (it->outstanding || it->frame == s->current_frame
+                                || (!s->frame_queue.empty() && s->frame_queue.front() == it->frame)) {
+                        ++it;
+                        continue;
+                }
+                gl_pbo_buffer_destroy(&*it);
+                it = s->pbo_retired.erase(it);
+        }
+}
+
+/**
+ * Creates ring of persistently mapped PBOs for desc (if supported) that will be
+ * returned by display_gl_getf(). Buffers of the previous format are retired.
+ * @note called from GL thread
+ */
+static void gl_pbo_ring_reconfigure(struct state_gl *s, struct video_desc desc) {
+        lock_guard<mutex> lk(s->lock);
+        s->pbo_retired.insert(s->pbo_retired.end(), s->pbo_ring.begin(), s->pbo_ring.end());
+        s->pbo_ring.clear();
+        gl_pbo_ring_collect_retired(s);
+
+        // R10k needs byte swap before upload, other codecs don't use upload_texture()
+        const codec_t ring_codecs[] = { UYVY, v210, Y416, RGBA, RGB, VIDEO_CODEC_NONE };
+        if (!s->use_pbo || !gl_has_buffer_storage() || !codec_is_in_set(desc.color_spec, ring_codecs)
+                        || desc.tile_count != 1) {
+                return;
+        }
+#ifdef GL_PERSISTENT_PBO
+        const size_t data_len = vc_get_linesize(desc.width, desc.color_spec) * desc.height;
+        // read access is needed by vc_deinterlace()
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        for (int i = 0; i < PBO_RING_SIZE; ++i) {
+                gl_pbo_buffer b;
+                glGenBuffersARB(1, &b.id);
+                glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, b.id);
+                glBufferStorage(GL_PIXEL_UNPACK_BUFFER_ARB, data_len + MAX_PADDING, nullptr, flags);
+                void *ptr = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER_ARB, 0, data_len + MAX_PADDING, flags);
+                glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+                if (ptr == nullptr) {
+                        glDeleteBuffersARB(1, &b.id);
+                        LOG(LOG_LEVEL_WARNING) << MOD_NAME "Cannot map persistent PBO, using copy upload.\n";
+                        break;
+                }
+                b.frame = vf_alloc_desc(desc);
+                b.frame->tiles[0].data = static_cast<char *>(ptr);
+                b.frame->tiles[0].data_len = data_len;
+                vf_clear(b.frame);
+                s->pbo_ring.push_back(b);
+        }
+        if (s->pbo_ring.size() != PBO_RING_SIZE) {
+                for (auto &b : s->pbo_ring) {
+                        gl_pbo_buffer_destroy(&b);
+                }
+                s->pbo_ring.clear();
+                return;
+        }
+        for (auto &b : s->pbo_ring) {
+                s->free_frame_queue.push(b.frame);
+        }
+        LOG(LOG_LEVEL_VERBOSE) << MOD_NAME "Using ring of " << PBO_RING_SIZE << " persistently mapped PBOs.\n";
+#endif
+}
+
+/// @note called from GL thread on exit, frames are freed with the queues
+static void gl_pbo_ring_destroy(struct state_gl *s) {
+        for (auto *ring : { &s->pbo_ring, &s->pbo_retired }) {
+                for (auto &b : *ring) {
+                        b.frame = nullptr;
+                        gl_pbo_buffer_destroy(&b);
+                }
+                ring->clear();
+        }
+}
+
 static struct video_frame * display_gl_getf(void *state)
 {
         struct state_gl *s = (struct state_gl *) state;
@@ -1798,12 +2250,23 @@ static struct video_frame * display_gl_getf(void *state)
         while (s->free_frame_queue.size() > 0) {
                 struct video_frame *buffer = s->free_frame_queue.front();
                 s->free_frame_queue.pop();
+                gl_pbo_buffer *pbo = gl_pbo_find(s, buffer);
                 if (video_desc_eq(video_desc_from_frame(buffer), s->current_desc)) {
+                        if (pbo != nullptr) {
+                                pbo->outstanding = true;
+                        }
                         return buffer;
                 }
-                vf_free(buffer);
+                if (pbo == nullptr) { // PBO frames are released by the GL thread
+                        vf_free(buffer);
+                }
         }
 
+#ifdef HAVE_GL_CUDA
+        if (codec_is_gpu_resident(s->current_desc.color_spec)) {
+                return gl_cuda_alloc_frame(s->current_desc);
+        }
+#endif
         struct video_frame *buffer = vf_alloc_desc_data(s->current_desc);
         vf_clear(buffer);
         return buffer;
@@ -1826,14 +2289,12 @@ static int display_gl_putf(void *state, struct video_frame *frame, int nonblock)
         }
 
         if (nonblock == PUTF_DISCARD) {
-                vf_recycle(frame);
-                s->free_frame_queue.push(frame);
+                gl_release_frame(s, frame);
                 return 0;
         }
         if (s->frame_queue.size() >= MAX_BUFFER_SIZE && nonblock == PUTF_NONBLOCK) {
                 LOG(LOG_LEVEL_INFO) << MOD_NAME << "1 frame(s) dropped!\n";
-                vf_recycle(frame);
-                s->free_frame_queue.push(frame);
+                gl_release_frame(s, frame);
                 return 1;
         }
         s->frame_consumed_cv.wait(lk, [s]{return s->frame_queue.size() < MAX_BUFFER_SIZE;});
@@ -0,0 +1,168 @@
+/**
+ * @file   gl_cuda.cpp
+ *
+ * @brief CUDA-OpenGL interoperability for GPU-resident frames
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ * 
+ *      This product includes software developed by CESNET z.s.p.o.
+ * 
+ * 4. Neither the name of the CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // defined HAVE_CONFIG_H
+
+#include <cassert>
+#include <cuda_runtime_api.h>
+#include <cuda_gl_interop.h>
+
+#include "debug.h"
+#include "host.h"
+#include "video_codec.h"
+#include "video_frame.h"
+
+#include "gl_cuda.hpp"
+
+#define MOD_NAME "[GL CUDA] "
+
+#define CHECK_CUDA(cmd, action) do { \
+        cudaError_t err_ = (cmd); \
+        if (err_ != cudaSuccess) { \
+                LOG(LOG_LEVEL_ERROR) << MOD_NAME << #cmd << ": " << cudaGetErrorString(err_) << "\n"; \
+                action; \
+        } \
+} while (0)
+
+bool state_gl_cuda::init()
+{
+        unsigned int count = 0;
+        int devices[8];
+        if (cudaGLGetDevices(&count, devices, sizeof devices / sizeof devices[0], cudaGLDeviceListAll) != cudaSuccess) {
+                cudaGetLastError(); // reset the error
+                LOG(LOG_LEVEL_VERBOSE) << MOD_NAME "GL context doesn't run on a CUDA device.\n";
+                return false;
+        }
+        device = cuda_devices[0];
+        for (unsigned int i = 0; i < count; ++i) {
+                if (devices[i] == device) {
+                        glGenBuffersARB(1, &pbo);
+                        initialized = true;
+                        LOG(LOG_LEVEL_VERBOSE) << MOD_NAME "CUDA-GL interop enabled on device " << device << ".\n";
+                        return true;
+                }
+        }
+        LOG(LOG_LEVEL_VERBOSE) << MOD_NAME "CUDA device " << device << " doesn't drive the GL context.\n";
+        return false;
+}
+
+GLuint state_gl_cuda::loadFrame(const char *dev_data, size_t len)
+{
+        CHECK_CUDA(cudaSetDevice(device), return 0);
+        if (len != pbo_size) {
+                if (resource != nullptr) {
+                        cudaGraphicsUnregisterResource(resource);
+                        resource = nullptr;
+                }
+                glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, pbo);
+                glBufferDataARB(GL_PIXEL_UNPACK_BUFFER_ARB, len, nullptr, GL_STREAM_DRAW_ARB);
+                glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+                pbo_size = 0;
+                CHECK_CUDA(cudaGraphicsGLRegisterBuffer(&resource, pbo, cudaGraphicsRegisterFlagsWriteDiscard), return 0);
+                pbo_size = len;
+        }
+
+        CHECK_CUDA(cudaGraphicsMapResources(1, &resource, nullptr), return 0);
+        void *ptr = nullptr;
+        size_t size = 0;
+        GLuint ret = pbo;
+        CHECK_CUDA(cudaGraphicsResourceGetMappedPointer(&ptr, &size, resource), ret = 0);
+        if (ret != 0) {
+                CHECK_CUDA(cudaMemcpy(ptr, dev_data, len < size ? len : size, cudaMemcpyDeviceToDevice), ret = 0);
+        }
+        // unmapping orders the copy before subsequent GL commands using the buffer
+        CHECK_CUDA(cudaGraphicsUnmapResources(1, &resource, nullptr), ret = 0);
+        return ret;
+}
+
+bool state_gl_cuda::download(char *dst, const char *dev_data, size_t len)
+{
+        CHECK_CUDA(cudaMemcpy(dst, dev_data, len, cudaMemcpyDeviceToHost), return false);
+        return true;
+}
+
+void state_gl_cuda::uninit()
+{
+        if (resource != nullptr) {
+                cudaGraphicsUnregisterResource(resource);
+                resource = nullptr;
+        }
+        if (pbo != 0) {
+                glDeleteBuffersARB(1, &pbo);
+                pbo = 0;
+        }
+        pbo_size = 0;
+        initialized = false;
+}
+
+static void gl_cuda_data_deleter(struct video_frame *frame)
+{
+        for (unsigned int i = 0; i < frame->tile_count; ++i) {
+                cudaFree(frame->tiles[i].data);
+        }
+}
+
+struct video_frame *gl_cuda_alloc_frame(struct video_desc desc)
+{
+        assert(codec_is_gpu_resident(desc.color_spec));
+        struct video_frame *frame = vf_alloc_desc(desc);
+        // the current device is per thread, this may be called from the decoder
+        CHECK_CUDA(cudaSetDevice(cuda_devices[0]), );
+        for (unsigned int i = 0; i < frame->tile_count; ++i) {
+                frame->tiles[i].data_len = vc_get_linesize(desc.width, desc.color_spec) * desc.height;
+                size_t alloc_len = frame->tiles[i].data_len;
+                if (desc.color_spec == CUDA_DXT1 || desc.color_spec == CUDA_DXT5) { // texture is uploaded in whole 4x4 blocks
+                        alloc_len = vc_get_linesize((desc.width + 3) / 4 * 4, desc.color_spec) * ((desc.height + 3) / 4 * 4);
+                }
+                void *ptr = nullptr;
+                CHECK_CUDA(cudaMalloc(&ptr, alloc_len + MAX_PADDING), );
+                frame->tiles[i].data = static_cast<char *>(ptr);
+                assert(frame->tiles[i].data != nullptr);
+        }
+        frame->callbacks.data_deleter = gl_cuda_data_deleter;
+        return frame;
+}
@@ -0,0 +1,87 @@
+/**
+ * @file   gl_cuda.hpp
+ *
+ * @brief CUDA-OpenGL interoperability for GPU-resident frames
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ * 
+ *      This product includes software developed by CESNET z.s.p.o.
+ * 
+ * 4. Neither the name of the CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef GL_CUDA_HPP_7c2e5a91d04b
+#define GL_CUDA_HPP_7c2e5a91d04b
+
+#ifdef HAVE_GL_CUDA
+
+#include <cstddef>
+#include <GL/glew.h>
+
+#include "types.h"
+
+struct cudaGraphicsResource;
+struct video_frame;
+
+/**
+ * Uploads GPU-resident frames (eg. CUDA_RGBA) to a GL pixel buffer object
+ * with a device-to-device copy, so that the decoded frame never leaves the
+ * GPU. Must be used from the GL thread with the context current.
+ */
+struct state_gl_cuda {
+        bool initialized = false; ///< GL context runs on the CUDA device
+        int device = 0;
+        GLuint pbo = 0;
+        size_t pbo_size = 0;
+        cudaGraphicsResource *resource = nullptr;
+
+        bool init();
+        /**
+         * Copies len bytes of device memory to the PBO.
+         * @returns PBO to upload the texture from, 0 on error
+         */
+        GLuint loadFrame(const char *dev_data, size_t len);
+        /// fallback if loadFrame() fails - copies the frame to system memory
+        bool download(char *dst, const char *dev_data, size_t len);
+        void uninit();
+};
+
+/**
+ * Allocates frame with tiles in CUDA device memory, the data are freed by
+ * vf_free().
+ */
+struct video_frame *gl_cuda_alloc_frame(struct video_desc desc);
+
+#endif //HAVE_GL_CUDA
+#endif //GL_CUDA_HPP_7c2e5a91d04b
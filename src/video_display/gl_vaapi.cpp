@@ -0,0 +1,246 @@
+/**
+ * @file   gl_vaapi.cpp
+ *
+ * @brief VAAPI-OpenGL interoperability (DMA-BUF import via EGLImage)
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ * 
+ *      This product includes software developed by CESNET z.s.p.o.
+ * 
+ * 4. Neither the name of the CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // defined HAVE_CONFIG_H
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <unistd.h>
+#include <va/va_drmcommon.h>
+
+#include "debug.h"
+
+#include "gl_vaapi.hpp"
+
+#define MOD_NAME "[GL VAAPI] "
+
+#ifndef DRM_FORMAT_MOD_INVALID
+#define DRM_FORMAT_MOD_INVALID ((1ULL << 56) - 1)
+#endif
+
+/**
+ * @brief Checks whether space-separated extension list contains ext
+ */
+static bool has_extension(const char *list, const char *ext){
+        if(list == nullptr){
+                return false;
+        }
+        const size_t len = strlen(ext);
+        for(const char *it = strstr(list, ext); it != nullptr; it = strstr(it + len, ext)){
+                if((it == list || it[-1] == ' ') && (it[len] == ' ' || it[len] == '\0')){
+                        return true;
+                }
+        }
+        return false;
+}
+
+/**
+ * @brief Initializes state_vaapi
+ *
+ * Must be called with the GL context current.
+ * @retval false if the context doesn't support DMA-BUF import (not an EGL
+ *               context, missing extensions); HW_VAAPI must not be used then
+ */
+bool state_vaapi::init(){
+        if(initialized){
+                return true;
+        }
+
+#if !VA_CHECK_VERSION(1, 1, 0)
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Surface export requires VA-API 1.1.\n");
+        return false;
+#endif
+
+        egl_display = eglGetCurrentDisplay();
+        if(egl_display == EGL_NO_DISPLAY){
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "GL context was not created with EGL.\n");
+                return false;
+        }
+
+        const char *egl_exts = eglQueryString(egl_display, EGL_EXTENSIONS);
+        if(!has_extension(egl_exts, "EGL_EXT_image_dma_buf_import")){
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "EGL_EXT_image_dma_buf_import not supported.\n");
+                return false;
+        }
+        has_modifiers = has_extension(egl_exts, "EGL_EXT_image_dma_buf_import_modifiers");
+
+        if(!has_extension((const char *) glGetString(GL_EXTENSIONS), "GL_OES_EGL_image")){
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "GL_OES_EGL_image not supported.\n");
+                return false;
+        }
+
+        eglCreateImageKHR = (PFNEGLCREATEIMAGEKHRPROC) eglGetProcAddress("eglCreateImageKHR");
+        eglDestroyImageKHR = (PFNEGLDESTROYIMAGEKHRPROC) eglGetProcAddress("eglDestroyImageKHR");
+        glEGLImageTargetTexture2DOES = (void (*)(GLenum, void *)) eglGetProcAddress("glEGLImageTargetTexture2DOES");
+        if(!eglCreateImageKHR || !eglDestroyImageKHR || !glEGLImageTargetTexture2DOES){
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Cannot load EGLImage functions.\n");
+                return false;
+        }
+
+        glGenTextures(2, textures);
+        for(GLuint tex : textures){
+                glBindTexture(GL_TEXTURE_2D, tex);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        initialized = true;
+        return true;
+}
+
+void state_vaapi::destroyImages(){
+        for(auto &img : images){
+                if(img != EGL_NO_IMAGE_KHR){
+                        eglDestroyImageKHR(egl_display, img);
+                        img = EGL_NO_IMAGE_KHR;
+                }
+        }
+}
+
+/**
+ * @brief Binds planes of the VAAPI surface to textures (see struct state_vaapi)
+ *
+ * The frame is referenced until next call so that the decoder doesn't reuse
+ * the surface while GL may still be sampling it.
+ */
+void state_vaapi::loadFrame(hw_vaapi_frame *frame){
+        assert(initialized);
+
+#if VA_CHECK_VERSION(1, 1, 0)
+        VADisplay va_display = hw_vaapi_frame_get_display(frame);
+        VASurfaceID surface = hw_vaapi_frame_get_surface(frame);
+
+        VAStatus st = vaSyncSurface(va_display, surface);
+        if(st != VA_STATUS_SUCCESS){
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "vaSyncSurface failed: %s\n", vaErrorStr(st));
+        }
+
+        VADRMPRIMESurfaceDescriptor prime;
+        st = vaExportSurfaceHandle(va_display, surface,
+                        VA_SURFACE_ATTRIB_MEM_TYPE_DRM_PRIME_2,
+                        VA_EXPORT_SURFACE_READ_ONLY | VA_EXPORT_SURFACE_SEPARATE_LAYERS,
+                        &prime);
+        if(st != VA_STATUS_SUCCESS){
+                if(!export_failed){
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot export surface: %s\n", vaErrorStr(st));
+                        export_failed = true;
+                }
+                return;
+        }
+
+        destroyImages();
+
+        for(uint32_t i = 0; i < prime.num_layers && i < 2; i++){
+                const auto &layer = prime.layers[i];
+                const auto &object = prime.objects[layer.object_index[0]];
+                // visible size only (the surface may be aligned to coded size),
+                // layers past the first one are chroma of a 4:2:0 surface
+                EGLint width = i == 0 ? frame->av_frame->width : (frame->av_frame->width + 1) / 2;
+                EGLint height = i == 0 ? frame->av_frame->height : (frame->av_frame->height + 1) / 2;
+
+                EGLint attribs[32];
+                int n = 0;
+                attribs[n++] = EGL_WIDTH; attribs[n++] = width;
+                attribs[n++] = EGL_HEIGHT; attribs[n++] = height;
+                attribs[n++] = EGL_LINUX_DRM_FOURCC_EXT; attribs[n++] = (EGLint) layer.drm_format;
+                attribs[n++] = EGL_DMA_BUF_PLANE0_FD_EXT; attribs[n++] = object.fd;
+                attribs[n++] = EGL_DMA_BUF_PLANE0_OFFSET_EXT; attribs[n++] = (EGLint) layer.offset[0];
+                attribs[n++] = EGL_DMA_BUF_PLANE0_PITCH_EXT; attribs[n++] = (EGLint) layer.pitch[0];
+#ifdef EGL_DMA_BUF_PLANE0_MODIFIER_LO_EXT
+                if(has_modifiers && object.drm_format_modifier != DRM_FORMAT_MOD_INVALID){
+                        attribs[n++] = EGL_DMA_BUF_PLANE0_MODIFIER_LO_EXT;
+                        attribs[n++] = (EGLint) (object.drm_format_modifier & 0xFFFFFFFFU);
+                        attribs[n++] = EGL_DMA_BUF_PLANE0_MODIFIER_HI_EXT;
+                        attribs[n++] = (EGLint) (object.drm_format_modifier >> 32U);
+                }
+#endif
+                attribs[n++] = EGL_NONE;
+
+                images[i] = eglCreateImageKHR(egl_display, EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT, nullptr, attribs);
+                if(images[i] == EGL_NO_IMAGE_KHR){
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot create EGLImage for layer %u (error 0x%x)\n",
+                                        i, eglGetError());
+                        continue;
+                }
+
+                glActiveTexture(GL_TEXTURE0 + 2 + i);
+                glBindTexture(GL_TEXTURE_2D, textures[i]);
+                glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, images[i]);
+        }
+        glActiveTexture(GL_TEXTURE0 + 2);
+
+        // EGL holds own references to the buffers
+        for(uint32_t i = 0; i < prime.num_objects; i++){
+                close(prime.objects[i].fd);
+        }
+
+        av_frame_free(&lastFrame.av_frame);
+        hw_vaapi_frame_from_avframe(&lastFrame, frame->av_frame);
+#else
+        (void) frame; // not reached, init() fails
+#endif
+}
+
+/**
+ * @brief Uninitializes state_vaapi
+ */
+void state_vaapi::uninit(){
+        if(!initialized){
+                return;
+        }
+        destroyImages();
+        glDeleteTextures(2, textures);
+        for(auto &tex : textures){
+                tex = 0;
+        }
+        av_frame_free(&lastFrame.av_frame);
+        initialized = false;
+}
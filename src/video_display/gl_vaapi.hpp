@@ -0,0 +1,87 @@
+/**
+ * @file   gl_vaapi.hpp
+ *
+ * @brief VAAPI-OpenGL interoperability (DMA-BUF import via EGLImage)
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ * 
+ *      This product includes software developed by CESNET z.s.p.o.
+ * 
+ * 4. Neither the name of the CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef GL_VAAPI_HPP_4b1f0c2e9a3d
+#define GL_VAAPI_HPP_4b1f0c2e9a3d
+
+#ifdef HAVE_GL_VAAPI
+
+#include <GL/glew.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include "hwaccel_vaapi.h"
+
+/**
+ * Imports HW_VAAPI surfaces as GL textures without a round-trip through
+ * system memory. The surface is exported as DMA-BUF (one layer per plane)
+ * and each layer is bound to a texture through an EGLImage, so the GL
+ * context must have been created with EGL.
+ *
+ * After loadFrame(), luma is bound to texture unit 2 and interleaved
+ * chroma (half resolution) to unit 3.
+ */
+struct state_vaapi {
+        bool initialized = false;
+        GLuint textures[2] = {0};
+        EGLImageKHR images[2] = {EGL_NO_IMAGE_KHR, EGL_NO_IMAGE_KHR};
+        hw_vaapi_frame lastFrame = {nullptr};
+
+        EGLDisplay egl_display = EGL_NO_DISPLAY;
+        bool has_modifiers = false;
+        bool export_failed = false;
+
+        PFNEGLCREATEIMAGEKHRPROC eglCreateImageKHR = nullptr;
+        PFNEGLDESTROYIMAGEKHRPROC eglDestroyImageKHR = nullptr;
+        void (*glEGLImageTargetTexture2DOES)(GLenum target, void *image) = nullptr;
+
+        bool init();
+        void loadFrame(hw_vaapi_frame *frame);
+        void uninit();
+
+private:
+        void destroyImages();
+};
+
+#endif //HAVE_GL_VAAPI
+#endif //GL_VAAPI_HPP_4b1f0c2e9a3d
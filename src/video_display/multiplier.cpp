@@ -42,10 +42,13 @@
 #include "debug.h"
 #include "lib_common.h"
 #include "video.h"
+#include "video_codec.h"
 #include "video_display.h"
 #include "utils/misc.h"
 
+#include <algorithm>
 #include <condition_variable>
+#include <map>
 #include <vector>
 #include <memory>
 #include <mutex>
@@ -61,12 +64,67 @@ static constexpr int SKIP_FIRST_N_FRAMES_IN_STREAM = 5;
 namespace{
 struct disp_deleter{ void operator()(display *d){ display_done(d); } };
 using unique_disp = std::unique_ptr<struct display, disp_deleter>;
+struct frame_deleter{ void operator()(video_frame *f){ vf_free(f); } };
+using unique_frame = std::unique_ptr<struct video_frame, frame_deleter>;
+
+/**
+ * Received frame shared read-only by all sub-displays. Conversions to other
+ * pixel formats are done on demand, once per format, and shared as well.
+ */
+struct shared_frame {
+        explicit shared_frame(struct video_frame *f) : frame(f) {}
+        const struct video_frame *get(codec_t codec);
+
+        unique_frame frame;
+        mutex lock;
+        map<codec_t, unique_frame> converted;
+};
+
+const struct video_frame *shared_frame::get(codec_t codec)
+{
+        if (codec == frame->color_spec) {
+                return frame.get();
+        }
+        lock_guard<mutex> lk(lock);
+        auto &conv = converted[codec];
+        if (conv) {
+                return conv.get();
+        }
+        const codec_t candidates[] = { codec, VIDEO_CODEC_NONE };
+        codec_t out = VIDEO_CODEC_NONE;
+        struct decoder_chain chain;
+        if (!get_best_decoder_chain_from(frame->color_spec, candidates, &out, &chain)) {
+                return nullptr;
+        }
+        struct video_desc desc = video_desc_from_frame(frame.get());
+        desc.color_spec = codec;
+        conv.reset(vf_alloc_desc_data(desc));
+        const size_t src_linesize = vc_get_linesize(desc.width, frame->color_spec);
+        const size_t dst_linesize = vc_get_linesize(desc.width, codec);
+        for (unsigned int y = 0; y < desc.height; ++y) {
+                decoder_chain_decode(&chain, (unsigned char *) conv->tiles[0].data + y * dst_linesize,
+                                (const unsigned char *) frame->tiles[0].data + y * src_linesize,
+                                dst_linesize, 0, 8, 16);
+        }
+        return conv.get();
 }
 
-struct state_multiplier_common {
-        std::vector<unique_disp> displays;
+/// feeds one sub-display from its own thread so that fan-out costs just a queue push
+struct sub_display {
+        unique_disp disp;
+        struct video_desc desc{};     ///< current configuration of the display
+        int pitch = PITCH_DEFAULT;
 
-        struct video_desc display_desc;
+        queue<shared_ptr<shared_frame>> frames;
+        mutex lock;
+        condition_variable cv;
+        condition_variable frame_consumed_cv;
+        thread feeder;
+};
+}
+
+struct state_multiplier_common {
+        std::vector<std::unique_ptr<sub_display>> subs;
 
         queue<struct video_frame *> incoming_queue;
         condition_variable in_queue_decremented_cv;
@@ -126,32 +184,113 @@ static void *display_multiplier_init(struct module *parent, const char *fmt, uns
                         abort();
                 }
                 unique_disp disp(d_ptr);
-                if (display_needs_mainloop(disp.get()) && !s->common->displays.empty()) {
+                if (display_needs_mainloop(disp.get()) && !s->common->subs.empty()) {
                         LOG(LOG_LEVEL_ERROR) << "[multiplier] Display " << display << " needs mainloop and should be given first!\n";
                 }
 
-                s->common->displays.push_back(std::move(disp));
+                s->common->subs.push_back(std::make_unique<sub_display>());
+                s->common->subs.back()->disp = std::move(disp);
         }
 
         return s.release();
 }
 
-static void check_reconf(struct state_multiplier_common *s, struct video_desc desc)
+/// configures the display for the frame, in-place if it supports the pixel format or to the best conversion
+static bool sub_display_reconfigure(struct sub_display *sd, struct video_desc desc)
+{
+        codec_t codecs[VIDEO_CODEC_COUNT];
+        size_t len = sizeof codecs - sizeof(codec_t);
+        if (!display_ctl_property(sd->disp.get(), DISPLAY_PROPERTY_CODECS, codecs, &len)) {
+                len = 0;
+        }
+        codecs[len / sizeof(codec_t)] = VIDEO_CODEC_NONE;
+        codec_t out = desc.color_spec;
+        struct decoder_chain chain;
+        if (len > 0 && !get_best_decoder_chain_from(desc.color_spec, codecs, &out, &chain)) {
+                LOG(LOG_LEVEL_ERROR) << MOD_NAME << "Display cannot display " << get_codec_name(desc.color_spec) << "!\n";
+                return false;
+        }
+        if (out != desc.color_spec) {
+                LOG(LOG_LEVEL_NOTICE) << MOD_NAME << "Converting " << get_codec_name(desc.color_spec) << " to "
+                        << get_codec_name(out) << " for a display.\n";
+        }
+        desc.color_spec = out;
+        if (!display_reconfigure(sd->disp.get(), desc, VIDEO_NORMAL)) {
+                return false;
+        }
+        sd->desc = desc;
+        len = sizeof sd->pitch;
+        sd->pitch = PITCH_DEFAULT;
+        display_ctl_property(sd->disp.get(), DISPLAY_PROPERTY_BUF_PITCH, &sd->pitch, &len);
+        return true;
+}
+
+static void sub_display_feeder(struct sub_display *sd)
 {
-        if (!video_desc_eq(desc, s->display_desc)) {
-                s->display_desc = desc;
-                fprintf(stderr, "RECONFIGURED\n");
-                for(auto& disp : s->displays){
-                        display_reconfigure(disp.get(), s->display_desc, VIDEO_NORMAL);
+        struct video_desc configured{};
+        bool configured_ok = false;
+        while (1) {
+                shared_ptr<shared_frame> f;
+                {
+                        unique_lock<mutex> lk(sd->lock);
+                        sd->cv.wait(lk, [sd]{ return !sd->frames.empty(); });
+                        f = std::move(sd->frames.front());
+                        sd->frames.pop();
+                }
+                sd->frame_consumed_cv.notify_one();
+
+                if (!f) {
+                        display_put_frame(sd->disp.get(), NULL, PUTF_BLOCKING);
+                        break;
+                }
+
+                struct video_desc desc = video_desc_from_frame(f->frame.get());
+                if (!video_desc_eq(desc, configured)) {
+                        configured = desc;
+                        configured_ok = sub_display_reconfigure(sd, desc);
+                }
+                if (!configured_ok) {
+                        continue;
+                }
+
+                const struct video_frame *src = f->get(sd->desc.color_spec);
+                if (src == nullptr) {
+                        continue;
+                }
+                struct video_frame *real_display_frame = display_get_frame(sd->disp.get());
+                const size_t linesize = vc_get_linesize(src->tiles[0].width, src->color_spec);
+                const size_t pitch = sd->pitch == PITCH_DEFAULT ? linesize : sd->pitch;
+                if (pitch == linesize) {
+                        memcpy(real_display_frame->tiles[0].data, src->tiles[0].data, src->tiles[0].data_len);
+                } else {
+                        for (unsigned int y = 0; y < src->tiles[0].height; ++y) {
+                                memcpy(real_display_frame->tiles[0].data + y * pitch,
+                                                src->tiles[0].data + y * linesize, linesize);
+                        }
                 }
+                display_put_frame(sd->disp.get(), real_display_frame, PUTF_BLOCKING);
         }
 }
 
+static void sub_display_push(struct sub_display *sd, shared_ptr<shared_frame> f)
+{
+        {
+                unique_lock<mutex> lk(sd->lock);
+                sd->frame_consumed_cv.wait(lk, [sd]{ return sd->frames.size() < IN_QUEUE_MAX_BUFFER_LEN; });
+                sd->frames.push(std::move(f));
+        }
+        sd->cv.notify_one();
+}
+
 static void display_multiplier_worker(void *state)
 {
         shared_ptr<struct state_multiplier_common> s = ((struct state_multiplier *)state)->common;
         int skipped = 0;
 
+        for (auto& sd : s->subs) {
+                sd->feeder = thread(sub_display_feeder, sd.get());
+        }
+
         while (1) {
                 struct video_frame *frame;
                 {
@@ -163,8 +302,8 @@ static void display_multiplier_worker(void *state)
                 }
 
                 if (!frame) {
-                        for (auto& disp : s->displays) {
-                                display_put_frame(disp.get(), NULL, PUTF_BLOCKING);
+                        for (auto& sd : s->subs) {
+                                sub_display_push(sd.get(), nullptr);
                         }
                         break;
                 }
@@ -175,15 +314,15 @@ static void display_multiplier_worker(void *state)
                         continue;
                 }
 
-                check_reconf(s.get(), video_desc_from_frame(frame));
-
-                for (auto& disp : s->displays) {
-                        struct video_frame *real_display_frame = display_get_frame(disp.get());
-                        memcpy(real_display_frame->tiles[0].data, frame->tiles[0].data, frame->tiles[0].data_len);
-                        display_put_frame(disp.get(), real_display_frame, PUTF_BLOCKING);
+                // the frame is shared by all sub-displays, freed by the last one
+                auto shared = make_shared<shared_frame>(frame);
+                for (auto& sd : s->subs) {
+                        sub_display_push(sd.get(), shared);
                 }
+        }
 
-                vf_free(frame);
+        for (auto& sd : s->subs) {
+                sd->feeder.join();
         }
 }
 
@@ -199,19 +338,19 @@ static void display_multiplier_run(void *state)
 {
         shared_ptr<struct state_multiplier_common> s = ((struct state_multiplier *)state)->common;
 
-        assert(!s->displays.empty());
+        assert(!s->subs.empty());
 
-        for (size_t i = 1; i < s->displays.size(); i++) {
-                display_run_new_thread(s->displays[i].get());
+        for (size_t i = 1; i < s->subs.size(); i++) {
+                display_run_new_thread(s->subs[i]->disp.get());
         }
 
         s->worker_thread = thread(display_multiplier_worker, state);
 
-        display_run_this_thread(s->displays[0].get());
+        display_run_this_thread(s->subs[0]->disp.get());
 
         s->worker_thread.join();
-        for (size_t i = 1; i < s->displays.size(); i++) {
-                display_join(s->displays[i].get());
+        for (size_t i = 1; i < s->subs.size(); i++) {
+                display_join(s->subs[i]->disp.get());
         }
 }
 
@@ -268,7 +407,15 @@ static int display_multiplier_get_property(void *state, int property, void *val,
 
         }
         //TODO Find common properties, for now just return properties of the first display
-        return display_ctl_property(s->displays[0].get(), property, val, len);
+        if (!display_ctl_property(s->subs[0]->disp.get(), property, val, len)) {
+                return FALSE;
+        }
+        if (property == DISPLAY_PROPERTY_CODECS) { // frames are copied in system memory
+                codec_t *codecs = (codec_t *) val;
+                codec_t *end = remove_if(codecs, codecs + *len / sizeof(codec_t), codec_is_gpu_resident);
+                *len = (end - codecs) * sizeof(codec_t);
+        }
+        return TRUE;
 }
 
 static int display_multiplier_reconfigure(void *state, struct video_desc desc)
@@ -284,7 +431,7 @@ static void display_multiplier_put_audio_frame(void *state, const struct audio_f
 {
         auto *s = static_cast<struct state_multiplier *>(state);
 
-        display_put_audio_frame(s->common->displays.at(0).get(), frame);
+        display_put_audio_frame(s->common->subs.at(0)->disp.get(), frame);
 }
 
 static int display_multiplier_reconfigure_audio(void *state, int quant_samples, int channels,
@@ -292,13 +439,13 @@ static int display_multiplier_reconfigure_audio(void *state, int quant_samples,
 {
         auto *s = static_cast<struct state_multiplier *>(state);
 
-        return display_reconfigure_audio(s->common->displays.at(0).get(), quant_samples, channels, sample_rate);
+        return display_reconfigure_audio(s->common->subs.at(0)->disp.get(), quant_samples, channels, sample_rate);
 }
 
 static auto display_multiplier_needs_mainloop(void *state)
 {
         auto s = static_cast<struct state_multiplier *>(state)->common;
-        return !s->displays.empty() && display_needs_mainloop(s->displays[0].get());
+        return !s->subs.empty() && display_needs_mainloop(s->subs[0]->disp.get());
 }
 
 static void display_multiplier_probe(struct device_info **available_cards, int *count, void (**deleter)(void *)) {
@@ -58,11 +58,13 @@
 #include "utils/color_out.h"
 #include "utils/macros.h" // OPTIMIZED_FOR
 #include "utils/misc.h"
+#include "utils/video_frame_pool.h"
 #include "video.h"
 #include "video_display.h"
 
 #define DEFAULT_AUDIO_LEVEL 0
 #define MOD_NAME "[NDI disp.] "
+#define POOL_FRAMES 3 ///< frame being sent + frame being decoded + spare one
 
 typedef void ndi_disp_convert_t(const struct video_frame *f, char *out);
 static void ndi_disp_convert_Y216_to_P216(const struct video_frame *f, char *out);
@@ -77,12 +79,22 @@ struct display_ndi {
         char *video_metadata;
         struct video_desc desc;
         struct audio_desc audio_desc;
+        void *pool;
         struct video_frame *send_frame; ///< frame that is just being asynchronously sent
 
         ndi_disp_convert_t *convert;
-        char *convert_buffer; ///< for codecs that need conversion (eg. Y216->P216)
+        char *convert_buffer[2]; ///< for codecs that need conversion (eg. Y216->P216), one may be being sent
+        int convert_idx;
 };
 
+/// waits for the async frame to be processed and returns its buffer
+static void display_ndi_flush(struct display_ndi *s)
+{
+        s->NDIlib->send_send_video_v2(s->pNDI_send, NULL);
+        VIDEO_FRAME_DISPOSE(s->send_frame);
+        s->send_frame = NULL;
+}
+
 static void display_ndi_probe(struct device_info **available_cards, int *count, void (**deleter)(void *))
 {
         *count = 1;
@@ -115,9 +127,16 @@ static int display_ndi_reconfigure(void *state, struct video_desc desc)
 {
         struct display_ndi *s = (struct display_ndi *) state;
 
+        display_ndi_flush(s);
         s->desc = desc;
-        free(s->convert_buffer);
-        s->convert_buffer = malloc(MAX_BPS * desc.width * desc.height + MAX_PADDING);
+        for (int i = 0; i < 2; ++i) {
+                free(s->convert_buffer[i]);
+                s->convert_buffer[i] = malloc(MAX_BPS * desc.width * desc.height + MAX_PADDING);
+        }
+        if (s->pool != NULL) {
+                video_frame_pool_destroy(s->pool);
+        }
+        s->pool = video_frame_pool_init(desc, POOL_FRAMES);
 
         s->NDI_video_frame.xres = s->desc.width;
         s->NDI_video_frame.yres = s->desc.height;
@@ -262,11 +281,15 @@ static void display_ndi_done(void *state)
 {
         struct display_ndi *s = (struct display_ndi *) state;
 
+        display_ndi_flush(s);
         s->NDIlib->send_destroy(s->pNDI_send);
-        free(s->convert_buffer);
+        free(s->convert_buffer[0]);
+        free(s->convert_buffer[1]);
         s->NDIlib->destroy();
         close_ndi_library(s->lib);
-        vf_free(s->send_frame);
+        if (s->pool != NULL) {
+                video_frame_pool_destroy(s->pool);
+        }
         free(s->video_metadata);
         free(s);
 }
@@ -275,7 +298,7 @@ static struct video_frame *display_ndi_getf(void *state)
 {
         struct display_ndi *s = (struct display_ndi *) state;
 
-        return vf_alloc_desc_data(s->desc);
+        return video_frame_pool_get_disposable_frame(s->pool);
 }
 
 static void ndi_disp_convert_Y216_to_P216(const struct video_frame *f, char *out)
@@ -332,24 +355,27 @@ static int display_ndi_putf(void *state, struct video_frame *frame, int flag)
         }
 
         if (flag == PUTF_DISCARD) {
-                vf_free(frame);
+                VIDEO_FRAME_DISPOSE(frame);
                 return TRUE;
         }
 
-        s->NDIlib->send_send_video_v2(s->pNDI_send, NULL); // wait for the async frame to be processed
-        vf_free(s->send_frame);
-        s->send_frame = NULL;
-
+        // The previous frame is still being processed by NDI - convert to
+        // the other buffer, the next async send waits for the previous one.
+        struct video_frame *sent_frame = NULL;
         if (s->convert != NULL) {
-                s->convert(frame, s->convert_buffer);
-                s->NDI_video_frame.p_data = (uint8_t *) s->convert_buffer;
-                vf_free(frame);
+                s->convert_idx ^= 1;
+                s->convert(frame, s->convert_buffer[s->convert_idx]);
+                s->NDI_video_frame.p_data = (uint8_t *) s->convert_buffer[s->convert_idx];
+                VIDEO_FRAME_DISPOSE(frame);
         } else {
                 s->NDI_video_frame.p_data = (uint8_t *) frame->tiles[0].data;
-                s->send_frame = frame;
+                sent_frame = frame;
         }
 
         s->NDIlib->send_send_video_async_v2(s->pNDI_send, &s->NDI_video_frame);
+        // now the previous frame was released by NDI
+        VIDEO_FRAME_DISPOSE(s->send_frame);
+        s->send_frame = sent_frame;
 
         return TRUE;
 }
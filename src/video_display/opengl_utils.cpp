@@ -34,6 +34,8 @@
  * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
+#include <algorithm>
+#include <cmath>
 #include <vector>
 #include <stdexcept>
 #include <glm/glm.hpp>
@@ -42,7 +44,9 @@
 #include <glm/gtc/quaternion.hpp>
 #include "opengl_utils.hpp"
 
+#include "gl_program_cache.h"
 #include "utils/profile_timer.hpp"
+#include "utils/viewport_tiles.h"
 
 static const float PI_F=3.14159265358979f;
 
@@ -158,6 +162,11 @@ static std::vector<float> gen_sphere_vertices(int r, int latitude_n, int longtit
 static std::vector<unsigned> gen_sphere_indices(int latitude_n, int longtitude_n);
 
 GlProgram::GlProgram(const char *vert_src, const char *frag_src){
+        program = glCreateProgram();
+        if (gl_program_cache_load(program, vert_src, frag_src)) {
+                return;
+        }
+
         GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
         GLuint fragShader = glCreateShader(GL_FRAGMENT_SHADER);
 
@@ -166,10 +175,10 @@ GlProgram::GlProgram(const char *vert_src, const char *frag_src){
         glShaderSource(fragShader, 1, &frag_src, NULL);
         compileShader(fragShader);
 
-        program = glCreateProgram();
         glAttachShader(program, vertexShader);
         glAttachShader(program, fragShader);
         glLinkProgram(program);
+        gl_program_cache_store(program, vert_src, frag_src);
         //glUseProgram(program);
 
         glDetachShader(program, vertexShader);
@@ -441,9 +450,61 @@ void Scene::render(int width, int height){
         render(width, height, pvMat);
 }
 
+/**
+ * Direction on the unit sphere for texture coordinates, inverse to the mapping
+ * of gen_sphere_vertices().
+ */
+static glm::vec3 sphere_dir(float u, float v){
+        float phi = (1 - u) * 2 * PI_F;
+        float theta = v * PI_F;
+        return {std::sin(phi) * std::sin(theta), std::cos(theta), std::cos(phi) * std::sin(theta)};
+}
+
+/**
+ * Reports panorama cells (see utils/viewport_tiles.h) in or near the view to
+ * the sender. Cells are sampled in a sparse grid, the cell in the view center
+ * is added explicitly for narrow FOVs.
+ */
+static void report_viewport(const glm::mat4& pvMat){
+        constexpr float margin = 1.25f; // clip space; includes cells "near" the viewport
+        constexpr int samples = 4; // per cell edge
+        struct viewport_tiles visible{};
+
+        for(int row = 0; row < VIEWPORT_TILES_ROWS; row++){
+                for(int col = 0; col < VIEWPORT_TILES_COLS; col++){
+                        bool cell_visible = false;
+                        for(int sy = 0; sy <= samples && !cell_visible; sy++){
+                                for(int sx = 0; sx <= samples && !cell_visible; sx++){
+                                        float u = (col + static_cast<float>(sx) / samples) / VIEWPORT_TILES_COLS;
+                                        float v = (row + static_cast<float>(sy) / samples) / VIEWPORT_TILES_ROWS;
+                                        glm::vec4 c = pvMat * glm::vec4(sphere_dir(u, v), 1.f);
+                                        cell_visible = c.w > 0 && std::fabs(c.x) <= margin * c.w
+                                                && std::fabs(c.y) <= margin * c.w;
+                                }
+                        }
+                        if(cell_visible){
+                                viewport_tiles_set(&visible, col, row);
+                        }
+                }
+        }
+
+        glm::vec4 center = glm::inverse(pvMat) * glm::vec4(0.f, 0.f, 0.f, 1.f);
+        glm::vec3 dir = glm::normalize(glm::vec3(center) / center.w);
+        float phi = std::atan2(dir.x, dir.z);
+        if(phi < 0) phi += 2 * PI_F;
+        float theta = std::acos(glm::clamp(dir.y, -1.f, 1.f));
+        int col = static_cast<int>((1 - phi / (2 * PI_F)) * VIEWPORT_TILES_COLS) % VIEWPORT_TILES_COLS;
+        int row = std::min(static_cast<int>(theta / PI_F * VIEWPORT_TILES_ROWS), VIEWPORT_TILES_ROWS - 1);
+        viewport_tiles_set(&visible, col, row);
+
+        viewport_tiles_report(&visible);
+}
+
 void Scene::render(int width, int height, const glm::mat4& pvMat){
         PROFILE_FUNC;
 
+        report_viewport(pvMat);
+
         glUseProgram(program.get());
         glViewport(0, 0, width, height);
         GLuint pvLoc;
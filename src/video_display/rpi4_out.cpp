@@ -48,6 +48,7 @@
 #include "utils/misc.h"
 #include "utils/color_out.h"
 
+#include <algorithm>
 #include <memory>
 #include <queue>
 #include <stack>
@@ -70,7 +71,7 @@ extern "C" { //needed for rpi_zc.h and rpi_sand_fns.h
 #include <libavutil/rpi_sand_fns.h>
 }
 
-#define MAX_BUFFER_SIZE 4
+#define DEFAULT_BUFFER_SIZE 4 ///< default frame queue depth (and renderer buffer count)
 
 namespace{
 
@@ -113,7 +114,7 @@ using mmal_buf_header_unique = std::unique_ptr<MMAL_BUFFER_HEADER_T, mmal_buf_he
 class Rpi4_video_out{
 public:
         Rpi4_video_out() = default;
-        Rpi4_video_out(int x, int y, int width, int height, bool fs, int layer);
+        Rpi4_video_out(int x, int y, int width, int height, bool fs, int layer, int buffer_count);
 
         void display(AVFrame *f);
 
@@ -160,6 +161,7 @@ private:
         int y_dir = 2;
         bool fullscreen;
         int layer;
+        int buffer_count;
 
         MMAL_ES_FORMAT_T curr_stream_format = {};
 
@@ -197,13 +199,14 @@ static void release_buf_cb(MMAL_PORT_T *, MMAL_BUFFER_HEADER_T *buf){
         mmal_buffer_header_release(buf);
 }
 
-Rpi4_video_out::Rpi4_video_out(int x, int y, int width, int height, bool fs, int layer):
+Rpi4_video_out::Rpi4_video_out(int x, int y, int width, int height, bool fs, int layer, int buffer_count):
         out_pos_x(x),
         out_pos_y(y),
         out_width(width),
         out_height(height),
         fullscreen(fs),
-        layer(layer)
+        layer(layer),
+        buffer_count(buffer_count)
 {
         bcm_host_init();
 
@@ -225,7 +228,7 @@ Rpi4_video_out::Rpi4_video_out(int x, int y, int width, int height, bool fs, int
         }
 
 
-        pool.reset(mmal_pool_create(MAX_BUFFER_SIZE, 0));
+        pool.reset(mmal_pool_create(buffer_count, 0));
         if(!pool){
                 throw std::runtime_error("Failed to create pool");
         }
@@ -313,7 +316,7 @@ void Rpi4_video_out::display(AVFrame *f){
         stream_fmt_from_frame(&stream_fmt, f, zc_frame.get());
         set_output_format(&stream_fmt);
 
-        renderer_component->input[0]->buffer_num = MAX_BUFFER_SIZE;
+        renderer_component->input[0]->buffer_num = buffer_count;
         renderer_component->input[0]->buffer_size = av_rpi_zc_numbytes(zc_frame.get());
 
         if(!renderer_component->input[0]->is_enabled){
@@ -361,17 +364,19 @@ struct rpi4_display_state{
         int force_w = 0;
         int force_h = 0;
         bool fullscreen = false;
+        size_t queue_len = DEFAULT_BUFFER_SIZE; ///< max frames waiting for display
 
         Rpi4_video_out video_out;
 };
 
 static void print_rpi4_out_help(){
         col() << "usage:\n";
-        col() << TBOLD(TRED("\t-d rpi4") << "[:force-size=<w>x<h>|:position=<x>x<y>|:fs]* | help\n\n");
+        col() << TBOLD(TRED("\t-d rpi4") << "[:force-size=<w>x<h>|:position=<x>x<y>|:fs|:queue=<n>]* | help\n\n");
         col() << "options:\n";
         col() << TBOLD("\tfs")          << "\t\tfullscreen\n";
         col() << TBOLD("\tforce-size")  << "\t\tspecifies desired size of output\n";
         col() << TBOLD("\tposition")    << "\t\tspecifies the desired position of output (coordinates of top left corner)\n";
+        col() << TBOLD("\tqueue")       << "\t\tnumber of frames queued for display (default " << DEFAULT_BUFFER_SIZE << "), lower values decrease latency\n";
 }
 
 static void *display_rpi4_init(struct module *parent, const char *cfg, unsigned int flags)
@@ -402,6 +407,16 @@ static void *display_rpi4_init(struct module *parent, const char *cfg, unsigned
                         }
                 } else if(key == "fs"){
                         s->fullscreen = true;
+                } else if(key == "queue"){
+                        auto val = tokenize(token, '=');
+                        int queue_len = 0;
+                        if(std::from_chars(val.data(), val.data() + val.size(), queue_len).ec != std::errc()
+                                        || queue_len < 1)
+                        {
+                                log_msg(LOG_LEVEL_ERROR, "[RPi4 out] Wrong queue length!\n");
+                                return nullptr;
+                        }
+                        s->queue_len = queue_len;
                 } else if(key == "position"){
                         auto val = tokenize(token, '=');
 
@@ -424,7 +439,8 @@ static void *display_rpi4_init(struct module *parent, const char *cfg, unsigned
 
         s->video_out = Rpi4_video_out(s->requested_pos_x, s->requested_pos_y,
                         width, height,
-                        s->fullscreen, 2);
+                        s->fullscreen, 2,
+                        std::max<int>(s->queue_len, 2)); // one buffer is held by the renderer while displayed
 
         return s.release();
 }
@@ -516,7 +532,7 @@ static int display_rpi4_putf(void *state, struct video_frame *frame, int flags)
                 return 0;
         }
 
-        if (s->frame_queue.size() >= MAX_BUFFER_SIZE && flags == PUTF_NONBLOCK) {
+        if (s->frame_queue.size() >= s->queue_len && flags == PUTF_NONBLOCK) {
                 log_msg(LOG_LEVEL_VERBOSE, "nonblock putf drop\n");
                 vf_recycle(frame);
                 std::lock_guard(s->free_frames_mut);
@@ -525,7 +541,7 @@ static int display_rpi4_putf(void *state, struct video_frame *frame, int flags)
         }
 
         std::unique_lock lk(s->frame_queue_mut);
-        s->frame_consumed_cv.wait(lk, [s]{return s->frame_queue.size() < MAX_BUFFER_SIZE;});
+        s->frame_consumed_cv.wait(lk, [s]{return s->frame_queue.size() < s->queue_len;});
         s->frame_queue.emplace(frame);
         lk.unlock();
         s->new_frame_ready_cv.notify_one();
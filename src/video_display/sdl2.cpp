@@ -42,11 +42,13 @@
  * Missing from SDL1:
  * * audio (would be perhaps better as an audio playback device)
  * * autorelease_pool (macOS) - perhaps not needed
- * @todo
- * * frames are copied, better would be to preallocate textures and set
- *   video_frame::tiles::data to SDL_LockTexture() pixels. This, however,
- *   needs decoder to use either pitch (toggling fullscreen or resize) or
- *   forcing decoder to reconfigure pitch.
+ *
+ * By default, frames are copied to the texture with SDL_UpdateTexture(). With
+ * the option "direct", a small ring of streaming textures is kept locked and
+ * video_frame::tiles::data points directly to SDL_LockTexture() pixels, so that
+ * the decoder writes to the texture memory (using the texture pitch). Textures
+ * are locked, unlocked and recreated only by the SDL thread, decoder thread
+ * waits for the ring to be recreated in display_sdl2_reconfigure().
  */
 
 #ifdef HAVE_CONFIG_H
@@ -89,6 +91,7 @@
 
 #define MAGIC_SDL2   0x3cc234a1
 #define MAX_BUFFER_SIZE   1
+#define DIRECT_TEXTURE_COUNT 3 ///< 1 decoded + 1 queued (MAX_BUFFER_SIZE) + 1 displayed
 #define MOD_NAME "[SDL] "
 
 using rang::fg;
@@ -101,12 +104,14 @@ static void display_sdl2_new_message(struct module *);
 static int display_sdl2_putf(void *state, struct video_frame *frame, int nonblock);
 static int display_sdl2_reconfigure(void *state, struct video_desc desc);
 static int display_sdl2_reconfigure_real(void *state, struct video_desc desc);
+static uint32_t get_ug_to_sdl_format(codec_t ug_codec);
 
 struct state_sdl2 {
         struct module           mod;
 
         Uint32                  sdl_user_new_frame_event;
         Uint32                  sdl_user_new_message_event;
+        Uint32                  sdl_user_reconfigure_event;
 
         chrono::steady_clock::time_point tv{chrono::steady_clock::now()};
         unsigned long long int  frames{0};
@@ -124,7 +129,10 @@ struct state_sdl2 {
         bool                    keep_aspect{false};
         bool                    vsync{true};
         bool                    fixed_size{false};
+        bool                    direct{false}; ///< decode to locked streaming textures
         int                     fixed_w{0}, fixed_h{0};
+        SDL_Rect                crop{};         ///< requested region to be shown, zero width - whole frame (guarded by lock)
+        SDL_Rect                display_crop{}; ///< region currently shown, set on reconfigure
         uint32_t                window_flags{0}; ///< user requested flags
 
         mutex                   lock;
@@ -137,6 +145,18 @@ struct state_sdl2 {
 
         queue<struct video_frame *> free_frame_queue;
 
+        /// frame backed by a streaming texture (see "direct" option)
+        struct direct_buffer {
+                SDL_Texture *texture;
+                bool         locked;
+                bool         stale; ///< texture already destroyed, free the frame once returned
+        };
+        unordered_map<struct video_frame *, direct_buffer> direct_buffers; ///< guarded by lock
+        int                     direct_pitch{PITCH_DEFAULT}; ///< pitch of the direct textures reported to decoder
+        condition_variable      reconfigured_cv;
+        bool                    reconfigure_pending{false};
+        bool                    reconfigure_result{false};
+
         state_sdl2(struct module *parent) {
                 module_init_default(&mod);
                 mod.priv_magic = MAGIC_SDL2;
@@ -144,9 +164,10 @@ struct state_sdl2 {
                 mod.cls = MODULE_CLASS_DATA;
                 module_register(&mod, parent);
 
-                sdl_user_new_frame_event = SDL_RegisterEvents(2);
+                sdl_user_new_frame_event = SDL_RegisterEvents(3);
                 assert(sdl_user_new_frame_event != (Uint32) -1);
                 sdl_user_new_message_event = sdl_user_new_frame_event + 1;
+                sdl_user_reconfigure_event = sdl_user_new_frame_event + 2;
         }
         ~state_sdl2() {
                 module_done(&mod);
@@ -159,15 +180,157 @@ static constexpr array display_sdl2_keybindings{
         pair{'q', "quit"}
 };
 
+/**
+ * Destroys the textures of all direct buffers. Frames that are not currently
+ * held by the decoder are freed immediately, the others are marked as stale
+ * and freed when returned.
+ *
+ * @note to be called from the SDL thread with s->lock held
+ */
+static void direct_buffers_release(struct state_sdl2 *s)
+{
+        for (auto &b : s->direct_buffers) {
+                if (b.second.texture != nullptr) {
+                        SDL_DestroyTexture(b.second.texture);
+                        b.second.texture = nullptr;
+                }
+                b.second.stale = true;
+        }
+
+        queue<struct video_frame *> keep;
+        while (!s->free_frame_queue.empty()) {
+                struct video_frame *f = s->free_frame_queue.front();
+                s->free_frame_queue.pop();
+                if (s->direct_buffers.erase(f) > 0) {
+                        vf_free(f);
+                } else {
+                        keep.push(f);
+                }
+        }
+        s->free_frame_queue = move(keep);
+        if (s->last_frame != nullptr && s->direct_buffers.erase(s->last_frame) > 0) {
+                vf_free(s->last_frame);
+                s->last_frame = nullptr;
+        }
+        s->direct_pitch = PITCH_DEFAULT;
+}
+
+/**
+ * Creates DIRECT_TEXTURE_COUNT locked streaming textures and puts frames
+ * pointing to their pixels into the free frame queue.
+ *
+ * @note to be called from the SDL thread
+ */
+static bool direct_buffers_create(struct state_sdl2 *s, struct video_desc desc)
+{
+        for (int i = 0; i < DIRECT_TEXTURE_COUNT; ++i) {
+                SDL_Texture *texture = SDL_CreateTexture(s->renderer, get_ug_to_sdl_format(desc.color_spec), SDL_TEXTUREACCESS_STREAMING, desc.width, desc.height);
+                if (texture == nullptr) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unable to create texture: %s\n", SDL_GetError());
+                        return false;
+                }
+                void *pixels = nullptr;
+                int pitch = 0;
+                if (SDL_LockTexture(texture, NULL, &pixels, &pitch) != 0) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unable to lock texture: %s\n", SDL_GetError());
+                        SDL_DestroyTexture(texture);
+                        return false;
+                }
+                lock_guard<mutex> lk(s->lock);
+                if (s->direct_pitch != PITCH_DEFAULT && pitch != s->direct_pitch) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Texture pitch mismatch (%d vs %d)!\n", pitch, s->direct_pitch);
+                        SDL_DestroyTexture(texture);
+                        return false;
+                }
+                s->direct_pitch = pitch;
+                struct video_frame *f = vf_alloc_desc(desc);
+                f->tiles[0].data = (char *) pixels;
+                f->tiles[0].data_len = pitch * desc.height;
+                s->direct_buffers.emplace(f, state_sdl2::direct_buffer{texture, true, false});
+                s->free_frame_queue.push(f);
+        }
+        return true;
+}
+
+/**
+ * Handles decoder reconfiguration in direct mode - recreates the window (if
+ * needed) and the ring of the textures.
+ *
+ * @note to be called from the SDL thread
+ */
+static bool display_sdl2_reconfigure_direct(struct state_sdl2 *s, struct video_desc desc)
+{
+        unique_lock<mutex> lk(s->lock);
+        direct_buffers_release(s);
+        lk.unlock();
+
+        if (!display_sdl2_reconfigure_real(s, desc)) {
+                return false;
+        }
+        if (codec_is_planar(desc.color_spec)) {
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Planar codec %s, frames will be copied.\n", get_codec_name(desc.color_spec));
+                return true;
+        }
+        if (!direct_buffers_create(s, desc)) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Cannot use direct textures, frames will be copied.\n");
+                lk.lock();
+                direct_buffers_release(s);
+                return true;
+        }
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Decoding directly to %d textures, pitch %d B.\n", DIRECT_TEXTURE_COUNT, s->direct_pitch);
+        return true;
+}
+
+static const SDL_Rect *get_src_rect(struct state_sdl2 *s)
+{
+        return s->display_crop.w > 0 ? &s->display_crop : nullptr;
+}
+
+/// size of the shown picture - either the whole frame or the cropped region
+static void get_view_size(struct state_sdl2 *s, struct video_desc desc, int *width, int *height)
+{
+        *width = s->display_crop.w > 0 ? s->display_crop.w : (int) desc.width;
+        *height = s->display_crop.w > 0 ? s->display_crop.h : (int) desc.height;
+}
+
 static void display_frame(struct state_sdl2 *s, struct video_frame *frame)
 {
         if (!frame) {
                 return;
         }
-        if (!video_desc_eq(video_desc_from_frame(frame), s->current_display_desc)) {
+
+        unique_lock<mutex> lk(s->lock);
+        auto direct = s->direct_buffers.find(frame);
+        if (direct != s->direct_buffers.end() && direct->second.stale) {
+                s->direct_buffers.erase(direct);
+                vf_free(frame);
+                return;
+        }
+        lk.unlock();
+
+        if (direct != s->direct_buffers.end()) {
+                if (direct->second.locked) {
+                        if (s->deinterlace) {
+                                vc_deinterlace((unsigned char *) frame->tiles[0].data, s->direct_pitch, frame->tiles[0].height);
+                        }
+                        SDL_UnlockTexture(direct->second.texture);
+                        direct->second.locked = false;
+                }
+                SDL_RenderCopy(s->renderer, direct->second.texture, get_src_rect(s), NULL);
+                SDL_RenderPresent(s->renderer);
+                goto free_frame;
+        }
+
+        lk.lock();
+        if (!video_desc_eq(video_desc_from_frame(frame), s->current_display_desc)
+                        || memcmp(&s->crop, &s->display_crop, sizeof s->crop) != 0) {
+                direct_buffers_release(s);
+                lk.unlock();
                 if (!display_sdl2_reconfigure_real(s, video_desc_from_frame(frame))) {
                         goto free_frame;
                 }
+        } else {
+                lk.unlock();
         }
 
         if (!s->deinterlace) {
@@ -175,7 +338,7 @@ static void display_frame(struct state_sdl2 *s, struct video_frame *frame)
                 if (codec_is_planar(frame->color_spec)) {
                         pitch = frame->tiles[0].width;
                 } else {
-                        pitch = vc_get_linesize(frame->tiles[0].width, frame->color_spec);
+                        pitch = frame->tiles[0].data_len / frame->tiles[0].height;
                 }
                 SDL_UpdateTexture(s->texture, NULL, frame->tiles[0].data, pitch);
         } else {
@@ -186,7 +349,7 @@ static void display_frame(struct state_sdl2 *s, struct video_frame *frame)
                 SDL_UnlockTexture(s->texture);
         }
 
-        SDL_RenderCopy(s->renderer, s->texture, NULL, NULL);
+        SDL_RenderCopy(s->renderer, s->texture, get_src_rect(s), NULL);
         SDL_RenderPresent(s->renderer);
 
 free_frame:
@@ -195,9 +358,26 @@ free_frame:
         }
 
         if (s->last_frame) {
-                s->lock.lock();
-                s->free_frame_queue.push(s->last_frame);
-                s->lock.unlock();
+                lk.lock();
+                auto last = s->direct_buffers.find(s->last_frame);
+                if (last != s->direct_buffers.end()) { // lock again to be reused by decoder
+                        void *pixels = nullptr;
+                        int pitch = 0; // pitch is fixed for the texture lifetime
+                        if (SDL_LockTexture(last->second.texture, NULL, &pixels, &pitch) == 0) {
+                                s->last_frame->tiles[0].data = (char *) pixels;
+                                last->second.locked = true;
+                                s->free_frame_queue.push(s->last_frame);
+                        } else {
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unable to lock texture: %s\n", SDL_GetError());
+                                SDL_DestroyTexture(last->second.texture);
+                                s->direct_buffers.erase(last);
+                                vf_free(s->last_frame);
+                        }
+                } else {
+                        s->free_frame_queue.push(s->last_frame);
+                }
+                lk.unlock();
+                s->frame_consumed_cv.notify_all();
         }
         s->last_frame = frame;
 
@@ -288,12 +468,19 @@ static void display_sdl2_run(void *arg)
                         std::unique_lock<std::mutex> lk(s->lock);
                         s->buffered_frames_count -= 1;
                         lk.unlock();
-                        s->frame_consumed_cv.notify_one();
+                        s->frame_consumed_cv.notify_all();
                         if (sdl_event.user.data1 != NULL) {
                                 display_frame(s, (struct video_frame *) sdl_event.user.data1);
                         } else { // poison pill received
                                 should_exit_sdl = true;
                         }
+                } else if (sdl_event.type == s->sdl_user_reconfigure_event) {
+                        bool ret = display_sdl2_reconfigure_direct(s, *(struct video_desc *) sdl_event.user.data1);
+                        std::unique_lock<std::mutex> lk(s->lock);
+                        s->reconfigure_result = ret;
+                        s->reconfigure_pending = false;
+                        lk.unlock();
+                        s->reconfigured_cv.notify_one();
                 } else if (sdl_event.type == s->sdl_user_new_message_event) {
                         struct msg_universal *msg;
                         while ((msg = (struct msg_universal *) check_message(&s->mod))) {
@@ -329,8 +516,11 @@ static void display_sdl2_run(void *arg)
                         // https://forums.libsdl.org/viewtopic.php?p=38342
                         if (s->keep_aspect && sdl_event.window.event == SDL_WINDOWEVENT_RESIZED) {
                                 double area = sdl_event.window.data1 * sdl_event.window.data2;
-                                int width = sqrt(area / ((double) s->current_display_desc.height / s->current_display_desc.width));
-                                int height = sqrt(area / ((double) s->current_display_desc.width / s->current_display_desc.height));
+                                int view_w = 0;
+                                int view_h = 0;
+                                get_view_size(s, s->current_display_desc, &view_w, &view_h);
+                                int width = sqrt(area / ((double) view_h / view_w));
+                                int height = sqrt(area / ((double) view_w / view_h));
                                 SDL_SetWindowSize(s->window, width, height);
                                 debug_msg("[SDL] resizing to %d x %d\n", width, height);
                         }
@@ -366,7 +556,7 @@ static void show_help(void)
 {
         SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS);
         printf("SDL options:\n");
-        cout << style::bold << fg::red << "\t-d sdl" << fg::reset << "[[:fs|:d|:display=<didx>|:driver=<drv>|:novsync|:renderer=<ridx>|:nodecorate|:fixed_size[=WxH]|:window_flags=<f>|:pos=<x>,<y>|:keep-aspect]*|:help]\n" << style::reset;
+        cout << style::bold << fg::red << "\t-d sdl" << fg::reset << "[[:fs|:d|:display=<didx>|:driver=<drv>|:novsync|:renderer=<ridx>|:nodecorate|:fixed_size[=WxH]|:window_flags=<f>|:pos=<x>,<y>|:keep-aspect|:direct]*|:help]\n" << style::reset;
         printf("\twhere:\n");
         cout << style::bold <<"\t\t       d" << style::reset << " - deinterlace\n";
         cout << style::bold <<"\t\t      fs" << style::reset << " - fullscreen\n";
@@ -379,6 +569,7 @@ static void show_help(void)
         cout << style::bold <<"\n";
         cout << style::bold <<"\t     keep-aspect" << style::reset << " - keep window aspect ratio respecive to the video\n";
         cout << style::bold <<"\t         novsync" << style::reset << " - disable sync on VBlank\n";
+        cout << style::bold <<"\t          direct" << style::reset << " - decode directly to (locked) texture memory instead of copying the frames\n";
         cout << style::bold <<"\t      nodecorate" << style::reset << " - disable window border\n";
         cout << style::bold <<"\tfixed_size[=WxH]" << style::reset << " - use fixed sized window\n";
         cout << style::bold <<"\t    window_flags" << style::reset << " - flags to be passed to SDL_CreateWindow (use prefix 0x for hex)\n";
@@ -402,7 +593,21 @@ static int display_sdl2_reconfigure(void *state, struct video_desc desc)
         struct state_sdl2 *s = (struct state_sdl2 *) state;
 
         s->current_desc = desc;
-        return 1;
+        if (!s->direct) {
+                return 1;
+        }
+
+        // textures can be only manipulated by the SDL thread, wait for it
+        std::unique_lock<std::mutex> lk(s->lock);
+        s->reconfigure_pending = true;
+        lk.unlock();
+        SDL_Event event;
+        event.type = s->sdl_user_reconfigure_event;
+        event.user.data1 = &desc;
+        SDL_PushEvent(&event);
+        lk.lock();
+        s->reconfigured_cv.wait(lk, [s]{return !s->reconfigure_pending;});
+        return s->reconfigure_result;
 }
 
 struct ug_to_sdl_pf { codec_t first; uint32_t second; };
@@ -471,9 +676,20 @@ static int display_sdl2_reconfigure_real(void *state, struct video_desc desc)
                         desc.height);
 
         s->current_display_desc = desc;
+        unique_lock<mutex> lk(s->lock);
+        s->display_crop = s->crop;
+        lk.unlock();
+        if (s->display_crop.w > 0 && (s->display_crop.x + s->display_crop.w > (int) desc.width
+                                || s->display_crop.y + s->display_crop.h > (int) desc.height)) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Crop region exceeds the frame, showing whole frame.\n");
+                s->display_crop = SDL_Rect{};
+        }
+        int view_w = 0;
+        int view_h = 0;
+        get_view_size(s, desc, &view_w, &view_h);
 
         if (s->fixed_size && s->window) {
-                SDL_RenderSetLogicalSize(s->renderer, desc.width, desc.height);
+                SDL_RenderSetLogicalSize(s->renderer, view_w, view_h);
                 return create_texture(s, desc);
         }
 
@@ -488,8 +704,8 @@ static int display_sdl2_reconfigure_real(void *state, struct video_desc desc)
         if (get_commandline_param("window-title")) {
                 window_title = get_commandline_param("window-title");
         }
-        int width = s->fixed_w ? s->fixed_w : desc.width;
-        int height = s->fixed_h ? s->fixed_h : desc.height;
+        int width = s->fixed_w ? s->fixed_w : view_w;
+        int height = s->fixed_h ? s->fixed_h : view_h;
         int x = s->x == SDL_WINDOWPOS_UNDEFINED ? SDL_WINDOWPOS_CENTERED_DISPLAY(s->display_idx) : s->x;
         int y = s->y == SDL_WINDOWPOS_UNDEFINED ? SDL_WINDOWPOS_CENTERED_DISPLAY(s->display_idx) : s->y;
         s->window = SDL_CreateWindow(window_title, x, y, width, height, flags);
@@ -512,7 +728,7 @@ static int display_sdl2_reconfigure_real(void *state, struct video_desc desc)
         }
 
         SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "linear");
-        SDL_RenderSetLogicalSize(s->renderer, desc.width, desc.height);
+        SDL_RenderSetLogicalSize(s->renderer, view_w, view_h);
 
         if (!create_texture(s, desc)) {
                 return FALSE;
@@ -536,7 +752,7 @@ static void loadSplashscreen(struct state_sdl2 *s) {
         desc.fps = 1;
         desc.tile_count = 1;
 
-        display_sdl2_reconfigure(s, desc);
+        s->current_desc = desc; // SDL thread is not running yet, don't use direct textures
 
         struct video_frame *frame = vf_alloc_desc_data(desc);
 
@@ -594,6 +810,8 @@ static void *display_sdl2_init(struct module *parent, const char *fmt, unsigned
                         s->window_flags |= SDL_WINDOW_BORDERLESS;
                 } else if (strcmp(tok, "keep-aspect") == 0) {
                         s->keep_aspect = true;
+                } else if (strcmp(tok, "direct") == 0) {
+                        s->direct = true;
 		} else if (strncmp(tok, "fixed_size", strlen("fixed_size")) == 0) {
 			s->fixed_size = true;
 			if (strncmp(tok, "fixed_size=", strlen("fixed_size=")) == 0) {
@@ -666,6 +884,7 @@ static void display_sdl2_done(void *state)
 
         assert(s->mod.priv_magic == MAGIC_SDL2);
 
+        direct_buffers_release(s);
         vf_free(s->last_frame);
 
         while (s->free_frame_queue.size() > 0) {
@@ -700,19 +919,33 @@ static struct video_frame *display_sdl2_getf(void *state)
         struct state_sdl2 *s = (struct state_sdl2 *)state;
         assert(s->mod.priv_magic == MAGIC_SDL2);
 
-        lock_guard<mutex> lock(s->lock);
+        unique_lock<mutex> lock(s->lock);
+
+        if (!s->direct_buffers.empty()) { // direct textures are recycled by the SDL thread
+                s->frame_consumed_cv.wait(lock, [s]{return !s->free_frame_queue.empty() || s->direct_buffers.empty();});
+        }
 
         while (s->free_frame_queue.size() > 0) {
                 struct video_frame *buffer = s->free_frame_queue.front();
                 s->free_frame_queue.pop();
-                if (video_desc_eq(video_desc_from_frame(buffer), s->current_desc)) {
+                auto direct = s->direct_buffers.find(buffer);
+                if (direct != s->direct_buffers.end() && direct->second.stale) {
+                        s->direct_buffers.erase(direct);
+                        vf_free(buffer);
+                } else if (video_desc_eq(video_desc_from_frame(buffer), s->current_desc)) {
                         return buffer;
                 } else {
                         vf_free(buffer);
                 }
         }
 
-        return vf_alloc_desc_data(s->current_desc);
+        struct video_frame *frame = vf_alloc_desc_data(s->current_desc);
+        if (s->direct_pitch != PITCH_DEFAULT) { // decoder uses texture pitch (all textures lost)
+                free(frame->tiles[0].data);
+                frame->tiles[0].data_len = s->direct_pitch * frame->tiles[0].height;
+                frame->tiles[0].data = (char *) malloc(frame->tiles[0].data_len + MAX_PADDING);
+        }
+        return frame;
 }
 
 static int display_sdl2_putf(void *state, struct video_frame *frame, int nonblock)
@@ -747,7 +980,7 @@ static int display_sdl2_putf(void *state, struct video_frame *frame, int nonbloc
 
 static int display_sdl2_get_property(void *state, int property, void *val, size_t *len)
 {
-        UNUSED(state);
+        auto *s = (struct state_sdl2 *) state;
         auto codecs = get_supported_pfs();
         size_t codecs_len = codecs.size() * sizeof(codec_t);
 
@@ -760,6 +993,34 @@ static int display_sdl2_get_property(void *state, int property, void *val, size_
                                 return FALSE;
                         }
                         break;
+                case DISPLAY_PROPERTY_BUF_PITCH:
+                        if (*len < sizeof(int)) {
+                                return FALSE;
+                        }
+                        *(int *) val = s->direct_pitch;
+                        *len = sizeof(int);
+                        break;
+                case DISPLAY_PROPERTY_SCALE_TO:
+                        if (*len < 2 * sizeof(int)) {
+                                return FALSE;
+                        }
+                        // renderer scales the texture to the window, create the window with requested size
+                        if (s->fixed_w == 0) {
+                                s->fixed_w = ((int *) val)[0];
+                                s->fixed_h = ((int *) val)[1];
+                        }
+                        break;
+                case DISPLAY_PROPERTY_CROP:
+                        if (*len < 4 * sizeof(int)) {
+                                return FALSE;
+                        }
+                        {
+                                // taken from the (possibly direct) texture on render, applied on reconfigure
+                                lock_guard<mutex> lk(s->lock);
+                                const int *rect = (const int *) val;
+                                s->crop = rect[2] > 0 ? SDL_Rect{ rect[0], rect[1], rect[2], rect[3] } : SDL_Rect{};
+                        }
+                        break;
                 default:
                         return FALSE;
         }
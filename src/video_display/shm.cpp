@@ -0,0 +1,263 @@
+/**
+ * @file   video_display/shm.cpp
+ *
+ * Puts frames into a shared memory ring (see utils/video_shm.h) to be
+ * picked up by other UltraGrid processes with "-t shm". The decoder writes
+ * directly to the shared slots.
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ * 
+ *      This product includes software developed by CESNET z.s.p.o.
+ * 
+ * 4. Neither the name of the CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "debug.h"
+#include "host.h"
+#include "lib_common.h"
+#include "rang.hpp"
+#include "utils/video_shm.h"
+#include "video.h"
+#include "video_codec.h"
+#include "video_display.h"
+
+#define MOD_NAME "[shm] "
+#define DEFAULT_SLOTS 4
+
+using std::cout;
+using std::string;
+using std::vector;
+using rang::style;
+
+struct state_shm_display {
+        string name;
+        int slots = DEFAULT_SLOTS;
+        size_t min_slot_size = 0;
+        vector<codec_t> codecs = {I420, UYVY, YUYV, v210, R10k, R12L, RGBA, RGB, BGR, RG48, Y416};
+        struct video_shm *shm = nullptr;
+        struct video_desc desc{};
+        long long dropped = 0;
+};
+
+static void display_shm_usage() {
+        cout << "Usage:\n";
+        cout << "\t" << style::bold << "-d shm:name=<name>" << style::reset << "[:slots=<n>][:size=<bytes>][:codec=<codec>]\n";
+        cout << "where\n";
+        cout << "\t" << style::bold << "<name>" << style::reset << "  - name of the segment, readers use \"-t shm:name=<name>\"\n";
+        cout << "\t" << style::bold << "<n>" << style::reset << "     - number of frame slots (default " << DEFAULT_SLOTS << ", max " << VIDEO_SHM_MAX_SLOTS << "), each reader holds at most one\n";
+        cout << "\t" << style::bold << "<bytes>" << style::reset << " - minimal slot size (to avoid reallocation on format change)\n";
+        cout << "\t" << style::bold << "<codec>" << style::reset << " - force the use of a codec instead of default set\n";
+}
+
+static void *display_shm_init(struct module * /* parent */, const char *cfg, unsigned int /* flags */)
+{
+        if (strcmp(cfg, "help") == 0) {
+                display_shm_usage();
+                return &display_init_noerr;
+        }
+        auto *s = new state_shm_display();
+        auto *ccpy = static_cast<char *>(alloca(strlen(cfg) + 1));
+        strcpy(ccpy, cfg);
+        char *item = nullptr;
+        char *save_ptr = nullptr;
+        while ((item = strtok_r(ccpy, ":", &save_ptr)) != nullptr) {
+                if (strstr(item, "name=") == item) {
+                        s->name = item + strlen("name=");
+                } else if (strstr(item, "slots=") == item) {
+                        s->slots = atoi(item + strlen("slots="));
+                } else if (strstr(item, "size=") == item) {
+                        s->min_slot_size = strtoull(item + strlen("size="), nullptr, 0);
+                } else if (strstr(item, "codec=") == item) {
+                        s->codecs = { get_codec_from_name(item + strlen("codec=")) };
+                        if (s->codecs[0] == VIDEO_CODEC_NONE) {
+                                LOG(LOG_LEVEL_ERROR) << MOD_NAME "Wrong codec: " << item + strlen("codec=") << "\n";
+                                delete s;
+                                return nullptr;
+                        }
+                } else {
+                        LOG(LOG_LEVEL_ERROR) << MOD_NAME "Unrecognized option: " << item << "\n";
+                        delete s;
+                        return nullptr;
+                }
+                ccpy = nullptr;
+        }
+        if (s->name.empty() || s->slots < 1 || s->slots > VIDEO_SHM_MAX_SLOTS) {
+                display_shm_usage();
+                delete s;
+                return nullptr;
+        }
+
+        return s;
+}
+
+static void display_shm_run(void * /* state */)
+{
+}
+
+static void display_shm_done(void *state)
+{
+        auto *s = static_cast<state_shm_display *>(state);
+
+        if (s->dropped > 0) {
+                LOG(LOG_LEVEL_INFO) << MOD_NAME << s->dropped << " frames not published (all slots were being read).\n";
+        }
+        video_shm_close(s->shm);
+        delete s;
+}
+
+static struct video_frame *display_shm_getf(void *state)
+{
+        auto *s = static_cast<state_shm_display *>(state);
+
+        int slot = s->shm ? video_shm_acquire(s->shm) : -1;
+        if (slot == -1) { // no free slot - let the decoder decode to a private frame, which will be dropped
+                struct video_frame *f = vf_alloc_desc_data(s->desc);
+                f->callbacks.dispose = vf_free;
+                return f;
+        }
+
+        struct video_frame *f = vf_alloc_desc(s->desc);
+        char *data = video_shm_get_slot_data(s->shm, slot);
+        for (unsigned i = 0; i < f->tile_count; ++i) {
+                f->tiles[i].data = data + i * video_shm_get_tile_stride(s->desc);
+        }
+        f->callbacks.dispose_udata = reinterpret_cast<void *>(static_cast<intptr_t>(slot));
+        return f;
+}
+
+static int display_shm_putf(void *state, struct video_frame *frame, int flags)
+{
+        auto *s = static_cast<state_shm_display *>(state);
+
+        if (frame == nullptr) {
+                return 0;
+        }
+        if (frame->callbacks.dispose == vf_free) {
+                s->dropped += 1;
+                vf_free(frame);
+                return 0;
+        }
+        int slot = static_cast<int>(reinterpret_cast<intptr_t>(frame->callbacks.dispose_udata));
+        if (flags == PUTF_DISCARD) {
+                video_shm_release(s->shm, slot);
+        } else {
+                video_shm_publish(s->shm, slot, video_desc_from_frame(frame), frame->tiles[0].data_len);
+        }
+        vf_free(frame);
+
+        return 0;
+}
+
+static int display_shm_get_property(void *state, int property, void *val, size_t *len)
+{
+        auto *s = static_cast<state_shm_display *>(state);
+        int rgb_shift[] = DEFAULT_RGB_SHIFT_INIT;
+
+        switch (property) {
+                case DISPLAY_PROPERTY_CODECS:
+                        if (s->codecs.size() * sizeof s->codecs[0] > *len) {
+                                return FALSE;
+                        }
+                        *len = s->codecs.size() * sizeof(codec_t);
+                        memcpy(val, s->codecs.data(), *len);
+                        break;
+                case DISPLAY_PROPERTY_RGB_SHIFT:
+                        if (sizeof rgb_shift > *len) {
+                                return FALSE;
+                        }
+                        memcpy(val, rgb_shift, sizeof rgb_shift);
+                        *len = sizeof rgb_shift;
+                        break;
+                case DISPLAY_PROPERTY_BUF_PITCH:
+                        *(int *) val = PITCH_DEFAULT;
+                        *len = sizeof(int);
+                        break;
+                case DISPLAY_PROPERTY_VIDEO_MODE:
+                        *(int *) val = DISPLAY_PROPERTY_VIDEO_MERGED;
+                        *len = sizeof(int);
+                        break;
+                default:
+                        return FALSE;
+        }
+        return TRUE;
+}
+
+static int display_shm_reconfigure(void *state, struct video_desc desc)
+{
+        auto *s = static_cast<state_shm_display *>(state);
+
+        s->desc = desc;
+        size_t needed = video_shm_get_tile_stride(desc) * desc.tile_count;
+        if (s->shm && video_shm_get_slot_size(s->shm) >= needed) {
+                return TRUE;
+        }
+        video_shm_close(s->shm); // readers reopen the new segment, frames they hold stay valid
+        s->shm = video_shm_create(s->name.c_str(), s->slots, std::max(needed, s->min_slot_size));
+
+        return s->shm != nullptr;
+}
+
+static void display_shm_probe(struct device_info **available_cards, int *count, void (**deleter)(void *)) {
+        UNUSED(deleter);
+        *available_cards = nullptr;
+        *count = 0;
+}
+
+static const struct video_display_info display_shm_info = {
+        display_shm_probe,
+        display_shm_init,
+        display_shm_run,
+        display_shm_done,
+        display_shm_getf,
+        display_shm_putf,
+        display_shm_reconfigure,
+        display_shm_get_property,
+        nullptr,
+        nullptr,
+        DISPLAY_DOESNT_NEED_MAINLOOP,
+        true,
+};
+
+REGISTER_MODULE(shm, &display_shm_info, LIBRARY_CLASS_VIDEO_DISPLAY, VIDEO_DISPLAY_ABI_VERSION);
+
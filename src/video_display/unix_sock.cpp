@@ -96,6 +96,7 @@ struct state_unix_sock {
         int target_height = -1;
 
         bool ignore_putf_blocking = false;
+        bool gpu_yuv = false; ///< reader (GUI preview) converts YUV to RGB itself
 
         struct module *parent;
 };
@@ -132,6 +133,7 @@ static void *display_unix_sock_init(struct module *parent,
                 s->target_width = DEFAULT_SCALE_W;
                 s->target_height = DEFAULT_SCALE_H;
                 s->ignore_putf_blocking = true;
+                s->gpu_yuv = true;
         }
 
         while(!fmt_sv.empty()){
@@ -204,8 +206,9 @@ static void display_unix_sock_run(void *state)
                 int scale = ipc_frame_get_scale_factor(tile->width, tile->height,
                                 s->target_width, s->target_height);
 
+                codec_t codec = s->gpu_yuv ? ipc_frame_get_preview_codec(frame->color_spec) : RGB;
                 if(!ipc_frame_from_ug_frame(s->ipc_frame.get(), frame.get(),
-                                        RGB, scale))
+                                        codec, scale))
                 {
                         log_msg(LOG_LEVEL_WARNING, MOD_NAME "Unable to convert\n");
                         continue;
@@ -43,16 +43,26 @@
 
 #include <compat/platform_semaphore.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
 
 #include "debug.h"
+#include "host.h"
 #include "video.h"
 #include "video_codec.h"
 #include "video_export.h"
 
 #define MAX_QUEUE_SIZE 300
+#define CONTAINER_CHUNK_SIZE (16 * 1024 * 1024) ///< minimal size of a single write in container mode
+#define CONTAINER_PREALLOC (1024LL * 1024 * 1024)
+#define CONTAINER_PARAM "video-export-container"
+#define ALIGN_UP(x, a) (((x) + (a) - 1) / (a) * (a))
 
 /*
  * we do not need to have possible stalls, so IO is performend in a separate thread
@@ -62,11 +72,24 @@ void output_summary(struct video_export *s);
 
 struct output_entry;
 
+struct container_index_rec {
+        uint32_t frame;
+        uint32_t tile;
+        uint64_t offset;
+        uint32_t len;
+};
+
 struct output_entry {
-        char *filename;
+        char *filename; ///< NULL for a container chunk
         char *data;
         int data_len;
 
+        // container chunk only
+        uint64_t offset; ///< offset of the chunk in the container file
+        int frames;
+        struct container_index_rec *index;
+        int index_count;
+
         struct output_entry *next;
 };
 
@@ -84,8 +107,107 @@ struct video_export {
         struct video_desc saved_desc;
 
         pthread_t thread_id;
+
+        bool container;
+        int container_fd;
+        FILE *container_index;
+        uint64_t container_allocated; ///< preallocated length (export thread)
+        uint64_t container_offset;    ///< offset of the next tile (producer)
+        struct output_entry *chunk;   ///< chunk being filled
+        int chunk_capacity;
 };
 
+static void free_entry(struct output_entry *entry)
+{
+        if (entry->filename == NULL) {
+                aligned_free(entry->data);
+        } else {
+                free(entry->data);
+        }
+        free(entry->index);
+        free(entry->filename);
+        free(entry);
+}
+
+static void write_container_chunk(struct video_export *s, struct output_entry *chunk)
+{
+        uint64_t end = chunk->offset + chunk->data_len;
+#ifndef WIN32
+        if (end > s->container_allocated) {
+                uint64_t len = MAX(CONTAINER_PREALLOC, end - s->container_allocated);
+                int ret = posix_fallocate(s->container_fd, s->container_allocated, len);
+                if (ret == 0) {
+                        s->container_allocated += len;
+                } else if (ret != EOPNOTSUPP && ret != EINVAL) {
+                        log_msg(LOG_LEVEL_WARNING, "[Video export] Cannot preallocate container: %s\n", strerror(ret));
+                }
+        }
+#endif
+        if (lseek(s->container_fd, chunk->offset, SEEK_SET) == (off_t) -1) {
+                perror("[Video export] lseek");
+                return;
+        }
+        int written = 0;
+        while (written < chunk->data_len) {
+                ssize_t ret = write(s->container_fd, chunk->data + written, chunk->data_len - written);
+                if (ret <= 0) {
+                        perror("[Video export] write");
+                        return;
+                }
+                written += ret;
+        }
+        for (int i = 0; i < chunk->index_count; ++i) {
+                fprintf(s->container_index, "%" PRIu32 " %" PRIu32 " %" PRIu64 " %" PRIu32 "\n",
+                                chunk->index[i].frame, chunk->index[i].tile,
+                                chunk->index[i].offset, chunk->index[i].len);
+        }
+}
+
+/**
+ * Opens the files for container mode, on failure per-frame files are used.
+ */
+static bool container_open(struct video_export *s)
+{
+        char name[512];
+        snprintf(name, sizeof name, "%s/%s", s->path, VIDEO_EXPORT_CONTAINER_DATA);
+        int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef WIN32
+        flags |= O_BINARY;
+#endif
+#ifdef HAVE_LINUX
+        s->container_fd = open(name, flags | O_DIRECT, 0644);
+        if (s->container_fd == -1 && errno == EINVAL) { // FS doesn't support O_DIRECT
+                s->container_fd = open(name, flags, 0644);
+        }
+#else
+        s->container_fd = open(name, flags, 0644);
+#endif
+        if (s->container_fd == -1) {
+                perror("[Video export] Cannot open container file");
+                return false;
+        }
+        snprintf(name, sizeof name, "%s/%s", s->path, VIDEO_EXPORT_CONTAINER_INDEX);
+        s->container_index = fopen(name, "w");
+        if (s->container_index == NULL) {
+                perror("[Video export] Cannot open container index");
+                close(s->container_fd);
+                return false;
+        }
+        fprintf(s->container_index, "version %d\n", VIDEO_EXPORT_CONTAINER_VERSION);
+        return true;
+}
+
+static void container_close(struct video_export *s)
+{
+        fclose(s->container_index);
+#ifndef WIN32
+        if (ftruncate(s->container_fd, s->container_offset) != 0) { // drop preallocated tail
+                perror("[Video export] ftruncate");
+        }
+#endif
+        close(s->container_fd);
+}
+
 static void *video_export_thread(void *arg)
 {
         struct video_export *s = (struct video_export *) arg;
@@ -98,7 +220,7 @@ static void *video_export_thread(void *arg)
                 {
                         current = s->head;
                         s->head = s->head->next;
-                        s->queue_len -= 1;
+                        s->queue_len -= current->filename == NULL ? current->frames : 1;
                 }
                 pthread_mutex_unlock(&s->lock);
 
@@ -107,9 +229,16 @@ static void *video_export_thread(void *arg)
 
                 // poison
                 if(current->data == NULL) {
+                        free(current);
                         return NULL;
                 }
 
+                if (current->filename == NULL) {
+                        write_container_chunk(s, current);
+                        free_entry(current);
+                        continue;
+                }
+
                 FILE *out = fopen(current->filename, "wb");
                 if (out == NULL) {
                         perror("fopen");
@@ -143,6 +272,10 @@ struct video_export * video_export_init(const char *path)
 
         memset(&s->saved_desc, 0, sizeof(s->saved_desc));
 
+        if (get_commandline_param(CONTAINER_PARAM) != NULL) {
+                s->container = container_open(s);
+        }
+
         if(pthread_create(&s->thread_id, NULL, video_export_thread, s) != 0) {
                 fprintf(stderr, "[Video exporter] Failed to create thread.\n");
                 free(s);
@@ -176,9 +309,82 @@ void output_summary(struct video_export *s)
         fclose(summary);
 }
 
+static void enqueue(struct video_export *s, struct output_entry *entry, int frames)
+{
+        pthread_mutex_lock(&s->lock);
+        {
+                if(s->head) {
+                        s->tail->next = entry;
+                        s->tail = entry;
+                } else {
+                        s->head = s->tail = entry;
+                }
+                s->queue_len += frames;
+        }
+        pthread_mutex_unlock(&s->lock);
+        platform_sem_post(&s->semaphore);
+}
+
+static void container_flush_chunk(struct video_export *s)
+{
+        if (s->chunk == NULL) {
+                return;
+        }
+        enqueue(s, s->chunk, s->chunk->frames);
+        s->chunk = NULL;
+}
+
+/**
+ * Copies the frame into the chunk being filled. Chunks are written as a
+ * whole by the export thread so that the writes are large and aligned.
+ */
+static void container_export(struct video_export *s, struct video_frame *frame)
+{
+        pthread_mutex_lock(&s->lock);
+        int queued = s->queue_len;
+        pthread_mutex_unlock(&s->lock);
+        if (queued + (s->chunk ? s->chunk->frames : 0) >= MAX_QUEUE_SIZE) {
+                fprintf(stderr, "[Video export] Maximal queue size (%d) exceeded, not saving frame %d.\n",
+                                MAX_QUEUE_SIZE, s->total);
+                s->total += 1; // keep the index
+                return;
+        }
+
+        for (unsigned int i = 0; i < frame->tile_count; ++i) {
+                int len = ALIGN_UP(frame->tiles[i].data_len, VIDEO_EXPORT_CONTAINER_ALIGN);
+                if (s->chunk != NULL && s->chunk->data_len + len > s->chunk_capacity) {
+                        container_flush_chunk(s);
+                }
+                if (s->chunk == NULL) {
+                        s->chunk = calloc(1, sizeof(struct output_entry));
+                        s->chunk_capacity = MAX(CONTAINER_CHUNK_SIZE, len);
+                        s->chunk->data = aligned_malloc(s->chunk_capacity, VIDEO_EXPORT_CONTAINER_ALIGN);
+                        s->chunk->index = malloc(s->chunk_capacity / VIDEO_EXPORT_CONTAINER_ALIGN * sizeof(struct container_index_rec));
+                        s->chunk->offset = s->container_offset;
+                }
+                struct output_entry *c = s->chunk;
+                memcpy(c->data + c->data_len, frame->tiles[i].data, frame->tiles[i].data_len);
+                memset(c->data + c->data_len + frame->tiles[i].data_len, 0, len - frame->tiles[i].data_len);
+                c->index[c->index_count++] = (struct container_index_rec) {
+                        .frame = s->total + 1,
+                        .tile = i,
+                        .offset = s->container_offset,
+                        .len = frame->tiles[i].data_len,
+                };
+                c->data_len += len;
+                s->container_offset += len;
+        }
+        s->chunk->frames += 1;
+        s->total += 1;
+}
+
 void video_export_destroy(struct video_export *s)
 {
         if(s) {
+                if (s->container) {
+                        container_flush_chunk(s);
+                }
+
                 // poison
                 struct output_entry *entry = calloc(sizeof(struct output_entry), 1);
 
@@ -197,6 +403,11 @@ void video_export_destroy(struct video_export *s)
                 pthread_join(s->thread_id, NULL);
                 pthread_mutex_destroy(&s->lock);
 
+                if (s->container) {
+                        fprintf(s->container_index, "tiles %d\n", s->saved_desc.tile_count);
+                        container_close(s);
+                }
+
                 // write summary
                 if(s->total > 0) {
                         output_summary(s);
@@ -224,6 +435,11 @@ void video_export(struct video_export *s, struct video_frame *frame)
                 }
         }
 
+        if (s->container) {
+                container_export(s, frame);
+                return;
+        }
+
         for (unsigned int i = 0; i < frame->tile_count; ++i) {
                 assert(frame->tiles[i].data != NULL && frame->tiles[i].data_len != 0);
 
@@ -271,3 +487,5 @@ void video_export(struct video_export *s, struct video_frame *frame)
         s->total += 1;
 }
 
+ADD_TO_PARAM(CONTAINER_PARAM, "* " CONTAINER_PARAM "\n"
+                "  Export video to a single indexed file instead of a file per frame.\n");
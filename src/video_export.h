@@ -40,6 +40,19 @@
 
 #define VIDEO_EXPORT_SUMMARY_VERSION 1
 
+/**
+ * @name single-file (container) export
+ * Tiles are stored back-to-back in VIDEO_EXPORT_CONTAINER_DATA, each starting
+ * at an offset aligned to VIDEO_EXPORT_CONTAINER_ALIGN. VIDEO_EXPORT_CONTAINER_INDEX
+ * is a text file with a "version <n>" and a "tiles <n>" line followed by
+ * "<frame> <tile> <offset> <length>" records, frames are numbered from 1.
+ * @{ */
+#define VIDEO_EXPORT_CONTAINER_DATA "video.data"
+#define VIDEO_EXPORT_CONTAINER_INDEX "video.index"
+#define VIDEO_EXPORT_CONTAINER_VERSION 1
+#define VIDEO_EXPORT_CONTAINER_ALIGN 4096
+/// @}
+
 #ifdef __cplusplus
 extern "C" {
 #endif // __cplusplus
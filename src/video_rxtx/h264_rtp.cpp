@@ -81,14 +81,14 @@ h264_rtp_video_rxtx::h264_rtp_video_rxtx(std::map<std::string, param_u> const &p
 
 void h264_rtp_video_rxtx::send_frame(shared_ptr<video_frame> tx_frame)
 {
-        if (m_connections_count == 1) { /* normal/default case - only one connection */
-            tx_send_h264(m_tx, tx_frame.get(), m_network_devices[0]);
-        } else {
-            //TODO to be tested, the idea is to reply per destiny
-                for (int i = 0; i < m_connections_count; ++i) {
-                    tx_send_h264(m_tx, tx_frame.get(),
-                                        m_network_devices[i]);
-                }
+        m_fanout_devices.clear();
+        for (auto const &r : m_fanout_receivers) {
+                m_fanout_devices.push_back(r.device);
+        }
+        if (m_fanout_devices.empty()) {
+                tx_send_h264_fanout(m_tx, tx_frame.get(), m_network_devices, m_connections_count);
+        } else { // shared RTSP clients - packetize once, send to all
+                tx_send_h264_fanout(m_tx, tx_frame.get(), m_fanout_devices.data(), m_fanout_devices.size());
         }
         if ((m_rxtx_mode & MODE_RECEIVER) == 0) { // send RTCP (receiver thread would otherwise do this
                 time_ns_t curr_time = get_time_in_ns();
@@ -101,6 +101,11 @@ void h264_rtp_video_rxtx::send_frame(shared_ptr<video_frame> tx_frame)
                 timeout.tv_sec = 0;
                 timeout.tv_usec = 0;
                 rtp_recv_r(m_network_devices[0], &timeout, ts);
+
+                for (auto *device : m_fanout_devices) {
+                        rtp_update(device, curr_time);
+                        rtp_send_ctrl(device, ts, 0, curr_time);
+                }
         }
 }
 
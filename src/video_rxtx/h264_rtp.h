@@ -56,6 +56,7 @@ private:
                 return NULL;
         }
         rtsp_serv_t *m_rtsp_server;
+        std::vector<struct rtp *> m_fanout_devices; ///< devices of m_fanout_receivers for current frame
 };
 
 #endif // VIDEO_RXTX_H264_RTP_H_
@@ -147,7 +147,7 @@ void h264_sdp_video_rxtx::sdp_add_video(codec_t codec)
 {
         int rc = ::sdp_add_video(m_sdp, m_saved_tx_port, codec);
         if (rc == -2) {
-                throw ug_runtime_error("[SDP] Unsupported video codec for SDP (allowed H.264 and JPEG)!\n");
+                throw ug_runtime_error("[SDP] Unsupported video codec for SDP (allowed H.264, HEVC and JPEG)!\n");
         }
 	if (rc != 0) {
 		abort();
@@ -205,7 +205,7 @@ void h264_sdp_video_rxtx::send_frame(shared_ptr<video_frame> tx_frame)
         }
 
         if (m_connections_count == 1) { /* normal/default case - only one connection */
-            if (m_sdp_configured_codec == H264) {
+            if (m_sdp_configured_codec == H264 || m_sdp_configured_codec == H265) {
                 tx_send_h264(m_tx, tx_frame.get(), m_network_devices[0]);
             } else {
                 tx_send_jpeg(m_tx, tx_frame.get(), m_network_devices[0]);
@@ -61,10 +61,12 @@
 #include "rtp/video_decoders.h"
 #include "rtp/pbuf.h"
 #include "rtp/rtp_callback.h"
+#include "rtp/rtp_event_loop.h"
 #include "tfrc.h"
 #include "transmit.h"
 #include "tv.h"
 #include "ug_runtime_error.hpp"
+#include "utils/macros.h"
 #include "utils/net.h" // IN6_BLACKHOLE_STR
 #include "utils/vf_split.h"
 #include "video.h"
@@ -199,6 +201,17 @@ struct response *rtp_video_rxtx::process_sender_message(struct msg_sender *msg,
                                 }
                         }
                         break;
+                case SENDER_MSG_ADD_FANOUT:
+                        assert(m_rxtx_mode == MODE_SENDER); // sender only
+                        if (!add_fanout_receiver(msg->fanout.addr, msg->fanout.port)) {
+                                return new_response(RESPONSE_INT_SERV_ERR, "Adding receiver failed!");
+                        }
+                        break;
+                case SENDER_MSG_REMOVE_FANOUT:
+                        if (!remove_fanout_receiver(msg->fanout.addr, msg->fanout.port)) {
+                                return new_response(RESPONSE_NOT_FOUND, NULL);
+                        }
+                        break;
                 case SENDER_MSG_GET_STATUS:
                 case SENDER_MSG_MUTE:
                         log_msg(LOG_LEVEL_ERROR, "Unexpected message!\n");
@@ -208,6 +221,89 @@ struct response *rtp_video_rxtx::process_sender_message(struct msg_sender *msg,
         return new_response(RESPONSE_OK, NULL);
 }
 
+#define DEFAULT_RETRANSMIT_MAX_AGE_MS 32 ///< default playout delay (see pbuf_init())
+ADD_TO_PARAM("rtp-retransmit", "* rtp-retransmit[=<ms>]\n"
+                "  Recover lost video packets by retransmission (set on both sides) - receiver requests them\n"
+                "  with RTCP NACK, sender keeps packets sent in last <ms> (default "
+                TOSTRING(DEFAULT_RETRANSMIT_MAX_AGE_MS) " - the default playout delay)\n");
+static void set_retransmit(struct rtp *device)
+{
+        if (const char *retransmit = get_commandline_param("rtp-retransmit")) {
+                int max_age_ms = atoi(retransmit);
+                rtp_set_retransmit(device, max_age_ms > 0 ? max_age_ms : DEFAULT_RETRANSMIT_MAX_AGE_MS);
+        }
+}
+
+#define FANOUT_LOOP_THREADS 1
+#define FANOUT_RTCP_INTERVAL (NS_IN_SEC / 10)
+
+/**
+ * Adds a receiver that gets the same packets as the others (only RTP headers
+ * differ). Its device has no receiving thread and only a default-sized receive
+ * buffer because it only gets RTCP, so a per-receiver cost is low. The RTCP is
+ * handled by a shared event loop, if available.
+ */
+bool rtp_video_rxtx::add_fanout_receiver(const char *addr, int port)
+{
+        lock_guard<mutex> lock(m_network_devices_lock);
+        for (auto &r : m_fanout_receivers) {
+                if (r.addr == addr && r.port == port) {
+                        r.refcount += 1;
+                        log_msg(LOG_LEVEL_VERBOSE, "[control] Receiver %s:%d shared by %d clients.\n",
+                                        addr, port, r.refcount);
+                        return true;
+                }
+        }
+        struct rtp *device = rtp_init_if(addr, m_requested_mcast_if, 0, port,
+                        m_requested_ttl, 5 * 1024 * 1024, FALSE, rtp_recv_callback,
+                        (uint8_t *) m_participants, m_force_ip_version, false);
+        if (device == nullptr) {
+                log_msg(LOG_LEVEL_ERROR, "[control] Unable to add receiver %s:%d.\n", addr, port);
+                return false;
+        }
+        rtp_set_option(device, RTP_OPT_WEAK_VALIDATION, TRUE);
+        rtp_set_sdes(device, rtp_my_ssrc(device), RTCP_SDES_TOOL,
+                        PACKAGE_STRING, strlen(PACKAGE_STRING));
+        rtp_set_send_buf(device, INITIAL_VIDEO_SEND_BUFFER_SIZE);
+        set_retransmit(device);
+        if (m_fanout_loop == nullptr) {
+                m_fanout_loop = rtp_event_loop_init(FANOUT_LOOP_THREADS);
+        }
+        if (m_fanout_loop != nullptr && !rtp_event_loop_add(m_fanout_loop, device,
+                                RTP_EVENT_LOOP_RTCP_ONLY, FANOUT_RTCP_INTERVAL)) {
+                rtp_done(device);
+                log_msg(LOG_LEVEL_ERROR, "[control] Unable to add receiver %s:%d.\n", addr, port);
+                return false;
+        }
+        m_fanout_receivers.push_back({addr, port, 1, device});
+        log_msg(LOG_LEVEL_NOTICE, "[control] Added receiver %s:%d (%zu receivers).\n",
+                        addr, port, m_fanout_receivers.size());
+        return true;
+}
+
+bool rtp_video_rxtx::remove_fanout_receiver(const char *addr, int port)
+{
+        lock_guard<mutex> lock(m_network_devices_lock);
+        for (auto it = m_fanout_receivers.begin(); it != m_fanout_receivers.end(); ++it) {
+                if (it->addr != addr || it->port != port) {
+                        continue;
+                }
+                if (--it->refcount == 0) {
+                        if (m_fanout_loop != nullptr) {
+                                rtp_event_loop_remove(m_fanout_loop, it->device);
+                        }
+                        rtp_send_bye(it->device);
+                        rtp_done(it->device);
+                        m_fanout_receivers.erase(it);
+                        log_msg(LOG_LEVEL_NOTICE, "[control] Removed receiver %s:%d (%zu receivers).\n",
+                                        addr, port, m_fanout_receivers.size());
+                }
+                return true;
+        }
+        log_msg(LOG_LEVEL_WARNING, "[control] Receiver %s:%d not found.\n", addr, port);
+        return false;
+}
+
 rtp_video_rxtx::rtp_video_rxtx(map<string, param_u> const &params) :
         video_rxtx(params), m_fec_state(NULL), m_start_time(params.at("start_time").ll), m_video_desc{}
 {
@@ -252,6 +348,11 @@ rtp_video_rxtx::~rtp_video_rxtx()
 
         m_network_devices_lock.lock();
         destroy_rtp_devices(m_network_devices);
+        rtp_event_loop_done(m_fanout_loop); // stops using the devices
+        for (auto &r : m_fanout_receivers) {
+                rtp_done(r.device);
+        }
+        m_fanout_receivers.clear();
         m_network_devices_lock.unlock();
 
         if (m_participants != NULL) {
@@ -365,6 +466,8 @@ struct rtp **rtp_video_rxtx::initialize_network(const char *addrs, int recv_port
 
                 rtp_set_send_buf(devices[index], INITIAL_VIDEO_SEND_BUFFER_SIZE);
 
+                set_retransmit(devices[index]);
+
                 pdb_add(participants, rtp_my_ssrc(devices[index]));
         }
         if(devices != NULL) devices[index] = NULL;
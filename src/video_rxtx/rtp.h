@@ -43,6 +43,7 @@
 
 #include <mutex>
 #include <string>
+#include <vector>
 
 #ifdef HAVE_MACOSX
 #define INITIAL_VIDEO_RECV_BUFFER_SIZE  5944320
@@ -82,6 +83,22 @@ protected:
         fec             *m_fec_state;
         time_ns_t        m_start_time;
         video_desc       m_video_desc;
+
+        /// Additional receivers of the same (once packetized) stream, eg. RTSP
+        /// clients. Receivers requesting the same address and port (multicast
+        /// group) share the device.
+        struct fanout_receiver {
+                std::string addr;
+                int port;
+                int refcount;
+                struct rtp *device;
+        };
+        std::vector<fanout_receiver> m_fanout_receivers;
+        /// drives RTCP of the fanout receivers, NULL if unsupported (polled
+        /// from the sender then)
+        struct rtp_event_loop *m_fanout_loop = nullptr;
+        bool add_fanout_receiver(const char *addr, int port);
+        bool remove_fanout_receiver(const char *addr, int port);
 private:
         struct response *process_sender_message(struct msg_sender *i, int *status);
 };
@@ -0,0 +1,344 @@
+/**
+ * @file   video_rxtx/simulcast.cpp
+ * @brief  sends several renditions (sizes, compressions) of one captured stream
+ *
+ * The captured frame is converted (if needed) to a pixel format the native
+ * resize supports only once and a scale pyramid is built - each rendition
+ * is scaled from the smallest already scaled bigger one. Renditions are then
+ * compressed in parallel by their own video_compress instances and sent by
+ * per-rendition sender threads, each to its own port with its own SSRC, so
+ * that a reflector can forward the appropriate one to each receiver.
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <algorithm>
+#include <iostream>
+#include <thread>
+
+#include "capture_filter/resize_utils.h"
+#include "debug.h"
+#include "host.h"
+#include "lib_common.h"
+#include "rang.hpp"
+#include "rtp/rtp.h"
+#include "transmit.h"
+#include "tv.h"
+#include "ug_runtime_error.hpp"
+#include "utils/macros.h"
+#include "utils/misc.h"
+#include "utils/parallel_conv.h"
+#include "utils/thread.h"
+#include "utils/worker.h"
+#include "video.h"
+#include "video_compress.h"
+#include "video_rxtx.h"
+#include "video_rxtx/simulcast.hpp"
+
+#define MOD_NAME "[simulcast] "
+#define SIMULCAST_PORT_STEP 4 ///< rendition ports are spaced by 4 to keep port + 2 free for audio
+
+using rang::fg;
+using rang::style;
+using std::cout;
+using std::lock_guard;
+using std::mutex;
+using std::shared_ptr;
+using std::string;
+using std::unique_ptr;
+
+struct simulcast_video_rxtx::rendition {
+        unsigned width = 0;
+        unsigned height = 0;
+        string compress_cfg;
+        int port_offset;
+        struct compress_state *compress = nullptr;
+        struct tx *tx = nullptr;          ///< m_tx for the first rendition
+        struct rtp **devices = nullptr;   ///< m_network_devices for the first rendition
+        video_frame_pool pool;            ///< scaled frames
+        shared_ptr<video_frame> frame;    ///< frame to be compressed
+        std::thread thread;
+};
+
+static void usage()
+{
+        cout << "Sends multiple renditions of the captured video, each to its own port (with its own SSRC).\n"
+                "Input is converted and scaled only once - smaller renditions are scaled from the bigger ones.\n\n";
+        cout << "Usage:\n";
+        cout << style::bold << "\tuv " << fg::red << "--protocol \"simulcast:<W>x<H>[@<compress>][;<W>x<H>[@<compress>]...]\"" << fg::reset << " <receiver>\n" << style::reset;
+        cout << "where:\n";
+        cout << style::bold << "\t<W>x<H>" << style::reset << " - size of the rendition (aspect ratio is kept, letterboxed if needed)\n";
+        cout << style::bold << "\t<compress>" << style::reset << " - compression of the rendition, same syntax as for \"-c\" (default none)\n";
+        cout << "\nN-th rendition (from 0) is sent to the port <tx_port> + " << SIMULCAST_PORT_STEP << " * N. Use without \"-c\", renditions\n"
+                "are compressed in parallel from the uncompressed frames.\n";
+        cout << "\nExample:\n\tuv -t testcard --protocol \"simulcast:1920x1080@libavcodec:codec=H.264:bitrate=8M;640x360@libavcodec:codec=H.264:bitrate=800k\" <receiver>\n";
+}
+
+simulcast_video_rxtx::simulcast_video_rxtx(std::map<std::string, param_u> const &params)
+        : rtp_video_rxtx(params)
+{
+        const char *opts = params.at("opts").str;
+        if (strcmp(opts, "help") == 0) {
+                usage();
+                throw 0;
+        }
+        if (strlen(opts) == 0) {
+                throw string(MOD_NAME "No rendition given, see \"--protocol simulcast:help\"!\n");
+        }
+        auto *opts_c = static_cast<char *>(alloca(strlen(opts) + 1));
+        strcpy(opts_c, opts);
+        char *item, *save_ptr;
+        while ((item = strtok_r(opts_c, ";", &save_ptr)) != nullptr) {
+                opts_c = nullptr;
+                auto r = unique_ptr<rendition>(new rendition());
+                char *compress = strchr(item, '@');
+                if (compress != nullptr) {
+                        *compress = '\0';
+                        r->compress_cfg = compress + 1;
+                } else {
+                        r->compress_cfg = "none";
+                }
+                if (strchr(item, 'x') != nullptr) {
+                        r->width = atoi(item);
+                        r->height = atoi(strchr(item, 'x') + 1);
+                }
+                if (r->width == 0 || r->height == 0) {
+                        throw string(MOD_NAME "Wrong rendition size: ") + item + "\n";
+                }
+                r->width += r->width % 2; // keep UYVY macropixels
+                r->port_offset = SIMULCAST_PORT_STEP * m_renditions.size();
+                m_renditions.push_back(std::move(r));
+        }
+
+        for (auto &r : m_renditions) {
+                int ret = compress_init(&m_sender_mod, r->compress_cfg.c_str(), &r->compress);
+                if (ret > 0) { // help shown
+                        throw 0;
+                }
+                if (ret < 0) {
+                        throw string(MOD_NAME "Error initializing compression ") + r->compress_cfg + "\n";
+                }
+                if (r->port_offset == 0) { // the first rendition uses the base device and transmitter
+                        r->devices = m_network_devices;
+                        r->tx = m_tx;
+                        continue;
+                }
+                r->devices = initialize_network(m_requested_receiver.c_str(), m_recv_port_number + r->port_offset,
+                                m_send_port_number + r->port_offset, m_participants, m_force_ip_version,
+                                m_requested_mcast_if, m_requested_ttl);
+                if (r->devices == nullptr) {
+                        throw ug_runtime_error("Unable to open network", EXIT_FAIL_NETWORK);
+                }
+                r->tx = tx_init(&m_sender_mod, params.at("mtu").i, TX_MEDIA_VIDEO, params.at("fec").str,
+                                params.at("encryption").str, params.at("bitrate").ll);
+                if (r->tx == nullptr) {
+                        throw ug_runtime_error("Unable to initialize transmitter", EXIT_FAIL_TRANSMIT);
+                }
+        }
+        for (auto &r : m_renditions) {
+                m_pyramid.push_back(r.get());
+                rendition *rp = r.get();
+                r->thread = std::thread([this, rp]() { sender_loop(rp); });
+        }
+        std::stable_sort(m_pyramid.begin(), m_pyramid.end(), [](rendition *a, rendition *b) {
+                        return (unsigned long) a->width * a->height > (unsigned long) b->width * b->height; });
+}
+
+/**
+ * Stops the base sender (so that no more frames are passed to send_frame()),
+ * then flushes the rendition compressions and joins the rendition senders.
+ */
+void simulcast_video_rxtx::join()
+{
+        video_rxtx::join();
+        if (m_renditions_joined) {
+                return;
+        }
+        for (auto &r : m_renditions) {
+                if (r->thread.joinable()) {
+                        compress_frame(r->compress, nullptr); // poisoned pill
+                        r->thread.join();
+                }
+        }
+        m_renditions_joined = true;
+}
+
+simulcast_video_rxtx::~simulcast_video_rxtx()
+{
+        join();
+        for (auto &r : m_renditions) {
+                if (r->compress != nullptr) {
+                        module_done(CAST_MODULE(r->compress));
+                }
+                if (r->port_offset == 0) { // base device and transmitter are freed by rtp_video_rxtx
+                        continue;
+                }
+                if (r->tx != nullptr) {
+                        module_done(CAST_MODULE(r->tx));
+                }
+                if (r->devices != nullptr) {
+                        destroy_rtp_devices(r->devices);
+                }
+        }
+}
+
+/**
+ * Converts the frame to a codec that can be scaled (UYVY, RGB or RGBA), only
+ * once for all renditions.
+ */
+shared_ptr<video_frame> simulcast_video_rxtx::convert(shared_ptr<video_frame> const &in)
+{
+        struct video_desc desc = video_desc_from_frame(in.get());
+        if (desc != m_in_desc) {
+                m_in_desc = desc;
+                m_decoder = nullptr;
+                if (!resize_native_supported(desc.color_spec)) {
+                        const codec_t candidates[] = { UYVY, RGB, RGBA, VIDEO_CODEC_NONE };
+                        codec_t out = VIDEO_CODEC_NONE;
+                        m_decoder = get_best_decoder_from(desc.color_spec, candidates, &out, true);
+                        if (m_decoder == nullptr) {
+                                LOG(LOG_LEVEL_ERROR) << MOD_NAME "Cannot convert " << get_codec_name(desc.color_spec)
+                                        << " to a scalable pixel format!\n";
+                                return {};
+                        }
+                        desc.color_spec = out;
+                        m_conv_pool.reconfigure(desc);
+                }
+                for (auto *r : m_pyramid) {
+                        struct video_desc r_desc = desc;
+                        r_desc.width = r->width;
+                        r_desc.height = r->height;
+                        r->pool.reconfigure(r_desc);
+                }
+        }
+        if (m_decoder == nullptr) {
+                return in;
+        }
+        auto out = m_conv_pool.get_frame();
+        parallel_pix_conv(in->tiles[0].height, out->tiles[0].data, vc_get_linesize(out->tiles[0].width, out->color_spec),
+                        in->tiles[0].data, vc_get_linesize(in->tiles[0].width, in->color_spec), m_decoder, get_cpu_core_count());
+        out->fps = in->fps;
+        out->trace = in->trace;
+        return out;
+}
+
+static void *compress_rendition(void *arg)
+{
+        auto *job = static_cast<std::pair<struct compress_state *, shared_ptr<video_frame> *> *>(arg);
+        compress_frame(job->first, std::move(*job->second));
+        return nullptr;
+}
+
+void simulcast_video_rxtx::send_frame(shared_ptr<video_frame> tx_frame)
+{
+        if (is_codec_opaque(tx_frame->color_spec) || tx_frame->tile_count != 1) {
+                log_msg_once(LOG_LEVEL_ERROR, to_fourcc('S', 'M', 'C', 'S'), MOD_NAME "Renditions are made from "
+                                "uncompressed single-tile video only, do not use \"-c\"!\n");
+                return;
+        }
+        shared_ptr<video_frame> in = convert(tx_frame);
+        if (!in) {
+                return;
+        }
+
+        // scale pyramid - every rendition is scaled from the smallest bigger one
+        for (size_t i = 0; i < m_pyramid.size(); ++i) {
+                rendition *r = m_pyramid[i];
+                if (r->width == in->tiles[0].width && r->height == in->tiles[0].height) {
+                        r->frame = in;
+                        continue;
+                }
+                shared_ptr<video_frame> src = in;
+                for (size_t j = i; j-- > 0; ) {
+                        if (m_pyramid[j]->width >= r->width && m_pyramid[j]->height >= r->height) {
+                                src = m_pyramid[j]->frame;
+                                break;
+                        }
+                }
+                r->frame = r->pool.get_frame();
+                resize_frame_native(src->tiles[0].data, src->color_spec, r->frame->tiles[0].data,
+                                src->tiles[0].width, src->tiles[0].height, r->width, r->height, true);
+                r->frame->fps = in->fps;
+                r->frame->trace = in->trace;
+        }
+
+        // renditions are compressed concurrently (compress_frame() of a
+        // synchronous compression does the work in the calling thread)
+        std::vector<std::pair<struct compress_state *, shared_ptr<video_frame> *>> jobs;
+        for (auto &r : m_renditions) {
+                jobs.emplace_back(r->compress, &r->frame);
+        }
+        task_run_parallel(compress_rendition, (int) jobs.size(), jobs.data(), sizeof jobs[0], nullptr);
+}
+
+void simulcast_video_rxtx::sender_loop(rendition *r)
+{
+        set_thread_name("simulcast_send");
+        while (shared_ptr<video_frame> frame = compress_pop(r->compress)) {
+                lock_guard<mutex> lock(m_network_devices_lock);
+                if (m_paused) {
+                        continue;
+                }
+                struct rtp *device = r->port_offset == 0 ? m_network_devices[0] : r->devices[0];
+                tx_send(r->tx, frame.get(), device);
+
+                time_ns_t curr_time = get_time_in_ns();
+                uint32_t ts = (curr_time - m_start_time) / 100'000 * 9; // at 90000 Hz
+                rtp_update(device, curr_time);
+                rtp_send_ctrl(device, get_local_mediatime(), 0, curr_time); // SR in media clock for A/V sync
+
+                // receive RTCP
+                struct timeval timeout;
+                timeout.tv_sec = 0;
+                timeout.tv_usec = 0;
+                rtcp_recv_r(device, &timeout, ts);
+        }
+}
+
+static video_rxtx *create_video_rxtx_simulcast(std::map<std::string, param_u> const &params)
+{
+        return new simulcast_video_rxtx(params);
+}
+
+static const struct video_rxtx_info simulcast_video_rxtx_info = {
+        "UltraGrid RTP simulcast",
+        create_video_rxtx_simulcast
+};
+
+REGISTER_MODULE(simulcast, &simulcast_video_rxtx_info, LIBRARY_CLASS_VIDEO_RXTX, VIDEO_RXTX_ABI_VERSION);
@@ -0,0 +1,72 @@
+/**
+ * @file   video_rxtx/simulcast.hpp
+ * @brief  sends several renditions (sizes, compressions) of one captured stream
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef VIDEO_RXTX_SIMULCAST_HPP_
+#define VIDEO_RXTX_SIMULCAST_HPP_
+
+#include <memory>
+#include <vector>
+
+#include "types.h"
+#include "utils/video_frame_pool.h"
+#include "video_codec.h"
+#include "video_rxtx.h"
+#include "video_rxtx/rtp.h"
+
+class simulcast_video_rxtx : public rtp_video_rxtx {
+public:
+        simulcast_video_rxtx(std::map<std::string, param_u> const &);
+        virtual ~simulcast_video_rxtx();
+        void join() override;
+private:
+        struct rendition;
+        virtual void send_frame(std::shared_ptr<video_frame>);
+        virtual void *(*get_receiver_thread())(void *arg) {
+                return NULL;
+        }
+        void sender_loop(struct rendition *r);
+        std::shared_ptr<video_frame> convert(std::shared_ptr<video_frame> const &in);
+
+        std::vector<std::unique_ptr<rendition>> m_renditions; ///< in order of the ports
+        std::vector<rendition *> m_pyramid; ///< renditions from the largest one
+        struct video_desc m_in_desc{};
+        decoder_t m_decoder = nullptr; ///< conversion of input to a codec supported by resize, NULL if not needed
+        video_frame_pool m_conv_pool;
+        bool m_renditions_joined = false;
+};
+
+#endif // VIDEO_RXTX_SIMULCAST_HPP_
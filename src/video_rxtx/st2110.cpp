@@ -0,0 +1,495 @@
+/**
+ * @file   video_rxtx/st2110.cpp
+ * @brief  SMPTE ST 2110-20 (RFC 4175) uncompressed video sender and receiver
+ *
+ * Video is packetized to line segments of whole pixel groups (pgroups), each
+ * packet carrying one sample row data header. Packets are spread uniformly
+ * over the active part of the frame period (ST 2110-21 narrow gapped sender,
+ * TRS = Tframe * RACTIVE / Npackets), using SO_TXTIME kernel pacing when
+ * available and busy waiting otherwise.
+ *
+ * Receiver places the line segments directly to the display framebuffer (10-bit
+ * pgroups are collected in a frame buffer and converted to v210 once per
+ * frame). Since the stream is not self-describing, the receiver needs to be
+ * given the format (see help).
+ *
+ * @note
+ * RTP timestamps are aligned to the SMPTE (PTP) epoch only with the PTP clock
+ * enabled (see utils/ptp_clock.h), otherwise they are taken from the local
+ * clock and the SDP announces local reference clock.
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <sstream>
+
+#include "debug.h"
+#include "host.h"
+#include "lib_common.h"
+#include "pdb.h"
+#include "rang.hpp"
+#include "rtp/pbuf.h"
+#include "rtp/rtp.h"
+#include "rtp/rtp_callback.h"
+#include "tv.h"
+#include "utils/misc.h"
+#include "utils/ptp_clock.h"
+#include "utils/thread.h"
+#include "video.h"
+#include "video_display.h"
+#include "video_rxtx.h"
+#include "video_rxtx/st2110.hpp"
+
+#define MOD_NAME "[ST 2110] "
+#define ST2110_DEFAULT_PT 96
+#define ST2110_MAX_UDP_PAYLOAD 1460 ///< ST 2110-10 standard UDP size limit
+#define ST2110_RTP_HDR_LEN 12
+#define ST2110_SRD_LEN 6 ///< sample row data header (length, F + line, C + offset)
+#define ST2110_HDR_LEN (2 + ST2110_SRD_LEN) ///< extended seq. number + one SRD
+#define ST2110_RACTIVE (1080.0 / 1125.0) ///< ST 2110-21 active ratio (same for 720p and 2160p)
+#define ST2110_MAX_BURST_NS 100'000 ///< max duration of a burst when pacing in user space
+
+using rang::fg;
+using rang::style;
+using std::clamp;
+using std::cout;
+using std::min;
+using std::ostringstream;
+using std::shared_ptr;
+using std::string;
+
+struct st2110_format {
+        codec_t codec;
+        const char *sampling;
+        int depth;
+        int pgroup_bytes;
+        int pgroup_pixels;
+};
+
+static const struct st2110_format st2110_formats[] = {
+        { UYVY, "YCbCr-4:2:2", 8, 4, 2 },
+        { v210, "YCbCr-4:2:2", 10, 5, 2 },
+        { RGB, "RGB", 8, 3, 1 },
+};
+
+static const struct st2110_format *get_format(codec_t codec)
+{
+        for (auto const &f : st2110_formats) {
+                if (f.codec == codec) {
+                        return &f;
+                }
+        }
+        return nullptr;
+}
+
+/// packed (pgroup) line length in bytes
+static size_t get_pgroup_linesize(const struct st2110_format *fmt, unsigned width)
+{
+        return width / fmt->pgroup_pixels * fmt->pgroup_bytes;
+}
+
+/**
+ * Packs v210 line to 10-bit 4:2:2 pgroups (Cb Y0 Cr Y1 as continuous big-endian
+ * bitstream, 5 bytes per 2 pixels). Component order is the same in both formats,
+ * v210 just stores 3 components per 32-bit little-endian word. Width must be even.
+ */
+static void v210_to_pgroup10(const unsigned char *in, unsigned char *out, unsigned width)
+{
+        uint32_t acc = 0;
+        int bits = 0;
+        for (unsigned x = 0; x < width; x += 6) {
+                const int comps = min(12U, (width - x) * 2);
+                for (int i = 0; i < comps; ++i) {
+                        const unsigned char *w = in + 4 * (i / 3);
+                        uint32_t word = w[0] | w[1] << 8U | w[2] << 16U | (uint32_t) w[3] << 24U;
+                        acc = acc << 10U | ((word >> (10 * (i % 3))) & 0x3FFU);
+                        bits += 10;
+                        while (bits >= 8) {
+                                *out++ = acc >> (bits - 8);
+                                bits -= 8;
+                        }
+                }
+                in += 16;
+        }
+}
+
+/// inverse of v210_to_pgroup10(), padding of the last v210 block is zeroed
+static void pgroup10_to_v210(const unsigned char *in, unsigned char *out, unsigned width)
+{
+        uint32_t acc = 0;
+        int bits = 0;
+        for (unsigned x = 0; x < width; x += 6) {
+                const int comps = min(12U, (width - x) * 2);
+                uint32_t c[12] = {};
+                for (int i = 0; i < comps; ++i) {
+                        while (bits < 10) {
+                                acc = acc << 8U | *in++;
+                                bits += 8;
+                        }
+                        c[i] = (acc >> (bits - 10)) & 0x3FFU;
+                        bits -= 10;
+                }
+                for (int i = 0; i < 4; ++i) {
+                        uint32_t word = c[3 * i] | c[3 * i + 1] << 10U | c[3 * i + 2] << 20U;
+                        *out++ = word & 0xFFU;
+                        *out++ = (word >> 8U) & 0xFFU;
+                        *out++ = (word >> 16U) & 0xFFU;
+                        *out++ = word >> 24U;
+                }
+        }
+}
+
+static void usage()
+{
+        cout << "SMPTE ST 2110-20 uncompressed video (RFC 4175) with ST 2110-21 narrow gapped pacing.\n\n";
+        cout << "Usage:\n";
+        cout << style::bold << "\tuv " << fg::red << "--protocol st2110" << fg::reset << "[:size=<w>x<h>][:fps=<fps>][:codec=<c>][:pt=<pt>]\n" << style::reset;
+        cout << "where:\n";
+        cout << style::bold << "\tsize, fps, codec" << style::reset << " - format of the received stream (size is mandatory for receiver, default fps 30, codec UYVY)\n";
+        cout << style::bold << "\tpt" << style::reset << " - RTP payload type (default " << ST2110_DEFAULT_PT << ")\n";
+        cout << "\nSupported codecs: ";
+        for (auto const &f : st2110_formats) {
+                cout << get_codec_name(f.codec) << " (" << f.sampling << " " << f.depth << "-bit) ";
+        }
+        cout << "\nSender uses the format of the captured (uncompressed) frames, the SDP is printed to the log.\n";
+}
+
+st2110_video_rxtx::st2110_video_rxtx(std::map<std::string, param_u> const &params)
+        : rtp_video_rxtx(params), m_pt(ST2110_DEFAULT_PT), m_mtu(params.at("mtu").i),
+        m_display_device(static_cast<struct display *>(params.at("display_device").ptr))
+{
+        auto opts = params.at("opts").str;
+        if (strcmp(opts, "help") == 0) {
+                usage();
+                throw 0;
+        }
+        m_rx_desc = { 0, 0, UYVY, 30, PROGRESSIVE, 1 };
+        auto *opts_c = static_cast<char *>(alloca(strlen(opts) + 1));
+        strcpy(opts_c, opts);
+        char *item, *save_ptr;
+        while ((item = strtok_r(opts_c, ":", &save_ptr)) != nullptr) {
+                if (strstr(item, "size=") == item && strchr(item, 'x') != nullptr) {
+                        m_rx_desc.width = atoi(item + strlen("size="));
+                        m_rx_desc.height = atoi(strchr(item, 'x') + 1);
+                } else if (strstr(item, "fps=") == item) {
+                        m_rx_desc.fps = atof(item + strlen("fps="));
+                } else if (strstr(item, "codec=") == item) {
+                        m_rx_desc.color_spec = get_codec_from_name(item + strlen("codec="));
+                } else if (strstr(item, "pt=") == item) {
+                        m_pt = atoi(item + strlen("pt="));
+                } else {
+                        throw string(MOD_NAME "Wrong option: ") + item + "\n";
+                }
+                opts_c = nullptr;
+        }
+
+        if ((m_rxtx_mode & MODE_RECEIVER) == 0) {
+                return;
+        }
+        m_rx_fmt = get_format(m_rx_desc.color_spec);
+        if (m_rx_fmt == nullptr) {
+                throw string(MOD_NAME "Unsupported codec, see \"--protocol st2110:help\"!\n");
+        }
+        if (m_rx_desc.width == 0 || m_rx_desc.height == 0 || m_rx_desc.fps <= 0
+                        || m_rx_desc.width % m_rx_fmt->pgroup_pixels != 0) {
+                throw string(MOD_NAME "Receiver requires a valid stream size and fps, see \"--protocol st2110:help\"!\n");
+        }
+        if (m_rx_fmt->codec == v210) {
+                m_rx_pgroup_buf.resize(get_pgroup_linesize(m_rx_fmt, m_rx_desc.width) * m_rx_desc.height);
+        }
+}
+
+st2110_video_rxtx::~st2110_video_rxtx() = default;
+
+void st2110_video_rxtx::print_sdp()
+{
+        const bool ipv6 = rtp_is_ipv6(m_network_devices[0]);
+        const int fps_n = get_framerate_n(m_tx_desc.fps);
+        const int fps_d = get_framerate_d(m_tx_desc.fps);
+        ostringstream sdp;
+        sdp << "v=0\n";
+        sdp << "o=- " << rtp_my_ssrc(m_network_devices[0]) << " 0 IN IP" << (ipv6 ? 6 : 4) << " " << m_requested_receiver << "\n";
+        sdp << "s=UltraGrid ST 2110-20\n";
+        sdp << "t=0 0\n";
+        sdp << "m=video " << m_send_port_number << " RTP/AVP " << m_pt << "\n";
+        sdp << "c=IN IP" << (ipv6 ? 6 : 4) << " " << m_requested_receiver << "\n";
+        sdp << "a=rtpmap:" << m_pt << " raw/90000\n";
+        sdp << "a=fmtp:" << m_pt << " sampling=" << m_tx_fmt->sampling << "; width=" << m_tx_desc.width
+                << "; height=" << m_tx_desc.height << "; exactframerate=" << fps_n;
+        if (fps_d != 1) {
+                sdp << "/" << fps_d;
+        }
+        sdp << "; depth=" << m_tx_fmt->depth << "; TCS=SDR; colorimetry=BT709; PM=2110GPM; SSN=ST2110-20:2017; TP=2110TPN;\n";
+        if (ptp_clock_enabled()) {
+                sdp << "a=ts-refclk:ptp=IEEE1588-2008:traceable\n";
+                sdp << "a=mediaclk:direct=0\n";
+        } else {
+                sdp << "a=ts-refclk:local\n";
+                sdp << "a=mediaclk:sender\n";
+        }
+        LOG(LOG_LEVEL_NOTICE) << MOD_NAME "Stream SDP:\n" << sdp.str();
+}
+
+void st2110_video_rxtx::send_frame(shared_ptr<video_frame> tx_frame)
+{
+        struct video_desc desc = video_desc_from_frame(tx_frame.get());
+        if (desc != m_tx_desc) {
+                m_tx_desc = desc;
+                m_tx_fmt = get_format(desc.color_spec);
+                if (m_tx_fmt == nullptr || desc.tile_count != 1 || desc.interlacing != PROGRESSIVE
+                                || desc.width % m_tx_fmt->pgroup_pixels != 0) {
+                        LOG(LOG_LEVEL_ERROR) << MOD_NAME "Unsupported video " << string(desc)
+                                << ", only single tile progressive UYVY, v210 or RGB can be sent!\n";
+                        m_tx_fmt = nullptr;
+                } else {
+                        print_sdp();
+                }
+        }
+        if (m_tx_fmt == nullptr) {
+                return;
+        }
+
+        struct rtp *device = m_network_devices[0];
+        const unsigned width = desc.width;
+        const unsigned height = desc.height;
+        char *src = tx_frame->tiles[0].data;
+        size_t src_linesize = vc_get_linesize(width, desc.color_spec);
+        const size_t line_bytes = get_pgroup_linesize(m_tx_fmt, width);
+        if (m_tx_fmt->codec == v210) {
+                m_tx_pgroup_buf.resize(line_bytes * height);
+                for (unsigned y = 0; y < height; ++y) {
+                        v210_to_pgroup10((unsigned char *) src + y * src_linesize, m_tx_pgroup_buf.data() + y * line_bytes, width);
+                }
+                src = (char *) m_tx_pgroup_buf.data();
+                src_linesize = line_bytes;
+        }
+
+        // line is split to equally sized segments of whole pgroups
+        const int udp_payload = min(m_mtu - (rtp_is_ipv6(device) ? 40 : 20) - 8, ST2110_MAX_UDP_PAYLOAD);
+        const int max_pgroups = (udp_payload - ST2110_RTP_HDR_LEN - ST2110_HDR_LEN) / m_tx_fmt->pgroup_bytes;
+        const int line_pgroups = width / m_tx_fmt->pgroup_pixels;
+        const int segs = (line_pgroups + max_pgroups - 1) / max_pgroups;
+        const int seg_pgroups = (line_pgroups + segs - 1) / segs;
+        const long packet_count = (long) segs * height;
+        m_tx_hdrs.resize(packet_count * ST2110_HDR_LEN);
+
+        const long trs = std::max(std::lround(NS_IN_SEC / desc.fps * ST2110_RACTIVE / packet_count), 1L);
+        bool kernel_paced = false;
+        if (m_kernel_pacing) {
+                kernel_paced = rtp_set_txtime_pacing(device, trs);
+                if (!kernel_paced) {
+                        LOG(LOG_LEVEL_NOTICE) << MOD_NAME "Kernel pacing (SO_TXTIME) not available, pacing in user space.\n";
+                        m_kernel_pacing = false;
+                }
+        }
+        const long burst = kernel_paced ? packet_count : clamp<long>(ST2110_MAX_BURST_NS / trs, 1L, packet_count);
+
+        uint32_t ts = (get_time_in_ns() - m_start_time) / 100'000 * 9; // at 90000 Hz
+        if (ptp_clock_enabled()) { // capture time since the SMPTE epoch
+                ts = ptp_to_mediatime(tx_frame->trace.ts[FT_CAPTURE] != 0
+                                ? tx_frame->trace.ts[FT_CAPTURE] + ptp_clock_get_offset_ns() : ptp_clock_get_ns());
+        }
+        uint32_t ext_seq = (uint32_t) m_tx_seq_hi << 16U | rtp_get_next_seq(device);
+        rtp_async_start(device, packet_count);
+        const time_ns_t start = get_time_in_ns();
+        long packet_idx = 0;
+        for (unsigned y = 0; y < height; ++y) {
+                for (int s = 0; s < segs; ++s) {
+                        const int pgroup_off = s * seg_pgroups;
+                        const int len = min(seg_pgroups, line_pgroups - pgroup_off) * m_tx_fmt->pgroup_bytes;
+                        const unsigned offset = pgroup_off * m_tx_fmt->pgroup_pixels;
+                        const int m = y == height - 1 && s == segs - 1;
+                        unsigned char *hdr = &m_tx_hdrs[packet_idx * ST2110_HDR_LEN];
+                        hdr[0] = ext_seq >> 24U;
+                        hdr[1] = (ext_seq >> 16U) & 0xFFU;
+                        hdr[2] = len >> 8U;
+                        hdr[3] = len & 0xFFU;
+                        hdr[4] = (y >> 8U) & 0x7FU; // F = 0 (progressive)
+                        hdr[5] = y & 0xFFU;
+                        hdr[6] = (offset >> 8U) & 0x7FU; // C = 0 (single SRD)
+                        hdr[7] = offset & 0xFFU;
+                        rtp_send_data_hdr(device, ts, m_pt, m, 0, nullptr, (char *) hdr, ST2110_HDR_LEN,
+                                        src + y * src_linesize + pgroup_off * m_tx_fmt->pgroup_bytes, len,
+                                        nullptr, 0, 0);
+                        ext_seq += 1;
+                        if (++packet_idx % burst == 0 && !m) {
+                                rtp_async_flush(device);
+                                while (get_time_in_ns() - start < packet_idx * trs) {
+                                }
+                        }
+                }
+        }
+        rtp_async_wait(device);
+        m_tx_seq_hi = ext_seq >> 16U;
+
+        if ((m_rxtx_mode & MODE_RECEIVER) == 0) { // send RTCP (receiver thread would otherwise do this)
+                time_ns_t curr_time = get_time_in_ns();
+                rtp_update(device, curr_time);
+                rtp_send_ctrl(device, ts, 0, curr_time);
+
+                // receive RTCP
+                struct timeval timeout;
+                timeout.tv_sec = 0;
+                timeout.tv_usec = 0;
+                rtp_recv_r(device, &timeout, ts);
+        }
+}
+
+/**
+ * Places line segments of a received frame directly to the display framebuffer
+ * (or pgroup buffer for v210). Malformed packets are skipped.
+ */
+int st2110_video_rxtx::decode_frame(struct coded_data *cdata, void *decode_data, struct pbuf_stats *stats)
+{
+        UNUSED(stats);
+        auto *s = static_cast<st2110_video_rxtx *>(decode_data);
+        const struct st2110_format *fmt = s->m_rx_fmt;
+        const size_t line_bytes = get_pgroup_linesize(fmt, s->m_rx_desc.width);
+        unsigned char *dst = (unsigned char *) s->m_rx_frame->tiles[0].data;
+        size_t dst_linesize = vc_get_linesize(s->m_rx_desc.width, fmt->codec);
+        if (fmt->codec == v210) {
+                dst = s->m_rx_pgroup_buf.data();
+                dst_linesize = line_bytes;
+        }
+
+        bool placed = false;
+        for ( ; cdata != nullptr; cdata = cdata->nxt) {
+                rtp_packet *pckt = cdata->data;
+                if (pckt->pt != s->m_pt) {
+                        continue;
+                }
+                const unsigned char *end = (unsigned char *) pckt->data + pckt->data_len;
+                const unsigned char *srd = (unsigned char *) pckt->data + 2; // skip extended seq. number
+                const unsigned char *data = srd;
+                int srd_count = 0;
+                bool cont = true;
+                while (cont && data + ST2110_SRD_LEN <= end) {
+                        cont = (data[4] & 0x80U) != 0;
+                        data += ST2110_SRD_LEN;
+                        srd_count += 1;
+                }
+                for (int i = 0; i < srd_count && !cont; ++i, srd += ST2110_SRD_LEN) {
+                        const unsigned len = srd[0] << 8U | srd[1];
+                        const unsigned line = (srd[2] & 0x7FU) << 8U | srd[3];
+                        const unsigned offset = (srd[4] & 0x7FU) << 8U | srd[5];
+                        const size_t byte_off = offset / fmt->pgroup_pixels * fmt->pgroup_bytes;
+                        if (line >= s->m_rx_desc.height || byte_off + len > line_bytes || data + len > end) {
+                                debug_msg(MOD_NAME "Malformed packet (line %u, offset %u, length %u).\n", line, offset, len);
+                                break;
+                        }
+                        memcpy(dst + line * dst_linesize + byte_off, data, len);
+                        data += len;
+                        placed = true;
+                }
+        }
+        if (placed && fmt->codec == v210) {
+                const size_t v210_linesize = vc_get_linesize(s->m_rx_desc.width, v210);
+                for (unsigned y = 0; y < s->m_rx_desc.height; ++y) {
+                        pgroup10_to_v210(dst + y * line_bytes, (unsigned char *) s->m_rx_frame->tiles[0].data + y * v210_linesize,
+                                        s->m_rx_desc.width);
+                }
+        }
+        return placed ? TRUE : FALSE;
+}
+
+void *st2110_video_rxtx::receiver_thread(void *arg)
+{
+        return static_cast<st2110_video_rxtx *>(arg)->receiver_loop();
+}
+
+void *(*st2110_video_rxtx::get_receiver_thread())(void *arg)
+{
+        return receiver_thread;
+}
+
+void *st2110_video_rxtx::receiver_loop()
+{
+        set_thread_name(__func__);
+        if (display_reconfigure(m_display_device, m_rx_desc, VIDEO_NORMAL) != TRUE) {
+                LOG(LOG_LEVEL_ERROR) << MOD_NAME "Unable to reconfigure display to " << string(m_rx_desc) << "!\n";
+                exit_uv(1);
+                display_put_frame(m_display_device, NULL, PUTF_BLOCKING);
+                return NULL;
+        }
+        m_rx_frame = display_get_frame(m_display_device);
+
+        while (!should_exit) {
+                time_ns_t curr_time = get_time_in_ns();
+                uint32_t ts = (curr_time - m_start_time) / 100'000 * 9; // at 90000 Hz
+                rtp_update(m_network_devices[0], curr_time);
+                rtp_send_ctrl(m_network_devices[0], ts, 0, curr_time);
+
+                struct timeval timeout;
+                timeout.tv_sec = 0;
+                timeout.tv_usec = 1000;
+                rtp_recv_r(m_network_devices[0], &timeout, ts);
+
+                pdb_iter_t it;
+                struct pdb_e *cp = pdb_iter_init(m_participants, &it);
+                while (cp != NULL) {
+                        if (pbuf_decode(cp->playout_buffer, curr_time, decode_frame, this)) {
+                                display_put_frame(m_display_device, m_rx_frame, PUTF_NONBLOCK);
+                                m_rx_frame = display_get_frame(m_display_device);
+                        }
+                        pbuf_remove(cp->playout_buffer, curr_time);
+                        cp = pdb_iter_next(&it);
+                }
+                pdb_iter_done(&it);
+        }
+
+        display_put_frame(m_display_device, m_rx_frame, PUTF_DISCARD);
+        // pass poisoned pill to display
+        display_put_frame(m_display_device, NULL, PUTF_BLOCKING);
+        return NULL;
+}
+
+static video_rxtx *create_video_rxtx_st2110(std::map<std::string, param_u> const &params)
+{
+        return new st2110_video_rxtx(params);
+}
+
+static const struct video_rxtx_info st2110_video_rxtx_info = {
+        "SMPTE ST 2110-20 uncompressed",
+        create_video_rxtx_st2110
+};
+
+REGISTER_MODULE(st2110, &st2110_video_rxtx_info, LIBRARY_CLASS_VIDEO_RXTX, VIDEO_RXTX_ABI_VERSION);
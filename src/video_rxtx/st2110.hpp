@@ -0,0 +1,81 @@
+/**
+ * @file   video_rxtx/st2110.hpp
+ * @brief  SMPTE ST 2110-20 (RFC 4175) uncompressed video sender and receiver
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef VIDEO_RXTX_ST2110_HPP_
+#define VIDEO_RXTX_ST2110_HPP_
+
+#include <vector>
+
+#include "types.h"
+#include "video_rxtx.h"
+#include "video_rxtx/rtp.h"
+
+struct coded_data;
+struct display;
+struct pbuf_stats;
+struct st2110_format;
+
+class st2110_video_rxtx : public rtp_video_rxtx {
+public:
+        st2110_video_rxtx(std::map<std::string, param_u> const &);
+        virtual ~st2110_video_rxtx();
+private:
+        virtual void send_frame(std::shared_ptr<video_frame>);
+        virtual void *(*get_receiver_thread())(void *arg);
+        static void *receiver_thread(void *arg);
+        void *receiver_loop();
+        static int decode_frame(struct coded_data *cdata, void *decode_data, struct pbuf_stats *stats);
+        void print_sdp();
+
+        int m_pt;
+        int m_mtu;
+        bool m_kernel_pacing = true;
+
+        struct video_desc m_tx_desc{};
+        const struct st2110_format *m_tx_fmt = nullptr;
+        std::vector<unsigned char> m_tx_pgroup_buf; ///< v210 frame converted to 10-bit pgroups
+        std::vector<unsigned char> m_tx_hdrs;       ///< payload headers, valid until rtp_async_wait()
+        uint16_t m_tx_seq_hi = 0;                   ///< high 16 bits of the extended sequence number
+
+        struct display *m_display_device;
+        struct video_desc m_rx_desc{}; ///< format of the received stream (given by the user)
+        const struct st2110_format *m_rx_fmt = nullptr;
+        struct video_frame *m_rx_frame = nullptr;
+        std::vector<unsigned char> m_rx_pgroup_buf; ///< received 10-bit pgroups, converted to v210 per frame
+};
+
+#endif // VIDEO_RXTX_ST2110_HPP_
@@ -66,6 +66,7 @@
 #include "tv.h"
 #include "utils/thread.h"
 #include "utils/vf_split.h"
+#include "utils/viewport_tiles.h"
 #include "video.h"
 #include "video_compress.h"
 #include "video_decompress.h"
@@ -77,10 +78,20 @@
 
 #include <chrono>
 #include <sstream>
+#include <thread>
 #include <utility>
 
+#define DEFAULT_HANDOFF_LEN 16384
+
 using namespace std;
 
+ADD_TO_PARAM("video-fanout", "* video-fanout=<host>[:<port>][/<host>[:<port>]...]\n"
+                "  Send the video also to the given receivers (port defaults to the video TX port, IPv6 as [addr]:port).\n"
+                "  The stream is packetized, FEC-protected and encrypted only once, receivers share FEC and encryption key.\n");
+ADD_TO_PARAM("participant-threads", "* participant-threads[=<max_pkts>]\n"
+                "  Decode every received participant in its own thread, the network thread only receives packets and passes\n"
+                "  at most <max_pkts> (default " TOSTRING(DEFAULT_HANDOFF_LEN) ") of them to the worker (requires a display\n"
+                "  supporting multiple sources, eg. conference).\n");
 ultragrid_rtp_video_rxtx::ultragrid_rtp_video_rxtx(const map<string, param_u> &params) :
         rtp_video_rxtx(params), m_send_bytes_total(0)
 {
@@ -95,6 +106,41 @@ ultragrid_rtp_video_rxtx::ultragrid_rtp_video_rxtx(const map<string, param_u> &p
         }
 
         m_control = (struct control_state *) get_module(get_root_module(static_cast<struct module *>(params.at("parent").ptr)), "control");
+
+        if (const char *fanout = get_commandline_param("video-fanout")) {
+                if ((m_rxtx_mode & MODE_SENDER) == 0 || m_connections_count != 1) {
+                        throw ug_runtime_error("Video fanout requires a sender with a single destination!");
+                }
+                char *tmp = strdup(fanout);
+                char *save_ptr = nullptr;
+                char *item = tmp;
+                while (char *dst = strtok_r(item, "/", &save_ptr)) {
+                        item = nullptr;
+                        int port = m_send_port_number;
+                        // host:port, [IPv6]:port or bare IPv6 address
+                        char *colon = strrchr(dst, ':');
+                        if (dst[0] == '[') {
+                                char *bracket = strchr(dst, ']');
+                                if (bracket == nullptr) {
+                                        free(tmp);
+                                        throw ug_runtime_error("Wrong fanout address: "s + dst);
+                                }
+                                *bracket = '\0';
+                                if (bracket[1] == ':') {
+                                        port = atoi(bracket + 2);
+                                }
+                                dst += 1;
+                        } else if (colon != nullptr && colon == strchr(dst, ':')) {
+                                *colon = '\0';
+                                port = atoi(colon + 1);
+                        }
+                        if (!add_fanout_receiver(dst, port)) {
+                                free(tmp);
+                                throw ug_runtime_error("Unable to add fanout receiver "s + dst, EXIT_FAIL_NETWORK);
+                        }
+                }
+                free(tmp);
+        }
 }
 
 ultragrid_rtp_video_rxtx::~ultragrid_rtp_video_rxtx()
@@ -124,7 +170,9 @@ void ultragrid_rtp_video_rxtx::send_frame(shared_ptr<video_frame> tx_frame)
 {
         m_video_desc = video_desc_from_frame(tx_frame.get());
         if (m_fec_state) {
+                struct frame_trace trace = tx_frame->trace;
                 tx_frame = m_fec_state->encode(tx_frame);
+                tx_frame->trace = trace;
         }
 
         auto data = new pair<ultragrid_rtp_video_rxtx *, shared_ptr<video_frame>>(this, tx_frame);
@@ -154,7 +202,14 @@ void ultragrid_rtp_video_rxtx::send_frame_async(shared_ptr<video_frame> tx_frame
                 goto after_send;
         }
 
-        if (m_connections_count == 1) { /* normal case - only one connection */
+        if (m_connections_count == 1 && !m_fanout_receivers.empty()) { /* fanout - packetize once, send to all */
+                m_tx_devices.assign(1, m_network_devices[0]);
+                for (auto const &r : m_fanout_receivers) {
+                        m_tx_devices.push_back(r.device);
+                }
+                tx_send_fanout(m_tx, tx_frame.get(),
+                                m_tx_devices.data(), m_tx_devices.size());
+        } else if (m_connections_count == 1) { /* normal case - only one connection */
                 tx_send(m_tx, tx_frame.get(),
                                 m_network_devices[0]);
         } else { /* split */
@@ -163,10 +218,7 @@ void ultragrid_rtp_video_rxtx::send_frame_async(shared_ptr<video_frame> tx_frame
                 //assert(frame_count == 1);
                 vf_split_horizontal(split_frames, tx_frame.get(),
                                 m_connections_count);
-                for (int i = 0; i < m_connections_count; ++i) {
-                        tx_send_tile(m_tx, split_frames, i,
-                                        m_network_devices[i]);
-                }
+                tx_send_tiles(m_tx, split_frames, m_network_devices);
 
                 vf_free(split_frames);
         }
@@ -175,7 +227,7 @@ void ultragrid_rtp_video_rxtx::send_frame_async(shared_ptr<video_frame> tx_frame
                 time_ns_t curr_time = get_time_in_ns();
                 uint32_t ts = (curr_time - m_start_time) / 100'000 * 9; // at 90000 Hz
                 rtp_update(m_network_devices[0], curr_time);
-                rtp_send_ctrl(m_network_devices[0], ts, 0, curr_time);
+                rtp_send_ctrl(m_network_devices[0], get_local_mediatime(), 0, curr_time); // SR in media clock for A/V sync
 
                 // receive RTCP
                 int rc = TRUE;
@@ -185,6 +237,22 @@ void ultragrid_rtp_video_rxtx::send_frame_async(shared_ptr<video_frame> tx_frame
                 } while (!should_exit && rc == TRUE);
         }
 
+        // fanout receivers have no receiver thread - unless served by m_fanout_loop,
+        // RTCP (SR, RR, NACKs) is handled here
+        if (!m_fanout_receivers.empty() && m_fanout_loop == nullptr) {
+                time_ns_t curr_time = get_time_in_ns();
+                uint32_t ts = (curr_time - m_start_time) / 100'000 * 9; // at 90000 Hz
+                for (auto const &r : m_fanout_receivers) {
+                        rtp_update(r.device, curr_time);
+                        rtp_send_ctrl(r.device, get_local_mediatime(), 0, curr_time);
+                        int rc = TRUE;
+                        do {
+                                struct timeval timeout { 0, 0 };
+                                rc = rtcp_recv_r(r.device, &timeout, ts);
+                        } while (!should_exit && rc == TRUE);
+                }
+        }
+
 after_send:
         m_async_sending_lock.lock();
         m_async_sending = false;
@@ -251,9 +319,10 @@ void ultragrid_rtp_video_rxtx::remove_display_from_decoders() {
                 pdb_iter_t it;
                 struct pdb_e *cp = pdb_iter_init(m_participants, &it);
                 while (cp != NULL) {
-                        if(cp->decoder_state)
-                                video_decoder_remove_display(
-                                                ((struct vcodec_state*) cp->decoder_state)->decoder);
+                        struct vcodec_state *vdecoder_state = get_vcodec_state(cp);
+                        if (vdecoder_state != nullptr) {
+                                video_decoder_remove_display(vdecoder_state->decoder);
+                        }
                         cp = pdb_iter_next(&it);
                 }
                 pdb_iter_done(&it);
@@ -292,6 +361,187 @@ struct vcodec_state *ultragrid_rtp_video_rxtx::new_video_decoder(struct display
         return state;
 }
 
+/**
+ * Appends viewport feedback of panoramic displays (see utils/viewport_tiles.h)
+ * to our RTCP reports. send_rtcp() calls this until NULL is returned.
+ */
+static rtcp_app *viewport_feedback_app(struct rtp *, uint32_t, int max_size)
+{
+        alignas(rtcp_app) static thread_local unsigned char buf[sizeof(rtcp_app) + VIEWPORT_TILES_PAYLOAD_LEN];
+        static thread_local bool returned = false;
+        if (returned) {
+                returned = false;
+                return nullptr;
+        }
+        auto *app = reinterpret_cast<rtcp_app *>(buf);
+        int len = viewport_tiles_get_feedback(reinterpret_cast<unsigned char *>(app->data),
+                        max_size - 12 /* hdr+SSRC+name */);
+        if (len == 0) {
+                return nullptr;
+        }
+        app->p = 0;
+        app->subtype = 0;
+        memcpy(app->name, VIEWPORT_TILES_APP_NAME, sizeof app->name);
+        app->length = 2 + len / 4; // in 32-bit words minus one
+        returned = true;
+        return app;
+}
+
+/**
+ * Returns display for a decoder of a newly appeared participant - either a
+ * fork of the display if it supports multiple sources or the display itself
+ * (removed from other decoders).
+ */
+struct display *ultragrid_rtp_video_rxtx::get_display_for_new_decoder()
+{
+        struct multi_sources_supp_info supp_for_mult_sources;
+        size_t len = sizeof(multi_sources_supp_info);
+        int ret = display_ctl_property(m_display_device,
+                        DISPLAY_PROPERTY_SUPPORTS_MULTI_SOURCES, &supp_for_mult_sources, &len);
+        if (!ret) {
+                supp_for_mult_sources.val = false;
+        }
+
+        if (supp_for_mult_sources.val == false) {
+                remove_display_from_decoders(); // must be called before creating new decoder state
+                return m_display_device;
+        }
+        struct display *d = supp_for_mult_sources.fork_display(supp_for_mult_sources.state);
+        assert(d != NULL);
+        m_display_copies.push_back(d);
+        return d;
+}
+
+/// enlarges socket receive buffers according to the observed frame size
+void ultragrid_rtp_video_rxtx::adjust_recv_buf(struct vcodec_state *vdecoder_state)
+{
+        if (vdecoder_state == nullptr || vdecoder_state->decoded % 100 != 99) {
+                return;
+        }
+        int new_size = vdecoder_state->max_frame_size * 110ull / 100;
+        int last_buf_size = m_last_buf_size;
+        if (new_size <= last_buf_size || !m_last_buf_size.compare_exchange_strong(last_buf_size, new_size)) {
+                return;
+        }
+        // workers race with RX port change done by receiver_process_messages()
+        unique_lock<mutex> lk(m_network_devices_lock, defer_lock);
+        if (m_parallel_decode) {
+                lk.lock();
+        }
+        struct rtp **device = m_network_devices;
+        while(*device) {
+                int ret = rtp_set_recv_buf(*device, new_size);
+                if(!ret) {
+                        display_buf_increase_warning(new_size);
+                }
+                debug_msg("Recv buffer adjusted to %d\n", new_size);
+                device++;
+        }
+}
+
+struct ultragrid_rtp_video_rxtx::participant_worker {
+        struct pdb_e *cp;
+        struct vcodec_state *decoder = nullptr;
+        atomic<bool> should_stop{false};
+        thread worker;
+
+        void stop() {
+                should_stop = true;
+                if (worker.joinable()) {
+                        worker.join();
+                }
+        }
+};
+
+struct vcodec_state *ultragrid_rtp_video_rxtx::get_vcodec_state(struct pdb_e *cp)
+{
+        if (cp->decoder_state == nullptr) {
+                return nullptr;
+        }
+        if (m_parallel_decode) {
+                return static_cast<participant_worker *>(cp->decoder_state)->decoder;
+        }
+        return (struct vcodec_state *) cp->decoder_state;
+}
+
+/**
+ * Switches the participant playout buffer to the concurrent mode and starts
+ * the worker. Called from the receiver thread, so no packets can be inserted
+ * meanwhile.
+ */
+void ultragrid_rtp_video_rxtx::start_participant_worker(struct pdb_e *cp)
+{
+        pbuf_set_concurrent(cp->playout_buffer, m_handoff_len);
+        auto *w = new participant_worker();
+        w->cp = cp;
+        cp->decoder_state = w;
+        cp->decoder_state_deleter = destroy_participant_worker;
+        w->worker = thread(&ultragrid_rtp_video_rxtx::participant_worker_loop, this, w);
+}
+
+void ultragrid_rtp_video_rxtx::destroy_participant_worker(void *state)
+{
+        auto *w = static_cast<participant_worker *>(state);
+        w->stop();
+        destroy_video_decoder(w->decoder);
+        delete w;
+}
+
+/**
+ * Decodes one participant - counterpart of the per-participant part of
+ * receiver_loop(). NACKs are passed to the receiver thread, which owns the
+ * RTP session.
+ */
+void ultragrid_rtp_video_rxtx::participant_worker_loop(struct participant_worker *w)
+{
+        set_thread_name("participant_dec");
+        struct pdb_e *cp = w->cp;
+        const bool send_nacks = get_commandline_param("rtp-retransmit") != nullptr;
+
+        while (!w->should_stop && !should_exit) {
+                pbuf_wait(cp->playout_buffer, NS_IN_SEC / 1000);
+                time_ns_t curr_time = get_time_in_ns();
+
+                if (w->decoder == nullptr) {
+                        if (pbuf_is_empty(cp->playout_buffer)) {
+                                continue;
+                        }
+                        struct vcodec_state *decoder = nullptr;
+                        {
+                                lock_guard<mutex> lk(m_decoder_create_lock);
+                                decoder = new_video_decoder(get_display_for_new_decoder());
+                        }
+                        if (decoder == nullptr) {
+                                log_msg(LOG_LEVEL_FATAL, "Fatal: unable to create decoder state for "
+                                                "participant %u.\n", cp->ssrc);
+                                exit_uv(1);
+                                break;
+                        }
+                        w->decoder = decoder;
+                        pbuf_set_av_sync(cp->playout_buffer, AV_SYNC_VIDEO);
+                }
+
+                if (send_nacks) {
+                        uint16_t nacks[RTP_NACK_MAX_SEQS];
+                        int count = pbuf_get_nacks(cp->playout_buffer, curr_time, nacks, RTP_NACK_MAX_SEQS);
+                        if (count > 0) {
+                                lock_guard<mutex> lk(m_nacks_lock);
+                                m_pending_nacks.emplace_back(cp->ssrc, vector<uint16_t>(nacks, nacks + count));
+                        }
+                }
+                if (video_decoder_keyframe_requested(w->decoder->decoder)) {
+                        lock_guard<mutex> lk(m_nacks_lock);
+                        m_pending_plis.push_back(cp->ssrc);
+                }
+
+                if (pbuf_decode(cp->playout_buffer, curr_time, decode_video_frame, w->decoder)) {
+                        m_frame_decoded = true;
+                }
+                adjust_recv_buf(w->decoder);
+                pbuf_remove(cp->playout_buffer, curr_time);
+        }
+}
+
 void *ultragrid_rtp_video_rxtx::receiver_loop()
 {
         set_thread_name(__func__);
@@ -300,7 +550,7 @@ void *ultragrid_rtp_video_rxtx::receiver_loop()
         int ret;
         int tiles_post = 0;
         time_ns_t last_tile_received = 0;
-        int last_buf_size = INITIAL_VIDEO_RECV_BUFFER_SIZE;
+        m_last_buf_size = INITIAL_VIDEO_RECV_BUFFER_SIZE;
 
 #ifdef SHARED_DECODER
         struct vcodec_state *shared_decoder = new_video_decoder(m_display_device);
@@ -314,6 +564,28 @@ void *ultragrid_rtp_video_rxtx::receiver_loop()
         fr = 1;
 
         time_ns_t last_not_timeout = 0;
+        const bool send_nacks = get_commandline_param("rtp-retransmit") != nullptr;
+
+        if (const char *handoff = get_commandline_param("participant-threads")) {
+                struct multi_sources_supp_info supp_for_mult_sources;
+#ifdef SHARED_DECODER
+                supp_for_mult_sources.val = false;
+#else
+                size_t len = sizeof(multi_sources_supp_info);
+                if (!display_ctl_property(m_display_device, DISPLAY_PROPERTY_SUPPORTS_MULTI_SOURCES,
+                                        &supp_for_mult_sources, &len)) {
+                        supp_for_mult_sources.val = false;
+                }
+#endif
+                if (supp_for_mult_sources.val) {
+                        m_parallel_decode = true;
+                        m_handoff_len = strlen(handoff) > 0 ? MAX(atoi(handoff), 1) : DEFAULT_HANDOFF_LEN;
+                        log_msg(LOG_LEVEL_INFO, "Decoding participants in separate threads.\n");
+                } else {
+                        log_msg(LOG_LEVEL_WARNING, "Display doesn't support multiple sources, "
+                                        "participant-threads ignored.\n");
+                }
+        }
 
         while (!should_exit) {
                 struct timeval timeout;
@@ -322,7 +594,7 @@ void *ultragrid_rtp_video_rxtx::receiver_loop()
                 uint32_t ts = (m_start_time - curr_time) / 100'000 * 9; // at 90000 Hz
 
                 rtp_update(m_network_devices[0], curr_time);
-                rtp_send_ctrl(m_network_devices[0], ts, 0, curr_time);
+                rtp_send_ctrl(m_network_devices[0], get_local_mediatime(), viewport_feedback_app, curr_time); // SR in media clock for A/V sync
 
                 /* Receive packets from the network... The timeout is adjusted */
                 /* to match the video capture rate, so the transmitter works.  */
@@ -361,30 +633,21 @@ void *ultragrid_rtp_video_rxtx::receiver_loop()
                                                                curr_time));
                         }
 
+                        if (m_parallel_decode) {
+                                if (cp->decoder_state == NULL) {
+                                        start_participant_worker(cp);
+                                }
+                                cp = pdb_iter_next(&it);
+                                continue;
+                        }
+
                         if(cp->decoder_state == NULL &&
                                         !pbuf_is_empty(cp->playout_buffer)) { // the second check is needed because we want to assign display to participant that really sends data
 #ifdef SHARED_DECODER
                                 cp->decoder_state = shared_decoder;
 #else
                                 // we are assigning our display so we make sure it is removed from other dispaly
-
-                                struct multi_sources_supp_info supp_for_mult_sources;
-                                size_t len = sizeof(multi_sources_supp_info);
-                                int ret = display_ctl_property(m_display_device,
-                                                DISPLAY_PROPERTY_SUPPORTS_MULTI_SOURCES, &supp_for_mult_sources, &len);
-                                if (!ret) {
-                                        supp_for_mult_sources.val = false;
-                                }
-
-                                struct display *d;
-                                if (supp_for_mult_sources.val == false) {
-                                        remove_display_from_decoders(); // must be called before creating new decoder state
-                                        d = m_display_device;
-                                } else {
-                                        d = supp_for_mult_sources.fork_display(supp_for_mult_sources.state);
-                                        assert(d != NULL);
-                                        m_display_copies.push_back(d);
-                                }
+                                struct display *d = get_display_for_new_decoder();
 
                                 cp->decoder_state = new_video_decoder(d);
                                 cp->decoder_state_deleter = destroy_video_decoder;
@@ -396,10 +659,22 @@ void *ultragrid_rtp_video_rxtx::receiver_loop()
                                         break;
                                 }
 #endif // SHARED_DECODER
+                                pbuf_set_av_sync(cp->playout_buffer, AV_SYNC_VIDEO);
                         }
 
                         struct vcodec_state *vdecoder_state = (struct vcodec_state *) cp->decoder_state;
 
+                        if (send_nacks) {
+                                uint16_t nacks[RTP_NACK_MAX_SEQS];
+                                int count = pbuf_get_nacks(cp->playout_buffer, curr_time, nacks, RTP_NACK_MAX_SEQS);
+                                if (count > 0) {
+                                        rtp_send_nack(m_network_devices[0], get_local_mediatime(), cp->ssrc, nacks, count);
+                                }
+                        }
+                        if (vdecoder_state != nullptr && video_decoder_keyframe_requested(vdecoder_state->decoder)) {
+                                rtp_send_pli(m_network_devices[0], get_local_mediatime(), cp->ssrc);
+                        }
+
                         /* Decode and render video... */
                         if (pbuf_decode
                             (cp->playout_buffer, curr_time, decode_video_frame, vdecoder_state)) {
@@ -435,26 +710,44 @@ void *ultragrid_rtp_video_rxtx::receiver_loop()
                                 last_tile_received = curr_time;
                         }
 
-                        if(vdecoder_state && vdecoder_state->decoded % 100 == 99) {
-                                int new_size = vdecoder_state->max_frame_size * 110ull / 100;
-                                if(new_size > last_buf_size) {
-                                        struct rtp **device = m_network_devices;
-                                        while(*device) {
-                                                int ret = rtp_set_recv_buf(*device, new_size);
-                                                if(!ret) {
-                                                        display_buf_increase_warning(new_size);
-                                                }
-                                                debug_msg("Recv buffer adjusted to %d\n", new_size);
-                                                device++;
-                                        }
-                                        last_buf_size = new_size;
-                                }
-                        }
+                        adjust_recv_buf(vdecoder_state);
 
                         pbuf_remove(cp->playout_buffer, curr_time);
                         cp = pdb_iter_next(&it);
                 }
                 pdb_iter_done(&it);
+
+                if (m_parallel_decode) {
+                        decltype(m_pending_nacks) nacks;
+                        decltype(m_pending_plis) plis;
+                        {
+                                lock_guard<mutex> lk(m_nacks_lock);
+                                swap(nacks, m_pending_nacks);
+                                swap(plis, m_pending_plis);
+                        }
+                        for (auto const &n : nacks) {
+                                rtp_send_nack(m_network_devices[0], get_local_mediatime(), n.first,
+                                                n.second.data(), n.second.size());
+                        }
+                        for (uint32_t ssrc : plis) {
+                                rtp_send_pli(m_network_devices[0], get_local_mediatime(), ssrc);
+                        }
+                        if (m_frame_decoded.exchange(false)) {
+                                fr = 1;
+                        }
+                }
+        }
+
+        if (m_parallel_decode) { // decoders must not be used while the display is removed
+                pdb_iter_t it;
+                cp = pdb_iter_init(m_participants, &it);
+                while (cp != NULL) {
+                        if (cp->decoder_state != NULL) {
+                                static_cast<participant_worker *>(cp->decoder_state)->stop();
+                        }
+                        cp = pdb_iter_next(&it);
+                }
+                pdb_iter_done(&it);
         }
 
 #ifdef SHARED_DECODER
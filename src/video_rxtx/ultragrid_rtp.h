@@ -41,13 +41,17 @@
 #include "video_rxtx.h"
 #include "video_rxtx/rtp.h"
 
+#include <atomic>
 #include <condition_variable>
 #include <list>
 #include <map>
 #include <mutex>
 #include <string>
+#include <utility>
+#include <vector>
 
 struct control_state;
+struct pdb_e;
 
 class ultragrid_rtp_video_rxtx : public rtp_video_rxtx {
 public:
@@ -68,9 +72,30 @@ private:
 
         void receiver_process_messages();
         void remove_display_from_decoders();
+        struct display *get_display_for_new_decoder();
+        void adjust_recv_buf(struct vcodec_state *vdecoder_state);
         struct vcodec_state *new_video_decoder(struct display *d);
         static void destroy_video_decoder(void *state);
 
+        /**
+         * participant-threads mode - every participant is decoded by its own
+         * worker, the receiver thread only receives and files packets
+         * @{ */
+        struct participant_worker;
+        void start_participant_worker(struct pdb_e *cp);
+        void participant_worker_loop(struct participant_worker *w);
+        static void destroy_participant_worker(void *state);
+        struct vcodec_state *get_vcodec_state(struct pdb_e *cp);
+        bool             m_parallel_decode = false;
+        int              m_handoff_len = 0;   ///< max packets queued for a participant worker
+        std::mutex       m_decoder_create_lock;
+        std::mutex       m_nacks_lock;
+        std::vector<std::pair<uint32_t, std::vector<uint16_t>>> m_pending_nacks; ///< sent by the receiver thread
+        std::vector<uint32_t> m_pending_plis; ///< SSRCs to request keyframe from, sent by the receiver thread
+        std::atomic<bool> m_frame_decoded{false};
+        /// @}
+        std::atomic<int> m_last_buf_size;
+
         enum video_mode  m_decoder_mode;
         struct display  *m_display_device;
         std::list<struct display *> m_display_copies; ///< some displays can be "forked"
@@ -89,6 +114,7 @@ private:
 
         long long int m_send_bytes_total;
         struct control_state *m_control;
+        std::vector<struct rtp *> m_tx_devices; ///< primary device and fanout receivers for current frame
 
         long long int m_nano_per_frame_actual_cumul = 0;
         long long int m_nano_per_frame_expected_cumul = 0;
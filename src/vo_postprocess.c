@@ -207,6 +207,16 @@ bool vo_postprocess(struct vo_postprocess_state *s, struct video_frame *in,
         return true;
 }
 
+bool vo_postprocess_in_place(struct vo_postprocess_state *s, struct video_frame *frame, int pitch)
+{
+        if (s == NULL) {
+                return false;
+        }
+        assert(simple_linked_list_size(s->postprocessors) == 1);
+        struct vo_postprocess_state_single *state = simple_linked_list_first(s->postprocessors);
+        return state->funcs->vo_postprocess(state->state, frame, frame, pitch);
+}
+
 void vo_postprocess_done(struct vo_postprocess_state *s)
 {
         if (s == NULL) {
@@ -238,7 +248,7 @@ bool vo_postprocess_get_property(struct vo_postprocess_state *s, int property, v
 
         if (simple_linked_list_size(s->postprocessors) == 1 || property == VO_PP_DOES_CHANGE_TILING_MODE) {
                 struct vo_postprocess_state_single *state = simple_linked_list_last(s->postprocessors);
-                return state->funcs->get_property(state, property, val, len);
+                return state->funcs->get_property(state->state, property, val, len);
         }
 
         /** @todo
@@ -247,7 +257,7 @@ bool vo_postprocess_get_property(struct vo_postprocess_state *s, int property, v
          */
         if (property == VO_PP_PROPERTY_CODECS) {
                 struct vo_postprocess_state_single *state = simple_linked_list_first(s->postprocessors);
-                return state->funcs->get_property(state, property, val, len);
+                return state->funcs->get_property(state->state, property, val, len);
         }
 
         return false;
@@ -47,6 +47,13 @@ extern "C" {
 /*          property                               type                   default          */
 #define VO_PP_PROPERTY_CODECS                0 /*  codec_t[]          all uncompressed     */
 #define VO_PP_DOES_CHANGE_TILING_MODE        1 /*  bool                    false           */
+#define VO_PP_PROPERTY_DISPLAY_SCALE         2 /*  int[2] - size the display may scale to instead of
+                                                           the postprocessor (see DISPLAY_PROPERTY_SCALE_TO) */
+#define VO_PP_PROPERTY_DISPLAY_CROP          3 /*  int[4] - x, y, width, height of the region the display may
+                                                           show instead of the postprocessor copying it out
+                                                           (see DISPLAY_PROPERTY_CROP), valid after reconfigure */
+#define VO_PP_PROPERTY_IN_PLACE              4 /*  bool - postprocessor can process the frame in the display
+                                                           buffer itself (in == out, output desc equals input) */
 
 #define VO_PP_ABI_VERSION 5
 
@@ -136,6 +143,11 @@ void vo_postprocess_get_out_desc(struct vo_postprocess_state *, struct video_des
 bool vo_postprocess_get_property(struct vo_postprocess_state *, int property, void *val, size_t *len);
 
 bool vo_postprocess(struct vo_postprocess_state *, struct video_frame*, struct video_frame*, int req_pitch);
+/**
+ * Processes frame obtained from the display (not from vo_postprocess_getf()) in place. May be
+ * used only if the (single) postprocessor reports @ref VO_PP_PROPERTY_IN_PLACE.
+ */
+bool vo_postprocess_in_place(struct vo_postprocess_state *, struct video_frame *frame, int pitch);
 void vo_postprocess_done(struct vo_postprocess_state *s);
 
 void show_vo_postprocess_help(bool full);
@@ -41,6 +41,8 @@
 #include "config_win32.h"
 #endif /* HAVE_CONFIG_H */
 
+#include <algorithm>
+
 #include "capture_filter.h"
 #include "debug.h"
 #include "lib_common.h"
@@ -48,6 +50,8 @@
 #include "video_display.h"
 #include "vo_postprocess.h"
 
+using std::min;
+
 struct state_border {
         struct video_desc saved_desc = {};
         uint8_t color[4] = { 0xff, 0xff, 0x00, 0xff }; ///< border color in RGBA
@@ -56,9 +60,15 @@ struct state_border {
         struct video_frame *in = nullptr;
 };
 
-static bool border_get_property(void * /* state */, int /* property */, void * /* val */, size_t * /* len */)
+static bool border_get_property(void * /* state */, int property, void *val, size_t *len)
 {
-        return false;
+        if (property != VO_PP_PROPERTY_IN_PLACE || *len < sizeof(bool)) {
+                return false;
+        }
+        // only the border pixels are overdrawn, the decoder may write directly to the display buffer
+        *(bool *) val = true;
+        *len = sizeof(bool);
+        return true;
 }
 
 static void * border_init(const char *config) {
@@ -82,7 +92,6 @@ static void * border_init(const char *config) {
                         }
                         if (strlen(color) == 6) {
                                 char color_str[3] = "";
-                                color += 1; //skip #
 
                                 for (int i = 0; i < 3; ++i) {
                                         color_str[0] = color[0];
@@ -124,77 +133,72 @@ static int border_postprocess_reconfigure(void *state, struct video_desc desc)
         struct state_border *s = (struct state_border *) state;
         s->saved_desc = desc;
         vf_free(s->in);
-        s->in = vf_alloc_desc_data(s->saved_desc);
+        s->in = nullptr; // allocated on demand, not needed when processing in place
         return TRUE;
 }
 
 static struct video_frame * border_getf(void *state)
 {
         struct state_border *s = (struct state_border *) state;
+        if (s->in == nullptr) {
+                s->in = vf_alloc_desc_data(s->saved_desc);
+        }
         return s->in;
 }
 
 static bool border_postprocess(void *state, struct video_frame *in, struct video_frame *out, int req_pitch)
 {
-        assert(req_pitch == vc_get_linesize(in->tiles[0].width, in->color_spec));
         assert(in->tile_count == 1);
 
         struct state_border *s = (struct state_border *) state;
+        const unsigned int width = out->tiles[0].width;
+        const unsigned int height = out->tiles[0].height;
+        const unsigned int bh = min(s->height, height / 2);
+        const unsigned int block_px = get_pf_block_pixels(in->color_spec);
+        const unsigned int bw = min(s->width, width / 2) / block_px * block_px;
+        const int linesize = vc_get_linesize(width, in->color_spec);
+
+        if (in->color_spec != UYVY && in->color_spec != RGB && in->color_spec != RGBA) {
+                log_msg(LOG_LEVEL_WARNING, "Unsupported pixel format!\n");
+                return false;
+        }
 
-        memcpy(out->tiles[0].data + s->height * req_pitch, in->tiles[0].data + s->height * req_pitch, in->tiles[0].data_len - 2 * s->height * req_pitch);
+        if (in != out) { // copy just the part that won't be overdrawn
+                for (unsigned int y = bh; y < height - bh; ++y) {
+                        memcpy(out->tiles[0].data + y * req_pitch, in->tiles[0].data + y * linesize, linesize);
+                }
+        }
 
+        // pixel block of the border color - 2 pixels for UYVY, 1 otherwise
+        unsigned char block[4];
+        int block_len = get_pf_block_bytes(in->color_spec);
         if (in->color_spec == UYVY) {
                 uint32_t rgba[2]{};
-                uint32_t uyvy{};
                 memcpy(&rgba[0], s->color, 4);
                 memcpy(&rgba[1], s->color, 4);
                 decoder_t vc_copylineRGBAtoUYVY = get_decoder_from_to(RGBA, UYVY);
-                vc_copylineRGBAtoUYVY((unsigned char *) &uyvy, (unsigned char *) rgba, 4, 0, 0, 0);
-                // up and down
-                for (unsigned int i = 0; i < s->height; ++i) {
-                        char *line1 = out->tiles[0].data + i * req_pitch;
-                        char *line2 = out->tiles[0].data + (out->tiles[0].height - 1 - i) * req_pitch;
-                        for (unsigned int x = 0; x < out->tiles[0].width; x += 2) {
-                                memcpy(line1 + x * 2, &uyvy, 4);
-                                memcpy(line2 + x * 2, &uyvy, 4);
-                        }
-                }
-                // sides
-                for (unsigned int i = 0; i < s->width; ++i) {
-                        if (i % 2 == 0) {
-                                for (unsigned int y = 0; y < out->tiles[0].height; y += 1) {
-                                        char *line = out->tiles[0].data + y * req_pitch;
-                                        char *line_end = out->tiles[0].data + y * req_pitch +
-                                                vc_get_linesize(out->tiles[0].width, UYVY) - 4;
-                                        memcpy(line + i / 2 * 4, &uyvy, 4);
-                                        memcpy(line_end - i / 2 * 4, &uyvy, 4);
-                                }
-                        }
-                }
-        } else if (in->color_spec == RGB || in->color_spec == RGBA) {
-                int bpp = get_bpp(in->color_spec);
-                for (unsigned int i = 0; i < s->height; ++i) {
-                        char *line1 = out->tiles[0].data + i * req_pitch;
-                        char *line2 = out->tiles[0].data + (out->tiles[0].height - 1 - i) * req_pitch;
-                        for (unsigned int x = 0; x < out->tiles[0].width; x += 1) {
-                                memcpy(line1 + x * bpp, s->color, bpp);
-                                memcpy(line2 + x * bpp, s->color, bpp);
-                        }
-                }
+                vc_copylineRGBAtoUYVY(block, (unsigned char *) rgba, 4, 0, 0, 0);
+        } else {
+                memcpy(block, s->color, block_len);
+        }
 
-                // sides
-                for (unsigned int i = 0; i < s->width; ++i) {
-                        for (unsigned int y = 0; y < out->tiles[0].height; y += 1) {
-                                char *line = out->tiles[0].data + y * req_pitch;
-                                char *line_end = out->tiles[0].data + y * req_pitch +
-                                        (out->tiles[0].width - 1) * bpp;
-                                memcpy(line + i * bpp, s->color, bpp);
-                                memcpy(line_end - i * bpp, s->color, bpp);
-                        }
+        auto fill = [&](char *dst, unsigned int pixels) {
+                for (unsigned int x = 0; x < pixels; x += block_px) {
+                        memcpy(dst, block, block_len);
+                        dst += block_len;
                 }
-        } else {
-                log_msg(LOG_LEVEL_WARNING, "Unsupported pixel format!\n");
-                return false;
+        };
+        // up and down
+        for (unsigned int i = 0; i < bh; ++i) {
+                fill(out->tiles[0].data + i * req_pitch, width);
+                fill(out->tiles[0].data + (height - 1 - i) * req_pitch, width);
+        }
+        // sides
+        const int side_bytes = bw / block_px * block_len;
+        for (unsigned int y = bh; y < height - bh; y += 1) {
+                char *line = out->tiles[0].data + y * req_pitch;
+                fill(line, bw);
+                fill(line + linesize - side_bytes, bw);
         }
 
         return true;
@@ -63,14 +63,27 @@ struct state_crop {
         int height = 0;
         int xoff = 0;
         int yoff = 0;
+        bool offload = true; ///< let the display show just the region if it can
+        int x = 0;           ///< effective offsets (clamped to the input frame)
+        int y = 0;
+        int x_bytes = 0;
         struct video_desc in_desc = {};
         struct video_desc out_desc = {};
         struct video_frame *in = nullptr;
 };
 
-static bool crop_get_property(void * /* state */, int /* property */, void * /* val */, size_t * /* len */)
+static bool crop_get_property(void *state, int property, void *val, size_t *len)
 {
-        return false;
+        auto s = static_cast<struct state_crop *>(state);
+        if (property != VO_PP_PROPERTY_DISPLAY_CROP || !s->offload || *len < 4 * sizeof(int)) {
+                return false;
+        }
+        ((int *) val)[0] = s->x;
+        ((int *) val)[1] = s->y;
+        ((int *) val)[2] = s->out_desc.width;
+        ((int *) val)[3] = s->out_desc.height;
+        *len = 4 * sizeof(int);
+        return true;
 }
 
 static void * crop_init(const char *config) {
@@ -81,7 +94,9 @@ static void * crop_init(const char *config) {
                         << style::bold << "height" << style::reset << ", "
                         << style::bold << "xoff" << style::reset << " and "
                         << style::bold << "yoff" << style::reset << ". Example:\n";
-                cout << style::bold << fg::red << "\t-p crop" << fg::reset << "[:width=<w>][:height=<h>][:xoff=<x>][:yoff=<y>]\n\n" << style::reset;
+                cout << style::bold << fg::red << "\t-p crop" << fg::reset << "[:width=<w>][:height=<h>][:xoff=<x>][:yoff=<y>][:nooffload]\n\n" << style::reset;
+                cout << "If the display is able to show just a region of the frame (sdl), frames are passed\n"
+                        "to it uncropped. Use " << style::bold << "nooffload" << style::reset << " to always copy the region out.\n\n";
                 return nullptr;
         }
 
@@ -99,6 +114,8 @@ static void * crop_init(const char *config) {
                         s->xoff = atoi(item + strlen("xoff="));
                 } else if (strncasecmp(item, "yoff=", strlen("yoff=")) == 0) {
                         s->yoff = atoi(item + strlen("yoff="));
+                } else if (strcasecmp(item, "nooffload") == 0) {
+                        s->offload = false;
                 } else {
                         log_msg(LOG_LEVEL_ERROR, "Wrong config: %s!\n", item);
                         free(tmp);
@@ -118,9 +135,9 @@ static int crop_postprocess_reconfigure(void *state, struct video_desc desc)
 {
         auto s = static_cast<struct state_crop *>(state);
         vf_free(s->in);
+        s->in = nullptr; // allocated on demand, not needed when offloaded
 
         s->in_desc = desc;
-        s->in = vf_alloc_desc_data(desc);
 
         s->out_desc = desc;
         s->out_desc.width = s->width ? min<int>(s->width, desc.width) : desc.width;
@@ -132,12 +149,21 @@ static int crop_postprocess_reconfigure(void *state, struct video_desc desc)
                 * get_pf_block_bytes(desc.color_spec);
         s->out_desc.width = linesize / get_bpp(desc.color_spec);
 
+        int xoff = max<int>(0, s->xoff - max<int>(0, s->out_desc.width + s->xoff - desc.width));
+        int xoff_blocks = (int) (xoff * get_bpp(desc.color_spec)) / get_pf_block_bytes(desc.color_spec);
+        s->x_bytes = xoff_blocks * get_pf_block_bytes(desc.color_spec);
+        s->x = xoff_blocks * get_pf_block_pixels(desc.color_spec);
+        s->y = max<int>(0, s->yoff - max<int>(0, s->out_desc.height + s->yoff - desc.height));
+
         return TRUE;
 }
 
 static struct video_frame * crop_getf(void *state)
 {
         auto s = static_cast<struct state_crop *>(state);
+        if (s->in == nullptr) {
+                s->in = vf_alloc_desc_data(s->in_desc);
+        }
         return s->in;
 }
 
@@ -148,15 +174,11 @@ static bool crop_postprocess(void *state, struct video_frame *in, struct video_f
 
         auto s = static_cast<struct state_crop *>(state);
         int src_linesize = vc_get_linesize(in->tiles[0].width, in->color_spec);
-        int xoff = s->xoff - max<int>(0, out->tiles[0].width + s->xoff - in->tiles[0].width);
-        int xoff_bytes = (int) (xoff * get_bpp(in->color_spec)) / get_pf_block_bytes(in->color_spec)
-                * get_pf_block_bytes(in->color_spec);
-        int yoff = s->yoff - max<int>(0, out->tiles[0].height + s->yoff - in->tiles[0].height);
-
+        int dst_linesize = vc_get_linesize(out->tiles[0].width, out->color_spec);
         for (int y = 0 ; y < (int) out->tiles[0].height; y++) {
                 memcpy(out->tiles[0].data + y * req_pitch,
-                                in->tiles[0].data + (yoff + y) * src_linesize + xoff_bytes,
-                                req_pitch);
+                                in->tiles[0].data + (s->y + y) * src_linesize + s->x_bytes,
+                                dst_linesize);
         }
 
         return true;
@@ -44,35 +44,308 @@
 #include <pthread.h>
 #include <stdlib.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "capture_filter.h"
 #include "debug.h"
 #include "lib_common.h"
+#include "utils/misc.h"
+#include "utils/worker.h"
 #include "video.h"
 #include "video_display.h"
 #include "vo_postprocess.h"
 
+#define DEFAULT_THRESHOLD 10
+#define MOD_NAME "[deinterlace] "
+
+enum deinterlace_mode {
+        DEINTERLACE_BLEND,    ///< linear blend of both fields
+        DEINTERLACE_ADAPTIVE, ///< weave static areas, interpolate moving ones
+};
+
 struct state_deinterlace {
         struct video_frame *out; ///< for postprocess only
+        enum deinterlace_mode mode;
+        int threshold;
+
+        struct video_desc desc;
+        unsigned char *prev_field; ///< bottom field of the previous frame (adaptive mode)
+        size_t prev_field_len;
+        bool prev_valid;
+};
+
+struct deinterlace_job {
+        enum deinterlace_mode mode;
+        int bpc;                   ///< bytes per component - 1 or 2
+        int threshold;
+        const unsigned char *in;
+        unsigned char *out;
+        unsigned char *prev_field; ///< may be NULL if no history is available
+        unsigned char *new_field;  ///< where to store current bottom field, NULL in blend mode
+        size_t linesize;
+        size_t out_pitch;
+        size_t lines;
+        size_t start;              ///< first line (even)
+        size_t end;
 };
 
 static void usage()
 {
         printf("Deinterlaces output video frames.\nUsage:\n");
-        printf("\t-p deinterlace\n");
+        printf("\t-p deinterlace[:adaptive[:threshold=<t>]]\n");
+        printf("\t\tadaptive - motion-adaptive mode, static areas keep full vertical resolution\n");
+        printf("\t\t<t> - difference from the previous field considered as a motion (default %d)\n",
+                        DEFAULT_THRESHOLD);
+        printf("\tSupported codecs with 8-bit or 16-bit components are processed natively, other\n"
+                        "\tcodecs are blended bytewise.\n");
 }
 
 static void * deinterlace_init(const char *config) {
-        if (strcmp(config, "help") == 0) {
+        if (config != NULL && strcmp(config, "help") == 0) {
                 usage();
                 return NULL;
         }
 
         struct state_deinterlace *s = calloc(1, sizeof(struct state_deinterlace));
         assert(s != NULL);
+        s->mode = DEINTERLACE_BLEND;
+        s->threshold = DEFAULT_THRESHOLD;
+
+        char *tmp = strdup(config != NULL ? config : "");
+        char *save_ptr = NULL;
+        char *item = NULL;
+        char *cfg = tmp;
+        while ((item = strtok_r(cfg, ":", &save_ptr)) != NULL) {
+                cfg = NULL;
+                if (strcmp(item, "adaptive") == 0) {
+                        s->mode = DEINTERLACE_ADAPTIVE;
+                } else if (strcmp(item, "blend") == 0) {
+                        s->mode = DEINTERLACE_BLEND;
+                } else if (strncmp(item, "threshold=", strlen("threshold=")) == 0) {
+                        s->threshold = atoi(item + strlen("threshold="));
+                        if (s->threshold < 0 || s->threshold > 255) {
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Threshold must be in range 0-255!\n");
+                                free(tmp);
+                                free(s);
+                                return NULL;
+                        }
+                } else {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unknown option: %s\n", item);
+                        usage();
+                        free(tmp);
+                        free(s);
+                        return NULL;
+                }
+        }
+        free(tmp);
 
         return s;
 }
 
+/// @returns bytes per component for natively supported codecs, 0 otherwise
+static int get_component_bytes(codec_t codec)
+{
+        const codec_t codecs8[] = { RGBA, UYVY, YUYV, RGB, BGR, VIDEO_CODEC_NONE };
+        const codec_t codecs16[] = { RG48, Y216, Y416, VIDEO_CODEC_NONE };
+        if (codec_is_in_set(codec, codecs8)) {
+                return 1;
+        }
+        if (codec_is_in_set(codec, codecs16)) {
+                return 2;
+        }
+        return 0;
+}
+
+static void blend_line8(unsigned char *d0, unsigned char *d1, const unsigned char *s0, const unsigned char *s1, size_t len)
+{
+        size_t x = 0;
+#ifdef __SSE2__
+        for ( ; x + 16 <= len; x += 16) {
+                __m128i avg = _mm_avg_epu8(_mm_loadu_si128((const __m128i *)(const void *) (s0 + x)),
+                                _mm_loadu_si128((const __m128i *)(const void *) (s1 + x)));
+                _mm_storeu_si128((__m128i *)(void *) (d0 + x), avg);
+                _mm_storeu_si128((__m128i *)(void *) (d1 + x), avg);
+        }
+#endif
+        for ( ; x < len; ++x) {
+                d0[x] = d1[x] = (s0[x] + s1[x] + 1) >> 1;
+        }
+}
+
+static void blend_line16(unsigned char *d0, unsigned char *d1, const unsigned char *s0, const unsigned char *s1, size_t len)
+{
+        size_t x = 0;
+#ifdef __SSE2__
+        for ( ; x + 16 <= len; x += 16) {
+                __m128i avg = _mm_avg_epu16(_mm_loadu_si128((const __m128i *)(const void *) (s0 + x)),
+                                _mm_loadu_si128((const __m128i *)(const void *) (s1 + x)));
+                _mm_storeu_si128((__m128i *)(void *) (d0 + x), avg);
+                _mm_storeu_si128((__m128i *)(void *) (d1 + x), avg);
+        }
+#endif
+        for ( ; x + 2 <= len; x += 2) {
+                uint16_t a, b;
+                memcpy(&a, s0 + x, 2);
+                memcpy(&b, s1 + x, 2);
+                uint16_t val = (a + b + 1) >> 1;
+                memcpy(d0 + x, &val, 2);
+                memcpy(d1 + x, &val, 2);
+        }
+}
+
+/**
+ * Reconstructs a bottom-field line - samples that differ from the previous
+ * bottom field by at most thr are kept (weave), the others are interpolated
+ * from the neighbouring top-field lines. If prev is NULL, whole line is
+ * interpolated.
+ */
+static void adaptive_line8(unsigned char *dst, const unsigned char *cur, const unsigned char *prev,
+                const unsigned char *above, const unsigned char *below, size_t len, int thr)
+{
+        size_t x = 0;
+#ifdef __SSE2__
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i thr_v = _mm_set1_epi8((char) thr);
+        for ( ; x + 16 <= len; x += 16) {
+                __m128i c = _mm_loadu_si128((const __m128i *)(const void *) (cur + x));
+                __m128i bob = _mm_avg_epu8(_mm_loadu_si128((const __m128i *)(const void *) (above + x)),
+                                _mm_loadu_si128((const __m128i *)(const void *) (below + x)));
+                __m128i res = bob;
+                if (prev != NULL) {
+                        __m128i p = _mm_loadu_si128((const __m128i *)(const void *) (prev + x));
+                        __m128i diff = _mm_or_si128(_mm_subs_epu8(c, p), _mm_subs_epu8(p, c));
+                        __m128i still = _mm_cmpeq_epi8(_mm_subs_epu8(diff, thr_v), zero);
+                        res = _mm_or_si128(_mm_and_si128(still, c), _mm_andnot_si128(still, bob));
+                }
+                _mm_storeu_si128((__m128i *)(void *) (dst + x), res);
+        }
+#endif
+        for ( ; x < len; ++x) {
+                if (prev != NULL && abs(cur[x] - prev[x]) <= thr) {
+                        dst[x] = cur[x];
+                } else {
+                        dst[x] = (above[x] + below[x] + 1) >> 1;
+                }
+        }
+}
+
+static void adaptive_line16(unsigned char *dst, const unsigned char *cur, const unsigned char *prev,
+                const unsigned char *above, const unsigned char *below, size_t len, int thr)
+{
+        thr <<= 8;
+        size_t x = 0;
+#ifdef __SSE2__
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i thr_v = _mm_set1_epi16((short) thr);
+        for ( ; x + 16 <= len; x += 16) {
+                __m128i c = _mm_loadu_si128((const __m128i *)(const void *) (cur + x));
+                __m128i bob = _mm_avg_epu16(_mm_loadu_si128((const __m128i *)(const void *) (above + x)),
+                                _mm_loadu_si128((const __m128i *)(const void *) (below + x)));
+                __m128i res = bob;
+                if (prev != NULL) {
+                        __m128i p = _mm_loadu_si128((const __m128i *)(const void *) (prev + x));
+                        __m128i diff = _mm_or_si128(_mm_subs_epu16(c, p), _mm_subs_epu16(p, c));
+                        __m128i still = _mm_cmpeq_epi16(_mm_subs_epu16(diff, thr_v), zero);
+                        res = _mm_or_si128(_mm_and_si128(still, c), _mm_andnot_si128(still, bob));
+                }
+                _mm_storeu_si128((__m128i *)(void *) (dst + x), res);
+        }
+#endif
+        for ( ; x + 2 <= len; x += 2) {
+                uint16_t c, a, b, val;
+                memcpy(&c, cur + x, 2);
+                memcpy(&a, above + x, 2);
+                memcpy(&b, below + x, 2);
+                val = (a + b + 1) >> 1;
+                if (prev != NULL) {
+                        uint16_t p;
+                        memcpy(&p, prev + x, 2);
+                        if (abs(c - p) <= thr) {
+                                val = c;
+                        }
+                }
+                memcpy(dst + x, &val, 2);
+        }
+}
+
+static void *deinterlace_worker(void *arg)
+{
+        struct deinterlace_job *j = arg;
+        for (size_t y = j->start; y < j->end && y + 1 < j->lines; y += 2) {
+                const unsigned char *top = j->in + y * j->linesize;
+                const unsigned char *bottom = top + j->linesize;
+                unsigned char *d0 = j->out + y * j->out_pitch;
+                unsigned char *d1 = d0 + j->out_pitch;
+                if (j->mode == DEINTERLACE_BLEND) {
+                        if (j->bpc == 2) {
+                                blend_line16(d0, d1, top, bottom, j->linesize);
+                        } else {
+                                blend_line8(d0, d1, top, bottom, j->linesize);
+                        }
+                        continue;
+                }
+                // next top-field line, the last bottom line is interpolated from the one above only
+                const unsigned char *below = y + 2 < j->lines ? bottom + j->linesize : top;
+                const unsigned char *prev = j->prev_field ? j->prev_field + y / 2 * j->linesize : NULL;
+                memcpy(d0, top, j->linesize);
+                if (j->bpc == 2) {
+                        adaptive_line16(d1, bottom, prev, top, below, j->linesize, j->threshold);
+                } else {
+                        adaptive_line8(d1, bottom, prev, top, below, j->linesize, j->threshold);
+                }
+                memcpy(j->new_field + y / 2 * j->linesize, bottom, j->linesize);
+        }
+        return NULL;
+}
+
+static void deinterlace_frame(struct state_deinterlace *s, struct video_frame *in, unsigned char *out, size_t out_pitch)
+{
+        const size_t linesize = vc_get_linesize(in->tiles[0].width, in->color_spec);
+        const size_t lines = in->tiles[0].height;
+        int bpc = get_component_bytes(in->color_spec);
+
+        if (bpc == 0) {
+                vc_deinterlace_ex((unsigned char *) in->tiles[0].data, linesize, out, out_pitch, lines);
+                return;
+        }
+
+        enum deinterlace_mode mode = s->mode;
+        unsigned char *new_field = NULL;
+        if (mode == DEINTERLACE_ADAPTIVE) {
+                struct video_desc desc = video_desc_from_frame(in);
+                size_t field_len = linesize * (lines / 2);
+                if (!video_desc_eq(desc, s->desc) || s->prev_field_len != field_len) {
+                        free(s->prev_field);
+                        s->prev_field = malloc(field_len);
+                        s->prev_field_len = field_len;
+                        s->prev_valid = false;
+                        s->desc = desc;
+                }
+                // updated in place - every job reads and overwrites only its own lines
+                new_field = s->prev_field;
+        }
+
+        const size_t pairs = (lines + 1) / 2;
+        int threads = MIN((size_t) get_cpu_core_count(), pairs);
+        threads = MAX(threads, 1);
+        struct deinterlace_job jobs[threads];
+        for (int i = 0; i < threads; ++i) {
+                jobs[i] = (struct deinterlace_job) { mode, bpc, s->threshold,
+                        (const unsigned char *) in->tiles[0].data, out,
+                        s->prev_valid ? s->prev_field : NULL, new_field,
+                        linesize, out_pitch, lines,
+                        pairs * i / threads * 2, pairs * (i + 1) / threads * 2 };
+        }
+        task_run_parallel(deinterlace_worker, threads, jobs, sizeof jobs[0], NULL);
+
+        if (lines % 2 == 1) {
+                memcpy(out + (lines - 1) * out_pitch, in->tiles[0].data + (lines - 1) * linesize, linesize);
+        }
+        s->prev_valid = mode == DEINTERLACE_ADAPTIVE;
+}
+
 static int cf_deinterlace_init(struct module *parent, const char *cfg, void **state)
 {
         UNUSED(parent);
@@ -101,6 +374,11 @@ static int deinterlace_reconfigure(void *state, struct video_desc desc)
         vf_free(s->out);
         assert(desc.tile_count == 1);
         s->out = vf_alloc_desc_data(desc);
+        s->prev_valid = false;
+        if (get_component_bytes(desc.color_spec) == 0) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Codec %s is not supported natively, blending bytewise.\n",
+                                get_codec_name(desc.color_spec));
+        }
 
         return TRUE;
 }
@@ -114,24 +392,19 @@ static struct video_frame * deinterlace_getf(void *state)
 
 static bool deinterlace_postprocess(void *state, struct video_frame *in, struct video_frame *out, int req_pitch)
 {
-        UNUSED(state);
+        struct state_deinterlace *s = (struct state_deinterlace *) state;
         assert (req_pitch == vc_get_linesize(in->tiles[0].width, in->color_spec));
         assert (video_desc_eq(video_desc_from_frame(out), video_desc_from_frame(in)));
         assert (in->tiles[0].data_len <= vc_get_linesize(in->tiles[0].width, in->color_spec) * in->tiles[0].height);
         assert (out->tiles[0].data_len <= vc_get_linesize(in->tiles[0].width, in->color_spec) * in->tiles[0].height);
 
-        vc_deinterlace_ex((unsigned char *) in->tiles[0].data, vc_get_linesize(in->tiles[0].width, in->color_spec),
-                                (unsigned char *) out->tiles[0].data, vc_get_linesize(out->tiles[0].width, in->color_spec),
-                                in->tiles[0].height);
-        memcpy(out->tiles[0].data, in->tiles[0].data, in->tiles[0].data_len);
+        deinterlace_frame(s, in, (unsigned char *) out->tiles[0].data, req_pitch);
 
         return true;
 }
 
 static struct video_frame *cf_deinterlace_filter(void *state, struct video_frame *f)
 {
-        UNUSED(state);
-
         struct video_frame *out = vf_alloc_desc_data(video_desc_from_frame(f));
         out->callbacks.dispose = vf_free;
         if (!deinterlace_postprocess(state, f, out, vc_get_linesize(f->tiles[0].width, f->color_spec))) {
@@ -148,6 +421,7 @@ static void deinterlace_done(void *state)
         struct state_deinterlace *s = (struct state_deinterlace *) state;
         
         vf_free(s->out);
+        free(s->prev_field);
         free(s);
 }
 
@@ -173,9 +447,9 @@ static const struct vo_postprocess_info vo_pp_deinterlace_info = {
 };
 
 static const struct capture_filter_info capture_filter_deinterlace_info = {
-        cf_deinterlace_init,
-        deinterlace_done,
-        cf_deinterlace_filter
+        .init = cf_deinterlace_init,
+        .done = deinterlace_done,
+        .filter = cf_deinterlace_filter,
 };
 
 REGISTER_MODULE(deinterlace, &vo_pp_deinterlace_info, LIBRARY_CLASS_VIDEO_POSTPROCESS, VO_PP_ABI_VERSION);
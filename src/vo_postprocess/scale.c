@@ -56,6 +56,7 @@ struct state_scale {
         struct gl_context context;
 
         int scaled_width, scaled_height;
+        bool offload; ///< let GL-based displays scale the frame when drawing
         GLuint tex_input;
         GLuint tex_output;
         GLuint fbo;
@@ -63,11 +64,10 @@ struct state_scale {
 
 static bool scale_get_property(void *state, int property, void *val, size_t *len)
 {
+        struct state_scale *s = (struct state_scale *) state;
         bool ret = false;
         codec_t supported[] = {UYVY, RGBA};
 
-        UNUSED(state);
-
         switch(property) {
                 case VO_PP_PROPERTY_CODECS:
                         if(*len < (int) sizeof(supported)) {
@@ -79,6 +79,15 @@ static bool scale_get_property(void *state, int property, void *val, size_t *len
                         }
                         ret = true;
                         break;
+                case VO_PP_PROPERTY_DISPLAY_SCALE:
+                        if (!s->offload || *len < 2 * sizeof(int)) {
+                                break;
+                        }
+                        ((int *) val)[0] = s->scaled_width;
+                        ((int *) val)[1] = s->scaled_height;
+                        *len = 2 * sizeof(int);
+                        ret = true;
+                        break;
         }
 
         return ret;
@@ -87,7 +96,10 @@ static bool scale_get_property(void *state, int property, void *val, size_t *len
 static void usage()
 {
         printf("Scale postprocessor settings:\n");
-        printf("\t-p scale:width:height\n");
+        printf("\t-p scale:width:height[:nooffload]\n");
+        printf("\tIf the display is able to scale on GPU itself (gl, sdl), frames are passed to\n"
+                        "\tit unscaled and the display window is sized accordingly. Use 'nooffload' to\n"
+                        "\talways scale in the postprocessor.\n");
 }
 
 static void * scale_init(const char *config) {
@@ -114,6 +126,19 @@ static void * scale_init(const char *config) {
         if (ptr != NULL) {
                 s->scaled_height = atoi(ptr);
         }
+        s->offload = true;
+        ptr = strtok_r(NULL, ":", &save_ptr);
+        if (ptr != NULL) {
+                if (strcmp(ptr, "nooffload") == 0) {
+                        s->offload = false;
+                } else {
+                        fprintf(stderr, "Scale postprocessor unknown option: %s\n", ptr);
+                        usage();
+                        free(s);
+                        free(tmp);
+                        return NULL;
+                }
+        }
         if (s->scaled_width <= 0 || s->scaled_height <= 0) {
                 fprintf(stderr, "Scale postprocessor incorrect usage.\n");
                 usage();
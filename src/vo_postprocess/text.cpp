@@ -48,6 +48,7 @@
 #endif /* HAVE_CONFIG_H */
 
 #include <memory>
+#include <vector>
 
 #ifdef WAND7
 #include <MagickWand/MagickWand.h>
@@ -66,6 +67,7 @@
 #include "vo_postprocess.h"
 #include "rang.hpp"
 #include "utils/misc.h"
+#include "utils/overlay.h"
 
 using rang::style;
 using namespace std;
@@ -79,8 +81,7 @@ struct state_text {
         int margin_x, margin_y, text_h;
         struct video_desc saved_desc;
 
-        DrawingWand *dw;
-        MagickWand *wand;
+        struct overlay *overlay; ///< text prerendered for current video format
 };
 
 static bool text_get_property(void *state, int property, void *val, size_t *len)
@@ -162,18 +163,50 @@ static int cf_text_init(struct module * /* parent */, const char *cfg, void **st
         }
 }
 
+static bool render_text(struct state_text *s, DrawingWand *dw, MagickWand *wand, PixelWand *pw,
+                unsigned char *rgba)
+{
+        DrawSetFontSize(dw, s->text_h);
+        auto status = DrawSetFont(dw, "helvetica");
+        if(status != MagickTrue) {
+                log_msg(LOG_LEVEL_WARNING, "[text vo_pp.] DraweSetFont failed!\n");
+                return false;
+        }
+        PixelSetColor(pw, "#333333FF");
+        DrawSetFillColor(dw, pw);
+        PixelSetColor(pw, "#FFFFFFFF");
+        DrawSetStrokeColor(dw, pw);
+
+        PixelSetColor(pw, "none");
+        status = MagickNewImage(wand, s->width, s->height, pw);
+        if(status != MagickTrue) {
+                log_msg(LOG_LEVEL_WARNING, "[text vo_pp.] MagickNewImage failed!\n");
+                return false;
+        }
+        status = MagickAnnotateImage(wand, dw, s->margin_x, s->margin_y + s->text_h, 0, s->text.c_str());
+        if (status != MagickTrue) {
+                log_msg(LOG_LEVEL_WARNING, "[text vo_pp.] MagickAnnotateImage failed!\n");
+                return false;
+        }
+        status = MagickExportImagePixels(wand, 0, 0, s->width, s->height, "RGBA", CharPixel, rgba);
+        if (status != MagickTrue) {
+                log_msg(LOG_LEVEL_WARNING, "[text vo_pp.] MagickExportImagePixels failed!\n");
+                return false;
+        }
+        return true;
+}
+
+/**
+ * The text doesn't change so it is rendered only here (with transparent
+ * background) and then just alpha blended to every frame.
+ */
 static int text_postprocess_reconfigure(void *state, struct video_desc desc)
 {
         struct state_text *s = (struct state_text *) state;
 
         vf_free(s->in);
-        if (s->wand)
-                DestroyMagickWand(s->wand);
-        if (s->dw)
-                DestroyDrawingWand(s->dw);
-        s->in = 0;
-        s->wand = 0;
-        s->dw = 0;
+        overlay_destroy(s->overlay);
+        s->overlay = nullptr;
 
         s->in = vf_alloc_desc_data(desc);
 
@@ -183,61 +216,25 @@ static int text_postprocess_reconfigure(void *state, struct video_desc desc)
         s->width = min<unsigned long>(s->margin_x + s->text.length() * s->text_h, desc.width);
         s->height = min<unsigned long>(s->margin_y + s->text_h, desc.height);
 
-        const char *color;
-        const char *color_outline;
-        const char *colorspace;
-        if (desc.color_spec == RGBA) {
-                color = "#333333FF";
-                color_outline = "#FFFFFFFF";
-                colorspace = "rgba";
-        } else if (desc.color_spec == RGB) {
-                color = "#333333FF";
-                color_outline = "#FFFFFFFF";
-                colorspace = "rgb";
-        } else if (desc.color_spec == UYVY) {
-                color = "#228080FF";
-                color_outline = "#EB8080FF";
-                colorspace = "UYVY";
-        } else {
+        if (!overlay_codec_supported(desc.color_spec)) {
                 log_msg(LOG_LEVEL_ERROR, "[text vo_pp.] Codec not supported! Please report to "
                                 PACKAGE_BUGREPORT ".\n");
                 return FALSE;
         }
 
-        s->dw = NewDrawingWand();
-        DrawSetFontSize(s->dw, s->text_h);
-        auto status = DrawSetFont(s->dw, "helvetica");
-        if(status != MagickTrue) {
-                log_msg(LOG_LEVEL_WARNING, "[text vo_pp.] DraweSetFont failed!\n");
-                return FALSE;
-        }
-        {
-               PixelWand *pw = NewPixelWand();
-               PixelSetColor(pw, color);
-               DrawSetFillColor(s->dw, pw);
-               PixelSetColor(pw, color_outline);
-               DrawSetStrokeColor(s->dw, pw);
-               DestroyPixelWand(pw);
-        }
-
-        s->wand = NewMagickWand();
-        status = MagickSetFormat(s->wand, colorspace);
-        if(status != MagickTrue) {
-                log_msg(LOG_LEVEL_WARNING, "[text vo_pp.] MagickSetFormat failed!\n");
-                return FALSE;
-        }
-
-        status = MagickSetSize(s->wand, s->width, s->height);
-        if(status != MagickTrue) {
-                log_msg(LOG_LEVEL_WARNING, "[text vo_pp.] MagickSetSize failed!\n");
+        vector<unsigned char> rgba(4 * s->width * s->height);
+        DrawingWand *dw = NewDrawingWand();
+        MagickWand *wand = NewMagickWand();
+        PixelWand *pw = NewPixelWand();
+        bool ret = render_text(s, dw, wand, pw, rgba.data());
+        DestroyPixelWand(pw);
+        DestroyMagickWand(wand);
+        DestroyDrawingWand(dw);
+        if (!ret) {
                 return FALSE;
         }
 
-        status = MagickSetDepth(s->wand, 8);
-        if(status != MagickTrue) {
-                log_msg(LOG_LEVEL_WARNING, "[text vo_pp.] MagickSetDepth failed!\n");
-                return FALSE;
-        }
+        s->overlay = overlay_create(rgba.data(), s->width, s->height, desc.color_spec, desc.width, 0, 0);
 
         return TRUE;
 }
@@ -249,57 +246,20 @@ static struct video_frame * text_getf(void *state)
         return s->in;
 }
 
-/**
- * @todo
- * Rendering of the text is a bit slow. Since the text doesn't change at all, it should be
- * prerendered and then only alpha blended.
- */
 static bool text_postprocess(void *state, struct video_frame *in, struct video_frame *out, int req_pitch)
 {
         struct state_text *s = (struct state_text *) state;
 
-        int dstlinesize = vc_get_linesize(s->width, in->color_spec);
-        int srclinesize = vc_get_linesize(in->tiles[0].width, in->color_spec);
-        auto tmp = unique_ptr<char []>(new char[s->height * dstlinesize]);
-        for (int y = 0; y < s->height; y++) {
-                memcpy(tmp.get() + y * dstlinesize, in->tiles[0].data + y * srclinesize, dstlinesize);
-        }
-
-        MagickRemoveImage(s->wand);
-        auto status = MagickReadImageBlob(s->wand, tmp.get(), s->height * dstlinesize);
-        if (status != MagickTrue) {
-                log_msg(LOG_LEVEL_WARNING, "[text vo_pp.] MagickReadImageBlob failed!\n");
-                return false;
-        }
-        //double *ret = MagickQueryFontMetrics(wand, dw, s->text.c_str());
-        //fprintf(stderr, "%f %f %f %f %f\n", ret[0], ret[1], ret[2], ret[3], ret[4]);
-        unsigned char *data;
-        size_t data_len;
-        status = MagickAnnotateImage(s->wand, s->dw, s->margin_x, s->margin_y + s->text_h, 0, s->text.c_str());
-        if (status != MagickTrue) {
-                log_msg(LOG_LEVEL_WARNING, "[text vo_pp.] MagickAnnotateImage failed!\n");
-                return false;
-        }
-        status = MagickDrawImage(s->wand, s->dw);
-        if (status != MagickTrue) {
-                log_msg(LOG_LEVEL_WARNING, "[text vo_pp.] MagickDrawImage failed!\n");
-                return false;
-        }
-        data = MagickGetImageBlob(s->wand, &data_len);
-        if (!data) {
-                log_msg(LOG_LEVEL_WARNING, "[text vo_pp.] MagickGetImageBlob failed!\n");
-                return false;
-        }
-
-        memcpy(out->tiles[0].data, in->tiles[0].data, in->tiles[0].data_len);
-
-        if ((int) data_len == s->height * dstlinesize) {
-                for (int y = 0; y < s->height; y++) {
-                        memcpy(out->tiles[0].data + y * req_pitch, data + y * dstlinesize, dstlinesize);
+        int linesize = vc_get_linesize(in->tiles[0].width, in->color_spec);
+        if (req_pitch == linesize) {
+                memcpy(out->tiles[0].data, in->tiles[0].data, in->tiles[0].data_len);
+        } else {
+                for (unsigned int y = 0; y < in->tiles[0].height; y++) {
+                        memcpy(out->tiles[0].data + y * req_pitch, in->tiles[0].data + y * linesize, linesize);
                 }
         }
 
-        free(data);
+        overlay_blend(s->overlay, out->tiles[0].data, req_pitch);
 
         return true;
 }
@@ -317,16 +277,9 @@ static struct video_frame *cf_text_filter(void *state, struct video_frame *f)
                 }
         }
 
-        struct video_frame *out = vf_alloc_desc_data(s->saved_desc);
-        out->callbacks.dispose = vf_free;
-        if (text_postprocess(state, f, out, vc_get_linesize(f->tiles[0].width, f->color_spec))) {
-                VIDEO_FRAME_DISPOSE(f);
-                return out;
-        } else {
-                VIDEO_FRAME_DISPOSE(f);
-                vf_free(out);
-                return NULL;
-        }
+        // no need to copy the frame, the text is blended in place
+        overlay_blend(s->overlay, f->tiles[0].data, vc_get_linesize(f->tiles[0].width, f->color_spec));
+        return f;
 }
 
 static void text_done(void *state)
@@ -334,9 +287,7 @@ static void text_done(void *state)
         struct state_text *s = (struct state_text *) state;
 
         vf_free(s->in);
-
-        DestroyMagickWand(s->wand);
-        DestroyDrawingWand(s->dw);
+        overlay_destroy(s->overlay);
 
         delete s;
 }
@@ -1,44 +1,472 @@
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cerrno>
 #include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "../src/config_unix.h"
 #include "../src/video_codec.h"
+#ifdef HAVE_LAVC
+#include "../src/libavcodec/from_lavc_vid_conv.h"
+#include "../src/libavcodec/to_lavc_vid_conv.h"
+extern "C" {
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+}
+#endif
 
-using std::chrono::duration_cast;
 using std::chrono::high_resolution_clock;
-using std::chrono::microseconds;
 using std::cout;
 using std::cerr;
 using std::ifstream;
 using std::ofstream;
+using std::pair;
 using std::stoi;
 using std::string;
 using std::vector;
 
-static void benchmark() {
-        int width = 3840;
-        int height = 2160;
-        vector<unsigned char> in(width * height * MAX_BPS + MAX_PADDING);
-        vector<unsigned char> out(width * height * MAX_BPS + MAX_PADDING);
-        for (int i = 0; i < VIDEO_CODEC_END; ++i) {
-                bool src_print = false;
-                for (int j = 0; j < VIDEO_CODEC_END; ++j) {
-                        codec_t inc = static_cast<codec_t>(i);
-                        codec_t outc = static_cast<codec_t>(j);
-                        decoder_t conv = nullptr;
-                        if ((conv = get_decoder_from_to(inc, outc)) == nullptr || i == j) {
-                                continue;
+// video_codec.o (and lavc_common.o) read UltraGrid parameters, provide them here
+static std::map<string, string> params;
+extern "C" const char *get_commandline_param(const char *key) {
+        auto it = params.find(key);
+        return it == params.end() ? nullptr : it->second.c_str();
+}
+extern "C" void register_param(const char *param, const char *doc) {
+        (void) param, (void) doc;
+}
+
+struct bench_opts {
+        vector<pair<int, int>> sizes{{1920, 1080}, {3840, 2160}, {7680, 4320}};
+        vector<int> threads{1, static_cast<int>(std::thread::hardware_concurrency())};
+        vector<string> isas{"native", "generic"};
+        int reps = 3;
+        string format = "text";
+};
+
+struct bench_result {
+        string kind; ///< ug, to_lavc or from_lavc
+        string src;
+        string dst;
+        int width;
+        int height;
+        int threads;
+        string isa;
+        double ns_per_px;
+        double gb_per_s; ///< (input + output bytes) / time
+};
+
+/// runs fn(first_row, rows) in parallel for the whole height, returns best time in seconds
+template<typename F>
+static double bench_run(int height, int threads, int reps, int row_align, F fn) {
+        double best = std::numeric_limits<double>::max();
+        for (int r = 0; r < reps; ++r) {
+                auto t0 = high_resolution_clock::now();
+                vector<std::thread> workers;
+                int rows_per_thread = (height / threads + row_align - 1) / row_align * row_align;
+                for (int t = 0; t < threads; ++t) {
+                        int first = t * rows_per_thread;
+                        int rows = std::min(rows_per_thread, height - first);
+                        if (rows > 0) {
+                                workers.emplace_back(fn, first, rows);
+                        }
+                }
+                for (auto &w : workers) {
+                        w.join();
+                }
+                std::chrono::duration<double> t = high_resolution_clock::now() - t0;
+                best = std::min(best, t.count());
+        }
+        return best;
+}
+
+static void bench_ug(const bench_opts &opts, vector<bench_result> &results) {
+        for (const auto &isa : opts.isas) {
+                params["conv-isa"] = isa;
+                for (auto size : opts.sizes) {
+                        int width = size.first;
+                        int height = size.second;
+                        vector<unsigned char> in(static_cast<size_t>(width) * height * MAX_BPS + MAX_PADDING);
+                        vector<unsigned char> out(static_cast<size_t>(width) * height * MAX_BPS + MAX_PADDING);
+                        for (size_t i = 0; i < in.size(); ++i) {
+                                in[i] = i * 37U;
+                        }
+                        for (int i = 0; i < VIDEO_CODEC_END; ++i) {
+                                for (int j = 0; j < VIDEO_CODEC_END; ++j) {
+                                        codec_t inc = static_cast<codec_t>(i);
+                                        codec_t outc = static_cast<codec_t>(j);
+                                        decoder_t conv = nullptr;
+                                        if ((conv = get_decoder_from_to(inc, outc)) == nullptr || i == j) {
+                                                continue;
+                                        }
+                                        size_t src_linesize = vc_get_linesize(width, inc);
+                                        size_t dst_linesize = vc_get_linesize(width, outc);
+                                        for (int threads : opts.threads) {
+                                                double t = bench_run(height, threads, opts.reps, 1, [&](int first, int rows) {
+                                                        conv(out.data() + first * dst_linesize, in.data() + first * src_linesize,
+                                                                        dst_linesize * rows, DEFAULT_R_SHIFT, DEFAULT_G_SHIFT, DEFAULT_B_SHIFT);
+                                                });
+                                                results.push_back({"ug", get_codec_name(inc), get_codec_name(outc), width, height, threads, isa,
+                                                                t * 1E9 / width / height, (src_linesize + dst_linesize) * height / t / 1E9});
+                                        }
+                                }
+                        }
+                }
+        }
+        params.erase("conv-isa");
+}
+
+#ifdef HAVE_LAVC
+/// AVFrame referencing rows [first, first + rows) of frame
+static AVFrame frame_rows(const AVFrame *frame, int first, int rows) {
+        AVFrame view = *frame;
+        const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(static_cast<enum AVPixelFormat>(frame->format));
+        for (int plane = 0; plane < AV_NUM_DATA_POINTERS && frame->data[plane] != nullptr; ++plane) {
+                int shift = plane == 1 || plane == 2 ? desc->log2_chroma_h : 0;
+                view.data[plane] += static_cast<ptrdiff_t>(first >> shift) * frame->linesize[plane];
+        }
+        view.height = rows;
+        return view;
+}
+
+static void bench_lavc(const bench_opts &opts, vector<bench_result> &results) {
+        for (auto size : opts.sizes) {
+                int width = size.first;
+                int height = size.second;
+                vector<unsigned char> ug_buf(static_cast<size_t>(width) * height * MAX_BPS + MAX_PADDING);
+                for (size_t i = 0; i < ug_buf.size(); ++i) {
+                        ug_buf[i] = i * 37U;
+                }
+                auto bench_one = [&](const char *kind, codec_t uv_codec, enum AVPixelFormat av_codec, auto convert) {
+                        if (codec_is_hw_accelerated(uv_codec)) {
+                                return;
+                        }
+                        AVFrame *frame = av_frame_alloc();
+                        frame->format = av_codec;
+                        frame->width = width;
+                        frame->height = height;
+                        if (av_frame_get_buffer(frame, 0) != 0) {
+                                av_frame_free(&frame);
+                                return;
+                        }
+                        for (int plane = 0; plane < AV_NUM_DATA_POINTERS && frame->buf[plane] != nullptr; ++plane) {
+                                memset(frame->buf[plane]->data, 0x40, frame->buf[plane]->size);
+                        }
+                        size_t uv_linesize = vc_get_linesize(width, uv_codec);
+                        size_t av_size = av_image_get_buffer_size(av_codec, width, height, 1);
+                        int row_align = 1 << av_pix_fmt_desc_get(av_codec)->log2_chroma_h;
+                        for (int threads : opts.threads) {
+                                double t = bench_run(height, threads, opts.reps, row_align, [&](int first, int rows) {
+                                        AVFrame view = frame_rows(frame, first, rows);
+                                        convert(&view, ug_buf.data() + first * uv_linesize, rows, uv_linesize);
+                                });
+                                bool to_lavc = string("to_lavc") == kind;
+                                results.push_back({kind, to_lavc ? get_codec_name(uv_codec) : av_get_pix_fmt_name(av_codec),
+                                                to_lavc ? av_get_pix_fmt_name(av_codec) : get_codec_name(uv_codec), width, height, threads, "native",
+                                                t * 1E9 / width / height, (uv_linesize * height + av_size) / t / 1E9});
+                        }
+                        av_frame_free(&frame);
+                };
+                for (const auto *c = get_uv_to_av_conversions(); c->src != VIDEO_CODEC_NONE; c++) {
+                        bench_one("to_lavc", c->src, c->dst, [&](AVFrame *view, unsigned char *uv, int rows, size_t) {
+                                c->func(view, uv, width, rows);
+                        });
+                }
+                for (const auto *c = get_av_to_uv_conversions(); c->uv_codec != VIDEO_CODEC_NONE; c++) {
+                        const int rgb_shift[] = DEFAULT_RGB_SHIFT_INIT;
+                        bench_one("from_lavc", c->uv_codec, static_cast<enum AVPixelFormat>(c->av_codec), [&](AVFrame *view, unsigned char *uv, int rows, size_t pitch) {
+                                c->convert(reinterpret_cast<char *>(uv), view, width, rows, pitch, rgb_shift);
+                        });
+                }
+        }
+}
+#endif // defined HAVE_LAVC
+
+static void print_results(const vector<bench_result> &results, const string &format) {
+        if (format == "csv") {
+                cout << "kind,src,dst,width,height,threads,isa,ns_per_px,gb_per_s\n";
+                for (const auto &r : results) {
+                        cout << r.kind << "," << r.src << "," << r.dst << "," << r.width << "," << r.height << ","
+                                << r.threads << "," << r.isa << "," << r.ns_per_px << "," << r.gb_per_s << "\n";
+                }
+        } else if (format == "json") {
+                cout << "[\n";
+                for (size_t i = 0; i < results.size(); ++i) {
+                        const auto &r = results[i];
+                        cout << "  {\"kind\": \"" << r.kind << "\", \"src\": \"" << r.src << "\", \"dst\": \"" << r.dst
+                                << "\", \"width\": " << r.width << ", \"height\": " << r.height << ", \"threads\": " << r.threads
+                                << ", \"isa\": \"" << r.isa << "\", \"ns_per_px\": " << r.ns_per_px << ", \"gb_per_s\": " << r.gb_per_s
+                                << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+                }
+                cout << "]\n";
+        } else {
+                for (const auto &r : results) {
+                        cout << std::left << std::setw(10) << r.kind << std::setw(24) << (r.src + "->" + r.dst)
+                                << std::right << std::setw(5) << r.width << "x" << std::left << std::setw(5) << r.height
+                                << std::right << std::setw(3) << r.threads << " thr " << std::left << std::setw(8) << r.isa
+                                << std::right << std::fixed << std::setprecision(3) << std::setw(9) << r.ns_per_px << " ns/px "
+                                << std::setw(8) << r.gb_per_s << " GB/s\n" << std::defaultfloat;
+                }
+        }
+}
+
+static vector<string> split(const string &str, char delim) {
+        vector<string> ret;
+        std::istringstream iss(str);
+        string item;
+        while (getline(iss, item, delim)) {
+                ret.push_back(item);
+        }
+        return ret;
+}
+
+/**
+ * @param argv options in format key=val, see usage
+ */
+static bool benchmark(int argc, char *argv[]) {
+        bench_opts opts;
+        for (int i = 0; i < argc; ++i) {
+                string opt = argv[i];
+                string key = opt.substr(0, opt.find('='));
+                string val = opt.find('=') == string::npos ? "" : opt.substr(opt.find('=') + 1);
+                if (key == "sizes") {
+                        opts.sizes.clear();
+                        for (const auto &size : split(val, ',')) {
+                                if (size == "1080p") {
+                                        opts.sizes.push_back({1920, 1080});
+                                } else if (size == "4k") {
+                                        opts.sizes.push_back({3840, 2160});
+                                } else if (size == "8k") {
+                                        opts.sizes.push_back({7680, 4320});
+                                } else if (size.find('x') != string::npos) {
+                                        opts.sizes.push_back({stoi(size), stoi(size.substr(size.find('x') + 1))});
+                                } else {
+                                        cerr << "Wrong size: " << size << "\n";
+                                        return false;
+                                }
+                        }
+                } else if (key == "threads") {
+                        opts.threads.clear();
+                        for (const auto &t : split(val, ',')) {
+                                opts.threads.push_back(std::max(stoi(t), 1));
+                        }
+                } else if (key == "isa") {
+                        opts.isas = split(val, ',');
+                } else if (key == "reps") {
+                        opts.reps = std::max(stoi(val), 1);
+                } else if (key == "format") {
+                        opts.format = val;
+                } else {
+                        cerr << "Unknown option: " << opt << "\n";
+                        return false;
+                }
+        }
+        std::sort(opts.threads.begin(), opts.threads.end());
+        opts.threads.erase(std::unique(opts.threads.begin(), opts.threads.end()), opts.threads.end());
+
+        vector<bench_result> results;
+        bench_ug(opts, results);
+#ifdef HAVE_LAVC
+        bench_lavc(opts, results);
+#endif
+        print_results(results, opts.format);
+        return true;
+}
+
+#define BATCH_ALIGN 4096 ///< output buffer alignment (written whole frames at once)
+
+struct batch_opts {
+        int width;
+        int height;
+        codec_t in_codec;
+        codec_t out_codec;
+        decoder_t decode;
+        string out_dir;
+        int threads = static_cast<int>(std::thread::hardware_concurrency());
+};
+
+/**
+ * @param input directory (all regular files, sorted by name) or a printf-like
+ *              sequence pattern (eg. frame%05d.yuv), that is expanded from 0
+ *              or 1 up to the first missing file
+ */
+static vector<string> batch_inputs(const string &input) {
+        vector<string> ret;
+        struct stat st{};
+        if (input.find('%') != string::npos) {
+                char path[1024];
+                for (int first = 0; first <= 1 && ret.empty(); ++first) {
+                        for (int i = first; ; ++i) {
+                                snprintf(path, sizeof path, input.c_str(), i);
+                                if (stat(path, &st) != 0) {
+                                        break;
+                                }
+                                ret.emplace_back(path);
+                        }
+                }
+                return ret;
+        }
+        if (stat(input.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+                DIR *dir = opendir(input.c_str());
+                struct dirent *ent = nullptr;
+                while (dir != nullptr && (ent = readdir(dir)) != nullptr) {
+                        string path = input + "/" + ent->d_name;
+                        if (stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+                                ret.push_back(path);
+                        }
+                }
+                if (dir != nullptr) {
+                        closedir(dir);
+                }
+                std::sort(ret.begin(), ret.end());
+                return ret;
+        }
+        ret.push_back(input);
+        return ret;
+}
+
+/**
+ * Converts all whole frames contained in the (memory-mapped) input file.
+ * @returns number of converted frames, -1 on error
+ */
+static long batch_convert_file(const batch_opts &opts, const string &in_path, unsigned char *out_buf) {
+        size_t in_frame_len = vc_get_datalen(opts.width, opts.height, opts.in_codec);
+        size_t out_frame_len = vc_get_datalen(opts.width, opts.height, opts.out_codec);
+        size_t src_linesize = vc_get_linesize(opts.width, opts.in_codec);
+        size_t dst_linesize = vc_get_linesize(opts.width, opts.out_codec);
+
+        int in_fd = open(in_path.c_str(), O_RDONLY);
+        struct stat st{};
+        if (in_fd == -1 || fstat(in_fd, &st) != 0 || static_cast<size_t>(st.st_size) < in_frame_len) {
+                cerr << in_path << ": " << (in_fd == -1 ? strerror(errno) : "shorter than one frame") << "\n";
+                if (in_fd != -1) {
+                        close(in_fd);
+                }
+                return -1;
+        }
+        void *in_map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, in_fd, 0);
+        close(in_fd);
+        if (in_map == MAP_FAILED) {
+                cerr << in_path << ": mmap: " << strerror(errno) << "\n";
+                return -1;
+        }
+        madvise(in_map, st.st_size, MADV_SEQUENTIAL);
+
+        string out_path = opts.out_dir + "/" + in_path.substr(in_path.find_last_of('/') + 1);
+        int out_fd = open(out_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (out_fd == -1) {
+                cerr << out_path << ": " << strerror(errno) << "\n";
+                munmap(in_map, st.st_size);
+                return -1;
+        }
+        long frames = st.st_size / in_frame_len;
+        for (long f = 0; f < frames; ++f) {
+                const auto *in = static_cast<const unsigned char *>(in_map) + f * in_frame_len;
+                for (int y = 0; y < opts.height; ++y) {
+                        opts.decode(out_buf + y * dst_linesize, in + y * src_linesize, dst_linesize,
+                                        DEFAULT_R_SHIFT, DEFAULT_G_SHIFT, DEFAULT_B_SHIFT);
+                }
+                for (size_t written = 0; written < out_frame_len; ) {
+                        ssize_t ret = write(out_fd, out_buf + written, out_frame_len - written);
+                        if (ret <= 0) {
+                                cerr << out_path << ": write: " << strerror(errno) << "\n";
+                                frames = -1;
+                                break;
                         }
-                        auto t0 = high_resolution_clock::now();
-                        conv(out.data(), in.data(), vc_get_linesize(width, outc) * height, DEFAULT_R_SHIFT, DEFAULT_G_SHIFT, DEFAULT_B_SHIFT);
-                        auto t1 = high_resolution_clock::now();
-                        cout << get_codec_name(inc) << "->" << get_codec_name(outc) << ": " << duration_cast<microseconds>(t1 - t0).count() / 1000.0 << " ms\n";
+                        written += ret;
+                }
+                if (frames == -1) {
+                        break;
                 }
         }
+        close(out_fd);
+        munmap(in_map, st.st_size);
+        return frames;
+}
+
+/**
+ * Converts files (each containing one or more frames) in parallel, one file
+ * per thread at a time.
+ * @param argv <width> <height> <in_codec> <out_codec> <input> <out_dir> [threads=<n>]
+ */
+static bool batch(int argc, char *argv[]) {
+        if (argc < 6) {
+                cerr << "Wrong number of batch arguments!\n";
+                return false;
+        }
+        batch_opts opts;
+        opts.width = stoi(argv[0]);
+        opts.height = stoi(argv[1]);
+        opts.in_codec = get_codec_from_name(argv[2]);
+        opts.out_codec = get_codec_from_name(argv[3]);
+        opts.out_dir = argv[5];
+        if (argc > 6 && strncmp(argv[6], "threads=", strlen("threads=")) == 0) {
+                opts.threads = std::max(stoi(argv[6] + strlen("threads=")), 1);
+        }
+        opts.decode = get_decoder_from_to(opts.in_codec, opts.out_codec);
+        if (opts.decode == nullptr) {
+                cerr << "Cannot find decoder from " << argv[2] << " to " << argv[3] << "!\n";
+                return false;
+        }
+        vector<string> inputs = batch_inputs(argv[4]);
+        if (inputs.empty()) {
+                cerr << "No input files found for " << argv[4] << "!\n";
+                return false;
+        }
+
+        std::atomic<size_t> next{0};
+        std::atomic<long> frames{0};
+        std::atomic<bool> failed{false};
+        size_t out_buf_len = (vc_get_datalen(opts.width, opts.height, opts.out_codec) + MAX_PADDING + BATCH_ALIGN - 1)
+                / BATCH_ALIGN * BATCH_ALIGN;
+        auto t0 = high_resolution_clock::now();
+        vector<std::thread> workers;
+        for (int t = 0; t < std::min<int>(opts.threads, inputs.size()); ++t) {
+                workers.emplace_back([&]() {
+                        void *out_buf = nullptr;
+                        if (posix_memalign(&out_buf, BATCH_ALIGN, out_buf_len) != 0) {
+                                failed = true;
+                                return;
+                        }
+                        size_t i = 0;
+                        while ((i = next++) < inputs.size()) {
+                                long ret = batch_convert_file(opts, inputs[i], static_cast<unsigned char *>(out_buf));
+                                if (ret < 0) {
+                                        failed = true;
+                                } else {
+                                        frames += ret;
+                                }
+                        }
+                        free(out_buf);
+                });
+        }
+        for (auto &w : workers) {
+                w.join();
+        }
+        std::chrono::duration<double> t = high_resolution_clock::now() - t0;
+        size_t bytes = frames * (vc_get_datalen(opts.width, opts.height, opts.in_codec)
+                        + vc_get_datalen(opts.width, opts.height, opts.out_codec));
+        cout << "Converted " << frames << " frames from " << inputs.size() << " files in " << t.count() << " s ("
+                << frames / t.count() << " fps, " << bytes / t.count() / 1E9 << " GB/s read+write)\n";
+        return !failed;
 }
 
 static void print_conversions() {
@@ -62,17 +490,28 @@ int main(int argc, char *argv[]) {
                 print_conversions();
                 return 0;
         }
-        if (argc == 2 && string("benchmark") == argv[1]) {
-                benchmark();
-                return 0;
+        if (argc >= 2 && (string("benchmark") == argv[1] || string("--bench") == argv[1])) {
+                return benchmark(argc - 2, argv + 2) ? 0 : 1;
+        }
+        if (argc >= 2 && string("batch") == argv[1]) {
+                return batch(argc - 2, argv + 2) ? 0 : 1;
         }
         if (argc < 7) {
                 cout << "Usage:\n"
-                                "\t" << argv[0] << " <width> <height> <in_codec> <out_codec> <in_file> <out_file> | benchmark | list-conversions\n"
+                                "\t" << argv[0] << " <width> <height> <in_codec> <out_codec> <in_file> <out_file> | benchmark [opts] | list-conversions\n"
+                                "\t" << argv[0] << " batch <width> <height> <in_codec> <out_codec> <input> <out_dir> [threads=<n>]\n"
                                 "\n"
                                 "where\n"
                                 "\t" << "list-conversions - prints valid conversion pairs\n"
-                                "\t" << "benchmark - benchmark conversions\n";
+                                "\t" << "batch - converts files of <input> (directory or printf-like sequence pattern, eg. frame%05d.yuv)\n"
+                                "\t\t" << "in parallel (default thread count is CPU count), each file may contain multiple frames,\n"
+                                "\t\t" << "output files are named as the input ones\n"
+                                "\t" << "benchmark (or --bench) - benchmark conversions, opts (key=val):\n"
+                                "\t\t" << "sizes=1080p,4k,8k,<W>x<H> - frame sizes (default 1080p,4k,8k)\n"
+                                "\t\t" << "threads=<n>[,<m>...] - thread counts (default 1 and CPU count)\n"
+                                "\t\t" << "isa=native,generic - line decoders optimized for running CPU and/or generic ones\n"
+                                "\t\t" << "reps=<n> - repetitions, best is reported (default 3)\n"
+                                "\t\t" << "format=text|csv|json - output format\n";
                 return 1;
         }
         int width = stoi(argv[1]);
@@ -0,0 +1,447 @@
+/**
+ * @file   tools/fec_benchmark.cpp
+ * @brief  FEC encode/decode throughput and recovery under simulated loss
+ *
+ * Encodes frames of given size with the UltraGrid FEC implementations (RS,
+ * LDGM - CPU or GPU with --param ldgm-device=GPU), packetizes them the same
+ * way as the transmitter does, drops packets according to a loss model and
+ * decodes the rest. Reports encode/decode throughput and the ratio of
+ * recovered frames for every FEC/loss combination.
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ * 
+ *      This product includes software developed by CESNET z.s.p.o.
+ * 
+ * 4. Neither the name of the CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "debug.h"
+#include "host.h"
+#include "rtp/fec.h"
+#include "rtp/rtp_types.h"
+#include "tv.h"
+#include "types.h"
+#include "video_frame.h"
+
+using std::cerr;
+using std::cout;
+using std::map;
+using std::shared_ptr;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+#define DEFAULT_MTU 1500
+#define IP_UDP_RTP_HDRS_LEN (20 + 8 + 12)
+
+/// placeholder for UG exit handler needed by linked modules
+void exit_uv(int status) {
+        (void) status;
+}
+
+namespace {
+/**
+ * Gilbert-Elliott packet loss model. Random (Bernoulli) and burst loss are
+ * special cases of it, see parse_loss().
+ */
+struct loss_model {
+        string name;
+        double p_gb = 0.0;      ///< probability of transition good->bad
+        double p_bg = 1.0;      ///< probability of transition bad->good
+        double loss_good = 0.0; ///< loss probability in good state
+        double loss_bad = 0.0;  ///< loss probability in bad state
+
+        bool bad = false;
+        bool lost(std::mt19937 &gen) {
+                std::uniform_real_distribution<double> dist(0.0, 1.0);
+                bool ret = dist(gen) < (bad ? loss_bad : loss_good);
+                bad = bad ? dist(gen) >= p_bg : dist(gen) < p_gb;
+                return ret;
+        }
+};
+
+struct bench_opts {
+        vector<string> fecs{"rs:200:240", "ldgm:256:64"};
+        vector<loss_model> losses;
+        long frame_size = 1000000;
+        int mtu = DEFAULT_MTU;
+        int frames = 100;
+        unsigned seed = 1;
+        string format = "text";
+};
+
+struct bench_result {
+        string fec;
+        string loss;
+        long frame_size;
+        double overhead_pct; ///< redundancy relative to source data
+        int packets;         ///< per frame
+        double pkt_loss_pct; ///< actual simulated loss
+        double enc_gb_per_s; ///< source bytes / encode time
+        double dec_gb_per_s; ///< source bytes / decode time
+        double recovered_pct;
+        int corrupted;       ///< frames reported as recovered but with wrong content
+};
+
+vector<string> split(const string &str, char delim) {
+        vector<string> ret;
+        std::istringstream iss(str);
+        string item;
+        while (getline(iss, item, delim)) {
+                ret.push_back(item);
+        }
+        return ret;
+}
+
+/**
+ * Parses none | random:<%> | burst:<%>:<avg_len> | ge:<p_gb%>:<p_bg%>[:<loss_good%>:<loss_bad%>]
+ */
+bool parse_loss(const string &cfg, loss_model &model) {
+        auto items = split(cfg, ':');
+        vector<double> vals;
+        for (size_t i = 1; i < items.size(); ++i) {
+                vals.push_back(std::stod(items[i]));
+        }
+        model.name = cfg;
+        if (items.empty() || items[0] == "none") {
+                return true;
+        }
+        if (items[0] == "random" && vals.size() == 1) {
+                model.loss_good = vals[0] / 100.0;
+                return true;
+        }
+        if (items[0] == "burst" && vals.size() == 2 && vals[0] < 100.0 && vals[1] >= 1.0) {
+                // all packets in bad state lost, mean burst length avg_len, P(bad) = loss
+                double loss = vals[0] / 100.0;
+                model.p_bg = 1.0 / vals[1];
+                model.p_gb = loss * model.p_bg / (1.0 - loss);
+                model.loss_bad = 1.0;
+                return true;
+        }
+        if (items[0] == "ge" && (vals.size() == 2 || vals.size() == 4)) {
+                model.p_gb = vals[0] / 100.0;
+                model.p_bg = vals[1] / 100.0;
+                model.loss_good = vals.size() == 4 ? vals[2] / 100.0 : 0.0;
+                model.loss_bad = vals.size() == 4 ? vals[3] / 100.0 : 1.0;
+                return true;
+        }
+        cerr << "Wrong loss model: " << cfg << "\n";
+        return false;
+}
+
+/// creates FEC encoder from -f style config (rs[:<k>:<n>], ldgm[:<k>:<m>[:<c>]] or ldgm:<loss>%)
+fec *create_encoder(const string &cfg, const bench_opts &opts) {
+        string name = cfg.substr(0, cfg.find(':'));
+        string params = cfg.find(':') == string::npos ? "" : cfg.substr(cfg.find(':') + 1);
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        string fec_cfg;
+        if (name == "rs") {
+                fec_cfg = "RS cfg " + params;
+        } else if (name == "ldgm" && params.find('%') != string::npos) {
+                int data_len = opts.mtu - (IP_UDP_RTP_HDRS_LEN + sizeof(fec_payload_hdr_t));
+                data_len = (data_len / 48) * 48; // as the transmitter does
+                fec_cfg = "LDGM percents " + std::to_string(data_len) + " " +
+                        std::to_string(opts.frame_size) + " " + std::to_string(std::stod(params));
+        } else if (name == "ldgm") {
+                fec_cfg = "LDGM cfg " + params;
+        } else {
+                cerr << "Unknown FEC: " << cfg << "\n";
+                return nullptr;
+        }
+        fec *ret = fec::create_from_config(fec_cfg.c_str());
+        if (ret == nullptr) {
+                cerr << "Cannot create FEC " << cfg << " for frame size " << opts.frame_size << "\n";
+        }
+        return ret;
+}
+
+/// packet lengths of an encoded tile, mirrors get_packet_sizes() in transmit.cpp
+vector<int> get_packet_sizes(const struct video_frame *frame, int payload_len) {
+        const int ss = frame->fec_params.symbol_size;
+        vector<int> ret;
+        int symbol_offset = 0;
+        unsigned pos = 0;
+        while (pos < frame->tiles[0].data_len) {
+                int len = 0;
+                if (ss > payload_len) {
+                        if (ss - symbol_offset <= payload_len) {
+                                len = ss - symbol_offset;
+                                symbol_offset = 0;
+                        } else {
+                                len = payload_len;
+                                symbol_offset += payload_len;
+                        }
+                } else {
+                        len = payload_len / ss * ss;
+                }
+                len = std::min<int>(len, frame->tiles[0].data_len - pos);
+                ret.push_back(len);
+                pos += len;
+        }
+        return ret;
+}
+
+bool run_bench(const string &fec_cfg, loss_model model, const bench_opts &opts, bench_result &res) {
+        unique_ptr<fec> encoder(create_encoder(fec_cfg, opts));
+        if (!encoder) {
+                return false;
+        }
+        struct video_desc desc{1920, 1080, UYVY, 30.0, PROGRESSIVE, 1};
+        vector<char> src(opts.frame_size);
+        shared_ptr<video_frame> frame(vf_alloc_desc(desc), vf_free);
+        frame->tiles[0].data = src.data();
+        frame->tiles[0].data_len = src.size();
+
+        std::mt19937 gen(opts.seed);
+        std::uniform_int_distribution<int> byte_dist(0, 255);
+        for (auto &c : src) {
+                c = (char) byte_dist(gen);
+        }
+
+        const int payload_len = opts.mtu - (IP_UDP_RTP_HDRS_LEN + sizeof(fec_payload_hdr_t));
+        unique_ptr<fec> decoder;
+        struct fec_desc dec_desc{};
+        time_ns_t enc_time = 0, dec_time = 0;
+        long pkts_total = 0, pkts_lost = 0;
+        int recovered = 0, corrupted = 0;
+        long encoded_len = 0;
+        int packets = 0;
+        vector<char> recv_buf;
+
+        for (int i = 0; i < opts.frames; ++i) {
+                frame->seq = i;
+                time_ns_t t0 = get_time_in_ns();
+                shared_ptr<video_frame> enc = encoder->encode(frame);
+                enc_time += get_time_in_ns() - t0;
+                if (!enc) {
+                        cerr << "Encoding with " << fec_cfg << " failed!\n";
+                        return false;
+                }
+                if (!decoder || memcmp(&dec_desc, &enc->fec_params, sizeof dec_desc) != 0) {
+                        dec_desc = enc->fec_params;
+                        decoder.reset(fec::create_from_desc(dec_desc));
+                        if (!decoder) {
+                                return false;
+                        }
+                }
+
+                // simulate transmission
+                encoded_len = enc->tiles[0].data_len;
+                recv_buf.assign(encoded_len, 0);
+                map<int, int> pckt_list;
+                vector<int> sizes = get_packet_sizes(enc.get(), payload_len);
+                packets = sizes.size();
+                int pos = 0;
+                for (int len : sizes) {
+                        pkts_total += 1;
+                        if (model.lost(gen)) {
+                                pkts_lost += 1;
+                        } else {
+                                memcpy(recv_buf.data() + pos, enc->tiles[0].data + pos, len);
+                                pckt_list[pos] = len;
+                        }
+                        pos += len;
+                }
+
+                char *out = nullptr;
+                int out_len = 0;
+                t0 = get_time_in_ns();
+                bool ok = decoder->decode(recv_buf.data(), encoded_len, &out, &out_len, pckt_list);
+                dec_time += get_time_in_ns() - t0;
+                if (!ok) {
+                        continue;
+                }
+                // decoded data are prefixed by the video header
+                if (out_len == (int) (sizeof(video_payload_hdr_t) + src.size())
+                                && memcmp(out + sizeof(video_payload_hdr_t), src.data(), src.size()) == 0) {
+                        recovered += 1;
+                } else {
+                        corrupted += 1;
+                }
+        }
+
+        double bytes = (double) opts.frame_size * opts.frames;
+        res = { fec_cfg, model.name, opts.frame_size,
+                100.0 * (encoded_len - opts.frame_size) / opts.frame_size, packets,
+                100.0 * pkts_lost / pkts_total,
+                enc_time > 0 ? bytes / enc_time : 0.0,
+                dec_time > 0 ? bytes / dec_time : 0.0,
+                100.0 * recovered / opts.frames, corrupted };
+        return true;
+}
+
+void print_results(const vector<bench_result> &results, const string &format) {
+        if (format == "csv") {
+                cout << "fec,loss,frame_size,overhead_pct,packets,pkt_loss_pct,enc_gb_per_s,dec_gb_per_s,recovered_pct,corrupted\n";
+                for (const auto &r : results) {
+                        cout << r.fec << "," << r.loss << "," << r.frame_size << "," << r.overhead_pct << ","
+                                << r.packets << "," << r.pkt_loss_pct << "," << r.enc_gb_per_s << ","
+                                << r.dec_gb_per_s << "," << r.recovered_pct << "," << r.corrupted << "\n";
+                }
+        } else if (format == "json") {
+                cout << "[\n";
+                for (size_t i = 0; i < results.size(); ++i) {
+                        const auto &r = results[i];
+                        cout << "  {\"fec\": \"" << r.fec << "\", \"loss\": \"" << r.loss << "\", \"frame_size\": " << r.frame_size
+                                << ", \"overhead_pct\": " << r.overhead_pct << ", \"packets\": " << r.packets
+                                << ", \"pkt_loss_pct\": " << r.pkt_loss_pct << ", \"enc_gb_per_s\": " << r.enc_gb_per_s
+                                << ", \"dec_gb_per_s\": " << r.dec_gb_per_s << ", \"recovered_pct\": " << r.recovered_pct
+                                << ", \"corrupted\": " << r.corrupted << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+                }
+                cout << "]\n";
+        } else {
+                for (const auto &r : results) {
+                        cout << std::left << std::setw(16) << r.fec << std::setw(20) << r.loss << std::right
+                                << std::fixed << std::setprecision(1) << std::setw(6) << r.overhead_pct << " % overhead "
+                                << std::setw(6) << r.packets << " pkts " << std::setw(6) << r.pkt_loss_pct << " % lost "
+                                << std::setprecision(3) << std::setw(8) << r.enc_gb_per_s << " GB/s enc "
+                                << std::setw(8) << r.dec_gb_per_s << " GB/s dec " << std::setprecision(1)
+                                << std::setw(6) << r.recovered_pct << " % recovered";
+                        if (r.corrupted > 0) {
+                                cout << " (" << r.corrupted << " CORRUPTED)";
+                        }
+                        cout << "\n" << std::defaultfloat;
+                }
+        }
+}
+
+void usage(const char *progname) {
+        cout << "Usage:\n"
+                "\t" << progname << " [--param ldgm-device=GPU] [opts]\n"
+                "\n"
+                "where opts (key=val) are:\n"
+                "\t\t" << "fec=<fec>[,<fec>...] - FEC to test as for -f, eg. rs:200:240, ldgm:256:64, ldgm:10% (default rs:200:240,ldgm:256:64)\n"
+                "\t\t" << "loss=<model>[,<model>...] - loss models (default none,random:1,burst:1:5):\n"
+                "\t\t\t" << "none | random:<%> | burst:<%>:<avg_burst_len> | ge:<p_gb%>:<p_bg%>[:<loss_good%>:<loss_bad%>]\n"
+                "\t\t" << "size=<bytes>[k|M] - frame size (default 1M)\n"
+                "\t\t" << "mtu=<bytes> - MTU (default " << DEFAULT_MTU << ")\n"
+                "\t\t" << "frames=<n> - number of frames per run (default 100)\n"
+                "\t\t" << "seed=<n> - random seed\n"
+                "\t\t" << "format=text|csv|json - output format\n";
+}
+} // end of anonymous namespace
+
+int main(int argc, char *argv[]) {
+        struct init_data *init = common_preinit(argc, argv);
+        if (init == nullptr) {
+                return 1;
+        }
+        bench_opts opts;
+        vector<string> loss_cfgs{"none", "random:1", "burst:1:5"};
+        for (int i = 1; i < argc; ++i) {
+                string opt = argv[i];
+                if (opt == "--param") { // already handled by common_preinit()
+                        i += 1;
+                        continue;
+                }
+                string key = opt.substr(0, opt.find('='));
+                string val = opt.find('=') == string::npos ? "" : opt.substr(opt.find('=') + 1);
+                if (key == "fec") {
+                        opts.fecs = split(val, ',');
+                } else if (key == "loss") {
+                        loss_cfgs = split(val, ',');
+                } else if (key == "size") {
+                        size_t idx = 0;
+                        opts.frame_size = std::stol(val, &idx);
+                        if (val.substr(idx) == "k") {
+                                opts.frame_size *= 1000;
+                        } else if (val.substr(idx) == "M") {
+                                opts.frame_size *= 1000 * 1000;
+                        }
+                } else if (key == "mtu") {
+                        opts.mtu = std::stoi(val);
+                } else if (key == "frames") {
+                        opts.frames = std::max(std::stoi(val), 1);
+                } else if (key == "seed") {
+                        opts.seed = std::stoul(val);
+                } else if (key == "format") {
+                        opts.format = val;
+                } else {
+                        usage(argv[0]);
+                        common_cleanup(init);
+                        return opt == "help" || opt == "-h" ? 0 : 1;
+                }
+        }
+        for (const auto &cfg : loss_cfgs) {
+                loss_model model;
+                if (!parse_loss(cfg, model)) {
+                        common_cleanup(init);
+                        return 1;
+                }
+                opts.losses.push_back(model);
+        }
+
+        // keep stdout for the results only, diagnostics of FEC modules go to stderr
+        fflush(stdout);
+        cout.flush();
+        int stdout_fd = dup(STDOUT_FILENO);
+        dup2(STDERR_FILENO, STDOUT_FILENO);
+
+        vector<bench_result> results;
+        for (const auto &fec_cfg : opts.fecs) {
+                for (const auto &model : opts.losses) {
+                        bench_result res;
+                        if (run_bench(fec_cfg, model, opts, res)) {
+                                results.push_back(res);
+                        }
+                }
+        }
+        fflush(stdout);
+        cout.flush();
+        dup2(stdout_fd, STDOUT_FILENO);
+        close(stdout_fd);
+        print_results(results, opts.format);
+
+        common_cleanup(init);
+        return results.empty() ? 1 : 0;
+}
+
+/* vim: set expandtab sw=8: */
@@ -54,22 +54,26 @@ Ipc_frame *ipc_frame_new(){
 
         frame->data = nullptr;
         frame->alloc_size = 0;
+        frame->alloc_data = nullptr;
 
         return frame;
 }
 
 void ipc_frame_free(Ipc_frame *frame){
-        free(frame->data);
+        free(frame->alloc_data);
         free(frame);
 }
 
 bool ipc_frame_reserve(Ipc_frame *frame, size_t size){
-        if(size <= frame->alloc_size)
+        if(size <= frame->alloc_size){
+                frame->data = frame->alloc_data;
                 return true;
+        }
 
-        auto newbuf = static_cast<char *>(realloc(frame->data, size));
+        auto newbuf = static_cast<char *>(realloc(frame->alloc_data, size));
         if(!newbuf)
                 return false;
+        frame->alloc_data = newbuf;
         frame->data = newbuf;
         frame->alloc_size = size;
 
@@ -22,9 +22,10 @@ struct Ipc_frame_header{
 
 struct Ipc_frame{
         Ipc_frame_header header;
-        char *data;
+        char *data; ///< may point to shared memory of Ipc_frame_reader, then valid until next read
 
         size_t alloc_size;
+        char *alloc_data; ///< owned buffer of alloc_size bytes
 };
 
 bool ipc_frame_parse_header(struct Ipc_frame_header *hdr, const char *buf);
@@ -41,12 +41,13 @@ bool ipc_frame_from_ug_frame(struct Ipc_frame *dst,
                 return false;
 
         decoder_t dec = nullptr;
-        if(codec != VIDEO_CODEC_NONE){
+        if(codec != VIDEO_CODEC_NONE && codec != src->color_spec){
                 dec = get_decoder_from_to(src->color_spec, codec);
                 if(!dec){
                         return false;
                 }
         } else {
+                // also for RGB[A] - the shifts passed below are the identity
                 codec = src->color_spec;
                 dec = vc_memcpy;
         }
@@ -123,3 +124,10 @@ int ipc_frame_get_scale_factor(int src_w, int src_h, int target_w, int target_h)
 
         return std::round(scale);
 }
+
+codec_t ipc_frame_get_preview_codec(codec_t src_codec){
+        if(codec_is_a_rgb(src_codec) || !get_decoder_from_to(src_codec, UYVY))
+                return RGB;
+
+        return UYVY;
+}
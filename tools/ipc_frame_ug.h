@@ -25,4 +25,12 @@ bool ipc_frame_write_to_fd(const struct Ipc_frame *f, int fd);
 
 int ipc_frame_get_scale_factor(int src_w, int src_h, int target_w, int target_h);
 
+/**
+ * @brief Returns codec to pass frames of src_codec to a preview in
+ *
+ * The GUI preview converts YUV to RGB on the GPU, so YUV frames are passed
+ * as UYVY (no conversion for UYVY input and 2/3 of RGB size), RGB as RGB.
+ */
+codec_t ipc_frame_get_preview_codec(codec_t src_codec);
+
 #endif //IPC_FRAME_UG_32ee5c748f3e
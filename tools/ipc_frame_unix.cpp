@@ -23,19 +23,78 @@ typedef int fd_t;
 typedef SOCKET fd_t;
 #endif
 
+#ifdef __linux__
+#include <sys/mman.h>
+#define IPC_FRAME_SHM ///< frame data passed in memfd shared memory if reader supports it
+#endif
+
 #include <cerrno>
+#include <cstdint>
 #include "ipc_frame_unix.h"
 
 #ifndef MSG_NOSIGNAL
 #define MSG_NOSIGNAL 0
 #endif
 
+#ifdef IPC_FRAME_SHM
+/*
+ * Shared memory transport: the reader announces support by sending
+ * SHM_HELLO after accepting the connection. The writer then puts the frames
+ * to a ring of SHM_SLOTS slots in a memfd (passed with SCM_RIGHTS along with
+ * the first header using it) and sends only the headers with a shm_desc. The
+ * reader keeps the slot of the last read frame and releases it by sending
+ * SHM_RELEASE message on next read.
+ */
+namespace{
+constexpr int SHM_SLOTS = 3;
+constexpr unsigned char SHM_HELLO = 'S';
+constexpr unsigned char SHM_RELEASE = 0x80; ///< | ring generation (5 bits) << 2 | slot
+constexpr int SHM_DESC_OFFSET = 64; ///< offset of shm_desc in the (reserved part of) header
+constexpr uint32_t SHM_MAGIC = 0x4D534755; // "UGSM"
+
+struct shm_desc{
+        uint32_t magic;
+        uint32_t slot;
+        uint32_t slot_size;
+        uint32_t generation;
+};
+
+unsigned char shm_release_msg(uint32_t generation, uint32_t slot){
+        return SHM_RELEASE | (generation & 0x1FU) << 2U | slot;
+}
+} //anon namespace
+#endif
+
 struct Ipc_frame_reader{
         fd_t listen_fd;
         fd_t data_fd;
         std::string path;
+#ifdef IPC_FRAME_SHM
+        char *shm_map = nullptr;
+        size_t shm_slot_size = 0;
+        uint32_t shm_generation = 0;
+        int held_slot = -1; ///< slot of last read frame, -1 if none
+#endif
 };
 
+#ifdef IPC_FRAME_SHM
+static void reader_unmap(struct Ipc_frame_reader *reader){
+        if(reader->shm_map)
+                munmap(reader->shm_map, reader->shm_slot_size * SHM_SLOTS);
+        reader->shm_map = nullptr;
+        reader->held_slot = -1;
+}
+
+static void reader_release_slot(struct Ipc_frame_reader *reader){
+        if(reader->held_slot == -1)
+                return;
+
+        unsigned char msg = shm_release_msg(reader->shm_generation, reader->held_slot);
+        send(reader->data_fd, (const char *) &msg, 1, MSG_NOSIGNAL);
+        reader->held_slot = -1;
+}
+#endif
+
 Ipc_frame_reader *ipc_frame_reader_new(const char *path){
         auto reader = new Ipc_frame_reader();
         reader->path = path;
@@ -73,6 +132,9 @@ Ipc_frame_reader *ipc_frame_reader_new(const char *path){
 }
 
 void ipc_frame_reader_free(struct Ipc_frame_reader *reader){
+#ifdef IPC_FRAME_SHM
+        reader_unmap(reader);
+#endif
         if(reader->data_fd != INVALID_SOCKET)
                 CLOSESOCKET(reader->data_fd);
         if(reader->listen_fd != INVALID_SOCKET)
@@ -119,6 +181,13 @@ static bool try_accept(struct Ipc_frame_reader *reader){
                 return false;
 
         reader->data_fd = accept(reader->listen_fd, nullptr, 0);
+#ifdef IPC_FRAME_SHM
+        reader_unmap(reader);
+        if(reader->data_fd != INVALID_SOCKET){
+                unsigned char hello = SHM_HELLO;
+                send(reader->data_fd, (const char *) &hello, 1, MSG_NOSIGNAL);
+        }
+#endif
         return true;
 }
 
@@ -133,15 +202,101 @@ bool ipc_frame_reader_is_connected(struct Ipc_frame_reader *reader){
         return reader->data_fd != INVALID_SOCKET || try_accept(reader);
 }
 
+#ifdef IPC_FRAME_SHM
+/**
+ * Reads the header, a file descriptor passed along is stored to passed_fd.
+ */
+static size_t blocking_read_header(fd_t fd, char *dst, size_t size, int *passed_fd){
+        size_t bytes_read = 0;
+
+        while(bytes_read < size){
+                char cbuf[CMSG_SPACE(sizeof(int))];
+                struct iovec iov = { dst + bytes_read, size - bytes_read };
+                struct msghdr msg{};
+                msg.msg_iov = &iov;
+                msg.msg_iovlen = 1;
+                msg.msg_control = cbuf;
+                msg.msg_controllen = sizeof cbuf;
+
+                ssize_t read_now = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+                if(read_now <= 0)
+                        break;
+
+                for(struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)){
+                        if(c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS){
+                                if(*passed_fd != -1)
+                                        close(*passed_fd);
+                                memcpy(passed_fd, CMSG_DATA(c), sizeof(int));
+                        }
+                }
+                bytes_read += read_now;
+        }
+
+        return bytes_read;
+}
+
+/**
+ * @retval true  frame was in shared memory, dst->data points to it
+ * @retval false frame data follows on the socket
+ */
+static bool read_shm_frame(Ipc_frame_reader *reader, Ipc_frame *dst, const char *header_buf, int passed_fd, bool *err){
+        shm_desc desc;
+        memcpy(&desc, header_buf + SHM_DESC_OFFSET, sizeof desc);
+
+        if(passed_fd != -1){
+                // new ring - the previously held slot belongs to the old one, so it isn't released
+                reader_unmap(reader);
+                void *map = mmap(nullptr, (size_t) desc.slot_size * SHM_SLOTS, PROT_READ, MAP_SHARED, passed_fd, 0);
+                close(passed_fd);
+                if(map == MAP_FAILED){
+                        *err = true;
+                        return true;
+                }
+                reader->shm_map = static_cast<char *>(map);
+                reader->shm_slot_size = desc.slot_size;
+                reader->shm_generation = desc.generation;
+        } else {
+                reader_release_slot(reader);
+        }
+
+        if(desc.magic != SHM_MAGIC)
+                return false;
+
+        if(!reader->shm_map || desc.slot >= SHM_SLOTS || desc.generation != reader->shm_generation
+                        || (size_t) dst->header.data_len > reader->shm_slot_size){
+                *err = true;
+                return true;
+        }
+        dst->data = reader->shm_map + desc.slot * reader->shm_slot_size;
+        reader->held_slot = desc.slot;
+        return true;
+}
+#endif
+
 static bool do_frame_read(Ipc_frame_reader *reader, Ipc_frame *dst){
         char header_buf[IPC_FRAME_HEADER_LEN];
 
+#ifdef IPC_FRAME_SHM
+        int passed_fd = -1;
+        if(blocking_read_header(reader->data_fd, header_buf, IPC_FRAME_HEADER_LEN, &passed_fd) != IPC_FRAME_HEADER_LEN){
+                if(passed_fd != -1)
+                        close(passed_fd);
+                return false;
+        }
+#else
         if(blocking_read(reader->data_fd, header_buf, IPC_FRAME_HEADER_LEN) != IPC_FRAME_HEADER_LEN)
                 return false;
+#endif
 
         if(!ipc_frame_parse_header(&dst->header, header_buf))
                 return false;
 
+#ifdef IPC_FRAME_SHM
+        bool err = false;
+        if(read_shm_frame(reader, dst, header_buf, passed_fd, &err))
+                return !err;
+#endif
+
         if(!ipc_frame_reserve(dst, dst->header.data_len))
                 return false;
 
@@ -153,6 +308,9 @@ static bool do_frame_read(Ipc_frame_reader *reader, Ipc_frame *dst){
 bool ipc_frame_reader_read(Ipc_frame_reader *reader, Ipc_frame *dst){
         bool ret = do_frame_read(reader, dst);
         if(!ret){
+#ifdef IPC_FRAME_SHM
+                reader_unmap(reader);
+#endif
                 CLOSESOCKET(reader->data_fd);
                 reader->data_fd = INVALID_SOCKET;
         }
@@ -162,6 +320,16 @@ bool ipc_frame_reader_read(Ipc_frame_reader *reader, Ipc_frame *dst){
 
 struct Ipc_frame_writer{
         fd_t data_fd;
+#ifdef IPC_FRAME_SHM
+        bool shm_supported = false; ///< reader announced shared memory support
+        int shm_fd = -1;
+        char *shm_map = nullptr;
+        size_t shm_slot_size = 0;
+        uint32_t shm_generation = 0;
+        bool shm_fd_sent = false;
+        bool slot_busy[SHM_SLOTS] = {};
+        int next_slot = 0;
+#endif
 };
 
 Ipc_frame_writer *ipc_frame_writer_new(const char *path){
@@ -191,6 +359,12 @@ Ipc_frame_writer *ipc_frame_writer_new(const char *path){
 }
 
 void ipc_frame_writer_free(struct Ipc_frame_writer *writer){
+#ifdef IPC_FRAME_SHM
+        if(writer->shm_map)
+                munmap(writer->shm_map, writer->shm_slot_size * SHM_SLOTS);
+        if(writer->shm_fd != -1)
+                close(writer->shm_fd);
+#endif
         if(writer->data_fd != INVALID_SOCKET)
                 CLOSESOCKET(writer->data_fd);
 
@@ -213,11 +387,134 @@ void block_write(fd_t fd, void *buf, size_t size){
 
 } //anon namespace
 
+#ifdef IPC_FRAME_SHM
+/**
+ * Processes messages from the reader.
+ * @param wait block until at least one message arrives
+ * @retval false connection error
+ */
+static bool writer_process_msgs(struct Ipc_frame_writer *writer, bool wait){
+        while(true){
+                unsigned char msgs[16];
+                ssize_t ret = recv(writer->data_fd, (char *) msgs, sizeof msgs, wait ? 0 : MSG_DONTWAIT);
+                if(ret == 0)
+                        return false;
+                if(ret < 0)
+                        return !wait && (errno == EAGAIN || errno == EWOULDBLOCK);
+
+                for(ssize_t i = 0; i < ret; i++){
+                        if(msgs[i] == SHM_HELLO){
+                                writer->shm_supported = true;
+                        } else if(msgs[i] & SHM_RELEASE){
+                                unsigned slot = msgs[i] & 0x3U;
+                                if(msgs[i] == shm_release_msg(writer->shm_generation, slot) && slot < SHM_SLOTS)
+                                        writer->slot_busy[slot] = false;
+                        }
+                }
+                wait = false;
+        }
+}
+
+static bool writer_create_ring(struct Ipc_frame_writer *writer, size_t size){
+        if(writer->shm_map)
+                munmap(writer->shm_map, writer->shm_slot_size * SHM_SLOTS);
+        if(writer->shm_fd != -1)
+                close(writer->shm_fd);
+        writer->shm_map = nullptr;
+
+        const size_t page = sysconf(_SC_PAGESIZE);
+        writer->shm_slot_size = (size + page - 1) / page * page;
+        writer->shm_fd = memfd_create("ug_ipc_frame", MFD_CLOEXEC);
+        if(writer->shm_fd == -1)
+                return false;
+        if(ftruncate(writer->shm_fd, writer->shm_slot_size * SHM_SLOTS) == -1)
+                return false;
+        void *map = mmap(nullptr, writer->shm_slot_size * SHM_SLOTS, PROT_READ | PROT_WRITE, MAP_SHARED, writer->shm_fd, 0);
+        if(map == MAP_FAILED)
+                return false;
+
+        writer->shm_map = static_cast<char *>(map);
+        writer->shm_generation += 1;
+        writer->shm_fd_sent = false;
+        for(auto &busy : writer->slot_busy)
+                busy = false;
+        return true;
+}
+
+/**
+ * @retval 1  frame was sent through shared memory
+ * @retval 0  shared memory not available, send through socket
+ * @retval -1 error
+ */
+static int writer_write_shm(struct Ipc_frame_writer *writer, const struct Ipc_frame *f,
+                std::array<char, IPC_FRAME_HEADER_LEN>& header){
+        if(!writer_process_msgs(writer, false))
+                return -1;
+        if(!writer->shm_supported || f->header.data_len <= 0)
+                return 0;
+
+        if((size_t) f->header.data_len > writer->shm_slot_size || !writer->shm_map){
+                if(!writer_create_ring(writer, f->header.data_len)){
+                        perror("ipc_frame shared memory");
+                        writer->shm_supported = false;
+                        return 0;
+                }
+        }
+
+        int slot = -1;
+        while(slot == -1){
+                for(int i = 0; i < SHM_SLOTS; i++){
+                        int candidate = (writer->next_slot + i) % SHM_SLOTS;
+                        if(!writer->slot_busy[candidate]){
+                                slot = candidate;
+                                break;
+                        }
+                }
+                if(slot == -1 && !writer_process_msgs(writer, true)) // all slots are being read
+                        return -1;
+        }
+        writer->next_slot = (slot + 1) % SHM_SLOTS;
+        writer->slot_busy[slot] = true;
+        memcpy(writer->shm_map + slot * writer->shm_slot_size, f->data, f->header.data_len);
+
+        shm_desc desc{ SHM_MAGIC, (uint32_t) slot, (uint32_t) writer->shm_slot_size, writer->shm_generation };
+        memcpy(header.data() + SHM_DESC_OFFSET, &desc, sizeof desc);
+
+        char cbuf[CMSG_SPACE(sizeof(int))];
+        struct iovec iov = { header.data(), header.size() };
+        struct msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        if(!writer->shm_fd_sent){
+                msg.msg_control = cbuf;
+                msg.msg_controllen = sizeof cbuf;
+                struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+                c->cmsg_level = SOL_SOCKET;
+                c->cmsg_type = SCM_RIGHTS;
+                c->cmsg_len = CMSG_LEN(sizeof(int));
+                memcpy(CMSG_DATA(c), &writer->shm_fd, sizeof(int));
+        }
+
+        ssize_t ret = sendmsg(writer->data_fd, &msg, MSG_NOSIGNAL);
+        if(ret != (ssize_t) header.size()){
+                return -1;
+        }
+        writer->shm_fd_sent = true;
+        return 1;
+}
+#endif
+
 bool ipc_frame_writer_write(struct Ipc_frame_writer *writer, const struct Ipc_frame *f){
         std::array<char, IPC_FRAME_HEADER_LEN> header;
 
         ipc_frame_write_header(&f->header, header.data());
 
+#ifdef IPC_FRAME_SHM
+        int shm_ret = writer_write_shm(writer, f, header);
+        if(shm_ret != 0)
+                return shm_ret == 1;
+#endif
+
         errno = 0;
         block_write(writer->data_fd, header.data(), header.size());
         block_write(writer->data_fd, f->data, f->header.data_len);
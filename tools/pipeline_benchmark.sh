@@ -0,0 +1,214 @@
+#!/bin/bash
+#
+# Benchmarks the whole UltraGrid pipeline on a single host - testcard capture,
+# compression, packetization, FEC, encryption, UDP over localhost, playout
+# buffer, FEC decoding, decompression and dummy display (or the loopback
+# video transport, which skips the network part entirely).
+#
+# Every combination of the given sizes, pixel formats, compressions, FEC and
+# encryption settings is run for a fixed time and the achieved frame rate,
+# per-thread CPU usage and latency percentiles (from --param frame-trace)
+# are reported as CSV or JSON, so that the results can be compared between
+# builds or deployment configurations.
+#
+
+set -eu
+
+UV=${UV:-$(dirname "$0")/../bin/uv}
+DURATION=10
+WARMUP=3
+FPS=120
+SIZES=1920x1080,3840x2160
+PIXFMTS=UYVY
+COMPRESSIONS=none
+FECS=none
+ENCRYPTIONS=none
+MODE=udp
+FORMAT=csv
+STAGES="compress tx network pbuf fec decompress display total"
+
+usage() {
+        cat <<EOF
+Usage:
+	$0 [-b <uv_binary>] [-d <sec>] [-w <sec>] [-r <fps>] [-s <sizes>] [-p <pix_fmts>]
+	   [-c <compressions>] [-f <fecs>] [-e <keys>] [-m udp|loopback] [-o csv|json]
+
+	-b  UltraGrid binary (default: \$UV or ../bin/uv relative to this script)
+	-d  measured duration of one run in seconds (default: $DURATION)
+	-w  warm-up time excluded from measurements in seconds (default: $WARMUP)
+	-r  testcard frame rate - upper bound of the measured one (default: $FPS)
+	-s  comma-separated list of sizes (default: $SIZES)
+	-p  comma-separated list of testcard pixel formats (default: $PIXFMTS)
+	-c  comma-separated list of -c arguments, "none" for uncompressed (default: $COMPRESSIONS)
+	-f  comma-separated list of video FEC (-f V:<fec>), "none" to disable (default: $FECS)
+	-e  comma-separated list of encryption keys, "none" to disable (default: $ENCRYPTIONS)
+	-m  udp - send to itself over 127.0.0.1 (default), loopback - use loopback video
+	    transport (no network, FEC nor encryption; uncompressed only)
+	-o  output format (default: $FORMAT)
+
+Example:
+	$0 -s 1920x1080,3840x2160 -c none,libavcodec:codec=H.264 -f none,rs:200:240 -e none,secret -o json
+EOF
+}
+
+while getopts "b:d:w:r:s:p:c:f:e:m:o:h" opt; do
+        case $opt in
+                b) UV=$OPTARG ;;
+                d) DURATION=$OPTARG ;;
+                w) WARMUP=$OPTARG ;;
+                r) FPS=$OPTARG ;;
+                s) SIZES=$OPTARG ;;
+                p) PIXFMTS=$OPTARG ;;
+                c) COMPRESSIONS=$OPTARG ;;
+                f) FECS=$OPTARG ;;
+                e) ENCRYPTIONS=$OPTARG ;;
+                m) MODE=$OPTARG ;;
+                o) FORMAT=$OPTARG ;;
+                h) usage; exit 0 ;;
+                *) usage >&2; exit 1 ;;
+        esac
+done
+
+if [ ! -x "$UV" ]; then
+        echo "UltraGrid binary $UV not found, use -b or set UV" >&2
+        exit 1
+fi
+if [ "$MODE" != udp ] && [ "$MODE" != loopback ]; then
+        echo "Wrong mode: $MODE" >&2
+        exit 1
+fi
+
+CLK_TCK=$(getconf CLK_TCK)
+LOG=$(mktemp)
+trap 'rm -f "$LOG"' EXIT
+
+## prints "<thread name>\t<utime + stime in ticks>" of all threads of given PID
+thread_cpu() {
+        for stat in /proc/"$1"/task/*/stat; do
+                # comm may contain spaces, take everything in the outermost parentheses
+                sed 's/^[0-9]* (\(.*\)) [^ ]* \(.*\)/\1\t\2/' "$stat" 2>/dev/null || true
+        done | awk -F'\t' '{ split($2, f, " "); ticks[$1] += f[11] + f[12] }
+                END { for (n in ticks) print n "\t" ticks[n] }'
+}
+
+## prints CPU usage in percent per thread name from samples $1 and $2
+cpu_delta() {
+        awk -F'\t' -v tck="$CLK_TCK" -v dur="$DURATION" '
+                NR == FNR { start[$1] = $2; next }
+                { pct = ($2 - start[$1]) / tck / dur * 100; if (pct >= 0.5) printf "%s\t%.1f\n", $1, pct }' \
+                <(echo "$1") <(echo "$2") | sort -t"$(printf '\t')" -k2 -rn
+}
+
+## average FPS reported by given module, the first (warm-up) report is skipped if there are more
+module_fps() {
+        sed 's/\x1b\[[0-9;]*m//g' "$LOG" | awk -v mod="[$1]" '
+                $1 == mod && $3 == "frames" { n++; fr[n] = $2; sec[n] = $5 }
+                END { f = 0; s = 0; for (i = (n > 1 ? 2 : 1); i <= n; i++) { f += fr[i]; s += sec[i] }
+                      if (s > 0) printf "%.2f", f / s; else printf "0" }'
+}
+
+## prints p50/p95/p99 [ms] of a stage from the last frame trace report, empty if not present
+stage_latency() {
+        sed 's/\x1b\[[0-9;]*m//g' "$LOG" | grep '^\[frame trace\]' | tail -n 1 |
+                awk -v stage="$1" '{ for (i = 1; i < NF; i++) if ($i == stage) print $(i + 1) }'
+}
+
+json_first=1
+print_header() {
+        if [ "$FORMAT" = csv ]; then
+                printf 'mode,size,pixfmt,compression,fec,encryption,target_fps,capture_fps,display_fps'
+                for s in $STAGES; do
+                        printf ',%s_p50_ms,%s_p95_ms,%s_p99_ms' "$s" "$s" "$s"
+                done
+                printf ',cpu_percent\n'
+        else
+                echo "["
+        fi
+}
+
+print_footer() {
+        if [ "$FORMAT" = json ]; then
+                printf '\n]\n'
+        fi
+}
+
+# $1 size, $2 pixfmt, $3 compression, $4 fec, $5 encryption, $6 CPU usage (name\tpct lines)
+print_result() {
+        local encryption=none
+        [ "$5" = none ] || encryption=yes
+        local capture_fps display_fps
+        capture_fps=$(module_fps testcard)
+        display_fps=$(module_fps dummy)
+        if [ "$FORMAT" = csv ]; then
+                printf '%s,%s,%s,"%s",%s,%s,%s,%s,%s' "$MODE" "$1" "$2" "$3" "$4" "$encryption" "$FPS" "$capture_fps" "$display_fps"
+                for s in $STAGES; do
+                        lat=$(stage_latency "$s")
+                        printf ',%s' "$(echo "${lat:-//}" | tr / ,)"
+                done
+                printf ',"%s"\n' "$(echo "$6" | awk -F'\t' 'NF == 2 { printf "%s%s=%s", sep, $1, $2; sep = ";" }')"
+        else
+                [ $json_first = 1 ] || printf ',\n'
+                json_first=0
+                printf '  { "mode": "%s", "size": "%s", "pixfmt": "%s", "compression": "%s", "fec": "%s", "encryption": "%s",\n' \
+                        "$MODE" "$1" "$2" "$3" "$4" "$encryption"
+                printf '    "target_fps": %s, "capture_fps": %s, "display_fps": %s,\n' "$FPS" "$capture_fps" "$display_fps"
+                printf '    "latency_ms": {'
+                local sep=""
+                for s in $STAGES; do
+                        lat=$(stage_latency "$s")
+                        [ -n "$lat" ] || continue
+                        printf '%s "%s": [%s]' "$sep" "$s" "$(echo "$lat" | tr / ,)"
+                        sep=","
+                done
+                printf ' },\n    "cpu_percent": {'
+                echo "$6" | awk -F'\t' 'NF == 2 { printf "%s \"%s\": %s", sep, $1, $2; sep = "," }'
+                printf ' } }'
+        fi
+}
+
+run_one() {
+        local args=(-t "testcard:size=$1:fps=$FPS:codec=$2" -d dummy --param frame-trace)
+        [ "$3" = none ] || args+=(-c "$3")
+        if [ "$MODE" = loopback ]; then
+                args+=(--video-protocol loopback)
+        else
+                [ "$4" = none ] || args+=(-f "V:$4")
+                [ "$5" = none ] || args+=(--encryption "$5")
+                args+=(127.0.0.1)
+        fi
+
+        "$UV" "${args[@]}" </dev/null >"$LOG" 2>&1 &
+        local pid=$!
+        sleep "$WARMUP"
+        local cpu_start cpu_end
+        cpu_start=$(thread_cpu $pid)
+        sleep "$DURATION"
+        cpu_end=$(thread_cpu $pid)
+        kill -INT $pid 2>/dev/null || true
+        wait $pid || true
+
+        if [ -z "$cpu_end" ]; then
+                echo "Run with $* terminated prematurely, log:" >&2
+                cat "$LOG" >&2
+        fi
+        print_result "$@" "$(cpu_delta "$cpu_start" "$cpu_end")"
+}
+
+print_header
+IFS=, read -r -a sizes <<< "$SIZES"
+IFS=, read -r -a pixfmts <<< "$PIXFMTS"
+IFS=, read -r -a compressions <<< "$COMPRESSIONS"
+IFS=, read -r -a fecs <<< "$FECS"
+IFS=, read -r -a encryptions <<< "$ENCRYPTIONS"
+for size in "${sizes[@]}"; do
+        for pixfmt in "${pixfmts[@]}"; do
+                for compression in "${compressions[@]}"; do
+                        for fec in "${fecs[@]}"; do
+                                for encryption in "${encryptions[@]}"; do
+                                        run_one "$size" "$pixfmt" "$compression" "$fec" "$encryption"
+                                done
+                        done
+                done
+        done
+done
+print_footer